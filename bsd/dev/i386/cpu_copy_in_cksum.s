@@ -42,6 +42,15 @@
  *	in a 32-bit variable (without 1's complement); caller is
  *	responsible for folding the 32-bit sum into 16-bit and
  *	performing the 1's complement if applicable
+ *
+ *  Runs shorter than 64 bytes (mostly protocol headers) are done with
+ *  integer registers only, since saving and restoring the vector
+ *  registers would cost more than the copy itself.  In the kernel, runs
+ *  of at least 256 bytes go through an AVX2 loop first when
+ *  os_cpu_copy_in_cksum_avx2 has been set at boot (see cpu_in_cksum_gen.c).
+ *  That loop saves ymm0-ymm7 with VEX-encoded moves, which zero bits
+ *  511:256 of the zmm registers on restore, so the flag is never set
+ *  when AVX-512 state is enabled.
  */
 
 #define LITTLE_ENDIAN	1
@@ -105,6 +114,7 @@ _os_cpu_copy_in_cksum:
 	push	%rbp
 	movq	%rsp, %rbp
 
+	mov	%edx, %edx	// zero-extend len
 	mov	$0, partial	// partial = 0;
 	mov	$0, need_swap	// needs_swap = 0;
 
@@ -137,7 +147,85 @@ _os_cpu_copy_in_cksum:
 	jz	L_len_0
 1:
 
+	/* short runs don't pay for saving the vector registers */
+	cmp	$4*16, len
+	jb	L_scalar
+
 #ifdef KERNEL
+	cmp	$16*16, len
+	jb	L_sse
+	cmpl	$0, _os_cpu_copy_in_cksum_avx2(%rip)
+	je	L_sse
+
+	/* allocate stack space and save ymm0-ymm7 */
+	sub	$8*32, %rsp
+	vmovdqu	%ymm0, 0*32(%rsp)
+	vmovdqu	%ymm1, 1*32(%rsp)
+	vmovdqu	%ymm2, 2*32(%rsp)
+	vmovdqu	%ymm3, 3*32(%rsp)
+	vmovdqu	%ymm4, 4*32(%rsp)
+	vmovdqu	%ymm5, 5*32(%rsp)
+	vmovdqu	%ymm6, 6*32(%rsp)
+	vmovdqu	%ymm7, 7*32(%rsp)
+
+	/*
+	 * copy 64 bytes per iteration, accumulating the even/odd 32-bit
+	 * words into the 64-bit lanes of ymm0-ymm3; t counts down the
+	 * 64-byte blocks, and what's left (< 64 bytes) goes to L_scalar
+	 */
+	vpxor	%ymm0, %ymm0, %ymm0
+	vpxor	%ymm1, %ymm1, %ymm1
+	vpxor	%ymm2, %ymm2, %ymm2
+	vpxor	%ymm3, %ymm3, %ymm3
+	vpbroadcastq	Lmask, %ymm7
+	mov	len, t
+	and	$~(4*16 - 1), t
+	sub	t, len
+
+L64_avx2_loop:
+	vmovdqu	0*32(src), %ymm4
+	vmovdqu	1*32(src), %ymm5
+	add	$4*16, src
+	vmovdqu	%ymm4, 0*32(dst)
+	vmovdqu	%ymm5, 1*32(dst)
+	add	$4*16, dst
+
+	vpand	%ymm7, %ymm4, %ymm6
+	vpsrlq	$32, %ymm4, %ymm4
+	vpaddq	%ymm6, %ymm0, %ymm0
+	vpaddq	%ymm4, %ymm1, %ymm1
+	vpand	%ymm7, %ymm5, %ymm6
+	vpsrlq	$32, %ymm5, %ymm5
+	vpaddq	%ymm6, %ymm2, %ymm2
+	vpaddq	%ymm5, %ymm3, %ymm3
+
+	sub	$4*16, t
+	ja	L64_avx2_loop
+
+	/* fold the 16 lanes into partial */
+	vpaddq	%ymm1, %ymm0, %ymm0
+	vpaddq	%ymm3, %ymm2, %ymm2
+	vpaddq	%ymm2, %ymm0, %ymm0
+	vextracti128	$1, %ymm0, %xmm1
+	vpaddq	%xmm1, %xmm0, %xmm0
+	vmovq	%xmm0, %rax
+	vpextrq	$1, %xmm0, t
+	add	%rax, partial
+	add	t, partial
+
+	/* restore ymm0-ymm7 and deallocate stack space */
+	vmovdqu	0*32(%rsp), %ymm0
+	vmovdqu	1*32(%rsp), %ymm1
+	vmovdqu	2*32(%rsp), %ymm2
+	vmovdqu	3*32(%rsp), %ymm3
+	vmovdqu	4*32(%rsp), %ymm4
+	vmovdqu	5*32(%rsp), %ymm5
+	vmovdqu	6*32(%rsp), %ymm6
+	vmovdqu	7*32(%rsp), %ymm7
+	add	$8*32, %rsp
+	jmp	L_scalar
+
+L_sse:
 	/* allocate stack space and save xmm0-xmm15 */
 	sub	$16*16, %rsp
 	movdqa	v0, 0*16(%rsp)
@@ -487,6 +575,7 @@ L8_bytes:
 	add	$16*16, %rsp
 #endif
 
+L_scalar:
 	sub	$4, len
 	jl	L2_bytes
 0:
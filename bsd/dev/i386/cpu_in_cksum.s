@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  extern uint64_t os_cpu_in_cksum_sse2(const void *data, uint32_t len);
+ *  extern uint64_t os_cpu_in_cksum_avx2(const void *data, uint32_t len);
+ *
+ *  input :
+ *      data : starting address, 4-byte aligned
+ *      len : byte stream length, a non-zero multiple of 64
+ *
+ *  output :
+ *      the function returns the sum of the 32-bit words of the byte
+ *	stream in a 64-bit variable (deferred carries); the caller is
+ *	responsible for adding it into its own accumulator and folding
+ *	the result.  Since every 64-bit lane gathers at most len / 16
+ *	words, no lane can overflow for any length below 4GB.
+ *
+ *  These are the block kernels used by os_cpu_in_cksum_mbuf() for long
+ *  runs; alignment, odd bytes and byte swapping are all handled by the
+ *  caller, which keeps the vector code down to a load/add loop.
+ *
+ *  The kernel AVX2 kernel saves ymm0-ymm7 with VEX-encoded moves, which
+ *  zero bits 511:256 of the corresponding zmm registers on restore, so
+ *  it must not be selected when AVX-512 state is enabled.
+ */
+
+	.const
+	.align	4
+
+/*
+ * a vector v = w3 : w2 : w1 : w0 will be using the following mask to
+ * extract 0 : w2 : 0 : w0
+ * then shift right quadword 32-bit to get 0 : w3 : 0 : w1
+ */
+L_mask:
+	.quad	0x00000000ffffffff
+	.quad	0x00000000ffffffff
+
+#define Lmask	L_mask(%rip)
+
+#define	src		%rdi
+#define	len		%rsi
+
+	.globl	_os_cpu_in_cksum_sse2
+	.text
+	.align	4
+_os_cpu_in_cksum_sse2:
+	push	%rbp
+	movq	%rsp, %rbp
+
+	mov	%esi, %esi	// zero-extend len
+
+#ifdef KERNEL
+	/* allocate stack space and save xmm0-xmm5 */
+	sub	$6*16, %rsp
+	movdqa	%xmm0, 0*16(%rsp)
+	movdqa	%xmm1, 1*16(%rsp)
+	movdqa	%xmm2, 2*16(%rsp)
+	movdqa	%xmm3, 3*16(%rsp)
+	movdqa	%xmm4, 4*16(%rsp)
+	movdqa	%xmm5, 5*16(%rsp)
+#endif
+
+	/*
+	 * xmm0/xmm1 accumulate the even/odd 32-bit words of every vector
+	 * into 2 x 64-bit lanes each; xmm5 holds the even word mask
+	 */
+	pxor	%xmm0, %xmm0
+	pxor	%xmm1, %xmm1
+	movdqa	Lmask, %xmm5
+
+L64_sse2_loop:
+	movdqu	0*16(src), %xmm2
+	movdqu	1*16(src), %xmm3
+	movdqa	%xmm2, %xmm4
+	pand	%xmm5, %xmm2
+	psrlq	$32, %xmm4
+	paddq	%xmm2, %xmm0
+	paddq	%xmm4, %xmm1
+	movdqa	%xmm3, %xmm4
+	pand	%xmm5, %xmm3
+	psrlq	$32, %xmm4
+	paddq	%xmm3, %xmm0
+	paddq	%xmm4, %xmm1
+
+	movdqu	2*16(src), %xmm2
+	movdqu	3*16(src), %xmm3
+	movdqa	%xmm2, %xmm4
+	pand	%xmm5, %xmm2
+	psrlq	$32, %xmm4
+	paddq	%xmm2, %xmm0
+	paddq	%xmm4, %xmm1
+	movdqa	%xmm3, %xmm4
+	pand	%xmm5, %xmm3
+	psrlq	$32, %xmm4
+	paddq	%xmm3, %xmm0
+	paddq	%xmm4, %xmm1
+
+	add	$4*16, src
+	sub	$4*16, len
+	ja	L64_sse2_loop
+
+	/* fold the 4 lanes into rax */
+	paddq	%xmm1, %xmm0
+	movq	%xmm0, %rax
+	psrldq	$8, %xmm0
+	movq	%xmm0, %rdx
+	add	%rdx, %rax
+
+#ifdef KERNEL
+	/* restore xmm0-xmm5 and deallocate stack space */
+	movdqa	0*16(%rsp), %xmm0
+	movdqa	1*16(%rsp), %xmm1
+	movdqa	2*16(%rsp), %xmm2
+	movdqa	3*16(%rsp), %xmm3
+	movdqa	4*16(%rsp), %xmm4
+	movdqa	5*16(%rsp), %xmm5
+	add	$6*16, %rsp
+#endif
+
+	pop	%rbp
+	ret
+
+	.globl	_os_cpu_in_cksum_avx2
+	.text
+	.align	4
+_os_cpu_in_cksum_avx2:
+	push	%rbp
+	movq	%rsp, %rbp
+
+	mov	%esi, %esi	// zero-extend len
+
+#ifdef KERNEL
+	/* allocate stack space and save ymm0-ymm7 */
+	sub	$8*32, %rsp
+	vmovdqu	%ymm0, 0*32(%rsp)
+	vmovdqu	%ymm1, 1*32(%rsp)
+	vmovdqu	%ymm2, 2*32(%rsp)
+	vmovdqu	%ymm3, 3*32(%rsp)
+	vmovdqu	%ymm4, 4*32(%rsp)
+	vmovdqu	%ymm5, 5*32(%rsp)
+	vmovdqu	%ymm6, 6*32(%rsp)
+	vmovdqu	%ymm7, 7*32(%rsp)
+#endif
+
+	/*
+	 * vpmovzxdq widens 4 x 32-bit words into 4 x 64-bit lanes as part
+	 * of the load, so each 64-byte block takes 4 loads and 4 adds into
+	 * the independent accumulators ymm0-ymm3
+	 */
+	vpxor	%ymm0, %ymm0, %ymm0
+	vpxor	%ymm1, %ymm1, %ymm1
+	vpxor	%ymm2, %ymm2, %ymm2
+	vpxor	%ymm3, %ymm3, %ymm3
+
+L64_avx2_loop:
+	vpmovzxdq	0*16(src), %ymm4
+	vpmovzxdq	1*16(src), %ymm5
+	vpmovzxdq	2*16(src), %ymm6
+	vpmovzxdq	3*16(src), %ymm7
+	vpaddq	%ymm4, %ymm0, %ymm0
+	vpaddq	%ymm5, %ymm1, %ymm1
+	vpaddq	%ymm6, %ymm2, %ymm2
+	vpaddq	%ymm7, %ymm3, %ymm3
+
+	add	$4*16, src
+	sub	$4*16, len
+	ja	L64_avx2_loop
+
+	/* fold the 16 lanes into rax */
+	vpaddq	%ymm1, %ymm0, %ymm0
+	vpaddq	%ymm3, %ymm2, %ymm2
+	vpaddq	%ymm2, %ymm0, %ymm0
+	vextracti128	$1, %ymm0, %xmm1
+	vpaddq	%xmm1, %xmm0, %xmm0
+	vmovq	%xmm0, %rax
+	vpextrq	$1, %xmm0, %rdx
+	add	%rdx, %rax
+
+#ifdef KERNEL
+	/* restore ymm0-ymm7 and deallocate stack space */
+	vmovdqu	0*32(%rsp), %ymm0
+	vmovdqu	1*32(%rsp), %ymm1
+	vmovdqu	2*32(%rsp), %ymm2
+	vmovdqu	3*32(%rsp), %ymm3
+	vmovdqu	4*32(%rsp), %ymm4
+	vmovdqu	5*32(%rsp), %ymm5
+	vmovdqu	6*32(%rsp), %ymm6
+	vmovdqu	7*32(%rsp), %ymm7
+	add	$8*32, %rsp
+#else
+	vzeroupper
+#endif
+
+	pop	%rbp
+	ret
@@ -72,6 +72,13 @@ UNUSED_SYMBOL(decmpfs_validate_compressed_file)
 #include <libkern/OSByteOrder.h>
 #include <libkern/section_keywords.h>
 #include <sys/fsctl.h>
+#include <sys/sysctl.h>
+#include <kern/clock.h>
+#include <kern/thread.h>
+
+#if CONFIG_IO_COMPRESSION_STATS
+#include <vfs/vfs_io_compression_stats.h>
+#endif /* CONFIG_IO_COMPRESSION_STATS */
 
 #include <ptrauth.h>
 
@@ -1216,6 +1223,280 @@ out:
 	return err;
 }
 
+#pragma mark --- parallel decompression ---
+
+/*
+ *  A large fetch that spans several compression chunks is split at chunk
+ *  boundaries and the pieces are decompressed concurrently by a small pool of
+ *  worker threads, each writing straight into its slice of the caller's buffer.
+ *  The caller runs the first piece itself and takes back any piece no worker
+ *  has picked up yet, so the pool never makes a fetch slower than doing it serially.
+ *
+ *  Chunk boundaries are found by asking the compressor's adjust_fetch callout
+ *  where the chunk containing a given offset starts; compressors that don't
+ *  provide one are always fetched serially.
+ */
+
+#define DECMPFS_PAR_THREADS     4
+#define DECMPFS_PAR_MAX_PIECES  (DECMPFS_PAR_THREADS + 1)
+#define DECMPFS_PAR_MIN_PIECE   (64 * 1024)
+
+SYSCTL_DECL(_vfs_generic);
+
+static int decmpfs_parallel_min_size = 256 * 1024;
+SYSCTL_INT(_vfs_generic, OID_AUTO, decmpfs_parallel_min_size, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &decmpfs_parallel_min_size, 0, "smallest decmpfs fetch split across decompression workers (0 disables)");
+
+struct decmpfs_par_fetch;
+
+struct decmpfs_par_piece {
+	TAILQ_ENTRY(decmpfs_par_piece) dp_link;
+	struct decmpfs_par_fetch *dp_fetch;
+	off_t                   dp_offset;
+	decmpfs_vector          dp_vec;
+	uint64_t                dp_did_read;
+	int                     dp_err;
+	bool                    dp_queued;      /* on decmpfs_par_queue, not yet picked up */
+};
+
+struct decmpfs_par_fetch {
+	vnode_t                 df_vp;
+	decmpfs_cnode           *df_cp;
+	decmpfs_header          *df_hdr;
+	int                     df_pending;     /* pieces handed to the pool and not yet finished */
+	int                     df_npieces;
+	struct decmpfs_par_piece df_pieces[DECMPFS_PAR_MAX_PIECES];
+};
+
+static LCK_MTX_DECLARE(decmpfs_par_lock, &decmpfs_lockgrp);
+static TAILQ_HEAD(, decmpfs_par_piece) decmpfs_par_queue = TAILQ_HEAD_INITIALIZER(decmpfs_par_queue);
+static int decmpfs_par_threads_started = 0;
+
+static void
+decmpfs_par_run(struct decmpfs_par_piece *dp)
+{
+	struct decmpfs_par_fetch *df = dp->dp_fetch;
+
+	dp->dp_err = decmpfs_fetch_uncompressed_data(df->df_vp, df->df_cp, df->df_hdr,
+	    dp->dp_offset, dp->dp_vec.size, 1, &dp->dp_vec, &dp->dp_did_read);
+}
+
+static void
+decmpfs_par_thread(__unused void *arg, __unused wait_result_t wr)
+{
+	struct decmpfs_par_piece *dp;
+	struct decmpfs_par_fetch *df;
+
+	lck_mtx_lock(&decmpfs_par_lock);
+	for (;;) {
+		dp = TAILQ_FIRST(&decmpfs_par_queue);
+		if (dp == NULL) {
+			msleep(&decmpfs_par_queue, &decmpfs_par_lock, PVFS, "decmpfs_par", NULL);
+			continue;
+		}
+		TAILQ_REMOVE(&decmpfs_par_queue, dp, dp_link);
+		dp->dp_queued = false;
+		lck_mtx_unlock(&decmpfs_par_lock);
+
+		decmpfs_par_run(dp);
+
+		lck_mtx_lock(&decmpfs_par_lock);
+		df = dp->dp_fetch;
+		if (--df->df_pending == 0) {
+			wakeup(df);
+		}
+	}
+}
+
+static void
+decmpfs_par_start_threads(void)
+{
+	thread_t thread;
+	int i;
+
+	lck_mtx_lock(&decmpfs_par_lock);
+	if (decmpfs_par_threads_started) {
+		lck_mtx_unlock(&decmpfs_par_lock);
+		return;
+	}
+	decmpfs_par_threads_started = 1;
+	lck_mtx_unlock(&decmpfs_par_lock);
+
+	for (i = 0; i < DECMPFS_PAR_THREADS; i++) {
+		if (kernel_thread_start(decmpfs_par_thread, NULL, &thread) == KERN_SUCCESS) {
+			thread_deallocate(thread);
+		}
+	}
+}
+
+static int
+decmpfs_par_split(struct decmpfs_par_fetch *df, off_t offset, user_ssize_t size, decmpfs_vector *vec)
+{
+	/* carve [offset, offset + size) into pieces that start on chunk boundaries; returns the number of pieces */
+
+	vnode_t vp = df->df_vp;
+	decmpfs_header *hdr = df->df_hdr;
+	off_t start = offset;
+	off_t end;
+	int npieces = 0;
+	int want;
+	int i;
+
+	if (decmpfs_parallel_min_size <= 0 || offset < 0 || offset >= (off_t)hdr->uncompressed_size) {
+		return 0;
+	}
+	size = MIN(size, vec->size);
+	if (hdr->uncompressed_size - offset < size) {
+		size = (user_ssize_t)(hdr->uncompressed_size - offset);
+	}
+	if (size < decmpfs_parallel_min_size) {
+		return 0;
+	}
+	end = offset + size;
+	want = (int)MIN(DECMPFS_PAR_MAX_PIECES, size / DECMPFS_PAR_MIN_PIECE);
+
+	lck_rw_lock_shared(&decompressorsLock);
+	decmpfs_adjust_fetch_region_func adjust_fetch = decmp_get_func(vp, hdr->compression_type, adjust_fetch);
+	if (adjust_fetch == NULL) {
+		lck_rw_unlock_shared(&decompressorsLock);
+		return 0;
+	}
+	for (i = 1; i < want; i++) {
+		off_t boundary = offset + (off_t)((size * i) / want);
+		user_ssize_t probe = PAGE_SIZE;
+
+		/* the adjusted region starts at the beginning of the chunk holding boundary */
+		adjust_fetch(vp, decmpfs_ctx, hdr, &boundary, &probe);
+		if (boundary & PAGE_MASK) {
+			continue;
+		}
+		if (boundary - start < DECMPFS_PAR_MIN_PIECE || end - boundary < DECMPFS_PAR_MIN_PIECE) {
+			continue;
+		}
+		df->df_pieces[npieces].dp_offset = start;
+		df->df_pieces[npieces].dp_vec.size = (user_ssize_t)(boundary - start);
+		npieces++;
+		start = boundary;
+	}
+	lck_rw_unlock_shared(&decompressorsLock);
+
+	df->df_pieces[npieces].dp_offset = start;
+	df->df_pieces[npieces].dp_vec.size = (user_ssize_t)(end - start);
+	npieces++;
+
+	for (i = 0; i < npieces; i++) {
+		struct decmpfs_par_piece *dp = &df->df_pieces[i];
+
+		dp->dp_fetch = df;
+		dp->dp_vec.buf = (char *)vec->buf + (dp->dp_offset - offset);
+		dp->dp_did_read = 0;
+		dp->dp_err = 0;
+		dp->dp_queued = false;
+	}
+	return npieces;
+}
+
+static int
+decmpfs_fetch_uncompressed_data_parallel(vnode_t vp, decmpfs_cnode *cp, decmpfs_header *hdr, off_t offset, user_ssize_t size, decmpfs_vector *vec, uint64_t *bytes_read)
+{
+	/* same as a single-vector decmpfs_fetch_uncompressed_data, but decompresses independent chunks concurrently */
+
+	struct decmpfs_par_fetch *df;
+	struct decmpfs_par_piece *dp;
+	uint64_t start_time = mach_absolute_time();
+	int npieces = 0;
+	int err = 0;
+	int i;
+
+	*bytes_read = 0;
+
+	if (decmpfs_parallel_min_size <= 0 || size < decmpfs_parallel_min_size) {
+		err = decmpfs_fetch_uncompressed_data(vp, cp, hdr, offset, size, 1, vec, bytes_read);
+		npieces = 1;
+		goto out;
+	}
+
+	df = kalloc_type(struct decmpfs_par_fetch, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	df->df_vp = vp;
+	df->df_cp = cp;
+	df->df_hdr = hdr;
+	npieces = decmpfs_par_split(df, offset, size, vec);
+
+	if (npieces <= 1) {
+		kfree_type(struct decmpfs_par_fetch, df);
+		err = decmpfs_fetch_uncompressed_data(vp, cp, hdr, offset, size, 1, vec, bytes_read);
+		npieces = 1;
+		goto out;
+	}
+
+	if (!decmpfs_par_threads_started) {
+		decmpfs_par_start_threads();
+	}
+
+	df->df_npieces = npieces;
+	lck_mtx_lock(&decmpfs_par_lock);
+	for (i = 1; i < npieces; i++) {
+		dp = &df->df_pieces[i];
+		dp->dp_queued = true;
+		TAILQ_INSERT_TAIL(&decmpfs_par_queue, dp, dp_link);
+	}
+	df->df_pending = npieces - 1;
+	lck_mtx_unlock(&decmpfs_par_lock);
+	wakeup(&decmpfs_par_queue);
+
+	decmpfs_par_run(&df->df_pieces[0]);
+
+	/* take back whatever the workers haven't started, then wait for the rest */
+	lck_mtx_lock(&decmpfs_par_lock);
+	for (i = 1; i < npieces; i++) {
+		dp = &df->df_pieces[i];
+		if (!dp->dp_queued) {
+			continue;
+		}
+		TAILQ_REMOVE(&decmpfs_par_queue, dp, dp_link);
+		dp->dp_queued = false;
+		lck_mtx_unlock(&decmpfs_par_lock);
+
+		decmpfs_par_run(dp);
+
+		lck_mtx_lock(&decmpfs_par_lock);
+		df->df_pending--;
+	}
+	while (df->df_pending > 0) {
+		msleep(df, &decmpfs_par_lock, PVFS, "decmpfs_par_wait", NULL);
+	}
+	lck_mtx_unlock(&decmpfs_par_lock);
+
+	/* only the contiguous prefix of the pieces counts as read */
+	for (i = 0; i < npieces; i++) {
+		dp = &df->df_pieces[i];
+		if (err == 0 && dp->dp_err != 0) {
+			err = dp->dp_err;
+		}
+		if (err != 0) {
+			continue;
+		}
+		*bytes_read += dp->dp_did_read;
+		if (dp->dp_did_read < (uint64_t)dp->dp_vec.size) {
+			break;
+		}
+	}
+	kfree_type(struct decmpfs_par_fetch, df);
+
+out:
+#if CONFIG_IO_COMPRESSION_STATS
+	if (err == 0) {
+		uint64_t elapsed_ns;
+
+		absolutetime_to_nanoseconds(mach_absolute_time() - start_time, &elapsed_ns);
+		io_compression_stats_decmpfs_fetch(*bytes_read, (uint32_t)npieces, elapsed_ns);
+	}
+#else
+	(void)start_time;
+#endif /* CONFIG_IO_COMPRESSION_STATS */
+	return err;
+}
+
 static kern_return_t
 commit_upl(upl_t upl, upl_offset_t pl_offset, size_t uplSize, int flags, int abort)
 {
@@ -1405,7 +1686,7 @@ decompress:
 		err = 0;
 	} else {
 		if (verify_block_size <= PAGE_SIZE) {
-			err = decmpfs_fetch_uncompressed_data(vp, cp, hdr, uplPos, uplSize, 1, &vec, &did_read);
+			err = decmpfs_fetch_uncompressed_data_parallel(vp, cp, hdr, uplPos, uplSize, &vec, &did_read);
 			/* zero out whatever wasn't read */
 			if (did_read < rounded_uplSize) {
 				memset((char*)vec.buf + did_read, 0, (size_t)(rounded_uplSize - did_read));
@@ -1796,7 +2077,7 @@ decmpfs_read_compressed(struct vnop_read_args *ap, int *is_compressed, decmpfs_c
 		decmpfs_vector vec;
 decompress:
 		vec = (decmpfs_vector){ .buf = data, .size = curUplSize };
-		err = decmpfs_fetch_uncompressed_data(vp, cp, hdr, curUplPos, curUplSize, 1, &vec, &did_read);
+		err = decmpfs_fetch_uncompressed_data_parallel(vp, cp, hdr, curUplPos, curUplSize, &vec, &did_read);
 		if (err) {
 			ErrorLogWithPath("decmpfs_fetch_uncompressed_data err %d\n", err);
 
@@ -44,6 +44,7 @@
 #include <kern/task.h>
 #include <kern/debug.h>
 #include <kern/kalloc.h>
+#include <kern/percpu.h>
 #include <kern/telemetry.h>
 #include <kern/sched_prim.h>
 #include <sys/lock.h>
@@ -593,6 +594,186 @@ _should_emit_debugid(kdebug_emit_filter_t emit, uint32_t debugid)
 	}
 }
 
+#pragma mark - Sampling and rate limits
+
+// Rules are only changed while tracing is disabled, under the ktrace lock.
+// `kd_ratefilter` has a bit set for each class and subclass some rule covers,
+// so events outside of them only pay for a flag and a bit test.
+static kd_rate_rule kd_rate_rules[KDBG_RATE_RULES_MAX];
+static uint32_t kd_rate_rule_count;
+static uint8_t kd_ratefilter[KDBG_TYPEFILTER_BITMAP_SIZE];
+
+// Generic cell rate algorithm: the bucket is the theoretical arrival time of
+// the next event, which is a single word to update for each event.
+static struct kd_rate_bucket {
+	uint64_t krb_tat;
+	uint64_t krb_interval;
+	uint64_t krb_tolerance;
+} kd_rate_buckets[KDBG_RATE_RULES_MAX];
+
+struct kd_rate_counts {
+	uint64_t krc_matched[KDBG_RATE_RULES_MAX];
+	uint64_t krc_sampled_out[KDBG_RATE_RULES_MAX];
+	uint64_t krc_rate_limited[KDBG_RATE_RULES_MAX];
+};
+static struct kd_rate_counts PERCPU_DATA(kd_rate_counts);
+
+static bool
+_rate_bucket_take(struct kd_rate_bucket *bucket, uint64_t now)
+{
+	uint64_t tat, next;
+
+	return os_atomic_rmw_loop(&bucket->krb_tat, tat, next, relaxed, {
+		if (tat > now + bucket->krb_tolerance) {
+		        os_atomic_rmw_loop_give_up(return false);
+		}
+		next = MAX(tat, now) + bucket->krb_interval;
+	});
+}
+
+__attribute__((noinline))
+static bool
+_rate_allows_debugid_slow(uint32_t debugid)
+{
+	struct kd_rate_counts *counts;
+	kd_rate_rule *rule = NULL;
+	bool allowed = true;
+	uint32_t i;
+
+	for (i = 0; i < kd_rate_rule_count; i++) {
+		if (((debugid ^ kd_rate_rules[i].kdr_debugid) &
+		    kd_rate_rules[i].kdr_mask) == 0) {
+			rule = &kd_rate_rules[i];
+			break;
+		}
+	}
+	if (rule == NULL) {
+		return true;
+	}
+
+	disable_preemption();
+	counts = PERCPU_GET(kd_rate_counts);
+	uint64_t matched = os_atomic_inc(&counts->krc_matched[i], relaxed);
+	if (rule->kdr_sample > 1 && matched % rule->kdr_sample != 0) {
+		os_atomic_inc(&counts->krc_sampled_out[i], relaxed);
+		allowed = false;
+	} else if (rule->kdr_rate != 0 &&
+	    !_rate_bucket_take(&kd_rate_buckets[i], mach_absolute_time())) {
+		os_atomic_inc(&counts->krc_rate_limited[i], relaxed);
+		allowed = false;
+	}
+	enable_preemption();
+
+	return allowed;
+}
+
+static inline bool
+_rate_allows_debugid(uint32_t debugid)
+{
+	if (__probable(!(kd_control_trace.kdc_flags & KDBG_RATE_CHECK)) ||
+	    !isset(kd_ratefilter, KDBG_EXTRACT_CSC(debugid))) {
+		return true;
+	}
+	return _rate_allows_debugid_slow(debugid);
+}
+
+static void
+_rate_rules_clear(void)
+{
+	kd_control_trace.kdc_flags &= ~KDBG_RATE_CHECK;
+	kd_rate_rule_count = 0;
+	memset(kd_rate_rules, 0, sizeof(kd_rate_rules));
+	memset(kd_rate_buckets, 0, sizeof(kd_rate_buckets));
+	memset(kd_ratefilter, 0, sizeof(kd_ratefilter));
+	percpu_foreach(counts, kd_rate_counts) {
+		memset(counts, 0, sizeof(*counts));
+	}
+}
+
+static int
+_copyin_rate_rules(user_addr_t uaddr, size_t usize)
+{
+	kd_rate_rule rules[KDBG_RATE_RULES_MAX];
+	uint32_t count = (uint32_t)(usize / sizeof(kd_rate_rule));
+
+	if (usize % sizeof(kd_rate_rule) != 0 || count > KDBG_RATE_RULES_MAX) {
+		return EINVAL;
+	}
+	if (kdebug_enable) {
+		return EBUSY;
+	}
+	int ret = copyin(uaddr, rules, usize);
+	if (ret != 0) {
+		return ret;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		if ((rules[i].kdr_mask & KDBG_CLASS_MASK) != KDBG_CLASS_MASK ||
+		    KDBG_EXTRACT_CLASS(rules[i].kdr_debugid) == DBG_TRACE ||
+		    rules[i].kdr_rate > NSEC_PER_SEC) {
+			return EINVAL;
+		}
+	}
+
+	_rate_rules_clear();
+	for (uint32_t i = 0; i < count; i++) {
+		kd_rate_rule *rule = &kd_rate_rules[i];
+		struct kd_rate_bucket *bucket = &kd_rate_buckets[i];
+
+		*rule = rules[i];
+		rule->kdr_debugid &= rule->kdr_mask;
+		rule->kdr_matched = 0;
+		rule->kdr_sampled_out = 0;
+		rule->kdr_rate_limited = 0;
+
+		if (rule->kdr_rate != 0) {
+			nanoseconds_to_absolutetime(NSEC_PER_SEC / rule->kdr_rate,
+			    &bucket->krb_interval);
+			bucket->krb_tolerance = bucket->krb_interval *
+			    (MAX(rule->kdr_burst, 1) - 1);
+		}
+
+		uint32_t csc = KDBG_EXTRACT_CSC(rule->kdr_debugid);
+		if ((rule->kdr_mask & KDBG_CSC_MASK) == KDBG_CSC_MASK) {
+			setbit(kd_ratefilter, csc);
+		} else {
+			for (uint32_t sc = 0; sc < 256; sc++) {
+				setbit(kd_ratefilter, (csc & 0xff00) | sc);
+			}
+		}
+	}
+	kd_rate_rule_count = count;
+	if (count != 0) {
+		kd_control_trace.kdc_flags |= KDBG_RATE_CHECK;
+	}
+	return 0;
+}
+
+static int
+_copyout_rate_rules(user_addr_t uaddr, size_t *usize)
+{
+	kd_rate_rule rules[KDBG_RATE_RULES_MAX];
+	size_t size = kd_rate_rule_count * sizeof(kd_rate_rule);
+
+	if (uaddr == USER_ADDR_NULL) {
+		*usize = size;
+		return 0;
+	}
+	if (*usize < size) {
+		return ERANGE;
+	}
+
+	memcpy(rules, kd_rate_rules, size);
+	percpu_foreach(counts, kd_rate_counts) {
+		for (uint32_t i = 0; i < kd_rate_rule_count; i++) {
+			rules[i].kdr_matched += os_atomic_load(&counts->krc_matched[i], relaxed);
+			rules[i].kdr_sampled_out += os_atomic_load(&counts->krc_sampled_out[i], relaxed);
+			rules[i].kdr_rate_limited += os_atomic_load(&counts->krc_rate_limited[i], relaxed);
+		}
+	}
+	*usize = size;
+	return copyout(rules, uaddr, size);
+}
+
 static void
 _try_wakeup_above_threshold(uint32_t debugid)
 {
@@ -636,7 +817,7 @@ kernel_debug_enter(
 	if (!emit || !kdebug_enable) {
 		return;
 	}
-	if (!_should_emit_debugid(emit, debugid)) {
+	if (!_should_emit_debugid(emit, debugid) || !_rate_allows_debugid(debugid)) {
 		return;
 	}
 
@@ -715,6 +896,9 @@ kdebug_emit_internal(kdebug_emit_filter_t emit,
 	    !kdebug_debugid_procfilt_allowed(debugid)) {
 		return;
 	}
+	if (!_rate_allows_debugid(debugid)) {
+		return;
+	}
 
 	struct kd_record kd_rec = {
 		.cpu = -1,
@@ -1552,6 +1736,8 @@ kdbg_clear(void)
 	kd_control_trace.kdc_flags &= ~KDBG_CONTINUOUS_TIME;
 	kd_control_trace.kdc_flags &= ~KDBG_DISABLE_COPROCS;
 	kd_control_trace.kdc_flags &= ~KDBG_MATCH_DISABLE;
+	kd_control_trace.kdc_flags &= ~KDBG_MAPPED;
+	_rate_rules_clear();
 	kd_control_trace.kdc_live_flags &= ~(KDBG_NOWRAP | KDBG_WRAPPED);
 
 	kd_control_trace.kdc_oldest_time = 0;
@@ -2341,6 +2527,69 @@ kernel_debug_trace_write_to_file(user_addr_t *buffer, size_t *number,
 	return error;
 }
 
+#pragma mark - Mapped buffers
+
+// Switch the trace buffers to per-CPU rings and map them read-only into the
+// calling process, so events can be streamed out without any copies.
+static int
+kdbg_map_buffers(user_addr_t where, size_t *sizep)
+{
+	vm_map_t map = current_map();
+	mach_vm_offset_t uaddr = 0;
+	vm_prot_t cur_prot, max_prot;
+	kern_return_t kr;
+	int error;
+
+	if (!proc_is64bit(current_proc())) {
+		return ENOTSUP;
+	}
+	if (*sizep < sizeof(kd_mapped_info) || where == USER_ADDR_NULL) {
+		return EINVAL;
+	}
+	if (kdebug_enable) {
+		return EBUSY;
+	}
+
+	kd_control_trace.kdc_flags |= KDBG_MAPPED;
+	error = kdbg_reinit(0);
+	if (error) {
+		kd_control_trace.kdc_flags &= ~KDBG_MAPPED;
+		return error;
+	}
+
+	kr = mach_vm_remap_kernel(map, &uaddr, kd_buffer_trace.kdb_mapped_size, 0,
+	    VM_FLAGS_ANYWHERE, VM_KERN_MEMORY_NONE, kernel_map,
+	    (mach_vm_offset_t)kd_buffer_trace.kdb_mapped, FALSE, &cur_prot,
+	    &max_prot, VM_INHERIT_NONE);
+	if (kr == KERN_SUCCESS) {
+		kr = mach_vm_protect(map, uaddr, kd_buffer_trace.kdb_mapped_size,
+		    TRUE, VM_PROT_READ);
+		if (kr != KERN_SUCCESS) {
+			mach_vm_deallocate(map, uaddr, kd_buffer_trace.kdb_mapped_size);
+		}
+	}
+	if (kr != KERN_SUCCESS) {
+		kdbg_clear();
+		return ENOMEM;
+	}
+
+	kd_mapped_info info = {
+		.kdmi_address = uaddr,
+		.kdmi_size = kd_buffer_trace.kdb_mapped_size,
+		.kdmi_ring_size = kd_buffer_trace.kdb_mapped_ring_size,
+		.kdmi_ring_count = kd_control_trace.alloc_cpus,
+		.kdmi_ring_capacity = kd_buffer_trace.kdb_mapped_capacity,
+	};
+	error = copyout(&info, where, sizeof(info));
+	if (error) {
+		mach_vm_deallocate(map, uaddr, kd_buffer_trace.kdb_mapped_size);
+		kdbg_clear();
+		return error;
+	}
+	*sizep = sizeof(info);
+	return 0;
+}
+
 #pragma mark - User space interface
 
 static int
@@ -2350,7 +2599,8 @@ _kd_sysctl_internal(int op, int value, user_addr_t where, size_t *sizep)
 	kd_regtype kd_Reg;
 	proc_t p;
 
-	bool read_only = (op == KERN_KDGETBUF || op == KERN_KDREADCURTHRMAP);
+	bool read_only = (op == KERN_KDGETBUF || op == KERN_KDREADCURTHRMAP ||
+	    op == KERN_KDGET_RATE);
 	int perm_error = read_only ? ktrace_read_check() :
 	    ktrace_configure(KTRACE_KDEBUG);
 	if (perm_error != 0) {
@@ -2404,7 +2654,10 @@ _kd_sysctl_internal(int op, int value, user_addr_t where, size_t *sizep)
 		kdbg_set_nkdbufs_trace(value);
 		return 0;
 	case KERN_KDSETUP:
+		kd_control_trace.kdc_flags &= ~KDBG_MAPPED;
 		return kdbg_reinit(0);
+	case KERN_KDMAPBUFS:
+		return kdbg_map_buffers(where, sizep);
 	case KERN_KDREMOVE:
 		ktrace_reset(KTRACE_KDEBUG);
 		return 0;
@@ -2419,6 +2672,9 @@ _kd_sysctl_internal(int op, int value, user_addr_t where, size_t *sizep)
 	case KERN_KDGETREG:
 		return EINVAL;
 	case KERN_KDREADTR:
+		if (kd_control_trace.kdc_flags & KDBG_MAPPED) {
+			return ENOTSUP;
+		}
 		return _read_merged_trace_events(where, sizep, NULL, NULL, false);
 	case KERN_KDWRITETR:
 	case KERN_KDWRITETR_V3:
@@ -2431,6 +2687,9 @@ _kd_sysctl_internal(int op, int value, user_addr_t where, size_t *sizep)
 		int ret = 0;
 
 		if (op == KERN_KDWRITETR || op == KERN_KDWRITETR_V3) {
+			if (kd_control_trace.kdc_flags & KDBG_MAPPED) {
+				return ENOTSUP;
+			}
 			(void)kdbg_wait(size, true);
 		}
 		p = current_proc();
@@ -2467,6 +2726,9 @@ _kd_sysctl_internal(int op, int value, user_addr_t where, size_t *sizep)
 		return ret;
 	}
 	case KERN_KDBUFWAIT:
+		if (kd_control_trace.kdc_flags & KDBG_MAPPED) {
+			return ENOTSUP;
+		}
 		*sizep = kdbg_wait(size, false);
 		return 0;
 	case KERN_KDPIDTR:
@@ -2497,6 +2759,10 @@ _kd_sysctl_internal(int op, int value, user_addr_t where, size_t *sizep)
 		return _copyin_event_disable_mask(where, size);
 	case KERN_KDGET_EDM:
 		return _copyout_event_disable_mask(where, size);
+	case KERN_KDSET_RATE:
+		return _copyin_rate_rules(where, size);
+	case KERN_KDGET_RATE:
+		return _copyout_rate_rules(where, sizep);
 #if DEVELOPMENT || DEBUG
 	case KERN_KDTEST:
 		return kdbg_test(size);
@@ -100,6 +100,46 @@ kdebug_timestamp(void)
 	}
 }
 
+// Mapped rings hold at least this many events per CPU.
+#define KD_MAPPED_MIN_EVENTS 1024
+
+static int
+create_mapped_rings(struct kd_control *kd_ctrl_page,
+    struct kd_buffer *kd_data_page, vm_tag_t tag)
+{
+	uint32_t ncpus = kd_ctrl_page->alloc_cpus;
+	uint32_t capacity = MAX(kd_data_page->kdb_event_count / ncpus,
+	    KD_MAPPED_MIN_EVENTS);
+	vm_offset_t addr = 0;
+
+	// Round down to a power of 2, so slots are a mask of the head away.
+	capacity = 1U << (31 - __builtin_clz(capacity));
+
+	vm_size_t ring_size = round_page(sizeof(kd_mapped_ring_header) +
+	    (vm_size_t)capacity * sizeof(kd_buf));
+	vm_size_t size = ring_size * ncpus;
+
+	if (kmem_alloc(kernel_map, &addr, size, KMA_DATA | KMA_ZERO,
+	    tag) != KERN_SUCCESS) {
+		return ENOSPC;
+	}
+
+	for (uint32_t i = 0; i < ncpus; i++) {
+		kd_mapped_ring_header *ring =
+		    (kd_mapped_ring_header *)(addr + i * ring_size);
+		ring->kdmr_capacity = capacity;
+		ring->kdmr_cpu = i;
+	}
+
+	kd_data_page->kdb_mapped = (kd_mapped_ring_header *)addr;
+	kd_data_page->kdb_mapped_size = size;
+	kd_data_page->kdb_mapped_ring_size = ring_size;
+	kd_data_page->kdb_mapped_capacity = capacity;
+	kd_data_page->kdb_event_count = (int)MIN(capacity * ncpus, INT_MAX);
+	kd_data_page->kdb_storage_count = 0;
+	return 0;
+}
+
 int
 create_buffers(
 	struct kd_control *kd_ctrl_page,
@@ -126,6 +166,15 @@ create_buffers(
 	}
 	kd_data_page->kdb_info = kdbip;
 
+	// Mapped rings replace the storage units and the copy buffer entirely.
+	if (kd_ctrl_page->kdc_flags & KDBG_MAPPED) {
+		error = create_mapped_rings(kd_ctrl_page, kd_data_page, tag);
+		if (error) {
+			goto out;
+		}
+		goto init_info;
+	}
+
 	f_buffers = kdb_storage_count / N_STORAGE_UNITS_PER_BUFFER;
 	kd_data_page->kdb_region_count = f_buffers;
 
@@ -195,6 +244,7 @@ create_buffers(
 
 	kd_data_page->kdb_storage_count = count_storage_units;
 
+init_info:
 	for (i = 0; i < ncpus; i++) {
 		kdbip[i].kd_list_head.raw = KDS_PTR_NULL;
 		kdbip[i].kd_list_tail.raw = KDS_PTR_NULL;
@@ -239,6 +289,16 @@ delete_buffers(struct kd_control *kd_ctrl_page,
 
 		kd_data_page->kdcopybuf = NULL;
 	}
+	if (kd_data_page->kdb_mapped) {
+		// Any reader's mapping keeps its own reference on the pages.
+		kmem_free(kernel_map, (vm_offset_t)kd_data_page->kdb_mapped,
+		    kd_data_page->kdb_mapped_size);
+
+		kd_data_page->kdb_mapped = NULL;
+		kd_data_page->kdb_mapped_size = 0;
+		kd_data_page->kdb_mapped_ring_size = 0;
+		kd_data_page->kdb_mapped_capacity = 0;
+	}
 	kd_ctrl_page->kds_free_list.raw = KDS_PTR_NULL;
 
 	if (kdbip) {
@@ -453,6 +513,48 @@ _enable_wrap(struct kd_control *kd_ctrl_page, kdebug_emit_filter_t emit)
 	kdebug_storage_unlock(kd_ctrl_page, intrs_en);
 }
 
+// Write an event into a mapped ring.  Lock-free: the head hands out slots to
+// concurrent writers, and the sequence number in the event's `unused` field
+// lets readers tell complete events from torn or overwritten ones.
+__attribute__((always_inline))
+static void
+kernel_debug_write_mapped(struct kd_control *kd_ctrl_page,
+    struct kd_buffer *kd_data_page, struct kd_record *kd_rec, int cpu)
+{
+	kd_mapped_ring_header *ring = (kd_mapped_ring_header *)
+	    ((uintptr_t)kd_data_page->kdb_mapped + cpu * kd_data_page->kdb_mapped_ring_size);
+	kd_buf *events = (kd_buf *)(ring + 1);
+	uint64_t now;
+
+	if (kd_rec->timestamp != -1) {
+		now = kd_rec->timestamp;
+	} else if (kd_ctrl_page->mode == KDEBUG_MODE_TRACE) {
+		now = kdebug_timestamp() & KDBG_TIMESTAMP_MASK;
+	} else {
+		now = mach_continuous_time() & KDBG_TIMESTAMP_MASK;
+	}
+
+	uint64_t index = os_atomic_inc_orig(&ring->kdmr_head, relaxed);
+	kd_buf *kd = &events[index & (kd_data_page->kdb_mapped_capacity - 1)];
+
+	os_atomic_store(&kd->unused, 0, relaxed);
+	os_atomic_thread_fence(release);
+
+	if (kd_ctrl_page->kdc_flags & KDBG_DEBUGID_64) {
+		kd->debugid = 0;
+	} else {
+		kd->debugid = kd_rec->debugid;
+	}
+	kd->arg1 = kd_rec->arg1;
+	kd->arg2 = kd_rec->arg2;
+	kd->arg3 = kd_rec->arg3;
+	kd->arg4 = kd_rec->arg4;
+	kd->arg5 = kd_rec->arg5;
+	kdbg_set_timestamp_and_cpu(kd, now, cpu);
+
+	os_atomic_store(&kd->unused, index + 1, release);
+}
+
 __attribute__((always_inline))
 void
 kernel_debug_write(struct kd_control *kd_ctrl_page,
@@ -502,6 +604,11 @@ kernel_debug_write(struct kd_control *kd_ctrl_page,
 		}
 	}
 
+	if (kd_data_page->kdb_mapped) {
+		kernel_debug_write_mapped(kd_ctrl_page, kd_data_page, &kd_rec, cpu);
+		goto out;
+	}
+
 retry_q:
 	kds_raw = kdbp->kd_list_tail;
 
@@ -58,6 +58,7 @@
 
 #include <sys/aio_kern.h>
 #include <sys/sysproto.h>
+#include <sys/event.h>
 
 #include <machine/limits.h>
 
@@ -67,6 +68,9 @@
 #include <kern/zalloc.h>
 #include <kern/task.h>
 #include <kern/sched_prim.h>
+#include <kern/clock.h>
+#include <kern/counter.h>
+#include <kern/thread_call.h>
 
 #include <vm/vm_map.h>
 
@@ -113,6 +117,7 @@ __options_decl(aio_entry_flags_t, uint32_t, {
 	AIO_DSYNC       = 0x00000008, /* aio_fsync with op = O_DSYNC (not supported yet) */
 	AIO_LIO         = 0x00000010, /* lio_listio generated IO */
 	AIO_LIO_WAIT    = 0x00000020, /* lio_listio is waiting on the leader */
+	AIO_COMPLETED   = 0x00000040, /* the IO finished and moved to the aio_doneq */
 
 	/*
 	 * These flags mean that this entry is blocking either:
@@ -152,9 +157,12 @@ __options_decl(aio_entry_flags_t, uint32_t, {
  *
  *   This ref is consumed in do_aio_completion_and_unlock() as well.
  *
- * - lastly, in lio_listio() when the LIO_WAIT behavior is requested,
+ * - in lio_listio() when the LIO_WAIT behavior is requested,
  *   an extra ref is taken in this syscall as it needs to keep accessing
  *   the leader "lio_pending" field until it hits 0.
+ *
+ * - lastly, an EVFILT_AIO knote holds a ref on the entry it is attached to,
+ *   from filt_aioattach() until filt_aiodetach().
  */
 struct aio_workq_entry {
 	/* queue lock */
@@ -178,6 +186,9 @@ struct aio_workq_entry {
 
 	/* Initialized, and possibly freed by aio_work_thread() or at free if cancelled */
 	vm_map_t                        aio_map;        /* user land map we have a reference to */
+
+	/* Proc lock */
+	struct klist                    aio_klist;      /* EVFILT_AIO knotes */
 };
 
 /*
@@ -191,6 +202,7 @@ struct aio_workq_entry {
  */
 typedef struct aio_workq   {
 	TAILQ_HEAD(, aio_workq_entry)   aioq_entries;
+	int                             aioq_count;     /* entries on aioq_entries */
 	lck_spin_t                      aioq_lock;
 	struct waitq                    aioq_waitq;
 } *aio_workq_t;
@@ -202,6 +214,17 @@ struct aio_anchor_cb {
 	/* Hash table of queues here */
 	int                     aio_num_workqs;
 	struct aio_workq        aio_async_workqs[AIO_NUM_WORK_QUEUES];
+
+	/*
+	 * Worker pool.
+	 *
+	 * aio_worker_threads workers are created at boot and always stay around.
+	 * When work is queued while no worker is idle, aio_grow_call adds
+	 * workers up to aio_worker_threads_max, and these extra workers exit
+	 * after idling for AIO_WORKER_IDLE_TIMEOUT_SECS.
+	 */
+	int                     aio_thread_count;       /* live worker threads (atomic) */
+	thread_call_t           aio_grow_call;
 };
 typedef struct aio_anchor_cb aio_anchor_cb;
 
@@ -229,6 +252,7 @@ static lck_mtx_t       *aio_proc_mutex(proc_t procp);
 static bool             aio_has_active_requests_for_process(proc_t procp);
 static bool             aio_proc_has_active_requests_for_file(proc_t procp, int fd);
 static boolean_t        is_already_queued(proc_t procp, user_addr_t aiocbp);
+static aio_workq_entry *aio_find_entry_locked(proc_t procp, user_addr_t aiocbp);
 
 static aio_workq_t      aio_entry_workq(aio_workq_entry *entryp);
 static void             aio_workq_remove_entry_locked(aio_workq_t queue, aio_workq_entry *entryp);
@@ -246,6 +270,8 @@ static lck_spin_t      *aio_workq_lock(aio_workq_t wq);
 
 static void             aio_work_thread(void *arg, wait_result_t wr);
 static aio_workq_entry *aio_get_some_work(void);
+static void             aio_worker_pool_grow(thread_call_param_t p0, thread_call_param_t p1);
+static bool             aio_worker_try_retire(void);
 
 static int              aio_queue_async_request(proc_t procp, user_addr_t aiocbp, aio_entry_flags_t);
 static int              aio_validate(proc_t, aio_workq_entry *entryp);
@@ -282,6 +308,14 @@ extern int aio_max_requests;                    /* AIO_MAX - configurable */
 extern int aio_max_requests_per_process;        /* AIO_PROCESS_MAX - configurable */
 extern int aio_worker_threads;                  /* AIO_THREAD_COUNT - configurable */
 
+#define AIO_WORKER_IDLE_TIMEOUT_SECS    5
+
+/*
+ * Upper bound of the worker pool when it grows to meet demand,
+ * never lower than aio_worker_threads.
+ */
+static TUNABLE_WRITEABLE(int, aio_worker_threads_max, "aio_worker_threads_max", 64);
+
 
 /*
  * aio static variables.
@@ -297,6 +331,19 @@ static LCK_MTX_DECLARE(aio_proc_mtx, &aio_proc_lock_grp);
 static ZONE_DEFINE_TYPE(aio_workq_zonep, "aiowq", aio_workq_entry,
     ZC_ZFREE_CLEARMEM);
 
+SYSCTL_INT(_kern, OID_AUTO, aiothreads_max, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &aio_worker_threads_max, 0, "max number of async IO worker threads");
+SYSCTL_INT(_kern, OID_AUTO, aiothreads_current, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &aio_anchor.aio_thread_count, 0, "current number of async IO worker threads");
+
+SCALABLE_COUNTER_DEFINE(aio_worker_spawns);
+SCALABLE_COUNTER_DEFINE(aio_worker_retires);
+
+SYSCTL_SCALABLE_COUNTER(_kern, aio_worker_spawns, aio_worker_spawns,
+    "number of async IO worker threads created on demand");
+SYSCTL_SCALABLE_COUNTER(_kern, aio_worker_retires, aio_worker_retires,
+    "number of on demand async IO worker threads that exited idle");
+
 /* Hash */
 static aio_workq_t
 aio_entry_workq(__unused aio_workq_entry *entryp)
@@ -327,6 +374,7 @@ aio_workq_remove_entry_locked(aio_workq_t queue, aio_workq_entry *entryp)
 
 	TAILQ_REMOVE(&queue->aioq_entries, entryp, aio_workq_link);
 	entryp->aio_workq_link.tqe_prev = NULL; /* Not on a workq */
+	queue->aioq_count--;
 }
 
 static void
@@ -335,6 +383,7 @@ aio_workq_add_entry_locked(aio_workq_t queue, aio_workq_entry *entryp)
 	ASSERT_AIO_WORKQ_LOCK_OWNED(queue);
 
 	TAILQ_INSERT_TAIL(&queue->aioq_entries, entryp, aio_workq_link);
+	queue->aioq_count++;
 }
 
 static void
@@ -1329,6 +1378,7 @@ aio_try_enqueue_work_locked(proc_t procp, aio_workq_entry *entryp,
     aio_workq_entry *leader)
 {
 	aio_workq_t queue = aio_entry_workq(entryp);
+	kern_return_t kr;
 
 	ASSERT_AIO_PROC_LOCK_OWNED(procp);
 
@@ -1347,10 +1397,15 @@ aio_try_enqueue_work_locked(proc_t procp, aio_workq_entry *entryp,
 	aio_entry_ref(entryp); /* consumed in do_aio_completion_and_unlock */
 	aio_workq_lock_spin(queue);
 	aio_workq_add_entry_locked(queue, entryp);
-	waitq_wakeup64_one(&queue->aioq_waitq, CAST_EVENT64_T(queue),
+	kr = waitq_wakeup64_one(&queue->aioq_waitq, CAST_EVENT64_T(queue),
 	    THREAD_AWAKENED, WAITQ_WAKEUP_DEFAULT);
 	aio_workq_unlock(queue);
 
+	if (kr == KERN_NOT_WAITING) {
+		/* every worker is busy, let the pool grow */
+		thread_call_enter(aio_anchor.aio_grow_call);
+	}
+
 	KERNEL_DEBUG_CONSTANT(BSDDBG_CODE(DBG_BSD_AIO, AIO_work_queued) | DBG_FUNC_START,
 	    VM_KERNEL_ADDRPERM(procp), VM_KERNEL_ADDRPERM(entryp->uaiocbp),
 	    entryp->flags, entryp->aiocb.aio_fildes, 0);
@@ -1509,7 +1564,7 @@ ExitRoutine:
  */
 __attribute__((noreturn))
 static void
-aio_work_thread(void *arg __unused, wait_result_t wr __unused)
+aio_work_thread(void *arg __unused, wait_result_t wr)
 {
 	aio_workq_entry *entryp;
 	int              error;
@@ -1519,6 +1574,12 @@ aio_work_thread(void *arg __unused, wait_result_t wr __unused)
 	struct uthread  *uthreadp = NULL;
 	proc_t           p = NULL;
 
+	if (wr == THREAD_TIMED_OUT && aio_worker_try_retire()) {
+		counter_inc(&aio_worker_retires);
+		thread_terminate_self();
+		__builtin_unreachable();
+	}
+
 	for (;;) {
 		/*
 		 * returns with the entry ref'ed.
@@ -1594,6 +1655,7 @@ aio_get_some_work(void)
 {
 	aio_workq_entry *entryp = NULL;
 	aio_workq_t      queue = NULL;
+	uint64_t         deadline = 0;
 
 	/* Just one queue for the moment.  In the future there will be many. */
 	queue = &aio_anchor.aio_async_workqs[0];
@@ -1643,8 +1705,17 @@ aio_get_some_work(void)
 		return entryp;
 	}
 
-	/* We will wake up when someone enqueues something */
-	waitq_assert_wait64(&queue->aioq_waitq, CAST_EVENT64_T(queue), THREAD_UNINT, 0);
+	/*
+	 * We will wake up when someone enqueues something.
+	 *
+	 * While the pool is larger than its resident size, idle workers
+	 * time out so that aio_work_thread() can retire them.
+	 */
+	if (os_atomic_load(&aio_anchor.aio_thread_count, relaxed) > aio_worker_threads) {
+		clock_interval_to_deadline(AIO_WORKER_IDLE_TIMEOUT_SECS,
+		    NSEC_PER_SEC, &deadline);
+	}
+	waitq_assert_wait64(&queue->aioq_waitq, CAST_EVENT64_T(queue), THREAD_UNINT, deadline);
 	aio_workq_unlock(queue);
 	thread_block(aio_work_thread);
 
@@ -1867,6 +1938,8 @@ do_aio_completion_and_unlock(proc_t p, aio_workq_entry *entryp)
 	ASSERT_AIO_PROC_LOCK_OWNED(p);
 
 	aio_proc_move_done_locked(p, entryp);
+	entryp->flags |= AIO_COMPLETED;
+	KNOTE(&entryp->aio_klist, 0);
 
 	if (leader) {
 		lio_pending = --leader->lio_pending;
@@ -2126,31 +2199,165 @@ do_aio_fsync(aio_workq_entry *entryp)
 static boolean_t
 is_already_queued(proc_t procp, user_addr_t aiocbp)
 {
-	aio_workq_entry *entryp;
-	boolean_t        result;
+	return aio_find_entry_locked(procp, aiocbp) != NULL;
+}
 
-	result = FALSE;
 
-	/* look for matches on our queue of async IO requests that have completed */
+/*
+ * aio_find_entry_locked - returns the active or completed request
+ * for the given aiocbp / process, if any.
+ *
+ * Called with proc aio lock held
+ */
+static aio_workq_entry *
+aio_find_entry_locked(proc_t procp, user_addr_t aiocbp)
+{
+	aio_workq_entry *entryp;
+
 	TAILQ_FOREACH(entryp, &procp->p_aio_doneq, aio_proc_link) {
 		if (aiocbp == entryp->uaiocbp) {
-			result = TRUE;
-			goto ExitThisRoutine;
+			return entryp;
 		}
 	}
 
-	/* look for matches on our queue of active async IO requests */
 	TAILQ_FOREACH(entryp, &procp->p_aio_activeq, aio_proc_link) {
 		if (aiocbp == entryp->uaiocbp) {
-			result = TRUE;
-			goto ExitThisRoutine;
+			return entryp;
 		}
 	}
 
-ExitThisRoutine:
+	return NULL;
+}
+
+
+#pragma mark EVFILT_AIO
+
+/*
+ * EVFILT_AIO knotes are attached to the request for the aiocb named by
+ * their ident, and fire once when that request completes.
+ *
+ * With NOTE_AIO_SUBMIT, attaching the knote also creates and queues the
+ * request (as lio_listio() with LIO_NOWAIT would), which lets a batch of
+ * IOs be submitted from a kevent changelist.
+ */
+static int
+filt_aioattach(struct knote *kn, __unused struct kevent_qos_s *kev)
+{
+	proc_t p = current_proc();
+	user_addr_t aiocbp = (user_addr_t)kn->kn_id;
+	aio_workq_entry *entryp;
+	int result;
+
+	if (kn->kn_sfflags & NOTE_AIO_SUBMIT) {
+		entryp = aio_create_queue_entry(p, aiocbp, AIO_LIO);
+		if (entryp == NULL) {
+			knote_set_error(kn, EAGAIN);
+			return 0;
+		}
+		if ((entryp->flags & (AIO_READ | AIO_WRITE)) == 0) {
+			/* LIO_NOP: there is nothing to submit or wait for */
+			aio_free_request(entryp);
+			knote_set_error(kn, EINVAL);
+			return 0;
+		}
+
+		aio_proc_lock_spin(p);
+		if (!aio_try_enqueue_work_locked(p, entryp, NULL)) {
+			aio_proc_unlock(p);
+			aio_free_request(entryp);
+			knote_set_error(kn, EAGAIN);
+			return 0;
+		}
+	} else {
+		aio_proc_lock_spin(p);
+		entryp = aio_find_entry_locked(p, aiocbp);
+		if (entryp == NULL) {
+			aio_proc_unlock(p);
+			knote_set_error(kn, ENOENT);
+			return 0;
+		}
+	}
+
+	aio_entry_ref(entryp); /* consumed in filt_aiodetach */
+	kn->kn_hook = entryp;
+	kn->kn_flags |= EV_ONESHOT;
+	KNOTE_ATTACH(&entryp->aio_klist, kn);
+	/* the request may have completed before we attached */
+	result = (entryp->flags & AIO_COMPLETED) != 0;
+	aio_proc_unlock(p);
+
+	return result;
+}
+
+static void
+filt_aiodetach(struct knote *kn)
+{
+	aio_workq_entry *entryp = kn->kn_hook;
+
+	aio_proc_lock_spin(entryp->procp);
+	KNOTE_DETACH(&entryp->aio_klist, kn);
+	aio_proc_unlock(entryp->procp);
+
+	kn->kn_hook = NULL;
+	aio_entry_unref(entryp);
+}
+
+static int
+filt_aioevent(__unused struct knote *kn, __unused long hint)
+{
+	/* only posted by do_aio_completion_and_unlock() */
+	return FILTER_ACTIVE;
+}
+
+static int
+filt_aiotouch(struct knote *kn, __unused struct kevent_qos_s *kev)
+{
+	aio_workq_entry *entryp = kn->kn_hook;
+	int result;
+
+	aio_proc_lock_spin(entryp->procp);
+	result = (entryp->flags & AIO_COMPLETED) != 0;
+	aio_proc_unlock(entryp->procp);
+
 	return result;
 }
 
+static int
+filt_aioprocess(struct knote *kn, struct kevent_qos_s *kev)
+{
+	aio_workq_entry *entryp = kn->kn_hook;
+	proc_t p = entryp->procp;
+	bool reaped = false;
+
+	aio_proc_lock_spin(p);
+	if ((entryp->flags & AIO_COMPLETED) == 0) {
+		aio_proc_unlock(p);
+		return 0;
+	}
+
+	/* Deliver the status as aio_return() would, and pull it off the list */
+	if (entryp->aio_proc_link.tqe_prev != NULL) {
+		aio_proc_remove_done_locked(p, entryp);
+		reaped = true;
+	}
+	kn->kn_fflags = (uint32_t)entryp->errorval;
+	knote_fill_kevent(kn, kev, entryp->returnval);
+	aio_proc_unlock(p);
+
+	if (reaped) {
+		aio_entry_unref(entryp); /* the proc's ref, see aio_create_queue_entry */
+	}
+	return FILTER_ACTIVE;
+}
+
+SECURITY_READ_ONLY_EARLY(struct filterops) aio_filtops = {
+	.f_attach  = filt_aioattach,
+	.f_detach  = filt_aiodetach,
+	.f_event   = filt_aioevent,
+	.f_touch   = filt_aiotouch,
+	.f_process = filt_aioprocess,
+};
+
 
 /*
  * aio initialization
@@ -2162,6 +2369,10 @@ aio_init(void)
 		aio_workq_init(&aio_anchor.aio_async_workqs[i]);
 	}
 
+	aio_anchor.aio_grow_call = thread_call_allocate_with_options(
+		aio_worker_pool_grow, NULL, THREAD_CALL_PRIORITY_KERNEL,
+		THREAD_CALL_OPTIONS_ONCE);
+
 	_aio_create_worker_threads(aio_worker_threads);
 }
 
@@ -2181,11 +2392,63 @@ _aio_create_worker_threads(int num)
 		if (KERN_SUCCESS != kernel_thread_start(aio_work_thread, NULL, &myThread)) {
 			printf("%s - failed to create a work thread \n", __FUNCTION__);
 		} else {
+			os_atomic_inc(&aio_anchor.aio_thread_count, relaxed);
 			thread_deallocate(myThread);
 		}
 	}
 }
 
+/*
+ * Grow the worker pool by as many threads as there are requests
+ * waiting for a worker, within aio_worker_threads_max.
+ *
+ * Called from aio_anchor.aio_grow_call when work was queued while every
+ * worker was busy.
+ */
+static void
+aio_worker_pool_grow(__unused thread_call_param_t p0, __unused thread_call_param_t p1)
+{
+	aio_workq_t queue = &aio_anchor.aio_async_workqs[0];
+	int limit = MAX(os_atomic_load(&aio_worker_threads_max, relaxed), aio_worker_threads);
+	int pending, room;
+
+	aio_workq_lock_spin(queue);
+	pending = queue->aioq_count;
+	aio_workq_unlock(queue);
+
+	room = limit - os_atomic_load(&aio_anchor.aio_thread_count, relaxed);
+	if (pending > room) {
+		pending = room;
+	}
+	if (pending > 0) {
+		_aio_create_worker_threads(pending);
+		counter_add(&aio_worker_spawns, pending);
+	}
+}
+
+/*
+ * Decide whether a worker that idled for AIO_WORKER_IDLE_TIMEOUT_SECS
+ * should exit, which happens as long as the pool is larger than
+ * aio_worker_threads and no work is pending.
+ */
+static bool
+aio_worker_try_retire(void)
+{
+	aio_workq_t queue = &aio_anchor.aio_async_workqs[0];
+	int old, new;
+
+	if (os_atomic_load(&queue->aioq_count, relaxed) != 0) {
+		return false;
+	}
+
+	return os_atomic_rmw_loop(&aio_anchor.aio_thread_count, old, new, relaxed, {
+		if (old <= aio_worker_threads) {
+		        os_atomic_rmw_loop_give_up(return false);
+		}
+		new = old - 1;
+	});
+}
+
 /*
  * Return the current activation utask
  */
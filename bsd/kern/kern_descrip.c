@@ -173,6 +173,21 @@ ZONE_DEFINE_ID(ZONE_ID_FILEPROC, "fileproc", struct fileproc, ZC_ZFREE_CLEARMEM)
 	kheap_free(KM_OFILETABL, ofiles, n_files * OFILESIZE) \
 	__typed_allocators_ignore_pop
 
+/*
+ * fdt_lookup_fast() reads the table without the proc_fdlock, so tables
+ * that have been published are freed only after an SMR grace period.
+ */
+static void
+fd_free_files_smr(void *files)
+{
+	__typed_allocators_ignore_push
+	kheap_free_addr(KM_OFILETABL, files);
+	__typed_allocators_ignore_pop
+}
+
+#define fd_retire_files(files, n_files) \
+	smr_global_retire(files, n_files * OFILESIZE, fd_free_files_smr)
+
 /*
  * Descriptor management.
  */
@@ -412,7 +427,8 @@ procfdtbl_releasefd(struct proc * p, int fd, struct fileproc * fp)
 	if (fp != NULL) {
 		p->p_fd.fd_ofiles[fd] = fp;
 	}
-	p->p_fd.fd_ofileflags[fd] &= ~UF_RESERVED;
+	/* pairs with the acquire in fdt_lookup_fast() */
+	os_atomic_andnot(&p->p_fd.fd_ofileflags[fd], UF_RESERVED, release);
 	if ((p->p_fd.fd_ofileflags[fd] & UF_RESVWAIT) == UF_RESVWAIT) {
 		p->p_fd.fd_ofileflags[fd] &= ~UF_RESVWAIT;
 		wakeup(&p->p_fd);
@@ -761,7 +777,7 @@ fdt_exec(proc_t p, short posix_spawn_flags, thread_t thread, bool in_exec)
 	 */
 	knotes_dealloc(p);
 	assert(fdp->fd_knlistsize == 0);
-	assert(fdp->fd_knhashmask == 0);
+	assert(fdp->fd_knhash == NULL);
 
 	proc_fdlock(p);
 
@@ -984,7 +1000,8 @@ fdt_fork(struct filedesc *newfdp, proc_t p, vnode_t uth_cdir, bool in_exec)
 
 	newfdp->fd_ofiles = ofiles;
 	newfdp->fd_ofileflags = ofileflags;
-	newfdp->fd_nfiles = n_files;
+	/* publish the table last, see fdt_lookup_fast() */
+	os_atomic_store(&newfdp->fd_nfiles, n_files, release);
 	newfdp->fd_afterlast = afterlast;
 	newfdp->fd_freefile = freefile;
 
@@ -1012,7 +1029,7 @@ fdt_invalidate(proc_t p)
 	 */
 	knotes_dealloc(p);
 	assert(fdp->fd_knlistsize == 0);
-	assert(fdp->fd_knhashmask == 0);
+	assert(fdp->fd_knhash == NULL);
 
 	/*
 	 * dealloc all workloops that have outstanding retains
@@ -1041,9 +1058,13 @@ fdt_invalidate(proc_t p)
 	vn1 = fdp->fd_cdir;
 	vn2 = fdp->fd_rdir;
 
-	fdp->fd_ofileflags = NULL;
-	fdp->fd_ofiles = NULL;
-	fdp->fd_nfiles = 0;
+	/*
+	 * fdt_lookup_fast() only looks at fd_ofileflags once it found
+	 * fd_ofiles set: clear the table before its flags.
+	 */
+	os_atomic_store(&fdp->fd_nfiles, 0, relaxed);
+	os_atomic_store(&fdp->fd_ofiles, NULL, relaxed);
+	os_atomic_store(&fdp->fd_ofileflags, NULL, release);
 	fdp->fd_wqkqueue = NULL;
 	fdp->fd_cdir = NULL;
 	fdp->fd_rdir = NULL;
@@ -1060,7 +1081,9 @@ fdt_invalidate(proc_t p)
 
 	lck_mtx_unlock(&fdp->fd_knhashlock);
 
-	fd_free_files(ofiles, n_files);
+	if (ofiles) {
+		fd_retire_files(ofiles, n_files);
+	}
 
 	if (kqwq) {
 		kqworkq_dealloc(kqwq);
@@ -1091,21 +1114,34 @@ fileproc_alloc_init(void)
 }
 
 
-void
-fileproc_free(struct fileproc *fp)
+static void
+fileproc_free_smr(void *fp)
+{
+	zfree_id(ZONE_ID_FILEPROC, fp);
+}
+
+static void
+fileproc_destroy(struct fileproc *fp)
 {
-	os_ref_count_t __unused refc = os_ref_release(&fp->fp_iocount);
-#if DEVELOPMENT || DEBUG
-	if (0 != refc) {
-		panic("%s: pid %d refc: %u != 0",
-		    __func__, proc_pid(current_proc()), refc);
-	}
-#endif
 	if (fp->fp_guard_attrs) {
 		guarded_fileproc_unguard(fp);
 	}
 	assert(fp->fp_wset == NULL);
-	zfree_id(ZONE_ID_FILEPROC, fp);
+	/* fdt_lookup_fast() may still be looking at this fileproc */
+	smr_global_retire(fp, sizeof(*fp), fileproc_free_smr);
+}
+
+void
+fileproc_free(struct fileproc *fp)
+{
+	/*
+	 * A racing fdt_lookup_fast() can hold a transient reference
+	 * on a fileproc that is being closed: it will notice that the
+	 * table entry changed and destroy the fileproc when it drops it.
+	 */
+	if (os_ref_release(&fp->fp_iocount) == 0) {
+		fileproc_destroy(fp);
+	}
 }
 
 
@@ -1241,8 +1277,12 @@ fdalloc(proc_t p, int want, int *result)
 		ofiles = fdp->fd_ofiles;
 		fdp->fd_ofiles = newofiles;
 		fdp->fd_ofileflags = newofileflags;
-		fdp->fd_nfiles = numfiles;
-		fd_free_files(ofiles, oldnfiles);
+		/*
+		 * Lockless readers bound their index by fd_nfiles before
+		 * loading the arrays, so publish the bigger size last.
+		 */
+		os_atomic_store(&fdp->fd_nfiles, numfiles, release);
+		fd_retire_files(ofiles, oldnfiles);
 		fdexpand++;
 	}
 }
@@ -1446,6 +1486,140 @@ fp_get_noref_locked_with_iocount(proc_t p, int fd)
 }
 
 
+/*
+ * fp_iocount_drop_unlocked
+ *
+ * Description:	Drop an I/O reference without holding the proc_fdlock.
+ *
+ *		The lock is only taken when this was the last I/O
+ *		reference and a thread in fileproc_drain() waits for it,
+ *		or when a select conflict needs to be cleared.
+ *
+ * Notes:	fp can't be used once the reference is dropped outside of
+ *		the proc_fdlock: a close can drain and free it right away.
+ *		Clearing FP_SELCONFLICT touches fp, so in that (rare) case
+ *		the reference is dropped with the lock held, which keeps
+ *		closers out.
+ */
+static void
+fp_iocount_drop_unlocked(proc_t p, struct fileproc *fp)
+{
+	struct filedesc *fdp = &p->p_fd;
+	os_ref_count_t refc;
+	int needwakeup = 0;
+
+	if (__improbable(fp->fp_flags & FP_SELCONFLICT)) {
+		proc_fdlock_spin(p);
+		refc = os_ref_release(&fp->fp_iocount);
+		if (refc == 1) {
+			fp->fp_flags &= ~FP_SELCONFLICT;
+		}
+		if (refc <= 1 && fdp->fd_fpdrainwait) {
+			fdp->fd_fpdrainwait = 0;
+			needwakeup = 1;
+		}
+		proc_fdunlock(p);
+		if (refc == 0) {
+			/* transient reference of fdt_lookup_fast() on a closed fp */
+			fileproc_destroy(fp);
+		}
+		goto out;
+	}
+
+	refc = os_ref_release(&fp->fp_iocount);
+	if (refc == 0) {
+		/* transient reference of fdt_lookup_fast() on a closed fp */
+		fileproc_destroy(fp);
+		return;
+	}
+	if (refc > 1) {
+		return;
+	}
+
+	/* pairs with the fence in fileproc_drain() */
+	os_atomic_thread_fence(seq_cst);
+	if (!os_atomic_load(&fdp->fd_fpdrainwait, relaxed)) {
+		return;
+	}
+
+	proc_fdlock_spin(p);
+	if (fdp->fd_fpdrainwait) {
+		fdp->fd_fpdrainwait = 0;
+		needwakeup = 1;
+	}
+	proc_fdunlock(p);
+
+out:
+	if (needwakeup) {
+		wakeup(&fdp->fd_fpdrainwait);
+	}
+}
+
+/*
+ * fdt_lookup_fast
+ *
+ * Description:	Lockless lookup of the fileproc for an fd, taking an I/O
+ *		reference on it.
+ *
+ * Returns:	the fileproc, or NULL if the caller must retry with the
+ *		proc_fdlock held (the fd is bad, or it is in flux).
+ *
+ * Notes:	Fileprocs and descriptor tables are freed with
+ *		smr_global_retire(), so they can be looked at within an
+ *		SMR critical section. Taking the I/O reference races with
+ *		close: the entry is checked again once the reference is held
+ *		(closers set UF_RESERVED before they drain the I/O references,
+ *		see fileproc_drain()), and the reference is dropped on mismatch.
+ */
+static struct fileproc *
+fdt_lookup_fast(proc_t p, int fd)
+{
+	struct filedesc *fdp = &p->p_fd;
+	struct fileproc *fp, *cur;
+	struct fileproc **ofiles;
+	char *ofileflags;
+	int nfiles;
+	bool ok = false;
+
+	if (fd < 0) {
+		return NULL;
+	}
+
+	smr_global_enter();
+
+	nfiles = os_atomic_load(&fdp->fd_nfiles, acquire);
+	ofiles = fdp->fd_ofiles;
+	if (fd >= nfiles || ofiles == NULL ||
+	    (fp = os_atomic_load(&ofiles[fd], relaxed)) == NULL ||
+	    !os_ref_retain_try(&fp->fp_iocount)) {
+		smr_global_leave();
+		return NULL;
+	}
+
+	/* pairs with the fence in fileproc_drain() */
+	os_atomic_thread_fence(seq_cst);
+
+	nfiles = os_atomic_load(&fdp->fd_nfiles, acquire);
+	ofiles = os_atomic_load(&fdp->fd_ofiles, relaxed);
+	ofileflags = os_atomic_load(&fdp->fd_ofileflags, relaxed);
+	if (fd < nfiles && ofiles != NULL && ofileflags != NULL) {
+		cur = os_atomic_load(&ofiles[fd], relaxed);
+		ok = (cur == fp) &&
+		    !(os_atomic_load(&ofileflags[fd], acquire) & UF_RESERVED);
+	}
+
+	smr_global_leave();
+
+	if (!ok) {
+		fp_iocount_drop_unlocked(p, fp);
+		return NULL;
+	}
+
+	zone_id_require(ZONE_ID_FILEPROC, sizeof(*fp), fp);
+	return fp;
+}
+
+
 /*
  * fp_lookup
  *
@@ -1468,7 +1642,9 @@ fp_get_noref_locked_with_iocount(proc_t p, int fd)
  *
  * Locks:	If the argument 'locked' is non-zero, then the caller is
  *		expected to have taken and held the proc_fdlock; if it is
- *		zero, than this routine internally takes and drops this lock.
+ *		zero, than this routine first tries a lockless lookup
+ *		(see fdt_lookup_fast()), and otherwise internally takes and
+ *		drops this lock.
  */
 int
 fp_lookup(proc_t p, int fd, struct fileproc **resultfp, int locked)
@@ -1477,6 +1653,12 @@ fp_lookup(proc_t p, int fd, struct fileproc **resultfp, int locked)
 	struct fileproc *fp;
 
 	if (!locked) {
+		if ((fp = fdt_lookup_fast(p, fd)) != NULL) {
+			if (resultfp) {
+				*resultfp = fp;
+			}
+			return 0;
+		}
 		proc_fdlock_spin(p);
 	}
 	if (fd < 0 || fdp == NULL || fd >= fdp->fd_nfiles ||
@@ -1489,7 +1671,7 @@ fp_lookup(proc_t p, int fd, struct fileproc **resultfp, int locked)
 	}
 
 	zone_id_require(ZONE_ID_FILEPROC, sizeof(*fp), fp);
-	os_ref_retain_locked(&fp->fp_iocount);
+	os_ref_retain(&fp->fp_iocount);
 
 	if (resultfp) {
 		*resultfp = fp;
@@ -1508,6 +1690,15 @@ fp_get_ftype(proc_t p, int fd, file_type_t ftype, int err, struct fileproc **fpp
 	struct filedesc *fdp = &p->p_fd;
 	struct fileproc *fp;
 
+	if ((fp = fdt_lookup_fast(p, fd)) != NULL) {
+		if (fp->f_type != ftype) {
+			fp_iocount_drop_unlocked(p, fp);
+			return err;
+		}
+		*fpp = fp;
+		return 0;
+	}
+
 	proc_fdlock_spin(p);
 	if (fd < 0 || fd >= fdp->fd_nfiles ||
 	    (fp = fdp->fd_ofiles[fd]) == NULL ||
@@ -1522,7 +1713,7 @@ fp_get_ftype(proc_t p, int fd, file_type_t ftype, int err, struct fileproc **fpp
 	}
 
 	zone_id_require(ZONE_ID_FILEPROC, sizeof(*fp), fp);
-	os_ref_retain_locked(&fp->fp_iocount);
+	os_ref_retain(&fp->fp_iocount);
 	proc_fdunlock(p);
 
 	*fpp = fp;
@@ -1559,6 +1750,10 @@ fp_drop(proc_t p, int fd, struct fileproc *fp, int locked)
 	struct filedesc *fdp = &p->p_fd;
 	int     needwakeup = 0;
 
+	if (!locked && fp != FILEPROC_NULL) {
+		fp_iocount_drop_unlocked(p, fp);
+		return 0;
+	}
 	if (!locked) {
 		proc_fdlock_spin(p);
 	}
@@ -1572,7 +1767,7 @@ fp_drop(proc_t p, int fd, struct fileproc *fp, int locked)
 		return EBADF;
 	}
 
-	if (1 == os_ref_release_locked(&fp->fp_iocount)) {
+	if (1 == os_ref_release(&fp->fp_iocount)) {
 		if (fp->fp_flags & FP_SELCONFLICT) {
 			fp->fp_flags &= ~FP_SELCONFLICT;
 		}
@@ -1639,6 +1834,9 @@ fileproc_drain(proc_t p, struct fileproc * fp)
 	/* Set the vflag for drain */
 	fileproc_modify_vflags(fp, FPV_DRAIN, FALSE);
 
+	/* order UF_RESERVED before fp_iocount, see fdt_lookup_fast() */
+	os_atomic_thread_fence(seq_cst);
+
 	while (os_ref_get_count(&fp->fp_iocount) > 1) {
 		lck_mtx_convert_spin(&fdp->fd_lock);
 
@@ -1664,7 +1862,15 @@ fileproc_drain(proc_t p, struct fileproc * fp)
 			}
 		}
 		fdp->fd_fpdrainwait = 1;
-		msleep(&fdp->fd_fpdrainwait, &fdp->fd_lock, PRIBIO, "fpdrain", NULL);
+		/*
+		 * Pairs with the fence in fp_iocount_drop_unlocked():
+		 * either the dropper sees fd_fpdrainwait and wakes us up,
+		 * or we see its drop.
+		 */
+		os_atomic_thread_fence(seq_cst);
+		if (os_ref_get_count(&fp->fp_iocount) > 1) {
+			msleep(&fdp->fd_fpdrainwait, &fdp->fd_lock, PRIBIO, "fpdrain", NULL);
+		}
 	}
 #if DIAGNOSTIC
 	if ((fp->fp_flags & FP_INSELECT) != 0) {
@@ -2242,7 +2448,7 @@ file_drop(int fd)
 	proc_fdlock_spin(p);
 	fp = fp_get_noref_locked_with_iocount(p, fd);
 
-	if (1 == os_ref_release_locked(&fp->fp_iocount)) {
+	if (1 == os_ref_release(&fp->fp_iocount)) {
 		if (fp->fp_flags & FP_SELCONFLICT) {
 			fp->fp_flags &= ~FP_SELCONFLICT;
 		}
@@ -3780,6 +3986,79 @@ sys_fcntl_nocancel(proc_t p, struct fcntl_nocancel_args *uap, int32_t *retval)
 		break;
 	}
 
+	case F_GROUPFSYNC: {  // F_FULLFSYNC/F_BARRIERFSYNC for several files, one flush per volume
+		fgroupfsync_t args;
+		struct fileproc *fps[FGROUPFSYNC_MAX];
+		vnode_t vps[FGROUPFSYNC_MAX + 1];
+		int nfps = 0, nvps = 0;
+
+		if (fp->f_type != DTYPE_VNODE) {
+			error = EBADF;
+			goto out;
+		}
+		vp = (struct vnode *)fp_get_data(fp);
+		proc_fdunlock(p);
+
+		if ((error = copyin(argp, (caddr_t)&args, sizeof(args)))) {
+			goto outdrop;
+		}
+		if ((args.fgf_flags & ~FGROUPFSYNC_BARRIER) ||
+		    args.fgf_count > FGROUPFSYNC_MAX) {
+			error = EINVAL;
+			goto outdrop;
+		}
+
+		for (i = 0; i < (int)args.fgf_count; i++) {
+			if ((error = fp_lookup(p, args.fgf_fds[i], &fps[nfps], 0))) {
+				break;
+			}
+			if (fps[nfps++]->f_type != DTYPE_VNODE) {
+				error = EBADF;
+				break;
+			}
+#if CONFIG_MACF
+			/* Re-do MAC checks against the other FDs, pass in a fake argument */
+			error = mac_file_check_fcntl(kauth_cred_get(), fps[nfps - 1]->fp_glob, cmd, 0);
+			if (error) {
+				break;
+			}
+#endif
+		}
+
+		if (error == 0 && (error = vnode_getwithref(vp)) == 0) {
+			vps[nvps++] = vp;
+			for (i = 0; i < nfps; i++) {
+				vnode_t vp2 = (struct vnode *)fp_get_data(fps[i]);
+				int j;
+
+				for (j = 0; j < nvps; j++) {
+					if (vps[j] == vp2) {
+						break;
+					}
+				}
+				if (j < nvps) {
+					continue;
+				}
+				if ((error = vnode_getwithref(vp2))) {
+					break;
+				}
+				vps[nvps++] = vp2;
+			}
+			if (error == 0) {
+				error = vn_fsync_group(vps, nvps,
+				    (args.fgf_flags & FGROUPFSYNC_BARRIER) != 0, &context);
+			}
+			for (i = 0; i < nvps; i++) {
+				(void)vnode_put(vps[i]);
+			}
+		}
+
+		for (i = 0; i < nfps; i++) {
+			fp_drop(p, args.fgf_fds[i], fps[i], 0);
+		}
+		goto outdrop;
+	}
+
 	/*
 	 * SPI (private) for opening a file starting from a dir fd
 	 */
@@ -92,10 +92,12 @@
 #include <kern/thread_group.h>
 #include <kern/locks.h>
 #include <kern/clock.h>
+#include <kern/counter.h>
 #include <kern/cpu_data.h>
 #include <kern/policy_internal.h>
 #include <kern/thread_call.h>
 #include <kern/sched_prim.h>
+#include <kern/smr.h>
 #include <kern/waitq.h>
 #include <kern/zalloc.h>
 #include <kern/kalloc.h>
@@ -160,6 +162,7 @@ static const struct fileops kqueueops = {
 };
 
 static inline int kevent_modern_copyout(struct kevent_qos_s *, user_addr_t *);
+static int kevent_ring_callback(struct kevent_qos_s *kevp, kevent_ctx_t kectx);
 static int kevent_register_wait_prepare(struct knote *kn, struct kevent_qos_s *kev, int result);
 static void kevent_register_wait_block(struct turnstile *ts, thread_t handoff_thread,
     thread_continue_t cont, struct _kevent_register *cont_args) __dead2;
@@ -220,6 +223,8 @@ static int kqworkloop_end_processing(struct kqworkloop *kqwl, int flags, int kev
 
 static struct knote *knote_alloc(void);
 static void knote_free(struct knote *kn);
+static void knote_retire(struct knote *kn);
+static void knhash_destroy(struct knhash *kh);
 static int kq_add_knote(struct kqueue *kq, struct knote *kn,
     struct knote_lock_ctx *knlc, struct proc *p);
 static struct knote *kq_find_knote_and_kq_lock(struct kqueue *kq,
@@ -269,6 +274,7 @@ extern const struct filterops memorystatus_filtops;
 #endif /* CONFIG_MEMORYSTATUS */
 extern const struct filterops fs_filtops;
 extern const struct filterops sig_filtops;
+extern const struct filterops aio_filtops;
 extern const struct filterops machport_filtops;
 extern const struct filterops pipe_nfiltops;
 extern const struct filterops pipe_rfiltops;
@@ -319,7 +325,7 @@ static const struct filterops * const sysfilt_ops[EVFILTID_MAX] = {
 	/* Public Filters */
 	[~EVFILT_READ]                  = &file_filtops,
 	[~EVFILT_WRITE]                 = &file_filtops,
-	[~EVFILT_AIO]                   = &bad_filtops,
+	[~EVFILT_AIO]                   = &aio_filtops,
 	[~EVFILT_VNODE]                 = &file_filtops,
 	[~EVFILT_PROC]                  = &proc_filtops,
 	[~EVFILT_SIGNAL]                = &sig_filtops,
@@ -496,6 +502,90 @@ knhash_unlock(struct filedesc *fdp)
 	lck_mtx_unlock(&fdp->fd_knhashlock);
 }
 
+/*
+ *	Knotes that aren't attached to a file descriptor are hashed by ident
+ *	in fd_knhash, which is split in KNHASH_SHARDS shards with their own
+ *	lock and bucket array, so that registrations of unrelated idents don't
+ *	serialize on a single lock.  A shard doubles its bucket array when it
+ *	holds more than KNHASH_LOAD knotes per bucket, which keeps chains short
+ *	for processes with millions of timer, user or workloop knotes, and
+ *	only ever rehashes a fraction of them at a time.
+ *
+ *	kevent_register() looks knotes up in the global SMR critical section
+ *	instead of taking the shard lock (see knhash_find_smr()):
+ *	- chains are singly linked, knotes are inserted at the head with
+ *	  release semantics and keep their link once unlinked;
+ *	- hashed knotes, and the bucket arrays a resize replaces,
+ *	  are freed with smr_global_retire();
+ *	- a resize moves knotes across chains, which can make a lockless walk
+ *	  miss: ks_seq is odd while one is in progress, and a lookup that
+ *	  misses while it changed is retried with the shard lock held.
+ *
+ *	fd_knhashlock only serializes the allocation and teardown of the table,
+ *	and keeps it alive while another process inspects it.
+ */
+#define KNHASH_SHARD_SHIFT      3
+#define KNHASH_SHARDS           (1u << KNHASH_SHARD_SHIFT)
+#define KNHASH_LOAD             2
+
+struct knhash_table {
+	u_long                  kht_mask;
+	struct klist            kht_list[];
+};
+
+struct knhash_shard {
+	lck_mtx_t               ks_lock;
+	struct knhash_table    *ks_table;       /* (S) published with release */
+	uint32_t                ks_count;       /* (S) number of hashed knotes */
+	uint32_t _Atomic        ks_seq;         /* (S) odd while resizing */
+};
+
+struct knhash {
+	struct knhash_shard     kh_shards[KNHASH_SHARDS];
+};
+
+SCALABLE_COUNTER_DEFINE(knhash_lookups);
+SCALABLE_COUNTER_DEFINE(knhash_lookup_retries);
+SCALABLE_COUNTER_DEFINE(knhash_chain_walked);
+SCALABLE_COUNTER_DEFINE(knhash_contended);
+static uint32_t knhash_resizes;
+#if DEVELOPMENT || DEBUG
+static uint32_t knhash_max_chain;
+#endif /* DEVELOPMENT || DEBUG */
+
+static inline u_long
+knhash_hash(uint64_t ident)
+{
+	return (u_long)KN_HASH(ident, ~0ull);
+}
+
+static inline struct knhash_shard *
+knhash_shard(struct knhash *kh, uint64_t ident)
+{
+	return &kh->kh_shards[knhash_hash(ident) & (KNHASH_SHARDS - 1)];
+}
+
+static inline struct klist *
+knhash_list(struct knhash_table *kht, uint64_t ident)
+{
+	return &kht->kht_list[(knhash_hash(ident) >> KNHASH_SHARD_SHIFT) & kht->kht_mask];
+}
+
+static inline void
+knhash_shard_lock(struct knhash_shard *ks)
+{
+	if (!lck_mtx_try_lock(&ks->ks_lock)) {
+		counter_inc(&knhash_contended);
+		lck_mtx_lock(&ks->ks_lock);
+	}
+}
+
+static inline void
+knhash_shard_unlock(struct knhash_shard *ks)
+{
+	lck_mtx_unlock(&ks->ks_lock);
+}
+
 /* wait event for knote locks */
 static inline event_t
 knote_lock_wev(struct knote *kn)
@@ -2905,6 +2995,7 @@ kqueue_dealloc(struct kqueue *kq)
 	KNOTE_LOCK_CTX(knlc);
 	struct proc *p = kq->kq_p;
 	struct filedesc *fdp = &p->p_fd;
+	struct knhash *kh;
 	struct knote *kn;
 
 	assert(kq && (kq->kq_state & (KQ_WORKLOOP | KQ_WORKQ)) == 0);
@@ -2928,29 +3019,39 @@ kqueue_dealloc(struct kqueue *kq)
 		}
 	}
 
-	knhash_lock(fdp);
 	proc_fdunlock(p);
 
-	if (fdp->fd_knhashmask != 0) {
-		for (int i = 0; i < (int)fdp->fd_knhashmask + 1; i++) {
-			kn = SLIST_FIRST(&fdp->fd_knhash[i]);
+	kh = os_atomic_load(&fdp->fd_knhash, acquire);
+	for (uint32_t s = 0; kh != NULL && s < KNHASH_SHARDS; s++) {
+		struct knhash_shard *ks = &kh->kh_shards[s];
+		struct knhash_table *kht;
+
+		knhash_shard_lock(ks);
+again:
+		kht = ks->ks_table;
+		for (u_long i = 0; i <= kht->kht_mask; i++) {
+			kn = SLIST_FIRST(&kht->kht_list[i]);
 			while (kn != NULL) {
 				if (kq == knote_get_kq(kn)) {
 					kqlock(kq);
-					knhash_unlock(fdp);
+					knhash_shard_unlock(ks);
 					if (knote_lock(kq, kn, &knlc, KNOTE_KQ_LOCK_ON_SUCCESS)) {
 						knote_drop(kq, kn, &knlc);
 					}
-					knhash_lock(fdp);
+					knhash_shard_lock(ks);
+					if (ks->ks_table != kht) {
+						/* the shard was resized, start over */
+						goto again;
+					}
 					/* start over at beginning of list */
-					kn = SLIST_FIRST(&fdp->fd_knhash[i]);
+					kn = SLIST_FIRST(&kht->kht_list[i]);
 					continue;
 				}
 				kn = SLIST_NEXT(kn, kn_link);
 			}
 		}
+		knhash_shard_unlock(ks);
 	}
-	knhash_unlock(fdp);
 
 	kqueue_destroy(kq, kqfile_zone);
 }
@@ -3564,8 +3665,7 @@ knotes_dealloc(proc_t p)
 	struct filedesc *fdp = &p->p_fd;
 	struct kqueue *kq;
 	struct knote *kn;
-	struct  klist *kn_hash = NULL;
-	u_long kn_hashmask;
+	struct knhash *kh;
 	int i;
 
 	proc_fdlock(p);
@@ -3588,29 +3688,29 @@ knotes_dealloc(proc_t p)
 
 	proc_fdunlock(p);
 
-	knhash_lock(fdp);
-
 	/* Clean out all the hashed knotes as well */
-	if (fdp->fd_knhashmask != 0) {
-		for (i = 0; i <= (int)fdp->fd_knhashmask; i++) {
-			while ((kn = SLIST_FIRST(&fdp->fd_knhash[i])) != NULL) {
-				kq = knote_get_kq(kn);
-				kqlock(kq);
-				knhash_unlock(fdp);
-				knote_drop(kq, kn, NULL);
-				knhash_lock(fdp);
+	if ((kh = fdp->fd_knhash) != NULL) {
+		for (uint32_t s = 0; s < KNHASH_SHARDS; s++) {
+			struct knhash_shard *ks = &kh->kh_shards[s];
+
+			knhash_shard_lock(ks);
+			for (u_long j = 0; j <= ks->ks_table->kht_mask; j++) {
+				while ((kn = SLIST_FIRST(&ks->ks_table->kht_list[j])) != NULL) {
+					kq = knote_get_kq(kn);
+					kqlock(kq);
+					knhash_shard_unlock(ks);
+					knote_drop(kq, kn, NULL);
+					knhash_shard_lock(ks);
+				}
 			}
+			knhash_shard_unlock(ks);
 		}
-		kn_hash = fdp->fd_knhash;
-		kn_hashmask = fdp->fd_knhashmask;
-		fdp->fd_knhashmask = 0;
-		fdp->fd_knhash = NULL;
-	}
 
-	knhash_unlock(fdp);
+		knhash_lock(fdp);
+		fdp->fd_knhash = NULL;
+		knhash_unlock(fdp);
 
-	if (kn_hash) {
-		hashdestroy(kn_hash, M_KQUEUE, kn_hashmask);
+		knhash_destroy(kh);
 	}
 }
 
@@ -6160,17 +6260,38 @@ restart:
 }
 
 /*
- * knote_fdfind - lookup a knote in the fd table for process
- *
- * If the filter is file-based, lookup based on fd index.
- * Otherwise use a hash based on the ident.
+ * knote_matches - whether a knote is the one designated by a kevent
  *
  * Matching is based on kq, filter, and ident. Optionally,
  * it may also be based on the udata field in the kevent -
  * allowing multiple event registration for the file object
  * per kqueue.
+ */
+static inline bool
+knote_matches(struct kqueue *kq, const struct kevent_internal_s *kev,
+    struct knote *kn)
+{
+	if (kq != knote_get_kq(kn) ||
+	    kev->kei_ident != kn->kn_id ||
+	    kev->kei_filter != kn->kn_filter) {
+		return false;
+	}
+	if (kev->kei_flags & EV_UDATA_SPECIFIC) {
+		/* matching udata-specific knote */
+		return (kn->kn_flags & EV_UDATA_SPECIFIC) &&
+		       kev->kei_udata == kn->kn_udata;
+	}
+	/* matching non-udata-specific knote */
+	return (kn->kn_flags & EV_UDATA_SPECIFIC) == 0;
+}
+
+/*
+ * knote_fdfind - lookup a knote in the fd table for process
+ *
+ * If the filter is file-based, lookup based on fd index.
+ * Otherwise use a hash based on the ident.
  *
- * fd_knhashlock or fdlock held on entry (and exit)
+ * fdlock, or the fd_knhash shard lock of the ident, held on entry (and exit)
  */
 static struct knote *
 knote_fdfind(struct kqueue *kq,
@@ -6190,9 +6311,11 @@ knote_fdfind(struct kqueue *kq,
 		if (kev->kei_ident < (u_int)fdp->fd_knlistsize) {
 			list = &fdp->fd_knlist[kev->kei_ident];
 		}
-	} else if (fdp->fd_knhashmask != 0) {
+	} else if (fdp->fd_knhash != NULL) {
 		/* hash non-fd knotes here too */
-		list = &fdp->fd_knhash[KN_HASH((u_long)kev->kei_ident, fdp->fd_knhashmask)];
+		struct knhash_shard *ks = knhash_shard(fdp->fd_knhash, kev->kei_ident);
+
+		list = knhash_list(ks->ks_table, kev->kei_ident);
 	}
 
 	/*
@@ -6200,23 +6323,209 @@ knote_fdfind(struct kqueue *kq,
 	 */
 	if (list != NULL) {
 		SLIST_FOREACH(kn, list, kn_link) {
-			if (kq == knote_get_kq(kn) &&
-			    kev->kei_ident == kn->kn_id &&
-			    kev->kei_filter == kn->kn_filter) {
-				if (kev->kei_flags & EV_UDATA_SPECIFIC) {
-					if ((kn->kn_flags & EV_UDATA_SPECIFIC) &&
-					    kev->kei_udata == kn->kn_udata) {
-						break; /* matching udata-specific knote */
-					}
-				} else if ((kn->kn_flags & EV_UDATA_SPECIFIC) == 0) {
-					break; /* matching non-udata-specific knote */
-				}
+			if (knote_matches(kq, kev, kn)) {
+				break;
 			}
 		}
 	}
 	return kn;
 }
 
+/*
+ * knhash_find_smr - lookup a hashed knote without taking the shard lock
+ *
+ * If a knote is found, it is returned with the kq locked.
+ *
+ * Returns false when the lookup must be redone with the shard lock held:
+ * a miss that raced with a resize, or a knote that is being dropped,
+ * which may already be unlinked and only stays valid for the caller if
+ * kq_remove_knote() hasn't run yet.
+ */
+static bool
+knhash_find_smr(struct kqueue *kq, const struct kevent_internal_s *kev,
+    struct knhash *kh, struct knote **knp)
+{
+	struct knhash_shard *ks = knhash_shard(kh, kev->kei_ident);
+	struct knhash_table *kht;
+	struct knote *kn = NULL;
+	uint32_t walked = 0;
+	uint32_t seq;
+	bool found = true;
+
+	smr_global_enter();
+
+	seq = os_atomic_load(&ks->ks_seq, acquire);
+	if (seq & 1) {
+		found = false;
+		goto out;
+	}
+
+	kht = os_atomic_load(&ks->ks_table, dependency);
+	for (kn = os_atomic_load(&SLIST_FIRST(knhash_list(kht, kev->kei_ident)), dependency);
+	    kn != NULL;
+	    kn = os_atomic_load(&SLIST_NEXT(kn, kn_link), dependency)) {
+		walked++;
+		if (knote_matches(kq, kev, kn)) {
+			break;
+		}
+	}
+
+	if (kn == NULL) {
+		os_atomic_thread_fence(acquire);
+		found = (os_atomic_load(&ks->ks_seq, relaxed) == seq);
+	} else {
+		kqlock(kq);
+		if (kn->kn_status & KN_DROPPING) {
+			kqunlock(kq);
+			kn = NULL;
+			found = false;
+		}
+	}
+
+out:
+	smr_global_leave();
+
+	counter_inc(&knhash_lookups);
+	counter_add(&knhash_chain_walked, walked);
+#if DEVELOPMENT || DEBUG
+	/* only write the shared maximum when it actually grows */
+	if (walked > os_atomic_load(&knhash_max_chain, relaxed)) {
+		os_atomic_max(&knhash_max_chain, walked, relaxed);
+	}
+#endif /* DEVELOPMENT || DEBUG */
+
+	*knp = kn;
+	return found;
+}
+
+static struct knhash_table *
+knhash_table_alloc(u_long nbuckets, zalloc_flags_t flags)
+{
+	struct knhash_table *kht;
+
+	kht = kalloc_type(struct knhash_table, struct klist, nbuckets, flags | Z_ZERO);
+	if (kht != NULL) {
+		kht->kht_mask = nbuckets - 1;
+	}
+	return kht;
+}
+
+static void
+knhash_table_free(void *arg)
+{
+	struct knhash_table *kht = arg;
+
+	kfree_type(struct knhash_table, struct klist, kht->kht_mask + 1, kht);
+}
+
+/*
+ * knhash_get - return the knote hash of the process,
+ * allocating it on first use
+ */
+static struct knhash *
+knhash_get(struct filedesc *fdp)
+{
+	struct knhash *kh = os_atomic_load(&fdp->fd_knhash, acquire);
+	u_long nbuckets;
+
+	if (kh != NULL) {
+		return kh;
+	}
+
+	knhash_lock(fdp);
+	if ((kh = fdp->fd_knhash) == NULL) {
+		/* the CONFIG_KN_HASHSIZE buckets are split between the shards */
+		nbuckets = 1ul << (fls(MAX(CONFIG_KN_HASHSIZE / KNHASH_SHARDS, 1)) - 1);
+
+		kh = kalloc_type(struct knhash, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+		for (uint32_t i = 0; i < KNHASH_SHARDS; i++) {
+			struct knhash_shard *ks = &kh->kh_shards[i];
+
+			lck_mtx_init(&ks->ks_lock, &proc_knhashlock_grp, &proc_lck_attr);
+			ks->ks_table = knhash_table_alloc(nbuckets, Z_WAITOK | Z_NOFAIL);
+		}
+		os_atomic_store(&fdp->fd_knhash, kh, release);
+	}
+	knhash_unlock(fdp);
+
+	return kh;
+}
+
+/*
+ * knhash_destroy - free a knote hash that no longer has any knote
+ */
+static void
+knhash_destroy(struct knhash *kh)
+{
+	for (uint32_t i = 0; i < KNHASH_SHARDS; i++) {
+		struct knhash_shard *ks = &kh->kh_shards[i];
+
+		assert(ks->ks_count == 0);
+		knhash_table_free(ks->ks_table);
+		lck_mtx_destroy(&ks->ks_lock, &proc_knhashlock_grp);
+	}
+	kfree_type(struct knhash, kh);
+}
+
+/*
+ * knhash_shard_grow - double the buckets of a shard
+ *
+ * shard lock held on entry (and exit)
+ */
+static void
+knhash_shard_grow(struct knhash_shard *ks)
+{
+	struct knhash_table *okht = ks->ks_table;
+	struct knhash_table *nkht;
+	struct knote *kn, *next;
+
+	LCK_MTX_ASSERT(&ks->ks_lock, LCK_MTX_ASSERT_OWNED);
+
+	nkht = knhash_table_alloc(2 * (okht->kht_mask + 1), Z_WAITOK);
+	if (nkht == NULL) {
+		/* longer chains, try again on the next insertion */
+		return;
+	}
+
+	/* make lockless lookups that miss until we're done retry */
+	os_atomic_inc(&ks->ks_seq, relaxed);
+	os_atomic_thread_fence(release);
+
+	for (u_long i = 0; i <= okht->kht_mask; i++) {
+		for (kn = SLIST_FIRST(&okht->kht_list[i]); kn != NULL; kn = next) {
+			struct klist *list = knhash_list(nkht, kn->kn_id);
+
+			next = SLIST_NEXT(kn, kn_link);
+			os_atomic_store(&SLIST_NEXT(kn, kn_link), SLIST_FIRST(list), relaxed);
+			os_atomic_store(&SLIST_FIRST(list), kn, release);
+		}
+	}
+
+	os_atomic_store(&ks->ks_table, nkht, release);
+	os_atomic_inc(&ks->ks_seq, release);
+	os_atomic_inc(&knhash_resizes, relaxed);
+
+	/* lockless lookups may still be walking the old buckets */
+	smr_global_retire(okht, sizeof(struct klist) * (okht->kht_mask + 1),
+	    knhash_table_free);
+}
+
+/*
+ * knhash_remove - unlink a knote from its hash chain
+ *
+ * The knote keeps its link, lockless lookups may be walking through it.
+ */
+static void
+knhash_remove(struct klist *list, struct knote *kn)
+{
+	struct knote **prevp = &SLIST_FIRST(list);
+
+	while (*prevp != kn) {
+		prevp = &SLIST_NEXT(*prevp, kn_link);
+	}
+	os_atomic_store(prevp, SLIST_NEXT(kn, kn_link), relaxed);
+}
+
 /*
  * kq_add_knote- Add knote to the fd table for process
  * while checking for duplicates.
@@ -6227,7 +6536,7 @@ knote_fdfind(struct kqueue *kq,
  * May have to grow the table of knote lists to cover the
  * file descriptor index presented.
  *
- * fd_knhashlock and fdlock unheld on entry (and exit).
+ * fd_knhash shard lock and fdlock unheld on entry (and exit).
  *
  * Takes a rwlock boost if inserting the knote is successful.
  */
@@ -6236,6 +6545,7 @@ kq_add_knote(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc,
     struct proc *p)
 {
 	struct filedesc *fdp = &p->p_fd;
+	struct knhash_shard *ks = NULL;
 	struct klist *list = NULL;
 	int ret = 0;
 	bool is_fd = kn->kn_is_fd;
@@ -6243,7 +6553,8 @@ kq_add_knote(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc,
 	if (is_fd) {
 		proc_fdlock(p);
 	} else {
-		knhash_lock(fdp);
+		ks = knhash_shard(knhash_get(fdp), kn->kn_id);
+		knhash_shard_lock(ks);
 	}
 
 	if (knote_fdfind(kq, &kn->kn_kevent, is_fd, p) != NULL) {
@@ -6254,21 +6565,12 @@ kq_add_knote(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc,
 
 	/* knote was not found: add it now */
 	if (!is_fd) {
-		if (fdp->fd_knhashmask == 0) {
-			u_long size = 0;
-
-			list = hashinit(CONFIG_KN_HASHSIZE, M_KQUEUE, &size);
-			if (list == NULL) {
-				ret = ENOMEM;
-				goto out_locked;
-			}
-
-			fdp->fd_knhash = list;
-			fdp->fd_knhashmask = size;
-		}
-
-		list = &fdp->fd_knhash[KN_HASH(kn->kn_id, fdp->fd_knhashmask)];
-		SLIST_INSERT_HEAD(list, kn, kn_link);
+		/*
+		 * lockless lookups can find the knote as soon as it is on
+		 * its chain, so it is linked with the kq locked below, and
+		 * they find it knote-locked
+		 */
+		list = knhash_list(ks->ks_table, kn->kn_id);
 		ret = 0;
 		goto out_locked;
 	} else {
@@ -6315,6 +6617,11 @@ kq_add_knote(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc,
 out_locked:
 	if (ret == 0) {
 		kqlock(kq);
+		if (!is_fd) {
+			SLIST_NEXT(kn, kn_link) = SLIST_FIRST(list);
+			os_atomic_store(&SLIST_FIRST(list), kn, release);
+			ks->ks_count++;
+		}
 		assert((kn->kn_status & KN_LOCKED) == 0);
 		(void)knote_lock(kq, kn, knlc, KNOTE_KQ_UNLOCK);
 		kqueue_retain(kq); /* retain a kq ref */
@@ -6322,7 +6629,10 @@ out_locked:
 	if (is_fd) {
 		proc_fdunlock(p);
 	} else {
-		knhash_unlock(fdp);
+		if (ks->ks_count > KNHASH_LOAD * (ks->ks_table->kht_mask + 1)) {
+			knhash_shard_grow(ks);
+		}
+		knhash_shard_unlock(ks);
 	}
 
 	return ret;
@@ -6334,30 +6644,29 @@ out_locked:
  * If the filter is file-based, remove based on fd index.
  * Otherwise remove from the hash based on the ident.
  *
- * fd_knhashlock and fdlock unheld on entry (and exit).
+ * fd_knhash shard lock and fdlock unheld on entry (and exit).
  */
 static void
 kq_remove_knote(struct kqueue *kq, struct knote *kn, struct proc *p,
     struct knote_lock_ctx *knlc)
 {
 	struct filedesc *fdp = &p->p_fd;
-	struct klist *list = NULL;
+	struct knhash_shard *ks = NULL;
 	uint16_t kq_state;
 	bool is_fd = kn->kn_is_fd;
 
 	if (is_fd) {
 		proc_fdlock(p);
-	} else {
-		knhash_lock(fdp);
-	}
 
-	if (is_fd) {
 		assert((u_int)fdp->fd_knlistsize > kn->kn_id);
-		list = &fdp->fd_knlist[kn->kn_id];
+		SLIST_REMOVE(&fdp->fd_knlist[kn->kn_id], kn, knote, kn_link);
 	} else {
-		list = &fdp->fd_knhash[KN_HASH(kn->kn_id, fdp->fd_knhashmask)];
+		ks = knhash_shard(fdp->fd_knhash, kn->kn_id);
+		knhash_shard_lock(ks);
+
+		knhash_remove(knhash_list(ks->ks_table, kn->kn_id), kn);
+		ks->ks_count--;
 	}
-	SLIST_REMOVE(list, kn, knote, kn_link);
 
 	kqlock(kq);
 
@@ -6373,7 +6682,7 @@ kq_remove_knote(struct kqueue *kq, struct knote *kn, struct proc *p,
 	if (is_fd) {
 		proc_fdunlock(p);
 	} else {
-		knhash_unlock(fdp);
+		knhash_shard_unlock(ks);
 	}
 
 	if (kq_state & KQ_DYNAMIC) {
@@ -6385,7 +6694,9 @@ kq_remove_knote(struct kqueue *kq, struct knote *kn, struct proc *p,
  * kq_find_knote_and_kq_lock - lookup a knote in the fd table for process
  * and, if the knote is found, acquires the kqlock while holding the fd table lock/spinlock.
  *
- * fd_knhashlock or fdlock unheld on entry (and exit)
+ * Hashed knotes are looked up locklessly first, see knhash_find_smr().
+ *
+ * fd_knhash shard lock or fdlock unheld on entry (and exit)
  */
 
 static struct knote *
@@ -6393,14 +6704,10 @@ kq_find_knote_and_kq_lock(struct kqueue *kq, struct kevent_qos_s *kev,
     bool is_fd, struct proc *p)
 {
 	struct filedesc *fdp = &p->p_fd;
+	struct knhash_shard *ks = NULL;
+	struct knhash *kh;
 	struct knote *kn;
 
-	if (is_fd) {
-		proc_fdlock(p);
-	} else {
-		knhash_lock(fdp);
-	}
-
 	/*
 	 * Temporary horrible hack:
 	 * this cast is gross and will go away in a future change.
@@ -6408,7 +6715,26 @@ kq_find_knote_and_kq_lock(struct kqueue *kq, struct kevent_qos_s *kev,
 	 * and that when we cast down the kev this way,
 	 * the truncated filter field works.
 	 */
-	kn = knote_fdfind(kq, (struct kevent_internal_s *)kev, is_fd, p);
+	struct kevent_internal_s *kei = (struct kevent_internal_s *)kev;
+
+	if (is_fd) {
+		proc_fdlock(p);
+	} else {
+		kh = os_atomic_load(&fdp->fd_knhash, acquire);
+		if (kh == NULL) {
+			/* nothing was ever hashed */
+			return NULL;
+		}
+		if (knhash_find_smr(kq, kei, kh, &kn)) {
+			return kn;
+		}
+		counter_inc(&knhash_lookup_retries);
+
+		ks = knhash_shard(kh, kei->kei_ident);
+		knhash_shard_lock(ks);
+	}
+
+	kn = knote_fdfind(kq, kei, is_fd, p);
 
 	if (kn) {
 		kqlock(kq);
@@ -6418,7 +6744,7 @@ kq_find_knote_and_kq_lock(struct kqueue *kq, struct kevent_qos_s *kev,
 	if (is_fd) {
 		proc_fdunlock(p);
 	} else {
-		knhash_unlock(fdp);
+		knhash_shard_unlock(ks);
 	}
 
 	return kn;
@@ -6670,7 +6996,11 @@ knote_drop(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc)
 		fp_drop(p, (int)kn->kn_id, kn->kn_fp, 0);
 	}
 
-	knote_free(kn);
+	if (kn->kn_is_fd) {
+		knote_free(kn);
+	} else {
+		knote_retire(kn);
+	}
 }
 
 void
@@ -6702,6 +7032,23 @@ knote_free(struct knote *kn)
 	zfree(knote_zone, kn);
 }
 
+static void
+knote_free_smr(void *arg)
+{
+	zfree(knote_zone, arg);
+}
+
+/*
+ * Free a knote that was hashed in fd_knhash,
+ * once lockless lookups are done looking at it.
+ */
+static void
+knote_retire(struct knote *kn)
+{
+	assert((kn->kn_status & (KN_LOCKED | KN_POSTING)) == 0);
+	smr_global_retire(kn, sizeof(*kn), knote_free_smr);
+}
+
 #pragma mark - syscalls: kevent, kevent64, kevent_qos, kevent_id
 
 kevent_ctx_t
@@ -7047,6 +7394,72 @@ kevent_modern_copyout(struct kevent_qos_s *kevp, user_addr_t *addrp)
 	return error;
 }
 
+/*!
+ * @function kevent_ring_entry
+ *
+ * @brief
+ * Returns the user address of entry @c idx of a KEVENT_FLAG_RING ring.
+ */
+static inline user_addr_t
+kevent_ring_entry(user_addr_t ring, uint32_t idx, uint32_t mask)
+{
+	return ring + offsetof(struct kevent_ring, kr_entries) +
+	       (user_addr_t)(idx & mask) * sizeof(struct kevent_qos_s);
+}
+
+/*!
+ * @function kevent_ring_copyin_header
+ *
+ * @brief
+ * Copies in and validates the header of a KEVENT_FLAG_RING ring.
+ */
+static int
+kevent_ring_copyin_header(user_addr_t ring, struct kevent_ring *hdr)
+{
+	int error;
+
+	if (__improbable(ring == USER_ADDR_NULL ||
+	    (ring & (sizeof(uint64_t) - 1)))) {
+		return EINVAL;
+	}
+
+	error = copyin(ring, hdr, sizeof(*hdr));
+	if (__improbable(error)) {
+		return error;
+	}
+
+	if (__improbable(hdr->kr_mask >= KEVENT_RING_MAX_ENTRIES ||
+	    ((hdr->kr_mask + 1) & hdr->kr_mask) != 0 ||
+	    hdr->kr_reserved != 0 ||
+	    hdr->kr_tail - hdr->kr_head > hdr->kr_mask + 1)) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+/*!
+ * @function kevent_ring_publish
+ *
+ * @brief
+ * Makes the completion ring entries written by this call visible
+ * by advancing the user-visible tail of the ring.
+ */
+static int
+kevent_ring_publish(kevent_ctx_t kectx)
+{
+	uint32_t tail;
+
+	if (kectx->kec_process_noutputs == 0) {
+		return 0;
+	}
+
+	tail = kectx->kec_process_ring_tail + (uint32_t)kectx->kec_process_noutputs;
+	/* order the entry copyouts before the tail update */
+	os_atomic_thread_fence(release);
+	return copyout_atomic32(tail, kectx->kec_process_eventlist +
+	           offsetof(struct kevent_ring, kr_tail));
+}
+
 #pragma mark kevent core implementation
 
 /*!
@@ -7138,6 +7551,13 @@ kevent_cleanup(kqueue_t kqu, int flags, int error, kevent_ctx_t kectx)
 	// poll should not call any codepath leading to this
 	assert((flags & KEVENT_FLAG_POLL) == 0);
 
+	if (flags & KEVENT_FLAG_RING) {
+		int publish_error = kevent_ring_publish(kectx);
+		if (error == 0) {
+			error = publish_error;
+		}
+	}
+
 	if (flags & KEVENT_FLAG_WORKLOOP) {
 		kqworkloop_release(kqu.kqwl);
 	} else if (flags & KEVENT_FLAG_WORKQ) {
@@ -7314,7 +7734,7 @@ kqueue_scan_continue(void *data, wait_result_t wait_result)
 
 	/*
 	 * only kevent variants call in here, so we know the callback is
-	 * kevent_legacy_callback or kevent_modern_callback.
+	 * kevent_legacy_callback, kevent_modern_callback or kevent_ring_callback.
 	 */
 	assert((flags & (KEVENT_FLAG_POLL | KEVENT_FLAG_KERNEL)) == 0);
 
@@ -7322,6 +7742,8 @@ kqueue_scan_continue(void *data, wait_result_t wait_result)
 	case THREAD_AWAKENED:
 		if (__improbable(flags & (KEVENT_FLAG_LEGACY32 | KEVENT_FLAG_LEGACY64))) {
 			error = kqueue_scan(kq, flags, kectx, kevent_legacy_callback);
+		} else if (__improbable(flags & KEVENT_FLAG_RING)) {
+			error = kqueue_scan(kq, flags, kectx, kevent_ring_callback);
 		} else {
 			error = kqueue_scan(kq, flags, kectx, kevent_modern_callback);
 		}
@@ -7603,6 +8025,137 @@ out:
 	return kevent_cleanup(kqu.kq, flags, error, kectx);
 }
 
+/*!
+ * @function kevent_ring_callback
+ *
+ * @brief
+ * Callback for each individual event delivered to a completion ring.
+ */
+static int
+kevent_ring_callback(struct kevent_qos_s *kevp, kevent_ctx_t kectx)
+{
+	user_addr_t addr;
+	int error;
+
+	assert(kectx->kec_process_noutputs < kectx->kec_process_nevents);
+
+	addr = kevent_ring_entry(kectx->kec_process_eventlist,
+	    kectx->kec_process_ring_tail + (uint32_t)kectx->kec_process_noutputs,
+	    kectx->kec_process_ring_mask);
+	error = kevent_modern_copyout(kevp, &addr);
+
+	/* stop processing once the ring is full */
+	if (error == 0 && ++kectx->kec_process_noutputs == kectx->kec_process_nevents) {
+		error = EWOULDBLOCK;
+	}
+	return error;
+}
+
+/*!
+ * @function kevent_ring_internal
+ *
+ * @brief
+ * The backend of kevent_qos() for KEVENT_FLAG_RING.
+ *
+ * @discussion
+ * Consumes up to @c nchanges changes from the submission ring at
+ * @c changelist, then delivers up to @c nevents events into the free
+ * space of the completion ring at @c eventlist. Receipts and errors for
+ * changes are delivered to the completion ring like any other event.
+ *
+ * Userspace drains completions without entering the kernel, and only
+ * calls in to flush submissions or to wait when the completion ring is
+ * empty. No event is collected (and the call doesn't wait) when the
+ * completion ring is full.
+ *
+ * Only file based kqueues support rings.
+ *
+ * Returns the number of completion entries produced by this call.
+ */
+OS_NOINLINE
+static int
+kevent_ring_internal(kqueue_t kqu,
+    user_addr_t changelist, int nchanges,
+    user_addr_t eventlist, int nevents,
+    int flags, kevent_ctx_t kectx, int32_t *retval)
+{
+	struct kevent_ring sq = { }, cq = { };
+	uint32_t sq_head, cq_space;
+	int error;
+
+	kectx->kec_process_flags = flags;
+	kectx->kec_process_noutputs = 0;
+	kectx->kec_process_nevents = 0;
+	kectx->kec_process_eventlist = eventlist;
+
+	error = kevent_ring_copyin_header(eventlist, &cq);
+	if (error == 0 && nchanges > 0) {
+		error = kevent_ring_copyin_header(changelist, &sq);
+	}
+	if (__improbable(error)) {
+		goto out;
+	}
+
+	cq_space = cq.kr_mask + 1 - (cq.kr_tail - cq.kr_head);
+	kectx->kec_process_nevents = (int)MIN((uint32_t)MAX(nevents, 0), cq_space);
+	kectx->kec_process_ring_tail = cq.kr_tail;
+	kectx->kec_process_ring_mask = cq.kr_mask;
+
+	/* register all the change requests queued in the submission ring... */
+	sq_head = sq.kr_head;
+	while (nchanges > 0 && sq_head != sq.kr_tail && error == 0) {
+		user_addr_t addr = kevent_ring_entry(changelist, sq_head, sq.kr_mask);
+		struct kevent_qos_s kev;
+		struct knote *kn = NULL;
+		int register_rc;
+
+		error = kevent_modern_copyin(&addr, &kev);
+		if (error) {
+			break;
+		}
+
+		/* only workloops can ask to wait, and they don't support rings */
+		register_rc = kevent_register(kqu.kq, &kev, &kn);
+		assert((register_rc & FILTER_REGISTER_WAIT) == 0);
+		(void)register_rc;
+
+		sq_head++;
+		nchanges--;
+
+		if (kectx->kec_process_noutputs < kectx->kec_process_nevents &&
+		    (kev.flags & (EV_ERROR | EV_RECEIPT))) {
+			if ((kev.flags & EV_ERROR) == 0) {
+				kev.flags |= EV_ERROR;
+				kev.data = 0;
+			}
+			error = kevent_ring_callback(&kev, kectx);
+			if (error == EWOULDBLOCK) {
+				error = 0;
+			}
+		} else if (kev.flags & EV_ERROR) {
+			error = (int)kev.data;
+		}
+	}
+
+	if (sq_head != sq.kr_head) {
+		int head_error = copyout_atomic32(sq_head,
+		    changelist + offsetof(struct kevent_ring, kr_head));
+		if (error == 0) {
+			error = head_error;
+		}
+	}
+
+	/* ... then collect events, waiting only if nothing was produced yet */
+	if (error == 0 &&
+	    kectx->kec_process_noutputs < kectx->kec_process_nevents) {
+		error = kqueue_scan(kqu.kq, flags, kectx, kevent_ring_callback);
+	}
+
+	*retval = kectx->kec_process_noutputs;
+out:
+	return kevent_cleanup(kqu.kq, flags, error, kectx);
+}
+
 #pragma mark modern syscalls: kevent_qos, kevent_id, kevent_workq_internal
 
 /*!
@@ -7771,13 +8324,18 @@ kevent_qos(struct proc *p, struct kevent_qos_args *uap, int32_t *retval)
 {
 	uthread_t uth = current_uthread();
 	kevent_ctx_t kectx = &uth->uu_save.uus_kevent;
-	int error, flags = uap->flags & KEVENT_FLAG_USER;
+	int error, flags = uap->flags & (KEVENT_FLAG_USER | KEVENT_FLAG_RING);
 	struct kqueue *kq;
 
 	if (__improbable(flags & KEVENT_ID_FLAG_USER)) {
 		return EINVAL;
 	}
 
+	if (__improbable((flags & KEVENT_FLAG_RING) && (flags &
+	    (KEVENT_FLAG_WORKQ | KEVENT_FLAG_STACK_DATA | KEVENT_FLAG_ERROR_EVENTS)))) {
+		return EINVAL;
+	}
+
 	flags = kevent_adjust_flags_for_proc(p, flags);
 
 	error = kevent_get_data_size(flags, uap->data_available, uap->data_out, kectx);
@@ -7800,6 +8358,11 @@ kevent_qos(struct proc *p, struct kevent_qos_args *uap, int32_t *retval)
 		return error;
 	}
 
+	if (__improbable(flags & KEVENT_FLAG_RING)) {
+		return kevent_ring_internal(kq, uap->changelist, uap->nchanges,
+		           uap->eventlist, uap->nevents, flags, kectx, retval);
+	}
+
 	return kevent_modern_internal(kq, uap->changelist, uap->nchanges,
 	           uap->eventlist, uap->nevents, flags, kectx, retval);
 }
@@ -8826,6 +9389,7 @@ pid_kqueue_extinfo(proc_t p, struct kqueue *kq, user_addr_t ubuf,
     uint32_t bufsize, int32_t *retval)
 {
 	struct knote *kn;
+	struct knhash *kh;
 	int i;
 	int err = 0;
 	struct filedesc *fdp = &p->p_fd;
@@ -8849,14 +9413,20 @@ pid_kqueue_extinfo(proc_t p, struct kqueue *kq, user_addr_t ubuf,
 	}
 	proc_fdunlock(p);
 
-	if (fdp->fd_knhashmask != 0) {
-		for (i = 0; i < (int)fdp->fd_knhashmask + 1; i++) {
-			knhash_lock(fdp);
-			kn = SLIST_FIRST(&fdp->fd_knhash[i]);
-			nknotes = kevent_extinfo_emit(kq, kn, kqext, buflen, nknotes);
-			knhash_unlock(fdp);
+	knhash_lock(fdp);
+	if ((kh = fdp->fd_knhash) != NULL) {
+		for (uint32_t s = 0; s < KNHASH_SHARDS; s++) {
+			struct knhash_shard *ks = &kh->kh_shards[s];
+
+			knhash_shard_lock(ks);
+			for (u_long j = 0; j <= ks->ks_table->kht_mask; j++) {
+				kn = SLIST_FIRST(&ks->ks_table->kht_list[j]);
+				nknotes = kevent_extinfo_emit(kq, kn, kqext, buflen, nknotes);
+			}
+			knhash_shard_unlock(ks);
 		}
 	}
+	knhash_unlock(fdp);
 
 	assert(bufsize >= sizeof(struct kevent_extinfo) * MIN(buflen, nknotes));
 	err = copyout(kqext, ubuf, sizeof(struct kevent_extinfo) * MIN(buflen, nknotes));
@@ -8898,6 +9468,7 @@ kevent_proc_copy_uptrs(void *proc, uint64_t *buf, uint32_t bufsize)
 	unsigned int nuptrs = 0;
 	unsigned int buflen = bufsize / sizeof(uint64_t);
 	struct kqworkloop *kqwl;
+	struct knhash *kh;
 
 	if (buflen > 0) {
 		assert(buf != NULL);
@@ -8910,9 +9481,15 @@ kevent_proc_copy_uptrs(void *proc, uint64_t *buf, uint32_t bufsize)
 	proc_fdunlock(p);
 
 	knhash_lock(fdp);
-	if (fdp->fd_knhashmask != 0) {
-		for (size_t i = 0; i < fdp->fd_knhashmask + 1; i++) {
-			nuptrs = klist_copy_udata(&fdp->fd_knhash[i], buf, buflen, nuptrs);
+	if ((kh = fdp->fd_knhash) != NULL) {
+		for (uint32_t s = 0; s < KNHASH_SHARDS; s++) {
+			struct knhash_shard *ks = &kh->kh_shards[s];
+
+			knhash_shard_lock(ks);
+			for (u_long i = 0; i <= ks->ks_table->kht_mask; i++) {
+				nuptrs = klist_copy_udata(&ks->ks_table->kht_list[i], buf, buflen, nuptrs);
+			}
+			knhash_shard_unlock(ks);
 		}
 	}
 	knhash_unlock(fdp);
@@ -9080,4 +9657,17 @@ SYSCTL_PROC(_kern_kevent, OID_AUTO, bound_id,
     sizeof(kqueue_id_t), kevent_sysctl, "Q",
     "get the ID of the bound kqueue");
 
+SYSCTL_SCALABLE_COUNTER(_kern_kevent, knhash_lookups, knhash_lookups,
+    "lockless lookups of hashed knotes");
+SYSCTL_SCALABLE_COUNTER(_kern_kevent, knhash_lookup_retries, knhash_lookup_retries,
+    "lockless lookups of hashed knotes redone with the shard lock");
+SYSCTL_SCALABLE_COUNTER(_kern_kevent, knhash_chain_walked, knhash_chain_walked,
+    "knotes walked by lockless lookups");
+SYSCTL_SCALABLE_COUNTER(_kern_kevent, knhash_contended, knhash_contended,
+    "knote hash shard lock acquisitions that had to wait");
+SYSCTL_UINT(_kern_kevent, OID_AUTO, knhash_resizes, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &knhash_resizes, 0, "knote hash shards resized");
+SYSCTL_UINT(_kern_kevent, OID_AUTO, knhash_max_chain, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &knhash_max_chain, 0, "longest knote hash chain walked by a lookup");
+
 #endif /* DEVELOPMENT || DEBUG */
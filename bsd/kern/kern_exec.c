@@ -1555,10 +1555,13 @@ grade:
 	}
 #endif /* XNU_TARGET_OS_OSX */
 
+	KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_EXEC_SHARED_REGN) | DBG_FUNC_START,
+	    cputype, cpu_subtype, reslide);
 	vm_map_exec(map, task, load_result.is_64bit_addr,
 	    (void *)p->p_fd.fd_rdir, cputype, cpu_subtype, reslide,
 	    (imgp->ip_flags & IMGPF_DRIVER) != 0,
 	    rsr_version);
+	KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_EXEC_SHARED_REGN) | DBG_FUNC_END);
 
 	/*
 	 * Close file descriptors which specify close-on-exec.
@@ -3879,8 +3882,12 @@ do_fork1:
 		struct kaudit_record *save_uu_ar = uthread->uu_ar;
 		uthread->uu_ar = NULL;
 #endif
+		KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_SPAWN_FILE_ACTS) | DBG_FUNC_START,
+		    px_args.file_actions_size);
 		error = exec_handle_file_actions(imgp,
 		    imgp->ip_px_sa != NULL ? px_sa.psa_flags : 0);
+		KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_SPAWN_FILE_ACTS) | DBG_FUNC_END,
+		    error);
 #if CONFIG_AUDIT
 		/* Restore the AUE_POSIX_SPAWN audit record. */
 		uthread->uu_ar = save_uu_ar;
@@ -3900,7 +3907,11 @@ do_fork1:
 		struct kaudit_record *save_uu_ar = uthread->uu_ar;
 		uthread->uu_ar = NULL;
 #endif
+		KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_SPAWN_PORT_ACTS) | DBG_FUNC_START,
+		    px_args.port_actions_size);
 		error = exec_handle_port_actions(imgp, &port_actions);
+		KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_SPAWN_PORT_ACTS) | DBG_FUNC_END,
+		    error);
 #if CONFIG_AUDIT
 		/* Restore the AUE_POSIX_SPAWN audit record. */
 		uthread->uu_ar = save_uu_ar;
@@ -4051,7 +4062,9 @@ do_fork1:
 	 * Warning: If activation failed after point of no return, it returns error
 	 * as 0 and pretends the call succeeded.
 	 */
+	KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_EXEC_IMAGE_LOAD) | DBG_FUNC_START);
 	error = exec_activate_image(imgp);
+	KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_EXEC_IMAGE_LOAD) | DBG_FUNC_END, error);
 #if defined(HAS_APPLE_PAC)
 	ml_task_set_jop_pid_from_shared_region(new_task);
 	ml_task_set_disable_user_jop(new_task, imgp->ip_flags & IMGPF_NOJOP ? TRUE : FALSE);
@@ -5005,7 +5018,9 @@ __mac_execve(proc_t p, struct __mac_execve_args *uap, int32_t *retval __unused)
 	 * Warning: If activation failed after point of no return, it returns error
 	 * as 0 and pretends the call succeeded.
 	 */
+	KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_EXEC_IMAGE_LOAD) | DBG_FUNC_START);
 	error = exec_activate_image(imgp);
+	KDBG(BSDDBG_CODE(DBG_BSD_PROC, BSD_PROC_EXEC_IMAGE_LOAD) | DBG_FUNC_END, error);
 	/* thread and task ref returned for vfexec case */
 
 	if (imgp->ip_new_thread != NULL) {
@@ -6230,6 +6245,7 @@ exec_check_permissions(struct image_params *imgp)
 	VATTR_WANTED(vap, va_fsid64);
 	VATTR_WANTED(vap, va_fileid);
 	VATTR_WANTED(vap, va_data_size);
+	VATTR_WANTED(vap, va_modify_time);
 	if ((error = vnode_getattr(vp, vap, imgp->ip_vfs_context)) != 0) {
 		return error;
 	}
@@ -180,6 +180,7 @@ extern void task_coalition_ids(task_t task, uint64_t ids[COALITION_NUM_TYPES]);
 extern uint64_t get_task_phys_footprint_limit(task_t);
 int proc_list_uptrs(void *p, uint64_t *udata_buffer, int size);
 extern uint64_t task_corpse_get_crashed_thread_id(task_t corpse_task);
+extern user_addr_t get_usersp(void);
 
 extern unsigned int exception_log_max_pid;
 
@@ -827,6 +828,13 @@ get_exception_from_corpse_crashinfo(kcdata_descriptor_t corpse_info)
 	return *etype;
 }
 
+/*
+ * Bytes of the faulting thread's user stack saved in a lightweight corpse,
+ * starting at its stack pointer.
+ */
+#define LW_CORPSE_STACK_MAX     (4096)
+static TUNABLE(uint32_t, lw_corpse_stack_bytes, "lw_corpse_stack_bytes", 1024);
+
 /*
  * Collect information required for generating lightwight corpse for current
  * task, which can be terminating.
@@ -1205,6 +1213,37 @@ current_thread_collect_backtrace_info(
 		kcdata_memcpy(kcdata, kaddr, &th_info.thread_id, sizeof(uint64_t));
 	}
 
+	/*
+	 * Save the top of the user stack, which holds the locals and spilled
+	 * registers of the innermost frames that the backtrace doesn't show.
+	 * This comes after the thread ID so that it can't crowd out the
+	 * required fields, and stops at the first page that can't be read.
+	 */
+	uint32_t stack_size = MIN(lw_corpse_stack_bytes, LW_CORPSE_STACK_MAX);
+	if (stack_size != 0 && KERN_SUCCESS == kcdata_get_memory_addr(kcdata,
+	    TASK_BTINFO_STACK_MEMORY, sizeof(struct btinfo_memory_region) + stack_size, &kaddr)) {
+		struct btinfo_memory_region *region = (struct btinfo_memory_region *)kaddr;
+		user_addr_t sp = get_usersp();
+		uint64_t page_mask = get_task_page_size(task) - 1;
+		uint32_t copied = 0, chunk;
+
+		while (copied < stack_size) {
+			chunk = (uint32_t)MIN(stack_size - copied,
+			    page_mask + 1 - ((sp + copied) & page_mask));
+			if (copyin(sp + copied, &region->data[copied], chunk) != 0) {
+				break;
+			}
+			copied += chunk;
+		}
+
+		region->address = sp;
+		region->size = copied;
+		region->flags = 0;
+		if (copied < stack_size) {
+			btinfo_flag |= TASK_BTINFO_FLAG_STACK_TRUNCATED;
+		}
+	}
+
 	/* Lastly, copy the flags to the address we reserved at the beginning. */
 	kcdata_memcpy(kcdata, btinfo_flag_addr, &btinfo_flag, sizeof(uint32_t));
 
@@ -319,6 +319,48 @@ memstat_bucket_t memstat_bucket[MEMSTAT_BUCKET_COUNT];
 static thread_call_t memorystatus_idle_demotion_call;
 uint64_t memstat_idle_demotion_deadline = 0;
 
+/*
+ * Generation counter for MEMORYSTATUS_CMD_GET_PRIORITY_LIST_DELTA.
+ * Bumped (under the proc_list_lock) whenever a process is added to,
+ * moved between or removed from the jetsam bands. Removed pids are
+ * remembered in a small ring; once a removal newer than the caller's
+ * generation falls out of it, the caller is told to resync.
+ */
+#define MEMSTAT_REMOVED_RING_SIZE       256
+
+typedef struct memstat_removed_entry {
+	pid_t           mre_pid;
+	uint64_t        mre_gen;
+} memstat_removed_entry_t;
+
+static uint64_t memorystatus_change_gen = 0;
+static memstat_removed_entry_t memstat_removed_ring[MEMSTAT_REMOVED_RING_SIZE];
+static uint32_t memstat_removed_count = 0;      /* total removals recorded, indexes the ring */
+static uint64_t memstat_removed_evicted_gen = 0;        /* generation of the last entry overwritten in the ring */
+
+static inline void
+memstat_note_change_locked(proc_t p)
+{
+	LCK_MTX_ASSERT(&proc_list_mlock, LCK_MTX_ASSERT_OWNED);
+	p->p_memstat_change_gen = ++memorystatus_change_gen;
+}
+
+static void
+memstat_note_removal_locked(proc_t p)
+{
+	memstat_removed_entry_t *entry;
+
+	LCK_MTX_ASSERT(&proc_list_mlock, LCK_MTX_ASSERT_OWNED);
+
+	entry = &memstat_removed_ring[memstat_removed_count % MEMSTAT_REMOVED_RING_SIZE];
+	if (memstat_removed_count >= MEMSTAT_REMOVED_RING_SIZE) {
+		memstat_removed_evicted_gen = entry->mre_gen;
+	}
+	entry->mre_pid = proc_getpid(p);
+	entry->mre_gen = ++memorystatus_change_gen;
+	memstat_removed_count++;
+}
+
 #ifdef XNU_TARGET_OS_OSX
 /*
  * Effectively disable the system process and application demotion
@@ -1141,21 +1183,41 @@ memorystatus_sort_bucket(unsigned int bucket_index, int sort_order)
 
 /*
  * Sort processes by size for a single jetsam bucket.
+ *
+ * Each process' footprint is read once into memstat_sort_scratch and the
+ * band is then rebuilt from a qsort of that array, instead of rescanning
+ * the band (and re-reading every footprint) for each position.
+ * The scratch array is protected by the proc_list_lock; bands that are
+ * larger than it fall back to the selection sort below.
  */
+#define MEMSTAT_SORT_SCRATCH_MAX        1024
+
+typedef struct memstat_proc_sort_entry {
+	proc_t          mpse_proc;
+	uint32_t        mpse_pages;
+	uint32_t        mpse_index;     /* position in the band, keeps the sort stable */
+} memstat_proc_sort_entry_t;
+
+static memstat_proc_sort_entry_t memstat_sort_scratch[MEMSTAT_SORT_SCRATCH_MAX];
+
+static int
+memstat_proc_desc_cmp(const void *a, const void *b)
+{
+	const memstat_proc_sort_entry_t *mpA = (const memstat_proc_sort_entry_t *)a;
+	const memstat_proc_sort_entry_t *mpB = (const memstat_proc_sort_entry_t *)b;
+
+	if (mpA->mpse_pages != mpB->mpse_pages) {
+		return mpA->mpse_pages > mpB->mpse_pages ? -1 : 1;
+	}
+	return mpA->mpse_index < mpB->mpse_index ? -1 : 1;
+}
 
 static void
-memorystatus_sort_by_largest_process_locked(unsigned int bucket_index)
+memorystatus_sort_by_largest_process_slow_locked(memstat_bucket_t *current_bucket)
 {
 	proc_t p = NULL, insert_after_proc = NULL, max_proc = NULL;
 	proc_t next_p = NULL, prev_max_proc = NULL;
 	uint32_t pages = 0, max_pages = 0;
-	memstat_bucket_t *current_bucket;
-
-	if (bucket_index >= MEMSTAT_BUCKET_COUNT) {
-		return;
-	}
-
-	current_bucket = &memstat_bucket[bucket_index];
 
 	p = TAILQ_FIRST(&current_bucket->list);
 
@@ -1192,6 +1254,49 @@ memorystatus_sort_by_largest_process_locked(unsigned int bucket_index)
 	}
 }
 
+static void
+memorystatus_sort_by_largest_process_locked(unsigned int bucket_index)
+{
+	memstat_bucket_t *current_bucket;
+	uint32_t count = 0;
+	proc_t p;
+
+	LCK_MTX_ASSERT(&proc_list_mlock, LCK_MTX_ASSERT_OWNED);
+
+	if (bucket_index >= MEMSTAT_BUCKET_COUNT) {
+		return;
+	}
+
+	current_bucket = &memstat_bucket[bucket_index];
+
+	if (current_bucket->count < 2) {
+		return;
+	}
+	if (current_bucket->count > MEMSTAT_SORT_SCRATCH_MAX) {
+		memorystatus_sort_by_largest_process_slow_locked(current_bucket);
+		return;
+	}
+
+	TAILQ_FOREACH(p, &current_bucket->list, p_memstat_list) {
+		if (count == MEMSTAT_SORT_SCRATCH_MAX) {
+			break;
+		}
+		memstat_sort_scratch[count].mpse_proc = p;
+		memorystatus_get_task_page_counts(proc_task(p), &memstat_sort_scratch[count].mpse_pages, NULL, NULL);
+		memstat_sort_scratch[count].mpse_index = count;
+		count++;
+	}
+
+	qsort(memstat_sort_scratch, count, sizeof(memstat_proc_sort_entry_t), memstat_proc_desc_cmp);
+
+	for (uint32_t i = 0; i < count; i++) {
+		p = memstat_sort_scratch[i].mpse_proc;
+		TAILQ_REMOVE(&current_bucket->list, p, p_memstat_list);
+		TAILQ_INSERT_TAIL(&current_bucket->list, p, p_memstat_list);
+		memstat_sort_scratch[i].mpse_proc = PROC_NULL;
+	}
+}
+
 proc_t
 memorystatus_get_first_proc_locked(unsigned int *bucket_index, boolean_t search)
 {
@@ -1998,6 +2103,7 @@ memorystatus_add(proc_t p, boolean_t locked)
 	}
 
 	memorystatus_list_count++;
+	memstat_note_change_locked(p);
 
 	memorystatus_check_levels_locked();
 
@@ -2255,6 +2361,7 @@ memorystatus_update_priority_locked(proc_t p, int priority, boolean_t head_inser
 	KERNEL_DEBUG_CONSTANT(BSDDBG_CODE(DBG_BSD_MEMSTAT, BSD_MEMSTAT_CHANGE_PRIORITY), proc_getpid(p), priority, p->p_memstat_effectivepriority, 0, 0);
 
 	p->p_memstat_effectivepriority = priority;
+	memstat_note_change_locked(p);
 
 #if CONFIG_SECLUDED_MEMORY
 	if (secluded_for_apps &&
@@ -2657,6 +2764,7 @@ memorystatus_remove(proc_t p)
 	}
 
 	memorystatus_list_count--;
+	memstat_note_removal_locked(p);
 
 	/* If awaiting demotion to the idle band, clean up */
 	if (reschedule) {
@@ -6545,6 +6653,112 @@ memorystatus_cmd_get_priority_list(pid_t pid, user_addr_t buffer, size_t buffer_
 	return error;
 }
 
+/*
+ * Fills the buffer with a memorystatus_priority_delta_header_t followed
+ * by the entries changed and the pids removed since the generation the
+ * caller passes in the header.
+ */
+static int
+memorystatus_cmd_get_priority_list_delta(user_addr_t buffer, size_t buffer_size, int32_t *retval)
+{
+	memorystatus_priority_delta_header_t header;
+	memorystatus_priority_entry_t *entries;
+	pid_t *removed;
+	uint32_t max_entries, max_removed, i = 0;
+	uint64_t since;
+	size_t entries_size, removed_size, total_size;
+	proc_t p;
+	int error;
+
+	if (buffer == USER_ADDR_NULL || buffer_size < sizeof(header)) {
+		return EINVAL;
+	}
+
+	error = copyin(buffer, &header, sizeof(header));
+	if (error) {
+		return error;
+	}
+	since = header.generation;
+
+	max_removed = MEMSTAT_REMOVED_RING_SIZE;
+	removed_size = max_removed * sizeof(pid_t);
+	if (buffer_size < sizeof(header) + removed_size) {
+		return EINVAL;
+	}
+	max_entries = (uint32_t)((buffer_size - sizeof(header) - removed_size) / sizeof(memorystatus_priority_entry_t));
+	entries_size = max_entries * sizeof(memorystatus_priority_entry_t);
+
+	entries = kalloc_data(entries_size, Z_WAITOK | Z_ZERO);
+	removed = kalloc_data(removed_size, Z_WAITOK | Z_ZERO);
+	if ((entries_size && entries == NULL) || removed == NULL) {
+		kfree_data(entries, entries_size);
+		kfree_data(removed, removed_size);
+		return ENOMEM;
+	}
+
+	bzero(&header, sizeof(header));
+
+	proc_list_lock();
+
+	p = memorystatus_get_first_proc_locked(&i, TRUE);
+	while (p) {
+		if (p->p_memstat_change_gen > since) {
+			if (header.changed_count == max_entries) {
+				header.flags |= MEMORYSTATUS_DELTA_OVERFLOW;
+				break;
+			}
+			memorystatus_priority_entry_t *entry = &entries[header.changed_count++];
+
+			entry->pid = proc_getpid(p);
+			entry->priority = p->p_memstat_effectivepriority;
+			entry->user_data = p->p_memstat_userdata;
+			if (p->p_memstat_memlimit <= 0) {
+				task_get_phys_footprint_limit(proc_task(p), &entry->limit);
+			} else {
+				entry->limit = p->p_memstat_memlimit;
+			}
+			entry->state = memorystatus_build_state(p);
+		}
+		p = memorystatus_get_next_proc_locked(&i, p, TRUE);
+	}
+
+	if (memstat_removed_evicted_gen > since) {
+		header.flags |= MEMORYSTATUS_DELTA_OVERFLOW;
+	}
+	for (uint32_t n = MIN(memstat_removed_count, max_removed); n > 0; n--) {
+		memstat_removed_entry_t *entry;
+
+		entry = &memstat_removed_ring[(memstat_removed_count - n) % MEMSTAT_REMOVED_RING_SIZE];
+		if (entry->mre_gen > since) {
+			removed[header.removed_count++] = entry->mre_pid;
+		}
+	}
+
+	header.generation = memorystatus_change_gen;
+
+	proc_list_unlock();
+
+	entries_size = header.changed_count * sizeof(memorystatus_priority_entry_t);
+	removed_size = header.removed_count * sizeof(pid_t);
+	total_size = sizeof(header) + entries_size + removed_size;
+
+	error = copyout(&header, buffer, sizeof(header));
+	if (error == 0 && entries_size) {
+		error = copyout(entries, buffer + sizeof(header), entries_size);
+	}
+	if (error == 0 && removed_size) {
+		error = copyout(removed, buffer + sizeof(header) + entries_size, removed_size);
+	}
+
+	kfree_data(entries, max_entries * sizeof(memorystatus_priority_entry_t));
+	kfree_data(removed, max_removed * sizeof(pid_t));
+
+	if (error == 0) {
+		*retval = (int32_t)total_size;
+	}
+	return error;
+}
+
 static void
 memorystatus_clear_errors(void)
 {
@@ -7978,6 +8192,9 @@ memorystatus_control(struct proc *p, struct memorystatus_control_args *args, int
 	case MEMORYSTATUS_CMD_GET_PRIORITY_LIST:
 		error = memorystatus_cmd_get_priority_list(args->pid, args->buffer, args->buffersize, ret);
 		break;
+	case MEMORYSTATUS_CMD_GET_PRIORITY_LIST_DELTA:
+		error = memorystatus_cmd_get_priority_list_delta(args->buffer, args->buffersize, ret);
+		break;
 	case MEMORYSTATUS_CMD_SET_PRIORITY_PROPERTIES:
 		error = memorystatus_cmd_set_priority_properties(args->pid, args->flags, args->buffer, args->buffersize, ret);
 		break;
@@ -156,6 +156,22 @@ static bool kill_all_frozen_processes(uint64_t max_band, bool suspended_only, os
 /* Stats */
 static uint64_t memorystatus_freeze_pageouts = 0;
 
+/*
+ * Background pre-compaction: every memorystatus_freeze_precompact_interval_secs,
+ * while available memory is within memorystatus_freeze_precompact_threshold_multiplier
+ * times the freeze threshold, queue the cold pages of the next few freeze candidates
+ * for compression.  The freeze itself then mostly relocates compressed data instead
+ * of compressing the whole task synchronously.
+ */
+unsigned int memorystatus_freeze_precompact_interval_secs = 30; /* 0 stops pre-compaction until reboot */
+unsigned int memorystatus_freeze_precompact_candidates = 2;
+unsigned int memorystatus_freeze_precompact_pages_max = 4096; /* per pass, across all candidates */
+unsigned int memorystatus_freeze_precompact_threshold_multiplier = 2;
+static uint64_t memorystatus_freeze_precompacted_pages = 0;
+static thread_call_t freeze_precompact_thread_call;
+static void memorystatus_freeze_precompact(thread_call_param_t, thread_call_param_t);
+static void memorystatus_freeze_precompact_schedule(void);
+
 /* Throttling */
 #define DEGRADED_WINDOW_MINS    (30)
 #define NORMAL_WINDOW_MINS      (24 * 60)
@@ -207,6 +223,7 @@ SYSCTL_UINT(_kern, OID_AUTO, memorystatus_freeze_count_xpc_service, CTLFLAG_RD |
 SYSCTL_UINT(_kern, OID_AUTO, memorystatus_thaw_count, CTLFLAG_RD | CTLFLAG_LOCKED, &memorystatus_thaw_count, 0, "");
 SYSCTL_QUAD(_kern, OID_AUTO, memorystatus_thaw_count_since_boot, CTLFLAG_RD | CTLFLAG_LOCKED, &memorystatus_thaw_count_since_boot, "");
 SYSCTL_QUAD(_kern, OID_AUTO, memorystatus_freeze_pageouts, CTLFLAG_RD | CTLFLAG_LOCKED, &memorystatus_freeze_pageouts, "");
+SYSCTL_QUAD(_kern, OID_AUTO, memorystatus_freeze_precompacted_pages, CTLFLAG_RD | CTLFLAG_LOCKED, &memorystatus_freeze_precompacted_pages, "");
 SYSCTL_UINT(_kern, OID_AUTO, memorystatus_freeze_interval, CTLFLAG_RD | CTLFLAG_LOCKED, &memorystatus_freeze_current_interval, 0, "");
 
 /*
@@ -485,6 +502,11 @@ SYSCTL_UINT(_kern, OID_AUTO, memorystatus_freeze_throttle_enabled, CTLFLAG_RW |
 boolean_t memorystatus_freeze_to_memory = FALSE;
 SYSCTL_UINT(_kern, OID_AUTO, memorystatus_freeze_to_memory, CTLFLAG_RW | CTLFLAG_LOCKED, &memorystatus_freeze_to_memory, 0, "");
 
+SYSCTL_UINT(_kern, OID_AUTO, memorystatus_freeze_precompact_interval_secs, CTLFLAG_RW | CTLFLAG_LOCKED, &memorystatus_freeze_precompact_interval_secs, 0, "");
+SYSCTL_UINT(_kern, OID_AUTO, memorystatus_freeze_precompact_candidates, CTLFLAG_RW | CTLFLAG_LOCKED, &memorystatus_freeze_precompact_candidates, 0, "");
+SYSCTL_UINT(_kern, OID_AUTO, memorystatus_freeze_precompact_pages_max, CTLFLAG_RW | CTLFLAG_LOCKED, &memorystatus_freeze_precompact_pages_max, 0, "");
+SYSCTL_UINT(_kern, OID_AUTO, memorystatus_freeze_precompact_threshold_multiplier, CTLFLAG_RW | CTLFLAG_LOCKED, &memorystatus_freeze_precompact_threshold_multiplier, 0, "");
+
 #define VM_PAGES_FOR_ALL_PROCS    (2)
 
 /*
@@ -1665,6 +1687,8 @@ memorystatus_freeze_init(void)
 		}
 
 		freeze_interval_reset_thread_call = thread_call_allocate_with_options(memorystatus_freeze_reset_interval, NULL, THREAD_CALL_PRIORITY_KERNEL, THREAD_CALL_OPTIONS_ONCE);
+		freeze_precompact_thread_call = thread_call_allocate_with_options(memorystatus_freeze_precompact, NULL, THREAD_CALL_PRIORITY_LOW, THREAD_CALL_OPTIONS_ONCE);
+		memorystatus_freeze_precompact_schedule();
 		/* Start a new interval */
 
 		lck_mtx_lock(&freezer_mutex);
@@ -2134,6 +2158,81 @@ memorystatus_freeze_top_process(void)
 	return num_frozen;
 }
 
+static void
+memorystatus_freeze_precompact_schedule(void)
+{
+	uint64_t interval_absolutetime;
+
+	if (memorystatus_freeze_precompact_interval_secs == 0) {
+		return;
+	}
+	nanoseconds_to_absolutetime(memorystatus_freeze_precompact_interval_secs * NSEC_PER_SEC, &interval_absolutetime);
+	thread_call_enter_delayed(freeze_precompact_thread_call, mach_absolute_time() + interval_absolutetime);
+}
+
+/*
+ * Walk the next memorystatus_freeze_precompact_candidates freezer candidates,
+ * in the order the freezer thread would pick them, and queue their cold pages
+ * for compression.  Skipped entirely if the freezer is busy.
+ */
+static void
+memorystatus_freeze_precompact(thread_call_param_t arg0 __unused, thread_call_param_t arg1 __unused)
+{
+	struct memorystatus_freeze_list_iterator iterator;
+	uint32_t budget = memorystatus_freeze_precompact_pages_max;
+	uint32_t precompacted;
+	unsigned int candidates = 0;
+	kern_return_t kr;
+	proc_t p;
+
+	if (!lck_mtx_try_lock(&freezer_mutex)) {
+		goto out;
+	}
+
+	if (!memorystatus_freeze_enabled ||
+	    memorystatus_available_pages > memorystatus_freeze_threshold * memorystatus_freeze_precompact_threshold_multiplier) {
+		lck_mtx_unlock(&freezer_mutex);
+		goto out;
+	}
+
+	bzero(&iterator, sizeof(struct memorystatus_freeze_list_iterator));
+
+	proc_list_lock();
+	while (candidates < memorystatus_freeze_precompact_candidates && budget > 0 &&
+	    !vm_compressor_low_on_space()) {
+		p = memorystatus_freeze_pick_process(&iterator);
+		if (p == PROC_NULL) {
+			break;
+		}
+		candidates++;
+
+		p = proc_ref(p, true);
+		if (p == PROC_NULL) {
+			continue;
+		}
+		/* Mark as locked temporarily to avoid kill */
+		p->p_memstat_state |= P_MEMSTAT_LOCKED;
+		proc_list_unlock();
+
+		kr = task_freeze_precompact(proc_task(p), budget, &precompacted);
+
+		proc_list_lock();
+		p->p_memstat_state &= ~P_MEMSTAT_LOCKED;
+		wakeup(&p->p_memstat_state);
+		proc_rele(p);
+
+		if (kr == KERN_SUCCESS) {
+			budget -= MIN(budget, precompacted);
+			memorystatus_freeze_precompacted_pages += precompacted;
+		}
+	}
+	proc_list_unlock();
+
+	lck_mtx_unlock(&freezer_mutex);
+out:
+	memorystatus_freeze_precompact_schedule();
+}
+
 #if DEVELOPMENT || DEBUG
 /* For testing memorystatus_freeze_top_process */
 static int
@@ -183,6 +183,7 @@ extern int       jld_idle_kill_candidates;
  * VM globals read by the memorystatus subsystem
  */
 extern unsigned int    vm_page_free_count;
+extern unsigned int    vm_page_free_cached_count;
 extern unsigned int    vm_page_active_count;
 extern unsigned int    vm_page_inactive_count;
 extern unsigned int    vm_page_throttled_count;
@@ -202,7 +203,7 @@ void vm_compressor_process_special_swapped_in_segments(void);
 #if CONFIG_JETSAM
 #define MEMORYSTATUS_LOG_AVAILABLE_PAGES memorystatus_available_pages
 #else /* CONFIG_JETSAM */
-#define MEMORYSTATUS_LOG_AVAILABLE_PAGES (vm_page_active_count + vm_page_inactive_count + vm_page_free_count + vm_page_speculative_count)
+#define MEMORYSTATUS_LOG_AVAILABLE_PAGES (vm_page_active_count + vm_page_inactive_count + vm_page_free_count + vm_page_free_cached_count + vm_page_speculative_count)
 #endif /* CONFIG_JETSAM */
 
 bool memorystatus_avail_pages_below_pressure(void);
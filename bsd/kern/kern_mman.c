@@ -186,6 +186,7 @@ mmap(proc_t p, struct mmap_args *uap, user_addr_t *retval)
 	 */
 	struct fileproc *fp;
 	struct                  vnode *vp;
+	struct                  vnode *lvp;
 	int                     flags;
 	int                     prot;
 	int                     err = 0;
@@ -603,6 +604,24 @@ mmap(proc_t p, struct mmap_args *uap, user_addr_t *retval)
 				(void)vnode_put(vp);
 				goto bad;
 			}
+
+			/*
+			 * A passthrough layer (nullfs/bindfs) shares its lower
+			 * vnode's page cache: map the lower memory object so the
+			 * pages are not copied into the upper vnode's UBC too.
+			 * Executable mappings stay on the upper vnode, since any
+			 * code signatures were attached there.
+			 */
+			if ((prot & PROT_EXEC) == 0 &&
+			    vnode_getpassthroughvnode(vp, &lvp) == 0) {
+				if (lvp->v_type == VREG) {
+					(void)vnode_put(vp);
+					vp = lvp;
+					handle = (void *)vp;
+				} else {
+					(void)vnode_put(lvp);
+				}
+			}
 		}
 
 		/*
@@ -104,6 +104,37 @@ static LCK_GRP_DECLARE(sysctl_lock_group, "sysctl");
 static LCK_RW_DECLARE(sysctl_geometry_lock, &sysctl_lock_group);
 static LCK_MTX_DECLARE(sysctl_unlocked_node_lock, &sysctl_lock_group);
 
+/*
+ * Bumped under the exclusive geometry lock whenever an OID is added or
+ * removed, so that cached name translations can be recognized as stale.
+ */
+static uint64_t sysctl_geometry_gen;
+
+/*
+ * Cache of name to OID translations for sysctlbyname().
+ *
+ * Each entry is protected by a sequence count: writers claim an entry by
+ * moving the count from even to odd, and readers retry-free discard what
+ * they copied if the count changed underneath them.  Lookups and fills only
+ * happen with the geometry lock held shared, so the generation is stable
+ * for their duration.
+ */
+#define SYSCTL_NAME_CACHE_SIZE          128
+#define SYSCTL_NAME_CACHE_NAMELEN       64
+
+struct sysctl_name_cache_entry {
+	uint32_t        snce_seq;
+	uint32_t        snce_len;
+	uint64_t        snce_gen;
+	int             snce_oid[CTL_MAXNAME];
+	char            snce_name[SYSCTL_NAME_CACHE_NAMELEN];
+};
+
+static struct sysctl_name_cache_entry sysctl_name_cache[SYSCTL_NAME_CACHE_SIZE];
+
+SCALABLE_COUNTER_DEFINE(sysctl_name_cache_hits);
+SCALABLE_COUNTER_DEFINE(sysctl_name_cache_misses);
+
 /*
  * Conditionally allow dtrace to see these functions for debugging purposes.
  */
@@ -128,10 +159,12 @@ STATIC int sysctl_sysctl_next_ls(struct sysctl_oid_list *lsp,
 STATIC int sysctl_old_kernel(struct sysctl_req *req, const void *p, size_t l);
 STATIC int sysctl_new_kernel(struct sysctl_req *req, void *p, size_t l);
 STATIC int name2oid(char *name, int *oid, size_t *len);
+STATIC int name2oid_cached(char *name, int *oid, size_t *len);
 STATIC int sysctl_sysctl_name2oid(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
 STATIC int sysctl_sysctl_next(struct sysctl_oid *oidp, void *arg1, int arg2,
     struct sysctl_req *req);
 STATIC int sysctl_sysctl_oidfmt(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
+STATIC int sysctl_sysctl_batch(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
 STATIC int sysctl_old_user(struct sysctl_req *req, const void *p, size_t l);
 STATIC int sysctl_new_user(struct sysctl_req *req, void *p, size_t l);
 
@@ -239,6 +272,7 @@ sysctl_register_oid_locked(struct sysctl_oid *new_oidp,
 
 	SLIST_NEXT(oidp, oid_link) = *prevp;
 	*prevp = oidp;
+	os_atomic_inc(&sysctl_geometry_gen, relaxed);
 }
 
 void
@@ -382,6 +416,10 @@ sysctl_unregister_oid(struct sysctl_oid *oidp)
 	}
 #endif /* defined(HAS_APPLE_PAC) */
 
+	if (removed_oidp) {
+		os_atomic_inc(&sysctl_geometry_gen, relaxed);
+	}
+
 	/*
 	 * We've removed it from the list at this point, but we don't want
 	 * to return to the caller until all handler references have drained
@@ -1142,6 +1180,65 @@ name2oid(char *name, int *oid, size_t *len)
 	return ENOENT;
 }
 
+/*
+ * name2oid_cached
+ *
+ * Description:	Same as name2oid(), consulting and filling the name cache
+ *		first.  Names that do not fit in a cache entry always take
+ *		the slow path.
+ *
+ * Locks:	Assumes sysctl_geometry_lock is held prior to calling
+ */
+STATIC int
+name2oid_cached(char *name, int *oid, size_t *len)
+{
+	struct sysctl_name_cache_entry *snce;
+	char key[SYSCTL_NAME_CACHE_NAMELEN];
+	uint64_t gen = os_atomic_load(&sysctl_geometry_gen, relaxed);
+	size_t namelen = strlen(name);
+	uint32_t seq;
+	int error;
+
+	if (namelen == 0 || namelen >= SYSCTL_NAME_CACHE_NAMELEN) {
+		return name2oid(name, oid, len);
+	}
+	strlcpy(key, name, sizeof(key));
+	snce = &sysctl_name_cache[os_hash_jenkins(key, namelen) % SYSCTL_NAME_CACHE_SIZE];
+
+	seq = os_atomic_load(&snce->snce_seq, acquire);
+	if ((seq & 1) == 0 && snce->snce_gen == gen && snce->snce_len != 0 &&
+	    strncmp(snce->snce_name, key, sizeof(key)) == 0) {
+		size_t cached_len = MIN(snce->snce_len, CTL_MAXNAME);
+
+		memcpy(oid, snce->snce_oid, cached_len * sizeof(int));
+		os_atomic_thread_fence(acquire);
+		if (os_atomic_load(&snce->snce_seq, relaxed) == seq) {
+			*len = cached_len;
+			counter_inc(&sysctl_name_cache_hits);
+			return 0;
+		}
+	}
+
+	counter_inc(&sysctl_name_cache_misses);
+	error = name2oid(name, oid, len);
+	if (error) {
+		return error;
+	}
+
+	/* Don't wait for a concurrent filler; the next lookup can try again */
+	seq = os_atomic_load(&snce->snce_seq, relaxed);
+	if ((seq & 1) == 0 &&
+	    os_atomic_cmpxchg(&snce->snce_seq, seq, seq + 1, acquire)) {
+		snce->snce_gen = gen;
+		snce->snce_len = (uint32_t)*len;
+		memcpy(snce->snce_oid, oid, *len * sizeof(int));
+		strlcpy(snce->snce_name, key, sizeof(snce->snce_name));
+		os_atomic_store(&snce->snce_seq, seq + 2, release);
+	}
+
+	return 0;
+}
+
 /*
  * sysctl_sysctl_name2oid
  *
@@ -1214,7 +1311,7 @@ sysctl_sysctl_name2oid(__unused struct sysctl_oid *oidp, __unused void *arg1,
 	 *		avoid making name2oid needlessly complex.
 	 */
 	lck_rw_lock_shared(&sysctl_geometry_lock);
-	error = name2oid(p, oid, &len);
+	error = name2oid_cached(p, oid, &len);
 	lck_rw_done(&sysctl_geometry_lock);
 
 	kfree_data(p, req->newlen + 1);
@@ -1327,6 +1424,121 @@ err:
 
 SYSCTL_NODE(_sysctl, 4, oidfmt, CTLFLAG_RD | CTLFLAG_LOCKED, sysctl_sysctl_oidfmt, "");
 
+/*
+ * sysctl_sysctl_batch
+ *
+ * Description:	Read several OIDs with a single trip into the kernel
+ *
+ * Args:	oidp				(ignored)
+ *		arg1				(ignored)
+ *		arg2				(ignored)
+ *		req				Pointer to user request data
+ *
+ * Returns:	0				Success
+ *		EINVAL				Invalid batch
+ *		ENOMEM				Insufficient memory
+ *	SYSCTL_IN/OUT:EPERM			Permission denied
+ *	SYSCTL_IN/OUT:EFAULT			Bad user supplied buffer
+ *	SYSCTL_IN/OUT:???			Return value from user function
+ *						for SYSCTL_IN/OUT
+ *
+ * Implicit:	*req				Modified request structure.
+ *
+ * Locks:	Each entry is dispatched through sysctl_root(), which acquires
+ *		and releases the sysctl_geometry_lock as usual.
+ *
+ * Notes:	The new value is an array of struct sysctl_batch_entry.  The
+ *		old value receives the updated array, followed by the value of
+ *		each entry at its sbe_offset; a failing entry reports its own
+ *		error in sbe_error without failing the batch.  Each value is
+ *		read as with sysctl(3), including the MAC checks, so a batch
+ *		can never read anything its caller could not read one at a
+ *		time.  Entries may not refer to the sysctl.* meta-OIDs.
+ */
+STATIC int
+sysctl_sysctl_batch(__unused struct sysctl_oid *oidp, __unused void *arg1,
+    __unused int arg2, struct sysctl_req *req)
+{
+	struct sysctl_batch_entry *entries;
+	struct sysctl_req subreq;
+	char *namestring;
+	size_t count, entries_size, offset, oldlen;
+	int error;
+
+	if (req->newptr == USER_ADDR_NULL || req->newlen == 0 ||
+	    req->newlen % sizeof(struct sysctl_batch_entry) != 0) {
+		return EINVAL;
+	}
+	count = req->newlen / sizeof(struct sysctl_batch_entry);
+	if (count > SYSCTL_BATCH_MAX) {
+		return EINVAL;
+	}
+	entries_size = count * sizeof(struct sysctl_batch_entry);
+
+	/* Size probes and in-kernel callers aren't supported */
+	if (req->oldptr == USER_ADDR_NULL || req->oldfunc != sysctl_old_user ||
+	    req->oldlen < entries_size) {
+		return EINVAL;
+	}
+
+	entries = kalloc_data(entries_size, Z_WAITOK | Z_ZERO);
+	namestring = kalloc_data(MAXPATHLEN, Z_WAITOK);
+	if (entries == NULL || namestring == NULL) {
+		error = ENOMEM;
+		goto out;
+	}
+
+	error = SYSCTL_IN(req, entries, entries_size);
+	if (error) {
+		goto out;
+	}
+
+	offset = roundup(entries_size, sizeof(uint64_t));
+	for (size_t i = 0; i < count; i++) {
+		struct sysctl_batch_entry *sbe = &entries[i];
+		size_t avail = 0;
+
+		sbe->sbe_offset = (uint32_t)offset;
+		if (sbe->sbe_namelen < 2 || sbe->sbe_namelen > CTL_MAXNAME ||
+		    sbe->sbe_name[0] == CTL_UNSPEC) {
+			sbe->sbe_size = 0;
+			sbe->sbe_error = EINVAL;
+			continue;
+		}
+
+		if (offset < req->oldlen) {
+			avail = MIN(req->oldlen - offset, sbe->sbe_size);
+		}
+		sysctl_create_user_req(&subreq, req->p, req->oldptr + offset,
+		    avail, USER_ADDR_NULL, 0);
+		oldlen = 0;
+		sbe->sbe_error = userland_sysctl(FALSE, namestring, MAXPATHLEN,
+		    sbe->sbe_name, sbe->sbe_namelen, &subreq, &oldlen);
+		sbe->sbe_size = (uint32_t)oldlen;
+
+		if (sbe->sbe_error == 0) {
+			offset = roundup(offset + oldlen, sizeof(uint64_t));
+		}
+	}
+
+	error = SYSCTL_OUT(req, entries, entries_size);
+	if (error == 0) {
+		req->oldidx = MIN(offset, req->oldlen);
+	}
+
+out:
+	if (namestring) {
+		kfree_data(namestring, MAXPATHLEN);
+	}
+	if (entries) {
+		kfree_data(entries, entries_size);
+	}
+	return error;
+}
+
+SYSCTL_PROC(_sysctl, 5, batch, CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_ANYBODY | CTLFLAG_LOCKED, 0, 0,
+    sysctl_sysctl_batch, "S,sysctl_batch_entry", "");
+
 
 /*
  * Default "handler" functions.
@@ -1608,7 +1820,7 @@ sysctl_root(boolean_t from_kernel, boolean_t string_is_canonical,
 
 	if (string_is_canonical) {
 		/* namestring is actually canonical, name/namelen needs to be populated */
-		error = name2oid(namestring, name, &namelen);
+		error = name2oid_cached(namestring, name, &namelen);
 		if (error) {
 			goto err;
 		}
@@ -2297,6 +2509,41 @@ SYSCTL_PROC(_vm, OID_AUTO, reclaim_drain_async_queue,
 
 extern uint64_t vm_reclaim_max_threshold;
 SYSCTL_QUAD(_vm, OID_AUTO, reclaim_max_threshold, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_reclaim_max_threshold, "");
+
+extern size_t vm_deferred_reclamation_reclaim_bytes(size_t bytes_goal);
+
+static int
+sysctl_vm_reclaim_bytes SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2)
+	int error;
+	uint64_t goal = 0;
+
+	error = sysctl_handle_quad(oidp, &goal, 0, req);
+	if (error || !req->newptr) {
+		return error;
+	}
+
+	(void) vm_deferred_reclamation_reclaim_bytes((size_t) goal);
+	return 0;
+}
+
+SYSCTL_PROC(_vm, OID_AUTO, reclaim_bytes,
+    CTLTYPE_QUAD | CTLFLAG_WR | CTLFLAG_LOCKED | CTLFLAG_MASKED, 0, 0,
+    &sysctl_vm_reclaim_bytes, "Q", "");
+
+extern uint32_t vm_reclaim_thread_count;
+extern uint64_t vm_reclaim_entries_coalesced;
+extern uint64_t vm_reclaim_bytes_requests;
+extern uint64_t vm_reclaim_bytes_reclaimed;
+extern uint64_t vm_reclaim_bytes_latency_total_ns;
+extern uint64_t vm_reclaim_bytes_latency_max_ns;
+SYSCTL_UINT(_vm, OID_AUTO, reclaim_threads, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_reclaim_thread_count, 0, "");
+SYSCTL_QUAD(_vm, OID_AUTO, reclaim_entries_coalesced, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_reclaim_entries_coalesced, "");
+SYSCTL_QUAD(_vm, OID_AUTO, reclaim_bytes_requests, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_reclaim_bytes_requests, "");
+SYSCTL_QUAD(_vm, OID_AUTO, reclaim_bytes_reclaimed, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_reclaim_bytes_reclaimed, "");
+SYSCTL_QUAD(_vm, OID_AUTO, reclaim_bytes_latency_total_ns, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_reclaim_bytes_latency_total_ns, "");
+SYSCTL_QUAD(_vm, OID_AUTO, reclaim_bytes_latency_max_ns, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_reclaim_bytes_latency_max_ns, "");
 #endif /* CONFIG_DEFERRED_RECLAIM */
 
 kern_return_t
@@ -2363,6 +2610,73 @@ sysctl_perf_compressor SYSCTL_HANDLER_ARGS
  */
 SYSCTL_PROC(_kern, OID_AUTO, perf_compressor, CTLFLAG_WR | CTLFLAG_MASKED | CTLTYPE_STRUCT,
     0, 0, sysctl_perf_compressor, "S", "Compressor & swap benchmark");
+
+kern_return_t
+run_codec_perf_test(
+	user_addr_t buf,
+	size_t buffer_size,
+	uint32_t codec,
+	uint64_t *encode_time,
+	uint64_t *decode_time,
+	uint64_t *bytes_encoded);
+
+struct perf_codec_data {
+	user_addr_t buffer;
+	size_t buffer_size;
+	uint32_t codec;
+	uint32_t reserved;
+	uint64_t encode_time;
+	uint64_t decode_time;
+	uint64_t bytes_encoded;
+};
+
+static int
+sysctl_perf_codec SYSCTL_HANDLER_ARGS
+{
+	int error = EINVAL;
+	size_t len = sizeof(struct perf_codec_data);
+	struct perf_codec_data benchmark_data = {0};
+
+	if (req->oldptr == USER_ADDR_NULL || req->oldlen != len ||
+	    req->newptr == USER_ADDR_NULL || req->newlen != len) {
+		return EINVAL;
+	}
+
+	error = SYSCTL_IN(req, &benchmark_data, len);
+	if (error) {
+		return error;
+	}
+
+	kern_return_t ret = run_codec_perf_test(benchmark_data.buffer, benchmark_data.buffer_size,
+	    benchmark_data.codec, &benchmark_data.encode_time, &benchmark_data.decode_time,
+	    &benchmark_data.bytes_encoded);
+	switch (ret) {
+	case KERN_SUCCESS:
+		error = 0;
+		break;
+	case KERN_INVALID_ARGUMENT:
+		error = EINVAL;
+		break;
+	case KERN_RESOURCE_SHORTAGE:
+		error = ENOMEM;
+		break;
+	default:
+		/* Round trip mismatch */
+		error = EIO;
+		break;
+	}
+	if (error != 0) {
+		return error;
+	}
+
+	return SYSCTL_OUT(req, &benchmark_data, len);
+}
+
+/*
+ * WKdm / LZ4 codec throughput test
+ */
+SYSCTL_PROC(_kern, OID_AUTO, perf_codec, CTLFLAG_WR | CTLFLAG_MASKED | CTLTYPE_STRUCT,
+    0, 0, sysctl_perf_codec, "S", "Compressor codec throughput benchmark");
 #endif /* DEVELOPMENT || DEBUG */
 
 #if CONFIG_JETSAM
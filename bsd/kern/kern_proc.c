@@ -2045,6 +2045,41 @@ phash_remove_locked(pid_t pid, struct proc *p)
 	smr_serialized_store_relaxed(prev, pn);
 }
 
+/*
+ * Visit every process in the pid hash without taking the proc list lock.
+ *
+ * Each bucket is walked in its own SMR section: `fn` runs with preemption
+ * disabled, must not block, and must not use `p` after returning.
+ * Processes concurrently forking, exec'ing or being reaped may or may not
+ * be visited.  Iteration stops as soon as `fn` returns false.
+ */
+void
+phash_foreach_smr(bool (^fn)(proc_t p))
+{
+	LCK_MTX_ASSERT(&proc_list_mlock, LCK_MTX_ASSERT_NOTOWNED);
+
+	for (u_long i = 0; i <= pidhash; i++) {
+		bool done = false;
+
+		smr_global_enter();
+		for (proc_t p = smr_entered_load(&pidhashtbl[i]); p;
+		    p = smr_entered_load(&p->p_hash)) {
+			if (p->p_proc_ro == NULL || proc_is_shadow(p)) {
+				continue;
+			}
+			if (!fn(p)) {
+				done = true;
+				break;
+			}
+		}
+		smr_global_leave();
+
+		if (done) {
+			break;
+		}
+	}
+}
+
 proc_t
 proc_find(int pid)
 {
@@ -1380,7 +1380,6 @@ copyin_user_iovec_array(user_addr_t uaddr, int spacetype, int count, struct user
 {
 	size_t size_of_iovec = (spacetype == UIO_USERSPACE64 ? sizeof(struct user64_iovec) : sizeof(struct user32_iovec));
 	int error;
-	int i;
 
 	// copyin to the front of "dst", without regard for putting records in the right places
 	error = copyin(uaddr, dst, count * size_of_iovec);
@@ -1388,7 +1387,20 @@ copyin_user_iovec_array(user_addr_t uaddr, int spacetype, int count, struct user
 		return error;
 	}
 
-	// now, unpack the entries in reverse order, so we don't overwrite anything
+	unpack_user_iovec_array(spacetype, count, dst);
+	return 0;
+}
+
+/*
+ * Expand "count" user32/user64 iovecs copied in to the front of "dst"
+ * into struct user_iovec records.
+ */
+void
+unpack_user_iovec_array(int spacetype, int count, struct user_iovec *dst)
+{
+	int i;
+
+	// unpack the entries in reverse order, so we don't overwrite anything
 	for (i = count - 1; i >= 0; i--) {
 		if (spacetype == UIO_USERSPACE64) {
 			struct user64_iovec iovec = ((struct user64_iovec *)dst)[i];
@@ -1400,6 +1412,4 @@ copyin_user_iovec_array(user_addr_t uaddr, int spacetype, int count, struct user
 			dst[i].iov_len = iovec.iov_len;
 		}
 	}
-
-	return 0;
 }
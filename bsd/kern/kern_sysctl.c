@@ -132,6 +132,7 @@
 #include <vm/vm_kern.h>
 #include <vm/vm_map.h>
 #include <mach/host_info.h>
+#include <mach_debug/lockgroup_info.h>
 #include <kern/hvg_hypercall.h>
 
 #include <sys/mount_internal.h>
@@ -3129,6 +3130,7 @@ enum {
 	LATENCY, LATENCY_MIN, LATENCY_MAX, LONG_TERM_SCAN_LIMIT,
 	LONG_TERM_SCAN_INTERVAL, LONG_TERM_SCAN_PAUSES,
 	SCAN_LIMIT, SCAN_INTERVAL, SCAN_PAUSES, SCAN_POSTPONES,
+	LONG_TERM_WHEEL_CASCADES,
 };
 extern uint64_t timer_sysctl_get(int);
 extern int      timer_sysctl_set(int, uint64_t);
@@ -3167,6 +3169,9 @@ SYSCTL_PROC(_kern_timer_longterm, OID_AUTO, qlen,
 SYSCTL_PROC(_kern_timer_longterm, OID_AUTO, scan_pauses,
     CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED,
     (void *) LONG_TERM_SCAN_PAUSES, 0, sysctl_timer, "Q", "");
+SYSCTL_PROC(_kern_timer_longterm, OID_AUTO, wheel_cascades,
+    CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED,
+    (void *) LONG_TERM_WHEEL_CASCADES, 0, sysctl_timer, "Q", "");
 
 #if  DEBUG
 SYSCTL_PROC(_kern_timer_longterm, OID_AUTO, enqueues,
@@ -4290,6 +4295,11 @@ extern uint32_t compressor_sample_max_in_msecs;
 extern uint32_t compressor_thrashing_threshold_per_10msecs;
 extern uint32_t compressor_thrashing_min_per_10msecs;
 extern uint32_t vm_compressor_time_thread;
+extern uint32_t vm_compressor_dedup_rate;
+extern uint64_t c_dedup_bytes_saved;
+extern uint64_t c_dedup_bytes_stored;
+extern uint64_t c_dedup_hits;
+extern uint64_t c_dedup_entries;
 
 #if DEVELOPMENT || DEBUG
 extern uint32_t vm_compressor_minorcompact_threshold_divisor;
@@ -4381,6 +4391,11 @@ SYSCTL_PROC(_vm, OID_AUTO, compressor_catchup_threshold_divisor,
 SYSCTL_QUAD(_vm, OID_AUTO, compressor_input_bytes, CTLFLAG_RD | CTLFLAG_LOCKED, &c_segment_input_bytes, "");
 SYSCTL_QUAD(_vm, OID_AUTO, compressor_compressed_bytes, CTLFLAG_RD | CTLFLAG_LOCKED, &c_segment_compressed_bytes, "");
 SYSCTL_QUAD(_vm, OID_AUTO, compressor_bytes_used, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_bytes_used, "");
+SYSCTL_UINT(_vm, OID_AUTO, compressor_dedup_rate, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_compressor_dedup_rate, 0, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_dedup_bytes_saved, CTLFLAG_RD | CTLFLAG_LOCKED, &c_dedup_bytes_saved, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_dedup_bytes_stored, CTLFLAG_RD | CTLFLAG_LOCKED, &c_dedup_bytes_stored, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_dedup_hits, CTLFLAG_RD | CTLFLAG_LOCKED, &c_dedup_hits, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_dedup_entries, CTLFLAG_RD | CTLFLAG_LOCKED, &c_dedup_entries, "");
 
 SYSCTL_INT(_vm, OID_AUTO, compressor_mode, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_compressor_mode, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, compressor_is_active, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_compressor_is_active, 0, "");
@@ -4411,10 +4426,119 @@ SYSCTL_QUAD(_vm, OID_AUTO, compressor_swapper_swapout_free_count_low, CTLFLAG_RD
 SYSCTL_QUAD(_vm, OID_AUTO, compressor_swapper_swapout_thrashing_detected, CTLFLAG_RD | CTLFLAG_LOCKED, &vmcs_stats.thrashing_detected, "");
 SYSCTL_QUAD(_vm, OID_AUTO, compressor_swapper_swapout_fragmentation_detected, CTLFLAG_RD | CTLFLAG_LOCKED, &vmcs_stats.fragmentation_detected, "");
 
+SYSCTL_OPAQUE(_vm, OID_AUTO, swapin_latency_histogram, CTLFLAG_RD | CTLFLAG_LOCKED,
+    vm_swapin_latency_histogram, sizeof(vm_swapin_latency_histogram), "Q",
+    "Swap-in latency, log2 microsecond buckets");
+
 SYSCTL_STRING(_vm, OID_AUTO, swapfileprefix, CTLFLAG_RW | CTLFLAG_KERN | CTLFLAG_LOCKED, swapfilename, sizeof(swapfilename) - SWAPFILENAME_INDEX_LEN, "");
 
 SYSCTL_INT(_vm, OID_AUTO, compressor_timing_enabled, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_compressor_time_thread, 0, "");
 
+SYSCTL_INT(_vm, OID_AUTO, compressor_thread_count, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_state.vm_compressor_thread_count, 0, "");
+
+STATIC int
+sysctl_compressor_thread_stats(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
+{
+	int count = vm_pageout_state.vm_compressor_thread_count;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+	if (count <= 0 || count > MAX_COMPRESSOR_THREAD_COUNT) {
+		return ENOENT;
+	}
+	return SYSCTL_OUT(req, vmcts_stats, count * sizeof(struct vm_compressor_thread_stats));
+}
+
+SYSCTL_PROC(_vm, OID_AUTO, compressor_thread_stats,
+    CTLTYPE_STRUCT | CTLFLAG_RD | CTLFLAG_LOCKED,
+    0, 0, sysctl_compressor_thread_stats, "S,vm_compressor_thread_stats",
+    "Per compressor thread throughput and queue depth");
+
+STATIC int
+sysctl_page_free_cache_stats(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
+{
+	struct vm_page_free_cache_stats *stats;
+	int ncpus = zpercpu_count();
+	size_t size = ncpus * sizeof(*stats);
+	int error;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+	stats = kalloc_data(size, Z_WAITOK | Z_ZERO);
+	if (stats == NULL) {
+		return ENOMEM;
+	}
+	ncpus = vm_page_free_cache_stats_copy(stats, ncpus);
+	error = SYSCTL_OUT(req, stats, ncpus * sizeof(*stats));
+	kfree_data(stats, size);
+	return error;
+}
+
+SYSCTL_PROC(_vm, OID_AUTO, page_free_cache_stats,
+    CTLTYPE_STRUCT | CTLFLAG_RD | CTLFLAG_LOCKED,
+    0, 0, sysctl_page_free_cache_stats, "S,vm_page_free_cache_stats",
+    "Per-CPU free page list hits, misses, refills and drains");
+
+STATIC int
+sysctl_kalloc_size_histogram(__unused struct sysctl_oid *oidp, __unused void *arg1, int arg2, struct sysctl_req *req)
+{
+	size_t size = KALLOC_SIZE_HISTO_BUCKETS * sizeof(uint64_t);
+	uint64_t *counts;
+	int error;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+	counts = kalloc_data(size, Z_WAITOK | Z_ZERO);
+	if (counts == NULL) {
+		return ENOMEM;
+	}
+	if (kalloc_size_histo_copy((zone_kheap_id_t)arg2, counts)) {
+		error = SYSCTL_OUT(req, counts, size);
+	} else {
+		error = ENOTSUP;
+	}
+	kfree_data(counts, size);
+	return error;
+}
+
+STATIC int
+sysctl_kalloc_size_classes(__unused struct sysctl_oid *oidp, __unused void *arg1, int arg2, struct sysctl_req *req)
+{
+	uint32_t sizes[KHEAP_MAX_SIZE / KALLOC_SIZE_HISTO_GRANULE];
+	uint32_t count;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+	count = kalloc_size_classes_copy((zone_kheap_id_t)arg2, sizes,
+	    sizeof(sizes) / sizeof(sizes[0]));
+	return SYSCTL_OUT(req, sizes, count * sizeof(sizes[0]));
+}
+
+SYSCTL_NODE(_kern, OID_AUTO, kalloc_size_histogram, CTLFLAG_RD | CTLFLAG_LOCKED, 0,
+    "kalloc request sizes per heap, in 16 byte buckets (kalloc_size_histo=1)");
+SYSCTL_NODE(_kern, OID_AUTO, kalloc_size_classes, CTLFLAG_RD | CTLFLAG_LOCKED, 0,
+    "kalloc zone element sizes per heap");
+
+#define KALLOC_SIZE_SYSCTLS(name, heap_id) \
+	SYSCTL_PROC(_kern_kalloc_size_histogram, OID_AUTO, name, \
+	    CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED, \
+	    0, heap_id, sysctl_kalloc_size_histogram, "Q", ""); \
+	SYSCTL_PROC(_kern_kalloc_size_classes, OID_AUTO, name, \
+	    CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED, \
+	    0, heap_id, sysctl_kalloc_size_classes, "IU", "")
+
+KALLOC_SIZE_SYSCTLS(default, KHEAP_ID_DEFAULT);
+KALLOC_SIZE_SYSCTLS(data, KHEAP_ID_DATA_BUFFERS);
+KALLOC_SIZE_SYSCTLS(kt_var, KHEAP_ID_KT_VAR);
+
+extern uint32_t vm_free_magazine_release_max;
+SYSCTL_UINT(_vm, OID_AUTO, page_free_cache_release_max, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &vm_free_magazine_release_max, 0, "Freed pages kept on each per-CPU free list");
+
 #if DEVELOPMENT || DEBUG
 SYSCTL_QUAD(_vm, OID_AUTO, compressor_thread_runtime0, CTLFLAG_RD | CTLFLAG_LOCKED, &vmct_stats.vmct_runtimes[0], "");
 SYSCTL_QUAD(_vm, OID_AUTO, compressor_thread_runtime1, CTLFLAG_RD | CTLFLAG_LOCKED, &vmct_stats.vmct_runtimes[1], "");
@@ -4552,6 +4676,14 @@ SYSCTL_INT(_vm, OID_AUTO, lz4_max_preselects, CTLFLAG_RW | CTLFLAG_LOCKED, &vmct
 SYSCTL_INT(_vm, OID_AUTO, lz4_run_preselection_threshold, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_run_preselection_threshold, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, lz4_run_continue_bytes, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_run_continue_bytes, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, lz4_profitable_bytes, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_profitable_bytes, 0, "");
+SYSCTL_INT(_vm, OID_AUTO, seg_sample_pages, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.seg_sample_pages, 0, "");
+
+SYSCTL_QUAD(_vm, OID_AUTO, lz4_catime, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.lz4_cabstime, "");
+SYSCTL_QUAD(_vm, OID_AUTO, seg_sample_compressions, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.seg_sample_compressions, "");
+SYSCTL_QUAD(_vm, OID_AUTO, seg_sample_wk_bytes, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.seg_sample_wk_bytes, "");
+SYSCTL_QUAD(_vm, OID_AUTO, seg_sample_lz4_bytes, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.seg_sample_lz4_bytes, "");
+SYSCTL_QUAD(_vm, OID_AUTO, seg_wk_selections, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.seg_wk_selections, "");
+SYSCTL_QUAD(_vm, OID_AUTO, seg_lz4_selections, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.seg_lz4_selections, "");
 #if DEVELOPMENT || DEBUG
 extern int vm_compressor_current_codec;
 extern int vm_compressor_test_seg_wp;
@@ -4680,6 +4812,9 @@ SCALABLE_COUNTER_DECLARE(log_queue_cnt_mem_active);
 SCALABLE_COUNTER_DECLARE(log_queue_cnt_mem_allocated);
 SCALABLE_COUNTER_DECLARE(log_queue_cnt_mem_released);
 SCALABLE_COUNTER_DECLARE(log_queue_cnt_mem_failed);
+SCALABLE_COUNTER_DECLARE(log_queue_cnt_drain_batches);
+SCALABLE_COUNTER_DECLARE(log_queue_cnt_drain_latency);
+extern uint64_t log_queue_drain_latency_max;
 
 /* log message counters for streaming mode */
 SCALABLE_COUNTER_DECLARE(oslog_s_total_msgcount);
@@ -4734,6 +4869,9 @@ SYSCTL_SCALABLE_COUNTER(_debug, log_queue_cnt_dropped_off, log_queue_cnt_dropped
 SYSCTL_SCALABLE_COUNTER(_debug, log_queue_cnt_mem_allocated, log_queue_cnt_mem_allocated, "Number of memory allocations");
 SYSCTL_SCALABLE_COUNTER(_debug, log_queue_cnt_mem_released, log_queue_cnt_mem_released, "Number of memory releases");
 SYSCTL_SCALABLE_COUNTER(_debug, log_queue_cnt_mem_failed, log_queue_cnt_mem_failed, "Number of failed memory allocations");
+SYSCTL_SCALABLE_COUNTER(_debug, log_queue_cnt_drain_batches, log_queue_cnt_drain_batches, "Number of batches of queued logs handed off to FH");
+SYSCTL_SCALABLE_COUNTER(_debug, log_queue_cnt_drain_latency, log_queue_cnt_drain_latency, "Total time queued logs waited before being sent (abs units)");
+SYSCTL_QUAD(_debug, OID_AUTO, log_queue_drain_latency_max, CTLFLAG_RD | CTLFLAG_LOCKED, &log_queue_drain_latency_max, "Longest time a queued log waited before being sent (abs units)");
 
 #endif /* DEVELOPMENT || DEBUG */
 
@@ -4853,6 +4991,17 @@ __security_const_late static int pervasive_energy = 0;
 SYSCTL_INT(_kern, OID_AUTO, pervasive_energy,
     CTLFLAG_KERN | CTLFLAG_RD | CTLFLAG_LOCKED, &pervasive_energy, 0, "");
 
+#if CONFIG_PERVASIVE_MEMBW && MONOTONIC && defined(__x86_64__)
+extern int mt_membw_supported;
+SYSCTL_INT(_kern, OID_AUTO, pervasive_membw,
+    CTLFLAG_KERN | CTLFLAG_RD | CTLFLAG_LOCKED, &mt_membw_supported, 0,
+    "Memory traffic is sampled into the CPU usage statistics");
+#else /* CONFIG_PERVASIVE_MEMBW && MONOTONIC && defined(__x86_64__) */
+SYSCTL_INT(_kern, OID_AUTO, pervasive_membw,
+    CTLFLAG_KERN | CTLFLAG_RD | CTLFLAG_LOCKED, NULL, 0,
+    "Memory traffic is sampled into the CPU usage statistics");
+#endif /* !CONFIG_PERVASIVE_MEMBW || !MONOTONIC || !defined(__x86_64__) */
+
 /* Parameters related to timer coalescing tuning, to be replaced
  * with a dedicated systemcall in the future.
  */
@@ -5293,11 +5442,174 @@ SYSCTL_PROC(_kern, OID_AUTO, thread_group_count, CTLFLAG_RD | CTLFLAG_LOCKED | C
     0, 0, &sysctl_thread_group_count, "I", "count of thread groups");
 
 #endif /* DEVELOPMENT || DEBUG */
+
+#if CONFIG_SCHED_CLUTCH
+/* Must match TH_BUCKET_SCHED_MAX and SCHED_CLUTCH_LATENCY_BINS in osfmk/kern */
+#define SCHED_LATENCY_BUCKETS   6
+#define SCHED_LATENCY_BINS      16
+extern kern_return_t sched_clutch_latency_histogram_get(uint64_t, uint32_t *, uint32_t);
+
+/*
+ * Write a thread group id (0 or nothing for the caller's own group) and read
+ * back its makerunnable to running latency histograms, one row of log2
+ * microsecond bins per scheduling bucket. Looking at another thread group
+ * requires root.
+ */
+STATIC int
+sysctl_thread_group_sched_latency SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	uint32_t hist[SCHED_LATENCY_BUCKETS * SCHED_LATENCY_BINS];
+	uint64_t tg_id = 0;
+	int error;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		error = SYSCTL_IN(req, &tg_id, sizeof(tg_id));
+		if (error) {
+			return error;
+		}
+		if (tg_id != 0 &&
+		    tg_id != thread_group_get_id(thread_group_get(current_thread())) &&
+		    (error = suser(kauth_cred_get(), &req->p->p_acflag)) != 0) {
+			return error;
+		}
+	}
+
+	if (sched_clutch_latency_histogram_get(tg_id, hist,
+	    sizeof(hist) / sizeof(hist[0])) != KERN_SUCCESS) {
+		return ESRCH;
+	}
+	return SYSCTL_OUT(req, hist, sizeof(hist));
+}
+
+SYSCTL_PROC(_kern, OID_AUTO, thread_group_sched_latency,
+    CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_ANYBODY | CTLFLAG_LOCKED,
+    0, 0, &sysctl_thread_group_sched_latency, "S",
+    "thread group makerunnable to running latency histograms");
+
+extern uint32_t sched_clutch_latency_hist_enabled;
+SYSCTL_UINT(_kern, OID_AUTO, sched_clutch_latency_hist, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &sched_clutch_latency_hist_enabled, 0, "collect thread group scheduling latency histograms");
+
+extern kern_return_t sched_clutch_cpu_bandwidth_set(uint64_t, uint32_t, uint32_t);
+extern kern_return_t sched_clutch_cpu_bandwidth_get(uint64_t, uint32_t *, uint32_t *, uint64_t *);
+
+/* Must match the arguments of sched_clutch_cpu_bandwidth_{get,set}() */
+struct thread_group_cpu_bandwidth {
+	uint64_t tg_id;
+	uint32_t quota_us;
+	uint32_t period_us;
+	uint64_t throttled_periods;
+};
+
+/*
+ * Write a thread group id (0 for the caller's own group) with a quota and
+ * period (in microseconds) to limit the timeshare CPU time of that thread
+ * group, a period of 0 removes the limit. Writing only the thread group id
+ * reads back its current limit and the number of periods in which it was
+ * hit. Setting limits requires root.
+ */
+STATIC int
+sysctl_thread_group_cpu_bandwidth SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	struct thread_group_cpu_bandwidth bw = { };
+	kern_return_t kr;
+	int error;
+
+	if (req->newptr == USER_ADDR_NULL) {
+		return EINVAL;
+	}
+	if (req->newlen == sizeof(bw.tg_id)) {
+		error = SYSCTL_IN(req, &bw.tg_id, sizeof(bw.tg_id));
+		if (error) {
+			return error;
+		}
+	} else {
+		/* throttled_periods is output only */
+		error = SYSCTL_IN(req, &bw,
+		    offsetof(struct thread_group_cpu_bandwidth, throttled_periods));
+		if (error) {
+			return error;
+		}
+		if ((error = suser(kauth_cred_get(), &req->p->p_acflag)) != 0) {
+			return error;
+		}
+		kr = sched_clutch_cpu_bandwidth_set(bw.tg_id, bw.quota_us, bw.period_us);
+		if (kr != KERN_SUCCESS) {
+			return kr == KERN_NOT_FOUND ? ESRCH : EINVAL;
+		}
+	}
+
+	if (sched_clutch_cpu_bandwidth_get(bw.tg_id, &bw.quota_us, &bw.period_us,
+	    &bw.throttled_periods) != KERN_SUCCESS) {
+		return ESRCH;
+	}
+	return SYSCTL_OUT(req, &bw, sizeof(bw));
+}
+
+SYSCTL_PROC(_kern, OID_AUTO, thread_group_cpu_bandwidth,
+    CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_ANYBODY | CTLFLAG_LOCKED,
+    0, 0, &sysctl_thread_group_cpu_bandwidth, "S",
+    "thread group CPU bandwidth limits");
+#endif /* CONFIG_SCHED_CLUTCH */
 const uint32_t thread_groups_supported = 1;
 #else /* CONFIG_THREAD_GROUPS */
 const uint32_t thread_groups_supported = 0;
 #endif /* CONFIG_THREAD_GROUPS */
 
+/*
+ * Sampled lock contention profiles, see lck_prof_sample_begin().
+ *
+ * kern.lock_prof_sample profiles one in that many contended lck_mtx_t
+ * and lck_rw_t acquisitions of each thread (0 disables it),
+ * kern.lock_prof_groups and kern.lock_prof_sites return arrays of
+ * lockgroup_prof_info_t and lockprof_site_t. Sites hold kernel
+ * backtraces, so reading either requires root.
+ */
+SYSCTL_UINT(_kern, OID_AUTO, lock_prof_sample, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &lck_prof_sample_rate, 0, "profile one in N contended lock acquisitions");
+
+STATIC int
+sysctl_lock_prof SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, oidp)
+	size_t elem = arg2 ? sizeof(lockprof_site_t) : sizeof(lockgroup_prof_info_t);
+	uint32_t count;
+	size_t size;
+	void *buf;
+	int error;
+
+	if ((error = suser(kauth_cred_get(), &req->p->p_acflag)) != 0) {
+		return error;
+	}
+
+	count = arg2 ? lck_prof_copy_sites(NULL, 0) : lck_prof_copy_groups(NULL, 0);
+	size = count * elem;
+	if (req->oldptr == USER_ADDR_NULL || size == 0) {
+		return SYSCTL_OUT(req, NULL, size);
+	}
+
+	buf = kalloc_data(size, Z_WAITOK | Z_ZERO);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	count = arg2 ? lck_prof_copy_sites(buf, count) : lck_prof_copy_groups(buf, count);
+	error = SYSCTL_OUT(req, buf, count * elem);
+	kfree_data(buf, size);
+	return error;
+}
+
+SYSCTL_PROC(_kern, OID_AUTO, lock_prof_groups,
+    CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED,
+    0, 0, &sysctl_lock_prof, "S,lockgroup_prof_info",
+    "sampled lock contention histograms per lock group");
+
+SYSCTL_PROC(_kern, OID_AUTO, lock_prof_sites,
+    CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED,
+    0, 1, &sysctl_lock_prof, "S,lockprof_site",
+    "most contended lock acquisition call sites");
+
 STATIC int
 sysctl_thread_groups_supported(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
 {
@@ -5506,10 +5818,14 @@ int
 turnstile_get_boost_stats_sysctl(void *req);
 int
 turnstile_get_unboost_stats_sysctl(void *req);
+int
+turnstile_get_htable_stats_sysctl(void *req);
 static int
 sysctl_turnstile_boost_stats SYSCTL_HANDLER_ARGS;
 static int
 sysctl_turnstile_unboost_stats SYSCTL_HANDLER_ARGS;
+static int
+sysctl_turnstile_htable_stats SYSCTL_HANDLER_ARGS;
 extern uint64_t thread_block_on_turnstile_count;
 extern uint64_t thread_block_on_regular_waitq_count;
 
@@ -5527,10 +5843,19 @@ sysctl_turnstile_unboost_stats SYSCTL_HANDLER_ARGS
 	return turnstile_get_unboost_stats_sysctl(req);
 }
 
+static int
+sysctl_turnstile_htable_stats SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	return turnstile_get_htable_stats_sysctl(req);
+}
+
 SYSCTL_PROC(_kern, OID_AUTO, turnstile_boost_stats, CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_KERN | CTLFLAG_LOCKED | CTLTYPE_STRUCT,
     0, 0, sysctl_turnstile_boost_stats, "S", "turnstiles boost stats");
 SYSCTL_PROC(_kern, OID_AUTO, turnstile_unboost_stats, CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_KERN | CTLFLAG_LOCKED | CTLTYPE_STRUCT,
     0, 0, sysctl_turnstile_unboost_stats, "S", "turnstiles unboost stats");
+SYSCTL_PROC(_kern, OID_AUTO, turnstile_htable_stats, CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_KERN | CTLFLAG_LOCKED | CTLTYPE_STRUCT,
+    0, 0, sysctl_turnstile_htable_stats, "S", "turnstile hashtable occupancy stats");
 SYSCTL_QUAD(_kern, OID_AUTO, thread_block_count_on_turnstile,
     CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_KERN | CTLFLAG_LOCKED,
     &thread_block_on_turnstile_count, "thread blocked on turnstile count");
@@ -5538,6 +5863,27 @@ SYSCTL_QUAD(_kern, OID_AUTO, thread_block_count_on_reg_waitq,
     CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_KERN | CTLFLAG_LOCKED,
     &thread_block_on_regular_waitq_count, "thread blocked on regular waitq count");
 
+extern uint64_t smr_global_limbo_bytes;
+extern uint64_t smr_global_limbo_bytes_max;
+extern uint64_t smr_global_reclaim_inline;
+extern uint64_t smr_global_reclaim_daemon;
+extern uint64_t smr_global_grace_ns_total;
+extern uint64_t smr_global_grace_ns_max;
+
+SYSCTL_NODE(_kern, OID_AUTO, smr, CTLFLAG_RW | CTLFLAG_LOCKED, 0, "system global SMR");
+SYSCTL_QUAD(_kern_smr, OID_AUTO, limbo_bytes, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &smr_global_limbo_bytes, "bytes retired and waiting for their grace period");
+SYSCTL_QUAD(_kern_smr, OID_AUTO, limbo_bytes_max, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &smr_global_limbo_bytes_max, "high watermark of limbo_bytes");
+SYSCTL_QUAD(_kern_smr, OID_AUTO, reclaim_inline, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &smr_global_reclaim_inline, "buckets reclaimed by the retiring cpu");
+SYSCTL_QUAD(_kern_smr, OID_AUTO, reclaim_daemon, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &smr_global_reclaim_daemon, "buckets reclaimed by the deallocate daemon");
+SYSCTL_QUAD(_kern_smr, OID_AUTO, grace_ns_total, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &smr_global_grace_ns_total, "total time between sealing and reclaiming buckets");
+SYSCTL_QUAD(_kern_smr, OID_AUTO, grace_ns_max, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &smr_global_grace_ns_max, "longest time between sealing and reclaiming a bucket");
+
 #if CONFIG_PV_TICKET
 
 extern int ticket_lock_spins;
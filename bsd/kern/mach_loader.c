@@ -744,6 +744,140 @@ pie_required(
 	return FALSE;
 }
 
+/*
+ * Small cache of the load commands of recently exec'd main binaries.
+ *
+ * Job runners tend to exec the same handful of binaries over and over;
+ * this lets parse_machfile() skip re-reading the load command area through
+ * the filesystem for them.  Entries are keyed by vnode identity (vnode,
+ * vid, fsid, fileid) and generation (modification time and size), and are
+ * only inserted once the commands have parsed successfully.  Segments are
+ * still mapped, and code signatures still validated, on every exec.
+ */
+#define MACHO_LC_CACHE_ENTRIES          16
+#define MACHO_LC_CACHE_MAX_SIZE         (32 * 1024)
+
+struct macho_lc_cache_key {
+	vnode_t                 lck_vp;         /* identity only, no reference held */
+	uint32_t                lck_vid;
+	uint64_t                lck_fsid;
+	uint64_t                lck_fileid;
+	struct timespec         lck_mtime;
+	off_t                   lck_file_size;
+	off_t                   lck_file_offset;
+	vm_size_t               lck_size;
+};
+
+struct macho_lc_cache_entry {
+	struct macho_lc_cache_key lce_key;
+	void                    *lce_cmds;
+};
+
+static struct macho_lc_cache_entry macho_lc_cache[MACHO_LC_CACHE_ENTRIES];
+static uint32_t macho_lc_cache_next;
+static LCK_GRP_DECLARE(macho_lc_cache_grp, "macho_lc_cache");
+static LCK_MTX_DECLARE(macho_lc_cache_lock, &macho_lc_cache_grp);
+
+/*
+ * Only the main binary is cached: its attributes were fetched by
+ * exec_check_permissions() and can be used to detect modification.
+ */
+static boolean_t
+macho_lc_cache_make_key(
+	struct vnode            *vp,
+	struct image_params     *imgp,
+	off_t                   file_offset,
+	vm_size_t               size,
+	struct macho_lc_cache_key *key)
+{
+	struct vnode_attr *vap = imgp->ip_vattr;
+
+	if (vp != imgp->ip_vp || vap == NULL || size > MACHO_LC_CACHE_MAX_SIZE) {
+		return FALSE;
+	}
+	if (!VATTR_IS_SUPPORTED(vap, va_modify_time) ||
+	    !VATTR_IS_SUPPORTED(vap, va_fileid) ||
+	    !VATTR_IS_SUPPORTED(vap, va_data_size)) {
+		return FALSE;
+	}
+
+	*key = (struct macho_lc_cache_key){
+		.lck_vp = vp,
+		.lck_vid = vnode_vid(vp),
+		.lck_fsid = vap->va_fsid,
+		.lck_fileid = vap->va_fileid,
+		.lck_mtime = vap->va_modify_time,
+		.lck_file_size = vap->va_data_size,
+		.lck_file_offset = file_offset,
+		.lck_size = size,
+	};
+	return TRUE;
+}
+
+static boolean_t
+macho_lc_cache_key_equal(const struct macho_lc_cache_key *a,
+    const struct macho_lc_cache_key *b)
+{
+	return a->lck_vp == b->lck_vp &&
+	       a->lck_vid == b->lck_vid &&
+	       a->lck_fsid == b->lck_fsid &&
+	       a->lck_fileid == b->lck_fileid &&
+	       a->lck_mtime.tv_sec == b->lck_mtime.tv_sec &&
+	       a->lck_mtime.tv_nsec == b->lck_mtime.tv_nsec &&
+	       a->lck_file_size == b->lck_file_size &&
+	       a->lck_file_offset == b->lck_file_offset &&
+	       a->lck_size == b->lck_size;
+}
+
+static boolean_t
+macho_lc_cache_lookup(const struct macho_lc_cache_key *key, void *addr)
+{
+	boolean_t found = FALSE;
+
+	lck_mtx_lock(&macho_lc_cache_lock);
+	for (int i = 0; i < MACHO_LC_CACHE_ENTRIES; i++) {
+		struct macho_lc_cache_entry *lce = &macho_lc_cache[i];
+
+		if (lce->lce_cmds != NULL && macho_lc_cache_key_equal(&lce->lce_key, key)) {
+			memcpy(addr, lce->lce_cmds, key->lck_size);
+			found = TRUE;
+			break;
+		}
+	}
+	lck_mtx_unlock(&macho_lc_cache_lock);
+
+	return found;
+}
+
+static void
+macho_lc_cache_insert(const struct macho_lc_cache_key *key, const void *addr)
+{
+	struct macho_lc_cache_entry *lce;
+	void *cmds, *old_cmds = NULL;
+	vm_size_t old_size = 0;
+
+	cmds = kalloc_data(key->lck_size, Z_WAITOK);
+	if (cmds == NULL) {
+		return;
+	}
+	memcpy(cmds, addr, key->lck_size);
+
+	lck_mtx_lock(&macho_lc_cache_lock);
+	lce = &macho_lc_cache[macho_lc_cache_next];
+	macho_lc_cache_next = (macho_lc_cache_next + 1) % MACHO_LC_CACHE_ENTRIES;
+	if (lce->lce_cmds != NULL) {
+		old_cmds = lce->lce_cmds;
+		old_size = lce->lce_key.lck_size;
+	}
+	lce->lce_key = *key;
+	lce->lce_cmds = cmds;
+	lck_mtx_unlock(&macho_lc_cache_lock);
+
+	if (old_cmds != NULL) {
+		kfree_data(old_cmds, old_size);
+	}
+}
+
 /*
  * The file size of a mach-o file is limited to 32 bits; this is because
  * this is the limit on the kalloc() of enough bytes for a mach_header and
@@ -796,6 +930,9 @@ parse_machfile(
 	boolean_t               dyld_no_load_addr = FALSE;
 	boolean_t               is_dyld = FALSE;
 	vm_map_offset_t         effective_page_mask = PAGE_MASK;
+	struct macho_lc_cache_key lc_key;
+	boolean_t               lc_cacheable = FALSE;
+	boolean_t               lc_cached = FALSE;
 #if __arm64__
 	uint64_t                pagezero_end = 0;
 	uint64_t                executable_end = 0;
@@ -907,18 +1044,24 @@ parse_machfile(
 		return LOAD_NOSPACE;
 	}
 
-	error = vn_rdwr(UIO_READ, vp, addr, (int)alloc_size, file_offset,
-	    UIO_SYSSPACE, 0, vfs_context_ucred(imgp->ip_vfs_context), &resid, p);
-	if (error) {
-		kfree_data(addr, alloc_size);
-		return LOAD_IOERROR;
-	}
-
-	if (resid) {
-		{
-			/* We must be able to read in as much as the mach_header indicated */
+	lc_cacheable = macho_lc_cache_make_key(vp, imgp, file_offset,
+	    alloc_size, &lc_key);
+	if (lc_cacheable && macho_lc_cache_lookup(&lc_key, addr)) {
+		lc_cached = TRUE;
+	} else {
+		error = vn_rdwr(UIO_READ, vp, addr, (int)alloc_size, file_offset,
+		    UIO_SYSSPACE, 0, vfs_context_ucred(imgp->ip_vfs_context), &resid, p);
+		if (error) {
 			kfree_data(addr, alloc_size);
-			return LOAD_BADMACHO;
+			return LOAD_IOERROR;
+		}
+
+		if (resid) {
+			{
+				/* We must be able to read in as much as the mach_header indicated */
+				kfree_data(addr, alloc_size);
+				return LOAD_BADMACHO;
+			}
 		}
 	}
 
@@ -1512,6 +1655,10 @@ parse_machfile(
 		ret = LOAD_BADMACHO_UPX;
 	}
 
+	if (ret == LOAD_SUCCESS && lc_cacheable && !lc_cached) {
+		macho_lc_cache_insert(&lc_key, addr);
+	}
+
 	kfree_data(addr, alloc_size);
 
 	return ret;
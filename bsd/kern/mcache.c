@@ -112,6 +112,11 @@ static int mcache_ready;
 static int mcache_updating;
 
 static int mcache_bkt_contention = 3;
+/*
+ * Buckets handed between the CPU and bucket layers per second, above
+ * which a cache moves to larger buckets even without lock contention.
+ */
+static unsigned int mcache_bkt_xfer_rate = 1000;
 #if DEBUG
 static unsigned int mcache_flags = MCF_DEBUG;
 #else
@@ -703,6 +708,19 @@ mcache_purge_cache(mcache_t *cp, boolean_t async)
 	return TRUE;
 }
 
+/*
+ * Whether a list of objects holds more than the given number of them;
+ * only walks as far as needed to tell.
+ */
+static boolean_t
+mcache_list_exceeds(mcache_obj_t *list, int num)
+{
+	while (list != NULL && num-- > 0) {
+		list = list->obj_next;
+	}
+	return list != NULL;
+}
+
 /*
  * Free a single object to a cache.
  */
@@ -790,15 +808,12 @@ mcache_free_ext(mcache_t *cp, mcache_obj_t *list)
 		 * Both of the CPU's buckets are full; try to get empty
 		 * buckets from the bucket layer.  Upon success, empty this
 		 * CPU and place any full bucket into the full list.
-		 *
-		 * TODO: Because the caller currently doesn't indicate
-		 * the number of objects in the list, we choose the more
-		 * conservative approach of allocating only 1 empty
-		 * bucket (to prevent potential thrashing).  Once we
-		 * have the object count, we can replace 1 with similar
-		 * logic as used in mcache_alloc_ext().
+		 * To prevent potential thrashing, replace both full buckets
+		 * only if the rest of the list exceeds a bucket's worth of
+		 * objects, as when m_freem_list() frees a batch of packets.
 		 */
-		(void) mcache_bkt_batch_alloc(cp, &cp->mc_empty, &bkt, 1);
+		(void) mcache_bkt_batch_alloc(cp, &cp->mc_empty, &bkt,
+		    mcache_list_exceeds(list, ccp->cc_bktsize) ? 2 : 1);
 		if (bkt != NULL) {
 			mcache_bkt_t *bkt_list = NULL;
 
@@ -1409,6 +1424,7 @@ mcache_cache_update(mcache_t *cp)
 {
 	int need_bkt_resize = 0;
 	int need_bkt_reenable = 0;
+	u_int64_t xfer;
 
 	lck_mtx_assert(&mcache_llock, LCK_MTX_ASSERT_OWNED);
 
@@ -1428,18 +1444,26 @@ mcache_cache_update(mcache_t *cp)
 
 	MCACHE_LOCK(&cp->mc_bkt_lock);
 	/*
-	 * If the contention count is greater than the threshold, and if
-	 * we are not already at the maximum bucket size, increase it.
-	 * Otherwise, if this cache was previously purged by the user
-	 * then we simply reenable it.
+	 * If the contention count or the rate at which buckets go
+	 * through the bucket layer is greater than the threshold, and
+	 * if we are not already at the maximum bucket size, increase it;
+	 * a bursty workload (e.g. a NIC handing over packets in batches)
+	 * thus ends up with buckets that hold a whole batch.  Otherwise,
+	 * if this cache was previously purged by the user then we simply
+	 * reenable it.
 	 */
+	xfer = cp->mc_full.bl_alloc + cp->mc_empty.bl_alloc;
 	if ((unsigned int)cp->mc_chunksize < cp->cache_bkttype->bt_maxbuf &&
-	    (int)(cp->mc_bkt_contention - cp->mc_bkt_contention_prev) >
-	    mcache_bkt_contention && !need_bkt_reenable) {
+	    ((int)(cp->mc_bkt_contention - cp->mc_bkt_contention_prev) >
+	    mcache_bkt_contention ||
+	    xfer - cp->mc_bkt_xfer_prev >
+	    (u_int64_t)mcache_bkt_xfer_rate * mcache_reap_interval) &&
+	    !need_bkt_reenable) {
 		need_bkt_resize = 1;
 	}
 
 	cp->mc_bkt_contention_prev = cp->mc_bkt_contention;
+	cp->mc_bkt_xfer_prev = xfer;
 	MCACHE_UNLOCK(&cp->mc_bkt_lock);
 
 	if (need_bkt_resize) {
@@ -84,6 +84,7 @@
 
 #include <vm/vm_map.h>
 #include <vm/vm_protos.h>
+#include <vm/vm_fault.h>
 
 #define f_flag fp_glob->fg_flag
 #define f_ops fp_glob->fg_ops
@@ -130,6 +131,15 @@ typedef struct internal_pshminfo {
 #define PSHM_INUSE      0x010   /* mapped at least once */
 #define PSHM_REMOVED    0x020   /* no longer in the name cache due to shm_unlink() */
 #define PSHM_ALLOCATING 0x100   /* storage is being allocated */
+#define PSHM_PREFAULT   0x200   /* created with O_SHM_PREFAULT */
+#define PSHM_LARGEPAGE  0x400   /* created with O_SHM_LARGEPAGE */
+
+/*
+ * Objects created with O_SHM_LARGEPAGE are sized, chunked and mapped on
+ * boundaries of this size so the pmap can use block mappings for them.
+ */
+#define PSHM_LARGEPAGE_SIZE     (2ULL << 20)
+#define PSHM_LARGEPAGE_MASK     (PSHM_LARGEPAGE_SIZE - 1)
 
 /*
  * These handle reference counting pshm_info_t structs using pshm_usecount.
@@ -399,6 +409,12 @@ shm_open(proc_t p, struct shm_open_args *uap, int32_t *retval)
 		new_pinfo->pshm_mode = cmode;
 		new_pinfo->pshm_uid = kauth_getuid();
 		new_pinfo->pshm_gid = kauth_getgid();
+		if (uap->oflag & O_SHM_PREFAULT) {
+			new_pinfo->pshm_flags |= PSHM_PREFAULT;
+		}
+		if (uap->oflag & O_SHM_LARGEPAGE) {
+			new_pinfo->pshm_flags |= PSHM_LARGEPAGE;
+		}
 		SLIST_INIT(&new_pinfo->pshm_mobjs);
 #if CONFIG_MACF
 		mac_posixshm_label_init(&new_pinfo->pshm_hdr);
@@ -543,7 +559,7 @@ pshm_truncate(
 	pshmnode_t            *pnode;
 	kern_return_t         kret;
 	mem_entry_name_port_t mem_object;
-	mach_vm_size_t        total_size, alloc_size;
+	mach_vm_size_t        total_size, alloc_size, max_mosize;
 	memory_object_size_t  mosize;
 	pshm_mobj_t           *pshmobj, *pshmobj_last;
 	vm_map_t              user_map;
@@ -603,13 +619,19 @@ pshm_truncate(
 	/* set ALLOCATING, so another truncate can't start */
 	pinfo->pshm_flags |= PSHM_ALLOCATING;
 	total_size = vm_map_round_page(length, vm_map_page_mask(user_map));
+	max_mosize = ANON_MAX_SIZE;
+	if (pinfo->pshm_flags & PSHM_LARGEPAGE) {
+		/* keep every chunk, and so every chunk boundary, large page sized */
+		total_size = (total_size + PSHM_LARGEPAGE_MASK) & ~PSHM_LARGEPAGE_MASK;
+		max_mosize &= ~PSHM_LARGEPAGE_MASK;
+	}
 
 	pshmobj_last = NULL;
 	for (alloc_size = 0; alloc_size < total_size; alloc_size += mosize) {
 		PSHM_SUBSYS_UNLOCK();
 
 		/* get a memory object back some of the shared memory */
-		mosize = MIN(total_size - alloc_size, ANON_MAX_SIZE);
+		mosize = MIN(total_size - alloc_size, max_mosize);
 		kret = mach_make_memory_entry_64(VM_MAP_NULL, &mosize, 0,
 		    MAP_MEM_NAMED_CREATE | VM_PROT_DEFAULT, &mem_object, 0);
 
@@ -747,6 +769,7 @@ pshm_mmap(
 	vm_object_offset_t file_pos = (vm_object_offset_t)uap->pos;
 	vm_object_offset_t map_pos;
 	vm_map_t           user_map;
+	vm_map_offset_t    alloc_mask = 0;
 	int                alloc_flags;
 	vm_map_kernel_flags_t vmk_flags;
 	bool               docow;
@@ -815,6 +838,11 @@ pshm_mmap(
 		return EINVAL;
 	}
 
+	if ((pinfo->pshm_flags & PSHM_LARGEPAGE) &&
+	    (file_pos & PSHM_LARGEPAGE_MASK) == 0) {
+		alloc_mask = PSHM_LARGEPAGE_MASK;
+	}
+
 #if CONFIG_MACF
 	error = mac_posixshm_check_mmap(kauth_cred_get(), &pinfo->pshm_hdr, prot, flags);
 	if (error) {
@@ -858,7 +886,7 @@ pshm_mmap(
 	kret = vm_map_enter_mem_object(user_map,
 	    &user_addr,
 	    user_size,
-	    0,
+	    alloc_mask,
 	    alloc_flags,
 	    vmk_flags,
 	    VM_KERN_MEMORY_NONE,
@@ -913,6 +941,24 @@ pshm_mmap(
 		file_pos += map_size;
 	}
 
+	if ((pinfo->pshm_flags & PSHM_PREFAULT) &&
+	    (prot & (VM_PROT_READ | VM_PROT_WRITE))) {
+		vm_prot_t fault_type;
+
+		/*
+		 * Fault the whole mapping in now, so that processes sharing
+		 * the object don't take a first touch fault on every page.
+		 * Pages another mapping already populated only cost a pmap
+		 * enter here.
+		 */
+		fault_type = (prot & VM_PROT_WRITE) ? VM_PROT_WRITE : VM_PROT_READ;
+		for (vm_map_offset_t va = user_start_addr;
+		    va < user_start_addr + mapped_size;
+		    va += vm_map_page_size(user_map)) {
+			vm_pre_fault(va, fault_type);
+		}
+	}
+
 	PSHM_SUBSYS_LOCK();
 	pnode->mapp_addr = user_start_addr;
 	pinfo->pshm_flags |= (PSHM_MAPPED | PSHM_INUSE);
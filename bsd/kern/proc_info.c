@@ -153,6 +153,7 @@ static int __attribute__ ((noinline)) proc_pidoriginatorinfo(int pid, int flavor
 static int __attribute__ ((noinline)) proc_listcoalitions(int flavor, int coaltype, user_addr_t buffer, uint32_t buffersize, int32_t *retval);
 static int __attribute__ ((noinline)) proc_can_use_foreground_hw(int pid, user_addr_t reason, uint32_t resonsize, int32_t *retval);
 static int __attribute__ ((noinline)) proc_set_dyld_images(int pid, user_addr_t buffer, uint32_t  buffersize, int32_t *retval);
+static int __attribute__ ((noinline)) proc_pidinfo_batch(user_addr_t entries, int count, user_addr_t buffer, uint32_t buffersize, int32_t *retval);
 
 /* protos for procpidinfo calls */
 static int __attribute__ ((noinline)) proc_pidfdlist(proc_t p, user_addr_t buffer, uint32_t buffersize, int32_t *retval);
@@ -330,6 +331,9 @@ proc_info_internal(int callnum, int pid, uint32_t flags, uint64_t ext_id, int fl
 		return proc_set_dyld_images(pid, buffer, buffersize, retval);
 	case PROC_INFO_CALL_TERMINATE_RSR:
 		return proc_terminate_all_rsr(pid, flavor, (int)arg, retval);
+	case PROC_INFO_CALL_PIDINFO_BATCH:
+		/* arg points to the entries and flavor contains their count */
+		return proc_pidinfo_batch((user_addr_t)arg, flavor, buffer, buffersize, retval);
 	default:
 		return EINVAL;
 	}
@@ -337,7 +341,106 @@ proc_info_internal(int callnum, int pid, uint32_t flags, uint64_t ext_id, int fl
 	return EINVAL;
 }
 
+/******************* proc_pidinfo_batch routine ****************/
+/*
+ * Runs a list of proc_pidinfo() queries in one call, packing the results
+ * back to back in the caller's buffer.  Every entry goes through the same
+ * policy checks as an individual PROC_INFO_CALL_PIDINFO call; a failing
+ * entry only reports its own error.
+ */
+static int
+proc_pidinfo_batch(user_addr_t uentries, int count, user_addr_t buffer, uint32_t buffersize, int32_t *retval)
+{
+	struct proc_pidinfo_batch_entry *entries;
+	size_t entries_size;
+	uint32_t offset = 0;
+	int error;
+
+	if (count <= 0 || count > PROC_PIDINFO_BATCH_MAX ||
+	    uentries == USER_ADDR_NULL || buffer == USER_ADDR_NULL) {
+		return EINVAL;
+	}
+
+	entries_size = count * sizeof(*entries);
+	entries = kalloc_data(entries_size, Z_WAITOK);
+	if (entries == NULL) {
+		return ENOMEM;
+	}
+
+	error = copyin(uentries, entries, entries_size);
+	if (error) {
+		goto out;
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct proc_pidinfo_batch_entry *pbe = &entries[i];
+		int32_t entry_retval = 0;
+
+		pbe->pbe_offset = offset;
+		pbe->pbe_retval = 0;
+
+		if (pbe->pbe_size == 0 || pbe->pbe_size > buffersize - offset) {
+			pbe->pbe_error = ENOMEM;
+			continue;
+		}
+
+		pbe->pbe_error = proc_pidinfo(pbe->pbe_pid, 0, 0, pbe->pbe_flavor,
+		    pbe->pbe_arg, buffer + offset, pbe->pbe_size, &entry_retval);
+		if (pbe->pbe_error == 0) {
+			pbe->pbe_retval = entry_retval;
+			offset += MIN(roundup((uint32_t)entry_retval, sizeof(uint64_t)),
+			    buffersize - offset);
+		}
+	}
+
+	error = copyout(entries, uentries, entries_size);
+	if (error == 0) {
+		*retval = (int32_t)offset;
+	}
+
+out:
+	kfree_data(entries, entries_size);
+	return error;
+}
+
 /******************* proc_listpids routine ****************/
+static uint32_t
+proc_listpids_smr(uint32_t type, uint32_t typeinfo, int *kbuf, uint32_t numprocs)
+{
+	__block uint32_t n = 0;
+	bool (^visit)(proc_t) = ^bool (proc_t p) {
+		switch (type) {
+		case PROC_PGRP_ONLY:
+			if (p->p_pgrpid != (pid_t)typeinfo) {
+				return true;
+			}
+			break;
+		case PROC_PPID_ONLY:
+			if ((p->p_ppid != (pid_t)typeinfo) && (((p->p_lflag & P_LTRACED) == 0) || (p->p_oppid != (pid_t)typeinfo))) {
+				return true;
+			}
+			break;
+		case PROC_KDBG_ONLY:
+			if (p->p_kdebug == 0) {
+				return true;
+			}
+			break;
+		default:
+			break;
+		}
+
+		kbuf[n++] = proc_getpid(p);
+		return n < numprocs;
+	};
+
+	/* kernproc isn't in the pid hash */
+	if (visit(kernproc)) {
+		phash_foreach_smr(visit);
+	}
+
+	return n;
+}
+
 int
 proc_listpids(uint32_t type, uint32_t typeinfo, user_addr_t buffer, uint32_t  buffersize, int32_t * retval)
 {
@@ -378,6 +481,22 @@ proc_listpids(uint32_t type, uint32_t typeinfo, user_addr_t buffer, uint32_t  bu
 		return ENOMEM;
 	}
 
+	/*
+	 * Filters that only look at fields of the proc itself don't need to
+	 * block, so they can walk the pid hash under SMR and stay out of the
+	 * way of fork and exit.
+	 */
+	switch (type) {
+	case PROC_ALL_PIDS:
+	case PROC_PGRP_ONLY:
+	case PROC_PPID_ONLY:
+	case PROC_KDBG_ONLY:
+		n = proc_listpids_smr(type, typeinfo, kbuf, numprocs);
+		goto done_listing;
+	default:
+		break;
+	}
+
 	proc_list_lock();
 
 	n = 0;
@@ -470,6 +589,7 @@ proc_loop:
 
 	proc_list_unlock();
 
+done_listing:
 	ptr = kbuf;
 	error = copyout((caddr_t)ptr, buffer, n * sizeof(int));
 	if (error == 0) {
@@ -659,6 +659,11 @@ SYSCTL_INT(_kern, OID_AUTO, unrestrict_coalitions,
     CTLFLAG_RW, &unrestrict_coalition_syscalls, 0,
     "unrestrict the coalition interface");
 
+extern uint32_t coalition_usage_cache_us;
+SYSCTL_UINT(_kern, OID_AUTO, coalition_usage_cache_us,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &coalition_usage_cache_us, 0,
+    "how long a coalition resource usage snapshot may be reused");
+
 #endif /* DEVELOPMENT */
 
 #endif /* DEVELOPMENT || DEBUG */
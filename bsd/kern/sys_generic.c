@@ -113,6 +113,7 @@
 #include <kern/sched_prim.h>
 #include <kern/mpsc_queue.h>
 #include <kern/debug.h>
+#include <kern/counter.h>
 
 #include <sys/mbuf.h>
 #include <sys/domain.h>
@@ -1971,7 +1972,7 @@ selcount(struct proc *p, u_int32_t *ibits, int nfd, int *countp)
 					error = EBADF;
 					goto bad;
 				}
-				os_ref_retain_locked(&fp->fp_iocount);
+				os_ref_retain(&fp->fp_iocount);
 				n++;
 			}
 		}
@@ -2063,7 +2064,7 @@ seldrop_locked(struct proc *p, u_int32_t *ibits, int nfd, int lim, int *need_wak
 
 				nc++;
 
-				const os_ref_count_t refc = os_ref_release_locked(&fp->fp_iocount);
+				const os_ref_count_t refc = os_ref_release(&fp->fp_iocount);
 				if (0 == refc) {
 					panic("fp_iocount overdecrement!");
 				}
@@ -2518,6 +2519,32 @@ sysctl_mpsc_test_pingpong SYSCTL_HANDLER_ARGS
 SYSCTL_PROC(_kern, OID_AUTO, mpsc_test_pingpong, CTLTYPE_QUAD | CTLFLAG_RW | CTLFLAG_LOCKED,
     0, 0, sysctl_mpsc_test_pingpong, "Q", "MPSC tests: pingpong");
 
+static int
+sysctl_mpsc_test_burst SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg1)
+	uint64_t value = 0;
+	int error;
+
+	error = SYSCTL_IN(req, &value, sizeof(value));
+	if (error) {
+		return error;
+	}
+
+	if (error == 0 && req->newptr) {
+		error = mpsc_test_burst(value, arg2 != 0, &value);
+		if (error == 0) {
+			error = SYSCTL_OUT(req, &value, sizeof(value));
+		}
+	}
+
+	return error;
+}
+SYSCTL_PROC(_kern, OID_AUTO, mpsc_test_burst, CTLTYPE_QUAD | CTLFLAG_RW | CTLFLAG_LOCKED,
+    0, 0, sysctl_mpsc_test_burst, "Q", "MPSC tests: burst");
+SYSCTL_PROC(_kern, OID_AUTO, mpsc_test_burst_coalesced, CTLTYPE_QUAD | CTLFLAG_RW | CTLFLAG_LOCKED,
+    0, 1, sysctl_mpsc_test_burst, "Q", "MPSC tests: burst with batching and wakeup coalescing");
+
 #endif /* DEVELOPMENT || DEBUG */
 
 /* Telemetry, microstackshots */
@@ -2782,6 +2809,20 @@ sysctl_kern_sched_thread_bind_cluster_id SYSCTL_HANDLER_ARGS
 SYSCTL_PROC(_kern, OID_AUTO, sched_thread_bind_cluster_id, CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_LOCKED,
     0, 0, sysctl_kern_sched_thread_bind_cluster_id, "I", "");
 
+extern int sysctl_get_cpu_cluster_types(char *buf, int len);
+static int
+sysctl_kern_sched_cpu_cluster_types SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg1, arg2)
+	char buff[MAX_CPUS];
+	int ncpus = sysctl_get_cpu_cluster_types(buff, sizeof(buff));
+
+	return SYSCTL_OUT(req, buff, ncpus);
+}
+
+SYSCTL_PROC(_kern, OID_AUTO, sched_cpu_cluster_types, CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_LOCKED,
+    0, 0, sysctl_kern_sched_cpu_cluster_types, "A", "Cluster type (E or P) of each cpu id");
+
 #if CONFIG_SCHED_EDGE
 
 extern int sched_edge_restrict_ut;
@@ -2790,6 +2831,18 @@ extern int sched_edge_restrict_bg;
 SYSCTL_INT(_kern, OID_AUTO, sched_edge_restrict_bg, CTLFLAG_RW | CTLFLAG_LOCKED, &sched_edge_restrict_ut, 0, "Edge Scheduler Restrict BG Threads");
 extern int sched_edge_migrate_ipi_immediate;
 SYSCTL_INT(_kern, OID_AUTO, sched_edge_migrate_ipi_immediate, CTLFLAG_RW | CTLFLAG_LOCKED, &sched_edge_migrate_ipi_immediate, 0, "Edge Scheduler uses immediate IPIs for migration event based on execution latency");
+extern uint32_t sched_edge_steal_warm_us;
+SYSCTL_UINT(_kern, OID_AUTO, sched_edge_steal_warm_us, CTLFLAG_RW | CTLFLAG_LOCKED, &sched_edge_steal_warm_us, 0, "Edge Scheduler cache warmth window for cross-cluster steals");
+SCALABLE_COUNTER_DECLARE(sched_edge_steal_success);
+SYSCTL_SCALABLE_COUNTER(_kern, sched_edge_steal_success, sched_edge_steal_success, "Edge Scheduler steals which took a thread");
+SCALABLE_COUNTER_DECLARE(sched_edge_steal_failure);
+SYSCTL_SCALABLE_COUNTER(_kern, sched_edge_steal_failure, sched_edge_steal_failure, "Edge Scheduler steals which found nothing to take");
+SCALABLE_COUNTER_DECLARE(sched_edge_steal_warm_skips);
+SYSCTL_SCALABLE_COUNTER(_kern, sched_edge_steal_warm_skips, sched_edge_steal_warm_skips, "Edge Scheduler steals declined for cache warmth");
+SCALABLE_COUNTER_DECLARE(sched_edge_migrations);
+SYSCTL_SCALABLE_COUNTER(_kern, sched_edge_migrations, sched_edge_migrations, "Edge Scheduler placements on a different cluster than the thread last ran on");
+SCALABLE_COUNTER_DECLARE(sched_edge_spills);
+SYSCTL_SCALABLE_COUNTER(_kern, sched_edge_spills, sched_edge_spills, "Edge Scheduler placements away from the thread's preferred cluster");
 
 #endif /* CONFIG_SCHED_EDGE */
 
@@ -135,6 +135,7 @@
 #include <sys/aio_kern.h>
 #include <sys/signalvar.h>
 #include <sys/pipe.h>
+#include <sys/ubc.h>
 #include <sys/sysproto.h>
 #include <sys/proc_info.h>
 
@@ -145,6 +146,7 @@
 #include <kern/zalloc.h>
 #include <kern/kalloc.h>
 #include <vm/vm_kern.h>
+#include <vm/vm_map.h>
 #include <libkern/OSAtomic.h>
 #include <libkern/section_keywords.h>
 
@@ -240,9 +242,22 @@ static _Atomic uint64_t pipe_unique_id = 1;
 
 int maxpipekva __attribute__((used)) = PIPE_KVAMAX;  /* allowing 16MB max. */
 
-#if PIPE_SYSCTLS
+/*
+ * Blocking writes of at least pipe_direct_min bytes bypass the pipe
+ * buffer: the writer's pages are mapped in the kernel and the reader
+ * copies straight out of them (see pipe_direct_write()).
+ * 0 disables direct writes.
+ */
+static TUNABLE_WRITEABLE(uint32_t, pipe_direct_min, "pipe_direct_min", BIG_PIPE_SIZE);
+static TUNABLE_WRITEABLE(uint32_t, pipe_direct_max, "pipe_direct_max", 1024 * 1024);
+
 SYSCTL_DECL(_kern_ipc);
+SYSCTL_UINT(_kern_ipc, OID_AUTO, pipe_direct_min, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &pipe_direct_min, 0, "Minimum size of a direct pipe write, 0 disables them");
+SYSCTL_UINT(_kern_ipc, OID_AUTO, pipe_direct_max, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &pipe_direct_max, 0, "Maximum amount of a write mapped by a direct pipe write");
 
+#if PIPE_SYSCTLS
 SYSCTL_INT(_kern_ipc, OID_AUTO, maxpipekva, CTLFLAG_RD | CTLFLAG_LOCKED,
     &maxpipekva, 0, "Pipe KVA limit");
 SYSCTL_INT(_kern_ipc, OID_AUTO, maxpipekvawired, CTLFLAG_RW | CTLFLAG_LOCKED,
@@ -272,6 +287,11 @@ static ZONE_DEFINE_TYPE(pipe_zone, "pipe zone", struct pipepair, ZC_NONE);
 
 #define MAX_PIPESIZE(pipe)              ( MAX(PIPE_SIZE, (pipe)->pipe_buffer.size) )
 
+/* number of readable bytes, buffered or in a direct write */
+#define PIPE_COUNT(pipe) \
+	((pipe)->pipe_buffer.cnt + (((pipe)->pipe_state & PIPE_DIRECTW) ? \
+	(u_int)((pipe)->pipe_map.cnt - (pipe)->pipe_map.pos) : 0))
+
 SYSINIT(vfs, SI_SUB_VFS, SI_ORDER_ANY, pipeinit, NULL);
 
 #if defined(XNU_TARGET_OS_OSX)
@@ -480,13 +500,13 @@ pipe_stat(struct pipe *cpipe, void *ub, int isstat64)
 		if (cpipe->pipe_peer) {
 			/* the peer still exists, use it's info */
 			pipe_size  = MAX_PIPESIZE(cpipe->pipe_peer);
-			pipe_count = cpipe->pipe_peer->pipe_buffer.cnt;
+			pipe_count = PIPE_COUNT(cpipe->pipe_peer);
 		} else {
 			pipe_count = 0;
 		}
 	} else {
 		pipe_size  = MAX_PIPESIZE(cpipe);
-		pipe_count = cpipe->pipe_buffer.cnt;
+		pipe_count = PIPE_COUNT(cpipe);
 	}
 	/*
 	 * since peer's buffer is setup ouside of lock
@@ -815,6 +835,33 @@ pipe_read(struct fileproc *fp, struct uio *uio, __unused int flags,
 				rpipe->pipe_buffer.out = 0;
 			}
 			nread += size;
+		} else if (rpipe->pipe_state & PIPE_DIRECTW) {
+			/*
+			 * direct write receive: copy out of the writer's
+			 * mapping, the io lock keeps it from being torn down.
+			 */
+			struct pipemapping *map = &rpipe->pipe_map;
+
+			size = (u_int) MIN(INT_MAX, MIN((user_size_t)(map->cnt - map->pos),
+			    (user_size_t)uio_resid(uio)));
+
+			PIPE_UNLOCK(rpipe);
+			error = uiomove((caddr_t)(map->kva + map->pos), size, uio);
+			PIPE_LOCK(rpipe);
+			if (error) {
+				break;
+			}
+
+			map->pos += size;
+			if (map->pos == map->cnt) {
+				/* let the writer finish */
+				rpipe->pipe_state &= ~PIPE_DIRECTW;
+				if (rpipe->pipe_state & PIPE_WANTW) {
+					rpipe->pipe_state &= ~PIPE_WANTW;
+					wakeup(rpipe);
+				}
+			}
+			nread += size;
 		} else {
 			/*
 			 * detect EOF condition
@@ -903,6 +950,129 @@ unlocked_error:
 	return error;
 }
 
+/*
+ * Direct write: wire the current iovec of a large blocking write with a
+ * UPL, map it in the kernel, publish it with PIPE_DIRECTW, and wait until
+ * readers have copied it out. This saves the copy into the pipe buffer,
+ * and lets a single read drain up to pipe_direct_max bytes regardless of
+ * the buffer size.
+ *
+ * Called with the pipe locked and the pipe buffer empty.
+ * Returns EAGAIN if the buffer couldn't be wired or mapped and the write
+ * should go through the pipe buffer instead.
+ */
+static int
+pipe_direct_write(struct fileproc *fp, struct pipe *wpipe, struct uio *uio)
+{
+	struct pipemapping *map = &wpipe->pipe_map;
+	vm_map_t user_map = current_map();
+	upl_control_flags_t upl_flags;
+	upl_size_t upl_size;
+	upl_t upl = NULL;
+	vm_offset_t kva = 0, upl_offset;
+	vm_map_size_t map_size;
+	user_size_t size;
+	user_addr_t uaddr;
+	kern_return_t kr;
+	int error = 0;
+
+	uaddr = uio_curriovbase(uio);
+	size = MIN(uio_curriovlen(uio), pipe_direct_max);
+	if (size == 0) {
+		return EAGAIN;
+	}
+
+	upl_offset = (vm_offset_t)(uaddr & vm_map_page_mask(user_map));
+	map_size = vm_map_round_page(upl_offset + size, vm_map_page_mask(user_map));
+	if (map_size > MAX_UPL_SIZE_BYTES ||
+	    amountpipekva + (int)map_size > maxpipekva) {
+		return EAGAIN;
+	}
+
+	if ((error = pipeio_lock(wpipe, 1)) != 0) {
+		return error;
+	}
+	if (wpipe->pipe_buffer.cnt != 0 || (wpipe->pipe_state & PIPE_DIRECTW)) {
+		/* lost a race against another writer */
+		pipeio_unlock(wpipe);
+		return EAGAIN;
+	}
+
+	PIPE_UNLOCK(wpipe);
+	upl_size = (upl_size_t)map_size;
+	upl_flags = UPL_COPYOUT_FROM | UPL_SET_INTERNAL | UPL_SET_LITE |
+	    UPL_SET_IO_WIRE;
+	kr = vm_map_get_upl(user_map, vm_map_trunc_page(uaddr,
+	    vm_map_page_mask(user_map)), &upl_size, &upl, NULL, NULL,
+	    &upl_flags, VM_KERN_MEMORY_FILE, 0);
+	if (kr == KERN_SUCCESS && upl_size < map_size) {
+		ubc_upl_abort(upl, 0);
+		kr = KERN_FAILURE;
+	}
+	if (kr == KERN_SUCCESS && ubc_upl_map(upl, &kva) != KERN_SUCCESS) {
+		ubc_upl_abort(upl, 0);
+		kr = KERN_FAILURE;
+	}
+	PIPE_LOCK(wpipe);
+	if (kr != KERN_SUCCESS) {
+		pipeio_unlock(wpipe);
+		return EAGAIN;
+	}
+
+	OSAddAtomic((int)map_size, &amountpipekva);
+	map->upl = upl;
+	map->kva = kva + upl_offset;
+	map->cnt = (vm_size_t)size;
+	map->pos = 0;
+	wpipe->pipe_state |= PIPE_DIRECTW;
+	pipeio_unlock(wpipe);
+
+	if (wpipe->pipe_state & PIPE_WANTR) {
+		wpipe->pipe_state &= ~PIPE_WANTR;
+		wakeup(wpipe);
+	}
+	pipeselwakeup(wpipe, wpipe);
+
+	while (wpipe->pipe_state & PIPE_DIRECTW) {
+		if ((wpipe->pipe_state & (PIPE_DRAIN | PIPE_EOF)) ||
+		    (fileproc_get_vflags(fp) & FPV_DRAIN)) {
+			error = EPIPE;
+			break;
+		}
+		wpipe->pipe_state |= PIPE_WANTW;
+		error = msleep(wpipe, PIPE_MTX(wpipe), PRIBIO | PCATCH, "pipedw", 0);
+		if (error != 0) {
+			break;
+		}
+	}
+
+	/*
+	 * Tear the mapping down, waiting for a reader that might still
+	 * be copying out of it. Whatever was consumed has been written.
+	 */
+	(void)pipeio_lock(wpipe, 0);
+	wpipe->pipe_state &= ~PIPE_DIRECTW;
+	uio_update(uio, map->pos);
+	map->upl = NULL;
+	map->kva = 0;
+	map->cnt = map->pos = 0;
+	pipeio_unlock(wpipe);
+
+	PIPE_UNLOCK(wpipe);
+	ubc_upl_unmap(upl);
+	ubc_upl_abort(upl, 0);
+	PIPE_LOCK(wpipe);
+	OSAddAtomic(-(int)map_size, &amountpipekva);
+
+	/* let writers that queued behind us proceed */
+	if (wpipe->pipe_state & PIPE_WANTW) {
+		wpipe->pipe_state &= ~PIPE_WANTW;
+		wakeup(wpipe);
+	}
+
+	return error;
+}
+
 /*
  * perform a write of n bytes into the read side of buffer. Since
  * pipes are unidirectional a write is meant to be read by the otherside only.
@@ -1002,6 +1172,23 @@ retrywrite:
 			space = 0;
 		}
 
+		/* Data of a direct write must be consumed before anything else. */
+		if (wpipe->pipe_state & PIPE_DIRECTW) {
+			space = 0;
+		} else if (pipe_direct_min && wpipe->pipe_buffer.cnt == 0 &&
+		    uio_resid(uio) >= pipe_direct_min &&
+		    uio_isuserspace(uio) && (fp->f_flag & FNONBLOCK) == 0) {
+			error = pipe_direct_write(fp, wpipe, uio);
+			if (error == 0) {
+				continue;
+			}
+			if (error != EAGAIN) {
+				break;
+			}
+			/* couldn't map it, go through the pipe buffer */
+			error = 0;
+		}
+
 		if (space > 0) {
 			if ((error = pipeio_lock(wpipe, 1)) == 0) {
 				size_t size;       /* Transfer size */
@@ -1218,7 +1405,7 @@ pipe_ioctl(struct fileproc *fp, u_long cmd, caddr_t data,
 		return 0;
 
 	case FIONREAD:
-		*(int *)data = mpipe->pipe_buffer.cnt;
+		*(int *)data = (int)PIPE_COUNT(mpipe);
 		PIPE_UNLOCK(mpipe);
 		return 0;
 
@@ -1463,7 +1650,7 @@ filt_pipenotsupprocess(struct knote *kn, struct kevent_qos_s *kev)
 static int
 filt_piperead_common(struct knote *kn, struct kevent_qos_s *kev, struct pipe *rpipe)
 {
-	int64_t data = rpipe->pipe_buffer.cnt;
+	int64_t data = PIPE_COUNT(rpipe);
 	int res = 0;
 
 	if (filt_pipe_draincommon(kn, rpipe)) {
@@ -1529,7 +1716,9 @@ filt_pipewrite_common(struct knote *kn, struct kevent_qos_s *kev, struct pipe *r
 	if (filt_pipe_draincommon(kn, rpipe)) {
 		res = 1;
 	} else {
-		data = MAX_PIPESIZE(rpipe) - rpipe->pipe_buffer.cnt;
+		if ((rpipe->pipe_state & PIPE_DIRECTW) == 0) {
+			data = MAX_PIPESIZE(rpipe) - rpipe->pipe_buffer.cnt;
+		}
 		res = data >= filt_pipelowwat(kn, rpipe, PIPE_BUF);
 	}
 	if (res && kev) {
@@ -1696,13 +1885,13 @@ fill_pipeinfo(struct pipe * cpipe, struct pipe_info * pinfo)
 			 * the peer still exists, use it's info
 			 */
 			pipe_size  = MAX_PIPESIZE(cpipe->pipe_peer);
-			pipe_count = cpipe->pipe_peer->pipe_buffer.cnt;
+			pipe_count = PIPE_COUNT(cpipe->pipe_peer);
 		} else {
 			pipe_count = 0;
 		}
 	} else {
 		pipe_size  = MAX_PIPESIZE(cpipe);
-		pipe_count = cpipe->pipe_buffer.cnt;
+		pipe_count = PIPE_COUNT(cpipe);
 	}
 	/*
 	 * since peer's buffer is setup ouside of lock
@@ -49,6 +49,7 @@
 #include <kern/zalloc.h>
 #include <kern/thread.h>
 #include <kern/clock.h>
+#include <kern/counter.h>
 #include <kern/ledger.h>
 #include <kern/policy_internal.h>
 #include <kern/task.h>
@@ -167,11 +168,29 @@ typedef struct ull {
 #define ULL_MUST_EXIST  0x0001
 static void ull_put(ull_t *);
 
-static uint32_t ulock_adaptive_spin_usecs = 20;
+/*
+ * Upper bound of the ULF_WAIT_ADAPTIVE_SPIN spin, 0 disables spinning.
+ */
+static TUNABLE_WRITEABLE(uint32_t, ulock_adaptive_spin_usecs,
+    "ulock_adaptive_spin_usecs", 20);
 
 SYSCTL_INT(_kern, OID_AUTO, ulock_adaptive_spin_usecs, CTLFLAG_RW | CTLFLAG_LOCKED,
     &ulock_adaptive_spin_usecs, 0, "ulock adaptive spin duration");
 
+SCALABLE_COUNTER_DEFINE(ulock_wait_count);
+SCALABLE_COUNTER_DEFINE(ulock_hash_collisions);
+SCALABLE_COUNTER_DEFINE(ulock_adaptive_spin_count);
+SCALABLE_COUNTER_DEFINE(ulock_adaptive_spin_success);
+
+SYSCTL_SCALABLE_COUNTER(_kern, ulock_waits, ulock_wait_count,
+    "number of ulock waits that blocked or checked the lock value");
+SYSCTL_SCALABLE_COUNTER(_kern, ulock_hash_collisions, ulock_hash_collisions,
+    "number of ulocks skipped in a hash bucket before finding the key");
+SYSCTL_SCALABLE_COUNTER(_kern, ulock_adaptive_spins, ulock_adaptive_spin_count,
+    "number of ulock waits that spun on an on core owner");
+SYSCTL_SCALABLE_COUNTER(_kern, ulock_adaptive_spin_successes, ulock_adaptive_spin_success,
+    "number of adaptive spins that saw the lock change without blocking");
+
 #if DEVELOPMENT || DEBUG
 static int ull_simulate_copyin_fault = 0;
 
@@ -341,6 +360,7 @@ ull_get(ulk_t *key, uint32_t flags, ull_t **unused_ull)
 			break;
 		} else {
 			ull_unlock(elem);
+			counter_inc(&ulock_hash_collisions);
 		}
 	}
 	if (ull == NULL) {
@@ -554,7 +574,8 @@ sys_ulock_wait2(struct proc *p, struct ulock_wait2_args *args, int32_t *retval)
 		key.ulk_addr = args->addr;
 	}
 
-	if ((flags & ULF_WAIT_ADAPTIVE_SPIN) && set_owner) {
+	if ((flags & ULF_WAIT_ADAPTIVE_SPIN) && set_owner &&
+	    ulock_adaptive_spin_usecs != 0) {
 		/*
 		 * Attempt the copyin outside of the lock once,
 		 *
@@ -585,10 +606,16 @@ sys_ulock_wait2(struct proc *p, struct ulock_wait2_args *args, int32_t *retval)
 			if (end == 0) {
 				clock_interval_to_deadline(ulock_adaptive_spin_usecs,
 				    NSEC_PER_USEC, &end);
+				counter_inc(&ulock_adaptive_spin_count);
 			} else if (mach_absolute_time() > end) {
 				break;
 			}
-			if (copyin_atomic32_wait_if_equals(args->addr, u32) != 0) {
+			int spin_ret = copyin_atomic32_wait_if_equals(args->addr, u32);
+			if (spin_ret != 0) {
+				if (spin_ret == ESTALE) {
+					/* the owner released the lock while we spun */
+					counter_inc(&ulock_adaptive_spin_success);
+				}
 				goto munge_retval;
 			}
 		}
@@ -602,6 +629,7 @@ sys_ulock_wait2(struct proc *p, struct ulock_wait2_args *args, int32_t *retval)
 	/* ull is locked */
 
 	ull->ull_nwaiters++;
+	counter_inc(&ulock_wait_count);
 
 	if (ull->ull_opcode == 0) {
 		ull->ull_opcode = opcode;
@@ -679,14 +707,16 @@ sys_ulock_wait2(struct proc *p, struct ulock_wait2_args *args, int32_t *retval)
 		 * on it to come by later to issue the wakeup and lose its promotion.
 		 */
 
-		/* Return the +1 ref from the ull_owner field */
-		old_owner = ull->ull_owner;
-		ull->ull_owner = THREAD_NULL;
+		if (ull->ull_owner != owner_thread) {
+			/* Return the +1 ref from the ull_owner field */
+			old_owner = ull->ull_owner;
+			ull->ull_owner = THREAD_NULL;
 
-		if (owner_thread != THREAD_NULL) {
-			/* The ull_owner field now owns a +1 ref on owner_thread */
-			thread_reference(owner_thread);
-			ull->ull_owner = owner_thread;
+			if (owner_thread != THREAD_NULL) {
+				/* The ull_owner field now owns a +1 ref on owner_thread */
+				thread_reference(owner_thread);
+				ull->ull_owner = owner_thread;
+			}
 		}
 	}
 
@@ -97,6 +97,8 @@
 #include <sys/priv.h>
 #include <sys/kern_event.h>
 #include <net/route.h>
+#include <net/if_var.h>
+#include <net/dlil.h>
 #include <net/init.h>
 #include <net/net_api_stats.h>
 #include <net/ntstat.h>
@@ -111,6 +113,10 @@
 #include <netinet/flow_divert.h>
 #include <kern/zalloc.h>
 #include <kern/locks.h>
+#include <kern/counter.h>
+#include <kern/thread_call.h>
+#include <kern/clock.h>
+#include <kern/smr.h>
 #include <machine/limits.h>
 #include <libkern/OSAtomic.h>
 #include <pexpert/pexpert.h>
@@ -122,6 +128,9 @@
 #include <sys/mcache.h>
 #include <sys/unpcb.h>
 #include <libkern/section_keywords.h>
+#include <os/refcnt.h>
+#include <vm/vm_kern.h>
+#include <vm/vm_map.h>
 
 #include <os/log.h>
 
@@ -259,6 +268,72 @@ SYSCTL_INT(_kern_ipc, OID_AUTO, sosendminchain,
 SYSCTL_INT(_kern_ipc, OID_AUTO, sorecvmincopy,
     CTLFLAG_RW | CTLFLAG_LOCKED, &sorecvmincopy, 0, "");
 
+/*
+ * Plain stream reads unlink what they consume from the receive buffer in
+ * one pass and copy it out with the socket lock dropped once, instead of
+ * dropping and retaking it around every mbuf, so the input thread can
+ * keep appending while the reader copies.
+ */
+static int sorecvbatch = 1;
+SYSCTL_INT(_kern_ipc, OID_AUTO, sorecvbatch,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &sorecvbatch, 0,
+    "Copy out plain stream reads in one pass with the socket unlocked");
+
+SCALABLE_COUNTER_DEFINE(sorecvbatch_bytes);
+SYSCTL_SCALABLE_COUNTER(_kern_ipc, sorecvbatch_bytes, sorecvbatch_bytes,
+    "Bytes received through the batched stream path");
+
+/*
+ * SO_BUSY_POLL: a blocking read on an empty receive buffer first polls the
+ * interface the connection last sent on, from the reading thread, for up to
+ * so_busy_poll usecs.  Data that shows up in the meantime is ready without
+ * a wakeup and the two context switches that go with it.
+ */
+static uint32_t so_busy_poll_max = 10000;
+SYSCTL_UINT(_kern_ipc, OID_AUTO, busy_poll_max_usec,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &so_busy_poll_max, 0,
+    "Largest SO_BUSY_POLL budget in usecs (0 disables)");
+
+SCALABLE_COUNTER_DEFINE(so_busy_poll_hits);
+SYSCTL_SCALABLE_COUNTER(_kern_ipc, busy_poll_hits, so_busy_poll_hits,
+    "Busy-polling reads that found data before sleeping");
+SCALABLE_COUNTER_DEFINE(so_busy_poll_timeouts);
+SYSCTL_SCALABLE_COUNTER(_kern_ipc, busy_poll_timeouts, so_busy_poll_timeouts,
+    "Busy-polling reads that ran out of budget and slept");
+
+/* Time from the start of polling until data was ready, log2 ns buckets */
+#define SO_BUSY_POLL_BUCKETS    32
+static uint64_t so_busy_poll_hist[SO_BUSY_POLL_BUCKETS];
+
+static int
+sysctl_so_busy_poll_pct SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg1)
+	uint64_t hist[SO_BUSY_POLL_BUCKETS], total = 0, sum = 0, val = 0;
+	int i;
+
+	for (i = 0; i < SO_BUSY_POLL_BUCKETS; i++) {
+		hist[i] = os_atomic_load(&so_busy_poll_hist[i], relaxed);
+		total += hist[i];
+	}
+	for (i = 0; i < SO_BUSY_POLL_BUCKETS && total != 0; i++) {
+		sum += hist[i];
+		if (sum * 100 >= total * (uint64_t)arg2) {
+			/* Report the upper bound of the bucket */
+			val = 1ULL << (i + 1);
+			break;
+		}
+	}
+	return sysctl_io_number(req, val, sizeof(val), NULL, NULL);
+}
+
+SYSCTL_PROC(_kern_ipc, OID_AUTO, busy_poll_p50_ns,
+    CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED, NULL, 50,
+    sysctl_so_busy_poll_pct, "Q", "Median busy-poll hit latency in ns");
+SYSCTL_PROC(_kern_ipc, OID_AUTO, busy_poll_p99_ns,
+    CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED, NULL, 99,
+    sysctl_so_busy_poll_pct, "Q", "99th percentile busy-poll hit latency in ns");
+
 /*
  * Set to enable jumbo clusters (if available) for large writes when
  * the socket is marked with SOF_MULTIPAGES; see below.
@@ -337,6 +412,7 @@ vm_size_t       so_cache_zone_element_size;
 
 static int sodelayed_copy(struct socket *, struct uio *, struct mbuf **,
     user_ssize_t *);
+static int soreceive_stream_batch(struct socket *, struct uio *);
 static void cached_sock_alloc(struct socket **, zalloc_flags_t);
 static void cached_sock_free(struct socket *);
 
@@ -378,6 +454,64 @@ __private_extern__ u_int32_t sotcdb = 0;
 SYSCTL_INT(_kern_ipc, OID_AUTO, sotcdb, CTLFLAG_RW | CTLFLAG_LOCKED,
     &sotcdb, 0, "");
 
+/*
+ * SO_ZEROCOPY: TCP writes of at least sosend_zerocopy_min bytes are not
+ * copied into clusters.  The user pages are copied-in copy-on-write, mapped
+ * and wired in the kernel and attached to the mbufs as external storage;
+ * they are unmapped once the stack drops the last mbuf referring to them.
+ */
+static int sosend_zerocopy_min = 64 * 1024;
+SYSCTL_INT(_kern_ipc, OID_AUTO, sosend_zerocopy_min,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &sosend_zerocopy_min, 0,
+    "Smallest write sent without copying on SO_ZEROCOPY sockets (0 disables)");
+
+static uint64_t sosend_zerocopy_maxpinned = 64 * 1024 * 1024;
+SYSCTL_QUAD(_kern_ipc, OID_AUTO, sosend_zerocopy_maxpinned,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &sosend_zerocopy_maxpinned,
+    "Most bytes of user memory wired for zero-copy sends at once");
+
+static uint64_t sosend_zerocopy_pinned;
+SYSCTL_QUAD(_kern_ipc, OID_AUTO, sosend_zerocopy_pinned,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &sosend_zerocopy_pinned,
+    "Bytes of user memory currently wired for zero-copy sends");
+
+SCALABLE_COUNTER_DEFINE(sosend_zerocopy_bytes);
+SYSCTL_SCALABLE_COUNTER(_kern_ipc, sosend_zerocopy_bytes,
+    sosend_zerocopy_bytes, "Bytes sent without copying");
+SCALABLE_COUNTER_DEFINE(sosend_zerocopy_fallbacks);
+SYSCTL_SCALABLE_COUNTER(_kern_ipc, sosend_zerocopy_fallbacks,
+    sosend_zerocopy_fallbacks, "Zero-copy sends that fell back to copying");
+
+/* Per socket, outlives the socket until all of its regions are released */
+struct sozerocopy {
+	os_refcnt_t     zc_refcnt;
+	int             zc_enabled;
+	uint64_t        zc_sent;
+	uint64_t        zc_completed;
+};
+
+/* One wired kernel mapping of a user buffer, shared by its mbufs */
+struct sozerocopy_region {
+	STAILQ_ENTRY(sozerocopy_region) zr_link;
+	os_refcnt_t             zr_refcnt;
+	vm_map_offset_t         zr_start;
+	vm_map_offset_t         zr_end;
+	uint64_t                zr_pinned;
+	uint32_t                zr_len;
+	struct sozerocopy       *zr_zc;
+};
+
+os_refgrp_decl(static, sozerocopy_refgrp, "sozerocopy", NULL);
+
+static LCK_GRP_DECLARE(sozerocopy_mtx_grp, "sozerocopy");
+static LCK_MTX_DECLARE(sozerocopy_mtx, &sozerocopy_mtx_grp);
+static STAILQ_HEAD(, sozerocopy_region) sozerocopy_reclaimq =
+    STAILQ_HEAD_INITIALIZER(sozerocopy_reclaimq);
+static thread_call_t sozerocopy_tcall;
+
+static void sozerocopy_release(struct sozerocopy *);
+static void sozerocopy_reclaim(thread_call_param_t, thread_call_param_t);
+
 void
 socketinit(void)
 {
@@ -422,6 +556,10 @@ socketinit(void)
 	soextbkidlestat.so_xbkidle_time = SO_IDLE_BK_IDLE_TIME;
 	soextbkidlestat.so_xbkidle_rcvhiwat = SO_IDLE_BK_IDLE_RCV_HIWAT;
 
+	sozerocopy_tcall = thread_call_allocate_with_options(sozerocopy_reclaim,
+	    NULL, THREAD_CALL_PRIORITY_KERNEL, THREAD_CALL_OPTIONS_ONCE);
+	VERIFY(sozerocopy_tcall != NULL);
+
 	in_pcbinit();
 }
 
@@ -497,6 +635,12 @@ cached_sock_free(struct socket *so)
 	}
 }
 
+static void
+cached_sock_free_smr(void *so)
+{
+	cached_sock_free(so);
+}
+
 void
 so_update_last_owner_locked(struct socket *so, proc_t self)
 {
@@ -952,13 +1096,19 @@ sodealloc(struct socket *so)
 {
 	kauth_cred_unref(&so->so_cred);
 
+	if (so->so_zerocopy != NULL) {
+		sozerocopy_release(so->so_zerocopy);
+		so->so_zerocopy = NULL;
+	}
+
 	/* Remove any filters */
 	sflt_termsock(so);
 
 	so->so_gencnt = OSIncrementAtomic64((SInt64 *)&so_gencnt);
 
 	if (so->so_flags1 & SOF1_CACHED_IN_SOCK_LAYER) {
-		cached_sock_free(so);
+		/* in_pcblookup_hash() may still be looking at the bundled inpcb */
+		smr_global_retire(so, sizeof(*so), cached_sock_free_smr);
 	} else {
 		zfree(socket_zone, so);
 	}
@@ -2099,6 +2249,186 @@ defunct:
 	return 0;
 }
 
+static void
+sozerocopy_release(struct sozerocopy *zc)
+{
+	if (os_ref_release(&zc->zc_refcnt) == 0) {
+		kfree_type(struct sozerocopy, zc);
+	}
+}
+
+/*
+ * Unmapping needs the VM map lock, which can't be taken from wherever the
+ * last mbuf happens to be freed; hand the region to a thread call instead.
+ */
+static void
+sozerocopy_free(caddr_t buf, u_int size, caddr_t arg)
+{
+#pragma unused(buf, size)
+	struct sozerocopy_region *zr = (struct sozerocopy_region *)(void *)arg;
+
+	if (os_ref_release(&zr->zr_refcnt) != 0) {
+		return;
+	}
+
+	lck_mtx_lock_spin(&sozerocopy_mtx);
+	STAILQ_INSERT_TAIL(&sozerocopy_reclaimq, zr, zr_link);
+	lck_mtx_unlock(&sozerocopy_mtx);
+
+	thread_call_enter(sozerocopy_tcall);
+}
+
+static void
+sozerocopy_reclaim(thread_call_param_t arg0, thread_call_param_t arg1)
+{
+#pragma unused(arg0, arg1)
+	STAILQ_HEAD(, sozerocopy_region) q;
+	struct sozerocopy_region *zr;
+
+	lck_mtx_lock_spin(&sozerocopy_mtx);
+	STAILQ_INIT(&q);
+	STAILQ_CONCAT(&q, &sozerocopy_reclaimq);
+	lck_mtx_unlock(&sozerocopy_mtx);
+
+	while ((zr = STAILQ_FIRST(&q)) != NULL) {
+		STAILQ_REMOVE_HEAD(&q, zr_link);
+
+		(void) vm_map_unwire(ipc_kernel_map, zr->zr_start, zr->zr_end,
+		    FALSE);
+		(void) vm_deallocate(ipc_kernel_map, zr->zr_start,
+		    zr->zr_end - zr->zr_start);
+		os_atomic_sub(&sosend_zerocopy_pinned, zr->zr_pinned, relaxed);
+
+		os_atomic_add(&zr->zr_zc->zc_completed, zr->zr_len, relaxed);
+		sozerocopy_release(zr->zr_zc);
+		kfree_type(struct sozerocopy_region, zr);
+	}
+}
+
+/*
+ * Returns the zero-copy state if this send may skip copying user data,
+ * NULL otherwise.  Called with the socket locked.
+ */
+static struct sozerocopy *
+sosend_zerocopy_ok(struct socket *so, struct uio *uio, int atomic)
+{
+	struct sozerocopy *zc = so->so_zerocopy;
+
+	if (zc == NULL || !zc->zc_enabled || sosend_zerocopy_min <= 0 ||
+	    uio == NULL || atomic || !uio_isuserspace(uio) ||
+	    uio_resid(uio) < sosend_zerocopy_min ||
+	    SOCK_TYPE(so) != SOCK_STREAM || SOCK_PROTO(so) != IPPROTO_TCP) {
+		return NULL;
+	}
+	return zc;
+}
+
+/*
+ * Wire up to bytes of the current user iovec into the kernel and build a
+ * chain of mbufs over it, one per page.  The caller falls back to copying
+ * when NULL is returned; otherwise the uio has been advanced past *lenp
+ * bytes and *lastp points to the tail of the chain.  Called with the
+ * socket unlocked.
+ */
+static struct mbuf *
+sosend_zerocopy(struct sozerocopy *zc, struct uio *uio, int bytes, int hdr,
+    struct mbuf **lastp, int *lenp)
+{
+	struct sozerocopy_region *zr;
+	struct mbuf *top = NULL, **mp = &top, *m = NULL;
+	user_addr_t uaddr = uio_curriovbase(uio);
+	vm_map_copy_t copy;
+	vm_map_offset_t kaddr, start, end;
+	uint64_t size;
+	user_size_t len;
+	int off;
+
+	len = MIN((user_size_t)bytes, uio_curriovlen(uio));
+	if (len < (user_size_t)sosend_zerocopy_min) {
+		return NULL;
+	}
+	/* Leave a trailing partial page to the next write, or to copying */
+	if (vm_map_trunc_page(uaddr + len, PAGE_MASK) > uaddr) {
+		len = vm_map_trunc_page(uaddr + len, PAGE_MASK) - uaddr;
+	}
+	size = vm_map_round_page(uaddr + len, PAGE_MASK) -
+	    vm_map_trunc_page(uaddr, PAGE_MASK);
+
+	if (os_atomic_add(&sosend_zerocopy_pinned, size, relaxed) >
+	    sosend_zerocopy_maxpinned) {
+		goto fallback;
+	}
+	if (vm_map_copyin(current_map(), uaddr, len, FALSE,
+	    &copy) != KERN_SUCCESS) {
+		goto fallback;
+	}
+	if (vm_map_copyout(ipc_kernel_map, &kaddr, copy) != KERN_SUCCESS) {
+		vm_map_copy_discard(copy);
+		goto fallback;
+	}
+	start = vm_map_trunc_page(kaddr, PAGE_MASK);
+	end = vm_map_round_page(kaddr + len, PAGE_MASK);
+	if (vm_map_wire_kernel(ipc_kernel_map, start, end, VM_PROT_READ,
+	    VM_KERN_MEMORY_MBUF, FALSE) != KERN_SUCCESS) {
+		(void) vm_deallocate(ipc_kernel_map, start, end - start);
+		goto fallback;
+	}
+
+	zr = kalloc_type(struct sozerocopy_region, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	/* The extra reference keeps the region until the chain is built */
+	os_ref_init(&zr->zr_refcnt, &sozerocopy_refgrp);
+	zr->zr_start = start;
+	zr->zr_end = end;
+	zr->zr_pinned = size;
+	os_ref_retain(&zc->zc_refcnt);
+	zr->zr_zc = zc;
+
+	for (off = 0; off < (int)len;) {
+		int piece = (int)MIN(len - off,
+		    PAGE_SIZE - ((kaddr + off) & PAGE_MASK));
+
+		m = NULL;
+		if (top != NULL || !hdr) {
+			MGET(m, M_WAIT, MT_DATA);
+			if (m == NULL) {
+				break;
+			}
+		}
+		m = m_clattach(m, MT_DATA, (caddr_t)(kaddr + off),
+		    sozerocopy_free, piece, (caddr_t)zr, M_WAIT, 0);
+		if (m == NULL) {
+			break;
+		}
+		os_ref_retain(&zr->zr_refcnt);
+		if (m->m_flags & M_PKTHDR) {
+			m_add_crumb(m, PKT_CRUMB_SOSEND);
+		}
+		m->m_len = piece;
+		*mp = m;
+		mp = &m->m_next;
+		*lastp = m;
+		off += piece;
+	}
+	zr->zr_len = off;
+	sozerocopy_free(NULL, 0, (caddr_t)zr);
+
+	if (top == NULL) {
+		counter_inc(&sosend_zerocopy_fallbacks);
+		return NULL;
+	}
+
+	uio_update(uio, off);
+	*lenp = off;
+	os_atomic_add(&zc->zc_sent, off, relaxed);
+	counter_add(&sosend_zerocopy_bytes, off);
+	return top;
+
+fallback:
+	os_atomic_sub(&sosend_zerocopy_pinned, size, relaxed);
+	counter_inc(&sosend_zerocopy_fallbacks);
+	return NULL;
+}
+
 /*
  * Send on a socket.
  * If send must go all at once and message is larger than
@@ -2170,6 +2500,7 @@ sosend(struct socket *so, struct sockaddr *addr, struct uio *uio,
 	uint16_t headroom = 0;
 	ssize_t mlen;
 	boolean_t en_tracing = FALSE;
+	struct sozerocopy *zc;
 
 	if (uio != NULL) {
 		resid = uio_resid(uio);
@@ -2252,6 +2583,8 @@ sosend(struct socket *so, struct sockaddr *addr, struct uio *uio,
 		headroom = so->so_pktheadroom;
 	}
 
+	zc = sosend_zerocopy_ok(so, uio, atomic);
+
 	do {
 		error = sosendcheck(so, addr, resid, clen, atomic, flags,
 		    &sblocked);
@@ -2315,6 +2648,21 @@ sosend(struct socket *so, struct sockaddr *addr, struct uio *uio,
 				do {
 					int num_needed;
 					int hdrs_needed = (top == NULL) ? 1 : 0;
+					struct mbuf *mlast;
+					int zclen;
+
+					if (zc != NULL && freelist == NULL &&
+					    (m = sosend_zerocopy(zc, uio,
+					    bytes_to_copy, hdrs_needed, &mlast,
+					    &zclen)) != NULL) {
+						chainlength += zclen;
+						space -= zclen;
+						resid = uio_resid(uio);
+						*mp = m;
+						top->m_pkthdr.len += zclen;
+						mp = &mlast->m_next;
+						goto chained;
+					}
 
 					/*
 					 * try to maintain a local cache of mbuf
@@ -2493,6 +2841,7 @@ sosend(struct socket *so, struct sockaddr *addr, struct uio *uio,
 						break;
 					}
 					mp = &m->m_next;
+chained:
 					if (resid <= 0) {
 						if (flags & MSG_EOR) {
 							top->m_flags |= M_EOR;
@@ -3312,6 +3661,53 @@ so_should_wait(struct socket *so, struct uio *uio, struct mbuf *m, int flags)
 	return false;
 }
 
+/*
+ * Poll the interface for incoming data on behalf of a reader that is about
+ * to sleep in sbwait(), for up to so_busy_poll usecs.  Called and returns
+ * with the socket locked; the lock is dropped while polling so the input
+ * path can deliver to this socket.  An IO reference keeps the interface
+ * from being detached while it is polled without the socket lock.
+ */
+static void
+sobusypoll(struct socket *so, struct uio *uio, int flags)
+{
+	struct inpcb *inp;
+	struct ifnet *ifp;
+	uint64_t start, deadline, now, ns;
+	uint32_t budget;
+
+	budget = MIN(so->so_busy_poll, so_busy_poll_max);
+	if (budget == 0 || (SOCK_DOM(so) != PF_INET && SOCK_DOM(so) != PF_INET6) ||
+	    (inp = sotoinpcb(so)) == NULL || (ifp = inp->inp_last_outifp) == NULL ||
+	    !(ifp->if_eflags & IFEF_RXPOLL) || !ifnet_is_attached(ifp, 1)) {
+		return;
+	}
+
+	start = mach_absolute_time();
+	clock_interval_to_deadline(budget, NSEC_PER_USEC, &deadline);
+	do {
+		socket_unlock(so, 0);
+		(void) ifnet_busy_poll(ifp, 0);
+		socket_lock(so, 0);
+
+		if (so->so_error != 0 || (so->so_state & SS_CANTRCVMORE) ||
+		    !so_should_wait(so, uio, so->so_rcv.sb_mb, flags)) {
+			absolutetime_to_nanoseconds(mach_absolute_time() - start,
+			    &ns);
+			os_atomic_inc(&so_busy_poll_hist[MIN(ns == 0 ? 0 :
+			    63 - __builtin_clzll(ns), SO_BUSY_POLL_BUCKETS - 1)],
+			    relaxed);
+			counter_inc(&so_busy_poll_hits);
+			goto done;
+		}
+		now = mach_absolute_time();
+	} while (now < deadline && so->so_pcb != NULL);
+
+	counter_inc(&so_busy_poll_timeouts);
+done:
+	ifnet_decr_iorefcnt(ifp);
+}
+
 /*
  * Implement receive operations on a socket.
  * We depend on the way that records are added to the sockbuf
@@ -3651,6 +4047,10 @@ restart:
 		}
 
 		error = 0;
+		if (so->so_busy_poll != 0 &&
+		    so_should_wait(so, uio, so->so_rcv.sb_mb, flags)) {
+			sobusypoll(so, uio, flags);
+		}
 		if (so_should_wait(so, uio, so->so_rcv.sb_mb, flags)) {
 			error = sbwait(&so->so_rcv);
 		}
@@ -3751,6 +4151,22 @@ dontblock:
 		can_delay = 0;
 	}
 
+	if (sorecvbatch && m != NULL && mp == NULL &&
+	    (m->m_type == MT_DATA || m->m_type == MT_HEADER) &&
+	    nextrecord == NULL && SOCK_TYPE(so) == SOCK_STREAM &&
+	    !(pr->pr_flags & PR_ATOMIC) &&
+	    !(flags & (MSG_PEEK | MSG_OOB | MSG_WAITALL | MSG_WAITSTREAM)) &&
+	    so->so_oobmark == 0 &&
+	    !(so->so_options & SO_WANTOOBFLAG)) {
+		so->so_state &= ~SS_RCVATMARK;
+		error = soreceive_stream_batch(so, uio);
+		if (error != 0) {
+			goto release;
+		}
+		/* More may have been appended while the lock was dropped */
+		m = so->so_rcv.sb_mb;
+	}
+
 	while (m != NULL &&
 	    (uio_resid(uio) - delayed_copy_len) > 0 && error == 0) {
 		if (m->m_type == MT_OOBDATA) {
@@ -4104,6 +4520,108 @@ release:
 	return error;
 }
 
+/*
+ * Batched stream receive: with the socket locked and the receive buffer
+ * sblock'ed, unlink every whole data mbuf the read consumes, then copy
+ * those and the head of a trailing partially consumed mbuf out with the
+ * lock dropped.  The partial mbuf stays on the buffer while unlocked, as
+ * it does for the regular path: appends never touch the bytes already in
+ * it and sblock keeps other readers and flushes away.  If the copy
+ * fails part way, whatever wasn't copied goes back at the head of the
+ * buffer, so a fault doesn't lose data.
+ *
+ * Returns:	0			Success
+ *	uiomove:EFAULT
+ */
+static int
+soreceive_stream_batch(struct socket *so, struct uio *uio)
+{
+	struct sockbuf *sb = &so->so_rcv;
+	struct mbuf *m, *pm, *free_list = NULL, **mp = &free_list;
+	user_ssize_t resid = uio_resid(uio), taken = 0, copied;
+	int part = 0, error = 0;
+
+	while ((m = sb->sb_mb) != NULL &&
+	    (m->m_type == MT_DATA || m->m_type == MT_HEADER)) {
+		if (taken + m->m_len > resid) {
+			part = (int)(resid - taken);
+			break;
+		}
+		taken += m->m_len;
+		sbfree(sb, m);
+		sb->sb_mb = m->m_next;
+		m->m_next = NULL;
+		m->m_nextpkt = NULL;
+		*mp = m;
+		mp = &m->m_next;
+	}
+	pm = sb->sb_mb;
+	if (pm == NULL) {
+		SB_EMPTY_FIXUP(sb);
+	} else {
+		sb->sb_lastrecord = pm;
+	}
+	SBLASTRECORDCHK(sb, "soreceive_stream_batch");
+	SBLASTMBUFCHK(sb, "soreceive_stream_batch");
+
+	socket_unlock(so, 0);
+	for (m = free_list; m != NULL && error == 0; m = m->m_next) {
+		error = uiomove(mtod(m, caddr_t), (int)m->m_len, uio);
+	}
+	if (error == 0 && part > 0) {
+		error = uiomove(mtod(pm, caddr_t), part, uio);
+	}
+	socket_lock(so, 0);
+
+	copied = resid - uio_resid(uio);
+	if (copied < taken) {
+		struct mbuf *back, *last;
+		user_ssize_t skip = copied;
+
+		/*
+		 * Keep what was copied on free_list and put the rest back
+		 * ahead of anything appended while we were unlocked.
+		 */
+		mp = &free_list;
+		while ((m = *mp) != NULL && skip >= m->m_len) {
+			skip -= m->m_len;
+			mp = &m->m_next;
+		}
+		back = *mp;
+		*mp = NULL;
+		back->m_data += skip;
+		back->m_len -= (int32_t)skip;
+		for (last = back;; last = last->m_next) {
+			sballoc(sb, last);
+			if (last->m_next == NULL) {
+				break;
+			}
+		}
+		last->m_next = sb->sb_mb;
+		if (sb->sb_mb == NULL) {
+			sb->sb_mbtail = last;
+		}
+		sb->sb_mb = back;
+		sb->sb_lastrecord = back;
+		SBLASTRECORDCHK(sb, "soreceive_stream_batch 2");
+		SBLASTMBUFCHK(sb, "soreceive_stream_batch 2");
+		taken = copied;
+	} else if (copied > taken && sb->sb_mb == pm) {
+		/* all of the head of pm, or as much as made it on a fault */
+		part = (int)(copied - taken);
+		pm->m_data += part;
+		pm->m_len -= part;
+		sb->sb_cc -= part;
+		taken += part;
+	}
+	if (free_list != NULL) {
+		m_freem_list(free_list);
+	}
+	counter_add(&sorecvbatch_bytes, taken);
+
+	return error;
+}
+
 /*
  * Returns:	0			Success
  *	uiomove:EFAULT
@@ -5943,6 +6461,43 @@ sosetoptlock(struct socket *so, struct sockopt *sopt, int dolock)
 			}
 			break;
 		}
+		case SO_ZEROCOPY: {
+			struct sozerocopy *zc;
+
+			error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval));
+			if (error != 0) {
+				goto out;
+			}
+			if (SOCK_TYPE(so) != SOCK_STREAM ||
+			    SOCK_PROTO(so) != IPPROTO_TCP) {
+				error = EOPNOTSUPP;
+				goto out;
+			}
+			if ((zc = so->so_zerocopy) == NULL) {
+				if (optval == 0) {
+					break;
+				}
+				zc = kalloc_type(struct sozerocopy,
+				    Z_WAITOK | Z_ZERO | Z_NOFAIL);
+				os_ref_init(&zc->zc_refcnt, &sozerocopy_refgrp);
+				so->so_zerocopy = zc;
+			}
+			zc->zc_enabled = (optval != 0);
+			break;
+		}
+		case SO_BUSY_POLL:
+			error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval));
+			if (error != 0) {
+				goto out;
+			}
+			if (optval < 0) {
+				error = EINVAL;
+				goto out;
+			}
+			so->so_busy_poll = MIN((uint32_t)optval, so_busy_poll_max);
+			break;
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -6396,6 +6951,25 @@ integer:
 		case SO_FALLBACK_MODE:
 			optval = so->so_fallback_mode;
 			goto integer;
+		case SO_ZEROCOPY:
+			optval = (so->so_zerocopy != NULL &&
+			    so->so_zerocopy->zc_enabled) ? 1 : 0;
+			goto integer;
+		case SO_BUSY_POLL:
+			optval = (int)so->so_busy_poll;
+			goto integer;
+		case SO_ZEROCOPY_STAT: {
+			struct so_zerocopy_stat zcs = {};
+
+			if (so->so_zerocopy != NULL) {
+				zcs.zcs_sent = os_atomic_load(
+					&so->so_zerocopy->zc_sent, relaxed);
+				zcs.zcs_completed = os_atomic_load(
+					&so->so_zerocopy->zc_completed, relaxed);
+			}
+			error = sooptcopyout(sopt, &zcs, sizeof(zcs));
+			break;
+		}
 		case SO_MARK_KNOWN_TRACKER: {
 			optval = ((so->so_flags1 & SOF1_KNOWN_TRACKER) > 0)
 			    ? 1 : 0;
@@ -103,12 +103,14 @@
 
 #include <os/log.h>
 #include <os/ptrtools.h>
+#include <sys/ubc.h>
+#include <kern/counter.h>
 
 #include <os/log.h>
 
-#if CONFIG_MACF_SOCKET_SUBSET
+#if CONFIG_MACF_SOCKET_SUBSET || CONFIG_MACF
 #include <security/mac_framework.h>
-#endif /* MAC_SOCKET_SUBSET */
+#endif /* MAC_SOCKET_SUBSET || CONFIG_MACF */
 
 #define f_flag fp_glob->fg_flag
 #define f_ops fp_glob->fg_ops
@@ -2938,6 +2940,68 @@ getsockaddr_s(struct socket *so, sockaddr_storage_ref_t ss,
 	return error;
 }
 
+/*
+ * Number of messages whose iovec arrays are copied in with a single
+ * copyin_vec() by sendmsg_x() and recvmsg_x().
+ */
+#define MSGHDR_IOVEC_BATCH      16
+
+/*
+ * Copy in the iovec arrays of a batch of messages at once: the user span
+ * covering all of them is validated, and user access enabled, only once
+ * for the batch rather than once per message, which is what dominates a
+ * sendmsg_x()/recvmsg_x() of many small single-iovec messages.
+ */
+static int
+copyin_msghdr_iovec_batch(int spacetype, u_int n,
+    struct user_msghdr_x **user_msgs, uio_t *uios)
+{
+	size_t size_of_iovec = (spacetype == UIO_USERSPACE64 ?
+	    sizeof(struct user64_iovec) : sizeof(struct user32_iovec));
+	struct copyio_vec vec[MSGHDR_IOVEC_BATCH];
+	user_addr_t lo = 0, hi = 0, end;
+	int error;
+	u_int i;
+
+	assert(n <= MSGHDR_IOVEC_BATCH);
+
+	for (i = 0; i < n; i++) {
+		vec[i].civ_uaddr = user_msgs[i]->msg_iov;
+		vec[i].civ_kaddr = uio_iovsaddr(uios[i]);
+		vec[i].civ_len = user_msgs[i]->msg_iovlen * size_of_iovec;
+
+		if (os_add_overflow(vec[i].civ_uaddr, vec[i].civ_len, &end)) {
+			return EFAULT;
+		}
+		if (i == 0 || vec[i].civ_uaddr < lo) {
+			lo = vec[i].civ_uaddr;
+		}
+		if (end > hi) {
+			hi = end;
+		}
+	}
+
+	error = copyin_vec(lo, hi - lo, vec, n);
+	if (error) {
+		return error;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct user_msghdr_x *user_msg = user_msgs[i];
+		struct user_iovec *iovp = vec[i].civ_kaddr;
+
+		unpack_user_iovec_array(spacetype, user_msg->msg_iovlen, iovp);
+		user_msg->msg_iov = CAST_USER_ADDR_T(iovp);
+
+		error = uio_calculateresid(uios[i]);
+		if (error) {
+			return error;
+		}
+		user_msg->msg_datalen = uio_resid(uios[i]);
+	}
+	return 0;
+}
+
 int
 internalize_user_msghdr_array(const void_ptr_t src, int spacetype, int direction,
     u_int count, user_msghdr_x_ptr_t dst, uio_ref_ptr_t uiop)
@@ -2946,6 +3010,9 @@ internalize_user_msghdr_array(const void_ptr_t src, int spacetype, int direction
 	u_int i;
 	u_int namecnt = 0;
 	u_int ctlcnt = 0;
+	struct user_msghdr_x *batch_msgs[MSGHDR_IOVEC_BATCH];
+	uio_t batch_uios[MSGHDR_IOVEC_BATCH];
+	u_int batch = 0;
 
 	for (i = 0; i < count; i++) {
 		uio_t auio;
@@ -2998,18 +3065,16 @@ internalize_user_msghdr_array(const void_ptr_t src, int spacetype, int direction
 			error = ENOMEM;
 			goto done;
 		}
-		error = copyin_user_iovec_array(user_msg->msg_iov,
-		    spacetype, user_msg->msg_iovlen, iovp);
-		if (error) {
-			goto done;
-		}
-		user_msg->msg_iov = CAST_USER_ADDR_T(iovp);
-
-		error = uio_calculateresid(auio);
-		if (error) {
-			goto done;
+		batch_msgs[batch] = user_msg;
+		batch_uios[batch] = auio;
+		if (++batch == MSGHDR_IOVEC_BATCH || i + 1 == count) {
+			error = copyin_msghdr_iovec_batch(spacetype, batch,
+			    batch_msgs, batch_uios);
+			if (error) {
+				goto done;
+			}
+			batch = 0;
 		}
-		user_msg->msg_datalen = uio_resid(auio);
 
 		if (user_msg->msg_name && user_msg->msg_namelen) {
 			namecnt++;
@@ -3030,6 +3095,9 @@ internalize_recv_msghdr_array(const void_ptr_t src, int spacetype, int direction
 {
 	int error = 0;
 	u_int i;
+	struct user_msghdr_x *batch_msgs[MSGHDR_IOVEC_BATCH];
+	uio_t batch_uios[MSGHDR_IOVEC_BATCH];
+	u_int batch = 0;
 
 	for (i = 0; i < count; i++) {
 		struct user_iovec *iovp;
@@ -3081,18 +3149,16 @@ internalize_recv_msghdr_array(const void_ptr_t src, int spacetype, int direction
 			error = ENOMEM;
 			goto done;
 		}
-		error = copyin_user_iovec_array(user_msg->msg_iov,
-		    spacetype, user_msg->msg_iovlen, iovp);
-		if (error) {
-			goto done;
-		}
-		user_msg->msg_iov = CAST_USER_ADDR_T(iovp);
-
-		error = uio_calculateresid(recv_msg_elem->uio);
-		if (error) {
-			goto done;
+		batch_msgs[batch] = user_msg;
+		batch_uios[batch] = recv_msg_elem->uio;
+		if (++batch == MSGHDR_IOVEC_BATCH || i + 1 == count) {
+			error = copyin_msghdr_iovec_batch(spacetype, batch,
+			    batch_msgs, batch_uios);
+			if (error) {
+				goto done;
+			}
+			batch = 0;
 		}
-		user_msg->msg_datalen = uio_resid(recv_msg_elem->uio);
 
 		if (user_msg->msg_name && user_msg->msg_namelen) {
 			recv_msg_elem->which |= SOCK_MSG_SA;
@@ -3385,6 +3451,89 @@ alloc_sendpkt(int how, size_t pktlen, unsigned int *maxchunks,
 	*maxchunks = needed;
 }
 
+/*
+ * When the file range is fully resident, sendfile copies it into the
+ * packet straight from the page cache: a UPL holds the pages (marked
+ * cleaning in place, like for a pageout, so they stay put) just for the
+ * duration of the copy, which skips VNOP_READ and the filesystem locks
+ * and cluster read machinery behind it.  The pages are never left held
+ * while mbufs are outstanding, since writers and msync of the file would
+ * wait on them for as long as the peer doesn't read.
+ */
+static int sendfile_upl = 1;
+SYSCTL_INT(_kern_ipc, OID_AUTO, sendfile_upl, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &sendfile_upl, 0, "Copy resident file pages without going through VNOP_READ");
+
+SCALABLE_COUNTER_DEFINE(sendfile_upl_bytes);
+SYSCTL_SCALABLE_COUNTER(_kern_ipc, sendfile_upl_bytes, sendfile_upl_bytes,
+    "Bytes sendfile copied straight from the page cache");
+SCALABLE_COUNTER_DEFINE(sendfile_upl_fallbacks);
+SYSCTL_SCALABLE_COUNTER(_kern_ipc, sendfile_upl_fallbacks,
+    sendfile_upl_fallbacks, "sendfile chunks that had to be read through the filesystem");
+
+/*
+ * Copy [off, off + xfsize) of vp from the page cache into the mbuf chain
+ * m0, filling each mbuf up to its maximum length.  Returns EAGAIN if any
+ * of those pages is not resident, in which case the caller reads the
+ * data in as usual.
+ */
+static int
+sendfile_upl_copy(vnode_ref_t vp, off_t off, off_t xfsize, mbuf_ref_t m0)
+{
+	upl_page_info_t *pl;
+	mbuf_ref_t m;
+	upl_t upl;
+	vm_offset_t kaddr;
+	off_t start, end, done;
+	int npages, i;
+
+	start = trunc_page_64(off);
+	end = round_page_64(off + xfsize);
+	npages = (int)((end - start) >> PAGE_SHIFT);
+
+	/* the iocount keeps the vnode around for as long as the UPL */
+	if (vnode_getwithref(vp) != 0) {
+		goto fallback;
+	}
+	/* UPL_NOBLOCK: pages busy elsewhere are left out rather than waited on */
+	if (ubc_create_upl_kernel(vp, start, (int)(end - start), &upl, &pl,
+	    UPL_COPYOUT_FROM | UPL_SET_LITE | UPL_NOBLOCK,
+	    VM_KERN_MEMORY_FILE) != KERN_SUCCESS) {
+		vnode_put(vp);
+		goto fallback;
+	}
+
+	for (i = 0; i < npages; i++) {
+		if (!upl_page_present(pl, i)) {
+			break;
+		}
+	}
+	if (i != npages || ubc_upl_map(upl, &kaddr) != KERN_SUCCESS) {
+		(void) ubc_upl_abort(upl, 0);
+		vnode_put(vp);
+		goto fallback;
+	}
+
+	for (m = m0, done = 0; m != NULL && done < xfsize; m = mbuf_next(m)) {
+		size_t mlen = (size_t)MIN((off_t)mbuf_maxlen(m), xfsize - done);
+
+		bcopy((caddr_t)(kaddr + (off - start) + done),
+		    mbuf_datastart(m), mlen);
+		done += mlen;
+	}
+
+	(void) ubc_upl_unmap(upl);
+	(void) ubc_upl_abort(upl, 0);
+	vnode_put(vp);
+
+	counter_add(&sendfile_upl_bytes, done);
+	return 0;
+
+fallback:
+	counter_inc(&sendfile_upl_fallbacks);
+	return EAGAIN;
+}
+
 /*
  * sendfile(2).
  * int sendfile(int fd, int s, off_t offset, off_t *nbytes,
@@ -3412,6 +3561,7 @@ sendfile(proc_ref_t p, struct sendfile_args *uap, __unused int *retval)
 	size_t sizeof_hdtr;
 	off_t file_size;
 	struct vfs_context context = *vfs_context_current();
+	boolean_t use_upl;
 
 	const bool is_p_64bit_process = IS_64BIT_PROCESS(p);
 
@@ -3541,10 +3691,25 @@ sendfile(proc_ref_t p, struct sendfile_args *uap, __unused int *retval)
 	}
 
 	/*
-	 * Simply read file data into a chain of mbufs that used with scatter
-	 * gather reads. We're not (yet?) setup to use zero copy external
-	 * mbufs that point to the file pages.
+	 * Copy resident file pages straight from the page cache; otherwise
+	 * read file data into a chain of mbufs that used with scatter gather
+	 * reads.  The read path does the MAC check on its own, the page
+	 * cache path has to do it up front.
 	 */
+	use_upl = (sendfile_upl != 0);
+#if CONFIG_MACF
+	if (use_upl) {
+		if (vnode_getwithref(vp) != 0) {
+			use_upl = FALSE;
+		} else {
+			if (mac_vnode_check_read(&context, context.vc_ucred,
+			    vp) != 0) {
+				use_upl = FALSE;
+			}
+			vnode_put(vp);
+		}
+	}
+#endif /* CONFIG_MACF */
 	socket_lock(so, 1);
 	error = sblock(&so->so_snd, SBL_WAIT);
 	if (error) {
@@ -3620,6 +3785,11 @@ sendfile(proc_ref_t p, struct sendfile_args *uap, __unused int *retval)
 			xfsize = pktlen;
 		}
 
+		if (use_upl && sendfile_upl_copy(vp, off, xfsize, m0) == 0) {
+			socket_lock(so, 0);
+			goto setlen;
+		}
+
 		auio = uio_createwithbuffer(nbufs, off, UIO_SYSSPACE,
 		    UIO_READ, &uio_buf[0], sizeof(uio_buf));
 		if (auio == NULL) {
@@ -3677,6 +3847,7 @@ sendfile(proc_ref_t p, struct sendfile_args *uap, __unused int *retval)
 			printf("sendfile: xfsize: %lld + off: %lld > file_size:"
 			    "%lld\n", xfsize, off, file_size);
 		}
+setlen:
 		for (i = 0, m = m0, rlen = 0;
 		    i < nbufs && m != NULL && rlen < xfsize;
 		    i++, m = mbuf_next(m)) {
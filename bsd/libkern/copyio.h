@@ -35,6 +35,31 @@ __BEGIN_DECLS
 int     copyin(const user_addr_t uaddr, void *kaddr, size_t len) OS_WARN_RESULT;
 int     copyout(const void *kaddr, user_addr_t udaddr, size_t len);
 
+#ifdef XNU_KERNEL_PRIVATE
+/*
+ * One element of a vectored copy: civ_len bytes between the user address
+ * civ_uaddr and the kernel buffer civ_kaddr.
+ */
+struct copyio_vec {
+	user_addr_t     civ_uaddr;
+	void           *civ_kaddr;
+	size_t          civ_len;
+};
+
+/*
+ * Vectored copyin/copyout, for syscalls that move many small elements.
+ *
+ * The user region [uaddr, uaddr + size) is validated once and every
+ * element is copied within a single user access window; each element
+ * must lie entirely within that region or EFAULT is returned before
+ * anything is copied.  Copying stops at the first element that faults.
+ */
+int     copyin_vec(user_addr_t uaddr, size_t size,
+    const struct copyio_vec *vec, unsigned int count) OS_WARN_RESULT;
+int     copyout_vec(user_addr_t uaddr, size_t size,
+    const struct copyio_vec *vec, unsigned int count);
+#endif /* XNU_KERNEL_PRIVATE */
+
 #if defined (_FORTIFY_SOURCE) && _FORTIFY_SOURCE == 0
 /* FORTIFY_SOURCE disabled */
 
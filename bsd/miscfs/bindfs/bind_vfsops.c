@@ -68,6 +68,7 @@
 #include <sys/mount_internal.h>
 #include <sys/namei.h>
 #include <sys/proc.h>
+#include <sys/sysctl.h>
 #include <sys/vnode.h>
 #include <sys/vnode_internal.h>
 #include <security/mac_internal.h>
@@ -101,6 +102,16 @@ bindfs_vfs_getlowerattr(mount_t mp, struct vfs_attr * vfap, vfs_context_t ctx)
 	return vfs_getattr(mp, vfap, ctx);
 }
 
+/*
+ * When set, new bind mounts are made in passthrough mode: mmap maps the
+ * lower vnode's memory object and lookups are served from the lower
+ * name cache.
+ */
+static int bindfs_passthrough = 0;
+SYSCTL_DECL(_vfs_generic);
+SYSCTL_INT(_vfs_generic, OID_AUTO, bindfs_passthrough, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &bindfs_passthrough, 0, "New bindfs mounts share the lower page and name caches");
+
 /*
  * Mount bind layer
  */
@@ -231,6 +242,11 @@ bindfs_mount(struct mount * mp, __unused vnode_t devvp, user_addr_t user_data, v
 
 	xmp->bindm_flags = BINDM_CASEINSENSITIVE; /* default to case insensitive */
 
+	if (bindfs_passthrough) {
+		xmp->bindm_flags |= BINDM_PASSTHROUGH;
+		vfs_setpassthrough(mp);
+	}
+
 	error = bindfs_vfs_getlowerattr(vnode_mount(lowerrootvp), &vfa, ctx);
 	if (error == 0) {
 		if (VFSATTR_IS_SUPPORTED(&vfa, f_bsize)) {
@@ -232,7 +232,20 @@ notdot:
 		return error;
 	}
 
-	error = VNOP_LOOKUP(ldvp, &lvp, cnp, ap->a_context);
+	/*
+	 * In passthrough mode answer from the lower directory's name cache
+	 * when we can, rather than calling into the lower file system.  A
+	 * negative entry there is authoritative for us as well.
+	 */
+	error = 0;
+	if ((bind_mp->bindm_flags & BINDM_PASSTHROUGH) && (cnp->cn_flags & MAKEENTRY)) {
+		error = cache_lookup(ldvp, &lvp, cnp);
+	}
+	if (error == -1) {
+		error = 0;
+	} else if (error == 0) {
+		error = VNOP_LOOKUP(ldvp, &lvp, cnp, ap->a_context);
+	}
 
 	vnode_put(ldvp);
 
@@ -242,6 +255,15 @@ notdot:
 			error = vnode_get(vp);
 		} else {
 			error = bind_nodeget(mp, lvp, dvp, &vp, cnp, 0);
+			/*
+			 * A node found in our hash was not entered in the
+			 * name cache by vnode_create; do it here so the next
+			 * namei never reaches this vnop.
+			 */
+			if (error == 0 && (bind_mp->bindm_flags & BINDM_PASSTHROUGH) &&
+			    (cnp->cn_flags & MAKEENTRY)) {
+				cache_enter(dvp, vp, cnp);
+			}
 		}
 		if (error == 0) {
 			*ap->a_vpp = vp;
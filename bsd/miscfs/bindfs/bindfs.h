@@ -82,6 +82,7 @@
 
 #define BINDM_CACHE 0x0001
 #define BINDM_CASEINSENSITIVE 0x0000000000000002
+#define BINDM_PASSTHROUGH 0x0000000000000004 /* map and look up through the lower vnodes */
 
 typedef int (*vop_t)(void *);
 
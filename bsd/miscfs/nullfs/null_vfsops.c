@@ -65,6 +65,7 @@
 #include <sys/lock.h>
 #include <sys/malloc.h>
 #include <sys/mount.h>
+#include <sys/mount_internal.h>
 #include <sys/namei.h>
 #include <sys/proc.h>
 #include <sys/vnode.h>
@@ -247,7 +248,15 @@ nullfs_mount(struct mount * mp, __unused vnode_t devvp, user_addr_t user_data, v
 	xmp->nullm_flags = NULLM_CASEINSENSITIVE; /* default to case insensitive */
 
 	// Set the flags that are requested
-	xmp->nullm_flags |= conf.flags & NULLM_UNVEIL;
+	xmp->nullm_flags |= conf.flags & (NULLM_UNVEIL | NULLM_PASSTHROUGH);
+
+	/*
+	 * In passthrough mode mmap maps the lower vnode's memory object
+	 * directly, so pages are cached once, by the lower file system.
+	 */
+	if (xmp->nullm_flags & NULLM_PASSTHROUGH) {
+		vfs_setpassthrough(mp);
+	}
 
 	error = nullfs_vfs_getlowerattr(vnode_mount(lowerrootvp), &vfa, ctx);
 	if (error == 0) {
@@ -612,7 +612,20 @@ notdot:
 		return error;
 	}
 
-	error = VNOP_LOOKUP(ldvp, &lvp, cnp, ectx);
+	/*
+	 * In passthrough mode answer from the lower directory's name cache
+	 * when we can, rather than calling into the lower file system.  A
+	 * negative entry there is authoritative for us as well.
+	 */
+	error = 0;
+	if ((null_mp->nullm_flags & NULLM_PASSTHROUGH) && (cnp->cn_flags & MAKEENTRY)) {
+		error = cache_lookup(ldvp, &lvp, cnp);
+	}
+	if (error == -1) {
+		error = 0;
+	} else if (error == 0) {
+		error = VNOP_LOOKUP(ldvp, &lvp, cnp, ectx);
+	}
 
 	vnode_put(ldvp);
 
@@ -622,6 +635,15 @@ notdot:
 			error = vnode_get(vp);
 		} else {
 			error = null_nodeget(mp, lvp, dvp, &vp, cnp, 0);
+			/*
+			 * A node found in our hash was not entered in the
+			 * name cache by vnode_create; do it here so the next
+			 * namei never reaches this vnop.
+			 */
+			if (error == 0 && (null_mp->nullm_flags & NULLM_PASSTHROUGH) &&
+			    (cnp->cn_flags & MAKEENTRY)) {
+				cache_enter(dvp, vp, cnp);
+			}
 		}
 		if (error == 0) {
 			*ap->a_vpp = vp;
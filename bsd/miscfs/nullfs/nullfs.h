@@ -83,6 +83,7 @@
 #define NULLM_CACHE 0x0001
 #define NULLM_CASEINSENSITIVE 0x0000000000000002
 #define NULLM_UNVEIL 0x1ULL << 2
+#define NULLM_PASSTHROUGH 0x1ULL << 3 /* map and look up through the lower vnodes */
 
 typedef int (*vop_t)(void *);
 
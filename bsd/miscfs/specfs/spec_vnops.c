@@ -93,6 +93,8 @@
 #include <kern/policy_internal.h>
 #include <kern/timer_call.h>
 #include <kern/waitq.h>
+#include <kern/thread_call.h>
+#include <mach/coalition.h>
 
 #include <pexpert/pexpert.h>
 
@@ -109,6 +111,7 @@ extern boolean_t        iskmemdev(dev_t dev);
 extern int bpfkqfilter(dev_t dev, struct knote *kn);
 extern int ptsd_kqfilter(dev_t, struct knote *);
 extern int ptmx_kqfilter(dev_t, struct knote *);
+extern void task_coalition_ids(task_t task, uint64_t ids[COALITION_NUM_TYPES]);
 #if CONFIG_PHYS_WRITE_ACCT
 uint64_t kernel_pm_writes;    // to track the sync writes occurring during power management transitions
 #endif /* CONFIG_PHYS_WRITE_ACCT */
@@ -246,6 +249,9 @@ int     lowpri_throttle_enabled = 1;
 
 
 static void throttle_info_end_io_internal(struct _throttle_io_info_t *info, int throttle_level);
+static void fairshare_init(void);
+static boolean_t fairshare_enqueue(int devbsdunit, buf_t bp);
+static void fairshare_end_io(int devbsdunit);
 static int throttle_info_update_internal(struct _throttle_io_info_t *info, uthread_t ut, int flags, boolean_t isssd, boolean_t inflight, struct bufattr *bap);
 static int throttle_get_thread_throttle_level(uthread_t ut);
 static int throttle_get_thread_throttle_level_internal(uthread_t ut, int io_tier);
@@ -1443,6 +1449,7 @@ throttle_init(void)
 		info->throttle_disabled = 0;
 		info->throttle_is_fusion_with_priority = 0;
 	}
+	fairshare_init();
 #if CONFIG_IOSCHED
 	if (PE_parse_boot_argn("iosched", &iosched, sizeof(iosched))) {
 		iosched_enabled = iosched;
@@ -2188,12 +2195,19 @@ throttle_info_end_io(buf_t bp)
 	int io_tier;
 
 	bap = &bp->b_attr;
+	mp = buf_vnode(bp)->v_mount;
+
+	if (ISSET(bap->ba_flags, BA_FAIRSHARE_IO)) {
+		CLR(bap->ba_flags, BA_FAIRSHARE_IO);
+		if (mp != NULL) {
+			fairshare_end_io(mp->mnt_devbsdunit);
+		}
+	}
 	if (!ISSET(bap->ba_flags, BA_STRATEGY_TRACKED_IO)) {
 		return;
 	}
 	CLR(bap->ba_flags, BA_STRATEGY_TRACKED_IO);
 
-	mp = buf_vnode(bp)->v_mount;
 	if (mp != NULL) {
 		info = &_throttle_io_info[mp->mnt_devbsdunit];
 	} else {
@@ -2208,6 +2222,342 @@ throttle_info_end_io(buf_t bp)
 	throttle_info_end_io_internal(info, io_tier);
 }
 
+/*
+ * Weighted fair-share I/O scheduling
+ *
+ * The tier-based throttle above only delays low priority threads after
+ * their I/O has been issued.  When lowpri_fairshare_enabled is set,
+ * spec_strategy additionally bounds the number of I/Os outstanding on
+ * each device to lowpri_fairshare_depth, and holds the excess in one
+ * queue per resource coalition.  As I/Os complete, the queued bufs are
+ * issued in order of virtual time (bytes issued scaled by the
+ * coalition's weight), so each coalition gets a share of the device
+ * proportional to its weight.  A buf that has waited longer than the
+ * deadline for its tier is issued ahead of virtual time order, which
+ * keeps latency sensitive (tier 0) I/O from queueing behind a busy
+ * tenant.
+ *
+ * Coalitions hash into FAIRSHARE_NQUEUES queues per device; coalitions
+ * that collide share a queue and its weight.  Kernel and VM privileged
+ * I/O is never held back.
+ */
+#define FAIRSHARE_NQUEUES          16
+#define FAIRSHARE_NWEIGHTS         32
+#define FAIRSHARE_DEFAULT_WEIGHT   100
+
+struct _fairshare_queue {
+	TAILQ_HEAD(, buf) fq_bufs;
+	uint64_t        fq_coalition_id;
+	uint64_t        fq_vtime;               /* virtual time of the next I/O */
+	uint32_t        fq_weight;
+	uint32_t        fq_count;
+};
+
+struct _fairshare_io_info_t {
+	lck_spin_t      fs_lock;
+	uint64_t        fs_vclock;              /* virtual time of the last issued I/O */
+	int32_t         fs_inflight;
+	int32_t         fs_queued;
+	thread_call_t   fs_dispatch_call;
+	struct _fairshare_queue fs_queues[FAIRSHARE_NQUEUES];
+};
+
+static struct _fairshare_io_info_t *_fairshare_io_info;
+
+struct lowpri_fairshare_weight {
+	uint64_t        coalition_id;
+	uint32_t        weight;                 /* 0 removes the entry */
+	uint32_t        reserved;
+};
+
+static struct lowpri_fairshare_weight fairshare_weights[FAIRSHARE_NWEIGHTS];
+
+static LCK_GRP_DECLARE(fairshare_lock_grp, "fair-share I/O");
+static LCK_SPIN_DECLARE(fairshare_weights_lock, &fairshare_lock_grp);
+
+int     lowpri_fairshare_enabled = 0;
+int     lowpri_fairshare_depth = 32;
+int     lowpri_fairshare_deadline_msecs[THROTTLE_LEVEL_END + 1] = {
+	5,
+	50,
+	250,
+	1000,
+};
+
+static uint64_t fairshare_queued_ios;
+static uint64_t fairshare_deadline_ios;
+
+SYSCTL_INT(_debug, OID_AUTO, lowpri_fairshare_enabled, CTLFLAG_RW | CTLFLAG_LOCKED, &lowpri_fairshare_enabled, 0, "");
+SYSCTL_INT(_debug, OID_AUTO, lowpri_fairshare_depth, CTLFLAG_RW | CTLFLAG_LOCKED, &lowpri_fairshare_depth, 0, "");
+SYSCTL_INT(_debug, OID_AUTO, lowpri_fairshare_tier0_deadline_msecs, CTLFLAG_RW | CTLFLAG_LOCKED, &lowpri_fairshare_deadline_msecs[THROTTLE_LEVEL_TIER0], 0, "");
+SYSCTL_INT(_debug, OID_AUTO, lowpri_fairshare_tier1_deadline_msecs, CTLFLAG_RW | CTLFLAG_LOCKED, &lowpri_fairshare_deadline_msecs[THROTTLE_LEVEL_TIER1], 0, "");
+SYSCTL_INT(_debug, OID_AUTO, lowpri_fairshare_tier2_deadline_msecs, CTLFLAG_RW | CTLFLAG_LOCKED, &lowpri_fairshare_deadline_msecs[THROTTLE_LEVEL_TIER2], 0, "");
+SYSCTL_INT(_debug, OID_AUTO, lowpri_fairshare_tier3_deadline_msecs, CTLFLAG_RW | CTLFLAG_LOCKED, &lowpri_fairshare_deadline_msecs[THROTTLE_LEVEL_TIER3], 0, "");
+SYSCTL_QUAD(_debug, OID_AUTO, lowpri_fairshare_queued_ios, CTLFLAG_RD | CTLFLAG_LOCKED, &fairshare_queued_ios, "");
+SYSCTL_QUAD(_debug, OID_AUTO, lowpri_fairshare_deadline_ios, CTLFLAG_RD | CTLFLAG_LOCKED, &fairshare_deadline_ios, "");
+
+/*
+ * Reading returns the weight table; writing a struct lowpri_fairshare_weight
+ * sets (or, with a weight of 0, clears) the weight of one coalition.
+ */
+static int
+sysctl_lowpri_fairshare_weight SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg1, arg2)
+	struct lowpri_fairshare_weight table[FAIRSHARE_NWEIGHTS];
+	struct lowpri_fairshare_weight w;
+	int error, i, slot = -1;
+
+	lck_spin_lock(&fairshare_weights_lock);
+	bcopy(fairshare_weights, table, sizeof(table));
+	lck_spin_unlock(&fairshare_weights_lock);
+
+	error = SYSCTL_OUT(req, table, sizeof(table));
+	if (error || req->newptr == USER_ADDR_NULL) {
+		return error;
+	}
+	error = SYSCTL_IN(req, &w, sizeof(w));
+	if (error) {
+		return error;
+	}
+	if (w.coalition_id == 0 || w.weight > 10000) {
+		return EINVAL;
+	}
+
+	lck_spin_lock(&fairshare_weights_lock);
+	for (i = 0; i < FAIRSHARE_NWEIGHTS; i++) {
+		if (fairshare_weights[i].coalition_id == w.coalition_id) {
+			slot = i;
+			break;
+		}
+		if (slot < 0 && fairshare_weights[i].coalition_id == 0) {
+			slot = i;
+		}
+	}
+	if (slot < 0) {
+		error = w.weight ? ENOSPC : 0;
+	} else if (w.weight == 0) {
+		if (fairshare_weights[slot].coalition_id == w.coalition_id) {
+			bzero(&fairshare_weights[slot], sizeof(fairshare_weights[slot]));
+		}
+	} else {
+		fairshare_weights[slot].coalition_id = w.coalition_id;
+		fairshare_weights[slot].weight = w.weight;
+	}
+	lck_spin_unlock(&fairshare_weights_lock);
+
+	return error;
+}
+
+SYSCTL_PROC(_debug, OID_AUTO, lowpri_fairshare_weight, CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_LOCKED,
+    0, 0, sysctl_lowpri_fairshare_weight, "S,lowpri_fairshare_weight", "");
+
+static uint32_t
+fairshare_weight(uint64_t coalition_id)
+{
+	uint32_t weight = FAIRSHARE_DEFAULT_WEIGHT;
+	int i;
+
+	lck_spin_lock(&fairshare_weights_lock);
+	for (i = 0; i < FAIRSHARE_NWEIGHTS; i++) {
+		if (fairshare_weights[i].coalition_id == coalition_id) {
+			weight = fairshare_weights[i].weight;
+			break;
+		}
+	}
+	lck_spin_unlock(&fairshare_weights_lock);
+
+	return weight;
+}
+
+/*
+ * Pick the next buf to issue: the oldest buf past its tier's deadline if
+ * there is one, otherwise the head of the queue with the least virtual time.
+ */
+static buf_t
+fairshare_pick_locked(struct _fairshare_io_info_t *fsi)
+{
+	struct _fairshare_queue *fq, *best = NULL, *late = NULL;
+	struct timeval now, deadline, late_deadline = {};
+	buf_t   bp;
+	int     tier, i;
+
+	microuptime(&now);
+
+	for (i = 0; i < FAIRSHARE_NQUEUES; i++) {
+		fq = &fsi->fs_queues[i];
+		if ((bp = TAILQ_FIRST(&fq->fq_bufs)) == NULL) {
+			continue;
+		}
+		tier = GET_BUFATTR_IO_TIER(&bp->b_attr);
+		if (tier > THROTTLE_LEVEL_END) {
+			tier = THROTTLE_LEVEL_END;
+		}
+		deadline.tv_sec = lowpri_fairshare_deadline_msecs[tier] / 1000;
+		deadline.tv_usec = (lowpri_fairshare_deadline_msecs[tier] % 1000) * 1000;
+		timevaladd(&deadline, &bp->b_timestamp_tv);
+
+		if (timevalcmp(&deadline, &now, <=) &&
+		    (late == NULL || timevalcmp(&deadline, &late_deadline, <))) {
+			late = fq;
+			late_deadline = deadline;
+		}
+		if (best == NULL || fq->fq_vtime < best->fq_vtime) {
+			best = fq;
+		}
+	}
+	if (late != NULL) {
+		best = late;
+		fairshare_deadline_ios++;
+	}
+	if (best == NULL) {
+		return NULL;
+	}
+
+	bp = TAILQ_FIRST(&best->fq_bufs);
+	TAILQ_REMOVE(&best->fq_bufs, bp, b_act);
+	best->fq_count--;
+	fsi->fs_queued--;
+
+	if (best->fq_vtime > fsi->fs_vclock) {
+		fsi->fs_vclock = best->fq_vtime;
+	}
+	best->fq_vtime += ((uint64_t)buf_count(bp) << 10) / best->fq_weight;
+
+	return bp;
+}
+
+static void
+fairshare_dispatch(struct _fairshare_io_info_t *fsi, __unused thread_call_param_t p)
+{
+	typedef int strategy_fcn_ret_t(struct buf *bp);
+	buf_t   bp;
+
+	for (;;) {
+		lck_spin_lock(&fsi->fs_lock);
+		bp = NULL;
+		if (fsi->fs_inflight < MAX(lowpri_fairshare_depth, 1) || !lowpri_fairshare_enabled) {
+			bp = fairshare_pick_locked(fsi);
+		}
+		if (bp != NULL) {
+			fsi->fs_inflight++;
+		}
+		lck_spin_unlock(&fsi->fs_lock);
+
+		if (bp == NULL) {
+			break;
+		}
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wcast-function-type"
+		(void)(*(strategy_fcn_ret_t*)bdevsw[major(buf_device(bp))].d_strategy)(bp);
+#pragma clang diagnostic pop
+		microuptime(&bp->b_timestamp_tv);
+	}
+}
+
+static void
+fairshare_init(void)
+{
+	struct _fairshare_io_info_t *fsi;
+	int     i, q;
+
+	_fairshare_io_info = zalloc_permanent(sizeof(*_fairshare_io_info) * LOWPRI_MAX_NUM_DEV,
+	    ZALIGN(struct _fairshare_io_info_t));
+
+	for (i = 0; i < LOWPRI_MAX_NUM_DEV; i++) {
+		fsi = &_fairshare_io_info[i];
+
+		lck_spin_init(&fsi->fs_lock, &fairshare_lock_grp, LCK_ATTR_NULL);
+		fsi->fs_dispatch_call = thread_call_allocate_with_priority((thread_call_func_t)fairshare_dispatch,
+		    (thread_call_param_t)fsi, THREAD_CALL_PRIORITY_KERNEL_HIGH);
+
+		for (q = 0; q < FAIRSHARE_NQUEUES; q++) {
+			TAILQ_INIT(&fsi->fs_queues[q].fq_bufs);
+			fsi->fs_queues[q].fq_weight = FAIRSHARE_DEFAULT_WEIGHT;
+		}
+	}
+}
+
+/*
+ * Called by spec_strategy just before the buf is handed to the driver.
+ * Returns TRUE if the buf was queued, in which case fairshare_dispatch
+ * issues it later; otherwise the caller issues it right away.
+ */
+static boolean_t
+fairshare_enqueue(int devbsdunit, buf_t bp)
+{
+	struct _fairshare_io_info_t *fsi;
+	struct _fairshare_queue *fq;
+	uint64_t ids[COALITION_NUM_TYPES];
+	uint32_t weight;
+	boolean_t kick = FALSE;
+	task_t  task = current_task();
+
+	if (!lowpri_fairshare_enabled || _fairshare_io_info == NULL ||
+	    task == kernel_task || is_vm_privileged() || is_external_pageout_thread()) {
+		return FALSE;
+	}
+	fsi = &_fairshare_io_info[devbsdunit];
+
+	task_coalition_ids(task, ids);
+	weight = fairshare_weight(ids[COALITION_TYPE_RESOURCE]);
+
+	SET(bp->b_attr.ba_flags, BA_FAIRSHARE_IO);
+
+	lck_spin_lock(&fsi->fs_lock);
+	if (fsi->fs_queued == 0 && fsi->fs_inflight < MAX(lowpri_fairshare_depth, 1)) {
+		fsi->fs_inflight++;
+		lck_spin_unlock(&fsi->fs_lock);
+		return FALSE;
+	}
+
+	fq = &fsi->fs_queues[ids[COALITION_TYPE_RESOURCE] % FAIRSHARE_NQUEUES];
+	if (fq->fq_count == 0) {
+		/* an idle coalition does not bank credit while it is away */
+		if (fq->fq_vtime < fsi->fs_vclock) {
+			fq->fq_vtime = fsi->fs_vclock;
+		}
+		fq->fq_coalition_id = ids[COALITION_TYPE_RESOURCE];
+	}
+	fq->fq_weight = weight;
+	microuptime(&bp->b_timestamp_tv);
+	TAILQ_INSERT_TAIL(&fq->fq_bufs, bp, b_act);
+	fq->fq_count++;
+	fsi->fs_queued++;
+	fairshare_queued_ios++;
+
+	if (fsi->fs_inflight < MAX(lowpri_fairshare_depth, 1)) {
+		kick = TRUE;
+	}
+	lck_spin_unlock(&fsi->fs_lock);
+
+	if (kick) {
+		thread_call_enter(fsi->fs_dispatch_call);
+	}
+	return TRUE;
+}
+
+/*
+ * Called on completion of a buf that was counted against the device's
+ * fair-share depth; issues more queued bufs if there are any.
+ */
+static void
+fairshare_end_io(int devbsdunit)
+{
+	struct _fairshare_io_info_t *fsi = &_fairshare_io_info[devbsdunit];
+	boolean_t kick;
+
+	lck_spin_lock(&fsi->fs_lock);
+	fsi->fs_inflight--;
+	assert(fsi->fs_inflight >= 0);
+	kick = (fsi->fs_queued != 0);
+	lck_spin_unlock(&fsi->fs_lock);
+
+	if (kick) {
+		thread_call_enter(fsi->fs_dispatch_call);
+	}
+}
+
 /*
  * Decrement inflight count initially incremented by throttle_info_update_internal
  */
@@ -2668,6 +3018,14 @@ spec_strategy(struct vnop_strategy_args *ap)
 
 	typedef int strategy_fcn_ret_t(struct buf *bp);
 
+	/*
+	 * With fair-share scheduling enabled, the buf may be held back
+	 * and issued later by fairshare_dispatch on behalf of this thread.
+	 */
+	if (mp != NULL && fairshare_enqueue(mp->mnt_devbsdunit, bp)) {
+		return 0;
+	}
+
 	strategy_ret = (*(strategy_fcn_ret_t*)bdevsw[major(bdev)].d_strategy)(bp);
 
 #pragma clang diagnostic pop
@@ -129,10 +129,16 @@
 #include <net/pktap.h>
 
 #include <kern/assert.h>
+#include <kern/clock.h>
 #include <kern/locks.h>
 #include <kern/thread_call.h>
 #include <libkern/section_keywords.h>
 
+#include <mach/mach_port.h>
+#include <mach/mach_vm.h>
+#include <mach/vm_map.h>
+#include <vm/vm_kern.h>
+
 #include <os/log.h>
 
 extern int tvtohz(struct timeval *);
@@ -168,6 +174,14 @@ SYSCTL_PROC(_debug, OID_AUTO, bpf_bufsize_cap, CTLTYPE_INT | CTLFLAG_RD | CTLFLA
     0, 0,
     sysctl_bpf_bufsize_cap, "I", "Upper limit on BPF max buffer size");
 
+/*
+ * Upper bound on the memory of a ring set up with BIOCSRING; rings are
+ * wired so that packets can be copied into them under bpf_mlock.
+ */
+static unsigned int bpf_ring_maxsize = 64 * 1024 * 1024;
+SYSCTL_UINT(_debug, OID_AUTO, bpf_ring_maxsize, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &bpf_ring_maxsize, 0, "Maximum size of a BPF ring");
+
 static unsigned int bpf_maxdevices = 256;
 SYSCTL_UINT(_debug, OID_AUTO, bpf_maxdevices, CTLFLAG_RD | CTLFLAG_LOCKED,
     &bpf_maxdevices, 0, "");
@@ -196,6 +210,19 @@ static int bpf_hdr_comp_enable = 1;
 SYSCTL_INT(_debug, OID_AUTO, bpf_hdr_comp_enable, CTLFLAG_RW | CTLFLAG_LOCKED,
     &bpf_hdr_comp_enable, 1, "");
 
+/*
+ * Filters are translated by bpf_cprog_compile() when they are installed,
+ * unless this is off; bpf_filter_stats times every run of a filter, as
+ * reported by netstat -B.
+ */
+static int bpf_filter_compile = 1;
+SYSCTL_INT(_debug, OID_AUTO, bpf_filter_compile, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &bpf_filter_compile, 0, "Translate BPF filters when they are set");
+
+static int bpf_filter_stats = 0;
+SYSCTL_INT(_debug, OID_AUTO, bpf_filter_stats, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &bpf_filter_stats, 0, "Measure the time spent in BPF filters");
+
 static int sysctl_bpf_stats SYSCTL_HANDLER_ARGS;
 SYSCTL_PROC(_debug, OID_AUTO, bpf_stats, CTLTYPE_STRUCT | CTLFLAG_RD | CTLFLAG_LOCKED,
     0, 0,
@@ -238,6 +265,9 @@ static void     bpf_wakeup(struct bpf_d *);
 static uint32_t get_pkt_trunc_len(struct bpf_packet *);
 static void     catchpacket(struct bpf_d *, struct bpf_packet *, u_int, int);
 static void     reset_d(struct bpf_d *);
+static int      bpf_ring_setup(struct bpf_d *, struct bpf_ring_req *);
+static void     bpf_ring_free(struct bpf_d *);
+static boolean_t bpf_ring_ready(struct bpf_d *);
 static int      bpf_setf(struct bpf_d *, u_int, user_addr_t, u_long);
 static int      bpf_getdltlist(struct bpf_d *, caddr_t, struct proc *);
 static int      bpf_setdlt(struct bpf_d *, u_int);
@@ -1057,6 +1087,13 @@ bpfread(dev_t dev, struct uio *uio, int ioflag)
 
 	bpf_acquire_d(d);
 
+	/* a ring is consumed in place */
+	if (d->bd_ring != NULL) {
+		bpf_release_d(d);
+		lck_mtx_unlock(bpf_mlock);
+		return EOPNOTSUPP;
+	}
+
 	/*
 	 * Restrict application to use a buffer the same size as
 	 * as kernel buffers.
@@ -1351,7 +1388,7 @@ bpf_timed_out(void *arg, __unused void *dummy)
 		 * now stuff to read, wake it up.
 		 */
 		d->bd_state = BPF_TIMED_OUT;
-		if (d->bd_slen != 0) {
+		if (d->bd_ring != NULL ? bpf_ring_ready(d) : d->bd_slen != 0) {
 			bpf_wakeup(d);
 		}
 	} else if (d->bd_state == BPF_DRAINING) {
@@ -1605,8 +1642,15 @@ bpf_setup(struct bpf_d *d_to, uuid_t uuid_from, ifnet_t ifp)
 	}
 
 	/*
-	 * For now require the same buffer size
+	 * For now require the same buffer size, and no rings
 	 */
+	if (d_from->bd_ring != NULL || d_to->bd_ring != NULL) {
+		error = EINVAL;
+		os_log_error(OS_LOG_DEFAULT,
+		    "%s: ring mode error %d",
+		    __func__, error);
+		goto done;
+	}
 	if (d_from->bd_bufsize != d_to->bd_bufsize) {
 		error = EINVAL;
 		os_log_error(OS_LOG_DEFAULT,
@@ -1735,7 +1779,8 @@ done:
 	X(BIOCGHDRCOMP) \
 	X(BIOCSHDRCOMP) \
 	X(BIOCGHDRCOMPSTATS) \
-	X(BIOCGHDRCOMPON)
+	X(BIOCGHDRCOMPON) \
+	X(BIOCSRING)
 
 static void
 log_bpf_ioctl_str(struct bpf_d *d, u_long cmd)
@@ -1861,7 +1906,8 @@ bpfioctl(dev_t dev, u_long cmd, caddr_t addr, __unused int flags,
 	case BIOCSBLEN: {               /* u_int */
 		u_int size;
 
-		if (d->bd_bif != 0 || (d->bd_flags & BPF_DETACHING)) {
+		if (d->bd_bif != 0 || (d->bd_flags & BPF_DETACHING) ||
+		    d->bd_ring != NULL) {
 			/*
 			 * Interface already attached, unable to change buffers
 			 */
@@ -2299,7 +2345,8 @@ bpfioctl(dev_t dev, u_long cmd, caddr_t addr, __unused int flags,
 		if (int_arg != 0 && int_arg != 1) {
 			return EINVAL;
 		}
-		if (d->bd_bif != 0 || (d->bd_flags & BPF_DETACHING)) {
+		if (d->bd_bif != 0 || (d->bd_flags & BPF_DETACHING) ||
+		    d->bd_ring != NULL) {
 			/*
 			 * Interface already attached, unable to change buffers
 			 */
@@ -2329,6 +2376,17 @@ bpfioctl(dev_t dev, u_long cmd, caddr_t addr, __unused int flags,
 		bcopy(&bcs, addr, sizeof(bcs));
 		break;
 	}
+
+	case BIOCSRING: {               /* struct bpf_ring_req */
+		struct bpf_ring_req brr;
+
+		bcopy(addr, &brr, sizeof(brr));
+		error = bpf_ring_setup(d, &brr);
+		if (error == 0) {
+			bcopy(&brr, addr, sizeof(brr));
+		}
+		break;
+	}
 	}
 
 	bpf_release_d(d);
@@ -2345,6 +2403,7 @@ static int
 bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
     u_long cmd)
 {
+	struct bpf_cprog *cprog, *old_cprog;
 	struct bpf_insn *fcode, *old;
 	u_int flen, size;
 
@@ -2357,15 +2416,21 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 	}
 
 	old = d->bd_filter;
+	old_cprog = d->bd_cprog;
 	if (bf_insns == USER_ADDR_NULL) {
 		if (bf_len != 0) {
 			return EINVAL;
 		}
 		d->bd_filter = NULL;
+		d->bd_cprog = NULL;
+		d->bd_filter_len = 0;
 		reset_d(d);
 		if (old != 0) {
 			kfree_data_addr(old);
 		}
+		if (old_cprog != NULL) {
+			bpf_cprog_free(old_cprog);
+		}
 		return 0;
 	}
 	flen = bf_len;
@@ -2380,7 +2445,16 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 	}
 	if (copyin(bf_insns, (caddr_t)fcode, size) == 0 &&
 	    bpf_validate(fcode, (int)flen)) {
+		/* when this fails the filter is interpreted instead */
+		cprog = NULL;
+		if (bpf_filter_compile != 0) {
+			cprog = bpf_cprog_compile(fcode, flen);
+		}
 		d->bd_filter = fcode;
+		d->bd_cprog = cprog;
+		d->bd_filter_len = flen;
+		d->bd_filter_count = 0;
+		d->bd_filter_time = 0;
 
 		if (cmd == BIOCSETF32 || cmd == BIOCSETF64) {
 			reset_d(d);
@@ -2389,6 +2463,9 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 		if (old != 0) {
 			kfree_data_addr(old);
 		}
+		if (old_cprog != NULL) {
+			bpf_cprog_free(old_cprog);
+		}
 
 		return 0;
 	}
@@ -2655,9 +2732,10 @@ bpfselect(dev_t dev, int which, void * wql, struct proc *p)
 
 	switch (which) {
 	case FREAD:
-		if (d->bd_hlen != 0 ||
+		if (d->bd_ring != NULL ? bpf_ring_ready(d) :
+		    (d->bd_hlen != 0 ||
 		    ((d->bd_immediate ||
-		    d->bd_state == BPF_TIMED_OUT) && d->bd_slen != 0)) {
+		    d->bd_state == BPF_TIMED_OUT) && d->bd_slen != 0))) {
 			ret = 1;         /* read has data to return */
 		} else {
 			/*
@@ -2706,7 +2784,11 @@ filt_bpfread_common(struct knote *kn, struct kevent_qos_s *kev, struct bpf_d *d)
 	int ready = 0;
 	int64_t data = 0;
 
-	if (d->bd_immediate) {
+	if (d->bd_ring != NULL) {
+		/* the number of blocks handed to user space */
+		ready = bpf_ring_ready(d);
+		data = d->bd_ring_nuser;
+	} else if (d->bd_immediate) {
 		/*
 		 * If there's data in the hold buffer, it's the
 		 * amount of data a read will return.
@@ -2885,6 +2967,17 @@ bpf_mcopy(struct mbuf *m, void *dst_arg, size_t len, size_t offset)
 	}
 }
 
+static inline u_int
+bpf_run_filter(struct bpf_d *d, struct bpf_packet *bpf_pkt)
+{
+	if (d->bd_cprog != NULL) {
+		return bpf_cprog_run(d->bd_cprog, (u_char *)bpf_pkt,
+		           (u_int)bpf_pkt->bpfp_total_length, 0);
+	}
+	return bpf_filter(d->bd_filter, (u_char *)bpf_pkt,
+	           (u_int)bpf_pkt->bpfp_total_length, 0);
+}
+
 static inline void
 bpf_tap_imp(
 	ifnet_t         ifp,
@@ -2937,8 +3030,15 @@ bpf_tap_imp(
 		}
 
 		++d->bd_rcount;
-		slen = bpf_filter(d->bd_filter, (u_char *)bpf_pkt,
-		    (u_int)bpf_pkt->bpfp_total_length, 0);
+		if (__improbable(bpf_filter_stats != 0 && d->bd_filter != NULL)) {
+			uint64_t start = mach_absolute_time();
+
+			slen = bpf_run_filter(d, bpf_pkt);
+			d->bd_filter_time += mach_absolute_time() - start;
+			d->bd_filter_count++;
+		} else {
+			slen = bpf_run_filter(d, bpf_pkt);
+		}
 
 		if (slen != 0) {
 			if (bp->bif_ifp->if_type == IFT_PKTAP &&
@@ -3591,6 +3691,200 @@ get_common_prefix_size(const void *a, const void *b, uint8_t max_bytes)
 	return (uint8_t)(i << 2);
 }
 
+/*
+ * Ring mode (BIOCSRING): the store buffer is the data area of the block
+ * at bd_ring_cur, and there is no hold or free buffer.  A block that is
+ * full, or that has data when the reader is to be woken up, is retired
+ * to user space by flipping brb_status to BPF_RING_USER; user space hands
+ * it back by storing BPF_RING_KERNEL once it is done with it.  Blocks are
+ * retired and returned in ring order, so the blocks held by user space
+ * are always the bd_ring_nuser ones starting at bd_ring_head.
+ */
+#define BPF_RING_BLOCK(d, i) \
+	((struct bpf_ring_block *)(void *)((d)->bd_ring + \
+	    (size_t)(i) * (d)->bd_ring_bsize))
+
+static int
+bpf_ring_setup(struct bpf_d *d, struct bpf_ring_req *brr)
+{
+	vm_map_t map = get_task_map(current_task());
+	mach_vm_offset_t uaddr = 0;
+	memory_object_size_t msize;
+	ipc_port_t entry = IPC_PORT_NULL;
+	vm_offset_t kaddr = 0;
+	uint64_t size;
+	kern_return_t kr;
+
+	LCK_MTX_ASSERT(bpf_mlock, LCK_MTX_ASSERT_OWNED);
+
+	if (d->bd_bif != NULL || (d->bd_flags & BPF_DETACHING) ||
+	    d->bd_ring != NULL || (d->bd_flags & BPF_COMP_REQ)) {
+		return EINVAL;
+	}
+	if (brr->brr_block_size < PAGE_SIZE ||
+	    (brr->brr_block_size & PAGE_MASK) != 0 ||
+	    brr->brr_block_count < 2) {
+		return EINVAL;
+	}
+	size = (uint64_t)brr->brr_block_size * brr->brr_block_count;
+	if (size > bpf_ring_maxsize) {
+		return ENOBUFS;
+	}
+
+	/* the mutex cannot be held while the ring is wired and mapped */
+	bpf_acquire_d(d);
+	lck_mtx_unlock(bpf_mlock);
+
+	kr = kmem_alloc(kernel_map, &kaddr, (vm_size_t)size,
+	    KMA_DATA | KMA_ZERO, VM_KERN_MEMORY_BSD);
+	if (kr != KERN_SUCCESS) {
+		kaddr = 0;
+		goto fail;
+	}
+	msize = size;
+	kr = mach_make_memory_entry_64(kernel_map, &msize, kaddr,
+	    MAP_MEM_VM_SHARE | VM_PROT_READ | VM_PROT_WRITE, &entry,
+	    IPC_PORT_NULL);
+	if (kr != KERN_SUCCESS) {
+		goto fail;
+	}
+	kr = mach_vm_map_kernel(map, &uaddr, msize, 0, VM_FLAGS_ANYWHERE,
+	    VM_MAP_KERNEL_FLAGS_NONE, VM_KERN_MEMORY_NONE, entry, 0, FALSE,
+	    VM_PROT_READ | VM_PROT_WRITE, VM_PROT_READ | VM_PROT_WRITE,
+	    VM_INHERIT_NONE);
+	/* the user mapping holds its own reference on the memory */
+	mach_memory_entry_port_release(entry);
+	if (kr != KERN_SUCCESS) {
+		goto fail;
+	}
+
+	lck_mtx_lock(bpf_mlock);
+	bpf_release_d(d);
+	if (d->bd_bif != NULL || (d->bd_flags & BPF_CLOSING) ||
+	    d->bd_ring != NULL) {
+		/* lost a race with BIOCSETIF, close or another BIOCSRING */
+		lck_mtx_unlock(bpf_mlock);
+		(void) mach_vm_deallocate(map, uaddr, msize);
+		kmem_free(kernel_map, kaddr, (vm_size_t)size);
+		lck_mtx_lock(bpf_mlock);
+		return EINVAL;
+	}
+
+	bpf_freebufs(d);
+	d->bd_ring = (caddr_t)kaddr;
+	d->bd_ring_size = (uint32_t)size;
+	d->bd_ring_bsize = brr->brr_block_size;
+	d->bd_ring_nblocks = brr->brr_block_count;
+	d->bd_ring_cur = 0;
+	d->bd_ring_head = 0;
+	d->bd_ring_nuser = 0;
+	d->bd_ring_seq = 0;
+	d->bd_bufsize = d->bd_ring_bsize - sizeof(struct bpf_ring_block);
+	d->bd_sbuf = NULL;
+	d->bd_slen = 0;
+	d->bd_scnt = 0;
+
+	brr->brr_addr = uaddr;
+	return 0;
+
+fail:
+	if (kaddr != 0) {
+		kmem_free(kernel_map, kaddr, (vm_size_t)size);
+	}
+	lck_mtx_lock(bpf_mlock);
+	bpf_release_d(d);
+	return ENOMEM;
+}
+
+static void
+bpf_ring_free(struct bpf_d *d)
+{
+	if (d->bd_ring == NULL) {
+		return;
+	}
+	/* a user mapping that is still around keeps the pages alive */
+	kmem_free(kernel_map, (vm_offset_t)d->bd_ring, d->bd_ring_size);
+	d->bd_ring = NULL;
+	d->bd_ring_size = 0;
+	d->bd_sbuf = NULL;
+}
+
+/*
+ * Hand the block being filled over to user space
+ */
+static void
+bpf_ring_retire(struct bpf_d *d)
+{
+	struct bpf_ring_block *brb = BPF_RING_BLOCK(d, d->bd_ring_cur);
+
+	brb->brb_len = d->bd_slen;
+	brb->brb_npkts = d->bd_scnt;
+	brb->brb_seq = d->bd_ring_seq++;
+	brb->brb_drops = d->bd_dcount;
+	os_atomic_store(&brb->brb_status, BPF_RING_USER, release);
+
+	d->bd_ring_nuser++;
+	d->bd_ring_cur = (d->bd_ring_cur + 1) % d->bd_ring_nblocks;
+	d->bd_sbuf = NULL;
+	d->bd_slen = 0;
+	d->bd_scnt = 0;
+}
+
+/*
+ * Account for the blocks that user space gave back, oldest first
+ */
+static void
+bpf_ring_reclaim(struct bpf_d *d)
+{
+	while (d->bd_ring_nuser > 0 &&
+	    os_atomic_load(&BPF_RING_BLOCK(d, d->bd_ring_head)->brb_status,
+	    acquire) == BPF_RING_KERNEL) {
+		d->bd_ring_head = (d->bd_ring_head + 1) % d->bd_ring_nblocks;
+		d->bd_ring_nuser--;
+	}
+}
+
+/*
+ * Make room for totlen bytes in the store buffer, moving on to the next
+ * block of the ring when the current one is full.  Returns false when
+ * that block is still owned by user space.
+ */
+static bool
+bpf_ring_reserve(struct bpf_d *d, u_int totlen, int *do_wakeup)
+{
+	if (d->bd_sbuf != NULL &&
+	    BPF_WORDALIGN(d->bd_slen) + totlen <= d->bd_bufsize) {
+		return true;
+	}
+	if (d->bd_sbuf != NULL) {
+		bpf_ring_retire(d);
+		*do_wakeup = 1;
+	}
+	bpf_ring_reclaim(d);
+	if (d->bd_ring_nuser == d->bd_ring_nblocks) {
+		return false;
+	}
+	d->bd_sbuf = (caddr_t)(BPF_RING_BLOCK(d, d->bd_ring_cur) + 1);
+	d->bd_slen = 0;
+	d->bd_scnt = 0;
+	return true;
+}
+
+/*
+ * Readiness in ring mode: there is at least one block for user space,
+ * after retiring a partial block if the reader wants it now.
+ */
+static boolean_t
+bpf_ring_ready(struct bpf_d *d)
+{
+	bpf_ring_reclaim(d);
+	if (d->bd_ring_nuser == 0 && d->bd_slen != 0 &&
+	    (d->bd_immediate || d->bd_state == BPF_TIMED_OUT)) {
+		bpf_ring_retire(d);
+	}
+	return d->bd_ring_nuser > 0;
+}
+
 /*
  * Move the packet data from interface memory (pkt) into the
  * store buffer.  Return 1 if it's time to wakeup a listener (buffer full),
@@ -3626,6 +3920,22 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 		return;
 	}
 
+	if (d->bd_ring != NULL) {
+		if (!bpf_ring_reserve(d, totlen, &do_wakeup)) {
+			/* every block is still held by user space */
+			++d->bd_dcount;
+			if (do_wakeup) {
+				bpf_wakeup(d);
+			}
+			return;
+		}
+		curlen = BPF_WORDALIGN(d->bd_slen);
+		if (d->bd_immediate || d->bd_state == BPF_TIMED_OUT) {
+			do_wakeup = 1;
+		}
+		goto append;
+	}
+
 	/*
 	 * Round up the end of the previous packet to the next longword.
 	 */
@@ -3673,6 +3983,7 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 		do_wakeup = 1;
 	}
 
+append:
 	/*
 	 * Append the bpf header.
 	 */
@@ -3844,9 +4155,11 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 static void
 bpf_freebufs(struct bpf_d *d)
 {
-	if (d->bd_sbuf != NULL) {
+	/* in ring mode, the store buffer is a block of the ring */
+	if (d->bd_sbuf != NULL && d->bd_ring == NULL) {
 		kfree_data_addr(d->bd_sbuf);
 	}
+	d->bd_sbuf = NULL;
 	if (d->bd_hbuf != NULL) {
 		kfree_data_addr(d->bd_hbuf);
 	}
@@ -3869,6 +4182,11 @@ bpf_allocbufs(struct bpf_d *d)
 {
 	bpf_freebufs(d);
 
+	if (d->bd_ring != NULL) {
+		/* blocks are taken from the ring as packets come in */
+		goto done;
+	}
+
 	d->bd_fbuf = (caddr_t) kalloc_data(d->bd_bufsize, Z_WAITOK | Z_ZERO);
 	if (d->bd_fbuf == NULL) {
 		goto nobufs;
@@ -3878,6 +4196,7 @@ bpf_allocbufs(struct bpf_d *d)
 	if (d->bd_sbuf == NULL) {
 		goto nobufs;
 	}
+done:
 	d->bd_slen = 0;
 	d->bd_hlen = 0;
 	d->bd_scnt = 0;
@@ -3917,10 +4236,15 @@ bpf_freed(struct bpf_d *d)
 	}
 
 	bpf_freebufs(d);
+	bpf_ring_free(d);
 
 	if (d->bd_filter) {
 		kfree_data_addr(d->bd_filter);
 	}
+	if (d->bd_cprog != NULL) {
+		bpf_cprog_free(d->bd_cprog);
+		d->bd_cprog = NULL;
+	}
 }
 
 /*
@@ -4205,6 +4529,11 @@ bpfstats_fill_xbpf(struct xbpf_d *d, struct bpf_d *bd)
 
 	d->bd_read_count = bd->bd_bcs.bcs_total_read;
 	d->bd_fsize = bd->bd_bcs.bcs_total_size;
+
+	d->bd_filter_count = bd->bd_filter_count;
+	absolutetime_to_nanoseconds(bd->bd_filter_time, &d->bd_filter_ns);
+	d->bd_filter_len = bd->bd_filter_len;
+	d->bd_filter_compiled = bd->bd_cprog != NULL ? 1 : 0;
 }
 
 /*
@@ -189,6 +189,36 @@ struct bpf_version {
 };
 
 #ifdef PRIVATE
+/*
+ * Argument to BIOCSRING, which must be issued before BIOCSETIF.  The ring
+ * is brr_block_count blocks of brr_block_size bytes (a multiple of the
+ * page size), mapped read-write at brr_addr in the calling process.
+ *
+ * Each block starts with a struct bpf_ring_block, followed by brb_len
+ * bytes of packet records laid out exactly as read() would return them.
+ * The kernel fills blocks in order and hands each one over by setting
+ * brb_status to BPF_RING_USER; user space processes blocks in the same
+ * order and gives each back by storing BPF_RING_KERNEL.  Readiness is
+ * reported through select/poll/kevent; read() is not supported.
+ */
+struct bpf_ring_req {
+	uint32_t        brr_block_size;
+	uint32_t        brr_block_count;
+	uint64_t        brr_addr;       /* out: address of the ring */
+};
+
+struct bpf_ring_block {
+	volatile uint32_t brb_status;   /* owner of the block */
+	uint32_t        brb_seq;        /* increases with every block */
+	uint32_t        brb_len;        /* bytes of packet data */
+	uint32_t        brb_npkts;      /* number of packets */
+	uint64_t        brb_drops;      /* packets dropped so far */
+	uint64_t        brb_reserved;
+};
+
+#define BPF_RING_KERNEL         0
+#define BPF_RING_USER           1
+
 struct bpf_comp_stats {
 	uint64_t bcs_total_read; /* number of packets read from device */
 	uint64_t bcs_total_size; /* total size of filtered packets */
@@ -269,6 +299,7 @@ struct bpf_comp_stats {
 #define BIOCSHDRCOMP    _IOW('B', 135, int)
 #define BIOCGHDRCOMPSTATS    _IOR('B', 136, struct bpf_comp_stats)
 #define BIOCGHDRCOMPON  _IOR('B', 137, int)
+#define BIOCSRING       _IOWR('B', 138, struct bpf_ring_req)
 #endif /* PRIVATE */
 /*
  * Structure prepended to each packet.
@@ -366,6 +397,12 @@ struct xbpf_d {
 
 	uint64_t        bd_read_count;
 	uint64_t        bd_fsize;
+
+	uint64_t        bd_filter_count; /* packets timed through the filter */
+	uint64_t        bd_filter_ns;    /* time spent in the filter */
+	uint32_t        bd_filter_len;   /* number of filter instructions */
+	uint8_t         bd_filter_compiled;
+	uint8_t         bd_pad2[3];
 };
 
 #define _HAS_STRUCT_XBPF_D_ 2
@@ -1460,6 +1497,11 @@ extern int      bpf_validate(const struct bpf_insn *, int);
 extern void     bpfdetach(struct ifnet *);
 extern void     bpfilterattach(int);
 extern u_int    bpf_filter(const struct bpf_insn *, u_char *, u_int, u_int);
+
+struct bpf_cprog;
+extern struct bpf_cprog *bpf_cprog_compile(const struct bpf_insn *, u_int);
+extern void     bpf_cprog_free(struct bpf_cprog *);
+extern u_int    bpf_cprog_run(const struct bpf_cprog *, u_char *, u_int, u_int);
 #endif /* KERNEL_PRIVATE */
 
 #endif /* !defined(DRIVERKIT) */
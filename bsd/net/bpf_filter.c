@@ -887,4 +887,588 @@ bpf_validate(const struct bpf_insn *f, int len)
 	}
 	return BPF_CLASS(f[len - 1].code) == BPF_RET;
 }
+
+/*
+ * Filter programs are also translated once, when they are installed, into
+ * a form that is cheaper to run than the classic instruction stream:
+ *
+ * - opcodes are renumbered densely, so the dispatch is a single table
+ *   jump, and the checks that bpf_validate() already did at install time
+ *   (scratch memory indices, division by a zero constant, unknown
+ *   opcodes) are not repeated for every packet;
+ * - jump offsets are resolved to absolute instruction indices;
+ * - a packet load immediately followed by a "jeq #k" that nothing else
+ *   jumps to is fused into one instruction, which is how tcpdump(1)
+ *   compiles nearly every protocol and address test;
+ * - packet loads first try the link header and the first mbuf of the
+ *   packet, and only walk the mbuf chain when the data lies further.
+ *
+ * The kernel cannot generate native code, as its text is immutable, so
+ * this is as close to a JIT as it gets.
+ */
+enum {
+	BPFC_RET_K,
+	BPFC_RET_A,
+	BPFC_LD_W_ABS,
+	BPFC_LD_H_ABS,
+	BPFC_LD_B_ABS,
+	BPFC_LD_W_IND,
+	BPFC_LD_H_IND,
+	BPFC_LD_B_IND,
+	BPFC_LD_W_LEN,
+	BPFC_LDX_W_LEN,
+	BPFC_LDX_MSH,
+	BPFC_LD_IMM,
+	BPFC_LDX_IMM,
+	BPFC_LD_MEM,
+	BPFC_LDX_MEM,
+	BPFC_ST,
+	BPFC_STX,
+	BPFC_JA,
+	BPFC_JGT_K,
+	BPFC_JGE_K,
+	BPFC_JEQ_K,
+	BPFC_JSET_K,
+	BPFC_JGT_X,
+	BPFC_JGE_X,
+	BPFC_JEQ_X,
+	BPFC_JSET_X,
+	BPFC_ADD_K,
+	BPFC_SUB_K,
+	BPFC_MUL_K,
+	BPFC_DIV_K,
+	BPFC_AND_K,
+	BPFC_OR_K,
+	BPFC_LSH_K,
+	BPFC_RSH_K,
+	BPFC_ADD_X,
+	BPFC_SUB_X,
+	BPFC_MUL_X,
+	BPFC_DIV_X,
+	BPFC_AND_X,
+	BPFC_OR_X,
+	BPFC_LSH_X,
+	BPFC_RSH_X,
+	BPFC_NEG,
+	BPFC_TAX,
+	BPFC_TXA,
+	/* fused "ld [k]; jeq #k2, jt, jf" */
+	BPFC_LD_W_ABS_JEQ,
+	BPFC_LD_H_ABS_JEQ,
+	BPFC_LD_B_ABS_JEQ,
+};
+
+struct bpf_cinsn {
+	uint8_t         bc_op;
+	uint8_t         bc_pad;
+	uint16_t        bc_jt;          /* absolute index */
+	uint16_t        bc_jf;          /* absolute index */
+	uint16_t        bc_pad2;
+	uint32_t        bc_k;
+	uint32_t        bc_k2;          /* jeq constant of fused loads */
+};
+
+#define BPF_CPROG_USES_MEM      0x1
+
+struct bpf_cprog {
+	uint32_t        bcp_size;
+	uint32_t        bcp_flags;
+	uint32_t        bcp_len;
+	uint32_t        bcp_pad;
+	struct bpf_cinsn bcp_insns[];
+};
+
+static int
+bpf_cprog_op(uint16_t code)
+{
+	switch (code) {
+	case BPF_RET | BPF_K:
+		return BPFC_RET_K;
+	case BPF_RET | BPF_A:
+		return BPFC_RET_A;
+	case BPF_LD | BPF_W | BPF_ABS:
+		return BPFC_LD_W_ABS;
+	case BPF_LD | BPF_H | BPF_ABS:
+		return BPFC_LD_H_ABS;
+	case BPF_LD | BPF_B | BPF_ABS:
+		return BPFC_LD_B_ABS;
+	case BPF_LD | BPF_W | BPF_IND:
+		return BPFC_LD_W_IND;
+	case BPF_LD | BPF_H | BPF_IND:
+		return BPFC_LD_H_IND;
+	case BPF_LD | BPF_B | BPF_IND:
+		return BPFC_LD_B_IND;
+	case BPF_LD | BPF_W | BPF_LEN:
+		return BPFC_LD_W_LEN;
+	case BPF_LDX | BPF_W | BPF_LEN:
+		return BPFC_LDX_W_LEN;
+	case BPF_LDX | BPF_MSH | BPF_B:
+		return BPFC_LDX_MSH;
+	case BPF_LD | BPF_IMM:
+		return BPFC_LD_IMM;
+	case BPF_LDX | BPF_IMM:
+		return BPFC_LDX_IMM;
+	case BPF_LD | BPF_MEM:
+		return BPFC_LD_MEM;
+	case BPF_LDX | BPF_MEM:
+		return BPFC_LDX_MEM;
+	case BPF_ST:
+		return BPFC_ST;
+	case BPF_STX:
+		return BPFC_STX;
+	case BPF_JMP | BPF_JA:
+		return BPFC_JA;
+	case BPF_JMP | BPF_JGT | BPF_K:
+		return BPFC_JGT_K;
+	case BPF_JMP | BPF_JGE | BPF_K:
+		return BPFC_JGE_K;
+	case BPF_JMP | BPF_JEQ | BPF_K:
+		return BPFC_JEQ_K;
+	case BPF_JMP | BPF_JSET | BPF_K:
+		return BPFC_JSET_K;
+	case BPF_JMP | BPF_JGT | BPF_X:
+		return BPFC_JGT_X;
+	case BPF_JMP | BPF_JGE | BPF_X:
+		return BPFC_JGE_X;
+	case BPF_JMP | BPF_JEQ | BPF_X:
+		return BPFC_JEQ_X;
+	case BPF_JMP | BPF_JSET | BPF_X:
+		return BPFC_JSET_X;
+	case BPF_ALU | BPF_ADD | BPF_K:
+		return BPFC_ADD_K;
+	case BPF_ALU | BPF_SUB | BPF_K:
+		return BPFC_SUB_K;
+	case BPF_ALU | BPF_MUL | BPF_K:
+		return BPFC_MUL_K;
+	case BPF_ALU | BPF_DIV | BPF_K:
+		return BPFC_DIV_K;
+	case BPF_ALU | BPF_AND | BPF_K:
+		return BPFC_AND_K;
+	case BPF_ALU | BPF_OR | BPF_K:
+		return BPFC_OR_K;
+	case BPF_ALU | BPF_LSH | BPF_K:
+		return BPFC_LSH_K;
+	case BPF_ALU | BPF_RSH | BPF_K:
+		return BPFC_RSH_K;
+	case BPF_ALU | BPF_ADD | BPF_X:
+		return BPFC_ADD_X;
+	case BPF_ALU | BPF_SUB | BPF_X:
+		return BPFC_SUB_X;
+	case BPF_ALU | BPF_MUL | BPF_X:
+		return BPFC_MUL_X;
+	case BPF_ALU | BPF_DIV | BPF_X:
+		return BPFC_DIV_X;
+	case BPF_ALU | BPF_AND | BPF_X:
+		return BPFC_AND_X;
+	case BPF_ALU | BPF_OR | BPF_X:
+		return BPFC_OR_X;
+	case BPF_ALU | BPF_LSH | BPF_X:
+		return BPFC_LSH_X;
+	case BPF_ALU | BPF_RSH | BPF_X:
+		return BPFC_RSH_X;
+	case BPF_ALU | BPF_NEG:
+		return BPFC_NEG;
+	case BPF_MISC | BPF_TAX:
+		return BPFC_TAX;
+	case BPF_MISC | BPF_TXA:
+		return BPFC_TXA;
+	default:
+		return -1;
+	}
+}
+
+#define BPF_CPROG_ISTARGET(map, i) \
+	(((map)[(i) / NBBY] & (1 << ((i) % NBBY))) != 0)
+#define BPF_CPROG_SETTARGET(map, i) \
+	((map)[(i) / NBBY] |= (uint8_t)(1 << ((i) % NBBY)))
+
+/*
+ * Translate a program that passed bpf_validate().  Returns NULL if the
+ * program cannot be translated, in which case the caller keeps
+ * interpreting it with bpf_filter().
+ */
+struct bpf_cprog *
+bpf_cprog_compile(const struct bpf_insn *f, u_int len)
+{
+	uint8_t targets[(BPF_MAXINSNS + NBBY - 1) / NBBY] = {};
+	struct bpf_cprog *prog;
+	u_int i, size;
+
+	if (len < 1 || len > BPF_MAXINSNS) {
+		return NULL;
+	}
+	size = (u_int)(sizeof(*prog) + len * sizeof(struct bpf_cinsn));
+	prog = kalloc_data(size, Z_WAITOK | Z_ZERO);
+	if (prog == NULL) {
+		return NULL;
+	}
+	prog->bcp_size = size;
+	prog->bcp_len = len;
+
+	for (i = 0; i < len; i++) {
+		struct bpf_cinsn *c = &prog->bcp_insns[i];
+		int op = bpf_cprog_op(f[i].code);
+
+		if (op < 0) {
+			kfree_data(prog, size);
+			return NULL;
+		}
+		c->bc_op = (uint8_t)op;
+		c->bc_k = f[i].k;
+		if (op == BPFC_JA) {
+			c->bc_jt = c->bc_jf = (uint16_t)(i + 1 + f[i].k);
+			BPF_CPROG_SETTARGET(targets, c->bc_jt);
+		} else if (BPF_CLASS(f[i].code) == BPF_JMP) {
+			c->bc_jt = (uint16_t)(i + 1 + f[i].jt);
+			c->bc_jf = (uint16_t)(i + 1 + f[i].jf);
+			BPF_CPROG_SETTARGET(targets, c->bc_jt);
+			BPF_CPROG_SETTARGET(targets, c->bc_jf);
+		} else if (op == BPFC_LD_MEM || op == BPFC_LDX_MEM) {
+			prog->bcp_flags |= BPF_CPROG_USES_MEM;
+		}
+	}
+
+	/*
+	 * The jeq that gets folded into the load stays in place, so the
+	 * indices do not move, but it is no longer reachable.
+	 */
+	for (i = 0; i + 1 < len; i++) {
+		struct bpf_cinsn *c = &prog->bcp_insns[i];
+		struct bpf_cinsn *n = &prog->bcp_insns[i + 1];
+
+		if (n->bc_op != BPFC_JEQ_K || BPF_CPROG_ISTARGET(targets, i + 1)) {
+			continue;
+		}
+		switch (c->bc_op) {
+		case BPFC_LD_W_ABS:
+			c->bc_op = BPFC_LD_W_ABS_JEQ;
+			break;
+		case BPFC_LD_H_ABS:
+			c->bc_op = BPFC_LD_H_ABS_JEQ;
+			break;
+		case BPFC_LD_B_ABS:
+			c->bc_op = BPFC_LD_B_ABS_JEQ;
+			break;
+		default:
+			continue;
+		}
+		c->bc_k2 = n->bc_k;
+		c->bc_jt = n->bc_jt;
+		c->bc_jf = n->bc_jf;
+	}
+	return prog;
+}
+
+void
+bpf_cprog_free(struct bpf_cprog *prog)
+{
+	kfree_data(prog, prog->bcp_size);
+}
+
+/*
+ * The parts of the packet that loads can reach without walking an
+ * mbuf chain: the link header, then the first mbuf
+ */
+struct bpf_cwin {
+	const u_char    *bw_hdr;
+	u_int           bw_hdrlen;
+	const u_char    *bw_data;
+	u_int           bw_datalen;
+};
+
+static inline const u_char *
+bpf_cwin_get(const struct bpf_cwin *w, bpf_u_int32 k, u_int size)
+{
+	if (k < w->bw_hdrlen) {
+		if (size <= w->bw_hdrlen - k) {
+			return w->bw_hdr + k;
+		}
+		return NULL;
+	}
+	k -= w->bw_hdrlen;
+	if (k < w->bw_datalen && size <= w->bw_datalen - k) {
+		return w->bw_data + k;
+	}
+	return NULL;
+}
+
+/*
+ * Run a program from bpf_cprog_compile(); same arguments and result as
+ * bpf_filter()
+ */
+u_int
+bpf_cprog_run(const struct bpf_cprog *prog, u_char *p, u_int wirelen,
+    u_int buflen)
+{
+	const struct bpf_cinsn *pc = prog->bcp_insns;
+	const struct bpf_cinsn *insns = prog->bcp_insns;
+	struct bpf_packet *bp = (struct bpf_packet *)(void *)p;
+	struct bpf_cwin w = {};
+	u_int32_t A = 0, X = 0;
+	int32_t mem[BPF_MEMWORDS];
+	const u_char *cp;
+	bpf_u_int32 k;
+	int merr;
+
+	if (prog->bcp_flags & BPF_CPROG_USES_MEM) {
+		bzero(mem, sizeof(mem));
+	}
+	if (buflen != 0) {
+		w.bw_hdr = p;
+		w.bw_hdrlen = buflen;
+	} else {
+		w.bw_hdr = bp->bpfp_header;
+		w.bw_hdrlen = (u_int)bp->bpfp_header_length;
+		if (bp->bpfp_type == BPF_PACKET_TYPE_MBUF &&
+		    bp->bpfp_mbuf != NULL) {
+			w.bw_data = mtod(bp->bpfp_mbuf, const u_char *);
+			w.bw_datalen = (u_int)bp->bpfp_mbuf->m_len;
+		}
+	}
+
+/* the packet bytes past the window are only there for struct bpf_packet */
+#define BPF_CPROG_LOAD(size, extract, slow, dst) do {                   \
+	cp = bpf_cwin_get(&w, k, size);                                 \
+	if (__probable(cp != NULL)) {                                   \
+	        dst = extract(cp);                                      \
+	} else {                                                        \
+	        if (buflen != 0) {                                      \
+	                return 0;                                       \
+	        }                                                       \
+	        dst = slow(bp, k, &merr);                               \
+	        if (merr != 0) {                                        \
+	                return 0;                                       \
+	        }                                                       \
+	}                                                               \
+} while (0)
+#define BPF_CPROG_BYTE(cp)      (*(cp))
+
+	for (;; pc++) {
+		switch (pc->bc_op) {
+		case BPFC_RET_K:
+			return (u_int)pc->bc_k;
+
+		case BPFC_RET_A:
+			return (u_int)A;
+
+		case BPFC_LD_W_ABS:
+			k = pc->bc_k;
+			BPF_CPROG_LOAD(4, EXTRACT_LONG, bp_xword, A);
+			continue;
+
+		case BPFC_LD_H_ABS:
+			k = pc->bc_k;
+			BPF_CPROG_LOAD(2, EXTRACT_SHORT, bp_xhalf, A);
+			continue;
+
+		case BPFC_LD_B_ABS:
+			k = pc->bc_k;
+			BPF_CPROG_LOAD(1, BPF_CPROG_BYTE, bp_xbyte, A);
+			continue;
+
+		case BPFC_LD_W_ABS_JEQ:
+			k = pc->bc_k;
+			BPF_CPROG_LOAD(4, EXTRACT_LONG, bp_xword, A);
+			pc = &insns[(A == pc->bc_k2 ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_LD_H_ABS_JEQ:
+			k = pc->bc_k;
+			BPF_CPROG_LOAD(2, EXTRACT_SHORT, bp_xhalf, A);
+			pc = &insns[(A == pc->bc_k2 ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_LD_B_ABS_JEQ:
+			k = pc->bc_k;
+			BPF_CPROG_LOAD(1, BPF_CPROG_BYTE, bp_xbyte, A);
+			pc = &insns[(A == pc->bc_k2 ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_LD_W_IND:
+			k = X + pc->bc_k;
+			if (k < X) {
+				return 0;
+			}
+			BPF_CPROG_LOAD(4, EXTRACT_LONG, bp_xword, A);
+			continue;
+
+		case BPFC_LD_H_IND:
+			k = X + pc->bc_k;
+			if (k < X) {
+				return 0;
+			}
+			BPF_CPROG_LOAD(2, EXTRACT_SHORT, bp_xhalf, A);
+			continue;
+
+		case BPFC_LD_B_IND:
+			k = X + pc->bc_k;
+			if (k < X) {
+				return 0;
+			}
+			BPF_CPROG_LOAD(1, BPF_CPROG_BYTE, bp_xbyte, A);
+			continue;
+
+		case BPFC_LD_W_LEN:
+			A = wirelen;
+			continue;
+
+		case BPFC_LDX_W_LEN:
+			X = wirelen;
+			continue;
+
+		case BPFC_LDX_MSH:
+			k = pc->bc_k;
+			BPF_CPROG_LOAD(1, BPF_CPROG_BYTE, bp_xbyte, X);
+			X = (X & 0xf) << 2;
+			continue;
+
+		case BPFC_LD_IMM:
+			A = pc->bc_k;
+			continue;
+
+		case BPFC_LDX_IMM:
+			X = pc->bc_k;
+			continue;
+
+		/* scratch memory indices were checked by bpf_validate() */
+		case BPFC_LD_MEM:
+			A = mem[pc->bc_k];
+			continue;
+
+		case BPFC_LDX_MEM:
+			X = mem[pc->bc_k];
+			continue;
+
+		case BPFC_ST:
+			mem[pc->bc_k] = A;
+			continue;
+
+		case BPFC_STX:
+			mem[pc->bc_k] = X;
+			continue;
+
+		/* jump targets are absolute, and pc is incremented on continue */
+		case BPFC_JA:
+			pc = &insns[pc->bc_jt - 1];
+			continue;
+
+		case BPFC_JGT_K:
+			pc = &insns[(A > pc->bc_k ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_JGE_K:
+			pc = &insns[(A >= pc->bc_k ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_JEQ_K:
+			pc = &insns[(A == pc->bc_k ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_JSET_K:
+			pc = &insns[((A & pc->bc_k) ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_JGT_X:
+			pc = &insns[(A > X ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_JGE_X:
+			pc = &insns[(A >= X ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_JEQ_X:
+			pc = &insns[(A == X ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_JSET_X:
+			pc = &insns[((A & X) ? pc->bc_jt : pc->bc_jf) - 1];
+			continue;
+
+		case BPFC_ADD_K:
+			A += pc->bc_k;
+			continue;
+
+		case BPFC_SUB_K:
+			A -= pc->bc_k;
+			continue;
+
+		case BPFC_MUL_K:
+			A *= pc->bc_k;
+			continue;
+
+		/* bpf_validate() rejects a division by a zero constant */
+		case BPFC_DIV_K:
+			A /= pc->bc_k;
+			continue;
+
+		case BPFC_AND_K:
+			A &= pc->bc_k;
+			continue;
+
+		case BPFC_OR_K:
+			A |= pc->bc_k;
+			continue;
+
+		case BPFC_LSH_K:
+			A <<= pc->bc_k;
+			continue;
+
+		case BPFC_RSH_K:
+			A >>= pc->bc_k;
+			continue;
+
+		case BPFC_ADD_X:
+			A += X;
+			continue;
+
+		case BPFC_SUB_X:
+			A -= X;
+			continue;
+
+		case BPFC_MUL_X:
+			A *= X;
+			continue;
+
+		case BPFC_DIV_X:
+			if (X == 0) {
+				return 0;
+			}
+			A /= X;
+			continue;
+
+		case BPFC_AND_X:
+			A &= X;
+			continue;
+
+		case BPFC_OR_X:
+			A |= X;
+			continue;
+
+		case BPFC_LSH_X:
+			A <<= X;
+			continue;
+
+		case BPFC_RSH_X:
+			A >>= X;
+			continue;
+
+		case BPFC_NEG:
+			A = -A;
+			continue;
+
+		case BPFC_TAX:
+			X = A;
+			continue;
+
+		case BPFC_TXA:
+			A = X;
+			continue;
+
+		default:
+			return 0;
+		}
+	}
+#undef BPF_CPROG_BYTE
+#undef BPF_CPROG_LOAD
+}
 #endif
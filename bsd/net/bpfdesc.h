@@ -110,6 +110,10 @@ struct bpf_d {
 	uint32_t        bd_rtout;       /* Read timeout in 'ticks' */
 	struct bpf_if   *bd_bif;         /* interface descriptor */
 	struct bpf_insn *bd_filter;     /* filter code */
+	struct bpf_cprog *bd_cprog;     /* translated bd_filter, if any */
+	uint32_t        bd_filter_len;  /* number of instructions */
+	uint64_t        bd_filter_count; /* packets timed through the filter */
+	uint64_t        bd_filter_time; /* in mach absolute time */
 	uint64_t        bd_rcount;      /* number of packets received */
 	uint64_t        bd_dcount;      /* number of received packets dropped */
 	uint64_t        bd_fcount;      /* number of received packets which matched filter */
@@ -150,6 +154,20 @@ struct bpf_d {
 	caddr_t         bd_prev_fbuf;
 
 	struct bpf_comp_stats bd_bcs;
+
+	/*
+	 * Ring mode (BIOCSRING): bd_sbuf points into the block being
+	 * filled, or is NULL while waiting for user space to give back
+	 * the next block; there is no hold or free buffer.
+	 */
+	caddr_t         bd_ring;        /* kernel address of the ring */
+	uint32_t        bd_ring_size;
+	uint32_t        bd_ring_bsize;  /* bytes per block */
+	uint32_t        bd_ring_nblocks;
+	uint32_t        bd_ring_cur;    /* block being filled */
+	uint32_t        bd_ring_head;   /* oldest block handed out */
+	uint32_t        bd_ring_nuser;  /* blocks handed out */
+	uint32_t        bd_ring_seq;
 };
 
 /* Values for bd_state */
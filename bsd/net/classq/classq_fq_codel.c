@@ -603,20 +603,18 @@ fq_getq_flow_internal(fq_if_t *fqs, fq_t *fq, pktsched_pkt_t *pkt)
 	}
 }
 
-void
-fq_getq_flow(fq_if_t *fqs, fq_t *fq, pktsched_pkt_t *pkt, uint64_t now)
+/*
+ * Per packet part of the dequeue: account for the queueing delay of
+ * the packet and clear the scheduler private state in it.
+ */
+static void
+fq_getq_flow_qdelay(fq_if_t *fqs, fq_t *fq, pktsched_pkt_t *pkt, uint64_t now)
 {
 	fq_if_classq_t *fq_cl;
 	int64_t qdelay = 0;
 	volatile uint32_t *pkt_flags;
 	uint64_t *pkt_timestamp;
 
-	fq_getq_flow_internal(fqs, fq, pkt);
-	if (pkt->pktsched_ptype == QP_INVALID) {
-		VERIFY(pkt->pktsched_pkt_mbuf == NULL);
-		return;
-	}
-
 	pktsched_get_pkt_vars(pkt, &pkt_flags, &pkt_timestamp, NULL, NULL,
 	    NULL, NULL);
 
@@ -668,6 +666,35 @@ fq_getq_flow(fq_if_t *fqs, fq_t *fq, pktsched_pkt_t *pkt, uint64_t now)
 		}
 	}
 
+	*pkt_timestamp = 0;
+	switch (pkt->pktsched_ptype) {
+	case QP_MBUF:
+		*pkt_flags &= ~PKTF_PRIV_GUARDED;
+		break;
+#if SKYWALK
+	case QP_PACKET:
+		/* sanity check */
+		ASSERT((*pkt_flags & ~PKT_F_COMMON_MASK) == 0);
+		break;
+#endif /* SKYWALK */
+	default:
+		VERIFY(0);
+		/* NOTREACHED */
+		__builtin_unreachable();
+	}
+}
+
+/*
+ * Per flow part of the dequeue: evaluate the minimum queueing delay
+ * against the target and drive flow control off of it.  This only
+ * depends on the state accumulated in the flow, so a burst of packets
+ * dequeued with fq_getq_flow_batch() needs it just once at the end.
+ */
+void
+fq_getq_flow_update(fq_if_t *fqs, fq_t *fq, uint64_t now)
+{
+	fq_if_classq_t *fq_cl = &FQ_CLASSQ(fq);
+
 	if (now >= fq->fq_updatetime) {
 		if (fq->fq_min_qdelay > FQ_TARGET_DELAY(fq)) {
 			if (!FQ_IS_DELAY_HIGH(fq)) {
@@ -704,21 +731,29 @@ fq_getq_flow(fq_if_t *fqs, fq_t *fq, pktsched_pkt_t *pkt, uint64_t now)
 		fq->fq_getqtime = now;
 	}
 	fq_if_is_flow_heavy(fqs, fq);
+}
 
-	*pkt_timestamp = 0;
-	switch (pkt->pktsched_ptype) {
-	case QP_MBUF:
-		*pkt_flags &= ~PKTF_PRIV_GUARDED;
-		break;
-#if SKYWALK
-	case QP_PACKET:
-		/* sanity check */
-		ASSERT((*pkt_flags & ~PKT_F_COMMON_MASK) == 0);
-		break;
-#endif /* SKYWALK */
-	default:
-		VERIFY(0);
-		/* NOTREACHED */
-		__builtin_unreachable();
+/*
+ * Dequeue a packet without updating the flow state; the caller must
+ * call fq_getq_flow_update() once it is done with the flow.
+ */
+void
+fq_getq_flow_batch(fq_if_t *fqs, fq_t *fq, pktsched_pkt_t *pkt, uint64_t now)
+{
+	fq_getq_flow_internal(fqs, fq, pkt);
+	if (pkt->pktsched_ptype == QP_INVALID) {
+		VERIFY(pkt->pktsched_pkt_mbuf == NULL);
+		return;
+	}
+	fq_getq_flow_qdelay(fqs, fq, pkt, now);
+}
+
+void
+fq_getq_flow(fq_if_t *fqs, fq_t *fq, pktsched_pkt_t *pkt, uint64_t now)
+{
+	fq_getq_flow_batch(fqs, fq, pkt, now);
+	if (pkt->pktsched_ptype == QP_INVALID) {
+		return;
 	}
+	fq_getq_flow_update(fqs, fq, now);
 }
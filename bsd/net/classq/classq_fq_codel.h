@@ -246,6 +246,10 @@ extern int fq_addq(struct fq_codel_sched_data *, fq_if_group_t *,
     pktsched_pkt_t *, struct fq_if_classq *);
 extern void fq_getq_flow(struct fq_codel_sched_data *, fq_t *,
     pktsched_pkt_t *, uint64_t now);
+extern void fq_getq_flow_batch(struct fq_codel_sched_data *, fq_t *,
+    pktsched_pkt_t *, uint64_t now);
+extern void fq_getq_flow_update(struct fq_codel_sched_data *, fq_t *,
+    uint64_t now);
 extern void fq_codel_dequeue(fq_if_t *fqs, fq_t *fq,
     pktsched_pkt_t *pkt, uint64_t now);
 extern void fq_getq_flow_internal(struct fq_codel_sched_data *,
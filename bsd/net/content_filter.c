@@ -737,6 +737,16 @@ static int cfil_sbtrim = 1;
 SYSCTL_UINT(_net_cfil, OID_AUTO, sbtrim, CTLFLAG_RW | CTLFLAG_LOCKED,
     &cfil_sbtrim, 0, "");
 
+/*
+ * Largest span of queued stream data handed to a filter in one data event.
+ * Contiguous TCP chunks waiting in the control queue are coalesced up to
+ * this size instead of costing one kernel control message each.
+ * 0 sends every chunk on its own.
+ */
+static uint32_t cfil_data_event_span = 64 * 1024;
+SYSCTL_UINT(_net_cfil, OID_AUTO, data_event_span, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &cfil_data_event_span, 0, "");
+
 SYSCTL_PROC(_net_cfil, OID_AUTO, filter_list, CTLFLAG_RD | CTLFLAG_LOCKED,
     0, 0, sysctl_cfil_filter_list, "S,cfil_filter_stat", "");
 
@@ -3678,6 +3688,8 @@ cfil_dispatch_data_event(struct socket *so, struct cfil_info *cfil_info, uint32_
 	struct mbuf *copy = NULL;
 	struct mbuf *msg = NULL;
 	unsigned int one = 1;
+	unsigned int copied = 0, off = copyoffset;
+	struct mbuf *record;
 	struct cfil_msg_data_event *data_req;
 	size_t hdrsize;
 	struct inpcb *inp = (struct inpcb *)so->so_pcb;
@@ -3701,6 +3713,7 @@ cfil_dispatch_data_event(struct socket *so, struct cfil_info *cfil_info, uint32_
 		goto done;
 	}
 
+	record = data;
 	data = cfil_data_start(data);
 	if (data == NULL) {
 		CFIL_LOG(LOG_ERR, "No data start");
@@ -3718,13 +3731,35 @@ cfil_dispatch_data_event(struct socket *so, struct cfil_info *cfil_info, uint32_
 		goto done;
 	}
 
-	/* Make a copy of the data to pass to kernel control socket */
-	copy = m_copym_mode(data, copyoffset, copylen, M_DONTWAIT,
-	    M_COPYM_NOOP_HDR);
-	if (copy == NULL) {
-		CFIL_LOG(LOG_ERR, "m_copym_mode() failed");
-		error = ENOMEM;
-		goto done;
+	/*
+	 * Make a copy of the data to pass to kernel control socket.
+	 * For stream sockets the span may continue into the following
+	 * chunks of the control queue, see cfil_data_service_ctl_q().
+	 */
+	for (struct mbuf *rec = record, *tail = NULL; copied < copylen;
+	    rec = cfil_queue_next(&entrybuf->cfe_ctl_q, rec), off = 0) {
+		struct mbuf *m, *part;
+		unsigned int partlen;
+
+		VERIFY(rec != NULL);
+		m = cfil_data_start(rec);
+		partlen = MIN(copylen - copied,
+		    cfil_data_length(m, NULL, NULL) - off);
+		part = m_copym_mode(m, off, partlen, M_DONTWAIT,
+		    M_COPYM_NOOP_HDR);
+		if (part == NULL) {
+			CFIL_LOG(LOG_ERR, "m_copym_mode() failed");
+			m_freem(copy);
+			error = ENOMEM;
+			goto done;
+		}
+		if (tail == NULL) {
+			copy = part;
+		} else {
+			tail->m_next = part;
+		}
+		tail = m_last(part);
+		copied += partlen;
 	}
 
 	/* We need an mbuf packet for the message header */
@@ -3845,6 +3880,9 @@ cfil_data_service_ctl_q(struct socket *so, struct cfil_info *cfil_info, uint32_t
 	struct cfil_entry *entry;
 	struct cfe_buf *entrybuf;
 	uint64_t currentoffset = 0;
+	struct mbuf *last;
+	uint64_t lastoffset;
+	unsigned int spanlen, lastlen, lastcopylen;
 
 	if (cfil_info == NULL) {
 		return 0;
@@ -4007,23 +4045,68 @@ cfil_data_service_ctl_q(struct socket *so, struct cfil_info *cfil_info, uint32_t
 		if (copylen == 0) {
 			break;
 		}
+		/*
+		 * Stream data has no record boundaries the filter cares
+		 * about, so when this chunk is peeked to its end extend
+		 * the event over the chunks that follow it.
+		 */
+		spanlen = copylen;
+		last = data;
+		lastoffset = currentoffset;
+		lastlen = datalen;
+		lastcopylen = copylen;
+		if (IS_TCP(so) && copyoffset + copylen == datalen) {
+			struct mbuf *next = data;
+			uint64_t nextoffset = currentoffset + datalen;
+
+			while (nextoffset < entrybuf->cfe_peek_offset &&
+			    (next = cfil_queue_next(&entrybuf->cfe_ctl_q, next)) != NULL) {
+				unsigned int nextlen = cfil_data_length(next, NULL, NULL);
+				unsigned int take = nextlen;
+
+				if (nextoffset + take > entrybuf->cfe_peek_offset) {
+					take = (unsigned int)(entrybuf->cfe_peek_offset - nextoffset);
+				}
+				if (spanlen + take > cfil_data_event_span) {
+					break;
+				}
+				spanlen += take;
+				last = next;
+				lastoffset = nextoffset;
+				lastlen = nextlen;
+				lastcopylen = take;
+				nextoffset += nextlen;
+				if (take < nextlen) {
+					break;
+				}
+			}
+		}
 		/*
 		 * Let the filter get a peek at this span of data
 		 */
 		error = cfil_dispatch_data_event(so, cfil_info, kcunit,
-		    outgoing, data, copyoffset, copylen);
+		    outgoing, data, copyoffset, spanlen);
 		if (error != 0) {
 			/* On error, leave data in ctl_q */
 			break;
 		}
-		entrybuf->cfe_peeked += copylen;
+		entrybuf->cfe_peeked += spanlen;
 		if (outgoing) {
-			OSAddAtomic64(copylen,
+			OSAddAtomic64(spanlen,
 			    &cfil_stats.cfs_ctl_q_out_peeked);
 		} else {
-			OSAddAtomic64(copylen,
+			OSAddAtomic64(spanlen,
 			    &cfil_stats.cfs_ctl_q_in_peeked);
 		}
+		if (last != data) {
+			OSAddAtomic64(1, &cfil_stats.cfs_data_event_coalesced);
+			/* Carry on from the last chunk the event covered */
+			data = tmp = last;
+			currentoffset = lastoffset;
+			datalen = lastlen;
+			copyoffset = 0;
+			copylen = lastcopylen;
+		}
 
 		/* Stop when data could not be fully peeked at */
 		if (copylen + copyoffset < datalen) {
@@ -499,6 +499,8 @@ struct cfil_stats {
 	int64_t cfs_inject_q_out_enqueued __attribute__((aligned(8)));
 	int64_t cfs_inject_q_in_passed __attribute__((aligned(8)));
 	int64_t cfs_inject_q_out_passed __attribute__((aligned(8)));
+
+	int64_t cfs_data_event_coalesced __attribute__((aligned(8)));
 };
 #endif /* PRIVATE */
 
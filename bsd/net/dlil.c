@@ -452,6 +452,7 @@ static void ifnet_start_thread_cont(void *, wait_result_t);
 
 static void ifnet_poll_thread_func(void *, wait_result_t);
 static void ifnet_poll_thread_cont(void *, wait_result_t);
+static void ifnet_busy_poll_set_enabled(struct ifnet *, boolean_t);
 
 static errno_t ifnet_enqueue_common(struct ifnet *, struct ifclassq *,
     classq_pkt_t *, boolean_t, boolean_t *);
@@ -2037,6 +2038,42 @@ dlil_post_msg(struct ifnet *ifp, u_int32_t event_subclass,
 	return dlil_event_internal(ifp, &ev_msg, update_generation);
 }
 
+static void
+ifnet_pcpu_stats_alloc(struct ifnet *ifp)
+{
+	struct ifnet_pcpu_stats *ps = &ifp->if_pcpu_stats;
+
+	counter_alloc(&ps->ifi_ipackets);
+	counter_alloc(&ps->ifi_ierrors);
+	counter_alloc(&ps->ifi_opackets);
+	counter_alloc(&ps->ifi_oerrors);
+	counter_alloc(&ps->ifi_collisions);
+	counter_alloc(&ps->ifi_ibytes);
+	counter_alloc(&ps->ifi_obytes);
+	counter_alloc(&ps->ifi_iqdrops);
+}
+
+/*
+ * Only called at attach time, before the interface can see any traffic,
+ * so the per-CPU slots can be cleared without synchronization.
+ */
+static void
+ifnet_pcpu_stats_reset(struct ifnet *ifp)
+{
+	struct ifnet_pcpu_stats *ps = &ifp->if_pcpu_stats;
+	scalable_counter_t *counters[] = {
+		&ps->ifi_ipackets, &ps->ifi_ierrors, &ps->ifi_opackets,
+		&ps->ifi_oerrors, &ps->ifi_collisions, &ps->ifi_ibytes,
+		&ps->ifi_obytes, &ps->ifi_iqdrops,
+	};
+
+	for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+		zpercpu_foreach(it, *counters[i]) {
+			*it = 0;
+		}
+	}
+}
+
 __private_extern__ int
 dlil_alloc_local_stats(struct ifnet *ifp)
 {
@@ -3234,6 +3271,9 @@ dlil_input_thread_cont(void *v, wait_result_t wres)
 		 * safeguards if we deal with long chains of packets.
 		 */
 		if (__probable(m != NULL)) {
+#if INET
+			m = tcp_lro_list(ifp, m, &m_cnt);
+#endif /* INET */
 			dlil_input_packet_list_extended(NULL, m,
 			    m_cnt, ifp->if_poll_mode);
 		}
@@ -3513,6 +3553,15 @@ skip:
 				    ifp->if_rxpoll_bhiwat);
 			}
 
+			/*
+			 * Busy-pollers may only call into the driver while
+			 * it is in polling mode; take them out before the
+			 * driver goes back to interrupts.
+			 */
+			if (mode == IFNET_MODEL_INPUT_POLL_OFF) {
+				ifnet_busy_poll_set_enabled(ifp, FALSE);
+			}
+
 			if ((err = ((*ifp->if_input_ctl)(ifp,
 			    IFNET_CTL_SET_INPUT_MODEL, sizeof(p), &p))) != 0) {
 				DLIL_PRINTF("%s: error setting polling mode "
@@ -3537,6 +3586,8 @@ skip:
 				ifp->if_rxpoll_onreq++;
 				if (err != 0) {
 					ifp->if_rxpoll_onerr++;
+				} else {
+					ifnet_busy_poll_set_enabled(ifp, TRUE);
 				}
 				break;
 
@@ -3555,6 +3606,9 @@ skip:
 		 * safeguards if we deal with long chains of packets.
 		 */
 		if (__probable(m != NULL)) {
+#if INET
+			m = tcp_lro_list(ifp, m, &m_cnt);
+#endif /* INET */
 			dlil_input_packet_list_extended(NULL, m, m_cnt, mode);
 		}
 
@@ -4479,6 +4533,97 @@ ifnet_poll(struct ifnet *ifp)
 	lck_mtx_unlock(&ifp->if_poll_lock);
 }
 
+/*
+ * Allow or disallow busy-polling of the driver.  It is allowed only once
+ * the driver has accepted IFNET_MODEL_INPUT_POLL_ON; before the driver is
+ * switched back to interrupts, wait for a busy-poller that is still in
+ * if_input_poll to leave so it never races with the driver's own RX path.
+ */
+static void
+ifnet_busy_poll_set_enabled(struct ifnet *ifp, boolean_t enable)
+{
+	lck_mtx_lock(&ifp->if_poll_lock);
+	if (enable) {
+		ifp->if_poll_flags |= IF_POLLF_POLLMODE;
+	} else {
+		ifp->if_poll_flags &= ~IF_POLLF_POLLMODE;
+		while (ifp->if_poll_flags & IF_POLLF_BUSYPOLL) {
+			ifp->if_poll_flags |= IF_POLLF_BUSYPOLL_DRAIN;
+			(void) msleep(&ifp->if_poll_flags, &ifp->if_poll_lock,
+			    (PZERO - 1), "ifnet_busy_poll_drain", NULL);
+		}
+	}
+	lck_mtx_unlock(&ifp->if_poll_lock);
+}
+
+/*
+ * Poll the driver from the calling thread and run what it returns through
+ * the stack right away, on behalf of a busy-polling socket.  The poller
+ * thread and the input thread are left alone: this is skipped unless the
+ * driver is in polling mode, while the poller thread is running, or while
+ * the input thread still has packets queued, so nothing gets ahead of
+ * packets received earlier.  A limit of 0 uses the poller thread's.
+ * Returns the number of packets processed.
+ */
+u_int32_t
+ifnet_busy_poll(struct ifnet *ifp, u_int32_t m_lim)
+{
+	struct dlil_threading_info *inp;
+	struct mbuf *m_head = NULL, *m_tail = NULL;
+	u_int32_t m_cnt = 0, m_totlen = 0;
+
+	if (!(ifp->if_eflags & IFEF_RXPOLL) || !net_rxpoll ||
+	    (inp = ifp->if_inp) == NULL || qlen(&inp->dlth_pkts) != 0 ||
+	    !ifnet_is_attached(ifp, 1)) {
+		return 0;
+	}
+
+	lck_mtx_lock_spin(&ifp->if_poll_lock);
+	if (ifp->if_poll_thread == THREAD_NULL ||
+	    ifp->if_poll_mode != IFNET_MODEL_INPUT_POLL_ON ||
+	    !(ifp->if_poll_flags & IF_POLLF_POLLMODE) ||
+	    (ifp->if_poll_flags & (IF_POLLF_RUNNING | IF_POLLF_BUSYPOLL |
+	    IF_POLLF_TERMINATING | IF_POLLF_EMBRYONIC)) != 0) {
+		lck_mtx_unlock(&ifp->if_poll_lock);
+		ifnet_decr_iorefcnt(ifp);
+		return 0;
+	}
+	ifp->if_poll_flags |= IF_POLLF_BUSYPOLL;
+	if (m_lim == 0) {
+		m_lim = (ifp->if_rxpoll_plim != 0) ? ifp->if_rxpoll_plim :
+		    MAX((qlimit(&inp->dlth_pkts)), (ifp->if_rxpoll_phiwat << 2));
+	}
+	lck_mtx_unlock(&ifp->if_poll_lock);
+
+	(*ifp->if_input_poll)(ifp, 0, m_lim, &m_head, &m_tail, &m_cnt,
+	    &m_totlen);
+
+	lck_mtx_lock_spin(&ifp->if_poll_lock);
+	ifp->if_poll_flags &= ~IF_POLLF_BUSYPOLL;
+	if (ifp->if_poll_flags & IF_POLLF_BUSYPOLL_DRAIN) {
+		ifp->if_poll_flags &= ~IF_POLLF_BUSYPOLL_DRAIN;
+		wakeup(&ifp->if_poll_flags);
+	}
+	if (ifp->if_poll_flags & IF_POLLF_BUSYPOLL_WANT) {
+		ifp->if_poll_flags &= ~IF_POLLF_BUSYPOLL_WANT;
+		ifnet_poll_wakeup(ifp);
+	}
+	lck_mtx_unlock(&ifp->if_poll_lock);
+
+	if (m_head != NULL) {
+		VERIFY(m_tail != NULL && m_cnt > 0);
+		(void) ifnet_stat_increment_in(ifp, m_cnt, m_totlen, 0);
+#if INET
+		m_head = tcp_lro_list(ifp, m_head, &m_cnt);
+#endif /* INET */
+		dlil_input_packet_list_extended(NULL, m_head, m_cnt,
+		    IFNET_MODEL_INPUT_POLL_ON);
+	}
+	ifnet_decr_iorefcnt(ifp);
+
+	return m_cnt;
+}
+
 __attribute__((noreturn))
 static void
 ifnet_poll_thread_func(void *v, wait_result_t w)
@@ -4539,6 +4684,12 @@ ifnet_poll_thread_cont(void *v, wait_result_t wres)
 		goto skip;
 	}
 
+	/* A busy-polling socket is driving the driver; it wakes us when done */
+	if (ifp->if_poll_flags & IF_POLLF_BUSYPOLL) {
+		ifp->if_poll_flags |= IF_POLLF_BUSYPOLL_WANT;
+		goto skip;
+	}
+
 	ifp->if_poll_flags |= IF_POLLF_RUNNING;
 
 	/*
@@ -5966,41 +6117,42 @@ dlil_input_stats_sync(struct ifnet *ifp, struct dlil_threading_info *inp)
 	struct ifnet_stat_increment_param *s = &inp->dlth_stats;
 
 	/*
-	 * Use of atomic operations is unavoidable here because
-	 * these stats may also be incremented elsewhere via KPIs.
+	 * These stats may also be incremented elsewhere via KPIs;
+	 * they go to the per-CPU counters so that concurrent input
+	 * threads don't contend on if_data.
 	 */
 	if (s->packets_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ipackets, s->packets_in);
+		IFNET_STAT_ADD(ifp, ifi_ipackets, s->packets_in);
 		s->packets_in = 0;
 	}
 	if (s->bytes_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ibytes, s->bytes_in);
+		IFNET_STAT_ADD(ifp, ifi_ibytes, s->bytes_in);
 		s->bytes_in = 0;
 	}
 	if (s->errors_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ierrors, s->errors_in);
+		IFNET_STAT_ADD(ifp, ifi_ierrors, s->errors_in);
 		s->errors_in = 0;
 	}
 
 	if (s->packets_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_opackets, s->packets_out);
+		IFNET_STAT_ADD(ifp, ifi_opackets, s->packets_out);
 		s->packets_out = 0;
 	}
 	if (s->bytes_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_obytes, s->bytes_out);
+		IFNET_STAT_ADD(ifp, ifi_obytes, s->bytes_out);
 		s->bytes_out = 0;
 	}
 	if (s->errors_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_oerrors, s->errors_out);
+		IFNET_STAT_ADD(ifp, ifi_oerrors, s->errors_out);
 		s->errors_out = 0;
 	}
 
 	if (s->collisions != 0) {
-		atomic_add_64(&ifp->if_data.ifi_collisions, s->collisions);
+		IFNET_STAT_ADD(ifp, ifi_collisions, s->collisions);
 		s->collisions = 0;
 	}
 	if (s->dropped != 0) {
-		atomic_add_64(&ifp->if_data.ifi_iqdrops, s->dropped);
+		IFNET_STAT_ADD(ifp, ifi_iqdrops, s->dropped);
 		s->dropped = 0;
 	}
 
@@ -8781,6 +8933,7 @@ ifnet_attach(ifnet_t ifp, const struct sockaddr_dl *ll_addr)
 	/* Clear stats (save and restore other fields that we care) */
 	if_data_saved = ifp->if_data;
 	bzero(&ifp->if_data, sizeof(ifp->if_data));
+	ifnet_pcpu_stats_reset(ifp);
 	ifp->if_data.ifi_type = if_data_saved.ifi_type;
 	ifp->if_data.ifi_typelen = if_data_saved.ifi_typelen;
 	ifp->if_data.ifi_physical = if_data_saved.ifi_physical;
@@ -10179,6 +10332,7 @@ dlil_if_acquire(u_int32_t family, const void *uniqueid,
 		/* This probably shouldn't be fatal */
 		ret = 0;
 	}
+	ifnet_pcpu_stats_alloc(ifp1);
 
 	lck_mtx_init(&dlifp1->dl_if_lock, &ifnet_lock_group, &ifnet_lock_attr);
 	lck_rw_init(&ifp1->if_lock, &ifnet_lock_group, &ifnet_lock_attr);
@@ -12264,7 +12418,8 @@ dlil_dt_tcall_fn(thread_call_param_t arg0, thread_call_param_t arg1)
 void
 ifnet_notify_data_threshold(struct ifnet *ifp)
 {
-	uint64_t bytes = (ifp->if_ibytes + ifp->if_obytes);
+	uint64_t bytes = (IFNET_STAT_LOAD(ifp, ifi_ibytes) +
+	    IFNET_STAT_LOAD(ifp, ifi_obytes));
 	uint64_t oldbytes = ifp->if_dt_bytes;
 
 	ASSERT(ifp->if_dt_tcall != NULL);
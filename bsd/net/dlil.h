@@ -343,6 +343,7 @@ extern errno_t dlil_rxpoll_validate_params(struct ifnet_poll_params *);
 extern void dlil_rxpoll_update_params(struct ifnet *,
     struct ifnet_poll_params *);
 extern void ifnet_poll(struct ifnet *);
+extern u_int32_t ifnet_busy_poll(struct ifnet *, u_int32_t);
 extern errno_t ifnet_input_poll(struct ifnet *, struct mbuf *,
     struct mbuf *, const struct ifnet_stat_increment_param *);
 
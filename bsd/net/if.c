@@ -68,6 +68,7 @@
  */
 
 #include <kern/locks.h>
+#include <kern/smr.h>
 
 #include <sys/param.h>
 #include <sys/malloc.h>
@@ -431,6 +432,27 @@ if_detach_ifa_common(struct ifnet *ifp, struct ifaddr *ifa, int link)
 
 #define INITIAL_IF_INDEXLIM     8
 
+static int if_indexlim;
+
+/*
+ * The tables replaced by if_next_index() are retired through the global
+ * SMR domain so that ifnet_byindex_smr() can index ifindex2ifnet[]
+ * without the ifnet head lock.
+ */
+struct if_index_tables {
+	caddr_t        *iit_addrs;
+	size_t          iit_count;
+};
+
+static void
+if_index_tables_free(void *arg)
+{
+	struct if_index_tables *iit = arg;
+
+	kfree_type(caddr_t, iit->iit_count, iit->iit_addrs);
+	kfree_type(struct if_index_tables, iit);
+}
+
 /*
  * Function: if_next_index
  * Purpose:
@@ -449,7 +471,6 @@ int if_next_index(void);
 __private_extern__ int
 if_next_index(void)
 {
-	static int      if_indexlim = 0;
 	int             new_index;
 
 	new_index = ++if_index;
@@ -484,20 +505,56 @@ if_next_index(void)
 			bcopy(ifindex2ifnet, new_ifindex2ifnet, (if_indexlim + 1) * sizeof(caddr_t));
 		}
 
-		/* switch to the new tables and size */
+		/*
+		 * Switch to the new tables and size.  The table is published
+		 * before the limit, so that a lockless reader that observes
+		 * the new limit also observes the table that can hold it.
+		 */
 		ifnet_addrs = (struct ifaddr **)(void *)new_ifnet_addrs;
-		ifindex2ifnet = (struct ifnet **)(void *)new_ifindex2ifnet;
-		if_indexlim = new_if_indexlim;
+		os_atomic_store(&ifindex2ifnet,
+		    (struct ifnet **)(void *)new_ifindex2ifnet, release);
+		os_atomic_store(&if_indexlim, new_if_indexlim, release);
 
-		/* release the old data */
+		/* release the old data once lockless readers are done with it */
 		if (old_ifnet_addrs != NULL) {
-			void *old_ifnet_addrs_p = (void *)old_ifnet_addrs;
-			kfree_type(caddr_t, old_ifnet_size, old_ifnet_addrs_p);
+			struct if_index_tables *iit;
+
+			iit = kalloc_type(struct if_index_tables,
+			    Z_WAITOK | Z_NOFAIL);
+			iit->iit_addrs = (caddr_t *)(void *)old_ifnet_addrs;
+			iit->iit_count = old_ifnet_size;
+			smr_global_retire(iit, old_ifnet_size * sizeof(caddr_t),
+			    if_index_tables_free);
 		}
 	}
 	return new_index;
 }
 
+/*
+ * Look up an interface by index without taking the ifnet head lock.
+ *
+ * ifnets are never freed, so the returned pointer remains valid after
+ * this returns; callers that need the interface to stay attached must
+ * still take an I/O reference on it.
+ */
+struct ifnet *
+ifnet_byindex_smr(unsigned int idx)
+{
+	struct ifnet **table;
+	struct ifnet *ifp = NULL;
+	int lim;
+
+	smr_global_enter();
+	lim = os_atomic_load(&if_indexlim, acquire);
+	if (idx != 0 && idx <= (unsigned int)lim) {
+		table = os_atomic_load(&ifindex2ifnet, dependency);
+		ifp = os_atomic_load(&table[idx], relaxed);
+	}
+	smr_global_leave();
+
+	return ifp;
+}
+
 /*
  * Create a clone network interface.
  */
@@ -5485,7 +5542,6 @@ __private_extern__ void
 if_data_internal_to_if_data(struct ifnet *ifp,
     const struct if_data_internal *if_data_int, struct if_data *if_data)
 {
-#pragma unused(ifp)
 #define COPYFIELD(fld)          if_data->fld = if_data_int->fld
 #define COPYFIELD32(fld)        if_data->fld = (u_int32_t)(if_data_int->fld)
 /* compiler will cast down to 32-bit */
@@ -5495,6 +5551,13 @@ if_data_internal_to_if_data(struct ifnet *ifp,
 	        (u_int64_t *)(void *)(uintptr_t)&if_data_int->fld);     \
 	if_data->fld = (uint32_t) _val;                                 \
 } while (0)
+#define COPYFIELD32_PCPU(fld) do {                                      \
+	u_int64_t _val = 0;                                             \
+	atomic_get_64(_val,                                             \
+	        (u_int64_t *)(void *)(uintptr_t)&if_data_int->fld);     \
+	_val += counter_load(&ifp->if_pcpu_stats.fld);                  \
+	if_data->fld = (uint32_t) _val;                                 \
+} while (0)
 
 	COPYFIELD(ifi_type);
 	COPYFIELD(ifi_typelen);
@@ -5512,16 +5575,16 @@ if_data_internal_to_if_data(struct ifnet *ifp,
 		COPYFIELD32(ifi_baudrate);
 	}
 
-	COPYFIELD32_ATOMIC(ifi_ipackets);
-	COPYFIELD32_ATOMIC(ifi_ierrors);
-	COPYFIELD32_ATOMIC(ifi_opackets);
-	COPYFIELD32_ATOMIC(ifi_oerrors);
-	COPYFIELD32_ATOMIC(ifi_collisions);
-	COPYFIELD32_ATOMIC(ifi_ibytes);
-	COPYFIELD32_ATOMIC(ifi_obytes);
+	COPYFIELD32_PCPU(ifi_ipackets);
+	COPYFIELD32_PCPU(ifi_ierrors);
+	COPYFIELD32_PCPU(ifi_opackets);
+	COPYFIELD32_PCPU(ifi_oerrors);
+	COPYFIELD32_PCPU(ifi_collisions);
+	COPYFIELD32_PCPU(ifi_ibytes);
+	COPYFIELD32_PCPU(ifi_obytes);
 	COPYFIELD32_ATOMIC(ifi_imcasts);
 	COPYFIELD32_ATOMIC(ifi_omcasts);
-	COPYFIELD32_ATOMIC(ifi_iqdrops);
+	COPYFIELD32_PCPU(ifi_iqdrops);
 	COPYFIELD32_ATOMIC(ifi_noproto);
 
 	COPYFIELD(ifi_recvtiming);
@@ -5536,6 +5599,7 @@ if_data_internal_to_if_data(struct ifnet *ifp,
 	COPYFIELD(ifi_hwassist);
 	if_data->ifi_reserved1 = 0;
 	if_data->ifi_reserved2 = 0;
+#undef COPYFIELD32_PCPU
 #undef COPYFIELD32_ATOMIC
 #undef COPYFIELD32
 #undef COPYFIELD
@@ -5546,12 +5610,15 @@ if_data_internal_to_if_data64(struct ifnet *ifp,
     const struct if_data_internal *if_data_int,
     struct if_data64 *if_data64)
 {
-#pragma unused(ifp)
 #define COPYFIELD64(fld)        if_data64->fld = if_data_int->fld
 #define COPYFIELD64_ATOMIC(fld) do {                                    \
 	atomic_get_64(if_data64->fld,                                   \
 	    (u_int64_t *)(void *)(uintptr_t)&if_data_int->fld);         \
 } while (0)
+#define COPYFIELD64_PCPU(fld) do {                                      \
+	COPYFIELD64_ATOMIC(fld);                                        \
+	if_data64->fld += counter_load(&ifp->if_pcpu_stats.fld);        \
+} while (0)
 
 	COPYFIELD64(ifi_type);
 	COPYFIELD64(ifi_typelen);
@@ -5565,16 +5632,16 @@ if_data_internal_to_if_data64(struct ifnet *ifp,
 	COPYFIELD64(ifi_metric);
 	COPYFIELD64(ifi_baudrate);
 
-	COPYFIELD64_ATOMIC(ifi_ipackets);
-	COPYFIELD64_ATOMIC(ifi_ierrors);
-	COPYFIELD64_ATOMIC(ifi_opackets);
-	COPYFIELD64_ATOMIC(ifi_oerrors);
-	COPYFIELD64_ATOMIC(ifi_collisions);
-	COPYFIELD64_ATOMIC(ifi_ibytes);
-	COPYFIELD64_ATOMIC(ifi_obytes);
+	COPYFIELD64_PCPU(ifi_ipackets);
+	COPYFIELD64_PCPU(ifi_ierrors);
+	COPYFIELD64_PCPU(ifi_opackets);
+	COPYFIELD64_PCPU(ifi_oerrors);
+	COPYFIELD64_PCPU(ifi_collisions);
+	COPYFIELD64_PCPU(ifi_ibytes);
+	COPYFIELD64_PCPU(ifi_obytes);
 	COPYFIELD64_ATOMIC(ifi_imcasts);
 	COPYFIELD64_ATOMIC(ifi_omcasts);
-	COPYFIELD64_ATOMIC(ifi_iqdrops);
+	COPYFIELD64_PCPU(ifi_iqdrops);
 	COPYFIELD64_ATOMIC(ifi_noproto);
 
 	/*
@@ -5589,6 +5656,8 @@ if_data_internal_to_if_data64(struct ifnet *ifp,
 
 	if_data64->ifi_lastchange.tv_sec += (uint32_t)boottime_sec();
 
+#undef COPYFIELD64_PCPU
+#undef COPYFIELD64_ATOMIC
 #undef COPYFIELD64
 }
 
@@ -69,6 +69,7 @@
 #include <sys/protosw.h>
 #include <kern/locks.h>
 #include <kern/zalloc.h>
+#include <kern/smr.h>
 #include <os/refcnt.h>
 
 #include <netinet/in.h>
@@ -167,6 +168,16 @@ struct LAG_s {
 };
 typedef struct LAG_s LAG, * LAG_ref;
 
+/*
+ * Snapshot of the distributing ports for the transmit path, which reads
+ * it in an SMR section instead of taking the bond lock.  It's replaced,
+ * under the bond lock, whenever the set of distributing ports changes.
+ */
+struct bond_dist {
+	int                         bd_count;
+	struct ifnet *              bd_ifp[];
+};
+
 typedef struct partner_state_s {
 	LAG_info                    ps_lag_info;
 	lacp_port                   ps_port;
@@ -193,6 +204,7 @@ struct ifbond_s {
 	bondport_ref *              ifb_distributing_array;
 	int                         ifb_distributing_count;
 	int                         ifb_distributing_max;
+	struct bond_dist *          ifb_dist;
 	int                         ifb_last_link_event;
 	int                         ifb_mode;/* LACP, STATIC */
 };
@@ -699,6 +711,14 @@ ether_addr_copy(void * dest, const void * source)
 	return;
 }
 
+static void
+bond_dist_free(void * arg)
+{
+	struct bond_dist *  dist = arg;
+
+	kfree_type(struct bond_dist, struct ifnet *, dist->bd_count, dist);
+}
+
 static __inline__ void
 ifbond_retain(ifbond_ref ifb)
 {
@@ -726,6 +746,9 @@ ifbond_release(ifbond_ref ifb)
 	}
 	kfree_type(bondport_ref, ifb->ifb_distributing_max,
 	    ifb->ifb_distributing_array);
+	if (ifb->ifb_dist != NULL) {
+		bond_dist_free(ifb->ifb_dist);
+	}
 	if_clone_softc_deallocate(&bond_cloner, ifb);
 }
 
@@ -1217,6 +1240,8 @@ bond_clone_create(struct if_clone * ifc, u_int32_t unit, __unused void *params)
 
 	ifb->ifb_ifp = ifp;
 	ifnet_set_offload(ifp, 0);
+	/* bond_output() sorts packet lists into per-port chains */
+	ifnet_set_eflags(ifp, IFEF_SENDLIST, IFEF_SENDLIST);
 	ifnet_set_addrlen(ifp, ETHER_ADDR_LEN); /* XXX ethernet specific */
 	ifnet_set_flags(ifp, IFF_BROADCAST | IFF_MULTICAST | IFF_SIMPLEX, 0xffff);
 	ifnet_set_mtu(ifp, ETHERMTU);
@@ -1512,60 +1537,30 @@ bad_ipv6_packet:
 	return ether_header_hash(mtod(orig_m, struct ether_header *));
 }
 
-static int
-bond_output(struct ifnet * ifp, struct mbuf * m)
+static uint32_t
+bond_packet_hash(struct mbuf * m)
 {
-	bpf_packet_func             bpf_func;
-	uint32_t                    h;
-	ifbond_ref                  ifb;
-	struct ifnet *              port_ifp = NULL;
-	int                         err;
-	struct flowadv              adv = { .code = FADV_SUCCESS };
+	struct ether_header *   eh_p;
 
-	if (m == 0) {
-		return 0;
-	}
-	if ((m->m_flags & M_PKTHDR) == 0) {
-		m_freem(m);
-		return 0;
-	}
 	if (m->m_pkthdr.pkt_flowid != 0) {
-		h = m->m_pkthdr.pkt_flowid;
-	} else {
-		struct ether_header *   eh_p;
-
-		eh_p = mtod(m, struct ether_header *);
-		switch (ntohs(eh_p->ether_type)) {
-		case ETHERTYPE_IP:
-			h = ip_header_hash(m);
-			break;
-		case ETHERTYPE_IPV6:
-			h = ipv6_header_hash(m);
-			break;
-		default:
-			h = ether_header_hash(eh_p);
-			break;
-		}
-	}
-	bond_lock();
-	ifb = ifnet_softc(ifp);
-	if (ifb == NULL || ifbond_flags_if_detaching(ifb)
-	    || ifb->ifb_distributing_count == 0) {
-		goto done;
+		return m->m_pkthdr.pkt_flowid;
+	}
+	eh_p = mtod(m, struct ether_header *);
+	switch (ntohs(eh_p->ether_type)) {
+	case ETHERTYPE_IP:
+		return ip_header_hash(m);
+	case ETHERTYPE_IPV6:
+		return ipv6_header_hash(m);
+	default:
+		return ether_header_hash(eh_p);
 	}
-	h %= ifb->ifb_distributing_count;
-	port_ifp = ifb->ifb_distributing_array[h]->po_ifp;
-	bpf_func = ifb->ifb_bpf_output;
-	bond_unlock();
+}
 
-	if (m->m_pkthdr.csum_flags & CSUM_VLAN_TAG_VALID) {
-		(void)ifnet_stat_increment_out(ifp, 1,
-		    m->m_pkthdr.len + ETHER_VLAN_ENCAP_LEN,
-		    0);
-	} else {
-		(void)ifnet_stat_increment_out(ifp, 1, m->m_pkthdr.len, 0);
-	}
-	bond_bpf_output(ifp, m, bpf_func);
+static int
+bond_output_port(struct ifnet * port_ifp, struct mbuf * m)
+{
+	int                         err;
+	struct flowadv              adv = { .code = FADV_SUCCESS };
 
 	err = dlil_output(port_ifp, PF_BOND, m, NULL, NULL, 1, &adv);
 
@@ -1576,13 +1571,82 @@ bond_output(struct ifnet * ifp, struct mbuf * m)
 			err = EQSUSPENDED;
 		}
 	}
-
 	return err;
+}
 
-done:
-	bond_unlock();
-	m_freem(m);
-	return 0;
+/*
+ * Called with a list of packets.  Each one goes to the distributing port
+ * its flow hashes to, looked up without the bond lock; consecutive packets
+ * for the same port are handed to it as one list.
+ */
+static int
+bond_output(struct ifnet * ifp, struct mbuf * m)
+{
+	bpf_packet_func             bpf_func;
+	struct bond_dist *          dist;
+	uint32_t                    h;
+	ifbond_ref                  ifb;
+	struct ifnet *              port_ifp;
+	struct ifnet *              run_ifp = NULL;
+	struct mbuf *               next;
+	struct mbuf *               run = NULL;
+	struct mbuf **              run_tail = &run;
+	int                         err = 0;
+	int                         error;
+
+	ifb = ifnet_softc(ifp);
+	bpf_func = (ifb != NULL) ? ifb->ifb_bpf_output : NULL;
+	for (; m != NULL; m = next) {
+		next = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+		if ((m->m_flags & M_PKTHDR) == 0) {
+			m_freem(m);
+			continue;
+		}
+		h = bond_packet_hash(m);
+
+		port_ifp = NULL;
+		smr_global_enter();
+		dist = (ifb != NULL)
+		    ? os_atomic_load(&ifb->ifb_dist, dependency) : NULL;
+		if (dist != NULL) {
+			port_ifp = dist->bd_ifp[h % dist->bd_count];
+		}
+		smr_global_leave();
+		if (port_ifp == NULL) {
+			m_freem(m);
+			continue;
+		}
+
+		if (run != NULL && port_ifp != run_ifp) {
+			error = bond_output_port(run_ifp, run);
+			if (err == 0) {
+				err = error;
+			}
+			run = NULL;
+			run_tail = &run;
+		}
+
+		if (m->m_pkthdr.csum_flags & CSUM_VLAN_TAG_VALID) {
+			(void)ifnet_stat_increment_out(ifp, 1,
+			    m->m_pkthdr.len + ETHER_VLAN_ENCAP_LEN,
+			    0);
+		} else {
+			(void)ifnet_stat_increment_out(ifp, 1, m->m_pkthdr.len, 0);
+		}
+		bond_bpf_output(ifp, m, bpf_func);
+
+		run_ifp = port_ifp;
+		*run_tail = m;
+		run_tail = &m->m_nextpkt;
+	}
+	if (run != NULL) {
+		error = bond_output_port(run_ifp, run);
+		if (err == 0) {
+			err = error;
+		}
+	}
+	return err;
 }
 
 static bondport_ref
@@ -4211,6 +4275,38 @@ bondport_DetachMuxFromAggregator(bondport_ref p)
 	return;
 }
 
+/*
+ * Publish the current distributing ports to bond_output().  A failure to
+ * allocate the new snapshot leaves the transmit path without ports until
+ * the next change, like an empty aggregation.
+ */
+static void
+ifbond_update_dist(ifbond_ref ifb)
+{
+	struct bond_dist *  dist = NULL;
+	struct bond_dist *  old;
+	int                 i;
+
+	bond_assert_lock_held();
+
+	if (ifb->ifb_distributing_count != 0) {
+		dist = kalloc_type(struct bond_dist, struct ifnet *,
+		    ifb->ifb_distributing_count, Z_WAITOK | Z_ZERO);
+	}
+	if (dist != NULL) {
+		dist->bd_count = ifb->ifb_distributing_count;
+		for (i = 0; i < dist->bd_count; i++) {
+			dist->bd_ifp[i] = ifb->ifb_distributing_array[i]->po_ifp;
+		}
+	}
+	old = ifb->ifb_dist;
+	os_atomic_store(&ifb->ifb_dist, dist, release);
+	if (old != NULL) {
+		smr_global_retire(old, sizeof(*old) +
+		    old->bd_count * sizeof(old->bd_ifp[0]), bond_dist_free);
+	}
+}
+
 static void
 bondport_enable_distributing(bondport_ref p)
 {
@@ -4218,6 +4314,7 @@ bondport_enable_distributing(bondport_ref p)
 		ifbond_ref      bond = p->po_bond;
 
 		bond->ifb_distributing_array[bond->ifb_distributing_count++] = p;
+		ifbond_update_dist(bond);
 		if (if_bond_debug) {
 			timestamp_printf("[%s] Distribution Enabled\n",
 			    bondport_get_name(p));
@@ -4250,6 +4347,7 @@ bondport_disable_distributing(bondport_ref p)
 			}
 		}
 		bond->ifb_distributing_count--;
+		ifbond_update_dist(bond);
 		if (if_bond_debug) {
 			timestamp_printf("[%s] Distribution Disabled\n",
 			    bondport_get_name(p));
@@ -128,6 +128,7 @@
 #include <libkern/libkern.h>
 
 #include <kern/zalloc.h>
+#include <kern/smr.h>
 
 #if NBPFILTER > 0
 #include <net/bpf.h>
@@ -308,7 +309,12 @@ static int if_bridge_log_level = LOG_NOTICE;
  */
 #define BRIDGE_RTHASH_SIZE_MAX          2048
 
-#define BRIDGE_RTHASH_MASK(sc)          ((sc)->sc_rthash_size - 1)
+#define BRIDGE_RTHASH_MASK(rth)         ((rth)->brh_size - 1)
+
+/*
+ * Number of retired route nodes that triggers an early reclaim pass.
+ */
+#define BRIDGE_RTRETIRE_BATCH           64
 
 /*
  * Maximum number of addresses to cache.
@@ -473,10 +479,12 @@ struct mac_nat_record {
  * Bridge route node.
  */
 struct bridge_rtnode {
-	LIST_ENTRY(bridge_rtnode) brt_hash;     /* hash table linkage */
+	struct bridge_rtnode    *brt_hnext[2];  /* hash chains, per table slot */
 	LIST_ENTRY(bridge_rtnode) brt_list;     /* list linkage */
 	struct bridge_iflist    *brt_dst;       /* destination if */
+	struct ifnet            *brt_difp;      /* brt_dst's ifp for SMR readers */
 	unsigned long           brt_expire;     /* expiration time */
+	smr_seq_t               brt_free_seq;   /* free once readers are past */
 	uint8_t                 brt_flags;      /* address flags */
 	uint8_t                 brt_addr[ETHER_ADDR_LEN];
 	uint16_t                brt_vlan;       /* vlan id */
@@ -484,6 +492,21 @@ struct bridge_rtnode {
 };
 #define brt_ifp                 brt_dst->bif_ifp
 
+/*
+ * Bridge forwarding hash table.
+ *
+ * The output path looks addresses up in an SMR read section without the
+ * bridge lock; changes are made with the lock held.  Each node carries a
+ * chain link per slot so that a resize can thread the new table through
+ * the other slot while readers may still walk the old chains.
+ */
+struct bridge_rthash {
+	uint32_t                brh_size;       /* number of buckets */
+	uint32_t                brh_key;        /* key for hash */
+	uint8_t                 brh_slot;       /* brt_hnext[] used by chains */
+	struct bridge_rtnode    *brh_bucket[];
+};
+
 /*
  * Bridge delayed function call context
  */
@@ -510,10 +533,10 @@ struct bridge_softc {
 	u_int32_t               sc_flags;
 	LIST_ENTRY(bridge_softc) sc_list;
 	decl_lck_mtx_data(, sc_mtx);
-	struct _bridge_rtnode_list *sc_rthash;  /* our forwarding table */
+	struct bridge_rthash    *sc_rthash;     /* our forwarding table */
 	struct _bridge_rtnode_list sc_rtlist;   /* list version of above */
-	uint32_t                sc_rthash_key;  /* key for hash */
-	uint32_t                sc_rthash_size; /* size of the hash table */
+	struct _bridge_rtnode_list sc_rtretire; /* removed, awaiting readers */
+	uint32_t                sc_rtretire_cnt; /* # of retired nodes */
 	struct bridge_delayed_call sc_aging_timer;
 	struct bridge_delayed_call sc_resize_call;
 	TAILQ_HEAD(, bridge_iflist) sc_spanlist;        /* span ports list */
@@ -592,6 +615,7 @@ static int      bridge_rtable_prune_period = BRIDGE_RTABLE_PRUNE_PERIOD;
 
 static ZONE_DEFINE(bridge_rtnode_pool, "bridge_rtnode",
     sizeof(struct bridge_rtnode), ZC_NONE);
+static SMR_DEFINE(bridge_rt_smr);
 static ZONE_DEFINE(bridge_mne_pool, "bridge_mac_nat_entry",
     sizeof(struct mac_nat_entry), ZC_NONE);
 
@@ -639,6 +663,8 @@ static int      bridge_rtupdate(struct bridge_softc *, const uint8_t *,
     uint16_t, struct bridge_iflist *, int, uint8_t);
 static struct ifnet *bridge_rtlookup(struct bridge_softc *, const uint8_t *,
     uint16_t);
+static struct ifnet *bridge_rtlookup_smr(struct bridge_softc *,
+    const uint8_t *, uint16_t);
 static void     bridge_rttrim(struct bridge_softc *);
 static void     bridge_rtage(struct bridge_softc *);
 static void     bridge_rtflush(struct bridge_softc *, int);
@@ -651,14 +677,17 @@ static void     bridge_rtable_fini(struct bridge_softc *);
 static void     bridge_rthash_resize(struct bridge_softc *);
 
 static int      bridge_rtnode_addr_cmp(const uint8_t *, const uint8_t *);
+static struct bridge_rtnode *bridge_rthash_lookup(struct bridge_rthash *,
+    const uint8_t *, uint16_t);
 static struct bridge_rtnode *bridge_rtnode_lookup(struct bridge_softc *,
     const uint8_t *, uint16_t);
 static int      bridge_rtnode_hash(struct bridge_softc *,
-    struct bridge_rtnode *);
+    struct bridge_rthash *, struct bridge_rtnode *);
 static int      bridge_rtnode_insert(struct bridge_softc *,
     struct bridge_rtnode *);
 static void     bridge_rtnode_destroy(struct bridge_softc *,
     struct bridge_rtnode *);
+static void     bridge_rtnode_reclaim(struct bridge_softc *, boolean_t);
 #if BRIDGESTP
 static void     bridge_rtable_expire(struct ifnet *, int);
 static void     bridge_state_change(struct ifnet *, int);
@@ -1092,6 +1121,11 @@ static int if_bridge_txstart = 0;
 SYSCTL_INT(_net_link_bridge, OID_AUTO, txstart, CTLFLAG_RW | CTLFLAG_LOCKED,
     &if_bridge_txstart, 0, "Bridge interface uses TXSTART model");
 
+static unsigned int if_bridge_start_batch = 32;
+SYSCTL_UINT(_net_link_bridge, OID_AUTO, start_batch,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &if_bridge_start_batch, 0,
+    "Packets dequeued at once by the TXSTART model");
+
 SYSCTL_INT(_net_link_bridge, OID_AUTO, debug, CTLFLAG_RW | CTLFLAG_LOCKED,
     &if_bridge_debug, 0, "Bridge debug flags");
 
@@ -4987,6 +5021,7 @@ bridge_enqueue(ifnet_t bridge_ifp, struct ifnet *src_ifp,
 	 * NOTE: bridge_fragment() is called only when PFIL_HOOKS is enabled.
 	 */
 	for (struct mbuf *next_m = NULL; m != NULL; m = next_m) {
+		ChecksumOperation op = cksum_op;
 		bool            need_sw_tso = false;
 		bool            is_ipv4 = false;
 		bool            is_large_pkt;
@@ -5014,7 +5049,7 @@ bridge_enqueue(ifnet_t bridge_ifp, struct ifnet *src_ifp,
 				    dst_ifp, sizeof(struct ether_header),
 				    &need_sw_tso, &is_large_tcp);
 				if (is_large_tcp) {
-					cksum_op = CHECKSUM_OPERATION_NONE;
+					op = CHECKSUM_OPERATION_NONE;
 				}
 			} else {
 				BRIDGE_LOG(LOG_DEBUG, BR_DBGF_CHECKSUM,
@@ -5032,8 +5067,8 @@ bridge_enqueue(ifnet_t bridge_ifp, struct ifnet *src_ifp,
 			    "%s bridge_send(%s) len %d op %d",
 			    bridge_ifp->if_xname,
 			    dst_ifp->if_xname,
-			    len, cksum_op);
-			_error = bridge_send(src_ifp, dst_ifp, m, cksum_op);
+			    len, op);
+			_error = bridge_send(src_ifp, dst_ifp, m, op);
 		}
 
 		/* Preserve first error value */
@@ -5279,20 +5314,17 @@ sendunicast:
  * This routine is called externally from above only when if_bridge_txstart
  * is disabled; otherwise it is called internally by bridge_start().
  */
-static int
-bridge_output(struct ifnet *ifp, struct mbuf *m)
+static struct ifnet *
+bridge_output_prepare(struct ifnet *ifp, struct mbuf *m)
 {
 	struct bridge_softc *sc = ifnet_softc(ifp);
 	struct ether_header *eh;
 	struct ifnet *dst_if = NULL;
-	int error = 0;
-
-	eh = mtod(m, struct ether_header *);
-
-	BRIDGE_LOCK(sc);
 
+	/* Known unicast destinations don't need the bridge lock */
 	if (!(m->m_flags & (M_BCAST | M_MCAST))) {
-		dst_if = bridge_rtlookup(sc, eh->ether_dhost, 0);
+		eh = mtod(m, struct ether_header *);
+		dst_if = bridge_rtlookup_smr(sc, eh->ether_dhost, 0);
 	}
 
 	(void) ifnet_stat_increment_out(ifp, 1, m->m_pkthdr.len, 0);
@@ -5303,16 +5335,23 @@ bridge_output(struct ifnet *ifp, struct mbuf *m)
 	}
 #endif
 
+	return dst_if;
+}
+
+static int
+bridge_output(struct ifnet *ifp, struct mbuf *m)
+{
+	struct bridge_softc *sc = ifnet_softc(ifp);
+	struct ifnet *dst_if;
+	int error = 0;
+
+	dst_if = bridge_output_prepare(ifp, m);
 	if (dst_if == NULL) {
+		BRIDGE_LOCK(sc);
 		/* callee will unlock */
 		bridge_broadcast(sc, NULL, m, 0);
 	} else {
-		ifnet_t bridge_ifp;
-
-		bridge_ifp = sc->sc_ifp;
-		BRIDGE_UNLOCK(sc);
-
-		error = bridge_enqueue(bridge_ifp, NULL, dst_if, m,
+		error = bridge_enqueue(sc->sc_ifp, NULL, dst_if, m,
 		    CHECKSUM_OPERATION_FINALIZE);
 	}
 
@@ -5398,14 +5437,48 @@ bridge_finalize_cksum(struct ifnet *ifp, struct mbuf *m)
 static void
 bridge_start(struct ifnet *ifp)
 {
-	struct mbuf *m;
+	struct bridge_softc *sc = ifnet_softc(ifp);
+	struct mbuf *m, *m_head, *m_tail, *run = NULL, **runp = &run;
+	struct ifnet *dst_if, *run_if = NULL;
+	u_int32_t cnt, len;
 
 	for (;;) {
-		if (ifnet_dequeue(ifp, &m) != 0) {
+		if (ifnet_dequeue_multi(ifp, MAX(if_bridge_start_batch, 1),
+		    &m_head, &m_tail, &cnt, &len) != 0) {
 			break;
 		}
 
-		(void) bridge_output(ifp, m);
+		/*
+		 * Consecutive unicast packets for the same member go to
+		 * bridge_enqueue() as one chain.
+		 */
+		while ((m = m_head) != NULL) {
+			m_head = m->m_nextpkt;
+			m->m_nextpkt = NULL;
+
+			dst_if = bridge_output_prepare(ifp, m);
+			if (run != NULL && dst_if != run_if) {
+				(void) bridge_enqueue(ifp, NULL, run_if, run,
+				    CHECKSUM_OPERATION_FINALIZE);
+				run = NULL;
+				runp = &run;
+			}
+			if (dst_if == NULL) {
+				BRIDGE_LOCK(sc);
+				/* callee will unlock */
+				bridge_broadcast(sc, NULL, m, 0);
+				continue;
+			}
+			run_if = dst_if;
+			*runp = m;
+			runp = &m->m_nextpkt;
+		}
+		if (run != NULL) {
+			(void) bridge_enqueue(ifp, NULL, run_if, run,
+			    CHECKSUM_OPERATION_FINALIZE);
+			run = NULL;
+			runp = &run;
+		}
 	}
 }
 
@@ -6586,32 +6659,41 @@ bridge_rtupdate(struct bridge_softc *sc, const uint8_t *dst, uint16_t vlan,
 		brt->brt_vlan = vlan;
 
 
+		brt->brt_dst = bif;
+		brt->brt_difp = bif->bif_ifp;
 		if ((error = bridge_rtnode_insert(sc, brt)) != 0) {
 			zfree(bridge_rtnode_pool, brt);
 			return error;
 		}
-		brt->brt_dst = bif;
 		bif->bif_addrcnt++;
 		BRIDGE_LOG(LOG_DEBUG, BR_DBGF_RT_TABLE,
 		    "added %02x:%02x:%02x:%02x:%02x:%02x "
 		    "on %s count %u hashsize %u",
 		    dst[0], dst[1], dst[2], dst[3], dst[4], dst[5],
 		    sc->sc_ifp->if_xname, sc->sc_brtcnt,
-		    sc->sc_rthash_size);
+		    sc->sc_rthash->brh_size);
 	}
 
 	if ((brt->brt_flags & IFBAF_TYPEMASK) == IFBAF_DYNAMIC &&
 	    brt->brt_dst != bif) {
 		brt->brt_dst->bif_addrcnt--;
 		brt->brt_dst = bif;
+		os_atomic_store(&brt->brt_difp, bif->bif_ifp, relaxed);
 		brt->brt_dst->bif_addrcnt++;
 	}
 
 	if ((flags & IFBAF_TYPEMASK) == IFBAF_DYNAMIC) {
-		unsigned long now;
+		unsigned long expire;
 
-		now = (unsigned long) net_uptime();
-		brt->brt_expire = now + sc->sc_brttimeout;
+		/*
+		 * Every frame from a host refreshes its entry; only store
+		 * when the value changes so that CPUs forwarding for the
+		 * same host don't keep pulling the line away from readers.
+		 */
+		expire = (unsigned long) net_uptime() + sc->sc_brttimeout;
+		if (brt->brt_expire != expire) {
+			brt->brt_expire = expire;
+		}
 	}
 	if (setflags) {
 		brt->brt_flags = flags;
@@ -6640,6 +6722,33 @@ bridge_rtlookup(struct bridge_softc *sc, const uint8_t *addr, uint16_t vlan)
 	return brt->brt_ifp;
 }
 
+/*
+ * bridge_rtlookup_smr:
+ *
+ *	Lookup the destination interface for an address without taking
+ *	the bridge lock.  As with bridge_rtlookup() once the lock is
+ *	dropped, the interface may leave the bridge while the caller
+ *	is using it.
+ */
+static struct ifnet *
+bridge_rtlookup_smr(struct bridge_softc *sc, const uint8_t *addr,
+    uint16_t vlan)
+{
+	struct bridge_rthash *rth;
+	struct bridge_rtnode *brt;
+	struct ifnet *ifp = NULL;
+
+	smr_enter(&bridge_rt_smr);
+	rth = os_atomic_load(&sc->sc_rthash, dependency);
+	if (rth != NULL &&
+	    (brt = bridge_rthash_lookup(rth, addr, vlan)) != NULL) {
+		ifp = os_atomic_load(&brt->brt_difp, relaxed);
+	}
+	smr_leave(&bridge_rt_smr);
+
+	return ifp;
+}
+
 /*
  * bridge_rttrim:
  *
@@ -6686,6 +6795,7 @@ bridge_aging_timer(struct bridge_softc *sc)
 	BRIDGE_LOCK_ASSERT_HELD(sc);
 
 	bridge_rtage(sc);
+	bridge_rtnode_reclaim(sc, FALSE);
 	if ((sc->sc_ifp->if_flags & IFF_RUNNING) &&
 	    (sc->sc_flags & SCF_DETACHING) == 0) {
 		sc->sc_aging_timer.bdc_sc = sc;
@@ -6786,6 +6896,27 @@ bridge_rtdelete(struct bridge_softc *sc, struct ifnet *ifp, int full)
 	}
 }
 
+static struct bridge_rthash *
+bridge_rthash_alloc(uint32_t size, zalloc_flags_t how)
+{
+	struct bridge_rthash *rth;
+
+	rth = kalloc_type(struct bridge_rthash, struct bridge_rtnode *, size,
+	    how | Z_ZERO);
+	if (rth != NULL) {
+		rth->brh_size = size;
+		rth->brh_key = RandomULong();
+	}
+	return rth;
+}
+
+static void
+bridge_rthash_free(struct bridge_rthash *rth)
+{
+	kfree_type(struct bridge_rthash, struct bridge_rtnode *, rth->brh_size,
+	    rth);
+}
+
 /*
  * bridge_rtable_init:
  *
@@ -6794,19 +6925,11 @@ bridge_rtdelete(struct bridge_softc *sc, struct ifnet *ifp, int full)
 static int
 bridge_rtable_init(struct bridge_softc *sc)
 {
-	u_int32_t i;
-
-	sc->sc_rthash = kalloc_type(struct _bridge_rtnode_list,
-	    BRIDGE_RTHASH_SIZE, Z_WAITOK_ZERO_NOFAIL);
-	sc->sc_rthash_size = BRIDGE_RTHASH_SIZE;
-
-	for (i = 0; i < sc->sc_rthash_size; i++) {
-		LIST_INIT(&sc->sc_rthash[i]);
-	}
-
-	sc->sc_rthash_key = RandomULong();
+	sc->sc_rthash = bridge_rthash_alloc(BRIDGE_RTHASH_SIZE,
+	    Z_WAITOK_ZERO_NOFAIL);
 
 	LIST_INIT(&sc->sc_rtlist);
+	LIST_INIT(&sc->sc_rtretire);
 
 	return 0;
 }
@@ -6820,10 +6943,8 @@ static void
 bridge_rthash_delayed_resize(struct bridge_softc *sc)
 {
 	u_int32_t new_rthash_size = 0;
-	u_int32_t old_rthash_size = 0;
-	struct _bridge_rtnode_list *new_rthash = NULL;
-	struct _bridge_rtnode_list *old_rthash = NULL;
-	u_int32_t i;
+	struct bridge_rthash *new_rthash = NULL;
+	struct bridge_rthash *old_rthash = NULL;
 	struct bridge_rtnode *brt;
 	int error = 0;
 
@@ -6832,7 +6953,7 @@ bridge_rthash_delayed_resize(struct bridge_softc *sc)
 	/*
 	 * Four entries per hash bucket is our ideal load factor
 	 */
-	if (sc->sc_brtcnt < sc->sc_rthash_size * 4) {
+	if (sc->sc_brtcnt < sc->sc_rthash->brh_size * 4) {
 		goto out;
 	}
 
@@ -6840,57 +6961,63 @@ bridge_rthash_delayed_resize(struct bridge_softc *sc)
 	 * Doubling the number of hash buckets may be too simplistic
 	 * especially when facing a spike of new entries
 	 */
-	new_rthash_size = sc->sc_rthash_size * 2;
+	new_rthash_size = sc->sc_rthash->brh_size * 2;
 
 	sc->sc_flags |= SCF_RESIZING;
 	BRIDGE_UNLOCK(sc);
 
-	new_rthash = kalloc_type(struct _bridge_rtnode_list, new_rthash_size,
-	    Z_WAITOK | Z_ZERO);
+	/*
+	 * Getting a new key with the new table forces entries to be
+	 * shuffled around to reduce the likelihood they will land in
+	 * the same buckets
+	 */
+	new_rthash = bridge_rthash_alloc(new_rthash_size, Z_WAITOK);
 
 	BRIDGE_LOCK(sc);
-	sc->sc_flags &= ~SCF_RESIZING;
 
 	if (new_rthash == NULL) {
+		sc->sc_flags &= ~SCF_RESIZING;
 		error = ENOMEM;
 		goto out;
 	}
 	if ((sc->sc_flags & SCF_DETACHING)) {
+		sc->sc_flags &= ~SCF_RESIZING;
 		error = ENODEV;
 		goto out;
 	}
 	/*
-	 * Fail safe from here on
+	 * Fail safe from here on.  The new chains go through the other
+	 * link slot, leaving the old ones intact for lookups in progress.
 	 */
 	old_rthash = sc->sc_rthash;
-	old_rthash_size = sc->sc_rthash_size;
-	sc->sc_rthash = new_rthash;
-	sc->sc_rthash_size = new_rthash_size;
+	new_rthash->brh_slot = old_rthash->brh_slot ^ 1;
+	LIST_FOREACH(brt, &sc->sc_rtlist, brt_list) {
+		(void) bridge_rtnode_hash(sc, new_rthash, brt);
+	}
+	os_atomic_store(&sc->sc_rthash, new_rthash, release);
 
 	/*
-	 * Get a new key to force entries to be shuffled around to reduce
-	 * the likelihood they will land in the same buckets
+	 * Wait for readers still walking the old chains before freeing
+	 * the old table; the next resize reuses their links.
 	 */
-	sc->sc_rthash_key = RandomULong();
-
-	for (i = 0; i < sc->sc_rthash_size; i++) {
-		LIST_INIT(&sc->sc_rthash[i]);
-	}
-
-	LIST_FOREACH(brt, &sc->sc_rtlist, brt_list) {
-		LIST_REMOVE(brt, brt_hash);
-		(void) bridge_rtnode_hash(sc, brt);
-	}
+	BRIDGE_UNLOCK(sc);
+	smr_synchronize(&bridge_rt_smr);
+	BRIDGE_LOCK(sc);
+	sc->sc_flags &= ~SCF_RESIZING;
 out:
 	if (error == 0) {
 		BRIDGE_LOG(LOG_DEBUG, BR_DBGF_RT_TABLE,
 		    "%s new size %u",
-		    sc->sc_ifp->if_xname, sc->sc_rthash_size);
-		kfree_type(struct _bridge_rtnode_list, old_rthash_size, old_rthash);
+		    sc->sc_ifp->if_xname, sc->sc_rthash->brh_size);
+		if (old_rthash != NULL) {
+			bridge_rthash_free(old_rthash);
+		}
 	} else {
 		BRIDGE_LOG(LOG_NOTICE, BR_DBGF_RT_TABLE,
 		    "%s failed %d", sc->sc_ifp->if_xname, error);
-		kfree_type(struct _bridge_rtnode_list, new_rthash_size, new_rthash);
+		if (new_rthash != NULL) {
+			bridge_rthash_free(new_rthash);
+		}
 	}
 }
 
@@ -6911,13 +7038,13 @@ bridge_rthash_resize(struct bridge_softc *sc)
 	/*
 	 * Four entries per hash bucket is our ideal load factor
 	 */
-	if (sc->sc_brtcnt < sc->sc_rthash_size * 4) {
+	if (sc->sc_brtcnt < sc->sc_rthash->brh_size * 4) {
 		return;
 	}
 	/*
 	 * Hard limit on the size of the routing hash table
 	 */
-	if (sc->sc_rthash_size >= bridge_rtable_hash_size_max) {
+	if (sc->sc_rthash->brh_size >= bridge_rtable_hash_size_max) {
 		return;
 	}
 
@@ -6936,10 +7063,10 @@ bridge_rtable_fini(struct bridge_softc *sc)
 {
 	KASSERT(sc->sc_brtcnt == 0,
 	    ("%s: %d bridge routes referenced", __func__, sc->sc_brtcnt));
-	kfree_type(struct _bridge_rtnode_list, sc->sc_rthash_size,
-	    sc->sc_rthash);
+	smr_synchronize(&bridge_rt_smr);
+	bridge_rtnode_reclaim(sc, TRUE);
+	bridge_rthash_free(sc->sc_rthash);
 	sc->sc_rthash = NULL;
-	sc->sc_rthash_size = 0;
 }
 
 /*
@@ -6960,9 +7087,9 @@ do {                                                                    \
 } while ( /*CONSTCOND*/ 0)
 
 static __inline uint32_t
-bridge_rthash(struct bridge_softc *sc, const uint8_t *addr)
+bridge_rthash(struct bridge_rthash *rth, const uint8_t *addr)
 {
-	uint32_t a = 0x9e3779b9, b = 0x9e3779b9, c = sc->sc_rthash_key;
+	uint32_t a = 0x9e3779b9, b = 0x9e3779b9, c = rth->brh_key;
 
 	b += addr[5] << 8;
 	b += addr[4];
@@ -6973,7 +7100,7 @@ bridge_rthash(struct bridge_softc *sc, const uint8_t *addr)
 
 	mix(a, b, c);
 
-	return c & BRIDGE_RTHASH_MASK(sc);
+	return c & BRIDGE_RTHASH_MASK(rth);
 }
 
 #undef mix
@@ -6991,23 +7118,24 @@ bridge_rtnode_addr_cmp(const uint8_t *a, const uint8_t *b)
 }
 
 /*
- * bridge_rtnode_lookup:
+ * bridge_rthash_lookup:
  *
- *	Look up a bridge route node for the specified destination. Compare the
- *	vlan id or if zero then just return the first match.
+ *	Look up a bridge route node in the specified table.  Compare the
+ *	vlan id or if zero then just return the first match.  Safe to use
+ *	with the bridge lock held or in an SMR read section.
  */
 static struct bridge_rtnode *
-bridge_rtnode_lookup(struct bridge_softc *sc, const uint8_t *addr,
+bridge_rthash_lookup(struct bridge_rthash *rth, const uint8_t *addr,
     uint16_t vlan)
 {
 	struct bridge_rtnode *brt;
-	uint32_t hash;
+	uint8_t slot = rth->brh_slot;
 	int dir;
 
-	BRIDGE_LOCK_ASSERT_HELD(sc);
-
-	hash = bridge_rthash(sc, addr);
-	LIST_FOREACH(brt, &sc->sc_rthash[hash], brt_hash) {
+	brt = os_atomic_load(&rth->brh_bucket[bridge_rthash(rth, addr)],
+	    dependency);
+	for (; brt != NULL;
+	    brt = os_atomic_load(&brt->brt_hnext[slot], dependency)) {
 		dir = bridge_rtnode_addr_cmp(addr, brt->brt_addr);
 		if (dir == 0 && (brt->brt_vlan == vlan || vlan == 0)) {
 			return brt;
@@ -7020,31 +7148,41 @@ bridge_rtnode_lookup(struct bridge_softc *sc, const uint8_t *addr,
 	return NULL;
 }
 
+/*
+ * bridge_rtnode_lookup:
+ *
+ *	Look up a bridge route node for the specified destination. Compare the
+ *	vlan id or if zero then just return the first match.
+ */
+static struct bridge_rtnode *
+bridge_rtnode_lookup(struct bridge_softc *sc, const uint8_t *addr,
+    uint16_t vlan)
+{
+	BRIDGE_LOCK_ASSERT_HELD(sc);
+
+	return bridge_rthash_lookup(sc->sc_rthash, addr, vlan);
+}
+
 /*
  * bridge_rtnode_hash:
  *
- *	Insert the specified bridge node into the route hash table.
+ *	Insert the specified bridge node into a route hash table.
  *	This is used when adding a new node or to rehash when resizing
- *	the hash table
+ *	the hash table.  The node is published last, fully linked, so
+ *	concurrent lookups never see a partial chain.
  */
 static int
-bridge_rtnode_hash(struct bridge_softc *sc, struct bridge_rtnode *brt)
+bridge_rtnode_hash(struct bridge_softc *sc, struct bridge_rthash *rth,
+    struct bridge_rtnode *brt)
 {
-	struct bridge_rtnode *lbrt;
-	uint32_t hash;
+	struct bridge_rtnode **prev, *lbrt;
+	uint8_t slot = rth->brh_slot;
 	int dir;
 
 	BRIDGE_LOCK_ASSERT_HELD(sc);
 
-	hash = bridge_rthash(sc, brt->brt_addr);
-
-	lbrt = LIST_FIRST(&sc->sc_rthash[hash]);
-	if (lbrt == NULL) {
-		LIST_INSERT_HEAD(&sc->sc_rthash[hash], brt, brt_hash);
-		goto out;
-	}
-
-	do {
+	prev = &rth->brh_bucket[bridge_rthash(rth, brt->brt_addr)];
+	for (; (lbrt = *prev) != NULL; prev = &lbrt->brt_hnext[slot]) {
 		dir = bridge_rtnode_addr_cmp(brt->brt_addr, lbrt->brt_addr);
 		if (dir == 0 && brt->brt_vlan == lbrt->brt_vlan) {
 			BRIDGE_LOG(LOG_DEBUG, BR_DBGF_RT_TABLE,
@@ -7056,25 +7194,38 @@ bridge_rtnode_hash(struct bridge_softc *sc, struct bridge_rtnode *brt)
 			return EEXIST;
 		}
 		if (dir > 0) {
-			LIST_INSERT_BEFORE(lbrt, brt, brt_hash);
-			goto out;
-		}
-		if (LIST_NEXT(lbrt, brt_hash) == NULL) {
-			LIST_INSERT_AFTER(lbrt, brt, brt_hash);
-			goto out;
+			break;
 		}
-		lbrt = LIST_NEXT(lbrt, brt_hash);
-	} while (lbrt != NULL);
+	}
+	brt->brt_hnext[slot] = lbrt;
+	os_atomic_store(prev, brt, release);
 
-	BRIDGE_LOG(LOG_DEBUG, BR_DBGF_RT_TABLE,
-	    "%s impossible %02x:%02x:%02x:%02x:%02x:%02x",
-	    sc->sc_ifp->if_xname,
-	    brt->brt_addr[0], brt->brt_addr[1], brt->brt_addr[2],
-	    brt->brt_addr[3], brt->brt_addr[4], brt->brt_addr[5]);
-out:
 	return 0;
 }
 
+/*
+ * bridge_rtnode_unhash:
+ *
+ *	Remove the specified bridge node from the current route hash
+ *	table.  Its own link is left alone for lookups standing on it.
+ */
+static void
+bridge_rtnode_unhash(struct bridge_softc *sc, struct bridge_rtnode *brt)
+{
+	struct bridge_rthash *rth = sc->sc_rthash;
+	struct bridge_rtnode **prev;
+	uint8_t slot = rth->brh_slot;
+
+	BRIDGE_LOCK_ASSERT_HELD(sc);
+
+	prev = &rth->brh_bucket[bridge_rthash(rth, brt->brt_addr)];
+	while (*prev != brt) {
+		VERIFY(*prev != NULL);
+		prev = &(*prev)->brt_hnext[slot];
+	}
+	os_atomic_store(prev, brt->brt_hnext[slot], relaxed);
+}
+
 /*
  * bridge_rtnode_insert:
  *
@@ -7086,7 +7237,7 @@ bridge_rtnode_insert(struct bridge_softc *sc, struct bridge_rtnode *brt)
 {
 	int error;
 
-	error = bridge_rtnode_hash(sc, brt);
+	error = bridge_rtnode_hash(sc, sc->sc_rthash, brt);
 	if (error != 0) {
 		return error;
 	}
@@ -7102,19 +7253,45 @@ bridge_rtnode_insert(struct bridge_softc *sc, struct bridge_rtnode *brt)
 /*
  * bridge_rtnode_destroy:
  *
- *	Destroy a bridge rtnode.
+ *	Destroy a bridge rtnode.  Lockless lookups may still hold it, so
+ *	it is only freed by bridge_rtnode_reclaim() once they are done.
  */
 static void
 bridge_rtnode_destroy(struct bridge_softc *sc, struct bridge_rtnode *brt)
 {
 	BRIDGE_LOCK_ASSERT_HELD(sc);
 
-	LIST_REMOVE(brt, brt_hash);
+	bridge_rtnode_unhash(sc, brt);
 
 	LIST_REMOVE(brt, brt_list);
 	sc->sc_brtcnt--;
 	brt->brt_dst->bif_addrcnt--;
-	zfree(bridge_rtnode_pool, brt);
+
+	brt->brt_free_seq = smr_advance(&bridge_rt_smr);
+	LIST_INSERT_HEAD(&sc->sc_rtretire, brt, brt_list);
+	if (++sc->sc_rtretire_cnt >= BRIDGE_RTRETIRE_BATCH) {
+		bridge_rtnode_reclaim(sc, FALSE);
+	}
+}
+
+/*
+ * bridge_rtnode_reclaim:
+ *
+ *	Free the destroyed rtnodes no lookup can be looking at anymore,
+ *	or all of them when forced by the caller.
+ */
+static void
+bridge_rtnode_reclaim(struct bridge_softc *sc, boolean_t all)
+{
+	struct bridge_rtnode *brt, *nbrt;
+
+	LIST_FOREACH_SAFE(brt, &sc->sc_rtretire, brt_list, nbrt) {
+		if (all || smr_poll(&bridge_rt_smr, brt->brt_free_seq)) {
+			LIST_REMOVE(brt, brt_list);
+			sc->sc_rtretire_cnt--;
+			zfree(bridge_rtnode_pool, brt);
+		}
+	}
 }
 
 #if BRIDGESTP
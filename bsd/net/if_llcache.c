@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Neighbor cache for the transmit fast path.
+ *
+ * The table is direct mapped: a neighbor hashes to exactly one slot, and
+ * filling a slot evicts whoever was there before.  Every slot carries a
+ * sequence count, odd while the slot is being written.  Readers copy the
+ * slot without any lock and retry nothing: if the count was odd or moved
+ * while they copied, it's a miss and the caller takes the locked path.
+ * Writers claim a slot by moving its count from even to odd, and simply
+ * give up if someone else holds it, since losing a fill costs one more
+ * locked lookup.  Slots are never freed, so readers can't touch freed
+ * memory.
+ *
+ * ARP and ND fill the cache while holding the lock of the route that
+ * carries the neighbor's llinfo.  They also invalidate it under that lock,
+ * whenever the link-layer address changes, expires or goes away, so a
+ * fill can't resurrect data an invalidation has just removed.  As a
+ * backstop, entries only live for llcache_ttl_ms.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/sysctl.h>
+#include <sys/socket.h>
+#include <sys/protosw.h>
+#include <kern/counter.h>
+#include <kern/zalloc.h>
+#include <libkern/os/hash.h>
+#include <net/if.h>
+#include <net/if_var.h>
+#include <net/if_dl.h>
+#include <net/if_llcache.h>
+#include <netinet/in.h>
+
+#define LLCACHE_SIZE_DEFAULT    4096
+
+struct llcache_entry {
+	uint32_t                lce_seq;
+	uint16_t                lce_ifindex;
+	uint8_t                 lce_family;
+	uint8_t                 lce_pad;
+	uint64_t                lce_expire;     /* net_uptime_ms() */
+	struct in6_addr         lce_addr;       /* in_addr in the first word */
+	struct sockaddr_dl      lce_sdl;
+};
+
+static TUNABLE(uint32_t, llcache_size, "llcache_size", LLCACHE_SIZE_DEFAULT);
+
+static struct llcache_entry *llcache_table;
+static uint32_t llcache_mask;   /* slot count - 1 */
+
+SYSCTL_DECL(_net_link_generic_system);
+SYSCTL_NODE(_net_link_generic_system, OID_AUTO, llcache,
+    CTLFLAG_RW | CTLFLAG_LOCKED, 0, "neighbor cache");
+
+static int llcache_enabled = 1;
+SYSCTL_INT(_net_link_generic_system_llcache, OID_AUTO, enable,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &llcache_enabled, 0,
+    "Resolve neighbors from the lock-free cache on transmit");
+
+static uint32_t llcache_ttl_ms = 1000;
+SYSCTL_UINT(_net_link_generic_system_llcache, OID_AUTO, ttl_ms,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &llcache_ttl_ms, 0,
+    "Lifetime of a cached neighbor in milliseconds");
+
+SYSCTL_UINT(_net_link_generic_system_llcache, OID_AUTO, mask,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &llcache_mask, 0,
+    "Neighbor cache slot mask");
+
+SCALABLE_COUNTER_DEFINE(llcache_hits);
+SCALABLE_COUNTER_DEFINE(llcache_misses);
+SYSCTL_SCALABLE_COUNTER(_net_link_generic_system_llcache, hits,
+    llcache_hits, "Neighbor cache hits");
+SYSCTL_SCALABLE_COUNTER(_net_link_generic_system_llcache, misses,
+    llcache_misses, "Neighbor cache misses");
+
+void
+llcache_init(void)
+{
+	uint32_t size = llcache_size;
+
+	if (llcache_table != NULL) {
+		return;
+	}
+
+	/* round down to a power of 2 */
+	if (size == 0) {
+		size = LLCACHE_SIZE_DEFAULT;
+	}
+	size = 1u << (31 - __builtin_clz(size));
+	llcache_mask = size - 1;
+	llcache_table = zalloc_permanent(size * sizeof(*llcache_table),
+	    ZALIGN(struct llcache_entry));
+}
+
+/*
+ * Extract the neighbor address; only AF_INET and AF_INET6 are cached.
+ */
+static boolean_t
+llcache_key(const struct sockaddr *sa, uint8_t *family, struct in6_addr *addr)
+{
+	bzero(addr, sizeof(*addr));
+	switch (sa->sa_family) {
+	case AF_INET:
+		bcopy(&((const struct sockaddr_in *)(const void *)sa)->sin_addr,
+		    addr, sizeof(struct in_addr));
+		break;
+	case AF_INET6:
+		bcopy(&((const struct sockaddr_in6 *)(const void *)sa)->sin6_addr,
+		    addr, sizeof(struct in6_addr));
+		/* the embedded scope is implied by the interface */
+		if (IN6_IS_SCOPE_EMBED(addr)) {
+			addr->s6_addr16[1] = 0;
+		}
+		break;
+	default:
+		return FALSE;
+	}
+	*family = sa->sa_family;
+	return TRUE;
+}
+
+static struct llcache_entry *
+llcache_slot(uint16_t ifindex, const struct in6_addr *addr)
+{
+	uint32_t h;
+
+	h = os_hash_jenkins_update(addr, sizeof(*addr), ifindex);
+	return &llcache_table[os_hash_jenkins_finish(h) & llcache_mask];
+}
+
+/*
+ * Copy the cached link-layer address of the neighbor sa on ifp into
+ * ll_dest; returns FALSE, leaving ll_dest alone, if there is none.
+ */
+boolean_t
+llcache_lookup(struct ifnet *ifp, const struct sockaddr *sa,
+    struct sockaddr_dl *ll_dest, size_t ll_dest_len)
+{
+	struct llcache_entry *lce;
+	struct sockaddr_dl sdl;
+	struct in6_addr addr;
+	uint8_t family;
+	uint32_t seq;
+	boolean_t match;
+
+	if (!llcache_enabled || llcache_table == NULL ||
+	    !llcache_key(sa, &family, &addr)) {
+		return FALSE;
+	}
+
+	lce = llcache_slot(ifp->if_index, &addr);
+	seq = os_atomic_load(&lce->lce_seq, acquire);
+	if (seq & 1) {
+		goto miss;
+	}
+	match = (lce->lce_ifindex == ifp->if_index &&
+	    lce->lce_family == family &&
+	    lce->lce_expire > net_uptime_ms() &&
+	    IN6_ARE_ADDR_EQUAL(&lce->lce_addr, &addr));
+	sdl = lce->lce_sdl;
+	/* pairs with the fence in llcache_claim() */
+	os_atomic_thread_fence(acquire);
+	if (!match || os_atomic_load(&lce->lce_seq, relaxed) != seq) {
+		goto miss;
+	}
+
+	bcopy(&sdl, ll_dest, MIN(sdl.sdl_len, ll_dest_len));
+	counter_inc(&llcache_hits);
+	return TRUE;
+
+miss:
+	counter_inc(&llcache_misses);
+	return FALSE;
+}
+
+static struct llcache_entry *
+llcache_claim(struct llcache_entry *lce, uint32_t *seqp)
+{
+	uint32_t seq = os_atomic_load(&lce->lce_seq, relaxed);
+
+	if ((seq & 1) ||
+	    !os_atomic_cmpxchg(&lce->lce_seq, seq, seq + 1, acquire)) {
+		return NULL;
+	}
+	/*
+	 * Order the odd count before the plain stores to the slot, which
+	 * the acquire above doesn't do: a reader that sees any of them
+	 * must then see the count move (see the fence in llcache_lookup).
+	 */
+	os_atomic_thread_fence(release);
+	*seqp = seq + 2;
+	return lce;
+}
+
+/*
+ * Remember sdl as the link-layer address of the neighbor sa on ifp, for
+ * no longer than expire_ms (net_uptime_ms() based; 0 for no limit other
+ * than the cache's own lifetime).  Called with the neighbor's route
+ * locked.
+ */
+void
+llcache_enter(struct ifnet *ifp, const struct sockaddr *sa,
+    const struct sockaddr_dl *sdl, uint64_t expire_ms)
+{
+	struct llcache_entry *lce;
+	struct in6_addr addr;
+	uint64_t deadline;
+	uint8_t family;
+	uint32_t seq;
+
+	if (!llcache_enabled || llcache_table == NULL ||
+	    sdl->sdl_family != AF_LINK || sdl->sdl_alen == 0 ||
+	    sdl->sdl_len > sizeof(struct sockaddr_dl) ||
+	    !llcache_key(sa, &family, &addr)) {
+		return;
+	}
+
+	deadline = net_uptime_ms() + llcache_ttl_ms;
+	if (expire_ms != 0) {
+		deadline = MIN(deadline, expire_ms);
+	}
+
+	lce = llcache_claim(llcache_slot(ifp->if_index, &addr), &seq);
+	if (lce == NULL) {
+		return;
+	}
+	lce->lce_ifindex = ifp->if_index;
+	lce->lce_family = family;
+	lce->lce_expire = deadline;
+	lce->lce_addr = addr;
+	bzero(&lce->lce_sdl, sizeof(lce->lce_sdl));
+	bcopy(sdl, &lce->lce_sdl, sdl->sdl_len);
+	os_atomic_store(&lce->lce_seq, seq, release);
+}
+
+/*
+ * Forget the neighbor sa on ifp.  Called with the neighbor's route
+ * locked, whenever its link-layer address changes or stops being usable.
+ */
+void
+llcache_invalidate(struct ifnet *ifp, const struct sockaddr *sa)
+{
+	struct llcache_entry *lce;
+	struct in6_addr addr;
+	uint8_t family;
+	uint32_t seq;
+
+	if (llcache_table == NULL || ifp == NULL ||
+	    !llcache_key(sa, &family, &addr)) {
+		return;
+	}
+
+	/*
+	 * A slot someone else holds is being refilled for another
+	 * neighbor: fills for this one are serialized with us by its
+	 * route lock.
+	 */
+	lce = llcache_claim(llcache_slot(ifp->if_index, &addr), &seq);
+	if (lce == NULL) {
+		return;
+	}
+	if (lce->lce_ifindex == ifp->if_index && lce->lce_family == family &&
+	    IN6_ARE_ADDR_EQUAL(&lce->lce_addr, &addr)) {
+		lce->lce_expire = 0;
+	}
+	os_atomic_store(&lce->lce_seq, seq, release);
+}
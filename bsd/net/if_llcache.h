@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef _NET_IF_LLCACHE_H_
+#define _NET_IF_LLCACHE_H_
+
+#ifdef BSD_KERNEL_PRIVATE
+#include <sys/types.h>
+
+struct ifnet;
+struct sockaddr;
+struct sockaddr_dl;
+
+/*
+ * Lock-free cache of resolved neighbors for the transmit path.
+ *
+ * ARP and ND keep their state in the llinfo of cloned host routes; the
+ * cache only remembers, per (interface, neighbor address), the link-layer
+ * address the last locked resolution handed out, so that the next packets
+ * to that neighbor can skip route_to_gwroute() and the route lock.
+ */
+extern void llcache_init(void);
+extern boolean_t llcache_lookup(struct ifnet *, const struct sockaddr *,
+    struct sockaddr_dl *, size_t);
+extern void llcache_enter(struct ifnet *, const struct sockaddr *,
+    const struct sockaddr_dl *, uint64_t);
+extern void llcache_invalidate(struct ifnet *, const struct sockaddr *);
+#endif /* BSD_KERNEL_PRIVATE */
+#endif /* !_NET_IF_LLCACHE_H_ */
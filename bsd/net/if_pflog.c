@@ -374,8 +374,8 @@ pflog_packet(struct pfi_kif *kif, pbuf_t *pbuf, sa_family_t af, u_int8_t dir,
 	}
 #endif /* INET */
 
-	atomic_add_64(&ifn->if_opackets, 1);
-	atomic_add_64(&ifn->if_obytes, m->m_pkthdr.len);
+	IFNET_STAT_ADD(ifn, ifi_opackets, 1);
+	IFNET_STAT_ADD(ifn, ifi_obytes, m->m_pkthdr.len);
 
 	switch (dir) {
 	case PF_IN:
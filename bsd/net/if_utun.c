@@ -148,6 +148,8 @@ static errno_t  utun_ctl_disconnect(kern_ctl_ref kctlref, u_int32_t unit,
     void *unitinfo);
 static errno_t  utun_ctl_send(kern_ctl_ref kctlref, u_int32_t unit,
     void *unitinfo, mbuf_t m, int flags);
+static errno_t  utun_ctl_send_list(kern_ctl_ref kctlref, u_int32_t unit,
+    void *unitinfo, mbuf_t m, int flags);
 static errno_t  utun_ctl_getopt(kern_ctl_ref kctlref, u_int32_t unit, void *unitinfo,
     int opt, void *data, size_t *len);
 static errno_t  utun_ctl_setopt(kern_ctl_ref kctlref, u_int32_t unit, void *unitinfo,
@@ -161,6 +163,7 @@ static errno_t  utun_framer(ifnet_t interface, mbuf_t *packet,
     const struct sockaddr *dest, const char *desk_linkaddr,
     const char *frame_type, u_int32_t *prepend_len, u_int32_t *postpend_len);
 static errno_t  utun_output(ifnet_t interface, mbuf_t data);
+static errno_t  utun_output_list(ifnet_t interface, mbuf_t data);
 static errno_t  utun_demux(ifnet_t interface, mbuf_t data, char *frame_header,
     protocol_family_t *protocol);
 static errno_t  utun_add_proto(ifnet_t interface, protocol_family_t protocol,
@@ -211,7 +214,10 @@ static void utun_wait_data_move_drain(struct utun_pcb *pcb);
 
 #define UTUN_DEFAULT_MAX_PENDING_INPUT_COUNT 512
 
+#define UTUN_DEFAULT_OUTPUT_BATCH 32
+
 static int if_utun_max_pending_input = UTUN_DEFAULT_MAX_PENDING_INPUT_COUNT;
+static int if_utun_output_batch = UTUN_DEFAULT_OUTPUT_BATCH;
 
 static int sysctl_if_utun_ring_size SYSCTL_HANDLER_ARGS;
 static int sysctl_if_utun_tx_fsw_ring_size SYSCTL_HANDLER_ARGS;
@@ -225,6 +231,8 @@ SYSCTL_DECL(_net_utun);
 SYSCTL_NODE(_net, OID_AUTO, utun, CTLFLAG_RW | CTLFLAG_LOCKED, 0, "UTun");
 
 SYSCTL_INT(_net_utun, OID_AUTO, max_pending_input, CTLFLAG_LOCKED | CTLFLAG_RW, &if_utun_max_pending_input, 0, "");
+SYSCTL_INT(_net_utun, OID_AUTO, output_batch, CTLFLAG_LOCKED | CTLFLAG_RW, &if_utun_output_batch, 0,
+    "Maximum number of packets handed to the control socket at once");
 SYSCTL_PROC(_net_utun, OID_AUTO, ring_size, CTLTYPE_INT | CTLFLAG_LOCKED | CTLFLAG_RW,
     &if_utun_ring_size, UTUN_IF_DEFAULT_RING_SIZE, &sysctl_if_utun_ring_size, "I", "");
 SYSCTL_PROC(_net_utun, OID_AUTO, tx_fsw_ring_size, CTLTYPE_INT | CTLFLAG_LOCKED | CTLFLAG_RW,
@@ -1451,6 +1459,7 @@ utun_register_control(void)
 	kern_ctl.ctl_connect = utun_ctl_connect;
 	kern_ctl.ctl_disconnect = utun_ctl_disconnect;
 	kern_ctl.ctl_send = utun_ctl_send;
+	kern_ctl.ctl_send_list = utun_ctl_send_list;
 	kern_ctl.ctl_setopt = utun_ctl_setopt;
 	kern_ctl.ctl_getopt = utun_ctl_getopt;
 	kern_ctl.ctl_rcvd = utun_ctl_rcvd;
@@ -2051,6 +2060,36 @@ utun_ctl_send(__unused kern_ctl_ref kctlref,
 	return utun_pkt_input((struct utun_pcb *)unitinfo, m);
 }
 
+static errno_t
+utun_ctl_send_list(__unused kern_ctl_ref kctlref,
+    __unused u_int32_t unit,
+    void *unitinfo,
+    mbuf_t m,
+    __unused int flags)
+{
+	struct utun_pcb *pcb = unitinfo;
+	mbuf_t n;
+	errno_t result;
+
+	/*
+	 * sendmsg_x() hands over a whole batch: swap the protocol families
+	 * as utun_ctl_send() does and input the packets as one chain
+	 */
+	for (n = m; n != NULL; n = mbuf_nextpkt(n)) {
+		if (m_pktlen(n) >= (int32_t)UTUN_HEADER_SIZE(pcb)) {
+			*(protocol_family_t *)mbuf_data(n) = ntohl(*(protocol_family_t *)mbuf_data(n));
+		} else {
+			os_log_error(OS_LOG_DEFAULT, "%s - unexpected short mbuf pkt len %d\n", __func__, m_pktlen(n));
+		}
+	}
+
+	result = utun_pkt_input(pcb, m);
+	if (result != 0) {
+		mbuf_freem_list(m);
+	}
+	return result;
+}
+
 static errno_t
 utun_ctl_setopt(__unused kern_ctl_ref kctlref,
     __unused u_int32_t unit,
@@ -2581,6 +2620,7 @@ utun_start(ifnet_t interface)
 
 	for (;;) {
 		bool can_accept_packets = true;
+		u_int32_t limit = 1;
 		ifnet_lock_shared(pcb->utun_ifp);
 
 		u_int32_t utun_packet_cnt;
@@ -2591,7 +2631,11 @@ utun_start(ifnet_t interface)
 		}
 
 		can_accept_packets = (utun_packet_cnt < pcb->utun_max_pending_packets);
-		if (!can_accept_packets && pcb->utun_ctlref) {
+		if (can_accept_packets) {
+			/* Take as many packets as the client is willing to buffer */
+			limit = pcb->utun_max_pending_packets - utun_packet_cnt;
+			limit = MIN(limit, (u_int32_t)MAX(if_utun_output_batch, 1));
+		} else if (pcb->utun_ctlref) {
 			u_int32_t difference = 0;
 			if (ctl_getenqueuereadable(pcb->utun_ctlref, pcb->utun_unit, &difference) == 0) {
 				if (difference > 0) {
@@ -2610,10 +2654,10 @@ utun_start(ifnet_t interface)
 			break;
 		}
 		ifnet_lock_done(pcb->utun_ifp);
-		if (ifnet_dequeue(interface, &data) != 0) {
+		if (ifnet_dequeue_multi(interface, limit, &data, NULL, NULL, NULL) != 0) {
 			break;
 		}
-		if (utun_output(interface, data) != 0) {
+		if (utun_output_list(interface, data) != 0) {
 			break;
 		}
 	}
@@ -2682,6 +2726,85 @@ utun_output(ifnet_t     interface,
 	return 0;
 }
 
+/*
+ * Same as utun_output() for a chain of packets linked by m_nextpkt: the
+ * whole chain is appended to the control socket with a single socket lock
+ * round trip and a single wakeup of the client.
+ */
+static errno_t
+utun_output_list(ifnet_t interface, mbuf_t data)
+{
+	struct utun_pcb *pcb = ifnet_softc(interface);
+	mbuf_t m, remain = NULL;
+	u_int32_t packets = 0, bytes = 0;
+	errno_t result;
+
+	VERIFY(interface == pcb->utun_ifp);
+
+	if (mbuf_nextpkt(data) == NULL) {
+		return utun_output(interface, data);
+	}
+
+	for (m = data; m != NULL; m = mbuf_nextpkt(m)) {
+#if UTUN_NEXUS
+		if (!pcb->utun_use_netif)
+#endif // UTUN_NEXUS
+		{
+			if (m_pktlen(m) >= (int32_t)UTUN_HEADER_SIZE(pcb)) {
+				bpf_tap_out(pcb->utun_ifp, DLT_NULL, m, 0, 0);
+			}
+		}
+	}
+
+	if ((pcb->utun_flags & UTUN_FLAGS_NO_OUTPUT) || pcb->utun_ctlref == NULL) {
+		/* flush data */
+		mbuf_freem_list(data);
+		return 0;
+	}
+
+	for (m = data; m != NULL; m = mbuf_nextpkt(m)) {
+		/*
+		 * The ABI requires the protocol in network byte order
+		 */
+		if (m_pktlen(m) >= (int32_t)UTUN_HEADER_SIZE(pcb)) {
+			*(u_int32_t *)mbuf_data(m) = htonl(*(u_int32_t *)mbuf_data(m));
+		}
+		packets++;
+		bytes += mbuf_pkthdr_len(m);
+	}
+
+	result = ctl_enqueuembuf_list(pcb->utun_ctlref, pcb->utun_unit, data, 0, &remain);
+	if (result != 0) {
+		u_int32_t dropped = 0;
+
+		for (m = remain; m != NULL; m = mbuf_nextpkt(m)) {
+			dropped++;
+			bytes -= mbuf_pkthdr_len(m);
+		}
+		packets -= dropped;
+		if (remain != NULL) {
+			mbuf_freem_list(remain);
+		}
+		os_log_error(OS_LOG_DEFAULT, "utun_output_list - ctl_enqueuembuf_list failed: %d\n", result);
+#if UTUN_NEXUS
+		if (!pcb->utun_use_netif)
+#endif // UTUN_NEXUS
+		{
+			ifnet_stat_increment_out(interface, 0, 0, dropped);
+		}
+	}
+#if UTUN_NEXUS
+	if (!pcb->utun_use_netif)
+#endif // UTUN_NEXUS
+	{
+		if (!pcb->utun_ext_ifdata_stats && packets != 0) {
+			ifnet_stat_increment_out(interface, packets, bytes, 0);
+		}
+	}
+
+	return 0;
+}
+
 static errno_t
 utun_demux(__unused ifnet_t interface,
     mbuf_t data,
@@ -2970,28 +3093,33 @@ utun_pkt_input(struct utun_pcb *pcb, mbuf_t packet)
 	} else
 #endif // UTUN_NEXUS
 	{
-		mbuf_pkthdr_setrcvif(packet, pcb->utun_ifp);
+		struct ifnet_stat_increment_param incs = {};
+		mbuf_t m;
 
-		if (m_pktlen(packet) >= (int32_t)UTUN_HEADER_SIZE(pcb)) {
-			bpf_tap_in(pcb->utun_ifp, DLT_NULL, packet, 0, 0);
+		/* packet may be a chain handed over by utun_ctl_send_list() */
+		for (m = packet; m != NULL; m = mbuf_nextpkt(m)) {
+			mbuf_pkthdr_setrcvif(m, pcb->utun_ifp);
+
+			if (m_pktlen(m) >= (int32_t)UTUN_HEADER_SIZE(pcb)) {
+				bpf_tap_in(pcb->utun_ifp, DLT_NULL, m, 0, 0);
+			}
+			incs.packets_in++;
+			incs.bytes_in += mbuf_pkthdr_len(m);
 		}
 		if (pcb->utun_flags & UTUN_FLAGS_NO_INPUT) {
 			/* flush data */
-			mbuf_freem(packet);
+			mbuf_freem_list(packet);
 			return 0;
 		}
 
 		errno_t result = 0;
 		if (!pcb->utun_ext_ifdata_stats) {
-			struct ifnet_stat_increment_param incs = {};
-			incs.packets_in = 1;
-			incs.bytes_in = mbuf_pkthdr_len(packet);
 			result = ifnet_input(pcb->utun_ifp, packet, &incs);
 		} else {
 			result = ifnet_input(pcb->utun_ifp, packet, NULL);
 		}
 		if (result != 0) {
-			ifnet_stat_increment_in(pcb->utun_ifp, 0, 0, 1);
+			ifnet_stat_increment_in(pcb->utun_ifp, 0, 0, incs.packets_in);
 
 			os_log_error(OS_LOG_DEFAULT, "%s - ifnet_input failed: %d\n", __FUNCTION__, result);
 		}
@@ -549,9 +549,41 @@ extern bool intcoproc_unrestricted;
 #include <net/classq/if_classq.h>
 #include <net/if_types.h>
 #include <net/route.h>
+#include <kern/counter.h>
 
 RB_HEAD(ll_reach_tree, if_llreach);     /* define struct ll_reach_tree */
 
+/*
+ * Per-CPU halves of the if_data counters that are bumped for every
+ * packet.  They are updated with IFNET_STAT_ADD() so that the data path
+ * of a multi-queue interface doesn't contend on the cache line holding
+ * if_data; IFNET_STAT_LOAD() returns the sum of the if_data field, which
+ * is still written by drivers poking if_data directly, and of the
+ * per-CPU counter.  IFNET_STAT_SET() adjusts the if_data half so that
+ * the sum reads back as the requested value.
+ */
+struct ifnet_pcpu_stats {
+	scalable_counter_t      ifi_ipackets;
+	scalable_counter_t      ifi_ierrors;
+	scalable_counter_t      ifi_opackets;
+	scalable_counter_t      ifi_oerrors;
+	scalable_counter_t      ifi_collisions;
+	scalable_counter_t      ifi_ibytes;
+	scalable_counter_t      ifi_obytes;
+	scalable_counter_t      ifi_iqdrops;
+};
+
+#define IFNET_STAT_ADD(_ifp, _fld, _n)                                  \
+	counter_add(&(_ifp)->if_pcpu_stats._fld, (_n))
+
+#define IFNET_STAT_LOAD(_ifp, _fld)                                     \
+	(os_atomic_load(&(_ifp)->if_data._fld, relaxed) +               \
+	counter_load(&(_ifp)->if_pcpu_stats._fld))
+
+#define IFNET_STAT_SET(_ifp, _fld, _v)                                  \
+	os_atomic_store(&(_ifp)->if_data._fld,                          \
+	    (_v) - counter_load(&(_ifp)->if_pcpu_stats._fld), relaxed)
+
 #if SKYWALK
 struct nexus_ifnet_ops {
 	void (*ni_finalize)(struct nexus_netif_adapter *, struct ifnet *);
@@ -635,6 +667,7 @@ struct ifnet {
 	uint32_t         if_linkmiblen;  /* length of above data */
 
 	struct if_data_internal if_data __attribute__((aligned(8)));
+	struct ifnet_pcpu_stats if_pcpu_stats;
 
 	ifnet_family_t          if_family;      /* value assigned by Apple */
 	ifnet_subfamily_t       if_subfamily;   /* value assigned by Apple */
@@ -709,6 +742,10 @@ struct ifnet {
 #define IF_POLLF_READY          0x1     /* poll thread is ready */
 #define IF_POLLF_RUNNING        0x2     /* poll thread is running/active */
 #define IF_POLLF_TERMINATING    0x4     /* poll thread is terminating */
+#define IF_POLLF_BUSYPOLL       0x8     /* a busy-polling socket owns the driver */
+#define IF_POLLF_BUSYPOLL_WANT  0x10    /* poll thread deferred to a busy-poller */
+#define IF_POLLF_POLLMODE       0x20    /* driver is in IFNET_MODEL_INPUT_POLL_ON */
+#define IF_POLLF_BUSYPOLL_DRAIN 0x40    /* mode switch waiting on a busy-poller */
 #define IF_POLLF_EMBRYONIC      0x8000  /* poll thread is being setup */
 		struct timespec poll_cycle;  /* poll interval */
 		struct thread   *poll_thread;
@@ -1333,6 +1370,7 @@ extern int if_index;
 extern struct ifnethead ifnet_head;
 extern struct ifnethead ifnet_ordered_head;
 extern struct ifnet **__counted_by(if_index) ifindex2ifnet;
+extern struct ifnet *ifnet_byindex_smr(unsigned int);
 extern u_int32_t if_sndq_maxlen;
 extern u_int32_t if_rcvq_maxlen;
 extern struct ifaddr **ifnet_addrs;
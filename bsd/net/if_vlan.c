@@ -1116,7 +1116,7 @@ vlan_output(struct ifnet * ifp, struct mbuf * m)
 	/* do not run parent's if_output() if the parent is not up */
 	if ((ifnet_flags(p) & (IFF_UP | IFF_RUNNING)) != (IFF_UP | IFF_RUNNING)) {
 		m_freem(m);
-		atomic_add_64(&ifp->if_collisions, 1);
+		IFNET_STAT_ADD(ifp, ifi_collisions, 1);
 		return 0;
 	}
 	/*
@@ -1135,7 +1135,7 @@ vlan_output(struct ifnet * ifp, struct mbuf * m)
 		if (m == NULL) {
 			printf("%s%d: unable to prepend VLAN header\n", ifnet_name(ifp),
 			    ifnet_unit(ifp));
-			atomic_add_64(&ifp->if_oerrors, 1);
+			IFNET_STAT_ADD(ifp, ifi_oerrors, 1);
 			return 0;
 		}
 		/* M_PREPEND takes care of m_len, m_pkthdr.len for us */
@@ -1144,7 +1144,7 @@ vlan_output(struct ifnet * ifp, struct mbuf * m)
 			if (m == NULL) {
 				printf("%s%d: unable to pullup VLAN header\n", ifnet_name(ifp),
 				    ifnet_unit(ifp));
-				atomic_add_64(&ifp->if_oerrors, 1);
+				IFNET_STAT_ADD(ifp, ifi_oerrors, 1);
 				return 0;
 			}
 		}
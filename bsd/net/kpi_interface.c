@@ -1801,30 +1801,30 @@ ifnet_stat_increment(struct ifnet *ifp,
 	}
 
 	if (s->packets_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ipackets, s->packets_in);
+		IFNET_STAT_ADD(ifp, ifi_ipackets, s->packets_in);
 	}
 	if (s->bytes_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ibytes, s->bytes_in);
+		IFNET_STAT_ADD(ifp, ifi_ibytes, s->bytes_in);
 	}
 	if (s->errors_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ierrors, s->errors_in);
+		IFNET_STAT_ADD(ifp, ifi_ierrors, s->errors_in);
 	}
 
 	if (s->packets_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_opackets, s->packets_out);
+		IFNET_STAT_ADD(ifp, ifi_opackets, s->packets_out);
 	}
 	if (s->bytes_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_obytes, s->bytes_out);
+		IFNET_STAT_ADD(ifp, ifi_obytes, s->bytes_out);
 	}
 	if (s->errors_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_oerrors, s->errors_out);
+		IFNET_STAT_ADD(ifp, ifi_oerrors, s->errors_out);
 	}
 
 	if (s->collisions != 0) {
-		atomic_add_64(&ifp->if_data.ifi_collisions, s->collisions);
+		IFNET_STAT_ADD(ifp, ifi_collisions, s->collisions);
 	}
 	if (s->dropped != 0) {
-		atomic_add_64(&ifp->if_data.ifi_iqdrops, s->dropped);
+		IFNET_STAT_ADD(ifp, ifi_iqdrops, s->dropped);
 	}
 
 	/* Touch the last change time. */
@@ -1846,13 +1846,13 @@ ifnet_stat_increment_in(struct ifnet *ifp, u_int32_t packets_in,
 	}
 
 	if (packets_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ipackets, packets_in);
+		IFNET_STAT_ADD(ifp, ifi_ipackets, packets_in);
 	}
 	if (bytes_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ibytes, bytes_in);
+		IFNET_STAT_ADD(ifp, ifi_ibytes, bytes_in);
 	}
 	if (errors_in != 0) {
-		atomic_add_64(&ifp->if_data.ifi_ierrors, errors_in);
+		IFNET_STAT_ADD(ifp, ifi_ierrors, errors_in);
 	}
 
 	TOUCHLASTCHANGE(&ifp->if_lastchange);
@@ -1873,13 +1873,13 @@ ifnet_stat_increment_out(struct ifnet *ifp, u_int32_t packets_out,
 	}
 
 	if (packets_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_opackets, packets_out);
+		IFNET_STAT_ADD(ifp, ifi_opackets, packets_out);
 	}
 	if (bytes_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_obytes, bytes_out);
+		IFNET_STAT_ADD(ifp, ifi_obytes, bytes_out);
 	}
 	if (errors_out != 0) {
-		atomic_add_64(&ifp->if_data.ifi_oerrors, errors_out);
+		IFNET_STAT_ADD(ifp, ifi_oerrors, errors_out);
 	}
 
 	TOUCHLASTCHANGE(&ifp->if_lastchange);
@@ -1898,18 +1898,18 @@ ifnet_set_stat(struct ifnet *ifp, const struct ifnet_stats_param *s)
 		return EINVAL;
 	}
 
-	atomic_set_64(&ifp->if_data.ifi_ipackets, s->packets_in);
-	atomic_set_64(&ifp->if_data.ifi_ibytes, s->bytes_in);
+	IFNET_STAT_SET(ifp, ifi_ipackets, s->packets_in);
+	IFNET_STAT_SET(ifp, ifi_ibytes, s->bytes_in);
 	atomic_set_64(&ifp->if_data.ifi_imcasts, s->multicasts_in);
-	atomic_set_64(&ifp->if_data.ifi_ierrors, s->errors_in);
+	IFNET_STAT_SET(ifp, ifi_ierrors, s->errors_in);
 
-	atomic_set_64(&ifp->if_data.ifi_opackets, s->packets_out);
-	atomic_set_64(&ifp->if_data.ifi_obytes, s->bytes_out);
+	IFNET_STAT_SET(ifp, ifi_opackets, s->packets_out);
+	IFNET_STAT_SET(ifp, ifi_obytes, s->bytes_out);
 	atomic_set_64(&ifp->if_data.ifi_omcasts, s->multicasts_out);
-	atomic_set_64(&ifp->if_data.ifi_oerrors, s->errors_out);
+	IFNET_STAT_SET(ifp, ifi_oerrors, s->errors_out);
 
-	atomic_set_64(&ifp->if_data.ifi_collisions, s->collisions);
-	atomic_set_64(&ifp->if_data.ifi_iqdrops, s->dropped);
+	IFNET_STAT_SET(ifp, ifi_collisions, s->collisions);
+	IFNET_STAT_SET(ifp, ifi_iqdrops, s->dropped);
 	atomic_set_64(&ifp->if_data.ifi_noproto, s->no_protocol);
 
 	/* Touch the last change time. */
@@ -1929,18 +1929,18 @@ ifnet_stat(struct ifnet *ifp, struct ifnet_stats_param *s)
 		return EINVAL;
 	}
 
-	atomic_get_64(s->packets_in, &ifp->if_data.ifi_ipackets);
-	atomic_get_64(s->bytes_in, &ifp->if_data.ifi_ibytes);
+	s->packets_in = IFNET_STAT_LOAD(ifp, ifi_ipackets);
+	s->bytes_in = IFNET_STAT_LOAD(ifp, ifi_ibytes);
 	atomic_get_64(s->multicasts_in, &ifp->if_data.ifi_imcasts);
-	atomic_get_64(s->errors_in, &ifp->if_data.ifi_ierrors);
+	s->errors_in = IFNET_STAT_LOAD(ifp, ifi_ierrors);
 
-	atomic_get_64(s->packets_out, &ifp->if_data.ifi_opackets);
-	atomic_get_64(s->bytes_out, &ifp->if_data.ifi_obytes);
+	s->packets_out = IFNET_STAT_LOAD(ifp, ifi_opackets);
+	s->bytes_out = IFNET_STAT_LOAD(ifp, ifi_obytes);
 	atomic_get_64(s->multicasts_out, &ifp->if_data.ifi_omcasts);
-	atomic_get_64(s->errors_out, &ifp->if_data.ifi_oerrors);
+	s->errors_out = IFNET_STAT_LOAD(ifp, ifi_oerrors);
 
-	atomic_get_64(s->collisions, &ifp->if_data.ifi_collisions);
-	atomic_get_64(s->dropped, &ifp->if_data.ifi_iqdrops);
+	s->collisions = IFNET_STAT_LOAD(ifp, ifi_collisions);
+	s->dropped = IFNET_STAT_LOAD(ifp, ifi_iqdrops);
 	atomic_get_64(s->no_protocol, &ifp->if_data.ifi_noproto);
 
 	if (ifp->if_data_threshold != 0) {
@@ -71,6 +71,7 @@
 #include <corecrypto/cchmac.h>
 #include <corecrypto/ccsha2.h>
 #include <os/refcnt.h>
+#include <kern/counter.h>
 #include <mach-o/loader.h>
 #include <net/network_agent.h>
 #include <net/necp.h>
@@ -407,6 +408,53 @@ static LIST_HEAD(_necpkernelipoutputpolicies, necp_kernel_ip_output_policy) necp
 #define NECP_IP_OUTPUT_MAP_ID_TO_BUCKET(id) (id ? (id%(NECP_KERNEL_IP_OUTPUT_POLICIES_MAP_NUM_ID_BUCKETS - 1) + 1) : 0)
 static size_t necp_kernel_ip_output_policies_map_counts[NECP_KERNEL_IP_OUTPUT_POLICIES_MAP_NUM_ID_BUCKETS];
 static struct necp_kernel_ip_output_policy **necp_kernel_ip_output_policies_map[NECP_KERNEL_IP_OUTPUT_POLICIES_MAP_NUM_ID_BUCKETS];
+
+/*
+ * IP output result cache
+ *
+ * Per-packet matching walks the whole IP output policy bucket for every
+ * packet of a flow, although the answer only depends on the packet tuple,
+ * the socket policy IDs and the policy set.  Results are cached in a small
+ * direct-mapped table keyed by exactly the inputs of the match.  Entries
+ * carry the generation they were computed under; any change to the IP
+ * output policies, the drop-dest policy or the drop-all level bumps the
+ * generation and so invalidates every entry at once.  Entries are written
+ * under a per-entry sequence count so that lookups stay lock-free while
+ * the policy lock is only held shared.
+ */
+struct necp_ip_output_cache_key {
+	necp_kernel_policy_id           socket_policy_id;
+	necp_kernel_policy_id           socket_skip_policy_id;
+	u_int32_t                       bound_interface_index;
+	u_int32_t                       last_interface_index;
+	u_int16_t                       protocol;
+	u_int16_t                       pf_tag;
+	union necp_sockaddr_union       local_addr;
+	union necp_sockaddr_union       remote_addr;
+};
+
+struct necp_ip_output_cache_entry {
+	u_int32_t                       seq;            /* odd while being written */
+	int32_t                         gencount;
+	struct necp_ip_output_cache_key key;
+	struct necp_kernel_ip_output_policy *matched_policy;
+	u_int32_t                       route_rule_id;
+	necp_kernel_policy_result       drop_dest_policy_result;
+};
+
+#define NECP_IP_OUTPUT_CACHE_SIZE       256     /* must be a power of 2 */
+static struct necp_ip_output_cache_entry necp_ip_output_cache[NECP_IP_OUTPUT_CACHE_SIZE];
+
+static volatile int32_t necp_kernel_ip_output_policies_gencount = 1;
+#define BUMP_KERNEL_IP_OUTPUT_POLICIES_GENERATION_COUNT() do {                                                  \
+	if (OSIncrementAtomic(&necp_kernel_ip_output_policies_gencount) == (INT32_MAX - 1)) {   \
+	        necp_kernel_ip_output_policies_gencount = 1;                                                                    \
+	}                                                                                                                                                               \
+} while (0)
+
+static int necp_ip_output_cache_enabled = 1;
+SCALABLE_COUNTER_DEFINE(necp_ip_output_cache_hits);
+SCALABLE_COUNTER_DEFINE(necp_ip_output_cache_misses);
 static struct necp_kernel_socket_policy pass_policy =
 {
 	.id = NECP_KERNEL_POLICY_ID_NO_MATCH,
@@ -590,6 +638,10 @@ SYSCTL_INT(_net_necp, OID_AUTO, data_tracing_pid, CTLFLAG_LOCKED | CTLFLAG_RW, &
 static int necp_data_tracing_match_all = 0;
 SYSCTL_INT(_net_necp, OID_AUTO, data_tracing_match_all, CTLFLAG_LOCKED | CTLFLAG_RW, &necp_data_tracing_match_all, 0, "");
 
+SYSCTL_INT(_net_necp, OID_AUTO, ip_output_cache, CTLFLAG_LOCKED | CTLFLAG_RW, &necp_ip_output_cache_enabled, 0, "");
+SYSCTL_SCALABLE_COUNTER(_net_necp, ip_output_cache_hits, necp_ip_output_cache_hits, "");
+SYSCTL_SCALABLE_COUNTER(_net_necp, ip_output_cache_misses, necp_ip_output_cache_misses, "");
+
 #define NECP_DATA_TRACE_LEVEL_BRIEF     1
 #define NECP_DATA_TRACE_LEVEL_POLICY    2
 #define NECP_DATA_TRACE_LEVEL_CONDITION 3
@@ -731,6 +783,7 @@ sysctl_handle_necp_level SYSCTL_HANDLER_ARGS
 #pragma unused(arg1, arg2)
 	int error = sysctl_handle_int(oidp, oidp->oid_arg1, oidp->oid_arg2, req);
 	necp_drop_all_order = necp_get_first_order_for_priority(necp_drop_all_level);
+	BUMP_KERNEL_IP_OUTPUT_POLICIES_GENERATION_COUNT();
 	return error;
 }
 
@@ -6324,6 +6377,9 @@ necp_kernel_ip_output_policies_reprocess(void)
 
 	LCK_RW_ASSERT(&necp_kernel_policy_lock, LCK_RW_ASSERT_EXCLUSIVE);
 
+	// Invalidate cached IP output results before the old policies go away
+	BUMP_KERNEL_IP_OUTPUT_POLICIES_GENERATION_COUNT();
+
 	// Reset mask to 0
 	necp_kernel_ip_output_policies_condition_mask = 0;
 	necp_kernel_ip_output_policies_count = 0;
@@ -9611,6 +9667,88 @@ necp_ip_output_find_policy_match_locked(necp_kernel_policy_id socket_policy_id,
 	return matched_policy;
 }
 
+static struct necp_kernel_ip_output_policy *
+necp_ip_output_find_policy_match_cached(necp_kernel_policy_id socket_policy_id, necp_kernel_policy_id socket_skip_policy_id, u_int32_t bound_interface_index, u_int32_t last_interface_index, u_int16_t protocol, union necp_sockaddr_union *local_addr, union necp_sockaddr_union *remote_addr, struct rtentry *rt, u_int16_t pf_tag, u_int32_t *return_route_rule_id, necp_kernel_policy_result *return_drop_dest_policy_result, necp_drop_all_bypass_check_result_t *return_drop_all_bypass, int debug)
+{
+	struct necp_ip_output_cache_key key;
+	struct necp_ip_output_cache_entry *entry;
+	struct necp_ip_output_cache_entry copy;
+	struct necp_kernel_ip_output_policy *matched_policy;
+	int32_t gencount = necp_kernel_ip_output_policies_gencount;
+	u_int32_t seq;
+
+	LCK_RW_ASSERT(&necp_kernel_policy_lock, LCK_RW_ASSERT_SHARED);
+
+	/*
+	 * Local network conditions depend on the route rather than the tuple,
+	 * and traced packets must walk the policies to be logged.
+	 */
+	if (!necp_ip_output_cache_enabled || debug ||
+	    (necp_kernel_ip_output_policies_condition_mask & NECP_KERNEL_CONDITION_LOCAL_NETWORKS)) {
+		return necp_ip_output_find_policy_match_locked(socket_policy_id, socket_skip_policy_id, bound_interface_index, last_interface_index, protocol, local_addr, remote_addr, rt, pf_tag, return_route_rule_id, return_drop_dest_policy_result, return_drop_all_bypass, debug);
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.socket_policy_id = socket_policy_id;
+	key.socket_skip_policy_id = socket_skip_policy_id;
+	key.bound_interface_index = bound_interface_index;
+	key.last_interface_index = last_interface_index;
+	key.protocol = protocol;
+	key.pf_tag = pf_tag;
+	memcpy(&key.local_addr, local_addr, sizeof(key.local_addr));
+	memcpy(&key.remote_addr, remote_addr, sizeof(key.remote_addr));
+	entry = &necp_ip_output_cache[net_flowhash(&key, sizeof(key), 0) & (NECP_IP_OUTPUT_CACHE_SIZE - 1)];
+
+	seq = os_atomic_load(&entry->seq, acquire);
+	if ((seq & 1) == 0) {
+		memcpy(&copy, entry, sizeof(copy));
+		os_atomic_thread_fence(acquire);
+		if (os_atomic_load(&entry->seq, relaxed) == seq &&
+		    copy.gencount == gencount &&
+		    memcmp(&copy.key, &key, sizeof(key)) == 0) {
+			counter_inc(&necp_ip_output_cache_hits);
+			if (return_route_rule_id != NULL) {
+				*return_route_rule_id = copy.route_rule_id;
+			}
+			*return_drop_dest_policy_result = copy.drop_dest_policy_result;
+			if (return_drop_all_bypass != NULL) {
+				*return_drop_all_bypass = NECP_DROP_ALL_BYPASS_CHECK_RESULT_NONE;
+			}
+			return copy.matched_policy;
+		}
+	}
+	counter_inc(&necp_ip_output_cache_misses);
+
+	necp_drop_all_bypass_check_result_t drop_all_bypass = NECP_DROP_ALL_BYPASS_CHECK_RESULT_NONE;
+	u_int32_t route_rule_id = 0;
+
+	matched_policy = necp_ip_output_find_policy_match_locked(socket_policy_id, socket_skip_policy_id, bound_interface_index, last_interface_index, protocol, local_addr, remote_addr, rt, pf_tag, &route_rule_id, return_drop_dest_policy_result, &drop_all_bypass, debug);
+	if (return_route_rule_id != NULL) {
+		*return_route_rule_id = route_rule_id;
+	}
+	if (return_drop_all_bypass != NULL) {
+		*return_drop_all_bypass = drop_all_bypass;
+	}
+
+	/*
+	 * The drop-all bypass is decided by the sending process, so only
+	 * results that never consulted it are shared.  A writer that loses
+	 * the race for the entry simply does not cache.
+	 */
+	if (drop_all_bypass == NECP_DROP_ALL_BYPASS_CHECK_RESULT_NONE &&
+	    (seq = os_atomic_load(&entry->seq, relaxed), (seq & 1) == 0) &&
+	    os_atomic_cmpxchg(&entry->seq, seq, seq + 1, acquire)) {
+		entry->gencount = gencount;
+		memcpy(&entry->key, &key, sizeof(key));
+		entry->matched_policy = matched_policy;
+		entry->route_rule_id = route_rule_id;
+		entry->drop_dest_policy_result = *return_drop_dest_policy_result;
+		os_atomic_store(&entry->seq, seq + 2, release);
+	}
+
+	return matched_policy;
+}
+
 static inline bool
 necp_output_bypass(struct mbuf *packet)
 {
@@ -9747,7 +9885,7 @@ necp_ip_output_find_policy_match(struct mbuf *packet, int flags, struct ip_out_a
 	int debug = NECP_ENABLE_DATA_TRACE((&local_addr), (&remote_addr), protocol, 0);
 	NECP_DATA_TRACE_LOG_IP(debug, "IPv4", "START");
 
-	matched_policy = necp_ip_output_find_policy_match_locked(socket_policy_id, socket_skip_policy_id, bound_interface_index, last_interface_index, protocol, &local_addr, &remote_addr, rt, pf_tag, &route_rule_id, &drop_dest_policy_result, &drop_all_bypass, debug);
+	matched_policy = necp_ip_output_find_policy_match_cached(socket_policy_id, socket_skip_policy_id, bound_interface_index, last_interface_index, protocol, &local_addr, &remote_addr, rt, pf_tag, &route_rule_id, &drop_dest_policy_result, &drop_all_bypass, debug);
 	if (matched_policy) {
 		matched_policy_id = matched_policy->id;
 		if (result) {
@@ -9916,7 +10054,7 @@ necp_ip6_output_find_policy_match(struct mbuf *packet, int flags, struct ip6_out
 	int debug = NECP_ENABLE_DATA_TRACE((&local_addr), (&remote_addr), protocol, 0);
 	NECP_DATA_TRACE_LOG_IP(debug, "IPv6", "START");
 
-	matched_policy = necp_ip_output_find_policy_match_locked(socket_policy_id, socket_skip_policy_id, bound_interface_index, last_interface_index, protocol, &local_addr, &remote_addr, rt, pf_tag, &route_rule_id, &drop_dest_policy_result, &drop_all_bypass, debug);
+	matched_policy = necp_ip_output_find_policy_match_cached(socket_policy_id, socket_skip_policy_id, bound_interface_index, last_interface_index, protocol, &local_addr, &remote_addr, rt, pf_tag, &route_rule_id, &drop_dest_policy_result, &drop_all_bypass, debug);
 	if (matched_policy) {
 		matched_policy_id = matched_policy->id;
 		if (result) {
@@ -11910,6 +12048,7 @@ sysctl_handle_necp_drop_dest_level SYSCTL_HANDLER_ARGS
 
 		necp_drop_dest_entry->order = necp_get_first_order_for_priority(necp_drop_dest_entry->level);
 	}
+	BUMP_KERNEL_IP_OUTPUT_POLICIES_GENERATION_COUNT();
 	lck_rw_done(&necp_kernel_policy_lock);
 
 	return 0;
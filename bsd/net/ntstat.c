@@ -236,6 +236,7 @@ typedef struct nstat_provider {
 	void                    (*nstat_release)(nstat_provider_cookie_t cookie, boolean_t locked);
 	bool                    (*nstat_reporting_allowed)(nstat_provider_cookie_t cookie, nstat_provider_filter *filter, u_int64_t suppression_flags);
 	size_t                  (*nstat_copy_extension)(nstat_provider_cookie_t cookie, u_int32_t extension_id, void *buf, size_t len);
+	u_int64_t               (*nstat_activity)(nstat_provider_cookie_t cookie);
 } nstat_provider;
 
 typedef struct nstat_src {
@@ -247,6 +248,7 @@ typedef struct nstat_src {
 	uint32_t                filter;
 	bool                    ns_reported;            // At least one update/counts/desc message has been sent
 	uint64_t                seq;
+	u_int64_t               ns_activity;            // Provider activity when the last poll-all update was sent
 } nstat_src;
 
 static errno_t      nstat_control_send_counts(nstat_control_state *, nstat_src *, unsigned long long, u_int16_t, int *);
@@ -1424,6 +1426,32 @@ nstat_tcp_counts(
 	return 0;
 }
 
+/*
+ * Cheap summary of everything that moves the counts, so that a poll-all
+ * can skip a connection that has not changed since it was last reported
+ * without building its descriptor.  Packet counts only ever grow and every
+ * state transition is reflected in the top byte.  Zero means "always report".
+ */
+static u_int64_t
+nstat_tcp_activity(
+	nstat_provider_cookie_t cookie)
+{
+	struct nstat_tucookie *tucookie =
+	    (struct nstat_tucookie *)cookie;
+	struct inpcb *inp = tucookie->inp;
+	struct tcpcb *tp;
+	u_int64_t rxpackets, txpackets;
+
+	if (nstat_tcp_gone(cookie)) {
+		return 0;
+	}
+	tp = intotcpcb(inp);
+	atomic_get_64(rxpackets, &inp->inp_stat->rxpackets);
+	atomic_get_64(txpackets, &inp->inp_stat->txpackets);
+	return ((u_int64_t)(tp->t_state + 1) << 56) |
+	       ((rxpackets + txpackets) & ((1ULL << 56) - 1));
+}
+
 static void
 nstat_tcp_release(
 	nstat_provider_cookie_t cookie,
@@ -1894,6 +1922,7 @@ nstat_init_tcp_provider(void)
 	nstat_tcp_provider.nstat_copy_descriptor = nstat_tcp_copy_descriptor;
 	nstat_tcp_provider.nstat_reporting_allowed = nstat_tcp_reporting_allowed;
 	nstat_tcp_provider.nstat_copy_extension = nstat_tcp_extensions;
+	nstat_tcp_provider.nstat_activity = nstat_tcp_activity;
 	nstat_tcp_provider.next = nstat_providers;
 	nstat_providers = &nstat_tcp_provider;
 }
@@ -1961,6 +1990,23 @@ nstat_udp_counts(
 	return 0;
 }
 
+static u_int64_t
+nstat_udp_activity(
+	nstat_provider_cookie_t cookie)
+{
+	struct nstat_tucookie *tucookie =
+	    (struct nstat_tucookie *)cookie;
+	struct inpcb *inp = tucookie->inp;
+	u_int64_t rxpackets, txpackets;
+
+	if (nstat_udp_gone(cookie)) {
+		return 0;
+	}
+	atomic_get_64(rxpackets, &inp->inp_stat->rxpackets);
+	atomic_get_64(txpackets, &inp->inp_stat->txpackets);
+	return (1ULL << 63) | (rxpackets + txpackets);
+}
+
 static void
 nstat_udp_release(
 	nstat_provider_cookie_t cookie,
@@ -2199,6 +2245,7 @@ nstat_init_udp_provider(void)
 	nstat_udp_provider.nstat_release = nstat_udp_release;
 	nstat_udp_provider.nstat_reporting_allowed = nstat_udp_reporting_allowed;
 	nstat_udp_provider.nstat_copy_extension = nstat_udp_extensions;
+	nstat_udp_provider.nstat_activity = nstat_udp_activity;
 	nstat_udp_provider.next = nstat_providers;
 	nstat_providers = &nstat_udp_provider;
 }
@@ -3643,10 +3690,10 @@ nstat_ifnet_counts(
 	}
 
 	bzero(out_counts, sizeof(*out_counts));
-	out_counts->nstat_rxpackets = ifp->if_ipackets;
-	out_counts->nstat_rxbytes = ifp->if_ibytes;
-	out_counts->nstat_txpackets = ifp->if_opackets;
-	out_counts->nstat_txbytes = ifp->if_obytes;
+	out_counts->nstat_rxpackets = IFNET_STAT_LOAD(ifp, ifi_ipackets);
+	out_counts->nstat_rxbytes = IFNET_STAT_LOAD(ifp, ifi_ibytes);
+	out_counts->nstat_txpackets = IFNET_STAT_LOAD(ifp, ifi_opackets);
+	out_counts->nstat_txbytes = IFNET_STAT_LOAD(ifp, ifi_obytes);
 	out_counts->nstat_cell_rxbytes = out_counts->nstat_cell_txbytes = 0;
 	return 0;
 }
@@ -6590,8 +6637,28 @@ nstat_control_handle_get_update(
 			// Check to see if we should handle this source or if we're still skipping to find where to continue
 			if ((FALSE == partial || src->seq != state->ncs_seq)) {
 				u_int64_t suppression_flags = (src->ns_reported)? NSTAT_FILTER_SUPPRESS_BORING_POLL: 0;
+				u_int64_t activity = 0;
 				if (nstat_control_reporting_allowed(state, src, suppression_flags)) {
-					result = nstat_control_append_update(state, src, &gone);
+					/*
+					 * Providers that can tell cheaply whether anything
+					 * moved get the same "no change since the previous
+					 * report" suppression as the generic providers.
+					 */
+					if (src->provider->nstat_activity != NULL) {
+						activity = src->provider->nstat_activity(src->cookie);
+					}
+					if (suppression_flags != 0 && activity != 0 &&
+					    activity == src->ns_activity &&
+					    (state->ncs_provider_filters[src->provider->nstat_provider_id].npf_flags &
+					    NSTAT_FILTER_SUPPRESS_BORING_POLL) != 0) {
+						nstat_stats.nstat_poll_unchanged_suppressed++;
+						result = 0;
+					} else {
+						result = nstat_control_append_update(state, src, &gone);
+						if (result == 0) {
+							src->ns_activity = activity;
+						}
+					}
 					if (ENOMEM == result || ENOBUFS == result) {
 						/*
 						 * If the update message failed to
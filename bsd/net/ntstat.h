@@ -1127,6 +1127,7 @@ struct nstat_stats {
 	u_int32_t nstat_accumulate_msg_failures;
 	u_int32_t nstat_control_cleanup_source_failures;
 	u_int32_t nstat_handle_msg_failures;
+	u_int32_t nstat_poll_unchanged_suppressed;
 };
 
 #endif /* PRIVATE */
@@ -27,94 +27,56 @@
  */
 #include <stddef.h>
 #include <kern/debug.h>
-#include <kern/locks.h>
+#include <kern/mpsc_queue.h>
 #include <kern/thread.h>
-#include <kern/thread_call.h>
 #include <net/nwk_wq.h>
 #include <sys/proc_internal.h>
 #include <sys/systm.h>
 #include <sys/mcache.h>
 
-static TAILQ_HEAD(, nwk_wq_entry) nwk_wq_head =
-    TAILQ_HEAD_INITIALIZER(nwk_wq_head);
-static LCK_GRP_DECLARE(nwk_wq_lock_group, "Network work queue lock");
-static LCK_MTX_DECLARE(nwk_wq_lock, &nwk_wq_lock_group);
-
-/* Wait channel for Network work queue */
-static void *nwk_wq_waitch = NULL;
-static void nwk_wq_thread_func(void *, wait_result_t);
+/*
+ * Items are posted in bursts (e.g. route and interface events for every
+ * address of an interface), let a few of them accumulate before waking
+ * up the worker thread.
+ */
+#define NWK_WQ_COALESCE_THRESHOLD       32
+#define NWK_WQ_COALESCE_DELAY_NS        (1 * NSEC_PER_MSEC)
 
-static int nwk_wq_thread_cont(int err);
-static void nwk_wq_thread_func(void *v, wait_result_t w);
+static struct mpsc_daemon_queue nwk_wq_queue;
 
-void
-nwk_wq_init(void)
-{
-	thread_t nwk_wq_thread = THREAD_NULL;
-
-	if (kernel_thread_start(nwk_wq_thread_func,
-	    NULL, &nwk_wq_thread) != KERN_SUCCESS) {
-		panic_plain("%s: couldn't create network work queue thread", __func__);
-		/* NOTREACHED */
-	}
-	thread_deallocate(nwk_wq_thread);
-}
-
-static int
-nwk_wq_thread_cont(int err)
+static void
+nwk_wq_invoke(mpsc_queue_chain_t head, mpsc_queue_chain_t tail,
+    __assert_only mpsc_daemon_queue_t dq)
 {
-	TAILQ_HEAD(, nwk_wq_entry) temp_nwk_wq_head;
+	mpsc_queue_chain_t elm;
 	struct nwk_wq_entry *nwk_item;
-	struct nwk_wq_entry *nwk_item_next;
-
-#pragma unused(err)
-	for (;;) {
-		nwk_item = NULL;
-		nwk_item_next = NULL;
-		TAILQ_INIT(&temp_nwk_wq_head);
 
-		LCK_MTX_ASSERT(&nwk_wq_lock, LCK_MTX_ASSERT_OWNED);
-		while (TAILQ_FIRST(&nwk_wq_head) == NULL) {
-			(void) msleep0(&nwk_wq_waitch, &nwk_wq_lock,
-			    (PZERO - 1), "nwk_wq_thread_cont", 0,
-			    nwk_wq_thread_cont);
-			/* NOTREACHED */
-		}
+	assert(dq == &nwk_wq_queue);
 
-		TAILQ_SWAP(&temp_nwk_wq_head, &nwk_wq_head, nwk_wq_entry, nwk_wq_link);
-		VERIFY(TAILQ_EMPTY(&nwk_wq_head));
-		lck_mtx_unlock(&nwk_wq_lock);
-
-		VERIFY(TAILQ_FIRST(&temp_nwk_wq_head) != NULL);
-		TAILQ_FOREACH_SAFE(nwk_item, &temp_nwk_wq_head, nwk_wq_link, nwk_item_next) {
-			nwk_item->func(nwk_item);
-			/* nwk_item has been freed by the callback */
-		}
-		lck_mtx_lock(&nwk_wq_lock);
+	mpsc_queue_batch_foreach_safe(elm, head, tail) {
+		nwk_item = mpsc_queue_element(elm, struct nwk_wq_entry, nwk_wq_link);
+		nwk_item->func(nwk_item);
+		/* nwk_item has been freed by the callback */
 	}
 }
 
-__dead2
-static void
-nwk_wq_thread_func(void *v, wait_result_t w)
+void
+nwk_wq_init(void)
 {
-#pragma unused(v, w)
-	lck_mtx_lock(&nwk_wq_lock);
-	(void) msleep0(&nwk_wq_waitch, &nwk_wq_lock,
-	    (PZERO - 1), "nwk_wq_thread_func", 0, nwk_wq_thread_cont);
-	/*
-	 * msleep0() shouldn't have returned as PCATCH was not set;
-	 * therefore assert in this case.
-	 */
-	lck_mtx_unlock(&nwk_wq_lock);
-	VERIFY(0);
+	if (mpsc_daemon_queue_init_with_thread(&nwk_wq_queue, NULL,
+	    BASEPRI_KERNEL, "nwk_wq", MPSC_DAEMON_INIT_INACTIVE) != KERN_SUCCESS) {
+		panic_plain("%s: couldn't create network work queue thread", __func__);
+		/* NOTREACHED */
+	}
+	mpsc_daemon_queue_set_batch_invoke(&nwk_wq_queue, nwk_wq_invoke);
+	mpsc_daemon_queue_set_wakeup_coalescing(&nwk_wq_queue,
+	    NWK_WQ_COALESCE_THRESHOLD, NWK_WQ_COALESCE_DELAY_NS);
+	mpsc_daemon_queue_activate(&nwk_wq_queue);
 }
 
 void
 nwk_wq_enqueue(struct nwk_wq_entry *nwk_item)
 {
-	lck_mtx_lock(&nwk_wq_lock);
-	TAILQ_INSERT_TAIL(&nwk_wq_head, nwk_item, nwk_wq_link);
-	lck_mtx_unlock(&nwk_wq_lock);
-	wakeup((caddr_t)&nwk_wq_waitch);
+	mpsc_daemon_enqueue(&nwk_wq_queue, &nwk_item->nwk_wq_link,
+	    MPSC_QUEUE_DISABLE_PREEMPTION);
 }
@@ -32,9 +32,11 @@
 #include <os/base.h>
 
 #ifdef BSD_KERNEL_PRIVATE
+#include <kern/mpsc_queue.h>
+
 struct nwk_wq_entry {
 	void(*XNU_PTRAUTH_SIGNED_FUNCTION_PTR("nkw_wq_entry.func") func)(struct nwk_wq_entry *);
-	TAILQ_ENTRY(nwk_wq_entry) nwk_wq_link;
+	struct mpsc_queue_chain nwk_wq_link;
 };
 
 void nwk_wq_init(void);
@@ -2013,6 +2013,302 @@ pf_print_flags(u_int8_t f)
 	}
 }
 
+/*
+ * Index of the main filter ruleset, used by pf_test_rule() to step over
+ * rules that cannot match a packet.  Each rule is filed under at most
+ * one exact-match key:
+ *
+ * - its destination host, for an address family specific rule whose
+ *   destination is a single non-negated address;
+ * - else its destination port, for a TCP or UDP rule with "port = x";
+ * - else it is a wildcard, and always a candidate.
+ *
+ * The candidates for a packet are the wildcards plus the rules filed
+ * under the packet's destination address and port.  Every other rule
+ * would fail its destination address or port test, so pf_test_rule()
+ * can jump from one candidate to the next in rule number order without
+ * changing which rule matches, for first (quick) and last matches alike.
+ */
+#define PF_RIX_DHOST    1
+#define PF_RIX_DPORT    2
+
+struct pf_rix_ent {
+	u_int32_t       re_next;        /* next entry in the bucket */
+	u_int32_t       re_off;         /* first rule number in rix_nrs */
+	u_int32_t       re_cnt;
+	u_int8_t        re_kind;        /* PF_RIX_* */
+	u_int8_t        re_af;          /* PF_RIX_DHOST */
+	u_int8_t        re_proto;       /* PF_RIX_DPORT */
+	u_int8_t        re_pad;
+	u_int16_t       re_port;        /* network byte order */
+	u_int16_t       re_pad2;
+	struct pf_addr  re_addr;
+};
+
+struct pf_rule_index {
+	u_int32_t               rix_nrules;
+	u_int32_t               rix_nbuckets;   /* power of 2 */
+	u_int32_t               rix_nents;
+	u_int32_t               rix_nwild;
+	u_int32_t               *rix_buckets;
+	struct pf_rix_ent       *rix_ents;
+	u_int32_t               *rix_nrs;       /* wildcards first */
+	struct pf_rule          **rix_rules;    /* by rule number */
+};
+
+#define PF_RIX_NONE     UINT32_MAX
+
+/* rulesets below this size are not indexed; 0 disables the index */
+static TUNABLE(u_int32_t, pf_rule_index_min, "pf_rule_index_min", 64);
+
+static struct pf_rule_index *pf_filter_index;
+
+static u_int32_t
+pf_rix_hash(u_int8_t kind, u_int8_t af_proto, const struct pf_addr *a,
+    u_int16_t port)
+{
+	u_int32_t hash = ((u_int32_t)kind << 24) | ((u_int32_t)af_proto << 16) |
+	    port;
+
+	if (a != NULL) {
+		hash ^= a->addr32[0];
+		if (af_proto == AF_INET6) {
+			hash ^= a->addr32[1] ^ a->addr32[2] ^ a->addr32[3];
+		}
+	}
+	return hash * 0x9e3779b1;
+}
+
+/* the key a rule is filed under, PF_RIX_NONE for wildcards */
+static u_int8_t
+pf_rix_rule_key(struct pf_rule *r)
+{
+	struct pf_addr_wrap *aw = &r->dst.addr;
+	int bits;
+
+	if ((r->af == AF_INET || r->af == AF_INET6) && !r->dst.neg &&
+	    aw->type == PF_ADDR_ADDRMASK) {
+		bits = r->af == AF_INET ? 32 : 128;
+		for (int i = 0; i < bits / 32; i++) {
+			if (aw->v.a.mask.addr32[i] != 0xffffffff) {
+				bits = 0;
+				break;
+			}
+		}
+		if (bits != 0) {
+			return PF_RIX_DHOST;
+		}
+	}
+	if ((r->proto == IPPROTO_TCP || r->proto == IPPROTO_UDP) &&
+	    r->dst.xport.range.op == PF_OP_EQ) {
+		return PF_RIX_DPORT;
+	}
+	return 0;
+}
+
+static struct pf_rix_ent *
+pf_rix_lookup(struct pf_rule_index *rix, u_int8_t kind, u_int8_t af_proto,
+    const struct pf_addr *a, u_int16_t port)
+{
+	u_int32_t i;
+
+	i = rix->rix_buckets[(pf_rix_hash(kind, af_proto, a, port) >> 8) &
+	    (rix->rix_nbuckets - 1)];
+	for (; i != PF_RIX_NONE; i = rix->rix_ents[i].re_next) {
+		struct pf_rix_ent *re = &rix->rix_ents[i];
+
+		if (re->re_kind != kind) {
+			continue;
+		}
+		if (kind == PF_RIX_DHOST && re->re_af == af_proto &&
+		    PF_AEQ(&re->re_addr, a, af_proto)) {
+			return re;
+		}
+		if (kind == PF_RIX_DPORT && re->re_proto == af_proto &&
+		    re->re_port == port) {
+			return re;
+		}
+	}
+	return NULL;
+}
+
+static void
+pf_rule_index_free(struct pf_rule_index *rix)
+{
+	kfree_type(struct pf_rule *, rix->rix_nrules, rix->rix_rules);
+	kfree_data(rix->rix_nrs, rix->rix_nrules * sizeof(u_int32_t));
+	kfree_data(rix->rix_ents, rix->rix_nrules * sizeof(struct pf_rix_ent));
+	kfree_data(rix->rix_buckets, rix->rix_nbuckets * sizeof(u_int32_t));
+	kfree_type(struct pf_rule_index, rix);
+}
+
+void
+pf_rule_index_invalidate(void)
+{
+	LCK_MTX_ASSERT(&pf_lock, LCK_MTX_ASSERT_OWNED);
+
+	if (pf_filter_index != NULL) {
+		pf_rule_index_free(pf_filter_index);
+		pf_filter_index = NULL;
+	}
+}
+
+static void
+pf_rule_index_build(struct pf_rulequeue *rules)
+{
+	struct pf_rule_index *rix;
+	struct pf_rix_ent *re;
+	struct pf_rule *r;
+	u_int32_t n = 0, off, i;
+
+	pf_rule_index_invalidate();
+
+	TAILQ_FOREACH(r, rules, entries) {
+		if (r->nr != n) {
+			/* rule numbers are used as indices */
+			return;
+		}
+		n++;
+	}
+	if (pf_rule_index_min == 0 || n < pf_rule_index_min) {
+		return;
+	}
+
+	rix = kalloc_type(struct pf_rule_index, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	rix->rix_nrules = n;
+	rix->rix_nbuckets = 1;
+	while (rix->rix_nbuckets < n) {
+		rix->rix_nbuckets <<= 1;
+	}
+	rix->rix_rules = kalloc_type(struct pf_rule *, n, Z_WAITOK | Z_ZERO);
+	rix->rix_nrs = kalloc_data(n * sizeof(u_int32_t), Z_WAITOK | Z_ZERO);
+	rix->rix_ents = kalloc_data(n * sizeof(struct pf_rix_ent),
+	    Z_WAITOK | Z_ZERO);
+	rix->rix_buckets = kalloc_data(rix->rix_nbuckets * sizeof(u_int32_t),
+	    Z_WAITOK);
+	if (rix->rix_rules == NULL || rix->rix_nrs == NULL ||
+	    rix->rix_ents == NULL || rix->rix_buckets == NULL) {
+		pf_rule_index_free(rix);
+		return;
+	}
+	memset(rix->rix_buckets, 0xff, rix->rix_nbuckets * sizeof(u_int32_t));
+
+	/* create the keys and count their rules */
+	TAILQ_FOREACH(r, rules, entries) {
+		u_int8_t kind = pf_rix_rule_key(r);
+		u_int8_t af_proto;
+		u_int16_t port = 0;
+		struct pf_addr *a = NULL;
+		u_int32_t b;
+
+		rix->rix_rules[r->nr] = r;
+		if (kind == 0) {
+			rix->rix_nwild++;
+			continue;
+		}
+		if (kind == PF_RIX_DHOST) {
+			af_proto = r->af;
+			a = &r->dst.addr.v.a.addr;
+		} else {
+			af_proto = r->proto;
+			port = r->dst.xport.range.port[0];
+		}
+		re = pf_rix_lookup(rix, kind, af_proto, a, port);
+		if (re == NULL) {
+			re = &rix->rix_ents[rix->rix_nents];
+			re->re_kind = kind;
+			if (kind == PF_RIX_DHOST) {
+				re->re_af = af_proto;
+				PF_ACPY(&re->re_addr, a, af_proto);
+			} else {
+				re->re_proto = af_proto;
+				re->re_port = port;
+			}
+			b = (pf_rix_hash(kind, af_proto, a, port) >> 8) &
+			    (rix->rix_nbuckets - 1);
+			re->re_next = rix->rix_buckets[b];
+			rix->rix_buckets[b] = rix->rix_nents++;
+		}
+		re->re_cnt++;
+	}
+
+	/* lay out the rule numbers, which come out in ascending order */
+	off = rix->rix_nwild;
+	for (i = 0; i < rix->rix_nents; i++) {
+		re = &rix->rix_ents[i];
+		re->re_off = off;
+		off += re->re_cnt;
+		re->re_cnt = 0;
+	}
+	off = 0;
+	TAILQ_FOREACH(r, rules, entries) {
+		u_int8_t kind = pf_rix_rule_key(r);
+
+		if (kind == 0) {
+			rix->rix_nrs[off++] = r->nr;
+			continue;
+		}
+		if (kind == PF_RIX_DHOST) {
+			re = pf_rix_lookup(rix, kind, r->af,
+			    &r->dst.addr.v.a.addr, 0);
+		} else {
+			re = pf_rix_lookup(rix, kind, r->proto, NULL,
+			    r->dst.xport.range.port[0]);
+		}
+		rix->rix_nrs[re->re_off + re->re_cnt++] = r->nr;
+	}
+	pf_filter_index = rix;
+}
+
+/*
+ * The candidates of one packet: up to three ascending runs of rule
+ * numbers, merged on the fly
+ */
+struct pf_rix_cursor {
+	const u_int32_t *rc_pos[3];
+	const u_int32_t *rc_end[3];
+};
+
+static void
+pf_rix_cursor_init(struct pf_rule_index *rix, struct pf_rix_cursor *rc,
+    sa_family_t af, struct pf_addr *daddr, u_int8_t proto, u_int16_t dport)
+{
+	struct pf_rix_ent *re;
+
+	bzero(rc, sizeof(*rc));
+	rc->rc_pos[0] = rix->rix_nrs;
+	rc->rc_end[0] = rix->rix_nrs + rix->rix_nwild;
+	if ((af == AF_INET || af == AF_INET6) &&
+	    (re = pf_rix_lookup(rix, PF_RIX_DHOST, af, daddr, 0)) != NULL) {
+		rc->rc_pos[1] = rix->rix_nrs + re->re_off;
+		rc->rc_end[1] = rc->rc_pos[1] + re->re_cnt;
+	}
+	if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) &&
+	    (re = pf_rix_lookup(rix, PF_RIX_DPORT, proto, NULL,
+	    dport)) != NULL) {
+		rc->rc_pos[2] = rix->rix_nrs + re->re_off;
+		rc->rc_end[2] = rc->rc_pos[2] + re->re_cnt;
+	}
+}
+
+/* the first candidate at or after r */
+static struct pf_rule *
+pf_rix_next(struct pf_rule_index *rix, struct pf_rix_cursor *rc,
+    struct pf_rule *r)
+{
+	u_int32_t nr = (u_int32_t)r->nr, best = PF_RIX_NONE;
+
+	for (int i = 0; i < 3; i++) {
+		while (rc->rc_pos[i] < rc->rc_end[i] && *rc->rc_pos[i] < nr) {
+			rc->rc_pos[i]++;
+		}
+		if (rc->rc_pos[i] < rc->rc_end[i] && *rc->rc_pos[i] < best) {
+			best = *rc->rc_pos[i];
+		}
+	}
+	return best == PF_RIX_NONE ? NULL : rix->rix_rules[best];
+}
+
 #define PF_SET_SKIP_STEPS(i)                                    \
 	do {                                                    \
 	        while (head[i] != cur) {                        \
@@ -2108,6 +2404,10 @@ pf_calc_skip_steps(struct pf_rulequeue *rules)
 	for (i = 0; i < PF_SKIP_COUNT; ++i) {
 		PF_SET_SKIP_STEPS(i);
 	}
+
+	if (rules == pf_main_ruleset.rules[PF_RULESET_FILTER].active.ptr) {
+		pf_rule_index_build(rules);
+	}
 }
 
 u_int32_t
@@ -4913,6 +5213,8 @@ pf_test_rule(struct pf_rule **rm, struct pf_state **sm, int direction,
 	struct pf_grev1_hdr     *grev1 = pd->hdr.grev1;
 	union pf_state_xport bxport, bdxport, nxport, sxport, dxport;
 	struct pf_state_key      psk;
+	struct pf_rule_index    *rix;
+	struct pf_rix_cursor     rc;
 
 	LCK_MTX_ASSERT(&pf_lock, LCK_MTX_ASSERT_OWNED);
 
@@ -5227,7 +5529,20 @@ pf_test_rule(struct pf_rule **rm, struct pf_state **sm, int direction,
 		tag = nr->tag;
 	}
 
+	/* the destination is final now that translation is done */
+	rix = pf_filter_index;
+	if (rix != NULL) {
+		pf_rix_cursor_init(rix, &rc, pd->af, daddr, pd->proto,
+		    (pd->proto == IPPROTO_TCP || pd->proto == IPPROTO_UDP) ?
+		    th->th_dport : 0);
+	}
+
 	while (r != NULL) {
+		/* only the main ruleset is indexed */
+		if (rix != NULL && asd == 0 &&
+		    (r = pf_rix_next(rix, &rc, r)) == NULL) {
+			break;
+		}
 		r->evaluations++;
 		if (pfi_kif_match(r->kif, kif) == r->ifnot) {
 			r = r->skip[PF_SKIP_IFP].ptr;
@@ -720,6 +720,11 @@ pf_rm_rule(struct pf_rulequeue *rulequeue, struct pf_rule *rule)
 				pfr_detach_table(rule->overload_tbl);
 			}
 		}
+		/* the filter index must not outlive the rules it refers to */
+		if (rulequeue ==
+		    pf_main_ruleset.rules[PF_RULESET_FILTER].active.ptr) {
+			pf_rule_index_invalidate();
+		}
 		TAILQ_REMOVE(rulequeue, rule, entries);
 		rule->entries.tqe_prev = NULL;
 		rule->nr = -1;
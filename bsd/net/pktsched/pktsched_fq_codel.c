@@ -28,6 +28,7 @@
 
 #include <sys/types.h>
 #include <sys/param.h>
+#include <kern/clock.h>
 #include <kern/zalloc.h>
 #include <net/ethernet.h>
 #include <net/if_var.h>
@@ -55,12 +56,21 @@ static ZONE_DEFINE_TYPE(fq_if_zone, "pktsched_fq_if", fq_if_t, ZC_ZFREE_CLEARMEM
 static ZONE_DEFINE_TYPE(fq_if_grp_zone, "pktsched_fq_if_grp", fq_if_group_t, ZC_ZFREE_CLEARMEM);
 
 static uint64_t fq_empty_purge_delay = FQ_EMPTY_PURGE_DELAY;
+/*
+ * Update the per flow delay and flow control state once for each run of
+ * packets taken from a flow, rather than after every packet.
+ */
+static uint32_t fq_codel_batch_dequeue = 1;
 #if (DEVELOPMENT || DEBUG)
 SYSCTL_NODE(_net_classq, OID_AUTO, fq_codel, CTLFLAG_RW | CTLFLAG_LOCKED,
     0, "FQ-CODEL parameters");
 
 SYSCTL_QUAD(_net_classq_fq_codel, OID_AUTO, fq_empty_purge_delay, CTLFLAG_RW |
     CTLFLAG_LOCKED, &fq_empty_purge_delay, "Empty flow queue purge delay (ns)");
+
+SYSCTL_UINT(_net_classq_fq_codel, OID_AUTO, batch_dequeue, CTLFLAG_RW |
+    CTLFLAG_LOCKED, &fq_codel_batch_dequeue, 0,
+    "Update flow state once per dequeued run of packets");
 #endif /* !DEVELOPMENT && !DEBUG */
 
 typedef STAILQ_HEAD(, flowq) flowq_dqlist_t;
@@ -216,6 +226,8 @@ fq_getq_flow_kpkt(fq_if_t *fqs, fq_if_classq_t *fq_cl, fq_t *fq,
 	boolean_t limit_reached = FALSE;
 	struct ifclassq *ifq = fqs->fqs_ifq;
 	struct ifnet *ifp = ifq->ifcq_ifp;
+	bool batch = (fq_codel_batch_dequeue != 0);
+	bool dequeued = false;
 
 	/*
 	 * Assert to make sure pflags is part of PKT_F_COMMON_MASK;
@@ -223,12 +235,19 @@ fq_getq_flow_kpkt(fq_if_t *fqs, fq_if_classq_t *fq_cl, fq_t *fq,
 	 */
 	ASSERT((pflags & ~PKT_F_COMMON_MASK) == 0);
 
+	fqs->fqs_dq_flows++;
 	while (fq->fq_deficit > 0 && limit_reached == FALSE &&
 	    !KPKTQ_EMPTY(&fq->fq_kpktq)) {
 		_PKTSCHED_PKT_INIT(&pkt);
-		fq_getq_flow(fqs, fq, &pkt, now);
+		if (batch) {
+			fq_getq_flow_batch(fqs, fq, &pkt, now);
+		} else {
+			fq_getq_flow(fqs, fq, &pkt, now);
+		}
 		ASSERT(pkt.pktsched_ptype == QP_PACKET);
 
+		dequeued = true;
+
 		plen = pktsched_get_pkt_len(&pkt);
 		fq->fq_deficit -= plen;
 		pkt.pktsched_pkt_kpkt->pkt_pflags |= pflags;
@@ -254,6 +273,9 @@ fq_getq_flow_kpkt(fq_if_t *fqs, fq_if_classq_t *fq_cl, fq_t *fq,
 			limit_reached = TRUE;
 		}
 	}
+	if (batch && dequeued) {
+		fq_getq_flow_update(fqs, fq, now);
+	}
 	KDBG(AQM_KTRACE_STATS_FLOW_DEQUEUE, fq->fq_flowhash,
 	    AQM_KTRACE_FQ_GRP_SC_IDX(fq),
 	    fq->fq_bytes, fq->fq_min_qdelay);
@@ -274,13 +296,22 @@ fq_getq_flow_mbuf(fq_if_t *fqs, fq_if_classq_t *fq_cl, fq_t *fq,
 	boolean_t limit_reached = FALSE;
 	struct ifclassq *ifq = fqs->fqs_ifq;
 	struct ifnet *ifp = ifq->ifcq_ifp;
+	bool batch = (fq_codel_batch_dequeue != 0);
+	bool dequeued = false;
 
+	fqs->fqs_dq_flows++;
 	while (fq->fq_deficit > 0 && limit_reached == FALSE &&
 	    !MBUFQ_EMPTY(&fq->fq_mbufq)) {
 		_PKTSCHED_PKT_INIT(&pkt);
-		fq_getq_flow(fqs, fq, &pkt, now);
+		if (batch) {
+			fq_getq_flow_batch(fqs, fq, &pkt, now);
+		} else {
+			fq_getq_flow(fqs, fq, &pkt, now);
+		}
 		ASSERT(pkt.pktsched_ptype == QP_MBUF);
 
+		dequeued = true;
+
 		plen = pktsched_get_pkt_len(&pkt);
 		fq->fq_deficit -= plen;
 		pkt.pktsched_pkt_mbuf->m_pkthdr.pkt_flags |= pflags;
@@ -306,6 +337,9 @@ fq_getq_flow_mbuf(fq_if_t *fqs, fq_if_classq_t *fq_cl, fq_t *fq,
 			limit_reached = TRUE;
 		}
 	}
+	if (batch && dequeued) {
+		fq_getq_flow_update(fqs, fq, now);
+	}
 	KDBG(AQM_KTRACE_STATS_FLOW_DEQUEUE, fq->fq_flowhash,
 	    AQM_KTRACE_FQ_GRP_SC_IDX(fq),
 	    fq->fq_bytes, fq->fq_min_qdelay);
@@ -745,10 +779,11 @@ fq_if_dequeue_classq_multi_common(struct ifclassq *ifq, mbuf_svc_class_t svc,
 	fq_grp_tailq_t *grp_list, tmp_grp_list;
 	fq_if_group_t *fq_grp = NULL;
 	fq_if_t *fqs;
-	uint64_t now;
+	uint64_t now, start;
 	int pri = 0, svc_pri = 0;
 
 	IFCQ_LOCK_ASSERT_HELD(ifq);
+	start = mach_absolute_time();
 
 	fqs = (fq_if_t *)ifq->ifcq_disc;
 	STAILQ_INIT(&fq_dqlist_head);
@@ -890,6 +925,9 @@ state_change:
 
 	IFCQ_XMIT_ADD(ifq, total_pktcnt, total_bytecnt);
 	fq_if_purge_empty_flow_list(fqs, now, false);
+	fqs->fqs_dq_calls++;
+	fqs->fqs_dq_pkts += total_pktcnt;
+	fqs->fqs_dq_time += mach_absolute_time() - start;
 	return 0;
 }
 
@@ -939,8 +977,9 @@ fq_if_dequeue_sc_classq_multi_separate(struct ifclassq *ifq, mbuf_svc_class_t sv
 	fq_if_append_pkt_t append_pkt;
 	flowq_dqlist_t fq_dqlist_head;
 	fq_if_group_t *fq_grp;
-	uint64_t now;
+	uint64_t now, start;
 
+	start = mach_absolute_time();
 	switch (fqs->fqs_ptype) {
 	case QP_MBUF:
 		append_pkt = fq_if_append_mbuf;
@@ -1025,6 +1064,9 @@ fq_if_dequeue_sc_classq_multi_separate(struct ifclassq *ifq, mbuf_svc_class_t sv
 
 	IFCQ_XMIT_ADD(ifq, total_pktcnt, total_bytecnt);
 	fq_if_purge_empty_flow_list(fqs, now, false);
+	fqs->fqs_dq_calls++;
+	fqs->fqs_dq_pkts += total_pktcnt;
+	fqs->fqs_dq_time += mach_absolute_time() - start;
 	return 0;
 }
 
@@ -2058,6 +2100,10 @@ fq_if_getqstats_ifclassq(struct ifclassq *ifq, uint8_t gid, u_int32_t qid,
 	fcls->fcls_max_qdelay = fq_cl->fcl_stat.fcl_max_qdelay;
 	fcls->fcls_avg_qdelay = fq_cl->fcl_stat.fcl_avg_qdelay;
 	fcls->fcls_overwhelming = fq_cl->fcl_stat.fcl_overwhelming;
+	fcls->fcls_sched_calls = fqs->fqs_dq_calls;
+	fcls->fcls_sched_pkts = fqs->fqs_dq_pkts;
+	fcls->fcls_sched_flows = fqs->fqs_dq_flows;
+	absolutetime_to_nanoseconds(fqs->fqs_dq_time, &fcls->fcls_sched_time);
 
 	/* Gather per flow stats */
 	flowstat_cnt = min((fcls->fcls_newflows_cnt +
@@ -213,6 +213,11 @@ typedef struct fq_codel_sched_data {
 #define grp_bitmaps_cpy     fqs_bm_ops->cpy
 #define grp_bitmaps_clr     fqs_bm_ops->clr
 	fq_if_group_t           *fqs_classq_groups[FQ_IF_MAX_GROUPS];
+	/* dequeue cost, across all groups and classes */
+	uint64_t                fqs_dq_calls;   /* dequeue requests */
+	uint64_t                fqs_dq_pkts;    /* packets dequeued */
+	uint64_t                fqs_dq_flows;   /* flow queue visits */
+	uint64_t                fqs_dq_time;    /* mach time spent dequeueing */
 } fq_if_t;
 
 #define FQS_GROUP(_fqs, _group_idx)                                      \
@@ -309,6 +314,11 @@ struct fq_codel_classstats {
 	uint64_t        fcls_max_qdelay;
 	uint64_t        fcls_avg_qdelay;
 	uint32_t        fcls_overwhelming;
+	/* interface wide dequeue cost, the same for every class */
+	uint64_t        fcls_sched_calls;
+	uint64_t        fcls_sched_pkts;
+	uint64_t        fcls_sched_flows;
+	uint64_t        fcls_sched_time;        /* ns */
 };
 
 #ifdef BSD_KERNEL_PRIVATE
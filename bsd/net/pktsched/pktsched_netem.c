@@ -99,6 +99,16 @@ netem_enqueue(__unused struct netem *ne, __unused classq_pkt_t *p, \
  * interval. Upon wakeup, it dequeues all packets whose TTS is older than now
  * and sends them to output handler.
  *
+ * ##Timing wheel##
+ * Packets wait for their TTS in a hashed timing wheel, so enqueue and
+ * dequeue cost O(1) per packet however many packets are in flight. TTS is
+ * rounded down to a slot of sched_slot_us and the packet is appended to that
+ * slot's FIFO; the output thread drains slots from its cursor up to the
+ * current time. A slot also holds packets due in later
+ * rotations of the wheel, which are skipped until their time comes. Packets
+ * with monotonic TTS leave in order; packets falling in the same slot leave
+ * in enqueue order.
+ *
  */
 
 #if __LP64__
@@ -131,7 +141,13 @@ SYSCTL_UINT(_net_pktsched_netem, OID_AUTO, sched_output_ival_ms,
 static unsigned int netem_heap_size = NETEM_HEAP_SIZE_DEFAULT;
 SYSCTL_UINT(_net_pktsched_netem, OID_AUTO, heap_size,
     CTLFLAG_RW | CTLFLAG_LOCKED, &netem_heap_size, 0,
-    "Netem heap size");
+    "Netem maximum number of packets in flight");
+
+#define NETEM_WHEEL_SLOTS       1024    /* power of 2 */
+static unsigned int netem_slot_us = 100;
+SYSCTL_UINT(_net_pktsched_netem, OID_AUTO, sched_slot_us,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &netem_slot_us, 0,
+    "Netem timing wheel slot width in microseconds");
 
 extern kern_return_t thread_terminate(thread_t);
 
@@ -683,21 +699,35 @@ norm_dist(uint32_t mean, uint32_t stdvar)
 	return ret;
 }
 
-struct heap_elem {
+#define WHEEL_NIL       UINT32_MAX
+
+struct wheel_elem {
 	uint64_t key;
 	pktsched_pkt_t pkt;
+	uint32_t next;
+};
+
+struct wheel_slot {
+	uint32_t head;
+	uint32_t tail;
 };
 
-struct heap {
-	size_t limit;  /* max size */
-	size_t size;   /* current size */
-	struct heap_elem p[0];
+struct wheel {
+	uint32_t limit;         /* max size */
+	uint32_t size;          /* current size */
+	uint32_t free;          /* head of free elements */
+	uint64_t slot_abs;      /* slot width in absolute time */
+	uint64_t cursor;        /* next slot number to drain */
+	struct wheel_slot slots[NETEM_WHEEL_SLOTS];
+	struct wheel_elem e[0];
 };
 
-static struct heap *heap_create(size_t size);
-static int heap_insert(struct heap *h, uint64_t k, pktsched_pkt_t *p);
-static int heap_peek(struct heap *h, uint64_t *k, pktsched_pkt_t *p);
-static int heap_extract(struct heap *h, uint64_t *k, pktsched_pkt_t *p);
+static struct wheel *wheel_create(uint32_t limit);
+static int wheel_insert(struct wheel *w, uint64_t now, uint64_t k,
+    pktsched_pkt_t *p);
+static uint32_t wheel_extract(struct wheel *w, uint64_t now,
+    pktsched_pkt_t *pkts, uint32_t max);
+static void wheel_purge(struct wheel *w);
 
 typedef enum {
 	NETEM_MODEL_NULL = IF_NETEM_MODEL_NULL,
@@ -721,7 +751,7 @@ struct netem {
 	uint32_t                netem_output_max_batch_size;
 	uint32_t                netem_output_ival_ms;
 
-	struct heap             *netem_heap;
+	struct wheel            *netem_wheel;
 
 	/*********************** Parameters variables *************************/
 	netem_model_t           netem_model;
@@ -799,114 +829,145 @@ struct netem {
 #define NETEM_OUTPUT_IVAL_ONLY(_ne)             \
 	((_ne->netem_flags & NETEMF_OUTPUT_IVAL_ONLY) != 0)
 
-static struct heap *
-heap_create(size_t limit)
+static struct wheel *
+wheel_create(uint32_t limit)
 {
-	struct heap *h = NULL;
-
-	// verify limit
-	h = kalloc_type(struct heap, struct heap_elem, limit, Z_WAITOK | Z_ZERO);
-	if (h == NULL) {
-		return NULL;
+	struct wheel *w;
+	uint32_t i;
+
+	w = kalloc_type(struct wheel, struct wheel_elem, limit,
+	    Z_WAITOK | Z_ZERO | Z_NOFAIL);
+
+	w->limit = limit;
+	w->size = 0;
+	clock_interval_to_absolutetime_interval(MAX(netem_slot_us, 1),
+	    NSEC_PER_USEC, &w->slot_abs);
+	w->slot_abs = MAX(w->slot_abs, 1);
+	w->cursor = mach_absolute_time() / w->slot_abs;
+	for (i = 0; i < NETEM_WHEEL_SLOTS; i++) {
+		w->slots[i].head = w->slots[i].tail = WHEEL_NIL;
 	}
+	for (i = 0; i < limit; i++) {
+		w->e[i].next = (i + 1 < limit) ? i + 1 : WHEEL_NIL;
+	}
+	w->free = (limit != 0) ? 0 : WHEEL_NIL;
 
-	h->limit = limit;
-	h->size = 0;
-
-	return h;
+	return w;
 }
 
 static void
-heap_destroy(struct heap *h)
+wheel_destroy(struct wheel *w)
 {
-	ASSERT(h->size == 0);
+	ASSERT(w->size == 0);
 
-	kfree_type(struct heap, struct heap_elem, h->limit, h);
+	kfree_type(struct wheel, struct wheel_elem, w->limit, w);
 }
 
-#define HEAP_FATHER(child) (((child) - 1) / 2)
-#define HEAP_SWAP(a, b, tmp) { tmp = a; a = b; b = tmp; }
-#define HEAP_LEFT(x) (2 * (x) + 1)
-
 static int
-heap_insert(struct heap *h, uint64_t key, pktsched_pkt_t *pkt)
+wheel_insert(struct wheel *w, uint64_t now, uint64_t key,
+    pktsched_pkt_t *pkt)
 {
-	ASSERT(h != NULL);
+	struct wheel_slot *slot;
+	uint64_t slotno;
+	uint32_t i;
 
-	if (h->size == h->limit) {
+	if ((i = w->free) == WHEEL_NIL) {
 		return ENOBUFS;
 	}
+	w->free = w->e[i].next;
 
-	uint64_t child, parent;
-	if (pkt == NULL) {
-		child = key;
-		ASSERT(child < h->size);
-	} else {
-		child = h->size;
-		h->p[child].key = key;
-		h->p[child].pkt = *pkt;
-		h->size++;
+	if (w->size == 0) {
+		/* nothing to catch up with */
+		w->cursor = MAX(w->cursor, now / w->slot_abs);
 	}
-
-	while (child > 0) {
-		struct heap_elem tmp;
-		parent = HEAP_FATHER(child);
-		if (h->p[parent].key < h->p[child].key) {
-			break;
-		}
-		HEAP_SWAP(h->p[child], h->p[parent], tmp);
-		child = parent;
+	/* anything already due goes to the slot the cursor is on */
+	slotno = MAX(key / w->slot_abs, w->cursor);
+	slot = &w->slots[slotno & (NETEM_WHEEL_SLOTS - 1)];
+
+	w->e[i].key = key;
+	w->e[i].pkt = *pkt;
+	w->e[i].next = WHEEL_NIL;
+	if (slot->tail != WHEEL_NIL) {
+		w->e[slot->tail].next = i;
+	} else {
+		slot->head = i;
 	}
+	slot->tail = i;
+	w->size++;
 
 	return 0;
 }
 
-static int
-heap_peek(struct heap *h, uint64_t *key, pktsched_pkt_t *pkt)
+/*
+ * Take up to max packets whose time-to-send has been reached, in slot
+ * order, and return how many were taken.
+ */
+static uint32_t
+wheel_extract(struct wheel *w, uint64_t now, pktsched_pkt_t *pkts,
+    uint32_t max)
 {
-	if (h->size == 0) {
-		return ENOENT;
+	uint64_t now_slot = now / w->slot_abs;
+	uint32_t n = 0;
+
+	/* after a long gap one rotation visits every slot */
+	if (now_slot - w->cursor >= NETEM_WHEEL_SLOTS) {
+		w->cursor = now_slot - NETEM_WHEEL_SLOTS + 1;
 	}
 
-	*key = h->p[0].key;
-	*pkt = h->p[0].pkt;
-	return 0;
-}
+	while (n < max && w->size != 0 && w->cursor <= now_slot) {
+		struct wheel_slot *slot;
+		uint32_t i, next, prev = WHEEL_NIL;
 
-static int
-heap_extract(struct heap *h, uint64_t *key, pktsched_pkt_t *pkt)
-{
-	uint64_t child, parent, max;
+		slot = &w->slots[w->cursor & (NETEM_WHEEL_SLOTS - 1)];
+		for (i = slot->head; i != WHEEL_NIL && n < max; i = next) {
+			struct wheel_elem *e = &w->e[i];
 
-	if (h->size == 0) {
-		return ENOENT;
+			next = e->next;
+			if (e->key > now) {
+				/* due in a later rotation or later in this slot */
+				prev = i;
+				continue;
+			}
+			if (prev != WHEEL_NIL) {
+				w->e[prev].next = next;
+			} else {
+				slot->head = next;
+			}
+			if (slot->tail == i) {
+				slot->tail = prev;
+			}
+			pkts[n++] = e->pkt;
+			_PKTSCHED_PKT_INIT(&e->pkt);
+			e->next = w->free;
+			w->free = i;
+			w->size--;
+		}
+		if (n == max || w->cursor == now_slot) {
+			/* resume with this slot next time */
+			break;
+		}
+		w->cursor++;
+	}
+	if (w->size == 0) {
+		w->cursor = MAX(w->cursor, now_slot);
 	}
 
-	*key = h->p[0].key;
-	*pkt = h->p[0].pkt;
+	return n;
+}
 
-	/* re-heapify */
-	parent = 0;
-	child = HEAP_LEFT(parent);      /* start from left child */
-	max = h->size - 1;
-	while (child <= max) {
-		if (child != max && h->p[child + 1].key < h->p[child].key) {
-			child = child + 1;        /* right child */
-		}
-		h->p[parent] = h->p[child];
-		parent = child;
-		child = HEAP_LEFT(child);       /* left child for next loop */
-	}
+static void
+wheel_purge(struct wheel *w)
+{
+	uint32_t i, s;
 
-	h->size--;
-	if (parent != max) {
-		/* Fill hole with last entry, bubble up reusing insert code */
-		h->p[parent] = h->p[max];
-		_PKTSCHED_PKT_INIT(&h->p[max].pkt);
-		heap_insert(h, parent, NULL); /* this one cannot fail */
+	for (s = 0; s < NETEM_WHEEL_SLOTS; s++) {
+		for (i = w->slots[s].head; i != WHEEL_NIL; i = w->e[i].next) {
+			pktsched_free_pkt(&w->e[i].pkt);
+			w->size--;
+		}
+		w->slots[s].head = w->slots[s].tail = WHEEL_NIL;
 	}
-
-	return 0;
+	ASSERT(w->size == 0);
 }
 
 static void
@@ -1119,10 +1180,10 @@ nlc_enqueue(struct netem *ne, classq_pkt_t *p, bool *pdrop)
 
 		abs_time_to_send = latency_event(ne, abs_time_to_send);
 
-		ret = heap_insert(ne->netem_heap, abs_time_to_send, &pkt);
+		ret = wheel_insert(ne->netem_wheel, now, abs_time_to_send, &pkt);
 		if (ret != 0) {
 			NETEM_LOG(LOG_WARNING,
-			    "| heap_insert p %p err(%d), freeing pkt",
+			    "| wheel_insert p %p err(%d), freeing pkt",
 			    p->cp_mbuf, ret);
 			pktsched_free_pkt(&pkt);
 			goto done;
@@ -1161,45 +1222,6 @@ netem_enqueue(struct netem *ne, classq_pkt_t *p, bool *pdrop)
 	return ne->netem_enqueue(ne, p, pdrop);
 }
 
-static int
-netem_dequeue_internal_locked(struct netem *ne, pktsched_pkt_t *pp,
-    bool *more)
-{
-	int ret = 0;
-	uint64_t time_to_send;
-	pktsched_pkt_t pkt;
-
-	ASSERT(ne != NULL);
-	NETEM_MTX_LOCK_ASSERT_HELD(ne);
-
-	NETEM_LOG(LOG_DEBUG, "┌ begin");
-
-	ret = heap_peek(ne->netem_heap, &time_to_send, &pkt);
-	if (ret != 0) {
-		NETEM_LOG(LOG_DEBUG, "| heap empty");
-		ret = ENOENT;
-		goto done;
-	}
-
-	if (time_to_send > mach_absolute_time()) {
-		NETEM_LOG(LOG_DEBUG,
-		    "| TTS not yet reached: %llu now %llu",
-		    time_to_send, mach_absolute_time());
-		*more = true;
-		ret = EAGAIN;
-		goto done;
-	}
-
-	ret = heap_extract(ne->netem_heap, &time_to_send, &pkt);
-	ASSERT(ret == 0);
-	*pp = pkt;
-
-done:
-	NETEM_LOG(LOG_DEBUG, "└ end");
-
-	return ret;
-}
-
 __attribute__((noreturn))
 static void
 netem_output_thread_cont(void *v, wait_result_t w)
@@ -1208,7 +1230,6 @@ netem_output_thread_cont(void *v, wait_result_t w)
 	bool more = false;
 	pktsched_pkt_t pkts[NETEM_MAX_BATCH_SIZE];
 	uint32_t n_pkts = 0;
-	int ret;
 
 	NETEM_MTX_LOCK(ne);
 	ASSERT(!(ne->netem_flags & NETEMF_TERMINATED));
@@ -1238,25 +1259,17 @@ netem_output_thread_cont(void *v, wait_result_t w)
 	}
 
 	ASSERT(ne->netem_output != NULL);
-	n_pkts = 0;
 	for (;;) {
-		ret = netem_dequeue_internal_locked(ne, &pkts[n_pkts],
-		    &more);
-		if (__probable(ret == 0 &&
-		    ++n_pkts < ne->netem_output_max_batch_size)) {
-			continue;
-		}
-
-		if (__probable(n_pkts != 0)) {
-			NETEM_MTX_UNLOCK(ne);
-			(void) ne->netem_output(ne->netem_output_handle,
-			    pkts, n_pkts);
-			NETEM_MTX_LOCK(ne);
-			n_pkts = 0;
-		}
-		if (ret != 0) {
+		n_pkts = wheel_extract(ne->netem_wheel, mach_absolute_time(),
+		    pkts, ne->netem_output_max_batch_size);
+		more = (ne->netem_wheel->size != 0);
+		if (n_pkts == 0) {
 			break;
 		}
+
+		NETEM_MTX_UNLOCK(ne);
+		(void) ne->netem_output(ne->netem_output_handle, pkts, n_pkts);
+		NETEM_MTX_LOCK(ne);
 	}
 
 	uint64_t deadline = TIMEOUT_WAIT_FOREVER;
@@ -1306,7 +1319,7 @@ netem_create(const char *name, struct ifnet *ifp, void *output_handle,
 
 	lck_mtx_init(&ne->netem_lock, &netem_lock_group, LCK_ATTR_NULL);
 
-	ne->netem_heap = heap_create(netem_heap_size);
+	ne->netem_wheel = wheel_create(netem_heap_size);
 	ne->netem_flags = NETEMF_INITIALIZED;
 	ne->netem_output_handle = output_handle;
 	ne->netem_output = output;
@@ -1332,9 +1345,6 @@ netem_destroy(struct netem *ne)
 	uint64_t f = (1 * NSEC_PER_MSEC);       /* 1 ms */
 	uint64_t s = (1000 * NSEC_PER_MSEC);    /* 1 sec */
 	uint32_t i = 0;
-	int ret = 0;
-	uint64_t key = 0;
-	pktsched_pkt_t pkt;
 
 	ASSERT(ne != NULL);
 
@@ -1370,10 +1380,8 @@ netem_destroy(struct netem *ne)
 
 	lck_mtx_destroy(&ne->netem_lock, &netem_lock_group);
 
-	while ((ret = heap_extract(ne->netem_heap, &key, &pkt)) == 0) {
-		pktsched_free_pkt(&pkt);
-	}
-	heap_destroy(ne->netem_heap);
+	wheel_purge(ne->netem_wheel);
+	wheel_destroy(ne->netem_wheel);
 
 
 	kfree_type(struct netem, ne);
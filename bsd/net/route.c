@@ -86,6 +86,7 @@
 #include <net/route.h>
 #include <net/ntstat.h>
 #include <net/nwk_wq.h>
+#include <net/if_llcache.h>
 #if NECP
 #include <net/necp.h>
 #endif /* NECP */
@@ -317,6 +318,8 @@ static struct radix_node *node_lookup(struct sockaddr *, struct sockaddr *,
 static struct radix_node *node_lookup_default(int);
 static struct rtentry *rt_lookup_common(boolean_t, boolean_t, struct sockaddr *,
     struct sockaddr *, struct radix_node_head *, unsigned int);
+static struct radix_node *rt_lookup_select(boolean_t, struct sockaddr *,
+    struct sockaddr *, unsigned int *);
 static int rn_match_ifscope(struct radix_node *, void *);
 static struct ifaddr *ifa_ifwithroute_common_locked(int,
     const struct sockaddr *, const struct sockaddr *, unsigned int);
@@ -452,6 +455,7 @@ route_init(void)
 	rte_zone = zone_create(RTE_ZONE_NAME, size, ZC_NONE);
 
 	TAILQ_INIT(&rttrash_head);
+	rt_fib_init();
 }
 
 /*
@@ -476,6 +480,8 @@ set_primary_ifscope(int af, unsigned int ifscope)
 	} else {
 		primary6_ifscope = ifscope;
 	}
+	/* unscoped lookups depend on the primary interface */
+	rt_fib_invalidate(af);
 }
 
 /*
@@ -859,12 +865,14 @@ void
 routegenid_inet_update(void)
 {
 	atomic_add_32(&route_genid_inet, 1);
+	rt_fib_invalidate(AF_INET);
 }
 
 void
 routegenid_inet6_update(void)
 {
 	atomic_add_32(&route_genid_inet6, 1);
+	rt_fib_invalidate(AF_INET6);
 }
 
 /*
@@ -907,6 +915,9 @@ rtalloc_ign_common_locked(struct route *ro, uint32_t ignore,
 void
 rtalloc_ign(struct route *ro, uint32_t ignore)
 {
+	if (ro->ro_rt == NULL && rt_fib_alloc(ro, ignore)) {
+		return;
+	}
 	LCK_MTX_ASSERT(rnh_lock, LCK_MTX_ASSERT_NOTOWNED);
 	lck_mtx_lock(rnh_lock);
 	rtalloc_ign_common_locked(ro, ignore, IFSCOPE_NONE);
@@ -916,6 +927,10 @@ rtalloc_ign(struct route *ro, uint32_t ignore)
 void
 rtalloc_scoped_ign(struct route *ro, uint32_t ignore, unsigned int ifscope)
 {
+	if (ifscope == IFSCOPE_NONE && ro->ro_rt == NULL &&
+	    rt_fib_alloc(ro, ignore)) {
+		return;
+	}
 	LCK_MTX_ASSERT(rnh_lock, LCK_MTX_ASSERT_NOTOWNED);
 	lck_mtx_lock(rnh_lock);
 	rtalloc_ign_common_locked(ro, ignore, ifscope);
@@ -2643,6 +2658,11 @@ rt_setgate(struct rtentry *rt, struct sockaddr *dst, struct sockaddr *gate)
 		return EBUSY;
 	}
 
+	/* Nobody may keep using the link-layer address we're replacing */
+	if (rt->rt_flags & RTF_LLINFO) {
+		llcache_invalidate(rt->rt_ifp, rt_key(rt));
+	}
+
 	/* Add an extra ref for ourselves */
 	RT_ADDREF_LOCKED(rt);
 
@@ -3081,14 +3101,10 @@ static struct rtentry *
 rt_lookup_common(boolean_t lookup_only, boolean_t coarse, struct sockaddr *dst,
     struct sockaddr *netmask, struct radix_node_head *rnh, unsigned int ifscope)
 {
-	struct radix_node *rn0, *rn = NULL;
+	struct radix_node *rn = NULL;
 	int af = dst->sa_family;
-	struct sockaddr_storage dst_ss;
-	struct sockaddr_storage mask_ss;
-	boolean_t dontcare;
 #if (DEVELOPMENT || DEBUG)
 	char dbuf[MAX_SCOPE_ADDR_STR_LEN], gbuf[MAX_IPv6_STR_LEN];
-	char s_dst[MAX_IPv6_STR_LEN], s_netmask[MAX_IPv6_STR_LEN];
 #endif
 	VERIFY(!coarse || ifscope == IFSCOPE_NONE);
 
@@ -3131,6 +3147,66 @@ rt_lookup_common(boolean_t lookup_only, boolean_t coarse, struct sockaddr *dst,
 		return RT(rn);
 	}
 
+	rn = rt_lookup_select(coarse, dst, netmask, &ifscope);
+
+	if (rn != NULL) {
+		/*
+		 * Manually clear RTPRF_OURS using rt_validate() and
+		 * bump up the reference count after, and not before;
+		 * we only get here for AF_INET/AF_INET6.  node_lookup()
+		 * has done the check against RNF_ROOT, so we can be sure
+		 * that we're not returning a root node here.
+		 */
+		RT_LOCK_SPIN(RT(rn));
+		if (rt_validate(RT(rn))) {
+			RT_ADDREF_LOCKED(RT(rn));
+			RT_UNLOCK(RT(rn));
+		} else {
+			RT_UNLOCK(RT(rn));
+			rn = NULL;
+		}
+	}
+#if (DEVELOPMENT || DEBUG)
+	if (rt_verbose) {
+		if (rn == NULL) {
+			os_log(OS_LOG_DEFAULT, "%s %u return NULL\n", __func__, ifscope);
+		} else {
+			struct rtentry *rt = RT(rn);
+
+			rt_str(rt, dbuf, sizeof(dbuf), gbuf, sizeof(gbuf));
+
+			os_log(OS_LOG_DEFAULT, "%s %u return %p to %s->%s->%s ifa_ifp %s\n",
+			    __func__, ifscope, rt,
+			    dbuf, gbuf,
+			    (rt->rt_ifp != NULL) ? rt->rt_ifp->if_xname : "",
+			    (rt->rt_ifa->ifa_ifp != NULL) ?
+			    rt->rt_ifa->ifa_ifp->if_xname : "");
+		}
+	}
+#endif
+	return RT(rn);
+}
+
+/*
+ * Pick the AF_INET/AF_INET6 route that rt_lookup_common() returns for dst,
+ * without validating it or taking a reference; on return, *pifscope holds
+ * the scope the final search was done with.  Caller holds rnh_lock.
+ */
+static struct radix_node *
+rt_lookup_select(boolean_t coarse, struct sockaddr *dst,
+    struct sockaddr *netmask, unsigned int *pifscope)
+{
+	struct radix_node *rn0, *rn = NULL;
+	int af = dst->sa_family;
+	unsigned int ifscope = *pifscope;
+	struct sockaddr_storage dst_ss;
+	struct sockaddr_storage mask_ss;
+	boolean_t dontcare;
+#if (DEVELOPMENT || DEBUG)
+	char dbuf[MAX_SCOPE_ADDR_STR_LEN], gbuf[MAX_IPv6_STR_LEN];
+	char s_dst[MAX_IPv6_STR_LEN], s_netmask[MAX_IPv6_STR_LEN];
+#endif
+
 	/* Transform dst/netmask into the internal routing table form */
 	dst = sa_copy(dst, &dst_ss, &ifscope);
 	if (netmask != NULL) {
@@ -3290,42 +3366,8 @@ rt_lookup_common(boolean_t lookup_only, boolean_t coarse, struct sockaddr *dst,
 		rn = NULL;
 	}
 
-	if (rn != NULL) {
-		/*
-		 * Manually clear RTPRF_OURS using rt_validate() and
-		 * bump up the reference count after, and not before;
-		 * we only get here for AF_INET/AF_INET6.  node_lookup()
-		 * has done the check against RNF_ROOT, so we can be sure
-		 * that we're not returning a root node here.
-		 */
-		RT_LOCK_SPIN(RT(rn));
-		if (rt_validate(RT(rn))) {
-			RT_ADDREF_LOCKED(RT(rn));
-			RT_UNLOCK(RT(rn));
-		} else {
-			RT_UNLOCK(RT(rn));
-			rn = NULL;
-		}
-	}
-#if (DEVELOPMENT || DEBUG)
-	if (rt_verbose) {
-		if (rn == NULL) {
-			os_log(OS_LOG_DEFAULT, "%s %u return NULL\n", __func__, ifscope);
-		} else {
-			struct rtentry *rt = RT(rn);
-
-			rt_str(rt, dbuf, sizeof(dbuf), gbuf, sizeof(gbuf));
-
-			os_log(OS_LOG_DEFAULT, "%s %u return %p to %s->%s->%s ifa_ifp %s\n",
-			    __func__, ifscope, rt,
-			    dbuf, gbuf,
-			    (rt->rt_ifp != NULL) ? rt->rt_ifp->if_xname : "",
-			    (rt->rt_ifa->ifa_ifp != NULL) ?
-			    rt->rt_ifa->ifa_ifp->if_xname : "");
-		}
-	}
-#endif
-	return RT(rn);
+	*pifscope = ifscope;
+	return rn;
 }
 
 struct rtentry *
@@ -3344,6 +3386,20 @@ rt_lookup_coarse(boolean_t lookup_only, struct sockaddr *dst,
 	           rnh, IFSCOPE_NONE);
 }
 
+/*
+ * Return the AF_INET/AF_INET6 route an unscoped rt_lookup() would match
+ * for dst, without validating it or taking a reference; unlike a match,
+ * this doesn't unexpire cloned routes.  Caller holds rnh_lock.
+ */
+struct rtentry *
+rt_lookup_peek(struct sockaddr *dst)
+{
+	unsigned int ifscope = IFSCOPE_NONE;
+
+	LCK_MTX_ASSERT(rnh_lock, LCK_MTX_ASSERT_OWNED);
+	return RT(rt_lookup_select(FALSE, dst, NULL, &ifscope));
+}
+
 boolean_t
 rt_validate(struct rtentry *rt)
 {
@@ -0,0 +1,764 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Compiled forwarding tables.
+ *
+ * The radix trees in rt_tables[] remain the only source of truth for
+ * routing; for large AF_INET/AF_INET6 tables, route.c additionally keeps a
+ * read-only multi-bit trie (16 bits at the root, 8 bits per level below)
+ * that maps a destination straight to the route an unscoped rt_lookup()
+ * would have returned for it.  Lookups walk the trie without rnh_lock.
+ *
+ * The trie isn't derived from the prefixes themselves, as the scoped
+ * routing rules of rt_lookup_common() don't reduce to a longest prefix
+ * match.  Instead, every prefix in the tree contributes its first and
+ * one-past-last address as boundaries; between two consecutive boundaries
+ * the set of matching prefixes, and therefore the lookup result, can't
+ * change, so the table is built by resolving one address per interval
+ * with rt_lookup_peek() and painting the interval into the trie.
+ *
+ * Any change that moves the route generation count unpublishes the table
+ * right away, and a thread call rebuilds it once the tree has been quiet
+ * for route_fib_delay milliseconds; in between, lookups take the regular
+ * path.  Tables are published with SMR and carry a reference count, as
+ * well as a reference on each route they point to.  Cloned and dynamic
+ * host routes are left to the regular path, as holding on to them
+ * would keep them from expiring.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/sysctl.h>
+#include <sys/socket.h>
+#include <kern/counter.h>
+#include <kern/kalloc.h>
+#include <kern/locks.h>
+#include <kern/smr.h>
+#include <kern/thread_call.h>
+#include <os/refcnt.h>
+#include <net/route.h>
+#include <net/radix.h>
+#include <netinet/in.h>
+#include <netinet6/in6_var.h>
+
+__private_extern__ void
+qsort(void *a, size_t n, size_t es, int (*cmp)(const void *, const void *));
+
+typedef __uint128_t rt_fib_key_t;
+
+#define RT_FIB_ROOT_BITS        16
+#define RT_FIB_ROOT_SIZE        (1u << RT_FIB_ROOT_BITS)
+#define RT_FIB_CHUNK_BITS       8
+#define RT_FIB_CHUNK_SIZE       (1u << RT_FIB_CHUNK_BITS)
+#define RT_FIB_ROOT             UINT32_MAX      /* "chunk" index of the root */
+
+/*
+ * A trie entry is either empty (use the regular lookup), the index of a
+ * child chunk tagged with RT_FIB_CHILD, or 1 + the index of a route in
+ * rf_rt[].
+ */
+#define RT_FIB_EMPTY            0u
+#define RT_FIB_CHILD            0x80000000u
+
+enum {
+	RT_FIB_INET = 0,
+	RT_FIB_INET6,
+	RT_FIB_MAX
+};
+
+struct rt_fib {
+	os_refcnt_t             rf_refcnt;
+	uint32_t                rf_width;       /* key bits: 32 or 128 */
+	uint32_t                rf_genid;       /* route genid it was built at */
+	uint32_t                *rf_root;       /* RT_FIB_ROOT_SIZE entries */
+	uint32_t                *rf_chunks;     /* rf_nchunks * RT_FIB_CHUNK_SIZE */
+	uint32_t                rf_nchunks;
+	uint32_t                rf_maxchunks;
+	struct rtentry          **rf_rt;        /* referenced leaf routes */
+	uint32_t                rf_nrt;
+	uint32_t                rf_maxrt;
+	struct rt_fib           *rf_next;       /* on rt_fib_dead */
+};
+
+static struct rt_fib *rt_fib_table[RT_FIB_MAX];
+static uint32_t rt_fib_pending;                 /* RT_FIB_* bits to rebuild */
+static thread_call_t rt_fib_tcall;
+static uint64_t rt_fib_build_usec;              /* duration of the last build */
+
+static struct rt_fib *rt_fib_dead;             /* released, for the thread call */
+
+SCALABLE_COUNTER_DEFINE(rt_fib_hits);
+SCALABLE_COUNTER_DEFINE(rt_fib_misses);
+static uint32_t rt_fib_builds;
+static uint32_t rt_fib_mem;                     /* bytes in published tables */
+
+static int rt_fib_enabled = 1;
+static uint32_t route_fib_min_routes = 1024;
+static uint32_t route_fib_delay = 100;          /* msec */
+static uint32_t route_fib_max_mem = 64 << 20;   /* bytes, per table */
+
+static void rt_fib_schedule(int);
+
+SYSCTL_DECL(_net_route);
+
+static int
+sysctl_route_fib SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2)
+	int error, val = rt_fib_enabled;
+
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == USER_ADDR_NULL) {
+		return error;
+	}
+	rt_fib_enabled = (val != 0);
+	rt_fib_invalidate(AF_INET);
+	rt_fib_invalidate(AF_INET6);
+	return 0;
+}
+
+SYSCTL_PROC(_net_route, OID_AUTO, fib,
+    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_LOCKED, NULL, 0,
+    sysctl_route_fib, "I", "Use compiled forwarding tables for route lookups");
+SYSCTL_UINT(_net_route, OID_AUTO, fib_min_routes, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &route_fib_min_routes, 0, "Routes needed before a table is compiled");
+SYSCTL_UINT(_net_route, OID_AUTO, fib_delay, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &route_fib_delay, 0, "Quiet period before recompiling a table (msec)");
+SYSCTL_UINT(_net_route, OID_AUTO, fib_max_mem, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &route_fib_max_mem, 0, "Largest compiled table (bytes)");
+SYSCTL_UINT(_net_route, OID_AUTO, fib_builds, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &rt_fib_builds, 0, "Compiled tables built");
+SYSCTL_UINT(_net_route, OID_AUTO, fib_mem, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &rt_fib_mem, 0, "Memory used by the published tables (bytes)");
+SYSCTL_QUAD(_net_route, OID_AUTO, fib_build_usec, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &rt_fib_build_usec, "Duration of the last build (usec)");
+SYSCTL_SCALABLE_COUNTER(_net_route, fib_hits, rt_fib_hits,
+    "Lookups answered by a compiled table");
+SYSCTL_SCALABLE_COUNTER(_net_route, fib_misses, rt_fib_misses,
+    "Lookups a compiled table sent to the radix tree");
+
+static int
+rt_fib_index(int af)
+{
+	return af == AF_INET ? RT_FIB_INET :
+	       af == AF_INET6 ? RT_FIB_INET6 : -1;
+}
+
+static rt_fib_key_t
+rt_fib_ones(uint32_t bits)
+{
+	return bits >= 128 ? ~(rt_fib_key_t)0 : ((rt_fib_key_t)1 << bits) - 1;
+}
+
+/*
+ * Read the address of an AF_INET/AF_INET6 key or mask as an integer;
+ * radix masks may be trimmed, the missing bytes read as zero.
+ */
+static rt_fib_key_t
+rt_fib_sa_key(const struct sockaddr *sa, int af)
+{
+	const uint8_t *p = (const uint8_t *)sa;
+	size_t off, len;
+	rt_fib_key_t key = 0;
+
+	if (af == AF_INET) {
+		off = offsetof(struct sockaddr_in, sin_addr);
+		len = sizeof(struct in_addr);
+	} else {
+		off = offsetof(struct sockaddr_in6, sin6_addr);
+		len = sizeof(struct in6_addr);
+	}
+	for (size_t i = off; i < off + len; i++) {
+		key = (key << 8) | (i < sa->sa_len ? p[i] : 0);
+	}
+	return key;
+}
+
+static void
+rt_fib_key_sa(rt_fib_key_t key, int af, struct sockaddr_storage *ss)
+{
+	bzero(ss, sizeof(*ss));
+	if (af == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+
+		sin->sin_len = sizeof(*sin);
+		sin->sin_family = AF_INET;
+		sin->sin_addr.s_addr = htonl((uint32_t)key);
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+
+		sin6->sin6_len = sizeof(*sin6);
+		sin6->sin6_family = AF_INET6;
+		for (int i = 15; i >= 0; i--, key >>= 8) {
+			sin6->sin6_addr.s6_addr[i] = (uint8_t)key;
+		}
+	}
+}
+
+static uint32_t
+rt_fib_match(const struct rt_fib *fib, rt_fib_key_t key)
+{
+	uint32_t shift = fib->rf_width - RT_FIB_ROOT_BITS;
+	uint32_t e;
+
+	e = fib->rf_root[(uint32_t)(key >> shift) & (RT_FIB_ROOT_SIZE - 1)];
+	while (e & RT_FIB_CHILD) {
+		shift -= RT_FIB_CHUNK_BITS;
+		e = fib->rf_chunks[(e & ~RT_FIB_CHILD) * RT_FIB_CHUNK_SIZE +
+		    ((uint32_t)(key >> shift) & (RT_FIB_CHUNK_SIZE - 1))];
+	}
+	return e;
+}
+
+#pragma mark table lifecycle
+
+static size_t
+rt_fib_size(const struct rt_fib *fib)
+{
+	return sizeof(*fib) + RT_FIB_ROOT_SIZE * sizeof(uint32_t) +
+	       (size_t)fib->rf_maxchunks * RT_FIB_CHUNK_SIZE * sizeof(uint32_t) +
+	       (size_t)fib->rf_maxrt * sizeof(struct rtentry *);
+}
+
+static void
+rt_fib_free(void *arg)
+{
+	struct rt_fib *fib = arg;
+
+	kfree_data(fib->rf_root, RT_FIB_ROOT_SIZE * sizeof(uint32_t));
+	if (fib->rf_chunks != NULL) {
+		kfree_data(fib->rf_chunks,
+		    (size_t)fib->rf_maxchunks * RT_FIB_CHUNK_SIZE * sizeof(uint32_t));
+	}
+	if (fib->rf_rt != NULL) {
+		kfree_type(struct rtentry *, fib->rf_maxrt, fib->rf_rt);
+	}
+	kfree_type(struct rt_fib, fib);
+}
+
+/*
+ * Drop the route references of a table nobody can find anymore, and
+ * free it once the SMR readers that might still be looking at it are
+ * gone.  Caller holds rnh_lock.
+ */
+static void
+rt_fib_destroy(struct rt_fib *fib)
+{
+	LCK_MTX_ASSERT(rnh_lock, LCK_MTX_ASSERT_OWNED);
+
+	for (uint32_t i = 0; i < fib->rf_nrt; i++) {
+		rtfree_locked(fib->rf_rt[i]);
+	}
+	fib->rf_nrt = 0;
+	smr_global_retire(fib, rt_fib_size(fib), rt_fib_free);
+}
+
+/*
+ * The last reference may go away in contexts that hold rnh_lock, or even
+ * a route lock, and in contexts that don't; the table is pushed on a
+ * lockless list for the thread call, which drops the route references.
+ */
+static void
+rt_fib_release(struct rt_fib *fib)
+{
+	struct rt_fib *head;
+
+	if (os_ref_release(&fib->rf_refcnt) != 0) {
+		return;
+	}
+	head = os_atomic_load(&rt_fib_dead, relaxed);
+	do {
+		fib->rf_next = head;
+	} while (!os_atomic_cmpxchgv(&rt_fib_dead, head, fib, &head, release));
+	thread_call_enter(rt_fib_tcall);
+}
+
+/*
+ * Unpublish the compiled table of an address family; called whenever the
+ * route generation count of that family moves, with or without rnh_lock.
+ */
+void
+rt_fib_invalidate(int af)
+{
+	int idx = rt_fib_index(af);
+	struct rt_fib *fib;
+
+	if (idx < 0 || rt_fib_tcall == NULL) {
+		return;
+	}
+	fib = os_atomic_xchg(&rt_fib_table[idx], NULL, seq_cst);
+	if (fib != NULL) {
+		os_atomic_sub(&rt_fib_mem, (uint32_t)rt_fib_size(fib), relaxed);
+		rt_fib_release(fib);
+	}
+	if (rt_fib_enabled) {
+		rt_fib_schedule(idx);
+	}
+}
+
+static void
+rt_fib_schedule(int idx)
+{
+	uint64_t deadline, delay;
+
+	if (os_atomic_or_orig(&rt_fib_pending, 1u << idx, relaxed) != 0) {
+		return;         /* the thread call is already armed */
+	}
+
+	/* don't spend more than ~10% of the time under rnh_lock rebuilding */
+	delay = MAX((uint64_t)route_fib_delay * USEC_PER_MSEC,
+	    10 * os_atomic_load(&rt_fib_build_usec, relaxed));
+	clock_interval_to_deadline((uint32_t)MIN(delay, UINT32_MAX),
+	    NSEC_PER_USEC, &deadline);
+	thread_call_enter_delayed(rt_fib_tcall, deadline);
+}
+
+#pragma mark build
+
+struct rt_fib_walk {
+	int                     rw_af;
+	uint32_t                rw_width;
+	uint32_t                rw_nroutes;
+	boolean_t               rw_error;
+	rt_fib_key_t            *rw_keys;
+	uint32_t                rw_nkeys;
+	uint32_t                rw_maxkeys;
+};
+
+static boolean_t
+rt_fib_walk_add(struct rt_fib_walk *w, rt_fib_key_t key)
+{
+	if (w->rw_nkeys == w->rw_maxkeys) {
+		uint32_t max = MAX(w->rw_maxkeys * 2, 1024);
+		rt_fib_key_t *keys;
+
+		keys = krealloc_data(w->rw_keys, w->rw_maxkeys * sizeof(*keys),
+		    max * sizeof(*keys), Z_WAITOK);
+		if (keys == NULL) {
+			return FALSE;
+		}
+		w->rw_keys = keys;
+		w->rw_maxkeys = max;
+	}
+	w->rw_keys[w->rw_nkeys++] = key;
+	return TRUE;
+}
+
+static int
+rt_fib_walk_route(struct radix_node *rn, void *arg)
+{
+	struct rt_fib_walk *w = arg;
+	struct rtentry *rt = (struct rtentry *)rn;
+	rt_fib_key_t key, end, inv;
+	uint32_t plen = w->rw_width;
+
+	key = rt_fib_sa_key(rt_key(rt), w->rw_af);
+	if (rt_mask(rt) != NULL) {
+		/* only contiguous masks can be compiled */
+		inv = ~rt_fib_sa_key(rt_mask(rt), w->rw_af) & rt_fib_ones(w->rw_width);
+		if ((inv & (inv + 1)) != 0) {
+			w->rw_error = TRUE;
+			return EINVAL;
+		}
+		plen -= (uint32_t)__builtin_popcountll((uint64_t)inv) +
+		    (uint32_t)__builtin_popcountll((uint64_t)(inv >> 64));
+		key &= ~inv;
+	}
+	w->rw_nroutes++;
+
+	end = key + rt_fib_ones(w->rw_width - plen);
+	if (!rt_fib_walk_add(w, key) || (end != rt_fib_ones(w->rw_width) &&
+	    !rt_fib_walk_add(w, end + 1))) {
+		w->rw_error = TRUE;
+		return ENOMEM;
+	}
+	return 0;
+}
+
+static int
+rt_fib_key_cmp(const void *a, const void *b)
+{
+	rt_fib_key_t ka = *(const rt_fib_key_t *)a;
+	rt_fib_key_t kb = *(const rt_fib_key_t *)b;
+
+	return ka < kb ? -1 : ka > kb;
+}
+
+static boolean_t
+rt_fib_chunk_alloc(struct rt_fib *fib, uint32_t *chunk)
+{
+	if (fib->rf_nchunks == fib->rf_maxchunks) {
+		uint32_t max = MAX(fib->rf_maxchunks * 2, 64);
+		size_t csize = RT_FIB_CHUNK_SIZE * sizeof(uint32_t);
+		uint32_t *chunks;
+
+		if (rt_fib_size(fib) + (max - fib->rf_maxchunks) * csize >
+		    route_fib_max_mem) {
+			return FALSE;
+		}
+		chunks = krealloc_data(fib->rf_chunks, fib->rf_maxchunks * csize,
+		    max * csize, Z_WAITOK | Z_ZERO);
+		if (chunks == NULL) {
+			return FALSE;
+		}
+		fib->rf_chunks = chunks;
+		fib->rf_maxchunks = max;
+	}
+	*chunk = fib->rf_nchunks++;
+	return TRUE;
+}
+
+static uint32_t *
+rt_fib_slot(struct rt_fib *fib, uint32_t chunk, uint32_t idx)
+{
+	if (chunk == RT_FIB_ROOT) {
+		return &fib->rf_root[idx];
+	}
+	return &fib->rf_chunks[chunk * RT_FIB_CHUNK_SIZE + idx];
+}
+
+/*
+ * Point every address under key/plen at val; the intervals painted by
+ * rt_fib_build() are disjoint, so the slots involved are still empty.
+ */
+static boolean_t
+rt_fib_set(struct rt_fib *fib, rt_fib_key_t key, uint32_t plen, uint32_t val)
+{
+	uint32_t bits = RT_FIB_ROOT_BITS, shift = fib->rf_width - bits;
+	uint32_t chunk = RT_FIB_ROOT, idx, child, *slot;
+
+	idx = (uint32_t)(key >> shift) & (RT_FIB_ROOT_SIZE - 1);
+	while (plen > bits) {
+		slot = rt_fib_slot(fib, chunk, idx);
+		if (*slot & RT_FIB_CHILD) {
+			child = *slot & ~RT_FIB_CHILD;
+		} else {
+			VERIFY(*slot == RT_FIB_EMPTY);
+			if (!rt_fib_chunk_alloc(fib, &child)) {
+				return FALSE;
+			}
+			/* the allocation may have moved the chunks */
+			*rt_fib_slot(fib, chunk, idx) = RT_FIB_CHILD | child;
+		}
+		chunk = child;
+		bits += RT_FIB_CHUNK_BITS;
+		shift -= RT_FIB_CHUNK_BITS;
+		idx = (uint32_t)(key >> shift) & (RT_FIB_CHUNK_SIZE - 1);
+	}
+
+	for (uint32_t i = 0; i < (1u << (bits - plen)); i++) {
+		slot = rt_fib_slot(fib, chunk, idx + i);
+		VERIFY(*slot == RT_FIB_EMPTY);
+		*slot = val;
+	}
+	return TRUE;
+}
+
+/* Split [start, end] into aligned blocks and paint each of them */
+static boolean_t
+rt_fib_paint(struct rt_fib *fib, rt_fib_key_t start, rt_fib_key_t end,
+    uint32_t val)
+{
+	uint32_t width = fib->rf_width, k;
+
+	if (start == 0 && end == rt_fib_ones(width)) {
+		return rt_fib_set(fib, 0, 0, val);
+	}
+	for (;;) {
+		/* largest block aligned on start that doesn't go past end */
+		for (k = width - 1; k > 0; k--) {
+			if ((start & rt_fib_ones(k)) == 0 &&
+			    end - start >= rt_fib_ones(k)) {
+				break;
+			}
+		}
+		if (!rt_fib_set(fib, start, width - k, val)) {
+			return FALSE;
+		}
+		if (end - start == rt_fib_ones(k)) {
+			return TRUE;
+		}
+		start += rt_fib_ones(k) + 1;
+	}
+}
+
+/*
+ * Whether a route can be pointed at by a compiled table; the table's
+ * reference must not keep a cloned or dynamic host route from expiring.
+ */
+static boolean_t
+rt_fib_leaf_ok(struct rtentry *rt)
+{
+	RT_LOCK_ASSERT_HELD(rt);
+
+	if ((rt->rt_flags & (RTF_UP | RTF_CONDEMNED)) != RTF_UP ||
+	    rt->rt_ifp == NULL) {
+		return FALSE;
+	}
+	return !((rt->rt_flags & RTF_HOST) &&
+	       (rt->rt_flags & (RTF_WASCLONED | RTF_DYNAMIC)));
+}
+
+static uint32_t
+rt_fib_leaf(struct rt_fib *fib, struct rtentry *rt)
+{
+	if (fib->rf_nrt == fib->rf_maxrt) {
+		uint32_t max = MAX(fib->rf_maxrt * 2, 64);
+		struct rtentry **rts;
+
+		rts = krealloc_type(struct rtentry *, fib->rf_maxrt, max,
+		    fib->rf_rt, Z_WAITOK | Z_ZERO);
+		if (rts == NULL) {
+			return RT_FIB_EMPTY;
+		}
+		fib->rf_rt = rts;
+		fib->rf_maxrt = max;
+	}
+	RT_ADDREF_LOCKED(rt);
+	fib->rf_rt[fib->rf_nrt++] = rt;
+	return fib->rf_nrt;
+}
+
+static struct rt_fib *
+rt_fib_build(int af)
+{
+	struct radix_node_head *rnh = rt_tables[af];
+	struct rt_fib_walk w = {
+		.rw_af = af,
+		.rw_width = (af == AF_INET) ? 32 : 128,
+	};
+	struct sockaddr_storage ss;
+	struct rtentry *rt, *cur = NULL;
+	struct rt_fib *fib = NULL;
+	rt_fib_key_t start = 0, end;
+	uint32_t n, val = RT_FIB_EMPTY;
+	uint64_t begin, usec;
+
+	LCK_MTX_ASSERT(rnh_lock, LCK_MTX_ASSERT_OWNED);
+
+	if (rnh == NULL) {
+		return NULL;
+	}
+	begin = mach_absolute_time();
+
+	(void) rnh->rnh_walktree(rnh, rt_fib_walk_route, &w);
+	if (w.rw_error || w.rw_nroutes < route_fib_min_routes) {
+		goto done;
+	}
+
+	/* sort the boundaries, and drop the duplicates */
+	(void) rt_fib_walk_add(&w, 0);
+	qsort(w.rw_keys, w.rw_nkeys, sizeof(*w.rw_keys), rt_fib_key_cmp);
+	n = 0;
+	for (uint32_t i = 0; i < w.rw_nkeys; i++) {
+		if (n == 0 || w.rw_keys[i] != w.rw_keys[n - 1]) {
+			w.rw_keys[n++] = w.rw_keys[i];
+		}
+	}
+
+	fib = kalloc_type(struct rt_fib, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	os_ref_init(&fib->rf_refcnt, NULL);
+	fib->rf_width = w.rw_width;
+	fib->rf_genid = (af == AF_INET) ? route_genid_inet : route_genid_inet6;
+	fib->rf_root = kalloc_data(RT_FIB_ROOT_SIZE * sizeof(uint32_t),
+	    Z_WAITOK | Z_ZERO);
+	if (fib->rf_root == NULL) {
+		kfree_type(struct rt_fib, fib);
+		fib = NULL;
+		goto done;
+	}
+
+	/*
+	 * Resolve each interval, merging neighbours that resolve to the
+	 * same route, and paint the intervals that have a usable route.
+	 */
+	for (uint32_t i = 0; i <= n; i++) {
+		rt = NULL;
+		if (i < n) {
+			rt_fib_key_sa(w.rw_keys[i], af, &ss);
+			if (af == AF_INET ||
+			    !IN6_IS_SCOPE_EMBED(&SIN6(&ss)->sin6_addr)) {
+				rt = rt_lookup_peek(SA(&ss));
+			}
+			if (rt == cur && i > 0) {
+				continue;
+			}
+		}
+		if (i > 0 && val != RT_FIB_EMPTY) {
+			end = (i < n) ? w.rw_keys[i] - 1 : rt_fib_ones(w.rw_width);
+			if (!rt_fib_paint(fib, start, end, val)) {
+				goto fail;
+			}
+		}
+		if (i == n) {
+			break;
+		}
+		start = w.rw_keys[i];
+		cur = rt;
+		val = RT_FIB_EMPTY;
+		if (rt != NULL) {
+			RT_LOCK_SPIN(rt);
+			if (rt_fib_leaf_ok(rt)) {
+				val = rt_fib_leaf(fib, rt);
+			}
+			RT_UNLOCK(rt);
+		}
+	}
+	rt_fib_builds++;
+	goto done;
+
+fail:
+	rt_fib_destroy(fib);
+	fib = NULL;
+done:
+	if (w.rw_keys != NULL) {
+		kfree_data(w.rw_keys, w.rw_maxkeys * sizeof(*w.rw_keys));
+	}
+	absolutetime_to_nanoseconds(mach_absolute_time() - begin, &usec);
+	os_atomic_store(&rt_fib_build_usec, usec / NSEC_PER_USEC, relaxed);
+	return fib;
+}
+
+static void
+rt_fib_update(__unused thread_call_param_t p0, __unused thread_call_param_t p1)
+{
+	struct rt_fib *fib, *old, *next;
+	uint32_t pending;
+
+	pending = os_atomic_xchg(&rt_fib_pending, 0, relaxed);
+
+	lck_mtx_lock(rnh_lock);
+	fib = os_atomic_xchg(&rt_fib_dead, NULL, acquire);
+	for (; fib != NULL; fib = next) {
+		next = fib->rf_next;
+		rt_fib_destroy(fib);
+	}
+
+	for (int idx = 0; idx < RT_FIB_MAX; idx++) {
+		int af = (idx == RT_FIB_INET) ? AF_INET : AF_INET6;
+		uint32_t *genid = (af == AF_INET) ?
+		    &route_genid_inet : &route_genid_inet6;
+
+		if (!(pending & (1u << idx)) || !rt_fib_enabled ||
+		    (fib = rt_fib_build(af)) == NULL) {
+			continue;
+		}
+		os_atomic_add(&rt_fib_mem, (uint32_t)rt_fib_size(fib), relaxed);
+		old = os_atomic_xchg(&rt_fib_table[idx], fib, seq_cst);
+		if (old != NULL) {
+			os_atomic_sub(&rt_fib_mem, (uint32_t)rt_fib_size(old), relaxed);
+			rt_fib_release(old);
+		}
+		/*
+		 * Not every genid update is done under rnh_lock; if one
+		 * slipped in during the build, throw the table away again.
+		 */
+		if (os_atomic_load(genid, relaxed) != fib->rf_genid) {
+			rt_fib_invalidate(af);
+		}
+	}
+	lck_mtx_unlock(rnh_lock);
+}
+
+void
+rt_fib_init(void)
+{
+	rt_fib_tcall = thread_call_allocate_with_options(rt_fib_update, NULL,
+	    THREAD_CALL_PRIORITY_KERNEL, THREAD_CALL_OPTIONS_ONCE);
+}
+
+#pragma mark lookup
+
+/*
+ * Satisfy an unscoped rtalloc_ign() from the compiled table; returns
+ * FALSE whenever the regular lookup has to run instead, which is the case
+ * for scoped destinations, routes that would be cloned, and anything the
+ * table doesn't cover.
+ */
+boolean_t
+rt_fib_alloc(struct route *ro, uint32_t ignore)
+{
+	struct sockaddr *dst = SA(&ro->ro_dst);
+	struct rtentry *rt = NULL;
+	struct rt_fib *fib;
+	rt_fib_key_t key;
+	uint32_t e;
+	int idx;
+
+	if (dst->sa_family == AF_INET) {
+		if (sin_get_ifscope(dst) != IFSCOPE_NONE) {
+			return FALSE;
+		}
+		idx = RT_FIB_INET;
+	} else if (dst->sa_family == AF_INET6) {
+		if (SIN6(dst)->sin6_scope_id != 0 ||
+		    IN6_IS_SCOPE_EMBED(&SIN6(dst)->sin6_addr)) {
+			return FALSE;
+		}
+		idx = RT_FIB_INET6;
+	} else {
+		return FALSE;
+	}
+
+	smr_global_enter();
+	fib = os_atomic_load(&rt_fib_table[idx], dependency);
+	if (fib != NULL && !os_ref_retain_try(&fib->rf_refcnt)) {
+		fib = NULL;
+	}
+	smr_global_leave();
+	if (fib == NULL) {
+		return FALSE;
+	}
+
+	key = rt_fib_sa_key(dst, dst->sa_family);
+	if ((e = rt_fib_match(fib, key)) != RT_FIB_EMPTY) {
+		rt = fib->rf_rt[e - 1];
+		RT_LOCK_SPIN(rt);
+		/* cloning is for rtalloc1_common_locked() to decide */
+		if (((rt->rt_flags & ~ignore) &
+		    (RTF_CLONING | RTF_PRCLONING)) == 0 && rt_validate(rt)) {
+			RT_ADDREF_LOCKED(rt);
+			RT_UNLOCK(rt);
+			RT_GENID_SYNC(rt);
+		} else {
+			RT_UNLOCK(rt);
+			rt = NULL;
+		}
+	}
+	rt_fib_release(fib);
+
+	if (rt == NULL) {
+		counter_inc(&rt_fib_misses);
+		return FALSE;
+	}
+	counter_inc(&rt_fib_hits);
+	ro->ro_rt = rt;
+	return TRUE;
+}
@@ -422,6 +422,10 @@ extern struct rtentry *rt_lookup(boolean_t, struct sockaddr *,
     struct sockaddr *, struct radix_node_head *, unsigned int);
 extern struct rtentry *rt_lookup_coarse(boolean_t, struct sockaddr *,
     struct sockaddr *, struct radix_node_head *);
+extern struct rtentry *rt_lookup_peek(struct sockaddr *);
+extern void rt_fib_init(void);
+extern void rt_fib_invalidate(int);
+extern boolean_t rt_fib_alloc(struct route *, uint32_t);
 extern void rtalloc(struct route *);
 extern void rtalloc_scoped(struct route *, unsigned int);
 extern void rtalloc_ign(struct route *, uint32_t);
@@ -214,6 +214,50 @@ os_cpu_in_cksum(const void *data, uint32_t len, uint32_t initial_sum)
  * reduction is done to avoid carry in long packets.
  */
 
+#if defined(KERNEL) && defined(__x86_64__)
+/*
+ * Runs of at least CKSUM_VEC_MIN bytes are summed 64 bytes at a time by
+ * one of the SIMD block kernels in cpu_in_cksum.s; the kernel is picked
+ * at boot from the CPU capabilities, and SSE2 (always present on x86_64)
+ * covers anything running before that.  A NULL kernel, which can be
+ * asked for with the in_cksum_vec=0 boot-arg, leaves everything to the
+ * scalar loops below.  The same choice turns on the AVX2 loop of the
+ * fused copy and checksum in cpu_copy_in_cksum.s.  With AVX-512 enabled,
+ * neither AVX2 path is used.
+ */
+#include <kern/startup.h>
+#include <i386/cpuid.h>
+#include <machine/machine_routines.h>
+
+#define CKSUM_VEC_MIN   256
+#define CKSUM_VEC_BLK   64
+
+extern uint64_t os_cpu_in_cksum_sse2(const void *, uint32_t);
+extern uint64_t os_cpu_in_cksum_avx2(const void *, uint32_t);
+
+uint64_t (*os_cpu_in_cksum_vec)(const void *, uint32_t) = os_cpu_in_cksum_sse2;
+int os_cpu_copy_in_cksum_avx2 = 0;
+
+static TUNABLE(uint32_t, in_cksum_vec, "in_cksum_vec", 1);
+
+static void
+os_cpu_in_cksum_vec_init(void)
+{
+	if (in_cksum_vec == 0) {
+		os_cpu_in_cksum_vec = NULL;
+	} else if ((cpuid_leaf7_features() & CPUID_LEAF7_FEATURE_AVX2) &&
+	    ml_fpu_avx_enabled() && !ml_fpu_avx512_enabled()) {
+		/*
+		 * Both AVX2 loops save only ymm0-7, and the VEX restores
+		 * clear the upper halves of zmm0-7
+		 */
+		os_cpu_in_cksum_vec = os_cpu_in_cksum_avx2;
+		os_cpu_copy_in_cksum_avx2 = 1;
+	}
+}
+STARTUP(EARLY_BOOT, STARTUP_RANK_MIDDLE, os_cpu_in_cksum_vec_init);
+#endif /* KERNEL && __x86_64__ */
+
 #if !defined(__LP64__)
 /* 32-bit version */
 uint32_t
@@ -438,6 +482,25 @@ post_initial_offset:
 			data += 2;
 			mlen -= 2;
 		}
+#if defined(KERNEL) && defined(__x86_64__)
+		if (mlen >= CKSUM_VEC_MIN && os_cpu_in_cksum_vec != NULL) {
+			int vlen = mlen & ~(CKSUM_VEC_BLK - 1);
+
+			/* both terms are below 2^62, so this can't carry out */
+			partial += os_cpu_in_cksum_vec(data, (uint32_t)vlen);
+			data += vlen;
+			mlen -= vlen;
+			if (PREDICT_FALSE(partial & (3ULL << 62))) {
+				if (needs_swap) {
+					partial = (partial << 8) +
+					    (partial >> 56);
+				}
+				sum += (partial >> 32);
+				sum += (partial & 0xffffffff);
+				partial = 0;
+			}
+		}
+#endif /* KERNEL && __x86_64__ */
 		while (mlen >= 64) {
 			__builtin_prefetch(data + 32);
 			__builtin_prefetch(data + 64);
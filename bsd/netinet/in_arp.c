@@ -78,6 +78,7 @@
 #include <net/dlil.h>
 #include <net/if_types.h>
 #include <net/if_llreach.h>
+#include <net/if_llcache.h>
 #include <net/route.h>
 #include <net/nwk_wq.h>
 
@@ -243,6 +244,13 @@ SYSCTL_INT(_net_link_ether_inet, OID_AUTO, send_conflicting_probes,
     &send_conflicting_probes, 0,
     "send conflicting link-local arp probes");
 
+/*
+ * Bumped whenever a resolved link-layer address is invalidated or
+ * changes, so that protocols caching the result of arp_lookup_ip()
+ * (see ip_output) know to come back and resolve again.
+ */
+u_int32_t arp_genid;
+
 static int arp_verbose;
 SYSCTL_INT(_net_link_ether_inet, OID_AUTO, verbose,
     CTLFLAG_RW | CTLFLAG_LOCKED, &arp_verbose, 0, "");
@@ -271,10 +279,23 @@ arp_init(void)
 	VERIFY(!arpinit_done);
 
 	LIST_INIT(&llinfo_arp);
+	llcache_init();
 
 	arpinit_done = 1;
 }
 
+/*
+ * The link-layer address of rt went away or changed; called with rt locked.
+ */
+static void
+arp_llinfo_changed(struct rtentry *rt)
+{
+	RT_LOCK_ASSERT_HELD(rt);
+
+	atomic_add_32(&arp_genid, 1);
+	llcache_invalidate(rt->rt_ifp, rt_key(rt));
+}
+
 static struct llinfo_arp *
 arp_llinfo_alloc(zalloc_flags_t how)
 {
@@ -451,6 +472,7 @@ arp_llinfo_refresh(struct rtentry *rt)
 
 	if (rt->rt_expire > timenow) {
 		rt->rt_expire = timenow;
+		arp_llinfo_changed(rt);
 	}
 	return;
 }
@@ -656,6 +678,7 @@ arptfree(struct llinfo_arp *la, void *arg)
 		if (sdl != NULL) {
 			sdl->sdl_alen = 0;
 		}
+		arp_llinfo_changed(rt);
 		(void) arp_llinfo_flushq(la);
 		/*
 		 * Enqueue work item to invoke callback for this route entry
@@ -702,6 +725,7 @@ arptfree(struct llinfo_arp *la, void *arg)
 			if (sdl != NULL) {
 				sdl->sdl_alen = 0;
 			}
+			arp_llinfo_changed(rt);
 			la->la_asked = 0;
 			rt->rt_flags &= ~RTF_REJECT;
 		}
@@ -1095,6 +1119,7 @@ arp_rtrequest(int req, struct rtentry *rt, struct sockaddr *sa)
 		la->la_le.le_next = NULL;
 		la->la_le.le_prev = NULL;
 		arpstat.inuse--;
+		arp_llinfo_changed(rt);
 
 		/*
 		 * Purge any link-layer info caching.
@@ -1319,6 +1344,18 @@ arp_lookup_ip(ifnet_t ifp, const struct sockaddr_in *net_dest,
 		return ENETDOWN;
 	}
 
+	/*
+	 * Neighbors resolved recently are handed out from the cache without
+	 * taking the route lock; llinfo use stamps get refreshed on the next
+	 * miss, at the latest once the cached entry times out.
+	 */
+	if ((packet == NULL || !(packet->m_flags & (M_BCAST | M_MCAST))) &&
+	    !IN_MULTICAST(ntohl(net_dest->sin_addr.s_addr)) &&
+	    llcache_lookup(ifp, (const struct sockaddr *)net_dest, ll_dest,
+	    ll_dest_len)) {
+		return 0;
+	}
+
 	/*
 	 * If we were given a route, verify the route and grab the gateway
 	 */
@@ -1497,6 +1534,8 @@ arp_lookup_ip(ifnet_t ifp, const struct sockaddr_in *net_dest,
 				 * we're not probing and if_addrlen is anything
 				 * but IF_LLREACH_MAXLEN.
 				 */
+				llcache_enter(ifp, rt_key(route), gateway,
+				    route->rt_expire * 1000);
 				goto release;
 			}
 		}
@@ -1635,6 +1674,66 @@ release:
 	return result;
 }
 
+/*
+ * Side-effect free variant of arp_lookup_ip() for callers that cache the
+ * result across packets: hand back the link-layer address of the next
+ * hop only when its entry is complete, reachable and not being probed.
+ * Everything else is left to arp_lookup_ip() on the regular output path,
+ * which takes care of holding packets and sending requests.
+ */
+errno_t
+arp_resolved_ip(ifnet_t ifp, const struct sockaddr_in *net_dest,
+    struct sockaddr_dl *ll_dest, size_t ll_dest_len, route_t hint)
+{
+	route_t route = NULL;
+	struct llinfo_arp *llinfo;
+	struct sockaddr_dl *gateway;
+	uint64_t timenow;
+	errno_t result;
+
+	if (hint == NULL || net_dest->sin_family != AF_INET) {
+		return EINVAL;
+	}
+
+	/*
+	 * Callee holds a reference on the route and returns
+	 * with the route entry locked, upon success.
+	 */
+	result = route_to_gwroute((const struct sockaddr *)net_dest, hint,
+	    &route);
+	if (result != 0) {
+		return result;
+	}
+	if (route == NULL) {
+		return EHOSTUNREACH;
+	}
+	RT_LOCK_ASSERT_HELD(route);
+
+	result = ENOENT;
+	llinfo = route->rt_llinfo;
+	gateway = SDL(route->rt_gateway);
+	timenow = net_uptime();
+	if (llinfo != NULL && route->rt_ifp == ifp &&
+	    (route->rt_expire == 0 || route->rt_expire > timenow) &&
+	    gateway != NULL && gateway->sdl_family == AF_LINK &&
+	    gateway->sdl_alen != 0 &&
+	    !(llinfo->la_flags & LLINFO_PROBING) &&
+	    arp_llreach_reachable(llinfo)) {
+		bcopy(gateway, ll_dest, MIN(gateway->sdl_len, ll_dest_len));
+		arp_llreach_use(llinfo);        /* Mark use timestamp */
+		result = 0;
+	}
+
+	if (route == hint) {
+		RT_REMREF_LOCKED(route);
+		RT_UNLOCK(route);
+	} else {
+		RT_UNLOCK(route);
+		rtfree(route);
+	}
+	return result;
+}
+
 errno_t
 arp_ip_handle_input(ifnet_t ifp, u_short arpop,
     const struct sockaddr_dl *sender_hw, const struct sockaddr_in *sender_ip,
@@ -2075,6 +2174,7 @@ match:
 			}
 			goto respond;
 		}
+		arp_llinfo_changed(route);
 	}
 
 	/* Copy the sender hardware address in to the route's gateway address */
@@ -61,11 +61,15 @@ struct sockaddr_in;
  *		the packet.
  */
 #ifdef BSD_KERNEL_PRIVATE
+extern u_int32_t arp_genid;
 extern boolean_t arp_is_entry_probing(route_t p_route);
 extern errno_t arp_lookup_ip(ifnet_t interface,
     const struct sockaddr_in *ip_dest, struct sockaddr_dl *ll_dest,
     size_t ll_dest_len, route_t hint, mbuf_t packet);
 #define inet_arp_lookup arp_lookup_ip
+extern errno_t arp_resolved_ip(ifnet_t interface,
+    const struct sockaddr_in *ip_dest, struct sockaddr_dl *ll_dest,
+    size_t ll_dest_len, route_t hint);
 #else
 extern errno_t inet_arp_lookup(ifnet_t interface,
     const struct sockaddr_in *ip_dest, struct sockaddr_dl *ll_dest,
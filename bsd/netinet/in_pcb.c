@@ -82,6 +82,7 @@
 
 #include <libkern/OSAtomic.h>
 #include <kern/locks.h>
+#include <kern/smr.h>
 
 #include <machine/limits.h>
 
@@ -250,6 +251,21 @@ SYSCTL_PROC(_net_inet_ip_portrange, OID_AUTO, hilast,
 SYSCTL_INT(_net_inet_ip_portrange, OID_AUTO, ipport_allow_udp_port_exhaustion,
     CTLFLAG_LOCKED | CTLFLAG_RW, &allow_udp_port_exhaustion, 0, "");
 
+/*
+ * The pcb hash tables grow once the pcbs outnumber the hash chains by
+ * this factor; 0 keeps them at their initial size.
+ */
+static int inpcb_hash_load = 2;
+SYSCTL_INT(_net_inet_ip, OID_AUTO, pcbhash_load,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &inpcb_hash_load, 0,
+    "Average pcb hash chain length at which the hash tables grow");
+
+static TUNABLE(uint32_t, inpcb_hash_max, "inpcb_hash_max", 1 << 20);
+
+#define INPCB_HASH_SEGSIZE      512     /* buckets per hash segment */
+#define INPCB_HASH_SPLITS       4       /* max bucket splits per insertion */
+#define INPCB_HASH_HIST_BINS    16
+
 static uint32_t apn_fallbk_debug = 0;
 #define apn_fallbk_log(x)       do { if (apn_fallbk_debug >= 1) log x; } while (0)
 
@@ -558,6 +574,32 @@ in_pcbinfo_attach(struct inpcbinfo *ipi)
 	lck_mtx_unlock(&inpcb_lock);
 }
 
+/*
+ * Set up the hash of a pcbinfo with the given number of chains (rounded
+ * down to a power of 2, as with hashinit()).  A growable hash may later
+ * grow to inpcb_hash_max chains, see in_pcbhash_grow().
+ */
+void
+in_pcbinfo_hashinit(struct inpcbinfo *ipi, int elements, boolean_t growable)
+{
+	struct inpcbhead *seg;
+	u_long mask;
+	u_int32_t segsize, count;
+
+	count = 1U << (fls(MAX(elements, 1)) - 1);
+	segsize = growable ? MAX(count, INPCB_HASH_SEGSIZE) : count;
+	seg = hashinit(segsize, M_PCB, &mask);
+	VERIFY(seg != NULL && mask + 1 == segsize);
+
+	ipi->ipi_hashsegshift = ffs(segsize) - 1;
+	ipi->ipi_hashsegmax = growable ?
+	    MAX(inpcb_hash_max >> ipi->ipi_hashsegshift, 1) : 1;
+	ipi->ipi_hashsegs = kalloc_type(struct inpcbhead *,
+	    ipi->ipi_hashsegmax, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	ipi->ipi_hashsegs[0] = seg;
+	ipi->ipi_hashcount = count;
+}
+
 int
 in_pcbinfo_detach(struct inpcbinfo *ipi)
 {
@@ -1952,6 +1994,14 @@ in_pcbdetach(struct inpcb *inp)
 }
 
 
+static void
+in_pcb_free_smr(void *arg)
+{
+	struct inpcb *inp = arg;
+
+	zfree(inp->inp_pcbinfo->ipi_zone, inp);
+}
+
 void
 in_pcbdispose(struct inpcb *inp)
 {
@@ -2024,7 +2074,8 @@ in_pcbdispose(struct inpcb *inp)
 		 */
 		ROUTE_RELEASE(&inp->inp_route);
 		if ((so->so_flags1 & SOF1_CACHED_IN_SOCK_LAYER) == 0) {
-			zfree(ipi->ipi_zone, inp);
+			/* in_pcblookup_hash() may still be looking at it */
+			smr_global_retire(inp, sizeof(*inp), in_pcb_free_smr);
 		}
 		sodealloc(so);
 	}
@@ -2232,8 +2283,7 @@ in_pcblookup_local(struct inpcbinfo *pcbinfo, struct in_addr laddr,
 		 * Look for an unconnected (wildcard foreign addr) PCB that
 		 * matches the local address and port we're looking for.
 		 */
-		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-		    pcbinfo->ipi_hashmask)];
+		head = INP_PCBHASH_HEAD(pcbinfo, INADDR_ANY, lport, 0);
 		LIST_FOREACH(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV4)) {
 				continue;
@@ -2336,8 +2386,7 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	/*
 	 * First look for an exact match.
 	 */
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr.s_addr, lport, fport,
-	    pcbinfo->ipi_hashmask)];
+	head = INP_PCBHASH_HEAD(pcbinfo, faddr.s_addr, lport, fport);
 	LIST_FOREACH(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV4)) {
 			continue;
@@ -2378,8 +2427,7 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 		return 0;
 	}
 
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-	    pcbinfo->ipi_hashmask)];
+	head = INP_PCBHASH_HEAD(pcbinfo, INADDR_ANY, lport, 0);
 	LIST_FOREACH(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV4)) {
 			continue;
@@ -2439,6 +2487,88 @@ in_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	return found;
 }
 
+/*
+ * Finish a lockless hash lookup: the caller found a candidate PCB under
+ * the global SMR and took a want reference on it.  Apply the receive
+ * policy checks the locked lookup does, which can't run inside the SMR
+ * section.  Returns FALSE (and drops the reference) if the locked lookup
+ * must be used instead.
+ */
+boolean_t
+in_pcbhash_admit(struct inpcb *inp, struct ifnet *ifp)
+{
+	if (inp_restricted_recv(inp, ifp)) {
+		goto fallback;
+	}
+#if NECP
+	if (!necp_socket_is_allowed_to_recv_on_interface(inp, ifp)) {
+		goto fallback;
+	}
+#endif /* NECP */
+	return TRUE;
+
+fallback:
+	in_pcb_checkstate(inp, WNT_RELEASE, 0);
+	return FALSE;
+}
+
+/*
+ * Lockless lookup of an exact { faddr, fport, laddr, lport } match,
+ * which is the common case of demuxing a segment of an established flow.
+ *
+ * Hash chains are walked within the global SMR critical section; inpcbs
+ * are only freed once no such walk can still be looking at them (see
+ * in_pcbdispose()) and keep their forward link when unhashed.  A PCB that
+ * is rehashed concurrently may send us down another chain, so a miss here
+ * is not authoritative and the caller retries with ipi_lock held.
+ */
+static struct inpcb *
+in_pcblookup_hash_smr(struct inpcbinfo *pcbinfo, struct in_addr faddr,
+    u_short fport, struct in_addr laddr, u_short lport, struct ifnet *ifp)
+{
+	struct inpcbhead *head;
+	struct inpcb *inp;
+
+	head = INP_PCBHASH_HEAD(pcbinfo, faddr.s_addr, lport, fport);
+
+	smr_global_enter();
+	for (inp = INP_HASH_FIRST_SMR(head); inp != NULL;
+	    inp = INP_HASH_NEXT_SMR(inp)) {
+		if ((inp->inp_vflag & INP_IPV4) &&
+		    inp->inp_faddr.s_addr == faddr.s_addr &&
+		    inp->inp_laddr.s_addr == laddr.s_addr &&
+		    inp->inp_fport == fport &&
+		    inp->inp_lport == lport) {
+			break;
+		}
+	}
+	if (inp != NULL &&
+	    in_pcb_checkstate(inp, WNT_ACQUIRE, 0) == WNT_STOPUSING) {
+		inp = NULL;
+	}
+	smr_global_leave();
+
+	if (inp == NULL) {
+		return NULL;
+	}
+
+	/*
+	 * The reference keeps the PCB from being disposed of, but it
+	 * may have been rehashed between the match and the acquire.
+	 */
+	if (!(inp->inp_vflag & INP_IPV4) ||
+	    inp->inp_faddr.s_addr != faddr.s_addr ||
+	    inp->inp_laddr.s_addr != laddr.s_addr ||
+	    inp->inp_fport != fport || inp->inp_lport != lport) {
+		in_pcb_checkstate(inp, WNT_RELEASE, 0);
+		return NULL;
+	}
+	if (!in_pcbhash_admit(inp, ifp)) {
+		return NULL;
+	}
+	return inp;
+}
+
 /*
  * Lookup PCB in hash list.
  */
@@ -2454,16 +2584,19 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	struct inpcb *local_wild_mapped = NULL;
 
 	/*
-	 * We may have found the pcb in the last lookup - check this first.
+	 * Established flows are found without taking ipi_lock.
 	 */
+	inp = in_pcblookup_hash_smr(pcbinfo, faddr, fport, laddr, lport, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
 
 	lck_rw_lock_shared(&pcbinfo->ipi_lock);
 
 	/*
 	 * First look for an exact match.
 	 */
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr.s_addr, lport, fport,
-	    pcbinfo->ipi_hashmask)];
+	head = INP_PCBHASH_HEAD(pcbinfo, faddr.s_addr, lport, fport);
 	LIST_FOREACH(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV4)) {
 			continue;
@@ -2505,8 +2638,7 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 		return NULL;
 	}
 
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-	    pcbinfo->ipi_hashmask)];
+	head = INP_PCBHASH_HEAD(pcbinfo, INADDR_ANY, lport, 0);
 	LIST_FOREACH(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV4)) {
 			continue;
@@ -2568,6 +2700,153 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	return NULL;
 }
 
+/*
+ * Insert a PCB at the head of a hash chain.  The PCB is fully linked
+ * before it is published, for the benefit of lockless lookups.
+ */
+static void
+in_pcbhash_insert(struct inpcbhead *head, struct inpcb *inp)
+{
+	struct inpcb *first = LIST_FIRST(head);
+
+	inp->inp_hash.le_next = first;
+	if (first != NULL) {
+		first->inp_hash.le_prev = &inp->inp_hash.le_next;
+	}
+	inp->inp_hash.le_prev = &LIST_FIRST(head);
+	os_atomic_store(&LIST_FIRST(head), inp, release);
+}
+
+/*
+ * The chain for a hash key.  The hash is grown by linear hashing: with
+ * N the largest power of 2 not above ipi_hashcount, keys are taken
+ * modulo 2N, and modulo N if that lands past the chains in use.
+ */
+static inline u_int32_t
+in_pcbhash_index(u_int32_t key, u_int32_t count)
+{
+	u_int32_t low = 1U << (fls(count) - 1);
+	u_int32_t idx = key & ((low << 1) - 1);
+
+	if (idx >= count) {
+		idx &= low - 1;
+	}
+	return idx;
+}
+
+static inline struct inpcbhead *
+in_pcbhash_bucket(struct inpcbinfo *ipi, u_int32_t idx)
+{
+	u_int32_t shift = ipi->ipi_hashsegshift;
+
+	return &ipi->ipi_hashsegs[idx >> shift][idx & ((1U << shift) - 1)];
+}
+
+struct inpcbhead *
+in_pcbhash_head(struct inpcbinfo *ipi, u_int32_t key)
+{
+	/* pairs with the release in in_pcbhash_split() */
+	u_int32_t count = os_atomic_load(&ipi->ipi_hashcount, acquire);
+
+	return in_pcbhash_bucket(ipi, in_pcbhash_index(key, count));
+}
+
+/*
+ * Bring the next chain into use, moving to it the pcbs of the chain it
+ * splits from.  A lockless lookup walking the old chain may follow a
+ * moved pcb onto the new one and miss; it then retries with ipi_lock.
+ */
+static boolean_t
+in_pcbhash_split(struct inpcbinfo *ipi)
+{
+	u_int32_t count = ipi->ipi_hashcount;
+	u_int32_t low = 1U << (fls(count) - 1);
+	u_int32_t seg = count >> ipi->ipi_hashsegshift;
+	struct inpcbhead *from, *to;
+	struct inpcb *inp, *next;
+	u_long mask;
+
+	LCK_RW_ASSERT(&ipi->ipi_lock, LCK_RW_ASSERT_EXCLUSIVE);
+
+	if (seg >= ipi->ipi_hashsegmax) {
+		return FALSE;
+	}
+	if (ipi->ipi_hashsegs[seg] == NULL) {
+		/* published by the ipi_hashcount update below */
+		ipi->ipi_hashsegs[seg] = hashinit(1 << ipi->ipi_hashsegshift,
+		    M_PCB, &mask);
+		if (ipi->ipi_hashsegs[seg] == NULL) {
+			return FALSE;
+		}
+	}
+
+	from = in_pcbhash_bucket(ipi, count - low);
+	to = in_pcbhash_bucket(ipi, count);
+	LIST_FOREACH_SAFE(inp, from, inp_hash, next) {
+		if ((inp->inp_hash_element & ((low << 1) - 1)) == count) {
+			LIST_REMOVE(inp, inp_hash);
+			in_pcbhash_insert(to, inp);
+		}
+	}
+	os_atomic_store(&ipi->ipi_hashcount, count + 1, release);
+	return TRUE;
+}
+
+/*
+ * Called as pcbs are hashed: split a few chains while the load factor
+ * is above inpcb_hash_load, so the table grows along with the pcb count
+ * without ever being rehashed all at once.
+ */
+static void
+in_pcbhash_grow(struct inpcbinfo *ipi)
+{
+	int load = inpcb_hash_load;
+
+	if (load <= 0) {
+		return;
+	}
+	for (int i = 0; i < INPCB_HASH_SPLITS; i++) {
+		if (ipi->ipi_count <= (uint64_t)ipi->ipi_hashcount * load ||
+		    !in_pcbhash_split(ipi)) {
+			break;
+		}
+	}
+}
+
+/*
+ * Histogram of the hash chain lengths of a pcbinfo (arg1): bin i counts
+ * the chains holding i pcbs, the last bin the chains holding more.
+ */
+int
+in_pcbhash_sysctl_hist SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg2)
+	struct inpcbinfo *ipi = arg1;
+	uint32_t hist[INPCB_HASH_HIST_BINS] = { };
+	struct inpcb *inp;
+	uint32_t len;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+	if (req->oldptr == USER_ADDR_NULL) {
+		req->oldidx = sizeof(hist);
+		return 0;
+	}
+
+	lck_rw_lock_shared(&ipi->ipi_lock);
+	for (uint32_t i = 0; i < ipi->ipi_hashcount; i++) {
+		len = 0;
+		LIST_FOREACH(inp, in_pcbhash_bucket(ipi, i), inp_hash) {
+			len++;
+		}
+		hist[MIN(len, INPCB_HASH_HIST_BINS - 1)]++;
+	}
+	lck_rw_done(&ipi->ipi_lock);
+
+	return SYSCTL_OUT(req, hist, sizeof(hist));
+}
+
 /*
  * @brief	Insert PCB onto various hash lists.
  *
@@ -2618,10 +2897,10 @@ in_pcbinshash(struct inpcb *inp, int locked)
 		hashkey_faddr = inp->inp_faddr.s_addr;
 	}
 
-	inp->inp_hash_element = INP_PCBHASH(hashkey_faddr, inp->inp_lport,
-	    inp->inp_fport, pcbinfo->ipi_hashmask);
+	inp->inp_hash_element = INP_PCBHASH_KEY(hashkey_faddr, inp->inp_lport,
+	    inp->inp_fport);
 
-	pcbhash = &pcbinfo->ipi_hashbase[inp->inp_hash_element];
+	pcbhash = in_pcbhash_head(pcbinfo, inp->inp_hash_element);
 
 	pcbporthash = &pcbinfo->ipi_porthashbase[INP_PCBPORTHASH(inp->inp_lport,
 	    pcbinfo->ipi_porthashmask)];
@@ -2674,8 +2953,9 @@ in_pcbinshash(struct inpcb *inp, int locked)
 
 	inp->inp_phd = phd;
 	LIST_INSERT_HEAD(&phd->phd_pcblist, inp, inp_portlist);
-	LIST_INSERT_HEAD(pcbhash, inp, inp_hash);
+	in_pcbhash_insert(pcbhash, inp);
 	inp->inp_flags2 |= INP2_INHASHLIST;
+	in_pcbhash_grow(pcbinfo);
 
 	if (!locked) {
 		lck_rw_done(&pcbinfo->ipi_lock);
@@ -2744,9 +3024,9 @@ in_pcbrehash(struct inpcb *inp)
 		hashkey_faddr = inp->inp_faddr.s_addr;
 	}
 
-	inp->inp_hash_element = INP_PCBHASH(hashkey_faddr, inp->inp_lport,
-	    inp->inp_fport, inp->inp_pcbinfo->ipi_hashmask);
-	head = &inp->inp_pcbinfo->ipi_hashbase[inp->inp_hash_element];
+	inp->inp_hash_element = INP_PCBHASH_KEY(hashkey_faddr, inp->inp_lport,
+	    inp->inp_fport);
+	head = in_pcbhash_head(inp->inp_pcbinfo, inp->inp_hash_element);
 
 	if (inp->inp_flags2 & INP2_INHASHLIST) {
 		LIST_REMOVE(inp, inp_hash);
@@ -2754,7 +3034,7 @@ in_pcbrehash(struct inpcb *inp)
 	}
 
 	VERIFY(!(inp->inp_flags2 & INP2_INHASHLIST));
-	LIST_INSERT_HEAD(head, inp, inp_hash);
+	in_pcbhash_insert(head, inp);
 	inp->inp_flags2 |= INP2_INHASHLIST;
 
 #if NECP
@@ -2782,8 +3062,11 @@ in_pcbremlists(struct inpcb *inp)
 
 		VERIFY(phd != NULL && inp->inp_lport > 0);
 
+		/*
+		 * Leave le_next alone: a lockless lookup may be standing
+		 * on this PCB and has to be able to walk off of it.
+		 */
 		LIST_REMOVE(inp, inp_hash);
-		inp->inp_hash.le_next = NULL;
 		inp->inp_hash.le_prev = NULL;
 
 		LIST_REMOVE(inp, inp_portlist);
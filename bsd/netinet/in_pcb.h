@@ -147,6 +147,24 @@ struct inp_necp_attributes {
 	char *inp_domain_context;
 };
 
+/*
+ * Link-layer destination cached by a connection across calls to
+ * ip_output, so that segments going out over the same route can skip
+ * ARP resolution.  The entry is only trusted while the route it was
+ * resolved through is the one in use and holds the same generation,
+ * arp_genid has not moved, and net.inet.ip.output_l2cache_ttl has not
+ * elapsed.  The rtentry pointer is only compared, never dereferenced.
+ */
+struct ip_l2cache {
+	struct rtentry  *l2c_rt;        /* route resolved through */
+	uint32_t        l2c_rtgen;      /* generation of l2c_rt */
+	uint32_t        l2c_arpgen;     /* arp_genid when resolved */
+	uint64_t        l2c_expire;     /* net_uptime() deadline */
+	uint32_t        l2c_ifindex;    /* outgoing interface */
+	/* prebuilt header handed to the ethernet pre-output routine */
+	struct sockaddr l2c_hdr;
+};
+
 /*
  * struct inpcb captures the network layer state for TCP, UDP and raw IPv6
  * and IPv6 sockets.  In the case of TCP, further per-connection state is
@@ -163,7 +181,7 @@ struct inpcb {
 	RB_ENTRY(inpcb) infc_link;      /* link for flowhash RB tree */
 	struct inpcbport *inp_phd;      /* head of this list */
 	inp_gen_t inp_gencnt;           /* generation count of this instance */
-	int     inp_hash_element;       /* array index of pcb's hash list */
+	u_int32_t inp_hash_element;     /* hash key of pcb's hash list */
 	int     inp_wantcnt;            /* wanted count; atomically updated */
 	int     inp_state;              /* state (INUSE/CACHED/DEAD) */
 	u_short inp_fport;              /* foreign port */
@@ -201,6 +219,7 @@ struct inpcb {
 		struct route inp4_route;
 		struct route_in6 inp6_route;
 	} inp_dependroute;
+	struct ip_l2cache inp_l2cache;  /* next hop resolved via inp_route */
 	struct {
 		/* type of service proto */
 		u_char inp4_ip_tos;
@@ -247,6 +266,7 @@ struct inpcb {
 	u_int8_t inp_keepalive_datalen; /* keepalive data length */
 	u_int8_t inp_keepalive_type;    /* type of application */
 	u_int16_t inp_keepalive_interval; /* keepalive interval */
+	u_int16_t inp_udp_segsz;        /* UDP_SEGMENT payload size */
 	uint32_t inp_nstat_refcnt __attribute__((aligned(4)));
 	struct inp_stat *inp_stat;
 	struct inp_stat *inp_cstat;     /* cellular data */
@@ -608,10 +628,19 @@ struct inpcbinfo {
 
 	/*
 	 * Per-protocol hash of pcbs, hashed by local and foreign
-	 * addresses and port numbers.
+	 * addresses and port numbers.  Modified with ipi_lock held
+	 * exclusive; may be walked under the global SMR instead of
+	 * ipi_lock with the INP_HASH_*_SMR() accessors.
+	 *
+	 * The table grows one bucket at a time (linear hashing) as
+	 * the pcb count goes up, so there's never a full rehash.
+	 * Buckets live in fixed size segments which are never moved
+	 * or freed; use in_pcbhash_head() to find a chain.
 	 */
-	struct inpcbhead        *ipi_hashbase;
-	u_long                  ipi_hashmask;
+	struct inpcbhead        **ipi_hashsegs;
+	u_int32_t               ipi_hashsegshift;
+	u_int32_t               ipi_hashsegmax;
+	u_int32_t               ipi_hashcount;  /* buckets in use */
 
 	/*
 	 * Per-protocol hash of pcbs, hashed by only local port number.
@@ -630,11 +659,18 @@ struct inpcbinfo {
 	u_int32_t               ipi_flags;
 };
 
-#define INP_PCBHASH(faddr, lport, fport, mask) \
-	(((faddr) ^ ((faddr) >> 16) ^ ntohs((lport) ^ (fport))) & (mask))
+#define INP_PCBHASH_KEY(faddr, lport, fport) \
+	((u_int32_t)((faddr) ^ ((faddr) >> 16) ^ ntohs((lport) ^ (fport))))
+#define INP_PCBHASH_HEAD(ipi, faddr, lport, fport) \
+	in_pcbhash_head((ipi), INP_PCBHASH_KEY(faddr, lport, fport))
 #define INP_PCBPORTHASH(lport, mask) \
 	(ntohs((lport)) & (mask))
 
+#define INP_HASH_FIRST_SMR(head) \
+	os_atomic_load(&LIST_FIRST(head), dependency)
+#define INP_HASH_NEXT_SMR(inp) \
+	os_atomic_load(&LIST_NEXT(inp, inp_hash), dependency)
+
 #define INP_IS_FLOW_CONTROLLED(_inp_) \
 	((_inp_)->inp_flags & INP_FLOW_CONTROLLED)
 #define INP_IS_FLOW_SUSPENDED(_inp_) \
@@ -738,6 +774,7 @@ struct inpcbinfo {
 #define INP2_NO_IFF_CONSTRAINED 0x00000800 /* do not use constrained interface */
 #define INP2_DONTFRAG           0x00001000 /* mark the DF bit in the IP header to avoid fragmentation */
 #define INP2_SCOPED_BY_NECP     0x00002000 /* NECP scoped the pcb */
+#define INP2_UDP_GRO            0x00004000 /* coalesce received UDP datagrams */
 
 /*
  * Flags passed to in_pcblookup*() functions.
@@ -774,6 +811,12 @@ extern int allow_udp_port_exhaustion;
 
 extern void in_pcbinit(void);
 extern void in_pcbinfo_attach(struct inpcbinfo *);
+extern void in_pcbinfo_hashinit(struct inpcbinfo *, int, boolean_t);
+extern struct inpcbhead *in_pcbhash_head(struct inpcbinfo *, u_int32_t);
+struct sysctl_oid;
+struct sysctl_req;
+extern int in_pcbhash_sysctl_hist(struct sysctl_oid *, void *, int,
+    struct sysctl_req *);
 extern int in_pcbinfo_detach(struct inpcbinfo *);
 
 /* type of timer to be scheduled by inpcb_gc_sched and inpcb_timer_sched */
@@ -805,6 +848,7 @@ extern struct inpcb *in_pcblookup_hash(struct inpcbinfo *, struct in_addr,
     u_int, struct in_addr, u_int, int, struct ifnet *);
 extern int in_pcblookup_hash_exists(struct inpcbinfo *, struct in_addr,
     u_int, struct in_addr, u_int, int, uid_t *, gid_t *, struct ifnet *);
+extern boolean_t in_pcbhash_admit(struct inpcb *, struct ifnet *);
 extern void in_pcbnotifyall(struct inpcbinfo *, struct in_addr, int,
     void (*)(struct inpcb *, int));
 extern void in_pcbrehash(struct inpcb *);
@@ -120,6 +120,7 @@
 #include <netinet/kpi_ipfilter_var.h>
 #include <netinet/udp.h>
 #include <netinet/udp_var.h>
+#include <netinet/tcp_var.h>
 #include <netinet/bootp.h>
 
 #if DUMMYNET
@@ -815,6 +816,39 @@ ip_input_update_nstat(struct ifnet *ifp, struct in_addr src_ip,
 	}
 }
 
+/*
+ * Without IP filters to run, a TCP chain can go to tcp_input_chain() as a
+ * whole, letting consecutive segments of a connection share the pcb lookup
+ * and socket lock; this only needs to do the per-packet part of
+ * ip_proto_dispatch_in() up front.
+ */
+static void
+ip_input_dispatch_tcp_chain(struct mbuf *m)
+{
+	struct mbuf *head = NULL, **tailp = &head;
+	struct mbuf *nxt_mbuf;
+	struct ip *ip;
+	boolean_t first = TRUE;
+
+	for (; m != NULL; m = nxt_mbuf, first = FALSE) {
+		nxt_mbuf = mbuf_nextpkt(m);
+		mbuf_setnextpkt(m, NULL);
+		if (!first) {
+			/* first mbuf of chain already has adjusted ip_len */
+			ip = mtod(m, struct ip *);
+			ip->ip_len -= IP_VHL_HL(ip->ip_vhl) << 2;
+		}
+		IP_HDR_ALIGNMENT_FIXUP(m, m->m_pkthdr.rcvif, goto next);
+		*tailp = m;
+		tailp = &m->m_nextpkt;
+next:
+		;
+	}
+	if (head != NULL) {
+		tcp_input_chain(head);
+	}
+}
+
 static void
 ip_input_dispatch_chain(struct mbuf *m)
 {
@@ -825,6 +859,11 @@ ip_input_dispatch_chain(struct mbuf *m)
 
 	ip = mtod(tmp_mbuf, struct ip *);
 	hlen = IP_VHL_HL(ip->ip_vhl) << 2;
+	if (ip->ip_p == IPPROTO_TCP && mbuf_nextpkt(m) != NULL &&
+	    TAILQ_EMPTY(&ipv4_filters)) {
+		ip_input_dispatch_tcp_chain(m);
+		return;
+	}
 	while (tmp_mbuf != NULL) {
 		nxt_mbuf = mbuf_nextpkt(tmp_mbuf);
 		mbuf_setnextpkt(tmp_mbuf, NULL);
@@ -76,6 +76,7 @@
 #include <sys/protosw.h>
 #include <sys/socket.h>
 #include <sys/socketvar.h>
+#include <kern/counter.h>
 #include <kern/locks.h>
 #include <sys/sysctl.h>
 #include <sys/mcache.h>
@@ -88,6 +89,7 @@
 #include <libkern/OSAtomic.h>
 #include <libkern/OSByteOrder.h>
 
+#include <net/ethernet.h>
 #include <net/if.h>
 #include <net/if_dl.h>
 #include <net/if_types.h>
@@ -98,6 +100,7 @@
 #include <net/net_perf.h>
 
 #include <netinet/in.h>
+#include <netinet/in_arp.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
 #include <netinet/in_pcb.h>
@@ -151,6 +154,8 @@ static void imo_trace(struct ip_moptions *, int);
 static void ip_mloopback(struct ifnet *, struct ifnet *, struct mbuf *,
     struct sockaddr_in *, int);
 static struct ifaddr *in_selectsrcif(struct ip *, struct route *, unsigned int);
+static const struct sockaddr *ip_output_l2dst(struct ip_l2cache *,
+    struct route *, struct ifnet *, struct mbuf *, struct sockaddr_in *);
 
 extern struct ip_linklocal_stat ip_linklocal_stat;
 
@@ -170,6 +175,23 @@ SYSCTL_INT(_net_inet_ip, OID_AUTO, forge_ce,
     "Forge ECN CE");
 #endif /* DEBUG */
 
+static int ip_output_l2cache = 1;
+SYSCTL_INT(_net_inet_ip, OID_AUTO, output_l2cache,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &ip_output_l2cache, 0,
+    "Let connections cache the resolved link-layer destination");
+
+static int ip_l2cache_ttl = 1;
+SYSCTL_INT(_net_inet_ip, OID_AUTO, output_l2cache_ttl,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &ip_l2cache_ttl, 0,
+    "Seconds a cached link-layer destination is trusted");
+
+SCALABLE_COUNTER_DEFINE(ip_l2cache_hits);
+SYSCTL_SCALABLE_COUNTER(_net_inet_ip, output_l2cache_hits, ip_l2cache_hits,
+    "Packets sent with a cached link-layer destination");
+SCALABLE_COUNTER_DEFINE(ip_l2cache_misses);
+SYSCTL_SCALABLE_COUNTER(_net_inet_ip, output_l2cache_misses,
+    ip_l2cache_misses, "Link-layer destination cache misses");
+
 static int ip_select_srcif_debug = 0;
 SYSCTL_INT(_net_inet_ip, OID_AUTO, select_srcif_debug,
     CTLFLAG_RW | CTLFLAG_LOCKED, &ip_select_srcif_debug, 0,
@@ -394,6 +416,9 @@ ip_output_list(struct mbuf *m0, int packetchain, struct mbuf *opt,
 		if ((dn_tag->dn_flags & IP_OUTARGS)) {
 			saved_ipoa = dn_tag->dn_ipoa;
 			ipoa = &saved_ipoa;
+			/* the caller's cache is long gone by now */
+			saved_ipoa.ipoa_flags &= ~IPOAF_L2CACHE;
+			saved_ipoa.ipoa_l2cache = NULL;
 		}
 
 		m_tag_delete(m0, tag);
@@ -1596,6 +1621,8 @@ skip_ipsec:
 			}
 
 			error = dlil_output(ifp, PF_INET, m, ro->ro_rt,
+			    (ipoa != NULL && (ipoa->ipoa_flags & IPOAF_L2CACHE)) ?
+			    ip_output_l2dst(ipoa->ipoa_l2cache, ro, ifp, m, dst) :
 			    SA(dst), 0, adv);
 			if (dlil_verbose && error) {
 				printf("dlil_output error on interface %s: %d\n",
@@ -1624,7 +1651,10 @@ sendchain:
 				}
 
 				error = dlil_output(ifp, PF_INET, packetlist,
-				    ro->ro_rt, SA(dst), 0, adv);
+				    ro->ro_rt, (ipoa != NULL &&
+				    (ipoa->ipoa_flags & IPOAF_L2CACHE)) ?
+				    ip_output_l2dst(ipoa->ipoa_l2cache, ro, ifp,
+				    packetlist, dst) : SA(dst), 0, adv);
 				if (dlil_verbose && error) {
 					printf("dlil_output error on interface %s: %d\n",
 					    ifp->if_xname, error);
@@ -3021,6 +3051,71 @@ ip_mloopback(struct ifnet *srcifp, struct ifnet *origifp, struct mbuf *m,
 	dlil_output(lo_ifp, PF_INET, copym, NULL, SA(dst), 0, NULL);
 }
 
+/*
+ * Pick the destination handed to dlil_output() for a packet going out on
+ * ifp through ro.  If the caller's link-layer cache still describes the
+ * route in use, return its prebuilt ethernet header; the ethernet
+ * pre-output routine then takes the destination from it as is, skipping
+ * the route and ARP lookup.  Otherwise try to refill the cache from a
+ * complete ARP entry, and fall back to dst (and to the regular ARP path)
+ * when there is none.
+ */
+static const struct sockaddr *
+ip_output_l2dst(struct ip_l2cache *l2c, struct route *ro, struct ifnet *ifp,
+    struct mbuf *m, struct sockaddr_in *dst)
+{
+	struct sockaddr_dl ll_dest = {};
+	struct ether_header *eh;
+	struct rtentry *rt = ro->ro_rt;
+	uint32_t arpgen;
+	uint64_t now;
+
+	if (!ip_output_l2cache || rt == NULL || rt->rt_ifp != ifp ||
+	    ifp->if_type != IFT_ETHER ||
+	    ifp->if_family != IFNET_FAMILY_ETHERNET ||
+	    (ifp->if_flags & IFF_NOARP) || IS_INTF_CLAT46(ifp) ||
+	    (m->m_flags & (M_BCAST | M_MCAST))) {
+		l2c->l2c_rt = NULL;
+		return SA(dst);
+	}
+
+	now = net_uptime();
+	arpgen = arp_genid;
+	if (l2c->l2c_rt == rt && l2c->l2c_rtgen == rt->rt_genid &&
+	    l2c->l2c_arpgen == arpgen &&
+	    l2c->l2c_ifindex == ifp->if_index && now < l2c->l2c_expire) {
+		counter_inc(&ip_l2cache_hits);
+		return &l2c->l2c_hdr;
+	}
+	counter_inc(&ip_l2cache_misses);
+	l2c->l2c_rt = NULL;
+
+	/*
+	 * arp_genid was sampled before the lookup, so a change racing
+	 * with it invalidates the entry on the next packet.
+	 */
+	if (arp_resolved_ip(ifp, dst, &ll_dest, sizeof(ll_dest), rt) != 0 ||
+	    ll_dest.sdl_alen != ETHER_ADDR_LEN ||
+	    ETHER_IS_MULTICAST(LLADDR(&ll_dest)) ||
+	    bcmp(LLADDR(&ll_dest), IF_LLADDR(ifp), ETHER_ADDR_LEN) == 0) {
+		return SA(dst);
+	}
+
+	bzero(&l2c->l2c_hdr, sizeof(l2c->l2c_hdr));
+	l2c->l2c_hdr.sa_len = sizeof(l2c->l2c_hdr);
+	l2c->l2c_hdr.sa_family = AF_UNSPEC;
+	eh = (struct ether_header *)(void *)l2c->l2c_hdr.sa_data;
+	bcopy(LLADDR(&ll_dest), eh->ether_dhost, ETHER_ADDR_LEN);
+	eh->ether_type = htons(ETHERTYPE_IP);
+
+	l2c->l2c_rt = rt;
+	l2c->l2c_rtgen = rt->rt_genid;
+	l2c->l2c_arpgen = arpgen;
+	l2c->l2c_ifindex = ifp->if_index;
+	l2c->l2c_expire = now + ip_l2cache_ttl;
+	return &l2c->l2c_hdr;
+}
+
 /*
  * Given a source IP address (and route, if available), determine the best
  * interface to send the packet from.  Checking for (and updating) the
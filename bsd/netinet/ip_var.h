@@ -268,6 +268,7 @@ struct ip_moptions;
 struct ip;
 struct inpcb;
 struct route;
+struct ip_l2cache;
 struct sockopt;
 
 #include <kern/zalloc.h>
@@ -294,9 +295,11 @@ struct ip_out_args {
 #define IPOAF_NO_CONSTRAINED    0x00000400      /* skip IFXF_CONSTRAINED */
 #define IPOAF_REDO_QOSMARKING_POLICY    0x00002000      /* Re-evaluate QOS marking policy */
 #define IPOAF_R_IFDENIED 0x00004000      /* denied access to interface */
+#define IPOAF_L2CACHE   0x00008000      /* ipoa_l2cache is valid */
 	int             ipoa_sotc;      /* traffic class for Fastlane DSCP mapping */
 	int             ipoa_netsvctype; /* network service type */
 	int32_t         qos_marking_gencount;
+	struct ip_l2cache *ipoa_l2cache; /* caller's link-layer cache */
 };
 
 #define IPOAF_RET_MASK (IPOAF_R_IFDENIED)
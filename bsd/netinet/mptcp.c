@@ -693,11 +693,16 @@ mptcp_output(struct mptses *mpte)
 
 	old_snd_nxt = mp_tp->mpt_sndnxt;
 	while (mptcp_can_send_more(mp_tp, FALSE)) {
+		boolean_t new_data;
+
 		/* get the "best" subflow to be used for transmission */
 		mpts = mptcp_get_subflow(mpte, &preferred_mpts);
 		if (mpts == NULL) {
 			break;
 		}
+		/* Reinjected data already on this subflow is skipped for new data */
+		new_data = (mpte->mpte_reinjectq == NULL ||
+		    mptcp_search_seq_in_sub(mpte->mpte_reinjectq, mpts->mpts_socket));
 
 		/* In case there's just one flow, we reattempt later */
 		if (mpts_tried != NULL &&
@@ -745,6 +750,11 @@ mptcp_output(struct mptses *mpte)
 		/* The model is to have only one active flow at a time */
 		mpts->mpts_flags |= MPTSF_ACTIVE;
 		mpts->mpts_probesoon = mpts->mpts_probecnt = 0;
+		mpts->mpts_sched_picks++;
+
+		if (new_data && MPTCP_SCHED(mpte)->sent != NULL) {
+			MPTCP_SCHED(mpte)->sent(mpte, mpts);
+		}
 
 		/* Allows us to update the smoothed rtt */
 		if (mptcp_probeto && mpts != preferred_mpts && preferred_mpts != NULL) {
@@ -845,6 +855,16 @@ mptcp_subflow_is_slow(struct mptses *mpte, struct mptsub *mpts)
  */
 struct mptsub *
 mptcp_get_subflow(struct mptses *mpte, struct mptsub **preferred)
+{
+	return MPTCP_SCHED(mpte)->get_subflow(mpte, preferred);
+}
+
+/*
+ * The default scheduler: prefer the best non-cellular subflow and pick
+ * between it and the best cellular one according to the service type.
+ */
+struct mptsub *
+mptcp_default_get_subflow(struct mptses *mpte, struct mptsub **preferred)
 {
 	struct tcpcb *besttp, *secondtp;
 	struct inpcb *bestinp, *secondinp;
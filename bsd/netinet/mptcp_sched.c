@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * MPTCP packet schedulers.
+ *
+ * The scheduler decides which subflow carries the next chunk of data.
+ * The default one lives in mptcp.c and follows the service type.  The
+ * others here are chosen per socket with the MPTCP_SCHEDULER option:
+ *
+ * - minrtt: send on the subflow expected to deliver the data first,
+ *   i.e. the one whose smoothed RTT plus the time to drain what is
+ *   already queued on it is the smallest.
+ *
+ * - redundant: send new data on the minrtt subflow and queue a copy of it
+ *   for every other subflow through the reinject queue, trading capacity
+ *   for latency and loss resilience.
+ *
+ * Both hand over to the default scheduler while the connection is still
+ * doing TFO or has fallen back to a single, degraded subflow.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/mbuf.h>
+#include <sys/socket.h>
+#include <sys/socketvar.h>
+
+#include <net/if.h>
+#include <net/if_var.h>
+#include <netinet/in.h>
+#include <netinet/in_pcb.h>
+#include <netinet/tcp.h>
+#include <netinet/tcp_fsm.h>
+#include <netinet/tcp_var.h>
+#include <netinet/mptcp_var.h>
+
+static struct mptcp_sched_algo mptcp_sched_default = {
+	.name = "default",
+	.get_subflow = mptcp_default_get_subflow,
+};
+
+static struct mptsub *mptcp_minrtt_get_subflow(struct mptses *, struct mptsub **);
+
+static struct mptcp_sched_algo mptcp_sched_minrtt = {
+	.name = "minrtt",
+	.get_subflow = mptcp_minrtt_get_subflow,
+};
+
+static struct mptsub *mptcp_redundant_get_subflow(struct mptses *, struct mptsub **);
+static void mptcp_redundant_sent(struct mptses *, struct mptsub *);
+
+static struct mptcp_sched_algo mptcp_sched_redundant = {
+	.name = "redundant",
+	.get_subflow = mptcp_redundant_get_subflow,
+	.sent = mptcp_redundant_sent,
+};
+
+struct mptcp_sched_algo *mptcp_sched_algo_list[MPTCP_SCHEDULER_MAX] = {
+	[MPTCP_SCHEDULER_DEFAULT] = &mptcp_sched_default,
+	[MPTCP_SCHEDULER_MINRTT] = &mptcp_sched_minrtt,
+	[MPTCP_SCHEDULER_REDUNDANT] = &mptcp_sched_redundant,
+};
+
+/*
+ * Returns 1 if mpts may carry MPTCP data, 0 if not and -1 if the session
+ * is in a state only the default scheduler knows how to handle.
+ */
+static int
+mptcp_sched_usable(struct mptsub *mpts)
+{
+	struct socket *so = mpts->mpts_socket;
+	struct tcpcb *tp = sototcpcb(so);
+	struct inpcb *inp = sotoinpcb(so);
+
+	if (inp->inp_last_outifp == NULL || INP_WAIT_FOR_IF_FEEDBACK(inp)) {
+		return 0;
+	}
+
+	if ((mpts->mpts_flags & MPTSF_MP_DEGRADED) ||
+	    (so->so_flags1 & SOF1_PRECONNECT_DATA)) {
+		return -1;
+	}
+
+	if (!(mpts->mpts_flags & MPTSF_MP_CAPABLE)) {
+		return 0;
+	}
+
+	if ((so->so_state & SS_ISDISCONNECTED) ||
+	    !(so->so_state & SS_ISCONNECTED) ||
+	    !TCPS_HAVEESTABLISHED(tp->t_state) ||
+	    tp->t_state > TCPS_CLOSE_WAIT) {
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Expected time, in scaled RTT units, until a byte queued now on mpts
+ * reaches the peer: one RTT plus the time to drain what is already
+ * sitting in the subflow's send buffer at one congestion window per RTT.
+ * Subflows in retransmission back off like their timer does.
+ */
+static uint64_t
+mptcp_sched_completion(struct mptsub *mpts)
+{
+	struct socket *so = mpts->mpts_socket;
+	struct tcpcb *tp = sototcpcb(so);
+	uint64_t srtt, cwnd;
+
+	srtt = tp->t_srtt;
+	if (srtt == 0) {
+		/* Nothing measured yet, assume the retransmit timeout */
+		srtt = (uint64_t)tp->t_rxtcur << TCP_RTT_SHIFT;
+	}
+	cwnd = MAX(tp->snd_cwnd, tp->t_maxseg);
+	if (cwnd == 0) {
+		cwnd = 1;
+	}
+
+	return (srtt + srtt * so->so_snd.sb_cc / cwnd) << MIN(tp->t_rxtshift, 8);
+}
+
+static struct mptsub *
+mptcp_minrtt_get_subflow(struct mptses *mpte, struct mptsub **preferred)
+{
+	struct mptsub *mpts, *best = NULL;
+	uint64_t best_ect = UINT64_MAX;
+
+	TAILQ_FOREACH(mpts, &mpte->mpte_subflows, mpts_entry) {
+		uint64_t ect;
+		int usable = mptcp_sched_usable(mpts);
+
+		if (usable < 0) {
+			return mptcp_default_get_subflow(mpte, preferred);
+		}
+		if (usable == 0 ||
+		    mptcp_subflow_cwnd_space(mpts->mpts_socket) <= 0) {
+			continue;
+		}
+
+		ect = mptcp_sched_completion(mpts);
+		if (ect < best_ect) {
+			best_ect = ect;
+			best = mpts;
+		}
+	}
+
+	/* Every subflow gets traffic, there is no preferred one to probe */
+	if (preferred != NULL) {
+		*preferred = NULL;
+	}
+
+	return best;
+}
+
+static struct mptsub *
+mptcp_redundant_get_subflow(struct mptses *mpte, struct mptsub **preferred)
+{
+	struct mbuf *m;
+
+	/*
+	 * Copies waiting in the reinject queue go to the quickest subflow
+	 * that does not carry them yet.  A copy every usable subflow already
+	 * carries has nowhere left to go and is dropped; the original stays
+	 * in the subflows' send buffers until it is acknowledged.
+	 */
+	while ((m = mpte->mpte_reinjectq) != NULL) {
+		struct mptsub *mpts, *best = NULL;
+		uint64_t best_ect = UINT64_MAX;
+		int usable_count = 0, missing_count = 0;
+
+		TAILQ_FOREACH(mpts, &mpte->mpte_subflows, mpts_entry) {
+			uint64_t ect;
+			int usable = mptcp_sched_usable(mpts);
+
+			if (usable < 0) {
+				return mptcp_default_get_subflow(mpte, preferred);
+			}
+			if (usable == 0) {
+				continue;
+			}
+			usable_count++;
+			if (mptcp_search_seq_in_sub(m, mpts->mpts_socket)) {
+				continue;
+			}
+			missing_count++;
+			if (mptcp_subflow_cwnd_space(mpts->mpts_socket) <= 0) {
+				continue;
+			}
+
+			ect = mptcp_sched_completion(mpts);
+			if (ect < best_ect) {
+				best_ect = ect;
+				best = mpts;
+			}
+		}
+
+		if (best != NULL) {
+			if (preferred != NULL) {
+				*preferred = NULL;
+			}
+			return best;
+		}
+		if (missing_count != 0 &&
+		    !mptcp_can_send_more(mpte->mpte_mptcb, TRUE)) {
+			/*
+			 * Wait for a subflow that lacks the copy to open its
+			 * window; sending on one that has it would fail.
+			 */
+			return NULL;
+		}
+		if (usable_count == 0 || missing_count != 0) {
+			break;
+		}
+
+		mpte->mpte_reinjectq = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+		m_freem(m);
+	}
+
+	return mptcp_minrtt_get_subflow(mpte, preferred);
+}
+
+static void
+mptcp_redundant_sent(struct mptses *mpte, struct mptsub *mpts)
+{
+	struct mptsub *other;
+
+	/* Only worth copying if some other subflow can carry it */
+	TAILQ_FOREACH(other, &mpte->mpte_subflows, mpts_entry) {
+		if (other != mpts && mptcp_sched_usable(other) > 0) {
+			mptcp_reinject_mbufs(mpts->mpts_socket);
+			return;
+		}
+	}
+}
@@ -2959,7 +2959,7 @@ mptcp_handle_input(struct socket *so)
 	mptcp_handle_deferred_upcalls(mpte->mpte_mppcb, MPP_INPUT_HANDLE);
 }
 
-static boolean_t
+boolean_t
 mptcp_search_seq_in_sub(struct mbuf *m, struct socket *so)
 {
 	struct mbuf *so_m = so->so_snd.sb_mb;
@@ -3318,6 +3318,12 @@ done_sending:
 			}
 		}
 
+		if (reinjected) {
+			mpts->mpts_sched_reinj_bytes += tot_sent;
+		} else if (!(flags & MPTCP_SUBOUT_PROBING)) {
+			mpts->mpts_sched_bytes += tot_sent;
+		}
+
 		if (!reinjected && !(flags & MPTCP_SUBOUT_PROBING)) {
 			if (MPTCP_DATASEQ_HIGH32(new_sndnxt) >
 			    MPTCP_DATASEQ_HIGH32(mp_tp->mpt_sndnxt)) {
@@ -3534,7 +3540,7 @@ err:
 	return NULL;
 }
 
-static void
+void
 mptcp_reinject_mbufs(struct socket *so)
 {
 	struct tcpcb *tp = sototcpcb(so);
@@ -6079,6 +6085,9 @@ fill_mptcp_subflow(struct socket *so, mptcp_flow_t *flow, struct mptsub *mpts)
 	flow->flow_relseq = mpts->mpts_rel_seq;
 	flow->flow_soerror = mpts->mpts_socket->so_error;
 	flow->flow_probecnt = mpts->mpts_probecnt;
+	flow->flow_sched_picks = mpts->mpts_sched_picks;
+	flow->flow_sched_bytes = mpts->mpts_sched_bytes;
+	flow->flow_sched_reinj_bytes = mpts->mpts_sched_reinj_bytes;
 }
 
 static int
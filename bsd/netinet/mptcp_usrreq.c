@@ -1769,6 +1769,21 @@ mptcp_setopt(struct mptses *mpte, struct sockopt *sopt)
 				mpte->mpte_flags &= ~MPTE_FORCE_ENABLE;
 			}
 
+			goto out;
+		case MPTCP_SCHEDULER:
+			/* record at MPTCP level */
+			error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval));
+			if (error) {
+				goto err_out;
+			}
+			if (optval < 0 || optval >= MPTCP_SCHEDULER_MAX) {
+				error = EINVAL;
+				goto err_out;
+			}
+
+			mpte->mpte_sched_index = (uint8_t)optval;
+
 			goto out;
 		case MPTCP_FORCE_VERSION:
 			error = sooptcopyin(sopt, &optval, sizeof(optval),
@@ -2115,6 +2130,9 @@ mptcp_getopt(struct mptses *mpte, struct sockopt *sopt)
 	case MPTCP_FORCE_ENABLE:
 		optval = !!(mpte->mpte_flags & MPTE_FORCE_ENABLE);
 		break;
+	case MPTCP_SCHEDULER:
+		optval = mpte->mpte_sched_index;
+		break;
 	case MPTCP_FORCE_VERSION:
 		if (mpte->mpte_flags & MPTE_FORCE_V0) {
 			optval = 0;
@@ -2310,6 +2328,8 @@ mptcp_sopt2str(int level, int optname)
 			return "MPTCP_FORCE_ENABLE";
 		case MPTCP_FORCE_VERSION:
 			return "MPTCP_FORCE_VERSION";
+		case MPTCP_SCHEDULER:
+			return "MPTCP_SCHEDULER";
 		case MPTCP_EXPECTED_PROGRESS_TARGET:
 			return "MPTCP_EXPECTED_PROGRESS_TARGET";
 		}
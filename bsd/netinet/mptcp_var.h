@@ -120,6 +120,7 @@ struct mptses {
 	uint8_t mpte_svctype;                   /* MPTCP Service type */
 	uint8_t mpte_lost_aid;                  /* storing lost address id */
 	uint8_t mpte_addrid_last;               /* storing address id parm */
+	uint8_t mpte_sched_index;               /* packet scheduler, see mptcp_sched.c */
 
 #define MPTE_ITFINFO_SIZE       4
 	uint32_t        mpte_itfinfo_size;
@@ -213,6 +214,27 @@ mptcp_subflow_cwnd_space(struct socket *so)
 	return MIN(cwnd, sbspace(&so->so_snd));
 }
 
+/*
+ * MPTCP packet schedulers, selected per socket with MPTCP_SCHEDULER.
+ * The index of each scheduler in mptcp_sched_algo_list is the value of
+ * the socket option.
+ */
+#define MPTCP_SCHED_NAME_MAX    16
+
+struct mptcp_sched_algo {
+	char name[MPTCP_SCHED_NAME_MAX];
+
+	/* pick the subflow for the next transmission, NULL if none can send */
+	struct mptsub *(*get_subflow)(struct mptses *mpte, struct mptsub **preferred);
+
+	/* called after new (not reinjected) data went out on mpts */
+	void (*sent)(struct mptses *mpte, struct mptsub *mpts);
+};
+
+extern struct mptcp_sched_algo *mptcp_sched_algo_list[];
+
+#define MPTCP_SCHED(mpte) (mptcp_sched_algo_list[(mpte)->mpte_sched_index])
+
 static inline bool
 mptcp_subflows_need_backup_flag(struct mptses *mpte)
 {
@@ -266,6 +288,9 @@ struct mptsub {
 	uint32_t                mpts_probesoon; /* send probe after probeto */
 	uint32_t                mpts_probecnt;  /* number of probes sent */
 	uint32_t                mpts_maxseg;    /* cached value of t_maxseg */
+	uint32_t                mpts_sched_picks;       /* times chosen by the scheduler */
+	uint64_t                mpts_sched_bytes;       /* new data sent on this subflow */
+	uint64_t                mpts_sched_reinj_bytes; /* reinjected/redundant data sent */
 };
 
 /*
@@ -617,6 +642,9 @@ extern void mptcp_output_getm_data_level_details(struct socket *so, int off,
     uint16_t *data_len, uint16_t *dss_csum);
 extern void mptcp_act_on_txfail(struct socket *);
 extern struct mptsub *mptcp_get_subflow(struct mptses *mpte, struct mptsub **preferred);
+extern struct mptsub *mptcp_default_get_subflow(struct mptses *mpte, struct mptsub **preferred);
+extern boolean_t mptcp_search_seq_in_sub(struct mbuf *m, struct socket *so);
+extern void mptcp_reinject_mbufs(struct socket *so);
 extern int mptcp_get_map_for_dsn(struct socket *so, uint64_t dsn_fail, uint32_t *tcp_seq);
 extern int32_t mptcp_adj_sendlen(struct socket *so, int32_t off);
 extern void mptcp_sbrcv_grow(struct mptcb *mp_tp);
@@ -657,6 +685,9 @@ typedef struct mptcp_flow {
 	uint32_t                flow_relseq;    /* last subflow rel seq# */
 	int32_t                 flow_soerror;   /* subflow level error */
 	uint32_t                flow_probecnt;  /* number of probes sent */
+	uint32_t                flow_sched_picks;       /* times chosen by the scheduler */
+	uint64_t                flow_sched_bytes;       /* new data sent */
+	uint64_t                flow_sched_reinj_bytes; /* reinjected/redundant data sent */
 	conninfo_tcp_t          flow_ci;        /* must be the last field */
 } mptcp_flow_t;
 
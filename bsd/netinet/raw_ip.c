@@ -155,9 +155,9 @@ rip_init(struct protosw *pp, struct domain *dp)
 	/*
 	 * XXX We don't use the hash list for raw IP, but it's easier
 	 * to allocate a one entry hash list than it is to check all
-	 * over the place for ipi_hashbase == NULL.
+	 * over the place for ipi_hashsegs == NULL.
 	 */
-	ripcbinfo.ipi_hashbase = hashinit(1, M_PCB, &ripcbinfo.ipi_hashmask);
+	in_pcbinfo_hashinit(&ripcbinfo, 1, FALSE);
 	ripcbinfo.ipi_porthashbase = hashinit(1, M_PCB, &ripcbinfo.ipi_porthashmask);
 
 	ripcbinfo.ipi_zone = zone_create("ripzone", sizeof(struct inpcb),
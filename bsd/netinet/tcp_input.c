@@ -119,6 +119,7 @@
 #include <netinet/tcp_var.h>
 #include <netinet/tcp_cc.h>
 #include <dev/random/randomdev.h>
+#include <kern/counter.h>
 #include <kern/zalloc.h>
 #include <netinet6/tcp6_var.h>
 #include <netinet/tcpip.h>
@@ -168,6 +169,17 @@ SYSCTL_SKMEM_TCP_INT(OID_AUTO, ack_strategy,
     CTLFLAG_RW | CTLFLAG_LOCKED, int, tcp_ack_strategy, TCP_ACK_STRATEGY_MODERN,
     "Revised TCP ACK-strategy, avoiding stretch-ACK implementation");
 
+SYSCTL_SKMEM_TCP_INT(OID_AUTO, input_batch,
+    CTLFLAG_RW | CTLFLAG_LOCKED, int, tcp_input_batch, 1,
+    "Process runs of segments for one connection under a single lookup");
+
+SCALABLE_COUNTER_DEFINE(tcp_input_batches);
+SYSCTL_SCALABLE_COUNTER(_net_inet_tcp, input_batches, tcp_input_batches,
+    "Runs of segments processed under a single pcb lookup");
+SCALABLE_COUNTER_DEFINE(tcp_input_batched);
+SYSCTL_SCALABLE_COUNTER(_net_inet_tcp, input_batched, tcp_input_batched,
+    "Segments processed as part of a run");
+
 static int blackhole = 0;
 SYSCTL_INT(_net_inet_tcp, OID_AUTO, blackhole,
     CTLFLAG_RW | CTLFLAG_LOCKED, &blackhole, 0,
@@ -1866,8 +1878,17 @@ tcp_input_ip_ecn(struct tcpcb *tp, struct inpcb *inp, uint32_t tlen, uint32_t se
 	}
 }
 
-void
-tcp_input(struct mbuf *m, int off0)
+/*
+ * Segments of a batch handed in by tcp_input_chain() arrive with the
+ * socket already locked and referenced; leave both to the caller.
+ */
+#define TCP_INPUT_UNLOCK(_so) do {                                      \
+	if (batch_inp == NULL || (_so) != batch_inp->inp_socket)        \
+	        socket_unlock((_so), 1);                                \
+} while (0)
+
+static void
+tcp_input_internal(struct mbuf *m, int off0, struct inpcb *batch_inp)
 {
 	int exiting_fr = 0;
 	struct tcphdr *th;
@@ -2137,7 +2158,9 @@ findpcb:
 	isconnected = FALSE;
 	isdisconnected = FALSE;
 
-	if (isipv6) {
+	if (batch_inp != NULL) {
+		inp = batch_inp;
+	} else if (isipv6) {
 		inp = in6_pcblookup_hash(&tcbinfo, &ip6->ip6_src, th->th_sport, ip6_input_getsrcifscope(m),
 		    &ip6->ip6_dst, th->th_dport, ip6_input_getdstifscope(m), 1,
 		    m->m_pkthdr.rcvif);
@@ -2243,8 +2266,13 @@ findpcb:
 		goto dropnosock;
 	}
 
-	socket_lock(so, 1);
-	if (in_pcb_checkstate(inp, WNT_RELEASE, 1) == WNT_STOPUSING) {
+	if (batch_inp != NULL) {
+		socket_lock_assert_owned(so);
+	} else {
+		socket_lock(so, 1);
+	}
+	if (batch_inp == NULL &&
+	    in_pcb_checkstate(inp, WNT_RELEASE, 1) == WNT_STOPUSING) {
 		socket_unlock(so, 1);
 		inp = NULL;     // pretend we didn't find it
 		TCP_LOG_DROP_PKT(TCP_LOG_HDR, th, ifp, "inp state WNT_STOPUSING");
@@ -2260,7 +2288,7 @@ findpcb:
 			    __func__,
 			    ntohs(inp->inp_fport), ntohs(th->th_sport),
 			    ntohs(inp->inp_lport), ntohs(th->th_dport));
-			if (findpcb_iterated) {
+			if (findpcb_iterated || batch_inp != NULL) {
 				goto drop;
 			}
 			findpcb_iterated = true;
@@ -2277,7 +2305,7 @@ findpcb:
 			    __func__,
 			    ntohs(inp->inp_fport), ntohs(th->th_sport),
 			    ntohs(inp->inp_lport), ntohs(th->th_dport));
-			if (findpcb_iterated) {
+			if (findpcb_iterated || batch_inp != NULL) {
 				goto drop;
 			}
 			findpcb_iterated = true;
@@ -2909,7 +2937,7 @@ findpcb:
 		tp->t_flags |= TF_ACKNOW;
 		(void) tcp_output(tp);
 		tcp_check_timer_state(tp);
-		socket_unlock(so, 1);
+		TCP_INPUT_UNLOCK(so);
 		return;
 	}
 #endif /* MPTCP */
@@ -3127,7 +3155,7 @@ findpcb:
 
 				tcp_handle_wakeup(so, read_wakeup, write_wakeup);
 
-				socket_unlock(so, 1);
+				TCP_INPUT_UNLOCK(so);
 				KERNEL_DEBUG(DBG_FNC_TCP_INPUT | DBG_FUNC_END, 0, 0, 0, 0, 0);
 				return;
 			}
@@ -3238,7 +3266,7 @@ findpcb:
 
 			tcp_handle_wakeup(so, read_wakeup, write_wakeup);
 
-			socket_unlock(so, 1);
+			TCP_INPUT_UNLOCK(so);
 			KERNEL_DEBUG(DBG_FNC_TCP_INPUT | DBG_FUNC_END, 0, 0, 0, 0, 0);
 			return;
 		}
@@ -4607,6 +4635,23 @@ close:
 			tcp_sack_doack(tp, &to, th, &sack_bytes_acked, &sack_bytes_newly_acked);
 		}
 
+		/*
+		 * With RACK, loss is detected from send times rather than
+		 * from the duplicate ACK count.
+		 */
+		if (TCP_RACK_ENABLED(tp)) {
+			tcp_rack_ack(tp, th, &to);
+			if (tcp_rack_detect_loss(tp) && !IN_FASTRECOVERY(tp) &&
+			    tp->t_rxtshift == 0 &&
+			    (tp->t_state == TCPS_ESTABLISHED ||
+			    tp->t_state == TCPS_FIN_WAIT_1)) {
+				tcp_rack_enter_recovery(tp);
+				if (SEQ_LEQ(th->th_ack, tp->snd_una)) {
+					(void) tcp_output(tp);
+				}
+			}
+		}
+
 #if MPTCP
 		if (tp->t_mpuna && SEQ_GEQ(th->th_ack, tp->t_mpuna)) {
 			if (tp->t_mpflags & TMPF_PREESTABLISHED) {
@@ -4696,7 +4741,8 @@ process_dupack:
 				if (SACK_ENABLED(tp) && tcp_do_better_lr) {
 					tp->t_new_dupacks += (sack_bytes_newly_acked / tp->t_maxseg);
 
-					if (tp->t_new_dupacks >= tp->t_rexmtthresh && IN_FASTRECOVERY(tp)) {
+					if (tp->t_new_dupacks >= tp->t_rexmtthresh && IN_FASTRECOVERY(tp) &&
+					    !TCP_RACK_ENABLED(tp)) {
 						/* Let's restart the retransmission */
 						tcp_sack_lost_rexmit(tp);
 
@@ -4780,8 +4826,8 @@ process_dupack:
 					tp->t_dupacks = 0;
 					tp->t_rexmtthresh = tcprexmtthresh;
 					tp->t_new_dupacks = 0;
-				} else if ((tp->t_dupacks > tp->t_rexmtthresh && (!tcp_do_better_lr || old_dupacks >= tp->t_rexmtthresh)) ||
-				    IN_FASTRECOVERY(tp)) {
+				} else if ((tp->t_dupacks > tp->t_rexmtthresh && (!tcp_do_better_lr || old_dupacks >= tp->t_rexmtthresh) &&
+				    !TCP_RACK_ENABLED(tp)) || IN_FASTRECOVERY(tp)) {
 					/*
 					 * If this connection was seeing packet
 					 * reordering, then recovery might be
@@ -4837,8 +4883,9 @@ process_dupack:
 					(void) tcp_output(tp);
 
 					goto drop;
-				} else if ((!tcp_do_better_lr && tp->t_dupacks == tp->t_rexmtthresh) ||
-				    (tcp_do_better_lr && tp->t_dupacks >= tp->t_rexmtthresh)) {
+				} else if (!TCP_RACK_ENABLED(tp) &&
+				    ((!tcp_do_better_lr && tp->t_dupacks == tp->t_rexmtthresh) ||
+				    (tcp_do_better_lr && tp->t_dupacks >= tp->t_rexmtthresh))) {
 					tcp_seq onxt = tp->snd_nxt;
 
 					/*
@@ -5651,7 +5698,7 @@ dodata:
 
 	tcp_handle_wakeup(so, read_wakeup, write_wakeup);
 
-	socket_unlock(so, 1);
+	TCP_INPUT_UNLOCK(so);
 	KERNEL_DEBUG(DBG_FNC_TCP_INPUT | DBG_FUNC_END, 0, 0, 0, 0, 0);
 	return;
 
@@ -5691,7 +5738,7 @@ dropafterack:
 	tcp_handle_wakeup(so, read_wakeup, write_wakeup);
 
 	/* Don't need to check timer state as we should have done it during tcp_output */
-	socket_unlock(so, 1);
+	TCP_INPUT_UNLOCK(so);
 	KERNEL_DEBUG(DBG_FNC_TCP_INPUT | DBG_FUNC_END, 0, 0, 0, 0, 0);
 	return;
 dropwithresetnosock:
@@ -5747,7 +5794,7 @@ dropwithreset:
 	} else if ((inp != NULL) && (nosock == 0)) {
 		tcp_handle_wakeup(so, read_wakeup, write_wakeup);
 
-		socket_unlock(so, 1);
+		TCP_INPUT_UNLOCK(so);
 	}
 	KERNEL_DEBUG(DBG_FNC_TCP_INPUT | DBG_FUNC_END, 0, 0, 0, 0, 0);
 	return;
@@ -5771,12 +5818,121 @@ drop:
 	} else if (nosock == 0) {
 		tcp_handle_wakeup(so, read_wakeup, write_wakeup);
 
-		socket_unlock(so, 1);
+		TCP_INPUT_UNLOCK(so);
 	}
 	KERNEL_DEBUG(DBG_FNC_TCP_INPUT | DBG_FUNC_END, 0, 0, 0, 0, 0);
 	return;
 }
 
+void
+tcp_input(struct mbuf *m, int off0)
+{
+	tcp_input_internal(m, off0, NULL);
+}
+
+/*
+ * Returns the TCP header of an IPv4 segment that may join a batch, or
+ * NULL if it has to go through tcp_input() on its own.  SYNs are kept
+ * out since they may re-enter the lookup (TIME_WAIT reuse).
+ */
+static struct tcphdr *
+tcp_input_batch_hdr(struct mbuf *m, int *off0)
+{
+	struct ip *ip = mtod(m, struct ip *);
+	struct tcphdr *th;
+	int hlen;
+
+	hlen = IP_VHL_HL(ip->ip_vhl) << 2;
+	if (m->m_len < hlen + (int)sizeof(struct tcphdr)) {
+		return NULL;
+	}
+	th = (struct tcphdr *)(void *)((caddr_t)ip + hlen);
+	if (th->th_flags & TH_SYN) {
+		return NULL;
+	}
+	*off0 = hlen;
+	return th;
+}
+
+/*
+ * Input a list of IPv4 segments sharing source, destination and protocol,
+ * as grouped by ip_input_process_list().  Consecutive segments for the same
+ * synchronized connection are processed back to back with one pcb lookup
+ * and one acquisition of the socket lock for the whole run; everything
+ * else takes the regular tcp_input() path.
+ */
+void
+tcp_input_chain(struct mbuf *m_list)
+{
+	struct mbuf *m;
+	struct tcphdr *th;
+	struct inpcb *inp;
+	struct socket *so;
+	struct tcpcb *tp;
+	struct ip *ip;
+	uint32_t count;
+	int off0;
+
+	while ((m = m_list) != NULL) {
+		m_list = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+
+		ip = mtod(m, struct ip *);
+		if (!tcp_input_batch || m_list == NULL ||
+		    (th = tcp_input_batch_hdr(m, &off0)) == NULL) {
+			tcp_input(m, IP_VHL_HL(ip->ip_vhl) << 2);
+			continue;
+		}
+
+		inp = in_pcblookup_hash(&tcbinfo, ip->ip_src, th->th_sport,
+		    ip->ip_dst, th->th_dport, 0, m->m_pkthdr.rcvif);
+		if (inp == NULL) {
+			tcp_input(m, off0);
+			continue;
+		}
+		so = inp->inp_socket;
+		socket_lock(so, 1);
+		if (in_pcb_checkstate(inp, WNT_RELEASE, 1) == WNT_STOPUSING ||
+		    (tp = intotcpcb(inp)) == NULL ||
+		    !TCPS_HAVEESTABLISHED(tp->t_state) ||
+		    tp->t_state == TCPS_TIME_WAIT) {
+			socket_unlock(so, 1);
+			tcp_input(m, off0);
+			continue;
+		}
+
+		/*
+		 * The use count taken by socket_lock() keeps the socket, and
+		 * with it the pcb, around for the whole run.
+		 */
+		count = 0;
+		for (;;) {
+			uint16_t sport = th->th_sport, dport = th->th_dport;
+
+			tcp_input_internal(m, off0, inp);
+			count++;
+
+			if (inp->inp_state == INPCB_STATE_DEAD ||
+			    (tp = intotcpcb(inp)) == NULL ||
+			    !TCPS_HAVEESTABLISHED(tp->t_state) ||
+			    tp->t_state == TCPS_TIME_WAIT ||
+			    (m = m_list) == NULL ||
+			    (th = tcp_input_batch_hdr(m, &off0)) == NULL ||
+			    th->th_sport != sport || th->th_dport != dport) {
+				break;
+			}
+			m_list = m->m_nextpkt;
+			m->m_nextpkt = NULL;
+		}
+		socket_unlock(so, 1);
+
+		if (count > 1) {
+			counter_inc(&tcp_input_batches);
+			counter_add(&tcp_input_batched, count);
+		}
+	}
+}
+
 /*
  * Parse TCP options and place in tcpopt.
  */
@@ -623,6 +623,28 @@ tcp_log_connection_summary(struct tcpcb *tp)
 	os_log(OS_LOG_DEFAULT, TCP_LOG_CONNECTION_SUMMARY_FMT,
 	    TCP_LOG_CONNECTION_SUMMARY_ARGS);
 #undef TCP_LOG_CONNECTION_SUMMARY_FMT
+#undef TCP_LOG_CONNECTION_SUMMARY_ARGS
+
+	if (!(tp->t_flagsext & TF_RACK)) {
+		return;
+	}
+
+#define TCP_LOG_CONNECTION_SUMMARY_FMT \
+	    "tcp_connection_summary " \
+	    TCP_LOG_COMMON_PCB_FMT \
+	    "rack lost: %u lost rxmit: %u reo timeouts: %u recoveries: %u " \
+	    "reordering: %u reo_wnd mult: %u min rtt: %u ms\n"
+
+#define TCP_LOG_CONNECTION_SUMMARY_ARGS \
+	    TCP_LOG_COMMON_PCB_ARGS, \
+	    tp->t_rack.r_lost, tp->t_rack.r_lost_rxmit, \
+	    tp->t_rack.r_reo_timeouts, tp->t_rack.r_recoveries, \
+	    tp->t_rack.r_reordering_seen, tp->t_rack.r_reo_wnd_mult, \
+	    tp->t_rack.r_min_rtt
+
+	os_log(OS_LOG_DEFAULT, TCP_LOG_CONNECTION_SUMMARY_FMT,
+	    TCP_LOG_CONNECTION_SUMMARY_ARGS);
+#undef TCP_LOG_CONNECTION_SUMMARY_FMT
 #undef TCP_LOG_CONNECTION_SUMMARY_ARGS
 }
 
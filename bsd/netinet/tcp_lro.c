@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Software TCP receive offload for the legacy (dlil input thread) path.
+ *
+ * Interfaces attached to a flowswitch get receive aggregation from
+ * flow_agg.c; everything else hands its packets to the per-interface
+ * dlil input thread, which passes each dequeued list through
+ * tcp_lro_list() before demux.  Within that list, in-order data segments
+ * of a flow are chained onto the first one, whose IP and TCP headers are
+ * then rewritten to describe the whole run, much like a hardware LRO
+ * engine would.  Nothing is held back across lists, so no timer is
+ * needed and no latency is added.
+ *
+ * Only plain ACK (optionally PSH) segments carrying data, with either no
+ * TCP options or just the aligned timestamp option, whose checksums have
+ * been verified by the hardware, are coalesced.  A segment with PSH ends
+ * the run it joins; any other segment of the flow ends the run before it,
+ * keeping the order the protocol sees intact.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/mbuf.h>
+#include <sys/sysctl.h>
+
+#include <kern/counter.h>
+
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_dl.h>
+#include <net/if_private.h>
+#include <net/if_var.h>
+#include <net/if_types.h>
+
+#include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/in_var.h>
+#include <netinet/ip.h>
+#include <netinet/ip_var.h>
+#include <netinet/ip6.h>
+#include <netinet6/ip6_var.h>
+#include <netinet/tcp.h>
+#include <netinet/tcp_seq.h>
+#include <netinet/tcp_var.h>
+
+#define TCP_LRO_FLOWS           8       /* flows tracked per list */
+#define TCP_LRO_MAXLEN          IP_MAXPACKET
+
+SYSCTL_SKMEM_TCP_INT(OID_AUTO, lro, CTLFLAG_RW | CTLFLAG_LOCKED,
+    int, tcp_lro_enabled, 1,
+    "Coalesce received segments on interfaces without receive offload");
+
+SCALABLE_COUNTER_DEFINE(tcp_lro_aggregates);
+SYSCTL_SCALABLE_COUNTER(_net_inet_tcp, lro_aggregates, tcp_lro_aggregates,
+    "Packets built out of coalesced segments");
+SCALABLE_COUNTER_DEFINE(tcp_lro_coalesced);
+SYSCTL_SCALABLE_COUNTER(_net_inet_tcp, lro_coalesced, tcp_lro_coalesced,
+    "Segments merged into a preceding segment of the same flow");
+
+struct tcp_lro_pkt {
+	struct in6_addr lp_src;         /* IPv4 addresses stored mapped */
+	struct in6_addr lp_dst;
+	struct tcphdr   *lp_th;
+	uint32_t        *lp_ts;         /* timestamp option words */
+	void            *lp_ip;
+	uint32_t        lp_hlen;        /* IP + TCP header length */
+	uint32_t        lp_len;         /* TCP payload length */
+	uint32_t        lp_class;       /* TOS or IPv6 traffic class */
+	uint8_t         lp_af;
+	bool            lp_ok;          /* may be coalesced */
+};
+
+struct tcp_lro_flow {
+	struct tcp_lro_pkt lf_pkt;      /* headers of the first segment */
+	struct mbuf     *lf_head;
+	struct mbuf     *lf_tail;       /* last mbuf of the run */
+	tcp_seq         lf_next;        /* sequence number expected next */
+	uint32_t        lf_len;
+	uint8_t         lf_segs;
+};
+
+/*
+ * Locates the IP and TCP headers of a received Ethernet frame.  Returns
+ * false if the frame isn't TCP that we could track; otherwise lp_ok tells
+ * whether the segment may take part in coalescing.
+ */
+static bool
+tcp_lro_parse(struct ifnet *ifp, struct mbuf *m, struct tcp_lro_pkt *lp)
+{
+	struct ether_header *eh = m->m_pkthdr.pkt_hdr;
+	struct tcphdr *th;
+	uint32_t iphlen, thlen, ip_len, csum;
+
+	if (eh == NULL || m->m_pkthdr.seg_cnt > 1 ||
+	    (m->m_pkthdr.pkt_flags & PKTF_WAKE_PKT) ||
+	    (m->m_pkthdr.csum_flags & CSUM_VLAN_TAG_VALID) ||
+	    bcmp(eh->ether_dhost, IF_LLADDR(ifp), ETHER_ADDR_LEN) != 0) {
+		return false;
+	}
+
+	lp->lp_ip = mtod(m, void *);
+	if (!IP_HDR_ALIGNED_P(lp->lp_ip)) {
+		return false;
+	}
+	switch (ntohs(eh->ether_type)) {
+	case ETHERTYPE_IP: {
+		struct ip *ip = lp->lp_ip;
+
+		if (m->m_len < (int)(sizeof(*ip) + sizeof(*th)) ||
+		    IP_VHL_V(ip->ip_vhl) != IPVERSION ||
+		    IP_VHL_HL(ip->ip_vhl) != (sizeof(*ip) >> 2) ||
+		    ip->ip_p != IPPROTO_TCP) {
+			return false;
+		}
+		iphlen = sizeof(*ip);
+		ip_len = ntohs(ip->ip_len);
+		lp->lp_af = AF_INET;
+		lp->lp_class = ip->ip_tos;
+		bzero(&lp->lp_src, sizeof(lp->lp_src));
+		bzero(&lp->lp_dst, sizeof(lp->lp_dst));
+		lp->lp_src.s6_addr32[3] = ip->ip_src.s_addr;
+		lp->lp_dst.s6_addr32[3] = ip->ip_dst.s_addr;
+		lp->lp_ok = !ipforwarding &&
+		    (ip->ip_off & htons(IP_MF | IP_OFFMASK)) == 0;
+		if ((m->m_pkthdr.csum_flags & CSUM_IP_CHECKED) == 0) {
+			lp->lp_ok = lp->lp_ok && in_cksum_hdr(ip) == 0;
+		} else {
+			lp->lp_ok = lp->lp_ok &&
+			    (m->m_pkthdr.csum_flags & CSUM_IP_VALID);
+		}
+		break;
+	}
+	case ETHERTYPE_IPV6: {
+		struct ip6_hdr *ip6 = lp->lp_ip;
+
+		if (m->m_len < (int)(sizeof(*ip6) + sizeof(*th)) ||
+		    (ip6->ip6_vfc & IPV6_VERSION_MASK) != IPV6_VERSION ||
+		    ip6->ip6_nxt != IPPROTO_TCP) {
+			return false;
+		}
+		iphlen = sizeof(*ip6);
+		ip_len = sizeof(*ip6) + ntohs(ip6->ip6_plen);
+		lp->lp_af = AF_INET6;
+		lp->lp_class = ip6->ip6_flow & htonl(IPV6_FLOWINFO_MASK);
+		lp->lp_src = ip6->ip6_src;
+		lp->lp_dst = ip6->ip6_dst;
+		lp->lp_ok = !ip6_forwarding;
+		break;
+	}
+	default:
+		return false;
+	}
+
+	th = (struct tcphdr *)(void *)((caddr_t)lp->lp_ip + iphlen);
+	thlen = th->th_off << 2;
+	lp->lp_th = th;
+	lp->lp_ts = NULL;
+	lp->lp_hlen = iphlen + thlen;
+	if (thlen < sizeof(*th) || ip_len < lp->lp_hlen ||
+	    (uint32_t)m_pktlen(m) < ip_len || (uint32_t)m->m_len < lp->lp_hlen) {
+		lp->lp_ok = false;
+		return true;
+	}
+	lp->lp_len = ip_len - lp->lp_hlen;
+
+	if (thlen == sizeof(*th) + TCPOLEN_TSTAMP_APPA &&
+	    *(uint32_t *)(void *)(th + 1) == htonl(TCPOPT_TSTAMP_HDR)) {
+		lp->lp_ts = (uint32_t *)(void *)(th + 1) + 1;
+	} else if (thlen != sizeof(*th)) {
+		lp->lp_ok = false;
+	}
+
+	csum = m->m_pkthdr.csum_flags & (CSUM_DATA_VALID | CSUM_PSEUDO_HDR);
+	if (lp->lp_len == 0 || (th->th_flags & ~TH_PUSH) != TH_ACK ||
+	    csum != (CSUM_DATA_VALID | CSUM_PSEUDO_HDR) ||
+	    (m->m_pkthdr.csum_rx_val ^ 0xffff) != 0) {
+		lp->lp_ok = false;
+	}
+	return true;
+}
+
+static bool
+tcp_lro_match(const struct tcp_lro_pkt *a, const struct tcp_lro_pkt *b)
+{
+	return a->lp_th->th_sport == b->lp_th->th_sport &&
+	       a->lp_th->th_dport == b->lp_th->th_dport &&
+	       a->lp_af == b->lp_af &&
+	       IN6_ARE_ADDR_EQUAL(&a->lp_src, &b->lp_src) &&
+	       IN6_ARE_ADDR_EQUAL(&a->lp_dst, &b->lp_dst);
+}
+
+static bool
+tcp_lro_can_merge(const struct tcp_lro_flow *lf, const struct tcp_lro_pkt *lp)
+{
+	const struct tcp_lro_pkt *h = &lf->lf_pkt;
+
+	if (ntohl(lp->lp_th->th_seq) != lf->lf_next ||
+	    lp->lp_class != h->lp_class ||
+	    (lp->lp_ts == NULL) != (h->lp_ts == NULL) ||
+	    SEQ_LT(ntohl(lp->lp_th->th_ack), ntohl(h->lp_th->th_ack)) ||
+	    lf->lf_segs == UINT8_MAX ||
+	    h->lp_hlen + lf->lf_len + lp->lp_len > TCP_LRO_MAXLEN) {
+		return false;
+	}
+	/* timestamps must not go backwards, or PAWS would see it */
+	if (lp->lp_ts != NULL &&
+	    TSTMP_LT(ntohl(lp->lp_ts[0]), ntohl(h->lp_ts[0]))) {
+		return false;
+	}
+	return true;
+}
+
+static void
+tcp_lro_merge(struct tcp_lro_flow *lf, struct tcp_lro_pkt *lp, struct mbuf *m)
+{
+	struct tcphdr *th = lf->lf_pkt.lp_th;
+	struct mbuf *n;
+
+	/* the run reads as if its last segment had carried the headers */
+	th->th_ack = lp->lp_th->th_ack;
+	th->th_win = lp->lp_th->th_win;
+	th->th_flags |= (lp->lp_th->th_flags & TH_PUSH);
+	if (lp->lp_ts != NULL) {
+		lf->lf_pkt.lp_ts[0] = lp->lp_ts[0];
+		lf->lf_pkt.lp_ts[1] = lp->lp_ts[1];
+	}
+
+	/* keep the payload only, without any link-layer padding */
+	m_adj(m, lp->lp_hlen);
+	if ((uint32_t)m_pktlen(m) > lp->lp_len) {
+		m_adj(m, (int)lp->lp_len - m_pktlen(m));
+	}
+	m_tag_delete_chain(m, NULL);
+	m->m_flags &= ~M_PKTHDR;
+
+	lf->lf_tail->m_next = m;
+	for (n = m; n->m_next != NULL; n = n->m_next) {
+		;
+	}
+	lf->lf_tail = n;
+	lf->lf_head->m_pkthdr.len += lp->lp_len;
+	lf->lf_len += lp->lp_len;
+	lf->lf_next += lp->lp_len;
+	lf->lf_segs++;
+}
+
+static void
+tcp_lro_flush(struct tcp_lro_flow *lf)
+{
+	struct mbuf *m = lf->lf_head;
+	uint32_t len = lf->lf_pkt.lp_hlen + lf->lf_len;
+
+	if (lf->lf_segs > 1) {
+		if (lf->lf_pkt.lp_af == AF_INET) {
+			struct ip *ip = lf->lf_pkt.lp_ip;
+
+			ip->ip_len = htons((uint16_t)len);
+			ip->ip_sum = 0;
+			ip->ip_sum = in_cksum_hdr(ip);
+			m->m_pkthdr.csum_flags |= CSUM_IP_CHECKED | CSUM_IP_VALID;
+		} else {
+			struct ip6_hdr *ip6 = lf->lf_pkt.lp_ip;
+
+			ip6->ip6_plen = htons((uint16_t)(len - sizeof(*ip6)));
+		}
+		/* each segment was verified; th_sum is left stale */
+		m->m_pkthdr.seg_cnt = lf->lf_segs;
+		counter_inc(&tcp_lro_aggregates);
+		counter_add(&tcp_lro_coalesced, lf->lf_segs - 1);
+	}
+	lf->lf_head = NULL;
+}
+
+/*
+ * Coalesce the list of packets just dequeued by the input thread of ifp;
+ * returns the new list head and updates *cnt.
+ */
+struct mbuf *
+tcp_lro_list(struct ifnet *ifp, struct mbuf *m_list, u_int32_t *cnt)
+{
+	struct tcp_lro_flow flows[TCP_LRO_FLOWS], *lf;
+	struct tcp_lro_pkt lp;
+	struct mbuf *head = NULL, **tailp = &head;
+	struct mbuf *m;
+	u_int32_t n = 0, merged = 0;
+	int i, victim = 0;
+
+	/*
+	 * Interface filters and bridging want to see the frames as they
+	 * arrived; CLAT translation rewrites the headers after demux.
+	 * An unlocked peek at the filter list is good enough here.
+	 */
+	if (!tcp_lro_enabled || m_list == NULL || m_list->m_nextpkt == NULL ||
+	    ifp->if_type != IFT_ETHER || (ifp->if_hwassist & IFNET_LRO) ||
+	    ifp->if_bridge != NULL || IS_INTF_CLAT46(ifp) ||
+	    !TAILQ_EMPTY(&ifp->if_flt_head)) {
+		return m_list;
+	}
+#if SKYWALK
+	/* the flowswitch already did its own aggregation */
+	if (ifp->if_capabilities & IFCAP_SKYWALK) {
+		return m_list;
+	}
+#endif /* SKYWALK */
+
+	for (i = 0; i < TCP_LRO_FLOWS; i++) {
+		flows[i].lf_head = NULL;
+	}
+
+	while ((m = m_list) != NULL) {
+		m_list = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+		n++;
+
+		if (!tcp_lro_parse(ifp, m, &lp)) {
+			goto append;
+		}
+		for (i = 0, lf = NULL; i < TCP_LRO_FLOWS; i++) {
+			if (flows[i].lf_head != NULL &&
+			    tcp_lro_match(&flows[i].lf_pkt, &lp)) {
+				lf = &flows[i];
+				break;
+			}
+		}
+		if (lf != NULL) {
+			if (lp.lp_ok && tcp_lro_can_merge(lf, &lp)) {
+				tcp_lro_merge(lf, &lp, m);
+				merged++;
+				if (lp.lp_th->th_flags & TH_PUSH) {
+					tcp_lro_flush(lf);
+				}
+				continue;
+			}
+			/* anything else ends the run before this segment */
+			tcp_lro_flush(lf);
+		}
+		if (!lp.lp_ok || (lp.lp_th->th_flags & TH_PUSH)) {
+			goto append;
+		}
+
+		/* start a run, evicting another flow if all slots are busy */
+		for (i = 0, lf = NULL; i < TCP_LRO_FLOWS; i++) {
+			if (flows[i].lf_head == NULL) {
+				lf = &flows[i];
+				break;
+			}
+		}
+		if (lf == NULL) {
+			lf = &flows[victim];
+			victim = (victim + 1) % TCP_LRO_FLOWS;
+			tcp_lro_flush(lf);
+		}
+		if ((uint32_t)m_pktlen(m) > lp.lp_hlen + lp.lp_len) {
+			m_adj(m, (int)(lp.lp_hlen + lp.lp_len) - m_pktlen(m));
+		}
+		lf->lf_pkt = lp;
+		lf->lf_head = m;
+		for (lf->lf_tail = m; lf->lf_tail->m_next != NULL;
+		    lf->lf_tail = lf->lf_tail->m_next) {
+			;
+		}
+		lf->lf_next = ntohl(lp.lp_th->th_seq) + lp.lp_len;
+		lf->lf_len = lp.lp_len;
+		lf->lf_segs = 1;
+append:
+		*tailp = m;
+		tailp = &m->m_nextpkt;
+	}
+
+	for (i = 0; i < TCP_LRO_FLOWS; i++) {
+		if (flows[i].lf_head != NULL) {
+			tcp_lro_flush(&flows[i]);
+		}
+	}
+	*cnt = n - merged;
+	return head;
+}
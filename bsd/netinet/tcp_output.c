@@ -1680,6 +1680,15 @@ just_return:
 	return 0;
 
 send:
+	/*
+	 * A paced connection that is too far ahead of its rate leaves the
+	 * data for the pacing wheel to send. Pure ACKs and control segments
+	 * are never held back.
+	 */
+	if (len > 0 && !(tp->t_flags & TF_ACKNOW) &&
+	    !(tp->t_flagsext & TF_FORCE) && tcp_pacing_defer(tp)) {
+		goto just_return;
+	}
 	/*
 	 * Set TF_MAXSEGSNT flag if the segment size is greater than
 	 * the max segment size.
@@ -2525,6 +2534,9 @@ send:
 		p->rxmit += len;
 		tp->sackhint.sack_bytes_rexmit += len;
 	}
+	if (len > 0 && TCP_RACK_ENABLED(tp)) {
+		tcp_rack_sent(tp, ntohl(th->th_seq), len);
+	}
 	th->th_ack = htonl(tp->rcv_nxt);
 	tp->last_ack_sent = tp->rcv_nxt;
 	if (optlen) {
@@ -2702,13 +2714,16 @@ timer:
 		 * SACK option is enabled on a connection.
 		 *
 		 * Every time new data is sent PTO will get reset.
+		 * Reordering turns probes off unless RACK, which accounts
+		 * for reordering itself, is doing loss detection.
 		 */
 		if (tcp_enable_tlp && len != 0 && tp->t_state == TCPS_ESTABLISHED &&
 		    SACK_ENABLED(tp) && !IN_FASTRECOVERY(tp) &&
 		    tp->snd_nxt == tp->snd_max &&
 		    SEQ_GT(tp->snd_nxt, tp->snd_una) &&
 		    tp->t_rxtshift == 0 &&
-		    (tp->t_flagsext & (TF_SENT_TLPROBE | TF_PKTS_REORDERED)) == 0) {
+		    !(tp->t_flagsext & TF_SENT_TLPROBE) &&
+		    (!(tp->t_flagsext & TF_PKTS_REORDERED) || TCP_RACK_ENABLED(tp))) {
 			uint32_t pto, srtt;
 
 			if (tcp_do_better_lr) {
@@ -2934,6 +2949,9 @@ timer:
 
 	tp->t_pktlist_sentlen += len;
 	tp->t_lastchain++;
+	if (len > 0) {
+		tcp_pacing_sent(tp, len);
+	}
 
 	if (isipv6) {
 		DTRACE_TCP5(send, struct mbuf *, m, struct inpcb *, inp,
@@ -3136,6 +3154,7 @@ tcp_ip_output(struct socket *so, struct tcpcb *tp, struct mbuf *pkt,
 	boolean_t ifdenied = FALSE;
 	struct inpcb *inp = tp->t_inpcb;
 	struct ifnet *outif = NULL;
+	struct ip_l2cache l2c = {};
 	bool check_qos_marking_again = (so->so_flags1 & SOF1_QOSMARKING_POLICY_OVERRIDE) ? FALSE : TRUE;
 
 	union {
@@ -3246,6 +3265,16 @@ tcp_ip_output(struct socket *so, struct tcpcb *tp, struct mbuf *pkt,
 		in6p_route_copyout(inp, &ro6);
 	} else {
 		inp_route_copyout(inp, &ro);
+		/*
+		 * Established connections keep the resolved next hop
+		 * along with the route; IP validates it against the
+		 * route and ARP generations before using it.
+		 */
+		if (tp->t_state == TCPS_ESTABLISHED) {
+			l2c = inp->inp_l2cache;
+			ipoa.ipoa_l2cache = &l2c;
+			ipoa.ipoa_flags |= IPOAF_L2CACHE;
+		}
 	}
 #if (DEBUG || DEVELOPMENT)
 	if ((so->so_flags & SOF_MARK_WAKE_PKT) && pkt != NULL) {
@@ -3341,6 +3370,9 @@ tcp_ip_output(struct socket *so, struct tcpcb *tp, struct mbuf *pkt,
 	if (unlocked) {
 		socket_lock(so, 0);
 	}
+	if (!isipv6 && (ipoa.ipoa_flags & IPOAF_L2CACHE)) {
+		inp->inp_l2cache = l2c;
+	}
 
 	/*
 	 * Enter flow controlled state if the connection is established
@@ -3394,7 +3426,7 @@ tcp_ip_output(struct socket *so, struct tcpcb *tp, struct mbuf *pkt,
 		 * outgoing interface
 		 */
 		if (ip6oa.ip6oa_flags & IP6OAF_BOUND_IF) {
-			outif = ifindex2ifnet[ip6oa.ip6oa_boundif];
+			outif = ifnet_byindex_smr(ip6oa.ip6oa_boundif);
 		} else if (ro6.ro_rt != NULL) {
 			outif = ro6.ro_rt->rt_ifp;
 		}
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * TCP pacing.
+ *
+ * A paced connection has a release time, t_pace_next, which advances by
+ * len / rate every time tcp_output() sends len bytes of data. The rate is
+ * derived from cwnd / srtt, scaled up by tcp_pacing_ss_ratio in slow start
+ * and by tcp_pacing_ca_ratio otherwise, and capped by TCP_MAX_PACING_RATE.
+ *
+ * A connection that is more than tcp_pacing_burst_usec ahead of its
+ * release time stops sending and goes on a timer wheel shared by all
+ * connections. A single thread call runs the wheel and calls tcp_output()
+ * again on the connections whose slot is due, so pacing costs no timer per
+ * connection.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/socket.h>
+#include <sys/socketvar.h>
+#include <sys/protosw.h>
+#include <sys/sysctl.h>
+
+#include <kern/counter.h>
+#include <kern/locks.h>
+#include <kern/thread_call.h>
+
+#include <net/route.h>
+
+#include <netinet/in.h>
+#include <netinet/in_pcb.h>
+#include <netinet/tcp.h>
+#include <netinet/tcp_fsm.h>
+#include <netinet/tcp_seq.h>
+#include <netinet/tcp_timer.h>
+#include <netinet/tcp_var.h>
+
+#define TCP_PACE_WHEEL_SLOTS    512     /* must be a power of 2 */
+#define TCP_PACE_WHEEL_MASK     (TCP_PACE_WHEEL_SLOTS - 1)
+
+SYSCTL_SKMEM_TCP_INT(OID_AUTO, pacing, CTLFLAG_RW | CTLFLAG_LOCKED,
+    int, tcp_pacing_enabled, 0, "Pace TCP transmissions at cwnd / srtt");
+
+SYSCTL_SKMEM_TCP_INT(OID_AUTO, pacing_ss_ratio, CTLFLAG_RW | CTLFLAG_LOCKED,
+    int, tcp_pacing_ss_ratio, 200, "Pacing rate in slow start, % of cwnd / srtt");
+
+SYSCTL_SKMEM_TCP_INT(OID_AUTO, pacing_ca_ratio, CTLFLAG_RW | CTLFLAG_LOCKED,
+    int, tcp_pacing_ca_ratio, 120, "Pacing rate in congestion avoidance, % of cwnd / srtt");
+
+SYSCTL_SKMEM_TCP_INT(OID_AUTO, pacing_burst_usec, CTLFLAG_RW | CTLFLAG_LOCKED,
+    int, tcp_pacing_burst_usec, 1000, "How far ahead of its pacing rate a connection may send");
+
+/* width of a wheel slot, the wheel covers TCP_PACE_WHEEL_SLOTS of them */
+static TUNABLE(uint32_t, tcp_pacing_slot_usec, "tcp_pacing_slot_usec", 100);
+SYSCTL_UINT(_net_inet_tcp, OID_AUTO, pacing_slot_usec, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &tcp_pacing_slot_usec, 0, "Granularity of the pacing timer wheel");
+
+SCALABLE_COUNTER_DEFINE(tcp_pacing_deferred);
+SYSCTL_SCALABLE_COUNTER(_net_inet_tcp, pacing_deferred, tcp_pacing_deferred,
+    "Transmissions deferred to the pacing wheel");
+
+struct tcp_pace_wheel {
+	decl_lck_mtx_data(, tpw_lock);
+	thread_call_t           tpw_call;
+	uint64_t                tpw_slot_abs;   /* slot width in absolute time */
+	uint64_t                tpw_cur;        /* first slot that hasn't run */
+	uint64_t                tpw_armed;      /* slot the call is armed for, or 0 */
+	uint32_t                tpw_count;      /* connections on the wheel */
+	boolean_t               tpw_running;
+	TAILQ_HEAD(, tcpcb)     tpw_slots[TCP_PACE_WHEEL_SLOTS];
+};
+
+static LCK_GRP_DECLARE(tcp_pace_lck_grp, "tcppacing");
+static struct tcp_pace_wheel tcp_pace_wheel;
+
+static void tcp_pace_wheel_run(thread_call_param_t, thread_call_param_t);
+
+void
+tcp_pacing_init(void)
+{
+	struct tcp_pace_wheel *wheel = &tcp_pace_wheel;
+
+	lck_mtx_init(&wheel->tpw_lock, &tcp_pace_lck_grp, LCK_ATTR_NULL);
+	for (int i = 0; i < TCP_PACE_WHEEL_SLOTS; i++) {
+		TAILQ_INIT(&wheel->tpw_slots[i]);
+	}
+	if (tcp_pacing_slot_usec == 0) {
+		tcp_pacing_slot_usec = 1;
+	}
+	nanoseconds_to_absolutetime((uint64_t)tcp_pacing_slot_usec * NSEC_PER_USEC,
+	    &wheel->tpw_slot_abs);
+	wheel->tpw_cur = mach_absolute_time() / wheel->tpw_slot_abs;
+	wheel->tpw_call = thread_call_allocate_with_options(tcp_pace_wheel_run,
+	    NULL, THREAD_CALL_PRIORITY_KERNEL, THREAD_CALL_OPTIONS_ONCE);
+	if (wheel->tpw_call == NULL) {
+		panic("failed to allocate the tcp pacing thread call");
+	}
+}
+
+/*
+ * Rate in bytes per second this connection is paced at, 0 if unpaced.
+ */
+static uint64_t
+tcp_pacing_rate(struct tcpcb *tp)
+{
+	uint64_t rate = 0;
+	int ratio;
+
+	if (tcp_pacing_enabled && tp->t_srtt != 0 &&
+	    tp->t_state == TCPS_ESTABLISHED) {
+		ratio = tp->snd_cwnd < tp->snd_ssthresh ?
+		    tcp_pacing_ss_ratio : tcp_pacing_ca_ratio;
+		/* t_srtt is in TCP_RETRANSHZ ticks, scaled by TCP_RTT_SHIFT */
+		rate = ((uint64_t)tp->snd_cwnd * (uint32_t)ratio *
+		    (TCP_RETRANSHZ << TCP_RTT_SHIFT)) / (100 * (uint64_t)tp->t_srtt);
+	}
+	if (tp->t_pace_maxrate != 0 && (rate == 0 || rate > tp->t_pace_maxrate)) {
+		rate = tp->t_pace_maxrate;
+	}
+	return rate;
+}
+
+static void
+tcp_pace_wheel_arm(struct tcp_pace_wheel *wheel, uint64_t slot)
+{
+	LCK_MTX_ASSERT(&wheel->tpw_lock, LCK_MTX_ASSERT_OWNED);
+
+	if (wheel->tpw_running ||
+	    (wheel->tpw_armed != 0 && wheel->tpw_armed <= slot)) {
+		return;
+	}
+	wheel->tpw_armed = slot;
+	thread_call_enter_delayed(wheel->tpw_call, slot * wheel->tpw_slot_abs);
+}
+
+static void
+tcp_pace_enqueue(struct tcpcb *tp)
+{
+	struct tcp_pace_wheel *wheel = &tcp_pace_wheel;
+	uint64_t slot;
+
+	lck_mtx_lock(&wheel->tpw_lock);
+	if (tp->t_pace_queued) {
+		lck_mtx_unlock(&wheel->tpw_lock);
+		return;
+	}
+	if (wheel->tpw_count == 0) {
+		/* don't walk the slots that went by while the wheel was idle */
+		wheel->tpw_cur = MAX(wheel->tpw_cur,
+		    mach_absolute_time() / wheel->tpw_slot_abs);
+	}
+	slot = tp->t_pace_next / wheel->tpw_slot_abs;
+	slot = MAX(slot, wheel->tpw_cur);
+	slot = MIN(slot, wheel->tpw_cur + TCP_PACE_WHEEL_MASK - 1);
+
+	tp->t_pace_slot = slot;
+	tp->t_pace_queued = 1;
+	TAILQ_INSERT_TAIL(&wheel->tpw_slots[slot & TCP_PACE_WHEEL_MASK], tp,
+	    t_pace_link);
+	wheel->tpw_count++;
+	tcp_pace_wheel_arm(wheel, slot);
+	lck_mtx_unlock(&wheel->tpw_lock);
+}
+
+void
+tcp_pacing_cancel(struct tcpcb *tp)
+{
+	struct tcp_pace_wheel *wheel = &tcp_pace_wheel;
+
+	socket_lock_assert_owned(tp->t_inpcb->inp_socket);
+	if (!tp->t_pace_queued) {
+		return;
+	}
+	lck_mtx_lock(&wheel->tpw_lock);
+	if (tp->t_pace_queued) {
+		TAILQ_REMOVE(&wheel->tpw_slots[tp->t_pace_slot & TCP_PACE_WHEEL_MASK],
+		    tp, t_pace_link);
+		tp->t_pace_queued = 0;
+		wheel->tpw_count--;
+	}
+	lck_mtx_unlock(&wheel->tpw_lock);
+}
+
+/*
+ * Called by tcp_output() before sending data. Returns true if the
+ * connection is too far ahead of its pacing rate, in which case it has
+ * been put on the wheel and must not send now.
+ */
+boolean_t
+tcp_pacing_defer(struct tcpcb *tp)
+{
+	uint64_t burst;
+
+	if (tp->t_pace_queued) {
+		return TRUE;
+	}
+	if (tcp_pacing_rate(tp) == 0) {
+		return FALSE;
+	}
+	nanoseconds_to_absolutetime((uint64_t)MAX(tcp_pacing_burst_usec,
+	    (int)tcp_pacing_slot_usec) * NSEC_PER_USEC, &burst);
+	if (tp->t_pace_next <= mach_absolute_time() + burst) {
+		return FALSE;
+	}
+	counter_inc(&tcp_pacing_deferred);
+	tcp_pace_enqueue(tp);
+	return TRUE;
+}
+
+/*
+ * Called by tcp_output() after queueing len bytes of data for transmission.
+ */
+void
+tcp_pacing_sent(struct tcpcb *tp, uint32_t len)
+{
+	uint64_t rate, now, delta;
+
+	if ((rate = tcp_pacing_rate(tp)) == 0) {
+		return;
+	}
+	now = mach_absolute_time();
+	if (tp->t_pace_next < now) {
+		/* an idle connection doesn't accumulate credit */
+		tp->t_pace_next = now;
+	}
+	nanoseconds_to_absolutetime(((uint64_t)len * NSEC_PER_SEC) / rate, &delta);
+	tp->t_pace_next += delta;
+}
+
+static void
+tcp_pace_output(struct tcpcb *tp)
+{
+	struct inpcb *inp = tp->t_inpcb;
+	struct socket *so = inp->inp_socket;
+
+	socket_lock(so, 1);
+	if (in_pcb_checkstate(inp, WNT_RELEASE, 1) != WNT_STOPUSING &&
+	    inp->inp_ppcb != NULL && !tp->t_pace_queued) {
+		(void) tcp_output(tp);
+	}
+	socket_unlock(so, 1);
+}
+
+static void
+tcp_pace_wheel_run(thread_call_param_t arg0, thread_call_param_t arg1)
+{
+#pragma unused(arg0, arg1)
+	struct tcp_pace_wheel *wheel = &tcp_pace_wheel;
+	struct tcpcb *tp;
+	uint64_t now_slot, last, slot;
+
+	lck_mtx_lock(&wheel->tpw_lock);
+	wheel->tpw_running = TRUE;
+	wheel->tpw_armed = 0;
+
+	now_slot = mach_absolute_time() / wheel->tpw_slot_abs;
+	last = MIN(now_slot, wheel->tpw_cur + TCP_PACE_WHEEL_MASK);
+
+	while (wheel->tpw_count > 0 && wheel->tpw_cur <= last) {
+		slot = wheel->tpw_cur++;
+
+		/*
+		 * Connections stay on the wheel until they're dispatched so
+		 * that tcp_pacing_cancel() can still find them while the wheel
+		 * lock is dropped. Anything tcp_output() puts back goes to a
+		 * later slot, as tpw_cur has already moved past this one.
+		 */
+		while ((tp = TAILQ_FIRST(&wheel->tpw_slots[slot & TCP_PACE_WHEEL_MASK])) != NULL) {
+			TAILQ_REMOVE(&wheel->tpw_slots[slot & TCP_PACE_WHEEL_MASK], tp,
+			    t_pace_link);
+			tp->t_pace_queued = 0;
+			wheel->tpw_count--;
+
+			/* keep the pcb around while the wheel lock is dropped */
+			if (in_pcb_checkstate(tp->t_inpcb, WNT_ACQUIRE, 0) ==
+			    WNT_STOPUSING) {
+				continue;
+			}
+			lck_mtx_unlock(&wheel->tpw_lock);
+			tcp_pace_output(tp);
+			lck_mtx_lock(&wheel->tpw_lock);
+		}
+	}
+	if (wheel->tpw_cur <= now_slot) {
+		wheel->tpw_cur = now_slot + 1;
+	}
+
+	wheel->tpw_running = FALSE;
+	if (wheel->tpw_count > 0) {
+		for (slot = wheel->tpw_cur; slot < wheel->tpw_cur + TCP_PACE_WHEEL_MASK; slot++) {
+			if (!TAILQ_EMPTY(&wheel->tpw_slots[slot & TCP_PACE_WHEEL_MASK])) {
+				tcp_pace_wheel_arm(wheel, slot);
+				break;
+			}
+		}
+	}
+	lck_mtx_unlock(&wheel->tpw_lock);
+}
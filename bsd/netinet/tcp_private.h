@@ -141,6 +141,14 @@ struct tcp_notify_ack_complete {
 #define TCP_FASTOPEN_FORCE_ENABLE       0x218
 #define MPTCP_EXPECTED_PROGRESS_TARGET  0x219
 #define MPTCP_FORCE_VERSION             0x21a
+#define TCP_MAX_PACING_RATE             0x21b   /* pace sends at up to this many bytes/sec (uint64_t) */
+#define TCP_RACK                        0x21c   /* use RACK-TLP loss detection */
+#define MPTCP_SCHEDULER                 0x21d   /* MPTCP packet scheduler */
+
+#define MPTCP_SCHEDULER_DEFAULT         0 /* Follows MPTCP_SERVICE_TYPE */
+#define MPTCP_SCHEDULER_MINRTT          1 /* Earliest expected completion */
+#define MPTCP_SCHEDULER_REDUNDANT       2 /* Duplicate data on every subflow */
+#define MPTCP_SCHEDULER_MAX             3
 
 /* When adding new socket-options, you need to make sure MPTCP supports these as well! */
 
@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * RACK: time-based loss detection (RFC 8985).
+ *
+ * Instead of counting duplicate ACKs, RACK remembers when every run of
+ * sequence space was last sent. A run is lost once a run that was sent
+ * after it has been delivered, and more than an RTT plus a reordering
+ * window has passed since it was sent. The reordering window starts at a
+ * quarter of the minimum RTT once reordering has been seen and grows
+ * with DSACKs reporting spurious retransmissions.
+ *
+ * Runs RACK has not declared lost yet are rechecked from the TCPT_DELAYFR
+ * timer. Tail losses are still caught by the tail loss probe (TCPT_PTO),
+ * whose ACK then lets RACK detect the loss. Retransmissions go through
+ * the SACK scoreboard as usual.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/sysctl.h>
+#include <sys/socket.h>
+#include <sys/socketvar.h>
+#include <kern/zalloc.h>
+#include <net/route.h>
+#include <netinet/in.h>
+#include <netinet/in_pcb.h>
+#include <netinet/tcp.h>
+#include <netinet/tcp_fsm.h>
+#include <netinet/tcp_seq.h>
+#include <netinet/tcp_timer.h>
+#include <netinet/tcp_var.h>
+#include <netinet/tcp_cc.h>
+#include <netinet/tcp_utils.h>
+
+SYSCTL_SKMEM_TCP_INT(OID_AUTO, rack, CTLFLAG_RW | CTLFLAG_LOCKED,
+    int, tcp_rack, 0, "Use RACK-TLP loss detection on new connections");
+
+SYSCTL_SKMEM_TCP_INT(OID_AUTO, rack_maxsegs, CTLFLAG_RW | CTLFLAG_LOCKED,
+    static int, tcp_rack_maxsegs, 1024,
+    "Maximum number of sent runs RACK tracks per connection");
+
+#define TCP_RACK_REO_WND_PERSIST        16      /* recoveries a grown reo_wnd lasts */
+#define TCP_RACK_REO_WND_MULT_MAX       UINT8_MAX
+
+static ZONE_DEFINE_TYPE(tcp_rack_seg_zone, "tcp_rack_seg", struct tcp_rack_seg,
+    ZC_NONE);
+
+static struct tcp_rack_seg *
+tcp_rack_insert(struct tcpcb *tp, struct tcp_rack_seg *after, tcp_seq start,
+    tcp_seq end)
+{
+	struct tcp_rack *r = &tp->t_rack;
+	struct tcp_rack_seg *rs;
+
+	if (r->r_nsegs >= (uint32_t)tcp_rack_maxsegs) {
+		return NULL;
+	}
+	rs = zalloc_flags(tcp_rack_seg_zone, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	rs->rs_start = start;
+	rs->rs_end = end;
+	if (after != NULL) {
+		TAILQ_INSERT_AFTER(&r->r_segs, after, rs, rs_link);
+	} else {
+		TAILQ_INSERT_HEAD(&r->r_segs, rs, rs_link);
+	}
+	r->r_nsegs++;
+	return rs;
+}
+
+static void
+tcp_rack_remove(struct tcpcb *tp, struct tcp_rack_seg *rs)
+{
+	struct tcp_rack *r = &tp->t_rack;
+
+	if (rs->rs_flags & TCP_RACK_SEG_SACKED) {
+		r->r_sacked -= rs->rs_end - rs->rs_start;
+	}
+	TAILQ_REMOVE(&r->r_segs, rs, rs_link);
+	r->r_nsegs--;
+	zfree(tcp_rack_seg_zone, rs);
+}
+
+/*
+ * Split rs at seq, the second half becomes a new run following rs.
+ */
+static struct tcp_rack_seg *
+tcp_rack_split(struct tcpcb *tp, struct tcp_rack_seg *rs, tcp_seq seq)
+{
+	struct tcp_rack_seg *nrs;
+
+	nrs = tcp_rack_insert(tp, rs, seq, rs->rs_end);
+	if (nrs != NULL) {
+		nrs->rs_xmit_ts = rs->rs_xmit_ts;
+		nrs->rs_flags = rs->rs_flags;
+		rs->rs_end = seq;
+	}
+	return nrs;
+}
+
+/*
+ * Make run boundaries line up with start and end, and if fill is set,
+ * add runs for the parts of [start, end) that aren't tracked. When the
+ * connection runs out of runs this does what it can, the callers only
+ * act on the runs that end up within the range.
+ */
+static void
+tcp_rack_cover(struct tcpcb *tp, tcp_seq start, tcp_seq end, boolean_t fill)
+{
+	struct tcp_rack_seg *rs, *prev = NULL;
+	tcp_seq seq = start;
+
+	TAILQ_FOREACH(rs, &tp->t_rack.r_segs, rs_link) {
+		if (SEQ_GEQ(seq, end)) {
+			break;
+		}
+		if (SEQ_LEQ(rs->rs_end, seq)) {
+			prev = rs;
+			continue;
+		}
+		if (SEQ_LT(seq, rs->rs_start)) {
+			if (fill) {
+				(void) tcp_rack_insert(tp, prev, seq,
+				    SEQ_MIN(end, rs->rs_start));
+			}
+			seq = rs->rs_start;
+			if (SEQ_GEQ(seq, end)) {
+				break;
+			}
+		}
+		if (SEQ_GT(seq, rs->rs_start)) {
+			/* the next iteration picks up the second half */
+			if (tcp_rack_split(tp, rs, seq) == NULL) {
+				seq = rs->rs_end;
+			}
+			prev = rs;
+			continue;
+		}
+		if (SEQ_GT(rs->rs_end, end)) {
+			(void) tcp_rack_split(tp, rs, end);
+		}
+		seq = rs->rs_end;
+		prev = rs;
+	}
+	if (fill && SEQ_LT(seq, end)) {
+		(void) tcp_rack_insert(tp, prev, seq, end);
+	}
+}
+
+/*
+ * Called by tcp_output() for every segment carrying len bytes of data
+ * from start.
+ */
+void
+tcp_rack_sent(struct tcpcb *tp, tcp_seq start, uint32_t len)
+{
+	struct tcp_rack *r = &tp->t_rack;
+	struct tcp_rack_seg *rs;
+	tcp_seq end = start + len, rend;
+
+	if (SEQ_LT(start, tp->snd_max)) {
+		/* retransmission */
+		rend = SEQ_MIN(end, tp->snd_max);
+		tcp_rack_cover(tp, start, rend, TRUE);
+		TAILQ_FOREACH(rs, &r->r_segs, rs_link) {
+			if (SEQ_LEQ(rs->rs_end, start)) {
+				continue;
+			}
+			if (SEQ_GEQ(rs->rs_start, rend)) {
+				break;
+			}
+			rs->rs_xmit_ts = tcp_now;
+			rs->rs_flags &= ~TCP_RACK_SEG_LOST;
+			rs->rs_flags |= TCP_RACK_SEG_RXMIT;
+		}
+		start = rend;
+		if (SEQ_GEQ(start, end)) {
+			return;
+		}
+	}
+
+	/*
+	 * New data sent in the same tick extends the last run. So does
+	 * anything sent once the connection is out of runs, which only
+	 * makes RACK wait longer before calling that data lost.
+	 */
+	rs = TAILQ_LAST(&r->r_segs, tcp_rack_seghead);
+	if (rs != NULL && rs->rs_end == start && rs->rs_flags == 0 &&
+	    (rs->rs_xmit_ts == tcp_now ||
+	    r->r_nsegs >= (uint32_t)tcp_rack_maxsegs)) {
+		rs->rs_end = end;
+		rs->rs_xmit_ts = tcp_now;
+		return;
+	}
+	rs = tcp_rack_insert(tp, rs, start, end);
+	if (rs != NULL) {
+		rs->rs_xmit_ts = tcp_now;
+	}
+}
+
+/*
+ * A run was delivered, either cumulatively or by SACK.
+ */
+static void
+tcp_rack_delivered(struct tcpcb *tp, struct tcp_rack_seg *rs)
+{
+	struct tcp_rack *r = &tp->t_rack;
+	uint32_t rtt = tcp_now - rs->rs_xmit_ts;
+
+	if (rs->rs_flags & TCP_RACK_SEG_RXMIT) {
+		/*
+		 * An ACK this quick was most likely for the original
+		 * transmission. It says nothing about when the
+		 * retransmission arrived.
+		 */
+		if (rtt < r->r_min_rtt) {
+			return;
+		}
+	} else if (r->r_min_rtt == 0 || rtt < r->r_min_rtt) {
+		r->r_min_rtt = max(rtt, 1);
+	}
+
+	if (r->r_xmit_ts != 0 && SEQ_LT(rs->rs_end, r->r_fack)) {
+		/* delivered below something delivered before */
+		if (!(rs->rs_flags & TCP_RACK_SEG_RXMIT)) {
+			r->r_reordering_seen = 1;
+		}
+	} else {
+		r->r_fack = rs->rs_end;
+	}
+
+	if (TSTMP_GT(rs->rs_xmit_ts, r->r_xmit_ts) ||
+	    (rs->rs_xmit_ts == r->r_xmit_ts &&
+	    SEQ_GT(rs->rs_end, r->r_end_seq))) {
+		r->r_xmit_ts = rs->rs_xmit_ts;
+		r->r_end_seq = rs->rs_end;
+		r->r_rtt = rtt;
+	}
+}
+
+/*
+ * Update the runs from the cumulative ACK and SACK blocks of an incoming
+ * ACK. tcp_sack_process_dsack() has already removed any DSACK block.
+ */
+void
+tcp_rack_ack(struct tcpcb *tp, struct tcphdr *th, struct tcpopt *to)
+{
+	struct tcp_rack *r = &tp->t_rack;
+	struct tcp_rack_seg *rs;
+	struct sackblk sack;
+	tcp_seq th_ack = th->th_ack;
+	int i;
+
+	while ((rs = TAILQ_FIRST(&r->r_segs)) != NULL &&
+	    SEQ_LT(rs->rs_start, th_ack)) {
+		if (!(rs->rs_flags & TCP_RACK_SEG_SACKED)) {
+			tcp_rack_delivered(tp, rs);
+		}
+		if (SEQ_GT(rs->rs_end, th_ack)) {
+			if (rs->rs_flags & TCP_RACK_SEG_SACKED) {
+				r->r_sacked -= th_ack - rs->rs_start;
+			}
+			rs->rs_start = th_ack;
+			break;
+		}
+		tcp_rack_remove(tp, rs);
+	}
+
+	for (i = 0; i < to->to_nsacks; i++) {
+		bcopy((to->to_sacks + i * TCPOLEN_SACK), &sack, sizeof(sack));
+		sack.start = ntohl(sack.start);
+		sack.end = ntohl(sack.end);
+		if (!TCP_VALIDATE_SACK_SEQ_NUMBERS(tp, &sack, th_ack)) {
+			continue;
+		}
+		tcp_rack_cover(tp, sack.start, sack.end, FALSE);
+		TAILQ_FOREACH(rs, &r->r_segs, rs_link) {
+			if (SEQ_LEQ(rs->rs_end, sack.start)) {
+				continue;
+			}
+			if (SEQ_GEQ(rs->rs_start, sack.end)) {
+				break;
+			}
+			if ((rs->rs_flags & TCP_RACK_SEG_SACKED) ||
+			    SEQ_LT(rs->rs_start, sack.start) ||
+			    SEQ_GT(rs->rs_end, sack.end)) {
+				continue;
+			}
+			tcp_rack_delivered(tp, rs);
+			rs->rs_flags |= TCP_RACK_SEG_SACKED;
+			rs->rs_flags &= ~TCP_RACK_SEG_LOST;
+			r->r_sacked += rs->rs_end - rs->rs_start;
+		}
+	}
+}
+
+/*
+ * A DSACK reported a spurious retransmission, widen the reordering
+ * window, at most once per round trip.
+ */
+void
+tcp_rack_dsack(struct tcpcb *tp)
+{
+	struct tcp_rack *r = &tp->t_rack;
+
+	if (r->r_dsack_round_valid && SEQ_LT(tp->snd_una, r->r_dsack_round)) {
+		return;
+	}
+	r->r_dsack_round = tp->snd_nxt;
+	r->r_dsack_round_valid = 1;
+	if (r->r_reo_wnd_mult < TCP_RACK_REO_WND_MULT_MAX) {
+		r->r_reo_wnd_mult++;
+	}
+	r->r_reo_wnd_persist = TCP_RACK_REO_WND_PERSIST;
+	r->r_reordering_seen = 1;
+}
+
+static uint32_t
+tcp_rack_reo_wnd(struct tcpcb *tp)
+{
+	struct tcp_rack *r = &tp->t_rack;
+	uint32_t wnd, srtt;
+
+	/*
+	 * Without any sign of reordering, don't hold back the
+	 * retransmission once enough is known to be lost.
+	 */
+	if (!r->r_reordering_seen &&
+	    (IN_FASTRECOVERY(tp) ||
+	    r->r_sacked >= tcprexmtthresh * tp->t_maxseg)) {
+		return 0;
+	}
+	wnd = (r->r_min_rtt >> 2) * max(r->r_reo_wnd_mult, 1);
+	srtt = tp->t_srtt >> TCP_RTT_SHIFT;
+	if (srtt != 0) {
+		wnd = min(wnd, srtt);
+	}
+	return wnd;
+}
+
+/*
+ * Mark what has been lost according to RACK and arm the reordering timer
+ * for the runs that may yet turn out lost. Returns true if anything that
+ * still needs to be retransmitted is lost.
+ */
+boolean_t
+tcp_rack_detect_loss(struct tcpcb *tp)
+{
+	struct tcp_rack *r = &tp->t_rack;
+	struct tcp_rack_seg *rs;
+	int32_t remaining, timeout = 0;
+	uint32_t reo_wnd;
+	boolean_t lost = FALSE;
+
+	if (r->r_xmit_ts == 0) {
+		return FALSE;
+	}
+	reo_wnd = tcp_rack_reo_wnd(tp);
+	TAILQ_FOREACH(rs, &r->r_segs, rs_link) {
+		if (rs->rs_flags & TCP_RACK_SEG_SACKED) {
+			continue;
+		}
+		if (rs->rs_flags & TCP_RACK_SEG_LOST) {
+			lost = TRUE;
+			continue;
+		}
+		/* only runs sent before the newest delivered one */
+		if (!(TSTMP_LT(rs->rs_xmit_ts, r->r_xmit_ts) ||
+		    (rs->rs_xmit_ts == r->r_xmit_ts &&
+		    SEQ_LT(rs->rs_end, r->r_end_seq)))) {
+			continue;
+		}
+		remaining = timer_diff(rs->rs_xmit_ts, r->r_rtt + reo_wnd,
+		    tcp_now, 0);
+		if (remaining > 0) {
+			timeout = MAX(timeout, remaining);
+			continue;
+		}
+		rs->rs_flags |= TCP_RACK_SEG_LOST;
+		r->r_lost++;
+		if (rs->rs_flags & TCP_RACK_SEG_RXMIT) {
+			r->r_lost_rxmit++;
+		}
+		tcp_sack_mark_lost(tp, rs->rs_start, rs->rs_end);
+		lost = TRUE;
+	}
+
+	if (timeout > 0) {
+		tp->t_timer[TCPT_DELAYFR] = OFFSET_FROM_START(tp, timeout);
+	} else {
+		tp->t_timer[TCPT_DELAYFR] = 0;
+	}
+	return lost;
+}
+
+/*
+ * Start SACK recovery because RACK found a loss, the counterpart of
+ * reaching the duplicate ACK threshold in tcp_input().
+ */
+void
+tcp_rack_enter_recovery(struct tcpcb *tp)
+{
+	struct tcp_rack *r = &tp->t_rack;
+
+	if (tp->t_flags & TF_SENTFIN) {
+		tp->snd_recover = tp->snd_max - 1;
+	} else {
+		tp->snd_recover = tp->snd_max;
+	}
+	tp->t_timer[TCPT_PTO] = 0;
+	tp->t_rtttime = 0;
+
+	tcp_rexmt_save_state(tp);
+	if (CC_ALGO(tp)->pre_fr != NULL) {
+		CC_ALGO(tp)->pre_fr(tp);
+	}
+	ENTER_FASTRECOVERY(tp);
+	tp->t_timer[TCPT_REXMT] = 0;
+	if (!TCP_ACC_ECN_ON(tp) && TCP_ECN_ENABLED(tp)) {
+		tp->ecn_flags |= TE_SENDCWR;
+	}
+
+	tcpstat.tcps_sack_recovery_episode++;
+	tp->t_sack_recovery_episode++;
+	tp->sack_newdata = tp->snd_nxt;
+	if (tcp_do_better_lr) {
+		tp->snd_cwnd = tp->snd_ssthresh;
+	} else {
+		tp->snd_cwnd = tp->t_maxseg;
+	}
+	tp->t_flagsext &= ~TF_CWND_NONVALIDATED;
+
+	r->r_recoveries++;
+	if (r->r_reo_wnd_persist > 0 && --r->r_reo_wnd_persist == 0) {
+		r->r_reo_wnd_mult = 1;
+	}
+	tcp_ccdbg_trace(tp, NULL, TCP_CC_ENTER_FASTRECOVERY);
+}
+
+/*
+ * Forget the sent runs, on close and when a retransmit timeout throws
+ * away the SACK scoreboard.
+ */
+void
+tcp_rack_free(struct tcpcb *tp)
+{
+	struct tcp_rack_seg *rs;
+
+	while ((rs = TAILQ_FIRST(&tp->t_rack.r_segs)) != NULL) {
+		tcp_rack_remove(tp, rs);
+	}
+	VERIFY(tp->t_rack.r_nsegs == 0 && tp->t_rack.r_sacked == 0);
+}
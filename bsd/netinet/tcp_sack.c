@@ -119,14 +119,6 @@ SYSCTL_INT(_net_inet_tcp, OID_AUTO, sack_globalholes, CTLFLAG_RD | CTLFLAG_LOCKE
 
 extern struct zone *sack_hole_zone;
 
-#define TCP_VALIDATE_SACK_SEQ_NUMBERS(_tp_, _sb_, _ack_) \
-    (SEQ_GT((_sb_)->end, (_sb_)->start) && \
-    SEQ_GT((_sb_)->start, (_tp_)->snd_una) && \
-    SEQ_GT((_sb_)->start, (_ack_)) && \
-    SEQ_LT((_sb_)->start, (_tp_)->snd_max) && \
-    SEQ_GT((_sb_)->end, (_tp_)->snd_una) && \
-    SEQ_LEQ((_sb_)->end, (_tp_)->snd_max))
-
 /*
  * This function is called upon receipt of new valid data (while not in header
  * prediction mode), and it updates the ordered list of sacks.
@@ -808,6 +800,45 @@ tcp_sack_lost_rexmit(struct tcpcb *tp)
 	tp->sack_newdata = tp->snd_nxt;
 }
 
+/*
+ * RACK declared [start, end) lost. Make the scoreboard send it again:
+ * rewind the holes whose retransmission already went past it and cover
+ * whatever lies beyond snd_fack with a new hole.
+ */
+void
+tcp_sack_mark_lost(struct tcpcb *tp, tcp_seq start, tcp_seq end)
+{
+	struct sackhole *hole;
+	tcp_seq rewind;
+	int bytes;
+
+	TAILQ_FOREACH(hole, &tp->snd_holes, scblink) {
+		if (SEQ_LEQ(hole->end, start)) {
+			continue;
+		}
+		if (SEQ_GEQ(hole->start, end)) {
+			break;
+		}
+		rewind = SEQ_MAX(start, hole->start);
+		if (SEQ_GT(hole->rxmit, rewind)) {
+			hole->rxmit = rewind;
+			hole->rxmit_start = tcp_now;
+		}
+	}
+	if (TAILQ_EMPTY(&tp->snd_holes)) {
+		/* nothing is SACKed, snd_fack may be stale */
+		tp->snd_fack = tp->snd_una;
+	}
+	if (SEQ_GT(end, tp->snd_fack) &&
+	    tcp_sackhole_insert(tp, tp->snd_fack, end, NULL) != NULL) {
+		tp->snd_fack = end;
+	}
+
+	/* recompute the hints the way tcp_sack_output() expects them */
+	tp->sackhint.nexthole = tcp_sack_output_debug(tp, &bytes);
+	tp->sackhint.sack_bytes_rexmit = bytes;
+}
+
 /*
  * After a timeout, the SACK list may be rebuilt.  This SACK information
  * should be used to avoid retransmitting SACKed data.  This function
@@ -947,6 +978,9 @@ tcp_sack_process_dsack(struct tcpcb *tp, struct tcpopt *to,
 	to->to_sacks += TCPOLEN_SACK;
 	tcpstat.tcps_dsack_recvd++;
 	tp->t_dsack_recvd++;
+	if (TCP_RACK_ENABLED(tp)) {
+		tcp_rack_dsack(tp);
+	}
 
 	/* Update the sender's retransmit segment state */
 	if (((tp->t_rxtshift == 1 && first_sack.start == tp->snd_una) ||
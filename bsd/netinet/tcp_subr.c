@@ -281,6 +281,10 @@ __private_extern__ int  tcp_tcbhashsize = TCBHASHSIZE;
 SYSCTL_INT(_net_inet_tcp, OID_AUTO, tcbhashsize, CTLFLAG_RD | CTLFLAG_LOCKED,
     &tcp_tcbhashsize, 0, "Size of TCP control-block hashtable");
 
+SYSCTL_PROC(_net_inet_tcp, OID_AUTO, pcbhash_hist,
+    CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED, &tcbinfo, 0,
+    in_pcbhash_sysctl_hist, "IU", "Histogram of TCP pcb hash chain lengths");
+
 /*
  * This is the actual shape of what we allocate using the zone
  * allocator.  Doing it this way allows us to protect both structures
@@ -567,8 +571,7 @@ tcp_init(struct protosw *pp, struct domain *dp)
 		    tcp_tcbhashsize);
 	}
 
-	tcbinfo.ipi_hashbase = hashinit(tcp_tcbhashsize, M_PCB,
-	    &tcbinfo.ipi_hashmask);
+	in_pcbinfo_hashinit(&tcbinfo, tcp_tcbhashsize, TRUE);
 	tcbinfo.ipi_porthashbase = hashinit(tcp_tcbhashsize, M_PCB,
 	    &tcbinfo.ipi_porthashmask);
 	str_size = (vm_size_t)P2ROUNDUP(sizeof(struct inp_tp), sizeof(u_int64_t));
@@ -617,6 +620,8 @@ tcp_init(struct protosw *pp, struct domain *dp)
 		panic("failed to allocate call entry 1 in tcp_init");
 	}
 
+	tcp_pacing_init();
+
 	/* Initialize TCP Cache */
 	tcp_cache_init();
 
@@ -1114,6 +1119,10 @@ tcp_newtcpcb(struct inpcb *inp)
 	tp->t_flagsext |= TF_SACK_ENABLE;
 
 	TAILQ_INIT(&tp->snd_holes);
+	TAILQ_INIT(&tp->t_rack.r_segs);
+	if (tcp_rack) {
+		tp->t_flagsext |= TF_RACK;
+	}
 	SLIST_INIT(&tp->t_rxt_segments);
 	SLIST_INIT(&tp->t_notify_ack);
 	tp->t_inpcb = inp;
@@ -1460,6 +1469,7 @@ tcp_close(struct tcpcb *tp)
 	tcp_del_fsw_flow(tp);
 
 	tcp_canceltimers(tp);
+	tcp_pacing_cancel(tp);
 	KERNEL_DEBUG(DBG_FNC_TCP_CLOSE | DBG_FUNC_START, tp, 0, 0, 0, 0);
 
 	/*
@@ -1629,6 +1639,7 @@ no_valid_rt:
 	tcp_update_stats_per_flow(&ifs, inp->inp_last_outifp);
 
 	tcp_free_sackholes(tp);
+	tcp_rack_free(tp);
 	tcp_notify_ack_free(tp);
 
 	inp_decr_sndbytes_allunsent(so, tp->snd_una);
@@ -1038,6 +1038,7 @@ tcp_timers(struct tcpcb *tp, int timer)
 	 */
 	case TCPT_2MSL:
 		tcp_free_sackholes(tp);
+		tcp_rack_free(tp);
 		if (tp->t_state != TCPS_TIME_WAIT &&
 		    tp->t_state != TCPS_FIN_WAIT_2 &&
 		    ((idle_time > 0) && (idle_time < TCP_CONN_MAXIDLE(tp)))) {
@@ -1269,6 +1270,7 @@ retransmit_packet:
 		}
 
 		tcp_free_sackholes(tp);
+		tcp_rack_free(tp);
 		/*
 		 * Check for potential Path MTU Discovery Black Hole
 		 */
@@ -1825,6 +1827,21 @@ fc_output:
 	case TCPT_DELAYFR:
 		tp->t_flagsext &= ~TF_DELAY_RECOVERY;
 
+		/* With RACK this is the reordering timer */
+		if (TCP_RACK_ENABLED(tp)) {
+			tp->t_rack.r_reo_timeouts++;
+			if (!tcp_rack_detect_loss(tp)) {
+				break;
+			}
+			if (!IN_FASTRECOVERY(tp) && tp->t_rxtshift == 0 &&
+			    (tp->t_state == TCPS_ESTABLISHED ||
+			    tp->t_state == TCPS_FIN_WAIT_1)) {
+				tcp_rack_enter_recovery(tp);
+			}
+			(void) tcp_output(tp);
+			break;
+		}
+
 		/*
 		 * Don't do anything if one of the following is true:
 		 * - the connection is already in recovery
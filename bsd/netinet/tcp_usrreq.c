@@ -2729,6 +2729,32 @@ tcp_ctloutput(struct socket *so, struct sockopt *sopt)
 				tp->t_rxt_minimum_timeout *= TCP_RETRANSHZ;
 			}
 			break;
+		case TCP_MAX_PACING_RATE: {
+			uint64_t rate;
+
+			error = sooptcopyin(sopt, &rate, sizeof(rate),
+			    sizeof(rate));
+			if (error) {
+				break;
+			}
+			/* 0 removes the limit */
+			tp->t_pace_maxrate = rate;
+			break;
+		}
+		case TCP_RACK:
+			error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval));
+			if (error) {
+				break;
+			}
+			if (optval) {
+				tp->t_flagsext |= TF_RACK;
+			} else if (tp->t_flagsext & TF_RACK) {
+				tp->t_flagsext &= ~TF_RACK;
+				tp->t_timer[TCPT_DELAYFR] = 0;
+				tcp_rack_free(tp);
+			}
+			break;
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -2902,6 +2928,13 @@ tcp_ctloutput(struct socket *so, struct sockopt *sopt)
 		case TCP_RXT_MINIMUM_TIMEOUT:
 			optval = tp->t_rxt_minimum_timeout / TCP_RETRANSHZ;
 			break;
+		case TCP_MAX_PACING_RATE:
+			error = sooptcopyout(sopt, &tp->t_pace_maxrate,
+			    sizeof(tp->t_pace_maxrate));
+			goto done;
+		case TCP_RACK:
+			optval = (tp->t_flagsext & TF_RACK) ? 1 : 0;
+			break;
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -188,6 +188,42 @@ struct sackhint {
 	int sack_bytes_acked;
 };
 
+/*
+ * A run of sequence space sent at the same time, as tracked by RACK
+ * (tcp_rack.c). The runs of a connection are kept in sequence order.
+ */
+struct tcp_rack_seg {
+	TAILQ_ENTRY(tcp_rack_seg) rs_link;
+	tcp_seq         rs_start;
+	tcp_seq         rs_end;
+	u_int32_t       rs_xmit_ts;     /* tcp_now at last (re)transmission */
+	u_int16_t       rs_flags;
+#define TCP_RACK_SEG_SACKED     0x1     /* delivered out of order */
+#define TCP_RACK_SEG_RXMIT      0x2     /* retransmitted at least once */
+#define TCP_RACK_SEG_LOST       0x4     /* marked lost, not yet retransmitted */
+};
+
+struct tcp_rack {
+	TAILQ_HEAD(tcp_rack_seghead, tcp_rack_seg) r_segs;
+	u_int32_t       r_nsegs;
+	u_int32_t       r_sacked;       /* bytes marked TCP_RACK_SEG_SACKED */
+	u_int32_t       r_xmit_ts;      /* send time of the newest delivered run */
+	tcp_seq         r_end_seq;      /* and its end */
+	u_int32_t       r_rtt;          /* RTT measured from that run */
+	u_int32_t       r_min_rtt;
+	tcp_seq         r_fack;         /* highest delivered sequence */
+	tcp_seq         r_dsack_round;  /* snd_nxt when reo_wnd was last grown */
+	u_int8_t        r_reordering_seen;
+	u_int8_t        r_reo_wnd_mult;
+	u_int8_t        r_reo_wnd_persist;
+	u_int8_t        r_dsack_round_valid;
+	/* per-connection counters, logged by tcp_log_connection_summary() */
+	u_int32_t       r_lost;         /* runs marked lost */
+	u_int32_t       r_lost_rxmit;   /* lost retransmissions detected */
+	u_int32_t       r_reo_timeouts; /* reordering timer expirations */
+	u_int32_t       r_recoveries;   /* recovery episodes entered by RACK */
+};
+
 struct tcp_rxt_seg {
 	tcp_seq rx_start;
 	tcp_seq rx_end;
@@ -558,6 +594,7 @@ struct tcpcb {
 #define TF_FASTOPEN_FORCE_ENABLE 0x1000000      /* Force-enable TCP Fastopen */
 #define TF_LOGGED_CONN_SUMMARY  0x2000000       /* Connection summary was logged */
 #define TF_USR_OUTPUT           0x4000000       /* In connect() or send() so tcp_output() can log */
+#define TF_RACK                 0x8000000       /* Use RACK-TLP loss detection */
 
 #if TRAFFIC_MGT
 	/* Inter-arrival jitter related state */
@@ -728,10 +765,21 @@ struct tcpcb {
 
 	uuid_t          t_fsw_uuid;
 	uuid_t          t_flow_uuid;
+
+	/* Pacing, see tcp_pacing.c */
+	TAILQ_ENTRY(tcpcb) t_pace_link;     /* link on the pacing wheel */
+	uint64_t t_pace_next;               /* abs time the next segment is due */
+	uint64_t t_pace_slot;               /* wheel slot, valid while queued */
+	uint64_t t_pace_maxrate;            /* TCP_MAX_PACING_RATE, bytes/sec */
+	uint8_t  t_pace_queued;             /* on the pacing wheel */
+
+	struct tcp_rack t_rack;             /* RACK-TLP loss detection state */
 };
 
 #define IN_FASTRECOVERY(tp)     (tp->t_flags & TF_FASTRECOVERY)
 #define SACK_ENABLED(tp)        (tp->t_flagsext & TF_SACK_ENABLE)
+#define TCP_RACK_ENABLED(tp)    (((tp)->t_flagsext & (TF_SACK_ENABLE | TF_RACK)) == \
+	                         (TF_SACK_ENABLE | TF_RACK))
 
 /*
  * If the connection is in a throttled state due to advisory feedback from
@@ -832,6 +880,14 @@ extern int tcp_acc_ecn;
     (SEQ_LEQ((_seq_), (_tp_)->snd_max) && \
     SEQ_GEQ((_seq_), ((_una_) - TCP_DSACK_MAX_SEND_WINDOW(_tp_))))
 
+#define TCP_VALIDATE_SACK_SEQ_NUMBERS(_tp_, _sb_, _ack_) \
+    (SEQ_GT((_sb_)->end, (_sb_)->start) && \
+    SEQ_GT((_sb_)->start, (_tp_)->snd_una) && \
+    SEQ_GT((_sb_)->start, (_ack_)) && \
+    SEQ_LT((_sb_)->start, (_tp_)->snd_max) && \
+    SEQ_GT((_sb_)->end, (_tp_)->snd_una) && \
+    SEQ_LEQ((_sb_)->end, (_tp_)->snd_max))
+
 #define TCP_RESET_REXMT_STATE(_tp_) do { \
 	(_tp_)->t_rxtshift = 0; \
 	(_tp_)->t_rxtstart = 0; \
@@ -1627,6 +1683,7 @@ extern int tcp_use_min_curr_rtt;
 #define TCP_ACK_COMPRESSION_DUMMY 1
 
 extern int tcp_do_better_lr;
+extern int tcp_rack;
 extern int tcp_cubic_minor_fixes;
 extern int tcp_cubic_rfc_compliant;
 extern int tcp_flow_control_response;
@@ -1647,6 +1704,10 @@ struct tcp_respond_args {
 };
 
 void     tcp_canceltimers(struct tcpcb *);
+void     tcp_pacing_init(void);
+boolean_t tcp_pacing_defer(struct tcpcb *);
+void     tcp_pacing_sent(struct tcpcb *, uint32_t);
+void     tcp_pacing_cancel(struct tcpcb *);
 struct tcpcb *
 tcp_close(struct tcpcb *);
 void     tcp_ctlinput(int, struct sockaddr *, void *, struct ifnet *);
@@ -1657,6 +1718,8 @@ void     tcp_drain(void);
 void     tcp_getrt_rtt(struct tcpcb *tp, struct rtentry *rt);
 void     tcp_init(struct protosw *, struct domain *);
 void     tcp_input(struct mbuf *, int);
+void     tcp_input_chain(struct mbuf *);
+struct mbuf *tcp_lro_list(struct ifnet *, struct mbuf *, u_int32_t *);
 void     tcp_mss(struct tcpcb *, int, unsigned int);
 uint32_t tcp_ceil(double a);
 uint32_t tcp_round_to(uint32_t val, uint32_t round);
@@ -1716,6 +1779,13 @@ extern void tcp_set_foreground_cc(struct socket *);
 extern void tcp_set_recv_bg(struct socket *);
 extern void tcp_clear_recv_bg(struct socket *);
 extern boolean_t tcp_sack_byte_islost(struct tcpcb *tp);
+extern void tcp_sack_mark_lost(struct tcpcb *tp, tcp_seq start, tcp_seq end);
+extern void tcp_rack_sent(struct tcpcb *tp, tcp_seq start, uint32_t len);
+extern void tcp_rack_ack(struct tcpcb *tp, struct tcphdr *th, struct tcpopt *to);
+extern void tcp_rack_dsack(struct tcpcb *tp);
+extern boolean_t tcp_rack_detect_loss(struct tcpcb *tp);
+extern void tcp_rack_enter_recovery(struct tcpcb *tp);
+extern void tcp_rack_free(struct tcpcb *tp);
 #define IS_TCP_RECV_BG(_so)     \
 	((_so)->so_flags1 & SOF1_TRAFFIC_MGT_TCP_RECVBG)
 
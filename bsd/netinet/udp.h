@@ -89,6 +89,8 @@ struct udphdr {
 #define UDP_NOCKSUM     0x01    /* don't checksum outbound payloads */
 #ifdef PRIVATE
 #define UDP_KEEPALIVE_OFFLOAD   0x02 /* Send keep-alive at a given interval */
+#define UDP_SEGMENT             0x03 /* int: split sends into datagrams of this payload size */
+#define UDP_GRO                 0x04 /* int: coalesce received datagrams of a flow */
 #endif /* PRIVATE */
 
 #ifdef PRIVATE
@@ -118,5 +120,18 @@ struct udp_keepalive_offload {
 #define UDP_KEEPALIVE_OFFLOAD_TYPE_AIRPLAY      0x1
 };
 
+/*
+ * UDP_SEGMENT lets a single send carry up to UDP_MAX_SEGMENTS datagrams:
+ * the payload is cut into datagrams of the given size (the last one may
+ * be shorter) after the socket, route and policy work has been done once.
+ *
+ * With UDP_GRO set, consecutive datagrams from the same source that are
+ * queued on the socket are delivered by a single receive. Every receive
+ * then carries an IPPROTO_UDP/UDP_GRO control message whose int payload
+ * is the size of the datagrams that were coalesced; only the last one
+ * may be shorter.
+ */
+#define UDP_MAX_SEGMENTS        64
+
 #endif /* PRIVATE */
 #endif /* _NETINET_UDP_H */
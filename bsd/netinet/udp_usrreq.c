@@ -175,6 +175,10 @@ SYSCTL_INT(_net_inet_udp, OID_AUTO, pcbcount,
     CTLFLAG_RD | CTLFLAG_LOCKED, &udbinfo.ipi_count, 0,
     "Number of active PCBs");
 
+SYSCTL_PROC(_net_inet_udp, OID_AUTO, pcbhash_hist,
+    CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED, &udbinfo, 0,
+    in_pcbhash_sysctl_hist, "IU", "Histogram of UDP pcb hash chain lengths");
+
 __private_extern__ int udp_use_randomport = 1;
 SYSCTL_INT(_net_inet_udp, OID_AUTO, randomize_ports,
     CTLFLAG_RW | CTLFLAG_LOCKED, &udp_use_randomport, 0,
@@ -248,8 +252,7 @@ udp_init(struct protosw *pp, struct domain *dp)
 	}
 	LIST_INIT(&udb);
 	udbinfo.ipi_listhead = &udb;
-	udbinfo.ipi_hashbase = hashinit(UDBHASHSIZE, M_PCB,
-	    &udbinfo.ipi_hashmask);
+	in_pcbinfo_hashinit(&udbinfo, UDBHASHSIZE, TRUE);
 	udbinfo.ipi_porthashbase = hashinit(UDBHASHSIZE, M_PCB,
 	    &udbinfo.ipi_porthashmask);
 	udbinfo.ipi_zone = zone_create("udpcb", sizeof(struct inpcb), ZC_NONE);
@@ -756,7 +759,10 @@ udp_input(struct mbuf *m, int iphlen)
 		inp_set_activity_bitmap(inp);
 	}
 	so_recv_data_stat(inp->inp_socket, m, 0);
-	if (sbappendaddr(&inp->inp_socket->so_rcv, append_sa,
+	if ((inp->inp_flags2 & INP2_UDP_GRO) &&
+	    udp_gro_append(inp->inp_socket, append_sa, m, &opts)) {
+		sorwakeup(inp->inp_socket);
+	} else if (sbappendaddr(&inp->inp_socket->so_rcv, append_sa,
 	    m, opts, NULL) == 0) {
 		udpstat.udps_fullsock++;
 	} else {
@@ -1088,6 +1094,33 @@ udp_ctloutput(struct socket *so, struct sockopt *sopt)
 			}
 			break;
 		}
+		case UDP_SEGMENT:
+			if ((error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval))) != 0) {
+				break;
+			}
+
+			if (optval < 0 ||
+			    optval > IP_MAXPACKET - (int)sizeof(struct udpiphdr)) {
+				error = EINVAL;
+				break;
+			}
+			inp->inp_udp_segsz = (u_int16_t)optval;
+			break;
+
+		case UDP_GRO:
+			if ((error = sooptcopyin(sopt, &optval, sizeof(optval),
+			    sizeof(optval))) != 0) {
+				break;
+			}
+
+			if (optval != 0) {
+				inp->inp_flags2 |= INP2_UDP_GRO;
+			} else {
+				inp->inp_flags2 &= ~INP2_UDP_GRO;
+			}
+			break;
+
 		case SO_FLUSH:
 			if ((error = sooptcopyin(sopt, &optval, sizeof(optval),
 			    sizeof(optval))) != 0) {
@@ -1109,6 +1142,14 @@ udp_ctloutput(struct socket *so, struct sockopt *sopt)
 			optval = inp->inp_flags & INP_UDP_NOCKSUM;
 			break;
 
+		case UDP_SEGMENT:
+			optval = inp->inp_udp_segsz;
+			break;
+
+		case UDP_GRO:
+			optval = !!(inp->inp_flags2 & INP2_UDP_GRO);
+			break;
+
 		default:
 			error = ENOPROTOOPT;
 			break;
@@ -1121,6 +1162,111 @@ udp_ctloutput(struct socket *so, struct sockopt *sopt)
 	return error;
 }
 
+/*
+ * UDP_SEGMENT: split a datagram whose first hlen bytes are its IP and UDP
+ * headers into datagrams carrying at most segsz bytes of payload each,
+ * linked through m_nextpkt. The headers and the packet metadata are copied
+ * from the original; the caller fixes up the lengths and checksums.
+ *
+ * Returns the head of the chain, or NULL after freeing everything.
+ */
+struct mbuf *
+udp_gso_segment(struct mbuf *m, int hlen, int segsz, u_int32_t *cnt)
+{
+	struct mbuf *tail = m, *n;
+	int off, len, total = m->m_pkthdr.len;
+
+	VERIFY(m->m_len >= hlen && hlen <= MHLEN);
+
+	*cnt = 1;
+	for (off = hlen + segsz; off < total; off += segsz) {
+		len = MIN(segsz, total - off);
+		if ((n = m_gethdr(M_DONTWAIT, MT_DATA)) == NULL) {
+			goto fail;
+		}
+		if (m_dup_pkthdr(n, m, M_DONTWAIT) == 0 ||
+		    (n->m_next = m_copym(m, off, len, M_DONTWAIT)) == NULL) {
+			m_freem(n);
+			goto fail;
+		}
+		bcopy(mtod(m, caddr_t), mtod(n, caddr_t), hlen);
+		n->m_len = hlen;
+		n->m_pkthdr.len = hlen + len;
+		tail->m_nextpkt = n;
+		tail = n;
+		(*cnt)++;
+	}
+	if (*cnt > 1) {
+		/* the payload now lives in the copies */
+		m_adj(m, -(total - hlen - segsz));
+	}
+	return m;
+
+fail:
+	m_freem_list(m);
+	return NULL;
+}
+
+/*
+ * UDP_GRO: coalesce a datagram onto the last one queued on the socket if
+ * it came from the same source and the train so far only has datagrams of
+ * the same size. Otherwise tag it with its size so that the next ones can
+ * be coalesced onto it.
+ *
+ * Returns 1 if m was queued, in which case the caller must not append it.
+ */
+int
+udp_gro_append(struct socket *so, struct sockaddr *from, struct mbuf *m,
+    struct mbuf **opts)
+{
+	struct sockbuf *sb = &so->so_rcv;
+	struct mbuf *rec = sb->sb_lastrecord, *ctl, *n, **mp;
+	struct cmsghdr *cm;
+	int len = m->m_pkthdr.len, segsz, reclen = 0;
+
+	/*
+	 * Only trains without other control messages are extended, and never
+	 * the record a reader might be in the middle of.
+	 */
+	if (*opts != NULL || so->so_filt != NULL || rec == NULL ||
+	    (sb->sb_flags & SB_DROP) ||
+	    (rec == sb->sb_mb && (sb->sb_flags & SB_LOCK)) ||
+	    rec->m_type != MT_SONAME || rec->m_len != from->sa_len ||
+	    bcmp(mtod(rec, caddr_t), from, from->sa_len) != 0 ||
+	    (ctl = rec->m_next) == NULL || ctl->m_type != MT_CONTROL ||
+	    ctl->m_len != CMSG_SPACE(sizeof(segsz))) {
+		goto tag;
+	}
+	cm = mtod(ctl, struct cmsghdr *);
+	if (cm->cmsg_level != IPPROTO_UDP || cm->cmsg_type != UDP_GRO) {
+		goto tag;
+	}
+	bcopy(CMSG_DATA(cm), &segsz, sizeof(segsz));
+	for (n = ctl->m_next; n != NULL; n = n->m_next) {
+		reclen += n->m_len;
+	}
+	if (len == 0 || len > segsz || reclen % segsz != 0 ||
+	    reclen + len > IP_MAXPACKET || sbspace(sb) < len) {
+		goto tag;
+	}
+
+	sb->sb_mbtail->m_next = m;
+	for (n = m; n != NULL; n = n->m_next) {
+		sballoc(sb, n);
+		sb->sb_mbtail = n;
+	}
+	SBLASTMBUFCHK(sb, __func__);
+	return 1;
+
+tag:
+	for (mp = opts; *mp != NULL && (*mp)->m_next != NULL; mp = &(*mp)->m_next) {
+		;
+	}
+	(void) sbcreatecontrol_mbuf((caddr_t)&len, sizeof(len), UDP_GRO,
+	    IPPROTO_UDP, mp);
+	return 0;
+}
+
 static int
 udp_pcblist SYSCTL_HANDLER_ARGS
 {
@@ -1442,35 +1588,23 @@ udp_check_pktinfo(struct mbuf *control, struct ifnet **outif,
 
 		pktinfo =  (struct in_pktinfo *)(void *)CMSG_DATA(cm);
 
-		/* Check for a valid ifindex in pktinfo */
-		ifnet_head_lock_shared();
-
-		if (pktinfo->ipi_ifindex > if_index) {
-			ifnet_head_done();
-			return ENXIO;
-		}
-
 		/*
 		 * If ipi_ifindex is specified it takes precedence
 		 * over ipi_spec_dst.
 		 */
 		if (pktinfo->ipi_ifindex) {
-			ifp = ifindex2ifnet[pktinfo->ipi_ifindex];
+			ifp = ifnet_byindex_smr(pktinfo->ipi_ifindex);
 			if (ifp == NULL) {
-				ifnet_head_done();
 				return ENXIO;
 			}
 			if (outif != NULL) {
 				ifnet_reference(ifp);
 				*outif = ifp;
 			}
-			ifnet_head_done();
 			laddr->s_addr = INADDR_ANY;
 			break;
 		}
 
-		ifnet_head_done();
-
 		/*
 		 * Use the provided ipi_spec_dst address for temp
 		 * source address.
@@ -1518,6 +1652,8 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 	struct ifnet *origoutifp = NULL;
 	int flowadv = 0;
 	int tos = IPTOS_UNSPEC;
+	int segsz = inp->inp_udp_segsz;
+	u_int32_t pktcnt = 1;
 
 	/* Enable flow advisory only when connected */
 	flowadv = (so->so_state & SS_ISCONNECTED) ? 1 : 0;
@@ -1584,6 +1720,15 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 		goto release;
 	}
 
+	/* UDP_SEGMENT only applies to sends that don't fit in one datagram */
+	if (segsz != 0 && len <= segsz) {
+		segsz = 0;
+	}
+	if (segsz != 0 && len > segsz * UDP_MAX_SEGMENTS) {
+		error = EMSGSIZE;
+		goto release;
+	}
+
 	if (flowadv && INP_WAIT_FOR_IF_FEEDBACK(inp)) {
 		/*
 		 * The socket is flow-controlled, drop the packets
@@ -1843,7 +1988,7 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 	 * later operation at IP layer that modify the values used here must
 	 * update the checksum as well (for example NAT etc).
 	 */
-	if ((inp->inp_flags2 & INP2_CLAT46_FLOW) ||
+	if ((inp->inp_flags2 & INP2_CLAT46_FLOW) || segsz != 0 ||
 	    (udpcksum && !(inp->inp_flags & INP_UDP_NOCKSUM))) {
 		ui->ui_sum = in_pseudo(ui->ui_src.s_addr, ui->ui_dst.s_addr,
 		    htons((u_short)len + sizeof(struct udphdr) + IPPROTO_UDP));
@@ -1991,8 +2136,36 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 		ipoa.ipoa_flags |= IPOAF_BOUND_SRCADDR;
 	}
 
+	if (segsz != 0) {
+		struct mbuf *n;
+		int ulen;
+
+		/*
+		 * Segmented sends are always checksummed, and go down
+		 * as one packet chain sharing the route lookup.
+		 */
+		m = udp_gso_segment(m, sizeof(struct udpiphdr), segsz, &pktcnt);
+		if (m == NULL) {
+			if (mopts != NULL) {
+				IMO_REMREF(mopts);
+			}
+			inp_route_copyin(inp, &ro);
+			error = ENOBUFS;
+			goto abort;
+		}
+		for (n = m; n != NULL; n = n->m_nextpkt) {
+			ui = mtod(n, struct udpiphdr *);
+			ulen = n->m_pkthdr.len - (int)sizeof(struct ip);
+			ui->ui_ulen = htons((u_short)ulen);
+			ui->ui_sum = in_pseudo(ui->ui_src.s_addr, ui->ui_dst.s_addr,
+			    htons((u_short)ulen + IPPROTO_UDP));
+			((struct ip *)ui)->ip_len = (uint16_t)n->m_pkthdr.len;
+		}
+		udpstat.udps_opackets += pktcnt - 1;
+	}
+
 	socket_unlock(so, 0);
-	error = ip_output(m, inpopts, &ro, soopts, mopts, &ipoa);
+	error = ip_output_list(m, pktcnt > 1, inpopts, &ro, soopts, mopts, &ipoa);
 	m = NULL;
 	socket_lock(so, 0);
 	if (mopts != NULL) {
@@ -2019,7 +2192,7 @@ udp_output(struct inpcb *inp, struct mbuf *m, struct sockaddr *addr,
 		} else {
 			cell = wifi = wired = FALSE;
 		}
-		INP_ADD_STAT(inp, cell, wifi, wired, txpackets, 1);
+		INP_ADD_STAT(inp, cell, wifi, wired, txpackets, pktcnt);
 		INP_ADD_STAT(inp, cell, wifi, wired, txbytes, len);
 		inp_set_activity_bitmap(inp);
 	}
@@ -182,6 +182,10 @@ extern uint32_t udp_find_anypcb_byaddr(struct ifaddr *);
 extern void udp_fill_keepalive_offload_frames(struct ifnet *,
     struct ifnet_keepalive_offload_frame *, u_int32_t, size_t, u_int32_t *);
 
+extern struct mbuf *udp_gso_segment(struct mbuf *, int, int, u_int32_t *);
+extern int udp_gro_append(struct socket *, struct sockaddr *, struct mbuf *,
+    struct mbuf **);
+
 __END_DECLS
 #endif /* BSD_KERNEL_PRIVATE */
 #endif /* _NETINET_UDP_VAR_H_ */
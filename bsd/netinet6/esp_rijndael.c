@@ -65,6 +65,7 @@
 #include <sys/syslog.h>
 #include <sys/mbuf.h>
 #include <sys/mcache.h>
+#include <sys/sysctl.h>
 
 #include <kern/locks.h>
 
@@ -93,6 +94,17 @@ typedef struct {
 	ccgcm_ctx ctxt[0];
 } aes_gcm_ctx;
 
+/*
+ * AES-GCM runs in place when the payload mbufs allow it, saving a
+ * cluster allocation and a copy of every packet.
+ */
+static int esp_gcm_inplace = 1;
+
+SYSCTL_DECL(_net_inet_ipsec);
+SYSCTL_INT(_net_inet_ipsec, OID_AUTO, esp_gcm_inplace,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &esp_gcm_inplace, 0,
+    "Encrypt and decrypt AES-GCM payloads in place when possible");
+
 size_t
 esp_aes_schedlen(
 	__unused const struct esp_algorithm *algo)
@@ -671,6 +683,55 @@ esp_gcm_decrypt_finalize(struct secasvar *sav,
 	return aes_decrypt_finalize_gcm(tag, tag_bytes, ctx->decrypt);
 }
 
+/*
+ * The payload starting at bodyoff may be overwritten if no mbuf holding
+ * it shares its cluster (the same test as ipsec_copypkt()) and every
+ * segment starts aligned.
+ */
+static bool
+esp_gcm_can_inplace(struct mbuf *m, size_t bodyoff)
+{
+	size_t off = 0, start;
+
+	for (; m != NULL; off += m->m_len, m = m->m_next) {
+		if (off + m->m_len <= bodyoff) {
+			continue;
+		}
+		start = (bodyoff > off) ? bodyoff - off : 0;
+		if ((m->m_flags & M_EXT) &&
+		    (m_get_ext_free(m) != NULL || m_mclhasreference(m))) {
+			return false;
+		}
+		if (!IPSEC_IS_P2ALIGNED(mtod(m, u_int8_t *) + start)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int
+esp_gcm_crypt_inplace(struct mbuf *m, size_t bodyoff, ccgcm_ctx *ctx,
+    bool encrypt)
+{
+	size_t off = 0, start;
+	u_int8_t *p;
+	unsigned int len;
+
+	for (; m != NULL; off += m->m_len, m = m->m_next) {
+		if (off + m->m_len <= bodyoff) {
+			continue;
+		}
+		start = (bodyoff > off) ? bodyoff - off : 0;
+		p = mtod(m, u_int8_t *) + start;
+		len = (unsigned int)(m->m_len - start);
+		if (encrypt ? aes_encrypt_gcm(p, len, p, ctx) :
+		    aes_decrypt_gcm(p, len, p, ctx)) {
+			return EINVAL;
+		}
+	}
+	return 0;
+}
+
 int
 esp_gcm_encrypt_aes(
 	struct mbuf *m,
@@ -769,6 +830,15 @@ esp_gcm_encrypt_aes(
 		return EINVAL;
 	}
 
+	if (esp_gcm_inplace && esp_gcm_can_inplace(m, bodyoff)) {
+		if (esp_gcm_crypt_inplace(m, bodyoff, ctx->encrypt, true)) {
+			ipseclog((LOG_ERR, "%s: failed to encrypt\n", __FUNCTION__));
+			m_freem(m);
+			return EINVAL;
+		}
+		return 0;
+	}
+
 	s = m;
 	soff = sn = dn = 0;
 	d = d0 = dp = NULL;
@@ -993,6 +1063,15 @@ esp_gcm_decrypt_aes(
 		return EINVAL;
 	}
 
+	if (esp_gcm_inplace && esp_gcm_can_inplace(m, bodyoff)) {
+		if (esp_gcm_crypt_inplace(m, bodyoff, ctx->decrypt, false)) {
+			ipseclog((LOG_ERR, "%s: failed to decrypt\n", __FUNCTION__));
+			m_freem(m);
+			return EINVAL;
+		}
+		return 0;
+	}
+
 	s = m;
 	soff = sn = dn = 0;
 	d = d0 = dp = NULL;
@@ -127,6 +127,7 @@
 
 #include <kern/kern_types.h>
 #include <kern/zalloc.h>
+#include <kern/smr.h>
 
 #if IPSEC
 #include <netinet6/ipsec.h>
@@ -1201,8 +1202,7 @@ in6_pcblookup_local(struct inpcbinfo *pcbinfo, struct in6_addr *laddr,
 		 * Look for an unconnected (wildcard foreign addr) PCB that
 		 * matches the local address and port we're looking for.
 		 */
-		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-		    pcbinfo->ipi_hashmask)];
+		head = INP_PCBHASH_HEAD(pcbinfo, INADDR_ANY, lport, 0);
 		LIST_FOREACH(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV6)) {
 				continue;
@@ -1341,8 +1341,8 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	/*
 	 * First look for an exact match.
 	 */
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr->s6_addr32[3] /* XXX */,
-	    lport, fport, pcbinfo->ipi_hashmask)];
+	head = INP_PCBHASH_HEAD(pcbinfo, faddr->s6_addr32[3] /* XXX */,
+	    lport, fport);
 	LIST_FOREACH(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV6)) {
 			continue;
@@ -1381,8 +1381,7 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	if (wildcard) {
 		struct inpcb *local_wild = NULL;
 
-		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-		    pcbinfo->ipi_hashmask)];
+		head = INP_PCBHASH_HEAD(pcbinfo, INADDR_ANY, lport, 0);
 		LIST_FOREACH(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV6)) {
 				continue;
@@ -1437,6 +1436,54 @@ in6_pcblookup_hash_exists(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	return 0;
 }
 
+/*
+ * Lockless lookup of an exact match; see in_pcblookup_hash_smr().
+ */
+static struct inpcb *
+in6_pcblookup_hash_smr(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
+    uint16_t fport, uint32_t fifscope, struct in6_addr *laddr, uint16_t lport,
+    uint32_t lifscope, struct ifnet *ifp)
+{
+	struct inpcbhead *head;
+	struct inpcb *inp;
+
+	head = INP_PCBHASH_HEAD(pcbinfo, faddr->s6_addr32[3] /* XXX */,
+	    lport, fport);
+
+	smr_global_enter();
+	for (inp = INP_HASH_FIRST_SMR(head); inp != NULL;
+	    inp = INP_HASH_NEXT_SMR(inp)) {
+		if ((inp->inp_vflag & INP_IPV6) &&
+		    in6_are_addr_equal_scoped(&inp->in6p_faddr, faddr, inp->inp_fifscope, fifscope) &&
+		    in6_are_addr_equal_scoped(&inp->in6p_laddr, laddr, inp->inp_lifscope, lifscope) &&
+		    inp->inp_fport == fport &&
+		    inp->inp_lport == lport) {
+			break;
+		}
+	}
+	if (inp != NULL &&
+	    in_pcb_checkstate(inp, WNT_ACQUIRE, 0) == WNT_STOPUSING) {
+		inp = NULL;
+	}
+	smr_global_leave();
+
+	if (inp == NULL) {
+		return NULL;
+	}
+
+	if (!(inp->inp_vflag & INP_IPV6) ||
+	    !in6_are_addr_equal_scoped(&inp->in6p_faddr, faddr, inp->inp_fifscope, fifscope) ||
+	    !in6_are_addr_equal_scoped(&inp->in6p_laddr, laddr, inp->inp_lifscope, lifscope) ||
+	    inp->inp_fport != fport || inp->inp_lport != lport) {
+		in_pcb_checkstate(inp, WNT_RELEASE, 0);
+		return NULL;
+	}
+	if (!in_pcbhash_admit(inp, ifp)) {
+		return NULL;
+	}
+	return inp;
+}
+
 /*
  * Lookup PCB in hash list.
  */
@@ -1449,13 +1496,19 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	struct inpcb *inp;
 	uint16_t fport = (uint16_t)fport_arg, lport = (uint16_t)lport_arg;
 
+	inp = in6_pcblookup_hash_smr(pcbinfo, faddr, fport, fifscope, laddr,
+	    lport, lifscope, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	lck_rw_lock_shared(&pcbinfo->ipi_lock);
 
 	/*
 	 * First look for an exact match.
 	 */
-	head = &pcbinfo->ipi_hashbase[INP_PCBHASH(faddr->s6_addr32[3] /* XXX */,
-	    lport, fport, pcbinfo->ipi_hashmask)];
+	head = INP_PCBHASH_HEAD(pcbinfo, faddr->s6_addr32[3] /* XXX */,
+	    lport, fport);
 	LIST_FOREACH(inp, head, inp_hash) {
 		if (!(inp->inp_vflag & INP_IPV6)) {
 			continue;
@@ -1492,8 +1545,7 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
 	if (wildcard) {
 		struct inpcb *local_wild = NULL;
 
-		head = &pcbinfo->ipi_hashbase[INP_PCBHASH(INADDR_ANY, lport, 0,
-		    pcbinfo->ipi_hashmask)];
+		head = INP_PCBHASH_HEAD(pcbinfo, INADDR_ANY, lport, 0);
 		LIST_FOREACH(inp, head, inp_hash) {
 			if (!(inp->inp_vflag & INP_IPV6)) {
 				continue;
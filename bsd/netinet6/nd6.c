@@ -87,6 +87,7 @@
 #include <net/if_dl.h>
 #include <net/if_types.h>
 #include <net/if_llreach.h>
+#include <net/if_llcache.h>
 #include <net/route.h>
 #include <net/dlil.h>
 #include <net/ntstat.h>
@@ -299,6 +300,7 @@ nd6_init(void)
 
 	nd6_nbr_init();
 	nd6_rtr_init();
+	llcache_init();
 
 	nd6_init_done = 1;
 
@@ -3026,6 +3028,7 @@ nd6_rtrequest(int req, struct rtentry *rt, struct sockaddr *sa)
 		if (ln == NULL) {
 			break;
 		}
+		llcache_invalidate(ifp, rt_key(rt));
 		/* leave from solicited node multicast for proxy ND */
 		if ((rt->rt_flags & RTF_ANNOUNCE) &&
 		    (ifp->if_flags & IFF_MULTICAST)) {
@@ -3812,6 +3815,7 @@ fail:
 		 * Record source link-layer address
 		 * XXX is it dependent to ifp->if_type?
 		 */
+		llcache_invalidate(ifp, rt_key(rt));
 		sdl->sdl_alen = ifp->if_addrlen;
 		bcopy(lladdr, LLADDR(sdl), ifp->if_addrlen);
 
@@ -4712,6 +4716,13 @@ nd6_lookup_ipv6(ifnet_t  ifp, const struct sockaddr_in6 *ip6_dest,
 		return ENETDOWN;
 	}
 
+	if ((packet == NULL || !(packet->m_flags & M_MCAST)) &&
+	    !IN6_IS_ADDR_MULTICAST(&ip6_dest->sin6_addr) &&
+	    llcache_lookup(ifp, (const struct sockaddr *)ip6_dest, ll_dest,
+	    ll_dest_len)) {
+		return 0;
+	}
+
 	if (hint != NULL) {
 		/*
 		 * Callee holds a reference on the route and returns
@@ -4786,6 +4797,10 @@ nd6_lookup_ipv6(ifnet_t  ifp, const struct sockaddr_in6 *ip6_dest,
 
 	copy_len = sdl->sdl_len <= ll_dest_len ? sdl->sdl_len : ll_dest_len;
 	bcopy(sdl, ll_dest, copy_len);
+	/* NUD runs in nd6_output_list(), the cache only saves us the lookup */
+	if (route->rt_flags & RTF_LLINFO) {
+		llcache_enter(ifp, rt_key(route), sdl, 0);
+	}
 
 release:
 	if (route != NULL) {
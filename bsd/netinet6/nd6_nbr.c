@@ -79,6 +79,7 @@
 #include <net/if_types.h>
 #include <net/if_dl.h>
 #include <net/if_llreach.h>
+#include <net/if_llcache.h>
 #include <net/route.h>
 #include <net/dlil.h>
 #include <net/nwk_wq.h>
@@ -1075,6 +1076,7 @@ nd6_na_input(struct mbuf *m, int off, int icmp6len)
 		/*
 		 * Record link-layer address, and update the state.
 		 */
+		llcache_invalidate(ifp, rt_key(rt));
 		sdl->sdl_alen = ifp->if_addrlen;
 		bcopy(lladdr, LLADDR(sdl), ifp->if_addrlen);
 		if (is_solicited) {
@@ -1193,6 +1195,7 @@ nd6_na_input(struct mbuf *m, int off, int icmp6len)
 			 * Update link-local address, if any.
 			 */
 			if (lladdr) {
+				llcache_invalidate(ifp, rt_key(rt));
 				sdl->sdl_alen = ifp->if_addrlen;
 				bcopy(lladdr, LLADDR(sdl), ifp->if_addrlen);
 			}
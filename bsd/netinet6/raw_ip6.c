@@ -853,7 +853,7 @@ rip6_output(
 			 * outgoing interface
 			 */
 			if (ip6oa.ip6oa_flags & IP6OAF_BOUND_IF) {
-				outif = ifindex2ifnet[ip6oa.ip6oa_boundif];
+				outif = ifnet_byindex_smr(ip6oa.ip6oa_boundif);
 			} else {
 				outif = rt->rt_ifp;
 			}
@@ -170,6 +170,8 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 	struct socket *so = in6p->in6p_socket;
 	struct route_in6 ro;
 	int flowadv = 0;
+	int segsz = in6p->inp_udp_segsz;
+	u_int32_t pktcnt = 1;
 	bool sndinprog_cnt_used = false;
 #if CONTENT_FILTER
 	struct m_tag *cfil_tag = NULL;
@@ -394,6 +396,16 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 		hlen = sizeof(struct ip);
 	}
 
+	/* UDP_SEGMENT only applies to sends that don't fit in one datagram */
+	if (segsz != 0 && (af != AF_INET6 || ulen <= (u_int32_t)segsz)) {
+		segsz = 0;
+	}
+	if (segsz != 0 && (ulen > (u_int32_t)segsz * UDP_MAX_SEGMENTS ||
+	    plen > IPV6_MAXPACKET)) {
+		error = EMSGSIZE;
+		goto release;
+	}
+
 	if (fport == htons(53) && !(so->so_flags1 & SOF1_DNS_COUNTED)) {
 		so->so_flags1 |= SOF1_DNS_COUNTED;
 		INC_ATOMIC_INT64_LIM(net_api_stats.nas_socket_inet_dgram_dns);
@@ -572,8 +584,35 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 		ip6_output_setdstifscope(m, fifscope, NULL);
 		ip6_output_setsrcifscope(m, lifscope, NULL);
 
+		if (segsz != 0) {
+			struct mbuf *n;
+			u_int32_t seglen;
+
+			/* sent as one packet chain sharing the route lookup */
+			m = udp_gso_segment(m, hlen + sizeof(struct udphdr),
+			    segsz, &pktcnt);
+			if (m == NULL) {
+				if (im6o != NULL) {
+					IM6O_REMREF(im6o);
+				}
+				in6p_route_copyin(in6p, &ro);
+				error = ENOBUFS;
+				goto release;
+			}
+			for (n = m; n != NULL; n = n->m_nextpkt) {
+				ip6 = mtod(n, struct ip6_hdr *);
+				udp6 = (struct udphdr *)(void *)(mtod(n, caddr_t) + hlen);
+				seglen = n->m_pkthdr.len - hlen;
+				udp6->uh_ulen = htons((u_short)seglen);
+				udp6->uh_sum = in6_pseudo(&ip6->ip6_src, &ip6->ip6_dst,
+				    htonl(seglen + IPPROTO_UDP));
+			}
+			udp6stat.udp6s_opackets += pktcnt - 1;
+		}
+
 		socket_unlock(so, 0);
-		error = ip6_output(m, optp, &ro, flags, im6o, NULL, &ip6oa);
+		error = ip6_output_list(m, pktcnt > 1, optp, &ro, flags, im6o,
+		    NULL, &ip6oa);
 		m = NULL;
 		socket_lock(so, 0);
 
@@ -603,7 +642,7 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 			} else {
 				cell = wifi = wired = FALSE;
 			}
-			INP_ADD_STAT(in6p, cell, wifi, wired, txpackets, 1);
+			INP_ADD_STAT(in6p, cell, wifi, wired, txpackets, pktcnt);
 			INP_ADD_STAT(in6p, cell, wifi, wired, txbytes, ulen);
 			inp_set_activity_bitmap(in6p);
 		}
@@ -667,7 +706,7 @@ udp6_output(struct in6pcb *in6p, struct mbuf *m, struct sockaddr *addr6,
 				 * outgoing interface
 				 */
 				if (ip6oa.ip6oa_flags & IP6OAF_BOUND_IF) {
-					outif = ifindex2ifnet[ip6oa.ip6oa_boundif];
+					outif = ifnet_byindex_smr(ip6oa.ip6oa_boundif);
 				} else {
 					outif = rt->rt_ifp;
 				}
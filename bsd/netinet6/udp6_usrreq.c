@@ -633,7 +633,11 @@ udp6_input(struct mbuf **mp, int *offp, int proto)
 		inp_set_activity_bitmap(in6p);
 	}
 	so_recv_data_stat(in6p->in6p_socket, m, 0);
-	if (sbappendaddr(&in6p->in6p_socket->so_rcv,
+	if ((in6p->inp_flags2 & INP2_UDP_GRO) &&
+	    udp_gro_append(in6p->in6p_socket, (struct sockaddr *)&udp_in6,
+	    m, &opts)) {
+		/* coalesced onto the last queued datagram */
+	} else if (sbappendaddr(&in6p->in6p_socket->so_rcv,
 	    (struct sockaddr *)&udp_in6, m, opts, NULL) == 0) {
 		m = NULL;
 		opts = NULL;
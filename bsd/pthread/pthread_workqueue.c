@@ -32,7 +32,9 @@
 #include <kern/assert.h>
 #include <kern/ast.h>
 #include <kern/clock.h>
+#include <kern/counter.h>
 #include <kern/cpu_data.h>
+#include <kern/cpu_number.h>
 #include <kern/kern_types.h>
 #include <kern/policy_internal.h>
 #include <kern/processor.h>
@@ -153,8 +155,28 @@ wq_cooperative_queue_max_size(struct workqueue *wq)
 	return wq->wq_cooperative_queue_has_limited_max_size ? 1 : wq_max_cooperative_threads;
 }
 
+/* How many warm idle threads to look at when looking for one on this core */
+#define WORKQ_IDLE_AFFINITY_SCAN        4
+
+SCALABLE_COUNTER_DEFINE(workq_lock_holds);
+SCALABLE_COUNTER_DEFINE(workq_lock_hold_abs);
+SCALABLE_COUNTER_DEFINE(workq_req_fulfilled);
+SCALABLE_COUNTER_DEFINE(workq_req_latency_abs);
+SCALABLE_COUNTER_DEFINE(workq_idle_affinity_hits);
+
 #pragma mark sysctls
 
+SYSCTL_SCALABLE_COUNTER(_kern, wq_lock_holds, workq_lock_holds,
+    "number of times a workqueue lock was released");
+SYSCTL_SCALABLE_COUNTER(_kern, wq_lock_hold_time, workq_lock_hold_abs,
+    "total time workqueue locks were held (mach absolute time)");
+SYSCTL_SCALABLE_COUNTER(_kern, wq_req_fulfilled, workq_req_fulfilled,
+    "number of thread requests handed to a thread");
+SYSCTL_SCALABLE_COUNTER(_kern, wq_req_latency, workq_req_latency_abs,
+    "total time thread requests spent queued (mach absolute time)");
+SYSCTL_SCALABLE_COUNTER(_kern, wq_idle_affinity_hits, workq_idle_affinity_hits,
+    "number of idle threads picked because they parked on the current core");
+
 static int
 workq_sysctl_handle_usecs SYSCTL_HANDLER_ARGS
 {
@@ -498,6 +520,7 @@ static inline void
 workq_lock_spin(struct workqueue *wq)
 {
 	lck_ticket_lock(&wq->wq_lock, &workq_lck_grp);
+	wq->wq_lock_acquired = mach_absolute_time();
 }
 
 static inline void
@@ -509,13 +532,21 @@ workq_lock_held(struct workqueue *wq)
 static inline bool
 workq_lock_try(struct workqueue *wq)
 {
-	return lck_ticket_lock_try(&wq->wq_lock, &workq_lck_grp);
+	if (lck_ticket_lock_try(&wq->wq_lock, &workq_lck_grp)) {
+		wq->wq_lock_acquired = mach_absolute_time();
+		return true;
+	}
+	return false;
 }
 
 static inline void
 workq_unlock(struct workqueue *wq)
 {
+	uint64_t held = mach_absolute_time() - wq->wq_lock_acquired;
+
 	lck_ticket_unlock(&wq->wq_lock);
+	counter_add(&workq_lock_hold_abs, held);
+	counter_inc(&workq_lock_holds);
 }
 
 #pragma mark idle thread lists
@@ -968,13 +999,40 @@ workq_kill_old_threads_call(void *param0, void *param1 __unused)
 	workq_unlock(wq);
 }
 
+/*
+ * Among the few most recently parked threads (which still have a warm
+ * stack), prefer one that parked on the current core, so that its
+ * cache footprint is likely still around.
+ */
+static struct uthread *
+workq_idle_thread_for_cpu(struct workqueue *wq)
+{
+	struct uthread *uth, *first = TAILQ_FIRST(&wq->wq_thidlelist);
+	uint16_t cpu = (uint16_t)cpu_number();
+	int scanned = 0;
+
+	TAILQ_FOREACH(uth, &wq->wq_thidlelist, uu_workq_entry) {
+		if (scanned++ >= WORKQ_IDLE_AFFINITY_SCAN ||
+		    !uth->uu_save.uus_workq_park_data.has_stack) {
+			break;
+		}
+		if (uth->uu_save.uus_workq_park_data.park_cpu == cpu) {
+			if (uth != first) {
+				counter_inc(&workq_idle_affinity_hits);
+			}
+			return uth;
+		}
+	}
+	return first;
+}
+
 static struct uthread *
 workq_pop_idle_thread(struct workqueue *wq, uint16_t uu_flags,
     bool *needs_wakeup)
 {
 	struct uthread *uth;
 
-	if ((uth = TAILQ_FIRST(&wq->wq_thidlelist))) {
+	if ((uth = workq_idle_thread_for_cpu(wq))) {
 		TAILQ_REMOVE(&wq->wq_thidlelist, uth, uu_workq_entry);
 	} else {
 		uth = TAILQ_FIRST(&wq->wq_thnewlist);
@@ -1254,6 +1312,7 @@ workq_push_idle_thread(proc_t p, struct workqueue *wq, struct uthread *uth,
 	}
 
 	uth->uu_save.uus_workq_park_data.idle_stamp = now;
+	uth->uu_save.uus_workq_park_data.park_cpu = (uint16_t)cpu_number();
 
 	struct uthread *oldest = workq_oldest_killable_idle_thread(wq);
 	uint16_t cur_idle = wq->wq_thidlecount;
@@ -1578,6 +1637,7 @@ workq_threadreq_enqueue(struct workqueue *wq, workq_threadreq_t req)
 	assert(req->tr_state == WORKQ_TR_STATE_NEW);
 
 	req->tr_state = WORKQ_TR_STATE_QUEUED;
+	req->tr_enqueue_time = mach_absolute_time();
 	wq->wq_reqcount += req->tr_count;
 
 	if (req->tr_qos == WORKQ_THREAD_QOS_MANAGER) {
@@ -1634,6 +1694,9 @@ workq_threadreq_dequeue(struct workqueue *wq, workq_threadreq_t req,
 {
 	wq->wq_reqcount--;
 
+	counter_add(&workq_req_latency_abs, mach_absolute_time() - req->tr_enqueue_time);
+	counter_inc(&workq_req_fulfilled);
+
 	bool next_highest_request_changed = false;
 
 	if (--req->tr_count == 0) {
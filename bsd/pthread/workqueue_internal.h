@@ -182,6 +182,7 @@ typedef struct workq_threadreq_s {
 	workq_tr_flags_t   tr_flags;
 	workq_tr_state_t   tr_state;
 	thread_qos_t       tr_qos;                 /* qos for the thread request */
+	uint64_t           tr_enqueue_time;        /* when the request was queued */
 
 	/* kqueue states, modified under the kqlock */
 	kq_index_t         tr_kq_override_index;   /* highest wakeup override index */
@@ -220,6 +221,7 @@ struct workqueue {
 	};
 
 	lck_ticket_t    wq_lock;
+	uint64_t        wq_lock_acquired;       /* for lock hold time accounting */
 
 	uint64_t        wq_thread_call_last_run;
 	struct os_refcnt wq_refcnt;
@@ -58,6 +58,7 @@
 #include <sys/sdt.h>
 #include <skywalk/os_skywalk_private.h>
 #include <skywalk/nexus/netif/nx_netif.h>
+#include <skywalk/nexus/monitor/nx_monitor.h>
 
 #define KEV_EVTID(code) BSDDBG_CODE(DBG_BSD_KEVENT, (code))
 
@@ -2253,6 +2254,18 @@ ch_set_opt(struct kern_channel *ch, struct sockopt *sopt)
 		err = ch_configure_interface_advisory_event(ch, sopt);
 		break;
 
+	case CHOPT_MONITOR_FILTER:
+#if CONFIG_NEXUS_MONITOR
+		if (ch->ch_na == NULL || (ch->ch_flags & CHANF_CLOSING)) {
+			err = ENXIO;
+		} else {
+			err = nx_mon_set_filter(ch->ch_na, sopt);
+		}
+#else /* !CONFIG_NEXUS_MONITOR */
+		err = ENOTSUP;
+#endif /* !CONFIG_NEXUS_MONITOR */
+		break;
+
 	default:
 		err = ENOPROTOOPT;
 		break;
@@ -248,14 +248,14 @@ kern_channel_increment_ring_net_stats(kern_channel_ring_t kring,
     struct ifnet *ifp, struct kern_channel_ring_stat_increment *stats)
 {
 	if (kring->ckr_tx == NR_TX) {
-		atomic_add_64(&ifp->if_data.ifi_opackets,
+		IFNET_STAT_ADD(ifp, ifi_opackets,
 		    stats->kcrsi_slots_transferred);
-		atomic_add_64(&ifp->if_data.ifi_obytes,
+		IFNET_STAT_ADD(ifp, ifi_obytes,
 		    stats->kcrsi_bytes_transferred);
 	} else {
-		atomic_add_64(&ifp->if_data.ifi_ipackets,
+		IFNET_STAT_ADD(ifp, ifi_ipackets,
 		    stats->kcrsi_slots_transferred);
-		atomic_add_64(&ifp->if_data.ifi_ibytes,
+		IFNET_STAT_ADD(ifp, ifi_ibytes,
 		    stats->kcrsi_bytes_transferred);
 	}
 
@@ -1020,6 +1020,13 @@ kr_rxsync_prologue(struct kern_channel *ch, struct __kern_channel_ring *kring,
 		slot_count += kring->ckr_num_slots;
 	}
 
+#if CONFIG_NEXUS_FLOWSWITCH
+	if (__improbable(kring->ckr_rx_pickup_wait != 0) && slot_count > 0) {
+		kring->ckr_rx_pickup_time = mach_absolute_time();
+		kring->ckr_rx_pickup_wait = 0;
+	}
+#endif /* CONFIG_NEXUS_FLOWSWITCH */
+
 	/*
 	 * Invoke nexus-specific RX prologue callback, which may detach
 	 * and free any consumed packets.  Configured in na_kr_create().
@@ -1403,6 +1410,8 @@ kr_rxsync_finalize(struct kern_channel *ch, struct __kern_channel_ring *kring,
 	*(slot_idx_t *)(uintptr_t)&kring->ckr_ring->ring_tail =
 	    kring->ckr_rtail = ckr_ktail;
 	*(slot_idx_t *)(uintptr_t)&kring->ckr_ring->ring_khead = ckr_khead;
+	*(slot_idx_t *)(uintptr_t)&kring->ckr_ring->ring_ktail_hint =
+	    ckr_ktail;
 
 	SK_DF(SK_VERB_SYNC | SK_VERB_RX, "%s(%d) kr \"%s\", kh %u kt %u | "
 	    "rh %u rt %u | h %u t %u", sk_proc_name_address(p),
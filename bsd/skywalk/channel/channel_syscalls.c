@@ -52,12 +52,68 @@ static const struct fileops channel_ops = {
 	.fo_kqfilter = chop_kqfilter,
 };
 
+/*
+ * An RX sync on a CHMODE_BUSY_POLL channel that finds nothing for the
+ * user spins for up to ch_busy_poll_usec, so that packets arriving in
+ * the meantime are returned without an event and another sync.  Rings
+ * filled by the kernel (e.g. flowswitch) are watched for their tail to
+ * move; every CH_BUSY_POLL_RESYNC_USEC the rings are synced again, which
+ * polls rings whose provider is only driven by syncs.
+ */
+#define CH_BUSY_POLL_USEC_MAX           1000
+#define CH_BUSY_POLL_RESYNC_USEC        2
+static uint32_t ch_busy_poll_usec = 50;
+SYSCTL_UINT(_kern_skywalk_channel, OID_AUTO, busy_poll_usec,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &ch_busy_poll_usec, 0,
+    "Longest spin of a busy-polling RX sync (usec)");
+
 #if (DEVELOPMENT || DEBUG)
 static uint32_t ch_force_defunct = 0;
 SYSCTL_UINT(_kern_skywalk_channel, OID_AUTO, force_defunct,
     CTLFLAG_RW | CTLFLAG_LOCKED, &ch_force_defunct, 0, "");
 #endif /* !DEVELOPMENT && !DEBUG */
 
+/*
+ * Returns TRUE if none of the RX rings has anything left for the user;
+ * otherwise there's no point in spinning.
+ */
+static boolean_t
+ch_busy_poll_empty(struct __kern_channel_ring *krings, ring_id_t qfirst,
+    ring_id_t qlast)
+{
+	ring_id_t i;
+
+	for (i = qfirst; i < qlast; i++) {
+		if (krings[i].ckr_rhead != krings[i].ckr_rtail) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Spin until one of the RX rings has been filled past what the last
+ * sync saw, until it's time to sync again, or until deadline.
+ */
+static void
+ch_busy_poll_wait(struct __kern_channel_ring *krings, ring_id_t qfirst,
+    ring_id_t qlast, uint64_t deadline)
+{
+	uint64_t until;
+	ring_id_t i;
+
+	clock_interval_to_deadline(CH_BUSY_POLL_RESYNC_USEC, NSEC_PER_USEC,
+	    &until);
+	until = MIN(until, deadline);
+	do {
+		for (i = qfirst; i < qlast; i++) {
+			if (krings[i].ckr_ktail != krings[i].ckr_rtail) {
+				return;
+			}
+		}
+	} while (mach_absolute_time() < until);
+}
+
 static int
 chop_select(struct fileproc *fp, int which, void *wql, vfs_context_t ctx)
 {
@@ -369,6 +425,7 @@ __channel_sync(struct proc *p, struct __channel_sync_args *uap, int *retval)
 	sync_mode_t mode;
 	ring_id_t i, qfirst, qlast;
 	sync_flags_t flags, upp_sync_flags = 0;
+	uint64_t busy_poll_deadline = 0;
 	enum txrx t;
 	int err;
 	int s;
@@ -450,6 +507,7 @@ __channel_sync(struct proc *p, struct __channel_sync_args *uap, int *retval)
 	qfirst = ch->ch_first[t];
 	qlast = ch->ch_last[t];
 
+sync_again:
 	for (i = qfirst; i < qlast; i++) {
 		kring = krings + i;
 		s = kr_enter(kring, TRUE);
@@ -546,6 +604,24 @@ __channel_sync(struct proc *p, struct __channel_sync_args *uap, int *retval)
 		kr_exit(kring);
 	}
 
+	if (__improbable(mode == CHANNEL_SYNC_RX && err == 0 &&
+	    (ch->ch_info->cinfo_ch_mode & CHMODE_BUSY_POLL) != 0 &&
+	    ch_busy_poll_usec != 0) &&
+	    ch_busy_poll_empty(krings, qfirst, qlast)) {
+		if (busy_poll_deadline == 0) {
+			clock_interval_to_deadline(MIN(ch_busy_poll_usec,
+			    CH_BUSY_POLL_USEC_MAX), NSEC_PER_USEC,
+			    &busy_poll_deadline);
+		}
+		if (mach_absolute_time() < busy_poll_deadline &&
+		    !(ch->ch_flags & CHANF_DEFUNCT)) {
+			ch_busy_poll_wait(krings, qfirst, qlast,
+			    busy_poll_deadline);
+			net_update_uptime();
+			goto sync_again;
+		}
+	}
+
 packet_pool_sync:
 	if (flags & (CHANNEL_SYNCF_ALLOC | CHANNEL_SYNCF_ALLOC_BUF)) {
 		qfirst = ch->ch_first[NR_A];
@@ -442,6 +442,13 @@ struct __kern_channel_ring {
 	    struct proc *, uint32_t flags);
 	uint32_t        *ckr_leases;
 #define CKR_NOSLOT      ((uint32_t)~0)  /* used in nkr_*lease* */
+	/*
+	 * Time (mach_absolute_time) of the first Rx sync that consumed
+	 * slots after the flow switch last asked for it by setting
+	 * ckr_rx_pickup_wait; used for per-flow pickup latency.
+	 */
+	uint64_t        ckr_rx_pickup_time;
+	uint32_t        ckr_rx_pickup_wait;
 	slot_idx_t      ckr_klease;
 	slot_idx_t      ckr_lease_idx;
 #endif /* CONFIG_NEXUS_FLOWSWITCH */
@@ -517,6 +524,8 @@ struct __kern_channel_ring {
 	uint32_t ckr_mon_tail;  /* last seen slot on rx */
 	/* index of this ring in the monitored ring array */
 	uint32_t ckr_mon_pos;
+	/* packets left to skip before the next sample (monitor ring) */
+	uint32_t ckr_mon_skip;
 #endif /* CONFIG_NEXUS_MONITOR */
 
 	uint32_t        ckr_users;      /* existing bindings for this ring */
@@ -841,6 +850,21 @@ kr_available_slots_rxring(struct __kern_channel_ring *rxkring)
 	return space;
 }
 
+/*
+ * kr_publish_ktail: tell the user ring of an Rx kring how far the kernel
+ * has filled it, for consumers that busy-poll instead of waiting for an
+ * event.  Called with the kring entered, which keeps ckr_ring around.
+ */
+__attribute__((always_inline))
+static inline void
+kr_publish_ktail(struct __kern_channel_ring *rxkring)
+{
+	if (rxkring->ckr_ring != NULL && !KR_KERNEL_ONLY(rxkring)) {
+		*(slot_idx_t *)(uintptr_t)&rxkring->ckr_ring->ring_ktail_hint =
+		    rxkring->ckr_ktail;
+	}
+}
+
 /*
  * kr_reserve_slots: reserve n slots from kr in range [start, end).
  * return ticket for later publish those reserved correspondingly.
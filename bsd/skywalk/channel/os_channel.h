@@ -164,6 +164,7 @@ typedef enum {
 	CHANNEL_ATTR_NUM_BUFFERS,       /* (g) # of buffers in user pool */
 	CHANNEL_ATTR_LOW_LATENCY,       /* (g/s) bool: low latency channel */
 	CHANNEL_ATTR_LARGE_BUF_SIZE,    /* (g) large buffer size (bytes) */
+	CHANNEL_ATTR_BUSY_POLL,         /* (g/s) bool: RX sync spins for data */
 } channel_attr_type_t;
 
 /*
@@ -381,6 +382,13 @@ extern channel_ring_t os_channel_rx_ring(const channel_t channel,
     const ring_id_t rid);
 extern int os_channel_pending(const channel_ring_t ring);
 
+/*
+ * For an RX ring, returns non-zero when the kernel has packets for it
+ * that os_channel_sync() would pick up; it costs no system call, so
+ * a busy-polling consumer can spin on it between syncs.
+ */
+extern int os_channel_rx_ready(const channel_ring_t ring);
+
 /*
  * This returns a nexus-specific timestamp in nanoseconds taken at the
  * lasttime os_channel_sync() or its equivalent implicit kevent sync
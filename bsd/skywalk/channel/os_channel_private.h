@@ -251,7 +251,7 @@ struct __user_channel_schema {
  * to ensure that both kernel and libsystem_kernel are in sync,
  * as otherwise we'd assert due to version mismatch.
  */
-#define CSM_CURRENT_VERSION     15
+#define CSM_CURRENT_VERSION     16
 
 /* valid values for csm_flags */
 #define CSM_PRIV_MEM    0x1             /* private memory region */
@@ -416,6 +416,12 @@ struct __user_channel_ring {
 	const volatile uint32_t ring_alloc_ws;
 	/* current working set for the buflet allocator ring */
 	const volatile uint32_t ring_alloc_buf_ws;
+	/*
+	 * RX rings only: the kernel's tail, published whenever packets
+	 * are queued to the ring; it runs ahead of ring_tail until the
+	 * next sync hands them over.
+	 */
+	const volatile slot_idx_t ring_ktail_hint;
 };
 
 /* check if space is available in the ring */
@@ -521,6 +527,7 @@ struct ch_init {
 #define CHMODE_FILTER                   0x00000020     /* packet filter channel */
 #define CHMODE_EVENT_RING               0x00000040
 #define CHMODE_LOW_LATENCY              0x00000080
+#define CHMODE_BUSY_POLL                0x00000100
 #define CHMODE_EXCLUSIVE                0x00000200
 #define CHMODE_MONITOR                  \
 	(CHMODE_MONITOR_TX | CHMODE_MONITOR_RX)
@@ -530,7 +537,7 @@ struct ch_init {
 	(CHMODE_MONITOR | CHMODE_MONITOR_NO_COPY |      \
 	CHMODE_USER_PACKET_POOL | CHMODE_FILTER  |      \
 	CHMODE_DEFUNCT_OK | CHMODE_EVENT_RING | CHMODE_EXCLUSIVE | \
-	CHMODE_LOW_LATENCY)
+	CHMODE_LOW_LATENCY | CHMODE_BUSY_POLL)
 #define CHMODE_KERNEL                   0x00001000  /* special, in-kernel */
 #define CHMODE_NO_NXREF                 0x00002000  /* does not hold nx refcnt */
 #define CHMODE_CONFIG                   0x00004000  /* provider config mode */
@@ -538,7 +545,8 @@ struct ch_init {
 
 #define CHMODE_BITS                                                       \
 	"\020\01MON_TX\02MON_RX\03NO_COPY\04USER_PKT_POOL"                \
-	"\05DEFUNCT_OK\06FILTER\07EVENT_RING\010LOW_LATENCY\012EXCLUSIVE" \
+	"\05DEFUNCT_OK\06FILTER\07EVENT_RING\010LOW_LATENCY\011BUSY_POLL" \
+	"\012EXCLUSIVE"                                                   \
 	"\015KERNEL\016NO_NXREF\017CONFIG\020HOST"
 #endif /* KERNEL */
 
@@ -548,6 +556,20 @@ struct ch_init {
 #define CHOPT_TX_LOWAT_THRESH   1  /* (get/set) ch_ev_thresh */
 #define CHOPT_RX_LOWAT_THRESH   2  /* (get/set) ch_ev_thresh */
 #define CHOPT_IF_ADV_CONF       3  /* (set) enable/disable interface advisory events on the channel */
+#define CHOPT_MONITOR_FILTER    4  /* (set) ch_mon_filter, copy monitors only */
+
+/*
+ * Argument structure for CHOPT_MONITOR_FILTER.  The BPF program runs on
+ * each packet of the monitored rings before it is copied to the monitor;
+ * of the packets it accepts, only 1 in cmf_sample is copied.  A zero
+ * cmf_len removes the program, and a cmf_sample of 0 or 1 copies every
+ * accepted packet.
+ */
+struct ch_mon_filter {
+	uint32_t                cmf_sample;     /* copy 1 in N packets */
+	uint32_t                cmf_len;        /* number of BPF insns */
+	user_addr_t             cmf_insns;      /* array of struct bpf_insn */
+};
 
 #ifndef KERNEL
 /*
@@ -659,6 +681,7 @@ struct channel_attr {
 	uint32_t        cha_num_buffers;
 	uint32_t        cha_low_latency;
 	uint32_t        cha_large_buf_size;
+	uint32_t        cha_busy_poll;
 };
 
 #if !defined(_POSIX_C_SOURCE) || defined(_DARWIN_C_SOURCE)
@@ -128,6 +128,13 @@ uint32_t sk_fsw_rx_agg_tcp = 16384;
  */
 uint32_t sk_fsw_rx_agg_tcp_host = SK_FSW_RX_AGG_TCP_HOST_AUTO;
 
+/*
+ * Configures the RX aggregation logic for UDP flows that asked for it.
+ * A non-zero value enables chaining datagrams into super packets, with
+ * the length of a super packet (in bytes) limited to this value.
+ */
+uint32_t sk_fsw_rx_agg_udp = 65535;
+
 /*
  * Configures the skywalk infrastructure for handling TCP TX aggregation.
  * A non-zero value enables the support.
@@ -404,6 +411,8 @@ skywalk_init(void)
 	parse_netif_direct();
 	(void) PE_parse_boot_argn("sk_fsw_rx_agg_tcp", &sk_fsw_rx_agg_tcp,
 	    sizeof(sk_fsw_rx_agg_tcp));
+	(void) PE_parse_boot_argn("sk_fsw_rx_agg_udp", &sk_fsw_rx_agg_udp,
+	    sizeof(sk_fsw_rx_agg_udp));
 	(void) PE_parse_boot_argn("sk_fsw_tx_agg_tcp", &sk_fsw_tx_agg_tcp,
 	    sizeof(sk_fsw_tx_agg_tcp));
 	(void) PE_parse_boot_argn("sk_fsw_max_bufs", &sk_fsw_max_bufs,
@@ -336,6 +336,7 @@ typedef enum fsw_rx_agg_tcp_host {
 	SK_FSW_RX_AGG_TCP_HOST_AUTO
 } fsw_rx_agg_tcp_host_t;
 extern uint32_t sk_fsw_rx_agg_tcp_host;
+extern uint32_t sk_fsw_rx_agg_udp;
 extern uint32_t sk_fsw_max_bufs;
 
 typedef enum netif_mit_cfg {
@@ -42,6 +42,31 @@ SYSCTL_UINT(_kern_skywalk_libcuckoo, OID_AUTO, verbose,
     CTLFLAG_RW | CTLFLAG_LOCKED, &cuckoo_verbose, 0, "");
 #endif /* DEVELOPMENT || DEBUG */
 
+static uint64_t cuckoo_kicks;           /* entries moved to make room */
+SYSCTL_QUAD(_kern_skywalk_libcuckoo, OID_AUTO, kicks,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &cuckoo_kicks,
+    "Entries displaced by cuckoo moves");
+
+static uint32_t cuckoo_kick_max;        /* longest cuckoo path so far */
+SYSCTL_UINT(_kern_skywalk_libcuckoo, OID_AUTO, kick_max,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &cuckoo_kick_max, 0,
+    "Longest chain of cuckoo moves for one insertion");
+
+static uint64_t cuckoo_expands;
+SYSCTL_QUAD(_kern_skywalk_libcuckoo, OID_AUTO, expands,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &cuckoo_expands,
+    "Completed table expansions");
+
+static uint64_t cuckoo_expand_last_us;
+SYSCTL_QUAD(_kern_skywalk_libcuckoo, OID_AUTO, expand_last_us,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &cuckoo_expand_last_us,
+    "Duration of the last table expansion, in microseconds");
+
+static uint64_t cuckoo_expand_max_us;
+SYSCTL_QUAD(_kern_skywalk_libcuckoo, OID_AUTO, expand_max_us,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &cuckoo_expand_max_us,
+    "Longest table expansion, in microseconds");
+
 typedef enum cht_verb {
 	CHTV_ERR = 0,
 	CHTV_WARN = 1,
@@ -128,10 +153,7 @@ cuckoo_node_next(struct cuckoo_node *node)
 #define _CHT_MAX_LOAD_SHRINK 40       /* at least below 40% load to shrink */
 #define _CHT_MIN_LOAD_EXPAND 85       /* cuckoo could hold 85% full table */
 
-enum cuckoo_resize_ops {
-	_CHT_RESIZE_EXPAND = 0,
-	_CHT_RESIZE_SHRINK = 1,
-};
+#define _CHT_MIGRATE_RETRIES 8       /* cuckoo paths invalidated under us */
 
 /*
  * Following classic Cuckoo hash table design, cuckoo_hashtable use k hash
@@ -170,6 +192,16 @@ enum cuckoo_resize_ops {
  * Adding to the table will call its retain function.
  * Deleting from the table will call its release function.
  *
+ * Expansion
+ * Growing the table doesn't rebuild it in one go.  The expanding thread
+ * installs a bucket array twice the size, keeps the previous one around as
+ * _old_buckets and moves the entries over one old bucket at a time, while
+ * other threads keep using the table.  New entries always go to the new
+ * array; lookups and deletes check the old array first, then the new one,
+ * so an entry migrating under them can't be missed (it is added to the new
+ * array before it leaves the old bucket, whose lock they wait for).  Only
+ * installing and retiring the old array take the table exclusively.
+ * Shrinking still rebuilds the table under the exclusive lock.
  */
 
 /* hash might be zero, so always use _node == NULL to test empty slot */
@@ -214,6 +246,13 @@ struct cuckoo_hashtable {
 
 	struct _bucket  *_buckets;
 
+	/* previous buckets, while an expansion migrates entries out of them */
+	struct _bucket  *_old_buckets;
+	uint32_t        _old_bitmask;
+	uint32_t        _old_n_buckets;
+	uint32_t        _migrate_idx;   /* next old bucket to migrate */
+	decl_lck_mtx_data(, _migrate_lock);
+
 	int (*_obj_cmp)(struct cuckoo_node *node, void *key);
 	void (*_obj_retain)(struct cuckoo_node *);
 	void (*_obj_release)(struct cuckoo_node *);
@@ -262,6 +301,18 @@ __alt_bucket(struct cuckoo_hashtable *h, uint32_t hash)
 	return __get_bucket(h, __alt_hash(hash) & h->_bitmask);
 }
 
+static inline struct _bucket *
+__old_prim_bucket(struct cuckoo_hashtable *h, uint32_t hash)
+{
+	return &h->_old_buckets[hash & h->_old_bitmask];
+}
+
+static inline struct _bucket *
+__old_alt_bucket(struct cuckoo_hashtable *h, uint32_t hash)
+{
+	return &h->_old_buckets[__alt_hash(hash) & h->_old_bitmask];
+}
+
 #if SK_LOG
 static inline size_t
 __bucket_idx(struct cuckoo_hashtable *h, struct _bucket *b)
@@ -302,6 +353,31 @@ cuckoo_hashtable_load_factor(struct cuckoo_hashtable *h)
 	return (100 * h->_n_entries) / (h->_n_buckets * _CHT_BUCKET_SLOTS);
 }
 
+static struct _bucket *
+__buckets_alloc(uint32_t n_buckets)
+{
+	struct _bucket *buckets;
+
+	buckets = sk_alloc_type_array(struct _bucket, n_buckets, Z_WAITOK,
+	    cuckoo_tag);
+	if (buckets == NULL) {
+		return NULL;
+	}
+	for (uint32_t i = 0; i < n_buckets; i++) {
+		lck_mtx_init(&buckets[i]._lock, &cht_lock_group, &cht_lock_attr);
+	}
+	return buckets;
+}
+
+static void
+__buckets_free(struct _bucket *buckets, uint32_t n_buckets)
+{
+	for (uint32_t i = 0; i < n_buckets; i++) {
+		lck_mtx_destroy(&buckets[i]._lock, &cht_lock_group);
+	}
+	sk_free_type_array(struct _bucket, n_buckets, buckets);
+}
+
 /*
  * Cuckoo hashtable uses regular mutex.  Most operations(find/add) should
  * finish faster than a context switch.  It avoids using the spin lock since
@@ -341,7 +417,7 @@ __lock_bucket_with_backoff(struct _bucket *b)
 #define __unwlock_table(h)      lck_rw_unlock_exclusive(&h->_resize_lock)
 
 static inline int
-__resize_begin(struct cuckoo_hashtable *h)
+__resize_begin(struct cuckoo_hashtable *h, bool exclusive)
 {
 	// takes care of concurrent resize
 	lck_mtx_lock(&h->_lock);
@@ -367,14 +443,18 @@ __resize_begin(struct cuckoo_hashtable *h)
 	lck_mtx_unlock(&h->_lock);
 
 	// takes other readers offline
-	__wlock_table(h);
+	if (exclusive) {
+		__wlock_table(h);
+	}
 	return 0;
 }
 
 static inline void
-__resize_end(struct cuckoo_hashtable *h)
+__resize_end(struct cuckoo_hashtable *h, bool exclusive)
 {
-	__unwlock_table(h);
+	if (exclusive) {
+		__unwlock_table(h);
+	}
 	lck_mtx_lock(&h->_lock);
 	h->_busy = false;
 	if (__improbable(h->_resize_waiters > 0)) {
@@ -391,7 +471,6 @@ cuckoo_hashtable_create(struct cuckoo_hashtable_params *p)
 	uint32_t n = 0;
 	uint32_t n_buckets = 0;
 	struct _bucket *buckets = NULL;
-	uint32_t i;
 
 	if (p->cht_capacity > CUCKOO_HASHTABLE_ENTRIES_MAX ||
 	    p->cht_capacity < _CHT_BUCKET_SLOTS) {
@@ -403,17 +482,14 @@ cuckoo_hashtable_create(struct cuckoo_hashtable_params *p)
 	h = sk_alloc_type(struct cuckoo_hashtable, Z_WAITOK | Z_NOFAIL, cuckoo_tag);
 
 	n_buckets = __align32pow2(n / _CHT_BUCKET_SLOTS);
-	buckets = sk_alloc_type_array(struct _bucket, n_buckets, Z_WAITOK, cuckoo_tag);
+	buckets = __buckets_alloc(n_buckets);
 	if (buckets == NULL) {
 		sk_free_type(struct cuckoo_hashtable, h);
 		return NULL;
 	}
 
-	for (i = 0; i < n_buckets; i++) {
-		lck_mtx_init(&buckets[i]._lock, &cht_lock_group, &cht_lock_attr);
-	}
-
 	lck_mtx_init(&h->_lock, &cht_lock_group, &cht_lock_attr);
+	lck_mtx_init(&h->_migrate_lock, &cht_lock_group, &cht_lock_attr);
 
 	h->_n_entries = 0;
 	h->_n_buckets = n_buckets;
@@ -437,8 +513,6 @@ cuckoo_hashtable_create(struct cuckoo_hashtable_params *p)
 void
 cuckoo_hashtable_free(struct cuckoo_hashtable *h)
 {
-	uint32_t i;
-
 	if (h == NULL) {
 		return;
 	}
@@ -446,11 +520,15 @@ cuckoo_hashtable_free(struct cuckoo_hashtable *h)
 	ASSERT(h->_n_entries == 0);
 
 	if (h->_buckets != NULL) {
-		for (i = 0; i < h->_n_buckets; i++) {
-			lck_mtx_destroy(&h->_buckets[i]._lock, &cht_lock_group);
-		}
-		sk_free_type_array(struct _bucket, h->_n_buckets, h->_buckets);
+		__buckets_free(h->_buckets, h->_n_buckets);
+	}
+	if (h->_old_buckets != NULL) {
+		/* an expansion that ran out of room stopped half way */
+		__buckets_free(h->_old_buckets, h->_old_n_buckets);
 	}
+	lck_mtx_destroy(&h->_migrate_lock, &cht_lock_group);
+	lck_mtx_destroy(&h->_lock, &cht_lock_group);
+	lck_rw_destroy(&h->_resize_lock, &cht_lock_group);
 	sk_free_type(struct cuckoo_hashtable, h);
 }
 
@@ -470,7 +548,7 @@ size_t
 cuckoo_hashtable_memory_footprint(struct cuckoo_hashtable *h)
 {
 	size_t total_meminuse = sizeof(struct cuckoo_hashtable) +
-	    (h->_n_buckets * sizeof(struct _bucket));
+	    ((h->_n_buckets + h->_old_n_buckets) * sizeof(struct _bucket));
 	return total_meminuse;
 }
 
@@ -513,6 +591,17 @@ cuckoo_hashtable_find_with_hash(struct cuckoo_hashtable *h, void *key,
 
 	__rlock_table(h);
 
+	if (__improbable(h->_old_buckets != NULL)) {
+		b1 = __old_prim_bucket(h, hash);
+		if ((node = __find_in_bucket(h, b1, key, hash)) != NULL) {
+			goto done;
+		}
+		b2 = __old_alt_bucket(h, hash);
+		if ((node = __find_in_bucket(h, b2, key, hash)) != NULL) {
+			goto done;
+		}
+	}
+
 	b1 = __prim_bucket(h, hash);
 	if ((node = __find_in_bucket(h, b1, key, hash)) != NULL) {
 		goto done;
@@ -528,6 +617,20 @@ done:
 	return node;
 }
 
+/*
+ * Start pulling in the primary bucket of hash ahead of a lookup.  This
+ * takes no lock: a concurrent resize may leave us prefetching a stale
+ * bucket, which costs nothing but the wasted prefetch.
+ */
+void
+cuckoo_hashtable_prefetch(struct cuckoo_hashtable *h, uint32_t hash)
+{
+	struct _bucket *buckets = os_atomic_load(&h->_buckets, relaxed);
+	uint32_t bitmask = os_atomic_load(&h->_bitmask, relaxed);
+
+	__builtin_prefetch(&buckets[hash & bitmask], 1, 3);
+}
+
 /*
  * To add a key into cuckoo_hashtable:
  *   1. First it searches the key's two candidate buckets b1, b2
@@ -616,6 +719,7 @@ cuckoo_move(struct cuckoo_hashtable *h, struct cuckoo_node *node,
 	struct _bfs_node *prev_node, *curr_node;
 	struct _bucket *from_bkt, *to_bkt, *alt_bkt;
 	uint8_t from_slot, to_slot;
+	uint32_t kicks = 0;
 
 	curr_node = &queue[leaf_node_idx];
 	to_bkt = __get_bucket(h, curr_node->bkt_idx);
@@ -666,12 +770,18 @@ cuckoo_move(struct cuckoo_hashtable *h, struct cuckoo_node *node,
 		from_bkt->_inuse--;
 
 		__unlock_bucket(to_bkt);
+		kicks++;
 
 		curr_node = prev_node;
 		to_bkt = from_bkt;
 		to_slot = from_slot;
 	}
 
+	if (kicks != 0) {
+		os_atomic_add(&cuckoo_kicks, kicks, relaxed);
+		os_atomic_max(&cuckoo_kick_max, kicks, relaxed);
+	}
+
 	ASSERT(curr_node->prev_node_idx == _CHT_BFS_QUEUE_LEN);
 	ASSERT(curr_node->prev_slot_idx == _CHT_SLOT_INVAL);
 
@@ -780,14 +890,11 @@ done:
 }
 
 static inline void
-__foreach_node(struct cuckoo_hashtable *h, bool wlocked,
+__foreach_node_in(struct _bucket *buckets, uint32_t n_buckets, bool wlocked,
     void (^node_handler)(struct cuckoo_node *, uint32_t hash))
 {
-	if (!wlocked) {
-		__rlock_table(h);
-	}
-	for (uint32_t i = 0; i < h->_n_buckets; i++) {
-		struct _bucket *b = &h->_buckets[i];
+	for (uint32_t i = 0; i < n_buckets; i++) {
+		struct _bucket *b = &buckets[i];
 		if (b->_inuse == 0) {
 			continue;
 		}
@@ -808,7 +915,24 @@ __foreach_node(struct cuckoo_hashtable *h, bool wlocked,
 			__unlock_bucket(b);
 		}
 	}
+}
+
+static inline void
+__foreach_node(struct cuckoo_hashtable *h, bool wlocked,
+    void (^node_handler)(struct cuckoo_node *, uint32_t hash))
+{
 	if (!wlocked) {
+		__rlock_table(h);
+		/* keep entries from migrating behind our back */
+		lck_mtx_lock(&h->_migrate_lock);
+	}
+	if (h->_old_buckets != NULL) {
+		__foreach_node_in(h->_old_buckets, h->_old_n_buckets, wlocked,
+		    node_handler);
+	}
+	__foreach_node_in(h->_buckets, h->_n_buckets, wlocked, node_handler);
+	if (!wlocked) {
+		lck_mtx_unlock(&h->_migrate_lock);
 		__unrlock_table(h);
 	}
 }
@@ -833,13 +957,13 @@ cuckoo_dummy_release(struct cuckoo_node *node)
 }
 
 static int
-cuckoo_resize(struct cuckoo_hashtable *h, enum cuckoo_resize_ops option)
+cuckoo_shrink(struct cuckoo_hashtable *h)
 {
 	int ret = 0;
 
 	/* backoff from concurrent expansion */
 	do {
-		ret = __resize_begin(h);
+		ret = __resize_begin(h, true);
 		if (ret == EAGAIN) {
 			cht_info("resize done by peer");
 			return EAGAIN;
@@ -852,19 +976,12 @@ cuckoo_resize(struct cuckoo_hashtable *h, enum cuckoo_resize_ops option)
 	uint32_t new_capacity;
 	__block size_t add_called = 0;
 
-	/* check load factor to ensure we are not hitting something else */
-	if (option == _CHT_RESIZE_EXPAND) {
-		if (curr_load < _CHT_MIN_LOAD_EXPAND) {
-			cht_warn("Warning: early expand at %d load", curr_load);
-		}
-		new_capacity = curr_capacity * 2;
-	} else {
-		if (curr_load > _CHT_MAX_LOAD_SHRINK ||
-		    curr_capacity == h->_rcapacity) {
-			goto done;
-		}
-		new_capacity = curr_capacity / 2;
+	/* an expansion that ran out of room has to complete first */
+	if (curr_load > _CHT_MAX_LOAD_SHRINK ||
+	    curr_capacity == h->_rcapacity || h->_old_buckets != NULL) {
+		goto done;
 	}
+	new_capacity = curr_capacity / 2;
 
 	cht_info("resize %d/(%d -> %d)", h->_n_entries,
 	    curr_capacity, new_capacity);
@@ -897,47 +1014,184 @@ cuckoo_resize(struct cuckoo_hashtable *h, enum cuckoo_resize_ops option)
 		    cuckoo_hashtable_entries(tmp_h));
 	}
 
-	for (uint32_t i = 0; i < h->_n_buckets; i++) {
-		lck_mtx_destroy(&h->_buckets[i]._lock, &cht_lock_group);
-	}
+	__buckets_free(h->_buckets, curr_buckets);
 	h->_n_buckets = tmp_h->_n_buckets;
 	h->_capacity = h->_n_buckets * _CHT_BUCKET_SLOTS;
 	h->_bitmask = tmp_h->_bitmask;
-	sk_free_type_array(struct _bucket, curr_buckets, h->_buckets);
-
 	h->_buckets = tmp_h->_buckets;
 	lck_rw_destroy(&tmp_h->_resize_lock, &cht_lock_group);
+	lck_mtx_destroy(&tmp_h->_migrate_lock, &cht_lock_group);
 	lck_mtx_destroy(&tmp_h->_lock, &cht_lock_group);
 	sk_free_type(struct cuckoo_hashtable, tmp_h);
 
 done:
-	__resize_end(h);
+	__resize_end(h, true);
 
 	return ret;
 }
 
+/* table rlock held */
+static inline int
+__add_no_expand(struct cuckoo_hashtable *h, struct cuckoo_node *node,
+    uint32_t hash)
+{
+	struct _bucket *b1, *b2;
+
+	b1 = __prim_bucket(h, hash);
+	if (__add_to_bucket(h, b1, node, hash) == 0) {
+		return 0;
+	}
+
+	b2 = __alt_bucket(h, hash);
+	if (__add_to_bucket(h, b2, node, hash) == 0) {
+		return 0;
+	}
+
+	return cuckoo_probe(h, node, hash);
+}
+
 static inline int
 cuckoo_add_no_expand(struct cuckoo_hashtable *h,
     struct cuckoo_node *node, uint32_t hash)
 {
-	struct _bucket *b1, *b2;
-	int ret = -1;
+	int ret;
 
 	__rlock_table(h);
+	ret = __add_no_expand(h, node, hash);
+	__unrlock_table(h);
+	return ret;
+}
 
-	b1 = __prim_bucket(h, hash);
-	if ((ret = __add_to_bucket(h, b1, node, hash)) == 0) {
-		goto done;
+/*
+ * Move every entry of old bucket ob into the current buckets.  Each entry
+ * is added to its new bucket before it leaves ob, both under ob's lock.
+ */
+static int
+cuckoo_migrate_bucket(struct cuckoo_hashtable *h, struct _bucket *ob)
+{
+	int ret = 0;
+
+	__lock_bucket(ob);
+	for (uint8_t i = 0; i < _CHT_BUCKET_SLOTS && ob->_inuse != 0; i++) {
+		struct _slot *s = __bucket_slot(ob, i);
+		struct cuckoo_node *node, *next_node;
+
+		if (__slot_empty(s)) {
+			continue;
+		}
+		while ((node = s->_node) != NULL) {
+			next_node = cuckoo_node_next(node);
+			cuckoo_node_set_next(node, NULL);
+			ret = __add_no_expand(h, node, s->_hash);
+			if (ret != 0) {
+				cuckoo_node_set_next(node, next_node);
+				goto done;
+			}
+			/* the table's reference and count carry over */
+			h->_obj_release(node);
+			OSAddAtomic(-1, &h->_n_entries);
+			s->_node = next_node;
+		}
+		__slot_reset(s);
+		ob->_inuse--;
 	}
+done:
+	__unlock_bucket(ob);
+	return ret;
+}
 
-	b2 = __alt_bucket(h, hash);
-	if ((ret = __add_to_bucket(h, b2, node, hash)) == 0) {
-		goto done;
+static int
+cuckoo_expand(struct cuckoo_hashtable *h)
+{
+	uint64_t start, elapsed_us;
+	struct _bucket *buckets;
+	uint32_t n_buckets, retries = 0;
+	int ret = 0;
+
+	/* backoff from concurrent expansion */
+	do {
+		ret = __resize_begin(h, false);
+		if (ret == EAGAIN) {
+			cht_info("resize done by peer");
+			return EAGAIN;
+		}
+	} while (ret == EINTR);
+
+	start = mach_absolute_time();
+
+	/* otherwise resume an expansion that ran out of room */
+	if (h->_old_buckets == NULL) {
+		uint32_t curr_capacity = h->_n_buckets * _CHT_BUCKET_SLOTS;
+		uint32_t curr_load = (100 * h->_n_entries) / curr_capacity;
+
+		if (curr_load < _CHT_MIN_LOAD_EXPAND) {
+			cht_warn("Warning: early expand at %d load", curr_load);
+		}
+		if (curr_capacity * 2 > CUCKOO_HASHTABLE_ENTRIES_MAX) {
+			ret = ENOMEM;
+			goto done;
+		}
+		cht_info("expand %d/(%d -> %d)", h->_n_entries,
+		    curr_capacity, curr_capacity * 2);
+
+		n_buckets = h->_n_buckets * 2;
+		buckets = __buckets_alloc(n_buckets);
+		if (buckets == NULL) {
+			ret = ENOMEM;
+			goto done;
+		}
+
+		__wlock_table(h);
+		h->_old_buckets = h->_buckets;
+		h->_old_n_buckets = h->_n_buckets;
+		h->_old_bitmask = h->_bitmask;
+		h->_migrate_idx = 0;
+		h->_buckets = buckets;
+		h->_n_buckets = n_buckets;
+		h->_bitmask = n_buckets - 1;
+		h->_capacity = n_buckets * _CHT_BUCKET_SLOTS;
+		__unwlock_table(h);
 	}
 
-	ret = cuckoo_probe(h, node, hash);
+	while (h->_migrate_idx < h->_old_n_buckets) {
+		__rlock_table(h);
+		lck_mtx_lock(&h->_migrate_lock);
+		ret = cuckoo_migrate_bucket(h,
+		    &h->_old_buckets[h->_migrate_idx]);
+		if (ret == 0) {
+			h->_migrate_idx++;
+			retries = 0;
+		}
+		lck_mtx_unlock(&h->_migrate_lock);
+		__unrlock_table(h);
+		if (ret == EAGAIN && ++retries < _CHT_MIGRATE_RETRIES) {
+			continue;
+		}
+		if (ret != 0) {
+			cht_err("migration stopped at bucket %d/%d: err %d",
+			    h->_migrate_idx, h->_old_n_buckets, ret);
+			goto done;
+		}
+	}
+
+	__wlock_table(h);
+	buckets = h->_old_buckets;
+	n_buckets = h->_old_n_buckets;
+	h->_old_buckets = NULL;
+	h->_old_n_buckets = 0;
+	h->_old_bitmask = 0;
+	h->_migrate_idx = 0;
+	__unwlock_table(h);
+	__buckets_free(buckets, n_buckets);
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &elapsed_us);
+	elapsed_us /= NSEC_PER_USEC;
+	os_atomic_inc(&cuckoo_expands, relaxed);
+	os_atomic_store(&cuckoo_expand_last_us, elapsed_us, relaxed);
+	os_atomic_max(&cuckoo_expand_max_us, elapsed_us, relaxed);
+
 done:
-	__unrlock_table(h);
+	__resize_end(h, false);
 	return ret;
 }
 
@@ -953,7 +1207,7 @@ cuckoo_hashtable_add_with_hash(struct cuckoo_hashtable *h,
 	ret = cuckoo_add_no_expand(h, node, hash);
 	if (ret == ENOSPC) {
 		do {
-			ret = cuckoo_resize(h, _CHT_RESIZE_EXPAND);
+			ret = cuckoo_expand(h);
 			if (ret != 0 && ret != EAGAIN) {
 				break;
 			}
@@ -1000,6 +1254,17 @@ cuckoo_hashtable_del(struct cuckoo_hashtable *h,
 
 	__rlock_table(h);
 
+	if (__improbable(h->_old_buckets != NULL)) {
+		b1 = __old_prim_bucket(h, hash);
+		if ((ret = __del_from_bucket(h, b1, node, hash)) == 0) {
+			goto done;
+		}
+		b2 = __old_alt_bucket(h, hash);
+		if ((ret = __del_from_bucket(h, b2, node, hash)) == 0) {
+			goto done;
+		}
+	}
+
 	b1 = __prim_bucket(h, hash);
 	if ((ret = __del_from_bucket(h, b1, node, hash)) == 0) {
 		goto done;
@@ -1021,7 +1286,7 @@ done:
 void
 cuckoo_hashtable_try_shrink(struct cuckoo_hashtable *h)
 {
-	cuckoo_resize(h, _CHT_RESIZE_SHRINK);
+	cuckoo_shrink(h);
 }
 
 #if (DEVELOPMENT || DEBUG)
@@ -1046,20 +1311,19 @@ cuckoo_node_looped(struct cuckoo_node *node)
 	return false;
 }
 
-int
-cuckoo_hashtable_health_check(struct cuckoo_hashtable *h)
+static bool
+__health_check_buckets(struct cuckoo_hashtable *h, bool old, uint32_t *seen)
 {
+	struct _bucket *buckets = old ? h->_old_buckets : h->_buckets;
+	uint32_t n_buckets = old ? h->_old_n_buckets : h->_n_buckets;
 	uint32_t hash;
 	uint32_t i, j;
 	struct _bucket *b;
 	struct cuckoo_node *node;
 	bool healthy = true;
-	uint32_t seen = 0;
-
-	__wlock_table(h);
 
-	for (i = 0; i < h->_n_buckets; i++) {
-		b = &h->_buckets[i];
+	for (i = 0; i < n_buckets; i++) {
+		b = &buckets[i];
 		uint8_t inuse = 0;
 		for (j = 0; j < _CHT_BUCKET_SLOTS; j++) {
 			hash = b->_slots[j]._hash;
@@ -1068,9 +1332,11 @@ cuckoo_hashtable_health_check(struct cuckoo_hashtable *h)
 				inuse++;
 			}
 			while (node != NULL) {
-				seen++;
-				if ((__prim_bucket(h, hash) != b) &&
-				    (__alt_bucket(h, hash) != b)) {
+				(*seen)++;
+				if (old ? (__old_prim_bucket(h, hash) != b &&
+				    __old_alt_bucket(h, hash) != b) :
+				    (__prim_bucket(h, hash) != b &&
+				    __alt_bucket(h, hash) != b)) {
 					panic("[%d][%d] stray hash %x node %p",
 					    i, j, hash, node);
 					healthy = false;
@@ -1087,6 +1353,24 @@ cuckoo_hashtable_health_check(struct cuckoo_hashtable *h)
 		ASSERT(inuse == b->_inuse);
 	}
 
+	return healthy;
+}
+
+int
+cuckoo_hashtable_health_check(struct cuckoo_hashtable *h)
+{
+	bool healthy = true;
+	uint32_t seen = 0;
+
+	__wlock_table(h);
+
+	if (h->_old_buckets != NULL) {
+		healthy = __health_check_buckets(h, true, &seen);
+	}
+	if (!__health_check_buckets(h, false, &seen)) {
+		healthy = false;
+	}
+
 	if (seen != h->_n_entries) {
 		panic("seen %d != n_entries %d", seen, h->_n_entries);
 	}
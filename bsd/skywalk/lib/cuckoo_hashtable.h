@@ -92,6 +92,7 @@ int cuckoo_hashtable_del(struct cuckoo_hashtable *h, struct cuckoo_node *node,
     uint32_t key);
 struct cuckoo_node *cuckoo_hashtable_find_with_hash(struct cuckoo_hashtable *h,
     void *key, uint32_t hv);
+void cuckoo_hashtable_prefetch(struct cuckoo_hashtable *h, uint32_t hv);
 
 /*
  * There is no guarantee that keys concurrently operated would be returned by
@@ -31,6 +31,7 @@
 #include <pexpert/pexpert.h>    /* for PE_parse_boot_argn */
 #include <libkern/OSDebug.h>    /* for OSBacktrace */
 #include <kern/sched_prim.h>    /* for assert_wait */
+#include <machine/machine_routines.h> /* for ml_get_cluster_number_local */
 
 /*
  * Memory allocator with per-CPU caching (magazines), derived from the kmem
@@ -239,6 +240,8 @@ static void skmem_magazine_destroy(struct skmem_cache *, struct skmem_mag *,
     int);
 static uint32_t skmem_depot_batch_alloc(struct skmem_cache *,
     struct skmem_maglist *, uint32_t *, struct skmem_mag **, uint32_t);
+static uint32_t skmem_depot_full_alloc(struct skmem_cache *, uint32_t,
+    struct skmem_mag **, uint32_t);
 static void skmem_depot_batch_free(struct skmem_cache *, struct skmem_maglist *,
     uint32_t *, struct skmem_mag *);
 static void skmem_depot_ws_update(struct skmem_cache *);
@@ -314,6 +317,19 @@ static int skmem_cache_depot_contention = SKMEM_DEPOT_CONTENTION;
  */
 #define SKMEM_SLAB_BACKOFF_RANDOM       4       /* range is [1,4] msec */
 
+/*
+ * Full magazines remember the CPU cluster they were filled on, and the
+ * depot hands them back to that cluster first, so that objects freed on
+ * one cluster tend to be reused while still in its caches.  Only the first
+ * SKMEM_DEPOT_SCAN magazines are considered, to bound the depot lock hold
+ * time.
+ */
+#define SKMEM_DEPOT_SCAN                8
+static uint32_t skmem_cache_depot_local = 1;
+SYSCTL_UINT(_kern_skywalk_mem, OID_AUTO, cache_depot_local,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &skmem_cache_depot_local, 0,
+    "Prefer full magazines filled on the local CPU cluster");
+
 #if (DEVELOPMENT || DEBUG)
 SYSCTL_UINT(_kern_skywalk_mem, OID_AUTO, cache_update_interval,
     CTLFLAG_RW | CTLFLAG_LOCKED, &skmem_cache_update_interval,
@@ -1630,6 +1646,7 @@ skmem_magazine_ctor(struct skmem_obj_info *oi, struct skmem_obj_info *oim,
 	 * depot lock may not be acquired then.
 	 */
 	mg->mg_magtype = arg;
+	mg->mg_cluster = 0;
 
 	return 0;
 }
@@ -1683,19 +1700,19 @@ skmem_magazine_destroy(struct skmem_cache *skm, struct skmem_mag *mg,
 	skmem_cache_free(mg->mg_magtype->mt_cache, mg);
 }
 
-/*
- * Get one or more magazines from the depot.
- */
-static uint32_t
-skmem_depot_batch_alloc(struct skmem_cache *skm, struct skmem_maglist *ml,
-    uint32_t *count, struct skmem_mag **list, uint32_t num)
+static inline uint32_t
+skmem_cpu_cluster(void)
 {
-	SLIST_HEAD(, skmem_mag) mg_list = SLIST_HEAD_INITIALIZER(mg_list);
-	struct skmem_mag *mg;
-	uint32_t need = num, c = 0;
-
-	ASSERT(list != NULL && need > 0);
+#if defined(__arm64__)
+	return (uint32_t)ml_get_cluster_number_local();
+#else /* !__arm64__ */
+	return 0;
+#endif /* !__arm64__ */
+}
 
+static inline void
+skmem_depot_lock_alloc(struct skmem_cache *skm)
+{
 	if (!SKM_DEPOT_LOCK_TRY(skm)) {
 		/*
 		 * Track the amount of lock contention here; if the contention
@@ -1709,6 +1726,22 @@ skmem_depot_batch_alloc(struct skmem_cache *skm, struct skmem_maglist *ml,
 			skm->skm_depot_contention++;
 		}
 	}
+}
+
+/*
+ * Get one or more magazines from the depot.
+ */
+static uint32_t
+skmem_depot_batch_alloc(struct skmem_cache *skm, struct skmem_maglist *ml,
+    uint32_t *count, struct skmem_mag **list, uint32_t num)
+{
+	SLIST_HEAD(, skmem_mag) mg_list = SLIST_HEAD_INITIALIZER(mg_list);
+	struct skmem_mag *mg;
+	uint32_t need = num, c = 0;
+
+	ASSERT(list != NULL && need > 0);
+
+	skmem_depot_lock_alloc(skm);
 
 	while ((mg = SLIST_FIRST(&ml->ml_list)) != NULL) {
 		SLIST_REMOVE_HEAD(&ml->ml_list, mg_link);
@@ -1732,6 +1765,68 @@ skmem_depot_batch_alloc(struct skmem_cache *skm, struct skmem_maglist *ml,
 	return num - need;
 }
 
+/*
+ * Get one or more full magazines from the depot for a CPU of cluster cl,
+ * preferring those that were filled on that cluster.
+ */
+static uint32_t
+skmem_depot_full_alloc(struct skmem_cache *skm, uint32_t cl,
+    struct skmem_mag **list, uint32_t num)
+{
+	SLIST_HEAD(, skmem_mag) mg_list = SLIST_HEAD_INITIALIZER(mg_list);
+	struct skmem_maglist *ml = &skm->skm_full;
+	struct skmem_mag *mg, *nmg, *pmg = NULL;
+	uint32_t need = num, c, scan = 0;
+
+	ASSERT(list != NULL && need > 0);
+
+	if (!skmem_cache_depot_local) {
+		return skmem_depot_batch_alloc(skm, ml, &skm->skm_depot_full,
+		           list, num);
+	}
+
+	skmem_depot_lock_alloc(skm);
+
+	for (mg = SLIST_FIRST(&ml->ml_list);
+	    mg != NULL && need > 0 && scan < SKMEM_DEPOT_SCAN;
+	    mg = nmg, scan++) {
+		nmg = SLIST_NEXT(mg, mg_link);
+		if (mg->mg_cluster != cl) {
+			pmg = mg;
+			continue;
+		}
+		if (pmg == NULL) {
+			SLIST_REMOVE_HEAD(&ml->ml_list, mg_link);
+		} else {
+			SLIST_REMOVE_AFTER(pmg, mg_link);
+		}
+		SLIST_INSERT_HEAD(&mg_list, mg, mg_link);
+		skm->skm_depot_local++;
+		need--;
+	}
+	while (need > 0 && (mg = SLIST_FIRST(&ml->ml_list)) != NULL) {
+		SLIST_REMOVE_HEAD(&ml->ml_list, mg_link);
+		SLIST_INSERT_HEAD(&mg_list, mg, mg_link);
+		skm->skm_depot_remote++;
+		need--;
+	}
+
+	c = num - need;
+	ASSERT(ml->ml_total >= c);
+	ml->ml_total -= c;
+	if (ml->ml_total < ml->ml_min) {
+		ml->ml_min = ml->ml_total;
+	}
+	ml->ml_alloc += c;
+	skm->skm_depot_full -= c;
+
+	SKM_DEPOT_UNLOCK(skm);
+
+	*list = SLIST_FIRST(&mg_list);
+
+	return c;
+}
+
 /*
  * Return one or more magazines to the depot.
  */
@@ -2015,8 +2110,8 @@ skmem_cache_batch_alloc(struct skmem_cache *skm, struct skmem_obj **list,
 		 * replace both empty magazines only if the requested
 		 * count exceeds a magazine's worth of objects.
 		 */
-		(void) skmem_depot_batch_alloc(skm, &skm->skm_full,
-		    &skm->skm_depot_full, &mg, (need <= cp->cp_magsize) ? 1 : 2);
+		(void) skmem_depot_full_alloc(skm, skmem_cpu_cluster(), &mg,
+		    (need <= cp->cp_magsize) ? 1 : 2);
 		if (mg != NULL) {
 			SLIST_HEAD(, skmem_mag) mg_list =
 			    SLIST_HEAD_INITIALIZER(mg_list);
@@ -2265,6 +2360,8 @@ skmem_cache_batch_free(struct skmem_cache *skm, struct skmem_obj *list)
 		if (mg != NULL) {
 			SLIST_HEAD(, skmem_mag) mg_list =
 			    SLIST_HEAD_INITIALIZER(mg_list);
+			struct skmem_mag *fmg;
+			uint32_t cl;
 
 			if (cp->cp_ploaded != NULL) {
 				SLIST_INSERT_HEAD(&mg_list, cp->cp_ploaded,
@@ -2288,6 +2385,10 @@ skmem_cache_batch_free(struct skmem_cache *skm, struct skmem_obj *list)
 				}
 				skmem_cpu_batch_reload(cp, mg, 0);
 			}
+			cl = skmem_cpu_cluster();
+			SLIST_FOREACH(fmg, &mg_list, mg_link) {
+				fmg->mg_cluster = cl;
+			}
 			skmem_depot_batch_free(skm, &skm->skm_full,
 			    &skm->skm_depot_full, SLIST_FIRST(&mg_list));
 			continue;
@@ -2921,6 +3022,8 @@ skmem_cache_mib_get_stats(struct skmem_cache *skm, void *out, size_t len)
 	sca->sca_depot_full = skm->skm_depot_full;
 	sca->sca_depot_empty = skm->skm_depot_empty;
 	sca->sca_depot_ws_zero = skm->skm_depot_ws_zero;
+	sca->sca_depot_local = skm->skm_depot_local;
+	sca->sca_depot_remote = skm->skm_depot_remote;
 	/* in case of a race this might be a negative value, turn it into 0 */
 	if ((contention = (int)(skm->skm_depot_contention -
 	    skm->skm_depot_contention_prev)) < 0) {
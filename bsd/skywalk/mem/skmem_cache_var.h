@@ -117,6 +117,7 @@ struct skmem_magtype {
 struct skmem_mag {
 	SLIST_ENTRY(skmem_mag)  mg_link;        /* magazine linkage */
 	struct skmem_magtype    *mg_magtype;    /* magazine type */
+	uint32_t                mg_cluster;     /* CPU cluster that filled it */
 	void                    *mg_round[1];   /* one or more objs */
 };
 
@@ -263,6 +264,8 @@ struct skmem_cache {
 	uint32_t        skm_depot_full;         /* # of full magazines */
 	uint32_t        skm_depot_empty;        /* # of empty magazines */
 	uint32_t        skm_depot_ws_zero;      /* # of working set flushes */
+	uint64_t        skm_depot_local;        /* full mags from own cluster */
+	uint64_t        skm_depot_remote;       /* full mags from other ones */
 	uint32_t        skm_sl_rescale;         /* # of hash table rescales */
 	uint32_t        skm_sl_create;          /* slab creates */
 	uint32_t        skm_sl_destroy;         /* slab destroys */
@@ -213,6 +213,13 @@ static uint32_t skmem_md_seg_size = SKMEM_MD_SEG_SIZE;
 static uint32_t skmem_drv_buf_seg_size = SKMEM_DRV_BUF_SEG_SIZE;
 static uint32_t skmem_drv_buf_seg_eff_size = SKMEM_DRV_BUF_SEG_SIZE;
 uint32_t skmem_usr_buf_seg_size = SKMEM_USR_BUF_SEG_SIZE;
+uint32_t skmem_lbuf_seg_size = SKMEM_LBUF_SEG_SIZE;
+/*
+ * Large buffers hold TSO/LRO sized super packets; backing each of their
+ * segments with physically contiguous memory lets a segment be mapped for
+ * I/O as a single range.
+ */
+uint32_t skmem_lbuf_physcontig = 1;
 
 #define SKMEM_TAG_SEGMENT_BMAP  "com.apple.skywalk.segment.bmap"
 static SKMEM_TAG_DEFINE(skmem_tag_segment_bmap, SKMEM_TAG_SEGMENT_BMAP);
@@ -372,10 +379,22 @@ skmem_region_init(void)
 	    SKMEM_MIN_SEG_SIZE);
 	VERIFY((skmem_usr_buf_seg_size % SKMEM_PAGE_SIZE) == 0);
 
+	(void) PE_parse_boot_argn("skmem_lbuf_seg_size",
+	    &skmem_lbuf_seg_size, sizeof(skmem_lbuf_seg_size));
+	if (skmem_lbuf_seg_size < skmem_seg_size) {
+		skmem_lbuf_seg_size = skmem_seg_size;
+	}
+	skmem_lbuf_seg_size = (uint32_t)P2ROUNDUP(skmem_lbuf_seg_size,
+	    SKMEM_MIN_SEG_SIZE);
+	VERIFY((skmem_lbuf_seg_size % SKMEM_PAGE_SIZE) == 0);
+	(void) PE_parse_boot_argn("skmem_lbuf_physcontig",
+	    &skmem_lbuf_physcontig, sizeof(skmem_lbuf_physcontig));
+
 	SK_ERR("seg_size %u, md_seg_size %u, drv_buf_seg_size %u [eff %u], "
-	    "usr_buf_seg_size %u", skmem_seg_size, skmem_md_seg_size,
-	    skmem_drv_buf_seg_size, skmem_drv_buf_seg_eff_size,
-	    skmem_usr_buf_seg_size);
+	    "usr_buf_seg_size %u, lbuf_seg_size %u%s", skmem_seg_size,
+	    skmem_md_seg_size, skmem_drv_buf_seg_size,
+	    skmem_drv_buf_seg_eff_size, skmem_usr_buf_seg_size,
+	    skmem_lbuf_seg_size, skmem_lbuf_physcontig ? " (contig)" : "");
 
 	TAILQ_INIT(&skmem_region_head);
 
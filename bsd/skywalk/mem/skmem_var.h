@@ -54,6 +54,7 @@
 #define SKMEM_MD_SEG_SIZE       (16 * 1024)     /* default for metadata */
 #define SKMEM_DRV_BUF_SEG_SIZE  (64 * 1024)     /* default for device buffer */
 #define SKMEM_USR_BUF_SEG_SIZE  (16 * 1024)     /* default for user buffer */
+#define SKMEM_LBUF_SEG_SIZE     (256 * 1024)    /* default for large buffer */
 
 #define SKMEM_DRV_BUF_SEG_MULTIPLIER    2
 
@@ -65,6 +66,8 @@
 extern lck_attr_t skmem_lock_attr;
 extern lck_grp_t skmem_lock_grp;
 extern uint32_t skmem_usr_buf_seg_size;
+extern uint32_t skmem_lbuf_seg_size;
+extern uint32_t skmem_lbuf_physcontig;
 
 #if (DEVELOPMENT || DEBUG)
 SYSCTL_DECL(_kern_skywalk_mem);
@@ -146,8 +146,17 @@ struct ns {
 
 	uint32_t        ns_n_reservations;
 	struct ns_reservation_tree ns_reservations;
+
+	/*
+	 * Ports with a reservation, mirroring ns_reservations; allocated
+	 * the first time an ephemeral port is picked in this namespace so
+	 * that the search can skip ports in use without walking the tree.
+	 */
+	bitstr_t        *ns_port_map;
 };
 
+#define NETNS_PORT_MAP_SIZE     bitstr_size(UINT16_MAX + 1)
+
 static uint32_t netns_n_namespaces;
 
 static inline int ns_cmp(const struct ns *, const struct ns *);
@@ -233,6 +242,9 @@ static struct skmem_cache *netns_ns_flow_info_cache; /* for ns_flow_info */
 static unsigned int netns_ns_reservation_size; /* size of zone element */
 static struct skmem_cache *netns_ns_reservation_cache; /* for ns_reservation */
 
+#define SKMEM_TAG_NETNS_PORT_MAP        "com.apple.skywalk.netns.port_map"
+static SKMEM_TAG_DEFINE(skmem_tag_netns_port_map, SKMEM_TAG_NETNS_PORT_MAP);
+
 static struct ns_reservation *netns_ns_reservation_alloc(in_port_t, uint32_t);
 static void netns_ns_reservation_free(struct ns_reservation *);
 static struct ns *netns_ns_alloc(zalloc_flags_t);
@@ -340,6 +352,11 @@ netns_ns_free(struct ns *namespace)
 
 	VERIFY(RB_EMPTY(&namespace->ns_reservations));
 
+	if (namespace->ns_port_map != NULL) {
+		sk_free_data(namespace->ns_port_map, NETNS_PORT_MAP_SIZE);
+		namespace->ns_port_map = NULL;
+	}
+
 	if (netns_global_wild[NETNS_NS_GLOBAL_IDX(namespace->ns_proto,
 	    namespace->ns_addr_len)] == namespace) {
 		netns_global_wild[NETNS_NS_GLOBAL_IDX(namespace->ns_proto,
@@ -577,6 +594,9 @@ _netns_reserve_common(struct ns *namespace, in_port_t port, uint32_t flags)
 	    res);
 	if (__probable(exist == NULL)) {
 		namespace->ns_n_reservations++;
+		if (namespace->ns_port_map != NULL) {
+			bitstr_set(namespace->ns_port_map, port);
+		}
 	} else {
 		netns_ns_reservation_free(res);
 		res = exist;
@@ -821,6 +841,9 @@ done:
 			RB_REMOVE(ns_reservation_tree,
 			    &namespace->ns_reservations, res);
 			namespace->ns_n_reservations--;
+			if (namespace->ns_port_map != NULL) {
+				bitstr_clear(namespace->ns_port_map, port);
+			}
 			netns_ns_reservation_free(res);
 		}
 	}
@@ -876,12 +899,77 @@ _netns_release_common(struct ns *namespace, in_port_t port, uint32_t flags)
 		RB_REMOVE(ns_reservation_tree, &namespace->ns_reservations,
 		    res);
 		namespace->ns_n_reservations--;
+		if (namespace->ns_port_map != NULL) {
+			bitstr_clear(namespace->ns_port_map, port);
+		}
 		NETNS_LOCK_CONVERT();
 		netns_ns_reservation_free(res);
 		netns_ns_cleanup(namespace);
 	}
 }
 
+/*
+ * Start mirroring the reservations of a namespace in a port bitmap.
+ */
+static void
+_netns_port_map_init(struct ns *namespace)
+{
+	struct ns_reservation *res;
+	bitstr_t *map;
+
+	NETNS_LOCK_ASSERT_HELD();
+
+	if (namespace == NULL || namespace->ns_port_map != NULL) {
+		return;
+	}
+
+	NETNS_LOCK_CONVERT();
+	map = sk_alloc_data(NETNS_PORT_MAP_SIZE, Z_WAITOK | Z_NOFAIL,
+	    skmem_tag_netns_port_map);
+	RB_FOREACH(res, ns_reservation_tree, &namespace->ns_reservations) {
+		bitstr_set(map, res->nsr_port);
+	}
+	namespace->ns_port_map = map;
+}
+
+__attribute__((always_inline))
+static inline boolean_t
+_netns_port_is_reserved(struct ns *namespace, in_port_t port)
+{
+	if (namespace == NULL) {
+		return FALSE;
+	}
+	if (namespace->ns_port_map != NULL) {
+		return bitstr_test(namespace->ns_port_map, port) != 0;
+	}
+	return ns_reservation_tree_find(&namespace->ns_reservations,
+	           port) != NULL;
+}
+
+/*
+ * Cheap check used by the ephemeral port search: a port that already has
+ * a reservation in the namespace, or in the global namespace it would
+ * collide with, is not worth a full reservation attempt.
+ */
+__attribute__((always_inline))
+static inline boolean_t
+_netns_ephemeral_port_busy(struct ns *namespace, in_port_t port)
+{
+	uint8_t idx = NETNS_NS_GLOBAL_IDX(namespace->ns_proto,
+	    namespace->ns_addr_len);
+
+	if (_netns_port_is_reserved(namespace, port)) {
+		return TRUE;
+	}
+	if (_netns_is_wildcard_addr(namespace->ns_addr,
+	    namespace->ns_addr_len)) {
+		return _netns_port_is_reserved(netns_global_non_wild[idx],
+		           port);
+	}
+	return namespace != netns_global_wild[idx] &&
+	       _netns_port_is_reserved(netns_global_wild[idx], port);
+}
+
 __attribute__((always_inline))
 static inline void
 netns_init_global_ns(struct ns **global_ptr, uint8_t proto, uint8_t addrlen)
@@ -1291,6 +1379,7 @@ netns_reserve_ephemeral(netns_token *token, uint32_t *addr, uint8_t addr_len,
 	boolean_t count_up = true;
 	boolean_t use_randomport = (proto == IPPROTO_TCP) ?
 	    tcp_use_randomport : udp_use_randomport;
+	in_port_t rand_seed = 0;
 #if SK_LOG
 	char tmp_ip_str[MAX_IPv6_STR_LEN];
 #endif /* SK_LOG */
@@ -1310,6 +1399,11 @@ netns_reserve_ephemeral(netns_token *token, uint32_t *addr, uint8_t addr_len,
 	    tmp_ip_str, sizeof(tmp_ip_str)), PROTO_STR(proto), ntohs(*port),
 	    flags);
 
+	/* Draw the random starting point before serializing on the lock */
+	if (use_randomport) {
+		read_frandom(&rand_seed, sizeof(rand_seed));
+	}
+
 	NETNS_LOCK_SPIN();
 
 	namespace = _netns_get_ns(addr, addr_len, proto, true);
@@ -1319,6 +1413,12 @@ netns_reserve_ephemeral(netns_token *token, uint32_t *addr, uint8_t addr_len,
 		return err;
 	}
 
+	_netns_port_map_init(namespace);
+	if (_netns_is_wildcard_addr(addr, addr_len)) {
+		_netns_port_map_init(netns_global_non_wild[
+			    NETNS_NS_GLOBAL_IDX(proto, addr_len)]);
+	}
+
 	if (proto == IPPROTO_UDP) {
 		if (UINT16_MAX - namespace->ns_n_reservations <
 		    NETNS_NS_UDP_EPHEMERAL_RESERVE) {
@@ -1334,9 +1434,7 @@ netns_reserve_ephemeral(netns_token *token, uint32_t *addr, uint8_t addr_len,
 		rand_port = first;
 	} else {
 		if (use_randomport) {
-			NETNS_LOCK_CONVERT();
-			read_frandom(&rand_port, sizeof(rand_port));
-
+			rand_port = rand_seed;
 			if (first > last) {
 				rand_port = last + (rand_port %
 				    (first - last));
@@ -1376,7 +1474,8 @@ netns_reserve_ephemeral(netns_token *token, uint32_t *addr, uint8_t addr_len,
 		 * Skip if this is a restricted port as we do not want to
 		 * restricted ports as ephemeral
 		 */
-		if (!IS_RESTRICTED_IN_PORT(n_last_port)) {
+		if (!IS_RESTRICTED_IN_PORT(n_last_port) &&
+		    !_netns_ephemeral_port_busy(namespace, last_port)) {
 			err = _netns_reserve_kpi_common(namespace, token, addr,
 			    addr_len, proto, &n_last_port, flags, nfi);
 			if (err == 0 || err != EADDRINUSE) {
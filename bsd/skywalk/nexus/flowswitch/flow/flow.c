@@ -80,9 +80,9 @@ flow_init(void)
 
 	sk_fe_size = sizeof(struct flow_entry);
 	if (sk_fe_cache == NULL) {
-		/* request for 16-bytes alignment (due to fe_key) */
+		/* cache line aligned, for the hot field groups */
 		sk_fe_cache = skmem_cache_create(SK_FE_ZONE_NAME, sk_fe_size,
-		    16, NULL, NULL, NULL, NULL, NULL, 0);
+		    CHANNEL_CACHE_ALIGN_MAX, NULL, NULL, NULL, NULL, NULL, 0);
 		if (sk_fe_cache == NULL) {
 			panic("%s: skmem_cache create failed (%s)", __func__,
 			    SK_FE_ZONE_NAME);
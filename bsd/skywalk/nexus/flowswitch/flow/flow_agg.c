@@ -33,12 +33,14 @@
 #include <skywalk/nexus/netif/nx_netif.h>
 #include <skywalk/nexus/netif/nx_netif_compat.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <net/pktap.h>
 #include <sys/sdt.h>
 
 #define MAX_AGG_IP_LEN()        MIN(sk_fsw_rx_agg_tcp, IP_MAXPACKET)
+#define MAX_AGG_UDP_LEN()       MIN(sk_fsw_rx_agg_udp, IP_MAXPACKET)
 #define MAX_BUFLET_COUNT        (32)
 #define TCP_FLAGS_IGNORE        (TH_FIN|TH_SYN|TH_RST|TH_URG)
 #define PKT_IS_MBUF(_pkt)       (_pkt->pkt_pflags & PKT_F_MBUF_DATA)
@@ -771,7 +773,7 @@ copy_pkt_csum(struct __kern_packet *pkt, uint32_t plen, _dbuf_array_t *dbuf,
 	}
 	copied_len += pkt->pkt_flow_ip_hlen;
 
-	/* Copy & verify TCP checksum */
+	/* Copy & verify TCP/UDP checksum */
 	start = pkt->pkt_flow_ip_hlen;
 	len = plen - start;
 
@@ -822,7 +824,7 @@ copy_pkt_csum(struct __kern_packet *pkt, uint32_t plen, _dbuf_array_t *dbuf,
 	/* Fold in the data checksum to TCP checksum */
 	partial += *data_csum;
 
-	partial += htons(len + IPPROTO_TCP);
+	partial += htons(len + pkt->pkt_flow_ip_proto);
 	if (pkt->pkt_flow_ip_ver == IPVERSION) {
 		csum = in_pseudo(pkt->pkt_flow_ipv4_src.s_addr,
 		    pkt->pkt_flow_ipv4_dst.s_addr, partial);
@@ -832,7 +834,15 @@ copy_pkt_csum(struct __kern_packet *pkt, uint32_t plen, _dbuf_array_t *dbuf,
 		    &pkt->pkt_flow_ipv6_dst, partial);
 	}
 
-	SK_DF(logflags, "TCP copy+sum %u(%u) (csum 0x%04x)",
+	/* UDP over IPv4 may carry no checksum at all */
+	if (pkt->pkt_flow_ip_proto == IPPROTO_UDP &&
+	    pkt->pkt_flow_ip_ver == IPVERSION &&
+	    ((struct udphdr *)(void *)(daddr +
+	    pkt->pkt_flow_ip_hlen))->uh_sum == 0) {
+		csum = 0xffff;
+	}
+
+	SK_DF(logflags, "L4 copy+sum %u(%u) (csum 0x%04x)",
 	    pkt->pkt_flow_ip_hlen, len, csum);
 
 	/* pkt metadata will be transfer to super packet */
@@ -1886,7 +1896,7 @@ next:
 	KPKTQ_CONCAT(&fe->fe_rx_pktq, &pkts);
 	KPKTQ_FINI(&pkts);
 
-	fsw_ring_enqueue_tail_drop(fsw, ring, &fe->fe_rx_pktq);
+	fsw_ring_enqueue_tail_drop(fsw, fe, ring, &fe->fe_rx_pktq);
 
 	pp_free_pktq(&disposed_pkts);
 }
@@ -2417,6 +2427,284 @@ next:
 	pp_free_pktq(&disposed_pkts);
 }
 
+static inline void
+finalize_udp_chain(struct __kern_packet **spkt, kern_packet_t *sph,
+    uint16_t *spkts, uint16_t bufcnt)
+{
+	(*spkts)++;
+	if ((*spkt)->pkt_seg_cnt > 1) {
+		(*spkt)->pkt_aggr_type = PKT_AGGR_IP_CHAIN;
+	} else if (bufcnt > 1) {
+		(*spkt)->pkt_aggr_type = PKT_AGGR_SINGLE_IP;
+	}
+	pkt_finalize(*sph);
+	pkt_agg_log(*spkt, kernproc, false);
+	DTRACE_SKYWALK2(aggr__udp__chain, uint8_t, (*spkt)->pkt_seg_cnt,
+	    uint16_t, bufcnt);
+	*sph = 0;
+	*spkt = NULL;
+}
+
+/*
+ * UDP datagrams can't be merged the way TCP segments are, so they are
+ * chained instead: every datagram keeps its IP and UDP headers in a buflet
+ * of its own, and a run of datagrams of the same size goes to the channel
+ * as one PKT_AGGR_IP_CHAIN super packet, with the number of datagrams in
+ * pkt_seg_cnt and their payload size in pkt_proto_seg_sz.  A shorter
+ * datagram may end a run; one that doesn't fit a buflet, fails its
+ * checksum or woke the system travels on its own.
+ */
+SK_NO_INLINE_ATTRIBUTE
+static void
+flow_rx_agg_channel_udp(struct nx_flowswitch *fsw, struct flow_entry *fe,
+    struct pktq *dropped_pkts, bool is_mbuf)
+{
+#define __RX_AGG_UDP_DROP_SOURCE_PACKET(_pkt)    do {    \
+	KPKTQ_ENQUEUE(dropped_pkts, (_pkt));             \
+	(_pkt) = NULL;                                   \
+	prev_agg_ok = false;                             \
+} while (0)
+	struct pktq pkts;               /* dst super packets */
+	struct pktq disposed_pkts;      /* done src packets */
+
+	KPKTQ_INIT(&pkts);
+	KPKTQ_INIT(&disposed_pkts);
+
+	struct __kern_channel_ring *ring;
+	ring = fsw_flow_get_rx_ring(fsw, fe);
+	if (__improbable(ring == NULL)) {
+		SK_ERR("Rx ring is NULL");
+		KPKTQ_CONCAT(dropped_pkts, &fe->fe_rx_pktq);
+		STATS_ADD(&fsw->fsw_stats, FSW_STATS_DST_NXPORT_INVALID,
+		    KPKTQ_LEN(dropped_pkts));
+		return;
+	}
+	struct kern_pbufpool *dpp = ring->ckr_pp;
+	ASSERT(dpp->pp_max_frags > 1);
+
+	struct __kern_packet *pkt, *tpkt;
+	/* state for super packet */
+	struct __kern_packet *spkt = NULL;
+	kern_packet_t sph = 0;
+	kern_buflet_t sbuf = NULL;
+	bool prev_agg_ok = false, csum_ok, agg_ok;
+	uint16_t spkts = 0, bufcnt = 0;
+	int err;
+
+	struct fsw_stats *fsws = &fsw->fsw_stats;
+
+	/* state for buflet batch alloc */
+	uint32_t bh_cnt, bh_cnt_tmp;
+	uint64_t buf_arr[MAX_BUFLET_COUNT];
+	_dbuf_array_t dbuf_array = {.dba_is_buflet = true, .dba_num_dbufs = 0};
+	uint32_t agg_bufsize = PP_BUF_SIZE_DEF(dpp);
+	uint32_t max_len = MAX_AGG_UDP_LEN();
+	uint8_t iter = 0;
+
+	SK_LOG_VAR(uint64_t logflags = (SK_VERB_FSW | SK_VERB_RX));
+	SK_DF(logflags, "Rx input queue len %u", KPKTQ_LEN(&fe->fe_rx_pktq));
+
+	/* one buflet per datagram, in the common case */
+	bh_cnt_tmp = bh_cnt = MIN(KPKTQ_LEN(&fe->fe_rx_pktq), MAX_BUFLET_COUNT);
+	err = pp_alloc_buflet_batch(dpp, buf_arr, &bh_cnt, SKMEM_NOSLEEP,
+	    PP_ALLOC_BFT_ATTACH_BUFFER);
+	if (__improbable(bh_cnt == 0)) {
+		SK_ERR("failed to alloc %u buflets (err %d), use slow path",
+		    bh_cnt_tmp, err);
+	}
+	bool is_ipv4 = (fe->fe_key.fk_ipver == IPVERSION);
+	KPKTQ_FOREACH_SAFE(pkt, &fe->fe_rx_pktq, tpkt) {
+		if (tpkt != NULL) {
+			void *baddr;
+			MD_BUFLET_ADDR_ABS_PKT(tpkt, baddr);
+			SK_PREFETCH(baddr, 0);
+		}
+
+		ASSERT(pkt->pkt_qum.qum_pp != dpp);
+		ASSERT(is_mbuf == !!(PKT_IS_MBUF(pkt)));
+		ASSERT(fe->fe_key.fk_ipver == pkt->pkt_flow_ip_ver);
+		ASSERT((pkt->pkt_link_flags & PKT_LINKF_ETHFCS) == 0);
+		ASSERT(!pkt->pkt_flow_ip_is_frag);
+		ASSERT(pkt->pkt_flow_ip_proto == IPPROTO_UDP);
+
+		uint32_t plen = (pkt->pkt_flow_ip_hlen +
+		    pkt->pkt_flow_udp_hlen + pkt->pkt_flow_ulen);
+		uint16_t data_csum = 0;
+
+		KPKTQ_REMOVE(&fe->fe_rx_pktq, pkt);
+		fe->fe_rx_pktq_bytes -= pkt->pkt_flow_ulen;
+		err = flow_pkt_track(fe, pkt, true);
+		if (__improbable(err != 0)) {
+			STATS_INC(fsws, FSW_STATS_RX_FLOW_TRACK_ERR);
+			SK_ERR("flow_pkt_track failed (err %d)", err);
+			__RX_AGG_UDP_DROP_SOURCE_PACKET(pkt);
+			continue;
+		}
+
+		if (is_mbuf) {          /* compat */
+			m_adj(pkt->pkt_mbuf, pkt->pkt_l2_len);
+			pkt->pkt_svc_class = m_get_service_class(pkt->pkt_mbuf);
+			if (pkt->pkt_mbuf->m_pkthdr.pkt_flags & PKTF_WAKE_PKT) {
+				pkt->pkt_pflags |= PKT_F_WAKE_PKT;
+			}
+		}
+
+		/* calculate number of buflets required */
+		bh_cnt_tmp = howmany(plen, agg_bufsize);
+		if (__improbable(bh_cnt_tmp > MAX_BUFLET_COUNT)) {
+			STATS_INC(fsws, FSW_STATS_DROP_NOMEM_PKT);
+			SK_ERR("packet too big: bufcnt %d len %d", bh_cnt_tmp,
+			    plen);
+			__RX_AGG_UDP_DROP_SOURCE_PACKET(pkt);
+			continue;
+		}
+		if (bh_cnt < bh_cnt_tmp) {
+			uint32_t tmp;
+
+			if (iter != 0) {
+				/*
+				 * rearrange the array for additional
+				 * allocation
+				 */
+				uint8_t i;
+				for (i = 0; i < bh_cnt; i++, iter++) {
+					buf_arr[i] = buf_arr[iter];
+					buf_arr[iter] = 0;
+				}
+				iter = 0;
+			}
+			tmp = MIN(KPKTQ_LEN(&fe->fe_rx_pktq) + 1,
+			    MAX_BUFLET_COUNT);
+			tmp = MAX(tmp, bh_cnt_tmp);
+			tmp -= bh_cnt;
+			ASSERT(tmp <= (MAX_BUFLET_COUNT - bh_cnt));
+			DTRACE_SKYWALK1(refilled_blt_cnt, uint32_t, tmp);
+			err = pp_alloc_buflet_batch(dpp, &buf_arr[bh_cnt],
+			    &tmp, SKMEM_NOSLEEP, PP_ALLOC_BFT_ATTACH_BUFFER);
+			bh_cnt += tmp;
+			if (__improbable((tmp == 0) || (bh_cnt < bh_cnt_tmp))) {
+				STATS_INC(fsws, FSW_STATS_DROP_NOMEM_PKT);
+				SK_ERR("buflet alloc failed (err %d)", err);
+				__RX_AGG_UDP_DROP_SOURCE_PACKET(pkt);
+				continue;
+			}
+		}
+		/* Use pre-allocated buflets */
+		ASSERT(bh_cnt >= bh_cnt_tmp);
+		dbuf_array.dba_num_dbufs = bh_cnt_tmp;
+		while (bh_cnt_tmp-- > 0) {
+			dbuf_array.dba_buflet[bh_cnt_tmp] =
+			    (kern_buflet_t)(buf_arr[iter]);
+			buf_arr[iter] = 0;
+			bh_cnt--;
+			iter++;
+		}
+
+		/* copy and checksum the whole datagram */
+		csum_ok = copy_pkt_csum(pkt, plen, &dbuf_array, &data_csum,
+		    is_ipv4);
+		if (__improbable(!csum_ok)) {
+			STATS_INC(fsws, FSW_STATS_RX_AGG_BAD_CSUM);
+			SK_ERR("%d incorrect csum", __LINE__);
+			DTRACE_SKYWALK(aggr__chan_udp_csum_fail);
+		}
+
+		agg_ok = false;
+		if (prev_agg_ok && csum_ok && dbuf_array.dba_num_dbufs == 1 &&
+		    (pkt->pkt_pflags & PKT_F_WAKE_PKT) == 0) {
+			ASSERT(spkt != NULL);
+			if (pkt->pkt_flow_ulen > spkt->pkt_proto_seg_sz) {
+				STATS_INC(fsws, FSW_STATS_RX_AGG_NO_ULEN_UDP);
+			} else if (bufcnt >= dpp->pp_max_frags ||
+			    spkt->pkt_seg_cnt == UINT8_MAX ||
+			    spkt->pkt_length + plen > max_len) {
+				STATS_INC(fsws, FSW_STATS_RX_AGG_LIMIT);
+			} else {
+				agg_ok = true;
+			}
+		}
+
+		if (agg_ok) {
+			spkt->pkt_length += plen;
+			spkt->pkt_seg_cnt++;
+			bufcnt++;
+			_append_dbuf_array_to_kpkt(sph, sbuf, &dbuf_array,
+			    &sbuf);
+			STATS_INC(fsws, FSW_STATS_RX_AGG_OK_UDP);
+		} else {
+			/* Finalize the current super packet */
+			if (sph != 0) {
+				finalize_udp_chain(&spkt, &sph, &spkts,
+				    bufcnt);
+			}
+
+			/* New super packet */
+			err = kern_pbufpool_alloc_nosleep(dpp, 0, &sph);
+			if (__improbable(err != 0)) {
+				STATS_INC(fsws, FSW_STATS_DROP_NOMEM_PKT);
+				SK_ERR("packet alloc failed (err %d)", err);
+				_free_dbuf_array(dpp, &dbuf_array);
+				__RX_AGG_UDP_DROP_SOURCE_PACKET(pkt);
+				continue;
+			}
+			spkt = SK_PTR_ADDR_KPKT(sph);
+			pkt_copy_metadata(pkt, spkt);
+			/* Packet length for super packet starts from L3 */
+			spkt->pkt_length = plen;
+			spkt->pkt_flow_ulen = pkt->pkt_flow_ulen;
+			spkt->pkt_headroom = 0;
+			spkt->pkt_l2_len = 0;
+			spkt->pkt_seg_cnt = 1;
+			spkt->pkt_proto_seg_sz = (uint16_t)pkt->pkt_flow_ulen;
+
+			ASSERT(dbuf_array.dba_num_dbufs > 0);
+			bufcnt = dbuf_array.dba_num_dbufs;
+			sbuf = kern_packet_get_next_buflet(sph, NULL);
+			_append_dbuf_array_to_kpkt(sph, sbuf, &dbuf_array,
+			    &sbuf);
+
+			KPKTQ_ENQUEUE(&pkts, spkt);
+			_UUID_COPY(spkt->pkt_flow_id, fe->fe_uuid);
+			_UUID_COPY(spkt->pkt_policy_euuid, fe->fe_eproc_uuid);
+			spkt->pkt_policy_id = fe->fe_policy_id;
+			spkt->pkt_transport_protocol =
+			    fe->fe_transport_protocol;
+		}
+		pkt_agg_log(pkt, kernproc, true);
+		/* a shorter datagram ends the run */
+		prev_agg_ok = (csum_ok && bufcnt == spkt->pkt_seg_cnt &&
+		    pkt->pkt_flow_ulen == spkt->pkt_proto_seg_sz);
+		KPKTQ_ENQUEUE(&disposed_pkts, pkt);
+	}
+
+	/* Free unused buflets */
+	while (bh_cnt > 0) {
+		pp_free_buflet(dpp, (kern_buflet_t)(buf_arr[iter]));
+		buf_arr[iter] = 0;
+		bh_cnt--;
+		iter++;
+	}
+	/* Finalize the last super packet */
+	if (sph != 0) {
+		finalize_udp_chain(&spkt, &sph, &spkts, bufcnt);
+	}
+	DTRACE_SKYWALK1(aggr__udp__spkt__count, uint16_t, spkts);
+	if (__improbable(is_mbuf)) {
+		STATS_ADD(fsws, FSW_STATS_RX_AGG_MBUF2PKT, spkts);
+	} else {
+		STATS_ADD(fsws, FSW_STATS_RX_AGG_PKT2PKT, spkts);
+	}
+	FLOW_STATS_IN_ADD(fe, spackets, spkts);
+
+	KPKTQ_FINI(&fe->fe_rx_pktq);
+	KPKTQ_CONCAT(&fe->fe_rx_pktq, &pkts);
+	KPKTQ_FINI(&pkts);
+
+	fsw_ring_enqueue_tail_drop(fsw, fe, ring, &fe->fe_rx_pktq);
+
+	pp_free_pktq(&disposed_pkts);
+}
+
 void
 flow_rx_agg_tcp(struct nx_flowswitch *fsw, struct flow_entry *fe)
 {
@@ -2470,3 +2758,44 @@ flow_rx_agg_tcp(struct nx_flowswitch *fsw, struct flow_entry *fe)
 done:
 	pp_free_pktq(&dropped_pkts);
 }
+
+void
+flow_rx_agg_udp(struct nx_flowswitch *fsw, struct flow_entry *fe)
+{
+	struct pktq dropped_pkts;
+	bool is_mbuf;
+
+	if (__improbable(fe->fe_rx_frag_count > 0)) {
+		dp_flow_rx_process(fsw, fe);
+		return;
+	}
+
+	/*
+	 * The BSD stack takes datagrams one at a time; fsw_host_rx()
+	 * already hands it the whole batch as a single mbuf chain.
+	 */
+	if (__improbable(fe->fe_nx_port == FSW_VP_HOST)) {
+		dp_flow_rx_process(fsw, fe);
+		return;
+	}
+
+	KPKTQ_INIT(&dropped_pkts);
+
+	if (!dp_flow_rx_route_process(fsw, fe)) {
+		SK_ERR("Rx route bad");
+		fsw_snoop_and_dequeue(fe, &dropped_pkts, true);
+		STATS_ADD(&fsw->fsw_stats, FSW_STATS_RX_FLOW_NONVIABLE,
+		    KPKTQ_LEN(&dropped_pkts));
+		goto done;
+	}
+
+	is_mbuf = !!(PKT_IS_MBUF(KPKTQ_FIRST(&fe->fe_rx_pktq)));
+
+	if (__improbable(pktap_total_tap_count != 0)) {
+		fsw_snoop(fsw, fe, true);
+	}
+	flow_rx_agg_channel_udp(fsw, fe, &dropped_pkts, is_mbuf);
+
+done:
+	pp_free_pktq(&dropped_pkts);
+}
@@ -533,6 +533,12 @@ flow_entry_alloc(struct flow_owner *fo, struct nx_flow_req *req, int *perr)
 	    (fe->fe_key.fk_proto == IPPROTO_TCP) &&
 	    (fe->fe_key.fk_mask == FKMASK_5TUPLE)) {
 		fe->fe_rx_process = flow_rx_agg_tcp;
+	} else if (NX_FSW_UDP_RX_AGG_ENABLED() &&
+	    (req->nfr_flags & NXFLOWREQF_UDP_RX_AGG) &&
+	    (fo->fo_fsw->fsw_nx->nx_prov->nxprov_params->nxp_max_frags > 1) &&
+	    (fe->fe_key.fk_proto == IPPROTO_UDP) &&
+	    (fe->fe_key.fk_mask == FKMASK_5TUPLE)) {
+		fe->fe_rx_process = flow_rx_agg_udp;
 	}
 	uuid_copy(fe->fe_uuid, req->nfr_flow_uuid);
 	if ((req->nfr_flags & NXFLOWREQF_LISTENER) == 0 &&
@@ -937,6 +943,11 @@ fe_alloc(boolean_t can_block)
 	struct flow_entry *fe;
 
 	_CASSERT((offsetof(struct flow_entry, fe_key) % 16) == 0);
+#if !OS_REFCNT_DEBUG
+	/* per-packet RX fields share the first cache line */
+	_CASSERT(offsetof(struct flow_entry, fe_rx_process) +
+	    sizeof(flow_action_t) <= CHANNEL_CACHE_ALIGN_MAX);
+#endif /* !OS_REFCNT_DEBUG */
 
 	fe = skmem_cache_alloc(sk_fe_cache,
 	    can_block ? SKMEM_SLEEP : SKMEM_NOSLEEP);
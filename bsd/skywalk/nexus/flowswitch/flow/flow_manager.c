@@ -1180,6 +1180,29 @@ flow_mgr_find_fe_by_key(struct flow_mgr *fm, struct flow_key *key)
 	return fe;
 }
 
+/*
+ * Prefetch the flow table bucket that flow_mgr_find_fe_by_key() will
+ * probe first for key.
+ */
+void
+flow_mgr_prefetch_fe_by_key(struct flow_mgr *fm, struct flow_key *key)
+{
+	uint16_t saved_mask = key->fk_mask;
+
+	for (int i = 0; i < FKMASK_IDX_MAX; i++) {
+		uint16_t mask = fm->fm_flow_hash_masks[i];
+
+		if (fm->fm_flow_hash_count[i] == 0 || mask == 0) {
+			continue;
+		}
+		key->fk_mask = mask;
+		cuckoo_hashtable_prefetch(fm->fm_flow_table,
+		    flow_key_hash(key));
+		break;
+	}
+	key->fk_mask = saved_mask;
+}
+
 struct flow_entry *
 flow_mgr_find_conflicting_fe(struct flow_mgr *fm, struct flow_key *key)
 {
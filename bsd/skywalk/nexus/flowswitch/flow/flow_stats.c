@@ -92,6 +92,29 @@ flow_stats_alloc(boolean_t cansleep)
 	return fs;
 }
 
+/*
+ * Account for spending [start, end) (mach absolute time) in the Rx
+ * pipeline stage (SFLOW_LAT_*) of the flow.
+ */
+void
+flow_stats_lat_sample(struct flow_entry *fe, uint32_t stage, uint64_t start,
+    uint64_t end)
+{
+	uint64_t usec;
+	uint32_t b;
+
+	ASSERT(stage < SFLOW_LAT_MAX);
+	if (__improbable(fe->fe_stats == NULL || end < start)) {
+		return;
+	}
+
+	absolutetime_to_nanoseconds(end - start, &usec);
+	usec /= NSEC_PER_USEC;
+	b = (usec == 0) ? 0 : (uint32_t)(64 - __builtin_clzll(usec));
+	b = MIN(b, SFLOW_LAT_BUCKETS - 1);
+	fe->fe_stats->fs_stats.sf_lat.sfl_hist[stage][b]++;
+}
+
 void
 flow_stats_free(struct flow_stats *fs)
 {
@@ -245,37 +245,28 @@ TAILQ_HEAD(flow_entry_list, flow_entry);
 
 typedef void (*flow_action_t)(struct nx_flowswitch *fsw, struct flow_entry *fe);
 
+/*
+ * The fields read or written for every packet on the RX path (flow lookup,
+ * batching and the per-batch reset) come first and fit in one cache line;
+ * those used for every packet on the TX path follow in the next one.
+ * Everything else is only touched on flow setup, teardown or slow paths.
+ */
 struct flow_entry {
-	/**** Common Group ****/
-	os_refcnt_t             fe_refcnt;
+	/**** Rx/Lookup Group ****/
 	struct flow_key         fe_key;
+	os_refcnt_t             fe_refcnt;
 	uint32_t                fe_flags;
 	uint32_t                fe_key_hash;
-	struct cuckoo_node      fe_cnode;
-
-	uuid_t                  fe_uuid __sk_aligned(8);
-	nexus_port_t            fe_nx_port;
-	uint32_t                fe_laddr_gencnt;
-	uint32_t                fe_want_nonviable;
-	uint32_t                fe_want_withdraw;
-	uint8_t                 fe_transport_protocol;
-
-	/**** Rx Group ****/
 	uint16_t                fe_rx_frag_count;
+	uint8_t                 fe_transport_protocol;
+	struct cuckoo_node      fe_cnode;
 	uint32_t                fe_rx_pktq_bytes;
 	struct pktq             fe_rx_pktq;
 	TAILQ_ENTRY(flow_entry) fe_rx_link;
 	flow_action_t           fe_rx_process;
 
-	/*
-	 * largest allocated packet size.
-	 * used by:
-	 *  - mbuf batch allocation logic during RX aggregtion and netif copy.
-	 *  - packet allocation logic during RX aggregation.
-	 */
-	uint32_t                fe_rx_largest_size;
-
 	/**** Tx Group ****/
+	uuid_t                  fe_uuid __sk_aligned(CHANNEL_CACHE_ALIGN_MAX);
 	bool                    fe_tx_is_cont_frag;
 	uint32_t                fe_tx_frag_id;
 	struct pktq             fe_tx_pktq;
@@ -285,8 +276,24 @@ struct flow_entry {
 	uuid_t                  fe_eproc_uuid __sk_aligned(8);
 	flowadv_idx_t           fe_adv_idx;
 	kern_packet_svc_class_t fe_svc_class;
+	uint32_t                fe_flowid; /* globally unique flow ID */
+	struct netif_qset      *fe_qset;
+
+	/**** Common Group ****/
+	nexus_port_t            fe_nx_port;
+	uint32_t                fe_laddr_gencnt;
+	uint32_t                fe_want_nonviable;
+	uint32_t                fe_want_withdraw;
 	uint32_t                fe_policy_id;   /* policy id matched to flow */
 
+	/*
+	 * largest allocated packet size.
+	 * used by:
+	 *  - mbuf batch allocation logic during RX aggregtion and netif copy.
+	 *  - packet allocation logic during RX aggregation.
+	 */
+	uint32_t                fe_rx_largest_size;
+
 	/**** Misc Group ****/
 	struct nx_flowswitch *  const fe_fsw;
 	struct ns_token         *fe_port_reservation;
@@ -303,6 +310,10 @@ struct flow_entry {
 	struct flow_stats       *fe_stats;
 	struct flow_route       *fe_route;
 
+	/* Rx latency sampling (fsw_flow_lat), in mach absolute time */
+	uint64_t                fe_rx_lat_ts;   /* flow processing start */
+	uint64_t                fe_rx_lat_enq;  /* last ring enqueue */
+
 	RB_ENTRY(flow_entry)    fe_id_link;
 
 	TAILQ_ENTRY(flow_entry) fe_linger_link;
@@ -314,10 +325,7 @@ struct flow_entry {
 	char                    fe_proc_name[FLOW_PROCESS_NAME_LENGTH];
 	char                    fe_eproc_name[FLOW_PROCESS_NAME_LENGTH];
 
-	uint32_t                fe_flowid; /* globally unique flow ID */
-
 	/* Logical link related information */
-	struct netif_qset      *fe_qset;
 	uint64_t                fe_qset_id;
 	flow_qset_select_t      fe_qset_select;
 	uint32_t                fe_tr_genid;
@@ -957,6 +965,8 @@ extern uint32_t flow_owner_activate_nexus_port(struct flow_mgr *,
 
 extern struct flow_entry *flow_mgr_find_fe_by_key(struct flow_mgr *,
     struct flow_key *);
+extern void flow_mgr_prefetch_fe_by_key(struct flow_mgr *,
+    struct flow_key *);
 extern struct flow_entry * flow_mgr_find_conflicting_fe(struct flow_mgr *fm,
     struct flow_key *fe_key);
 extern void flow_mgr_foreach_flow(struct flow_mgr *fm,
@@ -997,6 +1007,7 @@ extern void fsw_host_sendup(struct ifnet *, struct mbuf *, struct mbuf *,
     uint32_t, uint32_t);
 
 extern void flow_rx_agg_tcp(struct nx_flowswitch *fsw, struct flow_entry *fe);
+extern void flow_rx_agg_udp(struct nx_flowswitch *fsw, struct flow_entry *fe);
 
 extern void flow_route_init(void);
 extern void flow_route_fini(void);
@@ -1031,6 +1042,8 @@ extern void flow_qset_select_dynamic(struct nx_flowswitch *,
 extern void flow_stats_init(void);
 extern void flow_stats_fini(void);
 extern struct flow_stats *flow_stats_alloc(boolean_t cansleep);
+extern void flow_stats_lat_sample(struct flow_entry *, uint32_t, uint64_t,
+    uint64_t);
 
 #if SK_LOG
 #define FLOWKEY_DBGBUF_SIZE   256
@@ -65,6 +65,8 @@
 #if (DEVELOPMENT || DEBUG)
 SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, chain_enqueue,
     CTLFLAG_RW | CTLFLAG_LOCKED, &fsw_chain_enqueue, 0, "");
+SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, qset_chain_enqueue,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &fsw_qset_chain_enqueue, 0, "");
 #endif /* !DEVELOPMENT && !DEBUG */
 
 /*
@@ -79,6 +81,7 @@ uint32_t fsw_use_dual_sized_pool = 0;
 #endif
 
 uint32_t fsw_chain_enqueue = 0;
+uint32_t fsw_qset_chain_enqueue = 1;
 static int __nx_fsw_inited = 0;
 static eventhandler_tag __nx_fsw_ifnet_eventhandler_tag = NULL;
 static eventhandler_tag __nx_fsw_protoctl_eventhandler_tag = NULL;
@@ -273,6 +276,21 @@ fsw_rps_threads_sysctl SYSCTL_HANDLER_ARGS
 	}
 	return error;
 }
+
+static int
+fsw_rps_load_sysctl SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg2)
+	struct nx_flowswitch *fsw = arg1;
+	struct fsw_rps_load load[FSW_RPS_MAX_NTHREADS];
+	uint32_t n = FSW_RPS_MAX_NTHREADS;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+	(void) fsw_rps_get_load(fsw, load, &n);
+	return SYSCTL_OUT(req, load, n * sizeof(load[0]));
+}
 #endif /* !DEVELOPMENT && !DEBUG */
 
 static int
@@ -421,6 +439,8 @@ fsw_setup_ifp(struct nx_flowswitch *fsw, struct nexus_adapter *hwna)
 	if (SKYWALK_NATIVE(fsw->fsw_ifp)) {
 		skoid_add_handler(&fsw->fsw_skoid, "rps_nthreads", CTLFLAG_RW,
 		    fsw_rps_threads_sysctl, fsw, 0);
+		skoid_add_handler(&fsw->fsw_skoid, "rps_load", CTLFLAG_RD,
+		    fsw_rps_load_sysctl, fsw, 0);
 	}
 #endif /* !DEVELOPMENT && !DEBUG */
 
@@ -146,12 +146,27 @@ SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, tx_batch,
     "flowswitch Tx batch size");
 #endif /* !DEVELOPMENT && !DEBUG */
 
+/* # of packets ahead whose flow table bucket is prefetched (RX) */
+static uint32_t fsw_rx_prefetch_depth = 4;
+SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, rx_prefetch_depth,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &fsw_rx_prefetch_depth, 0,
+    "flowswitch Rx flow lookup prefetch distance");
+
+/* collect per-flow Rx pipeline latency histograms (sk_stats_flow) */
+uint32_t fsw_flow_lat = 0;
+SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, flow_lat,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &fsw_flow_lat, 0,
+    "flowswitch per-flow Rx latency histograms (enable/disable)");
+
 SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, rx_agg_tcp,
     CTLFLAG_RW | CTLFLAG_LOCKED, &sk_fsw_rx_agg_tcp, 0,
     "flowswitch RX aggregation for tcp flows (enable/disable)");
 SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, rx_agg_tcp_host,
     CTLFLAG_RW | CTLFLAG_LOCKED, &sk_fsw_rx_agg_tcp_host, 0,
     "flowswitch RX aggregation for tcp kernel path (0/1/2 (off/on/auto))");
+SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, rx_agg_udp,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &sk_fsw_rx_agg_udp, 0,
+    "flowswitch RX aggregation for udp flows (enable/disable)");
 
 /*
  * IP reassembly
@@ -908,6 +923,7 @@ fsw_ring_enqueue_pktq(struct nx_flowswitch *fsw, struct __kern_channel_ring *r,
 	membar_sync();
 
 	r->ckr_ktail = idx_end;
+	kr_publish_ktail(r);
 
 	kr_exit(r);
 
@@ -1229,11 +1245,41 @@ fsw_host_rx(struct nx_flowswitch *fsw, struct pktq *pktq)
 	fsw_host_sendup(fsw->fsw_ifp, m_head, m_tail, cnt, bytes);
 }
 
+/*
+ * The pickup latency of a flow runs from its oldest unsampled enqueue to
+ * the first user Rx sync of the ring after it.  It is sampled at the next
+ * enqueue of the flow, so a flow sharing its ring with busier ones may see
+ * a later sync than the one that picked up its packets.
+ */
 void
-fsw_ring_enqueue_tail_drop(struct nx_flowswitch *fsw,
+fsw_ring_enqueue_tail_drop(struct nx_flowswitch *fsw, struct flow_entry *fe,
     struct __kern_channel_ring *r, struct pktq *pktq)
 {
+	uint64_t ts = 0;
+
+	if (__improbable(fe->fe_rx_lat_ts != 0)) {
+		ts = mach_absolute_time();
+		flow_stats_lat_sample(fe, SFLOW_LAT_RX_PROCESS,
+		    fe->fe_rx_lat_ts, ts);
+		if (fe->fe_rx_lat_enq != 0 &&
+		    r->ckr_rx_pickup_time >= fe->fe_rx_lat_enq) {
+			flow_stats_lat_sample(fe, SFLOW_LAT_RX_PICKUP,
+			    fe->fe_rx_lat_enq, r->ckr_rx_pickup_time);
+			fe->fe_rx_lat_enq = 0;
+		}
+	}
+
 	fsw_ring_enqueue_pktq(fsw, r, pktq);
+
+	if (__improbable(ts != 0)) {
+		uint64_t now = mach_absolute_time();
+
+		flow_stats_lat_sample(fe, SFLOW_LAT_RX_ENQUEUE, ts, now);
+		if (fe->fe_rx_lat_enq == 0) {
+			fe->fe_rx_lat_enq = now;
+		}
+		r->ckr_rx_pickup_wait = 1;
+	}
 	FSW_STATS_ADD(FSW_STATS_RX_DST_RING_FULL, KPKTQ_LEN(pktq));
 	dp_drop_pktq(fsw, pktq);
 }
@@ -1398,6 +1444,38 @@ dp_flow_rx_route_process(struct nx_flowswitch *fsw, struct flow_entry *fe)
 	return okay;
 }
 
+#if (DEVELOPMENT || DEBUG)
+static inline uint32_t
+fsw_rps_hash(struct flow_key *key)
+{
+	key->fk_mask = FKMASK_5TUPLE;
+	return flow_key_hash(key) & (FSW_RPS_FLOWS - 1);
+}
+
+/*
+ * Point fe's RPS steering entry at the thread matching the CPU its
+ * consumer last synced its rx ring on.
+ */
+static void
+fsw_rps_steer(struct nx_flowswitch *fsw, struct flow_entry *fe,
+    struct __kern_channel_ring *r)
+{
+	uint32_t n = fsw->fsw_rps_nthreads;
+	struct flow_key key;
+	uint32_t cpu;
+
+	if (n == 0 || fsw->fsw_rps_flows == NULL ||
+	    KRNA(r)->na_type != NA_FLOWSWITCH_VP ||
+	    (cpu = VPNA(KRNA(r))->vpna_rx_cpu) == 0) {
+		return;
+	}
+
+	key = fe->fe_key;
+	fsw->fsw_rps_flows[fsw_rps_hash(&key)].rf_want =
+	    (uint16_t)((cpu - 1) % n + 1);
+}
+#endif /* !DEVELOPMENT && !DEBUG */
+
 void
 dp_flow_rx_process(struct nx_flowswitch *fsw, struct flow_entry *fe)
 {
@@ -1442,6 +1520,9 @@ dp_flow_rx_process(struct nx_flowswitch *fsw, struct flow_entry *fe)
 		fsw_snoop_and_dequeue(fe, &dropped_pkts, true);
 		goto done;
 	}
+#if (DEVELOPMENT || DEBUG)
+	fsw_rps_steer(fsw, fe, r);
+#endif /* !DEVELOPMENT && !DEBUG */
 
 	/* snoop before L2 is stripped */
 	if (__improbable(pktap_total_tap_count != 0)) {
@@ -1592,7 +1673,7 @@ dp_flow_rx_process(struct nx_flowswitch *fsw, struct flow_entry *fe)
 	KPKTQ_CONCAT(&fe->fe_rx_pktq, &transferred_pkts);
 	KPKTQ_FINI(&transferred_pkts);
 
-	fsw_ring_enqueue_tail_drop(fsw, r, &fe->fe_rx_pktq);
+	fsw_ring_enqueue_tail_drop(fsw, fe, r, &fe->fe_rx_pktq);
 
 done:
 	/* Free unused buflets */
@@ -1608,7 +1689,8 @@ done:
 }
 
 static inline void
-rx_flow_process(struct nx_flowswitch *fsw, struct flow_entry *fe)
+rx_flow_process(struct nx_flowswitch *fsw, struct flow_entry *fe,
+    uint64_t rx_ts)
 {
 	ASSERT(!KPKTQ_EMPTY(&fe->fe_rx_pktq));
 	ASSERT(KPKTQ_LEN(&fe->fe_rx_pktq) != 0);
@@ -1616,8 +1698,15 @@ rx_flow_process(struct nx_flowswitch *fsw, struct flow_entry *fe)
 	SK_DF(SK_VERB_FSW_DP | SK_VERB_RX, "Rx %d pkts for fe %p port %d",
 	    KPKTQ_LEN(&fe->fe_rx_pktq), fe, fe->fe_nx_port);
 
+	if (__improbable(rx_ts != 0)) {
+		fe->fe_rx_lat_ts = mach_absolute_time();
+		flow_stats_lat_sample(fe, SFLOW_LAT_RX_CLASSIFY, rx_ts,
+		    fe->fe_rx_lat_ts);
+	}
+
 	/* flow related processing (default, agg, fpd, etc.) */
 	fe->fe_rx_process(fsw, fe);
+	fe->fe_rx_lat_ts = 0;
 
 	if (__improbable(fe->fe_want_withdraw)) {
 		fsw_reap_sched(fsw);
@@ -1649,6 +1738,82 @@ dp_rx_process_wake_packet(struct nx_flowswitch *fsw, struct __kern_packet *pkt)
 	}
 }
 
+static void
+rx_lookup_batch_packet(struct nx_flowswitch *fsw, struct flow_entry_list *fes,
+    struct __kern_packet *pkt, struct pktq *host_pkts,
+    struct flow_entry **prev_fe)
+{
+	struct flow_entry *fe;
+
+#if DEVELOPMENT || DEBUG
+	trace_pkt_dump_payload(fsw->fsw_ifp, pkt, true);
+#endif /* DEVELOPMENT || DEBUG */
+
+	*prev_fe = fe = rx_lookup_flow(fsw, pkt, *prev_fe);
+	if (__improbable(fe == NULL)) {
+		KPKTQ_ENQUEUE_LIST(host_pkts, pkt);
+		return;
+	}
+
+	fe->fe_rx_pktq_bytes += pkt->pkt_flow_ulen;
+
+	dp_rx_process_wake_packet(fsw, pkt);
+
+	rx_flow_batch_packet(fes, fe, pkt);
+}
+
+static inline void
+rx_lookup_prefetch(struct nx_flowswitch *fsw, struct __kern_packet *pkt,
+    struct flow_entry *prev_fe)
+{
+	struct flow_key key __sk_aligned(16);
+
+	flow_pkt2key(pkt, true, &key);
+	/* the common case of a run of packets of one flow needs nothing */
+	if (prev_fe != NULL && prev_fe->fe_key.fk_mask == FKMASK_5TUPLE) {
+		uint16_t saved_mask = key.fk_mask;
+
+		key.fk_mask = FKMASK_5TUPLE;
+		if (flow_key_cmp_mask(&prev_fe->fe_key, &key,
+		    &fk_mask_5tuple) == 0) {
+			return;
+		}
+		key.fk_mask = saved_mask;
+	}
+	flow_mgr_prefetch_fe_by_key(fsw->fsw_flow_mgr, &key);
+}
+
+/*
+ * Look up the flows of classified packets, prefetching the flow table
+ * buckets of the packets fsw_rx_prefetch_depth ahead so that the cache
+ * misses of several lookups overlap.
+ */
+static void
+rx_lookup_pktq(struct nx_flowswitch *fsw, struct flow_entry_list *fes,
+    struct pktq *pktq, struct pktq *host_pkts, struct flow_entry **prev_fe)
+{
+	struct __kern_packet *pkt, *ahead;
+	uint32_t i;
+
+	ahead = KPKTQ_FIRST(pktq);
+	for (i = 0; i < fsw_rx_prefetch_depth && ahead != NULL; i++) {
+		rx_lookup_prefetch(fsw, ahead, *prev_fe);
+		ahead = ahead->pkt_nextpkt;
+	}
+
+	for (;;) {
+		KPKTQ_DEQUEUE(pktq, pkt);
+		if (pkt == NULL) {
+			break;
+		}
+		if (ahead != NULL) {
+			rx_lookup_prefetch(fsw, ahead, *prev_fe);
+			ahead = ahead->pkt_nextpkt;
+		}
+		rx_lookup_batch_packet(fsw, fes, pkt, host_pkts, prev_fe);
+	}
+}
+
 static void
 _fsw_receive_locked(struct nx_flowswitch *fsw, struct pktq *pktq)
 {
@@ -1656,11 +1821,14 @@ _fsw_receive_locked(struct nx_flowswitch *fsw, struct pktq *pktq)
 	struct flow_entry_list fes = TAILQ_HEAD_INITIALIZER(fes);
 	struct flow_entry *fe, *prev_fe;
 	sa_family_t af;
-	struct pktq host_pkts, dropped_pkts;
+	struct pktq host_pkts, dropped_pkts, lookup_pkts;
+	uint64_t rx_ts;
 	int err;
 
 	KPKTQ_INIT(&host_pkts);
 	KPKTQ_INIT(&dropped_pkts);
+	KPKTQ_INIT(&lookup_pkts);
+	rx_ts = (__improbable(fsw_flow_lat != 0)) ? mach_absolute_time() : 0;
 
 	if (__improbable(FSW_QUIESCED(fsw))) {
 		DTRACE_SKYWALK1(rx__quiesced, struct nx_flowswitch *, fsw);
@@ -1706,29 +1874,21 @@ _fsw_receive_locked(struct nx_flowswitch *fsw, struct pktq *pktq)
 			if (pkt == NULL) {
 				continue;
 			}
-		}
-
-#if DEVELOPMENT || DEBUG
-		trace_pkt_dump_payload(fsw->fsw_ifp, pkt, true);
-#endif /* DEVELOPMENT || DEBUG */
-
-		prev_fe = fe = rx_lookup_flow(fsw, pkt, prev_fe);
-		if (__improbable(fe == NULL)) {
-			KPKTQ_ENQUEUE_LIST(&host_pkts, pkt);
+			/* keep the reassembled chain in order within its flow */
+			rx_lookup_pktq(fsw, &fes, &lookup_pkts, &host_pkts,
+			    &prev_fe);
+			rx_lookup_batch_packet(fsw, &fes, pkt, &host_pkts,
+			    &prev_fe);
 			continue;
 		}
 
-		fe->fe_rx_pktq_bytes += pkt->pkt_flow_ulen;
-
-		dp_rx_process_wake_packet(fsw, pkt);
-
-		rx_flow_batch_packet(&fes, fe, pkt);
-		prev_fe = fe;
+		KPKTQ_ENQUEUE(&lookup_pkts, pkt);
 	}
+	rx_lookup_pktq(fsw, &fes, &lookup_pkts, &host_pkts, &prev_fe);
 
 	struct flow_entry *tfe = NULL;
 	TAILQ_FOREACH_SAFE(fe, &fes, fe_rx_link, tfe) {
-		rx_flow_process(fsw, fe);
+		rx_flow_process(fsw, fe, rx_ts);
 		TAILQ_REMOVE(&fes, fe, fe_rx_link);
 		fe->fe_rx_pktq_bytes = 0;
 		fe->fe_rx_frag_count = 0;
@@ -1744,15 +1904,20 @@ done:
 }
 
 #if (DEVELOPMENT || DEBUG)
-static void
+/* returns the sequence number of pkt on the thread */
+static uint64_t
 fsw_rps_rx(struct nx_flowswitch *fsw, uint32_t id,
     struct __kern_packet *pkt)
 {
 	struct fsw_rps_thread *frt = &fsw->fsw_rps_threads[id];
+	uint64_t seq;
 
 	lck_mtx_lock_spin(&frt->frt_lock);
 	KPKTQ_ENQUEUE(&frt->frt_pktq, pkt);
+	seq = ++frt->frt_enq_seq;
 	lck_mtx_unlock(&frt->frt_lock);
+
+	return seq;
 }
 
 static void
@@ -1790,6 +1955,7 @@ fsw_rps_thread_cont(void *v, wait_result_t w)
 
 	for (;;) {
 		uint32_t requests = frt->frt_requests;
+		uint64_t seq = frt->frt_enq_seq;
 		struct pktq pkts;
 
 		KPKTQ_INIT(&pkts);
@@ -1804,6 +1970,7 @@ fsw_rps_thread_cont(void *v, wait_result_t w)
 		sk_sync_unprotect(protect);
 
 		lck_mtx_lock(&frt->frt_lock);
+		os_atomic_store(&frt->frt_done_seq, seq, release);
 		if ((frt->frt_flags & FRT_TERMINATING) != 0 ||
 		    requests == frt->frt_requests) {
 			frt->frt_requests = 0;
@@ -1938,14 +2105,56 @@ fsw_rps_set_nthreads(struct nx_flowswitch* fsw, uint32_t n)
 			fsw_rps_thread_spawn(fsw, i);
 		}
 	}
+	if (n != 0 && fsw->fsw_rps_flows == NULL) {
+		fsw->fsw_rps_flows = kalloc_type(struct fsw_rps_flow,
+		    FSW_RPS_FLOWS, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	} else if (n == 0 && fsw->fsw_rps_flows != NULL) {
+		kfree_type(struct fsw_rps_flow, FSW_RPS_FLOWS,
+		    fsw->fsw_rps_flows);
+		fsw->fsw_rps_flows = NULL;
+	} else if (fsw->fsw_rps_flows != NULL) {
+		/* the threads flows were on may be gone */
+		bzero(fsw->fsw_rps_flows,
+		    FSW_RPS_FLOWS * sizeof(struct fsw_rps_flow));
+	}
 	fsw->fsw_rps_nthreads = n;
 	FSW_WUNLOCK(fsw);
 	return 0;
 }
 
+int
+fsw_rps_get_load(struct nx_flowswitch *fsw, struct fsw_rps_load *load,
+    uint32_t *n)
+{
+	FSW_RLOCK(fsw);
+	*n = MIN(*n, fsw->fsw_rps_nthreads);
+	for (uint32_t i = 0; i < *n; i++) {
+		struct fsw_rps_thread *frt = &fsw->fsw_rps_threads[i];
+
+		lck_mtx_lock_spin(&frt->frt_lock);
+		load[i].frl_enqueued = frt->frt_enq_seq;
+		load[i].frl_processed = frt->frt_done_seq;
+		load[i].frl_flows_in = frt->frt_flows_in;
+		lck_mtx_unlock(&frt->frt_lock);
+	}
+	FSW_RUNLOCK(fsw);
+	return 0;
+}
+
+/*
+ * Pick the RPS thread for pkt: the one its flow is steered to, once the
+ * thread it was on has caught up with it, else the flow hash's.
+ */
 static uint32_t
-get_rps_id(struct nx_flowswitch *fsw, struct __kern_packet *pkt)
+get_rps_id(struct nx_flowswitch *fsw, struct __kern_packet *pkt,
+    struct fsw_rps_flow **rfp)
 {
+	uint32_t n = fsw->fsw_rps_nthreads;
+	struct fsw_rps_flow *rf;
+	uint32_t want, cur;
+
+	*rfp = NULL;
+
 	sa_family_t af = fsw->fsw_demux(fsw, pkt);
 	if (__improbable(af == AF_UNSPEC)) {
 		return 0;
@@ -1962,9 +2171,31 @@ get_rps_id(struct nx_flowswitch *fsw, struct __kern_packet *pkt)
 	flow_pkt2key(pkt, true, &key);
 	key.fk_mask = FKMASK_5TUPLE;
 
-	uint32_t id = flow_key_hash(&key) % fsw->fsw_rps_nthreads;
+	uint32_t hash = flow_key_hash(&key);
+	uint32_t id = hash % n;
 
-	return id;
+	if (__improbable(fsw->fsw_rps_flows == NULL)) {
+		return id;
+	}
+	rf = &fsw->fsw_rps_flows[hash & (FSW_RPS_FLOWS - 1)];
+	want = (rf->rf_want != 0 && rf->rf_want <= n) ? rf->rf_want - 1 : id;
+	if (rf->rf_cur == 0 || rf->rf_cur > n) {
+		cur = want;
+	} else {
+		cur = rf->rf_cur - 1;
+		/* don't let the flow overtake what it left behind on cur */
+		if (cur != want &&
+		    os_atomic_load(&fsw->fsw_rps_threads[cur].frt_done_seq,
+		    acquire) >= rf->rf_last_seq) {
+			cur = want;
+			os_atomic_inc(&fsw->fsw_rps_threads[cur].frt_flows_in,
+			    relaxed);
+		}
+	}
+	rf->rf_cur = (uint16_t)(cur + 1);
+	*rfp = rf;
+
+	return cur;
 }
 
 #endif /* !DEVELOPMENT && !DEBUG */
@@ -1980,9 +2211,15 @@ fsw_receive(struct nx_flowswitch *fsw, struct pktq *pktq)
 
 		_CASSERT(BITMAP_LEN(FSW_RPS_MAX_NTHREADS) == 1);
 		KPKTQ_FOREACH_SAFE(pkt, pktq, tpkt) {
-			uint32_t id = get_rps_id(fsw, pkt);
+			struct fsw_rps_flow *rf;
+			uint32_t id = get_rps_id(fsw, pkt, &rf);
+			uint64_t seq;
+
 			KPKTQ_REMOVE(pktq, pkt);
-			fsw_rps_rx(fsw, id, pkt);
+			seq = fsw_rps_rx(fsw, id, pkt);
+			if (rf != NULL) {
+				rf->rf_last_seq = seq;
+			}
 			bitmap_set(&map, id);
 		}
 		for (int i = bitmap_first(&map, 64); i >= 0;
@@ -2601,10 +2838,6 @@ classq_qset_enqueue_flow(struct nx_flowswitch *fsw, struct flow_entry *fe,
 	SK_DF(SK_VERB_FSW_DP | SK_VERB_AQM, "%s classq enqueued %d pkts",
 	    if_name(fsw->fsw_ifp), KPKTQ_LEN(&fe->fe_tx_pktq));
 
-	/*
-	 * Not supporting chains for now
-	 */
-	VERIFY(!chain);
 	pkt = KPKTQ_FIRST(&fe->fe_tx_pktq);
 	tail = KPKTQ_LAST(&fe->fe_tx_pktq);
 	KPKTQ_INIT(&fe->fe_tx_pktq);
@@ -2615,7 +2848,7 @@ classq_qset_enqueue_flow(struct nx_flowswitch *fsw, struct flow_entry *fe,
 	flowadv_cap = ((pkt->pkt_pflags & PKT_F_FLOW_ADV) != 0);
 	flow_adv_token = pkt->pkt_flow_token;
 
-	err = netif_qset_enqueue(fe->fe_qset, pkt, tail, cnt, bytes,
+	err = netif_qset_enqueue(fe->fe_qset, chain, pkt, tail, cnt, bytes,
 	    &flowctl, &dropped);
 
 	if (__improbable(err != 0)) {
@@ -2795,11 +3028,18 @@ fsw_update_timestamps(struct __kern_packet *pkt, volatile uint64_t *fg_ts,
 static bool
 fsw_chain_enqueue_enabled(struct nx_flowswitch *fsw, struct flow_entry *fe)
 {
-#pragma unused(fe)
-	return fsw_chain_enqueue != 0 &&
-	       fsw->fsw_ifp->if_output_netem == NULL &&
-	       (fsw->fsw_ifp->if_eflags & IFEF_ENQUEUE_MULTI) == 0 &&
-	       fe->fe_qset == NULL;
+	if (fsw->fsw_ifp->if_output_netem != NULL ||
+	    (fsw->fsw_ifp->if_eflags & IFEF_ENQUEUE_MULTI) != 0) {
+		return false;
+	}
+	/*
+	 * Logical link queue sets are only fed by the native path, so the
+	 * whole flow batch can go to the qset's classq in one go.
+	 */
+	if (fe->fe_qset != NULL) {
+		return fsw_qset_chain_enqueue != 0;
+	}
+	return fsw_chain_enqueue != 0;
 }
 
 void
@@ -3326,6 +3566,11 @@ fsw_dp_dtor(struct nx_flowswitch *fsw)
 		}
 		kfree_type(struct fsw_rps_thread, fsw->fsw_rps_threads);
 	}
+	if (fsw->fsw_rps_flows != NULL) {
+		kfree_type(struct fsw_rps_flow, FSW_RPS_FLOWS,
+		    fsw->fsw_rps_flows);
+		fsw->fsw_rps_flows = NULL;
+	}
 #endif /* !DEVELOPMENT && !DEBUG */
 
 	nx_advisory_free(fsw->fsw_nx);
@@ -3618,10 +3863,11 @@ fsw_reap_thread_cont(void *v, wait_result_t wres)
 		/* emit periodic interface stats ktrace */
 		last = fsw->fsw_reap_last;
 		if (last != 0 && (now - last) >= FSW_IFSTATS_THRES) {
-			KDBG(SK_KTRACE_AON_IF_STATS, ifp->if_data.ifi_ipackets,
-			    ifp->if_data.ifi_ibytes * 8,
-			    ifp->if_data.ifi_opackets,
-			    ifp->if_data.ifi_obytes * 8);
+			KDBG(SK_KTRACE_AON_IF_STATS,
+			    IFNET_STAT_LOAD(ifp, ifi_ipackets),
+			    IFNET_STAT_LOAD(ifp, ifi_ibytes) * 8,
+			    IFNET_STAT_LOAD(ifp, ifi_opackets),
+			    IFNET_STAT_LOAD(ifp, ifi_obytes) * 8);
 
 			fsw->fsw_reap_last = now;
 		} else if (__improbable(last == 0)) {
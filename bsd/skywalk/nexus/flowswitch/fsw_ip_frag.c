@@ -67,6 +67,7 @@
  */
 
 #include <sys/domain.h>
+#include <libkern/os/hash.h>
 #include <netinet/in.h>
 #include <netinet/ip6.h>
 #include <netinet/icmp6.h>
@@ -78,6 +79,12 @@
 #define IPFM_MAX_QUEUES                 1024    /* same as ip/ip6 */
 #define IPFM_FRAG_TTL                   60      /* RFC 2460 */
 #define IPFM_TIMEOUT_TCALL_INTERVAL     1
+#define IPFM_MEM_LIMIT                  (4 * 1024 * 1024) /* bytes */
+#define IPFM_MAX_SHARDS                 8
+#define IPFM_HASH_SIZE                  128     /* per shard, power of 2 */
+#define IPFM_REASS_SLOW_NSEC            (10 * NSEC_PER_MSEC)
+
+extern unsigned int ml_wait_max_cpus(void);
 
 static uint32_t ipfm_max_frags_per_queue = IPFM_MAX_FRAGS_PER_QUEUE;
 static uint32_t ipfm_frag_ttl = IPFM_FRAG_TTL;
@@ -95,6 +102,11 @@ SYSCTL_INT(_kern_skywalk_flowswitch, OID_AUTO,
     ipfm_timeout_tcall_ival, CTLFLAG_RW | CTLFLAG_LOCKED,
     &ipfm_timeout_tcall_ival, 0, "");
 
+/* default budget of fragment bytes held per flowswitch */
+static uint32_t ipfm_mem_limit = IPFM_MEM_LIMIT;
+SYSCTL_UINT(_kern_skywalk_flowswitch, OID_AUTO, ipfm_mem_limit,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &ipfm_mem_limit, 0, "");
+
 static LCK_GRP_DECLARE(fsw_ipfm_lock_group, "sk_fsw_ipfm_lock");
 static LCK_ATTR_DECLARE(fsw_ipfm_lock_attr, 0, 0);
 
@@ -105,6 +117,7 @@ struct ipf {
 	struct __kern_packet *ipf_pkt;
 	int             ipf_len;        /* fragmentable part length */
 	int             ipf_off;        /* fragment offset */
+	uint32_t        ipf_bytes;      /* packet length, for ipfm_b_count */
 	uint16_t        ipf_mff;        /* more fragment bit in frag off */
 };
 
@@ -128,9 +141,11 @@ enum {
 struct ipfq {
 	struct ipf      *ipfq_down;     /* fragment chain */
 	struct ipf      *ipfq_up;
-	struct ipfq     *ipfq_next;     /* queue chain */
+	struct ipfq     *ipfq_next;     /* queue chain, most recent first */
 	struct ipfq     *ipfq_prev;
+	LIST_ENTRY(ipfq) ipfq_hlink;    /* hash chain */
 	uint64_t        ipfq_timestamp; /* time of creation */
+	uint64_t        ipfq_start;     /* mach_absolute_time() of creation */
 	struct ipf_key  ipfq_key;       /* ipfq search key */
 	uint16_t        ipfq_nfrag;     /* # of fragments in queue */
 	uint16_t        ipfq_unfraglen; /* len of unfragmentable part */
@@ -138,16 +153,20 @@ struct ipfq {
 };
 
 /*
- * @internal (externally opaque)
- * flowswitch IP Fragment Manager
+ * @internal
+ * One shard of a flowswitch IP Fragment Manager.  Reassembly queues are
+ * found through a hash table, and kept on a list in order of last use so
+ * that reaping and the memory budget evict the least recently active.
  */
-struct fsw_ip_frag_mgr {
-	struct skoid    ipfm_skoid;
+struct ipfm {
 	struct ipfq     ipfm_q;         /* ip reassembly queues */
+	LIST_HEAD(, ipfq) ipfm_hash[IPFM_HASH_SIZE]; /* queues by key */
 	uint32_t        ipfm_q_limit;   /* limit # of reass queues */
 	uint32_t        ipfm_q_count;   /* # of allocated reass queues */
 	uint32_t        ipfm_f_limit;   /* limit # of ipfs */
 	uint32_t        ipfm_f_count;   /* current # of allocated ipfs */
+	uint32_t        ipfm_b_limit;   /* limit # of bytes held */
+	uint32_t        ipfm_b_count;   /* current # of bytes held */
 	decl_lck_mtx_data(, ipfm_lock); /* guard reass and timeout cleanup */
 	thread_call_t   ipfm_timeout_tcall;     /* frag timeout thread */
 
@@ -155,51 +174,62 @@ struct fsw_ip_frag_mgr {
 	struct fsw_stats *ipfm_stats;   /* indirect stats in fsw */
 };
 
-static int ipf_process(struct fsw_ip_frag_mgr *, struct __kern_packet **,
-    struct ipf_key *, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t *,
-    uint16_t *);
+#define IPFM_HASH_IDX(_h)       (((_h) >> 16) & (IPFM_HASH_SIZE - 1))
+
+/*
+ * @internal (externally opaque)
+ * flowswitch IP Fragment Manager.  Fragments are spread over shards by a
+ * hash of their key, so that all fragments of a datagram meet in the same
+ * shard whichever thread receives them, while threads working on other
+ * datagrams mostly take other locks.
+ */
+struct fsw_ip_frag_mgr {
+	struct skoid    ipfm_skoid;
+	uint32_t        ipfm_nshards;   /* power of 2 */
+	struct ipfm     *ipfm_shards;
+	struct fsw_stats *ipfm_stats;   /* indirect stats in fsw */
+};
+
+static int ipf_process(struct ipfm *, struct __kern_packet **,
+    struct ipf_key *, uint32_t, uint16_t, uint16_t, uint16_t, uint16_t,
+    uint16_t *, uint16_t *);
 static int ipf_key_cmp(struct ipf_key *, struct ipf_key *);
 static void ipf_enq(struct ipf *, struct ipf *);
 static void ipf_deq(struct ipf *);
 static void ipfq_insque(struct ipfq *, struct ipfq *);
 static void ipfq_remque(struct ipfq *);
-static uint32_t ipfq_freef(struct fsw_ip_frag_mgr *mgr, struct ipfq *,
-    void (*)(struct fsw_ip_frag_mgr *, struct ipf *));
+static uint32_t ipfq_freef(struct ipfm *mgr, struct ipfq *,
+    void (*)(struct ipfm *, struct ipf *));
 
 static void ipfq_timeout(thread_call_param_t, thread_call_param_t);
-static void ipfq_sched_timeout(struct fsw_ip_frag_mgr *, boolean_t);
-
-static struct ipfq *ipfq_alloc(struct fsw_ip_frag_mgr *mgr, int how);
-static void ipfq_free(struct fsw_ip_frag_mgr *mgr, struct ipfq *q);
-static uint32_t ipfq_freefq(struct fsw_ip_frag_mgr *mgr, struct ipfq *q,
-    void (*ipf_cb)(struct fsw_ip_frag_mgr *, struct ipf *));
-static struct ipf *ipf_alloc(struct fsw_ip_frag_mgr *mgr);
-static void ipf_free(struct fsw_ip_frag_mgr *mgr, struct ipf *f);
+static void ipfq_sched_timeout(struct ipfm *, boolean_t);
+
+static struct ipfq *ipfq_alloc(struct ipfm *mgr, int how);
+static void ipfq_free(struct ipfm *mgr, struct ipfq *q);
+static uint32_t ipfq_freefq(struct ipfm *mgr, struct ipfq *q,
+    void (*ipf_cb)(struct ipfm *, struct ipf *));
+static struct ipf *ipf_alloc(struct ipfm *mgr, struct __kern_packet *);
+static void ipf_free(struct ipfm *mgr, struct ipf *f);
 static void ipf_free_pkt(struct ipf *f);
-static void ipfq_drain(struct fsw_ip_frag_mgr *mgr);
-static void ipfq_reap(struct fsw_ip_frag_mgr *mgr);
+static void ipfq_drain(struct ipfm *mgr);
+static void ipfq_reap(struct ipfm *mgr);
+static void ipfq_trim(struct ipfm *mgr, struct ipfq *, uint32_t);
 static int ipfq_drain_sysctl SYSCTL_HANDLER_ARGS;
-void ipf_icmp_param_err(struct fsw_ip_frag_mgr *, struct __kern_packet *pkt,
+static int ipfm_limit_sysctl SYSCTL_HANDLER_ARGS;
+void ipf_icmp_param_err(struct ipfm *, struct __kern_packet *pkt,
     int param);
-void ipf_icmp_timeout_err(struct fsw_ip_frag_mgr *, struct ipf *f);
+void ipf_icmp_timeout_err(struct ipfm *, struct ipf *f);
 
-/* Create a flowswitch IP fragment manager. */
-struct fsw_ip_frag_mgr *
-fsw_ip_frag_mgr_create(struct nx_flowswitch *fsw, struct ifnet *ifp,
-    size_t f_limit)
+static void
+ipfm_init(struct ipfm *mgr, struct nx_flowswitch *fsw, struct ifnet *ifp,
+    uint32_t f_limit, uint32_t b_limit)
 {
-	struct fsw_ip_frag_mgr *mgr;
-
-	/* ipf/ipfq uses mbufs for IP fragment queue structures */
-	_CASSERT(sizeof(struct ipfq) <= _MLEN);
-	_CASSERT(sizeof(struct ipf) <= _MLEN);
-
-	ASSERT(ifp != NULL);
-
-	mgr = sk_alloc_type(struct fsw_ip_frag_mgr, Z_WAITOK | Z_NOFAIL,
-	    skmem_tag_fsw_frag_mgr);
+	uint32_t i;
 
 	mgr->ipfm_q.ipfq_next = mgr->ipfm_q.ipfq_prev = &mgr->ipfm_q;
+	for (i = 0; i < IPFM_HASH_SIZE; i++) {
+		LIST_INIT(&mgr->ipfm_hash[i]);
+	}
 	lck_mtx_init(&mgr->ipfm_lock, &fsw_ipfm_lock_group, &fsw_ipfm_lock_attr);
 
 	mgr->ipfm_timeout_tcall =
@@ -210,31 +240,17 @@ fsw_ip_frag_mgr_create(struct nx_flowswitch *fsw, struct ifnet *ifp,
 	mgr->ipfm_ifp = ifp;
 	mgr->ipfm_stats = &fsw->fsw_stats;
 
-	/* Use caller provided limit (caller knows pool size) */
-	ASSERT(f_limit >= 2 && f_limit < UINT32_MAX);
-	mgr->ipfm_f_limit = (uint32_t)f_limit;
+	ASSERT(f_limit >= 2);
+	mgr->ipfm_f_limit = f_limit;
 	mgr->ipfm_f_count = 0;
 	mgr->ipfm_q_limit = MIN(IPFM_MAX_QUEUES, mgr->ipfm_f_limit / 2);
 	mgr->ipfm_q_count = 0;
-
-	skoid_create(&mgr->ipfm_skoid, SKOID_DNODE(fsw->fsw_skoid), "ipfm", 0);
-	skoid_add_uint(&mgr->ipfm_skoid, "frag_limit", CTLFLAG_RW,
-	    &mgr->ipfm_f_limit);
-	skoid_add_uint(&mgr->ipfm_skoid, "frag_count", CTLFLAG_RD,
-	    &mgr->ipfm_f_count);
-	skoid_add_uint(&mgr->ipfm_skoid, "queue_limit", CTLFLAG_RW,
-	    &mgr->ipfm_q_limit);
-	skoid_add_uint(&mgr->ipfm_skoid, "queue_count", CTLFLAG_RD,
-	    &mgr->ipfm_q_count);
-	skoid_add_handler(&mgr->ipfm_skoid, "drain", CTLFLAG_RW,
-	    ipfq_drain_sysctl, mgr, 0);
-
-	return mgr;
+	mgr->ipfm_b_limit = b_limit;
+	mgr->ipfm_b_count = 0;
 }
 
-/* Free a flowswitch IP fragment manager. */
-void
-fsw_ip_frag_mgr_destroy(struct fsw_ip_frag_mgr *mgr)
+static void
+ipfm_fini(struct ipfm *mgr)
 {
 	thread_call_t tcall;
 
@@ -251,8 +267,84 @@ fsw_ip_frag_mgr_destroy(struct fsw_ip_frag_mgr *mgr)
 
 	lck_mtx_unlock(&mgr->ipfm_lock);
 	lck_mtx_destroy(&mgr->ipfm_lock, &fsw_ipfm_lock_group);
+}
+
+static inline struct ipfm *
+ipfm_shard(struct fsw_ip_frag_mgr *mgr, struct ipf_key *key, uint32_t *hash)
+{
+	uint32_t h;
+
+	h = os_hash_jenkins_update(key->ipfk_addr, key->ipfk_len,
+	    key->ipfk_ident);
+	*hash = h = os_hash_jenkins_finish(h);
+	return &mgr->ipfm_shards[h & (mgr->ipfm_nshards - 1)];
+}
+
+/* Create a flowswitch IP fragment manager. */
+struct fsw_ip_frag_mgr *
+fsw_ip_frag_mgr_create(struct nx_flowswitch *fsw, struct ifnet *ifp,
+    size_t f_limit)
+{
+	struct fsw_ip_frag_mgr *mgr;
+	uint32_t i, n;
+
+	/* ipf/ipfq uses mbufs for IP fragment queue structures */
+	_CASSERT(sizeof(struct ipfq) <= _MLEN);
+	_CASSERT(sizeof(struct ipf) <= _MLEN);
+
+	ASSERT(ifp != NULL);
+
+	/* Use caller provided limit (caller knows pool size) */
+	ASSERT(f_limit >= 2 && f_limit < UINT32_MAX);
+
+	/* no more shards than CPUs could be reassembling at once */
+	n = MIN((uint32_t)ml_wait_max_cpus(), IPFM_MAX_SHARDS);
+	n = 1U << (31 - __builtin_clz(n));
+	while (n > 1 && f_limit / n < 2) {
+		n >>= 1;
+	}
+
+	mgr = sk_alloc_type(struct fsw_ip_frag_mgr, Z_WAITOK | Z_NOFAIL,
+	    skmem_tag_fsw_frag_mgr);
+	mgr->ipfm_nshards = n;
+	mgr->ipfm_shards = sk_alloc_type_array(struct ipfm, n,
+	    Z_WAITOK | Z_NOFAIL, skmem_tag_fsw_frag_mgr);
+	mgr->ipfm_stats = &fsw->fsw_stats;
+	for (i = 0; i < n; i++) {
+		ipfm_init(&mgr->ipfm_shards[i], fsw, ifp,
+		    (uint32_t)f_limit / n, MAX(ipfm_mem_limit / n, IP_MAXPACKET));
+	}
+
+	skoid_create(&mgr->ipfm_skoid, SKOID_DNODE(fsw->fsw_skoid), "ipfm", 0);
+	skoid_add_handler(&mgr->ipfm_skoid, "frag_limit", CTLFLAG_RW,
+	    ipfm_limit_sysctl, mgr, offsetof(struct ipfm, ipfm_f_limit));
+	skoid_add_handler(&mgr->ipfm_skoid, "frag_count", CTLFLAG_RD,
+	    ipfm_limit_sysctl, mgr, offsetof(struct ipfm, ipfm_f_count));
+	skoid_add_handler(&mgr->ipfm_skoid, "queue_limit", CTLFLAG_RW,
+	    ipfm_limit_sysctl, mgr, offsetof(struct ipfm, ipfm_q_limit));
+	skoid_add_handler(&mgr->ipfm_skoid, "queue_count", CTLFLAG_RD,
+	    ipfm_limit_sysctl, mgr, offsetof(struct ipfm, ipfm_q_count));
+	skoid_add_handler(&mgr->ipfm_skoid, "mem_limit", CTLFLAG_RW,
+	    ipfm_limit_sysctl, mgr, offsetof(struct ipfm, ipfm_b_limit));
+	skoid_add_handler(&mgr->ipfm_skoid, "mem_count", CTLFLAG_RD,
+	    ipfm_limit_sysctl, mgr, offsetof(struct ipfm, ipfm_b_count));
+	skoid_add_handler(&mgr->ipfm_skoid, "drain", CTLFLAG_RW,
+	    ipfq_drain_sysctl, mgr, 0);
+
+	return mgr;
+}
+
+/* Free a flowswitch IP fragment manager. */
+void
+fsw_ip_frag_mgr_destroy(struct fsw_ip_frag_mgr *mgr)
+{
+	uint32_t i;
 
 	skoid_destroy(&mgr->ipfm_skoid);
+	for (i = 0; i < mgr->ipfm_nshards; i++) {
+		ipfm_fini(&mgr->ipfm_shards[i]);
+	}
+	sk_free_type_array(struct ipfm, mgr->ipfm_nshards, mgr->ipfm_shards);
 	sk_free_type(struct fsw_ip_frag_mgr, mgr);
 }
 
@@ -282,6 +374,8 @@ fsw_ip_frag_reass_v4(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt,
     struct ip *ip4, uint16_t *nfrags, uint16_t *tlen)
 {
 	struct ipf_key key;
+	struct ipfm *ipfm;
+	uint32_t hash;
 	uint16_t unfragpartlen, offflag, fragoff, fragpartlen, fragflag;
 	int err;
 
@@ -297,8 +391,9 @@ fsw_ip_frag_reass_v4(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt,
 	fragpartlen = ntohs(ip4->ip_len) - (uint16_t)(ip4->ip_hl << 2);
 	fragflag = offflag & IP_MF;
 
-	err = ipf_process(mgr, pkt, &key, unfragpartlen, fragoff, fragpartlen,
-	    fragflag, nfrags, tlen);
+	ipfm = ipfm_shard(mgr, &key, &hash);
+	err = ipf_process(ipfm, pkt, &key, hash, unfragpartlen, fragoff,
+	    fragpartlen, fragflag, nfrags, tlen);
 
 	/*
 	 * If packet has been reassembled compute the user data length.
@@ -342,6 +437,8 @@ fsw_ip_frag_reass_v6(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt,
     uint16_t *tlen)
 {
 	struct ipf_key key;
+	struct ipfm *ipfm;
+	uint32_t hash;
 	ptrdiff_t ip6f_ptroff = (uintptr_t)ip6f - (uintptr_t)ip6;
 	uint16_t ip6f_off, fragoff, fragpartlen, unfragpartlen, fragflag;
 	int err;
@@ -375,8 +472,9 @@ fsw_ip_frag_reass_v6(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt,
 	key.ipfk_len = IPFK_LEN_V6;
 	key.ipfk_ident = ip6f->ip6f_ident;
 
-	err = ipf_process(mgr, pkt, &key, unfragpartlen, fragoff, fragpartlen,
-	    fragflag, nfrags, tlen);
+	ipfm = ipfm_shard(mgr, &key, &hash);
+	err = ipf_process(ipfm, pkt, &key, hash, unfragpartlen, fragoff,
+	    fragpartlen, fragflag, nfrags, tlen);
 
 	/*
 	 * If packet has been reassembled compute the user data length.
@@ -392,7 +490,7 @@ fsw_ip_frag_reass_v6(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt,
 }
 
 static struct mbuf *
-ipf_pkt2mbuf(struct fsw_ip_frag_mgr *mgr, struct __kern_packet *pkt)
+ipf_pkt2mbuf(struct ipfm *mgr, struct __kern_packet *pkt)
 {
 	unsigned int one = 1;
 	struct mbuf *m = NULL;
@@ -439,7 +537,7 @@ ipf_pkt2mbuf(struct fsw_ip_frag_mgr *mgr, struct __kern_packet *pkt)
 }
 
 /*
- * Since this function can be called while holding fsw_ip_frag_mgr.ipfm_lock,
+ * Since this function can be called while holding ipfm.ipfm_lock,
  * we need to ensure we don't enter the driver directly because a deadlock
  * can happen if this same thread tries to get the workloop lock.
  */
@@ -458,7 +556,7 @@ ipf_icmp6_error_flag(struct mbuf *m, int type, int code, int param, int flags)
  *   offending parameter offset, only applicable to ICMPv6
  */
 void
-ipf_icmp_param_err(struct fsw_ip_frag_mgr *mgr, struct __kern_packet *pkt,
+ipf_icmp_param_err(struct ipfm *mgr, struct __kern_packet *pkt,
     int param_offset)
 {
 	if (pkt->pkt_flow_ip_ver != IPV6_VERSION) {
@@ -477,7 +575,7 @@ ipf_icmp_param_err(struct fsw_ip_frag_mgr *mgr, struct __kern_packet *pkt,
 
 /* @internal IP fragment ICMP timeout error handling */
 void
-ipf_icmp_timeout_err(struct fsw_ip_frag_mgr *mgr, struct ipf *f)
+ipf_icmp_timeout_err(struct ipfm *mgr, struct ipf *f)
 {
 	struct __kern_packet *pkt = f->ipf_pkt;
 	ASSERT(pkt != NULL);
@@ -504,8 +602,8 @@ ipf_icmp_timeout_err(struct fsw_ip_frag_mgr *mgr, struct ipf *f)
 
 /* @internal IP fragment processing, v4/v6 agonistic */
 int
-ipf_process(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt_ptr,
-    struct ipf_key *key, uint16_t unfraglen, uint16_t fragoff,
+ipf_process(struct ipfm *mgr, struct __kern_packet **pkt_ptr,
+    struct ipf_key *key, uint32_t hash, uint16_t unfraglen, uint16_t fragoff,
     uint16_t fragpartlen, uint16_t fragflag, uint16_t *nfrags, uint16_t *tlen)
 {
 	struct __kern_packet *pkt = *pkt_ptr;
@@ -513,6 +611,7 @@ ipf_process(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt_ptr,
 	struct ipfq *q, *mq = &mgr->ipfm_q;
 	struct ipf *f, *f_new, *f_down;
 	uint32_t nfrags_freed;
+	uint64_t elapsed;
 	int next;
 	int first_frag = 0;
 	int err = 0;
@@ -537,19 +636,24 @@ ipf_process(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt_ptr,
 	lck_mtx_lock(&mgr->ipfm_lock);
 
 	/* find ipfq */
-	for (q = mq->ipfq_next; q != mq; q = q->ipfq_next) {
+	LIST_FOREACH(q, &mgr->ipfm_hash[IPFM_HASH_IDX(hash)], ipfq_hlink) {
 		if (ipf_key_cmp(key, &q->ipfq_key) == 0) {
 			if (q->ipfq_is_dirty) {
 				SK_DF(SK_VERB_IP_FRAG, "found dirty q, skip");
 				err = EINVAL;
 				goto done;
 			}
+			/* most recently active goes to the front */
+			if (mq->ipfq_next != q) {
+				ipfq_remque(q);
+				ipfq_insque(q, mq);
+			}
 			break;
 		}
 	}
 
 	/* not found, create new ipfq */
-	if (q == mq) {
+	if (q == NULL) {
 		first_frag = 1;
 
 		q = ipfq_alloc(mgr, M_DONTWAIT);
@@ -561,6 +665,8 @@ ipf_process(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt_ptr,
 		}
 
 		ipfq_insque(q, mq);
+		LIST_INSERT_HEAD(&mgr->ipfm_hash[IPFM_HASH_IDX(hash)], q,
+		    ipfq_hlink);
 		net_update_uptime();
 
 		bcopy(key, &q->ipfq_key, sizeof(struct ipf_key));
@@ -568,6 +674,7 @@ ipf_process(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt_ptr,
 		q->ipfq_unfraglen = 0;
 		q->ipfq_nfrag = 0;
 		q->ipfq_timestamp = _net_uptime;
+		q->ipfq_start = mach_absolute_time();
 	}
 
 	ASSERT(!q->ipfq_is_dirty);
@@ -620,7 +727,18 @@ ipf_process(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt_ptr,
 		}
 	}
 
-	f_new = ipf_alloc(mgr);
+	/* make room within the memory budget at the expense of others */
+	if (mgr->ipfm_b_count + pkt->pkt_length > mgr->ipfm_b_limit) {
+		ipfq_trim(mgr, q, pkt->pkt_length);
+		if (mgr->ipfm_b_count + pkt->pkt_length > mgr->ipfm_b_limit) {
+			STATS_INC(mgr->ipfm_stats,
+			    FSW_STATS_RX_FRAG_DROP_MEM_LIMIT);
+			err = ENOMEM;
+			goto done;
+		}
+	}
+
+	f_new = ipf_alloc(mgr, pkt);
 	if (f_new == NULL) {
 		STATS_INC(mgr->ipfm_stats, FSW_STATS_RX_FRAG_DROP_NOMEM);
 		err = ENOMEM;
@@ -630,7 +748,6 @@ ipf_process(struct fsw_ip_frag_mgr *mgr, struct __kern_packet **pkt_ptr,
 	f_new->ipf_mff = fragflag;
 	f_new->ipf_off = fragoff;
 	f_new->ipf_len = fragpartlen;
-	f_new->ipf_pkt = pkt;
 
 	if (first_frag) {
 		f = (struct ipf *)q;
@@ -731,6 +848,13 @@ insert:
 
 	err = 0;
 	STATS_INC(mgr->ipfm_stats, FSW_STATS_RX_FRAG_REASSED);
+	absolutetime_to_nanoseconds(mach_absolute_time() - q->ipfq_start,
+	    &elapsed);
+	STATS_ADD(mgr->ipfm_stats, FSW_STATS_RX_FRAG_REASS_USEC,
+	    elapsed / NSEC_PER_USEC);
+	if (elapsed > IPFM_REASS_SLOW_NSEC) {
+		STATS_INC(mgr->ipfm_stats, FSW_STATS_RX_FRAG_REASS_SLOW);
+	}
 	ipfq_remque(q);
 	ipfq_free(mgr, q);
 
@@ -804,8 +928,8 @@ ipfq_remque(struct ipfq *p6)
  * @internal drain reassembly queue till reaching target q count.
  */
 static void
-_ipfq_reap(struct fsw_ip_frag_mgr *mgr, uint32_t target_q_count,
-    void (*ipf_cb)(struct fsw_ip_frag_mgr *, struct ipf *))
+_ipfq_reap(struct ipfm *mgr, uint32_t target_q_count,
+    void (*ipf_cb)(struct ipfm *, struct ipf *))
 {
 	uint32_t n_freed = 0;
 
@@ -828,16 +952,39 @@ _ipfq_reap(struct fsw_ip_frag_mgr *mgr, uint32_t target_q_count,
  * @internal reap half reassembly queues to allow newer fragment assembly.
  */
 static void
-ipfq_reap(struct fsw_ip_frag_mgr *mgr)
+ipfq_reap(struct ipfm *mgr)
 {
 	_ipfq_reap(mgr, mgr->ipfm_q_count / 2, ipf_icmp_timeout_err);
 }
 
+/*
+ * @internal evict the least recently active reassembly queues other than
+ * keep, until len more bytes fit in the memory budget.
+ */
+static void
+ipfq_trim(struct ipfm *mgr, struct ipfq *keep, uint32_t len)
+{
+	struct ipfq *q, *q_prev;
+	uint32_t n_freed = 0;
+
+	LCK_MTX_ASSERT(&mgr->ipfm_lock, LCK_MTX_ASSERT_OWNED);
+
+	for (q = mgr->ipfm_q.ipfq_prev; q != &mgr->ipfm_q &&
+	    mgr->ipfm_b_count + len > mgr->ipfm_b_limit; q = q_prev) {
+		q_prev = q->ipfq_prev;
+		if (q != keep) {
+			n_freed += ipfq_freefq(mgr, q, NULL);
+		}
+	}
+
+	STATS_ADD(mgr->ipfm_stats, FSW_STATS_RX_FRAG_DROP_MEM_LIMIT, n_freed);
+}
+
 /*
  * @internal reap all reassembly queues, for shutdown etc.
  */
 static void
-ipfq_drain(struct fsw_ip_frag_mgr *mgr)
+ipfq_drain(struct ipfm *mgr)
 {
 	_ipfq_reap(mgr, 0, NULL);
 }
@@ -846,10 +993,10 @@ static void
 ipfq_timeout(thread_call_param_t arg0, thread_call_param_t arg1)
 {
 #pragma unused(arg1)
-	struct fsw_ip_frag_mgr *mgr = arg0;
+	struct ipfm *mgr = arg0;
 	struct ipfq *q;
 	uint64_t now, elapsed;
-	uint32_t n_freed = 0;
+	uint32_t n_freed = 0, n_qfreed = 0;
 
 	net_update_uptime();
 	now = _net_uptime;
@@ -864,13 +1011,15 @@ ipfq_timeout(thread_call_param_t arg0, thread_call_param_t arg1)
 			if (elapsed > ipfm_frag_ttl) {
 				SK_DF(SK_VERB_IP_FRAG, "timing out q id %5d",
 				    q->ipfq_prev->ipfq_key.ipfk_ident);
-				n_freed = ipfq_freefq(mgr, q->ipfq_prev,
-				    q->ipfq_is_dirty ? NULL :
+				n_freed += ipfq_freefq(mgr, q->ipfq_prev,
+				    q->ipfq_prev->ipfq_is_dirty ? NULL :
 				    ipf_icmp_timeout_err);
+				n_qfreed++;
 			}
 		}
 	}
 	STATS_ADD(mgr->ipfm_stats, FSW_STATS_RX_FRAG_DROP_TIMEOUT, n_freed);
+	STATS_ADD(mgr->ipfm_stats, FSW_STATS_RX_FRAG_QUEUE_TIMEOUT, n_qfreed);
 
 	/* If running out of resources, drain ipfm queues (oldest one first) */
 	if (mgr->ipfm_f_count >= mgr->ipfm_f_limit ||
@@ -886,7 +1035,7 @@ ipfq_timeout(thread_call_param_t arg0, thread_call_param_t arg1)
 }
 
 static void
-ipfq_sched_timeout(struct fsw_ip_frag_mgr *mgr, boolean_t in_tcall)
+ipfq_sched_timeout(struct ipfm *mgr, boolean_t in_tcall)
 {
 	uint32_t delay = MAX(1, ipfm_timeout_tcall_ival);       /* seconds */
 	thread_call_t tcall = mgr->ipfm_timeout_tcall;
@@ -909,18 +1058,56 @@ ipfq_drain_sysctl SYSCTL_HANDLER_ARGS
 {
 #pragma unused(oidp, arg2)
 	struct fsw_ip_frag_mgr *mgr = arg1;
+	struct ipfm *ipfm;
+	uint32_t i;
 
 	SKOID_PROC_CALL_GUARD;
 
-	lck_mtx_lock(&mgr->ipfm_lock);
-	ipfq_drain(mgr);
-	lck_mtx_unlock(&mgr->ipfm_lock);
+	for (i = 0; i < mgr->ipfm_nshards; i++) {
+		ipfm = &mgr->ipfm_shards[i];
+		lck_mtx_lock(&ipfm->ipfm_lock);
+		ipfq_drain(ipfm);
+		lck_mtx_unlock(&ipfm->ipfm_lock);
+	}
+
+	return 0;
+}
+
+/*
+ * Limits and counts are reported summed over the shards; a new limit
+ * is split evenly between them.
+ */
+static int
+ipfm_limit_sysctl SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp)
+	struct fsw_ip_frag_mgr *mgr = arg1;
+	uint32_t i, v = 0;
+	int error;
+
+	for (i = 0; i < mgr->ipfm_nshards; i++) {
+		v += *(uint32_t *)(void *)((uintptr_t)&mgr->ipfm_shards[i] +
+		    arg2);
+	}
+	error = sysctl_handle_int(oidp, &v, 0, req);
+	if (error != 0 || req->newptr == USER_ADDR_NULL) {
+		return error;
+	}
+
+	v = MAX(v / mgr->ipfm_nshards, 1);
+	for (i = 0; i < mgr->ipfm_nshards; i++) {
+		struct ipfm *ipfm = &mgr->ipfm_shards[i];
+
+		lck_mtx_lock(&ipfm->ipfm_lock);
+		*(uint32_t *)(void *)((uintptr_t)ipfm + arg2) = v;
+		lck_mtx_unlock(&ipfm->ipfm_lock);
+	}
 
 	return 0;
 }
 
 static struct ipfq *
-ipfq_alloc(struct fsw_ip_frag_mgr *mgr, int how)
+ipfq_alloc(struct ipfm *mgr, int how)
 {
 	struct mbuf *t;
 	struct ipfq *q;
@@ -944,8 +1131,9 @@ ipfq_alloc(struct fsw_ip_frag_mgr *mgr, int how)
 
 /* free q */
 static void
-ipfq_free(struct fsw_ip_frag_mgr *mgr, struct ipfq *q)
+ipfq_free(struct ipfm *mgr, struct ipfq *q)
 {
+	LIST_REMOVE(q, ipfq_hlink);
 	(void) m_free(dtom(q));
 	mgr->ipfm_q_count--;
 }
@@ -955,8 +1143,8 @@ ipfq_free(struct fsw_ip_frag_mgr *mgr, struct ipfq *q)
  * @return: number of frags freed
  */
 static uint32_t
-ipfq_freef(struct fsw_ip_frag_mgr *mgr, struct ipfq *q,
-    void (*ipf_cb)(struct fsw_ip_frag_mgr *, struct ipf *))
+ipfq_freef(struct ipfm *mgr, struct ipfq *q,
+    void (*ipf_cb)(struct ipfm *, struct ipf *))
 {
 	struct ipf *f, *down6;
 	uint32_t nfrags = 0;
@@ -979,8 +1167,8 @@ ipfq_freef(struct fsw_ip_frag_mgr *mgr, struct ipfq *q,
  * @return: number of frags freed
  */
 static uint32_t
-ipfq_freefq(struct fsw_ip_frag_mgr *mgr, struct ipfq *q,
-    void (*ipf_cb)(struct fsw_ip_frag_mgr *, struct ipf *))
+ipfq_freefq(struct ipfm *mgr, struct ipfq *q,
+    void (*ipf_cb)(struct ipfm *, struct ipf *))
 {
 	uint32_t freed_count;
 	freed_count = ipfq_freef(mgr, q, ipf_cb);
@@ -990,7 +1178,7 @@ ipfq_freefq(struct fsw_ip_frag_mgr *mgr, struct ipfq *q,
 }
 
 static struct ipf *
-ipf_alloc(struct fsw_ip_frag_mgr *mgr)
+ipf_alloc(struct ipfm *mgr, struct __kern_packet *pkt)
 {
 	struct mbuf *t;
 	struct ipf *f;
@@ -1005,6 +1193,9 @@ ipf_alloc(struct fsw_ip_frag_mgr *mgr)
 		mgr->ipfm_f_count++;
 		f = mtod(t, struct ipf *);
 		bzero(f, sizeof(*f));
+		f->ipf_pkt = pkt;
+		f->ipf_bytes = pkt->pkt_length;
+		mgr->ipfm_b_count += f->ipf_bytes;
 	} else {
 		f = NULL;
 	}
@@ -1021,8 +1212,10 @@ ipf_free_pkt(struct ipf *f)
 }
 
 static void
-ipf_free(struct fsw_ip_frag_mgr *mgr, struct ipf *f)
+ipf_free(struct ipfm *mgr, struct ipf *f)
 {
+	ASSERT(mgr->ipfm_b_count >= f->ipf_bytes);
+	mgr->ipfm_b_count -= f->ipf_bytes;
 	(void) m_free(dtom(f));
 	mgr->ipfm_f_count--;
 }
@@ -149,7 +149,8 @@ extern void fsw_dp_dtor(struct nx_flowswitch *fsw);
 extern void fsw_ring_flush(struct nx_flowswitch *fsw,
     struct __kern_channel_ring *skring, struct proc *p);
 extern void fsw_ring_enqueue_tail_drop(struct nx_flowswitch *fsw,
-    struct __kern_channel_ring *ring, struct pktq *pktq);
+    struct flow_entry *fe, struct __kern_channel_ring *ring,
+    struct pktq *pktq);
 extern boolean_t fsw_detach_barrier_add(struct nx_flowswitch *fsw);
 extern void fsw_detach_barrier_remove(struct nx_flowswitch *fsw);
 extern void fsw_linger_insert(struct flow_entry *fsw);
@@ -169,11 +170,15 @@ extern void dp_flow_rx_process(struct nx_flowswitch *fsw,
 
 #if (DEVELOPMENT || DEBUG)
 extern int fsw_rps_set_nthreads(struct nx_flowswitch* fsw, uint32_t n);
+extern int fsw_rps_get_load(struct nx_flowswitch *fsw,
+    struct fsw_rps_load *load, uint32_t *n);
 #endif /* !DEVELOPMENT && !DEBUG */
 
 extern uint32_t fsw_tx_batch;
 extern uint32_t fsw_rx_batch;
 extern uint32_t fsw_chain_enqueue;
+extern uint32_t fsw_qset_chain_enqueue;
+extern uint32_t fsw_flow_lat;
 extern uint32_t fsw_use_dual_sized_pool;
 
 // flow related
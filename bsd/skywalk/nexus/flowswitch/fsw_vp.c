@@ -260,6 +260,11 @@ fsw_vp_na_rxsync(struct __kern_channel_ring *kring, struct proc *p,
 	khead_prev = kring->ckr_khead;
 	kring->ckr_khead = head;
 
+#if (DEVELOPMENT || DEBUG)
+	/* RPS steers this port's flows to where it consumes them */
+	VPNA(KRNA(kring))->vpna_rx_cpu = cpu_number() + 1;
+#endif /* !DEVELOPMENT && !DEBUG */
+
 	/* ensure global visibility */
 	membar_sync();
 
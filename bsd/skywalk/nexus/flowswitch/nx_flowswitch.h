@@ -102,7 +102,7 @@
 /* {min, def, max} values for large buffer size */
 #define NX_FSW_MIN_LARGE_BUFSIZE    0
 #define NX_FSW_DEF_LARGE_BUFSIZE    (16 * 1024)
-#define NX_FSW_MAX_LARGE_BUFSIZE    (32 * 1024)
+#define NX_FSW_MAX_LARGE_BUFSIZE    (64 * 1024)
 
 /*
  * TODO: adi@apple.com -- minimum buflets for now; we will need to
@@ -121,6 +121,11 @@
  */
 #define NX_FSW_TCP_RX_AGG_ENABLED()    (sk_fsw_rx_agg_tcp != 0)
 
+/*
+ * macro to check if UDP RX aggregation is enabled in flowswitch.
+ */
+#define NX_FSW_UDP_RX_AGG_ENABLED()    (sk_fsw_rx_agg_udp != 0)
+
 struct nx_flowswitch;
 
 /*
@@ -148,6 +153,9 @@ struct nexus_vp_adapter {
 	boolean_t       vpna_pid_bound;
 	boolean_t       vpna_defunct;
 	pid_t           vpna_pid;
+#if (DEVELOPMENT || DEBUG)
+	uint32_t        vpna_rx_cpu;    /* CPU + 1 of the last rx sync */
+#endif /* !DEVELOPMENT && !DEBUG */
 };
 
 #define VPNA(_na)       ((struct nexus_vp_adapter *)(_na))
@@ -179,6 +187,31 @@ struct fsw_rps_thread {
 	uint32_t                frt_idx;
 	uint32_t                frt_flags;
 	uint32_t                frt_requests;
+
+	uint64_t                frt_enq_seq;    /* packets ever queued */
+	uint64_t                frt_done_seq;   /* ... and processed */
+	uint64_t                frt_flows_in;   /* flows steered here */
+};
+
+/*
+ * RPS steering table, indexed by flow hash.  rf_want is the thread the
+ * flow's consumer would like, from the CPU its channel last synced on;
+ * rf_cur is the thread the flow is on now.  The flow only moves once
+ * rf_cur has processed the flow's last packet (rf_last_seq), so that it
+ * is still delivered in order.
+ */
+#define FSW_RPS_FLOWS           1024
+struct fsw_rps_flow {
+	uint64_t                rf_last_seq;
+	uint16_t                rf_want;        /* thread + 1, 0 if none */
+	uint16_t                rf_cur;         /* thread + 1, 0 if none */
+};
+
+/* per-thread load, as exported by the rps_load sysctl */
+struct fsw_rps_load {
+	uint64_t                frl_enqueued;
+	uint64_t                frl_processed;
+	uint64_t                frl_flows_in;
 };
 
 #define FRT_RUNNING             0x00000001
@@ -310,6 +343,7 @@ struct nx_flowswitch {
 #if (DEVELOPMENT || DEBUG)
 	uint32_t                fsw_rps_nthreads;
 	struct fsw_rps_thread   *fsw_rps_threads;
+	struct fsw_rps_flow     *fsw_rps_flows;
 #endif /* !DEVELOPMENT && !DEBUG */
 };
 
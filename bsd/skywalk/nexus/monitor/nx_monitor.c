@@ -97,10 +97,16 @@
  * instead, need exclusive access to each of the monitored rings.  This may
  * change in the future, if we implement zero-copy monitor chaining.
  *
+ * A copy monitor may also be given a BPF program and a sampling rate
+ * (CHOPT_MONITOR_FILTER); packets that the program rejects, or that are
+ * not sampled, are skipped before anything gets copied, so a monitor of
+ * a few flows costs the monitored rings little more than the filter.
+ *
  */
 
 #include <skywalk/os_skywalk_private.h>
 #include <skywalk/nexus/monitor/nx_monitor.h>
+#include <net/bpf.h>
 
 static int nx_mon_na_txsync(struct __kern_channel_ring *, struct proc *,
     uint32_t);
@@ -134,6 +140,10 @@ static void nx_mon_zcopy_na_dtor(struct nexus_adapter *);
 
 static void nx_mon_parent_sync(struct __kern_channel_ring *, struct proc *,
     slot_idx_t, int);
+static boolean_t nx_mon_filter(struct nexus_monitor_adapter *,
+    struct __kern_channel_ring *, struct __kern_packet *, kern_packet_t);
+static void nx_mon_filter_free(struct bpf_insn *, struct bpf_cprog *,
+    uint32_t);
 static int nx_mon_na_activate(struct nexus_adapter *, na_activate_mode_t);
 static void nx_mon_na_dtor(struct nexus_adapter *);
 
@@ -1179,6 +1189,59 @@ nx_mon_zcopy_na_dtor(struct nexus_adapter *na)
  * Functions specific for copy monitors.
  */
 
+/*
+ * Run the monitor's pre-filter on a packet of a monitored ring, with the
+ * monitor ring locked; returns TRUE if the packet is to be copied.
+ */
+static boolean_t
+nx_mon_filter(struct nexus_monitor_adapter *mna,
+    struct __kern_channel_ring *mkring, struct __kern_packet *spkt,
+    kern_packet_t sph)
+{
+	if (mna->mna_filter_len != 0) {
+		struct bpf_packet bpf_pkt;
+		u_int wirelen, buflen;
+		uint16_t dlen;
+		u_char *p;
+
+		wirelen = spkt->pkt_qum.qum_len;
+		if (METADATA_TYPE(spkt) == NEXUS_META_TYPE_PACKET &&
+		    spkt->pkt_bufs_cnt > 1) {
+			/* let the filter walk the buflet chain */
+			bzero(&bpf_pkt, sizeof(bpf_pkt));
+			bpf_pkt.bpfp_type = BPF_PACKET_TYPE_PKT;
+			bpf_pkt.bpfp_pkt = sph;
+			bpf_pkt.bpfp_total_length = wirelen;
+			p = (u_char *)&bpf_pkt;
+			buflen = 0;
+		} else {
+			MD_BUFLET_ADDR_DLEN(spkt, p, dlen);
+			buflen = dlen;
+			if (buflen == 0) {
+				return FALSE;
+			}
+		}
+		if (mna->mna_filter_cprog != NULL) {
+			if (bpf_cprog_run(mna->mna_filter_cprog, p, wirelen,
+			    buflen) == 0) {
+				return FALSE;
+			}
+		} else if (bpf_filter(mna->mna_filter, p, wirelen,
+		    buflen) == 0) {
+			return FALSE;
+		}
+	}
+
+	if (mna->mna_sample > 1) {
+		if (mkring->ckr_mon_skip != 0) {
+			mkring->ckr_mon_skip--;
+			return FALSE;
+		}
+		mkring->ckr_mon_skip = mna->mna_sample - 1;
+	}
+	return TRUE;
+}
+
 static void
 nx_mon_parent_sync(struct __kern_channel_ring *kring, struct proc *p,
     slot_idx_t first_new, int new_slots)
@@ -1196,6 +1259,7 @@ nx_mon_parent_sync(struct __kern_channel_ring *kring, struct proc *p,
 		    (struct nexus_monitor_adapter *)dst_na;
 		uint32_t max_len = mkring->ckr_pp->pp_max_frags *
 		    PP_BUF_SIZE_DEF(mkring->ckr_pp);
+		boolean_t filtered;
 
 		/*
 		 * src and dst adapters must share the same nexus;
@@ -1223,10 +1287,16 @@ nx_mon_parent_sync(struct __kern_channel_ring *kring, struct proc *p,
 			goto out;
 		}
 
-		/* copy min(free_slots, new_slots) slots */
+		/*
+		 * Without a filter, copy the last min(free_slots, new_slots)
+		 * slots.  With one, the slots that will be copied aren't known
+		 * in advance; walk all of them and stop once the monitor ring
+		 * is full.
+		 */
+		filtered = (mna->mna_filter_len != 0 || mna->mna_sample > 1);
 		m = new_slots;
 		beg = first_new;
-		if (free_slots < m) {
+		if (!filtered && free_slots < m) {
 			beg += (m - free_slots);
 			if (beg >= kring->ckr_num_slots) {
 				beg -= kring->ckr_num_slots;
@@ -1251,6 +1321,16 @@ nx_mon_parent_sync(struct __kern_channel_ring *kring, struct proc *p,
 			spkt = src_sd->sd_pkt;
 			sph = SK_PTR_ENCODE(spkt, METADATA_TYPE(spkt),
 			    METADATA_SUBTYPE(spkt));
+
+			if (filtered) {
+				if (!nx_mon_filter(mna, mkring, spkt, sph)) {
+					goto skip;
+				}
+				if (free_slots == 0) {
+					break;
+				}
+			}
+
 			dpkt = dst_sd->sd_pkt;
 			dph = SK_PTR_ENCODE(dpkt, METADATA_TYPE(dpkt),
 			    METADATA_SUBTYPE(dpkt));
@@ -1286,6 +1366,7 @@ nx_mon_parent_sync(struct __kern_channel_ring *kring, struct proc *p,
 			    PP_KERNEL_ONLY(dpkt->pkt_qum.qum_pp));
 
 			sent++;
+			free_slots--;
 			i = SLOT_NEXT(i, mlim);
 skip:
 			beg = SLOT_NEXT(beg, lim);
@@ -1412,6 +1493,105 @@ nx_mon_na_dtor(struct nexus_adapter *na)
 		(void) na_release_locked(pna);
 		mna->mna_pna = NULL;
 	}
+
+	nx_mon_filter_free(mna->mna_filter, mna->mna_filter_cprog,
+	    mna->mna_filter_len);
+	mna->mna_filter = NULL;
+	mna->mna_filter_cprog = NULL;
+	mna->mna_filter_len = 0;
+}
+
+static void
+nx_mon_filter_free(struct bpf_insn *fcode, struct bpf_cprog *cprog,
+    uint32_t len)
+{
+	if (cprog != NULL) {
+		bpf_cprog_free(cprog);
+	}
+	if (fcode != NULL) {
+		kfree_data(fcode, len * sizeof(struct bpf_insn));
+	}
+}
+
+/* CHOPT_MONITOR_FILTER handler; called with the channel lock held */
+int
+nx_mon_set_filter(struct nexus_adapter *na, struct sockopt *sopt)
+{
+	struct nexus_monitor_adapter *mna = (struct nexus_monitor_adapter *)na;
+	struct bpf_insn *fcode = NULL, *ofcode;
+	struct bpf_cprog *cprog = NULL, *ocprog;
+	struct ch_mon_filter cmf;
+	uint32_t i, olen, size;
+	int err;
+
+	if (na->na_type != NA_MONITOR) {
+		return ENOTSUP;
+	}
+	/* zero-copy monitors take over the slots; there is no copy to skip */
+	if (na->na_activate == nx_mon_zcopy_na_activate) {
+		return ENOTSUP;
+	}
+	if (na->na_rx_rings == NULL) {
+		return ENXIO;
+	}
+	if (sopt->sopt_val == USER_ADDR_NULL) {
+		return EINVAL;
+	}
+
+	bzero(&cmf, sizeof(cmf));
+	err = sooptcopyin(sopt, &cmf, sizeof(cmf), sizeof(cmf));
+	if (err != 0) {
+		return err;
+	}
+	if (cmf.cmf_len > BPF_MAXINSNS ||
+	    (cmf.cmf_len != 0 && cmf.cmf_insns == USER_ADDR_NULL)) {
+		return EINVAL;
+	}
+
+	if (cmf.cmf_len != 0) {
+		size = cmf.cmf_len * sizeof(struct bpf_insn);
+		fcode = kalloc_data(size, Z_WAITOK | Z_ZERO);
+		if (fcode == NULL) {
+			return ENOMEM;
+		}
+		err = copyin(cmf.cmf_insns, (caddr_t)fcode, size);
+		if (err == 0 && !bpf_validate(fcode, (int)cmf.cmf_len)) {
+			err = EINVAL;
+		}
+		if (err != 0) {
+			kfree_data(fcode, size);
+			return err;
+		}
+		/* when this fails the filter is interpreted instead */
+		cprog = bpf_cprog_compile(fcode, cmf.cmf_len);
+	}
+
+	/*
+	 * The monitored rings consult the filter while holding the lock
+	 * of the monitor rx ring they copy to; hold all of them to swap.
+	 */
+	for (i = 0; i < na_get_nrings(na, NR_RX); i++) {
+		KR_LOCK(&na->na_rx_rings[i]);
+	}
+	ofcode = mna->mna_filter;
+	ocprog = mna->mna_filter_cprog;
+	olen = mna->mna_filter_len;
+	mna->mna_filter = fcode;
+	mna->mna_filter_cprog = cprog;
+	mna->mna_filter_len = cmf.cmf_len;
+	mna->mna_sample = cmf.cmf_sample;
+	for (i = 0; i < na_get_nrings(na, NR_RX); i++) {
+		na->na_rx_rings[i].ckr_mon_skip = 0;
+		KR_UNLOCK(&na->na_rx_rings[i]);
+	}
+
+	nx_mon_filter_free(ofcode, ocprog, olen);
+
+	SK_DF(SK_VERB_MONITOR, "%s (0x%llx): filter len %u%s sample 1/%u",
+	    na->na_name, SK_KVA(na), cmf.cmf_len,
+	    (cprog != NULL) ? " (compiled)" : "", MAX(cmf.cmf_sample, 1));
+
+	return 0;
 }
 
 /* check if chr is a request for a monitor adapter that we can satisfy */
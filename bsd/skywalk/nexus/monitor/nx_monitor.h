@@ -70,6 +70,15 @@ struct nexus_monitor_adapter {
 	uint32_t mna_last[NR_TXRX];
 	uint32_t mna_mode;
 	pkt_copy_from_pkt_t *mna_pkt_copy_from_pkt;
+
+	/*
+	 * Copy monitor pre-filter (CHOPT_MONITOR_FILTER); changed only
+	 * while holding the locks of all of the monitor's rx rings.
+	 */
+	struct bpf_insn *mna_filter;
+	struct bpf_cprog *mna_filter_cprog;
+	uint32_t mna_filter_len;
+	uint32_t mna_sample;
 };
 
 #define NEXUS_PROVIDER_MONITOR "com.apple.nexus.monitor"
@@ -81,6 +90,7 @@ extern int nx_monitor_na_find(struct kern_nexus *, struct kern_channel *,
     struct chreq *, struct kern_channel *, struct nxbind *, struct proc *,
     struct nexus_adapter **, boolean_t);
 extern void nx_mon_stop(struct nexus_adapter *);
+extern int nx_mon_set_filter(struct nexus_adapter *, struct sockopt *);
 __END_DECLS
 #endif /* CONFIG_NEXUS_MONITOR */
 #endif /* _SKYWALK_NEXUS_MONITOR_H_ */
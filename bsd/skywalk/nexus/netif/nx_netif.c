@@ -4350,11 +4350,11 @@ kern_netif_increment_queue_stats(kern_netif_queue_t queue,
 	struct netif_llink *llink = queue->nq_qset->nqs_llink;
 	struct ifnet *ifp = llink->nll_nif->nif_ifp;
 	if ((queue->nq_flags & NETIF_QUEUE_IS_RX) == 0) {
-		atomic_add_64(&ifp->if_data.ifi_opackets, pkt_count);
-		atomic_add_64(&ifp->if_data.ifi_obytes, byte_count);
+		IFNET_STAT_ADD(ifp, ifi_opackets, pkt_count);
+		IFNET_STAT_ADD(ifp, ifi_obytes, byte_count);
 	} else {
-		atomic_add_64(&ifp->if_data.ifi_ipackets, pkt_count);
-		atomic_add_64(&ifp->if_data.ifi_ibytes, byte_count);
+		IFNET_STAT_ADD(ifp, ifi_ipackets, pkt_count);
+		IFNET_STAT_ADD(ifp, ifi_ibytes, byte_count);
 	}
 
 	if (ifp->if_data_threshold != 0) {
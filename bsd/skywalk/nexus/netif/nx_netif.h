@@ -423,6 +423,12 @@ struct mit_cfg_tbl {
 
 #define NETIF_MIT_CFG_TBL_MAX_CFG       5
 
+/*
+ * Delivered latency histogram buckets; bucket b counts latencies in
+ * [2^(b-1), 2^b) microseconds, the last one everything above.
+ */
+#define NETIF_MIT_LAT_BUCKETS           16
+
 struct nx_netif_mit {
 	decl_lck_spin_data(, mit_lock);
 	volatile struct __kern_channel_ring *mit_ckr;  /* kring backpointer */
@@ -444,6 +450,18 @@ struct nx_netif_mit {
 	uint32_t        mit_bytes_min;          /* smallest # of bytes */
 	uint32_t        mit_bytes_max;          /* largest # of bytes */
 
+	/*
+	 * Latency-targeted mitigation.
+	 */
+	uint32_t        mit_lat_target;         /* p99 target in usec (0 = global) */
+	uint32_t        mit_lat_ival;           /* controller's interval in usec */
+	uint32_t        mit_lat_p99;            /* p99 of last window in usec */
+	uint32_t        mit_lat_occupancy;      /* most slots seen in one sync */
+	uint32_t        mit_lat_wcnt;           /* samples in current window */
+	uint64_t        mit_req_time;           /* oldest pending request */
+	uint32_t        mit_lat_whist[NETIF_MIT_LAT_BUCKETS]; /* window */
+	uint64_t        mit_lat_hist[NETIF_MIT_LAT_BUCKETS]; /* since init */
+
 	struct pktcntr  mit_sstats;             /* pkts & bytes per sampling */
 	struct timespec mit_mode_holdtime;      /* mode holdtime in nsec */
 	struct timespec mit_mode_lasttime;      /* last mode change time nsec */
@@ -759,8 +777,9 @@ extern void nx_netif_llink_init(struct nx_netif *);
 extern void nx_netif_llink_fini(struct nx_netif *);
 extern struct netif_qset * nx_netif_find_qset(struct nx_netif *, uint64_t);
 extern struct netif_qset * nx_netif_get_default_qset_noref(struct nx_netif *);
-extern int netif_qset_enqueue(struct netif_qset *, struct __kern_packet *,
-    struct __kern_packet *, uint32_t, uint32_t, uint32_t *, uint32_t *);
+extern int netif_qset_enqueue(struct netif_qset *, bool,
+    struct __kern_packet *, struct __kern_packet *, uint32_t, uint32_t,
+    uint32_t *, uint32_t *);
 extern int nx_netif_default_llink_config(struct nx_netif *,
     struct kern_nexus_netif_llink_init *);
 extern void nx_netif_llink_config_free(struct nx_netif *);
@@ -639,12 +639,54 @@ netif_qset_enqueue_single(struct netif_qset *qset, struct __kern_packet *pkt,
 	return err;
 }
 
+/*
+ * Enqueue all the packets of a flow at once; they share the flow ID and
+ * service class, so they land in the same AQM queue anyway.
+ */
+static int
+netif_qset_enqueue_chain(struct netif_qset *qset,
+    struct __kern_packet *pkt_chain, struct __kern_packet *tail, uint32_t cnt,
+    uint32_t bytes, uint32_t *flowctl, uint32_t *dropped)
+{
+	struct ifnet *ifp = qset->nqs_ifcq->ifcq_ifp;
+	struct __kern_packet *pkt;
+	boolean_t pkt_drop = FALSE;
+	int err;
+
+	ASSERT(!uuid_is_null(pkt_chain->pkt_flow_id));
+	netif_ifp_inc_traffic_class_out_pkt(ifp, pkt_chain->pkt_svc_class,
+	    cnt, bytes);
+
+	for (pkt = pkt_chain; pkt != NULL; pkt = pkt->pkt_nextpkt) {
+		/* Only native path is supported */
+		ASSERT((pkt->pkt_pflags & PKT_F_MBUF_DATA) == 0);
+		ASSERT(pkt->pkt_mbuf == NULL);
+		if (__improbable(pkt->pkt_trace_id != 0)) {
+			KDBG(SK_KTRACE_PKT_TX_FSW | DBG_FUNC_END,
+			    pkt->pkt_trace_id);
+			KDBG(SK_KTRACE_PKT_TX_AQM | DBG_FUNC_START,
+			    pkt->pkt_trace_id);
+		}
+	}
+
+	err = ifnet_enqueue_ifcq_pkt_chain(ifp, qset->nqs_ifcq, pkt_chain,
+	    tail, cnt, bytes, false, &pkt_drop);
+	if (__improbable(err != 0)) {
+		if ((err == EQFULL || err == EQSUSPENDED) && flowctl != NULL) {
+			(*flowctl)++;
+		}
+		if (pkt_drop && dropped != NULL) {
+			(*dropped) += cnt;
+		}
+	}
+	return err;
+}
+
 int
-netif_qset_enqueue(struct netif_qset *qset, struct __kern_packet *pkt_chain,
-    struct __kern_packet *tail, uint32_t cnt, uint32_t bytes, uint32_t *flowctl,
-    uint32_t *dropped)
+netif_qset_enqueue(struct netif_qset *qset, bool chain,
+    struct __kern_packet *pkt_chain, struct __kern_packet *tail, uint32_t cnt,
+    uint32_t bytes, uint32_t *flowctl, uint32_t *dropped)
 {
-#pragma unused(tail)
 	struct __kern_packet *pkt = pkt_chain;
 	struct __kern_packet *next;
 	struct netif_stats *nifs = &qset->nqs_llink->nll_nif->nif_stats;
@@ -661,19 +703,25 @@ netif_qset_enqueue(struct netif_qset *qset, struct __kern_packet *pkt_chain,
 		return ENXIO;
 	}
 
-	/* We don't support chains for now */
-	while (pkt != NULL) {
-		next = pkt->pkt_nextpkt;
-		pkt->pkt_nextpkt = NULL;
-		c++;
-		b += pkt->pkt_length;
-
-		(void) netif_qset_enqueue_single(qset, pkt, &flowctl_cnt,
-		    &drop_cnt);
-		pkt = next;
+	if (chain) {
+		(void) netif_qset_enqueue_chain(qset, pkt_chain, tail, cnt,
+		    bytes, &flowctl_cnt, &drop_cnt);
+		STATS_INC(nifs, NETIF_STATS_LLINK_TX_CHAIN);
+		STATS_ADD(nifs, NETIF_STATS_LLINK_TX_CHAIN_PKTS, cnt);
+	} else {
+		while (pkt != NULL) {
+			next = pkt->pkt_nextpkt;
+			pkt->pkt_nextpkt = NULL;
+			c++;
+			b += pkt->pkt_length;
+
+			(void) netif_qset_enqueue_single(qset, pkt,
+			    &flowctl_cnt, &drop_cnt);
+			pkt = next;
+		}
+		VERIFY(c == cnt);
+		VERIFY(b == bytes);
 	}
-	VERIFY(c == cnt);
-	VERIFY(b == bytes);
 	if (flowctl != NULL && flowctl_cnt > 0) {
 		*flowctl = flowctl_cnt;
 		STATS_ADD(nifs, NETIF_STATS_LLINK_AQM_QFULL, flowctl_cnt);
@@ -43,6 +43,7 @@ static void nx_netif_mit_thread_cont(void *, wait_result_t);
 static void nx_netif_mit_s_thread_cont(void *, wait_result_t);
 static void nx_netif_mit_stats(struct __kern_channel_ring *, uint64_t,
     uint64_t);
+static void nx_netif_mit_lat_sample(struct nx_netif_mit *, uint64_t);
 
 /* mitigation intervals in micro seconds */
 #define NETIF_BUSY_MIT_DELAY    (100)
@@ -138,6 +139,7 @@ static const struct mit_cfg_tbl mit_cfg_tbl_native_cellular[] = {
 
 #if (DEVELOPMENT || DEBUG)
 static int sysctl_mit_mode_holdtime SYSCTL_HANDLER_ARGS;
+static int sysctl_mit_lat_hist SYSCTL_HANDLER_ARGS;
 SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, busy_mit_delay,
     CTLFLAG_RW | CTLFLAG_LOCKED, &netif_busy_mit_delay,
     NETIF_BUSY_MIT_DELAY, "");
@@ -150,6 +152,24 @@ SYSCTL_PROC(_kern_skywalk_netif, OID_AUTO, ad_mit_freeze,
     NETIF_MIT_MODE_HOLDTIME, sysctl_mit_mode_holdtime, "Q", "");
 #endif /* !DEVELOPMENT && !DEBUG */
 
+/*
+ * Latency-targeted mitigation.  When a ring has a target, the delay
+ * between its wakeups no longer comes from the rate table; instead it is
+ * adjusted every NETIF_MIT_LAT_WINDOW wakeups from the 99th percentile
+ * of the latency packets saw until their request was serviced, and from
+ * how full the ring got.  The delay halves when the target is missed or
+ * the ring gets close to overflowing, and grows a little while latency
+ * stays under half the target, so a large target buys throughput and a
+ * small one keeps the ring interrupt driven.
+ */
+#define NETIF_MIT_LAT_WINDOW    128     /* wakeups per adjustment */
+#define NETIF_MIT_LAT_STEP      10      /* smallest increase in usec */
+
+static uint32_t netif_mit_lat_target = 0;       /* usec, 0 = rate table */
+SYSCTL_UINT(_kern_skywalk_netif, OID_AUTO, mit_lat_target,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &netif_mit_lat_target, 0,
+    "Default p99 delivery latency target of mitigated rings (usec)");
+
 void
 nx_netif_mit_init(struct nx_netif *nif, const struct ifnet *ifp,
     struct nx_netif_mit *mit, struct __kern_channel_ring *kr,
@@ -194,6 +214,15 @@ nx_netif_mit_init(struct nx_netif *nif, const struct ifnet *ifp,
 	mit->mit_interval = 0;
 	mit->mit_netif_ifp = ifp;
 
+	mit->mit_lat_target = 0;
+	mit->mit_lat_ival = 0;
+	mit->mit_lat_p99 = 0;
+	mit->mit_lat_occupancy = 0;
+	mit->mit_lat_wcnt = 0;
+	mit->mit_req_time = 0;
+	bzero(mit->mit_lat_whist, sizeof(mit->mit_lat_whist));
+	bzero(mit->mit_lat_hist, sizeof(mit->mit_lat_hist));
+
 	if ((ifp->if_eflags & IFEF_SKYWALK_NATIVE) && (ifp->if_family ==
 	    IFNET_FAMILY_CELLULAR)) {
 		bcopy(mit_cfg_tbl_native_cellular,
@@ -283,6 +312,16 @@ nx_netif_mit_init(struct nx_netif *nif, const struct ifnet *ifp,
 	skoid_create(&mit->mit_skoid, SKOID_DNODE(nif->nif_skoid), oid_name, 0);
 	skoid_add_uint(&mit->mit_skoid, "interval", CTLFLAG_RW,
 	    &mit->mit_interval);
+	if (!simple) {
+		skoid_add_uint(&mit->mit_skoid, "lat_target", CTLFLAG_RW,
+		    &mit->mit_lat_target);
+		skoid_add_uint(&mit->mit_skoid, "lat_ival", CTLFLAG_RD,
+		    &mit->mit_lat_ival);
+		skoid_add_uint(&mit->mit_skoid, "lat_p99", CTLFLAG_RD,
+		    &mit->mit_lat_p99);
+		skoid_add_handler(&mit->mit_skoid, "lat_hist", CTLFLAG_RD,
+		    sysctl_mit_lat_hist, mit, 0);
+	}
 	struct skoid *skoid = &mit->mit_skoid;
 	struct mit_cfg_tbl *t;
 #define MIT_ADD_SKOID(_i)       \
@@ -364,6 +403,11 @@ nx_netif_mit_update_interval(struct nx_netif_mit *mit, boolean_t reset)
 		break;
 	}
 
+	if (mit->mit_mode != MIT_MODE_SIMPLE &&
+	    (mit->mit_lat_target != 0 || netif_mit_lat_target != 0)) {
+		i = mit->mit_lat_ival;
+	}
+
 	/*
 	 * The idea here is to return the effective delay interval that
 	 * causes each work phase to begin at the desired cadence, at
@@ -449,6 +493,9 @@ nx_netif_mit_tx_intr(struct __kern_channel_ring *kr, struct proc *p,
 		ASSERT(mit->mit_flags & NETIF_MITF_INITIALIZED);
 		MIT_SPIN_LOCK(mit);
 		mit->mit_requests++;
+		if (mit->mit_req_time == 0) {
+			mit->mit_req_time = mach_absolute_time();
+		}
 		if (!(mit->mit_flags & (NETIF_MITF_RUNNING |
 		    NETIF_MITF_TERMINATING | NETIF_MITF_TERMINATED))) {
 			(void) thread_wakeup_thread((caddr_t)&mit->mit_flags,
@@ -484,6 +531,9 @@ nx_netif_mit_rx_intr(struct __kern_channel_ring *kr, struct proc *p,
 		ASSERT(mit->mit_flags & NETIF_MITF_INITIALIZED);
 		MIT_SPIN_LOCK(mit);
 		mit->mit_requests++;
+		if (mit->mit_req_time == 0) {
+			mit->mit_req_time = mach_absolute_time();
+		}
 		if (!(mit->mit_flags & (NETIF_MITF_RUNNING |
 		    NETIF_MITF_TERMINATING | NETIF_MITF_TERMINATED))) {
 			(void) thread_wakeup_thread((caddr_t)&mit->mit_flags,
@@ -664,9 +714,11 @@ nx_netif_mit_thread_cont(void *v, wait_result_t wres)
 	 */
 	for (;;) {
 		uint32_t requests = mit->mit_requests;
+		uint64_t req_time = mit->mit_req_time;
 		uint32_t ival;
 		int error = 0;
 
+		mit->mit_req_time = 0;
 		STATS_INC(nifs, irq_stat);
 		MIT_SPIN_UNLOCK(mit);
 
@@ -677,6 +729,9 @@ nx_netif_mit_thread_cont(void *v, wait_result_t wres)
 		 */
 		nx_netif_mit_set_start_interval(mit);
 		error = nx_netif_common_intr(kr, kernproc, 0, NULL);
+		if (req_time != 0 && error != EBUSY) {
+			nx_netif_mit_lat_sample(mit, req_time);
+		}
 		ival = nx_netif_mit_update_interval(mit, FALSE);
 
 		/*
@@ -692,6 +747,10 @@ nx_netif_mit_thread_cont(void *v, wait_result_t wres)
 				    NETIF_BUSY_MIT_DELAY);
 				MIT_SPIN_LOCK(mit);
 				mit->mit_requests++;
+				/* still pending, and older than any newer one */
+				if (req_time != 0) {
+					mit->mit_req_time = req_time;
+				}
 				MIT_SPIN_UNLOCK(mit);
 			}
 			delay(ival);
@@ -760,6 +819,10 @@ nx_netif_mit_stats(struct __kern_channel_ring *kr, uint64_t pkts,
 
 	ASSERT(mit != NULL && !(mit->mit_flags & NETIF_MITF_SIMPLE));
 
+	if (pkts > mit->mit_lat_occupancy) {
+		mit->mit_lat_occupancy = (uint32_t)pkts;
+	}
+
 	if ((atomic_bitset_32_ov(&mit->mit_flags, NETIF_MITF_SAMPLING) &
 	    NETIF_MITF_SAMPLING) != 0) {
 		return;
@@ -873,7 +936,78 @@ done:
 	atomic_bitclear_32(&mit->mit_flags, NETIF_MITF_SAMPLING);
 }
 
+/*
+ * Account for a request posted at req_time (mach_absolute_time) that has
+ * just been serviced, and run the latency controller at window ends.
+ * Only the ring's mitigation thread gets here.
+ */
+static void
+nx_netif_mit_lat_sample(struct nx_netif_mit *mit, uint64_t req_time)
+{
+	struct __kern_channel_ring *kr =
+	    __DEVOLATILE(struct __kern_channel_ring *, mit->mit_ckr);
+	uint32_t target, ival, slots, p99, n, c, b;
+	uint64_t usec;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - req_time, &usec);
+	usec /= NSEC_PER_USEC;
+	b = (usec == 0) ? 0 : (uint32_t)(64 - __builtin_clzll(usec));
+	b = MIN(b, NETIF_MIT_LAT_BUCKETS - 1);
+	mit->mit_lat_hist[b]++;
+	mit->mit_lat_whist[b]++;
+	if (++mit->mit_lat_wcnt < NETIF_MIT_LAT_WINDOW) {
+		return;
+	}
+
+	/* upper bound of the bucket holding the 99th percentile */
+	n = mit->mit_lat_wcnt - mit->mit_lat_wcnt / 100;
+	for (b = 0, c = 0; b < NETIF_MIT_LAT_BUCKETS - 1; b++) {
+		if ((c += mit->mit_lat_whist[b]) >= n) {
+			break;
+		}
+	}
+	p99 = 1U << b;
+
+	target = (mit->mit_lat_target != 0) ? mit->mit_lat_target :
+	    netif_mit_lat_target;
+	slots = kr->ckr_num_slots;
+	ival = mit->mit_lat_ival;
+	if (target == 0) {
+		ival = 0;
+	} else if (p99 > target || mit->mit_lat_occupancy > (slots * 3) / 4) {
+		ival >>= 1;
+	} else if (p99 <= target / 2 && mit->mit_lat_occupancy < slots / 2) {
+		ival += MAX(ival >> 3, NETIF_MIT_LAT_STEP);
+		/* the delay alone must not use up the target */
+		ival = MIN(ival, target / 2);
+	}
+
+	if (ival != mit->mit_lat_ival) {
+		SK_DF(SK_VERB_NETIF_MIT, "%s: p99 %u usec target %u usec "
+		    "occupancy %u/%u [delay %u->%u usec]", mit->mit_name, p99,
+		    target, mit->mit_lat_occupancy, slots, mit->mit_lat_ival,
+		    ival);
+		mit->mit_lat_ival = ival;
+	}
+	mit->mit_lat_p99 = p99;
+	mit->mit_lat_occupancy = 0;
+	mit->mit_lat_wcnt = 0;
+	bzero(mit->mit_lat_whist, sizeof(mit->mit_lat_whist));
+}
+
 #if (DEVELOPMENT || DEBUG)
+static int
+sysctl_mit_lat_hist SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg2)
+	struct nx_netif_mit *mit = arg1;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+	return SYSCTL_OUT(req, mit->mit_lat_hist, sizeof(mit->mit_lat_hist));
+}
+
 static int
 sysctl_mit_mode_holdtime SYSCTL_HANDLER_ARGS
 {
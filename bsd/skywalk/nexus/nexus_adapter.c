@@ -1841,6 +1841,8 @@ na_kr_setup(struct nexus_adapter *na, struct kern_channel *ch)
 			    kring->ckr_khead;
 			*(slot_idx_t *)(uintptr_t)&ring->ring_tail =
 			    kring->ckr_rtail;
+			*(slot_idx_t *)(uintptr_t)&ring->ring_ktail_hint =
+			    kring->ckr_rtail;
 
 			_CASSERT(sizeof(uint32_t) ==
 			    sizeof(ring->ring_def_buf_size));
@@ -447,12 +447,13 @@ struct nx_flow_req {
 #define NXFLOWREQF_NOWAKEFROMSLEEP        0x0800  /* Don't wake for traffic to this flow */
 #define NXFLOWREQF_REUSEPORT      0x1000  /* Don't wake for traffic to this flow */
 #define NXFLOWREQF_PARENT         0x4000  /* Parent flow */
+#define NXFLOWREQF_UDP_RX_AGG     0x8000  /* chain received UDP datagrams */
 
 #define NXFLOWREQF_BITS                                                   \
 	"\020\01TRACK\02QOS_MARKING\03FILTER\04CUSTOM_ETHER\05IPV6_ULA" \
 	"\06LISTENER\07OVERRIDE_ADDRESS_SELECTION\010USE_STABLE_ADDRESS" \
 	"\011ALLOC_FLOWADV\012ASIS\013LOW_LATENCY\014NOWAKEUPFROMSLEEP" \
-	"\015REUSEPORT\017PARENT"
+	"\015REUSEPORT\017PARENT\020UDP_RX_AGG"
 
 struct flow_ip_addr {
 	union {
@@ -521,7 +522,7 @@ extern const struct flow_key fk_mask_ipflow3;
     NXFLOWREQF_CUSTOM_ETHER | NXFLOWREQF_IPV6_ULA | NXFLOWREQF_LISTENER | \
     NXFLOWREQF_OVERRIDE_ADDRESS_SELECTION | NXFLOWREQF_USE_STABLE_ADDRESS | \
     NXFLOWREQF_FLOWADV | NXFLOWREQF_LOW_LATENCY | NXFLOWREQF_REUSEPORT | \
-    NXFLOWREQF_PARENT)
+    NXFLOWREQF_PARENT | NXFLOWREQF_UDP_RX_AGG)
 
 #define NXFLOWREQF_EXT_PORT_RSV   0x1000  /* external port reservation */
 #define NXFLOWREQF_EXT_PROTO_RSV  0x2000  /* external proto reservation */
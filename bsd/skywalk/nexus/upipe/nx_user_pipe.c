@@ -54,6 +54,19 @@
 #include <skywalk/os_skywalk_private.h>
 #include <skywalk/nexus/upipe/nx_user_pipe.h>
 
+/*
+ * Data path
+ *
+ * Both ends of a user pipe are adapters of the same parent, and share
+ * its arena; each end may be opened by a different process, which then
+ * maps the same packet buffers.  Transmit sync hands packets to the peer
+ * by swapping slot descriptors between the transmit ring and the peer's
+ * receive ring (see nx_upipe_na_txsync_locked()), and the receive sync
+ * pulls pending slots the same way.  No packet data is ever copied; only
+ * the descriptors change hands, and the receiver gets back the empty
+ * buffers it swapped out to refill its transmit side.
+ */
+
 #define NX_UPIPE_RINGSIZE       128 /* default ring size */
 #define NX_UPIPE_MAXRINGS       NX_MAX_NUM_RING_PAIR
 #define NX_UPIPE_MINSLOTS       2       /* XXX same as above */
@@ -751,6 +751,8 @@
 	X(NETIF_STATS_LLINK_RX_DROP_BAD_STATE,	"LLinkRxDroppedBadState", "\t%llu RX packets dropped due to bad llink state\n") \
 	X(NETIF_STATS_LLINK_AQM_QFULL,		"LLinkAQMQFull",	"\t%llu occurances of the queue full condition\n") \
 	X(NETIF_STATS_LLINK_AQM_DROPPED,	"LLinkAQMDropped",	"\t%llu packets dropped due to AQM\n") \
+	X(NETIF_STATS_LLINK_TX_CHAIN,		"LLinkTxChain",		"\t%llu packet chains enqueued\n") \
+	X(NETIF_STATS_LLINK_TX_CHAIN_PKTS,	"LLinkTxChainPkts",	"\t%llu packets enqueued in chains\n") \
 	X(NETIF_STATS_LLINK_AQM_DEQ_BAD_STATE,	"LLinkAQMDeqBadState",	"\t%llu dequeues occurred while llink is in a bad state\n") \
 	X(NETIF_STATS_LLINK_QSET_BAD_STATE,	"LLinkQSetAccessBadState", "\t%llu attempts to access a queue set while in bad llink state\n") \
 	X(NETIF_STATS_LLINK_ADD_BAD_PARAMS,	"LLinkAddBadParams",	"\t%llu attempts to add an llink with bad parameters\n") \
@@ -804,6 +806,10 @@
 	X(FSW_STATS_RX_FRAG_DROP_FRAG_LIMIT,	"RxFragHitFragLimit",	"\t\t\t%llu dropped due to ipf max limit\n")    \
 	X(FSW_STATS_RX_FRAG_DROP_REAPED,	"RxFragDrained",	"\t\t\t%llu dropped due to draining\n") \
 	X(FSW_STATS_RX_FRAG_DROP_PER_QUEUE_LIMIT,"RxFragHitPerQueueLimit","\t\t\t%llu dropped due to ipf max per queue limit\n")        \
+	X(FSW_STATS_RX_FRAG_DROP_MEM_LIMIT,     "RxFragHitMemLimit",    "\t\t\t%llu dropped due to reassembly memory budget\n")    \
+	X(FSW_STATS_RX_FRAG_QUEUE_TIMEOUT,      "RxFragQueueTimeout",   "\t\t%llu reassembly queues timed out\n")                \
+	X(FSW_STATS_RX_FRAG_REASS_USEC,         "RxFragReassUsec",      "\t\t%llu usec spent reassembling, total\n")              \
+	X(FSW_STATS_RX_FRAG_REASS_SLOW,         "RxFragReassSlow",      "\t\t%llu reassembled after more than 10 msec\n")        \
 	/* Rx aggregation stats */                                      \
 	X(FSW_STATS_RX_AGG_PKT2PKT,             "RxAggPktToPkt",        "\t\t%llu aggregated pkt  -> super pkt\n")             \
 	X(FSW_STATS_RX_AGG_PKT2MBUF,            "RxAggPktToMbuf",       "\t\t%llu aggregated pkt  -> super mbuf\n")          \
@@ -832,6 +838,8 @@
 	X(FSW_STATS_RX_AGG_NO_OPTTS_TCP,        "RxAggNoOptionTStampTCP", "\t\t%llu TCP timestamp option compare mismatch\n") \
 	X(FSW_STATS_RX_AGG_BAD_CSUM,            "RxAggIncorrectChecksum", "\t\t%llu Incorrect TCP/IP checksum\n") \
 	X(FSW_STATS_RX_AGG_NO_SHORT_MBUF,       "RxAggNoShortMbuf",      "\t\t%llu mbuf too short for mask compare\n") \
+	X(FSW_STATS_RX_AGG_OK_UDP,              "RxAggUDP",              "\t\t%llu UDP datagrams chained to a super pkt\n") \
+	X(FSW_STATS_RX_AGG_NO_ULEN_UDP,         "RxAggNoULenUDP",        "\t\t%llu UDP datagram size compare mismatch\n") \
         \
 	/* Tx stats */  \
 	X(FSW_STATS_TX_PACKETS,			"TXPackets",		"\t%llu total Tx packets\n")    \
@@ -1303,6 +1311,24 @@ struct sk_stats_flow_track {
  * Output: Array of struct sk_stats_flow (per flow).
  */
 #define SK_STATS_FLOW   "kern.skywalk.stats.flow"
+/*
+ * Per-flow Rx pipeline latency histograms, collected while the
+ * kern.skywalk.flowswitch.flow_lat sysctl is set.  Bucket b of a stage
+ * counts latencies in [2^(b-1), 2^b) microseconds, the last bucket
+ * everything above.
+ */
+#define SFLOW_LAT_BUCKETS       16
+
+#define SFLOW_LAT_RX_CLASSIFY   0       /* flowswitch input to flow batch */
+#define SFLOW_LAT_RX_PROCESS    1       /* flow processing (aggregation) */
+#define SFLOW_LAT_RX_ENQUEUE    2       /* channel ring enqueue */
+#define SFLOW_LAT_RX_PICKUP     3       /* ring enqueue to user Rx sync */
+#define SFLOW_LAT_MAX           4
+
+struct sk_stats_flow_lat {
+	uint32_t        sfl_hist[SFLOW_LAT_MAX][SFLOW_LAT_BUCKETS];
+};
+
 struct sk_stats_flow {
 	uuid_t          sf_nx_uuid;             /* nexus instance uuid */
 	char            sf_if_name[IFNAMSIZ];   /* interface name */
@@ -1340,6 +1366,8 @@ struct sk_stats_flow {
 #define sf_rwscale      sf_rtrack.sft_wscale
 
 	activity_bitmap_t sf_activity;          /* flow activity bitmap */
+
+	struct sk_stats_flow_lat sf_lat;        /* Rx pipeline latency */
 };
 
 /* valid values for sf_flags */
@@ -1812,6 +1840,12 @@ struct sk_stats_cache {
 	uint64_t        sca_sl_bufinuse;        /* total unfreed buffers */
 	uint64_t        sca_sl_rescale;         /* # of hash table rescales */
 	uint64_t        sca_sl_hash_size;       /* size of hash table */
+
+	/*
+	 * Depot locality statistics.
+	 */
+	uint64_t        sca_depot_local;        /* full mags from own cluster */
+	uint64_t        sca_depot_remote;       /* full mags from other ones */
 };
 
 /* valid values for sca_mode */
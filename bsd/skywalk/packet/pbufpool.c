@@ -454,12 +454,22 @@ pp_regions_params_adjust(struct skmem_region_params *srp_array,
 	}
 	skmem_region_params_config(buf_srp);
 
-	/* configure large buffer region */
+	/*
+	 * Configure large buffer region.  Large buffers carry aggregated
+	 * and segmentation offload super packets, so pack several of them
+	 * into each segment rather than giving each its own, and back the
+	 * segments with physically contiguous memory so that a whole super
+	 * packet needs only one I/O mapping.
+	 */
 	if (large_buf_size != 0) {
 		lbuf_srp->srp_r_obj_cnt = buf_srp->srp_r_obj_cnt;
 		lbuf_srp->srp_r_obj_size = large_buf_size;
-		lbuf_srp->srp_r_seg_size = buf_srp->srp_r_seg_size;
+		lbuf_srp->srp_r_seg_size = MAX(buf_srp->srp_r_seg_size,
+		    skmem_lbuf_seg_size);
 		lbuf_srp->srp_cflags = buf_srp->srp_cflags;
+		if (skmem_lbuf_physcontig != 0) {
+			lbuf_srp->srp_cflags |= SKMEM_REGION_CR_SEGPHYSCONTIG;
+		}
 		skmem_region_params_config(lbuf_srp);
 	}
 
@@ -107,8 +107,9 @@ struct buf {
 	int     b_timestamp;            /* timestamp for queuing operation */
 	struct timeval b_timestamp_tv; /* microuptime for disk conditioner */
 	int     b_whichq;               /* the free list the buffer belongs to */
+	int     b_shard;                /* buffer cache shard owning the buffer */
 	volatile uint32_t       b_flags;        /* B_* flags. */
-	volatile uint32_t       b_lflags;       /* BL_BUSY | BL_WANTED flags... protected by buf_mtx */
+	volatile uint32_t       b_lflags;       /* BL_BUSY | BL_WANTED flags... protected by the shard lock */
 	int     b_error;                /* errno value. */
 	int     b_bufsize;              /* Allocated buffer size. */
 	int     b_bcount;               /* Valid bytes in buffer. */
@@ -170,7 +171,7 @@ extern vm_offset_t buf_kernel_addrperm;
 
 /*
  * These flags are kept in b_lflags...
- * buf_mtx must be held before examining/updating
+ * the lock of the buffer's shard must be held before examining/updating
  */
 #define BL_BUSY         0x00000001      /* I/O in progress. */
 #define BL_WANTED       0x00000002      /* Process wants this buffer. */
@@ -278,6 +279,7 @@ extern vm_offset_t buf_kernel_addrperm;
 #define BA_IO_SCHEDULED         0x00008000 /* buf is associated with a mount point that is io scheduled */
 #define BA_EXPEDITED_META_IO    0x00010000 /* metadata I/O which needs a high I/O tier */
 #define BA_WILL_VERIFY          0x00020000 /* Cluster layer will verify data */
+#define BA_FAIRSHARE_IO         0x00040000 /* dispatched by the spec_strategy fair-share scheduler */
 
 #define GET_BUFATTR_IO_TIER(bap)        ((bap->ba_flags & BA_IO_TIER_MASK) >> BA_IO_TIER_SHIFT)
 #define SET_BUFATTR_IO_TIER(bap, tier)                                          \
@@ -163,6 +163,28 @@ struct kevent_qos_s {
  * Type definition for names/ids of dynamically allocated kqueues.
  */
 typedef uint64_t kqueue_id_t;
+
+/*
+ * Shared ring used by kevent_qos() when KEVENT_FLAG_RING is passed.
+ *
+ * The ring lives in user memory and holds (kr_mask + 1) entries, which must
+ * be a power of 2 no larger than KEVENT_RING_MAX_ENTRIES. kr_head and kr_tail
+ * are free running indexes: the consumer owns kr_head, the producer owns
+ * kr_tail, and entry i lives at kr_entries[i & kr_mask].
+ *
+ * For the submission ring (changelist) userspace produces and the kernel
+ * consumes; for the completion ring (eventlist) the kernel produces. The
+ * kernel writes completion entries before it publishes the new kr_tail.
+ */
+struct kevent_ring {
+	uint32_t        kr_head;        /* next entry to consume */
+	uint32_t        kr_tail;        /* next entry to produce */
+	uint32_t        kr_mask;        /* number of entries - 1 */
+	uint32_t        kr_reserved;    /* must be 0 */
+	struct kevent_qos_s kr_entries[];
+};
+
+#define KEVENT_RING_MAX_ENTRIES         65536
 #endif /* PRIVATE */
 
 #define EV_SET(kevp, a, b, c, d, e, f) do {     \
@@ -219,6 +241,7 @@ typedef uint64_t kqueue_id_t;
 #define KEVENT_FLAG_DYNAMIC_KQ_MUST_EXIST        0x020000   /* kq lookup by id must exist */
 #define KEVENT_FLAG_DYNAMIC_KQ_MUST_NOT_EXIST    0x040000   /* kq lookup by id must not exist */
 #define KEVENT_FLAG_WORKLOOP_NO_WQ_THREAD        0x080000   /* obsolete */
+#define KEVENT_FLAG_RING                         0x100000   /* changelist/eventlist are struct kevent_ring */
 
 #ifdef XNU_KERNEL_PRIVATE
 
@@ -435,6 +458,22 @@ typedef uint64_t kqueue_id_t;
 #define EV_EXTIDX_WL_VALUE       3         /* debounce value   [in: not current->ESTALE]
 	                                    *                  [out: new/debounce value] */
 
+/*
+ * data/hint fflags for EVFILT_AIO, shared with userspace
+ *
+ * The ident of an EVFILT_AIO knote is the address of an aiocb. The knote
+ * fires once the request completes, with the aio_return() value in data
+ * and the aio_error() value in fflags, and it consumes the request the way
+ * aio_return() does. The knote is implicitly EV_ONESHOT.
+ *
+ * Without NOTE_AIO_SUBMIT, the aiocb must already have been queued with
+ * aio_read(), aio_write() or lio_listio(). With NOTE_AIO_SUBMIT, registering
+ * the knote queues the aiocb as lio_listio() would, using its
+ * aio_lio_opcode, so that batches of IOs can be submitted and completed
+ * through a single kevent call.
+ */
+#define NOTE_AIO_SUBMIT          0x00000001
+
 #endif /* PRIVATE */
 
 /*
@@ -848,6 +887,8 @@ struct kevent_ctx_s {
 	int              kec_process_noutputs;      /* number of events output */
 	unsigned int     kec_process_flags;         /* kevent flags, only set for process  */
 	user_addr_t      kec_process_eventlist;     /* user-level event list address */
+	uint32_t         kec_process_ring_tail;     /* completion ring tail (KEVENT_FLAG_RING) */
+	uint32_t         kec_process_ring_mask;     /* completion ring mask (KEVENT_FLAG_RING) */
 };
 typedef struct kevent_ctx_s *kevent_ctx_t;
 
@@ -422,6 +422,10 @@
 
 #define F_TRANSFEREXTENTS       110      /* Transfer allocated extents beyond leof to a different file */
 
+#ifdef PRIVATE
+#define F_GROUPFSYNC            111      /* fsync several files + one flush (or barrier) per volume */
+#endif // PRIVATE
+
 // FS-specific fcntl()'s numbers begin at 0x00010000 and go up
 #define FCNTL_FS_SPECIFIC_BASE  0x00010000
 
@@ -692,6 +696,16 @@ typedef struct fassertbgaccess {
 	unsigned int       reserved;     /* (to maintain 8-byte alignment) */
 	unsigned long long ttl;          /* IN: time to live for the assertion (nanoseconds; continuous) */
 } fassertbgaccess_t;
+
+/* fgroupfsync_t used by F_GROUPFSYNC */
+#define FGROUPFSYNC_MAX         16              /* descriptors per call, besides the fcntl() one */
+#define FGROUPFSYNC_BARRIER     0x00000001      /* finish with F_BARRIERFSYNC rather than F_FULLFSYNC */
+
+typedef struct fgroupfsync {
+	unsigned int fgf_flags;                 /* IN: FGROUPFSYNC_* */
+	unsigned int fgf_count;                 /* IN: descriptors in fgf_fds */
+	int          fgf_fds[FGROUPFSYNC_MAX];  /* IN: synced along with the fcntl() descriptor */
+} fgroupfsync_t;
 #endif // PRIVATE
 
 /*
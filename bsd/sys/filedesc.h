@@ -90,6 +90,7 @@
 
 struct klist;
 struct kqwllist;
+struct knhash;
 
 __options_decl(filedesc_flags_t, uint8_t, {
 	/*
@@ -149,9 +150,8 @@ struct filedesc {
 	u_long              fd_kqhashmask;  /* (Q) size of dynamic kqueue hash */
 	struct  kqwllist   *fd_kqhash;      /* (Q) hash table for dynamic kqueues */
 
-	lck_mtx_t           fd_knhashlock;  /* (N) lock for hash table for attached knotes */
-	u_long              fd_knhashmask;  /* (N) size of knhash */
-	struct  klist      *fd_knhash;      /* (N) hash table for attached knotes */
+	lck_mtx_t           fd_knhashlock;  /* (N) lock for allocating and freeing fd_knhash */
+	struct  knhash     *fd_knhash;      /* (N) sharded hash table for attached knotes */
 };
 
 #define fdt_flag_test(fdt, flag)        (((fdt)->fd_flags & (flag)) != 0)
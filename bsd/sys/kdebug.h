@@ -280,6 +280,7 @@ __BEGIN_DECLS
 #define MACH_MODE_UNDEMOTE_FAILSAFE      0x5d /* Sched mode undemotion - failsafe */
 #define MACH_MODE_UNDEMOTE_RT_RESTRICTED 0x5e /* Sched mode undemotion - rt restricted */
 #define MACH_INT_MASKED_RESET           0x5f /* interrupt masked threshold reset */
+#define MACH_SCHED_WI_DEADLINE_MISS     0x60 /* work interval finished past its deadline */
 
 /* Codes for Clutch/Edge Scheduler (DBG_MACH_SCHED_CLUTCH) */
 #define MACH_SCHED_CLUTCH_ROOT_BUCKET_STATE     0x0 /* __unused */
@@ -670,6 +671,7 @@ __BEGIN_DECLS
  * Codes for Kernel Debug Sub Class DBG_VFS
  */
 #define DBG_VFS_IO_COMPRESSION_STATS 0x1000
+#define DBG_VFS_READDIRATTR_PREFETCH 0x1001
 
 /* The Kernel Debug Sub Classes for BSD */
 #define DBG_BSD_PROC              0x01 /* process/signals related */
@@ -687,6 +689,10 @@ __BEGIN_DECLS
 #define BSD_PROC_EXEC              3  /* process spawn / exec */
 #define BSD_PROC_EXITREASON_CREATE 4  /* exit reason creation */
 #define BSD_PROC_EXITREASON_COMMIT 5  /* exit reason commited to a proc */
+#define BSD_PROC_SPAWN_FILE_ACTS   6  /* posix_spawn file actions */
+#define BSD_PROC_SPAWN_PORT_ACTS   7  /* posix_spawn port actions */
+#define BSD_PROC_EXEC_IMAGE_LOAD   8  /* spawn / exec image activation */
+#define BSD_PROC_EXEC_SHARED_REGN  9  /* spawn / exec shared region setup */
 
 /* Codes for BSD subcode class DBG_BSD_MEMSTAT */
 #define BSD_MEMSTAT_SCAN             1  /* memorystatus thread awake */
@@ -140,6 +140,11 @@ struct kd_buffer {
 	struct kd_bufinfo *kdb_info;
 	struct kd_region *kd_bufs;
 	kd_buf *kdcopybuf;
+	// Per-CPU rings, only when `KDBG_MAPPED` is set.
+	kd_mapped_ring_header *kdb_mapped;
+	vm_size_t kdb_mapped_size;
+	vm_size_t kdb_mapped_ring_size;
+	uint32_t kdb_mapped_capacity;
 };
 
 struct kd_record {
@@ -361,6 +361,10 @@ __options_decl(kdebug_flags_t, uint32_t, {
 	KDBG_DISABLE_COPROCS = 0x0400,
 	// Disable tracing on event match.
 	KDBG_MATCH_DISABLE = 0x0800,
+	// Events are written to per-CPU rings mapped into the reader.
+	KDBG_MAPPED = 0x1000,
+	// Check events against the sampling and rate limit rules.
+	KDBG_RATE_CHECK = 0x2000,
 	// Check the typefilter.
 	KDBG_TYPEFILTER_CHECK = 0x00400000,
 	// 64-bit debug ID present in arg4 (triage-only).
@@ -415,6 +419,71 @@ typedef struct {
 	uint64_t kem_args[4];
 } kd_event_matcher;
 
+// The most sampling and rate limit rules that can be set.
+#define KDBG_RATE_RULES_MAX 16
+
+// Sampling and rate limit rules, set with `KERN_KDSET_RATE`.
+//
+// Events that pass the filter and match `kdr_debugid` under `kdr_mask`, which
+// must select at least the class, are thinned out by the first matching rule.
+// Only 1 in `kdr_sample` events is kept on each CPU, and the events left are
+// limited to `kdr_rate` per second with bursts up to `kdr_burst` events.  A
+// zero `kdr_sample` or `kdr_rate` turns that stage off.  `DBG_TRACE` events are
+// never dropped.
+//
+// The counts are filled in by `KERN_KDGET_RATE`, so analysis can reweight the
+// events that were kept.
+typedef struct {
+	uint32_t kdr_debugid;
+	uint32_t kdr_mask;
+	uint32_t kdr_sample;
+	uint32_t kdr_rate;
+	uint32_t kdr_burst;
+	uint32_t kdr_padding;
+	uint64_t kdr_matched;
+	uint64_t kdr_sampled_out;
+	uint64_t kdr_rate_limited;
+} kd_rate_rule;
+
+#if defined(__LP64__) || defined(__arm64__)
+
+// Mapped per-CPU rings, set up with `KERN_KDMAPBUFS`.
+//
+// Each CPU (and coprocessor) gets its own ring of `kdmr_capacity` events,
+// right after this header, and rings are `kdmi_ring_size` bytes apart in the
+// read-only mapping.  Writers claim slot `kdmr_head & (kdmr_capacity - 1)` by
+// incrementing the head, clear the event's `unused` field, fill in the event
+// and then store the slot's index plus one into `unused` with release
+// semantics.  The ring overwrites its oldest events when it wraps.
+//
+// Readers keep their own tail for each ring -- the mapping can't be written
+// to -- and, for the slot at `tail`:
+//
+//   - `unused == tail + 1`: the event is valid if `unused` still matches
+//     after copying it out;
+//   - `unused < tail + 1`: the event hasn't been written yet;
+//   - `unused > tail + 1`: the writer lapped the reader, which lost events
+//     and should resume at `kdmr_head - kdmr_capacity`.
+//
+// Events from different rings are merged by timestamp in user space.
+typedef struct {
+	uint64_t kdmr_head;
+	uint32_t kdmr_capacity;
+	uint32_t kdmr_cpu;
+	uint64_t kdmr_reserved[6];
+} kd_mapped_ring_header;
+
+// Returned by `KERN_KDMAPBUFS`.
+typedef struct {
+	uint64_t kdmi_address;
+	uint64_t kdmi_size;
+	uint64_t kdmi_ring_size;
+	uint32_t kdmi_ring_count;
+	uint32_t kdmi_ring_capacity;
+} kd_mapped_info;
+
+#endif // defined(__LP64__) || defined(__arm64__)
+
 // Options for `kdebug_enable` in the comm-page.
 #define KDEBUG_COMMPAGE_ENABLE_TRACE      0x1
 #define KDEBUG_COMMPAGE_ENABLE_TYPEFILTER 0x2
@@ -117,6 +117,27 @@ typedef struct memorystatus_priority_entry {
 	uint32_t state;
 } memorystatus_priority_entry_t;
 
+/*
+ * MEMORYSTATUS_CMD_GET_PRIORITY_LIST_DELTA
+ *
+ * The caller passes in the generation returned by its previous call (0 for
+ * the first one). The buffer is filled with this header, followed by
+ * changed_count memorystatus_priority_entry_t for the processes that were
+ * added or changed band since that generation, followed by removed_count
+ * pid_t for the processes that exited. If the kernel could not record every
+ * change, MEMORYSTATUS_DELTA_OVERFLOW is set and the caller must resync with
+ * MEMORYSTATUS_CMD_GET_PRIORITY_LIST before using the returned generation.
+ */
+#define MEMORYSTATUS_DELTA_OVERFLOW             0x1
+
+typedef struct memorystatus_priority_delta_header {
+	uint64_t generation;    /* in: last generation seen, out: current generation */
+	uint32_t changed_count;
+	uint32_t removed_count;
+	uint32_t flags;
+	uint32_t reserved;
+} memorystatus_priority_delta_header_t;
+
 /*
  * This should be the structure to specify different properties
  * for processes (group or single) from user-space. Unfortunately,
@@ -376,6 +397,7 @@ __END_DECLS
 #define MEMORYSTATUS_CMD_GET_PROCESS_COALITION_IS_SWAPPABLE 26 /* Get the swappable status for this process' coalition. */
 
 #define MEMORYSTATUS_CMD_CONVERT_MEMLIMIT_MB 28 /* Given a memlimit value (which may be 0 or -1), convert it to an actual limit in megabytes. */
+#define MEMORYSTATUS_CMD_GET_PRIORITY_LIST_DELTA 29 /* Get the processes whose band changed since a previous generation. */
 
 /* Commands that act on a group of processes */
 #define MEMORYSTATUS_CMD_GRP_SET_PROPERTIES           100
@@ -323,6 +323,7 @@ typedef struct mcache {
 	size_t          mc_chunksize;           /* bufsize + alignment */
 	u_int32_t       mc_bkt_contention;      /* lock contention count */
 	u_int32_t       mc_bkt_contention_prev; /* previous snapshot */
+	u_int64_t       mc_bkt_xfer_prev;       /* bucket transfers snapshot */
 
 	/*
 	 * Per-CPU layer, aligned at cache line boundary
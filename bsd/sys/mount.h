@@ -824,6 +824,32 @@ OS_ENUM(vfs_roles, uint32_t,
 
 #endif /* KERNEL */
 
+#ifdef PRIVATE
+/*
+ * read ahead statistics of a mount, from the vfs.generic.readahead_stats
+ * sysctl (written the fsid of the mount)
+ */
+struct vfs_readahead_stats {
+	uint64_t        vrs_hits;       /* pages read that had been prefetched */
+	uint64_t        vrs_waste;      /* pages prefetched but not read by their stream */
+	uint32_t        vrs_latency;    /* read latency, usecs (moving average) */
+	uint32_t        vrs_reserved;
+};
+
+/*
+ * order in which the write-behind pushes the scattered dirty data of a
+ * file, set per mount with the vfs.generic.writebehind_order sysctl
+ * (which hands back the previous order)
+ */
+#define VFS_WB_ORDER_OFFSET     0       /* sweep each file by offset (default) */
+#define VFS_WB_ORDER_AGE        1       /* oldest dirty data first */
+
+struct vfs_writebehind_order {
+	fsid_t          vwo_fsid;
+	uint32_t        vwo_order;
+};
+#endif /* PRIVATE */
+
 /*
  * flags passed into vfs_iterate
  */
@@ -202,6 +202,11 @@ struct mount {
 
 	uint64_t                mnt_mount_id;               /* system-wide unique mount ID */
 	uint32_t                mnt_supl_kern_flag;         /* Supplemental kernel-only mount flags */
+
+	uint32_t                mnt_ra_latency;             /* read latency seen by the read ahead, usecs (EWMA) */
+	uint64_t                mnt_ra_hits;                /* pages read that the read ahead had prefetched */
+	uint64_t                mnt_ra_waste;               /* pages prefetched that their stream didn't read */
+	uint32_t                mnt_wb_order;               /* VFS_WB_ORDER_* for scattered dirty data */
 };
 
 /*
@@ -282,6 +287,7 @@ extern struct mount * const dead_mountp;
  * exhausted, so this is intended as a supplement.
  */
 #define MNTK_SUPL_BASESYSTEM    0x00000001
+#define MNTK_SUPL_PASSTHROUGH   0x00000002      /* layered fs whose vnodes may be mapped through their backing vnode */
 
 
 /*
@@ -460,6 +466,7 @@ void    dounmount_submounts(struct mount *, int, vfs_context_t);
 
 /* xnu internal api */
 void  mount_dropcrossref(mount_t, vnode_t, int);
+void  vfs_setpassthrough(mount_t);
 mount_t mount_lookupby_volfsid(int, int);
 mount_t mount_list_lookupby_fsid(fsid_t *, int, int);
 int  mount_list_add(mount_t);
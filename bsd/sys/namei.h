@@ -86,6 +86,7 @@
 
 #include <sys/queue.h>
 #include <sys/uio.h>
+#include <kern/smr.h>
 #include <sys/vnode.h>
 #include <sys/mount.h>
 #include <sys/filedesc.h>
@@ -145,6 +146,7 @@ struct nameidata {
 #define NAMEI_COMPOUND_OP_MASK (NAMEI_COMPOUNDOPEN | NAMEI_COMPOUNDREMOVE | NAMEI_COMPOUNDMKDIR | NAMEI_COMPOUNDRMDIR | NAMEI_COMPOUNDRENAME)
 
 #define NAMEI_NOFOLLOW_ANY      0x1000  /* no symlinks allowed in the path */
+#define NAMEI_PATHCACHED        0x2000  /* cache_lookup_path() resolved the whole path, see cache_path_enter() */
 
 #ifdef KERNEL
 /*
@@ -239,15 +241,23 @@ struct nameidata {
 /*
  * This structure describes the elements in the cache of recent
  * names looked up by namei.
+ *
+ * The hash chains can be walked in an SMR read section without the
+ * name cache lock (see cache_lookup_path()), so an entry that has been
+ * deleted is only freed, and its name only released, once no such
+ * walk can still be looking at it.
  */
+SMR_POINTER_DECL(namecache_smr, struct namecache *);
+
 struct  namecache {
-	TAILQ_ENTRY(namecache)  nc_entry;       /* chain of all entries */
+	TAILQ_ENTRY(namecache)  nc_entry;       /* chain of all (or retired) entries */
 	TAILQ_ENTRY(namecache)  nc_child;       /* chain of ncp's that are children of a vp */
 	union {
 		LIST_ENTRY(namecache)  nc_link; /* chain of ncp's that 'name' a vp */
 		TAILQ_ENTRY(namecache) nc_negentry; /* chain of ncp's that 'name' a vp */
+		smr_seq_t              nc_free_seq; /* retired: free once readers are past */
 	} nc_un;
-	LIST_ENTRY(namecache)   nc_hash;        /* hash chain */
+	struct namecache_smr    nc_hash;        /* hash chain */
 	vnode_t                 nc_dvp;         /* vnode of parent of name */
 	vnode_t                 nc_vp;          /* vnode the name refers to */
 	unsigned int            nc_hashval;     /* hashval of stringname */
@@ -272,8 +282,11 @@ void    kdebug_lookup(struct vnode *dp, struct componentname *cnp);
  * namecache function prototypes
  */
 void    cache_purgevfs(mount_t mp);
+void    cache_smr_synchronize(void);
 int             cache_lookup_path(struct nameidata *ndp, struct componentname *cnp, vnode_t dp,
     vfs_context_t context, int *dp_authorized, vnode_t last_dp);
+vnode_t         cache_path_lookup(struct nameidata *ndp, vfs_context_t context, uint64_t *genp);
+void            cache_path_enter(struct nameidata *ndp, vfs_context_t context, uint64_t gen);
 
 void            vnode_cache_authorized_action(vnode_t vp, vfs_context_t context, kauth_action_t action);
 void            vnode_uncache_authorized_action(vnode_t vp, kauth_action_t action);
@@ -112,16 +112,18 @@ struct pipebuf {
 };
 
 
-#ifdef PIPE_DIRECT
+#ifdef KERNEL
 /*
- * Information to support direct transfers between processes for pipes.
+ * Information to support direct transfers between processes for pipes:
+ * the writer's pages are wired by a UPL and mapped in the kernel while
+ * PIPE_DIRECTW is set, and readers copy out of them directly.
  */
+struct upl;
 struct pipemapping {
-	vm_offset_t     kva;            /* kernel virtual address */
-	vm_size_t       cnt;            /* number of chars in buffer */
+	struct upl      *upl;           /* UPL wiring the writer's pages */
+	vm_offset_t     kva;            /* kernel address of the writer's data */
+	vm_size_t       cnt;            /* number of chars in the mapping */
 	vm_size_t       pos;            /* current position of transfer */
-	int             npages;         /* number of pages */
-	vm_page_t       ms[PIPENPAGES]; /* pages in source process */
 };
 #endif
 
@@ -154,9 +156,7 @@ struct label;
  */
 struct pipe {
 	struct  pipebuf pipe_buffer;    /* data storage */
-#ifdef PIPE_DIRECT
 	struct  pipemapping pipe_map;   /* pipe mapping for direct I/O */
-#endif
 	struct  selinfo pipe_sel;       /* for compat with select */
 	pid_t   pipe_pgid;              /* information for async I/O */
 	struct  pipe *pipe_peer;        /* link with other direction */
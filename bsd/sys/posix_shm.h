@@ -52,6 +52,15 @@ struct label;
 
 #define PSHMNAMLEN      31      /* maximum name segment length we bother with */
 
+#ifdef PRIVATE
+/*
+ * Additional shm_open() flags, honoured when the call creates the object.
+ * They reuse open(2) bits that only have meaning for vnodes.
+ */
+#define O_SHM_PREFAULT  0x00040000      /* populate mappings at mmap() time */
+#define O_SHM_LARGEPAGE 0x00080000      /* size and align for large pages */
+#endif /* PRIVATE */
+
 struct pshminfo {
 	unsigned int pshm_flags;
 	unsigned int pshm_usecount;
@@ -1067,6 +1067,24 @@ struct channel_fdinfo {
 #define PROC_INFO_CALL_UDATA_INFO        0xe
 #define PROC_INFO_CALL_SET_DYLD_IMAGES   0xf
 #define PROC_INFO_CALL_TERMINATE_RSR     0x10
+#define PROC_INFO_CALL_PIDINFO_BATCH     0x11
+
+/*
+ * One entry of a PROC_INFO_CALL_PIDINFO_BATCH request.  The caller fills in
+ * the pid, flavor, arg and size; the kernel fills in the rest.  Each result
+ * is packed into the output buffer at pbe_offset, aligned to 8 bytes.
+ */
+struct proc_pidinfo_batch_entry {
+	int32_t         pbe_pid;
+	int32_t         pbe_flavor;
+	uint64_t        pbe_arg;
+	uint32_t        pbe_size;       /* space to reserve for this result */
+	uint32_t        pbe_offset;     /* out: offset of the result in the buffer */
+	int32_t         pbe_retval;     /* out: bytes returned by the flavor */
+	int32_t         pbe_error;      /* out: errno for this entry, or 0 */
+};
+
+#define PROC_PIDINFO_BATCH_MAX          4096
 
 /* __proc_info_extended_id() flags */
 #define PIF_COMPARE_IDVERSION           0x01
@@ -471,6 +471,7 @@ struct proc {
 	int32_t           p_memstat_memlimit_active;    /* memory limit enforced when process is in active jetsam state */
 	int32_t           p_memstat_memlimit_inactive;  /* memory limit enforced when process is in inactive jetsam state */
 	int32_t           p_memstat_relaunch_flags;     /* flags indicating relaunch behavior for the process */
+	uint64_t          p_memstat_change_gen;         /* memorystatus_change_gen at the last band change. Protected by proc_list_lock */
 #if CONFIG_FREEZE
 	uint32_t          p_memstat_freeze_sharedanon_pages; /* shared pages left behind after freeze */
 	uint32_t          p_memstat_frozen_count;
@@ -480,6 +481,7 @@ struct proc {
 #endif /* CONFIG_MEMORYSTATUS */
 
 	_Atomic uint32_t  p_user_faults; /* count the number of user faults generated */
+	_Atomic uint32_t  p_dirty_pages; /* pages dirtied through the cluster layer since the last write-back wait */
 
 	uint32_t          p_memlimit_increase; /* byte increase for memory limit for dyld SPI rdar://problem/49950264, structure packing 32-bit and 64-bit */
 
@@ -854,6 +856,7 @@ struct proc *phash_find_locked(pid_t);
 extern void phash_insert_locked(pid_t pid, struct proc *);
 extern void phash_remove_locked(pid_t pid, struct proc *);
 extern void phash_replace_locked(pid_t pid, struct proc *old_proc, struct proc *new_proc);
+extern void phash_foreach_smr(bool (^fn)(struct proc *));
 struct pgrp *pghash_find_locked(pid_t);
 extern void pghash_insert_locked(pid_t pgid, struct pgrp *);
 extern struct pgrp *pgrp_find(pid_t);
@@ -433,7 +433,8 @@ struct rusage_info_v6 {
 	uint64_t ri_pcycles;
 	uint64_t ri_energy_nj;
 	uint64_t ri_penergy_nj;
-	uint64_t ri_reserved[14];
+	uint64_t ri_memory_bytes;
+	uint64_t ri_reserved[13];
 };
 
 typedef struct rusage_info_v6 rusage_info_current;
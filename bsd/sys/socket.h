@@ -372,6 +372,22 @@ struct so_mark_cellfallback_uuid_args {
 	int flow_cellfallback;
 };
 
+#define SO_ZEROCOPY                0x1133  /* send large TCP writes without copying (int) */
+#define SO_ZEROCOPY_STAT           0x1134  /* zero-copy send progress (struct so_zerocopy_stat) */
+
+/*
+ * Bytes of zero-copy sends handed to the stack, and how many of those the
+ * stack has since released.  Once zcs_completed covers a write, the pages
+ * that backed it are no longer shared with the kernel and may be reused
+ * without taking a copy-on-write fault.
+ */
+struct so_zerocopy_stat {
+	u_int64_t zcs_sent;
+	u_int64_t zcs_completed;
+};
+
+#define SO_BUSY_POLL               0x1135  /* usecs to poll the interface before a read sleeps (int) */
+
 #endif
 
 
@@ -351,6 +351,9 @@ struct socket {
 	u_int8_t        so_log_seqn;    /* Multi-layer Packet Logging rolling sequence number */
 	uint8_t         so_mpkl_send_proto;
 	uuid_t          so_mpkl_send_uuid;
+
+	struct sozerocopy *so_zerocopy; /* SO_ZEROCOPY send state */
+	uint32_t        so_busy_poll;   /* SO_BUSY_POLL budget in usecs */
 };
 
 /* Control message accessor in mbufs */
@@ -49,6 +49,52 @@ typedef struct stackshot_config {
 	uint64_t                sc_pagetable_mask;      /* Mask of page table levels to dump, must pass STACKSHOT_PAGE_TABLES */
 } stackshot_config_t;
 
+/*
+ * Layout of the ring written by STACKSHOT_DELTA_RING stackshots.
+ *
+ * The kernel allocates the ring on first use (sized by the config's size
+ * hint) and maps it read-only into the calling task; sc_buffer and sc_size
+ * describe the mapping and stay valid across captures.
+ *
+ * The header is followed by ssr_size bytes of record space.  Positions are
+ * logical byte counts that only grow; a record at logical position P lives
+ * at offset (P % ssr_size) of the record space.  Each record is a
+ * stackshot_ring_record_t followed by ssrr_size bytes of kcdata, padded to
+ * STACKSHOT_RING_ALIGN.  Records never straddle the end of the ring: a
+ * record with STACKSHOT_RING_RECORD_WRAP set carries no data and means the
+ * next record starts at offset 0.
+ *
+ * The newest record starts at ssr_last and ends at ssr_head.  A reader that
+ * copied the record at P must re-read ssr_write afterwards and discard the
+ * copy if (ssr_write - P) > ssr_size, as it was overwritten in between.
+ *
+ * Delta records only contain tasks and threads that ran since the previous
+ * record, so readers must keep state for everything else; a reader that fell
+ * behind should take a capture without STACKSHOT_COLLECT_DELTA_SNAPSHOT to
+ * get a full record and resynchronize.
+ */
+#define STACKSHOT_RING_MAGIC            0x53535247      /* 'SSRG' */
+#define STACKSHOT_RING_ALIGN            16
+
+typedef struct stackshot_ring_header {
+	uint32_t                ssr_magic;              /* STACKSHOT_RING_MAGIC */
+	uint32_t                ssr_size;               /* bytes of record space after the header */
+	volatile uint64_t       ssr_head;               /* logical end of the newest record */
+	volatile uint64_t       ssr_write;              /* logical end of the space the kernel may be writing */
+	volatile uint64_t       ssr_last;               /* logical start of the newest record */
+	uint64_t                ssr_generation;         /* number of records written */
+	uint64_t                ssr_timestamp;          /* mach_absolute_time() at which the newest record was taken */
+	uint64_t                ssr_reserved[2];
+} stackshot_ring_header_t;
+
+#define STACKSHOT_RING_RECORD_WRAP      0x1             /* no data, continue at offset 0 */
+
+typedef struct stackshot_ring_record {
+	uint32_t                ssrr_size;              /* bytes of kcdata following the record header */
+	uint32_t                ssrr_flags;             /* STACKSHOT_RING_RECORD_* */
+	uint64_t                ssrr_generation;        /* value of ssr_generation for this record */
+} stackshot_ring_record_t;
+
 typedef struct stackshot_stats {
 	uint64_t        ss_last_start;          /* mach_absolute_time of last start */
 	uint64_t        ss_last_end;            /* mach_absolute_time of last end */
@@ -145,6 +145,25 @@ struct ctlname {
 	int     ctl_type;       /* type of name */
 };
 
+#ifdef PRIVATE
+/*
+ * One entry of a batched read through the {CTL_UNSPEC, 5} ("sysctl.batch")
+ * OID.  The caller passes an array of these as the new value; on return the
+ * old buffer starts with the updated array, and each successful entry's value
+ * lives sbe_size bytes at sbe_offset into that buffer.  On input sbe_size is
+ * the space to reserve for the entry.
+ */
+struct sysctl_batch_entry {
+	int             sbe_name[CTL_MAXNAME];
+	uint32_t        sbe_namelen;
+	uint32_t        sbe_size;
+	uint32_t        sbe_offset;
+	int32_t         sbe_error;
+};
+
+#define SYSCTL_BATCH_MAX        256     /* most entries in one batch */
+#endif /* PRIVATE */
+
 #define CTLTYPE             0xf             /* Mask for the type */
 #define CTLTYPE_NODE        1               /* name is a node */
 #define CTLTYPE_INT         2               /* name describes an integer */
@@ -856,6 +875,9 @@ SYSCTL_DECL(_hw_features);
 #define KERN_KDSET_EDM        26
 #define KERN_KDGET_EDM        27
 #define KERN_KDWRITETR_V3     28
+#define KERN_KDMAPBUFS        29
+#define KERN_KDSET_RATE       30
+#define KERN_KDGET_RATE       31
 
 #define CTL_KERN_NAMES { \
 	{ 0, 0 }, \
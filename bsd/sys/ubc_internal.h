@@ -78,21 +78,31 @@ struct cl_wextent {
 	int             io_flags;
 };
 
+/*
+ * read ahead state of one sequential stream through a file; a file
+ * tracks up to CL_READAHEAD_STREAMS of them (ubc_info.cl_rahead points
+ * to an array), so that interleaved readers each get their read ahead
+ */
+#define CL_READAHEAD_STREAMS    4
+
 struct cl_readahead {
 	lck_mtx_t       cl_lockr;
 	daddr64_t       cl_lastr;                       /* last block read by client */
 	daddr64_t       cl_maxra;                       /* last block prefetched by the read ahead */
 	int             cl_ralen;                       /* length of last prefetch */
+	uint32_t        cl_rate;                        /* pages/sec the client consumes (EWMA) */
+	uint64_t        cl_lastuse;                     /* mach_absolute_time() of the last read */
 };
 
 struct cl_writebehind {
 	lck_mtx_t       cl_lockw;
-	void    *       cl_scmap;                       /* pointer to sparse cluster map */
+	void    *       cl_scmap;                       /* pointer to dirty extent map (vfs_dxt_*) */
 	off_t           cl_last_write;                  /* offset of the end of the last write */
 	off_t           cl_seq_written;                 /* sequentially written bytes */
 	int             cl_sparse_pushes;               /* number of pushes outside of the cl_lockw in progress */
 	int             cl_sparse_wait;                 /* synchronous push is in progress */
 	int             cl_number;                      /* number of packed write behind clusters currently valid */
+	_Atomic uint32_t cl_dirty_pages;                /* pages dirtied by delayed writes and not yet written back */
 	struct cl_wextent cl_clusters[MAX_CLUSTERS];    /* packed write behind clusters */
 };
 
@@ -102,6 +102,7 @@ __private_extern__ void uio_setcurriovlen( uio_t a_uio, user_size_t a_value );
 __private_extern__ int uio_spacetype( uio_t a_uio );
 __private_extern__ uio_t  uio_createwithbuffer( int a_iovcount, off_t a_offset, int a_spacetype, int a_iodirection, void *a_buf_p, size_t a_buffer_size );
 __private_extern__ int copyin_user_iovec_array(user_addr_t uaddr, int spacetype, int count, struct user_iovec *dst);
+__private_extern__ void unpack_user_iovec_array(int spacetype, int count, struct user_iovec *dst);
 /* reverse of uio_update to "undo" uncommited I/O. This only works in
  * limited cases */
 __private_extern__ void uio_pushback( uio_t a_uio, user_size_t a_count );
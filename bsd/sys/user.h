@@ -181,6 +181,7 @@ struct uthread {
 			uint32_t upcall_flags;
 			bool has_stack;
 			thread_qos_t qos;
+			uint16_t park_cpu;                   /* cpu the thread parked on */
 		} uus_workq_park_data;                   /* saved for parked workq threads */
 
 		struct _ulock_wait_data {
@@ -90,6 +90,7 @@
 
 struct lockf;
 struct label;
+struct xattr_cache;
 
 LIST_HEAD(buflists, buf);
 
@@ -149,9 +150,9 @@ typedef struct file_lease *file_lease_t;
 
 /*
  * Reading or writing any of these items requires holding the appropriate lock.
- * v_freelist is locked by the global vnode_list_lock
+ * v_freelist is locked by the global vnode_list_lock (and a per-cpu cache lock while VLIST_PCPU)
  * v_mntvnodes is locked by the mount_lock
- * v_nclinks and v_ncchildren are protected by the global name_cache_lock
+ * v_nclinks, v_ncchildren and v_ncnegcount are protected by the global name_cache_lock
  * v_cleanblkhd and v_dirtyblkhd and v_iterblkflags are locked via the global buf_mtx
  * the rest of the structure is protected by the vnode_lock
  */
@@ -216,6 +217,8 @@ struct vnode {
 	                                         *  set, points to target */
 #endif /* CONFIG_FIRMLINKS */
 	uint32_t       v_holdcount;               /* reference to keep vnode from being freed after reclaim */
+	uint32_t       v_ncnegcount;              /* negative name cache entries among v_ncchildren */
+	struct xattr_cache *v_xattr_cache;        /* recently read extended attributes */
 #if CONFIG_IO_COMPRESSION_STATS
 	io_compression_stats_t io_compression_stats;            /* IO compression statistics */
 #endif /* CONFIG_IO_COMPRESSION_STATS */
@@ -252,6 +255,7 @@ struct vnode {
 #define VLIST_DEAD                0x02          /* vnode is currently in the dead list */
 #define VLIST_ASYNC_WORK          0x04          /* vnode is currently on the deferred async work queue */
 #define VLIST_NO_REUSE            0x08          /* vnode should not be reused, will be deallocated */
+#define VLIST_PCPU                0x10          /* vnode is dead and parked on a per-cpu cache */
 
 /*
  * v_lflags
@@ -466,6 +470,7 @@ int     vn_open(struct nameidata *ndp, int fmode, int cmode);
 int     vn_open_modflags(struct nameidata *ndp, int *fmode, int cmode);
 int     vn_open_auth(struct nameidata *ndp, int *fmode, struct vnode_attr *, vnode_t authvp);
 int     vn_close(vnode_t, int flags, vfs_context_t ctx);
+int     vn_fsync_group(vnode_t *vps, int count, boolean_t barrier, vfs_context_t ctx);
 errno_t vn_remove(vnode_t dvp, vnode_t *vpp, struct nameidata *ndp, int32_t flags, struct vnode_attr *vap, vfs_context_t ctx);
 errno_t vn_rename(struct vnode *fdvp, struct vnode **fvpp, struct componentname *fcnp, struct vnode_attr *fvap,
     struct vnode *tdvp, struct vnode **tvpp, struct componentname *tcnp, struct vnode_attr *tvap,
@@ -518,6 +523,8 @@ int     vn_getxattr(vnode_t, const char *, uio_t, size_t *, int, vfs_context_t);
 int     vn_setxattr(vnode_t, const char *, uio_t, int, vfs_context_t);
 int     vn_removexattr(vnode_t, const char *, int, vfs_context_t);
 int     vn_listxattr(vnode_t, uio_t, size_t *, int, vfs_context_t);
+void    vn_xattr_cache_invalidate(vnode_t);
+void    vn_xattr_cache_free(vnode_t);
 
 #if NAMEDSTREAMS
 errno_t  vnode_getnamedstream(vnode_t, vnode_t *, const char *, enum nsoperation, int, vfs_context_t);
@@ -645,6 +652,7 @@ vnode_readdir64(struct vnode *vp, struct uio *uio, int flags, int *eofflag,
     int *numdirent, vfs_context_t ctxp);
 
 void vnode_setswapmount(vnode_t);
+int vnode_getpassthroughvnode(vnode_t, vnode_t *);
 int64_t vnode_getswappin_avail(vnode_t);
 
 int vnode_get_snapdir(vnode_t, vnode_t *, vfs_context_t);
@@ -60,6 +60,7 @@ extern kern_return_t arm64_late_pan_test(void);
 #endif
 extern kern_return_t copyio_test(void);
 extern kern_return_t parse_boot_arg_test(void);
+extern kern_return_t in_cksum_test(void);
 
 struct xnupost_test bsd_post_tests[] = {
 #ifdef __arm64__
@@ -78,6 +79,7 @@ struct xnupost_test bsd_post_tests[] = {
 	XNUPOST_TEST_CONFIG_BASIC(ipi_test),
 	XNUPOST_TEST_CONFIG_BASIC(copyio_test),
 	XNUPOST_TEST_CONFIG_BASIC(parse_boot_arg_test),
+	XNUPOST_TEST_CONFIG_BASIC(in_cksum_test),
 };
 
 uint32_t bsd_post_tests_count = sizeof(bsd_post_tests) / sizeof(xnupost_test_data_t);
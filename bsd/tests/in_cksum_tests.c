@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <kern/clock.h>
+#include <kern/kalloc.h>
+#include <libkern/libkern.h>
+#include <tests/ktest.h>
+#include <tests/xnupost.h>
+
+#if !(DEVELOPMENT || DEBUG)
+#error "Testing is not enabled on RELEASE configurations"
+#endif
+
+kern_return_t in_cksum_test(void);
+
+extern uint32_t os_cpu_in_cksum(const void *, uint32_t, uint32_t);
+#if defined(__x86_64__)
+extern uint64_t (*os_cpu_in_cksum_vec)(const void *, uint32_t);
+#endif /* __x86_64__ */
+#if SKYWALK
+extern uint32_t os_cpu_copy_in_cksum(const void *, void *, uint32_t, uint32_t);
+#if defined(__x86_64__)
+extern int os_cpu_copy_in_cksum_avx2;
+#endif /* __x86_64__ */
+#endif /* SKYWALK */
+
+#define IN_CKSUM_TEST_BUFSZ     (16 * 1024)
+#define IN_CKSUM_BENCH_ROUNDS   1000
+
+/* RFC 1071, one 16-bit word at a time */
+static uint16_t
+in_cksum_ref(const uint8_t *p, uint32_t len)
+{
+	uint64_t sum = 0;
+
+	for (; len > 1; p += 2, len -= 2) {
+		sum += *(const uint16_t *)(const void *)p;
+	}
+	if (len) {
+#if BYTE_ORDER == LITTLE_ENDIAN
+		sum += *p;
+#else
+		sum += *p << 8;
+#endif
+	}
+	while (sum >> 16) {
+		sum = (sum >> 16) + (sum & 0xffff);
+	}
+	return (uint16_t)sum;
+}
+
+static uint64_t
+in_cksum_bench(const uint8_t *buf, uint32_t len)
+{
+	uint64_t start, ns;
+	volatile uint32_t sum = 0;
+
+	start = mach_absolute_time();
+	for (int i = 0; i < IN_CKSUM_BENCH_ROUNDS; i++) {
+		sum += os_cpu_in_cksum(buf, len, 0);
+	}
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+	return ns / IN_CKSUM_BENCH_ROUNDS;
+}
+
+#if SKYWALK
+static uint64_t
+copy_in_cksum_bench(const uint8_t *src, uint8_t *dst, uint32_t len)
+{
+	uint64_t start, ns;
+	volatile uint32_t sum = 0;
+
+	start = mach_absolute_time();
+	for (int i = 0; i < IN_CKSUM_BENCH_ROUNDS; i++) {
+		sum += os_cpu_copy_in_cksum(src, dst, len, 0);
+	}
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+	return ns / IN_CKSUM_BENCH_ROUNDS;
+}
+
+/* what the copy costs when done in two passes */
+static uint64_t
+copy_then_cksum_bench(const uint8_t *src, uint8_t *dst, uint32_t len)
+{
+	uint64_t start, ns;
+	volatile uint32_t sum = 0;
+
+	start = mach_absolute_time();
+	for (int i = 0; i < IN_CKSUM_BENCH_ROUNDS; i++) {
+		bcopy(src, dst, len);
+		sum += os_cpu_in_cksum(dst, len, 0);
+	}
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+	return ns / IN_CKSUM_BENCH_ROUNDS;
+}
+
+static uint32_t
+copy_in_cksum_check(const uint8_t *buf, uint8_t *dst, const uint32_t *lens,
+    uint32_t nlens)
+{
+	uint32_t errors = 0;
+
+	for (uint32_t i = 0; i < nlens; i++) {
+		for (uint32_t off = 0; off < 8; off++) {
+			uint32_t sum;
+
+			memset(dst, 0, IN_CKSUM_TEST_BUFSZ);
+			sum = os_cpu_copy_in_cksum(buf + off, dst + (off & 3),
+			    lens[i], 0);
+			if (sum != in_cksum_ref(buf + off, lens[i]) ||
+			    memcmp(buf + off, dst + (off & 3), lens[i]) != 0) {
+				T_LOG("copy mismatch at len %u, offset %u",
+				    lens[i], off);
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+#endif /* SKYWALK */
+
+kern_return_t
+in_cksum_test(void)
+{
+	uint32_t lens[] = { 1, 20, 63, 64, 255, 256, 257, 1460, 1500, 4096, 9000 };
+	uint32_t bench_lens[] = { 64, 1500, 9000, IN_CKSUM_TEST_BUFSZ - 8 };
+	uint8_t *buf;
+	uint32_t errors = 0;
+
+	buf = kalloc_data(IN_CKSUM_TEST_BUFSZ, Z_WAITOK | Z_NOFAIL);
+	for (uint32_t i = 0; i < IN_CKSUM_TEST_BUFSZ; i++) {
+		buf[i] = (uint8_t)(random() & 0xff);
+	}
+
+	/* every alignment, on both sides of the vector threshold */
+	for (uint32_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		for (uint32_t off = 0; off < 8; off++) {
+			if (os_cpu_in_cksum(buf + off, lens[i], 0) !=
+			    in_cksum_ref(buf + off, lens[i])) {
+				T_LOG("mismatch at len %u, offset %u", lens[i], off);
+				errors++;
+			}
+		}
+	}
+	/* all ones data makes every partial reduction carry */
+	memset(buf, 0xff, IN_CKSUM_TEST_BUFSZ);
+	if (os_cpu_in_cksum(buf, IN_CKSUM_TEST_BUFSZ, 0) !=
+	    in_cksum_ref(buf, IN_CKSUM_TEST_BUFSZ)) {
+		T_LOG("mismatch on all ones data");
+		errors++;
+	}
+	T_ASSERT_EQ_UINT(errors, 0, "os_cpu_in_cksum matches the reference sum");
+
+#if SKYWALK
+	uint32_t copy_lens[] = { 1, 2, 20, 40, 63, 64, 127, 128, 255, 256, 257,
+		                 320, 1460, 1500, 4096, 9000 };
+	uint32_t copy_bench_lens[] = { 20, 64, 256, 1500, 9000,
+		                       IN_CKSUM_TEST_BUFSZ - 8 };
+	uint8_t *dst;
+
+	dst = kalloc_data(IN_CKSUM_TEST_BUFSZ, Z_WAITOK | Z_NOFAIL);
+	for (uint32_t i = 0; i < IN_CKSUM_TEST_BUFSZ; i++) {
+		buf[i] = (uint8_t)(random() & 0xff);
+	}
+	errors = copy_in_cksum_check(buf, dst, copy_lens,
+	    sizeof(copy_lens) / sizeof(copy_lens[0]));
+#if defined(__x86_64__)
+	if (os_cpu_copy_in_cksum_avx2) {
+		/* the SSE loop must keep working too */
+		os_cpu_copy_in_cksum_avx2 = 0;
+		errors += copy_in_cksum_check(buf, dst, copy_lens,
+		    sizeof(copy_lens) / sizeof(copy_lens[0]));
+		os_cpu_copy_in_cksum_avx2 = 1;
+	}
+#endif /* __x86_64__ */
+	T_ASSERT_EQ_UINT(errors, 0,
+	    "os_cpu_copy_in_cksum copies and matches the reference sum");
+
+	for (uint32_t i = 0;
+	    i < sizeof(copy_bench_lens) / sizeof(copy_bench_lens[0]); i++) {
+		uint32_t len = copy_bench_lens[i];
+		uint64_t fused_ns = copy_in_cksum_bench(buf, dst, len);
+		uint64_t twopass_ns = copy_then_cksum_bench(buf, dst, len);
+#if defined(__x86_64__)
+		int avx2 = os_cpu_copy_in_cksum_avx2;
+		uint64_t sse_ns;
+
+		os_cpu_copy_in_cksum_avx2 = 0;
+		sse_ns = copy_in_cksum_bench(buf, dst, len);
+		os_cpu_copy_in_cksum_avx2 = avx2;
+		T_LOG("{PERFORMANCE} copy len: %u, fused: %llu ns "
+		    "(avx2 %d), sse: %llu ns, copy then sum: %llu ns",
+		    len, fused_ns, avx2, sse_ns, twopass_ns);
+#else
+		T_LOG("{PERFORMANCE} copy len: %u, fused: %llu ns, "
+		    "copy then sum: %llu ns", len, fused_ns, twopass_ns);
+#endif /* __x86_64__ */
+	}
+	kfree_data(dst, IN_CKSUM_TEST_BUFSZ);
+#endif /* SKYWALK */
+
+	for (uint32_t i = 0; i < sizeof(bench_lens) / sizeof(bench_lens[0]); i++) {
+#if defined(__x86_64__)
+		uint64_t (*vec)(const void *, uint32_t) = os_cpu_in_cksum_vec;
+		uint64_t generic_ns, vec_ns;
+
+		/* other callers only pay for the scalar path while this runs */
+		os_cpu_in_cksum_vec = NULL;
+		generic_ns = in_cksum_bench(buf, bench_lens[i]);
+		os_cpu_in_cksum_vec = vec;
+		vec_ns = in_cksum_bench(buf, bench_lens[i]);
+		T_LOG("{PERFORMANCE} len: %u, generic: %llu ns, vector: %llu ns",
+		    bench_lens[i], generic_ns, vec_ns);
+#else
+		T_LOG("{PERFORMANCE} len: %u, %llu ns", bench_lens[i],
+		    in_cksum_bench(buf, bench_lens[i]));
+#endif /* __x86_64__ */
+	}
+
+	kfree_data(buf, IN_CKSUM_TEST_BUFSZ);
+	return KERN_SUCCESS;
+}
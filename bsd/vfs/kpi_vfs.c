@@ -127,6 +127,10 @@
 #include <miscfs/nullfs/nullfs.h>
 #endif
 
+#if BINDFS
+#include <miscfs/bindfs/bindfs.h>
+#endif
+
 #include <sys/sdt.h>
 
 #define ESUCCESS 0
@@ -3273,6 +3277,33 @@ vnode_getbackingvnode(vnode_t in_vp, vnode_t* out_vpp)
 #endif
 }
 
+/*
+ * If in_vp lives on a layered mount in passthrough mode, return the lower
+ * vnode it wraps with an iocount, so that callers such as mmap can operate
+ * on the lower vnode's UBC instead of building a second copy of its pages.
+ */
+int
+vnode_getpassthroughvnode(vnode_t in_vp, vnode_t *out_vpp)
+{
+	mount_t mp = vnode_mount(in_vp);
+
+	*out_vpp = NULLVP;
+	if (mp == NULL || (mp->mnt_supl_kern_flag & MNTK_SUPL_PASSTHROUGH) == 0) {
+		return ENOENT;
+	}
+#if NULLFS
+	if (strcmp(vfs_statfs(mp)->f_fstypename, "nullfs") == 0) {
+		return nullfs_getbackingvnode(in_vp, out_vpp);
+	}
+#endif
+#if BINDFS
+	if (strcmp(vfs_statfs(mp)->f_fstypename, "bindfs") == 0) {
+		return bindfs_getbackingvnode(in_vp, out_vpp);
+	}
+#endif
+	return ENOENT;
+}
+
 /*
  * Initialize a struct vnode_attr and activate the attributes required
  * by the vnode_notify() call.
@@ -5966,6 +5997,7 @@ VNOP_SETXATTR(vnode_t vp, const char *name, uio_t uio, int options, vfs_context_
 
 	error = (*vp->v_op[vnop_setxattr_desc.vdesc_offset])(&a);
 	DTRACE_FSINFO(setxattr, vnode_t, vp);
+	vn_xattr_cache_invalidate(vp);
 
 	if (error == 0) {
 		vnode_uncache_authorized_action(vp, KAUTH_INVALIDATE_CACHED_RIGHTS);
@@ -5990,6 +6022,7 @@ VNOP_REMOVEXATTR(vnode_t vp, const char *name, int options, vfs_context_t ctx)
 
 	error = (*vp->v_op[vnop_removexattr_desc.vdesc_offset])(&a);
 	DTRACE_FSINFO(removexattr, vnode_t, vp);
+	vn_xattr_cache_invalidate(vp);
 
 	post_event_if_success(vp, error, NOTE_ATTRIB);
 
@@ -50,6 +50,10 @@
 #include <sys/xattr.h>
 #include <sys/fsevents.h>
 #include <kern/zalloc.h>
+#include <kern/thread.h>
+#include <sys/kdebug.h>
+#include <sys/sysctl.h>
+#include <libkern/OSAtomic.h>
 #include <miscfs/specfs/specdev.h>
 #include <security/audit/audit.h>
 
@@ -3781,6 +3785,336 @@ out:
 #define MIN_BUF_SIZE_REQUIRED  (sizeof(uint32_t) + sizeof(attribute_set_t) +\
     sizeof(attrreference_t))
 
+/*
+ * "." and ".." (and a bunch of other invalid conditions) are not
+ * returned by readdirattr.
+ */
+static inline bool
+direntry_is_skipped(struct direntry *dp)
+{
+	return !dp->d_reclen || dp->d_ino == 0 || dp->d_namlen == 0 ||
+	       (dp->d_namlen == 1 && dp->d_name[0] == '.') ||
+	       (dp->d_namlen == 2 && dp->d_name[0] == '.' &&
+	       dp->d_name[1] == '.');
+}
+
+/*
+ * Directory attribute prefetch for the readdirattr() fallback.
+ *
+ * Without native VNOP_GETATTRLISTBULK support every entry costs a
+ * namei() of the child, which for a cold directory means one
+ * synchronous metadata read per entry.  While readdirattr() works on
+ * the current entry, a small pool of worker threads looks up the next
+ * readdirattr_prefetch_window entries of the per-fd direntry buffer so
+ * that their metadata reads are in flight in parallel; by the time
+ * readdirattr() gets to them the vnodes are in the name cache.
+ *
+ * The workers only warm the caches.  Lookups are done with the
+ * caller's credentials and every entry is still looked up and packed
+ * by readdirattr() itself.  All prefetches issued by a call are
+ * finished (or cancelled) before readdirattr() returns, which is what
+ * keeps the directory's iocount valid for the workers.
+ */
+#define RDA_PREFETCH_MAX_WINDOW  16
+#define RDA_PREFETCH_THREADS     4
+
+static int readdirattr_prefetch_window = 8;
+static uint64_t readdirattr_prefetch_cached = 0;
+static uint64_t readdirattr_prefetch_disk = 0;
+
+SYSCTL_DECL(_vfs_generic);
+SYSCTL_INT(_vfs_generic, OID_AUTO, readdirattr_prefetch_window,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &readdirattr_prefetch_window, 0,
+    "number of entries getattrlistbulk looks up ahead (0 disables)");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, readdirattr_prefetch_cached,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &readdirattr_prefetch_cached,
+    "getattrlistbulk entries found in the name cache");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, readdirattr_prefetch_disk,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &readdirattr_prefetch_disk,
+    "getattrlistbulk entries that had to be looked up by the filesystem");
+
+#define RDA_SLOT_FREE    0
+#define RDA_SLOT_QUEUED  1      /* on rda_prefetch_queue */
+#define RDA_SLOT_BUSY    2      /* a worker is looking it up */
+#define RDA_SLOT_DONE    3
+
+struct rda_prefetch;
+
+struct rda_slot {
+	TAILQ_ENTRY(rda_slot) rs_link;
+	struct rda_prefetch *rs_pf;
+	int             rs_state;       /* protected by rda_prefetch_lock */
+	int             rs_waiting;
+	int             rs_cached;      /* entry was already in the name cache */
+	off_t           rs_soff;        /* fv_soff of the buffer the entry came from */
+	size_t          rs_off;         /* offset of the entry in that buffer */
+	char            rs_name[MAXNAMLEN + 1];
+};
+
+struct rda_prefetch {
+	vnode_t         pf_dvp;
+	kauth_cred_t    pf_cred;
+	caddr_t         pf_buf;         /* fv_buf that pf_nextoff refers to */
+	off_t           pf_soff;
+	size_t          pf_nextoff;     /* next direntry in pf_buf to prefetch */
+	int             pf_window;
+	int             pf_head;        /* oldest slot, slots are in directory order */
+	int             pf_count;
+	uint32_t        pf_cached;
+	uint32_t        pf_disk;
+	struct rda_slot pf_slots[RDA_PREFETCH_MAX_WINDOW];
+};
+
+static LCK_GRP_DECLARE(rda_prefetch_lck_grp, "readdirattr-prefetch");
+static LCK_MTX_DECLARE(rda_prefetch_lock, &rda_prefetch_lck_grp);
+static TAILQ_HEAD(, rda_slot) rda_prefetch_queue =
+    TAILQ_HEAD_INITIALIZER(rda_prefetch_queue);
+static int rda_prefetch_threads_started = 0;
+
+/*
+ * Returns 1 if the name cache already knows about name in dvp.
+ */
+static int
+rda_lookup_cached(vnode_t dvp, const char *name)
+{
+	struct componentname cn;
+	vnode_t vp = NULLVP;
+	int error;
+
+	bzero(&cn, sizeof(cn));
+	cn.cn_nameiop = LOOKUP;
+	cn.cn_flags = MAKEENTRY;
+	cn.cn_nameptr = __DECONST(char *, name);
+	cn.cn_namelen = (int)strlen(name);
+
+	error = cache_lookup(dvp, &vp, &cn);
+	if (error == -1) {
+		vnode_put(vp);
+		return 1;
+	}
+
+	return error == ENOENT;
+}
+
+static void
+rda_prefetch_lookup(struct rda_slot *rs)
+{
+	struct rda_prefetch *pf = rs->rs_pf;
+	struct vfs_context context;
+	uthread_t ut = current_uthread();
+	vnode_t vp = NULLVP;
+
+	rs->rs_cached = rda_lookup_cached(pf->pf_dvp, rs->rs_name);
+	if (rs->rs_cached) {
+		return;
+	}
+
+	context.vc_thread = current_thread();
+	context.vc_ucred = pf->pf_cred;
+
+	/* age these the same way the caller's own lookups are aged */
+	ut->uu_flag |= UT_KERN_RAGE_VNODES;
+	if (vnode_lookupat(rs->rs_name,
+	    VNODE_LOOKUP_NOFOLLOW | VNODE_LOOKUP_NOCROSSMOUNT, &vp, &context,
+	    pf->pf_dvp) == 0) {
+		vnode_put(vp);
+	}
+	ut->uu_flag &= ~UT_KERN_RAGE_VNODES;
+}
+
+static void
+rda_prefetch_thread(__unused void *arg, __unused wait_result_t wr)
+{
+	struct rda_slot *rs;
+
+	lck_mtx_lock(&rda_prefetch_lock);
+	for (;;) {
+		rs = TAILQ_FIRST(&rda_prefetch_queue);
+		if (rs == NULL) {
+			msleep(&rda_prefetch_queue, &rda_prefetch_lock, PVFS,
+			    "rda_prefetch", NULL);
+			continue;
+		}
+		TAILQ_REMOVE(&rda_prefetch_queue, rs, rs_link);
+		rs->rs_state = RDA_SLOT_BUSY;
+		lck_mtx_unlock(&rda_prefetch_lock);
+
+		rda_prefetch_lookup(rs);
+
+		lck_mtx_lock(&rda_prefetch_lock);
+		rs->rs_state = RDA_SLOT_DONE;
+		if (rs->rs_waiting) {
+			rs->rs_waiting = 0;
+			wakeup(rs);
+		}
+	}
+}
+
+static struct rda_prefetch *
+rda_prefetch_create(vnode_t dvp, vfs_context_t ctx)
+{
+	struct rda_prefetch *pf;
+	int window = readdirattr_prefetch_window;
+	thread_t thread;
+	int i;
+
+	if (window <= 0) {
+		return NULL;
+	}
+
+	if (!rda_prefetch_threads_started) {
+		lck_mtx_lock(&rda_prefetch_lock);
+		if (rda_prefetch_threads_started) {
+			lck_mtx_unlock(&rda_prefetch_lock);
+		} else {
+			rda_prefetch_threads_started = 1;
+			lck_mtx_unlock(&rda_prefetch_lock);
+
+			for (i = 0; i < RDA_PREFETCH_THREADS; i++) {
+				if (kernel_thread_start(rda_prefetch_thread, NULL,
+				    &thread) == KERN_SUCCESS) {
+					thread_deallocate(thread);
+				}
+			}
+		}
+	}
+
+	pf = kalloc_type(struct rda_prefetch, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	pf->pf_dvp = dvp;
+	pf->pf_cred = vfs_context_ucred(ctx);
+	kauth_cred_ref(pf->pf_cred);
+	pf->pf_window = MIN(window, RDA_PREFETCH_MAX_WINDOW);
+
+	return pf;
+}
+
+/*
+ * Wait for a slot that has been taken off the ring.  Returns false if
+ * the lookup never ran (it was still queued and has been cancelled).
+ */
+static bool
+rda_slot_finish(struct rda_slot *rs)
+{
+	bool ran = true;
+
+	lck_mtx_lock(&rda_prefetch_lock);
+	if (rs->rs_state == RDA_SLOT_QUEUED) {
+		TAILQ_REMOVE(&rda_prefetch_queue, rs, rs_link);
+		ran = false;
+	}
+	while (rs->rs_state == RDA_SLOT_BUSY) {
+		rs->rs_waiting = 1;
+		msleep(rs, &rda_prefetch_lock, PVFS, "rda_slot", NULL);
+	}
+	rs->rs_state = RDA_SLOT_FREE;
+	lck_mtx_unlock(&rda_prefetch_lock);
+
+	return ran;
+}
+
+/*
+ * Queue lookups for the entries following dp, the entry at fv_bufdone,
+ * until the window is full or the buffer is exhausted.
+ */
+static void
+rda_prefetch_issue(struct rda_prefetch *pf, struct fd_vn_data *fvd,
+    struct direntry *dp)
+{
+	struct rda_slot *rs;
+	int queued = 0;
+
+	if (fvd->fv_buf != pf->pf_buf || fvd->fv_soff != pf->pf_soff ||
+	    pf->pf_nextoff <= fvd->fv_bufdone) {
+		pf->pf_buf = fvd->fv_buf;
+		pf->pf_soff = fvd->fv_soff;
+		pf->pf_nextoff = fvd->fv_bufdone + dp->d_reclen;
+	}
+
+	lck_mtx_lock(&rda_prefetch_lock);
+	while (pf->pf_count < pf->pf_window && pf->pf_nextoff < fvd->fv_bufsiz) {
+		dp = (struct direntry *)(fvd->fv_buf + pf->pf_nextoff);
+		if (dp->d_reclen == 0) {
+			pf->pf_nextoff = fvd->fv_bufsiz;
+			break;
+		}
+		rs = &pf->pf_slots[(pf->pf_head + pf->pf_count) % RDA_PREFETCH_MAX_WINDOW];
+		rs->rs_off = pf->pf_nextoff;
+		pf->pf_nextoff += dp->d_reclen;
+
+		if (direntry_is_skipped(dp) || dp->d_namlen > MAXNAMLEN) {
+			continue;
+		}
+
+		assert(rs->rs_state == RDA_SLOT_FREE);
+		rs->rs_pf = pf;
+		rs->rs_soff = fvd->fv_soff;
+		rs->rs_waiting = 0;
+		bcopy(dp->d_name, rs->rs_name, dp->d_namlen);
+		rs->rs_name[dp->d_namlen] = '\0';
+		rs->rs_state = RDA_SLOT_QUEUED;
+		TAILQ_INSERT_TAIL(&rda_prefetch_queue, rs, rs_link);
+		pf->pf_count++;
+		queued++;
+	}
+	lck_mtx_unlock(&rda_prefetch_lock);
+
+	if (queued) {
+		wakeup(&rda_prefetch_queue);
+	}
+}
+
+/*
+ * Consume the prefetch for the entry at fv_bufdone, if one was issued,
+ * dropping any stale slots ahead of it.  Returns 1 if the entry came
+ * from the name cache, 0 if the filesystem had to look it up and -1 if
+ * there is no prefetch result for it.
+ */
+static int
+rda_prefetch_take(struct rda_prefetch *pf, struct fd_vn_data *fvd)
+{
+	struct rda_slot *rs;
+	bool ran;
+
+	while (pf->pf_count > 0) {
+		rs = &pf->pf_slots[pf->pf_head];
+		if (rs->rs_soff == fvd->fv_soff && rs->rs_off > fvd->fv_bufdone) {
+			/* the oldest prefetch is for an entry further ahead */
+			return -1;
+		}
+
+		pf->pf_head = (pf->pf_head + 1) % RDA_PREFETCH_MAX_WINDOW;
+		pf->pf_count--;
+		ran = rda_slot_finish(rs);
+
+		if (rs->rs_soff == fvd->fv_soff && rs->rs_off == fvd->fv_bufdone) {
+			return ran ? rs->rs_cached : -1;
+		}
+	}
+
+	return -1;
+}
+
+static void
+rda_prefetch_destroy(struct rda_prefetch *pf)
+{
+	struct rda_slot *rs;
+
+	while (pf->pf_count > 0) {
+		rs = &pf->pf_slots[pf->pf_head];
+		pf->pf_head = (pf->pf_head + 1) % RDA_PREFETCH_MAX_WINDOW;
+		pf->pf_count--;
+		(void)rda_slot_finish(rs);
+	}
+
+	OSAddAtomic64(pf->pf_cached, (SInt64 *)&readdirattr_prefetch_cached);
+	OSAddAtomic64(pf->pf_disk, (SInt64 *)&readdirattr_prefetch_disk);
+	KDBG_RELEASE(FSDBG_CODE(DBG_VFS, DBG_VFS_READDIRATTR_PREFETCH) | DBG_FUNC_NONE,
+	    pf->pf_cached, pf->pf_disk, pf->pf_window);
+
+	kauth_cred_unref(&pf->pf_cred);
+	kfree_type(struct rda_prefetch, pf);
+}
+
 /*
  * Read directory entries and get attributes filled in for each directory
  */
@@ -3792,6 +4126,7 @@ readdirattr(vnode_t dvp, struct fd_vn_data *fvd, uio_t auio,
 	caddr_t kern_attr_buf;
 	size_t kern_attr_buf_siz;
 	caddr_t max_path_name_buf = NULL;
+	struct rda_prefetch *pf;
 	int error = 0;
 
 	*count = 0;
@@ -3814,6 +4149,7 @@ readdirattr(vnode_t dvp, struct fd_vn_data *fvd, uio_t auio,
 	}
 
 	kern_attr_buf = kalloc_data(kern_attr_buf_siz, Z_WAITOK);
+	pf = rda_prefetch_create(dvp, ctx);
 
 	while (uio_resid(auio) > (user_ssize_t)MIN_BUF_SIZE_REQUIRED) {
 		struct direntry *dp;
@@ -3825,6 +4161,7 @@ readdirattr(vnode_t dvp, struct fd_vn_data *fvd, uio_t auio,
 		size_t bytes_left;
 		size_t pad_bytes;
 		ssize_t new_resid;
+		int cached = -1;
 
 		/*
 		 * get_direntry returns the current direntry and does not
@@ -3839,10 +4176,7 @@ readdirattr(vnode_t dvp, struct fd_vn_data *fvd, uio_t auio,
 		/*
 		 * skip "." and ".." (and a bunch of other invalid conditions.)
 		 */
-		if (!dp->d_reclen || dp->d_ino == 0 || dp->d_namlen == 0 ||
-		    (dp->d_namlen == 1 && dp->d_name[0] == '.') ||
-		    (dp->d_namlen == 2 && dp->d_name[0] == '.' &&
-		    dp->d_name[1] == '.')) {
+		if (direntry_is_skipped(dp)) {
 			direntry_done(fvd);
 			continue;
 		}
@@ -3861,6 +4195,20 @@ readdirattr(vnode_t dvp, struct fd_vn_data *fvd, uio_t auio,
 			name_buffer = CAST_USER_ADDR_T(&(dp->d_name));
 		}
 
+		/*
+		 * Pick up the result of this entry's prefetch (if any) and
+		 * get the lookups for the entries after it going before we
+		 * do our own.
+		 */
+		if (pf) {
+			cached = rda_prefetch_take(pf, fvd);
+			if (cached < 0) {
+				cached = rda_lookup_cached(dvp,
+				    CAST_DOWN_EXPLICIT(char *, name_buffer));
+			}
+			rda_prefetch_issue(pf, fvd, dp);
+		}
+
 		/*
 		 * We have an iocount on the directory already.
 		 *
@@ -3887,6 +4235,14 @@ readdirattr(vnode_t dvp, struct fd_vn_data *fvd, uio_t auio,
 
 		vp = nd.ni_vp;
 
+		if (pf) {
+			if (cached) {
+				pf->pf_cached++;
+			} else {
+				pf->pf_disk++;
+			}
+		}
+
 		/*
 		 * getattrlist_internal can change the values of the
 		 * the required attribute list. Copy the current values
@@ -3984,6 +4340,10 @@ readdirattr(vnode_t dvp, struct fd_vn_data *fvd, uio_t auio,
 		direntry_done(fvd);
 	}
 
+	if (pf) {
+		rda_prefetch_destroy(pf);
+	}
+
 	if (max_path_name_buf) {
 		zfree(ZV_NAMEI, max_path_name_buf);
 	}
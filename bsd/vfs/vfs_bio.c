@@ -88,6 +88,7 @@
 #include <sys/kauth.h>
 #if DIAGNOSTIC
 #include <kern/assert.h>
+#include <kern/cpu_number.h>
 #endif /* DIAGNOSTIC */
 #include <kern/task.h>
 #include <kern/zalloc.h>
@@ -112,11 +113,15 @@
 
 #include <sys/sdt.h>
 
+struct bufshard;
+
 int     bcleanbuf(buf_t bp, boolean_t discard);
 static int      brecover_data(buf_t bp);
 static boolean_t incore(vnode_t vp, daddr64_t blkno);
 /* timeout is in msecs */
-static buf_t    getnewbuf(int slpflag, int slptimeo, int *queue);
+static buf_t    getnewbuf(struct bufshard *bs, int slpflag, int slptimeo, int *queue);
+static void     getnewbuf_wait(struct bufshard *bs, int slpflag, int slptimeo);
+static buf_t    getnewbuf_steal(struct bufshard *bs);
 static void     bremfree_locked(buf_t bp);
 static void     buf_reassign(buf_t bp, vnode_t newvp);
 static errno_t  buf_acquire_locked(buf_t bp, int flags, int slpflag, int slptimeo);
@@ -136,7 +141,7 @@ extern void disk_conditioner_delay(buf_t, int, int, uint64_t);
 
 /* zone allocated buffer headers */
 static void     bcleanbuf_thread_init(void);
-static void     bcleanbuf_thread(void);
+static void     bcleanbuf_thread(void *, wait_result_t);
 
 static ZONE_DEFINE_TYPE(buf_hdr_zone, "buf headers", struct buf, ZC_NONE);
 static int      buf_hdr_count;
@@ -147,7 +152,7 @@ static int      buf_hdr_count;
  */
 #define BUFHASH(dvp, lbn)       \
 	(&bufhashtbl[((long)(dvp) / sizeof(*(dvp)) + (int)(lbn)) & bufhash])
-LIST_HEAD(bufhashhdr, buf) * bufhashtbl, invalhash;
+LIST_HEAD(bufhashhdr, buf) * bufhashtbl;
 u_long  bufhash;
 
 static buf_t    incore_locked(vnode_t vp, daddr64_t blkno, struct bufhashhdr *dp);
@@ -157,24 +162,57 @@ struct bufstats bufstats;
 
 /* Number of delayed write buffers */
 long nbdwrite = 0;
-int blaundrycnt = 0;
 static int boot_nbuf_headers = 0;
 
 static TAILQ_HEAD(delayqueue, buf) delaybufqueue;
 
 static TAILQ_HEAD(ioqueue, buf) iobufqueue;
-static TAILQ_HEAD(bqueues, buf) bufqueues[BQUEUES];
+TAILQ_HEAD(bqueues, buf);
 static int needbuffer;
+static uint32_t needbuffer_gen; /* bumped by buf_brelse when it clears needbuffer */
 static int need_iobuffer;
 
+/*
+ * The buffer hash and free lists are split into NBUF_SHARDS shards so
+ * that lookups and releases of unrelated blocks don't all serialize on
+ * a single lock.  A hash bucket belongs to shard (bucket & BUFSHARD_MASK),
+ * and a buffer belongs to the shard of the bucket its (vnode, blkno)
+ * hashes to... buffers that aren't associated with a block sit on the
+ * shard's own invalhash.
+ *
+ * bs_mtx protects the shard's hash chains and free lists, and b_whichq,
+ * b_lflags and the shadow state of every buffer in the shard.  buf_mtx
+ * protects the per-vnode buffer lists and v_iterblkflags; when both are
+ * needed, buf_mtx is taken first.  b_shard only changes for a busy buffer
+ * that is on no hash chain, free list or vnode list, and only with both
+ * the old and the new shard locked.
+ */
+#define NBUF_SHARDS     8
+#define BUFSHARD_MASK   (NBUF_SHARDS - 1)
+
+struct bufshard {
+	__attribute__((aligned(128))) lck_mtx_t bs_mtx;
+	struct bqueues          bs_queues[BQUEUES];
+	struct bufhashhdr       bs_invalhash;
+	int                     bs_laundrycnt;
+};
+
+static struct bufshard bufshards[NBUF_SHARDS];
+
+#define BUFSHARD(dp)    (&bufshards[((dp) - bufhashtbl) & BUFSHARD_MASK])
+
 static LCK_GRP_DECLARE(buf_mtx_grp, "buffer cache");
 static LCK_ATTR_DECLARE(buf_mtx_attr, 0, 0);
 static LCK_MTX_DECLARE_ATTR(iobuffer_mtxp, &buf_mtx_grp, &buf_mtx_attr);
 static LCK_MTX_DECLARE_ATTR(buf_mtx, &buf_mtx_grp, &buf_mtx_attr);
 static LCK_MTX_DECLARE_ATTR(buf_gc_callout, &buf_mtx_grp, &buf_mtx_attr);
+static LCK_MTX_DECLARE_ATTR(needbuffer_mtx, &buf_mtx_grp, &buf_mtx_attr);
 
 static uint32_t buf_busycount;
 
+#define buf_busycount_inc()     os_atomic_inc(&buf_busycount, relaxed)
+#define buf_busycount_dec()     os_atomic_dec(&buf_busycount, relaxed)
+
 #define FS_BUFFER_CACHE_GC_CALLOUTS_MAX_SIZE 16
 typedef struct {
 	void (* callout)(int, void *);
@@ -284,16 +322,70 @@ bremhash(buf_t  bp)
 	*bp->b_hash.le_prev = (bp)->b_hash.le_next;
 }
 
+static __inline__ struct bufshard *
+buf_shard(buf_t bp)
+{
+	return &bufshards[bp->b_shard];
+}
+
+/*
+ * Lock the shard that owns bp... b_shard can only change while the
+ * old shard is locked, so it's stable once we hold the lock it named.
+ */
+static struct bufshard *
+buf_shard_lock(buf_t bp)
+{
+	struct bufshard *bs;
+
+	for (;;) {
+		bs = &bufshards[os_atomic_load(&bp->b_shard, relaxed)];
+
+		lck_mtx_lock_spin(&bs->bs_mtx);
+
+		if (bs == buf_shard(bp)) {
+			return bs;
+		}
+		lck_mtx_unlock(&bs->bs_mtx);
+	}
+}
+
+/*
+ * Hand a busy buffer that is on no hash chain, free list or
+ * vnode list over to shard 'to'.
+ * called with bp's shard locked, returns with 'to' locked
+ */
+static void
+buf_shard_move(buf_t bp, struct bufshard *to)
+{
+	struct bufshard *from = buf_shard(bp);
+
+	if (from == to) {
+		return;
+	}
+	if (from < to) {
+		lck_mtx_lock_spin(&to->bs_mtx);
+	} else {
+		lck_mtx_unlock(&from->bs_mtx);
+		lck_mtx_lock_spin(&to->bs_mtx);
+		lck_mtx_lock_spin(&from->bs_mtx);
+	}
+	bp->b_shard = (int)(to - bufshards);
+
+	lck_mtx_unlock(&from->bs_mtx);
+}
+
 /*
- * buf_mtx held.
+ * bp's shard lock held.
  */
 static __inline__ void
 bmovelaundry(buf_t bp)
 {
+	struct bufshard *bs = buf_shard(bp);
+
 	bp->b_whichq = BQ_LAUNDRY;
 	bp->b_timestamp = buf_timestamp();
-	binstailfree(bp, &bufqueues[BQ_LAUNDRY], BQ_LAUNDRY);
-	blaundrycnt++;
+	binstailfree(bp, &bs->bs_queues[BQ_LAUNDRY], BQ_LAUNDRY);
+	bs->bs_laundrycnt++;
 }
 
 static __inline__ void
@@ -879,6 +971,7 @@ static buf_t
 buf_create_shadow_internal(buf_t bp, boolean_t force_copy, uintptr_t external_storage, void (*iodone)(buf_t, void *), void *arg, int priv)
 {
 	buf_t   io_bp;
+	struct bufshard *bs;
 
 	KERNEL_DEBUG(0xbbbbc000 | DBG_FUNC_START, bp, 0, 0, 0, 0);
 
@@ -920,7 +1013,7 @@ buf_create_shadow_internal(buf_t bp, boolean_t force_copy, uintptr_t external_st
 		}
 		*(buf_t *)(&io_bp->b_orig) = bp;
 
-		lck_mtx_lock_spin(&buf_mtx);
+		bs = buf_shard_lock(bp);
 
 		io_bp->b_lflags |= BL_SHADOW;
 		io_bp->b_shadow = bp->b_shadow;
@@ -934,7 +1027,7 @@ buf_create_shadow_internal(buf_t bp, boolean_t force_copy, uintptr_t external_st
 			bp->b_data_ref++;
 		}
 #endif
-		lck_mtx_unlock(&buf_mtx);
+		lck_mtx_unlock(&bs->bs_mtx);
 	} else {
 		if (external_storage) {
 #ifdef BUF_MAKE_PRIVATE
@@ -967,6 +1060,7 @@ buf_make_private(buf_t bp)
 	buf_t   ds_bp;
 	buf_t   t_bp;
 	struct buf my_buf;
+	struct bufshard *bs;
 
 	KERNEL_DEBUG(0xbbbbc004 | DBG_FUNC_START, bp, bp->b_shadow_ref, 0, 0, 0);
 
@@ -980,7 +1074,7 @@ buf_make_private(buf_t bp)
 
 	bcopy((caddr_t)bp->b_datap, (caddr_t)my_buf.b_datap, bp->b_bcount);
 
-	lck_mtx_lock_spin(&buf_mtx);
+	bs = buf_shard_lock(bp);
 
 	for (t_bp = bp->b_shadow; t_bp; t_bp = t_bp->b_shadow) {
 		if (!ISSET(bp->b_lflags, BL_EXTERNAL)) {
@@ -998,7 +1092,7 @@ buf_make_private(buf_t bp)
 	}
 
 	if (ds_bp == NULL) {
-		lck_mtx_unlock(&buf_mtx);
+		lck_mtx_unlock(&bs->bs_mtx);
 
 		buf_free_meta_store(&my_buf);
 
@@ -1015,7 +1109,7 @@ buf_make_private(buf_t bp)
 	bp->b_data_ref = 0;
 	bp->b_datap = my_buf.b_datap;
 
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
 
 	KERNEL_DEBUG(0xbbbbc004 | DBG_FUNC_END, bp, bp->b_shadow_ref, 0, 0, 0);
 	return 0;
@@ -2022,9 +2116,13 @@ buf_itercomplete(vnode_t vp, struct buflists *iterheadp, int flags)
 }
 
 
+/*
+ * called with bp's shard locked
+ */
 static void
 bremfree_locked(buf_t bp)
 {
+	struct bufshard *bs = buf_shard(bp);
 	struct bqueues *dp = NULL;
 	int whichq;
 
@@ -2049,7 +2147,7 @@ bremfree_locked(buf_t bp)
 	 * NB: This makes an assumption about how tailq's are implemented.
 	 */
 	if (bp->b_freelist.tqe_next == NULL) {
-		dp = &bufqueues[whichq];
+		dp = &bs->bs_queues[whichq];
 
 		if (dp->tqh_last != &bp->b_freelist.tqe_next) {
 			panic("bremfree: lost tail");
@@ -2058,7 +2156,7 @@ bremfree_locked(buf_t bp)
 	TAILQ_REMOVE(dp, bp, b_freelist);
 
 	if (whichq == BQ_LAUNDRY) {
-		blaundrycnt--;
+		bs->bs_laundrycnt--;
 	}
 
 	bp->b_whichq = -1;
@@ -2161,30 +2259,39 @@ __private_extern__ void
 bufinit(void)
 {
 	buf_t   bp;
+	struct bufshard *bs;
 	struct bqueues *dp;
 	int     i;
 
 	nbuf_headers = 0;
 	/* Initialize the buffer queues ('freelists') and the hash table */
-	for (dp = bufqueues; dp < &bufqueues[BQUEUES]; dp++) {
-		TAILQ_INIT(dp);
+	for (bs = bufshards; bs < &bufshards[NBUF_SHARDS]; bs++) {
+		lck_mtx_init(&bs->bs_mtx, &buf_mtx_grp, &buf_mtx_attr);
+
+		for (dp = bs->bs_queues; dp < &bs->bs_queues[BQUEUES]; dp++) {
+			TAILQ_INIT(dp);
+		}
+		LIST_INIT(&bs->bs_invalhash);
+		bs->bs_laundrycnt = 0;
 	}
 	bufhashtbl = hashinit(nbuf_hashelements, M_CACHE, &bufhash);
 
 	buf_busycount = 0;
 
-	/* Initialize the buffer headers */
+	/* Initialize the buffer headers, spreading them over the shards */
 	for (i = 0; i < max_nbuf_headers; i++) {
 		nbuf_headers++;
 		bp = &buf_headers[i];
 		bufhdrinit(bp);
 
 		BLISTNONE(bp);
-		dp = &bufqueues[BQ_EMPTY];
+		bp->b_shard = i & BUFSHARD_MASK;
+		bs = buf_shard(bp);
+		dp = &bs->bs_queues[BQ_EMPTY];
 		bp->b_whichq = BQ_EMPTY;
 		bp->b_timestamp = buf_timestamp();
 		binsheadfree(bp, dp, BQ_EMPTY);
-		binshash(bp, &invalhash);
+		binshash(bp, &bs->bs_invalhash);
 	}
 	boot_nbuf_headers = nbuf_headers;
 
@@ -2194,6 +2301,8 @@ bufinit(void)
 	for (; i < nbuf_headers + niobuf_headers; i++) {
 		bp = &buf_headers[i];
 		bufhdrinit(bp);
+		/* io bufs never move, the shard only provides their lock */
+		bp->b_shard = i & BUFSHARD_MASK;
 		bp->b_whichq = -1;
 		binsheadfree(bp, &iobufqueue, -1);
 	}
@@ -2206,7 +2315,7 @@ bufinit(void)
 	printf("using %d buffer headers and %d cluster IO buffer headers\n",
 	    nbuf_headers, niobuf_headers);
 
-	/* start the bcleanbuf() thread */
+	/* start the bcleanbuf() threads */
 	bcleanbuf_thread_init();
 
 	/* Register a callout for relieving vm pressure */
@@ -2595,11 +2704,12 @@ buf_brelse_shadow(buf_t bp)
 	int     data_ref = 0;
 #endif
 	int need_wakeup = 0;
-
-	lck_mtx_lock_spin(&buf_mtx);
+	struct bufshard *bs;
 
 	__IGNORE_WCASTALIGN(bp_head = (buf_t)bp->b_orig);
 
+	bs = buf_shard_lock(bp_head);
+
 	if (bp_head->b_whichq != -1) {
 		panic("buf_brelse_shadow: bp_head on freelist %d", bp_head->b_whichq);
 	}
@@ -2660,10 +2770,10 @@ buf_brelse_shadow(buf_t bp)
 
 			if (ISSET(bp_head->b_flags, B_LOCKED)) {
 				bp_head->b_whichq = BQ_LOCKED;
-				binstailfree(bp_head, &bufqueues[BQ_LOCKED], BQ_LOCKED);
+				binstailfree(bp_head, &bs->bs_queues[BQ_LOCKED], BQ_LOCKED);
 			} else {
 				bp_head->b_whichq = BQ_META;
-				binstailfree(bp_head, &bufqueues[BQ_META], BQ_META);
+				binstailfree(bp_head, &bs->bs_queues[BQ_META], BQ_META);
 			}
 		} else if (ISSET(bp_head->b_lflags, BL_WAITSHADOW)) {
 			CLR(bp_head->b_lflags, BL_WAITSHADOW);
@@ -2675,7 +2785,7 @@ buf_brelse_shadow(buf_t bp)
 			need_wakeup = 1;
 		}
 	}
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
 
 	if (need_wakeup) {
 		wakeup(bp_head);
@@ -2701,6 +2811,7 @@ buf_brelse_shadow(buf_t bp)
 void
 buf_brelse(buf_t bp)
 {
+	struct bufshard *bs;
 	struct bqueues *bufq;
 	int    whichq;
 	upl_t   upl;
@@ -2865,34 +2976,41 @@ buf_brelse(buf_t bp)
 		 */
 		buf_release_credentials(bp);
 
-		lck_mtx_lock_spin(&buf_mtx);
+		bs = buf_shard_lock(bp);
 
 		if (bp->b_shadow_ref) {
 			SET(bp->b_lflags, BL_WAITSHADOW);
 
-			lck_mtx_unlock(&buf_mtx);
+			lck_mtx_unlock(&bs->bs_mtx);
 
 			return;
 		}
+		lck_mtx_unlock(&bs->bs_mtx);
+
 		if (delayed_buf_free_meta_store == TRUE) {
-			lck_mtx_unlock(&buf_mtx);
 finish_shadow_master:
 			buf_free_meta_store(bp);
-
-			lck_mtx_lock_spin(&buf_mtx);
 		}
 		CLR(bp->b_flags, (B_META | B_ZALLOC | B_DELWRI | B_LOCKED | B_AGE | B_ASYNC | B_NOCACHE | B_FUA));
 
+		/*
+		 * the vnode lists are protected by buf_mtx, which
+		 * ranks above the shard lock... we still own the
+		 * buffer, so it's safe to do this before retaking it
+		 */
 		if (bp->b_vp) {
+			lck_mtx_lock_spin(&buf_mtx);
 			brelvp_locked(bp);
+			lck_mtx_unlock(&buf_mtx);
 		}
+		bs = buf_shard_lock(bp);
 
 		bremhash(bp);
 		BLISTNONE(bp);
-		binshash(bp, &invalhash);
+		binshash(bp, &bs->bs_invalhash);
 
 		bp->b_whichq = BQ_EMPTY;
-		binsheadfree(bp, &bufqueues[BQ_EMPTY], BQ_EMPTY);
+		binsheadfree(bp, &bs->bs_queues[BQ_EMPTY], BQ_EMPTY);
 	} else {
 		/*
 		 * It has valid data.  Put it on the end of the appropriate
@@ -2907,16 +3025,15 @@ finish_shadow_master:
 		} else {
 			whichq = BQ_LRU;                /* valid data */
 		}
-		bufq = &bufqueues[whichq];
-
 		bp->b_timestamp = buf_timestamp();
 
-		lck_mtx_lock_spin(&buf_mtx);
+		bs = buf_shard_lock(bp);
+		bufq = &bs->bs_queues[whichq];
 
 		/*
 		 * the buf_brelse_shadow routine doesn't take 'ownership'
 		 * of the parent buf_t... it updates state that is protected by
-		 * the buf_mtx, and checks for BL_BUSY to determine whether to
+		 * the shard lock, and checks for BL_BUSY to determine whether to
 		 * put the buf_t back on a free list.  b_shadow_ref is protected
 		 * by the lock, and since we have not yet cleared B_BUSY, we need
 		 * to check it while holding the lock to insure that one of us
@@ -2936,20 +3053,19 @@ finish_shadow_master:
 			CLR(bp->b_flags, (B_ASYNC | B_NOCACHE));
 		}
 	}
-	if (needbuffer) {
+	if (needbuffer && os_atomic_xchg(&needbuffer, 0, relaxed)) {
 		/*
-		 * needbuffer is a global
-		 * we're currently using buf_mtx to protect it
+		 * needbuffer is a global shared by all the shards,
+		 * so it's cleared atomically rather than under a lock...
 		 * delay doing the actual wakeup until after
-		 * we drop buf_mtx
+		 * we drop the shard lock
 		 */
-		needbuffer = 0;
 		need_wakeup = 1;
 	}
 	if (ISSET(bp->b_lflags, BL_WANTED)) {
 		/*
 		 * delay the actual wakeup until after we
-		 * clear BL_BUSY and we've dropped buf_mtx
+		 * clear BL_BUSY and we've dropped the shard lock
 		 */
 		need_bp_wakeup = 1;
 	}
@@ -2957,14 +3073,19 @@ finish_shadow_master:
 	 * Unlock the buffer.
 	 */
 	CLR(bp->b_lflags, (BL_BUSY | BL_WANTED));
-	buf_busycount--;
+	buf_busycount_dec();
 
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
 
 	if (need_wakeup) {
 		/*
-		 * Wake up any processes waiting for any buffer to become free.
+		 * Wake up any processes waiting for any buffer to become free...
+		 * the generation bump lets a waiter that's still on its way
+		 * to sleep in getnewbuf_wait notice it missed this wakeup
 		 */
+		lck_mtx_lock_spin(&needbuffer_mtx);
+		needbuffer_gen++;
+		lck_mtx_unlock(&needbuffer_mtx);
 		wakeup(&needbuffer);
 	}
 	if (need_bp_wakeup) {
@@ -2989,22 +3110,27 @@ incore(vnode_t vp, daddr64_t blkno)
 {
 	boolean_t retval;
 	struct  bufhashhdr *dp;
+	struct  bufshard *bs;
 
 	dp = BUFHASH(vp, blkno);
+	bs = BUFSHARD(dp);
 
-	lck_mtx_lock_spin(&buf_mtx);
+	lck_mtx_lock_spin(&bs->bs_mtx);
 
 	if (incore_locked(vp, blkno, dp)) {
 		retval = TRUE;
 	} else {
 		retval = FALSE;
 	}
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
 
 	return retval;
 }
 
 
+/*
+ * called with the shard lock for 'dp' held
+ */
 static buf_t
 incore_locked(vnode_t vp, daddr64_t blkno, struct bufhashhdr *dp)
 {
@@ -3026,10 +3152,12 @@ buf_wait_for_shadow_io(vnode_t vp, daddr64_t blkno)
 {
 	buf_t bp;
 	struct  bufhashhdr *dp;
+	struct  bufshard *bs;
 
 	dp = BUFHASH(vp, blkno);
+	bs = BUFSHARD(dp);
 
-	lck_mtx_lock_spin(&buf_mtx);
+	lck_mtx_lock_spin(&bs->bs_mtx);
 
 	for (;;) {
 		if ((bp = incore_locked(vp, blkno, dp)) == NULL) {
@@ -3042,9 +3170,9 @@ buf_wait_for_shadow_io(vnode_t vp, daddr64_t blkno)
 
 		SET(bp->b_lflags, BL_WANTED_REF);
 
-		(void) msleep(bp, &buf_mtx, PSPIN | (PRIBIO + 1), "buf_wait_for_shadow", NULL);
+		(void) msleep(bp, &bs->bs_mtx, PSPIN | (PRIBIO + 1), "buf_wait_for_shadow", NULL);
 	}
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
 }
 
 /* XXX FIXME -- Update the comment to reflect the UBC changes (please) -- */
@@ -3068,6 +3196,7 @@ buf_getblk(vnode_t vp, daddr64_t blkno, int size, int slpflag, int slptimeo, int
 	struct timespec ts;
 	int upl_flags;
 	struct  bufhashhdr *dp;
+	struct  bufshard *bs;
 
 	KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 386)) | DBG_FUNC_START,
 	    (uintptr_t)(blkno * PAGE_SIZE), size, operation, 0, 0);
@@ -3075,8 +3204,9 @@ buf_getblk(vnode_t vp, daddr64_t blkno, int size, int slpflag, int slptimeo, int
 	ret_only_valid = operation & BLK_ONLYVALID;
 	operation &= ~BLK_ONLYVALID;
 	dp = BUFHASH(vp, blkno);
+	bs = BUFSHARD(dp);
 start:
-	lck_mtx_lock_spin(&buf_mtx);
+	lck_mtx_lock_spin(&bs->bs_mtx);
 
 	if ((bp = incore_locked(vp, blkno, dp))) {
 		/*
@@ -3091,7 +3221,7 @@ start:
 			case BLK_WRITE:
 			case BLK_META:
 				SET(bp->b_lflags, BL_WANTED);
-				bufstats.bufs_busyincore++;
+				OSAddAtomicLong(1, &bufstats.bufs_busyincore);
 
 				/*
 				 * don't retake the mutex after being awakened...
@@ -3103,7 +3233,7 @@ start:
 				KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 396)) | DBG_FUNC_NONE,
 				    (uintptr_t)blkno, size, operation, 0, 0);
 
-				err = msleep(bp, &buf_mtx, slpflag | PDROP | (PRIBIO + 1), "buf_getblk", &ts);
+				err = msleep(bp, &bs->bs_mtx, slpflag | PDROP | (PRIBIO + 1), "buf_getblk", &ts);
 
 				/*
 				 * Callers who call with PCATCH or timeout are
@@ -3131,12 +3261,12 @@ start:
 			 */
 			SET(bp->b_lflags, BL_BUSY);
 			SET(bp->b_flags, B_CACHE);
-			buf_busycount++;
+			buf_busycount_inc();
 
 			bremfree_locked(bp);
-			bufstats.bufs_incore++;
+			OSAddAtomicLong(1, &bufstats.bufs_incore);
 
-			lck_mtx_unlock(&buf_mtx);
+			lck_mtx_unlock(&bs->bs_mtx);
 #ifdef JOE_DEBUG
 			bp->b_owner = current_thread();
 			bp->b_tag   = 1;
@@ -3247,14 +3377,14 @@ start:
 		int queue = BQ_EMPTY; /* Start with no preference */
 
 		if (ret_only_valid) {
-			lck_mtx_unlock(&buf_mtx);
+			lck_mtx_unlock(&bs->bs_mtx);
 			return NULL;
 		}
 		if ((vnode_isreg(vp) == 0) || (UBCINFOEXISTS(vp) == 0) /*|| (vnode_issystem(vp) == 1)*/) {
 			operation = BLK_META;
 		}
 
-		if ((bp = getnewbuf(slpflag, slptimeo, &queue)) == NULL) {
+		if ((bp = getnewbuf(bs, slpflag, slptimeo, &queue)) == NULL) {
 			goto start;
 		}
 
@@ -3267,9 +3397,9 @@ start:
 		 */
 		if (incore_locked(vp, blkno, dp)) {
 			SET(bp->b_flags, B_INVAL);
-			binshash(bp, &invalhash);
+			binshash(bp, &bs->bs_invalhash);
 
-			lck_mtx_unlock(&buf_mtx);
+			lck_mtx_unlock(&bs->bs_mtx);
 
 			buf_brelse(bp);
 			goto start;
@@ -3294,7 +3424,16 @@ start:
 		/*
 		 * Insert in the hash so that incore() can find it
 		 */
-		binshash(bp, BUFHASH(vp, blkno));
+		binshash(bp, dp);
+
+		lck_mtx_unlock(&bs->bs_mtx);
+
+		/*
+		 * the buffer is ours (BL_BUSY), so anyone finding it
+		 * through the hash will wait for us... it's safe to put
+		 * it on the vnode's list once we've dropped the shard lock
+		 */
+		lck_mtx_lock_spin(&buf_mtx);
 
 		bgetvp_locked(vp, bp);
 
@@ -3308,11 +3447,11 @@ start:
 			/*
 			 * buffer data is invalid...
 			 *
-			 * I don't want to have to retake buf_mtx,
+			 * I don't want to have to retake the shard lock,
 			 * so the miss and vmhits counters are done
-			 * with Atomic updates... all other counters
-			 * in bufstats are protected with either
-			 * buf_mtx or iobuffer_mtxp
+			 * with Atomic updates... the buffer cache
+			 * counters in bufstats are all updated that
+			 * way, the iobuf ones under iobuffer_mtxp
 			 */
 			OSAddAtomicLong(1, &bufstats.bufs_miss);
 			break;
@@ -3446,11 +3585,18 @@ buf_geteblk(int size)
 {
 	buf_t   bp = NULL;
 	int queue = BQ_EMPTY;
+	struct bufshard *bs;
+
+	/*
+	 * no block to hash on, so spread these over
+	 * the shards by the cpu we happen to be on
+	 */
+	bs = &bufshards[cpu_number() & BUFSHARD_MASK];
 
 	do {
-		lck_mtx_lock_spin(&buf_mtx);
+		lck_mtx_lock_spin(&bs->bs_mtx);
 
-		bp = getnewbuf(0, 0, &queue);
+		bp = getnewbuf(bs, 0, 0, &queue);
 	} while (bp == NULL);
 
 	SET(bp->b_flags, (B_META | B_INVAL));
@@ -3460,10 +3606,10 @@ buf_geteblk(int size)
 #endif /* DIAGNOSTIC */
 	/* XXX need to implement logic to deal with other queues */
 
-	binshash(bp, &invalhash);
-	bufstats.bufs_eblk++;
+	binshash(bp, &bs->bs_invalhash);
+	OSAddAtomicLong(1, &bufstats.bufs_eblk);
 
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
 
 	allocbuf(bp, size);
 
@@ -3495,21 +3641,23 @@ recycle_buf_from_pool(int nsize)
 {
 	buf_t   bp;
 	void    *ptr = NULL;
+	struct bufshard *bs;
 
-	lck_mtx_lock_spin(&buf_mtx);
+	for (bs = bufshards; ptr == NULL && bs < &bufshards[NBUF_SHARDS]; bs++) {
+		lck_mtx_lock_spin(&bs->bs_mtx);
 
-	TAILQ_FOREACH(bp, &bufqueues[BQ_META], b_freelist) {
-		if (ISSET(bp->b_flags, B_DELWRI) || bp->b_bufsize != (uint32_t)nsize) {
-			continue;
-		}
-		ptr = (void *)bp->b_datap;
-		bp->b_bufsize = 0;
+		TAILQ_FOREACH(bp, &bs->bs_queues[BQ_META], b_freelist) {
+			if (ISSET(bp->b_flags, B_DELWRI) || bp->b_bufsize != (uint32_t)nsize) {
+				continue;
+			}
+			ptr = (void *)bp->b_datap;
+			bp->b_bufsize = 0;
 
-		bcleanbuf(bp, TRUE);
-		break;
+			bcleanbuf(bp, TRUE);
+			break;
+		}
+		lck_mtx_unlock(&bs->bs_mtx);
 	}
-	lck_mtx_unlock(&buf_mtx);
-
 	return ptr;
 }
 
@@ -3665,14 +3813,16 @@ allocbuf(buf_t bp, int size)
  *	Initialize the fields and disassociate the buffer from the vnode.
  *	Remove the buffer from the hash. Return the buffer and the queue
  *	on which it was found.
+ *	The buffer comes from shard 'bs' if it has one to spare, otherwise
+ *	from another shard, and is handed over to 'bs' before returning.
  *
- *	buf_mtx is held upon entry
- *	returns with buf_mtx locked if new buf available
- *	returns with buf_mtx UNlocked if new buf NOT available
+ *	bs->bs_mtx is held upon entry
+ *	returns with bs->bs_mtx locked if new buf available
+ *	returns with bs->bs_mtx UNlocked if new buf NOT available
  */
 
 static buf_t
-getnewbuf(int slpflag, int slptimeo, int * queue)
+getnewbuf(struct bufshard *bs, int slpflag, int slptimeo, int * queue)
 {
 	buf_t   bp;
 	buf_t   lru_bp;
@@ -3680,7 +3830,6 @@ getnewbuf(int slpflag, int slptimeo, int * queue)
 	buf_t   meta_bp;
 	int     age_time, lru_time, bp_time, meta_time;
 	int     req = *queue;   /* save it for restarts */
-	struct timespec ts;
 
 start:
 	/*
@@ -3692,7 +3841,7 @@ start:
 	}
 
 
-	if (*queue == BQ_EMPTY && (bp = bufqueues[*queue].tqh_first)) {
+	if (*queue == BQ_EMPTY && (bp = bs->bs_queues[*queue].tqh_first)) {
 		goto found;
 	}
 
@@ -3703,32 +3852,45 @@ start:
 		/*
 		 * Increment  count now as lock
 		 * is dropped for allocation.
-		 * That avoids over commits
+		 * That avoids over commits... other
+		 * shards may be racing us for the last one
 		 */
-		nbuf_headers++;
-		goto add_newbufs;
+		if (os_atomic_inc_orig(&nbuf_headers, relaxed) < max_nbuf_headers) {
+			goto add_newbufs;
+		}
+		os_atomic_dec(&nbuf_headers, relaxed);
 	}
+
 	/* Try for the requested queue first */
-	bp = bufqueues[*queue].tqh_first;
+	bp = bs->bs_queues[*queue].tqh_first;
 	if (bp) {
 		goto found;
 	}
 
 	/* Unable to use requested queue */
-	age_bp = bufqueues[BQ_AGE].tqh_first;
-	lru_bp = bufqueues[BQ_LRU].tqh_first;
-	meta_bp = bufqueues[BQ_META].tqh_first;
+	age_bp = bs->bs_queues[BQ_AGE].tqh_first;
+	lru_bp = bs->bs_queues[BQ_LRU].tqh_first;
+	meta_bp = bs->bs_queues[BQ_META].tqh_first;
 
 	if (!age_bp && !lru_bp && !meta_bp) {
 		/*
 		 * Unavailble on AGE or LRU or META queues
 		 * Try the empty list first
 		 */
-		bp = bufqueues[BQ_EMPTY].tqh_first;
+		bp = bs->bs_queues[BQ_EMPTY].tqh_first;
 		if (bp) {
 			*queue = BQ_EMPTY;
 			goto found;
 		}
+		/*
+		 * this shard has run dry... rather than
+		 * growing the pool, take a buffer from
+		 * one of the other shards
+		 */
+		if ((bp = getnewbuf_steal(bs))) {
+			*queue = BQ_EMPTY;
+			return bp;
+		}
 		/*
 		 * We have seen is this is hard to trigger.
 		 * This is an overcommit of nbufs but needed
@@ -3736,37 +3898,32 @@ start:
 		 */
 
 add_newbufs:
-		lck_mtx_unlock(&buf_mtx);
+		lck_mtx_unlock(&bs->bs_mtx);
 
 		/* Create a new temporary buffer header */
 		bp = zalloc_flags(buf_hdr_zone, Z_WAITOK | Z_NOFAIL);
 		bufhdrinit(bp);
+		bp->b_shard = (int)(bs - bufshards);
 		bp->b_whichq = BQ_EMPTY;
 		bp->b_timestamp = buf_timestamp();
 		BLISTNONE(bp);
 		SET(bp->b_flags, B_HDRALLOC);
 		*queue = BQ_EMPTY;
-		lck_mtx_lock_spin(&buf_mtx);
+		lck_mtx_lock_spin(&bs->bs_mtx);
 
 		if (bp) {
-			binshash(bp, &invalhash);
-			binsheadfree(bp, &bufqueues[BQ_EMPTY], BQ_EMPTY);
-			buf_hdr_count++;
+			binshash(bp, &bs->bs_invalhash);
+			binsheadfree(bp, &bs->bs_queues[BQ_EMPTY], BQ_EMPTY);
+			os_atomic_inc(&buf_hdr_count, relaxed);
 			goto found;
 		}
 		/* subtract already accounted bufcount */
-		nbuf_headers--;
+		os_atomic_dec(&nbuf_headers, relaxed);
 
-		bufstats.bufs_sleeps++;
+		OSAddAtomicLong(1, &bufstats.bufs_sleeps);
 
 		/* wait for a free buffer of any kind */
-		needbuffer = 1;
-		/* hz value is 100 */
-		ts.tv_sec = (slptimeo / 1000);
-		/* the hz value is 100; which leads to 10ms */
-		ts.tv_nsec = (slptimeo % 1000) * NSEC_PER_USEC * 1000 * 10;
-
-		msleep(&needbuffer, &buf_mtx, slpflag | PDROP | (PRIBIO + 1), "getnewbuf", &ts);
+		getnewbuf_wait(bs, slpflag, slptimeo);
 		return NULL;
 	}
 
@@ -3843,18 +4000,129 @@ found:
 }
 
 
+/*
+ * Wait for a buffer to be released on any shard.
+ *
+ * needbuffer is shared by all the shards, but buf_brelse only looks at
+ * it under the lock of the shard it's releasing to, which isn't the one
+ * we sleep on.  So needbuffer is set before every shard is looked at
+ * again under its own lock: a release that lands after we've looked at
+ * its shard is then guaranteed to see needbuffer set, and to bump
+ * needbuffer_gen before its wakeup.  The generation is checked under
+ * needbuffer_mtx, which msleep drops atomically, so that wakeup can't
+ * be lost.  Returns without sleeping if any shard has a buffer, for the
+ * caller to retry.
+ *
+ * bs->bs_mtx is held upon entry
+ * returns with bs->bs_mtx UNlocked
+ */
+static void
+getnewbuf_wait(struct bufshard *bs, int slpflag, int slptimeo)
+{
+	struct bufshard *other;
+	struct timespec ts;
+	uint32_t gen;
+	int     i, found = 0;
+
+	lck_mtx_lock_spin(&needbuffer_mtx);
+	gen = needbuffer_gen;
+	os_atomic_store(&needbuffer, 1, relaxed);
+	lck_mtx_unlock(&needbuffer_mtx);
+
+	lck_mtx_unlock(&bs->bs_mtx);
+
+	for (i = 1; i < NBUF_SHARDS && !found; i++) {
+		other = &bufshards[((bs - bufshards) + i) & BUFSHARD_MASK];
+
+		lck_mtx_lock_spin(&other->bs_mtx);
+		found = !TAILQ_EMPTY(&other->bs_queues[BQ_EMPTY]) ||
+		    !TAILQ_EMPTY(&other->bs_queues[BQ_AGE]) ||
+		    !TAILQ_EMPTY(&other->bs_queues[BQ_LRU]) ||
+		    !TAILQ_EMPTY(&other->bs_queues[BQ_META]);
+		lck_mtx_unlock(&other->bs_mtx);
+	}
+	if (found) {
+		return;
+	}
+
+	lck_mtx_lock(&needbuffer_mtx);
+	if (gen != needbuffer_gen) {
+		lck_mtx_unlock(&needbuffer_mtx);
+		return;
+	}
+	/* hz value is 100 */
+	ts.tv_sec = (slptimeo / 1000);
+	/* the hz value is 100; which leads to 10ms */
+	ts.tv_nsec = (slptimeo % 1000) * NSEC_PER_USEC * 1000 * 10;
+
+	msleep(&needbuffer, &needbuffer_mtx, slpflag | PDROP | (PRIBIO + 1), "getnewbuf", &ts);
+}
+
+/*
+ * Take a clean buffer from one of the shards other than 'bs',
+ * and hand it over to 'bs'.
+ * bs->bs_mtx is held upon entry, but dropped while we look
+ * returns with bs->bs_mtx locked
+ */
+static buf_t
+getnewbuf_steal(struct bufshard *bs)
+{
+	struct bufshard *victim;
+	buf_t   bp;
+	int     i;
+
+	for (i = 1; i < NBUF_SHARDS; i++) {
+		victim = &bufshards[((bs - bufshards) + i) & BUFSHARD_MASK];
+
+		/*
+		 * unlocked peek... we only need a hint
+		 * that the shard is worth locking
+		 */
+		if (TAILQ_EMPTY(&victim->bs_queues[BQ_EMPTY]) &&
+		    TAILQ_EMPTY(&victim->bs_queues[BQ_AGE]) &&
+		    TAILQ_EMPTY(&victim->bs_queues[BQ_LRU]) &&
+		    TAILQ_EMPTY(&victim->bs_queues[BQ_META])) {
+			continue;
+		}
+		lck_mtx_unlock(&bs->bs_mtx);
+		lck_mtx_lock_spin(&victim->bs_mtx);
+
+		if ((bp = TAILQ_FIRST(&victim->bs_queues[BQ_EMPTY])) == NULL &&
+		    (bp = TAILQ_FIRST(&victim->bs_queues[BQ_AGE])) == NULL &&
+		    (bp = TAILQ_FIRST(&victim->bs_queues[BQ_LRU])) == NULL) {
+			bp = TAILQ_FIRST(&victim->bs_queues[BQ_META]);
+		}
+		if (bp && bcleanbuf(bp, FALSE) == 0) {
+			/*
+			 * bp is ours now, and on no list that
+			 * would need the victim's lock
+			 */
+			buf_shard_move(bp, bs);
+
+			return bp;
+		}
+		lck_mtx_unlock(&victim->bs_mtx);
+		lck_mtx_lock_spin(&bs->bs_mtx);
+	}
+	return NULL;
+}
+
+
 /*
  * Clean a buffer.
  * Returns 0 if buffer is ready to use,
  * Returns 1 if issued a buf_bawrite() to indicate
  * that the buffer is not ready.
  *
- * buf_mtx is held upon entry
- * returns with buf_mtx locked
+ * bp's shard lock is held upon entry
+ * returns with bp's shard lock held
  */
 int
 bcleanbuf(buf_t bp, boolean_t discard)
 {
+	struct bufshard *bs = buf_shard(bp);
+	int need_wakeup = 0;
+
 	/* Remove from the queue */
 	bremfree_locked(bp);
 
@@ -3873,15 +4141,15 @@ bcleanbuf(buf_t bp, boolean_t discard)
 
 		bmovelaundry(bp);
 
-		lck_mtx_unlock(&buf_mtx);
+		lck_mtx_unlock(&bs->bs_mtx);
 
-		wakeup(&bufqueues[BQ_LAUNDRY]);
+		wakeup(&bs->bs_queues[BQ_LAUNDRY]);
 		/*
 		 * and give it a chance to run
 		 */
 		(void)thread_block(THREAD_CONTINUE_NULL);
 
-		lck_mtx_lock_spin(&buf_mtx);
+		lck_mtx_lock_spin(&bs->bs_mtx);
 
 		return 1;
 	}
@@ -3893,19 +4161,26 @@ bcleanbuf(buf_t bp, boolean_t discard)
 	 * Buffer is no longer on any free list... we own it
 	 */
 	SET(bp->b_lflags, BL_BUSY);
-	buf_busycount++;
+	buf_busycount_inc();
 
 	bremhash(bp);
 
+	lck_mtx_unlock(&bs->bs_mtx);
+
 	/*
 	 * disassociate us from our vnode, if we had one...
+	 * buf_mtx ranks above the shard lock, so this has
+	 * to wait until we've dropped it.  Until then a vnode
+	 * list walker can find the buffer busy and wait for it
+	 * (setting BL_WANTED under buf_mtx), so note that
+	 * before we forget the old b_lflags
 	 */
 	if (bp->b_vp) {
+		lck_mtx_lock_spin(&buf_mtx);
 		brelvp_locked(bp);
+		need_wakeup = ISSET(bp->b_lflags, BL_WANTED);
+		lck_mtx_unlock(&buf_mtx);
 	}
-
-	lck_mtx_unlock(&buf_mtx);
-
 	BLISTNONE(bp);
 
 	if (ISSET(bp->b_flags, B_META)) {
@@ -3918,13 +4193,13 @@ bcleanbuf(buf_t bp, boolean_t discard)
 
 	/* If discarding, just move to the empty queue */
 	if (discard) {
-		lck_mtx_lock_spin(&buf_mtx);
+		lck_mtx_lock_spin(&bs->bs_mtx);
 		CLR(bp->b_flags, (B_META | B_ZALLOC | B_DELWRI | B_LOCKED | B_AGE | B_ASYNC | B_NOCACHE | B_FUA));
 		bp->b_whichq = BQ_EMPTY;
-		binshash(bp, &invalhash);
-		binsheadfree(bp, &bufqueues[BQ_EMPTY], BQ_EMPTY);
-		CLR(bp->b_lflags, BL_BUSY);
-		buf_busycount--;
+		binshash(bp, &bs->bs_invalhash);
+		binsheadfree(bp, &bs->bs_queues[BQ_EMPTY], BQ_EMPTY);
+		CLR(bp->b_lflags, (BL_BUSY | BL_WANTED));
+		buf_busycount_dec();
 	} else {
 		/* Not discarding: clean up and prepare for reuse */
 		bp->b_bufsize = 0;
@@ -3955,7 +4230,15 @@ bcleanbuf(buf_t bp, boolean_t discard)
 		bp->b_validoff = bp->b_validend = 0;
 		bzero(&bp->b_attr, sizeof(struct bufattr));
 
-		lck_mtx_lock_spin(&buf_mtx);
+		lck_mtx_lock_spin(&bs->bs_mtx);
+	}
+	if (need_wakeup) {
+		/*
+		 * the walker is asleep by now (it held the shard
+		 * lock until it was)... it will find the buffer
+		 * gone from the vnode's list when it looks again
+		 */
+		wakeup(bp);
 	}
 	return 0;
 }
@@ -3968,24 +4251,26 @@ buf_invalblkno(vnode_t vp, daddr64_t lblkno, int flags)
 	buf_t   bp;
 	errno_t error;
 	struct bufhashhdr *dp;
+	struct bufshard *bs;
 
 	dp = BUFHASH(vp, lblkno);
+	bs = BUFSHARD(dp);
 
 relook:
-	lck_mtx_lock_spin(&buf_mtx);
+	lck_mtx_lock_spin(&bs->bs_mtx);
 
 	if ((bp = incore_locked(vp, lblkno, dp)) == (struct buf *)0) {
-		lck_mtx_unlock(&buf_mtx);
+		lck_mtx_unlock(&bs->bs_mtx);
 		return 0;
 	}
 	if (ISSET(bp->b_lflags, BL_BUSY)) {
 		if (!ISSET(flags, BUF_WAIT)) {
-			lck_mtx_unlock(&buf_mtx);
+			lck_mtx_unlock(&bs->bs_mtx);
 			return EBUSY;
 		}
 		SET(bp->b_lflags, BL_WANTED);
 
-		error = msleep((caddr_t)bp, &buf_mtx, PDROP | (PRIBIO + 1), "buf_invalblkno", NULL);
+		error = msleep((caddr_t)bp, &bs->bs_mtx, PDROP | (PRIBIO + 1), "buf_invalblkno", NULL);
 
 		if (error) {
 			return error;
@@ -3995,12 +4280,12 @@ relook:
 	bremfree_locked(bp);
 	SET(bp->b_lflags, BL_BUSY);
 	SET(bp->b_flags, B_INVAL);
-	buf_busycount++;
+	buf_busycount_inc();
 #ifdef JOE_DEBUG
 	bp->b_owner = current_thread();
 	bp->b_tag   = 4;
 #endif
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
 	buf_brelse(bp);
 
 	return 0;
@@ -4011,13 +4296,14 @@ void
 buf_drop(buf_t bp)
 {
 	int need_wakeup = 0;
+	struct bufshard *bs;
 
-	lck_mtx_lock_spin(&buf_mtx);
+	bs = buf_shard_lock(bp);
 
 	if (ISSET(bp->b_lflags, BL_WANTED)) {
 		/*
 		 * delay the actual wakeup until after we
-		 * clear BL_BUSY and we've dropped buf_mtx
+		 * clear BL_BUSY and we've dropped the shard lock
 		 */
 		need_wakeup = 1;
 	}
@@ -4029,9 +4315,9 @@ buf_drop(buf_t bp)
 	 * Unlock the buffer.
 	 */
 	CLR(bp->b_lflags, (BL_BUSY | BL_WANTED));
-	buf_busycount--;
+	buf_busycount_dec();
 
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
 
 	if (need_wakeup) {
 		/*
@@ -4042,33 +4328,25 @@ buf_drop(buf_t bp)
 }
 
 
-errno_t
-buf_acquire(buf_t bp, int flags, int slpflag, int slptimeo)
-{
-	errno_t error;
-
-	lck_mtx_lock_spin(&buf_mtx);
-
-	error = buf_acquire_locked(bp, flags, slpflag, slptimeo);
-
-	lck_mtx_unlock(&buf_mtx);
-
-	return error;
-}
-
-
+/*
+ * called with bp's shard locked, returns with it unlocked...
+ * if we have to wait for the buffer, 'outer' (if any) is dropped
+ * before the sleep and retaken once we wake up
+ */
 static errno_t
-buf_acquire_locked(buf_t bp, int flags, int slpflag, int slptimeo)
+buf_acquire_shard(buf_t bp, struct bufshard *bs, int flags, int slpflag, int slptimeo, lck_mtx_t *outer)
 {
 	errno_t error;
 	struct timespec ts;
 
 	if (ISSET(bp->b_flags, B_LOCKED)) {
 		if ((flags & BAC_SKIP_LOCKED)) {
+			lck_mtx_unlock(&bs->bs_mtx);
 			return EDEADLK;
 		}
 	} else {
 		if ((flags & BAC_SKIP_NONLOCKED)) {
+			lck_mtx_unlock(&bs->bs_mtx);
 			return EDEADLK;
 		}
 	}
@@ -4079,15 +4357,22 @@ buf_acquire_locked(buf_t bp, int flags, int slpflag, int slptimeo)
 		 * recheck for a NOWAIT request
 		 */
 		if (flags & BAC_NOWAIT) {
+			lck_mtx_unlock(&bs->bs_mtx);
 			return EBUSY;
 		}
 		SET(bp->b_lflags, BL_WANTED);
 
+		if (outer) {
+			lck_mtx_unlock(outer);
+		}
 		/* the hz value is 100; which leads to 10ms */
 		ts.tv_sec = (slptimeo / 100);
 		ts.tv_nsec = (slptimeo % 100) * 10  * NSEC_PER_USEC * 1000;
-		error = msleep((caddr_t)bp, &buf_mtx, slpflag | (PRIBIO + 1), "buf_acquire", &ts);
+		error = msleep((caddr_t)bp, &bs->bs_mtx, slpflag | PDROP | (PRIBIO + 1), "buf_acquire", &ts);
 
+		if (outer) {
+			lck_mtx_lock(outer);
+		}
 		if (error) {
 			return error;
 		}
@@ -4097,16 +4382,37 @@ buf_acquire_locked(buf_t bp, int flags, int slpflag, int slptimeo)
 		bremfree_locked(bp);
 	}
 	SET(bp->b_lflags, BL_BUSY);
-	buf_busycount++;
+	buf_busycount_inc();
 
 #ifdef JOE_DEBUG
 	bp->b_owner = current_thread();
 	bp->b_tag   = 5;
 #endif
+	lck_mtx_unlock(&bs->bs_mtx);
+
 	return 0;
 }
 
 
+errno_t
+buf_acquire(buf_t bp, int flags, int slpflag, int slptimeo)
+{
+	return buf_acquire_shard(bp, buf_shard_lock(bp), flags, slpflag, slptimeo, NULL);
+}
+
+
+/*
+ * called with buf_mtx held by the vnode buffer list walkers...
+ * buf_mtx is dropped across any sleep, in which case EAGAIN (or
+ * the msleep error) tells the caller the lists may have changed
+ */
+static errno_t
+buf_acquire_locked(buf_t bp, int flags, int slpflag, int slptimeo)
+{
+	return buf_acquire_shard(bp, buf_shard_lock(bp), flags, slpflag, slptimeo, &buf_mtx);
+}
+
+
 /*
  * Wait for operations on the buffer to complete.
  * When they do, extract and return the I/O's error value.
@@ -4114,15 +4420,17 @@ buf_acquire_locked(buf_t bp, int flags, int slpflag, int slptimeo)
 errno_t
 buf_biowait(buf_t bp)
 {
+	struct bufshard *bs;
+
 	while (!ISSET(bp->b_flags, B_DONE)) {
-		lck_mtx_lock_spin(&buf_mtx);
+		bs = buf_shard_lock(bp);
 
 		if (!ISSET(bp->b_flags, B_DONE)) {
 			DTRACE_IO1(wait__start, buf_t, bp);
-			(void) msleep(bp, &buf_mtx, PDROP | (PRIBIO + 1), "buf_biowait", NULL);
+			(void) msleep(bp, &bs->bs_mtx, PDROP | (PRIBIO + 1), "buf_biowait", NULL);
 			DTRACE_IO1(wait__done, buf_t, bp);
 		} else {
-			lck_mtx_unlock(&buf_mtx);
+			lck_mtx_unlock(&bs->bs_mtx);
 		}
 	}
 	/* check for interruption of I/O (e.g. via NFS), then errors. */
@@ -4161,6 +4469,7 @@ buf_biodone(buf_t bp)
 	struct bufattr *bap;
 	struct timeval real_elapsed;
 	uint64_t real_elapsed_usec = 0;
+	struct bufshard *bs;
 
 	KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 387)) | DBG_FUNC_START,
 	    bp, bp->b_datap, bp->b_flags, 0, 0);
@@ -4319,12 +4628,12 @@ buf_biodone(buf_t bp)
 		 * they do get to run, their going to re-set
 		 * BL_WANTED and go back to sleep
 		 */
-		lck_mtx_lock_spin(&buf_mtx);
+		bs = buf_shard_lock(bp);
 
 		CLR(bp->b_lflags, BL_WANTED);
 		SET(bp->b_flags, B_DONE);               /* note that it's done */
 
-		lck_mtx_unlock(&buf_mtx);
+		lck_mtx_unlock(&bs->bs_mtx);
 
 		wakeup(bp);
 	}
@@ -4353,16 +4662,18 @@ int
 count_lock_queue(void)
 {
 	buf_t   bp;
+	struct bufshard *bs;
 	int     n = 0;
 
-	lck_mtx_lock_spin(&buf_mtx);
+	for (bs = bufshards; bs < &bufshards[NBUF_SHARDS]; bs++) {
+		lck_mtx_lock_spin(&bs->bs_mtx);
 
-	for (bp = bufqueues[BQ_LOCKED].tqh_first; bp;
-	    bp = bp->b_freelist.tqe_next) {
-		n++;
+		for (bp = bs->bs_queues[BQ_LOCKED].tqh_first; bp;
+		    bp = bp->b_freelist.tqe_next) {
+			n++;
+		}
+		lck_mtx_unlock(&bs->bs_mtx);
 	}
-	lck_mtx_unlock(&buf_mtx);
-
 	return n;
 }
 
@@ -4387,24 +4698,26 @@ vfs_bufstats()
 {
 	int i, j, count;
 	struct buf *bp;
-	struct bqueues *dp;
+	struct bufshard *bs;
 	int counts[MAXBSIZE / CLBYTES + 1];
 	static char *bname[BQUEUES] =
 	{ "LOCKED", "LRU", "AGE", "EMPTY", "META", "LAUNDRY" };
 
-	for (dp = bufqueues, i = 0; dp < &bufqueues[BQUEUES]; dp++, i++) {
+	for (i = 0; i < BQUEUES; i++) {
 		count = 0;
 		for (j = 0; j <= MAXBSIZE / CLBYTES; j++) {
 			counts[j] = 0;
 		}
 
-		lck_mtx_lock(&buf_mtx);
+		for (bs = bufshards; bs < &bufshards[NBUF_SHARDS]; bs++) {
+			lck_mtx_lock(&bs->bs_mtx);
 
-		for (bp = dp->tqh_first; bp; bp = bp->b_freelist.tqe_next) {
-			counts[bp->b_bufsize / CLBYTES]++;
-			count++;
+			for (bp = bs->bs_queues[i].tqh_first; bp; bp = bp->b_freelist.tqe_next) {
+				counts[bp->b_bufsize / CLBYTES]++;
+				count++;
+			}
+			lck_mtx_unlock(&bs->bs_mtx);
 		}
-		lck_mtx_unlock(&buf_mtx);
 
 		printf("%s: total-%d", bname[i], count);
 		for (j = 0; j <= MAXBSIZE / CLBYTES; j++) {
@@ -4595,7 +4908,8 @@ buf_list_unlock(void)
 /*
  * If getnewbuf() calls bcleanbuf() on the same thread
  * there is a potential for stack overrun and deadlocks.
- * So we always handoff the work to a worker thread for completion
+ * So we always handoff the work to a worker thread for completion...
+ * each shard has its own laundry and its own thread to drain it
  */
 
 
@@ -4603,27 +4917,29 @@ static void
 bcleanbuf_thread_init(void)
 {
 	thread_t        thread = THREAD_NULL;
+	struct bufshard *bs;
 
-	/* create worker thread */
-	kernel_thread_start((thread_continue_t)bcleanbuf_thread, NULL, &thread);
-	thread_deallocate(thread);
+	/* create worker threads */
+	for (bs = bufshards; bs < &bufshards[NBUF_SHARDS]; bs++) {
+		kernel_thread_start(bcleanbuf_thread, bs, &thread);
+		thread_deallocate(thread);
+	}
 }
 
-typedef int (*bcleanbufcontinuation)(int);
-
 __attribute__((noreturn))
 static void
-bcleanbuf_thread(void)
+bcleanbuf_thread(void *param, __unused wait_result_t wr)
 {
+	struct bufshard *bs = param;
 	struct buf *bp;
 	int error = 0;
 	int loopcnt = 0;
 
 	for (;;) {
-		lck_mtx_lock_spin(&buf_mtx);
+		lck_mtx_lock_spin(&bs->bs_mtx);
 
-		while ((bp = TAILQ_FIRST(&bufqueues[BQ_LAUNDRY])) == NULL) {
-			(void)msleep0(&bufqueues[BQ_LAUNDRY], &buf_mtx, PRIBIO | PDROP, "blaundry", 0, (bcleanbufcontinuation)bcleanbuf_thread);
+		while ((bp = TAILQ_FIRST(&bs->bs_queues[BQ_LAUNDRY])) == NULL) {
+			(void)msleep(&bs->bs_queues[BQ_LAUNDRY], &bs->bs_mtx, PRIBIO | PSPIN, "blaundry", NULL);
 		}
 
 		/*
@@ -4635,14 +4951,14 @@ bcleanbuf_thread(void)
 		 * Buffer is no longer on any free list
 		 */
 		SET(bp->b_lflags, BL_BUSY);
-		buf_busycount++;
+		buf_busycount_inc();
 
 #ifdef JOE_DEBUG
 		bp->b_owner = current_thread();
 		bp->b_tag   = 10;
 #endif
 
-		lck_mtx_unlock(&buf_mtx);
+		lck_mtx_unlock(&bs->bs_mtx);
 		/*
 		 * do the IO
 		 */
@@ -4652,20 +4968,20 @@ bcleanbuf_thread(void)
 			bp->b_whichq = BQ_LAUNDRY;
 			bp->b_timestamp = buf_timestamp();
 
-			lck_mtx_lock_spin(&buf_mtx);
+			lck_mtx_lock_spin(&bs->bs_mtx);
 
-			binstailfree(bp, &bufqueues[BQ_LAUNDRY], BQ_LAUNDRY);
-			blaundrycnt++;
+			binstailfree(bp, &bs->bs_queues[BQ_LAUNDRY], BQ_LAUNDRY);
+			bs->bs_laundrycnt++;
 
 			/* we never leave a busy page on the laundry queue */
 			CLR(bp->b_lflags, BL_BUSY);
-			buf_busycount--;
+			buf_busycount_dec();
 #ifdef JOE_DEBUG
 			bp->b_owner = current_thread();
 			bp->b_tag   = 11;
 #endif
 
-			lck_mtx_unlock(&buf_mtx);
+			lck_mtx_unlock(&bs->bs_mtx);
 
 			if (loopcnt > MAXLAUNDRY) {
 				/*
@@ -4673,7 +4989,7 @@ bcleanbuf_thread(void)
 				 * done several I/Os and failed, give the system some time to unthrottle
 				 * the vnode
 				 */
-				(void)tsleep((void *)&bufqueues[BQ_LAUNDRY], PRIBIO, "blaundry", 1);
+				(void)tsleep((void *)&bs->bs_queues[BQ_LAUNDRY], PRIBIO, "blaundry", 1);
 				loopcnt = 0;
 			} else {
 				/* give other threads a chance to run */
@@ -4797,6 +5113,7 @@ buffer_cache_gc(int all)
 	int now = buf_timestamp();
 	uint32_t found = 0;
 	struct bqueues privq;
+	struct bufshard *bs;
 	int thresh_hold = BUF_STALE_THRESHHOLD;
 
 	if (all) {
@@ -4806,115 +5123,134 @@ buffer_cache_gc(int all)
 	 * We only care about metadata (incore storage comes from zalloc()).
 	 * Unless "all" is set (used to evict meta data buffers in preparation
 	 * for deep sleep), we only evict up to BUF_MAX_GC_BATCH_SIZE buffers
-	 * that have not been accessed in the last BUF_STALE_THRESHOLD seconds.
-	 * BUF_MAX_GC_BATCH_SIZE controls both the hold time of the global lock
-	 * "buf_mtx" and the length of time we spend compute bound in the GC
+	 * per shard that have not been accessed in the last BUF_STALE_THRESHOLD
+	 * seconds.  BUF_MAX_GC_BATCH_SIZE controls both the hold time of the
+	 * shard lock and the length of time we spend compute bound in the GC
 	 * thread which calls this function
 	 */
-	lck_mtx_lock(&buf_mtx);
-
-	do {
-		found = 0;
-		TAILQ_INIT(&privq);
-		need_wakeup = FALSE;
-
-		while (((bp = TAILQ_FIRST(&bufqueues[BQ_META]))) &&
-		    (now > bp->b_timestamp) &&
-		    (now - bp->b_timestamp > thresh_hold) &&
-		    (found < BUF_MAX_GC_BATCH_SIZE)) {
-			/* Remove from free list */
-			bremfree_locked(bp);
-			found++;
+	for (bs = bufshards; bs < &bufshards[NBUF_SHARDS]; bs++) {
+		lck_mtx_lock(&bs->bs_mtx);
+
+		do {
+			found = 0;
+			TAILQ_INIT(&privq);
+			need_wakeup = FALSE;
+
+			while (((bp = TAILQ_FIRST(&bs->bs_queues[BQ_META]))) &&
+			    (now > bp->b_timestamp) &&
+			    (now - bp->b_timestamp > thresh_hold) &&
+			    (found < BUF_MAX_GC_BATCH_SIZE)) {
+				/* Remove from free list */
+				bremfree_locked(bp);
+				found++;
 
 #ifdef JOE_DEBUG
-			bp->b_owner = current_thread();
-			bp->b_tag   = 12;
+				bp->b_owner = current_thread();
+				bp->b_tag   = 12;
 #endif
 
-			/* If dirty, move to laundry queue and remember to do wakeup */
-			if (ISSET(bp->b_flags, B_DELWRI)) {
-				SET(bp->b_lflags, BL_WANTDEALLOC);
+				/* If dirty, move to laundry queue and remember to do wakeup */
+				if (ISSET(bp->b_flags, B_DELWRI)) {
+					SET(bp->b_lflags, BL_WANTDEALLOC);
 
-				bmovelaundry(bp);
-				need_wakeup = TRUE;
+					bmovelaundry(bp);
+					need_wakeup = TRUE;
 
-				continue;
-			}
+					continue;
+				}
 
-			/*
-			 * Mark busy and put on private list.  We could technically get
-			 * away without setting BL_BUSY here.
-			 */
-			SET(bp->b_lflags, BL_BUSY);
-			buf_busycount++;
+				/*
+				 * Mark busy and put on private list.  We could technically get
+				 * away without setting BL_BUSY here.
+				 */
+				SET(bp->b_lflags, BL_BUSY);
+				buf_busycount_inc();
 
-			/*
-			 * Remove from hash and dissociate from vp.
-			 */
-			bremhash(bp);
-			if (bp->b_vp) {
-				brelvp_locked(bp);
+				/*
+				 * Remove from hash, we dissociate from the vp below.
+				 */
+				bremhash(bp);
+
+				TAILQ_INSERT_TAIL(&privq, bp, b_freelist);
 			}
 
-			TAILQ_INSERT_TAIL(&privq, bp, b_freelist);
-		}
+			if (found == 0) {
+				break;
+			}
 
-		if (found == 0) {
-			break;
-		}
+			/* Drop lock for batch processing */
+			lck_mtx_unlock(&bs->bs_mtx);
 
-		/* Drop lock for batch processing */
-		lck_mtx_unlock(&buf_mtx);
+			/* Wakeup and yield for laundry if need be */
+			if (need_wakeup) {
+				wakeup(&bs->bs_queues[BQ_LAUNDRY]);
+				(void)thread_block(THREAD_CONTINUE_NULL);
+			}
 
-		/* Wakeup and yield for laundry if need be */
-		if (need_wakeup) {
-			wakeup(&bufqueues[BQ_LAUNDRY]);
-			(void)thread_block(THREAD_CONTINUE_NULL);
-		}
+			/*
+			 * buf_mtx ranks above the shard lock... the buffers are
+			 * busy and ours, so dissociate them from their vnodes now
+			 */
+			lck_mtx_lock_spin(&buf_mtx);
 
-		/* Clean up every buffer on private list */
-		TAILQ_FOREACH(bp, &privq, b_freelist) {
-			/* Take note if we've definitely freed at least a page to a zone */
-			if ((ISSET(bp->b_flags, B_ZALLOC)) && (buf_size(bp) >= PAGE_SIZE)) {
-				did_large_zfree = TRUE;
+			TAILQ_FOREACH(bp, &privq, b_freelist) {
+				if (bp->b_vp) {
+					brelvp_locked(bp);
+				}
 			}
+			lck_mtx_unlock(&buf_mtx);
+			/*
+			 * a vnode list walker may have found one of these
+			 * busy before we got to it... it gets woken below
+			 */
 
-			trace(TR_BRELSE, pack(bp->b_vp, bp->b_bufsize), bp->b_lblkno);
+			/* Clean up every buffer on private list */
+			TAILQ_FOREACH(bp, &privq, b_freelist) {
+				/* Take note if we've definitely freed at least a page to a zone */
+				if ((ISSET(bp->b_flags, B_ZALLOC)) && (buf_size(bp) >= PAGE_SIZE)) {
+					did_large_zfree = TRUE;
+				}
 
-			/* Free Storage */
-			buf_free_meta_store(bp);
+				trace(TR_BRELSE, pack(bp->b_vp, bp->b_bufsize), bp->b_lblkno);
 
-			/* Release credentials */
-			buf_release_credentials(bp);
+				/* Free Storage */
+				buf_free_meta_store(bp);
 
-			/* Prepare for moving to empty queue */
-			CLR(bp->b_flags, (B_META | B_ZALLOC | B_DELWRI | B_LOCKED
-			    | B_AGE | B_ASYNC | B_NOCACHE | B_FUA));
-			bp->b_whichq = BQ_EMPTY;
-			BLISTNONE(bp);
-		}
-		lck_mtx_lock(&buf_mtx);
+				/* Release credentials */
+				buf_release_credentials(bp);
 
-		/* Back under lock, move them all to invalid hash and clear busy */
-		TAILQ_FOREACH(bp, &privq, b_freelist) {
-			binshash(bp, &invalhash);
-			CLR(bp->b_lflags, BL_BUSY);
-			buf_busycount--;
+				/* Prepare for moving to empty queue */
+				CLR(bp->b_flags, (B_META | B_ZALLOC | B_DELWRI | B_LOCKED
+				    | B_AGE | B_ASYNC | B_NOCACHE | B_FUA));
+				bp->b_whichq = BQ_EMPTY;
+				BLISTNONE(bp);
+			}
+			lck_mtx_lock(&bs->bs_mtx);
+
+			/* Back under lock, move them all to invalid hash and clear busy */
+			TAILQ_FOREACH(bp, &privq, b_freelist) {
+				binshash(bp, &bs->bs_invalhash);
+				if (ISSET(bp->b_lflags, BL_WANTED)) {
+					wakeup(bp);
+				}
+				CLR(bp->b_lflags, (BL_BUSY | BL_WANTED));
+				buf_busycount_dec();
 
 #ifdef JOE_DEBUG
-			if (bp->b_owner != current_thread()) {
-				panic("Buffer stolen from buffer_cache_gc()");
-			}
-			bp->b_owner = current_thread();
-			bp->b_tag   = 13;
+				if (bp->b_owner != current_thread()) {
+					panic("Buffer stolen from buffer_cache_gc()");
+				}
+				bp->b_owner = current_thread();
+				bp->b_tag   = 13;
 #endif
-		}
+			}
 
-		/* And do a big bulk move to the empty queue */
-		TAILQ_CONCAT(&bufqueues[BQ_EMPTY], &privq, b_freelist);
-	} while (all && (found == BUF_MAX_GC_BATCH_SIZE));
+			/* And do a big bulk move to the empty queue */
+			TAILQ_CONCAT(&bs->bs_queues[BQ_EMPTY], &privq, b_freelist);
+		} while (all && (found == BUF_MAX_GC_BATCH_SIZE));
 
-	lck_mtx_unlock(&buf_mtx);
+		lck_mtx_unlock(&bs->bs_mtx);
+	}
 
 	fs_buffer_cache_gc_dispatch_callouts(all);
 
@@ -4950,20 +5286,22 @@ int
 bflushq(int whichq, mount_t mp)
 {
 	buf_t   bp, next;
-	int     i, buf_count;
+	int     i, buf_count = 0;
 	int     total_writes = 0;
+	struct bufshard *bs;
 	static buf_t flush_table[NFLUSH];
 
 	if (whichq < 0 || whichq >= BQUEUES) {
 		return 0;
 	}
+	bs = bufshards;
 
 restart:
-	lck_mtx_lock(&buf_mtx);
+	lck_mtx_lock(&bs->bs_mtx);
 
-	bp = TAILQ_FIRST(&bufqueues[whichq]);
+	bp = TAILQ_FIRST(&bs->bs_queues[whichq]);
 
-	for (buf_count = 0; bp; bp = next) {
+	for (; bp; bp = next) {
 		next = bp->b_freelist.tqe_next;
 
 		if (bp->b_vp == NULL || bp->b_vp->v_mount != mp) {
@@ -4977,25 +5315,30 @@ restart:
 			bp->b_tag   = 7;
 #endif
 			SET(bp->b_lflags, BL_BUSY);
-			buf_busycount++;
+			buf_busycount_inc();
 
 			flush_table[buf_count] = bp;
 			buf_count++;
 			total_writes++;
 
 			if (buf_count >= NFLUSH) {
-				lck_mtx_unlock(&buf_mtx);
+				lck_mtx_unlock(&bs->bs_mtx);
 
 				qsort(flush_table, buf_count, sizeof(struct buf *), bp_cmp);
 
 				for (i = 0; i < buf_count; i++) {
 					buf_bawrite(flush_table[i]);
 				}
+				buf_count = 0;
 				goto restart;
 			}
 		}
 	}
-	lck_mtx_unlock(&buf_mtx);
+	lck_mtx_unlock(&bs->bs_mtx);
+
+	if (++bs < &bufshards[NBUF_SHARDS]) {
+		goto restart;
+	}
 
 	if (buf_count > 0) {
 		qsort(flush_table, buf_count, sizeof(struct buf *), bp_cmp);
@@ -79,9 +79,12 @@
 #include <sys/namei.h>
 #include <sys/errno.h>
 #include <kern/kalloc.h>
+#include <kern/counter.h>
+#include <kern/thread_call.h>
 #include <sys/kauth.h>
 #include <sys/user.h>
 #include <sys/paths.h>
+#include <sys/sysctl.h>
 #include <os/overflow.h>
 
 #if CONFIG_MACF
@@ -103,6 +106,17 @@
  * Upon reaching the last segment of a path, if the reference
  * is for DELETE, or NOCACHE is set (rewrite), and the
  * name is located in the cache, it will be dropped.
+ *
+ * The cache is modified with the name cache lock held exclusive.
+ * cache_lookup_path() walks the hash chains in an SMR read section
+ * (nc_smr) instead of taking the lock shared, so that fully cached path
+ * walks do not all bounce the lock's cache line.  For that to be safe:
+ *
+ * - hash chains are singly linked and updated with release semantics;
+ * - deleted entries stay intact (name included) on a retire list until
+ *   readers are past them, and are never reused in place;
+ * - vnodes and mounts are only freed once readers are past them, see
+ *   cache_smr_synchronize().
  */
 
 /*
@@ -111,7 +125,7 @@
 
 ZONE_DEFINE_TYPE(namecache_zone, "namecache", struct namecache, ZC_NONE);
 
-LIST_HEAD(nchashhead, namecache) * nchashtbl;    /* Hash Table */
+struct namecache_smr *nchashtbl;        /* Hash Table */
 u_long  nchashmask;
 u_long  nchash;                         /* size of hash table - 1 */
 long    numcache;                       /* number of cache entries allocated */
@@ -119,8 +133,137 @@ int     desiredNodes;
 int     desiredNegNodes;
 int     ncs_negtotal;
 TUNABLE_WRITEABLE(int, nc_disabled, "-novfscache", 0);
-TAILQ_HEAD(, namecache) nchead;         /* chain of all name cache entries */
+TAILQ_HEAD(, namecache) nchead;         /* chain of positive name cache entries */
 TAILQ_HEAD(, namecache) neghead;        /* chain of only negative cache entries */
+TAILQ_HEAD(, namecache) ncretire;       /* deleted entries readers may still see */
+int     ncs_retiretotal;
+
+/* lockless path walks; "-novfscachesmr" makes them take the lock again */
+static SMR_DEFINE(nc_smr);
+static TUNABLE(int, nc_smr_disabled, "-novfscachesmr", 0);
+
+/* how many deleted entries to let pile up before trying to free them */
+#define NC_RETIRE_BATCH         64
+
+/*
+ * Negative entries have their own LRU (neghead), capped by desiredNegNodes,
+ * so that a burst of failed lookups (e.g. a compiler probing every include
+ * directory) can't push positive entries out of nchead.  A single directory
+ * is further limited to nc_negperdir negative entries (0: no limit).
+ */
+static int nc_negperdir = 512;
+
+/*
+ * When the cache runs out of room and lookups mostly miss, grow it (up to
+ * NC_AUTOGROW_MAX times desiredvnodes) from a thread call, at most once
+ * per NC_AUTOGROW_INTERVAL.
+ */
+#define NC_AUTOGROW_INTERVAL    1                       /* seconds */
+#define NC_AUTOGROW_MIN_LOOKUPS 10000
+#define NC_AUTOGROW_MAX         2
+static int nc_autogrow_hitpct = 90;                     /* 0: don't grow */
+static int nc_autogrow_size;                            /* size last passed to resize_namecache() */
+static int nc_autogrows;
+static boolean_t nc_autogrow_pending;
+static uint64_t nc_autogrow_last_hits, nc_autogrow_last_lookups;
+static thread_call_t nc_autogrow_call;
+
+static void cache_autogrow(thread_call_param_t, thread_call_param_t);
+
+SCALABLE_COUNTER_DEFINE(nc_hits);
+SCALABLE_COUNTER_DEFINE(nc_neghits);
+SCALABLE_COUNTER_DEFINE(nc_misses);
+SCALABLE_COUNTER_DEFINE(nc_neg_evicted);
+SCALABLE_COUNTER_DEFINE(nc_neg_dir_evicted);
+
+SYSCTL_DECL(_vfs_generic);
+SYSCTL_NODE(_vfs_generic, OID_AUTO, namecache, CTLFLAG_RW | CTLFLAG_LOCKED, 0,
+    "name cache");
+SYSCTL_INT(_vfs_generic_namecache, OID_AUTO, negperdir, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &nc_negperdir, 0, "Negative entries allowed per directory (0: no limit)");
+SYSCTL_INT(_vfs_generic_namecache, OID_AUTO, autogrow_hitpct, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &nc_autogrow_hitpct, 0, "Grow the cache when fewer lookups hit (0: never)");
+SYSCTL_INT(_vfs_generic_namecache, OID_AUTO, autogrows, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &nc_autogrows, 0, "Times the cache grew itself");
+SYSCTL_INT(_vfs_generic_namecache, OID_AUTO, negtotal, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &ncs_negtotal, 0, "Negative entries");
+SYSCTL_INT(_vfs_generic_namecache, OID_AUTO, negmax, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &desiredNegNodes, 0, "Negative entries allowed");
+SYSCTL_SCALABLE_COUNTER(_vfs_generic_namecache, hits, nc_hits,
+    "Path walk lookups that found a vnode");
+SYSCTL_SCALABLE_COUNTER(_vfs_generic_namecache, neghits, nc_neghits,
+    "Path walk lookups that found a negative entry");
+SYSCTL_SCALABLE_COUNTER(_vfs_generic_namecache, misses, nc_misses,
+    "Path walk lookups that found nothing");
+SYSCTL_SCALABLE_COUNTER(_vfs_generic_namecache, neg_evicted, nc_neg_evicted,
+    "Negative entries evicted to stay under negmax");
+SYSCTL_SCALABLE_COUNTER(_vfs_generic_namecache, neg_dir_evicted, nc_neg_dir_evicted,
+    "Negative entries evicted to stay under negperdir");
+
+/*
+ * The path cache maps a whole absolute path, as looked up by one
+ * credential from one root directory, straight to the vnode it resolved
+ * to, so that namei() of a hot path is a single probe rather than a walk.
+ *
+ * An entry is only made from a walk that cache_lookup_path() finished on
+ * its own, with cached search rights on every directory (NAMEI_PATHCACHED),
+ * and stays good only while nc_path_generation and mount_generation are
+ * what they were before that walk.  Anything that changes the namespace or
+ * the rights cached on a vnode bumps nc_path_generation, after the change.
+ */
+#define NC_PATHCACHE_SIZE       256             /* entries, power of 2 */
+#define NC_PATHCACHE_MAXLEN     128             /* longest path cached, with NUL */
+
+/* lookups that can't be answered from, or entered in, the path cache */
+#define NC_PATHCACHE_CNFLAGS    (LOCKPARENT | WANTPARENT | NOCACHE | NOCROSSMOUNT | \
+	                         DONOTAUTH | SAVESTART | AUDITVNPATH1 | AUDITVNPATH2 | \
+	                         USEDVP | CN_VOLFSPATH | CN_FIRMLINK_NOFOLLOW | \
+	                         CN_WANTSRSRCFORK | CN_ALLOWRSRCFORK | CN_NBMOUNTLOOK | \
+	                         CN_SKIPNAMECACHE | CN_RAW_ENCRYPTED)
+#define NC_PATHCACHE_NIFLAGS    (NAMEI_CONTLOOKUP | NAMEI_UNFINISHED | \
+	                         NAMEI_COMPOUND_OP_MASK | NAMEI_NOFOLLOW_ANY)
+
+struct pathcache_entry {
+	lck_spin_t      pe_lock;
+	vnode_t         pe_vp;          /* held; NULLVP if the entry is free */
+	uint32_t        pe_vid;
+	uint32_t        pe_hash;
+	uint64_t        pe_gen;         /* cache_path_generation() before the walk */
+	kauth_cred_t    pe_cred;        /* referenced */
+	vnode_t         pe_rootdir;     /* held */
+	uint32_t        pe_rootvid;
+	uint16_t        pe_len;
+	uint16_t        pe_follow;      /* cn_flags & FOLLOW */
+	char            pe_path[NC_PATHCACHE_MAXLEN];
+};
+
+static struct pathcache_entry *nc_pathcache;
+static uint32_t nc_path_generation = 1;
+static int nc_pathcache_enabled = 1;
+static LCK_GRP_DECLARE(pathcache_lck_grp, "Path Cache");
+
+SCALABLE_COUNTER_DEFINE(nc_path_hits);
+SCALABLE_COUNTER_DEFINE(nc_path_misses);
+
+SYSCTL_INT(_vfs_generic_namecache, OID_AUTO, pathcache, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &nc_pathcache_enabled, 0, "Resolve repeated absolute paths in one probe");
+SYSCTL_SCALABLE_COUNTER(_vfs_generic_namecache, path_hits, nc_path_hits,
+    "namei lookups answered by the path cache");
+SYSCTL_SCALABLE_COUNTER(_vfs_generic_namecache, path_misses, nc_path_misses,
+    "namei lookups the path cache could have answered but didn't");
+
+static inline uint64_t
+cache_path_generation(void)
+{
+	return ((uint64_t)os_atomic_load(&nc_path_generation, acquire) << 32) |
+	       mount_generation;
+}
+
+static inline void
+cache_path_invalidate(void)
+{
+	os_atomic_inc(&nc_path_generation, release);
+}
 
 
 #if COLLECT_STATS
@@ -143,6 +286,17 @@ struct  nchstats nchstats;              /* cache effectiveness statistics */
 
 #endif
 
+/*
+ * cache_lookup_path() either enters an nc_smr read section, or, when
+ * exact statistics are collected or lockless walks are disabled, takes
+ * the name cache lock shared.
+ */
+#if COLLECT_STATS
+#define NC_SMR_LOOKUP()                 FALSE
+#else
+#define NC_SMR_LOOKUP()                 (!nc_smr_disabled)
+#endif
+
 
 /* vars for name cache list lock */
 static LCK_GRP_DECLARE(namecache_lck_grp, "Name Cache");
@@ -163,9 +317,12 @@ lck_mtx_t strcache_mtx_locks[NUM_STRCACHE_LOCKS];
 static vnode_t cache_lookup_locked(vnode_t dvp, struct componentname *cnp);
 static const char *add_name_internal(const char *, uint32_t, u_int, boolean_t, u_int);
 static void init_string_table(void);
-static void cache_delete(struct namecache *, int);
+static void cache_delete(struct namecache *);
+static void cache_reclaim_retired(void);
+static void cache_autogrow_check(void);
 static void cache_enter_locked(vnode_t dvp, vnode_t vp, struct componentname *cnp, const char *strname);
 static void cache_purge_locked(vnode_t vp, kauth_cred_t *credp);
+unsigned int hash_string(const char *cp, int len);
 
 #ifdef DUMP_STRING_TABLE
 /*
@@ -181,6 +338,20 @@ static unsigned int crc32tab[256];
 #define NCHHASH(dvp, hash_val) \
 	(&nchashtbl[(dvp->v_id ^ (hash_val)) & nchashmask])
 
+/*
+ * NCHHASH() for a reader that doesn't hold the name cache lock: the table
+ * only grows, and resize_namecache() publishes the new table before the
+ * new mask, so a mask is never applied to a smaller table.
+ */
+static inline struct namecache_smr *
+cache_hash_head_smr(vnode_t dvp, unsigned int hash_val)
+{
+	u_long mask = os_atomic_load(&nchashmask, acquire);
+	struct namecache_smr *tbl = os_atomic_load(&nchashtbl, relaxed);
+
+	return &tbl[(dvp->v_id ^ hash_val) & mask];
+}
+
 /*
  * This function tries to check if a directory vp is a subdirectory of dvp
  * only from valid v_parent pointers. It is called with the name cache lock
@@ -1033,11 +1204,11 @@ vnode_update_identity(vnode_t vp, vnode_t dvp, const char *name, int name_len, u
 			}
 
 			while ((ncp = LIST_FIRST(&vp->v_nclinks))) {
-				cache_delete(ncp, 1);
+				cache_delete(ncp);
 			}
 
 			while ((ncp = TAILQ_FIRST(&vp->v_ncchildren))) {
-				cache_delete(ncp, 1);
+				cache_delete(ncp);
 			}
 
 			/*
@@ -1065,9 +1236,10 @@ vnode_update_identity(vnode_t vp, vnode_t dvp, const char *name, int name_len, u
 		}
 		if (flags & VNODE_UPDATE_CACHE) {
 			while ((ncp = LIST_FIRST(&vp->v_nclinks))) {
-				cache_delete(ncp, 1);
+				cache_delete(ncp);
 			}
 		}
+		cache_path_invalidate();
 		NAME_CACHE_UNLOCK();
 
 		if (vname != NULL) {
@@ -1376,6 +1548,7 @@ vnode_uncache_authorized_action(vnode_t vp, kauth_action_t action)
 		tcred = vnode_cred(vp);
 		vp->v_cred = NOCRED;
 	}
+	cache_path_invalidate();
 	NAME_CACHE_UNLOCK();
 
 	kauth_cred_set(&tcred, NOCRED);
@@ -1475,13 +1648,20 @@ vnode_cache_authorized_action(vnode_t vp, vfs_context_t ctx, kauth_action_t acti
 	NAME_CACHE_LOCK();
 
 	if (vnode_cred(vp) != ucred) {
+		/*
+		 * Lockless walks sample v_cred around v_authorized_actions
+		 * (see cache_search_authorized()); clear the actions before
+		 * switching credentials, and only add the new ones after.
+		 */
+		os_atomic_store(&vp->v_authorized_actions, 0, relaxed);
+		os_atomic_thread_fence(release);
+
 		/*
 		 * Use a temp variable to avoid kauth_cred_drop() while NAME_CACHE_LOCK is held
 		 */
 		tcred = vnode_cred(vp);
 		vp->v_cred = NOCRED;
 		kauth_cred_set(&vp->v_cred, ucred);
-		vp->v_authorized_actions = 0;
 	}
 	if (ttl_active == TRUE && vp->v_authorized_actions == 0) {
 		/*
@@ -1494,7 +1674,7 @@ vnode_cache_authorized_action(vnode_t vp, vfs_context_t ctx, kauth_action_t acti
 		 */
 		vp->v_cred_timestamp = (int)tv.tv_sec;
 	}
-	vp->v_authorized_actions |= action;
+	os_atomic_or(&vp->v_authorized_actions, action, release);
 
 	NAME_CACHE_UNLOCK();
 
@@ -1521,6 +1701,39 @@ vnode_cache_is_stale(vnode_t vp)
 
 
 
+/*
+ * Whether the rights cached on dp let ucred search it without asking
+ * the file system.  A walk holding the name cache lock shared sees
+ * v_cred and v_authorized_actions consistent; an SMR walk may race with
+ * vnode_cache_authorized_action(), so it only trusts actions it read
+ * between two identical samples of the credential.
+ */
+static inline boolean_t
+cache_search_authorized(vnode_t dp, kauth_cred_t ucred)
+{
+	kauth_cred_t cred = os_atomic_load(&dp->v_cred, acquire);
+	kauth_action_t actions = os_atomic_load(&dp->v_authorized_actions, acquire);
+
+	if (actions & KAUTH_VNODE_SEARCHBYANYONE) {
+		return TRUE;
+	}
+	return (actions & KAUTH_VNODE_SEARCH) && cred == ucred &&
+	       os_atomic_load(&dp->v_cred, relaxed) == cred;
+}
+
+/*
+ * Leave the part of cache_lookup_path() that walks the cache.
+ */
+static inline void
+cache_lookup_path_leave(boolean_t in_smr)
+{
+	if (in_smr) {
+		smr_leave(&nc_smr);
+	} else {
+		NAME_CACHE_UNLOCK();
+	}
+}
+
 /*
  * Returns:	0			Success
  *		ERECYCLE		vnode was recycled from underneath us.  Force lookup to be re-driven from namei.
@@ -1542,20 +1755,34 @@ cache_lookup_path(struct nameidata *ndp, struct componentname *cnp, vnode_t dp,
 	unsigned int    hash;
 	int             error = 0;
 	boolean_t       dotdotchecked = FALSE;
+	boolean_t       in_smr = NC_SMR_LOOKUP();
+	boolean_t       pathcacheable;
+	vnode_t         held_dp = NULLVP;
 
 #if CONFIG_TRIGGERS
 	vnode_t         trigger_vp;
 #endif /* CONFIG_TRIGGERS */
 
 	ucred = vfs_context_ucred(ctx);
-	ndp->ni_flag &= ~(NAMEI_TRAILINGSLASH);
+	ndp->ni_flag &= ~(NAMEI_TRAILINGSLASH | NAMEI_PATHCACHED);
 
-	NAME_CACHE_LOCK_SHARED();
+	/*
+	 * Nothing below may block until the walk is left, except the MAC
+	 * check which temporarily leaves an SMR walk (see there).
+	 */
+	if (in_smr) {
+		smr_enter(&nc_smr);
+	} else {
+		NAME_CACHE_LOCK_SHARED();
+	}
 
 	if (dp->v_mount && (dp->v_mount->mnt_kern_flag & (MNTK_AUTH_OPAQUE | MNTK_AUTH_CACHE_TTL))) {
 		ttl_enabled = TRUE;
 		microuptime(&tv);
 	}
+	/* only a walk of the whole path from its start can go in the path cache */
+	pathcacheable = (last_dp == NULLVP) && !ttl_enabled;
+
 	for (;;) {
 		/*
 		 * Search a directory.
@@ -1659,9 +1886,31 @@ skiprsrcfork:
 		 * be perfomed in lookup().
 		 */
 		if (!(cnp->cn_flags & DONOTAUTH)) {
-			error = mac_vnode_check_lookup(ctx, dp, cnp);
+			if (in_smr) {
+				/*
+				 * Policies may block, which an SMR read
+				 * section must not; hold dp across the check
+				 * and make sure it wasn't recycled meanwhile.
+				 */
+				vid = dp->v_id;
+				vnode_hold(dp);
+				smr_leave(&nc_smr);
+				if (held_dp != NULLVP) {
+					vnode_drop(held_dp);
+				}
+				held_dp = dp;
+
+				error = mac_vnode_check_lookup(ctx, dp, cnp);
+
+				smr_enter(&nc_smr);
+				if (error == 0 && dp->v_id != vid) {
+					error = ERECYCLE;
+				}
+			} else {
+				error = mac_vnode_check_lookup(ctx, dp, cnp);
+			}
 			if (error) {
-				NAME_CACHE_UNLOCK();
+				cache_lookup_path_leave(in_smr);
 				goto errorout;
 			}
 		}
@@ -1673,7 +1922,8 @@ skiprsrcfork:
 		}
 
 		/*
-		 * NAME_CACHE_LOCK holds these fields stable
+		 * NAME_CACHE_LOCK holds these fields stable; an SMR walk
+		 * validates them in cache_search_authorized()
 		 *
 		 * We can't cache KAUTH_VNODE_SEARCHBYANYONE for root correctly
 		 * so we make an ugly check for root here. root is always
@@ -1685,8 +1935,7 @@ skiprsrcfork:
 		 * XXX: Remove the check for root when we can reliably set
 		 * KAUTH_VNODE_SEARCHBYANYONE as root.
 		 */
-		if ((vnode_cred(dp) != ucred || !(dp->v_authorized_actions & KAUTH_VNODE_SEARCH)) &&
-		    !(dp->v_authorized_actions & KAUTH_VNODE_SEARCHBYANYONE) &&
+		if (!cache_search_authorized(dp, ucred) &&
 		    (ttl_enabled || !vfs_context_issuser(ctx))) {
 			break;
 		}
@@ -1699,6 +1948,10 @@ skiprsrcfork:
 		 */
 		*dp_authorized = 1;
 
+		if (dp->v_mount && (dp->v_mount->mnt_kern_flag & (MNTK_AUTH_OPAQUE | MNTK_AUTH_CACHE_TTL))) {
+			pathcacheable = FALSE;
+		}
+
 		if ((cnp->cn_flags & (ISLASTCN | ISDOTDOT))) {
 			if (cnp->cn_nameiop != LOOKUP) {
 				break;
@@ -1878,11 +2131,24 @@ skiprsrcfork:
 	if (vp != NULLVP) {
 		vvid = vp->v_id;
 		vnode_hold(vp);
+#if CONFIG_TRIGGERS
+		if (vp->v_resolve) {
+			pathcacheable = FALSE;
+		}
+#endif /* CONFIG_TRIGGERS */
+		if (pathcacheable && (cnp->cn_flags & ISLASTCN)) {
+			ndp->ni_flag |= NAMEI_PATHCACHED;
+		}
 	}
 	vid = dp->v_id;
 
 	vnode_hold(dp);
-	NAME_CACHE_UNLOCK();
+	cache_lookup_path_leave(in_smr);
+
+	if (held_dp != NULLVP) {
+		vnode_drop(held_dp);
+		held_dp = NULLVP;
+	}
 
 	tdp = NULLVP;
 	if ((vp != NULLVP) && (vp->v_type != VLNK) &&
@@ -1951,6 +2217,7 @@ need_dp:
 		if ((vnode_getwithvid_drainok(vp, vvid))) {
 			vnode_drop(vp);
 			vp = NULLVP;
+			ndp->ni_flag &= ~NAMEI_PATHCACHED;
 
 			/*
 			 * can't get reference on the vp we'd like
@@ -1996,6 +2263,9 @@ need_dp:
 #endif /* CONFIG_TRIGGERS */
 
 errorout:
+	if (held_dp != NULLVP) {
+		vnode_drop(held_dp);
+	}
 	/*
 	 * If we came into cache_lookup_path after an iteration of the lookup loop that
 	 * resulted in a call to VNOP_LOOKUP, then VNOP_LOOKUP returned a vnode with a io ref
@@ -2013,12 +2283,161 @@ errorout:
 	return error;
 }
 
+/*
+ * Try to resolve the whole path in ndp from the path cache, on behalf of
+ * namei() before it starts walking.  On a hit the vnode is returned with
+ * an iocount and cnp is left as lookup() would leave it.  Otherwise
+ * *genp is set to the generation cache_path_enter() has to be passed for
+ * the walk that follows, or to 0 if this lookup can't use the path cache.
+ */
+vnode_t
+cache_path_lookup(struct nameidata *ndp, vfs_context_t ctx, uint64_t *genp)
+{
+	struct componentname *cnp = &ndp->ni_cnd;
+	struct pathcache_entry *pe;
+	kauth_cred_t    cred = vfs_context_ucred(ctx);
+	vnode_t         rootdir = ndp->ni_rootdir;
+	vnode_t         vp = NULLVP;
+	uint32_t        vid = 0;
+	uint32_t        hash;
+	size_t          len;
+	char            *cp;
+
+	*genp = 0;
+	if (!nc_pathcache_enabled || nc_pathcache == NULL || rootdir == NULLVP ||
+	    cnp->cn_nameiop != LOOKUP || (cnp->cn_flags & NC_PATHCACHE_CNFLAGS) ||
+	    (ndp->ni_flag & NC_PATHCACHE_NIFLAGS) || cnp->cn_pnbuf[0] != '/') {
+		return NULLVP;
+	}
+	len = strnlen(cnp->cn_pnbuf, NC_PATHCACHE_MAXLEN);
+	if (len == NC_PATHCACHE_MAXLEN || cnp->cn_pnbuf[len - 1] == '/') {
+		return NULLVP;
+	}
+#if CONFIG_MACF
+	/* a hit skips the per-component checks cache_lookup_path() makes */
+	if (mac_vnode_check_lookup_needed(ctx)) {
+		return NULLVP;
+	}
+#endif
+	*genp = cache_path_generation();
+
+	hash = hash_string(cnp->cn_pnbuf, (int)len);
+	pe = &nc_pathcache[hash & (NC_PATHCACHE_SIZE - 1)];
+
+	lck_spin_lock_grp(&pe->pe_lock, &pathcache_lck_grp);
+	if (pe->pe_vp != NULLVP && pe->pe_gen == *genp && pe->pe_hash == hash &&
+	    pe->pe_len == len && pe->pe_cred == cred &&
+	    pe->pe_rootdir == rootdir && pe->pe_rootvid == rootdir->v_id &&
+	    pe->pe_follow == (cnp->cn_flags & FOLLOW) &&
+	    bcmp(pe->pe_path, cnp->cn_pnbuf, len) == 0) {
+		vp = pe->pe_vp;
+		vid = pe->pe_vid;
+		vnode_hold(vp);
+	}
+	lck_spin_unlock(&pe->pe_lock);
+
+	if (vp == NULLVP) {
+		counter_inc(&nc_path_misses);
+		return NULLVP;
+	}
+	if (vnode_getwithvid(vp, vid)) {
+		vnode_drop(vp);
+		counter_inc(&nc_path_misses);
+		return NULLVP;
+	}
+	vnode_drop(vp);
+	counter_inc(&nc_path_hits);
+
+	/* leave the last component accessible, as lookup() does */
+	cp = cnp->cn_pnbuf + len;
+	while (cp[-1] != '/') {
+		cp--;
+	}
+	cnp->cn_nameptr = cp;
+	cnp->cn_namelen = (int)(cnp->cn_pnbuf + len - cp);
+	cnp->cn_hash = 0;
+	cnp->cn_flags &= ~(MAKEENTRY | ISDOTDOT | ISSYMLINK);
+	cnp->cn_flags |= ISLASTCN;
+	if (cnp->cn_namelen == 2 && cp[0] == '.' && cp[1] == '.') {
+		cnp->cn_flags |= ISDOTDOT;
+	}
+	ndp->ni_next = cnp->cn_pnbuf + len;
+	ndp->ni_pathlen = 1;
+
+	return vp;
+}
+
+/*
+ * Remember what namei() resolved ndp's path to, if cache_lookup_path()
+ * did it all by itself.  gen is what cache_path_lookup() handed back
+ * before the walk.
+ */
+void
+cache_path_enter(struct nameidata *ndp, vfs_context_t ctx, uint64_t gen)
+{
+	struct componentname *cnp = &ndp->ni_cnd;
+	struct pathcache_entry *pe;
+	kauth_cred_t    cred = vfs_context_ucred(ctx);
+	kauth_cred_t    ocred;
+	vnode_t         vp = ndp->ni_vp;
+	vnode_t         rootdir = ndp->ni_rootdir;
+	vnode_t         ovp, ordp;
+	uint32_t        hash;
+	size_t          len;
+
+	if (!(ndp->ni_flag & NAMEI_PATHCACHED)) {
+		return;
+	}
+	ndp->ni_flag &= ~NAMEI_PATHCACHED;
+
+	if (gen == 0 || vp == NULLVP || gen != cache_path_generation() ||
+	    (ndp->ni_flag & NAMEI_TRAILINGSLASH) ||
+	    (cnp->cn_flags & (ISSYMLINK | CN_WANTSRSRCFORK))) {
+		return;
+	}
+	len = strnlen(cnp->cn_pnbuf, NC_PATHCACHE_MAXLEN);
+	hash = hash_string(cnp->cn_pnbuf, (int)len);
+	pe = &nc_pathcache[hash & (NC_PATHCACHE_SIZE - 1)];
+
+	kauth_cred_ref(cred);
+	vnode_hold(vp);
+	vnode_hold(rootdir);
+
+	lck_spin_lock_grp(&pe->pe_lock, &pathcache_lck_grp);
+	ovp = pe->pe_vp;
+	ordp = pe->pe_rootdir;
+	ocred = pe->pe_cred;
+
+	pe->pe_vp = vp;
+	pe->pe_vid = vp->v_id;
+	pe->pe_hash = hash;
+	pe->pe_gen = gen;
+	pe->pe_cred = cred;
+	pe->pe_rootdir = rootdir;
+	pe->pe_rootvid = rootdir->v_id;
+	pe->pe_len = (uint16_t)len;
+	pe->pe_follow = (uint16_t)(cnp->cn_flags & FOLLOW);
+	bcopy(cnp->cn_pnbuf, pe->pe_path, len);
+	lck_spin_unlock(&pe->pe_lock);
+
+	if (ovp != NULLVP) {
+		vnode_drop(ovp);
+		vnode_drop(ordp);
+		kauth_cred_set(&ocred, NOCRED);
+	}
+}
+
 
+/*
+ * Called from cache_lookup_path(), either with the name cache lock held
+ * or in an nc_smr read section; entries found in the latter case may
+ * already have been deleted, but are still intact.
+ */
 static vnode_t
 cache_lookup_locked(vnode_t dvp, struct componentname *cnp)
 {
 	struct namecache *ncp;
-	struct nchashhead *ncpp;
+	struct namecache_smr *ncpp;
 	long namelen = cnp->cn_namelen;
 	unsigned int hashval = cnp->cn_hash;
 
@@ -2026,8 +2445,9 @@ cache_lookup_locked(vnode_t dvp, struct componentname *cnp)
 		return NULL;
 	}
 
-	ncpp = NCHHASH(dvp, cnp->cn_hash);
-	LIST_FOREACH(ncp, ncpp, nc_hash) {
+	ncpp = cache_hash_head_smr(dvp, hashval);
+	for (ncp = smr_entered_load(ncpp); ncp != NULL;
+	    ncp = smr_entered_load(&ncp->nc_hash)) {
 		if ((ncp->nc_dvp == dvp) && (ncp->nc_hashval == hashval)) {
 			if (strncmp(ncp->nc_name, cnp->cn_nameptr, namelen) == 0 && ncp->nc_name[namelen] == 0) {
 				break;
@@ -2039,9 +2459,15 @@ cache_lookup_locked(vnode_t dvp, struct componentname *cnp)
 		 * We failed to find an entry
 		 */
 		NCHSTAT(ncs_miss);
+		counter_inc(&nc_misses);
 		return NULL;
 	}
 	NCHSTAT(ncs_goodhits);
+	if (ncp->nc_vp) {
+		counter_inc(&nc_hits);
+	} else {
+		counter_inc(&nc_neghits);
+	}
 
 	return ncp->nc_vp;
 }
@@ -2097,7 +2523,7 @@ int
 cache_lookup(struct vnode *dvp, struct vnode **vpp, struct componentname *cnp)
 {
 	struct namecache *ncp;
-	struct nchashhead *ncpp;
+	struct namecache_smr *ncpp;
 	long namelen = cnp->cn_namelen;
 	unsigned int hashval;
 	boolean_t       have_exclusive = FALSE;
@@ -2117,7 +2543,8 @@ cache_lookup(struct vnode *dvp, struct vnode **vpp, struct componentname *cnp)
 
 relook:
 	ncpp = NCHHASH(dvp, cnp->cn_hash);
-	LIST_FOREACH(ncp, ncpp, nc_hash) {
+	for (ncp = smr_serialized_load(ncpp); ncp != NULL;
+	    ncp = smr_serialized_load(&ncp->nc_hash)) {
 		if ((ncp->nc_dvp == dvp) && (ncp->nc_hashval == hashval)) {
 			if (strncmp(ncp->nc_name, cnp->cn_nameptr, namelen) == 0 && ncp->nc_name[namelen] == 0) {
 				break;
@@ -2135,7 +2562,7 @@ relook:
 	if ((cnp->cn_flags & MAKEENTRY) == 0) {
 		if (have_exclusive == TRUE) {
 			NCHSTAT(ncs_badhits);
-			cache_delete(ncp, 1);
+			cache_delete(ncp);
 			NAME_CACHE_UNLOCK();
 			return 0;
 		}
@@ -2172,7 +2599,7 @@ relook:
 	if (cnp->cn_nameiop == CREATE || cnp->cn_nameiop == RENAME) {
 		if (have_exclusive == TRUE) {
 			NCHSTAT(ncs_badhits);
-			cache_delete(ncp, 1);
+			cache_delete(ncp);
 			NAME_CACHE_UNLOCK();
 			return 0;
 		}
@@ -2272,7 +2699,7 @@ static void
 cache_enter_locked(struct vnode *dvp, struct vnode *vp, struct componentname *cnp, const char *strname)
 {
 	struct namecache *ncp, *negp;
-	struct nchashhead *ncpp;
+	struct namecache_smr *ncpp;
 
 	if (nc_disabled) {
 		return;
@@ -2292,34 +2719,23 @@ cache_enter_locked(struct vnode *dvp, struct vnode *vp, struct componentname *cn
 		return;
 	}
 	/*
-	 * We allocate a new entry if we are less than the maximum
-	 * allowed and the one at the front of the list is in use.
-	 * Otherwise we use the one at the front of the list.
+	 * Once positive entries are at the maximum allowed, the entry at
+	 * the front of the list makes room for us (negative entries are
+	 * limited separately, below).  It can't be reused in place, since
+	 * a lockless lookup may still be looking at it.
 	 */
-	if (numcache < desiredNodes &&
-	    ((ncp = nchead.tqh_first) == NULL ||
-	    ncp->nc_hash.le_prev != 0)) {
-		/*
-		 * Allocate one more entry
-		 */
-		ncp = zalloc(namecache_zone);
-		numcache++;
-	} else {
-		/*
-		 * reuse an old entry
-		 */
-		ncp = TAILQ_FIRST(&nchead);
-		TAILQ_REMOVE(&nchead, ncp, nc_entry);
-
-		if (ncp->nc_hash.le_prev != 0) {
-			/*
-			 * still in use... we need to
-			 * delete it before re-using it
-			 */
-			NCHSTAT(ncs_stolen);
-			cache_delete(ncp, 0);
-		}
-	}
+	if (ncs_retiretotal >= NC_RETIRE_BATCH) {
+		cache_reclaim_retired();
+	}
+	if (vp != NULLVP &&
+	    numcache - ncs_negtotal - ncs_retiretotal >= desiredNodes - desiredNegNodes &&
+	    (ncp = TAILQ_FIRST(&nchead)) != NULL) {
+		NCHSTAT(ncs_stolen);
+		cache_delete(ncp);
+		cache_autogrow_check();
+	}
+	ncp = zalloc(namecache_zone);
+	numcache++;
 	NCHSTAT(ncs_enters);
 
 	/*
@@ -2353,18 +2769,13 @@ cache_enter_locked(struct vnode *dvp, struct vnode *vp, struct componentname *cn
 		ncp->nc_hashval = hash;
 	}
 
-	/*
-	 * make us the newest entry in the cache
-	 * i.e. we'll be the last to be stolen
-	 */
-	TAILQ_INSERT_TAIL(&nchead, ncp, nc_entry);
-
 	ncpp = NCHHASH(dvp, cnp->cn_hash);
 #if DIAGNOSTIC
 	{
 		struct namecache *p;
 
-		for (p = ncpp->lh_first; p != 0; p = p->nc_hash.le_next) {
+		for (p = smr_serialized_load(ncpp); p != NULL;
+		    p = smr_serialized_load(&p->nc_hash)) {
 			if (p == ncp) {
 				panic("cache_enter: duplicate");
 			}
@@ -2372,11 +2783,18 @@ cache_enter_locked(struct vnode *dvp, struct vnode *vp, struct componentname *cn
 	}
 #endif
 	/*
-	 * make us available to be found via lookup
+	 * make us available to be found via lookup; the entry has to be
+	 * filled in before lockless lookups can see it
 	 */
-	LIST_INSERT_HEAD(ncpp, ncp, nc_hash);
+	smr_serialized_store_relaxed(&ncp->nc_hash, smr_serialized_load(ncpp));
+	smr_serialized_store(ncpp, ncp);
 
 	if (vp) {
+		/*
+		 * make us the newest entry in the cache
+		 * i.e. we'll be the last to be stolen
+		 */
+		TAILQ_INSERT_TAIL(&nchead, ncp, nc_entry);
 		/*
 		 * add to the list of name cache entries
 		 * that point at vp
@@ -2390,26 +2808,94 @@ cache_enter_locked(struct vnode *dvp, struct vnode *vp, struct componentname *cn
 		TAILQ_INSERT_TAIL(&neghead, ncp, nc_un.nc_negentry);
 
 		ncs_negtotal++;
-
-		if (ncs_negtotal > desiredNegNodes) {
-			/*
-			 * if we've reached our desired limit
-			 * of negative cache entries, delete
-			 * the oldest
-			 */
-			negp = TAILQ_FIRST(&neghead);
-			cache_delete(negp, 1);
-		}
+		dvp->v_ncnegcount++;
 	}
 	/*
 	 * add us to the list of name cache entries that
-	 * are children of dvp
+	 * are children of dvp; negative ones go first, newest first
 	 */
 	if (vp) {
 		TAILQ_INSERT_TAIL(&dvp->v_ncchildren, ncp, nc_child);
 	} else {
 		TAILQ_INSERT_HEAD(&dvp->v_ncchildren, ncp, nc_child);
 	}
+
+	if (vp == NULLVP && nc_negperdir > 0 &&
+	    dvp->v_ncnegcount > (uint32_t)nc_negperdir) {
+		/*
+		 * dvp has its share of negative entries, delete its
+		 * oldest one: the last before its positive entries.
+		 * Only directories being probed for many missing names
+		 * pay for the walk.
+		 */
+		negp = ncp;
+		while ((ncp = TAILQ_NEXT(negp, nc_child)) != NULL &&
+		    ncp->nc_vp == NULLVP) {
+			negp = ncp;
+		}
+		counter_inc(&nc_neg_dir_evicted);
+		cache_delete(negp);
+	} else if (vp == NULLVP && ncs_negtotal > desiredNegNodes) {
+		/*
+		 * if we've reached our desired limit
+		 * of negative cache entries, delete
+		 * the oldest
+		 */
+		negp = TAILQ_FIRST(&neghead);
+		counter_inc(&nc_neg_evicted);
+		cache_delete(negp);
+		cache_autogrow_check();
+	}
+}
+
+/*
+ * Called with the name cache lock held exclusive when an entry had to be
+ * evicted to make room: have cache_autogrow() look at the hit ratio.
+ */
+static void
+cache_autogrow_check(void)
+{
+	uint64_t deadline;
+
+	if (nc_autogrow_hitpct > 0 && !nc_autogrow_pending &&
+	    nc_autogrow_call != NULL) {
+		nc_autogrow_pending = TRUE;
+		clock_interval_to_deadline(NC_AUTOGROW_INTERVAL, NSEC_PER_SEC, &deadline);
+		thread_call_enter_delayed(nc_autogrow_call, deadline);
+	}
+}
+
+/*
+ * Grow the cache by a quarter if, since the last time we looked, it was
+ * full and fewer than nc_autogrow_hitpct percent of the lookups hit.
+ */
+static void
+cache_autogrow(__unused thread_call_param_t p0, __unused thread_call_param_t p1)
+{
+	uint64_t hits, lookups, dhits, dlookups;
+	int newsize = 0;
+
+	hits = counter_load(&nc_hits) + counter_load(&nc_neghits);
+	lookups = hits + counter_load(&nc_misses);
+
+	NAME_CACHE_LOCK();
+	dhits = hits - nc_autogrow_last_hits;
+	dlookups = lookups - nc_autogrow_last_lookups;
+	if (dlookups >= NC_AUTOGROW_MIN_LOOKUPS) {
+		nc_autogrow_last_hits = hits;
+		nc_autogrow_last_lookups = lookups;
+		if (dhits * 100 < dlookups * (uint64_t)nc_autogrow_hitpct &&
+		    nc_autogrow_size < desiredvnodes * NC_AUTOGROW_MAX) {
+			newsize = MIN(nc_autogrow_size + nc_autogrow_size / 4,
+			    desiredvnodes * NC_AUTOGROW_MAX);
+		}
+	}
+	nc_autogrow_pending = FALSE;
+	NAME_CACHE_UNLOCK();
+
+	if (newsize != 0 && resize_namecache(newsize) == 0) {
+		nc_autogrows++;
+	}
 }
 
 
@@ -2456,9 +2942,20 @@ nchinit(void)
 
 	TAILQ_INIT(&nchead);
 	TAILQ_INIT(&neghead);
+	TAILQ_INIT(&ncretire);
+
+	nc_autogrow_size = desiredvnodes;
+	nc_autogrow_call = thread_call_allocate_with_options(cache_autogrow,
+	    NULL, THREAD_CALL_PRIORITY_LOW, THREAD_CALL_OPTIONS_ONCE);
 
 	init_crc32();
 
+	nc_pathcache = zalloc_permanent(NC_PATHCACHE_SIZE * sizeof(*nc_pathcache),
+	    ZALIGN(struct pathcache_entry));
+	for (int i = 0; i < NC_PATHCACHE_SIZE; i++) {
+		lck_spin_init(&nc_pathcache[i].pe_lock, &pathcache_lck_grp, LCK_ATTR_NULL);
+	}
+
 	nchashtbl = hashinit(MAX(CONFIG_NC_HASH, (2 * desiredNodes)), M_CACHE, &nchash);
 	nchashmask = nchash;
 	nchash++;
@@ -2492,13 +2989,13 @@ name_cache_unlock(void)
 int
 resize_namecache(int newsize)
 {
-	struct nchashhead   *new_table;
-	struct nchashhead   *old_table;
-	struct nchashhead   *old_head, *head;
+	struct namecache_smr *new_table;
+	struct namecache_smr *old_table;
+	struct namecache_smr *old_head, *head;
 	struct namecache    *entry, *next;
 	uint32_t            i, hashval;
 	int                 dNodes, dNegNodes, nelements;
-	u_long              new_size, old_size;
+	u_long              new_size, old_size, new_mask;
 
 	if (newsize < 0) {
 		return EINVAL;
@@ -2515,78 +3012,121 @@ resize_namecache(int newsize)
 		return EINVAL;
 	}
 
-	new_table = hashinit(nelements, M_CACHE, &nchashmask);
-	new_size  = nchashmask + 1;
+	new_table = hashinit(nelements, M_CACHE, &new_mask);
+	new_size  = new_mask + 1;
 
 	if (new_table == NULL) {
 		return ENOMEM;
 	}
 
 	NAME_CACHE_LOCK();
-	// do the switch!
 	old_table = nchashtbl;
-	nchashtbl = new_table;
 	old_size  = nchash;
-	nchash    = new_size;
 
 	// walk the old table and insert all the entries into
-	// the new table
+	// the new table; a lockless lookup that follows a moved
+	// entry may miss, but never loops
 	//
 	for (i = 0; i < old_size; i++) {
 		old_head = &old_table[i];
-		for (entry = old_head->lh_first; entry != NULL; entry = next) {
+		for (entry = smr_serialized_load(old_head); entry != NULL; entry = next) {
 			//
 			// XXXdbg - Beware: this assumes that hash_string() does
 			//                  the same thing as what happens in
 			//                  lookup() over in vfs_lookup.c
 			hashval = hash_string(entry->nc_name, 0);
-			entry->nc_hashval = hashval;
-			head = NCHHASH(entry->nc_dvp, hashval);
+			head = &new_table[(entry->nc_dvp->v_id ^ hashval) & new_mask];
 
-			next = entry->nc_hash.le_next;
-			LIST_INSERT_HEAD(head, entry, nc_hash);
+			next = smr_serialized_load(&entry->nc_hash);
+			smr_serialized_store_relaxed(&entry->nc_hash,
+			    smr_serialized_load(head));
+			smr_serialized_store(head, entry);
+			entry->nc_hashval = hashval;
 		}
 	}
+
+	// do the switch!  the table goes first (see cache_hash_head_smr())
+	os_atomic_store(&nchashtbl, new_table, release);
+	os_atomic_store(&nchashmask, new_mask, release);
+	nchash    = new_size;
 	desiredNodes = dNodes;
 	desiredNegNodes = dNegNodes;
+	nc_autogrow_size = newsize;
 
 	NAME_CACHE_UNLOCK();
+
+	/* lockless lookups may still be walking the old table */
+	smr_synchronize(&nc_smr);
 	hashdestroy(old_table, M_CACHE, old_size - 1);
 
 	return 0;
 }
 
+/*
+ * Unlink an entry from the cache.  Lockless lookups may still be walking
+ * through it, so it keeps its name and hash chain link, and is only freed
+ * by cache_reclaim_retired() once they are past it.
+ */
 static void
-cache_delete(struct namecache *ncp, int free_entry)
+cache_delete(struct namecache *ncp)
 {
+	struct namecache_smr *prev;
+	struct namecache *pn;
+
 	NCHSTAT(ncs_deletes);
 
 	if (ncp->nc_vp) {
 		LIST_REMOVE(ncp, nc_un.nc_link);
+		TAILQ_REMOVE(&nchead, ncp, nc_entry);
 	} else {
 		TAILQ_REMOVE(&neghead, ncp, nc_un.nc_negentry);
 		ncs_negtotal--;
+		ncp->nc_dvp->v_ncnegcount--;
 	}
 	TAILQ_REMOVE(&(ncp->nc_dvp->v_ncchildren), ncp, nc_child);
 
-	LIST_REMOVE(ncp, nc_hash);
-	/*
-	 * this field is used to indicate
-	 * that the entry is in use and
-	 * must be deleted before it can
-	 * be reused...
-	 */
-	ncp->nc_hash.le_prev = NULL;
+	prev = NCHHASH(ncp->nc_dvp, ncp->nc_hashval);
+	while ((pn = smr_serialized_load(prev)) != ncp) {
+		assert(pn != NULL);
+		prev = &pn->nc_hash;
+	}
+	smr_serialized_store_relaxed(prev, smr_serialized_load(&ncp->nc_hash));
 
-	vfs_removename(ncp->nc_name);
-	ncp->nc_name = NULL;
-	if (free_entry) {
-		TAILQ_REMOVE(&nchead, ncp, nc_entry);
+	ncp->nc_un.nc_free_seq = smr_advance(&nc_smr);
+	TAILQ_INSERT_TAIL(&ncretire, ncp, nc_entry);
+	ncs_retiretotal++;
+}
+
+/*
+ * Free the deleted entries no lockless lookup can be looking at anymore;
+ * they were retired in order, so stop at the first one still in use.
+ */
+static void
+cache_reclaim_retired(void)
+{
+	struct namecache *ncp;
+
+	while ((ncp = TAILQ_FIRST(&ncretire)) != NULL &&
+	    smr_poll(&nc_smr, ncp->nc_un.nc_free_seq)) {
+		TAILQ_REMOVE(&ncretire, ncp, nc_entry);
+		ncs_retiretotal--;
+
+		vfs_removename(ncp->nc_name);
 		zfree(namecache_zone, ncp);
 		numcache--;
 	}
 }
 
+/*
+ * Wait for lockless lookups that may have found a vnode or mount, before
+ * it gets freed.
+ */
+void
+cache_smr_synchronize(void)
+{
+	smr_synchronize(&nc_smr);
+}
+
 
 /*
  * purge the entry associated with the
@@ -2610,11 +3150,11 @@ cache_purge_locked(vnode_t vp, kauth_cred_t *credp)
 	}
 
 	while ((ncp = LIST_FIRST(&vp->v_nclinks))) {
-		cache_delete(ncp, 1);
+		cache_delete(ncp);
 	}
 
 	while ((ncp = TAILQ_FIRST(&vp->v_ncchildren))) {
-		cache_delete(ncp, 1);
+		cache_delete(ncp);
 	}
 
 	/*
@@ -2623,6 +3163,14 @@ cache_purge_locked(vnode_t vp, kauth_cred_t *credp)
 	*credp = vnode_cred(vp);
 	vp->v_cred = NOCRED;
 	vp->v_authorized_actions = 0;
+
+	/*
+	 * A vnode being recycled leaves the namespace as it was; path
+	 * cache entries that resolved to it fail their vid check.
+	 */
+	if (!(vp->v_lflag & VL_TERMINATE)) {
+		cache_path_invalidate();
+	}
 }
 
 void
@@ -2665,7 +3213,7 @@ cache_purge_negatives(vnode_t vp)
 			break;
 		}
 
-		cache_delete(ncp, 1);
+		cache_delete(ncp);
 	}
 
 	NAME_CACHE_UNLOCK();
@@ -2680,20 +3228,22 @@ cache_purge_negatives(vnode_t vp)
 void
 cache_purgevfs(struct mount *mp)
 {
-	struct nchashhead *ncpp;
-	struct namecache *ncp;
+	struct namecache_smr *ncpp;
+	struct namecache *ncp, *next;
 
 	NAME_CACHE_LOCK();
 	/* Scan hash tables for applicable entries */
 	for (ncpp = &nchashtbl[nchash - 1]; ncpp >= nchashtbl; ncpp--) {
-restart:
-		for (ncp = ncpp->lh_first; ncp != 0; ncp = ncp->nc_hash.le_next) {
+		for (ncp = smr_serialized_load(ncpp); ncp != NULL; ncp = next) {
+			/* a deleted entry keeps its link */
+			next = smr_serialized_load(&ncp->nc_hash);
 			if (ncp->nc_dvp->v_mount == mp) {
-				cache_delete(ncp, 0);
-				goto restart;
+				cache_delete(ncp);
 			}
 		}
 	}
+	cache_reclaim_retired();
+	cache_path_invalidate();
 	NAME_CACHE_UNLOCK();
 }
 
@@ -94,6 +94,7 @@
 #include <sys/kdebug.h>
 #include <sys/kdebug_triage.h>
 #include <libkern/OSAtomic.h>
+#include <libkern/tree.h>
 
 #include <sys/sdt.h>
 
@@ -163,7 +164,7 @@ static LCK_MTX_DECLARE(cl_transaction_mtxp, &cl_mtx_grp);
 static LCK_SPIN_DECLARE(cl_direct_read_spin_lock, &cl_mtx_grp);
 
 static ZONE_DEFINE(cl_rd_zone, "cluster_read",
-    sizeof(struct cl_readahead), ZC_ZFREE_CLEARMEM);
+    sizeof(struct cl_readahead) * CL_READAHEAD_STREAMS, ZC_ZFREE_CLEARMEM);
 
 static ZONE_DEFINE(cl_wr_zone, "cluster_write",
     sizeof(struct cl_writebehind), ZC_ZFREE_CLEARMEM);
@@ -231,9 +232,9 @@ static int      sparse_cluster_push(struct cl_writebehind *, void **cmapp, vnode
 static int      sparse_cluster_add(struct cl_writebehind *, void **cmapp, vnode_t vp, struct cl_extent *, off_t EOF,
     int (*)(buf_t, void *), void *callback_arg, boolean_t vm_initiated);
 
-static kern_return_t vfs_drt_mark_pages(void **cmapp, off_t offset, u_int length, u_int *setcountp);
-static kern_return_t vfs_drt_get_cluster(void **cmapp, off_t *offsetp, u_int *lengthp);
-static kern_return_t vfs_drt_control(void **cmapp, int op_type);
+static kern_return_t vfs_dxt_mark_pages(void **cmapp, off_t offset, u_int length, u_int *setcountp);
+static kern_return_t vfs_dxt_get_cluster(void **cmapp, int order, u_int maxlen, off_t *offsetp, u_int *lengthp);
+static kern_return_t vfs_dxt_control(void **cmapp, int op_type);
 static kern_return_t vfs_get_scmap_push_behavior_internal(void **cmapp, int *push_flag);
 
 
@@ -317,6 +318,110 @@ uint32_t throttle_max_iosize = (128 * 1024);
 
 SYSCTL_INT(_debug, OID_AUTO, lowpri_throttle_max_iosize, CTLFLAG_RW | CTLFLAG_LOCKED, &throttle_max_iosize, 0, "");
 
+/*
+ * a read that doesn't continue any stream of a file takes over its
+ * least recently used stream, unless that one is still reading ahead
+ * and was used within the last CL_RA_STREAM_IDLE_MS
+ */
+#define CL_RA_STREAM_IDLE_MS    100
+
+static int
+sysctl_vfs_readahead_stats(__unused struct sysctl_oid *oidp, __unused void *arg1,
+    __unused int arg2, struct sysctl_req *req)
+{
+	struct vfs_readahead_stats vrs = {};
+	fsid_t  fsid;
+	mount_t mp;
+	int     error;
+
+	if (req->newptr == USER_ADDR_NULL) {
+		return EINVAL;
+	}
+	error = SYSCTL_IN(req, &fsid, sizeof(fsid));
+	if (error) {
+		return error;
+	}
+	if ((mp = mount_list_lookupby_fsid(&fsid, 0, 1)) == NULL) {
+		return ENOENT;
+	}
+	vrs.vrs_hits = os_atomic_load(&mp->mnt_ra_hits, relaxed);
+	vrs.vrs_waste = os_atomic_load(&mp->mnt_ra_waste, relaxed);
+	vrs.vrs_latency = os_atomic_load(&mp->mnt_ra_latency, relaxed);
+	mount_iterdrop(mp);
+
+	return SYSCTL_OUT(req, &vrs, sizeof(vrs));
+}
+
+SYSCTL_DECL(_vfs_generic);
+SYSCTL_PROC(_vfs_generic, OID_AUTO, readahead_stats,
+    CTLTYPE_STRUCT | CTLFLAG_RW | CTLFLAG_ANYBODY | CTLFLAG_LOCKED,
+    NULL, 0, sysctl_vfs_readahead_stats, "S,vfs_readahead_stats",
+    "read ahead statistics of the mount with the fsid written");
+
+static int
+sysctl_vfs_writebehind_order(__unused struct sysctl_oid *oidp, __unused void *arg1,
+    __unused int arg2, struct sysctl_req *req)
+{
+	struct vfs_writebehind_order vwo;
+	uint32_t old_order;
+	mount_t mp;
+	int     error;
+
+	if (req->newptr == USER_ADDR_NULL) {
+		return EINVAL;
+	}
+	error = SYSCTL_IN(req, &vwo, sizeof(vwo));
+	if (error) {
+		return error;
+	}
+	if (vwo.vwo_order != VFS_WB_ORDER_OFFSET && vwo.vwo_order != VFS_WB_ORDER_AGE) {
+		return EINVAL;
+	}
+	if ((mp = mount_list_lookupby_fsid(&vwo.vwo_fsid, 0, 1)) == NULL) {
+		return ENOENT;
+	}
+	old_order = os_atomic_xchg(&mp->mnt_wb_order, vwo.vwo_order, relaxed);
+	mount_iterdrop(mp);
+
+	vwo.vwo_order = old_order;
+	return SYSCTL_OUT(req, &vwo, sizeof(vwo));
+}
+
+SYSCTL_PROC(_vfs_generic, OID_AUTO, writebehind_order,
+    CTLTYPE_STRUCT | CTLFLAG_RW | CTLFLAG_LOCKED,
+    NULL, 0, sysctl_vfs_writebehind_order, "S,vfs_writebehind_order",
+    "order in which scattered dirty data of the mount with the fsid written is pushed");
+
+/*
+ * dirty page pacing
+ *
+ * pages newly dirtied by delayed writes in cluster_write_copy are charged
+ * to the vnode (cl_dirty_pages) and to the writing process (p_dirty_pages)...
+ * the vnode's charge drops as the cluster layer writes pages back (pushes
+ * and pageouts), the process's charge when it has to wait for write-back.
+ * once either charge passes half of its limit, the writer starts write-behind
+ * on the vnode and pauses for a time proportional to how far it is into the
+ * second half... at the limit it waits for the vnode's dirty data to be
+ * written.  this keeps a streaming writer from building a backlog that only
+ * the pageout daemon ends up cleaning.  a limit of 0 disables that check.
+ */
+uint32_t cluster_dirty_vnode_max = (64 * 1024 * 1024);
+uint32_t cluster_dirty_proc_max = (256 * 1024 * 1024);
+uint32_t cluster_dirty_pause_max_ms = 20;
+uint64_t cluster_dirty_paced = 0;
+uint64_t cluster_dirty_waits = 0;
+
+SYSCTL_UINT(_vfs_generic, OID_AUTO, dirty_vnode_max, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &cluster_dirty_vnode_max, 0, "bytes of dirty data a vnode can accumulate before its writers wait");
+SYSCTL_UINT(_vfs_generic, OID_AUTO, dirty_proc_max, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &cluster_dirty_proc_max, 0, "bytes a process can dirty before it waits for write-back");
+SYSCTL_UINT(_vfs_generic, OID_AUTO, dirty_pause_max_ms, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &cluster_dirty_pause_max_ms, 0, "longest pause of a writer approaching a dirty limit");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, dirty_paced, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &cluster_dirty_paced, "writes paused for approaching a dirty limit");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, dirty_waits, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &cluster_dirty_waits, "writes that waited for write-back at a dirty limit");
+
 
 void
 cluster_init(void)
@@ -394,54 +499,190 @@ cluster_max_prefetch(vnode_t vp, uint32_t max_io_size, uint32_t prefetch_limit)
 #define CLW_IONOCACHE           0x04
 #define CLW_IOPASSIVE   0x08
 
+static void
+cluster_ra_free(struct cl_readahead *streams)
+{
+	for (int i = 0; i < CL_READAHEAD_STREAMS; i++) {
+		lck_mtx_destroy(&streams[i].cl_lockr, &cl_mtx_grp);
+	}
+	zfree(cl_rd_zone, streams);
+}
+
+/*
+ * forget what a stream prefetched beyond what its client read,
+ * accounting for it as waste
+ */
+static void
+cluster_ra_discard(vnode_t vp, struct cl_readahead *rap)
+{
+	if (rap->cl_lastr != -1 && rap->cl_maxra > rap->cl_lastr) {
+		os_atomic_add(&vp->v_mount->mnt_ra_waste,
+		    (uint64_t)(rap->cl_maxra - rap->cl_lastr), relaxed);
+	}
+	rap->cl_maxra = 0;
+}
+
 /*
- * if the read ahead context doesn't yet exist,
- * allocate and initialize it...
+ * if the read ahead streams don't yet exist,
+ * allocate and initialize them...
  * the vnode lock serializes multiple callers
  * during the actual assignment... first one
  * to grab the lock wins... the other callers
  * will release the now unnecessary storage
  *
- * once the context is present, try to grab (but don't block on)
- * the lock associated with it... if someone
- * else currently owns it, than the read
- * will run without read-ahead.  this allows
- * multiple readers to run in parallel and
- * since there's only 1 read ahead context,
- * there's no real loss in only allowing 1
- * reader to have read-ahead enabled.
+ * once they are present, find the stream the read
+ * described by 'extent' continues, or else one it can
+ * start, and try to grab (but don't block on) the lock
+ * associated with it... if someone else currently owns
+ * it, than the read will run without read-ahead.  this
+ * allows multiple readers of a stream to run in parallel,
+ * while interleaved readers of different parts of a file
+ * (parallel scans, an index and its data...) each keep
+ * their own read-ahead going.
  */
 static struct cl_readahead *
-cluster_get_rap(vnode_t vp)
+cluster_get_rap(vnode_t vp, struct cl_extent *extent)
 {
 	struct ubc_info         *ubc;
-	struct cl_readahead     *rap;
+	struct cl_readahead     *streams, *rap, *victim;
+	daddr64_t               lastr;
+	uint64_t                now, idle;
+	int                     i;
 
 	ubc = vp->v_ubcinfo;
 
-	if ((rap = ubc->cl_rahead) == NULL) {
-		rap = zalloc_flags(cl_rd_zone, Z_WAITOK | Z_ZERO);
-		rap->cl_lastr = -1;
-		lck_mtx_init(&rap->cl_lockr, &cl_mtx_grp, LCK_ATTR_NULL);
+	if ((streams = ubc->cl_rahead) == NULL) {
+		streams = zalloc_flags(cl_rd_zone, Z_WAITOK | Z_ZERO);
+		for (i = 0; i < CL_READAHEAD_STREAMS; i++) {
+			streams[i].cl_lastr = -1;
+			lck_mtx_init(&streams[i].cl_lockr, &cl_mtx_grp, LCK_ATTR_NULL);
+		}
 
 		vnode_lock(vp);
 
 		if (ubc->cl_rahead == NULL) {
-			ubc->cl_rahead = rap;
+			ubc->cl_rahead = streams;
 		} else {
-			lck_mtx_destroy(&rap->cl_lockr, &cl_mtx_grp);
-			zfree(cl_rd_zone, rap);
-			rap = ubc->cl_rahead;
+			cluster_ra_free(streams);
+			streams = ubc->cl_rahead;
 		}
 		vnode_unlock(vp);
 	}
-	if (lck_mtx_try_lock(&rap->cl_lockr) == TRUE) {
-		return rap;
+
+	/*
+	 * the unlocked peeks at the streams are only hints,
+	 * they get checked again once the lock is held
+	 */
+	for (i = 0; i < CL_READAHEAD_STREAMS; i++) {
+		rap = &streams[i];
+		lastr = os_atomic_load(&rap->cl_lastr, relaxed);
+
+		if (lastr != -1 && (extent->b_addr == lastr || extent->b_addr == lastr + 1)) {
+			if (lck_mtx_try_lock(&rap->cl_lockr) == TRUE) {
+				if (rap->cl_lastr == lastr) {
+					return rap;
+				}
+				lck_mtx_unlock(&rap->cl_lockr);
+			}
+			return (struct cl_readahead *)NULL;
+		}
+	}
+
+	victim = NULL;
+	for (i = 0; i < CL_READAHEAD_STREAMS; i++) {
+		rap = &streams[i];
+
+		if (rap->cl_lastr == -1) {
+			victim = rap;
+			break;
+		}
+		if (victim == NULL || rap->cl_lastuse < victim->cl_lastuse) {
+			victim = rap;
+		}
+	}
+	if (victim->cl_lastr != -1 && victim->cl_ralen) {
+		now = mach_absolute_time();
+		nanoseconds_to_absolutetime(CL_RA_STREAM_IDLE_MS * NSEC_PER_MSEC, &idle);
+
+		if (now - victim->cl_lastuse < idle) {
+			return (struct cl_readahead *)NULL;
+		}
+	}
+	if (lck_mtx_try_lock(&victim->cl_lockr) == TRUE) {
+		cluster_ra_discard(vp, victim);
+		victim->cl_lastr = -1;
+		victim->cl_ralen = 0;
+		victim->cl_rate = 0;
+		victim->cl_lastuse = 0;
+		return victim;
 	}
 
 	return (struct cl_readahead *)NULL;
 }
 
+/*
+ * pages of read-ahead that keep a stream consuming cl_rate pages/sec
+ * fed for twice the read latency of its mount; 0 until both are known
+ */
+static int
+cluster_ra_window(vnode_t vp, struct cl_readahead *rap)
+{
+	uint64_t        pages;
+	uint32_t        latency;
+
+	latency = os_atomic_load(&vp->v_mount->mnt_ra_latency, relaxed);
+
+	if (rap->cl_rate == 0 || latency == 0) {
+		return 0;
+	}
+	pages = ((uint64_t)rap->cl_rate * latency * 2) / USEC_PER_SEC;
+
+	return (int)MIN(MAX(pages, 1), INT_MAX);
+}
+
+/*
+ * fold the time a read issued at 'issued_at' took to
+ * complete into the read latency of its mount
+ */
+static void
+cluster_ra_update_latency(mount_t mp, uint64_t issued_at)
+{
+	uint64_t        usecs;
+	uint32_t        latency;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - issued_at, &usecs);
+	usecs = MIN(usecs / NSEC_PER_USEC, UINT32_MAX);
+
+	latency = os_atomic_load(&mp->mnt_ra_latency, relaxed);
+	latency = latency ? (uint32_t)((latency * 7ULL + usecs) / 8) : (uint32_t)usecs;
+	os_atomic_store(&mp->mnt_ra_latency, MAX(latency, 1), relaxed);
+}
+
+/*
+ * fold the rate at which the client of a stream read
+ * 'extent' into the stream's consumption rate
+ */
+static void
+cluster_ra_update_rate(struct cl_readahead *rap, struct cl_extent *extent, boolean_t sequential)
+{
+	uint64_t        now, nsecs, rate;
+
+	now = mach_absolute_time();
+
+	if (sequential && rap->cl_lastuse) {
+		absolutetime_to_nanoseconds(now - rap->cl_lastuse, &nsecs);
+
+		if (nsecs) {
+			rate = ((uint64_t)(extent->e_addr - extent->b_addr + 1) * NSEC_PER_SEC) / nsecs;
+			rate = MIN(rate, UINT32_MAX);
+
+			rap->cl_rate = rap->cl_rate ?
+			    (uint32_t)((rap->cl_rate * 3ULL + rate) / 4) : (uint32_t)rate;
+		}
+	}
+	rap->cl_lastuse = now;
+}
+
 
 /*
  * if the write behind context doesn't yet exist,
@@ -492,6 +733,123 @@ cluster_get_wbp(vnode_t vp, int flags)
 }
 
 
+/*
+ * charge pages newly dirtied by a delayed write
+ * to the vnode and to the current process
+ */
+static void
+cluster_dirty_charge(vnode_t vp, uint32_t pages)
+{
+	struct cl_writebehind *wbp;
+
+	if (pages == 0) {
+		return;
+	}
+	wbp = cluster_get_wbp(vp, CLW_ALLOCATE);
+
+	os_atomic_add(&wbp->cl_dirty_pages, pages, relaxed);
+	os_atomic_add(&current_proc()->p_dirty_pages, pages, relaxed);
+}
+
+
+/*
+ * pages of the vnode are being written back...
+ * the charge is only an estimate (pages dirtied through a mapping
+ * or rewritten while resident were never charged) so clamp at 0
+ */
+static void
+cluster_dirty_discharge(vnode_t vp, uint32_t pages)
+{
+	struct cl_writebehind *wbp;
+	uint32_t ov, nv;
+
+	if (!UBCINFOEXISTS(vp) || (wbp = cluster_get_wbp(vp, 0)) == NULL) {
+		return;
+	}
+	os_atomic_rmw_loop(&wbp->cl_dirty_pages, ov, nv, relaxed, {
+		if (ov == 0) {
+		        os_atomic_rmw_loop_give_up(return );
+		}
+		nv = (ov > pages) ? ov - pages : 0;
+	});
+}
+
+
+/*
+ * how far a charge is into the second half of its limit, in thousandths
+ */
+static uint32_t
+cluster_dirty_permille(uint32_t pages, uint32_t limit)
+{
+	uint64_t dirty = ptoa_64(pages);
+	uint64_t half = limit / 2;
+
+	if (limit == 0 || dirty <= half) {
+		return 0;
+	}
+	if (dirty >= limit) {
+		return 1000;
+	}
+	return (uint32_t)(((dirty - half) * 1000) / (limit - half));
+}
+
+
+/*
+ * called after a delayed write to hold the writer
+ * back in proportion to the dirty data it has built up
+ */
+static void
+cluster_dirty_pace(vnode_t vp, int (*callback)(buf_t, void *), void *callback_arg)
+{
+	struct cl_writebehind *wbp;
+	proc_t   p = current_proc();
+	uint32_t vnode_pages;
+	uint32_t permille;
+
+	if (p == kernproc || (wbp = cluster_get_wbp(vp, 0)) == NULL) {
+		return;
+	}
+	vnode_pages = os_atomic_load(&wbp->cl_dirty_pages, relaxed);
+
+	permille = MAX(cluster_dirty_permille(vnode_pages, cluster_dirty_vnode_max),
+	    cluster_dirty_permille(os_atomic_load(&p->p_dirty_pages, relaxed), cluster_dirty_proc_max));
+
+	if (permille == 0) {
+		return;
+	}
+	KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 84)) | DBG_FUNC_START, kdebug_vnode(vp), vnode_pages, permille, 0, 0);
+
+	if (permille >= 1000) {
+		/*
+		 * at a limit... write back everything the vnode
+		 * has in its clusters before dirtying any more
+		 */
+		os_atomic_inc(&cluster_dirty_waits, relaxed);
+
+		cluster_push_err(vp, IO_SYNC, callback, callback_arg, NULL);
+
+		os_atomic_store(&wbp->cl_dirty_pages, 0, relaxed);
+		os_atomic_store(&p->p_dirty_pages, 0, relaxed);
+	} else {
+		uint32_t ov, nv;
+
+		/*
+		 * start write-behind on the vnode and give
+		 * the device a proportional head start
+		 */
+		os_atomic_inc(&cluster_dirty_paced, relaxed);
+
+		cluster_push_err(vp, 0, callback, callback_arg, NULL);
+
+		os_atomic_rmw_loop(&p->p_dirty_pages, ov, nv, relaxed, {
+			nv = (ov > vnode_pages) ? ov - vnode_pages : 0;
+		});
+		delay((int)(cluster_dirty_pause_max_ms * permille));
+	}
+	KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 84)) | DBG_FUNC_END, kdebug_vnode(vp), os_atomic_load(&wbp->cl_dirty_pages, relaxed), permille, 0, 0);
+}
+
+
 static void
 cluster_syncup(vnode_t vp, off_t newEOF, int (*callback)(buf_t, void *), void *callback_arg, int flags)
 {
@@ -1233,6 +1591,13 @@ cluster_io(vnode_t vp, upl_t upl, vm_offset_t upl_offset, off_t f_offset, int no
 
 	mp = vp->v_mount;
 
+	if (!(flags & (CL_READ | CL_DEV_MEMORY | CL_DIRECT_IO))) {
+		/*
+		 * write-back of cached pages (a push or a pageout)
+		 */
+		cluster_dirty_discharge(vp, atop_32(round_page_32(non_rounded_size + (upl_offset & PAGE_MASK))));
+	}
+
 	/*
 	 * we don't want to do any funny rounding of the size for IO requests
 	 * coming through the DIRECT or CONTIGUOUS paths...  those pages don't
@@ -2175,7 +2540,7 @@ cluster_read_ahead(vnode_t vp, struct cl_extent *extent, off_t filesize, struct
 	}
 	if (rap->cl_lastr == -1 || (extent->b_addr != rap->cl_lastr && extent->b_addr != (rap->cl_lastr + 1))) {
 		rap->cl_ralen = 0;
-		rap->cl_maxra = 0;
+		cluster_ra_discard(vp, rap);
 
 		KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 48)) | DBG_FUNC_END,
 		    rap->cl_ralen, (int)rap->cl_maxra, (int)rap->cl_lastr, 1, 0);
@@ -2212,8 +2577,18 @@ cluster_read_ahead(vnode_t vp, struct cl_extent *extent, off_t filesize, struct
 	}
 	if (f_offset < filesize) {
 		daddr64_t read_size;
+		int       window;
 
-		rap->cl_ralen = rap->cl_ralen ? min(max_prefetch / PAGE_SIZE, rap->cl_ralen << 1) : 1;
+		/*
+		 * once we know how fast the client reads and how long the
+		 * device takes, prefetch just enough to hide that latency;
+		 * until then, ramp up by doubling
+		 */
+		if ((window = cluster_ra_window(vp, rap))) {
+			rap->cl_ralen = min(max_prefetch / PAGE_SIZE, window);
+		} else {
+			rap->cl_ralen = rap->cl_ralen ? min(max_prefetch / PAGE_SIZE, rap->cl_ralen << 1) : 1;
+		}
 
 		read_size = (extent->e_addr + 1) - extent->b_addr;
 
@@ -2519,6 +2894,10 @@ cluster_write_ext(vnode_t vp, struct uio *uio, off_t oldEOF, off_t newEOF, off_t
 				write_length = (u_int32_t)cur_resid;
 			}
 			retval = cluster_write_copy(vp, uio, write_length, oldEOF, newEOF, headOff, tailOff, zflags, callback, callback_arg);
+
+			if (retval == 0 && !(zflags & IO_SYNC)) {
+				cluster_dirty_pace(vp, callback, callback_arg);
+			}
 			break;
 
 		case IO_CONTIG:
@@ -3908,6 +4287,16 @@ cluster_write_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t old
 			 *    of this vnode is in progress, we will deadlock if the pages being flushed intersect the pages
 			 *    we hold since the flushing context is holding the cluster lock.
 			 */
+			if (!(flags & IO_SYNC)) {
+				uint32_t dirtied = 0;
+
+				for (int pg = 0; pg < pages_in_upl; pg++) {
+					if (!upl_dirty_page(pl, pg)) {
+						dirtied++;
+					}
+				}
+				cluster_dirty_charge(vp, dirtied);
+			}
 			ubc_upl_commit_range(upl, 0, (upl_size_t)upl_size,
 			    UPL_COMMIT_SET_DIRTY | UPL_COMMIT_INACTIVATE | UPL_COMMIT_FREE_ON_EMPTY);
 check_cluster:
@@ -4080,6 +4469,8 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 	int              take_reference = 1;
 	int              policy = IOPOL_DEFAULT;
 	boolean_t        iolock_inited = FALSE;
+	boolean_t        ra_sequential = FALSE;
+	uint64_t         io_issued_at;
 
 	KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 32)) | DBG_FUNC_START,
 	    (int)uio->uio_offset, io_req_size, (int)filesize, flags, 0);
@@ -4133,14 +4524,20 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 
 			max_rd_size = THROTTLE_MAX_IOSIZE;
 		}
-		if ((rap = cluster_get_rap(vp)) == NULL) {
+		extent.b_addr = uio->uio_offset / PAGE_SIZE_64;
+		extent.e_addr = (last_request_offset - 1) / PAGE_SIZE_64;
+
+		if ((rap = cluster_get_rap(vp, &extent)) == NULL) {
 			rd_ahead_enabled = 0;
-		} else {
-			extent.b_addr = uio->uio_offset / PAGE_SIZE_64;
-			extent.e_addr = (last_request_offset - 1) / PAGE_SIZE_64;
 		}
 	}
 	if (rap != NULL && rap->cl_ralen && (rap->cl_lastr == extent.b_addr || (rap->cl_lastr + 1) == extent.b_addr)) {
+		ra_sequential = TRUE;
+
+		if (rap->cl_maxra >= extent.b_addr) {
+			os_atomic_add(&vp->v_mount->mnt_ra_hits,
+			    (uint64_t)(MIN(extent.e_addr, rap->cl_maxra) - extent.b_addr + 1), relaxed);
+		}
 		/*
 		 * determine if we already have a read-ahead in the pipe courtesy of the
 		 * last read systemcall that was issued...
@@ -4246,7 +4643,7 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 			if (io_size == 0) {
 				if (rap != NULL) {
 					if (extent.e_addr < rap->cl_lastr) {
-						rap->cl_maxra = 0;
+						cluster_ra_discard(vp, rap);
 					}
 					rap->cl_lastr = extent.e_addr;
 				}
@@ -4263,6 +4660,7 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 		iostate.io_issued = 0;
 		iostate.io_error = 0;
 		iostate.io_wanted = 0;
+		io_issued_at = 0;
 
 		if ((flags & IO_RETURN_ON_THROTTLE)) {
 			if (cluster_is_throttled(vp) == THROTTLE_NOW) {
@@ -4405,6 +4803,8 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 			 * issue an asynchronous read to cluster_io
 			 */
 
+			io_issued_at = mach_absolute_time();
+
 			error = cluster_io(vp, upl, upl_offset, upl_f_offset + upl_offset,
 			    io_size, CL_READ | CL_ASYNC | bflag, (buf_t)NULL, &iostate, callback, callback_arg);
 
@@ -4416,7 +4816,7 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 					 * has gone wrong with the pipeline, so reset the read-ahead
 					 * logic which will cause us to restart from scratch
 					 */
-					rap->cl_maxra = 0;
+					cluster_ra_discard(vp, rap);
 				}
 			}
 		}
@@ -4500,7 +4900,7 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 
 				if (rap != NULL) {
 					if (extent.e_addr < rap->cl_lastr) {
-						rap->cl_maxra = 0;
+						cluster_ra_discard(vp, rap);
 					}
 					rap->cl_lastr = extent.e_addr;
 				}
@@ -4508,6 +4908,9 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 			if (iolock_inited == TRUE) {
 				cluster_iostate_wait(&iostate, 0, "cluster_read_copy");
 			}
+			if (io_issued_at && iostate.io_error == 0) {
+				cluster_ra_update_latency(vp->v_mount, io_issued_at);
+			}
 
 			if (iostate.io_error) {
 				error = iostate.io_error;
@@ -4632,6 +5035,7 @@ cluster_read_copy(vnode_t vp, struct uio *uio, u_int32_t io_req_size, off_t file
 		KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 32)) | DBG_FUNC_END,
 		    (int)uio->uio_offset, io_req_size, rap->cl_lastr, retval, 0);
 
+		cluster_ra_update_rate(rap, &extent, ra_sequential);
 		lck_mtx_unlock(&rap->cl_lockr);
 	} else {
 		KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 32)) | DBG_FUNC_END,
@@ -5934,7 +6338,7 @@ cluster_push_err(vnode_t vp, int flags, int (*callback)(buf_t, void *), void *ca
 							os_atomic_inc(&cl_sparse_push_error, relaxed);
 						}
 					} else {
-						vfs_drt_control(&scmap, 0); /* emit stats and free this memory. Dirty pages stay intact. */
+						vfs_dxt_control(&scmap, 0); /* free this memory. Dirty pages stay intact. */
 						scmap = NULL;
 					}
 				} else {
@@ -5997,7 +6401,7 @@ cluster_release(struct ubc_info *ubc)
 		KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 81)) | DBG_FUNC_START, ubc, wbp->cl_scmap, 0, 0, 0);
 
 		if (wbp->cl_scmap) {
-			vfs_drt_control(&(wbp->cl_scmap), 0);
+			vfs_dxt_control(&(wbp->cl_scmap), 0);
 		}
 		lck_mtx_destroy(&wbp->cl_lockw, &cl_mtx_grp);
 		zfree(cl_wr_zone, wbp);
@@ -6007,8 +6411,7 @@ cluster_release(struct ubc_info *ubc)
 	}
 
 	if ((rap = ubc->cl_rahead)) {
-		lck_mtx_destroy(&rap->cl_lockr, &cl_mtx_grp);
-		zfree(cl_rd_zone, rap);
+		cluster_ra_free(rap);
 		ubc->cl_rahead  = NULL;
 	}
 
@@ -6468,20 +6871,22 @@ sparse_cluster_push(struct cl_writebehind *wbp, void **scmap, vnode_t vp, off_t
 	off_t           offset;
 	u_int           length;
 	void            *l_scmap;
+	uint32_t        order;
 	int error = 0;
 
 	KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 79)) | DBG_FUNC_START, kdebug_vnode(vp), (*scmap), 0, push_flag, 0);
 
 	if (push_flag & PUSH_ALL) {
-		vfs_drt_control(scmap, 1);
+		vfs_dxt_control(scmap, 1);
 	}
 
 	l_scmap = *scmap;
+	order = os_atomic_load(&vp->v_mount->mnt_wb_order, relaxed);
 
 	for (;;) {
 		int retval;
 
-		if (vfs_drt_get_cluster(scmap, &offset, &length) != KERN_SUCCESS) {
+		if (vfs_dxt_get_cluster(scmap, order, MAX_CLUSTER_SIZE(vp), &offset, &length) != KERN_SUCCESS) {
 			/*
 			 * Not finding anything to push will return KERN_FAILURE.
 			 * Confusing since it isn't really a failure. But that's the
@@ -6511,7 +6916,7 @@ sparse_cluster_push(struct cl_writebehind *wbp, void **scmap, vnode_t vp, off_t
 		}
 
 		if (error) {
-			if (vfs_drt_mark_pages(scmap, offset, length, NULL) != KERN_SUCCESS) {
+			if (vfs_dxt_mark_pages(scmap, offset, length, NULL) != KERN_SUCCESS) {
 				panic("Failed to restore dirty state on failure");
 			}
 
@@ -6546,7 +6951,7 @@ sparse_cluster_add(struct cl_writebehind *wbp, void **scmap, vnode_t vp, struct
 	offset = (off_t)(cl->b_addr * PAGE_SIZE_64);
 	length = ((u_int)(cl->e_addr - cl->b_addr)) * PAGE_SIZE;
 
-	while (vfs_drt_mark_pages(scmap, offset, length, &new_dirty) != KERN_SUCCESS) {
+	while (vfs_dxt_mark_pages(scmap, offset, length, &new_dirty) != KERN_SUCCESS) {
 		/*
 		 * no room left in the map
 		 * only a partial update was done
@@ -6843,858 +7248,288 @@ is_file_clean(vnode_t vp, off_t filesize)
 
 
 /*
- * Dirty region tracking/clustering mechanism.
+ * Dirty extent tracking/clustering mechanism.
  *
- * This code (vfs_drt_*) provides a mechanism for tracking and clustering
- * dirty regions within a larger space (file).  It is primarily intended to
- * support clustering in large files with many dirty areas.
+ * This code (vfs_dxt_*) tracks the dirty regions of a file that the
+ * write-behind clusters couldn't absorb (random writes all over a large
+ * file), so that they can be pushed in large I/Os.
  *
- * The implementation assumes that the dirty regions are pages.
- *
- * To represent dirty pages within the file, we store bit vectors in a
- * variable-size circular hash.
+ * Dirty pages are kept as extents in a tree sorted by file offset;
+ * marking a range merges it with any extent it overlaps or touches, so
+ * neighbouring small writes coalesce into one extent no matter when
+ * they were made.  The extents are also kept in the order they were
+ * first dirtied, for mounts that want the oldest data pushed first
+ * (see vfs.generic.writebehind_order).
  */
 
-/*
- * Bitvector size.  This determines the number of pages we group in a
- * single hashtable entry.  Each hashtable entry is aligned to this
- * size within the file.
- */
-#define DRT_BITVECTOR_PAGES             ((1024 * 256) / PAGE_SIZE)
+struct vfs_dxt_extent {
+	RB_ENTRY(vfs_dxt_extent) dx_link;       /* tree, by file offset */
+	TAILQ_ENTRY(vfs_dxt_extent) dx_age;     /* oldest first */
+	daddr64_t               dx_b_addr;      /* first dirty page */
+	daddr64_t               dx_e_addr;      /* page after the last dirty one */
+};
 
-/*
- * File offset handling.
- *
- * DRT_ADDRESS_MASK is dependent on DRT_BITVECTOR_PAGES;
- * the correct formula is  (~((DRT_BITVECTOR_PAGES * PAGE_SIZE) - 1))
- */
-#define DRT_ADDRESS_MASK                (~((DRT_BITVECTOR_PAGES * PAGE_SIZE) - 1))
-#define DRT_ALIGN_ADDRESS(addr)         ((addr) & DRT_ADDRESS_MASK)
+struct vfs_dxt_map {
+	RB_HEAD(vfs_dxt_tree, vfs_dxt_extent) dm_tree;
+	TAILQ_HEAD(, vfs_dxt_extent) dm_age;
+	u_int32_t               dm_count;       /* extents in the map */
+	u_int32_t               dm_max;         /* extents allowed before a push is needed */
+	daddr64_t               dm_cursor;      /* where an offset ordered push resumes */
+};
 
 /*
- * Hashtable address field handling.
- *
- * The low-order bits of the hashtable address are used to conserve
- * space.
- *
- * DRT_HASH_COUNT_MASK must be large enough to store the range
- * 0-DRT_BITVECTOR_PAGES inclusive, as well as have one value
- * to indicate that the bucket is actually unoccupied.
+ * How many extents a map may track, by physical memory; on the largest
+ * configurations a full map is pushed out all at once (see
+ * vfs_get_scmap_push_behavior_internal()).
  */
-#define DRT_HASH_GET_ADDRESS(scm, i)    ((scm)->scm_hashtable[(i)].dhe_control & DRT_ADDRESS_MASK)
-#define DRT_HASH_SET_ADDRESS(scm, i, a)                                                                 \
-	do {                                                                                            \
-	        (scm)->scm_hashtable[(i)].dhe_control =                                                 \
-	            ((scm)->scm_hashtable[(i)].dhe_control & ~DRT_ADDRESS_MASK) | DRT_ALIGN_ADDRESS(a); \
-	} while (0)
-#define DRT_HASH_COUNT_MASK             0x1ff
-#define DRT_HASH_GET_COUNT(scm, i)      ((scm)->scm_hashtable[(i)].dhe_control & DRT_HASH_COUNT_MASK)
-#define DRT_HASH_SET_COUNT(scm, i, c)                                                                                   \
-	do {                                                                                                            \
-	        (scm)->scm_hashtable[(i)].dhe_control =                                                                 \
-	            ((scm)->scm_hashtable[(i)].dhe_control & ~DRT_HASH_COUNT_MASK) | ((c) & DRT_HASH_COUNT_MASK);       \
-	} while (0)
-#define DRT_HASH_CLEAR(scm, i)                                                                                          \
-	do {                                                                                                            \
-	        (scm)->scm_hashtable[(i)].dhe_control =	0;                                                              \
-	} while (0)
-#define DRT_HASH_VACATE(scm, i)         DRT_HASH_SET_COUNT((scm), (i), DRT_HASH_COUNT_MASK)
-#define DRT_HASH_VACANT(scm, i)         (DRT_HASH_GET_COUNT((scm), (i)) == DRT_HASH_COUNT_MASK)
-#define DRT_HASH_COPY(oscm, oi, scm, i)                                                                 \
-	do {                                                                                            \
-	        (scm)->scm_hashtable[(i)].dhe_control = (oscm)->scm_hashtable[(oi)].dhe_control;        \
-	        DRT_BITVECTOR_COPY(oscm, oi, scm, i);                                                   \
-	} while(0);
-
-
 #if !defined(XNU_TARGET_OS_OSX)
-/*
- * Hash table moduli.
- *
- * Since the hashtable entry's size is dependent on the size of
- * the bitvector, and since the hashtable size is constrained to
- * both being prime and fitting within the desired allocation
- * size, these values need to be manually determined.
- *
- * For DRT_BITVECTOR_SIZE = 64, the entry size is 16 bytes.
- *
- * The small hashtable allocation is 4096 bytes, so the modulus is 251.
- * The large hashtable allocation is 32768 bytes, so the modulus is 2039.
- * The xlarge hashtable allocation is 131072 bytes, so the modulus is 8179.
- */
-
-#define DRT_HASH_SMALL_MODULUS  251
-#define DRT_HASH_LARGE_MODULUS  2039
-#define DRT_HASH_XLARGE_MODULUS  8179
-
-/*
- * Physical memory required before the large hash modulus is permitted.
- *
- * On small memory systems, the large hash modulus can lead to phsyical
- * memory starvation, so we avoid using it there.
- */
-#define DRT_HASH_LARGE_MEMORY_REQUIRED  (1024LL * 1024LL * 1024LL)      /* 1GiB */
-#define DRT_HASH_XLARGE_MEMORY_REQUIRED  (8 * 1024LL * 1024LL * 1024LL)  /* 8GiB */
-
-#define DRT_SMALL_ALLOCATION    4096    /* 80 bytes spare */
-#define DRT_LARGE_ALLOCATION    32768   /* 144 bytes spare */
-#define DRT_XLARGE_ALLOCATION    131072  /* 208 bytes spare */
-
+#define DXT_LARGE_MEMORY_REQUIRED       (1024LL * 1024LL * 1024LL)              /* 1GiB */
+#define DXT_XLARGE_MEMORY_REQUIRED      (8 * 1024LL * 1024LL * 1024LL)          /* 8GiB */
 #else /* XNU_TARGET_OS_OSX */
-/*
- * Hash table moduli.
- *
- * Since the hashtable entry's size is dependent on the size of
- * the bitvector, and since the hashtable size is constrained to
- * both being prime and fitting within the desired allocation
- * size, these values need to be manually determined.
- *
- * For DRT_BITVECTOR_SIZE = 64, the entry size is 16 bytes.
- *
- * The small hashtable allocation is 16384 bytes, so the modulus is 1019.
- * The large hashtable allocation is 131072 bytes, so the modulus is 8179.
- * The xlarge hashtable allocation is 524288 bytes, so the modulus is 32749.
- */
-
-#define DRT_HASH_SMALL_MODULUS  1019
-#define DRT_HASH_LARGE_MODULUS  8179
-#define DRT_HASH_XLARGE_MODULUS  32749
-
-/*
- * Physical memory required before the large hash modulus is permitted.
- *
- * On small memory systems, the large hash modulus can lead to phsyical
- * memory starvation, so we avoid using it there.
- */
-#define DRT_HASH_LARGE_MEMORY_REQUIRED  (4 * 1024LL * 1024LL * 1024LL)  /* 4GiB */
-#define DRT_HASH_XLARGE_MEMORY_REQUIRED  (32 * 1024LL * 1024LL * 1024LL)  /* 32GiB */
-
-#define DRT_SMALL_ALLOCATION    16384   /* 80 bytes spare */
-#define DRT_LARGE_ALLOCATION    131072  /* 208 bytes spare */
-#define DRT_XLARGE_ALLOCATION   524288  /* 304 bytes spare */
-
+#define DXT_LARGE_MEMORY_REQUIRED       (4 * 1024LL * 1024LL * 1024LL)          /* 4GiB */
+#define DXT_XLARGE_MEMORY_REQUIRED      (32 * 1024LL * 1024LL * 1024LL)         /* 32GiB */
 #endif /* ! XNU_TARGET_OS_OSX */
 
-/* *** nothing below here has secret dependencies on DRT_BITVECTOR_PAGES *** */
-
-/*
- * Hashtable entry.
- */
-struct vfs_drt_hashentry {
-	u_int64_t       dhe_control;
-/*
- * dhe_bitvector was declared as dhe_bitvector[DRT_BITVECTOR_PAGES / 32];
- * DRT_BITVECTOR_PAGES is defined as ((1024 * 256) / PAGE_SIZE)
- * Since PAGE_SIZE is only known at boot time,
- *	-define MAX_DRT_BITVECTOR_PAGES for smallest supported page size (4k)
- *	-declare dhe_bitvector array for largest possible length
- */
-#define MAX_DRT_BITVECTOR_PAGES (1024 * 256)/( 4 * 1024)
-	u_int32_t       dhe_bitvector[MAX_DRT_BITVECTOR_PAGES / 32];
-};
-
-/*
- * Hashtable bitvector handling.
- *
- * Bitvector fields are 32 bits long.
- */
-
-#define DRT_HASH_SET_BIT(scm, i, bit)                           \
-	(scm)->scm_hashtable[(i)].dhe_bitvector[(bit) / 32] |= (1 << ((bit) % 32))
+#define DXT_SMALL_EXTENTS               1024
+#define DXT_LARGE_EXTENTS               8192
+#define DXT_XLARGE_EXTENTS              32768
 
-#define DRT_HASH_CLEAR_BIT(scm, i, bit)                         \
-	(scm)->scm_hashtable[(i)].dhe_bitvector[(bit) / 32] &= ~(1 << ((bit) % 32))
-
-#define DRT_HASH_TEST_BIT(scm, i, bit)                          \
-	((scm)->scm_hashtable[(i)].dhe_bitvector[(bit) / 32] & (1 << ((bit) % 32)))
-
-#define DRT_BITVECTOR_CLEAR(scm, i)                             \
-	bzero(&(scm)->scm_hashtable[(i)].dhe_bitvector[0], (MAX_DRT_BITVECTOR_PAGES / 32) * sizeof(u_int32_t))
-
-#define DRT_BITVECTOR_COPY(oscm, oi, scm, i)                    \
-	bcopy(&(oscm)->scm_hashtable[(oi)].dhe_bitvector[0],    \
-	    &(scm)->scm_hashtable[(i)].dhe_bitvector[0],        \
-	    (MAX_DRT_BITVECTOR_PAGES / 32) * sizeof(u_int32_t))
-
-/*
- * Dirty Region Tracking structure.
- *
- * The hashtable is allocated entirely inside the DRT structure.
- *
- * The hash is a simple circular prime modulus arrangement, the structure
- * is resized from small to large if it overflows.
- */
-
-struct vfs_drt_clustermap {
-	u_int32_t               scm_magic;      /* sanity/detection */
-#define DRT_SCM_MAGIC           0x12020003
-	u_int32_t               scm_modulus;    /* current ring size */
-	u_int32_t               scm_buckets;    /* number of occupied buckets */
-	u_int32_t               scm_lastclean;  /* last entry we cleaned */
-	u_int32_t               scm_iskips;     /* number of slot skips */
-
-	struct vfs_drt_hashentry scm_hashtable[0];
-};
-
-
-#define DRT_HASH(scm, addr)             ((addr) % (scm)->scm_modulus)
-#define DRT_HASH_NEXT(scm, addr)        (((addr) + 1) % (scm)->scm_modulus)
-
-/*
- * Debugging codes and arguments.
- */
-#define DRT_DEBUG_EMPTYFREE     (FSDBG_CODE(DBG_FSRW, 82)) /* nil */
-#define DRT_DEBUG_RETCLUSTER    (FSDBG_CODE(DBG_FSRW, 83)) /* offset, length */
-#define DRT_DEBUG_ALLOC         (FSDBG_CODE(DBG_FSRW, 84)) /* copycount */
-#define DRT_DEBUG_INSERT        (FSDBG_CODE(DBG_FSRW, 85)) /* offset, iskip */
-#define DRT_DEBUG_MARK          (FSDBG_CODE(DBG_FSRW, 86)) /* offset, length,
-	                                                    * dirty */
-                                                           /* 0, setcount */
-                                                           /* 1 (clean, no map) */
-                                                           /* 2 (map alloc fail) */
-                                                           /* 3, resid (partial) */
-#define DRT_DEBUG_6             (FSDBG_CODE(DBG_FSRW, 87))
-#define DRT_DEBUG_SCMDATA       (FSDBG_CODE(DBG_FSRW, 88)) /* modulus, buckets,
-	                                                    * lastclean, iskips */
-
-
-static kern_return_t    vfs_drt_alloc_map(struct vfs_drt_clustermap **cmapp);
-static kern_return_t    vfs_drt_free_map(struct vfs_drt_clustermap *cmap);
-static kern_return_t    vfs_drt_search_index(struct vfs_drt_clustermap *cmap,
-    u_int64_t offset, int *indexp);
-static kern_return_t    vfs_drt_get_index(struct vfs_drt_clustermap **cmapp,
-    u_int64_t offset,
-    int *indexp,
-    int recursed);
-static kern_return_t    vfs_drt_do_mark_pages(
-	void            **cmapp,
-	u_int64_t       offset,
-	u_int           length,
-	u_int           *setcountp,
-	int             dirty);
-static void             vfs_drt_trace(
-	struct vfs_drt_clustermap *cmap,
-	int code,
-	int arg1,
-	int arg2,
-	int arg3,
-	int arg4);
-
-
-/*
- * Allocate and initialise a sparse cluster map.
- *
- * Will allocate a new map, resize or compact an existing map.
- *
- * XXX we should probably have at least one intermediate map size,
- * as the 1:16 ratio seems a bit drastic.
- */
-static kern_return_t
-vfs_drt_alloc_map(struct vfs_drt_clustermap **cmapp)
-{
-	struct vfs_drt_clustermap *cmap = NULL, *ocmap = NULL;
-	kern_return_t   kret = KERN_SUCCESS;
-	u_int64_t       offset = 0;
-	u_int32_t       i = 0;
-	int             modulus_size = 0, map_size = 0, active_buckets = 0, index = 0, copycount = 0;
-
-	ocmap = NULL;
-	if (cmapp != NULL) {
-		ocmap = *cmapp;
-	}
-
-	/*
-	 * Decide on the size of the new map.
-	 */
-	if (ocmap == NULL) {
-		modulus_size = DRT_HASH_SMALL_MODULUS;
-		map_size = DRT_SMALL_ALLOCATION;
-	} else {
-		/* count the number of active buckets in the old map */
-		active_buckets = 0;
-		for (i = 0; i < ocmap->scm_modulus; i++) {
-			if (!DRT_HASH_VACANT(ocmap, i) &&
-			    (DRT_HASH_GET_COUNT(ocmap, i) != 0)) {
-				active_buckets++;
-			}
-		}
-		/*
-		 * If we're currently using the small allocation, check to
-		 * see whether we should grow to the large one.
-		 */
-		if (ocmap->scm_modulus == DRT_HASH_SMALL_MODULUS) {
-			/*
-			 * If the ring is nearly full and we are allowed to
-			 * use the large modulus, upgrade.
-			 */
-			if ((active_buckets > (DRT_HASH_SMALL_MODULUS - 5)) &&
-			    (max_mem >= DRT_HASH_LARGE_MEMORY_REQUIRED)) {
-				modulus_size = DRT_HASH_LARGE_MODULUS;
-				map_size = DRT_LARGE_ALLOCATION;
-			} else {
-				modulus_size = DRT_HASH_SMALL_MODULUS;
-				map_size = DRT_SMALL_ALLOCATION;
-			}
-		} else if (ocmap->scm_modulus == DRT_HASH_LARGE_MODULUS) {
-			if ((active_buckets > (DRT_HASH_LARGE_MODULUS - 5)) &&
-			    (max_mem >= DRT_HASH_XLARGE_MEMORY_REQUIRED)) {
-				modulus_size = DRT_HASH_XLARGE_MODULUS;
-				map_size = DRT_XLARGE_ALLOCATION;
-			} else {
-				/*
-				 * If the ring is completely full and we can't
-				 * expand, there's nothing useful for us to do.
-				 * Behave as though we had compacted into the new
-				 * array and return.
-				 */
-				return KERN_SUCCESS;
-			}
-		} else {
-			/* already using the xlarge modulus */
-			modulus_size = DRT_HASH_XLARGE_MODULUS;
-			map_size = DRT_XLARGE_ALLOCATION;
-
-			/*
-			 * If the ring is completely full, there's
-			 * nothing useful for us to do.  Behave as
-			 * though we had compacted into the new
-			 * array and return.
-			 */
-			if (active_buckets >= DRT_HASH_XLARGE_MODULUS) {
-				return KERN_SUCCESS;
-			}
-		}
-	}
-
-	/*
-	 * Allocate and initialise the new map.
-	 */
-
-	kret = kmem_alloc(kernel_map, (vm_offset_t *)&cmap, map_size,
-	    KMA_DATA, VM_KERN_MEMORY_FILE);
-	if (kret != KERN_SUCCESS) {
-		return kret;
-	}
-	cmap->scm_magic = DRT_SCM_MAGIC;
-	cmap->scm_modulus = modulus_size;
-	cmap->scm_buckets = 0;
-	cmap->scm_lastclean = 0;
-	cmap->scm_iskips = 0;
-	for (i = 0; i < cmap->scm_modulus; i++) {
-		DRT_HASH_CLEAR(cmap, i);
-		DRT_HASH_VACATE(cmap, i);
-		DRT_BITVECTOR_CLEAR(cmap, i);
-	}
-
-	/*
-	 * If there's an old map, re-hash entries from it into the new map.
-	 */
-	copycount = 0;
-	if (ocmap != NULL) {
-		for (i = 0; i < ocmap->scm_modulus; i++) {
-			/* skip empty buckets */
-			if (DRT_HASH_VACANT(ocmap, i) ||
-			    (DRT_HASH_GET_COUNT(ocmap, i) == 0)) {
-				continue;
-			}
-			/* get new index */
-			offset = DRT_HASH_GET_ADDRESS(ocmap, i);
-			kret = vfs_drt_get_index(&cmap, offset, &index, 1);
-			if (kret != KERN_SUCCESS) {
-				/* XXX need to bail out gracefully here */
-				panic("vfs_drt: new cluster map mysteriously too small");
-				index = 0;
-			}
-			/* copy */
-			DRT_HASH_COPY(ocmap, i, cmap, index);
-			copycount++;
-		}
-	}
-
-	/* log what we've done */
-	vfs_drt_trace(cmap, DRT_DEBUG_ALLOC, copycount, 0, 0, 0);
-
-	/*
-	 * It's important to ensure that *cmapp always points to
-	 * a valid map, so we must overwrite it before freeing
-	 * the old map.
-	 */
-	*cmapp = cmap;
-	if (ocmap != NULL) {
-		/* emit stats into trace buffer */
-		vfs_drt_trace(ocmap, DRT_DEBUG_SCMDATA,
-		    ocmap->scm_modulus,
-		    ocmap->scm_buckets,
-		    ocmap->scm_lastclean,
-		    ocmap->scm_iskips);
-
-		vfs_drt_free_map(ocmap);
-	}
-	return KERN_SUCCESS;
-}
-
-
-/*
- * Free a sparse cluster map.
- */
-static kern_return_t
-vfs_drt_free_map(struct vfs_drt_clustermap *cmap)
+static int
+vfs_dxt_compare(struct vfs_dxt_extent *a, struct vfs_dxt_extent *b)
 {
-	vm_size_t map_size = 0;
-
-	if (cmap->scm_modulus == DRT_HASH_SMALL_MODULUS) {
-		map_size = DRT_SMALL_ALLOCATION;
-	} else if (cmap->scm_modulus == DRT_HASH_LARGE_MODULUS) {
-		map_size = DRT_LARGE_ALLOCATION;
-	} else if (cmap->scm_modulus == DRT_HASH_XLARGE_MODULUS) {
-		map_size = DRT_XLARGE_ALLOCATION;
-	} else {
-		panic("vfs_drt_free_map: Invalid modulus %d", cmap->scm_modulus);
+	if (a->dx_b_addr < b->dx_b_addr) {
+		return -1;
 	}
-
-	kmem_free(kernel_map, (vm_offset_t)cmap, map_size);
-	return KERN_SUCCESS;
+	return a->dx_b_addr > b->dx_b_addr;
 }
 
+RB_PROTOTYPE_PREV(vfs_dxt_tree, vfs_dxt_extent, dx_link, vfs_dxt_compare);
+RB_GENERATE_PREV(vfs_dxt_tree, vfs_dxt_extent, dx_link, vfs_dxt_compare);
 
-/*
- * Find the hashtable slot currently occupied by an entry for the supplied offset.
- */
-static kern_return_t
-vfs_drt_search_index(struct vfs_drt_clustermap *cmap, u_int64_t offset, int *indexp)
+static void
+vfs_dxt_remove(struct vfs_dxt_map *dmap, struct vfs_dxt_extent *dx)
 {
-	int             index;
-	u_int32_t       i;
-
-	offset = DRT_ALIGN_ADDRESS(offset);
-	index = DRT_HASH(cmap, offset);
-
-	/* traverse the hashtable */
-	for (i = 0; i < cmap->scm_modulus; i++) {
-		/*
-		 * If the slot is vacant, we can stop.
-		 */
-		if (DRT_HASH_VACANT(cmap, index)) {
-			break;
-		}
-
-		/*
-		 * If the address matches our offset, we have success.
-		 */
-		if (DRT_HASH_GET_ADDRESS(cmap, index) == offset) {
-			*indexp = index;
-			return KERN_SUCCESS;
-		}
-
-		/*
-		 * Move to the next slot, try again.
-		 */
-		index = DRT_HASH_NEXT(cmap, index);
-	}
-	/*
-	 * It's not there.
-	 */
-	return KERN_FAILURE;
+	RB_REMOVE(vfs_dxt_tree, &dmap->dm_tree, dx);
+	TAILQ_REMOVE(&dmap->dm_age, dx, dx_age);
+	dmap->dm_count--;
+	kfree_type(struct vfs_dxt_extent, dx);
 }
 
-/*
- * Find the hashtable slot for the supplied offset.  If we haven't allocated
- * one yet, allocate one and populate the address field.  Note that it will
- * not have a nonzero page count and thus will still technically be free, so
- * in the case where we are called to clean pages, the slot will remain free.
- */
-static kern_return_t
-vfs_drt_get_index(struct vfs_drt_clustermap **cmapp, u_int64_t offset, int *indexp, int recursed)
+static void
+vfs_dxt_free_map(struct vfs_dxt_map *dmap)
 {
-	struct vfs_drt_clustermap *cmap;
-	kern_return_t   kret;
-	u_int32_t       index;
-	u_int32_t       i;
-
-	cmap = *cmapp;
-
-	/* look for an existing entry */
-	kret = vfs_drt_search_index(cmap, offset, indexp);
-	if (kret == KERN_SUCCESS) {
-		return kret;
-	}
-
-	/* need to allocate an entry */
-	offset = DRT_ALIGN_ADDRESS(offset);
-	index = DRT_HASH(cmap, offset);
-
-	/* scan from the index forwards looking for a vacant slot */
-	for (i = 0; i < cmap->scm_modulus; i++) {
-		/* slot vacant? */
-		if (DRT_HASH_VACANT(cmap, index) || DRT_HASH_GET_COUNT(cmap, index) == 0) {
-			cmap->scm_buckets++;
-			if (index < cmap->scm_lastclean) {
-				cmap->scm_lastclean = index;
-			}
-			DRT_HASH_SET_ADDRESS(cmap, index, offset);
-			DRT_HASH_SET_COUNT(cmap, index, 0);
-			DRT_BITVECTOR_CLEAR(cmap, index);
-			*indexp = index;
-			vfs_drt_trace(cmap, DRT_DEBUG_INSERT, (int)offset, i, 0, 0);
-			return KERN_SUCCESS;
-		}
-		cmap->scm_iskips += i;
-		index = DRT_HASH_NEXT(cmap, index);
-	}
+	struct vfs_dxt_extent *dx;
 
-	/*
-	 * We haven't found a vacant slot, so the map is full.  If we're not
-	 * already recursed, try reallocating/compacting it.
-	 */
-	if (recursed) {
-		return KERN_FAILURE;
-	}
-	kret = vfs_drt_alloc_map(cmapp);
-	if (kret == KERN_SUCCESS) {
-		/* now try to insert again */
-		kret = vfs_drt_get_index(cmapp, offset, indexp, 1);
+	while ((dx = RB_MIN(vfs_dxt_tree, &dmap->dm_tree)) != NULL) {
+		vfs_dxt_remove(dmap, dx);
 	}
-	return kret;
+	kfree_type(struct vfs_dxt_map, dmap);
 }
 
 /*
- * Implementation of set dirty/clean.
+ * Mark a range of pages as dirty.
  *
- * In the 'clean' case, not finding a map is OK.
+ * cmapp
+ *	Pointer to a pointer to the map; the map is allocated if needed.
+ *
+ * offset, length
+ *	Page aligned range to mark, in bytes.
+ *
+ * setcountp
+ *	Number of pages this call marked (optional).
+ *
+ * Returns KERN_FAILURE without marking anything if the range needs an
+ * extent of its own and the map is full; push some out and try again.
  */
 static kern_return_t
-vfs_drt_do_mark_pages(
-	void            **private,
-	u_int64_t       offset,
-	u_int           length,
-	u_int           *setcountp,
-	int             dirty)
+vfs_dxt_mark_pages(void **cmapp, off_t offset, u_int length, u_int *setcountp)
 {
-	struct vfs_drt_clustermap *cmap, **cmapp;
-	kern_return_t   kret;
-	int             i, index, pgoff, pgcount, setcount, ecount;
-
-	cmapp = (struct vfs_drt_clustermap **)private;
-	cmap = *cmapp;
-
-	vfs_drt_trace(cmap, DRT_DEBUG_MARK | DBG_FUNC_START, (int)offset, (int)length, dirty, 0);
+	struct vfs_dxt_map      *dmap;
+	struct vfs_dxt_extent   *dx, *next, key;
+	daddr64_t               b_addr, e_addr;
 
 	if (setcountp != NULL) {
 		*setcountp = 0;
 	}
+	if (length == 0) {
+		return KERN_SUCCESS;
+	}
+	if ((dmap = *cmapp) == NULL) {
+		dmap = kalloc_type(struct vfs_dxt_map, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+		RB_INIT(&dmap->dm_tree);
+		TAILQ_INIT(&dmap->dm_age);
 
-	/* allocate a cluster map if we don't already have one */
-	if (cmap == NULL) {
-		/* no cluster map, nothing to clean */
-		if (!dirty) {
-			vfs_drt_trace(cmap, DRT_DEBUG_MARK | DBG_FUNC_END, 1, 0, 0, 0);
-			return KERN_SUCCESS;
-		}
-		kret = vfs_drt_alloc_map(cmapp);
-		if (kret != KERN_SUCCESS) {
-			vfs_drt_trace(cmap, DRT_DEBUG_MARK | DBG_FUNC_END, 2, 0, 0, 0);
-			return kret;
+		if (max_mem >= DXT_XLARGE_MEMORY_REQUIRED) {
+			dmap->dm_max = DXT_XLARGE_EXTENTS;
+		} else if (max_mem >= DXT_LARGE_MEMORY_REQUIRED) {
+			dmap->dm_max = DXT_LARGE_EXTENTS;
+		} else {
+			dmap->dm_max = DXT_SMALL_EXTENTS;
 		}
+		*cmapp = dmap;
 	}
-	setcount = 0;
+	b_addr = (daddr64_t)(offset / PAGE_SIZE_64);
+	e_addr = (daddr64_t)((offset + length) / PAGE_SIZE_64);
 
 	/*
-	 * Iterate over the length of the region.
+	 * find the extent the range merges into: the last one starting
+	 * at or before it, if that one reaches it, or else the first one
+	 * starting within or right after it
 	 */
-	while (length > 0) {
-		/*
-		 * Get the hashtable index for this offset.
-		 *
-		 * XXX this will add blank entries if we are clearing a range
-		 * that hasn't been dirtied.
-		 */
-		kret = vfs_drt_get_index(cmapp, offset, &index, 0);
-		cmap = *cmapp;  /* may have changed! */
-		/* this may be a partial-success return */
-		if (kret != KERN_SUCCESS) {
-			if (setcountp != NULL) {
-				*setcountp = setcount;
-			}
-			vfs_drt_trace(cmap, DRT_DEBUG_MARK | DBG_FUNC_END, 3, (int)length, 0, 0);
-
-			return kret;
+	key.dx_b_addr = b_addr;
+	if ((dx = RB_NFIND(vfs_dxt_tree, &dmap->dm_tree, &key)) == NULL) {
+		dx = RB_MAX(vfs_dxt_tree, &dmap->dm_tree);
+	} else if (dx->dx_b_addr > b_addr) {
+		next = RB_PREV(vfs_dxt_tree, &dmap->dm_tree, dx);
+		if (next != NULL && next->dx_e_addr >= b_addr) {
+			dx = next;
 		}
+	}
+	if (dx != NULL && (dx->dx_e_addr < b_addr || dx->dx_b_addr > e_addr)) {
+		dx = NULL;
+	}
 
+	if (dx == NULL) {
+		if (dmap->dm_count >= dmap->dm_max) {
+			return KERN_FAILURE;
+		}
+		dx = kalloc_type(struct vfs_dxt_extent, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+		dx->dx_b_addr = b_addr;
+		dx->dx_e_addr = e_addr;
+		RB_INSERT(vfs_dxt_tree, &dmap->dm_tree, dx);
+		TAILQ_INSERT_TAIL(&dmap->dm_age, dx, dx_age);
+		dmap->dm_count++;
+	} else {
 		/*
-		 * Work out how many pages we're modifying in this
-		 * hashtable entry.
-		 */
-		pgoff = (int)((offset - DRT_ALIGN_ADDRESS(offset)) / PAGE_SIZE);
-		pgcount = min((length / PAGE_SIZE), (DRT_BITVECTOR_PAGES - pgoff));
-
-		/*
-		 * Iterate over pages, dirty/clearing as we go.
+		 * the extent keeps its position in the tree when it grows
+		 * down, since nothing lies between it and the range
 		 */
-		ecount = DRT_HASH_GET_COUNT(cmap, index);
-		for (i = 0; i < pgcount; i++) {
-			if (dirty) {
-				if (!DRT_HASH_TEST_BIT(cmap, index, pgoff + i)) {
-					if (ecount >= DRT_BITVECTOR_PAGES) {
-						panic("ecount >= DRT_BITVECTOR_PAGES, cmap = %p, index = %d, bit = %d", cmap, index, pgoff + i);
-					}
-					DRT_HASH_SET_BIT(cmap, index, pgoff + i);
-					ecount++;
-					setcount++;
-				}
-			} else {
-				if (DRT_HASH_TEST_BIT(cmap, index, pgoff + i)) {
-					if (ecount <= 0) {
-						panic("ecount <= 0, cmap = %p, index = %d, bit = %d", cmap, index, pgoff + i);
-					}
-					assert(ecount > 0);
-					DRT_HASH_CLEAR_BIT(cmap, index, pgoff + i);
-					ecount--;
-					setcount++;
-				}
-			}
+		if (b_addr < dx->dx_b_addr) {
+			dx->dx_b_addr = b_addr;
+		}
+		if (e_addr > dx->dx_e_addr) {
+			dx->dx_e_addr = e_addr;
+		}
+		/* swallow the extents the range bridged to */
+		while ((next = RB_NEXT(vfs_dxt_tree, &dmap->dm_tree, dx)) != NULL &&
+		    next->dx_b_addr <= dx->dx_e_addr) {
+			dx->dx_e_addr = MAX(dx->dx_e_addr, next->dx_e_addr);
+			vfs_dxt_remove(dmap, next);
 		}
-		DRT_HASH_SET_COUNT(cmap, index, ecount);
-
-		offset += pgcount * PAGE_SIZE;
-		length -= pgcount * PAGE_SIZE;
 	}
 	if (setcountp != NULL) {
-		*setcountp = setcount;
+		*setcountp = (u_int)(e_addr - b_addr);
 	}
-
-	vfs_drt_trace(cmap, DRT_DEBUG_MARK | DBG_FUNC_END, 0, setcount, 0, 0);
-
 	return KERN_SUCCESS;
 }
 
 /*
- * Mark a set of pages as dirty/clean.
- *
- * This is a public interface.
+ * Get a cluster of dirty pages, and mark them clean in the map.
  *
  * cmapp
- *	Pointer to storage suitable for holding a pointer.  Note that
- *	this must either be NULL or a value set by this function.
- *
- * size
- *	Current file size in bytes.
+ *	Pointer to storage managed by vfs_dxt_mark_pages.  Note that this
+ *	must be NULL or a value set by vfs_dxt_mark_pages.
  *
- * offset
- *	Offset of the first page to be marked as dirty, in bytes.  Must be
- *	page-aligned.
+ * order
+ *	VFS_WB_ORDER_OFFSET to sweep the file in offset order from where
+ *	the last call stopped, VFS_WB_ORDER_AGE for the oldest extent.
  *
- * length
- *	Length of dirty region, in bytes.  Must be a multiple of PAGE_SIZE.
+ * maxlen
+ *	The largest cluster to return, in bytes.
  *
- * setcountp
- *	Number of pages newly marked dirty by this call (optional).
+ * offsetp, lengthp
+ *	The byte offset and length of the cluster.
  *
- * Returns KERN_SUCCESS if all the pages were successfully marked.
+ * Returns success if a cluster was found.  If KERN_FAILURE is returned,
+ * the map was empty and has been released.
  */
 static kern_return_t
-vfs_drt_mark_pages(void **cmapp, off_t offset, u_int length, u_int *setcountp)
+vfs_dxt_get_cluster(void **cmapp, int order, u_int maxlen, off_t *offsetp, u_int *lengthp)
 {
-	/* XXX size unused, drop from interface */
-	return vfs_drt_do_mark_pages(cmapp, offset, length, setcountp, 1);
-}
-
-#if 0
-static kern_return_t
-vfs_drt_unmark_pages(void **cmapp, off_t offset, u_int length)
-{
-	return vfs_drt_do_mark_pages(cmapp, offset, length, NULL, 0);
-}
-#endif
+	struct vfs_dxt_map      *dmap;
+	struct vfs_dxt_extent   *dx, key;
+	daddr64_t               npages;
 
-/*
- * Get a cluster of dirty pages.
- *
- * This is a public interface.
- *
- * cmapp
- *	Pointer to storage managed by drt_mark_pages.  Note that this must
- *	be NULL or a value set by drt_mark_pages.
- *
- * offsetp
- *	Returns the byte offset into the file of the first page in the cluster.
- *
- * lengthp
- *	Returns the length in bytes of the cluster of dirty pages.
- *
- * Returns success if a cluster was found.  If KERN_FAILURE is returned, there
- * are no dirty pages meeting the minmum size criteria.  Private storage will
- * be released if there are no more dirty pages left in the map
- *
- */
-static kern_return_t
-vfs_drt_get_cluster(void **cmapp, off_t *offsetp, u_int *lengthp)
-{
-	struct vfs_drt_clustermap *cmap;
-	u_int64_t       offset;
-	u_int           length;
-	u_int32_t       j;
-	int             index, i, fs, ls;
-
-	/* sanity */
-	if ((cmapp == NULL) || (*cmapp == NULL)) {
+	if ((cmapp == NULL) || ((dmap = *cmapp) == NULL)) {
 		return KERN_FAILURE;
 	}
-	cmap = *cmapp;
-
-	/* walk the hashtable */
-	for (offset = 0, j = 0; j < cmap->scm_modulus; offset += (DRT_BITVECTOR_PAGES * PAGE_SIZE), j++) {
-		index = DRT_HASH(cmap, offset);
-
-		if (DRT_HASH_VACANT(cmap, index) || (DRT_HASH_GET_COUNT(cmap, index) == 0)) {
-			continue;
-		}
-
-		/* scan the bitfield for a string of bits */
-		fs = -1;
-
-		for (i = 0; i < DRT_BITVECTOR_PAGES; i++) {
-			if (DRT_HASH_TEST_BIT(cmap, index, i)) {
-				fs = i;
-				break;
-			}
-		}
-		if (fs == -1) {
-			/*  didn't find any bits set */
-			panic("vfs_drt: entry summary count > 0 but no bits set in map, cmap = %p, index = %d, count = %lld",
-			    cmap, index, DRT_HASH_GET_COUNT(cmap, index));
-		}
-		for (ls = 0; i < DRT_BITVECTOR_PAGES; i++, ls++) {
-			if (!DRT_HASH_TEST_BIT(cmap, index, i)) {
-				break;
-			}
+	if (order == VFS_WB_ORDER_AGE) {
+		dx = TAILQ_FIRST(&dmap->dm_age);
+	} else {
+		key.dx_b_addr = dmap->dm_cursor;
+		if ((dx = RB_NFIND(vfs_dxt_tree, &dmap->dm_tree, &key)) == NULL) {
+			dx = RB_MIN(vfs_dxt_tree, &dmap->dm_tree);
 		}
+	}
+	if (dx == NULL) {
+		vfs_dxt_free_map(dmap);
+		*cmapp = NULL;
 
-		/* compute offset and length, mark pages clean */
-		offset = DRT_HASH_GET_ADDRESS(cmap, index) + (PAGE_SIZE * fs);
-		length = ls * PAGE_SIZE;
-		vfs_drt_do_mark_pages(cmapp, offset, length, NULL, 0);
-		cmap->scm_lastclean = index;
+		return KERN_FAILURE;
+	}
+	npages = MIN(dx->dx_e_addr - dx->dx_b_addr, MAX(maxlen / PAGE_SIZE, 1));
 
-		/* return successful */
-		*offsetp = (off_t)offset;
-		*lengthp = length;
+	*offsetp = (off_t)(dx->dx_b_addr * PAGE_SIZE_64);
+	*lengthp = (u_int)(npages * PAGE_SIZE);
 
-		vfs_drt_trace(cmap, DRT_DEBUG_RETCLUSTER, (int)offset, (int)length, 0, 0);
-		return KERN_SUCCESS;
-	}
 	/*
-	 * We didn't find anything... hashtable is empty
-	 * emit stats into trace buffer and
-	 * then free it
+	 * trimming the front of the extent keeps it in
+	 * place in the tree: it's still before its successor
 	 */
-	vfs_drt_trace(cmap, DRT_DEBUG_SCMDATA,
-	    cmap->scm_modulus,
-	    cmap->scm_buckets,
-	    cmap->scm_lastclean,
-	    cmap->scm_iskips);
+	dx->dx_b_addr += npages;
+	dmap->dm_cursor = dx->dx_b_addr;
 
-	vfs_drt_free_map(cmap);
-	*cmapp = NULL;
+	if (dx->dx_b_addr == dx->dx_e_addr) {
+		vfs_dxt_remove(dmap, dx);
+	}
+	KERNEL_DEBUG((FSDBG_CODE(DBG_FSRW, 83)), (int)*offsetp, (int)*lengthp, dmap->dm_count, order, 0);
 
-	return KERN_FAILURE;
+	return KERN_SUCCESS;
 }
 
 
 static kern_return_t
-vfs_drt_control(void **cmapp, int op_type)
+vfs_dxt_control(void **cmapp, int op_type)
 {
-	struct vfs_drt_clustermap *cmap;
+	struct vfs_dxt_map *dmap;
 
 	/* sanity */
 	if ((cmapp == NULL) || (*cmapp == NULL)) {
 		return KERN_FAILURE;
 	}
-	cmap = *cmapp;
+	dmap = *cmapp;
 
 	switch (op_type) {
 	case 0:
-		/* emit stats into trace buffer */
-		vfs_drt_trace(cmap, DRT_DEBUG_SCMDATA,
-		    cmap->scm_modulus,
-		    cmap->scm_buckets,
-		    cmap->scm_lastclean,
-		    cmap->scm_iskips);
-
-		vfs_drt_free_map(cmap);
+		/* free the map, the pages stay dirty */
+		vfs_dxt_free_map(dmap);
 		*cmapp = NULL;
 		break;
 
 	case 1:
-		cmap->scm_lastclean = 0;
+		/* restart an offset ordered sweep from the start of the file */
+		dmap->dm_cursor = 0;
 		break;
 	}
 	return KERN_SUCCESS;
 }
 
 
-
-/*
- * Emit a summary of the state of the clustermap into the trace buffer
- * along with some caller-provided data.
- */
-#if KDEBUG
-static void
-vfs_drt_trace(__unused struct vfs_drt_clustermap *cmap, int code, int arg1, int arg2, int arg3, int arg4)
-{
-	KERNEL_DEBUG(code, arg1, arg2, arg3, arg4, 0);
-}
-#else
-static void
-vfs_drt_trace(__unused struct vfs_drt_clustermap *cmap, __unused int code,
-    __unused int arg1, __unused int arg2, __unused int arg3,
-    __unused int arg4)
-{
-}
-#endif
-
-#if 0
-/*
- * Perform basic sanity check on the hash entry summary count
- * vs. the actual bits set in the entry.
- */
-static void
-vfs_drt_sanity(struct vfs_drt_clustermap *cmap)
-{
-	int index, i;
-	int bits_on;
-
-	for (index = 0; index < cmap->scm_modulus; index++) {
-		if (DRT_HASH_VACANT(cmap, index)) {
-			continue;
-		}
-
-		for (bits_on = 0, i = 0; i < DRT_BITVECTOR_PAGES; i++) {
-			if (DRT_HASH_TEST_BIT(cmap, index, i)) {
-				bits_on++;
-			}
-		}
-		if (bits_on != DRT_HASH_GET_COUNT(cmap, index)) {
-			panic("bits_on = %d,  index = %d", bits_on, index);
-		}
-	}
-}
-#endif
-
 /*
  * Internal interface only.
  */
 static kern_return_t
 vfs_get_scmap_push_behavior_internal(void **cmapp, int *push_flag)
 {
-	struct vfs_drt_clustermap *cmap;
+	struct vfs_dxt_map *dmap;
 
 	/* sanity */
 	if ((cmapp == NULL) || (*cmapp == NULL) || (push_flag == NULL)) {
 		return KERN_FAILURE;
 	}
-	cmap = *cmapp;
+	dmap = *cmapp;
 
-	if (cmap->scm_modulus == DRT_HASH_XLARGE_MODULUS) {
+	if (dmap->dm_max == DXT_XLARGE_EXTENTS && dmap->dm_count >= dmap->dm_max) {
 		/*
 		 * If we have a full xlarge sparse cluster,
 		 * we push it out all at once so the cluster
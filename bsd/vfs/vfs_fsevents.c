@@ -57,6 +57,7 @@
 #include <mach/mach_time.h>
 #include <kern/thread_call.h>
 #include <kern/clock.h>
+#include <kern/cpu_number.h>
 #include <IOKit/IOBSD.h>
 
 #include <security/audit/audit.h>
@@ -66,13 +67,14 @@
 #include <libkern/section_keywords.h>
 
 typedef struct kfs_event {
-	LIST_ENTRY(kfs_event) kevent_list;
 	uint64_t       abstime;    // when this event happened (mach_absolute_time())
 	int16_t        type;       // type code of this event
 	uint16_t       flags;      // per-event flags
 	int32_t        refcount;   // number of clients referencing this
 	pid_t          pid;
-	int32_t        spare;
+	dev_t          watch_dev;  // device matched against watchers' device filters
+	uint16_t       shard;      // index of the fse_shard this event was created on
+	uint16_t       spare;
 
 	union {
 		struct regular_event {
@@ -122,10 +124,9 @@ _Static_assert(offsetof(struct regular_event, gid) == offsetof(fse_info, gid),
 // flags for the flags field
 #define KFSE_COMBINED_EVENTS          0x0001
 #define KFSE_CONTAINS_DROPPED_EVENTS  0x0002
-#define KFSE_ON_LIST                  0x0004
+#define KFSE_OUTSTANDING              0x0004
 #define KFSE_BEING_CREATED            0x0008
 
-LIST_HEAD(kfse_list, kfs_event) kfse_list_head = LIST_HEAD_INITIALIZER(x);
 int num_events_outstanding = 0;
 int num_pending_rename = 0;
 
@@ -183,6 +184,12 @@ static int fsevent_unmount_ack_count = 0;
 
 static int  watcher_add_event(fs_event_watcher *watcher, kfs_event *kfse);
 static void fsevents_wakeup(fs_event_watcher *watcher);
+static void fsevents_flush_staged(void);
+static void delayed_event_delivery(void *param0, void *param1);
+
+#define EVENT_DELAY_IN_MS   10
+static thread_call_t event_delivery_timer = NULL;
+static volatile UInt32 timer_set = 0;
 
 //
 // Locks
@@ -195,11 +202,77 @@ static LCK_RW_DECLARE_ATTR(event_handling_lock, // handles locking for event man
     &fsevent_rw_group, &fsevent_lock_attr);
 static LCK_MTX_DECLARE_ATTR(watch_table_lock,
     &fsevent_mutex_group, &fsevent_lock_attr);
-static LCK_MTX_DECLARE_ATTR(event_buf_lock,
-    &fsevent_mutex_group, &fsevent_lock_attr);
 static LCK_MTX_DECLARE_ATTR(event_writer_lock,
     &fsevent_mutex_group, &fsevent_lock_attr);
 
+//
+// Event creation is sharded by cpu so that add_fsevent() does not
+// serialize every filesystem mutation in the system on one lock.
+// Each shard carries three things, all protected by fs_lock:
+//
+//   - the coalescing state.  If we get the same event type and same
+//     vnode/pathname as the previous event on this shard, we just
+//     drop the event since it's superfluous.  This improves some
+//     micro-benchmarks considerably and actually has a real-world
+//     impact on tests like a Finder copy where multiple stat-changed
+//     events can get coalesced.
+//
+//   - a cached summary of which event types some watcher wants for
+//     the device the last event was on, so that events nobody will
+//     read are dropped before we allocate anything for them.  The
+//     cache is invalidated by bumping fse_filter_gen whenever the
+//     watcher table or a watcher's device filter changes.
+//
+//   - a small staging array of finished events.  Staged events are
+//     handed to the watchers in batches by fsevents_flush_staged(),
+//     which takes the watch table lock once per batch instead of
+//     once per event and wakes each reader at most once per batch.
+//
+// Lock ordering: watch_table_lock -> event_handling_lock -> fs_lock
+//
+#define FSE_NUM_SHARDS     16      // must be a power of 2
+#define FSE_SHARD_MASK     (FSE_NUM_SHARDS - 1)
+#define FSE_STAGE_SIZE     16
+#define FSE_BATCH_MAX      (2 * FSE_NUM_SHARDS * FSE_STAGE_SIZE)
+
+struct fse_shard {
+	__attribute__((aligned(128))) lck_mtx_t fs_lock;
+
+	// coalescing state
+	int          fs_last_event_type;
+	int          fs_last_nlen;
+	int          fs_last_vid;
+	pid_t        fs_last_pid;
+	void        *fs_last_ptr;
+	kfs_event   *fs_last_event_ptr;
+	uint64_t     fs_last_coalesced_time;
+
+	// watcher interest cache
+	uint32_t     fs_filter_gen;
+	dev_t        fs_filter_dev;
+	uint32_t     fs_filter_types;  // bit N set: someone wants type N on fs_filter_dev
+
+	// events waiting to be handed to the watchers
+	int          fs_nstaged;
+	kfs_event   *fs_staged[FSE_STAGE_SIZE];
+
+	char         fs_last_str[MAXPATHLEN];
+};
+
+_Static_assert(FSE_MAX_EVENTS <= 32, "fs_filter_types is too small");
+
+static struct fse_shard fse_shards[FSE_NUM_SHARDS];
+
+// bumped under the watch table lock whenever watcher interest changes
+static uint32_t fse_filter_gen = 1;
+
+// events being merged for delivery; protected by the watch table lock.
+// entries left over from one flush are at the front of the array.
+static kfs_event *fse_batch[FSE_BATCH_MAX];
+static int        fse_nbatch = 0;
+
+static void fsevent_stage(struct fse_shard *fs, kfs_event *kfse);
+
 
 /* Explicitly declare qsort so compiler doesn't complain */
 __private_extern__ void qsort(
@@ -241,6 +314,17 @@ fsevents_internal_init(void)
 
 	memset(watcher_table, 0, sizeof(watcher_table));
 
+	for (i = 0; i < FSE_NUM_SHARDS; i++) {
+		struct fse_shard *fs = &fse_shards[i];
+
+		lck_mtx_init(&fs->fs_lock, &fsevent_mutex_group, &fsevent_lock_attr);
+		fs->fs_last_event_type = -1;
+		fs->fs_last_vid = -1;
+		fs->fs_last_pid = -1;
+	}
+
+	event_delivery_timer = thread_call_allocate((thread_call_func_t)delayed_event_delivery, NULL);
+
 	PE_get_default("kern.maxkfsevents", &max_kfs_events, sizeof(max_kfs_events));
 
 	event_zone = zone_create_ext("fs-event-buf", sizeof(kfs_event),
@@ -265,18 +349,6 @@ unlock_watch_table(void)
 	lck_mtx_unlock(&watch_table_lock);
 }
 
-static void
-lock_fs_event_list(void)
-{
-	lck_mtx_lock(&event_buf_lock);
-}
-
-static void
-unlock_fs_event_list(void)
-{
-	lck_mtx_unlock(&event_buf_lock);
-}
-
 // forward prototype
 static void release_event_ref(kfs_event *kfse);
 
@@ -328,36 +400,123 @@ int num_dropped         = 0;
 
 static struct timeval last_print;
 
-//
-// These variables are used to track coalescing multiple identical
-// events for the same vnode/pathname.  If we get the same event
-// type and same vnode/pathname as the previous event, we just drop
-// the event since it's superfluous.  This improves some micro-
-// benchmarks considerably and actually has a real-world impact on
-// tests like a Finder copy where multiple stat-changed events can
-// get coalesced.
-//
-static int     last_event_type = -1;
-static void   *last_ptr = NULL;
-static char    last_str[MAXPATHLEN];
-static int     last_nlen = 0;
-static int     last_vid = -1;
-static uint64_t last_coalesced_time = 0;
-static void   *last_event_ptr = NULL;
-static pid_t last_pid = -1;
 int            last_coalesced = 0;
 static mach_timebase_info_data_t    sTimebaseInfo = { 0, 0 };
 
+static inline struct fse_shard *
+fse_shard_current(void)
+{
+	return &fse_shards[cpu_number() & FSE_SHARD_MASK];
+}
+
+//
+// Return a mask of the event types that at least one watcher
+// wants to see from device "dev", along with the filter generation
+// the answer is good for.
+//
+static uint32_t
+watcher_types_for_dev(dev_t dev, uint32_t *genp)
+{
+	fs_event_watcher *watcher;
+	uint32_t types = 0;
+	int i, j;
+
+	lock_watch_table();
+	for (i = 0; i < MAX_WATCHERS; i++) {
+		watcher = watcher_table[i];
+		if (watcher == NULL || !watcher_cares_about_dev(watcher, dev)) {
+			continue;
+		}
+
+		for (j = 0; j < watcher->num_events && j < FSE_MAX_EVENTS; j++) {
+			if (watcher->event_list[j] == FSE_REPORT) {
+				types |= (1U << j);
+			}
+		}
+	}
+	*genp = fse_filter_gen;
+	unlock_watch_table();
+
+	return types;
+}
+
+//
+// Find the device an event will be filtered on without doing any
+// of the work of building the event.  This mirrors how add_fsevent()
+// computes "dev" from the first vnode or fse_info argument; for
+// anything else we return 0 which means "don't know".
+//
+static dev_t
+fsevent_peek_dev(int type, va_list ap)
+{
+	int32_t arg_type;
+
+	if (type == FSE_DOCID_CREATED || type == FSE_DOCID_CHANGED ||
+	    type == FSE_ACCESS_GRANTED || type == FSE_UNMOUNT_PENDING) {
+		return 0;
+	}
+
+	for (arg_type = va_arg(ap, int32_t); arg_type != FSE_ARG_DONE; arg_type = va_arg(ap, int32_t)) {
+		switch (arg_type) {
+		case FSE_ARG_VNODE: {
+			struct vnode *vp = va_arg(ap, struct vnode *);
+
+			// vnode_getattr() reports va_fsid from the mount
+			if (vp == NULL || vp->v_mount == NULL) {
+				return 0;
+			}
+			return (dev_t)vp->v_mount->mnt_vfsstat.f_fsid.val[0];
+		}
+		case FSE_ARG_FINFO:
+			return (dev_t)(va_arg(ap, fse_info *))->dev;
+		case FSE_ARG_STRING:
+			(void)va_arg(ap, int32_t);
+			(void)va_arg(ap, char *);
+			break;
+		case FSE_ARG_INT32:
+			(void)va_arg(ap, int32_t);
+			break;
+		default:
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+//
+// Forget kfse as the last event of its shard so that a new identical
+// event isn't coalesced into one the watchers have already consumed.
+//
+static void
+kfse_forget_coalesced(kfs_event *kfse)
+{
+	struct fse_shard *fs = &fse_shards[kfse->shard];
+
+	if (fs->fs_last_event_ptr != kfse) {
+		return;
+	}
+
+	lck_mtx_lock(&fs->fs_lock);
+	if (fs->fs_last_event_ptr == kfse) {
+		fs->fs_last_event_ptr = NULL;
+		fs->fs_last_event_type = -1;
+		fs->fs_last_coalesced_time = 0;
+	}
+	lck_mtx_unlock(&fs->fs_lock);
+}
+
 #define MAX_HARDLINK_NOTIFICATIONS 128
 
 static inline void
-kfse_init(kfs_event *kfse, int type, uint64_t time, proc_t p)
+kfse_init(kfs_event *kfse, int type, uint64_t time, proc_t p, struct fse_shard *fs)
 {
 	memset(kfse, 0, sizeof(*kfse));
 	kfse->refcount = 1;
 	kfse->type =     (int16_t)type;
 	kfse->abstime =  time;
 	kfse->pid =      proc_getpid(p);
+	kfse->shard =    (uint16_t)(fs - fse_shards);
 
 	OSBitOrAtomic16(KFSE_BEING_CREATED, &kfse->flags);
 }
@@ -369,10 +528,11 @@ add_fsevent(int type, vfs_context_t ctx, ...)
 	int               i, arg_type, ret;
 	kfs_event        *kfse, *kfse_dest = NULL, *cur;
 	fs_event_watcher *watcher;
+	struct fse_shard *fs;
 	va_list           ap;
 	int               error = 0, did_alloc = 0;
 	int64_t           orig_linkcount = -1;
-	dev_t             dev = 0;
+	dev_t             dev = 0, filter_dev;
 	uint64_t          now, elapsed;
 	uint64_t          orig_linkid = 0, next_linkid = 0;
 	uint64_t          link_parentid = 0;
@@ -405,12 +565,44 @@ restart:
 		return 0;
 	}
 
+	filter_dev = fsevent_peek_dev(type, ap);
+	va_end(ap);
+	va_start(ap, ctx);
+
 	now = mach_absolute_time();
 
 	// find a free event and snag it for our use
 	// NOTE: do not do anything that would block until
 	//       the lock is dropped.
-	lock_fs_event_list();
+	fs = fse_shard_current();
+	lck_mtx_lock(&fs->fs_lock);
+
+	//
+	// if none of the watchers wants this type of event from this
+	// device, drop it now rather than building an event that every
+	// watcher would just skip.  (hard link replicas already passed
+	// this check on the first go-around.)
+	//
+	if (filter_dev != 0 && path_override == NULL) {
+		if (fs->fs_filter_gen != fse_filter_gen || fs->fs_filter_dev != filter_dev) {
+			uint32_t types, gen;
+
+			lck_mtx_unlock(&fs->fs_lock);
+			types = watcher_types_for_dev(filter_dev, &gen);
+			lck_mtx_lock(&fs->fs_lock);
+
+			fs->fs_filter_types = types;
+			fs->fs_filter_dev = filter_dev;
+			fs->fs_filter_gen = gen;
+		}
+
+		if ((fs->fs_filter_types & (1U << type)) == 0) {
+			lck_mtx_unlock(&fs->fs_lock);
+			va_end(ap);
+
+			return 0;
+		}
+	}
 
 	//
 	// check if this event is identical to the previous one...
@@ -437,7 +629,7 @@ restart:
 			case FSE_ARG_VNODE: {
 				ptr = va_arg(ap, void *);
 				vid = vnode_vid((struct vnode *)ptr);
-				last_str[0] = '\0';
+				fs->fs_last_str[0] = '\0';
 				break;
 			}
 			case FSE_ARG_STRING: {
@@ -456,7 +648,7 @@ restart:
 			(void) clock_timebase_info(&sTimebaseInfo);
 		}
 
-		elapsed = (now - last_coalesced_time);
+		elapsed = (now - fs->fs_last_coalesced_time);
 		if (sTimebaseInfo.denom != sTimebaseInfo.numer) {
 			if (sTimebaseInfo.denom == 1) {
 				elapsed *= sTimebaseInfo.numer;
@@ -468,29 +660,29 @@ restart:
 			}
 		}
 
-		if (type == last_event_type
+		if (type == fs->fs_last_event_type
 		    && (elapsed < 1000000000)
-		    && (last_pid == proc_getpid(p))
+		    && (fs->fs_last_pid == proc_getpid(p))
 		    &&
-		    ((vid && vid == last_vid && last_ptr == ptr)
+		    ((vid && vid == fs->fs_last_vid && fs->fs_last_ptr == ptr)
 		    ||
-		    (last_str[0] && last_nlen == nlen && ptr && strcmp(last_str, ptr) == 0))
+		    (fs->fs_last_str[0] && fs->fs_last_nlen == nlen && ptr && strcmp(fs->fs_last_str, ptr) == 0))
 		    ) {
-			last_coalesced++;
-			unlock_fs_event_list();
+			OSAddAtomic(1, &last_coalesced);
+			lck_mtx_unlock(&fs->fs_lock);
 			va_end(ap);
 
 			return 0;
 		} else {
-			last_ptr = ptr;
+			fs->fs_last_ptr = ptr;
 			if (ptr && was_str) {
-				strlcpy(last_str, ptr, sizeof(last_str));
+				strlcpy(fs->fs_last_str, ptr, sizeof(fs->fs_last_str));
 			}
-			last_nlen = nlen;
-			last_vid = vid;
-			last_event_type = type;
-			last_coalesced_time = now;
-			last_pid = proc_getpid(p);
+			fs->fs_last_nlen = nlen;
+			fs->fs_last_vid = vid;
+			fs->fs_last_event_type = type;
+			fs->fs_last_coalesced_time = now;
+			fs->fs_last_pid = proc_getpid(p);
 		}
 	}
 	va_start(ap, ctx);
@@ -508,7 +700,7 @@ restart:
 
 
 	if (kfse == NULL) {    // yikes! no free events
-		unlock_fs_event_list();
+		lck_mtx_unlock(&fs->fs_lock);
 		lock_watch_table();
 
 		for (i = 0; i < MAX_WATCHERS; i++) {
@@ -531,10 +723,10 @@ restart:
 			microuptime(&current_tv);
 			if ((current_tv.tv_sec - last_print.tv_sec) > 10) {
 				int ii;
-				void *junkptr = zalloc_noblock(event_zone), *listhead = kfse_list_head.lh_first;
+				void *junkptr = zalloc_noblock(event_zone);
 
 				printf("add_fsevent: event queue is full! dropping events (num dropped events: %d; num events outstanding: %d).\n", num_dropped, num_events_outstanding);
-				printf("add_fsevent: kfse_list head %p ; num_pending_rename %d\n", listhead, num_pending_rename);
+				printf("add_fsevent: num_pending_rename %d ; num staged/merging %d\n", num_pending_rename, fse_nbatch);
 				printf("add_fsevent: zalloc sez: %p\n", junkptr);
 				printf("add_fsevent: event_zone info: %d 0x%x\n", ((int *)event_zone)[0], ((int *)event_zone)[1]);
 				lock_watch_table();
@@ -565,25 +757,24 @@ restart:
 		return ENOSPC;
 	}
 
-	kfse_init(kfse, type, now, p);
-	last_event_ptr = kfse;
+	kfse_init(kfse, type, now, p, fs);
+	fs->fs_last_event_ptr = kfse;
 	if (type == FSE_RENAME || type == FSE_EXCHANGE || type == FSE_CLONE) {
-		kfse_init(kfse_dest, type, now, p);
+		kfse_init(kfse_dest, type, now, p, fs);
 		kfse->regular_event.dest = kfse_dest;
 	}
 
-	num_events_outstanding++;
+	OSAddAtomic(1, &num_events_outstanding);
 	if (kfse->type == FSE_RENAME) {
-		num_pending_rename++;
+		OSAddAtomic(1, &num_pending_rename);
 	}
-	LIST_INSERT_HEAD(&kfse_list_head, kfse, kevent_list);
-	OSBitOrAtomic16(KFSE_ON_LIST, &kfse->flags);
+	OSBitOrAtomic16(KFSE_OUTSTANDING, &kfse->flags);
 
 	if (kfse->refcount < 1) {
 		panic("add_fsevent: line %d: kfse recount %d but should be at least 1", __LINE__, kfse->refcount);
 	}
 
-	unlock_fs_event_list(); // at this point it's safe to unlock
+	lck_mtx_unlock(&fs->fs_lock); // at this point it's safe to unlock
 
 	//
 	// now process the arguments passed in and copy them into
@@ -943,6 +1134,8 @@ restart:
 done_with_args:
 	va_end(ap);
 
+	kfse->watch_dev = dev;
+
 	// XXX Memory barrier here?
 	if (kfse_dest) {
 		OSBitAndAtomic16(~KFSE_BEING_CREATED, &kfse_dest->flags);
@@ -950,32 +1143,10 @@ done_with_args:
 	OSBitAndAtomic16(~KFSE_BEING_CREATED, &kfse->flags);
 
 	//
-	// now we have to go and let everyone know that
-	// is interested in this type of event
+	// now stage the event; it gets handed to everyone that
+	// is interested in this type of event with the next batch
 	//
-	lock_watch_table();
-
-	for (i = 0; i < MAX_WATCHERS; i++) {
-		watcher = watcher_table[i];
-		if (watcher == NULL) {
-			continue;
-		}
-
-		if (type < watcher->num_events
-		    && watcher->event_list[type] == FSE_REPORT
-		    && watcher_cares_about_dev(watcher, dev)) {
-			if (watcher_add_event(watcher, kfse) != 0) {
-				watcher->num_dropped++;
-				continue;
-			}
-		}
-
-		// if (kfse->refcount < 1) {
-		//    panic("add_fsevent: line %d: kfse recount %d but should be at least 1", __LINE__, kfse->refcount);
-		// }
-	}
-
-	unlock_watch_table();
+	fsevent_stage(fs, kfse);
 
 clean_up:
 
@@ -1140,19 +1311,20 @@ release_event_ref(kfs_event *kfse)
 	int old_refcount;
 	kfs_event *dest = NULL;
 	const char *path_str = NULL, *dest_path_str = NULL;
+	struct fse_shard *fs = &fse_shards[kfse->shard];
 
-	lock_fs_event_list();
+	lck_mtx_lock(&fs->fs_lock);
 
 	old_refcount = OSAddAtomic(-1, &kfse->refcount);
 	if (old_refcount > 1) {
-		unlock_fs_event_list();
+		lck_mtx_unlock(&fs->fs_lock);
 		return;
 	}
 
-	if (last_event_ptr == kfse) {
-		last_event_ptr = NULL;
-		last_event_type = -1;
-		last_coalesced_time = 0;
+	if (fs->fs_last_event_ptr == kfse) {
+		fs->fs_last_event_ptr = NULL;
+		fs->fs_last_event_type = -1;
+		fs->fs_last_coalesced_time = 0;
 	}
 
 	if (kfse->refcount < 0) {
@@ -1184,21 +1356,19 @@ release_event_ref(kfs_event *kfse)
 	}
 
 	if (dest != NULL) {
-		if (dest->flags & KFSE_ON_LIST) {
-			num_events_outstanding--;
-			LIST_REMOVE(dest, kevent_list);
+		if (dest->flags & KFSE_OUTSTANDING) {
+			OSAddAtomic(-1, &num_events_outstanding);
 		}
 	}
 
-	if (kfse->flags & KFSE_ON_LIST) {
-		num_events_outstanding--;
-		LIST_REMOVE(kfse, kevent_list);
+	if (kfse->flags & KFSE_OUTSTANDING) {
+		OSAddAtomic(-1, &num_events_outstanding);
 		if (kfse->type == FSE_RENAME) {
-			num_pending_rename--;
+			OSAddAtomic(-1, &num_pending_rename);
 		}
 	}
 
-	unlock_fs_event_list();
+	lck_mtx_unlock(&fs->fs_lock);
 
 	zfree(event_zone, kfse);
 	if (dest != NULL) {
@@ -1323,6 +1493,7 @@ add_watcher(int8_t *event_list, int32_t num_events, int32_t eventq_size, fs_even
 			fs_event_type_watchers[i]++;
 		}
 	}
+	fse_filter_gen++;
 
 	unlock_watch_table();
 
@@ -1355,6 +1526,7 @@ remove_watcher(fs_event_watcher *target)
 				fs_event_type_watchers[i]--;
 			}
 		}
+		fse_filter_gen++;
 
 		if (watcher->flags & WATCHER_CLOSING) {
 			unlock_watch_table();
@@ -1403,16 +1575,17 @@ remove_watcher(fs_event_watcher *target)
 }
 
 
-#define EVENT_DELAY_IN_MS   10
-static thread_call_t event_delivery_timer = NULL;
-static int timer_set = 0;
-
-
 static void
 delayed_event_delivery(__unused void *param0, __unused void *param1)
 {
 	int i;
 
+	// clear this first so that anything staged while we
+	// flush arms the timer again
+	OSCompareAndSwap(1, 0, &timer_set);
+
+	fsevents_flush_staged();
+
 	lock_watch_table();
 
 	for (i = 0; i < MAX_WATCHERS; i++) {
@@ -1421,33 +1594,157 @@ delayed_event_delivery(__unused void *param0, __unused void *param1)
 		}
 	}
 
-	timer_set = 0;
-
 	unlock_watch_table();
 }
 
 
 //
-// The watch table must be locked before calling this function.
+// Arm the delivery timer unless it is already pending.  Staged
+// events sit for at most EVENT_DELAY_IN_MS milli-seconds before
+// they are handed to the watchers.
 //
 static void
 schedule_event_wakeup(void)
 {
 	uint64_t deadline;
 
-	if (event_delivery_timer == NULL) {
-		event_delivery_timer = thread_call_allocate((thread_call_func_t)delayed_event_delivery, NULL);
+	if (!OSCompareAndSwap(0, 1, &timer_set)) {
+		return;
 	}
 
 	clock_interval_to_deadline(EVENT_DELAY_IN_MS, 1000 * 1000, &deadline);
 
 	thread_call_enter_delayed(event_delivery_timer, deadline);
-	timer_set = 1;
 }
 
 
+static int
+kfse_abstime_cmp(const void *a, const void *b)
+{
+	const kfs_event *ka = *(kfs_event * const *)a;
+	const kfs_event *kb = *(kfs_event * const *)b;
+
+	if (ka->abstime < kb->abstime) {
+		return -1;
+	}
+	if (ka->abstime > kb->abstime) {
+		return 1;
+	}
+	return 0;
+}
+
+//
+// Hand everything sitting in the shards' staging arrays to the
+// watchers.  The shards are merged in abstime order.  An event
+// stamped after this flush started is held back until the next
+// flush: an event that happened before it may have been staged on
+// a shard we had already emptied, and readers must not see the two
+// out of order.  Each watcher that got something is woken up once
+// for the whole batch.
+//
+static void
+fsevents_flush_staged(void)
+{
+	fs_event_watcher *watcher;
+	kfs_event *kfse;
+	uint32_t woken = 0;
+	uint64_t start;
+	int i, j, n, ndeliver, carry;
+
+	lock_watch_table();
+
+	start = mach_absolute_time();
+	n = fse_nbatch;
+	for (i = 0; i < FSE_NUM_SHARDS; i++) {
+		struct fse_shard *fs = &fse_shards[i];
+
+		lck_mtx_lock(&fs->fs_lock);
+		assert(n + fs->fs_nstaged <= FSE_BATCH_MAX);
+		memcpy(&fse_batch[n], fs->fs_staged, fs->fs_nstaged * sizeof(kfs_event *));
+		n += fs->fs_nstaged;
+		fs->fs_nstaged = 0;
+		lck_mtx_unlock(&fs->fs_lock);
+	}
+
+	qsort(fse_batch, n, sizeof(kfs_event *), kfse_abstime_cmp);
+
+	for (ndeliver = 0; ndeliver < n; ndeliver++) {
+		if (fse_batch[ndeliver]->abstime >= start) {
+			break;
+		}
+	}
+
+	for (i = 0; i < ndeliver; i++) {
+		kfse = fse_batch[i];
+
+		for (j = 0; j < MAX_WATCHERS; j++) {
+			watcher = watcher_table[j];
+			if (watcher == NULL) {
+				continue;
+			}
+
+			if (kfse->type < watcher->num_events
+			    && watcher->event_list[kfse->type] == FSE_REPORT
+			    && watcher_cares_about_dev(watcher, kfse->watch_dev)) {
+				if (watcher_add_event(watcher, kfse) != 0) {
+					watcher->num_dropped++;
+					continue;
+				}
+				woken |= (1U << j);
+			}
+		}
+
+		// drop the reference the staging array held
+		release_event_ref(kfse);
+	}
+
+	for (j = 0; j < MAX_WATCHERS; j++) {
+		if ((woken & (1U << j)) && watcher_table[j] != NULL) {
+			fsevents_wakeup(watcher_table[j]);
+		}
+	}
+
+	carry = n - ndeliver;
+	memmove(&fse_batch[0], &fse_batch[ndeliver], carry * sizeof(kfs_event *));
+	fse_nbatch = carry;
+
+	unlock_watch_table();
+
+	if (carry != 0) {
+		schedule_event_wakeup();
+	}
+}
+
+//
+// Put a fully built event on its shard's staging array.  The
+// array holds its own reference until fsevents_flush_staged()
+// has queued the event for the watchers.
+//
+static void
+fsevent_stage(struct fse_shard *fs, kfs_event *kfse)
+{
+	int full;
+
+	OSAddAtomic(1, &kfse->refcount);
+
+	lck_mtx_lock(&fs->fs_lock);
+	while (fs->fs_nstaged == FSE_STAGE_SIZE) {
+		// someone else filled it up and is on their way to flush
+		lck_mtx_unlock(&fs->fs_lock);
+		fsevents_flush_staged();
+		lck_mtx_lock(&fs->fs_lock);
+	}
+	fs->fs_staged[fs->fs_nstaged++] = kfse;
+	full = (fs->fs_nstaged == FSE_STAGE_SIZE);
+	lck_mtx_unlock(&fs->fs_lock);
 
-#define MAX_NUM_PENDING  16
+	// the unmount path waits on FSE_UNMOUNT_PENDING so don't sit on it
+	if (full || kfse->type == FSE_UNMOUNT_PENDING) {
+		fsevents_flush_staged();
+	} else {
+		schedule_event_wakeup();
+	}
+}
 
 //
 // NOTE: the watch table must be locked before calling
@@ -1472,10 +1769,9 @@ watcher_add_event(fs_event_watcher *watcher, kfs_event *kfse)
 	watcher->wr = (watcher->wr + 1) % watcher->eventq_size;
 
 	//
-	// wake up the watcher if there are more than MAX_NUM_PENDING events.
-	// otherwise schedule a timer (if one isn't already set) which will
-	// send any pending events if no more are received in the next
-	// EVENT_DELAY_IN_MS milli-seconds.
+	// the caller wakes the watcher up once it has queued the
+	// whole batch; here we only deal with a watcher that is
+	// falling too far behind.
 	//
 	int32_t num_pending = 0;
 	if (watcher->rd < watcher->wr) {
@@ -1506,10 +1802,6 @@ watcher_add_event(fs_event_watcher *watcher, kfs_event *kfse)
 		    watcher->eventq_size, watcher->flags);
 
 		fsevents_wakeup(watcher);
-	} else if (num_pending > MAX_NUM_PENDING) {
-		fsevents_wakeup(watcher);
-	} else if (timer_set == 0) {
-		schedule_event_wakeup();
 	}
 
 	return 0;
@@ -1927,11 +2219,7 @@ restart_watch:
 				skipped = 1;
 			} else {
 				skipped = 0;
-				if (last_event_ptr == kfse) {
-					last_event_ptr = NULL;
-					last_event_type = -1;
-					last_coalesced_time = 0;
-				}
+				kfse_forget_coalesced(kfse);
 				error = copy_out_kfse(watcher, kfse, uio);
 				if (error != 0) {
 					// if an event won't fit or encountered an error while
@@ -2153,6 +2441,7 @@ handle_dev_filter:
 				fseh->watcher->devices_not_to_watch = NULL;
 				old_num_devices = fseh->watcher->num_devices;
 				fseh->watcher->num_devices = new_num_devices;
+				fse_filter_gen++;
 
 				unlock_watch_table();
 				kfree_data(tmp, old_num_devices * sizeof(dev_t));
@@ -2178,6 +2467,7 @@ handle_dev_filter:
 			fseh->watcher->num_devices = new_num_devices;
 			tmp = fseh->watcher->devices_not_to_watch;
 			fseh->watcher->devices_not_to_watch = devices_not_to_watch;
+			fse_filter_gen++;
 			unlock_watch_table();
 
 			kfree_data(tmp, old_num_devices * sizeof(dev_t));
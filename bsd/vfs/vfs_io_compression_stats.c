@@ -723,3 +723,52 @@ vnode_updateiocompressionbufferstats(__unused vnode_t vp, __unused uint64_t unco
 
 	return 0;
 }
+
+/*
+ * decmpfs decompression timing.  Every uncompressed-data fetch from
+ * decmpfs is recorded here; fetches that were split across the
+ * decompression worker pool also count the number of pieces they ran as.
+ */
+static struct decmpfs_fetch_stats decmpfs_fetch_stats;
+
+void
+io_compression_stats_decmpfs_fetch(uint64_t bytes, uint32_t pieces, uint64_t elapsed_ns)
+{
+	uint64_t max;
+
+	OSIncrementAtomic64((SInt64 *)&decmpfs_fetch_stats.dfs_fetches);
+	OSAddAtomic64(bytes, (SInt64 *)&decmpfs_fetch_stats.dfs_bytes);
+	OSAddAtomic64(elapsed_ns, (SInt64 *)&decmpfs_fetch_stats.dfs_time_ns);
+	if (pieces > 1) {
+		OSIncrementAtomic64((SInt64 *)&decmpfs_fetch_stats.dfs_parallel_fetches);
+		OSAddAtomic64(pieces, (SInt64 *)&decmpfs_fetch_stats.dfs_pieces);
+		OSAddAtomic64(elapsed_ns, (SInt64 *)&decmpfs_fetch_stats.dfs_parallel_time_ns);
+	}
+
+	do {
+		max = decmpfs_fetch_stats.dfs_max_time_ns;
+		if (elapsed_ns <= max) {
+			break;
+		}
+	} while (!OSCompareAndSwap64(max, elapsed_ns, &decmpfs_fetch_stats.dfs_max_time_ns));
+}
+
+static int
+sysctl_io_compression_decmpfs_stats SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	struct decmpfs_fetch_stats stats;
+	int error;
+
+	stats = decmpfs_fetch_stats;
+	error = SYSCTL_OUT(req, &stats, sizeof(stats));
+	if (error || req->newptr == USER_ADDR_NULL) {
+		return error;
+	}
+
+	/* any write resets the counters */
+	bzero(&decmpfs_fetch_stats, sizeof(decmpfs_fetch_stats));
+	return 0;
+}
+SYSCTL_PROC(_vfs, OID_AUTO, io_compression_decmpfs_stats, CTLTYPE_STRUCT | CTLFLAG_RW | CTLFLAG_LOCKED,
+    0, 0, sysctl_io_compression_decmpfs_stats, "S,decmpfs_fetch_stats", "");
@@ -34,6 +34,7 @@
 
 void io_compression_stats_init(void);
 void io_compression_stats(buf_t bp);
+void io_compression_stats_decmpfs_fetch(uint64_t bytes, uint32_t pieces, uint64_t elapsed_ns);
 
 #define IO_COMPRESSION_STATS_DEFAULT_BLOCK_SIZE (4 * 1024)
 #define IO_COMPRESSION_STATS_MIN_BLOCK_SIZE (4 * 1024)
@@ -62,4 +63,15 @@ struct iocs_store_buffer {
 /* Wait for the buffer to be 10% more full before notifying again */
 #define IOCS_STORE_BUFFER_NOTIFICATION_INTERVAL (IOCS_STORE_BUFFER_SIZE / 10)
 
+/* decmpfs_fetch_stats: Timing of decmpfs uncompressed-data fetches */
+struct decmpfs_fetch_stats {
+	uint64_t                dfs_fetches;            /* fetches completed */
+	uint64_t                dfs_bytes;              /* uncompressed bytes produced */
+	uint64_t                dfs_time_ns;            /* total wall time of all fetches */
+	uint64_t                dfs_max_time_ns;        /* slowest single fetch */
+	uint64_t                dfs_parallel_fetches;   /* fetches split across decompression workers */
+	uint64_t                dfs_pieces;             /* pieces those fetches were split into */
+	uint64_t                dfs_parallel_time_ns;   /* wall time of the split fetches */
+};
+
 #endif
@@ -187,6 +187,8 @@ namei(struct nameidata *ndp)
 	vnode_t usedvp_dp = NULLVP;
 	int32_t old_count = 0;
 	bool dp_has_iocount = false;
+	bool pathcache_probe;
+	uint64_t pathcache_gen = 0;
 
 #if DIAGNOSTIC
 	if (!vfs_context_ucred(ctx) || !p) {
@@ -442,6 +444,7 @@ retry_copy:
 
 	ndp->ni_dvp = NULLVP;
 	ndp->ni_vp  = NULLVP;
+	pathcache_probe = true;
 
 	for (;;) {
 #if CONFIG_MACF
@@ -461,9 +464,22 @@ retry_copy:
 		ndp->ni_startdir = dp;
 		dp = NULLVP;
 
-		if ((error = lookup(ndp))) {
+		/*
+		 * Only the path as the caller gave it can be looked up in,
+		 * or entered in, the path cache; not one a symlink led to.
+		 */
+		if (pathcache_probe &&
+		    (ndp->ni_vp = cache_path_lookup(ndp, ctx, &pathcache_gen)) != NULLVP) {
+			if (kdebug_enable) {
+				kdebug_lookup(ndp->ni_vp, cnp);
+			}
+		} else if ((error = lookup(ndp))) {
 			goto error_out;
+		} else if (pathcache_probe) {
+			cache_path_enter(ndp, ctx, pathcache_gen);
 		}
+		pathcache_probe = false;
+		ndp->ni_flag &= ~NAMEI_PATHCACHED;
 
 		/*
 		 * Check for symbolic link
@@ -120,6 +120,7 @@
 #include <mach/kern_return.h>
 #include <kern/thread.h>
 #include <kern/sched_prim.h>
+#include <kern/cpu_number.h>
 
 #include <miscfs/specfs/specdev.h>
 
@@ -290,6 +291,8 @@ static  uint64_t vfs_shutdown_last_completion_time;
 #define RAGE_LIMIT_MIN  100
 #define RAGE_TIME_LIMIT 5
 
+#define VN_LAUNDRY_BATCH        16      /* vnodes the laundry thread claims per pass */
+
 /*
  * ROSV definitions
  * NOTE: These are shadowed from PlatformSupport definitions, but XNU
@@ -381,6 +384,40 @@ static int print_busy_vnodes = 0;                               /* print out bus
 	        reusablevnodes--;    \
 	} while(0)
 
+/*
+ * Per-cpu caches of dead vnodes.
+ *
+ * new_vnode moves reclaimed vnodes that will never be deallocated off the
+ * head of vnode_dead_list onto its cpu's cache in batches of
+ * VNODE_PCPU_BATCH, and takes them from there on later calls without
+ * going through the global vnode_list_lock.  A cached vnode looks like
+ * it is on a list (VONLIST) and carries VLIST_PCPU and the index of its
+ * cache in v_listflag.  Its v_freelist and v_listflag change only with
+ * both the cache lock and either the vnode_list_lock or the vnode lock
+ * held, so vnode_list_remove (vnode lock + list lock) sees a stable view.
+ * Cached vnodes count in pcpudeadvnodes rather than deadvnodes.
+ */
+#define VNODE_PCPU_CACHES       16
+#define VNODE_PCPU_BATCH        16
+
+#define VLIST_PCPU_SHIFT        24
+#define VLIST_PCPU_INDEX(vp)    ((vp)->v_listflag >> VLIST_PCPU_SHIFT)
+
+struct vnode_pcpu_cache {
+	lck_spin_t              vpc_lock;
+	TAILQ_HEAD(, vnode)     vpc_list;
+	int                     vpc_count;
+} __attribute__((aligned(128)));
+
+static LCK_GRP_DECLARE(vnode_pcpu_lck_grp, "vnode_pcpu_cache");
+static struct vnode_pcpu_cache vnode_pcpu_caches[VNODE_PCPU_CACHES];
+long pcpudeadvnodes = 0;
+uint64_t pcpu_reusedvnodes = 0;
+uint64_t laundry_batches = 0;
+
+static void vnode_pcpu_cache_remove(vnode_t vp);
+static inline long vnode_dead_count(void);
+
 static void async_work_continue(void);
 static void vn_laundry_continue(void);
 static void wakeup_laundry_thread(void);
@@ -400,6 +437,11 @@ vntblinit(void)
 	TAILQ_INIT(&vnode_async_work_list);
 	TAILQ_INIT(&mountlist);
 
+	for (int i = 0; i < VNODE_PCPU_CACHES; i++) {
+		lck_spin_init(&vnode_pcpu_caches[i].vpc_lock, &vnode_pcpu_lck_grp, LCK_ATTR_NULL);
+		TAILQ_INIT(&vnode_pcpu_caches[i].vpc_list);
+	}
+
 	microuptime(&rage_tv);
 	rage_limit = desiredvnodes_one_percent;
 	if (rage_limit < RAGE_LIMIT_MIN) {
@@ -2552,6 +2594,8 @@ vnode_list_remove_locked(vnode_t vp)
 			wakeup_laundry_thread();
 		} else if (vp->v_listflag & VLIST_ASYNC_WORK) {
 			VREMASYNC_WORK("vnode_list_remove", vp);
+		} else if (vp->v_listflag & VLIST_PCPU) {
+			vnode_pcpu_cache_remove(vp);
 		} else {
 			VREMFREE("vnode_list_remove", vp);
 		}
@@ -3109,6 +3153,10 @@ vclean(vnode_t vp, int flags)
 	}
 #endif /* CONFIG_IO_COMPRESSION_STATS */
 
+	if (vp->v_xattr_cache) {
+		vn_xattr_cache_free(vp);
+	}
+
 	/*
 	 * Reclaim the vnode.
 	 */
@@ -5111,19 +5159,143 @@ vn_print_state(struct vnode *vp, const char *fmt, ...)
 long num_reusedvnodes = 0;
 
 
-static vnode_t
-process_vp(vnode_t vp, int want_vp, bool can_defer, int *deferred)
+/*
+ * Take vp off its cpu's dead vnode cache.  Called with the cache lock
+ * and either the vnode_list_lock or the vnode lock held.
+ */
+static void
+vnode_pcpu_cache_remove_locked(struct vnode_pcpu_cache *vpc, vnode_t vp)
 {
-	unsigned int  vpid;
+	TAILQ_REMOVE(&vpc->vpc_list, vp, v_freelist);
+	VLISTNONE(vp);
+	vp->v_listflag &= ~(VLIST_PCPU | (0xffU << VLIST_PCPU_SHIFT));
+	vpc->vpc_count--;
+	os_atomic_dec(&pcpudeadvnodes, relaxed);
+}
 
-	*deferred = 0;
+/*
+ * called with the vnode LOCKED and the vnode_list_lock held,
+ * from vnode_list_remove_locked
+ */
+static void
+vnode_pcpu_cache_remove(vnode_t vp)
+{
+	struct vnode_pcpu_cache *vpc = &vnode_pcpu_caches[VLIST_PCPU_INDEX(vp)];
 
-	vpid = vp->v_id;
+	lck_spin_lock_grp(&vpc->vpc_lock, &vnode_pcpu_lck_grp);
+	vnode_pcpu_cache_remove_locked(vpc, vp);
+	lck_spin_unlock(&vpc->vpc_lock);
+}
 
-	vnode_list_remove_locked(vp);
+/*
+ * Move up to VNODE_PCPU_BATCH reusable dead vnodes from the head of
+ * vnode_dead_list onto this cpu's cache, leaving skip (the vnode the
+ * caller is about to take) where it is.  Called with the vnode_list_lock
+ * held.
+ */
+static void
+vnode_pcpu_cache_fill_locked(vnode_t skip)
+{
+	unsigned int index = cpu_number() % VNODE_PCPU_CACHES;
+	struct vnode_pcpu_cache *vpc = &vnode_pcpu_caches[index];
+	vnode_t vp, nvp;
+
+	lck_spin_lock_grp(&vpc->vpc_lock, &vnode_pcpu_lck_grp);
+	for (vp = TAILQ_FIRST(&vnode_dead_list);
+	    vp != NULLVP && vpc->vpc_count < VNODE_PCPU_BATCH; vp = nvp) {
+		nvp = TAILQ_NEXT(vp, v_freelist);
+		if (vp == skip) {
+			continue;
+		}
+		/* freeable vnodes are at the tail of the dead list */
+		if ((vp->v_flag & VCANDEALLOC) || (vp->v_listflag & VLIST_NO_REUSE)) {
+			break;
+		}
+		VREMDEAD("vnode_pcpu_cache_fill", vp);
+		vp->v_listflag |= VLIST_PCPU | (index << VLIST_PCPU_SHIFT);
+		TAILQ_INSERT_TAIL(&vpc->vpc_list, vp, v_freelist);
+		vpc->vpc_count++;
+		os_atomic_inc(&pcpudeadvnodes, relaxed);
+	}
+	lck_spin_unlock(&vpc->vpc_lock);
+}
+
+/*
+ * Take a dead vnode from the cache at index.  Returns the vnode locked
+ * and with a holdcount, like process_vp, or NULLVP.  The vnode lock is
+ * only tried since the caller may hold the vnode_list_lock.
+ */
+static vnode_t
+vnode_pcpu_cache_get(unsigned int index)
+{
+	struct vnode_pcpu_cache *vpc = &vnode_pcpu_caches[index];
+	vnode_t vp;
+
+	if (vpc->vpc_count == 0) {
+		return NULLVP;
+	}
+
+	lck_spin_lock_grp(&vpc->vpc_lock, &vnode_pcpu_lck_grp);
+	TAILQ_FOREACH(vp, &vpc->vpc_list, v_freelist) {
+		if (lck_mtx_try_lock_spin(&vp->v_lock)) {
+			break;
+		}
+	}
+	if (vp == NULLVP) {
+		lck_spin_unlock(&vpc->vpc_lock);
+		return NULLVP;
+	}
+	vnode_pcpu_cache_remove_locked(vpc, vp);
+	lck_spin_unlock(&vpc->vpc_lock);
 
 	vnode_hold(vp);
-	vnode_list_unlock();
+
+	if ((vp->v_usecount != 0) || (vp->v_iocount != 0) || (vp->v_lflag & VL_TERMINATE)) {
+		/* someone has picked it up, it goes back on a list when they're done */
+		vnode_drop_and_unlock(vp);
+		return NULLVP;
+	}
+	if (vp->v_type != VBAD || !(vp->v_lflag & VL_DEAD)) {
+		panic("new_vnode(%p): cached dead vnode isn't dead", vp);
+	}
+	os_atomic_inc(&pcpu_reusedvnodes, relaxed);
+
+	return vp;
+}
+
+/*
+ * Take a dead vnode from any cpu's cache, for when the dead list is
+ * empty.  Called with the vnode_list_lock held.
+ */
+static vnode_t
+vnode_pcpu_cache_steal_locked(void)
+{
+	unsigned int start = cpu_number() % VNODE_PCPU_CACHES;
+	vnode_t vp;
+
+	for (unsigned int i = 0; i < VNODE_PCPU_CACHES; i++) {
+		vp = vnode_pcpu_cache_get((start + i) % VNODE_PCPU_CACHES);
+		if (vp != NULLVP) {
+			return vp;
+		}
+	}
+	return NULLVP;
+}
+
+static inline long
+vnode_dead_count(void)
+{
+	return deadvnodes + os_atomic_load(&pcpudeadvnodes, relaxed);
+}
+
+/*
+ * Second half of process_vp for a vnode the caller has already taken
+ * off its list and put a hold on.
+ */
+static vnode_t
+process_claimed_vp(vnode_t vp, unsigned int vpid, int want_vp, bool can_defer, int *deferred)
+{
+	*deferred = 0;
 
 	vnode_lock_spin(vp);
 
@@ -5209,6 +5381,21 @@ process_vp(vnode_t vp, int want_vp, bool can_defer, int *deferred)
 	return vp;
 }
 
+static vnode_t
+process_vp(vnode_t vp, int want_vp, bool can_defer, int *deferred)
+{
+	unsigned int  vpid;
+
+	vpid = vp->v_id;
+
+	vnode_list_remove_locked(vp);
+
+	vnode_hold(vp);
+	vnode_list_unlock();
+
+	return process_claimed_vp(vp, vpid, want_vp, can_defer, deferred);
+}
+
 __attribute__((noreturn))
 static void
 async_work_continue(void)
@@ -5249,8 +5436,11 @@ vn_laundry_continue(void)
 {
 	struct freelst *free_q;
 	struct ragelst *rage_q;
+	vnode_t batch[VN_LAUNDRY_BATCH];
+	unsigned int batch_vid[VN_LAUNDRY_BATCH];
 	vnode_t vp;
 	int deferred;
+	int nbatch, want, i;
 	bool rage_q_empty;
 	bool free_q_empty;
 
@@ -5287,7 +5477,7 @@ vn_laundry_continue(void)
 		}
 
 		if (numvnodes < numvnodes_min || (rage_q_empty && free_q_empty) ||
-		    (reusablevnodes <= reusablevnodes_max && deadvnodes >= deadvnodes_high)) {
+		    (reusablevnodes <= reusablevnodes_max && vnode_dead_count() >= deadvnodes_high)) {
 			assert_wait(free_q, (THREAD_UNINT));
 
 			vnode_list_unlock();
@@ -5297,18 +5487,36 @@ vn_laundry_continue(void)
 			continue;
 		}
 
-		if (!rage_q_empty) {
-			vp = TAILQ_FIRST(rage_q);
-		} else {
-			vp = TAILQ_FIRST(free_q);
+		/*
+		 * Claim a batch of vnodes under one hold of the list lock,
+		 * enough to bring the dead reserve back up to deadvnodes_high,
+		 * and reclaim them with the lock dropped.
+		 */
+		want = (int)MIN(VN_LAUNDRY_BATCH, MAX(1, deadvnodes_high - vnode_dead_count()));
+		for (nbatch = 0; nbatch < want; nbatch++) {
+			if (!rage_q_empty && !TAILQ_EMPTY(rage_q)) {
+				vp = TAILQ_FIRST(rage_q);
+			} else if (!TAILQ_EMPTY(free_q)) {
+				vp = TAILQ_FIRST(free_q);
+			} else {
+				break;
+			}
+			batch_vid[nbatch] = vp->v_id;
+			vnode_list_remove_locked(vp);
+			vnode_hold(vp);
+			batch[nbatch] = vp;
 		}
+		laundry_batches++;
+		vnode_list_unlock();
 
-		vp = process_vp(vp, 0, false, &deferred);
+		for (i = 0; i < nbatch; i++) {
+			vp = process_claimed_vp(batch[i], batch_vid[i], 0, false, &deferred);
 
-		if (vp != NULLVP) {
-			/* If process_vp returns a vnode, it is locked and has a holdcount */
-			vnode_drop_and_unlock(vp);
-			vp = NULLVP;
+			if (vp != NULLVP) {
+				/* If process_claimed_vp returns a vnode, it is locked and has a holdcount */
+				vnode_drop_and_unlock(vp);
+				vp = NULLVP;
+			}
 		}
 	}
 }
@@ -5316,7 +5524,7 @@ vn_laundry_continue(void)
 static inline void
 wakeup_laundry_thread()
 {
-	if (deadvnodes_noreuse || (numvnodes >= numvnodes_min && deadvnodes < deadvnodes_low &&
+	if (deadvnodes_noreuse || (numvnodes >= numvnodes_min && vnode_dead_count() < deadvnodes_low &&
 	    (reusablevnodes > reusablevnodes_max || numvnodes >= desiredvnodes))) {
 		wakeup(&vnode_free_list);
 	}
@@ -5345,6 +5553,16 @@ new_vnode(vnode_t *vpp, bool can_free)
 retry:
 	vp = NULLVP;
 
+	/*
+	 * Reuse a dead vnode from this cpu's cache if there is room for
+	 * another live vnode; this is the same test as below, made without
+	 * the list lock.
+	 */
+	if ((numvnodes - vnode_dead_count() + deadvnodes_noreuse) < desiredvnodes &&
+	    (vp = vnode_pcpu_cache_get(cpu_number() % VNODE_PCPU_CACHES)) != NULLVP) {
+		goto reuse_this_vp;
+	}
+
 	vnode_list_lock();
 	newvnode++;
 
@@ -5362,7 +5580,7 @@ retry:
 		force_alloc_freeable = false;
 	}
 
-	if (((numvnodes - deadvnodes + deadvnodes_noreuse) < desiredvnodes) ||
+	if (((numvnodes - vnode_dead_count() + deadvnodes_noreuse) < desiredvnodes) ||
 	    force_alloc || force_alloc_freeable) {
 		struct timespec ts;
 		uint32_t vflag = 0;
@@ -5400,11 +5618,26 @@ retry:
 			}
 
 			if (vp) {
+				if (!(vp->v_flag & VCANDEALLOC) &&
+				    vnode_pcpu_caches[cpu_number() % VNODE_PCPU_CACHES].vpc_count == 0) {
+					vnode_pcpu_cache_fill_locked(vp);
+				}
 				force_alloc_freeable = false;
 				goto steal_this_vp;
 			}
 		}
 
+		/*
+		 * the dead list is empty, but other cpus may have
+		 * dead vnodes cached
+		 */
+		if (os_atomic_load(&pcpudeadvnodes, relaxed) != 0 &&
+		    (vp = vnode_pcpu_cache_steal_locked()) != NULLVP) {
+			vnode_list_unlock();
+			force_alloc_freeable = false;
+			goto reuse_this_vp;
+		}
+
 		/*
 		 * no dead vnodes available... if we're under
 		 * the limit, we'll create a new vnode
@@ -5676,6 +5909,7 @@ steal_this_vp:
 		}
 		goto retry;
 	}
+reuse_this_vp:
 	OSAddAtomicLong(1, &num_reusedvnodes);
 
 
@@ -5782,9 +6016,16 @@ vnode_drop_internal(vnode_t vp, bool locked)
 		return vp;
 	}
 
-	if (!locked) {
-		vnode_lock(vp);
+	/*
+	 * A lockless name cache lookup may have found this vnode before it
+	 * was purged, and be about to take a hold on it.  Let it finish so
+	 * that the holdcount checks below see its hold.
+	 */
+	if (locked) {
+		vnode_unlock(vp);
 	}
+	cache_smr_synchronize();
+	vnode_lock(vp);
 
 	if ((os_atomic_load(&vp->v_holdcount, relaxed) != 0) || vp->v_iocount ||
 	    vp->v_usecount || !(vp->v_flag & VCANDEALLOC) || !(vp->v_lflag & VL_DEAD)) {
@@ -5800,7 +6041,7 @@ vnode_drop_internal(vnode_t vp, bool locked)
 	if ((os_atomic_load(&vp->v_holdcount, relaxed) == 0) && VONLIST(vp) &&
 	    (vp->v_listflag & VLIST_DEAD) &&
 	    (numvnodes > desiredvnodes || (vp->v_listflag & VLIST_NO_REUSE) ||
-	    vn_dealloc_level != DEALLOC_VNODE_ALL || deadvnodes >= deadvnodes_high)) {
+	    vn_dealloc_level != DEALLOC_VNODE_ALL || vnode_dead_count() >= deadvnodes_high)) {
 		VREMDEAD("vnode_list_remove", vp);
 		numvnodes--;
 		freeablevnodes--;
@@ -5863,6 +6104,15 @@ SYSCTL_LONG(_vfs_vnstats, OID_AUTO, num_deallocable_busy_vnodes,
 SYSCTL_LONG(_vfs_vnstats, OID_AUTO, num_dead_vnodes,
     CTLFLAG_RD | CTLFLAG_LOCKED,
     &deadvnodes, "");
+SYSCTL_LONG(_vfs_vnstats, OID_AUTO, num_pcpu_dead_vnodes,
+    CTLFLAG_RD | CTLFLAG_LOCKED,
+    &pcpudeadvnodes, "");
+SYSCTL_QUAD(_vfs_vnstats, OID_AUTO, num_pcpu_reusedvnodes,
+    CTLFLAG_RD | CTLFLAG_LOCKED,
+    &pcpu_reusedvnodes, "");
+SYSCTL_QUAD(_vfs_vnstats, OID_AUTO, num_laundry_batches,
+    CTLFLAG_RD | CTLFLAG_LOCKED,
+    &laundry_batches, "");
 SYSCTL_LONG(_vfs_vnstats, OID_AUTO, num_dead_vnodes_to_dealloc,
     CTLFLAG_RD | CTLFLAG_LOCKED,
     &deadvnodes_noreuse, "");
@@ -10712,6 +10962,14 @@ vfs_setcompoundopen(mount_t mp)
 	mount_unlock(mp);
 }
 
+void
+vfs_setpassthrough(mount_t mp)
+{
+	mount_lock_spin(mp);
+	mp->mnt_supl_kern_flag |= MNTK_SUPL_PASSTHROUGH;
+	mount_unlock(mp);
+}
+
 void
 vnode_setswapmount(vnode_t vp)
 {
@@ -2963,6 +2963,8 @@ out:
 #if CONFIG_MACF
 			mac_mount_label_destroy(mp);
 #endif
+			/* lockless name cache lookups may still look at it */
+			cache_smr_synchronize();
 			zfree(mount_zone, mp);
 		} else {
 			panic("dounmount: no coveredvp");
@@ -3053,6 +3055,8 @@ mount_dropcrossref(mount_t mp, vnode_t dp, int need_put)
 #if CONFIG_MACF
 		mac_mount_label_destroy(mp);
 #endif
+		/* lockless name cache lookups may still look at it */
+		cache_smr_synchronize();
 		zfree(mount_zone, mp);
 		return;
 	}
@@ -12651,6 +12655,7 @@ unlock:
 		case F_CHKCLEAN:
 		case F_FULLFSYNC:
 		case F_BARRIERFSYNC:
+		case F_GROUPFSYNC:
 		case F_FREEZE_FS:
 		case F_THAW_FS:
 		case FSIOC_KERNEL_ROOTAUTH:
@@ -1851,6 +1851,83 @@ vn_closefile(struct fileglob *fg, vfs_context_t ctx)
 	return error;
 }
 
+/*
+ * Flush a file system's device cache (or put a barrier in it) after vp,
+ * the last of a group on that file system, was synced.  F_FULLFSYNC and
+ * F_BARRIERFSYNC also commit the file system's journal, so they are what
+ * we ask for; for a file system that implements neither, fsync vp and send
+ * DKIOCSYNCHRONIZE to the device it is mounted from ourselves.
+ */
+static int
+vn_fsync_flush(vnode_t vp, boolean_t barrier, vfs_context_t ctx)
+{
+	dk_synchronize_t sync;
+	vnode_t devvp;
+	int error;
+
+	error = VNOP_IOCTL(vp, barrier ? F_BARRIERFSYNC : F_FULLFSYNC, (caddr_t)NULL, 0, ctx);
+	if (error != ENOTTY && error != ENOTSUP) {
+		return error;
+	}
+	if ((error = VNOP_FSYNC(vp, MNT_WAIT, ctx))) {
+		return error;
+	}
+	if ((devvp = vp->v_mount->mnt_devvp) == NULLVP) {
+		return 0;
+	}
+
+	bzero(&sync, sizeof(sync));
+	if (barrier) {
+		sync.options = DK_SYNCHRONIZE_OPTION_BARRIER;
+		error = VNOP_IOCTL(devvp, DKIOCSYNCHRONIZE, (caddr_t)&sync, FWRITE, ctx);
+		if (error != ENOTTY && error != ENOTSUP) {
+			return error;
+		}
+		/* no barriers on this device, flush it instead */
+		sync.options = 0;
+	}
+	error = VNOP_IOCTL(devvp, DKIOCSYNCHRONIZE, (caddr_t)&sync, FWRITE, ctx);
+	if (error == ENOTTY || error == ENOTSUP) {
+		/* nothing to flush */
+		error = 0;
+	}
+	return error;
+}
+
+/*
+ * Make a group of vnodes durable with one device cache flush, or one
+ * barrier, per file system rather than one per vnode: every vnode but the
+ * last on its mount is only fsync'ed, which waits for its writes, and the
+ * last one gets the flush.
+ *
+ * The caller holds an iocount on each vnode.  Every vnode is synced even
+ * if an earlier one fails; the first error is returned.
+ */
+int
+vn_fsync_group(vnode_t *vps, int count, boolean_t barrier, vfs_context_t ctx)
+{
+	int error = 0, error2;
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		for (j = i + 1; j < count; j++) {
+			if (vps[j]->v_mount == vps[i]->v_mount) {
+				break;
+			}
+		}
+		if (j < count) {
+			/* vps[j] will flush this mount */
+			error2 = VNOP_FSYNC(vps[i], MNT_WAIT, ctx);
+		} else {
+			error2 = vn_fsync_flush(vps[i], barrier, ctx);
+		}
+		if (error == 0) {
+			error = error2;
+		}
+	}
+	return error;
+}
+
 /*
  * Returns:	0			Success
  *	VNOP_PATHCONF:???
@@ -34,6 +34,7 @@
 
 #include <sys/param.h>
 
+#include <sys/decmpfs.h>
 #include <sys/fcntl.h>
 #include <sys/fsevents.h>
 #include <sys/kernel.h>
@@ -43,12 +44,14 @@
 #include <sys/namei.h>
 #include <sys/proc_internal.h>
 #include <sys/stat.h>
+#include <sys/sysctl.h>
 #include <sys/uio.h>
 #include <sys/utfconv.h>
 #include <sys/vnode.h>
 #include <sys/vnode_internal.h>
 #include <sys/xattr.h>
 
+#include <libkern/OSAtomic.h>
 #include <libkern/OSByteOrder.h>
 #include <vm/vm_kern.h>
 
@@ -110,6 +113,353 @@ static int default_listxattr(vnode_t vp, uio_t uio, size_t *size, int options,
 static int default_removexattr(vnode_t vp, const char *name, int options,
     vfs_context_t context);
 
+/*
+ * Extended attribute value cache.
+ *
+ * Small attributes that get read over and over (quarantine, tags, ...)
+ * are remembered per vnode so vn_getxattr doesn't have to go to the
+ * filesystem, or to its AppleDouble file, every time.  Attributes that
+ * don't exist are cached as well, and so is the fact that an attribute is
+ * too large to cache, so that it isn't read twice on every call.
+ *
+ * Only local filesystems are cached.  The resource fork, FinderInfo (which
+ * setattrlist can change behind our back), the compression attribute and
+ * protected system attributes never are.  Every change that goes through
+ * VNOP_SETXATTR/VNOP_REMOVEXATTR or vn_setxattr/vn_removexattr drops the
+ * vnode's entries, and xc_gen keeps a miss that raced with such a change
+ * from inserting what it read.  The cache is protected by the vnode lock.
+ */
+#define XATTR_CACHE_MAX_ENTRIES 8
+#define XATTR_CACHE_MAX_VALUE   512
+
+#define XCE_NOATTR      0x1             /* attribute doesn't exist */
+#define XCE_TOOBIG      0x2             /* value is larger than XATTR_CACHE_MAX_VALUE */
+
+struct xattr_cache_entry {
+	TAILQ_ENTRY(xattr_cache_entry) xce_link;
+	int             xce_flags;
+	size_t          xce_len;
+	void            *xce_value;
+	char            xce_name[XATTR_MAXNAMELEN + 1];
+};
+
+TAILQ_HEAD(xattr_cache_head, xattr_cache_entry);
+
+struct xattr_cache {
+	struct xattr_cache_head xc_entries;     /* most recently used first */
+	uint32_t        xc_count;
+	uint32_t        xc_gen;                 /* bumped on every invalidation */
+};
+
+static int xattr_cache_enabled = 1;
+static int64_t xattr_cache_maxbytes = 4 * 1024 * 1024;
+static int64_t xattr_cache_bytes = 0;
+static uint64_t xattr_cache_hits = 0;
+static uint64_t xattr_cache_neg_hits = 0;
+static uint64_t xattr_cache_misses = 0;
+static uint64_t xattr_cache_invalidations = 0;
+
+SYSCTL_DECL(_vfs_generic);
+SYSCTL_INT(_vfs_generic, OID_AUTO, xattr_cache_enabled,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &xattr_cache_enabled, 0,
+    "cache small extended attribute values per vnode");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, xattr_cache_maxbytes,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &xattr_cache_maxbytes,
+    "limit on the bytes of cached extended attribute values");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, xattr_cache_bytes,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &xattr_cache_bytes,
+    "bytes of cached extended attribute values");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, xattr_cache_hits,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &xattr_cache_hits,
+    "getxattr calls answered with a cached value");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, xattr_cache_neg_hits,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &xattr_cache_neg_hits,
+    "getxattr calls answered with a cached ENOATTR");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, xattr_cache_misses,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &xattr_cache_misses,
+    "cacheable getxattr calls that went to the filesystem");
+SYSCTL_QUAD(_vfs_generic, OID_AUTO, xattr_cache_invalidations,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &xattr_cache_invalidations,
+    "per-vnode xattr caches dropped by setxattr or removexattr");
+
+static bool
+xattr_cache_eligible(vnode_t vp, const char *name, uio_t uio, int options)
+{
+	if (!xattr_cache_enabled) {
+		return false;
+	}
+	if (!(vfs_flags(vnode_mount(vp)) & MNT_LOCAL)) {
+		return false;
+	}
+	if (options & (XATTR_NODEFAULT | XATTR_SHOWCOMPRESSION)) {
+		return false;
+	}
+	if (uio != NULL && uio_offset(uio) != 0) {
+		return false;
+	}
+	if (strnlen(name, XATTR_MAXNAMELEN + 1) > XATTR_MAXNAMELEN ||
+	    xattr_protected(name) ||
+	    strcmp(name, XATTR_RESOURCEFORK_NAME) == 0 ||
+	    strcmp(name, XATTR_FINDERINFO_NAME) == 0 ||
+	    strcmp(name, DECMPFS_XATTR_NAME) == 0) {
+		return false;
+	}
+	return true;
+}
+
+static void
+xattr_cache_free_entries(struct xattr_cache_head *head)
+{
+	struct xattr_cache_entry *xce;
+
+	while ((xce = TAILQ_FIRST(head)) != NULL) {
+		TAILQ_REMOVE(head, xce, xce_link);
+		if (xce->xce_value != NULL) {
+			OSAddAtomic64(-(SInt64)xce->xce_len, &xattr_cache_bytes);
+			kfree_data(xce->xce_value, xce->xce_len);
+		}
+		kfree_type(struct xattr_cache_entry, xce);
+	}
+}
+
+/*
+ * Drop everything cached for vp.  Called after any change to its
+ * extended attributes.
+ */
+void
+vn_xattr_cache_invalidate(vnode_t vp)
+{
+	struct xattr_cache_head head = TAILQ_HEAD_INITIALIZER(head);
+	struct xattr_cache *xc;
+
+	if (vp->v_xattr_cache == NULL) {
+		return;
+	}
+
+	vnode_lock_spin(vp);
+	xc = vp->v_xattr_cache;
+	if (xc != NULL) {
+		xc->xc_gen++;
+		TAILQ_CONCAT(&head, &xc->xc_entries, xce_link);
+		xc->xc_count = 0;
+	}
+	vnode_unlock(vp);
+
+	if (!TAILQ_EMPTY(&head)) {
+		OSAddAtomic64(1, (SInt64 *)&xattr_cache_invalidations);
+		xattr_cache_free_entries(&head);
+	}
+}
+
+/*
+ * Release the cache when the vnode is reclaimed.
+ */
+void
+vn_xattr_cache_free(vnode_t vp)
+{
+	struct xattr_cache *xc;
+
+	vnode_lock_spin(vp);
+	xc = vp->v_xattr_cache;
+	vp->v_xattr_cache = NULL;
+	vnode_unlock(vp);
+
+	if (xc != NULL) {
+		xattr_cache_free_entries(&xc->xc_entries);
+		kfree_type(struct xattr_cache, xc);
+	}
+}
+
+static struct xattr_cache_entry *
+xattr_cache_find(struct xattr_cache *xc, const char *name)
+{
+	struct xattr_cache_entry *xce;
+
+	TAILQ_FOREACH(xce, &xc->xc_entries, xce_link) {
+		if (strcmp(xce->xce_name, name) == 0) {
+			return xce;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Insert what a miss read, unless the attributes changed while it was
+ * reading them.  Consumes xce either way.
+ */
+static void
+xattr_cache_insert(vnode_t vp, struct xattr_cache *xc, uint32_t gen, struct xattr_cache_entry *xce)
+{
+	struct xattr_cache_head head = TAILQ_HEAD_INITIALIZER(head);
+	struct xattr_cache_entry *old;
+
+	if (xce->xce_value != NULL) {
+		OSAddAtomic64((SInt64)xce->xce_len, &xattr_cache_bytes);
+	}
+
+	vnode_lock_spin(vp);
+	if (vp->v_xattr_cache != xc || xc->xc_gen != gen) {
+		TAILQ_INSERT_HEAD(&head, xce, xce_link);
+	} else {
+		if ((old = xattr_cache_find(xc, xce->xce_name)) != NULL) {
+			TAILQ_REMOVE(&xc->xc_entries, old, xce_link);
+			TAILQ_INSERT_HEAD(&head, old, xce_link);
+			xc->xc_count--;
+		}
+		if (xc->xc_count >= XATTR_CACHE_MAX_ENTRIES) {
+			old = TAILQ_LAST(&xc->xc_entries, xattr_cache_head);
+			TAILQ_REMOVE(&xc->xc_entries, old, xce_link);
+			TAILQ_INSERT_HEAD(&head, old, xce_link);
+			xc->xc_count--;
+		}
+		TAILQ_INSERT_HEAD(&xc->xc_entries, xce, xce_link);
+		xc->xc_count++;
+	}
+	vnode_unlock(vp);
+
+	xattr_cache_free_entries(&head);
+}
+
+static int
+xattr_cache_copyout(void *value, size_t len, uio_t uio, size_t *size)
+{
+	if (size != NULL) {
+		*size = len;
+	}
+	if (uio == NULL) {
+		return 0;
+	}
+	if (uio_resid(uio) < (user_ssize_t)len) {
+		return ERANGE;
+	}
+	return uiomove(value, (int)len, uio);
+}
+
+/*
+ * Answer a getxattr from the cache, filling it on a miss.  Returns false
+ * if the caller should go to the filesystem itself.
+ */
+static bool
+xattr_cache_getxattr(vnode_t vp, const char *name, uio_t uio, size_t *size,
+    int options, vfs_context_t context, int *errorp)
+{
+	char value[XATTR_CACHE_MAX_VALUE];
+	struct xattr_cache *xc, *newxc = NULL;
+	struct xattr_cache_entry *xce;
+	uint32_t gen;
+	size_t len = 0;
+	void *buf;
+	uio_t auio;
+	int flags;
+	int error;
+
+	vnode_lock_spin(vp);
+	while ((xc = vp->v_xattr_cache) == NULL && newxc == NULL) {
+		vnode_unlock(vp);
+		newxc = kalloc_type(struct xattr_cache, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+		TAILQ_INIT(&newxc->xc_entries);
+		vnode_lock_spin(vp);
+	}
+	if (xc == NULL) {
+		if (vp->v_lflag & (VL_TERMINATE | VL_DEAD)) {
+			/* vclean has already released the cache, don't leave a new one behind */
+			vnode_unlock(vp);
+			kfree_type(struct xattr_cache, newxc);
+			return false;
+		}
+		xc = vp->v_xattr_cache = newxc;
+		newxc = NULL;
+	}
+
+	if ((xce = xattr_cache_find(xc, name)) != NULL) {
+		if (xce != TAILQ_FIRST(&xc->xc_entries)) {
+			TAILQ_REMOVE(&xc->xc_entries, xce, xce_link);
+			TAILQ_INSERT_HEAD(&xc->xc_entries, xce, xce_link);
+		}
+		flags = xce->xce_flags;
+		len = xce->xce_len;
+		if (flags == 0 && uio != NULL) {
+			bcopy(xce->xce_value, value, len);
+		}
+		vnode_unlock(vp);
+
+		if (newxc != NULL) {
+			kfree_type(struct xattr_cache, newxc);
+		}
+		if (flags & XCE_TOOBIG) {
+			return false;
+		}
+		if (flags & XCE_NOATTR) {
+			OSAddAtomic64(1, (SInt64 *)&xattr_cache_neg_hits);
+			*errorp = ENOATTR;
+			return true;
+		}
+		OSAddAtomic64(1, (SInt64 *)&xattr_cache_hits);
+		*errorp = xattr_cache_copyout(value, len, uio, size);
+		return true;
+	}
+	gen = xc->xc_gen;
+	vnode_unlock(vp);
+
+	if (newxc != NULL) {
+		kfree_type(struct xattr_cache, newxc);
+	}
+	OSAddAtomic64(1, (SInt64 *)&xattr_cache_misses);
+
+	/*
+	 * Read one byte more than we are willing to cache so that a
+	 * filesystem that truncates rather than failing with ERANGE
+	 * still shows up as too big.
+	 */
+	buf = kalloc_data(XATTR_CACHE_MAX_VALUE + 1, Z_WAITOK | Z_NOFAIL);
+	auio = uio_create(1, 0, UIO_SYSSPACE, UIO_READ);
+	uio_addiov(auio, CAST_USER_ADDR_T(buf), XATTR_CACHE_MAX_VALUE + 1);
+
+	error = VNOP_GETXATTR(vp, name, auio, &len, options, context);
+	if (error == ENOTSUP) {
+		error = default_getxattr(vp, name, auio, &len, options, context);
+	}
+	if (error == 0) {
+		len = XATTR_CACHE_MAX_VALUE + 1 - (size_t)uio_resid(auio);
+	}
+	uio_free(auio);
+
+	if (error != 0 && error != ENOATTR && error != ERANGE) {
+		kfree_data(buf, XATTR_CACHE_MAX_VALUE + 1);
+		*errorp = error;
+		return true;
+	}
+
+	xce = kalloc_type(struct xattr_cache_entry, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	strlcpy(xce->xce_name, name, sizeof(xce->xce_name));
+	if (error == ENOATTR) {
+		xce->xce_flags = XCE_NOATTR;
+	} else if (error == ERANGE || len > XATTR_CACHE_MAX_VALUE ||
+	    xattr_cache_bytes + (int64_t)len > xattr_cache_maxbytes) {
+		xce->xce_flags = XCE_TOOBIG;
+	} else {
+		xce->xce_len = len;
+		if (len > 0) {
+			xce->xce_value = kalloc_data(len, Z_WAITOK | Z_NOFAIL);
+			bcopy(buf, xce->xce_value, len);
+		}
+	}
+	flags = xce->xce_flags;
+	xattr_cache_insert(vp, xc, gen, xce);
+
+	if (flags & XCE_TOOBIG) {
+		kfree_data(buf, XATTR_CACHE_MAX_VALUE + 1);
+		return false;
+	}
+	if (flags & XCE_NOATTR) {
+		*errorp = ENOATTR;
+	} else {
+		*errorp = xattr_cache_copyout(buf, len, uio, size);
+	}
+	kfree_data(buf, XATTR_CACHE_MAX_VALUE + 1);
+	return true;
+}
+
 /*
  *  Retrieve the data of an extended attribute.
  */
@@ -162,6 +512,11 @@ vn_getxattr(vnode_t vp, const char *name, uio_t uio, size_t *size,
 		goto out;
 	}
 
+	if (xattr_cache_eligible(vp, name, uio, options) &&
+	    xattr_cache_getxattr(vp, name, uio, size, options, context, &error)) {
+		goto out;
+	}
+
 	error = VNOP_GETXATTR(vp, name, uio, size, options, context);
 	if (error == ENOTSUP && !(options & XATTR_NODEFAULT)) {
 		/*
@@ -256,6 +611,7 @@ vn_setxattr(vnode_t vp, const char *name, uio_t uio, int options, vfs_context_t
 		 */
 		error = default_setxattr(vp, name, uio, options, context);
 	}
+	vn_xattr_cache_invalidate(vp);
 #if CONFIG_MACF
 	if ((error == 0) && !(options & XATTR_NOSECURITY)) {
 		mac_vnode_notify_setextattr(context, vp, name, uio);
@@ -321,6 +677,7 @@ vn_removexattr(vnode_t vp, const char * name, int options, vfs_context_t context
 		}
 #endif /* DUAL_EAS */
 	}
+	vn_xattr_cache_invalidate(vp);
 #if CONFIG_MACF
 	if ((error == 0) && !(options & XATTR_NOSECURITY)) {
 		mac_vnode_notify_deleteextattr(context, vp, name);
@@ -104,6 +104,9 @@
 #include <vm/vm_dyld_pager.h>
 
 #include <vm/vm_protos.h>
+#if CONFIG_PHANTOM_CACHE
+#include <vm/vm_phantom_cache.h>
+#endif /* CONFIG_PHANTOM_CACHE */
 
 #include <sys/kern_memorystatus.h>
 #include <sys/kern_memorystatus_freeze.h>
@@ -3286,6 +3289,8 @@ SYSCTL_INT(_vm, OID_AUTO, dyld_pager_count,
     CTLFLAG_RD | CTLFLAG_LOCKED, &dyld_pager_count, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, dyld_pager_count_max,
     CTLFLAG_RD | CTLFLAG_LOCKED, &dyld_pager_count_max, 0, "");
+SYSCTL_INT(_vm, OID_AUTO, dyld_ws_prefetch_count,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &dyld_ws_prefetch_count, 0, "");
 #endif /* DEBUG || DEVELOPMENT */
 
 /* sysctl overflow room */
@@ -3324,6 +3329,47 @@ extern unsigned int     vm_page_purgeable_wired_count;
 SYSCTL_INT(_vm, OID_AUTO, page_purgeable_wired_count, CTLFLAG_RD | CTLFLAG_LOCKED,
     &vm_page_purgeable_wired_count, 0, "Wired purgeable page count");
 
+extern uint64_t vm_purgeable_purge_latency_max;
+extern uint64_t vm_purgeable_purge_latency_total;
+extern uint64_t vm_purgeable_purge_calls;
+extern uint64_t vm_purgeable_purge_batched_objects;
+SYSCTL_QUAD(_vm, OID_AUTO, purge_latency_max_ns, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_purgeable_purge_latency_max, "Longest purgeable object purge pass");
+SYSCTL_QUAD(_vm, OID_AUTO, purge_latency_total_ns, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_purgeable_purge_latency_total, "Time spent in purgeable object purge passes");
+SYSCTL_QUAD(_vm, OID_AUTO, purge_calls, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_purgeable_purge_calls, "Purgeable object purge passes");
+SYSCTL_QUAD(_vm, OID_AUTO, purge_batched_objects, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_purgeable_purge_batched_objects, "Small purgeable objects purged alongside another");
+#if DEVELOPMENT || DEBUG
+extern uint32_t vm_purgeable_batch_small_pages;
+SYSCTL_UINT(_vm, OID_AUTO, purge_batch_small_pages, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &vm_purgeable_batch_small_pages, 0, "Largest object, in pages, purged as part of a batch");
+#endif /* DEVELOPMENT || DEBUG */
+
+#if CONFIG_PHANTOM_CACHE
+/*
+ * vm.phantom_cache_refault_hist is uint64_t[VM_PHANTOM_CLASS_COUNT][VM_PHANTOM_DISTANCE_BUCKETS]:
+ * row = mount fsid % VM_PHANTOM_CLASS_COUNT, column = log2 of the refault distance in ghosts.
+ */
+SYSCTL_OPAQUE(_vm, OID_AUTO, phantom_cache_refault_hist, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_phantom_cache_refault_hist, sizeof(vm_phantom_cache_refault_hist), "Q",
+    "Phantom cache refault distance histogram per mount class");
+SYSCTL_UINT(_vm, OID_AUTO, phantom_cache_filecache_boost, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_phantom_cache_filecache_boost, 0, "Percent the file cache floor is raised for refaulting mounts");
+#if DEVELOPMENT || DEBUG
+extern uint32_t phantom_cache_class_thrashing_threshold;
+extern uint32_t phantom_cache_filecache_boost_step;
+extern uint32_t phantom_cache_filecache_boost_max;
+SYSCTL_UINT(_vm, OID_AUTO, phantom_cache_class_thrashing_threshold, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &phantom_cache_class_thrashing_threshold, 0, "");
+SYSCTL_UINT(_vm, OID_AUTO, phantom_cache_filecache_boost_step, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &phantom_cache_filecache_boost_step, 0, "");
+SYSCTL_UINT(_vm, OID_AUTO, phantom_cache_filecache_boost_max, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &phantom_cache_filecache_boost_max, 0, "");
+#endif /* DEVELOPMENT || DEBUG */
+#endif /* CONFIG_PHANTOM_CACHE */
+
 extern unsigned int vm_page_kern_lpage_count;
 SYSCTL_INT(_vm, OID_AUTO, kern_lpage_count, CTLFLAG_RD | CTLFLAG_LOCKED,
     &vm_page_kern_lpage_count, 0, "kernel used large pages");
@@ -3339,6 +3385,44 @@ SYSCTL_INT(_debug, OID_AUTO, vm_mixed_pagesize_supported, CTLFLAG_ANYBODY | CTLF
 
 SCALABLE_COUNTER_DECLARE(vm_page_grab_count);
 SYSCTL_SCALABLE_COUNTER(_vm, pages_grabbed, vm_page_grab_count, "Total pages grabbed");
+
+extern uint32_t vm_fault_decompress_ahead_max;
+SYSCTL_UINT(_vm, OID_AUTO, decompress_ahead_max, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &vm_fault_decompress_ahead_max, 0, "Max compressed pages decompressed ahead of a sequential fault");
+SCALABLE_COUNTER_DECLARE(vm_fault_decompress_ahead_triggers);
+SYSCTL_SCALABLE_COUNTER(_vm, decompress_ahead_triggers, vm_fault_decompress_ahead_triggers,
+    "Sequential compressor faults that attempted decompress-ahead");
+SCALABLE_COUNTER_DECLARE(vm_fault_decompress_ahead_hits);
+SYSCTL_SCALABLE_COUNTER(_vm, decompress_ahead_hits, vm_fault_decompress_ahead_hits,
+    "Pages decompressed ahead of a sequential fault");
+SCALABLE_COUNTER_DECLARE(vm_fault_decompress_ahead_misses);
+SYSCTL_SCALABLE_COUNTER(_vm, decompress_ahead_misses, vm_fault_decompress_ahead_misses,
+    "Decompress-ahead runs stopped before reaching the batch size");
+
+extern uint32_t vm_fault_around_pages;
+SYSCTL_UINT(_vm, OID_AUTO, fault_around_pages, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &vm_fault_around_pages, 0, "Resident pages mapped around a read fault on a file mapping");
+SCALABLE_COUNTER_DECLARE(vm_fault_around_attempts);
+SYSCTL_SCALABLE_COUNTER(_vm, fault_around_attempts, vm_fault_around_attempts,
+    "Read faults on file mappings that attempted fault-around");
+SCALABLE_COUNTER_DECLARE(vm_fault_around_mapped);
+SYSCTL_SCALABLE_COUNTER(_vm, fault_around_mapped, vm_fault_around_mapped,
+    "Pages mapped by fault-around");
+SCALABLE_COUNTER_DECLARE(vm_map_lookup_speculative_success);
+SYSCTL_SCALABLE_COUNTER(_vm, map_lookup_speculative_success, vm_map_lookup_speculative_success,
+    "Lockless map lookups whose result was validated");
+SCALABLE_COUNTER_DECLARE(vm_map_lookup_speculative_fail);
+SYSCTL_SCALABLE_COUNTER(_vm, map_lookup_speculative_fail, vm_map_lookup_speculative_fail,
+    "Lockless map lookups that raced with a writer and fell back to the map lock");
+extern uint32_t vm_pageout_scan_helper_count;
+SYSCTL_UINT(_vm, OID_AUTO, pageout_scan_helpers, CTLFLAG_RD | CTLFLAG_LOCKED,
+    &vm_pageout_scan_helper_count, 0, "Number of pageout scan helper threads");
+SCALABLE_COUNTER_DECLARE(vm_pageout_scan_helper_freed);
+SYSCTL_SCALABLE_COUNTER(_vm, pageout_scan_helper_freed, vm_pageout_scan_helper_freed,
+    "Clean pages freed by pageout scan helper threads");
+SCALABLE_COUNTER_DECLARE(vm_pageout_scan_helper_reactivated);
+SYSCTL_SCALABLE_COUNTER(_vm, pageout_scan_helper_reactivated, vm_pageout_scan_helper_reactivated,
+    "Pages reactivated by pageout scan helpers because they were touched");
 SYSCTL_ULONG(_vm, OID_AUTO, pages_freed, CTLFLAG_RD | CTLFLAG_LOCKED,
     &vm_pageout_vminfo.vm_page_pages_freed, "Total pages freed");
 
@@ -3403,6 +3487,9 @@ SYSCTL_QUAD(_vm, OID_AUTO, free_shared, CTLFLAG_RD | CTLFLAG_LOCKED,
 
 extern unsigned int vm_page_free_count, vm_page_speculative_count;
 SYSCTL_UINT(_vm, OID_AUTO, page_free_count, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_page_free_count, 0, "");
+extern unsigned int vm_page_free_cached_count;
+SYSCTL_UINT(_vm, OID_AUTO, page_free_cached_count, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_page_free_cached_count, 0,
+    "Free pages parked on per-CPU lists, not included in page_free_count");
 SYSCTL_UINT(_vm, OID_AUTO, page_speculative_count, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_page_speculative_count, 0, "");
 
 extern unsigned int vm_page_cleaned_count;
@@ -3416,6 +3503,7 @@ SYSCTL_UINT(_vm, OID_AUTO, page_pageable_external_count, CTLFLAG_RD | CTLFLAG_LO
 SYSCTL_UINT(_vm, OID_AUTO, pageout_inactive_clean, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_state.vm_pageout_inactive_clean, 0, "");
 SYSCTL_UINT(_vm, OID_AUTO, pageout_inactive_used, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_state.vm_pageout_inactive_used, 0, "");
 
+SYSCTL_ULONG(_vm, OID_AUTO, pageout_considered_page, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_vminfo.vm_pageout_considered_page, "Pages examined by pageout scan");
 SYSCTL_ULONG(_vm, OID_AUTO, pageout_inactive_dirty_internal, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_vminfo.vm_pageout_inactive_dirty_internal, "");
 SYSCTL_ULONG(_vm, OID_AUTO, pageout_inactive_dirty_external, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_vminfo.vm_pageout_inactive_dirty_external, "");
 SYSCTL_ULONG(_vm, OID_AUTO, pageout_speculative_clean, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_pageout_vminfo.vm_pageout_freed_speculative, "");
@@ -3770,6 +3858,15 @@ SYSCTL_QUAD(_vm, OID_AUTO, shared_region_pager_reclaimed,
 extern int shared_region_destroy_delay;
 SYSCTL_INT(_vm, OID_AUTO, shared_region_destroy_delay,
     CTLFLAG_RW | CTLFLAG_LOCKED, &shared_region_destroy_delay, 0, "");
+extern int shared_region_pager_cache_limit;
+SYSCTL_INT(_vm, OID_AUTO, shared_region_pager_cache_limit,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &shared_region_pager_cache_limit, 0, "");
+extern uint32_t shared_region_preslide_pages;
+extern uint64_t shared_region_preslid;
+SYSCTL_UINT(_vm, OID_AUTO, shared_region_preslide_pages,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &shared_region_preslide_pages, 0, "");
+SYSCTL_QUAD(_vm, OID_AUTO, shared_region_preslid,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &shared_region_preslid, "");
 
 #if MACH_ASSERT
 extern int pmap_ledgers_panic_leeway;
@@ -92,6 +92,15 @@ vnode_pager_isSSD(vnode_t vp)
 	return disk_conditioner_mount_is_ssd(vp->v_mount);
 }
 
+uint32_t
+vnode_pager_get_mount_id(vnode_t vp)
+{
+	if (vp->v_mount == NULL) {
+		return 0;
+	}
+	return (uint32_t)vp->v_mount->mnt_vfsstat.f_fsid.val[0];
+}
+
 #if CONFIG_IOSCHED
 void
 vnode_pager_issue_reprioritize_io(struct vnode *devvp, uint64_t blkno, uint32_t len, int priority)
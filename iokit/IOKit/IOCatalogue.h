@@ -68,6 +68,13 @@ private:
 	OSArray * arrayForPersonality(OSDictionary * dict);
 	void addPersonality(OSDictionary * dict);
 
+	OSPtr<OSDictionary> personalityIndex;
+	IOLock *                 indexLock;
+	OSDictionary * indexForClass(const OSSymbol * className, OSArray * array);
+	void flushPersonalityIndex(void);
+	void addIndexedDrivers(OSDictionary * props, const OSSymbol * className,
+	    OSArray * array, OSOrderedSet * set);
+
 public:
 /*!
  *   @function initialize
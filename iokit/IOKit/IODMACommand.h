@@ -44,7 +44,8 @@ enum{
 	kIODMAMapOptionNoCacheStore = 0x00000010, // Memory in descriptor
 	kIODMAMapOptionOnChip       = 0x00000020, // Indicates DMA is on South Bridge
 	kIODMAMapOptionIterateOnly  = 0x00000040, // DMACommand will be used as a cursor only
-	kIODMAMapOptionDextOwner    = 0x00000080  // Dext owned
+	kIODMAMapOptionDextOwner    = 0x00000080, // Dext owned
+	kIODMAMapOptionPersistent   = 0x00000100  // Mapping is kept across complete()
 };
 
 /**************************** class IODMACommand ***************************/
@@ -101,7 +102,8 @@ public:
 
 		kNoCacheStore = kIODMAMapOptionNoCacheStore, // Memory in descriptor
 		kOnChip       = kIODMAMapOptionOnChip,  // Indicates DMA is on South Bridge
-		kIterateOnly  = kIODMAMapOptionIterateOnly// DMACommand will be used as a cursor only
+		kIterateOnly  = kIODMAMapOptionIterateOnly,// DMACommand will be used as a cursor only
+		kPersistent   = kIODMAMapOptionPersistent // Mapping is kept across complete()
 	};
 
 	struct SegmentOptions {
@@ -348,6 +350,13 @@ public:
 
 	virtual IOReturn complete(bool invalidateCache = true, bool synchronize = true);
 
+/*! @function releasePersistentMapping
+ *   @abstract Releases the mapping kept by a kPersistent DMA command.
+ *   @discussion With the kPersistent mapping option, complete() leaves the mapper allocation and the computed segment list in place, and a following prepare() of the same range reuses them instead of walking and mapping the memory descriptor again.  Cache maintenance for kNonCoherent is still performed on every prepare() and complete().  The memory descriptor must stay prepared (wired) by the client until the mapping is released, by this method, by preparing a different range, by clearMemoryDescriptor() or by freeing the command.  Transfers that need double buffering are not kept.
+ *   @result kIOReturnBusy if the command is prepared, kIOReturnSuccess otherwise. */
+
+	IOReturn releasePersistentMapping();
+
 /*! @function synchronize
  *   @abstract Bring IOMemoryDescriptor and IODMACommand buffers into sync.
  *   @discussion This method should not be called unless a prepare was previously issued. If needed a caller may synchronize any IODMACommand buffers with the original IOMemoryDescriptor buffers.
@@ -457,6 +466,7 @@ private:
 		void         *segments,
 		UInt32        segmentIndex);
 	IOReturn walkAll(uint32_t op);
+	IOReturn unmapLocalAlloc(IOMemoryDescriptor * copyMD);
 
 public:
 
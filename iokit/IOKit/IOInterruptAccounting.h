@@ -146,6 +146,34 @@ enum {
 	kInterruptAccountingInvalidStatisticIndex /* Sentinel value for checking for a nonsensical index */
 };
 
+/*
+ * Latency histograms.  Each histogram is reported as its own IOHistogramReporter channel, using the
+ * channel ID IA_GET_HISTOGRAM_CHANNEL_ID(interruptIndex, histogramIndex); histogram channel IDs follow
+ * the statistic channel IDs for the same interrupt.  Values are in mach absolute time units, and the
+ * buckets are powers of 2: bucket N counts values in (2^N, 2^(N+1)], with the first bucket extending
+ * down to 0 and the last bucket extending to infinity.
+ *
+ * First Level Time: Time spent in the first level handler (the filter of an
+ *   IOFilterInterruptEventSource), per interrupt.
+ *
+ * Dispatch Latency: Time from the first level handler signalling the work loop to the second level
+ *   handler being invoked.  When interrupts coalesce, this is measured from the oldest pending one.
+ *
+ * Second Level System Time: Time spent in the second level handler, per invocation.
+ */
+#define IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS (3)
+#define IA_NUM_HISTOGRAM_BUCKETS (32)
+
+enum {
+	kInterruptAccountingFirstLevelTimeHistogramIndex = 0, /* Time spent in the top level handler */
+	kInterruptAccountingDispatchLatencyHistogramIndex, /* Delay from the top level handler to the workloop action */
+	kInterruptAccountingSecondLevelSystemTimeHistogramIndex, /* System time spent in the workloop action */
+	kInterruptAccountingInvalidHistogramIndex /* Sentinel value for checking for a nonsensical index */
+};
+
+#define IA_GET_HISTOGRAM_CHANNEL_ID(interruptIndex, histogramIndex) \
+    IA_GET_CHANNEL_ID(interruptIndex, (IA_NUM_INTERRUPT_ACCOUNTING_STATISTICS + histogramIndex))
+
 /*
  * IOReporting group name; exposed publicly for the purpose of getting channels by group
  * name; other strings (subgroup names, statistic names) are not exposed, as we may want
@@ -39,7 +39,10 @@
 #include <kern/queue.h>
 
 class OSObject;
+class IOService;
 class IOSimpleReporter;
+class IOHistogramReporter;
+class IOReportLegend;
 
 /*
  * A brief overview.  Interrupt accounting (as implemented in IOKit) pertains to infrastructure for
@@ -76,6 +79,11 @@ class IOSimpleReporter;
  */
 extern uint32_t gInterruptAccountingStatisticBitmask;
 
+/*
+ * As above, but for the latency histograms (set with the interrupt_histograms boot-arg).
+ */
+extern uint32_t gInterruptAccountingHistogramBitmask;
+
 /*
  * Check the bitmask by statistic index; useful for setting the initial value and conditionalizing code.
  */
@@ -91,6 +99,15 @@ extern uint32_t gInterruptAccountingStatisticBitmask;
 #define IA_ANY_STATISTICS_ENABLED \
     ((IA_GET_ENABLE_BIT(kInterruptAccountingInvalidStatisticIndex) - 1) & gInterruptAccountingStatisticBitmask)
 
+/*
+ * Same as the above, for the latency histograms.
+ */
+#define IA_GET_HISTOGRAM_ENABLED(histogramIndex) \
+    (IA_GET_ENABLE_BIT(histogramIndex) & gInterruptAccountingHistogramBitmask)
+
+#define IA_ANY_HISTOGRAMS_ENABLED \
+    ((IA_GET_ENABLE_BIT(kInterruptAccountingInvalidHistogramIndex) - 1) & gInterruptAccountingHistogramBitmask)
+
 /*
  * Actual string names for the statistics we gather.
  */
@@ -118,6 +135,16 @@ static const char * const kInterruptAccountingStatisticNameArray[IA_NUM_INTERRUP
 	[kInterruptAccountingIdleExitsIndex] = kInterruptAccountingChannelNameIdleExits,
 };
 
+#define kInterruptAccountingChannelNameFirstLevelTimeHistogram        ("First Level Interrupt Handler Time Histogram (MATUs)")
+#define kInterruptAccountingChannelNameDispatchLatencyHistogram       ("      Second Level Dispatch Latency Histogram (MATUs)")
+#define kInterruptAccountingChannelNameSecondLevelSystemTimeHistogram ("     Second Level System Time Histogram (MATUs)")
+
+static const char * const kInterruptAccountingHistogramNameArray[IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS] = {
+	[kInterruptAccountingFirstLevelTimeHistogramIndex] = kInterruptAccountingChannelNameFirstLevelTimeHistogram,
+	[kInterruptAccountingDispatchLatencyHistogramIndex] = kInterruptAccountingChannelNameDispatchLatencyHistogram,
+	[kInterruptAccountingSecondLevelSystemTimeHistogramIndex] = kInterruptAccountingChannelNameSecondLevelSystemTimeHistogram,
+};
+
 /*
  * For updating the statistics in the data structure.  We cannot guarantee all of our platforms will be
  * able to do a 64-bit store in a single transaction.  So, for new platforms, call out to the hardware
@@ -169,8 +196,51 @@ struct IOInterruptAccountingData {
 	 * it would cause a panic).
 	 */
 	volatile uint64_t interruptStatistics[IA_NUM_INTERRUPT_ACCOUNTING_STATISTICS] __attribute__((aligned(8)));
+
+	/*
+	 * Set by the first level handler when it signals an idle work loop; consumed by the second level
+	 * handler to measure dispatch latency.
+	 */
+	volatile uint64_t dispatchTimestamp __attribute__((aligned(8)));
+
+	/*
+	 * Hit counts and value sums for each histogram bucket, updated like the statistics above.  These are
+	 * deltas; the nub folds them into its IOInterruptAccountingHistograms when the owner goes away.
+	 */
+	volatile uint64_t histogramHits[IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS][IA_NUM_HISTOGRAM_BUCKETS] __attribute__((aligned(8)));
+	volatile uint64_t histogramSums[IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS][IA_NUM_HISTOGRAM_BUCKETS] __attribute__((aligned(8)));
+};
+
+/*
+ * Per-{nub, index} histogram state, owned by the nub alongside the IOSimpleReporter for the statistics.
+ * The base values hold whatever previous owners of the interrupt index accumulated.
+ */
+struct IOInterruptAccountingHistograms {
+	IOHistogramReporter * reporters[IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS];
+	uint64_t baseHits[IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS][IA_NUM_HISTOGRAM_BUCKETS];
+	uint64_t baseSums[IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS][IA_NUM_HISTOGRAM_BUCKETS];
 };
 
+/*
+ * Records value (in MATUs) in the given histogram of data.  Bucket N holds values in (2^N, 2^(N+1)],
+ * matching the log2 segment configuration of the reporters.
+ */
+static inline void
+interruptAccountingDataTallyHistogram(IOInterruptAccountingData * data, int histogramIndex, uint64_t value)
+{
+	unsigned int bucket = 0;
+
+	if (value > 2) {
+		bucket = 63 - __builtin_clzll(value - 1);
+		if (bucket >= IA_NUM_HISTOGRAM_BUCKETS) {
+			bucket = IA_NUM_HISTOGRAM_BUCKETS - 1;
+		}
+	}
+
+	IA_ADD_VALUE(&data->histogramHits[histogramIndex][bucket], 1);
+	IA_ADD_VALUE(&data->histogramSums[histogramIndex][bucket], value);
+}
+
 /*
  * Initializes global values/structures related to interrupt accounting.
  */
@@ -191,6 +261,24 @@ void interruptAccountingDataRemoveFromList(IOInterruptAccountingData * data);
  */
 void interruptAccountingDataUpdateChannels(IOInterruptAccountingData * data, IOSimpleReporter * reporter);
 
+/*
+ * Allocates the histogram reporters for interrupt index source of service, and adds their legends to
+ * legend under subgroupName.  Returns NULL if no histograms are enabled.
+ */
+IOInterruptAccountingHistograms * interruptAccountingHistogramsAlloc(IOService * service, int source,
+    IOReportLegend * legend, const char * subgroupName);
+void interruptAccountingHistogramsFree(IOInterruptAccountingHistograms * histograms);
+
+/*
+ * Updates the histogram reporters with the base values plus the deltas held in data (which may be NULL).
+ */
+void interruptAccountingDataUpdateHistograms(IOInterruptAccountingData * data, IOInterruptAccountingHistograms * histograms);
+
+/*
+ * Moves the deltas held in data into the base values; invoked when data is disassociated from the nub.
+ */
+void interruptAccountingDataRetireHistograms(IOInterruptAccountingData * data, IOInterruptAccountingHistograms * histograms);
+
 /*
  * Initializes the statistics in data using the statistics currently held by reporter.  Typically invoked
  * when data is first associated with reporter.  The nub that an interrupt is associated with will be
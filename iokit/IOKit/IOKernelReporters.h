@@ -1534,6 +1534,8 @@ private:
  *       Each IOHistogramReporter can report one histogram representing
  *       how a given value has changed over time.
  */
+struct IOHistogramCPUBucket;
+
 class IOHistogramReporter : public IOReporter
 {
 	OSDeclareDefaultStructors(IOHistogramReporter);
@@ -1618,6 +1620,25 @@ public:
  */
 	int tallyValue(int64_t value);
 
+/*! @function   IOHistogramReporter::enablePerCPUTally
+ *   @abstract   Make tallyValue() lock-free by counting into per-CPU buckets
+ *
+ *   @result     kIOReturnSuccess, or kIOReturnNoMemory
+ *
+ *   @discussion
+ *       Once enabled, tallyValue() updates a private copy of the buckets
+ *       for the current CPU with atomic operations and never takes the
+ *       reporter lock.  The copies are summed into the reported values
+ *       when updateReport() is called, so high-rate reporters (e.g.
+ *       per-I/O latency) can stay enabled without contending.  Values
+ *       tallied before the call are preserved.  Per-CPU tallying cannot
+ *       be disabled, and overrideBucketValues() returns
+ *       kIOReturnUnsupported once it is enabled.
+ *
+ *   Locking: same-instance concurrency SAFE, MAY BLOCK
+ */
+	IOReturn enablePerCPUTally(void);
+
 /*! @function   IOHistogramReporter::createLegend
  *   @abstract   Creates a legend entry for an IOStateReporter
  *
@@ -1685,13 +1706,33 @@ protected:
  */
 	OSPtr<IOReportLegendEntry> handleCreateLegend(void) APPLE_KEXT_OVERRIDE;
 
+/*! @function   IOHistogramReporter::updateChannelValues
+ *   @abstract   Fold the per-CPU buckets into the reported values
+ *
+ *   @param  channel_index - internal index of the channel
+ *   @result     appropriate IOReturn code
+ *
+ *   @discussion
+ *       Does nothing unless enablePerCPUTally() has been called.
+ *
+ *   Locking: Caller must ensure that the reporter (data) lock is held.
+ */
+	virtual IOReturn updateChannelValues(int channel_index) APPLE_KEXT_OVERRIDE;
+
 
 private:
 
+	int tallyCPUValue(IOHistogramCPUBucket *cpuBuckets,
+	    int element_index,
+	    int64_t value);
+
 	int                         _segmentCount;
 	int64_t                    *_bucketBounds;
 	int                         _bucketCount;
 	IOHistogramSegmentConfig   *_histogramSegmentsConfig;
+	IOHistogramCPUBucket       *_cpuBuckets;
+	unsigned int                _cpuCount;
+	int                         _cpuStride;
 };
 
 
@@ -41,7 +41,7 @@ typedef struct _IODataQueueEntry IODataQueueEntry;
 /*!
  * @class IOSharedDataQueue : public IODataQueue
  * @abstract A generic queue designed to pass data both from the kernel to a user process and from a user process to the kernel.
- * @discussion The IOSharedDataQueue class is designed to also allow a user process to queue data to kernel code.  IOSharedDataQueue objects are designed to be used in a single producer / single consumer situation.  As such, there are no locks on the data itself.  Because the kernel enqueue and user-space dequeue methods follow a strict set of guidelines, no locks are necessary to maintain the integrity of the data struct.
+ * @discussion The IOSharedDataQueue class is designed to also allow a user process to queue data to kernel code.  IOSharedDataQueue objects are designed to be used in a single producer / single consumer situation, unless enableMultiProducer() has been called.  As such, there are no locks on the data itself.  Because the kernel enqueue and user-space dequeue methods follow a strict set of guidelines, no locks are necessary to maintain the integrity of the data struct.
  *
  * <br>Each data entry can be variable sized, but the entire size of the queue data region (including overhead for each entry) must be specified up front.
  *
@@ -55,11 +55,22 @@ class IOSharedDataQueue : public IODataQueue
 
 	struct ExpansionData {
 		UInt32 queueSize;
+		bool   multiProducer;
+		UInt32 reserveTail;
+		UInt32 publishTail;
+		UInt32 notifyThreshold;
+		UInt32 notifyPending;
+		UInt64 notifyTimeout;
+		struct thread_call * notifyCall;
 	};
 /*! @var reserved
  *   Reserved for future use.  (Internal use only)  */
 	ExpansionData * _reserved;
 
+	Boolean enqueueMultiProducer(void *data, UInt32 dataSize);
+	void dataEnqueued(bool wasEmpty);
+	static void notifyCallout(void *param0, void *param1);
+
 protected:
 	virtual void free() APPLE_KEXT_OVERRIDE;
 
@@ -145,6 +156,24 @@ public:
  */
 	virtual Boolean enqueue(void *data, UInt32 dataSize) APPLE_KEXT_OVERRIDE;
 
+/*!
+ * @function enableMultiProducer
+ * @abstract Allows enqueue() to be called concurrently from several contexts.
+ * @discussion Once enabled, producers reserve their slot in the queue with an atomic operation and publish it in reservation order, so enqueue() may be called from any number of threads and interrupt contexts without external serialization.  The consumer side and the shared memory layout are unchanged.  Must be called before the first entry is enqueued.
+ * @result Returns true on success, false if the queue already holds entries.
+ */
+	Boolean enableMultiProducer();
+
+/*!
+ * @function setNotificationCoalescing
+ * @abstract Batches data available notifications.
+ * @discussion By default a notification is sent every time an entry is added to an empty queue.  With coalescing, the notification for a queue that became non-empty is held until entryThreshold entries have been added, or until timeoutNS nanoseconds have elapsed, whichever happens first.  A timeout also moves the notification out of the enqueueing context, which allows enqueue() to be called from a primary interrupt handler.
+ * @param entryThreshold Number of entries that trigger the notification, 0 or 1 for no count based batching.
+ * @param timeoutNS Maximum delay of a pending notification, 0 for none.
+ * @result Returns true on success, false if resources could not be allocated.
+ */
+	Boolean setNotificationCoalescing(UInt32 entryThreshold, UInt64 timeoutNS);
+
 #ifdef PRIVATE
 /* workaround for queue.h redefine, please do not use */
 	__inline__ Boolean
@@ -34,7 +34,7 @@
 #define IOSTATISTICS_SIG_WORKLOOP   'IOSW'
 
 /* Update when the binary format changes */
-#define IOSTATISTICS_VER                        0x2
+#define IOSTATISTICS_VER                        0x3
 
 enum {
 	kIOStatisticsDriverNameLength  = 64,
@@ -134,6 +134,8 @@ typedef struct IOStatisticsGlobal {
 	uint32_t kextCount;
 	uint32_t classCount;
 	uint32_t workloops;
+	uint32_t prepareCalls; /* IOGeneralMemoryDescriptor::prepare() calls on virtual memory */
+	uint64_t prepareTime;  /* Total time spent in those calls, in absolute time units */
 } IOStatisticsGlobal;
 
 typedef struct IOStatisticsKext {
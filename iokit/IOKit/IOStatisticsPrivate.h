@@ -195,6 +195,9 @@ class IOStatistics {
 
 	static uint32_t attachedEventSources;
 
+	static uint32_t prepareCalls;
+	static uint64_t prepareTime;
+
 	static KextNode *kextHint;
 
 	static IOWorkLoopDependency *nextWorkLoopDependency;
@@ -367,6 +370,16 @@ public:
 /* IOLib allocations */
 	static void countAlloc(uint32_t index, vm_size_t size);
 
+/* IOMemoryDescriptor wiring */
+	static inline void
+	countPrepare(uint64_t elapsed)
+	{
+		if (enabled) {
+			OSIncrementAtomic(&prepareCalls);
+			OSAddAtomic64(elapsed, &prepareTime);
+		}
+	}
+
 /* UserClient */
 	static void countUserClientCall(IOUserClient *client);
 };
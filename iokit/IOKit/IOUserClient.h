@@ -198,6 +198,7 @@ struct io_filter_callbacks {
 };
 struct IOUCFilterPolicy;
 #endif /* PRIVATE */
+struct IOUCPreparedMemory;
 
 /*!
  *   @class IOUserClient
@@ -229,6 +230,8 @@ protected:
 #else
 		void *iokitFilterReserved;
 #endif
+		IOLock * preparedLock;
+		IOUCPreparedMemory * preparedMemory;
 	};
 
 /*! @var reserved
@@ -435,6 +438,22 @@ public:
  */
 	OSPtr<IOMemoryMap>  removeMappingForDescriptor(IOMemoryDescriptor * memory);
 
+/*!
+ *   @function copyPreparedClientMemory
+ *   Return a prepared memory descriptor for a buffer in the calling task, reusing the descriptor from an earlier call with the same address, length and options. Intended for user clients that are handed the same buffers repeatedly, so they are wired once instead of on every request. A small number of buffers are cached per user client; the least recently used one is completed and released when the cache is full.
+ *   @param address The virtual address of the buffer in the calling task.
+ *   @param length The length of the buffer.
+ *   @param options The direction and other options passed to IOMemoryDescriptor::withAddressRange().
+ *   @result A prepared memory descriptor which the caller should release, but not complete, or zero on failure. The buffer remains wired until flushPreparedClientMemory() is called or the user client is freed, so the client task must not deallocate or remap it in the meantime.
+ */
+	OSPtr<IOMemoryDescriptor> copyPreparedClientMemory(mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options);
+
+/*!
+ *   @function flushPreparedClientMemory
+ *   Complete and release every memory descriptor cached by copyPreparedClientMemory(). Typically called from clientClose() or when the client unregisters its buffers.
+ */
+	void flushPreparedClientMemory(void);
+
 /*!
  *   @function exportObjectToClient
  *   Make an arbitrary OSObject available to the client task.
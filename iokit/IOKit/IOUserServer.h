@@ -48,6 +48,52 @@ enum{
 	kIOUserServerMethodRegisterClass = 0x0001000,
 	kIOUserServerMethodStart         = 0x0001001,
 	kIOUserServerMethodRegister      = 0x0001002,
+	kIOUserServerMethodRingConfigure = 0x0001003,
+};
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+ * Shared memory command ring between the kernel and a dext. The dext registers
+ * the msgids of its hot methods with kIOUserServerMethodRingConfigure and maps
+ * the ring with kIOUserServerRingMemoryType. Kernel calls to those methods are
+ * written to a slot and the slot index is appended to commands[]; object
+ * references travel in IORPCMessage.objects as send right names in the dext.
+ * The dext reports a completion, and waits for commandHead to move past the
+ * commands it has consumed, with the ring wait trap (trap index 1). Replies
+ * must not carry object references. Anything that does not fit uses Mach IPC.
+ */
+
+enum{
+	kIOUserServerRingMemoryType = 0x52494e47,       // 'RING'
+};
+
+#define kIOUserServerRingVersion     1
+#define kIOUserServerRingSlotCount   64
+#define kIOUserServerRingSlotSize    1024
+#define kIOUserServerRingMaxMethods  32
+
+enum{
+	kIOUserServerRingSlotFree      = 0,
+	kIOUserServerRingSlotSubmitted = 1,
+	kIOUserServerRingSlotCompleted = 2,
+};
+
+struct IOUserServerRingSlot {
+	uint32_t state;
+	uint32_t generation;
+	uint32_t size;
+	uint32_t __pad;
+	uint64_t data[(kIOUserServerRingSlotSize - 4 * sizeof(uint32_t)) / sizeof(uint64_t)];
+};
+
+struct IOUserServerRingHeader {
+	uint32_t             version;
+	uint32_t             slotCount;
+	uint32_t             commandHead;
+	uint32_t             __pad;
+	uint32_t             commands[kIOUserServerRingSlotCount];
+	IOUserServerRingSlot slots[kIOUserServerRingSlotCount];
 };
 
 
@@ -173,6 +219,7 @@ class IOUserServer : public IOUserClient2022
 	bool                  fPlatformDriver;
 	OSString            * fTeamIdentifier;
 	unsigned int          fCSValidationCategory;
+	struct IOUserServerRing * fRing;
 public:
 	kern_allocation_name_t fAllocationName;
 	task_t                 fOwningTask;
@@ -197,6 +244,8 @@ public:
 	virtual IOReturn       externalMethod(uint32_t selector, IOExternalMethodArgumentsOpaque * args) APPLE_KEXT_OVERRIDE;
 	static IOReturn        externalMethodStart(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
 	static IOReturn        externalMethodRegisterClass(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
+	static IOReturn        externalMethodRingConfigure(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
+	virtual IOReturn       clientMemoryForType(UInt32 type, IOOptionBits * options, IOMemoryDescriptor ** memory) APPLE_KEXT_OVERRIDE;
 
 	virtual IOExternalTrap * getTargetAndTrapForIndex(IOService ** targetP, UInt32 index) APPLE_KEXT_OVERRIDE;
 
@@ -262,6 +311,9 @@ public:
 	IOReturn               rpc(IORPC rpc);
 	IOReturn               server(ipc_kmsg_t requestkmsg, ipc_kmsg_t * preply);
 	kern_return_t          waitInterruptTrap(void * p1, void * p2, void * p3, void * p4, void * p5, void * p6);
+	kern_return_t          ringWaitTrap(void * p1, void * p2, void * p3, void * p4, void * p5, void * p6);
+	bool                   ringRPC(IORPCMessageMach * mach, IORPCMessage * message, uint32_t sendSize, uint32_t replySize, IOReturn * result);
+	void                   ringCancel(void);
 	static bool            shouldLeakObjects();
 	static void            beginLeakingObjects();
 	bool                   isPlatformDriver();
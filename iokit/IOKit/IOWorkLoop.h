@@ -104,6 +104,11 @@ private:
  */
 	static void releaseEventChain(LIBKERN_CONSUMED IOEventSource *eventChain);
 
+/*! @function releaseGroups
+ *   @abstract Releases the work loops of groups 1 and up created by workLoopWithGroups().
+ */
+	void releaseGroups();
+
 protected:
 
 /*! @typedef maintCommandEnum
@@ -162,6 +167,8 @@ protected:
 #endif
 		uint64_t lockInterval;
 		uint64_t lockTime;
+		IOWorkLoop **groups;
+		uint32_t groupCount;
 	};
 
 /*! @var reserved
@@ -342,6 +349,47 @@ public:
  */
 	void setMaximumLockTime(uint64_t interval, uint32_t options);
 
+/*! @function workLoopWithGroups
+ *   @abstract Factory member function to construct a work loop with several event source groups.
+ *   @discussion Each group is a serialization domain with its own gate and work thread, so event sources added to different groups run concurrently on separate threads while sources within one group remain single threaded against each other.  Group 0 is the returned work loop itself; the other groups are work loops owned by it and are released along with it.  An IOCommandGate added to a group single threads its actions against that group only.
+ *   @param groupCount Number of groups, at least 1.  A count of 1 is equivalent to workLoopWithOptions().
+ *   @param options Options applied to every group, see workLoopWithOptions().
+ *   @result Returns a workLoop instance if constructed successfully, 0 otherwise.
+ */
+	static OSPtr<IOWorkLoop> workLoopWithGroups(uint32_t groupCount, IOOptionBits options = 0);
+
+/*! @function getGroupCount
+ *   @abstract Returns the number of event source groups, 1 for a work loop that was not created with workLoopWithGroups().
+ */
+	uint32_t getGroupCount() const;
+
+/*! @function getGroup
+ *   @abstract Returns the work loop that serializes a given event source group.
+ *   @discussion The result is not retained; it is valid for as long as this work loop is.  Use it to create and run command gates or actions in the group's serialization domain.
+ *   @param group Group index, 0 being this work loop.
+ *   @result The group's work loop, or 0 if group is out of range.
+ */
+	IOWorkLoop * getGroup(uint32_t group) const;
+
+/*! @function addEventSourceToGroup
+ *   @discussion Add an event source to be monitored by one group of the work loop.  See addEventSource().
+ *   @param newEvent Pointer to IOEventSource subclass to add.
+ *   @param group Group index, 0 being this work loop.
+ *   @result kIOReturnBadArgument if group is out of range, otherwise the result of addEventSource() on the group.
+ */
+	IOReturn addEventSourceToGroup(IOEventSource *newEvent, uint32_t group);
+
+/*! @function closeAllGates
+ *   @abstract Closes the gate of every group, in group order.
+ *   @discussion Use to single thread against all event sources of a grouped work loop, for instance while reconfiguring the hardware.  Must be balanced with openAllGates().
+ */
+	void closeAllGates();
+
+/*! @function openAllGates
+ *   @abstract Opens the gates closed by closeAllGates(), in reverse group order.
+ */
+	void openAllGates();
+
 protected:
 // Internal APIs used by event sources to control the thread
 	virtual int sleepGate(void *event, AbsoluteTime deadline, UInt32 interuptibleType);
@@ -115,6 +115,8 @@ IOCatalogue::initialize(void)
 	gIOModuleIdentifierKey       = OSSymbol::withCStringNoCopy( kCFBundleIdentifierKey );
 	gIOModuleIdentifierKernelKey = OSSymbol::withCStringNoCopy( kCFBundleIdentifierKernelKey );
 	gIOHIDInterfaceClassName     = OSSymbol::withCStringNoCopy( "IOHIDInterface" );
+	gIOCatalogueUnindexedKey     = OSSymbol::withCStringNoCopy( "Unindexed" );
+	gIOCatalogueByPropertyKey    = OSSymbol::withCStringNoCopy( "ByProperty" );
 
 
 	assert( array && gIOClassKey && gIOProbeScoreKey
@@ -161,6 +163,195 @@ IOCatalogue::addPersonality(OSDictionary * dict)
 	}
 }
 
+/*********************************************************************
+* Secondary index over the personalities of one provider class.
+*
+* Personalities whose IOPropertyMatch is a single dictionary are filed
+* under one of its keys and that key's value, so findDrivers() only
+* needs to look at the ones whose value equals the nub's property.
+* Everything else stays in an unindexed list that is always returned.
+* The index is only a prefilter, passiveMatch() still evaluates every
+* candidate in full.
+*********************************************************************/
+#define kIOCatalogueIndexThreshold      8
+
+static OSSharedPtr<const OSSymbol> gIOCatalogueUnindexedKey;
+static OSSharedPtr<const OSSymbol> gIOCatalogueByPropertyKey;
+
+static OSSharedPtr<const OSSymbol>
+copyIndexValueSymbol(OSObject * value, bool create)
+{
+	OSString * str;
+	OSNumber * num;
+	char       buf[24];
+
+	if ((str = OSDynamicCast(OSString, value))) {
+		return create ? OSSymbol::withString(str) : OSSymbol::existingSymbolForString(str);
+	}
+	if ((num = OSDynamicCast(OSNumber, value))) {
+		snprintf(buf, sizeof(buf), "#%llu", num->unsigned64BitValue());
+		return create ? OSSymbol::withCString(buf) : OSSymbol::existingSymbolForCString(buf);
+	}
+	return nullptr;
+}
+
+static bool
+indexPersonality(OSDictionary * byProperty, OSDictionary * dict)
+{
+	OSDictionary * matchProps;
+	__block bool   indexed = false;
+
+	if (dict->getObject(gIOCompatibilityMatchKey)) {
+		return false;
+	}
+	matchProps = OSDynamicCast(OSDictionary, dict->getObject(gIOPropertyMatchKey));
+	if (!matchProps) {
+		return false;
+	}
+
+	matchProps->iterateObjects(^bool (const OSSymbol * key, OSObject * value) {
+		OSSharedPtr<const OSSymbol> valueSym;
+		OSSharedPtr<OSDictionary>   newValues;
+		OSSharedPtr<OSArray>        newArray;
+		OSDictionary              * values;
+		OSArray                   * array;
+
+		valueSym = copyIndexValueSymbol(value, true);
+		if (!valueSym) {
+		        return false;
+		}
+		values = (OSDictionary *) byProperty->getObject(key);
+		if (!values) {
+		        newValues = OSDictionary::withCapacity(4);
+		        if (!newValues || !byProperty->setObject(key, newValues.get())) {
+		                return true;
+			}
+		        values = newValues.get();
+		}
+		array = (OSArray *) values->getObject(valueSym.get());
+		if (!array) {
+		        newArray = OSArray::withCapacity(1);
+		        if (!newArray || !values->setObject(valueSym.get(), newArray.get())) {
+		                return true;
+			}
+		        array = newArray.get();
+		}
+		indexed = array->setObject(dict);
+		return true;
+	});
+
+	return indexed;
+}
+
+OSDictionary *
+IOCatalogue::indexForClass(const OSSymbol * className, OSArray * array)
+{
+	OSSharedPtr<OSDictionary> classIndex;
+	OSSharedPtr<OSDictionary> byProperty;
+	OSSharedPtr<OSArray>      unindexed;
+	OSDictionary            * dict;
+	OSDictionary            * result;
+	unsigned int              idx;
+
+	IOLockLock(indexLock);
+
+	result = (OSDictionary *) personalityIndex->getObject(className);
+	if (result) {
+		IOLockUnlock(indexLock);
+		return result;
+	}
+
+	classIndex = OSDictionary::withCapacity(2);
+	byProperty = OSDictionary::withCapacity(4);
+	unindexed  = OSArray::withCapacity(array->getCount());
+	if (classIndex && byProperty && unindexed) {
+		for (idx = 0; (dict = (OSDictionary *) array->getObject(idx)); idx++) {
+			if (!indexPersonality(byProperty.get(), dict)) {
+				unindexed->setObject(dict);
+			}
+		}
+		classIndex->setObject(gIOCatalogueUnindexedKey.get(), unindexed.get());
+		classIndex->setObject(gIOCatalogueByPropertyKey.get(), byProperty.get());
+		if (personalityIndex->setObject(className, classIndex.get())) {
+			result = classIndex.get();
+		}
+	}
+
+	IOLockUnlock(indexLock);
+
+	return result;
+}
+
+/*********************************************************************
+* Called with the catalogue lock held for writing, before any
+* personality array is changed.  Readers rebuild on demand.
+*********************************************************************/
+void
+IOCatalogue::flushPersonalityIndex(void)
+{
+	personalityIndex->flushCollection();
+}
+
+void
+IOCatalogue::addIndexedDrivers(OSDictionary * props, const OSSymbol * className,
+    OSArray * array, OSOrderedSet * set)
+{
+	OSDictionary * classIndex;
+	OSDictionary * byProperty;
+	OSArray      * unindexed;
+	OSDictionary * nextTable;
+	unsigned int   idx;
+
+	classIndex = props ? indexForClass(className, array) : NULL;
+	if (!classIndex) {
+		for (idx = 0; (nextTable = (OSDictionary *) array->getObject(idx)); idx++) {
+			set->setObject(nextTable);
+		}
+		return;
+	}
+
+	unindexed  = (OSArray *) classIndex->getObject(gIOCatalogueUnindexedKey.get());
+	byProperty = (OSDictionary *) classIndex->getObject(gIOCatalogueByPropertyKey.get());
+
+	for (idx = 0; (nextTable = (OSDictionary *) unindexed->getObject(idx)); idx++) {
+		set->setObject(nextTable);
+	}
+
+	byProperty->iterateObjects(^bool (const OSSymbol * key, OSObject * obj) {
+		OSDictionary * values = (OSDictionary *) obj;
+		OSObject     * prop;
+		OSArray      * candidates;
+		OSDictionary * table;
+		unsigned int   tableIdx;
+
+		prop = props->getObject(key);
+		if (!prop) {
+		        // IOPropertyMatch requires the property to be present
+		        return false;
+		}
+		if (OSDynamicCast(OSString, prop) || OSDynamicCast(OSNumber, prop)) {
+		        OSSharedPtr<const OSSymbol> valueSym = copyIndexValueSymbol(prop, false);
+
+		        candidates = valueSym ? (OSArray *) values->getObject(valueSym.get()) : NULL;
+		        for (tableIdx = 0; candidates && (table = (OSDictionary *) candidates->getObject(tableIdx)); tableIdx++) {
+		                set->setObject(table);
+			}
+		} else {
+		        // other types (OSData) may compare equal across types, take them all
+		        OSSharedPtr<OSCollectionIterator> valueIter = OSCollectionIterator::withCollection(values);
+		        const OSSymbol * valueKey;
+
+		        while (valueIter && (valueKey = (const OSSymbol *) valueIter->getNextObject())) {
+		                candidates = (OSArray *) values->getObject(valueKey);
+		                for (tableIdx = 0; (table = (OSDictionary *) candidates->getObject(tableIdx)); tableIdx++) {
+		                        set->setObject(table);
+				}
+			}
+		}
+		return false;
+	});
+}
+
 /*********************************************************************
 * Initialize the IOCatalog object.
 *********************************************************************/
@@ -178,6 +369,11 @@ IOCatalogue::init(OSArray * initArray)
 
 	personalities = OSDictionary::withCapacity(32);
 	personalities->setOptions(OSCollection::kSort, OSCollection::kSort);
+	personalityIndex = OSDictionary::withCapacity(32);
+	if (!personalities || !personalityIndex) {
+		return false;
+	}
+	indexLock = IOLockAlloc();
 	for (unsigned int idx = 0; (obj = initArray->getObject(idx)); idx++) {
 		dict = OSDynamicCast(OSDictionary, obj);
 		if (!dict) {
@@ -218,6 +414,7 @@ IOCatalogue::findDrivers(
 {
 	OSDictionary         * nextTable;
 	OSSharedPtr<OSOrderedSet> set;
+	OSSharedPtr<OSDictionary> props;
 	OSArray              * array;
 	const OSMetaClass    * meta;
 	unsigned int           idx;
@@ -228,12 +425,17 @@ IOCatalogue::findDrivers(
 		return NULL;
 	}
 
+	// snapshot the nub's properties outside the catalogue lock for the index
+	props = OSSharedPtr<OSDictionary>(service->dictionaryWithProperties(), OSNoRetain);
+
 	IORWLockRead(lock);
 
 	meta = service->getMetaClass();
 	while (meta) {
 		array = (OSArray *) personalities->getObject(meta->getClassNameSymbol());
-		if (array) {
+		if (array && (array->getCount() >= kIOCatalogueIndexThreshold)) {
+			addIndexedDrivers(props.get(), meta->getClassNameSymbol(), array, set.get());
+		} else if (array) {
 			for (idx = 0; (nextTable = (OSDictionary *) array->getObject(idx)); idx++) {
 				set->setObject(nextTable);
 			}
@@ -319,6 +521,7 @@ IOCatalogue::exchangeDrivers(
 	}
 
 	IORWLockWrite(lock);
+	flushPersonalityIndex();
 
 	iter_all_personalities = OSCollectionIterator::withCollection(personalities.get());
 	if (!iter_all_personalities) {
@@ -439,6 +642,7 @@ IOCatalogue::addDrivers(
 	result = true;
 
 	IORWLockWrite(lock);
+	flushPersonalityIndex();
 	while ((object = iter->getNextObject())) {
 		// xxx Deleted OSBundleModuleDemand check; will handle in other ways for SL
 
@@ -523,6 +727,7 @@ IOCatalogue::removeDrivers(bool doNubMatching, bool (^shouldRemove)(OSDictionary
 	}
 
 	IORWLockWrite(lock);
+	flushPersonalityIndex();
 	while ((key = (const OSSymbol *) iter->getNextObject())) {
 		array = (OSArray *) personalities->getObject(key);
 		if (array) {
@@ -846,6 +1051,7 @@ IOCatalogue::terminateDrivers(OSDictionary * matching)
 	}
 	ret = terminateDrivers(matching, NULL, false);
 	IORWLockWrite(lock);
+	flushPersonalityIndex();
 	if (kIOReturnSuccess == ret) {
 		ret = _removeDrivers(matching);
 	}
@@ -999,6 +1205,8 @@ IOCatalogue::terminateDriversForModule(
 		/* No goto between IOLock calls!
 		 */
 		IORWLockWrite(lock);
+		flushPersonalityIndex();
+	flushPersonalityIndex();
 		if (kIOReturnSuccess == ret) {
 			ret = _removeDrivers(dict.get());
 		}
@@ -1249,6 +1457,7 @@ IOCatalogue::resetAndAddDrivers(OSArray * drivers, bool doNubMatching)
 	/* No goto finish from here to unlock.
 	 */
 	IORWLockWrite(lock);
+	flushPersonalityIndex();
 
 	while ((key = (const OSSymbol *) iter->getNextObject())) {
 		array = (OSArray *) personalities->getObject(key);
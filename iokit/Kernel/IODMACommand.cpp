@@ -256,6 +256,10 @@ IODMACommand::setSpecification(SegmentFunction        outSegFunc,
 		return kIOReturnBadArgument;
 	}
 
+	if (fInternalState->fPersistentValid) {
+		releasePersistentMapping();
+	}
+
 	is32Bit = ((OutputHost32 == outSegFunc)
 	    || (OutputBig32 == outSegFunc)
 	    || (OutputLittle32 == outSegFunc));
@@ -336,6 +340,7 @@ IODMACommand::setSpecification(SegmentFunction        outSegFunc,
 
 	fInternalState->fIterateOnly = (0 != (kIterateOnly & mappingOptions));
 	fInternalState->fDextOwned   = (0 != (kIODMAMapOptionDextOwner & mappingOptions));
+	fInternalState->fPersistent  = (0 != (kIODMAMapOptionPersistent & mappingOptions));
 	fInternalState->fDevice = device;
 
 	return kIOReturnSuccess;
@@ -348,6 +353,9 @@ IODMACommand::free()
 		if (fActive && fInternalState->fDextOwned) {
 			CompleteDMA(kIODMACommandCompleteDMANoOptions);
 		}
+		if (!fActive && fMemory) {
+			releasePersistentMapping();
+		}
 		IOFreeType(reserved, IODMACommandInternal);
 	}
 
@@ -453,6 +461,7 @@ IODMACommand::clearMemoryDescriptor(bool autoComplete)
 		while (fActive) {
 			complete();
 		}
+		releasePersistentMapping();
 		if (fInternalState->fSetActiveNoMapper) {
 			fMemory->dmaCommandOperation(kIOMDSetDMAInactive, this, 0);
 		}
@@ -848,7 +857,19 @@ IODMACommand::prepare(UInt64 offset, UInt64 length, bool flushCache, bool synchr
 		    || (state->fPreparedLength != length)) {
 			ret = kIOReturnNotReady;
 		}
+	} else if (state->fPersistentValid
+	    && (state->fPreparedOffset == offset)
+	    && (state->fPreparedLength == length)) {
+		// The mapping and segment list are still in place from the last cycle
+		if (IS_NONCOHERENT(mappingOptions) && flushCache) {
+			fMemory->performOperation(kIOMemoryIncoherentIOStore, offset, length);
+		}
+		state->fPrepared = true;
 	} else {
+		if (state->fPersistentValid) {
+			unmapLocalAlloc(NULL);
+		}
+
 		if (fAlignMaskLength & length) {
 			return kIOReturnNotAligned;
 		}
@@ -1076,29 +1097,11 @@ IODMACommand::complete(bool invalidateCache, bool synchronize)
 		}
 
 		if (state->fLocalMapperAllocValid) {
-			IOMDDMAMapArgs mapArgs;
-			bzero(&mapArgs, sizeof(mapArgs));
-			mapArgs.fMapper = fMapper.get();
-			mapArgs.fCommand = this;
-			mapArgs.fAlloc = state->fLocalMapperAlloc;
-			mapArgs.fAllocLength = state->fLocalMapperAllocLength;
-			OSSharedPtr<IOMemoryDescriptor> md = copyMD;
-			if (md) {
-				mapArgs.fOffset = 0;
+			if (state->fPersistent && state->fCursor && !copyMD) {
+				// Keep the mapping for the next prepare() of this range
+				state->fPersistentValid = true;
 			} else {
-				md = fMemory;
-				mapArgs.fOffset = state->fPreparedOffset;
-			}
-
-			ret = md->dmaCommandOperation(kIOMDDMAUnmap, &mapArgs, sizeof(mapArgs));
-
-			state->fLocalMapperAlloc       = 0;
-			state->fLocalMapperAllocValid  = false;
-			state->fLocalMapperAllocLength = 0;
-			if (state->fMapSegments) {
-				IODeleteData(state->fMapSegments, IODMACommandMapSegment, state->fMapSegmentsCount);
-				state->fMapSegments      = NULL;
-				state->fMapSegmentsCount = 0;
+				ret = unmapLocalAlloc(copyMD.get());
 			}
 		}
 
@@ -1108,6 +1111,56 @@ IODMACommand::complete(bool invalidateCache, bool synchronize)
 	return ret;
 }
 
+IOReturn
+IODMACommand::unmapLocalAlloc(IOMemoryDescriptor * copyMD)
+{
+	IODMACommandInternal * state = fInternalState;
+	IOReturn               ret;
+
+	IOMDDMAMapArgs mapArgs;
+	bzero(&mapArgs, sizeof(mapArgs));
+	mapArgs.fMapper = fMapper.get();
+	mapArgs.fCommand = this;
+	mapArgs.fAlloc = state->fLocalMapperAlloc;
+	mapArgs.fAllocLength = state->fLocalMapperAllocLength;
+	IOMemoryDescriptor * md = copyMD;
+	if (md) {
+		mapArgs.fOffset = 0;
+	} else {
+		md = fMemory.get();
+		mapArgs.fOffset = state->fPreparedOffset;
+	}
+
+	ret = md->dmaCommandOperation(kIOMDDMAUnmap, &mapArgs, sizeof(mapArgs));
+
+	state->fLocalMapperAlloc       = 0;
+	state->fLocalMapperAllocValid  = false;
+	state->fLocalMapperAllocLength = 0;
+	state->fPersistentValid        = false;
+	if (state->fMapSegments) {
+		IODeleteData(state->fMapSegments, IODMACommandMapSegment, state->fMapSegmentsCount);
+		state->fMapSegments      = NULL;
+		state->fMapSegmentsCount = 0;
+	}
+
+	return ret;
+}
+
+IOReturn
+IODMACommand::releasePersistentMapping()
+{
+	IODMACommandInternal * state = fInternalState;
+
+	if (fActive) {
+		return kIOReturnBusy;
+	}
+	if (!state->fPersistentValid) {
+		return kIOReturnSuccess;
+	}
+
+	return unmapLocalAlloc(NULL);
+}
+
 IOReturn
 IODMACommand::getPreparedOffsetAndLength(UInt64 * offset, UInt64 * length)
 {
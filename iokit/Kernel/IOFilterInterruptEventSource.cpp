@@ -179,6 +179,12 @@ IOFilterInterruptEventSource::signalInterrupt()
 		IOTimeStampStartConstant(IODBG_INTES(IOINTES_SEMA), VM_KERNEL_ADDRHIDE(this), VM_KERNEL_ADDRHIDE(owner));
 	}
 
+	if (IOInterruptEventSource::reserved->statistics
+	    && IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingDispatchLatencyHistogramIndex)
+	    && !IOInterruptEventSource::reserved->statistics->dispatchTimestamp) {
+		IOInterruptEventSource::reserved->statistics->dispatchTimestamp = mach_absolute_time();
+	}
+
 	signalWorkAvailable();
 
 	if (trace) {
@@ -221,6 +227,7 @@ IOFilterInterruptEventSource::normalInterruptOccurred
 
 	if (IOInterruptEventSource::reserved->statistics) {
 		if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelTimeIndex)
+		    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingFirstLevelTimeHistogramIndex)
 		    || IOInterruptEventSource::reserved->statistics->enablePrimaryTimestamp) {
 			startTime = mach_absolute_time();
 		}
@@ -241,9 +248,16 @@ IOFilterInterruptEventSource::normalInterruptOccurred
 			IA_ADD_VALUE(&IOInterruptEventSource::reserved->statistics->interruptStatistics[kInterruptAccountingFirstLevelCountIndex], 1);
 		}
 
-		if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelTimeIndex)) {
+		if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelTimeIndex)
+		    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingFirstLevelTimeHistogramIndex)) {
 			endTime = mach_absolute_time();
-			IA_ADD_VALUE(&IOInterruptEventSource::reserved->statistics->interruptStatistics[kInterruptAccountingFirstLevelTimeIndex], endTime - startTime);
+			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelTimeIndex)) {
+				IA_ADD_VALUE(&IOInterruptEventSource::reserved->statistics->interruptStatistics[kInterruptAccountingFirstLevelTimeIndex], endTime - startTime);
+			}
+			if (IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingFirstLevelTimeHistogramIndex)) {
+				interruptAccountingDataTallyHistogram(IOInterruptEventSource::reserved->statistics,
+				    kInterruptAccountingFirstLevelTimeHistogramIndex, endTime - startTime);
+			}
 		}
 	}
 
@@ -274,6 +288,7 @@ IOFilterInterruptEventSource::disableInterruptOccurred
 
 	if (IOInterruptEventSource::reserved->statistics) {
 		if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelTimeIndex)
+		    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingFirstLevelTimeHistogramIndex)
 		    || IOInterruptEventSource::reserved->statistics->enablePrimaryTimestamp) {
 			startTime = mach_absolute_time();
 		}
@@ -294,9 +309,16 @@ IOFilterInterruptEventSource::disableInterruptOccurred
 			IA_ADD_VALUE(&IOInterruptEventSource::reserved->statistics->interruptStatistics[kInterruptAccountingFirstLevelCountIndex], 1);
 		}
 
-		if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelTimeIndex)) {
+		if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelTimeIndex)
+		    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingFirstLevelTimeHistogramIndex)) {
 			endTime = mach_absolute_time();
-			IA_ADD_VALUE(&IOInterruptEventSource::reserved->statistics->interruptStatistics[kInterruptAccountingFirstLevelTimeIndex], endTime - startTime);
+			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelTimeIndex)) {
+				IA_ADD_VALUE(&IOInterruptEventSource::reserved->statistics->interruptStatistics[kInterruptAccountingFirstLevelTimeIndex], endTime - startTime);
+			}
+			if (IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingFirstLevelTimeHistogramIndex)) {
+				interruptAccountingDataTallyHistogram(IOInterruptEventSource::reserved->statistics,
+				    kInterruptAccountingFirstLevelTimeHistogramIndex, endTime - startTime);
+			}
 		}
 	}
 
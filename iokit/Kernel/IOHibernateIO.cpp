@@ -184,6 +184,10 @@
 
 extern "C" addr64_t             kvtophys(vm_offset_t va);
 extern "C" ppnum_t              pmap_find_phys(pmap_t pmap, addr64_t va);
+#if defined(__x86_64__)
+extern "C" int                  apply_func_phys(addr64_t src64, vm_size_t bytes,
+    int (*func)(void * buffer, vm_size_t bytes, void * arg), void * arg);
+#endif /* defined(__x86_64__) */
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
@@ -343,6 +347,66 @@ IOMemoryDescriptorReadToPhysical(IOMemoryDescriptor * md,
 	return remaining ? kIOReturnUnderrun : kIOReturnSuccess;
 }
 
+#if defined(__x86_64__)
+
+// The physical aperture maps all of memory on x86_64, so pages can be
+// checksummed and (de)compressed in place rather than bounced through srcBuffer.
+
+struct IOHibernatePageArgs {
+	uint8_t *   src;
+	uint8_t *   compressed;
+	uint8_t *   scratch;
+	uint32_t    ppnum;
+	uint32_t    sum;
+	vm_offset_t compressedSize;
+	int         wkresult;
+};
+
+static int
+IOHibernateCompressPhysPage(void * buffer, vm_size_t bytes, void * arg)
+{
+	IOHibernatePageArgs * args = (IOHibernatePageArgs *) arg;
+
+	args->sum = hibernate_sum_page((uint8_t *) buffer, args->ppnum);
+	args->wkresult = WKdm_compress_new((const WK_word*) buffer,
+	    (WK_word*) args->compressed,
+	    (WK_word*) args->scratch,
+	    (uint32_t) (bytes - 4));
+
+	// the image takes the raw page, or its single repeated word, from src
+	if (-1 == args->wkresult) {
+		bcopy(buffer, args->src, bytes);
+	} else if (0 == args->wkresult) {
+		*(uint32_t *) args->src = *(uint32_t *) buffer;
+	}
+
+	return 0;
+}
+
+static int
+IOHibernateDecompressPhysPage(void * buffer, vm_size_t bytes, void * arg)
+{
+	IOHibernatePageArgs * args = (IOHibernatePageArgs *) arg;
+
+	if (args->compressedSize == 4) {
+		uint32_t   value = *(uint32_t *) args->src;
+		uint32_t * d     = (uint32_t *) buffer;
+
+		for (vm_size_t i = 0; i < (bytes / sizeof(uint32_t)); i++) {
+			*d++ = value;
+		}
+	} else if (args->compressedSize < bytes) {
+		pal_hib_decompress_page(args->src, buffer, args->scratch, ((unsigned int) args->compressedSize));
+	} else {
+		bcopy(args->src, buffer, bytes);
+	}
+	args->sum = hibernate_sum_page((uint8_t *) buffer, args->ppnum);
+
+	return 0;
+}
+
+#endif /* defined(__x86_64__) */
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 void
@@ -1649,6 +1713,9 @@ hibernate_write_image(void)
 
 	IOPolledFileCryptVars _cryptvars;
 	IOPolledFileCryptVars * cryptvars = NULL;
+#if defined(__x86_64__)
+	IOHibernatePageArgs     pageArgs;
+#endif /* defined(__x86_64__) */
 
 	wiredPagesEncrypted = 0;
 	dirtyPagesEncrypted = 0;
@@ -1961,6 +2028,11 @@ hibernate_write_image(void)
 		src = (uint8_t *) vars->srcBuffer->getBytesNoCopy();
 		compressed = src + page_size;
 		scratch    = compressed + page_size;
+#if defined(__x86_64__)
+		pageArgs.src        = src;
+		pageArgs.compressed = compressed;
+		pageArgs.scratch    = scratch;
+#endif /* defined(__x86_64__) */
 
 		pagesDone  = 0;
 		lastBlob   = 0;
@@ -2047,6 +2119,14 @@ hibernate_write_image(void)
 				}
 
 				for (page = ppnum; page < (ppnum + count); page++) {
+#if defined(__x86_64__)
+					pageArgs.ppnum = (uint32_t) page;
+					clock_get_uptime(&startTime);
+					apply_func_phys(ptoa_64(page), page_size, &IOHibernateCompressPhysPage, &pageArgs);
+					clock_get_uptime(&endTime);
+					sum      = pageArgs.sum;
+					wkresult = pageArgs.wkresult;
+#else /* defined(__x86_64__) */
 					err = IOMemoryDescriptorWriteFromPhysical(vars->srcBuffer, 0, ptoa_64(page), page_size);
 					if (err) {
 						HIBLOG("IOMemoryDescriptorWriteFromPhysical %d [%ld] %x\n", __LINE__, (long)page, err);
@@ -2054,11 +2134,6 @@ hibernate_write_image(void)
 					}
 
 					sum = hibernate_sum_page(src, (uint32_t) page);
-					if (kWired & pageType) {
-						sum1 += sum;
-					} else {
-						sum2 += sum;
-					}
 
 					clock_get_uptime(&startTime);
 					wkresult = WKdm_compress_new((const WK_word*) src,
@@ -2067,6 +2142,12 @@ hibernate_write_image(void)
 					    (uint32_t) (page_size - 4));
 
 					clock_get_uptime(&endTime);
+#endif /* defined(__x86_64__) */
+					if (kWired & pageType) {
+						sum1 += sum;
+					} else {
+						sum2 += sum;
+					}
 					ADD_ABSOLUTETIME(&compTime, &endTime);
 					SUB_ABSOLUTETIME(&compTime, &startTime);
 
@@ -2504,7 +2585,14 @@ hibernate_machine_init(void)
 	uint8_t * src = (uint8_t *) vars->srcBuffer->getBytesNoCopy();
 	uint8_t * compressed = src + page_size;
 	uint8_t * scratch    = compressed + page_size;
+#if defined(__x86_64__)
+	IOHibernatePageArgs pageArgs;
+
+	pageArgs.src     = src;
+	pageArgs.scratch = scratch;
+#else /* defined(__x86_64__) */
 	uint32_t  decoOffset;
+#endif /* defined(__x86_64__) */
 
 	clock_get_uptime(&allTime);
 	AbsoluteTime_to_scalar(&compTime) = 0;
@@ -2590,6 +2678,19 @@ hibernate_machine_init(void)
 				panic("Hibernate restore error %x", err);
 			}
 
+#if defined(__x86_64__)
+			pageArgs.ppnum          = ppnum;
+			pageArgs.compressedSize = compressedSize;
+			clock_get_uptime(&startTime);
+			apply_func_phys(ptoa_64(ppnum), page_size, &IOHibernateDecompressPhysPage, &pageArgs);
+			if (compressedSize < page_size) {
+				clock_get_uptime(&endTime);
+				ADD_ABSOLUTETIME(&compTime, &endTime);
+				SUB_ABSOLUTETIME(&compTime, &startTime);
+				compBytes += page_size;
+			}
+			sum += pageArgs.sum;
+#else /* defined(__x86_64__) */
 			if (compressedSize < page_size) {
 				decoOffset = ((uint32_t) page_size);
 				clock_get_uptime(&startTime);
@@ -2621,6 +2722,7 @@ hibernate_machine_init(void)
 				HIBLOG("IOMemoryDescriptorReadToPhysical [%ld] %x\n", (long)ppnum, err);
 				panic("Hibernate restore error %x", err);
 			}
+#endif /* defined(__x86_64__) */
 
 
 			ppnum++;
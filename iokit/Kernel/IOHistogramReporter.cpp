@@ -34,8 +34,23 @@
 #include <IOKit/IOKernelReportStructs.h>
 #include <IOKit/IOKernelReporters.h>
 #include <os/overflow.h>
+#include <kern/cpu_number.h>
+#include <kern/cpu_data.h>
+#include <machine/machine_routines.h>
 #include "IOReporterDefs.h"
 
+// One CPU's copy of a histogram bucket, see enablePerCPUTally().
+// hits is published last so a reader that sees it also sees the rest.
+struct IOHistogramCPUBucket {
+	uint64_t    hits;
+	int64_t     min;
+	int64_t     max;
+	int64_t     sum;
+};
+
+// keep each CPU's run of buckets on its own cache lines
+#define kIOHistogramCPUAlign    128
+
 
 #define super IOReporter
 OSDefineMetaClassAndStructors(IOHistogramReporter, IOReporter);
@@ -264,6 +279,10 @@ IOHistogramReporter::free(void)
 		IOFreeData(_histogramSegmentsConfig,
 		    (size_t)_segmentCount * sizeof(IOHistogramSegmentConfig));
 	}
+	if (_cpuBuckets) {
+		IOFreeData(_cpuBuckets,
+		    (size_t)_cpuCount * (size_t)_cpuStride * sizeof(IOHistogramCPUBucket));
+	}
 
 	super::free();
 }
@@ -311,6 +330,11 @@ IOHistogramReporter::overrideBucketValues(unsigned int index,
 	IOHistogramReportValues bucket;
 	lockReporter();
 
+	if (_cpuBuckets) {
+		result = kIOReturnUnsupported;
+		goto finish;
+	}
+
 	if (index >= (unsigned int)_bucketCount) {
 		result = kIOReturnBadArgument;
 		goto finish;
@@ -334,8 +358,7 @@ IOHistogramReporter::tallyValue(int64_t value)
 	int cnt = 0, element_index = 0;
 	int64_t sum = 0;
 	IOHistogramReportValues hist_values;
-
-	lockReporter();
+	IOHistogramCPUBucket *cpuBuckets;
 
 	// Iterate over _bucketCount minus one to make last bucket of infinite width
 	for (cnt = 0; cnt < _bucketCount - 1; cnt++) {
@@ -346,6 +369,19 @@ IOHistogramReporter::tallyValue(int64_t value)
 
 	element_index = cnt;
 
+	cpuBuckets = os_atomic_load(&_cpuBuckets, acquire);
+	if (cpuBuckets) {
+		return tallyCPUValue(cpuBuckets, element_index, value);
+	}
+
+	lockReporter();
+
+	// per-CPU tallying may have been enabled while we waited for the lock
+	if (_cpuBuckets) {
+		unlockReporter();
+		return tallyCPUValue(_cpuBuckets, element_index, value);
+	}
+
 	if (copyElementValues(element_index, (IOReportElementValues *)&hist_values) != kIOReturnSuccess) {
 		goto finish;
 	}
@@ -382,6 +418,156 @@ finish:
 	return result;
 }
 
+int
+IOHistogramReporter::tallyCPUValue(IOHistogramCPUBucket *cpuBuckets,
+    int element_index,
+    int64_t value)
+{
+	IOHistogramCPUBucket *bucket;
+	unsigned int cpu;
+
+	disable_preemption();
+
+	cpu = (unsigned int) cpu_number();
+	if (cpu >= _cpuCount) {
+		cpu = 0;
+	}
+
+	// atomics, since an interrupt on this CPU may tally into the same bucket
+	bucket = &cpuBuckets[cpu * (unsigned int)_cpuStride + (unsigned int)element_index];
+	os_atomic_min(&bucket->min, value, relaxed);
+	os_atomic_max(&bucket->max, value, relaxed);
+	os_atomic_add(&bucket->sum, value, relaxed);
+	os_atomic_inc(&bucket->hits, release);
+
+	enable_preemption();
+
+	return element_index;
+}
+
+IOReturn
+IOHistogramReporter::enablePerCPUTally(void)
+{
+	IOReturn result = kIOReturnSuccess;
+	IOHistogramCPUBucket *cpuBuckets;
+	IOHistogramReportValues hist_values;
+	unsigned int cpuCount;
+	int cpuStride, cnt;
+	size_t size;
+
+	if (os_atomic_load(&_cpuBuckets, acquire)) {
+		return kIOReturnSuccess;
+	}
+
+	cpuCount = ml_wait_max_cpus();
+	cpuStride = (int) (roundup((size_t)_bucketCount * sizeof(IOHistogramCPUBucket),
+	    kIOHistogramCPUAlign) / sizeof(IOHistogramCPUBucket));
+	if (os_mul3_overflow((size_t)cpuCount, (size_t)cpuStride,
+	    sizeof(IOHistogramCPUBucket), &size)) {
+		return kIOReturnNoMemory;
+	}
+	cpuBuckets = (IOHistogramCPUBucket *)IOMallocZeroData(size);
+	if (!cpuBuckets) {
+		return kIOReturnNoMemory;
+	}
+	for (cnt = 0; cnt < (int)cpuCount * cpuStride; cnt++) {
+		cpuBuckets[cnt].min = INT64_MAX;
+		cpuBuckets[cnt].max = INT64_MIN;
+	}
+
+	lockReporter();
+
+	if (_cpuBuckets) {
+		unlockReporter();
+		IOFreeData(cpuBuckets, size);
+		return kIOReturnSuccess;
+	}
+
+	// carry over anything tallied so far in CPU 0's buckets
+	for (cnt = 0; cnt < _bucketCount; cnt++) {
+		if (copyElementValues(cnt, (IOReportElementValues *)&hist_values) != kIOReturnSuccess) {
+			result = kIOReturnError;
+			break;
+		}
+		if (hist_values.bucket_hits) {
+			cpuBuckets[cnt].hits = hist_values.bucket_hits;
+			cpuBuckets[cnt].min = hist_values.bucket_min;
+			cpuBuckets[cnt].max = hist_values.bucket_max;
+			cpuBuckets[cnt].sum = hist_values.bucket_sum;
+		}
+	}
+
+	if (kIOReturnSuccess == result) {
+		_cpuCount = cpuCount;
+		_cpuStride = cpuStride;
+		os_atomic_store(&_cpuBuckets, cpuBuckets, release);
+	}
+
+	unlockReporter();
+
+	if (kIOReturnSuccess != result) {
+		IOFreeData(cpuBuckets, size);
+	}
+
+	return result;
+}
+
+IOReturn
+IOHistogramReporter::updateChannelValues(__unused int channel_index)
+{
+	IOReturn result = kIOReturnSuccess;
+	IOHistogramReportValues hist_values;
+	IOHistogramCPUBucket *bucket;
+	uint64_t hits;
+	int64_t sum;
+	unsigned int cpu;
+	int cnt;
+
+	IOREPORTER_CHECK_LOCK();
+
+	if (!_cpuBuckets) {
+		return kIOReturnSuccess;
+	}
+
+	for (cnt = 0; cnt < _bucketCount; cnt++) {
+		hist_values.bucket_hits = 0;
+		hist_values.bucket_min = INT64_MAX;
+		hist_values.bucket_max = INT64_MIN;
+		hist_values.bucket_sum = 0;
+
+		for (cpu = 0; cpu < _cpuCount; cpu++) {
+			bucket = &_cpuBuckets[cpu * (unsigned int)_cpuStride + (unsigned int)cnt];
+			hits = os_atomic_load(&bucket->hits, acquire);
+			if (!hits) {
+				continue;
+			}
+			hist_values.bucket_hits += hits;
+			hist_values.bucket_min = MIN(hist_values.bucket_min,
+			    os_atomic_load(&bucket->min, relaxed));
+			hist_values.bucket_max = MAX(hist_values.bucket_max,
+			    os_atomic_load(&bucket->max, relaxed));
+			if (os_add_overflow(hist_values.bucket_sum,
+			    os_atomic_load(&bucket->sum, relaxed), &sum)) {
+				sum = INT64_MAX;
+			}
+			hist_values.bucket_sum = sum;
+		}
+
+		if (!hist_values.bucket_hits) {
+			hist_values.bucket_min = kIOReportInvalidIntValue;
+			hist_values.bucket_max = kIOReportInvalidIntValue;
+			hist_values.bucket_sum = kIOReportInvalidIntValue;
+		}
+
+		result = setElementValues(cnt, (IOReportElementValues *)&hist_values);
+		if (kIOReturnSuccess != result) {
+			break;
+		}
+	}
+
+	return result;
+}
+
 /* static */ OSPtr<IOReportLegendEntry>
 IOHistogramReporter::createLegend(uint64_t channelID,
     const char *channelName,
@@ -41,6 +41,14 @@ uint32_t gInterruptAccountingStatisticBitmask =
     IA_GET_ENABLE_BIT(kInterruptAccountingFirstLevelCountIndex) |
     IA_GET_ENABLE_BIT(kInterruptAccountingSecondLevelCountIndex);
 
+uint32_t gInterruptAccountingHistogramBitmask =
+#if !defined(__arm__)
+    IA_GET_ENABLE_BIT(kInterruptAccountingFirstLevelTimeHistogramIndex) |
+    IA_GET_ENABLE_BIT(kInterruptAccountingDispatchLatencyHistogramIndex) |
+    IA_GET_ENABLE_BIT(kInterruptAccountingSecondLevelSystemTimeHistogramIndex) |
+#endif
+    0;
+
 IOLock * gInterruptAccountingDataListLock = NULL;
 queue_head_t gInterruptAccountingDataList;
 
@@ -53,6 +61,10 @@ interruptAccountingInit(void)
 		gInterruptAccountingStatisticBitmask = bootArgValue;
 	}
 
+	if (PE_parse_boot_argn("interrupt_histograms", &bootArgValue, sizeof(bootArgValue))) {
+		gInterruptAccountingHistogramBitmask = bootArgValue;
+	}
+
 	gInterruptAccountingDataListLock = IOLockAlloc();
 
 	assert(gInterruptAccountingDataListLock);
@@ -99,3 +111,99 @@ interruptAccountingDataInheritChannels(IOInterruptAccountingData * data, IOSimpl
 		}
 	}
 }
+
+IOInterruptAccountingHistograms *
+interruptAccountingHistogramsAlloc(IOService * service, int source, IOReportLegend * legend, const char * subgroupName)
+{
+	IOInterruptAccountingHistograms * histograms = NULL;
+	IOHistogramSegmentConfig config;
+	uint64_t i = 0;
+
+	if (!IA_ANY_HISTOGRAMS_ENABLED) {
+		return NULL;
+	}
+
+	histograms = IOMallocType(IOInterruptAccountingHistograms);
+
+	/*
+	 * A single log2 segment; see interruptAccountingDataTallyHistogram for the bucket mapping.
+	 */
+	config.base_bucket_width = 2;
+	config.scale_flag = 1;
+	config.segment_bucket_count = IA_NUM_HISTOGRAM_BUCKETS;
+
+	for (i = 0; i < IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS; i++) {
+		if (!IA_GET_HISTOGRAM_ENABLED(i)) {
+			continue;
+		}
+
+		OSSharedPtr<IOHistogramReporter> reporter = IOHistogramReporter::with(service, kIOReportCategoryPerformance,
+		    IA_GET_HISTOGRAM_CHANNEL_ID(source, i), kInterruptAccountingHistogramNameArray[i],
+		    kIOReportUnitNone, 1, &config);
+
+		if (reporter) {
+			legend->addReporterLegend(reporter.get(), kInterruptAccountingGroupName, subgroupName);
+			histograms->reporters[i] = reporter.detach();
+		}
+	}
+
+	return histograms;
+}
+
+void
+interruptAccountingHistogramsFree(IOInterruptAccountingHistograms * histograms)
+{
+	uint64_t i = 0;
+
+	for (i = 0; i < IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS; i++) {
+		OSSafeReleaseNULL(histograms->reporters[i]);
+	}
+
+	IOFreeType(histograms, IOInterruptAccountingHistograms);
+}
+
+void
+interruptAccountingDataUpdateHistograms(IOInterruptAccountingData * data, IOInterruptAccountingHistograms * histograms)
+{
+	uint64_t i = 0, j = 0;
+	uint64_t hits = 0, sum = 0;
+
+	for (i = 0; i < IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS; i++) {
+		if (!histograms->reporters[i]) {
+			continue;
+		}
+
+		for (j = 0; j < IA_NUM_HISTOGRAM_BUCKETS; j++) {
+			hits = histograms->baseHits[i][j];
+			sum = histograms->baseSums[i][j];
+
+			if (data) {
+				hits += data->histogramHits[i][j];
+				sum += data->histogramSums[i][j];
+			}
+
+			/*
+			 * Only hits and sums are tracked; per-bucket extremes would need a compare-and-swap in the
+			 * interrupt path.
+			 */
+			histograms->reporters[i]->overrideBucketValues((unsigned int) j, hits,
+			    kIOReportInvalidIntValue, kIOReportInvalidIntValue,
+			    (sum > INT64_MAX) ? INT64_MAX : (int64_t) sum);
+		}
+	}
+}
+
+void
+interruptAccountingDataRetireHistograms(IOInterruptAccountingData * data, IOInterruptAccountingHistograms * histograms)
+{
+	uint64_t i = 0, j = 0;
+
+	for (i = 0; i < IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS; i++) {
+		for (j = 0; j < IA_NUM_HISTOGRAM_BUCKETS; j++) {
+			histograms->baseHits[i][j] += data->histogramHits[i][j];
+			histograms->baseSums[i][j] += data->histogramSums[i][j];
+			data->histogramHits[i][j] = 0;
+			data->histogramSums[i][j] = 0;
+		}
+	}
+}
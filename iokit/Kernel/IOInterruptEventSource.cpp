@@ -101,7 +101,7 @@ IOInterruptEventSource::init(OSObject *inOwner,
 
 	// Assumes inOwner holds a reference(retain) on the provider
 	if (inProvider) {
-		if (IA_ANY_STATISTICS_ENABLED) {
+		if (IA_ANY_STATISTICS_ENABLED || IA_ANY_HISTOGRAMS_ENABLED) {
 			/*
 			 * We only treat this as an "interrupt" if it has a provider; if it does,
 			 * set up the objects necessary to track interrupt statistics.  Interrupt
@@ -344,13 +344,26 @@ IOInterruptEventSource::checkForWork()
 		}
 
 		if (reserved->statistics) {
-			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)) {
+			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)
+			    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingSecondLevelSystemTimeHistogramIndex)
+			    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingDispatchLatencyHistogramIndex)) {
 				startSystemTime = mach_absolute_time();
 			}
 
 			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelCPUTimeIndex)) {
 				startCPUTime = thread_get_runtime_self();
 			}
+
+			/*
+			 * Consume the dispatch timestamp before running the handler, so that the next interrupt
+			 * (even one arriving while the handler runs) sets a fresh one.
+			 */
+			if (IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingDispatchLatencyHistogramIndex)
+			    && reserved->statistics->dispatchTimestamp) {
+				interruptAccountingDataTallyHistogram(reserved->statistics, kInterruptAccountingDispatchLatencyHistogramIndex,
+				    startSystemTime - reserved->statistics->dispatchTimestamp);
+				reserved->statistics->dispatchTimestamp = 0;
+			}
 		}
 
 		// Call the handler
@@ -370,9 +383,16 @@ IOInterruptEventSource::checkForWork()
 				IA_ADD_VALUE(&reserved->statistics->interruptStatistics[kInterruptAccountingSecondLevelCPUTimeIndex], endCPUTime - startCPUTime);
 			}
 
-			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)) {
+			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)
+			    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingSecondLevelSystemTimeHistogramIndex)) {
 				endSystemTime = mach_absolute_time();
-				IA_ADD_VALUE(&reserved->statistics->interruptStatistics[kInterruptAccountingSecondLevelSystemTimeIndex], endSystemTime - startSystemTime);
+				if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)) {
+					IA_ADD_VALUE(&reserved->statistics->interruptStatistics[kInterruptAccountingSecondLevelSystemTimeIndex], endSystemTime - startSystemTime);
+				}
+				if (IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingSecondLevelSystemTimeHistogramIndex)) {
+					interruptAccountingDataTallyHistogram(reserved->statistics, kInterruptAccountingSecondLevelSystemTimeHistogramIndex,
+					    endSystemTime - startSystemTime);
+				}
 			}
 		}
 
@@ -396,13 +416,26 @@ IOInterruptEventSource::checkForWork()
 		}
 
 		if (reserved->statistics) {
-			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)) {
+			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)
+			    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingSecondLevelSystemTimeHistogramIndex)
+			    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingDispatchLatencyHistogramIndex)) {
 				startSystemTime = mach_absolute_time();
 			}
 
 			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelCPUTimeIndex)) {
 				startCPUTime = thread_get_runtime_self();
 			}
+
+			/*
+			 * Consume the dispatch timestamp before running the handler, so that the next interrupt
+			 * (even one arriving while the handler runs) sets a fresh one.
+			 */
+			if (IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingDispatchLatencyHistogramIndex)
+			    && reserved->statistics->dispatchTimestamp) {
+				interruptAccountingDataTallyHistogram(reserved->statistics, kInterruptAccountingDispatchLatencyHistogramIndex,
+				    startSystemTime - reserved->statistics->dispatchTimestamp);
+				reserved->statistics->dispatchTimestamp = 0;
+			}
 		}
 
 		// Call the handler
@@ -413,9 +446,16 @@ IOInterruptEventSource::checkForWork()
 		}
 
 		if (reserved->statistics) {
-			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)) {
+			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)
+			    || IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingSecondLevelSystemTimeHistogramIndex)) {
 				endSystemTime = mach_absolute_time();
-				IA_ADD_VALUE(&reserved->statistics->interruptStatistics[kInterruptAccountingSecondLevelSystemTimeIndex], endSystemTime - startSystemTime);
+				if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelSystemTimeIndex)) {
+					IA_ADD_VALUE(&reserved->statistics->interruptStatistics[kInterruptAccountingSecondLevelSystemTimeIndex], endSystemTime - startSystemTime);
+				}
+				if (IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingSecondLevelSystemTimeHistogramIndex)) {
+					interruptAccountingDataTallyHistogram(reserved->statistics, kInterruptAccountingSecondLevelSystemTimeHistogramIndex,
+					    endSystemTime - startSystemTime);
+				}
 			}
 
 			if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingSecondLevelCPUTimeIndex)) {
@@ -464,6 +504,10 @@ IOInterruptEventSource::normalInterruptOccurred
 		if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelCountIndex)) {
 			IA_ADD_VALUE(&reserved->statistics->interruptStatistics[kInterruptAccountingFirstLevelCountIndex], 1);
 		}
+		if (IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingDispatchLatencyHistogramIndex)
+		    && !reserved->statistics->dispatchTimestamp) {
+			reserved->statistics->dispatchTimestamp = mach_absolute_time();
+		}
 	}
 
 	signalWorkAvailable();
@@ -495,6 +539,10 @@ IOInterruptEventSource::disableInterruptOccurred
 		if (IA_GET_STATISTIC_ENABLED(kInterruptAccountingFirstLevelCountIndex)) {
 			IA_ADD_VALUE(&reserved->statistics->interruptStatistics[kInterruptAccountingFirstLevelCountIndex], 1);
 		}
+		if (IA_GET_HISTOGRAM_ENABLED(kInterruptAccountingDispatchLatencyHistogramIndex)
+		    && !reserved->statistics->dispatchTimestamp) {
+			reserved->statistics->dispatchTimestamp = mach_absolute_time();
+		}
 	}
 
 	signalWorkAvailable();
@@ -125,6 +125,8 @@ struct IODMACommandInternal {
 	UInt8  fForceDoubleBuffer;
 	UInt8  fSetActiveNoMapper;
 	UInt8  fDextOwned;
+	UInt8  fPersistent;
+	UInt8  fPersistentValid;
 
 	vm_page_t fCopyPageAlloc;
 	vm_page_t fCopyNext;
@@ -4211,6 +4211,21 @@ IOGeneralMemoryDescriptor::wireVirtual(IODirection forDirection)
 			} else {
 				// Get the startPage address and length of vec[range]
 				getAddrLenForInd(startPage, numBytes, type, vec, range);
+
+				// Fold in following ranges that continue this one in a user
+				// map, so a fragmented list describing one span of memory is
+				// wired with a single UPL request and one pass over the map
+				while (curMap && (curMap != kernel_map) && ((mdOffset + numBytes) < _length)) {
+					mach_vm_address_t nextAddr;
+					mach_vm_size_t    nextLen;
+
+					getAddrLenForInd(nextAddr, nextLen, type, vec, range + 1);
+					if (!nextLen || (nextAddr != (startPage + numBytes))) {
+						break;
+					}
+					numBytes += nextLen;
+					range++;
+				}
 				if (byteAlignUPL) {
 					startPageOffset = 0;
 				} else {
@@ -4686,7 +4701,13 @@ IOGeneralMemoryDescriptor::prepare(IODirection forDirection)
 			error = kIOReturnNotReady;
 			goto finish;
 		}
+#if IOKITSTATS
+		uint64_t wireStart = mach_absolute_time();
+		error = wireVirtual(forDirection);
+		IOStatistics::countPrepare(mach_absolute_time() - wireStart);
+#else
 		error = wireVirtual(forDirection);
+#endif /* IOKITSTATS */
 	}
 
 	if (kIOReturnSuccess == error) {
@@ -336,6 +336,7 @@ const OSSymbol                * gIOAssociatedServicesKey;
 struct IOInterruptAccountingReporter {
 	IOSimpleReporter * reporter; /* Reporter responsible for communicating the statistics */
 	IOInterruptAccountingData * statistics; /* The live statistics values, if any */
+	IOInterruptAccountingHistograms * histograms; /* Latency histogram reporters, if any are enabled */
 };
 
 struct ArbitrationLockQueueElement {
@@ -849,6 +850,9 @@ IOService::free( void )
 				if (reserved->interruptStatisticsArray[i].reporter) {
 					reserved->interruptStatisticsArray[i].reporter->release();
 				}
+				if (reserved->interruptStatisticsArray[i].histograms) {
+					interruptAccountingHistogramsFree(reserved->interruptStatisticsArray[i].histograms);
+				}
 			}
 
 			IODelete(reserved->interruptStatisticsArray, IOInterruptAccountingReporter, reserved->interruptStatisticsArrayCount);
@@ -8709,6 +8713,7 @@ IOService::addInterruptStatistics(IOInterruptAccountingData * statistics, int so
 		snprintf(subgroupName, sizeof(subgroupName), "%s %d", getName(), source);
 		subgroupName[sizeof(subgroupName) - 1] = 0;
 		legend->addReporterLegend(reserved->interruptStatisticsArray[source].reporter, kInterruptAccountingGroupName, subgroupName);
+		reserved->interruptStatisticsArray[source].histograms = interruptAccountingHistogramsAlloc(this, source, legend, subgroupName);
 		setProperty(kIOReportLegendKey, legend->getLegend());
 		legend->release();
 
@@ -8789,6 +8794,9 @@ IOService::removeInterruptStatistics(int source)
 	 * state is not lost.
 	 */
 	interruptAccountingDataUpdateChannels(reserved->interruptStatisticsArray[source].statistics, reserved->interruptStatisticsArray[source].reporter);
+	if (reserved->interruptStatisticsArray[source].histograms) {
+		interruptAccountingDataRetireHistograms(reserved->interruptStatisticsArray[source].statistics, reserved->interruptStatisticsArray[source].histograms);
+	}
 	reserved->interruptStatisticsArray[source].statistics = NULL;
 	IOLockUnlock(reserved->interruptStatisticsLock);
 
@@ -8862,6 +8870,7 @@ IOService::configureReport(IOReportChannelList    *channelList,
     void                   *destination)
 {
 	unsigned cnt;
+	unsigned i;
 
 	for (cnt = 0; cnt < channelList->nchannels; cnt++) {
 		if (channelList->channels[cnt].channel_id == kPMPowerStatesChID) {
@@ -8894,6 +8903,13 @@ IOService::configureReport(IOReportChannelList    *channelList,
 
 			reserved->interruptStatisticsArray[cnt].reporter->configureReport(channelList, action, result, destination);
 		}
+		if (reserved->interruptStatisticsArray[cnt].histograms) {
+			for (i = 0; i < IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS; i++) {
+				if (reserved->interruptStatisticsArray[cnt].histograms->reporters[i]) {
+					reserved->interruptStatisticsArray[cnt].histograms->reporters[i]->configureReport(channelList, action, result, destination);
+				}
+			}
+		}
 	}
 
 	IOLockUnlock(reserved->interruptStatisticsLock);
@@ -8912,6 +8928,7 @@ IOService::updateReport(IOReportChannelList      *channelList,
     void                     *destination)
 {
 	unsigned cnt;
+	unsigned i;
 
 	for (cnt = 0; cnt < channelList->nchannels; cnt++) {
 		if (channelList->channels[cnt].channel_id == kPMPowerStatesChID) {
@@ -8944,6 +8961,14 @@ IOService::updateReport(IOReportChannelList      *channelList,
 
 			reserved->interruptStatisticsArray[cnt].reporter->updateReport(channelList, action, result, destination);
 		}
+		if (reserved->interruptStatisticsArray[cnt].histograms) {
+			interruptAccountingDataUpdateHistograms(reserved->interruptStatisticsArray[cnt].statistics, reserved->interruptStatisticsArray[cnt].histograms);
+			for (i = 0; i < IA_NUM_INTERRUPT_ACCOUNTING_HISTOGRAMS; i++) {
+				if (reserved->interruptStatisticsArray[cnt].histograms->reporters[i]) {
+					reserved->interruptStatisticsArray[cnt].histograms->reporters[i]->updateReport(channelList, action, result, destination);
+				}
+			}
+		}
 	}
 
 	IOLockUnlock(reserved->interruptStatisticsLock);
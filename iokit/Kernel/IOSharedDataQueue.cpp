@@ -33,6 +33,8 @@
 #include <IOKit/IOLib.h>
 #include <IOKit/IOMemoryDescriptor.h>
 #include <libkern/c++/OSSharedPtr.h>
+#include <kern/thread_call.h>
+#include <machine/machine_routines.h>
 
 #ifdef enqueue
 #undef enqueue
@@ -133,6 +135,12 @@ IOSharedDataQueue::initWithCapacity(UInt32 size)
 void
 IOSharedDataQueue::free()
 {
+	if (_reserved && _reserved->notifyCall) {
+		thread_call_cancel_wait(_reserved->notifyCall);
+		thread_call_free(_reserved->notifyCall);
+		_reserved->notifyCall = NULL;
+	}
+
 	if (dataQueue) {
 		kmem_free(kernel_map, (vm_offset_t)dataQueue, round_page(getQueueSize() +
 		    DATA_QUEUE_MEMORY_HEADER_SIZE + DATA_QUEUE_MEMORY_APPENDIX_SIZE));
@@ -222,6 +230,10 @@ IOSharedDataQueue::enqueue(void * data, UInt32 dataSize)
 	const UInt32       entrySize = dataSize + DATA_QUEUE_ENTRY_HEADER_SIZE;
 	IODataQueueEntry * entry;
 
+	if (_reserved && _reserved->multiProducer) {
+		return enqueueMultiProducer(data, dataSize);
+	}
+
 	// Force a single read of head and tail
 	// See rdar://problem/40780584 for an explanation of relaxed/acquire barriers
 	tail = __c11_atomic_load((_Atomic UInt32 *)&dataQueue->tail, __ATOMIC_RELAXED);
@@ -301,13 +313,196 @@ IOSharedDataQueue::enqueue(void * data, UInt32 dataSize)
 		head = __c11_atomic_load((_Atomic UInt32 *)&dataQueue->head, __ATOMIC_RELAXED);
 	}
 
-	if (tail == head) {
-		// Send notification (via mach message) that data is now available.
-		sendDataAvailableNotification();
+	dataEnqueued(tail == head);
+	return true;
+}
+
+Boolean
+IOSharedDataQueue::enqueueMultiProducer(void * data, UInt32 dataSize)
+{
+	UInt32             head;
+	UInt32             reserve;
+	UInt32             newTail;
+	const UInt32       queueSize = getQueueSize();
+	const UInt32       entrySize = dataSize + DATA_QUEUE_ENTRY_HEADER_SIZE;
+	IODataQueueEntry * entry;
+	bool               wrap;
+	boolean_t          istate;
+
+	// Check for overflow of entrySize
+	if (dataSize > UINT32_MAX - DATA_QUEUE_ENTRY_HEADER_SIZE) {
+		return false;
+	}
+
+	// Entries are published in reservation order, so a producer may have
+	// to wait for the ones that reserved before it.  Nothing may preempt
+	// or interrupt us between reserving and publishing, or a producer on
+	// this CPU could wait for a slot that never gets published.
+	istate = ml_set_interrupts_enabled(FALSE);
+
+	// Reserve the slot.  The reservation tail is kernel private, only the
+	// head is read from the shared memory.
+	reserve = __c11_atomic_load((_Atomic UInt32 *)&_reserved->reserveTail, __ATOMIC_RELAXED);
+	do {
+		head = __c11_atomic_load((_Atomic UInt32 *)&dataQueue->head, __ATOMIC_ACQUIRE);
+		wrap = false;
+
+		if (queueSize < reserve || queueSize < head) {
+			ml_set_interrupts_enabled(istate);
+			return false;
+		}
+
+		if (reserve >= head) {
+			if ((entrySize <= UINT32_MAX - reserve) &&
+			    ((reserve + entrySize) <= queueSize)) {
+				newTail = reserve + entrySize;
+			} else if (head > entrySize) {
+				wrap = true;
+				newTail = entrySize;
+			} else {
+				ml_set_interrupts_enabled(istate);
+				return false; // queue is full
+			}
+		} else if ((head - reserve) > entrySize) {
+			newTail = reserve + entrySize;
+		} else {
+			ml_set_interrupts_enabled(istate);
+			return false; // queue is full
+		}
+	} while (!__c11_atomic_compare_exchange_weak((_Atomic UInt32 *)&_reserved->reserveTail,
+	    &reserve, newTail, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	if (wrap) {
+		// Same layout as the single producer wrap, see enqueue()
+		dataQueue->queue->size = dataSize;
+		if ((queueSize - reserve) >= DATA_QUEUE_ENTRY_HEADER_SIZE) {
+			((IODataQueueEntry *)((UInt8 *)dataQueue->queue + reserve))->size = dataSize;
+		}
+		entry = dataQueue->queue;
+	} else {
+		entry = (IODataQueueEntry *)((UInt8 *)dataQueue->queue + reserve);
+		entry->size = dataSize;
+	}
+	__nochk_memcpy(&entry->data, data, dataSize);
+
+	// Wait for the producers ahead of us, then publish the data we just
+	// enqueued.  The wait is on the kernel private copy of the tail so
+	// that user space cannot stall it.
+	while (__c11_atomic_load((_Atomic UInt32 *)&_reserved->publishTail, __ATOMIC_ACQUIRE) != reserve) {
+		;
+	}
+	__c11_atomic_store((_Atomic UInt32 *)&dataQueue->tail, newTail, __ATOMIC_RELEASE);
+	__c11_atomic_store((_Atomic UInt32 *)&_reserved->publishTail, newTail, __ATOMIC_RELEASE);
+
+	if (reserve != head) {
+		// Pairs with the barrier in ::dequeue, see enqueue()
+		__c11_atomic_thread_fence(__ATOMIC_SEQ_CST);
+		head = __c11_atomic_load((_Atomic UInt32 *)&dataQueue->head, __ATOMIC_RELAXED);
+	}
+
+	ml_set_interrupts_enabled(istate);
+
+	dataEnqueued(reserve == head);
+	return true;
+}
+
+Boolean
+IOSharedDataQueue::enableMultiProducer()
+{
+	UInt32 head;
+	UInt32 tail;
+
+	if (!dataQueue || !_reserved) {
+		return false;
+	}
+	if (_reserved->multiProducer) {
+		return true;
+	}
+
+	tail = __c11_atomic_load((_Atomic UInt32 *)&dataQueue->tail, __ATOMIC_RELAXED);
+	head = __c11_atomic_load((_Atomic UInt32 *)&dataQueue->head, __ATOMIC_ACQUIRE);
+	if (tail != head || tail > getQueueSize()) {
+		return false;
 	}
+
+	_reserved->reserveTail = tail;
+	_reserved->publishTail = tail;
+	__c11_atomic_store((_Atomic bool *)&_reserved->multiProducer, true, __ATOMIC_RELEASE);
+
 	return true;
 }
 
+void
+IOSharedDataQueue::notifyCallout(void *param0, void *)
+{
+	IOSharedDataQueue * me = (IOSharedDataQueue *) param0;
+
+	if (__c11_atomic_exchange((_Atomic UInt32 *)&me->_reserved->notifyPending, 0, __ATOMIC_RELAXED)) {
+		me->sendDataAvailableNotification();
+	}
+}
+
+Boolean
+IOSharedDataQueue::setNotificationCoalescing(UInt32 entryThreshold, UInt64 timeoutNS)
+{
+	if (!_reserved) {
+		return false;
+	}
+
+	if (timeoutNS && !_reserved->notifyCall) {
+		_reserved->notifyCall = thread_call_allocate(&IOSharedDataQueue::notifyCallout, this);
+		if (!_reserved->notifyCall) {
+			return false;
+		}
+	}
+
+	_reserved->notifyThreshold = entryThreshold;
+	_reserved->notifyTimeout   = timeoutNS;
+
+	return true;
+}
+
+void
+IOSharedDataQueue::dataEnqueued(bool wasEmpty)
+{
+	UInt32   threshold;
+	UInt32   pending;
+	uint64_t deadline;
+
+	threshold = _reserved ? _reserved->notifyThreshold : 0;
+	if (threshold <= 1 && !(_reserved && _reserved->notifyTimeout)) {
+		if (wasEmpty) {
+			// Send notification (via mach message) that data is now available.
+			sendDataAvailableNotification();
+		}
+		return;
+	}
+
+	// Count the entries added since the queue last became non-empty,
+	// a zero count means no notification is pending.
+	if (wasEmpty) {
+		pending = __c11_atomic_fetch_add((_Atomic UInt32 *)&_reserved->notifyPending, 1, __ATOMIC_RELAXED) + 1;
+	} else {
+		pending = __c11_atomic_load((_Atomic UInt32 *)&_reserved->notifyPending, __ATOMIC_RELAXED);
+		do {
+			if (!pending) {
+				return;
+			}
+		} while (!__c11_atomic_compare_exchange_weak((_Atomic UInt32 *)&_reserved->notifyPending,
+		    &pending, pending + 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+		pending++;
+	}
+
+	if (threshold > 1 && pending >= threshold) {
+		if (__c11_atomic_exchange((_Atomic UInt32 *)&_reserved->notifyPending, 0, __ATOMIC_RELAXED)) {
+			sendDataAvailableNotification();
+		}
+	} else if (pending == 1 && _reserved->notifyCall) {
+		nanoseconds_to_deadline(_reserved->notifyTimeout, &deadline);
+		thread_call_enter_delayed(_reserved->notifyCall, deadline);
+	}
+}
+
 Boolean
 IOSharedDataQueue::dequeue(void *data, UInt32 *dataSize)
 {
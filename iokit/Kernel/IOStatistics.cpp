@@ -53,6 +53,9 @@ uint32_t IOStatistics::registeredClasses = 0;
 uint32_t IOStatistics::registeredCounters = 0;
 uint32_t IOStatistics::registeredWorkloops = 0;
 
+uint32_t IOStatistics::prepareCalls = 0;
+uint64_t IOStatistics::prepareTime = 0;
+
 uint32_t IOStatistics::attachedEventSources = 0;
 
 IOWorkLoopDependency *IOStatistics::nextWorkLoopDependency = NULL;
@@ -866,6 +869,8 @@ IOStatistics::copyGlobalStatistics(IOStatisticsGlobal *stats)
 	stats->kextCount = loadedKexts;
 	stats->classCount = registeredClasses;
 	stats->workloops = registeredWorkloops;
+	stats->prepareCalls = prepareCalls;
+	stats->prepareTime = prepareTime;
 
 	return sizeof(IOStatisticsGlobal);
 }
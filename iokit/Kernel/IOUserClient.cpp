@@ -1602,6 +1602,9 @@ IOUserClient::reserve()
 	if (!reserved) {
 		reserved = IOMallocType(ExpansionData);
 	}
+	if (!reserved->preparedLock) {
+		reserved->preparedLock = IOLockAlloc();
+	}
 	setTerminateDefer(NULL, true);
 	IOStatisticsRegisterCounter();
 
@@ -1845,6 +1848,10 @@ IOUserClient::free()
 			}
 			IOFreeType(elem, IOUCFilterPolicy);
 		}
+		flushPreparedClientMemory();
+		if (reserved->preparedLock) {
+			IOLockFree(reserved->preparedLock);
+		}
 		IOFreeType(reserved, ExpansionData);
 	}
 
@@ -4667,6 +4674,153 @@ IOUserClient::removeMappingForDescriptor(IOMemoryDescriptor * mem)
 	return map;
 }
 
+enum { kIOUCPreparedMemoryCount = 8 };
+
+struct IOUCPreparedMemory {
+	IOMemoryDescriptor * md;
+	task_t               task;
+	mach_vm_address_t    address;
+	mach_vm_size_t       length;
+	IOOptionBits         options;
+	uint64_t             lastUse;
+};
+
+static void
+IOUCPreparedMemoryRelease(IOUCPreparedMemory * entry)
+{
+	entry->md->complete();
+	entry->md->release();
+	task_deallocate(entry->task);
+	bzero(entry, sizeof(*entry));
+}
+
+static IOUCPreparedMemory *
+IOUCPreparedMemoryLookup(IOUCPreparedMemory * cache, task_t task,
+    mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options)
+{
+	for (uint32_t idx = 0; idx < kIOUCPreparedMemoryCount; idx++) {
+		IOUCPreparedMemory * entry = &cache[idx];
+		if (entry->md && (task == entry->task) && (address == entry->address)
+		    && (length == entry->length) && (options == entry->options)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+IOMemoryDescriptor *
+IOUserClient::copyPreparedClientMemory(mach_vm_address_t address, mach_vm_size_t length, IOOptionBits options)
+{
+	IOUCPreparedMemory * cache;
+	IOUCPreparedMemory * entry;
+	IOUCPreparedMemory   victim = {};
+	IOMemoryDescriptor * md;
+	task_t               task = current_task();
+
+	if (!reserved || !reserved->preparedLock || !length) {
+		return NULL;
+	}
+
+	IOLockLock(reserved->preparedLock);
+	if (!reserved->preparedMemory) {
+		reserved->preparedMemory = IONewZero(IOUCPreparedMemory, kIOUCPreparedMemoryCount);
+	}
+	cache = reserved->preparedMemory;
+	if (!cache) {
+		IOLockUnlock(reserved->preparedLock);
+		return NULL;
+	}
+	if ((entry = IOUCPreparedMemoryLookup(cache, task, address, length, options))) {
+		entry->lastUse = mach_absolute_time();
+		md = entry->md;
+		md->retain();
+		IOLockUnlock(reserved->preparedLock);
+		return md;
+	}
+	IOLockUnlock(reserved->preparedLock);
+
+	// wire outside the lock, the cache only holds finished descriptors
+	md = IOMemoryDescriptor::withAddressRange(address, length, options, task);
+	if (!md) {
+		return NULL;
+	}
+	if (kIOReturnSuccess != md->prepare()) {
+		md->release();
+		return NULL;
+	}
+
+	IOLockLock(reserved->preparedLock);
+	cache = reserved->preparedMemory;
+	if (cache && (entry = IOUCPreparedMemoryLookup(cache, task, address, length, options))) {
+		// lost a race with another thread preparing the same buffer
+		entry->lastUse = mach_absolute_time();
+		victim.md = md;
+		md = entry->md;
+		md->retain();
+	} else if (!cache) {
+		// flushed while we were wiring
+		victim.md = md;
+		md = NULL;
+	} else {
+		IOUCPreparedMemory * slot = &cache[0];
+		for (uint32_t idx = 0; idx < kIOUCPreparedMemoryCount; idx++) {
+			if (!cache[idx].md) {
+				slot = &cache[idx];
+				break;
+			}
+			if (cache[idx].lastUse < slot->lastUse) {
+				slot = &cache[idx];
+			}
+		}
+		if (slot->md) {
+			victim = *slot;
+		}
+		task_reference(task);
+		md->retain();
+		slot->md      = md;
+		slot->task    = task;
+		slot->address = address;
+		slot->length  = length;
+		slot->options = options;
+		slot->lastUse = mach_absolute_time();
+	}
+	IOLockUnlock(reserved->preparedLock);
+
+	if (victim.task) {
+		IOUCPreparedMemoryRelease(&victim);
+	} else if (victim.md) {
+		victim.md->complete();
+		victim.md->release();
+	}
+
+	return md;
+}
+
+void
+IOUserClient::flushPreparedClientMemory(void)
+{
+	IOUCPreparedMemory * cache;
+
+	if (!reserved || !reserved->preparedLock) {
+		return;
+	}
+
+	IOLockLock(reserved->preparedLock);
+	cache = reserved->preparedMemory;
+	reserved->preparedMemory = NULL;
+	IOLockUnlock(reserved->preparedLock);
+
+	if (!cache) {
+		return;
+	}
+	for (uint32_t idx = 0; idx < kIOUCPreparedMemoryCount; idx++) {
+		if (cache[idx].md) {
+			IOUCPreparedMemoryRelease(&cache[idx]);
+		}
+	}
+	IODelete(cache, IOUCPreparedMemory, kIOUCPreparedMemoryCount);
+}
+
 extern "C" {
 /* Routine io_connect_unmap_memory_from_task */
 kern_return_t
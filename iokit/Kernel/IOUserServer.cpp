@@ -2171,6 +2171,322 @@ IOUserServer::waitInterruptTrap(void * p1, void * p2, void * p3, void * p4, void
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+struct IOUserServerRing {
+	IOBufferMemoryDescriptor * memory;
+	IOUserServerRingHeader   * header;
+	IOSimpleLock             * lock;
+	thread_t                   dextWaiter;
+	uint64_t                   freeMask;
+	uint64_t                   completedMask;
+	uint32_t                   commandHead;
+	uint32_t                   methodCount;
+	uint64_t                   methods[kIOUserServerRingMaxMethods];
+	uint32_t                   generation[kIOUserServerRingSlotCount];
+	uint8_t                    slotEvents[kIOUserServerRingSlotCount];
+	bool                       canceled;
+};
+
+static_assert(kIOUserServerRingSlotCount <= 64, "ring slots are tracked in a uint64_t");
+
+static void
+IOUserServerRingFree(IOUserServerRing * ring)
+{
+	OSSafeReleaseNULL(ring->memory);
+	if (ring->lock) {
+		IOSimpleLockFree(ring->lock);
+	}
+	IOFreeType(ring, IOUserServerRing);
+}
+
+static bool
+IOUserServerRingIsHot(IOUserServerRing * ring, uint64_t msgid)
+{
+	for (uint32_t idx = 0; idx < ring->methodCount; idx++) {
+		if (msgid == ring->methods[idx]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+IOUserServer::ringRPC(IORPCMessageMach * mach, IORPCMessage * message, uint32_t sendSize, uint32_t replySize, IOReturn * result)
+{
+	IOUserServerRing     * ring;
+	IOUserServerRingSlot * slot;
+	IORPCMessage         * copy;
+	IORPCMessage         * reply;
+	OSObject             * object;
+	task_t                 task;
+	uint64_t               msgid, refs, bit;
+	uint32_t               idx, size, replyMax;
+	IOReturn               ret;
+	bool                   completed;
+
+	ring = os_atomic_load(&fRing, acquire);
+	if (!ring) {
+		return false;
+	}
+	msgid = message->msgid;
+	if (!IOUserServerRingIsHot(ring, msgid)) {
+		return false;
+	}
+
+	// only requests whose objects all travel as send rights fit in a slot
+	refs = message->objectRefs;
+	if (refs > mach->msgh_body.msgh_descriptor_count) {
+		return false;
+	}
+	for (idx = 0; idx < mach->msgh_body.msgh_descriptor_count; idx++) {
+		if (MACH_MSG_PORT_DESCRIPTOR != mach->objects[idx].type) {
+			return false;
+		}
+	}
+	size = sendSize - ((uint32_t) (((uintptr_t) message) - ((uintptr_t) mach)));
+	if ((size < sizeof(IORPCMessage) + refs * sizeof(OSObjectRef))
+	    || (size > sizeof(slot->data))) {
+		return false;
+	}
+
+	IOSimpleLockLock(ring->lock);
+	if (ring->canceled || !ring->freeMask || !fOwningTask) {
+		IOSimpleLockUnlock(ring->lock);
+		return false;
+	}
+	idx = __builtin_ctzll(ring->freeMask);
+	bit = (1ULL << idx);
+	ring->freeMask &= ~bit;
+	ring->generation[idx]++;
+	task = fOwningTask;
+	task_reference(task);
+	IOSimpleLockUnlock(ring->lock);
+
+	// the slot is visible to the dext while it is filled in, so the kernel
+	// object pointers in the request are never copied there
+	slot = &ring->header->slots[idx];
+	copy = (typeof(copy)) &slot->data[0];
+	copy->msgid      = msgid;
+	copy->flags      = message->flags;
+	copy->objectRefs = refs;
+	ret = kIOReturnSuccess;
+	for (uint32_t objIdx = 0; objIdx < refs; objIdx++) {
+		object = (OSObject *) message->objects[objIdx];
+		copy->objects[objIdx] = MACH_PORT_NULL;
+		if (object) {
+			copy->objects[objIdx] = iokit_make_send_right(task, object, IKOT_UEXT_OBJECT);
+			if (MACH_PORT_NULL == copy->objects[objIdx]) {
+				ret = kIOReturnNoResources;
+			}
+		}
+	}
+	bcopy(&message->objects[refs], &copy->objects[refs], size - sizeof(IORPCMessage) - refs * sizeof(OSObjectRef));
+	slot->generation = ring->generation[idx];
+	slot->size       = size;
+	slot->state      = kIOUserServerRingSlotSubmitted;
+
+	IOSimpleLockLock(ring->lock);
+	if ((kIOReturnSuccess == ret) && !ring->canceled) {
+		ring->header->commands[ring->commandHead % kIOUserServerRingSlotCount] = idx;
+		ring->commandHead++;
+		os_atomic_store(&ring->header->commandHead, ring->commandHead, release);
+		if (ring->dextWaiter) {
+			thread_wakeup_thread((event_t) &ring->dextWaiter, ring->dextWaiter);
+			ring->dextWaiter = NULL;
+		}
+		while (!(ring->completedMask & bit) && !ring->canceled) {
+			assert_wait((event_t) &ring->slotEvents[idx], THREAD_UNINT);
+			IOSimpleLockUnlock(ring->lock);
+			thread_block(THREAD_CONTINUE_NULL);
+			IOSimpleLockLock(ring->lock);
+		}
+	}
+	completed = (0 != (ring->completedMask & bit));
+	ring->completedMask &= ~bit;
+	IOSimpleLockUnlock(ring->lock);
+	task_deallocate(task);
+
+	if (kIOReturnSuccess != ret) {
+		// nothing was submitted
+	} else if (!completed) {
+		ret = kIOReturnOffline;
+	} else {
+		// the reply is written by the dext, check it like a received message
+		size     = os_atomic_load(&slot->size, relaxed);
+		replyMax = replySize - ((uint32_t) sizeof(IORPCMessageMach));
+		if ((size < sizeof(IORPCMessage)) || (size > replyMax) || (size > sizeof(slot->data))) {
+			ret = MIG_BAD_ARGUMENTS;
+		} else {
+			mach->msgh.msgh_bits                  = 0;
+			mach->msgh.msgh_size                  = ((uint32_t) sizeof(IORPCMessageMach)) + size;
+			mach->msgh.msgh_id                    = kIORPCVersionCurrentReply;
+			mach->msgh_body.msgh_descriptor_count = 0;
+			reply = IORPCMessageFromMach(mach, true);
+			bcopy(&slot->data[0], reply, size);
+			if ((reply->msgid != msgid) || reply->objectRefs) {
+				ret = MIG_BAD_ARGUMENTS;
+			} else if (kIORPCMessageError & reply->flags) {
+				if (size < sizeof(IORPCMessageErrorReturnContent)) {
+					ret = MIG_BAD_ARGUMENTS;
+				} else {
+					ret = ((IORPCMessageErrorReturnContent *) reply)->result;
+				}
+			}
+		}
+	}
+
+	slot->state = kIOUserServerRingSlotFree;
+	IOSimpleLockLock(ring->lock);
+	ring->freeMask |= bit;
+	IOSimpleLockUnlock(ring->lock);
+
+	*result = ret;
+	return true;
+}
+
+kern_return_t
+IOUserServer::ringWaitTrap(void * p1, void * p2, void * p3, void * p4, void * p5, void * p6)
+{
+	IOUserServerRing * ring;
+	uint32_t           completedIdx, generation, consumed;
+	wait_result_t      waitResult;
+	IOReturn           ret;
+
+	ring = os_atomic_load(&fRing, acquire);
+	if (!ring) {
+		return kIOReturnNotReady;
+	}
+	completedIdx = (uint32_t)(uintptr_t) p1;
+	consumed     = (uint32_t)(uintptr_t) p2;
+	generation   = (uint32_t)(uintptr_t) p3;
+
+	ret = kIOReturnSuccess;
+	IOSimpleLockLock(ring->lock);
+	// p1 is the completed slot index plus one, zero when only waiting
+	if (completedIdx) {
+		completedIdx--;
+		if ((completedIdx >= kIOUserServerRingSlotCount)
+		    || (ring->freeMask & (1ULL << completedIdx))
+		    || (generation != ring->generation[completedIdx])) {
+			ret = kIOReturnBadArgument;
+		} else {
+			ring->completedMask |= (1ULL << completedIdx);
+			thread_wakeup((event_t) &ring->slotEvents[completedIdx]);
+		}
+	}
+	while ((kIOReturnSuccess == ret) && !ring->canceled && (consumed == ring->commandHead)) {
+		if (ring->dextWaiter) {
+			ret = kIOReturnBusy;
+			break;
+		}
+		ring->dextWaiter = current_thread();
+		assert_wait((event_t) &ring->dextWaiter, THREAD_INTERRUPTIBLE);
+		IOSimpleLockUnlock(ring->lock);
+		waitResult = thread_block(THREAD_CONTINUE_NULL);
+		IOSimpleLockLock(ring->lock);
+		if (THREAD_INTERRUPTED == waitResult) {
+			if (current_thread() == ring->dextWaiter) {
+				ring->dextWaiter = NULL;
+			}
+			ret = kIOReturnAborted;
+		}
+	}
+	if ((kIOReturnSuccess == ret) && ring->canceled) {
+		ret = kIOReturnAborted;
+	}
+	IOSimpleLockUnlock(ring->lock);
+
+	return ret;
+}
+
+void
+IOUserServer::ringCancel(void)
+{
+	IOUserServerRing * ring;
+
+	ring = os_atomic_load(&fRing, acquire);
+	if (!ring) {
+		return;
+	}
+	IOSimpleLockLock(ring->lock);
+	ring->canceled = true;
+	for (uint32_t idx = 0; idx < kIOUserServerRingSlotCount; idx++) {
+		thread_wakeup((event_t) &ring->slotEvents[idx]);
+	}
+	if (ring->dextWaiter) {
+		thread_wakeup_thread((event_t) &ring->dextWaiter, ring->dextWaiter);
+		ring->dextWaiter = NULL;
+	}
+	IOSimpleLockUnlock(ring->lock);
+}
+
+IOReturn
+IOUserServer::externalMethodRingConfigure(OSObject * target, void * reference, IOExternalMethodArguments * args)
+{
+	IOUserServer     * me = (typeof(me))target;
+	IOUserServerRing * ring;
+	uint32_t           count;
+	IOReturn           ret;
+
+	count = args->structureInputSize / sizeof(uint64_t);
+	if (!count || (count > kIOUserServerRingMaxMethods)
+	    || (args->structureInputSize != count * sizeof(uint64_t))) {
+		return kIOReturnBadArgument;
+	}
+
+	ring = IOMallocType(IOUserServerRing);
+	ring->memory = IOBufferMemoryDescriptor::inTaskWithOptions(kernel_task,
+	    kIODirectionInOut | kIOMemoryKernelUserShared,
+	    round_page(sizeof(IOUserServerRingHeader)), page_size);
+	ring->lock = IOSimpleLockAlloc();
+	if (!ring->memory || !ring->lock) {
+		IOUserServerRingFree(ring);
+		return kIOReturnNoMemory;
+	}
+	ring->header = (typeof(ring->header))ring->memory->getBytesNoCopy();
+	bzero(ring->header, sizeof(*ring->header));
+	ring->header->version   = kIOUserServerRingVersion;
+	ring->header->slotCount = kIOUserServerRingSlotCount;
+	ring->freeMask          = (kIOUserServerRingSlotCount == 64) ? -1ULL : ((1ULL << kIOUserServerRingSlotCount) - 1);
+	ring->methodCount       = count;
+	bcopy(args->structureInput, &ring->methods[0], count * sizeof(uint64_t));
+
+	ret = kIOReturnSuccess;
+	IOLockLock(me->fLock);
+	if (me->fRing) {
+		ret = kIOReturnStillOpen;
+	} else {
+		os_atomic_store(&me->fRing, ring, release);
+	}
+	IOLockUnlock(me->fLock);
+
+	if (kIOReturnSuccess != ret) {
+		IOUserServerRingFree(ring);
+	}
+
+	return ret;
+}
+
+IOReturn
+IOUserServer::clientMemoryForType(UInt32 type, IOOptionBits * options, IOMemoryDescriptor ** memory)
+{
+	IOUserServerRing * ring;
+
+	if (kIOUserServerRingMemoryType != type) {
+		return kIOReturnUnsupported;
+	}
+	ring = os_atomic_load(&fRing, acquire);
+	if (!ring) {
+		return kIOReturnNotReady;
+	}
+	ring->memory->retain();
+	*memory  = ring->memory;
+	*options = 0;
+
+	return kIOReturnSuccess;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
 kern_return_t
 IOUserServer::Create_Impl(
 	const char * name,
@@ -3450,6 +3766,11 @@ IOUserServer::rpc(IORPC rpc)
 
 	oneway = (0 != (kIORPCMessageOneway & message->flags));
 
+	if (!oneway && ringRPC(mach, message, sendSize, replySize, &ret)) {
+		ipc_port_release_send(sendPort);
+		return ret;
+	}
+
 	ret = copyOutObjects(mach, message, sendSize, false);
 
 	mach->msgh.msgh_bits = MACH_MSGH_BITS_COMPLEX |
@@ -4122,6 +4443,8 @@ IOUserServer::clientClose(void)
 	powerManagementFailed = fPowerManagementFailed;
 	IOLockUnlock(fLock);
 
+	ringCancel();
+
 	// if this was a an expected exit, termination and stop should have detached at this
 	// point, so send any provider still attached and not owned by this user server
 	// the ClientCrashed() notification
@@ -4184,6 +4507,7 @@ IOUserServer::setProperties(OSObject * properties)
 void
 IOUserServer::stop(IOService * provider)
 {
+	ringCancel();
 	if (fOwningTask) {
 		task_deallocate(fOwningTask);
 		fOwningTask = TASK_NULL;
@@ -4223,6 +4547,10 @@ IOUserServer::free()
 	if (fTaskCrashReason != OS_REASON_NULL) {
 		os_reason_free(fTaskCrashReason);
 	}
+	if (fRing) {
+		IOUserServerRingFree(fRing);
+		fRing = NULL;
+	}
 	IOUserClient::free();
 }
 
@@ -4392,6 +4720,15 @@ IOUserServer::externalMethod(uint32_t selector, IOExternalMethodArgumentsOpaque
 			.allowAsync               = false,
 			.checkEntitlement         = NULL,
 		},
+		[kIOUserServerMethodRingConfigure] = {
+			.function                 = &IOUserServer::externalMethodRingConfigure,
+			.checkScalarInputCount    = 0,
+			.checkStructureInputSize  = kIOUCVariableStructureSize,
+			.checkScalarOutputCount   = 0,
+			.checkStructureOutputSize = 0,
+			.allowAsync               = false,
+			.checkEntitlement         = NULL,
+		},
 	};
 
 	return dispatchExternalMethod(selector, args, dispatchArray, sizeof(dispatchArray) / sizeof(dispatchArray[0]), this, NULL);
@@ -4448,8 +4785,9 @@ IOUserServer::externalMethodStart(OSObject * target, void * reference, IOExterna
 IOExternalTrap *
 IOUserServer::getTargetAndTrapForIndex( IOService **targetP, UInt32 index )
 {
-	static const OSBoundedArray<IOExternalTrap, 1> trapTemplate = {{
+	static const OSBoundedArray<IOExternalTrap, 2> trapTemplate = {{
 									       { NULL, (IOTrap) & IOUserServer::waitInterruptTrap},
+									       { NULL, (IOTrap) & IOUserServer::ringWaitTrap},
 								       }};
 	if (index >= trapTemplate.size()) {
 		return NULL;
@@ -210,6 +210,63 @@ IOWorkLoop::workLoopWithOptions(IOOptionBits options)
 	return me;
 }
 
+IOWorkLoop *
+IOWorkLoop::workLoopWithGroups(uint32_t groupCount, IOOptionBits options)
+{
+	IOWorkLoop *me;
+
+	if (!groupCount) {
+		return NULL;
+	}
+
+	me = IOWorkLoop::workLoopWithOptions(options);
+	if (!me || groupCount == 1) {
+		return me;
+	}
+
+	me->reserved->groups = IONewZero(IOWorkLoop *, groupCount);
+	if (!me->reserved->groups) {
+		me->release();
+		return NULL;
+	}
+	me->reserved->groupCount = groupCount;
+
+	// Group 0 is the work loop itself and is not retained
+	me->reserved->groups[0] = me;
+	for (uint32_t group = 1; group < groupCount; group++) {
+		me->reserved->groups[group] = IOWorkLoop::workLoopWithOptions(options);
+		if (!me->reserved->groups[group]) {
+			me->release();
+			return NULL;
+		}
+	}
+
+	return me;
+}
+
+void
+IOWorkLoop::releaseGroups()
+{
+	IOWorkLoop **groups;
+	uint32_t     groupCount;
+
+	if (!reserved || !reserved->groups) {
+		return;
+	}
+
+	groups = reserved->groups;
+	groupCount = reserved->groupCount;
+	reserved->groups = NULL;
+	reserved->groupCount = 0;
+
+	for (uint32_t group = 1; group < groupCount; group++) {
+		if (groups[group]) {
+			groups[group]->release();
+		}
+	}
+	IODelete(groups, IOWorkLoop *, groupCount);
+}
+
 void
 IOWorkLoop::releaseEventChain(LIBKERN_CONSUMED IOEventSource *eventChain)
 {
@@ -258,7 +315,12 @@ IOWorkLoop::free()
 		IOSimpleLockUnlockEnableInterrupt(workToDoLock, is);
 
 		openGate();
+
+		// The other groups shut down their own threads the same way
+		releaseGroups();
 	} else { /* !workThread */
+		releaseGroups();
+
 		releaseEventChain(eventChain);
 		eventChain = NULL;
 
@@ -315,6 +377,51 @@ IOWorkLoop::removeEventSource(IOEventSource *toRemove)
 	return controlG->runCommand((void *) mRemoveEvent, (void *) toRemove);
 }
 
+uint32_t
+IOWorkLoop::getGroupCount() const
+{
+	return (reserved && reserved->groups) ? reserved->groupCount : 1;
+}
+
+IOWorkLoop *
+IOWorkLoop::getGroup(uint32_t group) const
+{
+	if (group >= getGroupCount()) {
+		return NULL;
+	}
+	if (!group) {
+		return const_cast<IOWorkLoop *>(this);
+	}
+	return reserved->groups[group];
+}
+
+IOReturn
+IOWorkLoop::addEventSourceToGroup(IOEventSource *newEvent, uint32_t group)
+{
+	IOWorkLoop *wl = getGroup(group);
+
+	if (!wl) {
+		return kIOReturnBadArgument;
+	}
+	return wl->addEventSource(newEvent);
+}
+
+void
+IOWorkLoop::closeAllGates()
+{
+	for (uint32_t group = 0; group < getGroupCount(); group++) {
+		getGroup(group)->closeGate();
+	}
+}
+
+void
+IOWorkLoop::openAllGates()
+{
+	for (uint32_t group = getGroupCount(); group-- > 0;) {
+		getGroup(group)->openGate();
+	}
+}
+
 void
 IOWorkLoop::enableAllEventSources() const
 {
@@ -327,6 +434,10 @@ IOWorkLoop::enableAllEventSources() const
 	for (event = passiveEventChain; event; event = event->getNext()) {
 		event->enable();
 	}
+
+	for (uint32_t group = 1; group < getGroupCount(); group++) {
+		reserved->groups[group]->enableAllEventSources();
+	}
 }
 
 void
@@ -344,6 +455,10 @@ IOWorkLoop::disableAllEventSources() const
 			event->disable();
 		}
 	}
+
+	for (uint32_t group = 1; group < getGroupCount(); group++) {
+		reserved->groups[group]->disableAllEventSources();
+	}
 }
 
 void
@@ -356,6 +471,10 @@ IOWorkLoop::enableAllInterrupts() const
 			event->enable();
 		}
 	}
+
+	for (uint32_t group = 1; group < getGroupCount(); group++) {
+		reserved->groups[group]->enableAllInterrupts();
+	}
 }
 
 void
@@ -368,6 +487,10 @@ IOWorkLoop::disableAllInterrupts() const
 			event->disable();
 		}
 	}
+
+	for (uint32_t group = 1; group < getGroupCount(); group++) {
+		reserved->groups[group]->disableAllInterrupts();
+	}
 }
 
 
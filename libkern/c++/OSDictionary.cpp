@@ -39,6 +39,7 @@
 #include <libkern/c++/OSSharedPtr.h>
 #include <libkern/c++/OSSymbol.h>
 #include <os/cpp_util.h>
+#include <os/hash.h>
 
 #define super OSCollection
 
@@ -80,6 +81,111 @@ OSDictionary::sortBySymbol(void)
 	    &OSDictionary::dictEntry::compare);
 }
 
+/*
+ * Large unsorted dictionaries (IORegistry property tables, kext
+ * personalities) keep a hash index of their entries, keyed on the symbol
+ * pointer, so that lookups aren't a scan of the whole array.  The array
+ * itself, and so the iteration order, is the same with or without it.
+ */
+unsigned int
+OSDictionary::findEntry(const OSSymbol *aKey) const
+{
+	unsigned int i;
+
+	if (reserved && reserved->hashTable) {
+		unsigned int mask = reserved->hashSize - 1;
+		unsigned int slot = os_hash_kernel_pointer(aKey) & mask;
+
+		// the table is never more than half full, so this ends
+		while ((i = reserved->hashTable[slot]) != 0) {
+			if (aKey == dictionary[i - 1].key) {
+				return i - 1;
+			}
+			slot = (slot + 1) & mask;
+		}
+		return count;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (aKey == dictionary[i].key) {
+			break;
+		}
+	}
+	return i;
+}
+
+void
+OSDictionary::hashInsert(unsigned int index)
+{
+	unsigned int mask = reserved->hashSize - 1;
+	unsigned int slot = os_hash_kernel_pointer(dictionary[index].key.get()) & mask;
+
+	while (reserved->hashTable[slot] != 0) {
+		slot = (slot + 1) & mask;
+	}
+	reserved->hashTable[slot] = index + 1;
+}
+
+// Re-index all entries, first sizing the index for capacity if resize is set.
+void
+OSDictionary::hashRebuild(bool resize)
+{
+	if ((fOptions & kSort) || count <= kHashThreshold) {
+		hashFree();
+		return;
+	}
+
+	if (!reserved) {
+		reserved = (typeof(reserved))kalloc_type(ExpansionData, (zalloc_flags_t)(Z_WAITOK | Z_ZERO));
+		if (!reserved) {
+			return;
+		}
+	}
+
+	unsigned int size = 2 * kHashThreshold;
+
+	while (size < 2 * capacity && size < (UINT_MAX / 2 / sizeof(unsigned int))) {
+		size <<= 1;
+	}
+	if (!reserved->hashTable || (resize && size != reserved->hashSize)) {
+		unsigned int *table;
+
+		table = (unsigned int *)kalloc_data(size * sizeof(unsigned int), Z_WAITOK_ZERO);
+		if (!table) {
+			// keep scanning
+			hashFree();
+			return;
+		}
+		if (reserved->hashTable) {
+			kfree_data(reserved->hashTable, reserved->hashSize * sizeof(unsigned int));
+			OSCONTAINER_ACCUMSIZE(-(reserved->hashSize * sizeof(unsigned int)));
+		}
+		OSCONTAINER_ACCUMSIZE(size * sizeof(unsigned int));
+		reserved->hashTable = table;
+		reserved->hashSize = size;
+	} else {
+		bzero(reserved->hashTable, reserved->hashSize * sizeof(unsigned int));
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		hashInsert(i);
+	}
+}
+
+void
+OSDictionary::hashFree()
+{
+	if (!reserved) {
+		return;
+	}
+	if (reserved->hashTable) {
+		kfree_data(reserved->hashTable, reserved->hashSize * sizeof(unsigned int));
+		OSCONTAINER_ACCUMSIZE(-(reserved->hashSize * sizeof(unsigned int)));
+	}
+	kfree_type(ExpansionData, reserved);
+	reserved = NULL;
+}
+
 bool
 OSDictionary::initWithCapacity(unsigned int inCapacity)
 {
@@ -215,6 +321,7 @@ OSDictionary::initWithDictionary(const OSDictionary *dict,
 	if ((kSort & fOptions) && !(kSort & dict->fOptions)) {
 		sortBySymbol();
 	}
+	hashRebuild(true);
 
 	return true;
 }
@@ -279,6 +386,7 @@ OSDictionary::free()
 {
 	(void) super::setOptions(0, kImmutable);
 	flushCollection();
+	hashFree();
 	if (dictionary) {
 		kfree_type(dictEntry, capacity, dictionary);
 		OSCONTAINER_ACCUMSIZE( -(capacity * sizeof(dictEntry)));
@@ -352,6 +460,7 @@ OSDictionary::flushCollection()
 		dictionary[i].value.reset();
 	}
 	count = 0;
+	hashFree();
 }
 
 bool
@@ -371,11 +480,8 @@ setObject(const OSSymbol *aKey, const OSMetaClassBase *anObject, bool onlyAdd)
 		i = OSSymbol::bsearch(aKey, &dictionary[0], count, sizeof(dictionary[0]));
 		exists = (i < count) && (aKey == dictionary[i].key);
 	} else {
-		for (exists = false, i = 0; i < count; i++) {
-			if ((exists = (aKey == dictionary[i].key))) {
-				break;
-			}
-		}
+		i = findEntry(aKey);
+		exists = (i < count);
 	}
 
 	if (exists) {
@@ -405,6 +511,15 @@ setObject(const OSSymbol *aKey, const OSMetaClassBase *anObject, bool onlyAdd)
 	dictionary[i].value.reset(anObject, OSRetain);
 	count++;
 
+	if (!(fOptions & kSort)) {
+		// unsorted entries are appended, so only the new one needs indexing
+		if (reserved && reserved->hashTable && 2 * count <= reserved->hashSize) {
+			hashInsert(i);
+		} else if (count > kHashThreshold) {
+			hashRebuild(true);
+		}
+	}
+
 	return true;
 }
 
@@ -449,11 +564,8 @@ OSDictionary::removeObject(const OSSymbol *aKey)
 		i = OSSymbol::bsearch(aKey, &dictionary[0], count, sizeof(dictionary[0]));
 		exists = (i < count) && (aKey == dictionary[i].key);
 	} else {
-		for (exists = false, i = 0; i < count; i++) {
-			if ((exists = (aKey == dictionary[i].key))) {
-				break;
-			}
-		}
+		i = findEntry(aKey);
+		exists = (i < count);
 	}
 
 	if (exists) {
@@ -463,6 +575,9 @@ OSDictionary::removeObject(const OSSymbol *aKey)
 
 		count--;
 		bcopy(&dictionary[i + 1], &dictionary[i], (count - i) * sizeof(dictionary[0]));
+		if (reserved) {
+			hashRebuild(false);
+		}
 
 		oldEntry.key->taggedRelease(OSTypeID(OSCollection));
 		oldEntry.value->taggedRelease(OSTypeID(OSCollection));
@@ -529,10 +644,9 @@ OSDictionary::getObject(const OSSymbol *aKey) const
 			}
 		}
 	} else {
-		for (i = l; i < r; i++) {
-			if (aKey == dictionary[i].key) {
-				return const_cast<OSObject *> ((const OSObject *)dictionary[i].value.get());
-			}
+		i = findEntry(aKey);
+		if (i < count) {
+			return const_cast<OSObject *> ((const OSObject *)dictionary[i].value.get());
 		}
 	}
 
@@ -769,6 +883,9 @@ OSDictionary::setOptions(unsigned options, unsigned mask, void *)
 
 	if (!(old & kSort) && (fOptions & kSort)) {
 		sortBySymbol();
+		hashFree();
+	} else if ((old & kSort) && !(fOptions & kSort)) {
+		hashRebuild(true);
 	}
 
 	return old;
@@ -103,6 +103,7 @@ extern int dtrace_keep_kernel_symbols(void);
 extern kern_return_t i386_slide_individual_kext(kernel_mach_header_t *mh, uintptr_t slide);
 extern kern_return_t i386_slide_kext_collection_mh_addrs(kernel_mach_header_t *mh, uintptr_t slide, bool adjust_mach_headers);
 extern void *ubc_getobject_from_filename(const char *filename, struct vnode **, off_t *file_size);
+extern int advisory_read(struct vnode *vp, off_t filesize, off_t f_offset, int resid);
 static void *allocate_kcfileset_map_entry_list(void);
 static void add_kcfileset_map_entry(void *map_entry_list, vm_map_offset_t start, vm_map_offset_t size);
 static void deallocate_kcfileset_map_entry_list_and_unmap_entries(void *map_entry_list, boolean_t unmap_entries, bool pageable);
@@ -6243,6 +6244,9 @@ OSKext::load(
 	unsigned int         i, count;
 	Boolean              alreadyLoaded                = false;
 	OSKext             * lastLoadedKext               = NULL;        // do not release
+	uint64_t             loadStartTime                = 0;
+	uint64_t             loadEndTime                  = 0;
+	uint64_t             startEndTime                 = 0;
 
 	if (isInExcludeList()) {
 		OSKextLog(this,
@@ -6478,6 +6482,7 @@ OSKext::load(
 		}
 	}
 
+	loadStartTime = mach_absolute_time();
 	result = loadExecutable();
 	if (result != KERN_SUCCESS) {
 		goto finish;
@@ -6566,9 +6571,15 @@ OSKext::load(
 	}
 
 loaded:
+	if (loadStartTime) {
+		loadEndTime = mach_absolute_time();
+	}
 	if (isExecutable() && !flags.started) {
 		if (startOpt == kOSKextExcludeNone) {
 			result = start();
+			if (loadStartTime) {
+				startEndTime = mach_absolute_time();
+			}
 			if (result != kOSReturnSuccess) {
 				OSKextLog(this,
 				    kOSKextLogErrorLevel | kOSKextLogLoadFlag,
@@ -6602,6 +6613,19 @@ finish:
 		    kOSKextLogLoadFlag,
 		    "Kext %s loaded.",
 		    getIdentifierCString());
+		if (loadStartTime) {
+			uint64_t loadNs, startNs = 0;
+
+			absolutetime_to_nanoseconds(loadEndTime - loadStartTime, &loadNs);
+			if (startEndTime) {
+				absolutetime_to_nanoseconds(startEndTime - loadEndTime, &startNs);
+			}
+			OSKextLog(this,
+			    kOSKextLogDetailLevel |
+			    kOSKextLogLoadFlag,
+			    "Kext %s load took %llu us, start took %llu us.",
+			    getIdentifierCString(), loadNs / NSEC_PER_USEC, startNs / NSEC_PER_USEC);
+		}
 
 		queueKextNotification(kKextRequestPredicateLoadNotification,
 		    OSDynamicCast(OSString, bundleID.get()));
@@ -13206,6 +13230,88 @@ finish:
 }
 
 
+#if VM_MAPPED_KEXTS
+/*********************************************************************
+* Every kext in an AuxKC is normally started shortly after the KC is
+* mapped, and each load faults its segments in from the KC vnode one
+* page at a time while holding sKextLock. Read the file into the UBC
+* ahead of that from a few threads, so the serial loads hit the cache.
+*********************************************************************/
+#define kOSKextKCPrefetchThreads    4
+#define kOSKextKCPrefetchChunkSize  (4 * 1024 * 1024)
+
+struct OSKextKCPrefetch {
+	struct vnode * vp;
+	off_t          fsize;
+	SInt32         nextChunk;
+	SInt32         chunkCount;
+	SInt32         activeThreads;
+	uint64_t       startTime;
+};
+
+static void
+OSKextKCPrefetchThread(thread_call_param_t param0, thread_call_param_t param1)
+{
+	OSKextKCPrefetch * prefetch = (OSKextKCPrefetch *) param0;
+	SInt32             chunk;
+	off_t              offset;
+	uint64_t           elapsedNs;
+
+	while ((chunk = OSIncrementAtomic(&prefetch->nextChunk)) < prefetch->chunkCount) {
+		offset = ((off_t) chunk) * kOSKextKCPrefetchChunkSize;
+		(void) advisory_read(prefetch->vp, prefetch->fsize, offset,
+		    (int) MIN(kOSKextKCPrefetchChunkSize, prefetch->fsize - offset));
+	}
+
+	thread_call_free((thread_call_t) param1);
+	if (1 == OSDecrementAtomic(&prefetch->activeThreads)) {
+		absolutetime_to_nanoseconds(mach_absolute_time() - prefetch->startTime, &elapsedNs);
+		OSKextLog(/* kext */ NULL, kOSKextLogDetailLevel | kOSKextLogLoadFlag,
+		    "Prefetched %lld bytes of Aux KC in %llu us.",
+		    (long long) prefetch->fsize, elapsedNs / NSEC_PER_USEC);
+		kfree_type(OSKextKCPrefetch, prefetch);
+	}
+}
+
+static void
+OSKextPrefetchKCFileSet(struct vnode * vp, off_t fsize)
+{
+	OSKextKCPrefetch * prefetch;
+	thread_call_t      calls[kOSKextKCPrefetchThreads];
+	SInt32             threads;
+
+	if (fsize <= 0) {
+		return;
+	}
+	prefetch = kalloc_type(OSKextKCPrefetch, Z_WAITOK | Z_ZERO);
+	if (!prefetch) {
+		return;
+	}
+	prefetch->vp         = vp;
+	prefetch->fsize      = fsize;
+	prefetch->chunkCount = (SInt32) howmany(fsize, kOSKextKCPrefetchChunkSize);
+	prefetch->startTime  = mach_absolute_time();
+
+	threads = MIN(kOSKextKCPrefetchThreads, prefetch->chunkCount);
+	for (SInt32 idx = 0; idx < threads; idx++) {
+		calls[idx] = thread_call_allocate_with_priority(&OSKextKCPrefetchThread,
+		    prefetch, THREAD_CALL_PRIORITY_KERNEL);
+		if (!calls[idx]) {
+			threads = idx;
+			break;
+		}
+	}
+	if (!threads) {
+		kfree_type(OSKextKCPrefetch, prefetch);
+		return;
+	}
+	prefetch->activeThreads = threads;
+	for (SInt32 idx = 0; idx < threads; idx++) {
+		thread_call_enter1(calls[idx], calls[idx]);
+	}
+}
+#endif /* VM_MAPPED_KEXTS */
+
 /*********************************************************************
 * Assumes sKextLock is held.
 *********************************************************************/
@@ -13302,6 +13408,7 @@ finish:
 			pageableKCloaded = true;
 		} else {
 			auxKCloaded = true;
+			OSKextPrefetchKCFileSet(vp, fsize);
 		}
 	} else {
 		vnode_put(vp);
@@ -330,7 +330,8 @@ OSSerialize::binarySerializeInternal(const OSMetaClassBase *o)
 #define setAtIndex(v, idx, o)                                                  \
 	ok = idx < v##Capacity;                                                \
 	if (!ok && v##Capacity < v##CapacityMax) {                             \
-	    uint32_t ncap = v##Capacity + 64;                                  \
+	    uint32_t ncap = v##Capacity ? 2 * v##Capacity : 64;                \
+	    if (ncap > v##CapacityMax) ncap = v##CapacityMax;                  \
 	    typeof(v##Array) nbuf = kreallocp_type_container(OSObject *,       \
 	        v##Array, v##Capacity, &ncap, Z_WAITOK_ZERO);                  \
 	    if (nbuf) {                                                        \
@@ -343,8 +344,8 @@ OSSerialize::binarySerializeInternal(const OSMetaClassBase *o)
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-OSObject *
-OSUnserializeBinary(const char *buffer, size_t bufferSize, OSString **errorString)
+static OSObject *
+OSUnserializeBinaryWithOptions(const char *buffer, size_t bufferSize, bool noCopy, OSString **errorString)
 {
 	OSObject ** objsArray;
 	uint32_t    objsCapacity;
@@ -485,7 +486,14 @@ OSUnserializeBinary(const char *buffer, size_t bufferSize, OSString **errorStrin
 			if (bufferPos > bufferSize) {
 				break;
 			}
-			o = OSString::withCString((const char *) next, len);
+			// strings are not terminated in the encoding, reference the
+			// buffer only when the padding happens to supply the NUL
+			if (noCopy && (len < (wordLen * sizeof(uint32_t))) && !((const char *) next)[len]
+			    && (strnlen((const char *) next, len) == len)) {
+				o = OSString::withCStringNoCopy((const char *) next);
+			} else {
+				o = OSString::withCString((const char *) next, len);
+			}
 			next += wordLen;
 			break;
 
@@ -494,7 +502,11 @@ OSUnserializeBinary(const char *buffer, size_t bufferSize, OSString **errorStrin
 			if (bufferPos > bufferSize) {
 				break;
 			}
-			o = OSData::withBytes(next, len);
+			if (noCopy && len) {
+				o = OSData::withBytesNoCopy((void *) next, len);
+			} else {
+				o = OSData::withBytes(next, len);
+			}
 			next += wordLen;
 			break;
 
@@ -646,6 +658,18 @@ OSUnserializeXML(
 	return result;
 }
 
+OSObject *
+OSUnserializeBinary(const char *buffer, size_t bufferSize, OSString **errorString)
+{
+	return OSUnserializeBinaryWithOptions(buffer, bufferSize, false, errorString);
+}
+
+OSObject *
+OSUnserializeBinaryNoCopy(const char *buffer, size_t bufferSize, OSString **errorString)
+{
+	return OSUnserializeBinaryWithOptions(buffer, bufferSize, true, errorString);
+}
+
 OSObject*
 OSUnserializeBinary(const char *buffer, size_t bufferSize, OSSharedPtr<OSString>& errorString)
 {
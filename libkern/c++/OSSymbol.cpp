@@ -33,6 +33,7 @@
 #include <sys/cdefs.h>
 
 #include <kern/locks.h>
+#include <kern/smr.h>
 
 #include <libkern/c++/OSSymbol.h>
 #include <libkern/c++/OSSharedPtr.h>
@@ -42,8 +43,14 @@
 
 #define super OSString
 
-typedef struct { unsigned int i, j; } OSSymbolPoolState;
-
+/*
+ * The symbol pool is split into shards selected by string hash, each with
+ * its own table and writer lock.  Lookups never take a lock: tables and
+ * buckets are immutable once published and are replaced copy-on-write by
+ * writers, readers walk them inside an SMR read section and the writers
+ * only reclaim the old copies (and the symbols removed with them) once
+ * every reader that could have seen them has left.
+ */
 #define INITIAL_POOL_SIZE  ((unsigned int)((exp2ml(1 + log2(kInitBucketCount)))))
 
 #define GROW_FACTOR   (1)
@@ -62,17 +69,43 @@ while (0)
     } \
 while (0)
 
+struct OSSymbolRetired {
+	OSSymbolRetired *next;
+	smr_seq_t        seq;
+	bool             isTable;
+};
+
+struct OSSymbolBucket {
+	OSSymbolRetired  retired;
+	OSSymbol        *freeSym;       // released along with the bucket
+	unsigned int     count;
+	OSSymbol        *symbols[];
+};
+
+SMR_POINTER_DECL(OSSymbolBucketRef, OSSymbolBucket *);
+
+struct OSSymbolTable {
+	OSSymbolRetired  retired;
+	unsigned int     nBuckets;
+	struct OSSymbolBucketRef buckets[];
+};
+
+SMR_POINTER_DECL(OSSymbolTableRef, OSSymbolTable *);
+
 class OSSymbolPool
 {
 private:
-	static const unsigned int kInitBucketCount = 16;
+	static const unsigned int kInitBucketCount = 8;
+	static const unsigned int kShardCount = 16;
 
-	typedef struct { unsigned int count; OSSymbol **symbolP; } Bucket;
+	static struct smr poolSMR;
+	static OSSymbolPool *shards;
 
-	Bucket *buckets;
-	unsigned int nBuckets;
+	lck_mtx_t poolLock;
+	struct OSSymbolTableRef table;
 	unsigned int count;
-	lck_rw_t *poolGate;
+	OSSymbolRetired *retiredHead;
+	OSSymbolRetired **retiredTail;
 
 	static inline void
 	hashSymbol(const char *s,
@@ -105,120 +138,99 @@ private:
 		*hashP = hash;
 	}
 
-	static unsigned long log2(unsigned int x);
-	static unsigned long exp2ml(unsigned long x);
-
-	void reconstructSymbols(void);
-	void reconstructSymbols(bool grow);
-
-public:
-	static void *operator new(size_t size);
-	static void operator delete(void *mem, size_t size);
-
-	OSSymbolPool()
+	static inline bool
+	symbolMatches(OSSymbol *probeSymbol, const char *cString, unsigned int inLen)
 	{
+		return inLen == probeSymbol->length
+		       && strncmp(probeSymbol->string, cString, probeSymbol->length) == 0;
 	}
-	OSSymbolPool(const OSSymbolPool *old);
-	virtual
-	~OSSymbolPool();
-
-	bool init();
 
-	inline void
-	closeReadGate()
+	static inline OSSymbolPool *
+	shardForHash(unsigned int hash)
 	{
-		lck_rw_lock(poolGate, LCK_RW_TYPE_SHARED);
+		/*
+		 * Use the top bits of a multiplicative hash so that the shard
+		 * choice stays independent of the bucket index (hash % nBuckets).
+		 */
+		return &shards[(hash * 0x9e3779b1u) >> 28];
 	}
 
-	inline void
-	openReadGate()
-	{
-		lck_rw_unlock(poolGate, LCK_RW_TYPE_SHARED);
-	}
+	static unsigned long log2(unsigned int x);
+	static unsigned long exp2ml(unsigned long x);
+
+	static OSSymbolTable *allocTable(unsigned int nBuckets);
+	static OSSymbolBucket *allocBucket(unsigned int count);
+	static void destroyRetired(OSSymbolRetired *list);
+
+	static OSSymbolBucket *bucketWith(OSSymbolBucket *old, OSSymbol *sym);
+	static OSSymbolBucket *bucketWithout(OSSymbolBucket *old, unsigned int idx);
+
+	void retire(OSSymbolRetired *item);
+	OSSymbolRetired *reclaimRetired();
+	void reconstructSymbols(bool grow);
+
+public:
+	static bool init();
 
+	static OSSymbolPool *poolForString(const char *cString);
 
 	inline void
 	closeWriteGate()
 	{
-		lck_rw_lock(poolGate, LCK_RW_TYPE_EXCLUSIVE);
+		lck_mtx_lock(&poolLock);
 	}
 
 	inline void
 	openWriteGate()
 	{
-		lck_rw_unlock(poolGate, LCK_RW_TYPE_EXCLUSIVE);
+		OSSymbolRetired *reclaimed = reclaimRetired();
+
+		lck_mtx_unlock(&poolLock);
+		destroyRetired(reclaimed);
 	}
 
-	OSSharedPtr<OSSymbol> findSymbol(const char *cString) const;
+	static OSSharedPtr<OSSymbol> findSymbol(const char *cString);
 	OSSharedPtr<OSSymbol> insertSymbol(OSSymbol *sym);
 	void removeSymbol(OSSymbol *sym);
 
-	OSSymbolPoolState initHashState();
-	LIBKERN_RETURNS_NOT_RETAINED OSSymbol * nextHashState(OSSymbolPoolState *stateP);
+	static void checkForPageUnload(void *startAddr, void *endAddr);
 };
 
-void *
-OSSymbolPool::operator new(__assert_only size_t size)
-{
-	OSMETA_ACCUMSIZE(size);
-	assert(size == sizeof(OSSymbolPool));
-
-	return (void *)kalloc_type_tag(OSSymbolPool, Z_WAITOK_ZERO_NOFAIL,
-	           VM_KERN_MEMORY_LIBKERN);
-}
-
-void
-OSSymbolPool::operator delete(void *mem, __assert_only size_t size)
-{
-	assert(size == sizeof(OSSymbolPool));
-	kfree_type(OSSymbolPool, mem);
-}
+struct smr OSSymbolPool::poolSMR;
+OSSymbolPool *OSSymbolPool::shards;
 
 extern lck_grp_t *IOLockGroup;
 
 bool
 OSSymbolPool::init()
 {
-	count = 0;
-	nBuckets = INITIAL_POOL_SIZE;
-	buckets = kalloc_type_tag(Bucket, nBuckets, Z_WAITOK_ZERO,
+	smr_init(&poolSMR);
+
+	shards = kalloc_type_tag(OSSymbolPool, kShardCount, Z_WAITOK_ZERO,
 	    VM_KERN_MEMORY_LIBKERN);
-	if (!buckets) {
+	if (!shards) {
 		return false;
 	}
-	OSMETA_ACCUMSIZE(nBuckets * sizeof(Bucket));
+	OSMETA_ACCUMSIZE(kShardCount * sizeof(OSSymbolPool));
 
-	poolGate = lck_rw_alloc_init(IOLockGroup, LCK_ATTR_NULL);
+	for (unsigned int i = 0; i < kShardCount; i++) {
+		OSSymbolPool *shard = &shards[i];
 
-	return poolGate != NULL;
-}
-
-OSSymbolPool::OSSymbolPool(const OSSymbolPool *old)
-{
-	count = old->count;
-	nBuckets = old->nBuckets;
-	buckets = old->buckets;
+		lck_mtx_init(&shard->poolLock, IOLockGroup, LCK_ATTR_NULL);
+		smr_init_store(&shard->table, allocTable(INITIAL_POOL_SIZE));
+		shard->retiredTail = &shard->retiredHead;
+	}
 
-	poolGate = NULL; // Do not duplicate the poolGate
+	return true;
 }
 
-OSSymbolPool::~OSSymbolPool()
+OSSymbolPool *
+OSSymbolPool::poolForString(const char *cString)
 {
-	if (buckets) {
-		Bucket *thisBucket;
-		for (thisBucket = &buckets[0]; thisBucket < &buckets[nBuckets]; thisBucket++) {
-			if (thisBucket->count > 1) {
-				kfree_type(OSSymbol *, thisBucket->count, thisBucket->symbolP);
-				OSMETA_ACCUMSIZE(-(thisBucket->count * sizeof(OSSymbol *)));
-			}
-		}
-		kfree_type(Bucket, nBuckets, buckets);
-		OSMETA_ACCUMSIZE(-(nBuckets * sizeof(Bucket)));
-	}
+	unsigned int hash, len;
 
-	if (poolGate) {
-		lck_rw_free(poolGate, IOLockGroup);
-	}
+	hashSymbol(cString, &hash, &len);
+	return shardForHash(hash);
 }
 
 unsigned long
@@ -238,183 +250,251 @@ OSSymbolPool::exp2ml(unsigned long x)
 	return (1 << x) - 1;
 }
 
-OSSymbolPoolState
-OSSymbolPool::initHashState()
+OSSymbolTable *
+OSSymbolPool::allocTable(unsigned int nBuckets)
+{
+	OSSymbolTable *newTable;
+
+	newTable = kalloc_type_tag(OSSymbolTable, struct OSSymbolBucketRef,
+	    nBuckets, Z_WAITOK_ZERO_NOFAIL, VM_KERN_MEMORY_LIBKERN);
+	OSMETA_ACCUMSIZE(sizeof(OSSymbolTable) +
+	    nBuckets * sizeof(struct OSSymbolBucketRef));
+	newTable->retired.isTable = true;
+	newTable->nBuckets = nBuckets;
+
+	return newTable;
+}
+
+OSSymbolBucket *
+OSSymbolPool::allocBucket(unsigned int count)
 {
-	OSSymbolPoolState newState = { nBuckets, 0 };
-	return newState;
+	OSSymbolBucket *newBucket;
+
+	newBucket = kalloc_type_tag(OSSymbolBucket, OSSymbol *, count,
+	    Z_WAITOK_ZERO_NOFAIL, VM_KERN_MEMORY_LIBKERN);
+	OSMETA_ACCUMSIZE(sizeof(OSSymbolBucket) + count * sizeof(OSSymbol *));
+	newBucket->count = count;
+
+	return newBucket;
 }
 
-OSSymbol *
-OSSymbolPool::nextHashState(OSSymbolPoolState *stateP)
+void
+OSSymbolPool::destroyRetired(OSSymbolRetired *list)
 {
-	Bucket *thisBucket = &buckets[stateP->i];
+	OSSymbolRetired *next;
+
+	for (; list; list = next) {
+		next = list->next;
+
+		if (list->isTable) {
+			OSSymbolTable *oldTable = (OSSymbolTable *)list;
+			unsigned int nBuckets = oldTable->nBuckets;
 
-	while (!stateP->j) {
-		if (!stateP->i) {
-			return NULL;
+			kfree_type(OSSymbolTable, struct OSSymbolBucketRef,
+			    nBuckets, oldTable);
+			OSMETA_ACCUMSIZE(-(sizeof(OSSymbolTable) +
+			    nBuckets * sizeof(struct OSSymbolBucketRef)));
+		} else {
+			OSSymbolBucket *oldBucket = (OSSymbolBucket *)list;
+			unsigned int count = oldBucket->count;
+
+			if (oldBucket->freeSym) {
+				oldBucket->freeSym->OSString::free();
+			}
+			kfree_type(OSSymbolBucket, OSSymbol *, count, oldBucket);
+			OSMETA_ACCUMSIZE(-(sizeof(OSSymbolBucket) +
+			    count * sizeof(OSSymbol *)));
 		}
-		stateP->i--;
-		thisBucket--;
-		stateP->j = thisBucket->count;
 	}
+}
 
-	stateP->j--;
-	if (thisBucket->count == 1) {
-		return (OSSymbol *) thisBucket->symbolP;
-	} else {
-		return thisBucket->symbolP[stateP->j];
+OSSymbolBucket *
+OSSymbolPool::bucketWith(OSSymbolBucket *old, OSSymbol *sym)
+{
+	unsigned int j = old ? old->count : 0;
+	OSSymbolBucket *newBucket = allocBucket(j + 1);
+
+	newBucket->symbols[0] = sym;
+	if (j) {
+		bcopy(old->symbols, newBucket->symbols + 1, j * sizeof(OSSymbol *));
+	}
+
+	return newBucket;
+}
+
+OSSymbolBucket *
+OSSymbolPool::bucketWithout(OSSymbolBucket *old, unsigned int idx)
+{
+	OSSymbolBucket *newBucket;
+
+	if (old->count == 1) {
+		return NULL;
 	}
+
+	newBucket = allocBucket(old->count - 1);
+	bcopy(old->symbols, newBucket->symbols, idx * sizeof(OSSymbol *));
+	bcopy(old->symbols + idx + 1, newBucket->symbols + idx,
+	    (old->count - 1 - idx) * sizeof(OSSymbol *));
+
+	return newBucket;
 }
 
 void
-OSSymbolPool::reconstructSymbols(void)
+OSSymbolPool::retire(OSSymbolRetired *item)
+{
+	item->next = NULL;
+	item->seq = smr_advance(&poolSMR);
+	*retiredTail = item;
+	retiredTail = &item->next;
+}
+
+OSSymbolRetired *
+OSSymbolPool::reclaimRetired()
 {
-	this->reconstructSymbols(true);
+	OSSymbolRetired *list = retiredHead, *item;
+	OSSymbolRetired **tail = &retiredHead;
+
+	/* Sequence numbers only grow, so stop at the first unfinished one. */
+	for (item = retiredHead; item; item = item->next) {
+		if (!smr_poll(&poolSMR, item->seq)) {
+			break;
+		}
+		tail = &item->next;
+	}
+
+	if (tail == &retiredHead) {
+		return NULL;
+	}
+
+	*tail = NULL;
+	retiredHead = item;
+	if (!item) {
+		retiredTail = &retiredHead;
+	}
+
+	return list;
 }
 
 void
 OSSymbolPool::reconstructSymbols(bool grow)
 {
-	unsigned int new_nBuckets = nBuckets;
-	OSSymbol *insert;
-	OSSymbolPoolState state;
+	OSSymbolTable *oldTable = smr_serialized_load(&table);
+	OSSymbolTable *newTable;
+	unsigned int new_nBuckets = oldTable->nBuckets;
 
 	if (grow) {
 		new_nBuckets += new_nBuckets + 1;
 	} else {
 		/* Don't shrink the pool below the default initial size.
 		 */
-		if (nBuckets <= INITIAL_POOL_SIZE) {
+		if (oldTable->nBuckets <= INITIAL_POOL_SIZE) {
 			return;
 		}
 		new_nBuckets = (new_nBuckets - 1) / 2;
 	}
 
-	/* Create old pool to iterate after doing above check, cause it
-	 * gets finalized at return.
+	/*
+	 * Build the new table privately, publish it, then retire the old
+	 * table and its buckets: readers may still be walking them.
 	 */
-	OSSymbolPool old(this);
+	newTable = allocTable(new_nBuckets);
 
-	count = 0;
-	nBuckets = new_nBuckets;
-	buckets = kalloc_type_tag(Bucket, nBuckets, Z_WAITOK_ZERO,
-	    VM_KERN_MEMORY_LIBKERN);
-	OSMETA_ACCUMSIZE(nBuckets * sizeof(Bucket));
-	/* @@@ gvdl: Zero test and panic if can't set up pool */
+	for (unsigned int i = 0; i < oldTable->nBuckets; i++) {
+		OSSymbolBucket *oldBucket = smr_serialized_load(&oldTable->buckets[i]);
+
+		if (!oldBucket) {
+			continue;
+		}
+
+		for (unsigned int j = 0; j < oldBucket->count; j++) {
+			OSSymbol *sym = oldBucket->symbols[j];
+			struct OSSymbolBucketRef *ref;
+			OSSymbolBucket *probeBucket;
+			unsigned int hash, len;
+
+			hashSymbol(sym->string, &hash, &len);
+			ref = &newTable->buckets[hash % new_nBuckets];
+			probeBucket = smr_serialized_load(ref);
+			smr_init_store(ref, bucketWith(probeBucket, sym));
+			if (probeBucket) {
+				destroyRetired(&probeBucket->retired);
+			}
+		}
 
-	state = old.initHashState();
-	while ((insert = old.nextHashState(&state))) {
-		insertSymbol(insert);
+		retire(&oldBucket->retired);
 	}
+
+	smr_serialized_store(&table, newTable);
+	retire(&oldTable->retired);
 }
 
 OSSharedPtr<OSSymbol>
-OSSymbolPool::findSymbol(const char *cString) const
+OSSymbolPool::findSymbol(const char *cString)
 {
-	Bucket *thisBucket;
+	OSSymbolPool *pool;
+	OSSymbolTable *thisTable;
+	OSSymbolBucket *thisBucket;
 	unsigned int j, inLen, hash;
-	OSSymbol *probeSymbol, **list;
+	OSSymbol *probeSymbol;
 	OSSharedPtr<OSSymbol> ret;
 
 	hashSymbol(cString, &hash, &inLen); inLen++;
-	thisBucket = &buckets[hash % nBuckets];
-	j = thisBucket->count;
+	pool = shardForHash(hash);
 
-	if (!j) {
-		return NULL;
-	}
+	smr_enter(&poolSMR);
 
-	if (j == 1) {
-		probeSymbol = (OSSymbol *) thisBucket->symbolP;
+	thisTable = smr_entered_load(&pool->table);
+	thisBucket = smr_entered_load(&thisTable->buckets[hash % thisTable->nBuckets]);
 
-		if (inLen == probeSymbol->length
-		    && strncmp(probeSymbol->string, cString, probeSymbol->length) == 0
+	for (j = 0; thisBucket && j < thisBucket->count; j++) {
+		probeSymbol = thisBucket->symbols[j];
+		/*
+		 * A symbol whose last reference is being dropped fails the
+		 * retain, which is treated as a miss: the caller will insert
+		 * a fresh symbol under the writer lock.
+		 */
+		if (symbolMatches(probeSymbol, cString, inLen)
 		    && probeSymbol->taggedTryRetain(nullptr)) {
 			ret.reset(probeSymbol, OSNoRetain);
-			return ret;
+			break;
 		}
-		return NULL;
 	}
 
-	for (list = thisBucket->symbolP; j--; list++) {
-		probeSymbol = *list;
-		if (inLen == probeSymbol->length
-		    && strncmp(probeSymbol->string, cString, probeSymbol->length) == 0
-		    && probeSymbol->taggedTryRetain(nullptr)) {
-			ret.reset(probeSymbol, OSNoRetain);
-			return ret;
-		}
-	}
+	smr_leave(&poolSMR);
 
-	return NULL;
+	return ret;
 }
 
 OSSharedPtr<OSSymbol>
 OSSymbolPool::insertSymbol(OSSymbol *sym)
 {
 	const char *cString = sym->string;
-	Bucket *thisBucket;
-	unsigned int j, inLen, hash;
-	OSSymbol *probeSymbol, **list;
+	OSSymbolTable *thisTable = smr_serialized_load(&table);
+	struct OSSymbolBucketRef *ref;
+	OSSymbolBucket *thisBucket;
+	unsigned int j, inLen, hash, nBuckets;
+	OSSymbol *probeSymbol;
 	OSSharedPtr<OSSymbol> ret;
 
 	hashSymbol(cString, &hash, &inLen); inLen++;
-	thisBucket = &buckets[hash % nBuckets];
-	j = thisBucket->count;
-
-	if (!j) {
-		thisBucket->symbolP = (OSSymbol **) sym;
-		thisBucket->count++;
-		count++;
-		return nullptr;
-	}
-
-	if (j == 1) {
-		probeSymbol = (OSSymbol *) thisBucket->symbolP;
+	nBuckets = thisTable->nBuckets;
+	ref = &thisTable->buckets[hash % nBuckets];
+	thisBucket = smr_serialized_load(ref);
 
-		if (inLen == probeSymbol->length
-		    && strncmp(probeSymbol->string, cString, probeSymbol->length) == 0
+	for (j = 0; thisBucket && j < thisBucket->count; j++) {
+		probeSymbol = thisBucket->symbols[j];
+		if (symbolMatches(probeSymbol, cString, inLen)
 		    && probeSymbol->taggedTryRetain(nullptr)) {
 			ret.reset(probeSymbol, OSNoRetain);
 			return ret;
 		}
-
-		list = kalloc_type_tag(OSSymbol *, 2, Z_WAITOK_ZERO_NOFAIL,
-		    VM_KERN_MEMORY_LIBKERN);
-		OSMETA_ACCUMSIZE(2 * sizeof(OSSymbol *));
-		/* @@@ gvdl: Zero test and panic if can't set up pool */
-		list[0] = sym;
-		list[1] = probeSymbol;
-		thisBucket->symbolP = list;
-		thisBucket->count++;
-		count++;
-		GROW_POOL();
-
-		return nullptr;
 	}
 
-	for (list = thisBucket->symbolP; j--; list++) {
-		probeSymbol = *list;
-		if (inLen == probeSymbol->length
-		    && strncmp(probeSymbol->string, cString, probeSymbol->length) == 0
-		    && probeSymbol->taggedTryRetain(nullptr)) {
-			ret.reset(probeSymbol, OSNoRetain);
-			return ret;
-		}
+	smr_serialized_store(ref, bucketWith(thisBucket, sym));
+	if (thisBucket) {
+		retire(&thisBucket->retired);
 	}
-
-	j = thisBucket->count++;
 	count++;
-	list = kalloc_type_tag(OSSymbol *, thisBucket->count, Z_WAITOK_ZERO,
-	    VM_KERN_MEMORY_LIBKERN);
-	/* @@@ gvdl: Zero test and panic if can't set up pool */
-	list[0] = sym;
-	bcopy(thisBucket->symbolP, list + 1, j * sizeof(OSSymbol *));
-	kfree_type(OSSymbol *, j, thisBucket->symbolP);
-
-	OSMETA_ACCUMSIZE((thisBucket->count - j) * sizeof(OSSymbol *));
-	thisBucket->symbolP = list;
 	GROW_POOL();
 
 	return nullptr;
@@ -423,87 +503,57 @@ OSSymbolPool::insertSymbol(OSSymbol *sym)
 void
 OSSymbolPool::removeSymbol(OSSymbol *sym)
 {
-	Bucket *thisBucket;
-	unsigned int j, inLen, hash;
-	OSSymbol *probeSymbol, **list;
+	OSSymbolTable *thisTable = smr_serialized_load(&table);
+	struct OSSymbolBucketRef *ref;
+	OSSymbolBucket *thisBucket;
+	unsigned int j, inLen, hash, nBuckets;
 
 	hashSymbol(sym->string, &hash, &inLen); inLen++;
-	thisBucket = &buckets[hash % nBuckets];
-	j = thisBucket->count;
-	list = thisBucket->symbolP;
-
-	if (!j) {
-		// couldn't find the symbol; probably means string hash changed
-		panic("removeSymbol %s count %d ", sym->string ? sym->string : "no string", count);
-		return;
-	}
-
-	if (j == 1) {
-		probeSymbol = (OSSymbol *) list;
-
-		if (probeSymbol == sym) {
-			thisBucket->symbolP = NULL;
+	nBuckets = thisTable->nBuckets;
+	ref = &thisTable->buckets[hash % nBuckets];
+	thisBucket = smr_serialized_load(ref);
+
+	for (j = 0; thisBucket && j < thisBucket->count; j++) {
+		if (thisBucket->symbols[j] == sym) {
+			smr_serialized_store(ref, bucketWithout(thisBucket, j));
+			/* Lookups may still hold the symbol, free it with the bucket. */
+			thisBucket->freeSym = sym;
+			retire(&thisBucket->retired);
 			count--;
-			thisBucket->count--;
 			SHRINK_POOL();
 			return;
 		}
-		// couldn't find the symbol; probably means string hash changed
-		panic("removeSymbol %s count %d ", sym->string ? sym->string : "no string", count);
-		return;
 	}
 
-	if (j == 2) {
-		probeSymbol = list[0];
-		if (probeSymbol == sym) {
-			thisBucket->symbolP = (OSSymbol **) list[1];
-			kfree_type(OSSymbol *, 2, list);
-			OSMETA_ACCUMSIZE(-(2 * sizeof(OSSymbol *)));
-			count--;
-			thisBucket->count--;
-			SHRINK_POOL();
-			return;
-		}
+	// couldn't find the symbol; probably means string hash changed
+	panic("removeSymbol %s count %d ", sym->string ? sym->string : "no string", count);
+}
 
-		probeSymbol = list[1];
-		if (probeSymbol == sym) {
-			thisBucket->symbolP = (OSSymbol **) list[0];
-			kfree_type(OSSymbol *, 2, list);
-			OSMETA_ACCUMSIZE(-(2 * sizeof(OSSymbol *)));
-			count--;
-			thisBucket->count--;
-			SHRINK_POOL();
-			return;
-		}
-		// couldn't find the symbol; probably means string hash changed
-		panic("removeSymbol %s count %d ", sym->string ? sym->string : "no string", count);
-		return;
-	}
-
-	for (; j--; list++) {
-		probeSymbol = *list;
-		if (probeSymbol == sym) {
-			list = kalloc_type_tag(OSSymbol *, thisBucket->count - 1,
-			    Z_WAITOK, VM_KERN_MEMORY_LIBKERN);
-			if (thisBucket->count - 1 != j) {
-				bcopy(thisBucket->symbolP, list,
-				    (thisBucket->count - 1 - j) * sizeof(OSSymbol *));
-			}
-			if (j) {
-				bcopy(thisBucket->symbolP + thisBucket->count - j,
-				    list + thisBucket->count - 1 - j,
-				    j * sizeof(OSSymbol *));
+void
+OSSymbolPool::checkForPageUnload(void *startAddr, void *endAddr)
+{
+	for (unsigned int i = 0; i < kShardCount; i++) {
+		OSSymbolPool *pool = &shards[i];
+		OSSymbolTable *thisTable;
+
+		pool->closeWriteGate();
+		thisTable = smr_serialized_load(&pool->table);
+		for (unsigned int j = 0; j < thisTable->nBuckets; j++) {
+			OSSymbolBucket *thisBucket = smr_serialized_load(&thisTable->buckets[j]);
+
+			for (unsigned int k = 0; thisBucket && k < thisBucket->count; k++) {
+				OSSymbol *probeSymbol = thisBucket->symbols[k];
+
+				if (probeSymbol->string >= startAddr && probeSymbol->string < endAddr) {
+					probeSymbol->OSString::initWithCString(probeSymbol->string);
+				}
 			}
-			kfree_type(OSSymbol *, thisBucket->count, thisBucket->symbolP);
-			OSMETA_ACCUMSIZE(-sizeof(OSSymbol *));
-			thisBucket->symbolP = list;
-			count--;
-			thisBucket->count--;
-			return;
 		}
+		pool->openWriteGate();
 	}
-	// couldn't find the symbol; probably means string hash changed
-	panic("removeSymbol %s count %d ", sym->string ? sym->string : "no string", count);
+
+	/* Make sure no lookup is still comparing against the old strings. */
+	smr_synchronize(&poolSMR);
 }
 
 /*
@@ -522,19 +572,11 @@ OSMetaClassDefineReservedUnused(OSSymbol, 5);
 OSMetaClassDefineReservedUnused(OSSymbol, 6);
 OSMetaClassDefineReservedUnused(OSSymbol, 7);
 
-static OSSymbolPool *pool;
-
 void
 OSSymbol::initialize()
 {
-	pool = new OSSymbolPool;
-	assert(pool);
-
-	if (pool && !pool->init()) {
-		delete pool;
-		assert(false);
-	}
-	;
+	__assert_only bool ok = OSSymbolPool::init();
+	assert(ok);
 }
 
 bool
@@ -573,7 +615,7 @@ OSSymbol::withCString(const char *cString)
 	OSSharedPtr<const OSSymbol> symbol;
 
 	// Check if the symbol exists already, we don't need to take a lock here,
-	// since existingSymbolForCString will take the shared lock.
+	// since existingSymbolForCString only needs an SMR read section.
 	symbol = OSSymbol::existingSymbolForCString(cString);
 	if (symbol) {
 		return symbol;
@@ -585,6 +627,8 @@ OSSymbol::withCString(const char *cString)
 	}
 
 	if (newSymb->OSString::initWithCString(cString)) {
+		OSSymbolPool *pool = OSSymbolPool::poolForString(newSymb->string);
+
 		pool->closeWriteGate();
 		symbol = pool->insertSymbol(newSymb.get());
 		pool->openWriteGate();
@@ -606,7 +650,7 @@ OSSymbol::withCStringNoCopy(const char *cString)
 	OSSharedPtr<OSSymbol> newSymb;
 
 	// Check if the symbol exists already, we don't need to take a lock here,
-	// since existingSymbolForCString will take the shared lock.
+	// since existingSymbolForCString only needs an SMR read section.
 	symbol = OSSymbol::existingSymbolForCString(cString);
 	if (symbol) {
 		return symbol;
@@ -618,6 +662,8 @@ OSSymbol::withCStringNoCopy(const char *cString)
 	}
 
 	if (newSymb->OSString::initWithCStringNoCopy(cString)) {
+		OSSymbolPool *pool = OSSymbolPool::poolForString(newSymb->string);
+
 		pool->closeWriteGate();
 		symbol = pool->insertSymbol(newSymb.get());
 		pool->openWriteGate();
@@ -649,29 +695,13 @@ OSSymbol::existingSymbolForString(const OSString *aString)
 OSSharedPtr<const OSSymbol>
 OSSymbol::existingSymbolForCString(const char *cString)
 {
-	OSSharedPtr<OSSymbol> symbol;
-
-	pool->closeReadGate();
-	symbol = pool->findSymbol(cString);
-	pool->openReadGate();
-
-	return os::move(symbol);
+	return OSSymbolPool::findSymbol(cString);
 }
 
 void
 OSSymbol::checkForPageUnload(void *startAddr, void *endAddr)
 {
-	OSSymbol *probeSymbol;
-	OSSymbolPoolState state;
-
-	pool->closeWriteGate();
-	state = pool->initHashState();
-	while ((probeSymbol = pool->nextHashState(&state))) {
-		if (probeSymbol->string >= startAddr && probeSymbol->string < endAddr) {
-			probeSymbol->OSString::initWithCString(probeSymbol->string);
-		}
-	}
-	pool->openWriteGate();
+	OSSymbolPool::checkForPageUnload(startAddr, endAddr);
 }
 
 void
@@ -689,10 +719,15 @@ OSSymbol::taggedRelease(const void *tag, const int when) const
 void
 OSSymbol::free()
 {
+	OSSymbolPool *pool = OSSymbolPool::poolForString(string);
+
+	/*
+	 * Lookups may still be looking at this symbol, the pool calls
+	 * super::free() once they are all done.
+	 */
 	pool->closeWriteGate();
 	pool->removeSymbol(this);
 	pool->openWriteGate();
-	super::free();
 }
 
 bool
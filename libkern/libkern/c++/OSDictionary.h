@@ -152,13 +152,34 @@ protected:
 	unsigned int   capacity;
 	unsigned int   capacityIncrement;
 
-	struct ExpansionData { };
+#endif /* APPLE_KEXT_ALIGN_CONTAINERS */
+
+#ifdef XNU_KERNEL_PRIVATE
+/* Available within xnu source only */
+protected:
+	struct ExpansionData {
+		/*
+		 * Open addressed index of an unsorted dictionary that has
+		 * grown past kHashThreshold entries: each slot holds a
+		 * position in dictionary plus one, or 0 if free.
+		 */
+		unsigned int * hashTable;
+		unsigned int   hashSize;      /* slots, a power of 2 */
+	};
+	enum { kHashThreshold = 16 };
+
+	unsigned int findEntry(const OSSymbol *aKey) const;
+	void hashInsert(unsigned int index);
+	void hashRebuild(bool resize);
+	void hashFree();
+#else /* XNU_KERNEL_PRIVATE */
+protected:
+	struct ExpansionData;
+#endif /* XNU_KERNEL_PRIVATE */
 
 /* Reserved for future use.  (Internal use only)  */
 	ExpansionData * reserved;
 
-#endif /* APPLE_KEXT_ALIGN_CONTAINERS */
-
 // Member functions used by the OSCollectionIterator class.
 	virtual unsigned int iteratorSize() const APPLE_KEXT_OVERRIDE;
 	virtual bool initIterator(void * iterator) const APPLE_KEXT_OVERRIDE;
@@ -114,6 +114,33 @@ OSUnserializeBinary(const char *buffer, size_t bufferSize, OSString * *errorStri
 extern "C++" OSPtr<OSObject>
 OSUnserializeBinary(const char *buffer, size_t bufferSize, OSSharedPtr<OSString>& errorString);
 
+#ifdef XNU_KERNEL_PRIVATE
+/*!
+ * @function OSUnserializeBinaryNoCopy
+ *
+ * @abstract
+ * Recreates a container object from its binary serialization,
+ * referencing data and string contents in place.
+ *
+ * @param  buffer      A buffer containing a binary serialization.
+ * @param  bufferSize  The size in bytes of the buffer.
+ * @param  errorString Not currently used.
+ *
+ * @result
+ * The recreated object, or <code>NULL</code> on failure.
+ *
+ * @discussion
+ * OSData objects, and OSString objects whose encoding is followed by a NUL
+ * pad byte, are created "NoCopy" over the serialized bytes rather than
+ * allocating a copy. The caller must keep <code>buffer</code> allocated and
+ * unmodified for as long as any object in the result exists, and the
+ * returned data and strings cannot be modified.
+ * <b>Not safe</b> to call in a primary interrupt handler.
+ */
+extern "C++" OSPtr<OSObject>
+OSUnserializeBinaryNoCopy(const char *buffer, size_t bufferSize, OSString * *errorString);
+#endif /* XNU_KERNEL_PRIVATE */
+
 #ifdef __APPLE_API_OBSOLETE
 extern OSPtr<OSObject> OSUnserialize(const char *buffer, OSString * *errorString = NULL);
 
@@ -205,12 +205,37 @@ log_add_arg(os_log_context_t ctx, os_log_fmt_cmd_type_t type, void *arg, size_t
 	return ENOMEM;
 }
 
+/*
+ * Looks for an already encoded argument with the same contents. Ranges carry
+ * their own offset, so a repeated argument can simply point at the earlier
+ * copy instead of being stored in the pubdata section again.
+ */
+static os_log_fmt_range_t
+log_find_public_data(os_log_context_t ctx, os_log_fmt_range_t *ranges,
+    uint16_t *lengths, int cnt, int pub_i, uint16_t length)
+{
+	const char *arg = ctx->ctx_pubdata[pub_i];
+
+	for (int i = 0; i < cnt; i++) {
+		if (ranges[i]->truncated || lengths[i] != length) {
+			continue;
+		}
+		if (ctx->ctx_pubdata[i] == arg || memcmp(ctx->ctx_pubdata[i], arg, length) == 0) {
+			return ranges[i];
+		}
+	}
+
+	return NULL;
+}
+
 static void
 log_encode_public_data(os_log_context_t ctx)
 {
 	const uint16_t orig_content_off = ctx->ctx_content_off;
 	os_log_fmt_hdr_t const hdr = ctx->ctx_hdr;
 	os_log_fmt_cmd_t cmd = (os_log_fmt_cmd_t)hdr->hdr_data;
+	os_log_fmt_range_t ranges[OS_LOG_MAX_PUB_ARGS];
+	uint16_t lengths[OS_LOG_MAX_PUB_ARGS];
 
 	assert(ctx->ctx_pubdata_cnt <= hdr->hdr_cmd_cnt);
 
@@ -221,6 +246,18 @@ log_encode_public_data(os_log_context_t ctx)
 
 		os_log_fmt_range_t const range __attribute__((aligned(8))) = (os_log_fmt_range_t)&cmd->cmd_data;
 
+		assert(pub_i < ctx->ctx_pubdata_cnt);
+		lengths[pub_i] = range->length;
+		ranges[pub_i] = range;
+
+		os_log_fmt_range_t const dup = log_find_public_data(ctx, ranges, lengths,
+		    pub_i, pub_i, range->length);
+		if (dup) {
+			log_range_update(range, dup->offset, dup->length);
+			pub_i++;
+			continue;
+		}
+
 		// Fix offset and length of the argument data in the hdr.
 		log_range_update(range, ctx->ctx_content_off - orig_content_off,
 		    MIN(range->length, ctx->ctx_content_sz - ctx->ctx_content_off));
@@ -229,7 +266,6 @@ log_encode_public_data(os_log_context_t ctx)
 			ctx->ctx_truncated = true;
 		}
 
-		assert(pub_i < ctx->ctx_pubdata_cnt);
 		log_add_range_data(ctx, range, ctx->ctx_pubdata[pub_i++]);
 	}
 }
@@ -23,6 +23,7 @@
  */
 
 #include <kern/assert.h>
+#include <kern/clock.h>
 #include <kern/counter.h>
 #include <kern/cpu_data.h>
 #include <kern/percpu.h>
@@ -41,6 +42,7 @@
 #define LQ_MIN_LOG_SZ_ORDER 5
 #define LQ_MAX_LOG_SZ_ORDER 11
 #define LQ_BATCH_SIZE 24
+#define LQ_MAX_DRAIN_BATCHES 4
 #define LQ_MAX_LM_SLOTS 8
 #define LQ_LOW_MEM_SCALE 3
 
@@ -74,6 +76,7 @@ typedef struct log_queue_entry {
 	uint16_t                        lqe_size;
 	uint16_t                        lqe_lm_id;
 	_Atomic log_queue_entry_state_t lqe_state;
+	uint64_t                        lqe_queued_at;
 	log_payload_s                   lqe_payload;
 } log_queue_entry_s, *log_queue_entry_t;
 
@@ -120,6 +123,12 @@ extern bool os_log_disabled(void);
  *
  * If extensive number of logs is expected, setting aforementioned boot-args as
  * needed allows to capture the vast majority of logs and avoid drops.
+ *
+ * Queued logs are drained on the next successful firehose send from the same
+ * cpu, in batches of LQ_BATCH_SIZE. As long as whole batches make it into the
+ * firehose, up to LQ_MAX_DRAIN_BATCHES are handed off back to back so that a
+ * burst is not drained only as fast as new logs arrive. The time logs spend
+ * queued is tracked in the drain latency counters.
  */
 TUNABLE(size_t, lq_bootarg_size_order, "lq_size_order", LQ_DEFAULT_SZ_ORDER);
 TUNABLE(size_t, lq_bootarg_nslots, "lq_nslots", LQ_MAX_LM_SLOTS);
@@ -133,6 +142,11 @@ SCALABLE_COUNTER_DEFINE(log_queue_cnt_dropped_off);
 SCALABLE_COUNTER_DEFINE(log_queue_cnt_mem_allocated);
 SCALABLE_COUNTER_DEFINE(log_queue_cnt_mem_released);
 SCALABLE_COUNTER_DEFINE(log_queue_cnt_mem_failed);
+SCALABLE_COUNTER_DEFINE(log_queue_cnt_drain_batches);
+SCALABLE_COUNTER_DEFINE(log_queue_cnt_drain_latency);
+
+/* Longest time (in absolute time units) a log spent queued before being sent. */
+uint64_t log_queue_drain_latency_max;
 
 static log_queue_s PERCPU_DATA(oslog_queue);
 static size_t lq_low_mem_limit;
@@ -210,6 +224,7 @@ log_queue_add_entry(log_queue_t lq, log_payload_t lp, const uint8_t *lp_data)
 	assert(lqe->lqe_size >= lp->lp_data_size);
 
 	lqe->lqe_payload = *lp;
+	lqe->lqe_queued_at = mach_absolute_time();
 	(void) memcpy((uint8_t *)lqe + sizeof(*lqe), lp_data, lqe->lqe_payload.lp_data_size);
 	STAILQ_INSERT_TAIL(&lq->lq_log_list, lqe, lqe_link);
 	publish(&lqe->lqe_state, LOG_QUEUE_ENTRY_STATE_STORED);
@@ -291,9 +306,11 @@ log_dispatch_prepare(log_queue_t lq, size_t requested, log_queue_entry_t *buf)
  * Streaming does not process timestamps and would therefore show logs out of
  * order.
  */
-static void
+static size_t
 log_queue_dispatch_logs(size_t logs_count, log_queue_entry_t *logs)
 {
+	size_t sent = 0;
+
 	for (size_t i = 0; i < logs_count; i++) {
 		const log_queue_entry_t lqe = logs[i];
 		log_queue_entry_state_t lqe_state = log_queue_entry_state(lqe);
@@ -308,6 +325,7 @@ log_queue_dispatch_logs(size_t logs_count, log_queue_entry_t *logs)
 				.lp_data_size = read_dependent(&lqe_lp->lp_data_size, lqe_state)
 			};
 			const void *lp_data = (uint8_t *)lqe + sizeof(*lqe);
+			const uint64_t queued_at = read_dependent_w(&lqe->lqe_queued_at, lqe_state);
 
 			/*
 			 * The log queue mechanism expects only the state to be
@@ -316,13 +334,24 @@ log_queue_dispatch_logs(size_t logs_count, log_queue_entry_t *logs)
 			 * later in dispatch_list_cleanup().
 			 */
 			if (log_payload_send(&lp, lp_data, false)) {
+				const uint64_t latency = mach_absolute_time() - queued_at;
+
 				publish(&lqe->lqe_state, LOG_QUEUE_ENTRY_STATE_SENT);
 				counter_inc(&log_queue_cnt_sent);
+				counter_add(&log_queue_cnt_drain_latency, latency);
+				os_atomic_max(&log_queue_drain_latency_max, latency, relaxed);
+				sent++;
 			} else {
 				publish(&lqe->lqe_state, LOG_QUEUE_ENTRY_STATE_FAILED);
 			}
 		}
 	}
+
+	if (logs_count > 0) {
+		counter_inc(&log_queue_cnt_drain_batches);
+	}
+
+	return sent;
 }
 
 static bool
@@ -532,18 +561,23 @@ detect_new_suspend(log_queue_t lq)
 	return false;
 }
 
-static void
+/*
+ * Returns true when a full batch of logs was sent, i.e. there may be more
+ * queued logs worth draining right away.
+ */
+static bool
 log_queue_dispatch(void)
 {
 	lq_mem_state_t new_mem_state = LQ_MEM_STATE_READY;
 	void *reclaimed_memory = NULL;
+	size_t sent = 0;
 
 	disable_preemption();
 
 	log_queue_t lq = PERCPU_GET(oslog_queue);
 	if (__improbable(!lq->lq_ready)) {
 		enable_preemption();
-		return;
+		return false;
 	}
 
 	dispatch_list_cleanup(lq);
@@ -577,12 +611,14 @@ log_queue_dispatch(void)
 		log_queue_order_memory(lq);
 	/* FALLTHROUGH */
 	case LQ_MEM_STATE_READY:
-		log_queue_dispatch_logs(logs_count, logs);
+		sent = log_queue_dispatch_logs(logs_count, logs);
 		break;
 	default:
 		panic("Invalid log memory state %u", new_mem_state);
 		break;
 	}
+
+	return sent == LQ_BATCH_SIZE;
 }
 
 static bool
@@ -687,7 +723,11 @@ log_queue_log(log_payload_t lp, const void *lp_data, bool stream)
 
 	if (log_payload_send(lp, lp_data, stream)) {
 		counter_inc(&log_queue_cnt_sent);
-		log_queue_dispatch();
+		for (int i = 0; i < LQ_MAX_DRAIN_BATCHES; i++) {
+			if (!log_queue_dispatch()) {
+				break;
+			}
+		}
 		return true;
 	}
 	counter_inc(&log_queue_cnt_rejected_fh);
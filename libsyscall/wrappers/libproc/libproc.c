@@ -134,6 +134,12 @@ proc_listcoalitions(int flavor, int coaltype, void *buffer, int buffersize)
 	return retval;
 }
 
+int
+proc_pidinfo_batch(struct proc_pidinfo_batch_entry *entries, int count, void *buffer, int buffersize)
+{
+	return __proc_info(PROC_INFO_CALL_PIDINFO_BATCH, 0, count, (uint64_t)(uintptr_t)entries, buffer, buffersize);
+}
+
 int
 proc_pid_rusage(int pid, int flavor, rusage_info_t *buffer)
 {
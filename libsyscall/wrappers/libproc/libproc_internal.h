@@ -161,6 +161,13 @@ int proc_pidoriginatorinfo(int flavor, void *buffer, int buffersize) __OSX_AVAIL
 
 int proc_listcoalitions(int flavor, int coaltype, void *buffer, int buffersize) __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_8_3);
 
+/*
+ * Run several proc_pidinfo() queries in one call.  Returns the number of
+ * bytes of buffer used, or -1 with errno set; per entry status is reported
+ * in the entries themselves.
+ */
+int proc_pidinfo_batch(struct proc_pidinfo_batch_entry *entries, int count, void *buffer, int buffersize);
+
 /* get scheduler stats for current thread */
 int proc_current_thread_schedinfo(void *buffer, size_t buffersize);
 
@@ -541,6 +541,9 @@ os_channel_create_extended(const uuid_t uuid, const nexus_port_t port,
 		if (cha->cha_low_latency != 0) {
 			init.ci_ch_mode |= CHMODE_LOW_LATENCY;
 		}
+		if (cha->cha_busy_poll != 0) {
+			init.ci_ch_mode |= CHMODE_BUSY_POLL;
+		}
 		init.ci_key_len = cha->cha_key_len;
 		init.ci_key = cha->cha_key;
 		init.ci_tx_lowat = cha->cha_tx_lowat;
@@ -954,6 +957,18 @@ os_channel_pending(const channel_ring_t chrd)
 	return ring->ring_head != ring->ring_khead;
 }
 
+int
+os_channel_rx_ready(const channel_ring_t chrd)
+{
+	const struct __user_channel_ring *ring = chrd->chrd_ring;
+
+	if (ring->ring_kind != CR_KIND_RX) {
+		return 0;
+	}
+	return ring->ring_head != ring->ring_tail ||
+	       ring->ring_ktail_hint != ring->ring_tail;
+}
+
 uint64_t
 os_channel_ring_sync_time(const channel_ring_t chrd)
 {
@@ -1415,6 +1430,10 @@ os_channel_attr_set(const channel_attr_t cha, const channel_attr_type_t type,
 		cha->cha_low_latency = (value != 0);
 		break;
 
+	case CHANNEL_ATTR_BUSY_POLL:
+		cha->cha_busy_poll = (value != 0);
+		break;
+
 	default:
 		err = EINVAL;
 		break;
@@ -1580,6 +1599,10 @@ os_channel_attr_get(const channel_attr_t cha, const channel_attr_type_t type,
 		*value = cha->cha_large_buf_size;
 		break;
 
+	case CHANNEL_ATTR_BUSY_POLL:
+		*value = (cha->cha_busy_poll != 0);
+		break;
+
 	default:
 		err = EINVAL;
 		break;
@@ -1667,6 +1690,8 @@ os_channel_info2attr(struct channel *chd, channel_attr_t cha)
 	    (cinfo->cinfo_ch_mode & CHMODE_EVENT_RING) != 0;
 	cha->cha_low_latency =
 	    (cinfo->cinfo_ch_mode & CHMODE_LOW_LATENCY) != 0;
+	cha->cha_busy_poll =
+	    (cinfo->cinfo_ch_mode & CHMODE_BUSY_POLL) != 0;
 
 	caps = CHD_PARAMS(chd)->nxp_capabilities;
 	if (caps & NXPCAP_CHECKSUM_PARTIAL) {
@@ -21,6 +21,7 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 #include <sys/stackshot.h>
+#include <kern/debug.h>
 #include <mach/mach.h>
 #include <mach/mach_vm.h>
 #include <stdint.h>
@@ -137,7 +138,8 @@ stackshot_capture_with_config(stackshot_config_t *stackshot_config)
 	}
 
 	s_config = (stackshot_config_t *) stackshot_config;
-	if (s_config->sc_buffer != 0) {
+	/* the stackshot ring stays mapped and is reused by later captures */
+	if (s_config->sc_buffer != 0 && !(s_config->sc_flags & STACKSHOT_DELTA_RING)) {
 		return EINVAL;
 	}
 
@@ -286,7 +288,7 @@ stackshot_config_dealloc_buffer(stackshot_config_t *stackshot_config)
 	}
 	s_config = (stackshot_config_t *) stackshot_config;
 
-	if (s_config->sc_size && s_config->sc_buffer) {
+	if (s_config->sc_size && s_config->sc_buffer && !(s_config->sc_flags & STACKSHOT_DELTA_RING)) {
 		mach_vm_deallocate(mach_task_self(), (mach_vm_offset_t)s_config->sc_buffer, (mach_vm_size_t)s_config->sc_size);
 	}
 
@@ -314,7 +316,7 @@ stackshot_config_dealloc(stackshot_config_t *stackshot_config)
 	}
 	s_config = (stackshot_config_t *) stackshot_config;
 
-	if (s_config->sc_size && s_config->sc_buffer) {
+	if (s_config->sc_size && s_config->sc_buffer && !(s_config->sc_flags & STACKSHOT_DELTA_RING)) {
 		mach_vm_deallocate(mach_task_self(), (mach_vm_offset_t)s_config->sc_buffer, (mach_vm_size_t)s_config->sc_size);
 	}
 
@@ -929,6 +929,7 @@ struct perfcontrol_work_interval {
 	uint64_t        thread_group_id;
 	void            *thread_group_data;
 	uint32_t        create_flags;
+	uint32_t        deadline_misses; // consecutive missed deadlines
 };
 typedef struct perfcontrol_work_interval *perfcontrol_work_interval_t;
 
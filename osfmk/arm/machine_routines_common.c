@@ -736,6 +736,7 @@ machine_work_interval_notify(thread_t thread,
 		.deadline       = kwi_args->deadline,
 		.next_start     = kwi_args->next_start,
 		.create_flags   = kwi_args->create_flags,
+		.deadline_misses = kwi_args->deadline_misses,
 	};
 #if CONFIG_THREAD_GROUPS
 	struct thread_group *tg;
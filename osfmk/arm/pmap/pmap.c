@@ -4186,12 +4186,18 @@ pmap_remove(
 	pmap_remove_options(pmap, start, end, PMAP_OPTIONS_REMOVE);
 }
 
-MARK_AS_PMAP_TEXT vm_map_address_t
-pmap_remove_options_internal(
+#if !XNU_MONITOR
+static void pmap_flush_context_add(pmap_flush_context *, pmap_t,
+    vm_map_address_t, vm_map_address_t, bool);
+#endif /* !XNU_MONITOR */
+
+MARK_AS_PMAP_TEXT static vm_map_address_t
+pmap_remove_options_internal_pfc(
 	pmap_t pmap,
 	vm_map_address_t start,
 	vm_map_address_t end,
-	int options)
+	int options,
+	__unused pmap_flush_context *pfc)
 {
 	vm_map_address_t eva = end;
 	pt_entry_t     *bpte, *epte;
@@ -4243,22 +4249,67 @@ pmap_remove_options_internal(
 	}
 
 done:
+	/*
+	 * The PV entries of the removed mappings are gone, so a concurrent
+	 * pmap_disconnect() of those pages would not invalidate them: the
+	 * flush must complete before the pmap lock is dropped and the pages
+	 * can be freed and reused.  A flush context only lets the ranges
+	 * already pending in it ride along with this flush.
+	 */
+	if (remove_count > 0) {
+#if !XNU_MONITOR
+		if (pfc != NULL) {
+			pmap_flush_context_add(pfc, pmap, start, eva, need_strong_sync);
+			pmap_flush(pfc);
+		} else
+#endif /* !XNU_MONITOR */
+		{
+			PMAP_UPDATE_TLBS(pmap, start, eva, need_strong_sync, true);
+		}
+	}
+
 	if (unlock) {
 		pmap_unlock(pmap, PMAP_LOCK_EXCLUSIVE);
 	}
 
-	if (remove_count > 0) {
-		PMAP_UPDATE_TLBS(pmap, start, eva, need_strong_sync, true);
-	}
 	return eva;
 }
 
+MARK_AS_PMAP_TEXT vm_map_address_t
+pmap_remove_options_internal(
+	pmap_t pmap,
+	vm_map_address_t start,
+	vm_map_address_t end,
+	int options)
+{
+	return pmap_remove_options_internal_pfc(pmap, start, end, options, NULL);
+}
+
 void
 pmap_remove_options(
 	pmap_t pmap,
 	vm_map_address_t start,
 	vm_map_address_t end,
 	int options)
+{
+	pmap_remove_options_flush_context(pmap, start, end, options, NULL);
+}
+
+/*
+ * When "pfc" is non-NULL, invalidations deferred in it (by protections of
+ * the same pmap) are issued together with those of the removed range.
+ * Removals themselves are never left pending once the pmap lock is
+ * dropped, since their PV entries are already gone.  The PPL never leaves
+ * stale TLB entries behind on return, so with XNU_MONITOR the context is
+ * ignored.
+ */
+void
+pmap_remove_options_flush_context(
+	pmap_t pmap,
+	vm_map_address_t start,
+	vm_map_address_t end,
+	int options,
+	__unused pmap_flush_context *pfc)
 {
 	vm_map_address_t va;
 
@@ -4310,7 +4361,7 @@ pmap_remove_options(
 
 		pmap_ledger_check_balance(pmap);
 #else
-		va = pmap_remove_options_internal(pmap, va, l, options);
+		va = pmap_remove_options_internal_pfc(pmap, va, l, options, pfc);
 #endif
 	}
 
@@ -5364,7 +5415,15 @@ pmap_protect_options_internal(
 			}
 		}
 		FLUSH_PTE_STRONG();
-		PMAP_UPDATE_TLBS(pmap, start, va, need_strong_sync, true);
+#if !XNU_MONITOR
+		if ((options & PMAP_OPTIONS_NOFLUSH) && args != NULL) {
+			pmap_flush_context_add((pmap_flush_context *)args,
+			    pmap, start, va, need_strong_sync);
+		} else
+#endif /* !XNU_MONITOR */
+		{
+			PMAP_UPDATE_TLBS(pmap, start, va, need_strong_sync, true);
+		}
 	} else {
 		va = end;
 	}
@@ -11321,17 +11380,62 @@ dtrace_copyio_postflight(
 
 
 void
-pmap_flush_context_init(__unused pmap_flush_context *pfc)
+pmap_flush_context_init(pmap_flush_context *pfc)
 {
+	pfc->pfc_cpus = 0;
+	pfc->pfc_invalid_global = 0;
+	pfc->pfc_pmap = PMAP_NULL;
+	pfc->pfc_start = 0;
+	pfc->pfc_end = 0;
+	pfc->pfc_strong_sync = false;
 }
 
+#if !XNU_MONITOR
+/*
+ * Fold the invalidation of [start, end) in "pmap" into "pfc".
+ *
+ * Deferred ranges of one pmap are merged into a single span; the gaps
+ * between them get invalidated too, which is harmless, and lets
+ * flush_mmu_tlb_region_asid_async() pick a range TLBI or an ASID-wide
+ * flush for the whole batch.  Switching to another pmap flushes what
+ * was pending for the previous one first.
+ */
+static void
+pmap_flush_context_add(
+	pmap_flush_context *pfc,
+	pmap_t pmap,
+	vm_map_address_t start,
+	vm_map_address_t end,
+	bool strong_sync)
+{
+	if (pfc->pfc_pmap != pmap) {
+		pmap_flush(pfc);
+		pfc->pfc_pmap = pmap;
+		pfc->pfc_start = start;
+		pfc->pfc_end = end;
+	} else {
+		pfc->pfc_start = MIN(pfc->pfc_start, start);
+		pfc->pfc_end = MAX(pfc->pfc_end, end);
+	}
+	pfc->pfc_strong_sync |= strong_sync;
+}
+#endif /* !XNU_MONITOR */
 
 void
 pmap_flush(
-	__unused pmap_flush_context *cpus_to_flush)
+	pmap_flush_context *pfc)
 {
-	/* not implemented yet */
-	return;
+	pmap_t pmap = pfc->pfc_pmap;
+
+	if (pmap == PMAP_NULL) {
+		return;
+	}
+
+	pmap_get_pt_ops(pmap)->flush_tlb_region_async(pfc->pfc_start,
+	    (size_t)(pfc->pfc_end - pfc->pfc_start), pmap, true);
+	arm64_sync_tlb(pfc->pfc_strong_sync);
+
+	pmap_flush_context_init(pfc);
 }
 
 #if XNU_MONITOR
@@ -258,8 +258,16 @@ typedef struct pmap_cpu_data pmap_cpu_data_t;
 
 
 
-/* superpages */
+/*
+ * superpages: on arm64 these are physically contiguous, aligned 2MB runs
+ * (the span of a contiguous-hint group of 16K L3 entries), mapped with
+ * base page table entries.
+ */
+#if __arm64__ && __ARM_16K_PG__
+#define SUPERPAGE_NBASEPAGES ((2 * 1024 * 1024) >> ARM_PGSHIFT)
+#else
 #define SUPERPAGE_NBASEPAGES 1 /* No superpages support */
+#endif
 
 /* Convert addresses to pages and vice versa. No rounding is used. */
 #define arm_atop(x) (((vm_map_address_t)(x)) >> ARM_PGSHIFT)
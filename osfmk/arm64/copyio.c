@@ -35,6 +35,7 @@
 #include <vm/vm_map.h>
 #include <san/kasan.h>
 #include <arm/pmap.h>
+#include <libkern/copyio.h>
 
 #undef copyin
 #undef copyout
@@ -117,6 +118,66 @@ is_kernel_to_kernel_copy()
 	return current_thread()->map->pmap == kernel_pmap;
 }
 
+/*
+ * Validate that [user_addr, user_addr + nbytes) is within the current map.
+ */
+static inline int
+copy_validate_user_range(const user_addr_t user_addr, vm_size_t nbytes)
+{
+	thread_t self = current_thread();
+	user_addr_t user_addr_last;
+
+	if (__improbable((user_addr < vm_map_min(self->map)) ||
+	    os_add_overflow(user_addr, nbytes, &user_addr_last) ||
+	    (user_addr_last > vm_map_max(self->map)))) {
+		return EFAULT;
+	}
+	return 0;
+}
+
+/*
+ * The kernel side of a copy must be kernel memory: anything else is a bug
+ * in the caller, not a user error.
+ */
+static inline void
+copy_validate_kernel_range(const user_addr_t user_addr, uintptr_t kernel_addr,
+    vm_size_t nbytes)
+{
+	uintptr_t kernel_addr_last;
+
+	if (__improbable(os_add_overflow(kernel_addr, nbytes, &kernel_addr_last))) {
+		panic("%s(%p, %p, %lu) - kaddr not in kernel", __func__,
+		    (void *)user_addr, (void *)kernel_addr, nbytes);
+	}
+
+	bool in_kva = (VM_KERNEL_STRIP_UPTR(kernel_addr) >= VM_MIN_KERNEL_ADDRESS) &&
+	    (VM_KERNEL_STRIP_UPTR(kernel_addr_last) <= VM_MAX_KERNEL_ADDRESS);
+	bool in_physmap = (VM_KERNEL_STRIP_UPTR(kernel_addr) >= physmap_base) &&
+	    (VM_KERNEL_STRIP_UPTR(kernel_addr_last) <= physmap_end);
+
+	if (__improbable(!(in_kva || in_physmap))) {
+		panic("%s(%p, %p, %lu) - kaddr not in kernel", __func__,
+		    (void *)user_addr, (void *)kernel_addr, nbytes);
+	}
+}
+
+static inline void
+copy_validate_kernel_buffer(uintptr_t kernel_addr, vm_size_t nbytes,
+    copyio_flags_t flags)
+{
+	zone_element_bounds_check(kernel_addr, nbytes);
+#if KASAN
+	/* For user copies, asan-check the kernel-side buffer */
+	if (flags & COPYIO_IN) {
+		__asan_storeN(kernel_addr, nbytes);
+	} else {
+		__asan_loadN(kernel_addr, nbytes);
+	}
+#else
+	(void)flags;
+#endif
+}
+
 /*
  * Validate the arguments to copy{in,out} on this platform.
  *
@@ -127,20 +188,16 @@ static int
 copy_validate(const user_addr_t user_addr, uintptr_t kernel_addr,
     vm_size_t nbytes, copyio_flags_t flags)
 {
-	thread_t self = current_thread();
-
-	user_addr_t user_addr_last;
-	uintptr_t kernel_addr_last;
+	int result;
 
 	if (__improbable(nbytes > copysize_limit_panic)) {
 		panic("%s(%p, %p, %lu) - transfer too large", __func__,
 		    (void *)user_addr, (void *)kernel_addr, nbytes);
 	}
 
-	if (__improbable((user_addr < vm_map_min(self->map)) ||
-	    os_add_overflow(user_addr, nbytes, &user_addr_last) ||
-	    (user_addr_last > vm_map_max(self->map)))) {
-		return EFAULT;
+	result = copy_validate_user_range(user_addr, nbytes);
+	if (__improbable(result)) {
+		return result;
 	}
 
 	if (flags & COPYIO_ATOMIC) {
@@ -150,20 +207,7 @@ copy_validate(const user_addr_t user_addr, uintptr_t kernel_addr,
 	}
 
 	if ((flags & COPYIO_VALIDATE_USER_ONLY) == 0) {
-		if (__improbable(os_add_overflow(kernel_addr, nbytes, &kernel_addr_last))) {
-			panic("%s(%p, %p, %lu) - kaddr not in kernel", __func__,
-			    (void *)user_addr, (void *)kernel_addr, nbytes);
-		}
-
-		bool in_kva = (VM_KERNEL_STRIP_UPTR(kernel_addr) >= VM_MIN_KERNEL_ADDRESS) &&
-		    (VM_KERNEL_STRIP_UPTR(kernel_addr_last) <= VM_MAX_KERNEL_ADDRESS);
-		bool in_physmap = (VM_KERNEL_STRIP_UPTR(kernel_addr) >= physmap_base) &&
-		    (VM_KERNEL_STRIP_UPTR(kernel_addr_last) <= physmap_end);
-
-		if (__improbable(!(in_kva || in_physmap))) {
-			panic("%s(%p, %p, %lu) - kaddr not in kernel", __func__,
-			    (void *)user_addr, (void *)kernel_addr, nbytes);
-		}
+		copy_validate_kernel_range(user_addr, kernel_addr, nbytes);
 	}
 
 	if (is_kernel_to_kernel_copy()) {
@@ -178,19 +222,62 @@ copy_validate(const user_addr_t user_addr, uintptr_t kernel_addr,
 	}
 
 	if ((flags & COPYIO_VALIDATE_USER_ONLY) == 0) {
-		zone_element_bounds_check(kernel_addr, nbytes);
-#if KASAN
-		/* For user copies, asan-check the kernel-side buffer */
-		if (flags & COPYIO_IN) {
-			__asan_storeN(kernel_addr, nbytes);
-		} else {
-			__asan_loadN(kernel_addr, nbytes);
-		}
-#endif
+		copy_validate_kernel_buffer(kernel_addr, nbytes, flags);
 	}
 	return 0;
 }
 
+/*
+ * Validate a vectored copy: the user region once, then the bounds and
+ * kernel side of every element, so that the copy loop itself only has
+ * to deal with faults.
+ *
+ * Unlike copy_validate(), the region size is not bounded by
+ * copysize_limit_panic, since it describes user memory; each element is.
+ */
+static int
+copy_validate_vec(user_addr_t uaddr, vm_size_t size,
+    const struct copyio_vec *vec, unsigned int count, copyio_flags_t flags)
+{
+	bool kernel_to_kernel = false;
+	int result;
+
+	result = copy_validate_user_range(uaddr, size);
+	if (__improbable(result)) {
+		return result;
+	}
+
+	if (is_kernel_to_kernel_copy()) {
+		kernel_to_kernel = true;
+	} else if (__improbable(uaddr & TBI_MASK)) {
+		return EINVAL;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		const struct copyio_vec *civ = &vec[i];
+
+		if (__improbable(civ->civ_uaddr < uaddr || civ->civ_len > size ||
+		    civ->civ_uaddr - uaddr > size - civ->civ_len)) {
+			return EFAULT;
+		}
+		if (__improbable(civ->civ_len > copysize_limit_panic)) {
+			panic("%s(%p, %p, %lu) - transfer too large", __func__,
+			    (void *)civ->civ_uaddr, civ->civ_kaddr, civ->civ_len);
+		}
+		if (civ->civ_len == 0) {
+			continue;
+		}
+		copy_validate_kernel_range(civ->civ_uaddr,
+		    (uintptr_t)civ->civ_kaddr, civ->civ_len);
+		if (!kernel_to_kernel) {
+			copy_validate_kernel_buffer((uintptr_t)civ->civ_kaddr,
+			    civ->civ_len, flags);
+		}
+	}
+
+	return kernel_to_kernel ? EXDEV : 0;
+}
+
 int
 copyin_kern(const user_addr_t user_addr, char *kernel_addr, vm_size_t nbytes)
 {
@@ -354,6 +441,63 @@ copyout(const void *kernel_addr, user_addr_t user_addr, vm_size_t nbytes)
 	return result;
 }
 
+/*
+ * copy{in,out}_vec
+ * Validate the user region once and copy all the elements with a single
+ * PAN toggle, instead of paying for it (and the checks) per element.
+ */
+int
+copyin_vec(user_addr_t uaddr, size_t size, const struct copyio_vec *vec,
+    unsigned int count)
+{
+	int result;
+
+	result = copy_validate_vec(uaddr, size, vec, count, COPYIO_IN);
+	if (result == EXDEV) {
+		for (unsigned int i = 0; i < count; i++) {
+			copyin_kern(vec[i].civ_uaddr, vec[i].civ_kaddr, vec[i].civ_len);
+		}
+		return 0;
+	}
+	if (__improbable(result)) {
+		return result;
+	}
+
+	user_access_enable();
+	for (unsigned int i = 0; i < count && result == 0; i++) {
+		result = _bcopyin((const char *)vec[i].civ_uaddr,
+		    vec[i].civ_kaddr, vec[i].civ_len);
+	}
+	user_access_disable();
+	return result;
+}
+
+int
+copyout_vec(user_addr_t uaddr, size_t size, const struct copyio_vec *vec,
+    unsigned int count)
+{
+	int result;
+
+	result = copy_validate_vec(uaddr, size, vec, count, COPYIO_OUT);
+	if (result == EXDEV) {
+		for (unsigned int i = 0; i < count; i++) {
+			copyout_kern(vec[i].civ_kaddr, vec[i].civ_uaddr, vec[i].civ_len);
+		}
+		return 0;
+	}
+	if (__improbable(result)) {
+		return result;
+	}
+
+	user_access_enable();
+	for (unsigned int i = 0; i < count && result == 0; i++) {
+		result = _bcopyout(vec[i].civ_kaddr,
+		    (char *)vec[i].civ_uaddr, vec[i].civ_len);
+	}
+	user_access_disable();
+	return result;
+}
+
 int
 copyoutstr_prevalidate(const void *__unused kaddr, user_addr_t __unused uaddr, size_t __unused len)
 {
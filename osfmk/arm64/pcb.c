@@ -418,6 +418,16 @@ get_useraddr()
 	return get_saved_state_pc(current_thread()->machine.upcb);
 }
 
+/*
+ * Routine: get_usersp
+ *
+ */
+user_addr_t
+get_usersp(void)
+{
+	return get_saved_state_sp(current_thread()->machine.upcb);
+}
+
 /*
  * Routine: machine_stack_detach
  *
@@ -96,6 +96,11 @@
  *   TOTAL_CORPSES_ALLOWED : (recompilation required) - Changing this number allows for controlling
  *     the number of corpse instances to be held for inspection before allowing memory to be reclaimed
  *     by system.
+ *   coalition_corpse_limit / coalition_corpse_window_s: boot-args bounding how many corpses (full
+ *     or lightweight) the tasks of one resource coalition may generate per window, so that a
+ *     service crashing in a loop doesn't use up the TOTAL_CORPSES_ALLOWED slots.
+ *   lw_corpse_stack_bytes: boot-arg for how much of the faulting thread's user stack a lightweight
+ *     corpse saves along with its registers and backtrace.
  *   CORPSEINFO_ALLOCATION_SIZE: is the default size of vm allocation. If in future there is much more
  *     data to be put in, then please re-tune this parameter.
  *
@@ -134,6 +139,7 @@
 #include <kern/kern_cdata.h>
 #include <mach/mach_vm.h>
 #include <kern/exc_guard.h>
+#include <kern/coalition.h>
 #include <os/log.h>
 
 #if CONFIG_MACF
@@ -246,6 +252,22 @@ task_crashinfo_get_ref(corpse_flags_t kcd_u_flags)
 	}
 }
 
+/*
+ * Routine: task_corpse_coalition_throttle
+ *          Charge a corpse for the task to its resource coalition.
+ * Returns: KERN_SUCCESS if the per coalition rate limit allows for creating a corpse.
+ */
+kern_return_t
+task_corpse_coalition_throttle(task_t task)
+{
+	if (!task_coalition_corpse_allowed(task)) {
+		os_log(OS_LOG_DEFAULT, "Corpse failure for pid %d, too many in its coalition\n",
+		    task_pid(task));
+		return KERN_RESOURCE_SHORTAGE;
+	}
+	return KERN_SUCCESS;
+}
+
 /*
  * Routine: task_crashinfo_release_ref
  *          release the slot for corpse being used.
@@ -584,6 +606,11 @@ task_enqueue_exception_with_corpse(
 		assert(task == current_task());
 		assert(etype == EXC_GUARD);
 
+		kr = task_corpse_coalition_throttle(task);
+		if (kr != KERN_SUCCESS) {
+			goto out;
+		}
+
 		kr = kcdata_object_throttle_get(KCDATA_OBJECT_TYPE_LW_CORPSE);
 		if (kr != KERN_SUCCESS) {
 			goto out;
@@ -685,6 +712,11 @@ task_generate_corpse_internal(
 		kc_u_flags |= CORPSE_CRASHINFO_USER_FAULT;
 	}
 
+	kr = task_corpse_coalition_throttle(task);
+	if (kr != KERN_SUCCESS) {
+		return kr;
+	}
+
 	kr = task_crashinfo_get_ref(kc_u_flags);
 	if (kr != KERN_SUCCESS) {
 		return kr;
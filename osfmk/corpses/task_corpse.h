@@ -128,6 +128,8 @@ extern kern_return_t current_thread_collect_backtrace_info(
 	mach_msg_type_number_t codeCnt,
 	void *reason);
 
+extern kern_return_t task_corpse_coalition_throttle(task_t task);
+
 extern void task_add_to_corpse_task_list(task_t corpse_task);
 void task_remove_from_corpse_task_list(task_t corpse_task);
 void task_purge_all_corpses(void);
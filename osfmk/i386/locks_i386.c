@@ -1389,6 +1389,8 @@ lck_mtx_lock_contended(
 	uint32_t state;
 	thread_t thread;
 	struct turnstile *ts = NULL;
+	uint64_t prof_start = lck_prof_sample_begin();
+	bool prof_blocked = false;
 
 try_again:
 
@@ -1423,6 +1425,7 @@ try_again:
 				    ret == LCK_MTX_SPINWAIT_NO_SPIN, first_miss);
 			}
 			lck_mtx_lock_wait_x86(lock, &ts);
+			prof_blocked = true;
 			/*
 			 * interlock is not held here.
 			 */
@@ -1458,6 +1461,10 @@ try_again:
 	 */
 
 	/* mutex has been acquired */
+	if (prof_start) {
+		lck_prof_sample_end(lock, lock->lck_mtx_grp, LCK_PROF_MTX,
+		    prof_start, prof_blocked);
+	}
 	if (state & LCK_MTX_WAITERS_MSK) {
 		/*
 		 * lck_mtx_lock_acquire_tail will call
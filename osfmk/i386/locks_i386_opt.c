@@ -31,6 +31,7 @@
 #include <mach_ldebug.h>
 
 #include <kern/locks.h>
+#include <kern/lock_stat.h>
 #include <kern/misc_protos.h>
 #include <kern/thread.h>
 #include <kern/processor.h>
@@ -412,6 +413,7 @@ lck_mtx_unlock(
 {
 	uint32_t prev, state;
 
+	LCK_PROF_HOLD_END(current_thread(), lock);
 	state = ordered_load_mtx_state(lock);
 
 	if (state & LCK_MTX_SPIN_MSK) {
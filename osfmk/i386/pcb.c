@@ -2102,6 +2102,26 @@ get_useraddr(void)
 	}
 }
 
+user_addr_t
+get_usersp(void)
+{
+	thread_t thr_act = current_thread();
+
+	if (thread_is_64bit_addr(thr_act)) {
+		x86_saved_state64_t     *iss64;
+
+		iss64 = USER_REGS64(thr_act);
+
+		return iss64->isf.rsp;
+	} else {
+		x86_saved_state32_t     *iss32;
+
+		iss32 = USER_REGS32(thr_act);
+
+		return iss32->uesp;
+	}
+}
+
 /*
  * detach and return a kernel stack from a thread
  */
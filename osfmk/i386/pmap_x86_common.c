@@ -1576,6 +1576,21 @@ pmap_remove(
 {
 	pmap_remove_options(map, s64, e64, PMAP_OPTIONS_REMOVE);
 }
+
+/*
+ * x86 already shoots down once per pmap_remove_options() call, so no
+ * invalidation is deferred into the flush context.
+ */
+void
+pmap_remove_options_flush_context(
+	pmap_t          map,
+	addr64_t        s64,
+	addr64_t        e64,
+	int             options,
+	__unused pmap_flush_context *pfc)
+{
+	pmap_remove_options(map, s64, e64, options);
+}
 #define PLCHECK_THRESHOLD (2)
 
 void
@@ -80,6 +80,9 @@
 
 KALLOC_ARRAY_TYPE_DEFINE(ipc_entry_table, struct ipc_entry, KT_PRIV_ACCT);
 
+/* tables smaller than this are cheap enough to grow when full */
+#define IPC_ENTRY_GROW_EARLY_MIN        4096
+
 /*
  *	Routine: ipc_entry_table_count_max
  *	Purpose:
@@ -251,6 +254,34 @@ ipc_entry_claim(
 	return KERN_SUCCESS;
 }
 
+/*
+ *	Routine:	ipc_entry_table_should_grow_early
+ *	Purpose:
+ *		Large tables start growing a little before they are full,
+ *		so that the copy happens while other threads can still
+ *		allocate from the remaining free entries, instead of all
+ *		of them waiting for the grower (see ipc_entry_grow_table).
+ *	Conditions:
+ *		The space is write-locked and active.
+ */
+
+static bool
+ipc_entry_table_should_grow_early(
+	ipc_space_t             space)
+{
+	ipc_entry_table_t table = is_active_table(space);
+	ipc_entry_num_t count = ipc_entry_table_count(table);
+
+	if (is_growing(space) || count < IPC_ENTRY_GROW_EARLY_MIN ||
+	    count >= ipc_entry_table_count_max()) {
+		return false;
+	}
+
+	/* ipc_entries_hold() refuses past 7/8 hashed */
+	return space->is_table_free < count / 16 ||
+	       space->is_table_hashed > count * 13 / 16;
+}
+
 /*
  *	Routine:	ipc_entry_alloc
  *	Purpose:
@@ -273,6 +304,7 @@ ipc_entry_alloc(
 	ipc_entry_t             *entryp)
 {
 	kern_return_t kr;
+	bool grew_early = false;
 
 	is_write_lock(space);
 
@@ -284,6 +316,14 @@ ipc_entry_alloc(
 
 		kr = ipc_entries_hold(space, 1);
 		if (kr == KERN_SUCCESS) {
+			if (!grew_early && ipc_entry_table_should_grow_early(space)) {
+				grew_early = true;
+				if (ipc_entry_grow_table(space, ITS_SIZE_NONE) != KERN_SUCCESS) {
+					/* not fatal, there still are free entries */
+					is_write_lock(space);
+				}
+				continue;
+			}
 			return ipc_entry_claim(space, object, namep, entryp);
 		}
 
@@ -517,6 +557,9 @@ ipc_entry_modified(
 	if (index > space->is_high_mod) {
 		space->is_high_mod = index;
 	}
+	if (is_growing(space)) {
+		bitmap_set(space->is_grow_dirty, index >> space->is_grow_shift);
+	}
 
 	KERNEL_DEBUG_CONSTANT(
 		MACHDBG_CODE(DBG_MACH_IPC, MACH_IPC_PORT_ENTRY_MODIFY) | DBG_FUNC_NONE,
@@ -554,6 +597,64 @@ ipc_space_done_growing_and_unlock(ipc_space_t space)
 	wakeup_all_with_inheritor((event_t)space, THREAD_AWAKENED);
 }
 
+/*
+ *	Routine:	ipc_entry_grow_copy
+ *	Purpose:
+ *		Copy the [first, last] range of an old table being grown
+ *		into the new one.
+ *
+ *		For each entry, take a snapshot of the corresponding entry
+ *		in the old table (so it won't change during this iteration).
+ *		The snapshot may not be self-consistent (if we caught it in
+ *		the middle of being changed), so be very cautious with the
+ *		values.
+ *	Conditions:
+ *		The space is growing and unlocked.
+ */
+
+static void
+ipc_entry_grow_copy(
+	ipc_entry_table_t       ntable,
+	ipc_entry_t             obase,
+	mach_port_index_t       first,
+	mach_port_index_t       last)
+{
+	ipc_entry_t nbase = ipc_entry_table_base(ntable);
+
+	assert(first > 0);
+	for (mach_port_index_t i = first; i <= last; i++) {
+		ipc_entry_t entry = &nbase[i];
+		ipc_object_t osnap_object = obase[i].ie_object;
+		ipc_entry_bits_t osnap_bits = obase[i].ie_bits;
+		ipc_entry_bits_t osnap_request = obase[i].ie_request;
+
+		/*
+		 * We need to make sure the osnap_* fields are never reloaded.
+		 */
+		os_compiler_barrier();
+
+		if (entry->ie_object != osnap_object ||
+		    IE_BITS_TYPE(entry->ie_bits) != IE_BITS_TYPE(osnap_bits)) {
+			if (entry->ie_object != IO_NULL &&
+			    IE_BITS_TYPE(entry->ie_bits) == MACH_PORT_TYPE_SEND) {
+				ipc_hash_table_delete(ntable, entry->ie_object, i, entry);
+			}
+
+			entry->ie_object = osnap_object;
+			entry->ie_bits = osnap_bits;
+			entry->ie_request = osnap_request; /* or ie_next */
+
+			if (osnap_object != IO_NULL &&
+			    IE_BITS_TYPE(osnap_bits) == MACH_PORT_TYPE_SEND) {
+				ipc_hash_table_insert(ntable, osnap_object, i, entry);
+			}
+		} else {
+			entry->ie_bits = osnap_bits;
+			entry->ie_request = osnap_request; /* or ie_next */
+		}
+	}
+}
+
 /*
  *	Routine:	ipc_entry_grow_table
  *	Purpose:
@@ -583,6 +684,8 @@ ipc_entry_grow_table(
 	mach_port_index_t free_index;
 	mach_port_index_t low_mod, hi_mod;
 	ipc_table_index_t sanity;
+	bitmap_t dirty[BITMAP_LEN(IS_GROW_CHUNKS)];
+	uint8_t shift;
 #if IPC_ENTRY_GROW_STATS
 	uint64_t rescan_count = 0;
 #endif
@@ -630,10 +733,20 @@ ipc_entry_grow_table(
 	 * table.  Modification of entries (other than hashes) will
 	 * bump this downward, and we only have to reprocess entries
 	 * above that mark.  Eventually, we'll get done.
+	 *
+	 * Modifications are also tracked by chunks of (1 << shift)
+	 * entries so that a rescan only copies the chunks that changed,
+	 * which keeps rescans short even when threads keep allocating
+	 * entries all over the (randomized) freelist in the meantime.
 	 */
+	for (shift = 0; ((ocount - 1) >> shift) >= IS_GROW_CHUNKS; shift++) {
+		;
+	}
 	ipc_space_start_growing(space);
 	space->is_low_mod = ocount;
 	space->is_high_mod = 0;
+	space->is_grow_shift = shift;
+	bitmap_zero(space->is_grow_dirty, IS_GROW_CHUNKS);
 #if IPC_ENTRY_GROW_STATS
 	ipc_entry_grow_count++;
 #endif
@@ -651,49 +764,8 @@ ipc_entry_grow_table(
 	ncount = ipc_entry_table_count(ntable);
 	ipc_space_rand_freelist(space, nbase, ocount, ncount);
 
-	low_mod = 1;
-	hi_mod = ocount - 1;
+	ipc_entry_grow_copy(ntable, obase, 1, ocount - 1);
 rescan:
-	/*
-	 * Within the range of the table that changed, determine what we
-	 * have to take action on. For each entry, take a snapshot of the
-	 * corresponding entry in the old table (so it won't change
-	 * during this iteration). The snapshot may not be self-consistent
-	 * (if we caught it in the middle of being changed), so be very
-	 * cautious with the values.
-	 */
-	assert(low_mod > 0);
-	for (mach_port_index_t i = MAX(1, low_mod); i <= hi_mod; i++) {
-		ipc_entry_t entry = &nbase[i];
-		ipc_object_t osnap_object = obase[i].ie_object;
-		ipc_entry_bits_t osnap_bits = obase[i].ie_bits;
-		ipc_entry_bits_t osnap_request = obase[i].ie_request;
-
-		/*
-		 * We need to make sure the osnap_* fields are never reloaded.
-		 */
-		os_compiler_barrier();
-
-		if (entry->ie_object != osnap_object ||
-		    IE_BITS_TYPE(entry->ie_bits) != IE_BITS_TYPE(osnap_bits)) {
-			if (entry->ie_object != IO_NULL &&
-			    IE_BITS_TYPE(entry->ie_bits) == MACH_PORT_TYPE_SEND) {
-				ipc_hash_table_delete(ntable, entry->ie_object, i, entry);
-			}
-
-			entry->ie_object = osnap_object;
-			entry->ie_bits = osnap_bits;
-			entry->ie_request = osnap_request; /* or ie_next */
-
-			if (osnap_object != IO_NULL &&
-			    IE_BITS_TYPE(osnap_bits) == MACH_PORT_TYPE_SEND) {
-				ipc_hash_table_insert(ntable, osnap_object, i, entry);
-			}
-		} else {
-			entry->ie_bits = osnap_bits;
-			entry->ie_request = osnap_request; /* or ie_next */
-		}
-	}
 	nbase[0].ie_next = obase[0].ie_next;  /* always rebase the freelist */
 
 	/*
@@ -746,6 +818,8 @@ rescan:
 		space->is_low_mod = ocount;
 		hi_mod = space->is_high_mod;
 		space->is_high_mod = 0;
+		memcpy(dirty, space->is_grow_dirty, sizeof(dirty));
+		bitmap_zero(space->is_grow_dirty, IS_GROW_CHUNKS);
 		is_write_unlock(space);
 
 		if (hi_mod >= ocount) {
@@ -760,9 +834,24 @@ rescan:
 		}
 
 		ipc_entry_grow_rescan++;
-		ipc_entry_grow_rescan_entries += hi_mod - low_mod + 1;
-		if (hi_mod - low_mod + 1 > ipc_entry_grow_rescan_entries_max) {
-			ipc_entry_grow_rescan_entries_max = hi_mod - low_mod + 1;
+		uint64_t rescan_entries = 0;
+#endif
+		for (int c = bitmap_lsb_first(dirty, IS_GROW_CHUNKS); c >= 0;
+		    c = bitmap_lsb_next(dirty, IS_GROW_CHUNKS, (uint)c)) {
+			mach_port_index_t first = MAX(MAX(1, low_mod), (mach_port_index_t)c << shift);
+			mach_port_index_t last = MIN(hi_mod, (((mach_port_index_t)c + 1) << shift) - 1);
+
+			if (first <= last) {
+				ipc_entry_grow_copy(ntable, obase, first, last);
+#if IPC_ENTRY_GROW_STATS
+				rescan_entries += last - first + 1;
+#endif
+			}
+		}
+#if IPC_ENTRY_GROW_STATS
+		ipc_entry_grow_rescan_entries += rescan_entries;
+		if (rescan_entries > ipc_entry_grow_rescan_entries_max) {
+			ipc_entry_grow_rescan_entries_max = rescan_entries;
 		}
 #endif
 		goto rescan;
@@ -54,6 +54,12 @@ static ZONE_DEFINE_TYPE(ipc_eventlink_zone, "ipc_eventlink",
 
 os_refgrp_decl(static, ipc_eventlink_refgrp, "eventlink", NULL);
 
+/*
+ * Largest number of signals a single signal call may deliver at once.
+ * A signal count of 0 is treated as 1 for compatibility.
+ */
+#define IPC_EVENTLINK_MAX_SIGNAL_COUNT  UINT32_MAX
+
 #if DEVELOPMENT || DEBUG
 static queue_head_t ipc_eventlink_list = QUEUE_HEAD_INITIALIZER(ipc_eventlink_list);
 static LCK_GRP_DECLARE(ipc_eventlink_dev_lock_grp, "ipc_eventlink_dev_lock");
@@ -87,13 +93,15 @@ ipc_eventlink_destroy_internal(
 
 static kern_return_t
 ipc_eventlink_signal(
-	struct ipc_eventlink *ipc_eventlink);
+	struct ipc_eventlink *ipc_eventlink,
+	uint64_t             signal_count);
 
 static uint64_t
 ipc_eventlink_signal_wait_until_trap_internal(
 	mach_port_name_t                     wait_port,
 	mach_port_name_t                     signal_port,
 	uint64_t                             count,
+	uint64_t                             signal_count,
 	mach_eventlink_signal_wait_option_t  el_option,
 	kern_clock_id_t                      clock_id,
 	uint64_t                             deadline);
@@ -102,6 +110,7 @@ static kern_return_t
 ipc_eventlink_signal_wait_internal(
 	struct ipc_eventlink        *wait_eventlink,
 	struct ipc_eventlink        *signal_eventlink,
+	uint64_t                    signal_count,
 	uint64_t                    deadline,
 	uint64_t                    *count,
 	ipc_eventlink_option_t      eventlink_option);
@@ -112,6 +121,7 @@ ipc_eventlink_convert_wait_result(int wait_result);
 static kern_return_t
 ipc_eventlink_signal_internal_locked(
 	struct ipc_eventlink         *signal_eventlink,
+	uint64_t                     signal_count,
 	ipc_eventlink_option_t       eventlink_option);
 
 static kern_return_t
@@ -292,7 +302,7 @@ ipc_eventlink_destroy_internal(
 			temp_ipc_eventlink->el_thread = THREAD_NULL;
 
 			ipc_eventlink_signal_internal_locked(temp_ipc_eventlink,
-			    IPC_EVENTLINK_FORCE_WAKEUP);
+			    0, IPC_EVENTLINK_FORCE_WAKEUP);
 		}
 
 		/* Only destroy the port on which destroy was called */
@@ -461,7 +471,7 @@ mach_eventlink_disassociate(
 
 	/* wake up the thread if blocked */
 	ipc_eventlink_signal_internal_locked(ipc_eventlink,
-	    IPC_EVENTLINK_FORCE_WAKEUP);
+	    0, IPC_EVENTLINK_FORCE_WAKEUP);
 
 	ipc_eventlink_unlock(ipc_eventlink);
 	splx(s);
@@ -481,6 +491,7 @@ mach_eventlink_disassociate(
  *
  * Args:
  *   eventlink: eventlink
+ *   signal_count: number of signals to deliver at once (0 means 1)
  *
  * Returns:
  *   uint64_t: Contains count and error codes.
@@ -488,7 +499,7 @@ mach_eventlink_disassociate(
 uint64_t
 mach_eventlink_signal_trap(
 	mach_port_name_t port,
-	uint64_t         signal_count __unused)
+	uint64_t         signal_count)
 {
 	struct ipc_eventlink *ipc_eventlink;
 	kern_return_t kr;
@@ -497,7 +508,8 @@ mach_eventlink_signal_trap(
 	kr = port_name_to_eventlink(port, &ipc_eventlink);
 	if (kr == KERN_SUCCESS) {
 		/* Signal the remote side of the eventlink */
-		kr = ipc_eventlink_signal(eventlink_remote_side(ipc_eventlink));
+		kr = ipc_eventlink_signal(eventlink_remote_side(ipc_eventlink),
+		    signal_count);
 
 		/* Deallocate ref returned by port_name_to_eventlink */
 		ipc_eventlink_deallocate(ipc_eventlink);
@@ -516,18 +528,21 @@ mach_eventlink_signal_trap(
  *
  * Args:
  *   eventlink: eventlink
+ *   signal_count: number of signals to deliver
  *
  * Returns:
  *   KERN_SUCCESS on Success.
  */
 static kern_return_t
 ipc_eventlink_signal(
-	struct ipc_eventlink *ipc_eventlink)
+	struct ipc_eventlink *ipc_eventlink,
+	uint64_t             signal_count)
 {
 	kern_return_t kr;
 	spl_t s;
 
-	if (ipc_eventlink == IPC_EVENTLINK_NULL) {
+	if (ipc_eventlink == IPC_EVENTLINK_NULL ||
+	    signal_count > IPC_EVENTLINK_MAX_SIGNAL_COUNT) {
 		return KERN_INVALID_ARGUMENT;
 	}
 
@@ -542,7 +557,7 @@ ipc_eventlink_signal(
 	}
 
 	kr = ipc_eventlink_signal_internal_locked(ipc_eventlink,
-	    IPC_EVENTLINK_NONE);
+	    signal_count, IPC_EVENTLINK_NONE);
 
 	ipc_eventlink_unlock(ipc_eventlink);
 	splx(s);
@@ -582,6 +597,7 @@ mach_eventlink_wait_until_trap(
 		eventlink_port,
 		MACH_PORT_NULL,
 		wait_count,
+		0,
 		option,
 		clock_id,
 		deadline);
@@ -597,6 +613,7 @@ mach_eventlink_wait_until_trap(
  * Args:
  *   wait_port: eventlink port for wait
  *   count_ptr: signal count to wait on
+ *   signal_count: number of signals to deliver (0 means 1)
  *   el_option: eventlink option
  *   clock_id: clock id
  *   deadline: deadline in mach_absolute_time
@@ -608,7 +625,7 @@ uint64_t
 mach_eventlink_signal_wait_until_trap(
 	mach_port_name_t                    eventlink_port,
 	uint64_t                            wait_count,
-	uint64_t                            signal_count __unused,
+	uint64_t                            signal_count,
 	mach_eventlink_signal_wait_option_t option,
 	kern_clock_id_t                     clock_id,
 	uint64_t                            deadline)
@@ -617,6 +634,7 @@ mach_eventlink_signal_wait_until_trap(
 		eventlink_port,
 		eventlink_port,
 		wait_count,
+		signal_count,
 		option,
 		clock_id,
 		deadline);
@@ -633,6 +651,7 @@ mach_eventlink_signal_wait_until_trap(
  *   wait_port: eventlink port for wait
  *   signal_port: eventlink port for signal
  *   count: signal count to wait on
+ *   signal_count: number of signals to deliver
  *   el_option: eventlink option
  *   clock_id: clock id
  *   deadline: deadline in mach_absolute_time
@@ -645,6 +664,7 @@ ipc_eventlink_signal_wait_until_trap_internal(
 	mach_port_name_t                     wait_port,
 	mach_port_name_t                     signal_port,
 	uint64_t                             count,
+	uint64_t                             signal_count,
 	mach_eventlink_signal_wait_option_t  el_option,
 	kern_clock_id_t                      clock_id,
 	uint64_t                             deadline)
@@ -654,7 +674,8 @@ ipc_eventlink_signal_wait_until_trap_internal(
 	kern_return_t kr;
 	ipc_eventlink_option_t ipc_eventlink_option = IPC_EVENTLINK_NONE;
 
-	if (clock_id != KERN_CLOCK_MACH_ABSOLUTE_TIME) {
+	if (clock_id != KERN_CLOCK_MACH_ABSOLUTE_TIME ||
+	    signal_count > IPC_EVENTLINK_MAX_SIGNAL_COUNT) {
 		return encode_eventlink_count_and_error(count, KERN_INVALID_ARGUMENT);
 	}
 
@@ -672,7 +693,7 @@ ipc_eventlink_signal_wait_until_trap_internal(
 		}
 
 		kr = ipc_eventlink_signal_wait_internal(wait_ipc_eventlink,
-		    signal_ipc_eventlink, deadline,
+		    signal_ipc_eventlink, signal_count, deadline,
 		    &count, ipc_eventlink_option);
 
 		/* release ref returned by port_name_to_eventlink */
@@ -691,6 +712,7 @@ ipc_eventlink_signal_wait_until_trap_internal(
  * Args:
  *   wait_eventlink: eventlink for wait
  *   signal_eventlink: eventlink for signal
+ *   signal_count: number of signals to deliver
  *   deadline: deadline in mach_absolute_time
  *   count_ptr: signal count to wait on
  *   el_option: eventlink option
@@ -703,6 +725,7 @@ static kern_return_t
 ipc_eventlink_signal_wait_internal(
 	struct ipc_eventlink        *wait_eventlink,
 	struct ipc_eventlink        *signal_eventlink,
+	uint64_t                    signal_count,
 	uint64_t                    deadline,
 	uint64_t                    *count,
 	ipc_eventlink_option_t      eventlink_option)
@@ -768,7 +791,7 @@ ipc_eventlink_signal_wait_internal(
 	if (signal_eventlink != IPC_EVENTLINK_NULL) {
 		kern_return_t signal_kr;
 		signal_kr = ipc_eventlink_signal_internal_locked(signal_eventlink,
-		    eventlink_option);
+		    signal_count, eventlink_option);
 
 		if (signal_kr == KERN_NOT_WAITING) {
 			assert(self->handoff_thread == THREAD_NULL);
@@ -851,8 +874,13 @@ ipc_eventlink_convert_wait_result(int wait_result)
  * wake up the thread waiting if sync counter is greater
  * than wake counter.
  *
+ * A batch of signals only wakes the waiter once, so a waiter
+ * that asked for a count several signals ahead is woken (and
+ * handed off to) only when the whole threshold is reached.
+ *
  * Args:
  *   eventlink: eventlink
+ *   signal_count: number of signals to deliver (0 means 1)
  *   ipc_eventlink_option_t: options
  *
  * Returns:
@@ -861,6 +889,7 @@ ipc_eventlink_convert_wait_result(int wait_result)
 static kern_return_t
 ipc_eventlink_signal_internal_locked(
 	struct ipc_eventlink         *signal_eventlink,
+	uint64_t                     signal_count,
 	ipc_eventlink_option_t       eventlink_option)
 {
 	kern_return_t kr = KERN_NOT_WAITING;
@@ -879,7 +908,7 @@ ipc_eventlink_signal_internal_locked(
 	}
 
 	/* Increment the eventlink sync count */
-	signal_eventlink->el_sync_counter++;
+	signal_eventlink->el_sync_counter += MAX(signal_count, 1);
 
 	/* Check if thread needs to be woken up */
 	if (signal_eventlink->el_sync_counter > signal_eventlink->el_wait_counter) {
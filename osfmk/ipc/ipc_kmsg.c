@@ -1458,6 +1458,8 @@ ipc_kmsg_trace_send(ipc_kmsg_t kmsg,
 ZONE_DEFINE(ipc_kmsg_zone, "ipc kmsgs", IKM_SAVED_KMSG_SIZE,
     ZC_CACHING | ZC_ZFREE_CLEARMEM);
 static TUNABLE(bool, enforce_strict_reply, "ipc_strict_reply", false);
+/* move deallocated out-of-line memory by stealing the sender's map entries */
+static TUNABLE(bool, ipc_ool_move, "ipc_ool_move", true);
 
 /*
  * Forward declarations
@@ -1753,6 +1755,26 @@ ipc_kmsg_alloc(
 		}
 	}
 
+	/*
+	 * Kernel RPC replies are small and freed by the thread that
+	 * receives them, which is usually the one that sends the next
+	 * request: recycle the last one it freed.
+	 */
+	if ((flags & IPC_KMSG_ALLOC_CACHED) && kmsg_type == IKM_TYPE_ALL_INLINED) {
+		thread_t self = current_thread();
+
+		kmsg = self->ith_kmsg_cache;
+		if (kmsg != IKM_NULL) {
+			self->ith_kmsg_cache = IKM_NULL;
+			/* same state as a Z_ZERO allocation from ipc_kmsg_zone */
+			bzero(kmsg, IKM_SAVED_KMSG_SIZE);
+			kmsg->ikm_type = kmsg_type;
+			kmsg->ikm_aux_size = aux_size;
+			kmsg->ikm_cacheable = true;
+			return kmsg;
+		}
+	}
+
 	/* Then, allocate memory for both udata and kdata if needed, as well as kmsg */
 	if (max_udata_size > 0) {
 		user_data = kalloc_data(max_udata_size, alloc_flags);
@@ -1778,6 +1800,8 @@ ipc_kmsg_alloc(
 	kmsg = zalloc_flags(ipc_kmsg_zone, Z_WAITOK | Z_ZERO | Z_NOFAIL);
 	kmsg->ikm_type = kmsg_type;
 	kmsg->ikm_aux_size = aux_size;
+	kmsg->ikm_cacheable = (flags & IPC_KMSG_ALLOC_CACHED) &&
+	    kmsg_type == IKM_TYPE_ALL_INLINED;
 
 	/* Finally, set up pointers properly */
 	if (user_data) {
@@ -1887,6 +1911,11 @@ ipc_kmsg_free(
 			ip_release(inuse_port); /* May be last reference */
 			return;
 		}
+		if (kmsg->ikm_cacheable &&
+		    current_thread()->ith_kmsg_cache == IKM_NULL) {
+			current_thread()->ith_kmsg_cache = kmsg;
+			return;
+		}
 		/* all data inlined, nothing to do */
 		break;
 	case IKM_TYPE_UDATA_OOL:
@@ -1915,6 +1944,26 @@ ipc_kmsg_free(
 	/* kmsg struct freed */
 }
 
+/*
+ *	Routine:	ipc_kmsg_thread_cache_drain
+ *	Purpose:
+ *		Free the kmsg kept by ipc_kmsg_free() for reuse
+ *		by IPC_KMSG_ALLOC_CACHED allocations of the thread.
+ *	Conditions:
+ *		The thread is terminated, nothing locked.
+ */
+void
+ipc_kmsg_thread_cache_drain(
+	thread_t        thread)
+{
+	ipc_kmsg_t kmsg = thread->ith_kmsg_cache;
+
+	if (kmsg != IKM_NULL) {
+		thread->ith_kmsg_cache = IKM_NULL;
+		zfree(ipc_kmsg_zone, kmsg);
+	}
+}
+
 
 /*
  *	Routine:	ipc_kmsg_enqueue_qos
@@ -3696,6 +3745,80 @@ ipc_kmsg_validate_reply_context_locked(
 	return MACH_MSG_SUCCESS;
 }
 
+/*
+ *	Routine:	ipc_kmsg_copyin_header_smr
+ *	Purpose:
+ *		Lockless fast path of ipc_kmsg_copyin_header() for the
+ *		common one-way send: a COPY_SEND destination, with no
+ *		reply port, no voucher and no send-possible request.
+ *
+ *		The destination is looked up with ipc_right_lookup_read(),
+ *		which returns the port locked after validating the entry
+ *		under SMR. Copying a send right only mutates the port,
+ *		so the space lock isn't needed.
+ *
+ *		Anything unusual (dead or reply ports, a recycled name...)
+ *		returns false without side effects, and the caller falls
+ *		back to the locked path which reports the proper error.
+ *	Conditions:
+ *		Nothing locked. The header bits have been validated.
+ */
+static bool
+ipc_kmsg_copyin_header_smr(
+	ipc_kmsg_t              kmsg,
+	ipc_space_t             space,
+	mach_msg_priority_t     priority,
+	mach_msg_option_t       option32)
+{
+	mach_msg_header_t *msg = ikm_header(kmsg);
+	mach_port_name_t dest_name = CAST_MACH_PORT_TO_NAME(msg->msgh_remote_port);
+	mach_msg_bits_t mbits = msg->msgh_bits;
+	ipc_entry_bits_t bits;
+	ipc_object_t object;
+	ipc_port_t port;
+
+	if (MACH_MSGH_BITS_REMOTE(mbits) != MACH_MSG_TYPE_COPY_SEND ||
+	    MACH_MSGH_BITS_LOCAL(mbits) != 0 ||
+	    MACH_MSGH_BITS_VOUCHER(mbits) != MACH_MSGH_BITS_ZERO ||
+	    (option32 & MACH_SEND_NOTIFY) ||
+	    (enforce_strict_reply && MACH_SEND_WITH_STRICT_REPLY(option32))) {
+		return false;
+	}
+
+	if (ipc_right_lookup_read(space, dest_name, &bits, &object) != KERN_SUCCESS) {
+		return false;
+	}
+	/* object is locked and active */
+
+	if ((bits & MACH_PORT_TYPE_SEND) == 0 || io_otype(object) != IOT_PORT) {
+		io_unlock(object);
+		return false;
+	}
+
+	port = ip_object_to_port(object);
+	if (ip_is_reply_port(port)) {
+		io_unlock(object);
+		return false;
+	}
+
+	ipc_port_copy_send_any_locked(port);
+
+	/* see ipc_kmsg_copyin_header() */
+	if (ip_is_kobject(port) && ip_in_space(port, ipc_space_kernel)) {
+		assert(ip_kotype(port) != IKOT_TIMER);
+		kmsg->ikm_flags |= IPC_OBJECT_COPYIN_FLAGS_ALLOW_IMMOVABLE_SEND;
+	}
+	ip_mq_unlock(port);
+
+	msg->msgh_bits = MACH_MSGH_BITS_SET(MACH_MSG_TYPE_PORT_SEND, 0, 0, mbits);
+	msg->msgh_remote_port = port;
+	msg->msgh_local_port = IP_NULL;
+
+	ipc_kmsg_set_qos(kmsg, option32, priority);
+
+	return true;
+}
+
 /*
  *	Routine:	ipc_kmsg_copyin_header
  *	Purpose:
@@ -3771,6 +3894,10 @@ ipc_kmsg_copyin_header(
 		return MACH_SEND_INVALID_DEST;
 	}
 
+	if (ipc_kmsg_copyin_header_smr(kmsg, space, priority, option32)) {
+		return MACH_MSG_SUCCESS;
+	}
+
 	is_write_lock(space);
 	if (!is_active(space)) {
 		is_write_unlock(space);
@@ -4362,9 +4489,17 @@ ipc_kmsg_copyin_ool_descriptor(
 		 *
 		 * NOTE: A virtual copy is OK if the original is being
 		 * deallocted, even if a physical copy was requested.
+		 * Page-aligned private memory being deallocated is
+		 * moved outright, without any copy-on-write setup.
 		 */
-		kern_return_t kr = vm_map_copyin(map, addr,
-		    (vm_map_size_t)length, dealloc, copy);
+		int copyin_flags = 0;
+
+		if (dealloc) {
+			copyin_flags = ipc_ool_move ? VM_MAP_COPYIN_MOVE :
+			    VM_MAP_COPYIN_SRC_DESTROY;
+		}
+		kern_return_t kr = vm_map_copyin_internal(map, addr,
+		    (vm_map_size_t)length, copyin_flags, copy);
 		if (kr != KERN_SUCCESS) {
 			*mr = (kr == KERN_RESOURCE_SHORTAGE) ?
 			    MACH_MSG_VM_KERNEL :
@@ -157,6 +157,7 @@ struct ipc_kmsg {
 
 	mach_msg_type_name_t       ikm_voucher_type: 6; /* disposition type the voucher came in with */
 	ipc_kmsg_type_t            ikm_type: 2;
+	bool                       ikm_cacheable: 1; /* may go to the freeing thread's kmsg cache */
 
 	/* size of buffer pointed to by ikm_udata, unused for IKM_TYPE_ALL_INLINED. */
 	mach_msg_size_t            ikm_udata_size;
@@ -259,6 +260,8 @@ __options_decl(ipc_kmsg_alloc_flags_t, uint32_t, {
 	IPC_KMSG_ALLOC_SAVED    = 0x0004,
 	IPC_KMSG_ALLOC_NOFAIL   = 0x0008,
 	IPC_KMSG_ALLOC_LINEAR   = 0x0010,
+	/* small kmsg, use and refill the current thread's kmsg cache */
+	IPC_KMSG_ALLOC_CACHED   = 0x0020,
 });
 
 /* Allocate a kernel message */
@@ -272,6 +275,10 @@ extern ipc_kmsg_t ipc_kmsg_alloc(
 extern void ipc_kmsg_free(
 	ipc_kmsg_t              kmsg);
 
+/* Free the kmsg cached on a terminated thread */
+extern void ipc_kmsg_thread_cache_drain(
+	thread_t                thread);
+
 __options_decl(ipc_kmsg_destroy_flags_t, uint32_t, {
 	IPC_KMSG_DESTROY_ALL           = 0x0000,
 	IPC_KMSG_DESTROY_SKIP_REMOTE   = 0x0001,
@@ -85,6 +85,7 @@
 #ifdef MACH_KERNEL_PRIVATE
 #include <kern/macro_help.h>
 #include <kern/kern_types.h>
+#include <kern/bits.h>
 #include <kern/smr.h>
 #include <kern/locks.h>
 #include <kern/task.h>
@@ -105,6 +106,10 @@
  *	that need it grown wait for the first.  We do almost all the
  *	work with the space unlocked, so lookups proceed pretty much
  *	unaffected while the grow operation is underway.
+ *
+ *	Entries modified while the table is being copied are tracked in
+ *	IS_GROW_CHUNKS chunks (is_grow_dirty), so that the grower only
+ *	recopies the chunks that changed instead of the whole range.
  */
 
 typedef natural_t ipc_space_refs_t;
@@ -120,6 +125,8 @@ typedef natural_t ipc_space_refs_t;
 #define IS_AT_MAX_LIMIT_NOTIFY         0x10     /* space has hit the max limit */
 #define IS_AT_MAX_LIMIT_NOTIFIED       0x20     /* sent max limit notification */
 
+#define IS_GROW_CHUNKS                 512      /* granularity of is_grow_dirty */
+
 struct ipc_space {
 	lck_ticket_t    is_lock;
 	os_ref_atomic_t is_bits;        /* holds refs, active, growing */
@@ -131,6 +138,8 @@ struct ipc_space {
 	ipc_label_t     is_label;       /* [private] mandatory access label */
 	ipc_entry_num_t is_low_mod;     /* lowest modified entry during growth */
 	ipc_entry_num_t is_high_mod;    /* highest modified entry during growth */
+	uint8_t         is_grow_shift;  /* log2 of the entries per is_grow_dirty bit */
+	bitmap_t        is_grow_dirty[BITMAP_LEN(IS_GROW_CHUNKS)]; /* chunks modified during growth */
 	struct bool_gen bool_gen;       /* state for boolean RNG */
 	unsigned int    is_entropy[IS_ENTROPY_CNT]; /* pool of entropy taken from RNG */
 	int             is_node_id;     /* HOST_LOCAL_NODE, or remote node if proxy space */
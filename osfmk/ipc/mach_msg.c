@@ -898,6 +898,213 @@ mach_msg_trap_receive(
 	return mr;
 }
 
+/*
+ *  Routine:    mach_msg_copyin_batch [internal]
+ *  Purpose:
+ *      Copy in the entries of a MACH64_MSG_BATCH call.
+ *      The caller frees the returned array with kfree_data().
+ */
+static mach_msg_return_t
+mach_msg_copyin_batch(
+	mach_vm_address_t       data_addr,
+	mach_msg_size_t         count,
+	mach_msg_option64_t     option64,
+	mach_msg_batch_entry_t  **entriesp)
+{
+	mach_msg_batch_entry_t *entries;
+
+	assert(option64 & MACH64_MSG_BATCH);
+
+	if (count == 0 || count > MACH_MSG_BATCH_MAX_COUNT) {
+		return (option64 & MACH64_SEND_MSG) ?
+		       MACH_SEND_INVALID_DATA : MACH_RCV_INVALID_ARGUMENTS;
+	}
+
+	entries = kalloc_data(count * sizeof(mach_msg_batch_entry_t),
+	    Z_WAITOK | Z_NOFAIL);
+
+	if (copyin(data_addr, (caddr_t)entries,
+	    count * sizeof(mach_msg_batch_entry_t))) {
+		kfree_data(entries, count * sizeof(mach_msg_batch_entry_t));
+		return (option64 & MACH64_SEND_MSG) ?
+		       MACH_SEND_INVALID_DATA : MACH_RCV_INVALID_ARGUMENTS;
+	}
+
+	*entriesp = entries;
+	return MACH_MSG_SUCCESS;
+}
+
+/*
+ *  Routine:    mach_msg_copyout_batch_results [internal]
+ *  Purpose:
+ *      Report the per-entry results of a MACH64_MSG_BATCH call.
+ *      Best effort: the messages have already been sent or received.
+ */
+static void
+mach_msg_copyout_batch_results(
+	mach_vm_address_t       data_addr,
+	mach_msg_batch_entry_t  *entries,
+	mach_msg_size_t         count)
+{
+	for (mach_msg_size_t i = 0; i < count; i++) {
+		(void)copyout(&entries[i].mbe_return,
+		    data_addr + i * sizeof(mach_msg_batch_entry_t) +
+		    offsetof(mach_msg_batch_entry_t, mbe_return),
+		    sizeof(mach_msg_return_t));
+	}
+}
+
+/*
+ *  Routine:    mach_msg_trap_send_batch [internal]
+ *  Purpose:
+ *      Send each message of a batch with mach_msg_trap_send().
+ *  Conditions:
+ *      MACH_SEND_MSG and MACH64_MSG_BATCH are set.
+ *  Returns:
+ *      MACH_MSG_SUCCESS        The batch was processed, results are per-entry.
+ *      MACH_SEND_INTERRUPTED   A send was interrupted, it and the remaining
+ *                              entries were not sent.
+ */
+static mach_msg_return_t
+mach_msg_trap_send_batch(
+	mach_msg_batch_entry_t  *entries,
+	mach_msg_size_t         count,
+	mach_msg_option64_t     option64,
+	mach_msg_timeout_t      msg_timeout,
+	mach_msg_priority_t     priority,
+	bool                    filter_nonfatal)
+{
+	mach_msg_user_base_t user_base;
+	mach_msg_size_t      desc_count, len_copied;
+	mach_msg_return_t    mr = MACH_MSG_SUCCESS;
+	mach_msg_size_t      i;
+
+	assert(option64 & MACH64_SEND_MSG);
+
+	for (i = 0; i < count; i++) {
+		mach_msg_batch_entry_t *entry = &entries[i];
+
+		/* mach_msg_trap_send() bound checks the rest */
+		if (entry->mbe_size < sizeof(mach_msg_user_header_t)) {
+			entry->mbe_return = MACH_SEND_MSG_TOO_SMALL;
+			continue;
+		}
+
+		len_copied = (mach_msg_size_t)MIN(entry->mbe_size, sizeof(mach_msg_user_base_t));
+		user_base.body.msgh_descriptor_count = 0;
+		if (copyinmsg(entry->mbe_msg, (char *)&user_base, len_copied)) {
+			entry->mbe_return = MACH_SEND_INVALID_DATA;
+			continue;
+		}
+
+		desc_count = 0;
+		if (user_base.header.msgh_bits & MACH_MSGH_BITS_COMPLEX) {
+			desc_count = user_base.body.msgh_descriptor_count;
+		}
+		user_base.header.msgh_size = entry->mbe_size;
+
+		mr = mach_msg_trap_send(entry->mbe_msg, 0, option64,
+		    msg_timeout, priority, filter_nonfatal,
+		    user_base.header, entry->mbe_size, 0, desc_count);
+		entry->mbe_return = mr;
+
+		if (mr == MACH_SEND_INTERRUPTED) {
+			break;
+		}
+		mr = MACH_MSG_SUCCESS;
+	}
+
+	for (; i < count; i++) {
+		entries[i].mbe_return = MACH_SEND_INTERRUPTED;
+	}
+
+	return mr;
+}
+
+/*
+ *  Routine:    mach_msg_trap_receive_batch [internal]
+ *  Purpose:
+ *      Receive up to count messages from one port or port set.
+ *
+ *      Only the first receive may wait. The following ones turn into
+ *      MACH_RCV_TIMEOUT polls, so that a service loop drains what is
+ *      already queued in one trap. Unlike mach_msg_trap_receive(),
+ *      this blocks without a continuation so that it can come back.
+ *  Conditions:
+ *      MACH_RCV_MSG and MACH64_MSG_BATCH are set.
+ *  Returns:
+ *      MACH_MSG_SUCCESS        At least one message was received, results
+ *                              are per-entry.
+ *      Otherwise, the error of the first receive.
+ */
+static mach_msg_return_t
+mach_msg_trap_receive_batch(
+	mach_msg_batch_entry_t  *entries,
+	mach_msg_size_t         count,
+	mach_msg_option64_t     option64,
+	mach_msg_timeout_t      msg_timeout,
+	mach_port_name_t        rcv_name)
+{
+	ipc_object_t object;
+
+	thread_t           self = current_thread();
+	ipc_space_t        space = current_space();
+	mach_msg_return_t  mr = MACH_MSG_SUCCESS;
+	mach_msg_size_t    i;
+
+	assert(option64 & MACH64_RCV_MSG);
+
+	mr = ipc_mqueue_copyin(space, rcv_name, &object);
+	if (mr != MACH_MSG_SUCCESS) {
+		return mr;
+	}
+	/* hold ref for object */
+
+	for (i = 0; i < count; i++) {
+		mach_msg_batch_entry_t *entry = &entries[i];
+
+		/* mach_msg_receive_results() consumes one */
+		io_reference(object);
+
+		self->ith_msg_addr = entry->mbe_msg;
+		self->ith_max_msize = entry->mbe_size;
+		self->ith_msize = 0;
+
+		self->ith_aux_addr = 0;
+		self->ith_max_asize = 0;
+		self->ith_asize = 0;
+
+		self->ith_object = object;
+		self->ith_option = option64;
+		self->ith_receiver_name = MACH_PORT_NULL;
+		self->ith_knote = ITH_KNOTE_NULL;
+
+		ipc_mqueue_receive(io_waitq(object),
+		    option64, entry->mbe_size, 0, msg_timeout,
+		    THREAD_ABORTSAFE, /* continuation ? */ false);
+
+		mr = mach_msg_receive_results();
+		entry->mbe_return = mr;
+		if (mr != MACH_MSG_SUCCESS) {
+			break;
+		}
+
+		/* only poll for the rest */
+		option64 |= MACH64_RCV_TIMEOUT;
+		msg_timeout = 0;
+	}
+
+	io_release(object);
+
+	if (i == count) {
+		return MACH_MSG_SUCCESS;
+	}
+	for (mach_msg_size_t j = i + 1; j < count; j++) {
+		entries[j].mbe_return = MACH_RCV_TIMED_OUT;
+	}
+	return i > 0 ? MACH_MSG_SUCCESS : mr;
+}
+
 /*
  *  Routine:    mach_msg_overwrite_trap [mach trap]
  *  Purpose:
@@ -1026,6 +1233,73 @@ mach_msg2_cfi_option_valid(
 	return (option64 != 0) && ((option64 & (option64 - 1)) == 0);
 }
 
+/*
+ *  Routine:    mach_msg2_trap_batch [internal]
+ *  Purpose:
+ *      mach_msg2_trap() with MACH64_MSG_BATCH: send and/or receive
+ *      a batch of scalar messages in one trap.
+ *
+ *      data_addr points to an array of mach_msg_batch_entry_t, the
+ *      sends use the first send count entries (high bits of mb_ss),
+ *      receives the following receive count entries (low bits of rs_pr).
+ *  Conditions:
+ *      Nothing locked.
+ *  Returns:
+ *      See mach_msg_trap_send_batch() and mach_msg_trap_receive_batch().
+ */
+static mach_msg_return_t
+mach_msg2_trap_batch(
+	mach_vm_address_t       data_addr,
+	mach_msg_option64_t     option64,
+	uint64_t                mb_ss,
+	uint64_t                dc_rn,
+	uint64_t                rs_pr,
+	mach_msg_timeout_t      msg_timeout,
+	bool                    filter_nonfatal)
+{
+	mach_msg_batch_entry_t *entries = NULL;
+	mach_msg_size_t send_cnt, rcv_cnt, count;
+	mach_msg_return_t mr;
+
+	send_cnt = (option64 & MACH64_SEND_MSG) ? (mach_msg_size_t)(mb_ss >> 32) : 0;
+	rcv_cnt = (option64 & MACH64_RCV_MSG) ? (mach_msg_size_t)rs_pr : 0;
+
+	/* batches are made of scalar messages to message queues */
+	if (__improbable((option64 & MACH64_MSG_VECTOR) ||
+	    ((option64 & MACH64_SEND_MSG) &&
+	    (option64 & MACH64_MSG_OPTION_CFI_MASK) != MACH64_SEND_MQ_CALL))) {
+		mach_port_guard_exception(0, 0, 0, kGUARD_EXC_INVALID_OPTIONS);
+		return MACH_SEND_INVALID_OPTIONS;
+	}
+	if (option64 & (MACH64_RCV_SYNC_WAIT | MACH64_RCV_SYNC_PEEK)) {
+		return MACH_RCV_INVALID_ARGUMENTS;
+	}
+	if (os_add_overflow(send_cnt, rcv_cnt, &count)) {
+		count = UINT32_MAX;
+	}
+
+	mr = mach_msg_copyin_batch(data_addr, count, option64, &entries);
+	if (mr != MACH_MSG_SUCCESS) {
+		return mr;
+	}
+
+	if (send_cnt) {
+		mr = mach_msg_trap_send_batch(entries, send_cnt, option64,
+		    msg_timeout, (mach_msg_priority_t)(rs_pr >> 32), filter_nonfatal);
+	}
+
+	if (mr == MACH_MSG_SUCCESS && rcv_cnt) {
+		mr = mach_msg_trap_receive_batch(entries + send_cnt, rcv_cnt,
+		    option64, msg_timeout,
+		    (mach_port_name_t)(dc_rn >> 32));
+	}
+
+	mach_msg_copyout_batch_results(data_addr, entries, count);
+	kfree_data(entries, count * sizeof(mach_msg_batch_entry_t));
+
+	return mr;
+}
+
 /*
  *  Routine:    mach_msg2_trap [mach trap]
  *  Purpose:
@@ -1076,6 +1350,12 @@ mach_msg2_trap(
 
 	KDBG(MACHDBG_CODE(DBG_MACH_IPC, MACH_IPC_KMSG_INFO) | DBG_FUNC_START);
 
+	if (option64 & MACH64_MSG_BATCH) {
+		mr = mach_msg2_trap_batch(data_addr, option64, mb_ss, dc_rn, rs_pr,
+		    msg_timeout, filter_nonfatal);
+		goto end;
+	}
+
 	/* kobject calls must be scalar calls (hence no aux data) */
 	if (__improbable((option64 & MACH64_SEND_KOBJECT_CALL) && vector_msg)) {
 		mach_port_guard_exception(0, 0, 0, kGUARD_EXC_INVALID_OPTIONS);
@@ -1224,6 +1224,7 @@ fill_task_rusage(task_t task, rusage_info_current *ri)
 	ri->ri_system_ptime = extra.system_ptime;
 	ri->ri_energy_nj = extra.energy;
 	ri->ri_penergy_nj = extra.penergy;
+	ri->ri_memory_bytes = extra.memory_bytes;
 
 	ri->ri_phys_footprint = get_task_phys_footprint(task);
 	ledger_get_balance(task->ledger, task_ledgers.phys_mem,
@@ -33,6 +33,7 @@
 #include <kern/coalition.h>
 #include <kern/exc_resource.h>
 #include <kern/host.h>
+#include <kern/kalloc.h>
 #include <kern/ledger.h>
 #include <kern/mach_param.h> /* for TASK_CHUNK */
 #if MONOTONIC
@@ -90,6 +91,22 @@ TUNABLE_WRITEABLE(int, unrestrict_coalition_syscalls, "unrestrict_coalition_sysc
 #define unrestrict_coalition_syscalls false
 #endif
 
+/*
+ * Resource usage queries arriving within this many microseconds of the
+ * previous one on the same coalition are served from its snapshot instead
+ * of walking every member task again.
+ */
+TUNABLE_WRITEABLE(uint32_t, coalition_usage_cache_us, "coalition_usage_cache_us", 10000);
+
+/*
+ * At most coalition_corpse_limit corpses, full or lightweight, are generated
+ * for the tasks of a resource coalition in any coalition_corpse_window_s
+ * seconds, so that a service crashing in a loop can't take every corpse slot
+ * and the memory that goes with them.  0 disables the limit.
+ */
+TUNABLE_WRITEABLE(uint32_t, coalition_corpse_limit, "coalition_corpse_limit", 8);
+TUNABLE_WRITEABLE(uint32_t, coalition_corpse_window_s, "coalition_corpse_window_s", 60);
+
 LCK_GRP_DECLARE(coalitions_lck_grp, "coalition");
 
 /* coalitions_list_lock protects coalition_count, coalitions queue, next_coalition_id. */
@@ -233,6 +250,17 @@ struct i_resource_coalition {
 #if CONFIG_PHYS_WRITE_ACCT
 	uint64_t fs_metadata_writes;
 #endif /* CONFIG_PHYS_WRITE_ACCT */
+
+	/*
+	 * Result of the last coalition_resource_usage_internal() and when it
+	 * was taken, protected by the coalition lock.
+	 */
+	struct coalition_resource_usage *usage_cache;
+	uint64_t usage_cache_time;
+
+	/* corpse rate limiting, protected by the coalition lock */
+	uint64_t corpse_window_start;
+	uint32_t corpse_window_count;
 };
 
 /*
@@ -578,6 +606,7 @@ i_coal_resource_dealloc(coalition_t coal)
 	recount_coalition_deinit(&coal->r.co_recount);
 	ledger_dereference(coal->r.ledger);
 	ledger_dereference(coal->r.resource_monitor_ledger);
+	kfree_type(struct coalition_resource_usage, coal->r.usage_cache);
 }
 
 static kern_return_t
@@ -729,6 +758,26 @@ coalition_resource_usage_internal(coalition_t coal, struct coalition_resource_us
 		}
 	}
 
+	/*
+	 * Serve recent snapshots directly: monitoring tools poll many
+	 * coalitions at a high rate, and a fresh walk is O(member tasks).
+	 */
+	uint64_t now = mach_absolute_time();
+	uint64_t cache_window = 0;
+	nanoseconds_to_absolutetime((uint64_t)coalition_usage_cache_us * NSEC_PER_USEC,
+	    &cache_window);
+
+	if (cache_window != 0) {
+		coalition_lock(coal);
+		if (coal->r.usage_cache != NULL &&
+		    now - coal->r.usage_cache_time < cache_window) {
+			*cru_out = *coal->r.usage_cache;
+			coalition_unlock(coal);
+			return KERN_SUCCESS;
+		}
+		coalition_unlock(coal);
+	}
+
 	ledger_t sum_ledger = ledger_instantiate(coalition_task_ledger_template, LEDGER_CREATE_ACTIVE_ENTRIES);
 	if (sum_ledger == LEDGER_NULL) {
 		return KERN_RESOURCE_SHORTAGE;
@@ -891,6 +940,9 @@ coalition_resource_usage_internal(coalition_t coal, struct coalition_resource_us
 #if CONFIG_PERVASIVE_ENERGY
 	cru_out->energy = stats_sum.ru_energy_nj;
 #endif /* CONFIG_PERVASIVE_ENERGY */
+#if CONFIG_PERVASIVE_MEMBW
+	cru_out->memory_bytes = stats_sum.ru_memory_bytes;
+#endif /* CONFIG_PERVASIVE_MEMBW */
 
 #if CONFIG_PHYS_WRITE_ACCT
 	// kernel_pm_writes are only recorded under kernel_task coalition
@@ -908,6 +960,27 @@ coalition_resource_usage_internal(coalition_t coal, struct coalition_resource_us
 	}
 	absolutetime_to_nanoseconds(time_nonempty, &cru_out->time_nonempty);
 
+	if (cache_window != 0) {
+		struct coalition_resource_usage *cache = NULL;
+
+		coalition_lock(coal);
+		if (coal->r.usage_cache == NULL) {
+			coalition_unlock(coal);
+			cache = kalloc_type(struct coalition_resource_usage, Z_WAITOK | Z_ZERO);
+			coalition_lock(coal);
+			if (coal->r.usage_cache == NULL) {
+				coal->r.usage_cache = cache;
+				cache = NULL;
+			}
+		}
+		if (coal->r.usage_cache != NULL && now >= coal->r.usage_cache_time) {
+			*coal->r.usage_cache = *cru_out;
+			coal->r.usage_cache_time = now;
+		}
+		coalition_unlock(coal);
+		kfree_type(struct coalition_resource_usage, cache);
+	}
+
 	return KERN_SUCCESS;
 }
 
@@ -1494,6 +1567,48 @@ task_coalition_update_gpu_stats(task_t task, uint64_t gpu_ns_delta)
 	coalition_unlock(coal);
 }
 
+/*
+ * Charge a corpse to the resource coalition of the task.  Returns FALSE if
+ * the coalition already generated coalition_corpse_limit corpses in the
+ * current window.
+ */
+boolean_t
+task_coalition_corpse_allowed(task_t task)
+{
+	coalition_t coal;
+	uint64_t now, window;
+	boolean_t allowed = TRUE;
+
+	assert(task != TASK_NULL);
+	if (coalition_corpse_limit == 0) {
+		return TRUE;
+	}
+
+	coal = task->coalition[COALITION_TYPE_RESOURCE];
+	if (coal == COALITION_NULL) {
+		return TRUE;
+	}
+
+	nanoseconds_to_absolutetime((uint64_t)coalition_corpse_window_s * NSEC_PER_SEC,
+	    &window);
+	now = mach_absolute_time();
+
+	coalition_lock(coal);
+	if (coal->r.corpse_window_start == 0 ||
+	    now - coal->r.corpse_window_start >= window) {
+		coal->r.corpse_window_start = now;
+		coal->r.corpse_window_count = 0;
+	}
+	if (coal->r.corpse_window_count >= coalition_corpse_limit) {
+		allowed = FALSE;
+	} else {
+		coal->r.corpse_window_count++;
+	}
+	coalition_unlock(coal);
+
+	return allowed;
+}
+
 boolean_t
 task_coalition_adjust_focal_count(task_t task, int count, uint32_t *new_count)
 {
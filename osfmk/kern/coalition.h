@@ -67,6 +67,7 @@ int      task_coalition_role_for_type(task_t task, int coalition_type);
 int      coalition_type(coalition_t coal);
 
 void     task_coalition_update_gpu_stats(task_t task, uint64_t gpu_ns_delta);
+boolean_t task_coalition_corpse_allowed(task_t task);
 boolean_t task_coalition_adjust_focal_count(task_t task, int count, uint32_t *new_count);
 uint32_t task_coalition_focal_count(task_t task);
 boolean_t task_coalition_adjust_nonfocal_count(task_t task, int count, uint32_t *new_count);
@@ -185,6 +186,12 @@ task_coalition_update_gpu_stats(__unused task_t task,
 	return;
 }
 
+static inline boolean_t
+task_coalition_corpse_allowed(__unused task_t task)
+{
+	return TRUE;
+}
+
 static inline boolean_t
 task_coalition_adjust_focal_count(__unused task_t task,
     __unused int count,
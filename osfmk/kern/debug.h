@@ -223,8 +223,18 @@ enum micro_snapshot_flags {
 	kIORecord               = 0x8,
 	kPMIRecord              = 0x10,
 	kMACFRecord             = 0x20, /* armed by MACF policy */
+	kAggregatedRecord       = 0x40, /* stands for several identical samples, see below */
 };
 
+/*
+ * With telemetry_aggregate=1, samples of a thread whose user stack matches
+ * the last record taken for it are folded into that record instead of
+ * being appended.  Such a record has kAggregatedRecord set, ms_time is the
+ * time of the first sample, and in its thread_snapshot wait_event holds the
+ * number of samples and continuation the time of the last one, in
+ * microseconds since the epoch.
+ */
+
 /*
  * Flags used in the following assortment of snapshots.
  */
@@ -275,6 +285,12 @@ __options_decl(stackshot_flags_t, uint64_t, {
 	STACKSHOT_DISABLE_LATENCY_INFO             = 0x40000000,
 	STACKSHOT_SAVE_DYLD_COMPACTINFO            = 0x80000000,
 	STACKSHOT_INCLUDE_DRIVER_THREADS_IN_KERNEL = 0x100000000,
+	/*
+	 * Append the stackshot to a ring shared with the caller (see
+	 * <sys/stackshot.h>). With STACKSHOT_COLLECT_DELTA_SNAPSHOT, records
+	 * only cover tasks and threads that ran since the previous record.
+	 */
+	STACKSHOT_DELTA_RING                       = 0x200000000,
 }); // Note: Add any new flags to kcdata.py (stackshot_in_flags)
 
 __options_decl(microstackshot_flags_t, uint32_t, {
@@ -440,7 +440,7 @@ host_statistics(host_t host, host_flavor_t flavor, host_info_t info, mach_msg_ty
 
 		stat32 = (vm_statistics_t)info;
 
-		stat32->free_count = VM_STATISTICS_TRUNCATE_TO_32_BIT(vm_page_free_count + vm_page_speculative_count);
+		stat32->free_count = VM_STATISTICS_TRUNCATE_TO_32_BIT(VM_PAGE_FREE_COUNT_WITH_CACHED() + vm_page_speculative_count);
 		stat32->active_count = VM_STATISTICS_TRUNCATE_TO_32_BIT(vm_page_active_count);
 
 		if (vm_page_local_q) {
@@ -785,7 +785,7 @@ vm_stats(void *info, unsigned int *count)
 
 	vm_statistics64_t stat = (vm_statistics64_t)info;
 
-	stat->free_count = vm_page_free_count + vm_page_speculative_count;
+	stat->free_count = VM_PAGE_FREE_COUNT_WITH_CACHED() + vm_page_speculative_count;
 	stat->active_count = vm_page_active_count;
 
 	local_q_internal_count = 0;
@@ -344,6 +344,19 @@ ipc_kobject_set_kobjidx(
 	return KERN_SUCCESS;
 }
 
+/*
+ * Replies that fit inline in a kmsg (most fixed size MIG replies) come
+ * from the per-thread kmsg cache, the receiving thread returns the kmsg
+ * there once the reply has been copied out.
+ */
+static ipc_kmsg_t
+ipc_kobject_alloc_reply(
+	mach_msg_size_t     reply_size)
+{
+	return ipc_kmsg_alloc(reply_size, 0, 0, IPC_KMSG_ALLOC_KERNEL |
+	           IPC_KMSG_ALLOC_ZERO | IPC_KMSG_ALLOC_NOFAIL | IPC_KMSG_ALLOC_CACHED);
+}
+
 static void
 ipc_kobject_init_reply(
 	ipc_kmsg_t          reply,
@@ -411,8 +424,7 @@ ipc_kobject_server_internal(
 	 * but until it does, pessimistically zero the
 	 * whole reply buffer.
 	 */
-	reply = ipc_kmsg_alloc(reply_size, 0, 0,
-	    IPC_KMSG_ALLOC_KERNEL | IPC_KMSG_ALLOC_ZERO | IPC_KMSG_ALLOC_NOFAIL);
+	reply = ipc_kobject_alloc_reply(reply_size);
 	ipc_kobject_init_reply(reply, request, KERN_SUCCESS);
 	reply_hdr = ikm_header(reply);
 
@@ -482,13 +494,22 @@ skip_kobjcall:
 	}
 
 	/* Fail the MIG call if the task exec token changed during the call */
-	if (exec_token_changed && ipc_kobject_reply_status(reply) == KERN_SUCCESS) {
+	if (exec_token_changed && ipc_kobject_reply_status(reply) == KERN_SUCCESS &&
+	    !(reply_hdr->msgh_bits & MACH_MSGH_BITS_COMPLEX) &&
+	    reply_size >= sizeof(mig_reply_error_t)) {
+		/*
+		 *	A simple reply carries no rights besides the reply port,
+		 *	turn it into the error reply in place.
+		 */
+		bzero((char *)reply_hdr + sizeof(mig_reply_error_t),
+		    reply_size - sizeof(mig_reply_error_t));
+		reply_hdr->msgh_size = sizeof(mig_reply_error_t);
+		((mig_reply_error_t *)reply_hdr)->RetCode = KERN_INVALID_TASK;
+	} else if (exec_token_changed && ipc_kobject_reply_status(reply) == KERN_SUCCESS) {
 		/*
 		 *	Create a new reply msg with error and destroy the old reply msg.
 		 */
-		ipc_kmsg_t new_reply = ipc_kmsg_alloc(sizeof(mig_reply_error_t),
-		    0, 0, IPC_KMSG_ALLOC_KERNEL | IPC_KMSG_ALLOC_ZERO |
-		    IPC_KMSG_ALLOC_NOFAIL);
+		ipc_kmsg_t new_reply = ipc_kobject_alloc_reply(sizeof(mig_reply_error_t));
 		new_reply_hdr = ikm_header(new_reply);
 
 		/*
@@ -576,8 +597,7 @@ ipc_kobject_server(
 		assert(reply == IKM_NULL);
 
 		/* convert the server error into a MIG error */
-		reply = ipc_kmsg_alloc(sizeof(mig_reply_error_t), 0, 0,
-		    IPC_KMSG_ALLOC_KERNEL | IPC_KMSG_ALLOC_ZERO | IPC_KMSG_ALLOC_NOFAIL);
+		reply = ipc_kobject_alloc_reply(sizeof(mig_reply_error_t));
 		ipc_kobject_init_reply(reply, request, kr);
 	}
 
@@ -813,6 +813,7 @@ ipc_thread_init(
 
 	thread->ipc_active = true;
 	ipc_kmsg_queue_init(&thread->ith_messages);
+	thread->ith_kmsg_cache = IKM_NULL;
 
 	thread->ith_kernel_reply_port = IP_NULL;
 }
@@ -1028,6 +1029,8 @@ ipc_thread_terminate(
 	assert(ipc_kmsg_queue_empty(&thread->ith_messages));
 	thread_mtx_unlock(thread);
 
+	ipc_kmsg_thread_cache_drain(thread);
+
 	/* clears read port ikol_alt_port, must be done first */
 	if (rdport != IP_NULL) {
 		ipc_kobject_dealloc_port(rdport, 0, IKOT_THREAD_READ);
@@ -382,6 +382,169 @@ SECURITY_READ_ONLY_LATE(struct kalloc_heap) KHEAP_KT_VAR[1] = {
 	}
 };
 
+/*
+ * Allocation size histograms
+ *
+ * With the kalloc_size_histo boot-arg, kalloc_ext() counts the requests
+ * made to each heap by size, in KALLOC_SIZE_HISTO_GRANULE steps. Compared to
+ * the size classes of the heap (kern.kalloc_size_histogram.* and
+ * kern.kalloc_size_classes.*), they show how much internal fragmentation
+ * costs, and tools/kalloc_sizeclass_tune.py derives a better class table
+ * from them.
+ *
+ * The tuned table for the data heap can be tried without a rebuild with
+ * kalloc_data_sizes=<size>,<size>,...: data buffers hold no pointers so
+ * their size classes play no part in type isolation. The default heap
+ * classes are also the kalloc_type size classes, and only change with
+ * k_zone_cfg.
+ */
+static TUNABLE(bool, kalloc_size_histo, "kalloc_size_histo", false);
+static SECURITY_READ_ONLY_LATE(uint64_t *) kalloc_size_histo_counts[KHEAP_ID_COUNT];
+
+__startup_func
+static void
+kalloc_size_histo_init(void)
+{
+	vm_size_t size = round_page(KALLOC_SIZE_HISTO_BUCKETS * sizeof(uint64_t));
+
+	if (!kalloc_size_histo) {
+		return;
+	}
+	for (zone_kheap_id_t id = KHEAP_ID_DEFAULT; id < KHEAP_ID_COUNT; id++) {
+		kmem_alloc(kernel_map, (vm_offset_t *)&kalloc_size_histo_counts[id],
+		    size, KMA_NOFAIL | KMA_ZERO | KMA_PERMANENT | KMA_KOBJECT,
+		    VM_KERN_MEMORY_DIAG);
+	}
+}
+STARTUP(KMEM, STARTUP_RANK_LAST, kalloc_size_histo_init);
+
+__attribute__((noinline))
+static void
+kalloc_size_histo_record(zone_kheap_id_t heap_id, vm_size_t size)
+{
+	uint64_t *counts = kalloc_size_histo_counts[heap_id];
+	uint32_t bucket = KALLOC_SIZE_HISTO_BUCKETS - 1;
+
+	if (counts == NULL) {
+		return;
+	}
+	if (size <= KHEAP_MAX_SIZE) {
+		bucket = (uint32_t)((size + KALLOC_SIZE_HISTO_GRANULE - 1) /
+		    KALLOC_SIZE_HISTO_GRANULE);
+	}
+	os_atomic_inc(&counts[bucket], relaxed);
+}
+
+bool
+kalloc_size_histo_copy(zone_kheap_id_t heap_id, uint64_t *counts)
+{
+	uint64_t *src;
+
+	if (heap_id == KHEAP_ID_NONE || heap_id >= KHEAP_ID_COUNT ||
+	    (src = kalloc_size_histo_counts[heap_id]) == NULL) {
+		return false;
+	}
+	for (uint32_t i = 0; i < KALLOC_SIZE_HISTO_BUCKETS; i++) {
+		counts[i] = os_atomic_load(&src[i], relaxed);
+	}
+	return true;
+}
+
+uint32_t
+kalloc_size_classes_copy(zone_kheap_id_t heap_id, uint32_t *sizes, uint32_t count)
+{
+	struct kheap_zones *khz;
+	uint32_t n = 0;
+
+	switch (heap_id) {
+	case KHEAP_ID_DEFAULT:
+	case KHEAP_ID_DATA_BUFFERS:
+		khz = (heap_id == KHEAP_ID_DEFAULT ? KHEAP_DEFAULT :
+		    KHEAP_DATA_BUFFERS)->kh_zones;
+		for (; n < khz->max_k_zone && n < count; n++) {
+			sizes[n] = khz->cfg[n].kzc_size;
+		}
+		break;
+#if ZSECURITY_CONFIG(KALLOC_TYPE)
+	case KHEAP_ID_KT_VAR:
+		for (; n < KHEAP_NUM_ZONES && n < count; n++) {
+			zone_id_t zid = kalloc_type_heap_array[KT_VAR_PTR_HEAP].kh_zstart;
+			sizes[n] = zone_elem_size(&zone_array[zid + n]);
+		}
+		break;
+#endif /* ZSECURITY_CONFIG(KALLOC_TYPE) */
+	default:
+		break;
+	}
+	return n;
+}
+
+#if ZSECURITY_CONFIG(SUBMAP_USER_DATA)
+static TUNABLE_STR(kalloc_data_sizes, 256, "kalloc_data_sizes", "");
+
+/*
+ * Replace the data heap size classes with the kalloc_data_sizes boot-arg,
+ * if it describes a valid table: increasing multiples of KALLOC_MINALIGN,
+ * ending with KHEAP_MAX_SIZE, and no more classes than the default table.
+ */
+__startup_func
+static void
+kalloc_data_sizes_parse(void)
+{
+	struct kalloc_zone_cfg cfg[MAX_K_ZONE(k_zone_cfg_data)] = { };
+	const char *str = kalloc_data_sizes;
+	uint32_t n = 0, prev = 0;
+
+	if (*str == '\0') {
+		return;
+	}
+
+	while (*str) {
+		uint32_t size = 0, j = 0;
+
+		if (n == MAX_K_ZONE(k_zone_cfg_data)) {
+			goto invalid;
+		}
+		for (; *str >= '0' && *str <= '9'; str++) {
+			size = size * 10 + (uint32_t)(*str - '0');
+			if (size > KHEAP_MAX_SIZE) {
+				goto invalid;
+			}
+		}
+		if (*str == ',') {
+			str++;
+		} else if (*str != '\0') {
+			goto invalid;
+		}
+		if (size < KALLOC_MINSIZE || size % KALLOC_MINALIGN || size <= prev) {
+			goto invalid;
+		}
+
+		/* Keep the caching policy of the class that used to serve this size. */
+		while (k_zone_cfg_data[j].kzc_size < size) {
+			j++;
+		}
+		cfg[n].kzc_caching = k_zone_cfg_data[j].kzc_caching;
+		cfg[n].kzc_size = size;
+		snprintf(cfg[n].kzc_name, sizeof(cfg[n].kzc_name), "kalloc.%u", size);
+		prev = size;
+		n++;
+	}
+	if (prev != KHEAP_MAX_SIZE) {
+		goto invalid;
+	}
+
+	memcpy(k_zone_cfg_data, cfg, sizeof(cfg));
+	kalloc_zones_data.max_k_zone = (uint16_t)n;
+	printf("kalloc: using %u data heap size classes from kalloc_data_sizes\n", n);
+	return;
+
+invalid:
+	printf("kalloc: ignoring invalid kalloc_data_sizes=%s\n", kalloc_data_sizes);
+}
+STARTUP(TUNABLES, STARTUP_RANK_MIDDLE, kalloc_data_sizes_parse);
+#endif /* ZSECURITY_CONFIG(SUBMAP_USER_DATA) */
+
 /*
  * Initialize kalloc heap: Create zones, generate direct lookup table and
  * do a quick test on lookups
@@ -2184,6 +2347,10 @@ kalloc_ext(
 	size = req_size;
 #endif
 
+	if (__improbable(kalloc_size_histo)) {
+		kalloc_size_histo_record(kheap->kh_heap_id, req_size);
+	}
+
 	z = kalloc_zone_for_size(kheap, kt_view, size, flags & Z_MAY_COPYINMAP);
 	if (z) {
 		return kalloc_zone(z, zstats, flags, req_size);
@@ -1816,6 +1816,28 @@ extern vm_size_t kalloc_large_max;
 SCALABLE_COUNTER_DECLARE(kalloc_large_count);
 SCALABLE_COUNTER_DECLARE(kalloc_large_total);
 
+/*
+ * Allocation size histograms (kalloc_size_histo boot-arg).
+ *
+ * Bucket i counts the requests of ((i - 1) * 16, i * 16] bytes, the last
+ * bucket counts the requests larger than KHEAP_MAX_SIZE.
+ */
+#define KALLOC_SIZE_HISTO_GRANULE   16
+#define KALLOC_SIZE_HISTO_BUCKETS   (KHEAP_MAX_SIZE / KALLOC_SIZE_HISTO_GRANULE + 2)
+
+/* Returns false if histograms are disabled or heap_id is invalid. */
+extern bool
+kalloc_size_histo_copy(
+	zone_kheap_id_t       heap_id,
+	uint64_t             *counts __counted_by(KALLOC_SIZE_HISTO_BUCKETS));
+
+/* Copies the element sizes of the heap zones, returns how many. */
+extern uint32_t
+kalloc_size_classes_copy(
+	zone_kheap_id_t       heap_id,
+	uint32_t             *sizes __counted_by(count),
+	uint32_t              count);
+
 extern void
 kern_os_typed_free(
 	kalloc_type_view_t    ktv,
@@ -1222,6 +1222,14 @@ struct btinfo_sc_load_info {
 	uint32_t sharedCacheBaseAddress;
 };
 
+/* data is variable length with size bytes, copied from the task at address */
+struct btinfo_memory_region {
+	uint64_t address;
+	uint32_t size;
+	uint32_t flags;
+	uint8_t  data[];
+};
+
 #define TASK_BTINFO_BEGIN                                       KCDATA_BUFFER_BEGIN_BTINFO
 
 /* Shared keys with CRASHINFO */
@@ -1250,6 +1258,7 @@ struct btinfo_sc_load_info {
 #define TASK_BTINFO_PLATFORM                                    0xA28 /* uint32_t */
 #define TASK_BTINFO_SC_LOADINFO                                 0xA29 /* struct btinfo_sc_load_info */
 #define TASK_BTINFO_SC_LOADINFO64                               0xA2A /* struct btinfo_sc_load_info64 */
+#define TASK_BTINFO_STACK_MEMORY                                0xA2B /* struct btinfo_memory_region */
 
 #define TASK_BTINFO_DYLD_LOADINFO                               KCDATA_TYPE_LIBRARY_LOADINFO
 #define TASK_BTINFO_DYLD_LOADINFO64                             KCDATA_TYPE_LIBRARY_LOADINFO64
@@ -1260,6 +1269,7 @@ struct btinfo_sc_load_info {
 #define TASK_BTINFO_FLAG_ASYNC_BT_TRUNCATED                     0x2
 #define TASK_BTINFO_FLAG_TASK_TERMINATED                        0x4 /* task is terminated */
 #define TASK_BTINFO_FLAG_KCDATA_INCOMPLETE                      0x8 /* lw corpse collection is incomplete */
+#define TASK_BTINFO_FLAG_STACK_TRUNCATED                        0x10 /* stack memory is shorter than requested */
 
 #define TASK_BTINFO_END                                         KCDATA_TYPE_BUFFER_END
 
@@ -567,6 +567,189 @@ stackshot_remap_buffer(void *stackshotbuf, uint32_t bytes_traced, uint64_t out_b
 	return error;
 }
 
+#pragma mark stackshot ring
+
+/*
+ * STACKSHOT_DELTA_RING: stackshots are appended to a single ring that
+ * stays mapped read-only in the caller's address space, so an always-on
+ * sampler doesn't pay for sizing, allocating and remapping a buffer on
+ * every call.  The layout is described in <sys/stackshot.h>.
+ *
+ * The ring is owned by the stackshot subsystem lock.  The data itself is
+ * only written from the debugger trap, in place.
+ */
+#define STACKSHOT_RING_DEFAULT_SIZE     (4 * 1024 * 1024)
+#define STACKSHOT_RING_MIN_SIZE         (256 * 1024)
+
+static stackshot_ring_header_t *stackshot_ring;
+static vm_size_t stackshot_ring_alloc_size;
+static uint64_t stackshot_ring_owner;           /* unique id of the task the ring is mapped in */
+static mach_vm_offset_t stackshot_ring_user_addr;
+static uint64_t stackshot_ring_timestamp;       /* when the newest record was taken */
+
+static kern_return_t
+stackshot_ring_setup(uint32_t size_hint)
+{
+	stackshot_ring_header_t *ring = NULL;
+	vm_size_t size;
+
+	if (stackshot_ring != NULL) {
+		return KERN_SUCCESS;
+	}
+
+	size = size_hint ? size_hint : STACKSHOT_RING_DEFAULT_SIZE;
+	size = MAX(size, STACKSHOT_RING_MIN_SIZE);
+	size = MIN(size, max_tracebuf_size);
+	size = VM_MAP_ROUND_PAGE(size, PAGE_MASK);
+
+	if (kmem_alloc(kernel_map, (vm_offset_t *)&ring, size,
+	    KMA_ZERO | KMA_DATA, VM_KERN_MEMORY_DIAG) != KERN_SUCCESS) {
+		return KERN_RESOURCE_SHORTAGE;
+	}
+
+	static_assert(sizeof(stackshot_ring_header_t) % STACKSHOT_RING_ALIGN == 0);
+	static_assert(sizeof(stackshot_ring_record_t) % STACKSHOT_RING_ALIGN == 0);
+	ring->ssr_magic = STACKSHOT_RING_MAGIC;
+	ring->ssr_size = (uint32_t)(size - sizeof(*ring));
+
+	stackshot_ring = ring;
+	stackshot_ring_alloc_size = size;
+	return KERN_SUCCESS;
+}
+
+/*
+ * Map the ring into the current task, unless it already is.  Only the last
+ * task to capture into the ring is tracked; a restarted sampler gets a new
+ * mapping.
+ */
+static kern_return_t
+stackshot_ring_map(uint64_t out_buffer_addr, uint64_t out_size_addr)
+{
+	task_t task = current_task();
+	vm_map_t map = get_task_map(task);
+	mach_vm_offset_t user_addr = 0;
+	uint32_t size = (uint32_t)stackshot_ring_alloc_size;
+	vm_prot_t cur_prot, max_prot;
+	kern_return_t error;
+
+	if (stackshot_ring_owner != get_task_uniqueid(task)) {
+		error = mach_vm_remap_kernel(map, &user_addr, stackshot_ring_alloc_size, 0,
+		    VM_FLAGS_ANYWHERE, VM_KERN_MEMORY_NONE, kernel_map,
+		    (mach_vm_offset_t)stackshot_ring, FALSE, &cur_prot, &max_prot, VM_INHERIT_NONE);
+		if (error != KERN_SUCCESS) {
+			return error;
+		}
+		error = mach_vm_protect(map, user_addr, stackshot_ring_alloc_size, TRUE, VM_PROT_READ);
+		if (error != KERN_SUCCESS) {
+			mach_vm_deallocate(map, user_addr, stackshot_ring_alloc_size);
+			return error;
+		}
+		stackshot_ring_owner = get_task_uniqueid(task);
+		stackshot_ring_user_addr = user_addr;
+	}
+
+	error = copyout(&stackshot_ring_user_addr, (user_addr_t)out_buffer_addr, sizeof(stackshot_ring_user_addr));
+	if (error == KERN_SUCCESS) {
+		error = copyout(&size, (user_addr_t)out_size_addr, sizeof(size));
+	}
+	return error;
+}
+
+/*
+ * Take a stackshot straight into the ring.  The record is written at the
+ * current head if the space left before the end of the ring allows it;
+ * otherwise, or if the stackshot didn't fit there, a wrap record is left
+ * behind and the stackshot is retaken at the start of the ring.
+ */
+static kern_return_t
+stackshot_ring_capture(int pid, uint64_t flags, uint32_t pagetable_mask,
+    uint32_t *bytes_traced, uint64_t *interrupts_off_abs)
+{
+	stackshot_ring_header_t *ring = stackshot_ring;
+	stackshot_ring_record_t *record;
+	struct kcdata_descriptor kcdata;
+	bool delta = (flags & STACKSHOT_COLLECT_DELTA_SNAPSHOT) != 0;
+	uint64_t since = delta ? stackshot_ring_timestamp : 0;
+	uint64_t head = ring->ssr_head;
+	uint64_t time_start = 0, time_end;
+	uint32_t offset, avail, len;
+	boolean_t istate;
+	bool retry = false;
+	kern_return_t error;
+
+	for (;;) {
+		offset = (uint32_t)(head % ring->ssr_size);
+		avail = ring->ssr_size - offset;
+		record = (stackshot_ring_record_t *)((uintptr_t)(ring + 1) + offset);
+
+		if (offset != 0 && (retry || avail < ring->ssr_size / 8)) {
+			/* leave a wrap marker and start over at the beginning */
+			os_atomic_store(&ring->ssr_write, head + avail, relaxed);
+			record->ssrr_size = 0;
+			record->ssrr_flags = STACKSHOT_RING_RECORD_WRAP;
+			record->ssrr_generation = 0;
+			head += avail;
+			os_atomic_store(&ring->ssr_head, head, release);
+			continue;
+		}
+
+		/* claim everything up to the end of the ring before scribbling on it */
+		os_atomic_store(&ring->ssr_write, head + avail, release);
+
+		error = kcdata_memory_static_init(&kcdata, (mach_vm_address_t)(record + 1),
+		    delta ? KCDATA_BUFFER_BEGIN_DELTA_STACKSHOT : KCDATA_BUFFER_BEGIN_STACKSHOT,
+		    avail - sizeof(*record), KCFLAG_USE_MEMCOPY | KCFLAG_NO_AUTO_ENDBUFFER);
+		if (error != KERN_SUCCESS) {
+			return error;
+		}
+
+		stackshot_initial_estimate = 0;
+		stackshot_duration_prior_abs = 0;
+		stackshot_duration_outer = NULL;
+
+		istate = ml_set_interrupts_enabled(FALSE);
+		time_start = mach_absolute_time();
+		SOCD_TRACE_XNU_START(STACKSHOT);
+
+		kdp_snapshot_preflight(pid, record + 1, avail - sizeof(*record), flags,
+		    &kcdata, since, pagetable_mask);
+		error = stackshot_trap();
+
+		time_end = mach_absolute_time();
+		SOCD_TRACE_XNU_END(STACKSHOT);
+		ml_set_interrupts_enabled(istate);
+
+		if (stackshot_duration_outer) {
+			*stackshot_duration_outer = time_end - time_start;
+		}
+		*interrupts_off_abs += time_end - time_start;
+		stackshot_kcdata_p = NULL;
+
+		if (error != KERN_INSUFFICIENT_BUFFER_SIZE || offset == 0) {
+			break;
+		}
+		retry = true;
+	}
+
+	if (error != KERN_SUCCESS) {
+		return error;
+	}
+
+	*bytes_traced = kdp_stack_snapshot_bytes_traced();
+	len = (uint32_t)ROUNDUP(sizeof(*record) + *bytes_traced, STACKSHOT_RING_ALIGN);
+	assert(len <= avail);
+
+	record->ssrr_size = *bytes_traced;
+	record->ssrr_flags = 0;
+	record->ssrr_generation = ++ring->ssr_generation;
+	ring->ssr_timestamp = time_start;
+	ring->ssr_last = head;
+	os_atomic_store(&ring->ssr_head, head + len, release);
+
+	stackshot_ring_timestamp = time_start;
+	return KERN_SUCCESS;
+}
+
 kern_return_t
 kern_stack_snapshot_internal(int stackshot_config_version, void *stackshot_config, size_t stackshot_config_size, boolean_t stackshot_from_user)
 {
@@ -670,6 +853,18 @@ kern_stack_snapshot_internal(int stackshot_config_version, void *stackshot_confi
 		return KERN_INVALID_ARGUMENT;
 	}
 
+	/*
+	 * Ring stackshots are taken against the previous record in the ring,
+	 * and are always handed back through the caller's mapping of it.
+	 */
+	if (flags & STACKSHOT_DELTA_RING) {
+		if (!stackshot_from_user || since_timestamp != 0 ||
+		    (flags & (STACKSHOT_DO_COMPRESS | STACKSHOT_PAGE_TABLES |
+		    STACKSHOT_RETRIEVE_EXISTING_BUFFER | STACKSHOT_GET_BOOT_PROFILE))) {
+			return KERN_INVALID_ARGUMENT;
+		}
+	}
+
 #if CONFIG_PERVASIVE_CPI && MONOTONIC
 	if (!mt_core_supported) {
 		flags &= ~STACKSHOT_INSTRS_CYCLES;
@@ -724,6 +919,22 @@ kern_stack_snapshot_internal(int stackshot_config_version, void *stackshot_confi
 		goto error_exit;
 	}
 
+	if (flags & STACKSHOT_DELTA_RING) {
+		KDBG_RELEASE(MACHDBG_CODE(DBG_MACH_STACKSHOT, STACKSHOT_RECORD) | DBG_FUNC_START,
+		    flags, size_hint, pid, stackshot_ring_timestamp);
+		is_traced = true;
+
+		error = stackshot_ring_setup(size_hint);
+		if (error == KERN_SUCCESS) {
+			error = stackshot_ring_capture(pid, flags, pagetable_mask,
+			    &bytes_traced, &tot_interrupts_off_abs);
+		}
+		if (error == KERN_SUCCESS) {
+			error = stackshot_ring_map(out_buffer_addr, out_size_addr);
+		}
+		goto error_exit;
+	}
+
 	stackshot_duration_prior_abs = 0;
 	stackshot_initial_estimate_adj = os_atomic_load(&stackshot_estimate_adj, relaxed);
 	stackshotbuf_size = stackshot_estimate =
@@ -2607,6 +2818,7 @@ kdp_stackshot_record_task(struct stackshot_context *ctx, task_t task)
 	boolean_t save_donating_pids_p    = ((ctx->trace_flags & STACKSHOT_SAVE_IMP_DONATION_PIDS) != 0);
 	boolean_t collect_delta_stackshot = ((ctx->trace_flags & STACKSHOT_COLLECT_DELTA_SNAPSHOT) != 0);
 	boolean_t save_owner_info         = ((ctx->trace_flags & STACKSHOT_THREAD_WAITINFO) != 0);
+	boolean_t changed_only            = ((ctx->trace_flags & STACKSHOT_DELTA_RING) != 0);
 
 	kern_return_t error = KERN_SUCCESS;
 	mach_vm_address_t out_addr = 0;
@@ -2649,6 +2861,7 @@ kdp_stackshot_record_task(struct stackshot_context *ctx, task_t task)
 	if (task_in_transition) {
 		collect_delta_stackshot = FALSE;
 	}
+	changed_only = changed_only && collect_delta_stackshot;
 
 	have_map = (task->map != NULL) && (_stackshot_validate_kva((vm_offset_t)(task->map), sizeof(struct _vm_map)));
 	have_pmap = have_map && (task->map->pmap != NULL) && (_stackshot_validate_kva((vm_offset_t)(task->map->pmap), sizeof(struct pmap)));
@@ -2676,10 +2889,6 @@ kdp_stackshot_record_task(struct stackshot_context *ctx, task_t task)
 
 	/* Trace everything, unless a process was specified. Add in driver tasks if requested. */
 	if ((ctx->pid == -1) || (ctx->pid == task_pid) || (ctx->include_drivers && task_is_driver(task))) {
-		/* add task snapshot marker */
-		kcd_exit_on_error(kcdata_add_container_marker(stackshot_kcdata_p, KCDATA_TYPE_CONTAINER_BEGIN,
-		    container_type, task_uniqueid));
-
 		if (collect_delta_stackshot) {
 			/*
 			 * For delta stackshots we need to know if a thread from this task has run since the
@@ -2705,7 +2914,9 @@ kdp_stackshot_record_task(struct stackshot_context *ctx, task_t task)
 					some_thread_ran = TRUE;
 					break;
 				case tc_delta_snapshot:
-					num_delta_thread_snapshots++;
+					if (!changed_only) {
+						num_delta_thread_snapshots++;
+					}
 					break;
 				}
 			}
@@ -2715,6 +2926,19 @@ kdp_stackshot_record_task(struct stackshot_context *ctx, task_t task)
 			proc_starttime_kdp(get_bsdtask_info(task), NULL, NULL, &task_start_abstime);
 		}
 
+		/*
+		 * Ring stackshots leave out tasks with nothing new since the
+		 * previous record: the reader already has their state.
+		 */
+		if (changed_only && !some_thread_ran && (task_start_abstime != 0) &&
+		    (task_start_abstime <= stack_snapshot_delta_since_timestamp)) {
+			goto error_exit;
+		}
+
+		/* add task snapshot marker */
+		kcd_exit_on_error(kcdata_add_container_marker(stackshot_kcdata_p, KCDATA_TYPE_CONTAINER_BEGIN,
+		    container_type, task_uniqueid));
+
 		/* Next record any relevant UUID info and store the task snapshot */
 		if (task_in_transition ||
 		    !collect_delta_stackshot ||
@@ -2806,6 +3030,9 @@ kdp_stackshot_record_task(struct stackshot_context *ctx, task_t task)
 				    STACKSHOT_KCCONTAINER_THREAD, thread_uniqueid));
 				break;
 			case tc_delta_snapshot:
+				if (changed_only) {
+					break;
+				}
 				kcd_exit_on_error(kcdata_record_thread_delta_snapshot(&delta_snapshots[current_delta_snapshot_index++], thread, thread_on_core));
 				break;
 			}
@@ -35,6 +35,8 @@
 #include <kern/task.h>
 #include <kern/thread.h>
 #include <kern/coalition.h>
+#include <kern/percpu.h>
+#include <kern/startup.h>
 
 #include <kern/processor.h>
 #include <kern/machine.h>
@@ -63,6 +65,7 @@
 #define LF_TRACKING_MAX         0x4000  /* track max balance. Exclusive w.r.t refill */
 #define LF_PANIC_ON_NEGATIVE    0x8000  /* panic if it goes negative */
 #define LF_TRACK_CREDIT_ONLY    0x10000 /* only update "credit" */
+#define LF_PERCPU               0x20000 /* updates are cached per-cpu */
 
 
 /*
@@ -83,7 +86,8 @@ _Static_assert(sizeof(int) * 8 >= ENTRY_ID_SIZE_SHIFT * 2, "Ledger indices don't
 #define MAX_LEDGER_ENTRIES (UINT16_MAX / sizeof(struct ledger_entry_small))
 
 /* These features can fit in a small ledger entry. All others require a full size ledger entry */
-#define LEDGER_ENTRY_SMALL_FLAGS (LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE | LEDGER_ENTRY_ALLOW_INACTIVE)
+#define LEDGER_ENTRY_SMALL_FLAGS (LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE | LEDGER_ENTRY_ALLOW_INACTIVE | \
+	LEDGER_ENTRY_ALLOW_PERCPU)
 
 /* Turn on to debug invalid ledger accesses */
 #if MACH_ASSERT
@@ -202,6 +206,7 @@ struct ledger_template {
 	lck_mtx_t               lt_lock;
 	zone_t                  lt_zone;
 	bool                    lt_initialized;
+	bool                    lt_percpu;      /* has LF_PERCPU entries */
 	uint16_t                lt_next_offset;
 	uint16_t                lt_cnt;
 	uint16_t                lt_table_size;
@@ -250,6 +255,7 @@ static uint32_t flag_clear(volatile uint32_t *flags, uint32_t bit);
 
 static void ledger_entry_check_new_balance(thread_t thread, ledger_t ledger,
     int entry);
+static void ledger_percpu_drain(ledger_t ledger, int offset, bool discard);
 
 #if 0
 static void
@@ -505,6 +511,10 @@ ledger_entry_add_with_flags(ledger_template_t template, const char *key,
 	if ((flags & ~(LEDGER_ENTRY_SMALL_FLAGS)) == 0) {
 		size = sizeof(struct ledger_entry_small);
 		et->et_flags |= LF_TRACK_CREDIT_ONLY;
+		if (flags & LEDGER_ENTRY_ALLOW_PERCPU) {
+			et->et_flags |= LF_PERCPU;
+			template->lt_percpu = true;
+		}
 	} else {
 		size = sizeof(struct ledger_entry);
 	}
@@ -719,6 +729,143 @@ flag_clear(volatile uint32_t *flags, uint32_t bit)
 	return OSBitAndAtomic(~bit, flags);
 }
 
+#pragma mark per-cpu entries
+
+/*
+ * Entries created with LEDGER_ENTRY_ALLOW_PERCPU are small credit-only
+ * counters, without limits or callbacks, that are updated on hot paths
+ * (page grabs, swapins) and only ever looked at by readers.  Instead of
+ * bouncing the entry's cache line between CPUs on every update, each CPU
+ * keeps a small direct-mapped cache of pending deltas.
+ *
+ * A delta is folded back into its entry when its slot is claimed by
+ * another entry, when the entry is read, rolled up or zeroed, and before
+ * a debit, so that panic-on-negative still sees every prior credit.
+ * Slots of a ledger being freed are discarded.
+ *
+ * Slots don't hold a reference on their ledger: the per-cpu lock
+ * serializes eviction against the discard done by ledger_dereference().
+ */
+#define LEDGER_PERCPU_SLOTS     8
+
+struct ledger_percpu_slot {
+	ledger_t                lps_ledger;
+	uint16_t                lps_offset;
+	ledger_amount_t         lps_delta;
+};
+
+struct ledger_percpu_cache {
+	simple_lock_data_t      lpc_lock;
+	struct ledger_percpu_slot lpc_slots[LEDGER_PERCPU_SLOTS];
+};
+
+static struct ledger_percpu_cache PERCPU_DATA(ledger_percpu_cache);
+static bool ledger_percpu_ready;
+
+__startup_func
+static void
+ledger_percpu_startup(void)
+{
+	percpu_foreach(cache, ledger_percpu_cache) {
+		simple_lock_init(&cache->lpc_lock, 0);
+	}
+	ledger_percpu_ready = true;
+}
+STARTUP(PERCPU, STARTUP_RANK_LAST, ledger_percpu_startup);
+
+static inline struct ledger_percpu_slot *
+ledger_percpu_slot(struct ledger_percpu_cache *cache, ledger_t ledger,
+    uint16_t offset)
+{
+	uint32_t hash = (uint32_t)((uintptr_t)ledger >> 4) + offset;
+
+	return &cache->lpc_slots[hash % LEDGER_PERCPU_SLOTS];
+}
+
+static inline bool
+ledger_entry_is_percpu(ledger_t ledger, int entry)
+{
+	return ENTRY_ID_SIZE(entry) == sizeof(struct ledger_entry_small) &&
+	       (ledger->l_entries[ENTRY_ID_OFFSET(entry)].les_flags & LF_PERCPU);
+}
+
+/*
+ * Add amount to the local CPU's cached delta for an entry.
+ * Returns false if the caller must update the entry directly.
+ */
+static bool
+ledger_percpu_credit(ledger_t ledger, uint16_t offset, ledger_amount_t amount)
+{
+	struct ledger_percpu_cache *cache;
+	struct ledger_percpu_slot *slot;
+
+	if (!ledger_percpu_ready || ml_at_interrupt_context()) {
+		return false;
+	}
+
+	disable_preemption();
+	cache = PERCPU_GET(ledger_percpu_cache);
+	slot = ledger_percpu_slot(cache, ledger, offset);
+
+	simple_lock(&cache->lpc_lock, LCK_GRP_NULL);
+	if (slot->lps_ledger != ledger || slot->lps_offset != offset) {
+		if (slot->lps_delta != 0) {
+			OSAddAtomic64(slot->lps_delta,
+			    &slot->lps_ledger->l_entries[slot->lps_offset].les_credit);
+		}
+		slot->lps_ledger = ledger;
+		slot->lps_offset = offset;
+		slot->lps_delta = 0;
+	}
+	slot->lps_delta += amount;
+	simple_unlock(&cache->lpc_lock);
+	enable_preemption();
+
+	return true;
+}
+
+/*
+ * Fold every CPU's cached delta for one entry of a ledger (or all of them,
+ * if offset is -1) back into the ledger, or throw them away if the ledger
+ * is being freed.
+ */
+static void
+ledger_percpu_drain(ledger_t ledger, int offset, bool discard)
+{
+	struct ledger_percpu_slot *slot;
+
+	if (!ledger_percpu_ready) {
+		return;
+	}
+
+	percpu_foreach(cache, ledger_percpu_cache) {
+		simple_lock(&cache->lpc_lock, LCK_GRP_NULL);
+		for (int i = 0; i < LEDGER_PERCPU_SLOTS; i++) {
+			slot = &cache->lpc_slots[i];
+			if (slot->lps_ledger != ledger ||
+			    (offset != -1 && slot->lps_offset != offset)) {
+				continue;
+			}
+			if (!discard && slot->lps_delta != 0) {
+				OSAddAtomic64(slot->lps_delta,
+				    &ledger->l_entries[slot->lps_offset].les_credit);
+			}
+			slot->lps_ledger = LEDGER_NULL;
+			slot->lps_offset = 0;
+			slot->lps_delta = 0;
+		}
+		simple_unlock(&cache->lpc_lock);
+	}
+}
+
+static inline void
+ledger_percpu_sync(ledger_t ledger, int entry)
+{
+	if (ledger_entry_is_percpu(ledger, entry)) {
+		ledger_percpu_drain(ledger, ENTRY_ID_OFFSET(entry), false);
+	}
+}
+
 /*
  * Take a reference on a ledger
  */
@@ -745,6 +892,9 @@ ledger_dereference(ledger_t ledger)
 
 	if (os_ref_release(&ledger->l_refs) == 0) {
 		ledger_template_t template = ledger->l_template;
+		if (template->lt_percpu) {
+			ledger_percpu_drain(ledger, -1, true);
+		}
 		if (template->lt_zone) {
 			zfree(template->lt_zone, ledger);
 		} else {
@@ -1080,6 +1230,9 @@ ledger_entry_check_new_balance(thread_t thread, ledger_t ledger,
 void
 ledger_check_new_balance(thread_t thread, ledger_t ledger, int entry)
 {
+	if (is_entry_valid(ledger, entry)) {
+		ledger_percpu_sync(ledger, entry);
+	}
 	ledger_entry_check_new_balance(thread, ledger, entry);
 }
 
@@ -1103,6 +1256,14 @@ ledger_credit_thread(thread_t thread, ledger_t ledger, int entry, ledger_amount_
 
 	if (entry_size == sizeof(struct ledger_entry_small)) {
 		struct ledger_entry_small *les = &ledger->l_entries[ENTRY_ID_OFFSET(entry)];
+		/*
+		 * Cached credits can't make the balance go negative, so
+		 * there is nothing to check until the entry is read.
+		 */
+		if ((les->les_flags & LF_PERCPU) &&
+		    ledger_percpu_credit(ledger, ENTRY_ID_OFFSET(entry), amount)) {
+			return KERN_SUCCESS;
+		}
 		old = OSAddAtomic64(amount, &les->les_credit);
 		new = old + amount;
 	} else if (entry_size == sizeof(struct ledger_entry)) {
@@ -1184,6 +1345,7 @@ ledger_rollup_entry(ledger_t to_ledger, ledger_t from_ledger, int entry)
 
 	assert(to_ledger->l_template->lt_cnt == from_ledger->l_template->lt_cnt);
 	if (is_entry_valid(from_ledger, entry) && is_entry_valid(to_ledger, entry)) {
+		ledger_percpu_sync(from_ledger, entry);
 		from_les = &from_ledger->l_entries[entry_offset];
 		to_les = &to_ledger->l_entries[entry_offset];
 		if (entry_size == sizeof(struct ledger_entry)) {
@@ -1222,6 +1384,7 @@ ledger_zero_balance(ledger_t ledger, int entry)
 
 	les = &ledger->l_entries[entry_offset];
 	if (entry_size == sizeof(struct ledger_entry_small)) {
+		ledger_percpu_sync(ledger, entry);
 		while (true) {
 			credit = les->les_credit;
 			if (OSCompareAndSwap64(credit, 0, &les->les_credit)) {
@@ -1774,6 +1937,9 @@ ledger_debit_thread(thread_t thread, ledger_t ledger, int entry, ledger_amount_t
 
 	if (entry_size == sizeof(struct ledger_entry_small)) {
 		struct ledger_entry_small *les = &ledger->l_entries[ENTRY_ID_OFFSET(entry)];
+		if (les->les_flags & LF_PERCPU) {
+			ledger_percpu_drain(ledger, ENTRY_ID_OFFSET(entry), false);
+		}
 		old = OSAddAtomic64(-amount, &les->les_credit);
 		new = old - amount;
 	} else if (entry_size == sizeof(struct ledger_entry)) {
@@ -2095,6 +2261,7 @@ ledger_get_entries(ledger_t ledger, int entry, ledger_amount_t *credit,
 		*credit = le->le_credit;
 		*debit = le->le_debit;
 	} else if (entry_size == sizeof(struct ledger_entry_small)) {
+		ledger_percpu_sync(ledger, entry);
 		*credit = les->les_credit;
 		*debit = 0;
 	} else {
@@ -2241,6 +2408,7 @@ ledger_fill_entry_info(ledger_t ledger,
 	les = &ledger->l_entries[entry_offset];
 	memset(lei, 0, sizeof(*lei));
 	if (entry_size == sizeof(struct ledger_entry_small)) {
+		ledger_percpu_sync(ledger, entry);
 		lei->lei_limit = LEDGER_LIMIT_INFINITY;
 		lei->lei_credit = les->les_credit;
 		lei->lei_debit = 0;
@@ -173,6 +173,12 @@ __options_decl(ledger_entry_flags, uint64_t, {
 	LEDGER_ENTRY_ALLOW_LIMIT = 0x10,
 	LEDGER_ENTRY_ALLOW_ACTION = 0x20,
 	LEDGER_ENTRY_ALLOW_INACTIVE = 0x40,
+	/*
+	 * Updates are accumulated per-cpu and folded into the entry when it
+	 * is read. Only honored for entries without limits, callbacks or
+	 * max tracking, and meant for counters which are mostly credited.
+	 */
+	LEDGER_ENTRY_ALLOW_PERCPU = 0x80,
 });
 
 /*
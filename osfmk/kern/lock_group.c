@@ -66,10 +66,12 @@
 #include <i386/tsc.h>
 #endif
 
+#include <kern/backtrace.h>
 #include <kern/compact_id.h>
 #include <kern/kalloc.h>
 #include <kern/lock_stat.h>
 #include <kern/locks.h>
+#include <kern/thread.h>
 
 #include <os/atomic_private.h>
 
@@ -407,6 +409,228 @@ host_lockgroup_info(
 	return KERN_SUCCESS;
 }
 
+#pragma mark lock profiling
+
+/*
+ * Profiles are handed out from a fixed pool to the first groups seeing
+ * a sampled contention, and slot 0 collects the samples of the groups
+ * that came too late to get one. Profiles are never recycled, so that
+ * the contention of groups that have since been destroyed is still
+ * reported.
+ *
+ * The profile and site tables are only ever updated with a try-lock:
+ * a sample racing with another one is dropped rather than adding
+ * contention of its own.
+ */
+#define LCK_PROF_GROUPS         64
+#define LCK_PROF_SITES          64
+
+TUNABLE_WRITEABLE(uint32_t, lck_prof_sample_rate, "lck_prof_sample", 0);
+
+static SIMPLE_LOCK_DECLARE(lck_prof_lock, 0);
+static lockgroup_prof_info_t lck_prof_groups[LCK_PROF_GROUPS] = {
+	[0].lockgroup_name = "<other>",
+};
+static uint32_t lck_prof_group_count = 1;
+static lockprof_site_t lck_prof_sites[LCK_PROF_SITES];
+static uint32_t lck_prof_site_count;
+
+static_assert(LCK_PROF_MTX == LOCKPROF_TYPE_MTX);
+static_assert(LCK_PROF_RW == LOCKPROF_TYPE_RW);
+
+uint64_t
+lck_prof_sample_begin_slow(void)
+{
+	thread_t thread = current_thread();
+
+	if (++thread->lck_prof_tick < os_atomic_load(&lck_prof_sample_rate, relaxed)) {
+		return 0;
+	}
+	thread->lck_prof_tick = 0;
+	return mach_absolute_time();
+}
+
+static uint32_t
+lck_prof_bucket(uint64_t ns)
+{
+	uint32_t bit = (uint32_t)flsll(ns);
+
+	if (bit <= LOCKPROF_BUCKET_SHIFT) {
+		return 0;
+	}
+	return MIN(bit - LOCKPROF_BUCKET_SHIFT, LOCKPROF_NBUCKETS - 1);
+}
+
+static uint16_t
+lck_prof_slot_locked(lck_grp_t *grp)
+{
+	lockgroup_prof_info_t *prof;
+	uint32_t slot;
+
+	if (grp == LCK_GRP_NULL) {
+		return 0;
+	}
+	prof = grp->lck_grp_prof;
+	if (prof) {
+		return (uint16_t)(prof - lck_prof_groups);
+	}
+	if (lck_prof_group_count == LCK_PROF_GROUPS) {
+		return 0;
+	}
+
+	slot = lck_prof_group_count++;
+	strlcpy(lck_prof_groups[slot].lockgroup_name, grp->lck_grp_name,
+	    LOCKGROUP_MAX_NAME);
+	grp->lck_grp_prof = &lck_prof_groups[slot];
+	return (uint16_t)slot;
+}
+
+static void
+lck_prof_site_record_locked(
+	uint16_t                slot,
+	uint32_t                type,
+	uint64_t                ns,
+	const uint64_t         *bt)
+{
+	lockprof_site_t *site, *victim = NULL;
+
+	for (uint32_t i = 0; i < lck_prof_site_count; i++) {
+		site = &lck_prof_sites[i];
+		if (site->lockprof_group == slot && site->lockprof_type == type &&
+		    memcmp(site->lockprof_bt, bt, sizeof(site->lockprof_bt)) == 0) {
+			goto found;
+		}
+		if (victim == NULL || site->lockprof_count < victim->lockprof_count) {
+			victim = site;
+		}
+	}
+
+	if (lck_prof_site_count < LCK_PROF_SITES) {
+		site = &lck_prof_sites[lck_prof_site_count++];
+	} else {
+		/*
+		 * Space-saving replacement: evict the least seen site,
+		 * and have the newcomer inherit its count so that a stream
+		 * of rare sites can't push out the frequent ones.
+		 */
+		site = victim;
+		site->lockprof_wait_total = 0;
+		site->lockprof_wait_max = 0;
+	}
+	site->lockprof_group = slot;
+	site->lockprof_type = (uint16_t)type;
+	memcpy(site->lockprof_bt, bt, sizeof(site->lockprof_bt));
+
+found:
+	site->lockprof_count++;
+	site->lockprof_wait_total += ns;
+	if (ns > site->lockprof_wait_max) {
+		site->lockprof_wait_max = ns;
+	}
+}
+
+void
+lck_prof_sample_end(
+	const void             *lock,
+	uint32_t                grp_attr_id,
+	uint32_t                type,
+	uint64_t                start,
+	bool                    blocked)
+{
+	struct backtrace_control ctl = {
+		.btc_frame_addr = (uintptr_t)__builtin_frame_address(0),
+	};
+	uintptr_t frames[LOCKPROF_SITE_DEPTH];
+	uint64_t bt[LOCKPROF_SITE_DEPTH] = { };
+	thread_t thread = current_thread();
+	lockgroup_prof_info_t *prof;
+	unsigned int depth;
+	uint64_t ns;
+	uint16_t slot;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+
+	depth = backtrace(frames, LOCKPROF_SITE_DEPTH, &ctl, NULL);
+	for (unsigned int i = 0; i < depth; i++) {
+		bt[i] = VM_KERNEL_UNSLIDE(frames[i]);
+	}
+
+	if (!simple_lock_try(&lck_prof_lock, LCK_GRP_NULL)) {
+		return;
+	}
+	slot = lck_prof_slot_locked(lck_grp_resolve(grp_attr_id));
+	lck_prof_site_record_locked(slot, type, ns, bt);
+	simple_unlock(&lck_prof_lock);
+
+	prof = &lck_prof_groups[slot];
+	os_atomic_inc(&prof->lockprof_samples[type], relaxed);
+	if (blocked) {
+		os_atomic_inc(&prof->lockprof_block[type][lck_prof_bucket(ns)], relaxed);
+	} else {
+		os_atomic_inc(&prof->lockprof_spin[type][lck_prof_bucket(ns)], relaxed);
+	}
+
+	/*
+	 * A thread only tracks the hold time of its last sampled lock,
+	 * if it was still holding a previous one, that sample is lost.
+	 */
+	thread->lck_prof_hold_slot = slot;
+	thread->lck_prof_hold_type = (uint16_t)type;
+	thread->lck_prof_hold_start = mach_absolute_time();
+	thread->lck_prof_hold_lock = lock;
+}
+
+void
+lck_prof_hold_end(thread_t thread)
+{
+	lockgroup_prof_info_t *prof = &lck_prof_groups[thread->lck_prof_hold_slot];
+	uint64_t ns;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() -
+	    thread->lck_prof_hold_start, &ns);
+	os_atomic_inc(&prof->lockprof_hold[thread->lck_prof_hold_type][lck_prof_bucket(ns)],
+	    relaxed);
+	thread->lck_prof_hold_lock = NULL;
+}
+
+/*
+ * Copies out up to `count` profiles, or returns how many there are
+ * when `buf` is NULL.
+ */
+uint32_t
+lck_prof_copy_groups(lockgroup_prof_info_t *buf, uint32_t count)
+{
+	simple_lock(&lck_prof_lock, LCK_GRP_NULL);
+	if (buf == NULL) {
+		count = lck_prof_group_count;
+	} else {
+		count = MIN(count, lck_prof_group_count);
+		memcpy(buf, lck_prof_groups, count * sizeof(*buf));
+	}
+	simple_unlock(&lck_prof_lock);
+
+	return count;
+}
+
+/*
+ * Copies out up to `count` call sites, or returns how many there are
+ * when `buf` is NULL.
+ */
+uint32_t
+lck_prof_copy_sites(lockprof_site_t *buf, uint32_t count)
+{
+	simple_lock(&lck_prof_lock, LCK_GRP_NULL);
+	if (buf == NULL) {
+		count = lck_prof_site_count;
+	} else {
+		count = MIN(count, lck_prof_site_count);
+		memcpy(buf, lck_prof_sites, count * sizeof(*buf));
+	}
+	simple_unlock(&lck_prof_lock);
+
+	return count;
+}
+
 #pragma mark lock attributes
 
 __startup_func
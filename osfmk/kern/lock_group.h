@@ -125,6 +125,7 @@ extern struct lck_debug_state {
 
 __options_decl(lck_grp_options_t, uint32_t, {
 	LCK_GRP_ATTR_NONE       = 0x00000000,
+	LCK_GRP_ATTR_RW_BIASED  = 0x00080000, /* reader biased rw locks        */
 
 #if MACH_KERNEL_PRIVATE
 	LCK_GRP_ATTR_ID_MASK    = 0x0000ffff,
@@ -172,6 +173,7 @@ struct _lck_grp_ {
 	uint32_t                lck_grp_mtxcnt;
 	uint32_t                lck_grp_rwcnt;
 	char                    lck_grp_name[LCK_GRP_MAX_NAME];
+	struct lockgroup_prof_info *lck_grp_prof;      /* sampled contention profile */
 #if CONFIG_DTRACE
 	lck_grp_stats_t         lck_grp_stats;
 #endif /* CONFIG_DTRACE */
@@ -248,6 +250,19 @@ extern void             lck_grp_enable_feature(
 
 extern void             lck_grp_disable_feature(
 	lck_debug_feature_t     feat);
+
+/*
+ * Sampled contention profiling, see lck_prof_sample_begin().
+ */
+extern uint32_t         lck_prof_sample_rate;
+
+extern uint32_t         lck_prof_copy_groups(
+	struct lockgroup_prof_info *buf,
+	uint32_t                count);
+
+extern uint32_t         lck_prof_copy_sites(
+	struct lockprof_site   *buf,
+	uint32_t                count);
 #pragma GCC visibility pop
 #endif /* XNU_KERNEL_PRIVATE */
 
@@ -840,6 +840,8 @@ lck_mtx_lock_contended(lck_mtx_t *lock, thread_t thread, lck_mtx_mode_t mode)
 #endif /* CONFIG_DTRACE */
 	bool              direct_wait = false;
 	uint64_t          spin_start;
+	uint64_t          prof_start = lck_prof_sample_begin();
+	bool              prof_blocked = false;
 	uint32_t          profile;
 
 	lck_mtx_check_irq(lock);
@@ -952,6 +954,7 @@ lck_mtx_lock_contended(lck_mtx_t *lock, thread_t thread, lck_mtx_mode_t mode)
 		    compiler_acq_rel);
 		ts = lck_mtx_lock_wait(lock, thread,
 		    ctid_get_thread(state.owner), ts);
+		prof_blocked = true;
 
 		/* returns interlock unlocked and preemption re-enabled */
 		lock_disable_preemption_for_thread(thread);
@@ -988,6 +991,10 @@ lck_mtx_lock_contended(lck_mtx_t *lock, thread_t thread, lck_mtx_mode_t mode)
 	}
 	LCK_MTX_ACQUIRED(lock, lock->lck_mtx_grp,
 	    mode != LCK_MTX_MODE_SLEEPABLE, profile);
+	if (prof_start) {
+		lck_prof_sample_end(lock, lock->lck_mtx_grp, LCK_PROF_MTX,
+		    prof_start, prof_blocked);
+	}
 }
 
 #if LCK_MTX_CHECK_INVARIANTS || CONFIG_DTRACE
@@ -1296,6 +1303,7 @@ lck_mtx_unlock(lck_mtx_t *lock)
 	uint32_t take_slowpath = 0;
 	uint32_t data;
 
+	LCK_PROF_HOLD_END(thread, lock);
 	take_slowpath |= LCK_MTX_SNIFF_DTRACE();
 
 	/*
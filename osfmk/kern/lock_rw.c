@@ -104,6 +104,9 @@ KALLOC_TYPE_DEFINE(KT_LCK_RW, lck_rw_t, KT_PRIV_ACCT);
 #define ordered_store_rw(lock, value)           os_atomic_store(&(lock)->lck_rw_data, (value), compiler_acq_rel)
 #define ordered_store_rw_owner(lock, value)     os_atomic_store(&(lock)->lck_rw_owner, (value), compiler_acq_rel)
 
+/* allows LCK_GRP_ATTR_RW_BIASED groups to make reader biased locks */
+static TUNABLE(bool, lck_rw_rbias_enabled, "lck_rw_rbias", true);
+
 #ifdef DEBUG_RW
 static TUNABLE(bool, lck_rw_recursive_shared_assert_74048094, "lck_rw_recursive_shared_assert", false);
 SECURITY_READ_ONLY_EARLY(vm_packing_params_t) rwlde_caller_packing_params =
@@ -163,6 +166,10 @@ lck_rw_alloc_init(
  * Readers can lock a shared lock even if there are writers waiting. Writers could potentially
  * starve.
  *
+ * Locks of a group created with LCK_GRP_ATTR_RW_BIASED are reader biased: readers normally
+ * do not write to the lock at all, at the price of a much more expensive exclusive acquisition
+ * after a period of read-only use. Only read-mostly locks should use such groups.
+ *
  * @param lck           lock to initialize.
  * @param grp           lock group to associate with the lock.
  * @param attr          lock attribute to initialize the lock.
@@ -182,9 +189,14 @@ lck_rw_init(
 	}
 	*lck = (lck_rw_t){
 		.lck_rw_type = type,
+		.lck_rw_grp = grp->lck_grp_attr_id & LCK_GRP_ATTR_ID_MASK,
 		.lck_rw_can_sleep = true,
 		.lck_rw_priv_excl = !(attr->lck_attr_val & LCK_ATTR_RW_SHARED_PRIORITY),
 	};
+	if (lck_rw_rbias_enabled && (grp->lck_grp_attr_id & LCK_GRP_ATTR_RW_BIASED)) {
+		lck->lck_rw_rbias_ok = true;
+		lck->lck_rw_rbias = true;
+	}
 	lck_grp_reference(grp, &grp->lck_grp_rwcnt);
 }
 
@@ -759,6 +771,273 @@ lck_rw_interlock_spin(
 	}
 }
 
+/*
+ * Reader bias
+ *
+ * Locks initialized in a group created with LCK_GRP_ATTR_RW_BIASED let
+ * readers skip the atomic on lck_rw_data, following BRAVO (Dice & Kogan,
+ * "BRAVO: Biased Locking for Reader-Writer Locks").  While LCK_RW_RBIAS
+ * is set, a reader publishes itself by claiming the lck_rw_rbias_table
+ * slot that (lock, thread) hashes to, and then checks that the bias is
+ * still set.  Such readers are not counted in shared_count, and the
+ * lock's cache line is only ever read by them.
+ *
+ * A writer that acquires the lock while the bias is set turns it off and
+ * waits until no slot refers to the lock anymore.  Since that revocation
+ * scans the whole table, the bias is then kept off for LCK_RW_RBIAS_INHIBIT
+ * times as long as the revocation took, after which the next reader that
+ * takes the regular path turns it back on.
+ *
+ * The table is indexed by thread rather than by cpu, since holders of
+ * sleepable locks can block and migrate while holding the lock.
+ */
+#define LCK_RW_RBIAS_SLOTS      4096
+#define LCK_RW_RBIAS_INHIBIT    9
+
+struct lck_rw_rbias_slot {
+	lck_rw_t *_Atomic       lrs_lock;
+	ctid_t _Atomic          lrs_owner;
+};
+
+static struct lck_rw_rbias_slot lck_rw_rbias_table[LCK_RW_RBIAS_SLOTS];
+
+static inline struct lck_rw_rbias_slot *
+lck_rw_rbias_slot(
+	lck_rw_t        *lock,
+	thread_t        thread)
+{
+	uint32_t hash;
+
+	hash = (uint32_t)((uintptr_t)lock >> 4) ^ (thread->ctid * 0x9e3779b9u);
+	hash ^= hash >> 16;
+	return &lck_rw_rbias_table[hash & (LCK_RW_RBIAS_SLOTS - 1)];
+}
+
+static inline bool
+lck_rw_rbias_held(
+	lck_rw_t        *lock,
+	thread_t        thread)
+{
+	struct lck_rw_rbias_slot *slot = lck_rw_rbias_slot(lock, thread);
+
+	return os_atomic_load(&slot->lrs_lock, relaxed) == lock &&
+	       os_atomic_load(&slot->lrs_owner, relaxed) == thread->ctid;
+}
+
+static inline void
+lck_rw_rbias_slot_clear(
+	struct lck_rw_rbias_slot *slot)
+{
+	os_atomic_store(&slot->lrs_owner, 0, relaxed);
+	os_atomic_store(&slot->lrs_lock, NULL, release);
+}
+
+/*
+ * Try to hold the lock shared through the reader indicator table.
+ * Returns false if the caller has to take the regular path.
+ */
+static bool
+lck_rw_rbias_enter(
+	lck_rw_t        *lock,
+	thread_t        thread)
+{
+	struct lck_rw_rbias_slot *slot = lck_rw_rbias_slot(lock, thread);
+
+	if (!os_atomic_cmpxchg(&slot->lrs_lock, NULL, lock, seq_cst)) {
+		return false;
+	}
+	os_atomic_store(&slot->lrs_owner, thread->ctid, relaxed);
+
+	/* pairs with the fence in lck_rw_rbias_revoke() */
+	if (os_atomic_load(&lock->lck_rw_data, seq_cst) & LCK_RW_RBIAS) {
+		return true;
+	}
+	lck_rw_rbias_slot_clear(slot);
+	return false;
+}
+
+static bool
+lck_rw_rbias_exit(
+	lck_rw_t        *lock,
+	thread_t        thread)
+{
+	struct lck_rw_rbias_slot *slot = lck_rw_rbias_slot(lock, thread);
+
+	if (!lck_rw_rbias_held(lock, thread)) {
+		return false;
+	}
+	lck_rw_rbias_slot_clear(slot);
+	return true;
+}
+
+/*
+ * Sets or clears LCK_RW_RBIAS without disturbing interlock holders.
+ * Clearing it is only allowed to the thread that owns want_excl or
+ * want_upgrade, see lck_rw_rbias_revoke().
+ */
+static void
+lck_rw_rbias_update(
+	lck_rw_t        *lock,
+	bool            enable)
+{
+	uint32_t        data, prev;
+
+	for (;;) {
+		data = atomic_exchange_begin32(&lock->lck_rw_data, &prev, memory_order_relaxed);
+		if (data & LCK_RW_INTERLOCK) {
+			atomic_exchange_abort();
+			lck_rw_interlock_spin(lock);
+			continue;
+		}
+		if (enable) {
+			data |= LCK_RW_RBIAS;
+		} else {
+			data &= ~LCK_RW_RBIAS;
+		}
+		if (atomic_exchange_complete32(&lock->lck_rw_data, prev, data, memory_order_relaxed)) {
+			break;
+		}
+		cpu_pause();
+	}
+}
+
+/*
+ * Called by readers that took the regular path on a lock whose bias
+ * is off, to turn it back on once the inhibition period is over.
+ */
+static void
+lck_rw_rbias_maybe_enable(
+	lck_rw_t        *lock)
+{
+	uint32_t now = (uint32_t)(mach_absolute_time() >> LCK_RW_RBIAS_TIME_SHIFT);
+
+	if ((int32_t)(now - os_atomic_load(&lock->lck_rw_rbias_until, relaxed)) >= 0) {
+		lck_rw_rbias_update(lock, true);
+	}
+}
+
+/*
+ * Called by a writer that owns want_excl or want_upgrade, once the
+ * readers counted in shared_count have drained: turns the bias off and
+ * waits for the readers that went through the table to leave.
+ *
+ * If trylock is set, or if lock_pause returns true, gives up as soon as a
+ * reader is found instead: the bias is turned back on, false is returned,
+ * and the caller must drop its claim on the lock.
+ */
+static bool
+lck_rw_rbias_revoke(
+	lck_rw_t        *lock,
+	bool            trylock,
+	bool            (^lock_pause)(void))
+{
+	uint64_t        start, now, deadline = 0;
+	bool            waited = false;
+
+	lck_rw_rbias_update(lock, false);
+	os_atomic_thread_fence(seq_cst);
+
+	start = mach_absolute_time();
+	for (uint32_t i = 0; i < LCK_RW_RBIAS_SLOTS; i++) {
+		struct lck_rw_rbias_slot *slot = &lck_rw_rbias_table[i];
+
+		while (os_atomic_load(&slot->lrs_lock, relaxed) == lock) {
+			if (trylock || (lock_pause && lock_pause())) {
+				lck_rw_rbias_update(lock, true);
+				return false;
+			}
+			if (!waited) {
+				deadline = lck_rw_deadline_for_spin(lock);
+				waited = true;
+			}
+			if (lock->lck_rw_can_sleep && mach_absolute_time() >= deadline) {
+				mutex_pause(0);
+			} else {
+				cpu_pause();
+			}
+		}
+	}
+	os_atomic_thread_fence(acquire);
+
+	now = mach_absolute_time();
+	os_atomic_store(&lock->lck_rw_rbias_until, (uint32_t)
+	    ((now + (now - start) * LCK_RW_RBIAS_INHIBIT) >> LCK_RW_RBIAS_TIME_SHIFT),
+	    relaxed);
+
+#if CONFIG_DTRACE
+	if (waited) {
+		LOCKSTAT_RECORD(LS_LCK_RW_LOCK_EXCL_SPIN, lock, now - start, 1);
+	}
+#endif /* CONFIG_DTRACE */
+	return true;
+}
+
+/*
+ * Drops the want_excl claim of a try-lock that failed to revoke the
+ * bias, and wakes up whoever queued behind it.
+ */
+static void
+lck_rw_rbias_drop_excl(
+	lck_rw_t        *lock)
+{
+	uint32_t        data, prev;
+
+	for (;;) {
+		data = atomic_exchange_begin32(&lock->lck_rw_data, &prev, memory_order_release_smp);
+		if (data & LCK_RW_INTERLOCK) {
+			atomic_exchange_abort();
+			lck_rw_interlock_spin(lock);
+			continue;
+		}
+		data &= ~(LCK_RW_WANT_EXCL | LCK_RW_W_WAITING | LCK_RW_R_WAITING);
+		if (atomic_exchange_complete32(&lock->lck_rw_data, prev, data, memory_order_release_smp)) {
+			break;
+		}
+		cpu_pause();
+	}
+	if (prev & LCK_RW_W_WAITING) {
+		thread_wakeup(LCK_RW_WRITER_EVENT(lock));
+	}
+	if (prev & LCK_RW_R_WAITING) {
+		thread_wakeup(LCK_RW_READER_EVENT(lock));
+	}
+}
+
+/*
+ * Turns a hold through the table into one counted in shared_count, so
+ * that it can be upgraded.  Fails if a writer has already claimed the
+ * lock, since it may be waiting for this very hold in the revocation,
+ * in which case the hold is dropped.
+ */
+static bool
+lck_rw_rbias_count(
+	lck_rw_t        *lock,
+	thread_t        thread)
+{
+	uint32_t        data, prev;
+
+	for (;;) {
+		data = atomic_exchange_begin32(&lock->lck_rw_data, &prev, memory_order_acquire_smp);
+		if (data & LCK_RW_INTERLOCK) {
+			atomic_exchange_abort();
+			lck_rw_interlock_spin(lock);
+			continue;
+		}
+		if (data & (LCK_RW_WANT_EXCL | LCK_RW_WANT_UPGRADE)) {
+			atomic_exchange_abort();
+			(void) lck_rw_rbias_exit(lock, thread);
+			return false;
+		}
+		data += LCK_RW_SHARED_READER;
+		if (atomic_exchange_complete32(&lock->lck_rw_data, prev, data, memory_order_acquire_smp)) {
+			break;
+		}
+		cpu_pause();
+	}
+	(void) lck_rw_rbias_exit(lock, thread);
+	return true;
+}
+
 #define LCK_RW_GRAB_WANT        0
 #define LCK_RW_GRAB_SHARED      1
 
@@ -884,6 +1163,7 @@ lck_rw_lock_exclusive_gen(
 	lck_rw_drain_state_t    drain_state = LCK_RW_DRAIN_S_NOT_DRAINED;
 	wait_result_t           res = 0;
 	boolean_t               istate;
+	uint64_t                prof_start = lck_prof_sample_begin();
 
 #if     CONFIG_DTRACE
 	boolean_t dtrace_ls_initialized = FALSE;
@@ -1088,6 +1368,10 @@ lck_rw_lock_exclusive_gen(
 #if CONFIG_DTRACE
 	LOCKSTAT_RECORD(LS_LCK_RW_LOCK_EXCL_ACQUIRE, lock, 1);
 #endif  /* CONFIG_DTRACE */
+	if (prof_start) {
+		lck_prof_sample_end(lock, lock->lck_rw_grp, LCK_PROF_RW,
+		    prof_start, slept != 0);
+	}
 
 	return TRUE;
 }
@@ -1132,6 +1416,10 @@ lck_rw_lock_exclusive_check_contended(
 		contended = true;
 		(void) lck_rw_lock_exclusive_gen(lock, NULL);
 	}
+	if (ordered_load_rw(lock) & LCK_RW_RBIAS) {
+		contended = true;
+		(void) lck_rw_rbias_revoke(lock, false, NULL);
+	}
 	assertf(lock->lck_rw_owner == 0, "state=0x%x, owner=%p",
 	    ordered_load_rw(lock), ctid_get_thread_unsafe(lock->lck_rw_owner));
 	ordered_store_rw_owner(lock, thread->ctid);
@@ -1173,6 +1461,12 @@ lck_rw_lock_exclusive_internal_inline(
 		return FALSE;
 	}
 
+	if ((ordered_load_rw(lock) & LCK_RW_RBIAS) &&
+	    !lck_rw_rbias_revoke(lock, false, lock_pause)) {
+		lck_rw_drop(lock, LCK_RW_GRAB_F_WANT_EXCL);
+		return FALSE;
+	}
+
 	assertf(lock->lck_rw_owner == 0, "state=0x%x, owner=%p",
 	    ordered_load_rw(lock), ctid_get_thread_unsafe(lock->lck_rw_owner));
 	ordered_store_rw_owner(lock, thread->ctid);
@@ -1264,6 +1558,7 @@ lck_rw_lock_shared_gen(
 	int                     slept = 0;
 	wait_result_t           res = 0;
 	boolean_t               istate;
+	uint64_t                prof_start = lck_prof_sample_begin();
 
 #if     CONFIG_DTRACE
 	uint64_t wait_interval = 0;
@@ -1372,6 +1667,10 @@ lck_rw_lock_shared_gen(
 #if     CONFIG_DTRACE
 	LOCKSTAT_RECORD(LS_LCK_RW_LOCK_SHARED_ACQUIRE, lck, 0);
 #endif  /* CONFIG_DTRACE */
+	if (prof_start) {
+		lck_prof_sample_end(lck, lck->lck_rw_grp, LCK_PROF_RW,
+		    prof_start, slept != 0);
+	}
 
 	return TRUE;
 }
@@ -1397,6 +1696,11 @@ lck_rw_lock_shared_internal_inline(
 		panic("Taking non-sleepable RW lock with preemption enabled");
 	}
 
+	if ((ordered_load_rw(lock) & LCK_RW_RBIAS) &&
+	    lck_rw_rbias_enter(lock, thread)) {
+		goto locked;
+	}
+
 	for (;;) {
 		data = atomic_exchange_begin32(&lock->lck_rw_data, &prev, memory_order_acquire_smp);
 		if (data & (LCK_RW_WANT_EXCL | LCK_RW_WANT_UPGRADE | LCK_RW_INTERLOCK)) {
@@ -1429,6 +1733,9 @@ lck_rw_lock_shared_internal_inline(
 		}
 		cpu_pause();
 	}
+	if ((data & (LCK_RW_RBIAS_OK | LCK_RW_RBIAS)) == LCK_RW_RBIAS_OK) {
+		lck_rw_rbias_maybe_enable(lock);
+	}
 #ifdef DEBUG_RW
 	if (check_canlock) {
 		/*
@@ -1710,6 +2017,11 @@ lck_rw_lock_shared_to_exclusive(
 	assert_held_rwlock(lock, thread, LCK_RW_TYPE_SHARED);
 #endif /* DEBUG_RW */
 
+	if (lock->lck_rw_rbias_ok && lck_rw_rbias_held(lock, thread) &&
+	    !lck_rw_rbias_count(lock, thread)) {
+		return lck_rw_lock_shared_to_exclusive_failure(lock, 0);
+	}
+
 	for (;;) {
 		data = atomic_exchange_begin32(&lock->lck_rw_data, &prev, memory_order_acquire_smp);
 		if (data & LCK_RW_INTERLOCK) {
@@ -1738,6 +2050,9 @@ lck_rw_lock_shared_to_exclusive(
 	if (data & LCK_RW_SHARED_MASK) {        /* check to see if all of the readers are drained */
 		lck_rw_lock_shared_to_exclusive_success(lock);  /* if not, we need to go wait */
 	}
+	if (ordered_load_rw(lock) & LCK_RW_RBIAS) {
+		(void) lck_rw_rbias_revoke(lock, false, NULL);
+	}
 
 	assertf(lock->lck_rw_owner == 0, "state=0x%x, owner=%p",
 	    ordered_load_rw(lock), ctid_get_thread_unsafe(lock->lck_rw_owner));
@@ -1912,6 +2227,11 @@ lck_rw_try_lock_shared_internal_inline(
 	boolean_t       check_canlock = TRUE;
 #endif
 
+	if ((ordered_load_rw(lock) & LCK_RW_RBIAS) &&
+	    lck_rw_rbias_enter(lock, thread)) {
+		goto locked;
+	}
+
 	for (;;) {
 		data = atomic_exchange_begin32(&lock->lck_rw_data, &prev, memory_order_acquire_smp);
 		if (data & LCK_RW_INTERLOCK) {
@@ -1938,6 +2258,9 @@ lck_rw_try_lock_shared_internal_inline(
 		}
 		cpu_pause();
 	}
+	if ((data & (LCK_RW_RBIAS_OK | LCK_RW_RBIAS)) == LCK_RW_RBIAS_OK) {
+		lck_rw_rbias_maybe_enable(lock);
+	}
 #ifdef DEBUG_RW
 	if (check_canlock) {
 		/*
@@ -1947,6 +2270,7 @@ lck_rw_try_lock_shared_internal_inline(
 		assert_canlock_rwlock(lock, thread, LCK_RW_TYPE_SHARED);
 	}
 #endif
+locked:
 	assertf(lock->lck_rw_owner == 0, "state=0x%x, owner=%p",
 	    ordered_load_rw(lock), ctid_get_thread_unsafe(lock->lck_rw_owner));
 
@@ -2022,6 +2346,10 @@ lck_rw_try_lock_exclusive_internal_inline(
 		}
 		cpu_pause();
 	}
+	if ((data & LCK_RW_RBIAS) && !lck_rw_rbias_revoke(lock, true, NULL)) {
+		lck_rw_rbias_drop_excl(lock);
+		return FALSE;
+	}
 	thread_t thread = current_thread();
 
 	if (lock->lck_rw_can_sleep) {
@@ -2122,6 +2450,48 @@ lck_rw_try_lock(
 	return _lck_rw_try_lock_type_panic(lck, lck_rw_type);
 }
 
+/*
+ *      Routine:        lck_rw_done_thread
+ *      Function:
+ *		Common tail of releasing a lock held in lock_type mode,
+ *		for the current thread's bookkeeping.
+ */
+static lck_rw_type_t
+lck_rw_done_thread(
+	lck_rw_t        *lck,
+	lck_rw_type_t   lock_type,
+	bool            can_sleep)
+{
+	thread_t        thread;
+	uint32_t        rwlock_count;
+
+	/* Check if dropping the lock means that we need to unpromote */
+	thread = current_thread();
+	LCK_PROF_HOLD_END(thread, lck);
+	if (can_sleep) {
+		rwlock_count = thread->rwlock_count--;
+	} else {
+		rwlock_count = UINT32_MAX;
+	}
+
+	if (rwlock_count == 0) {
+		panic("rw lock count underflow for thread %p", thread);
+	}
+
+	if ((rwlock_count == 1 /* field now 0 */) && (thread->sched_flags & TH_SFLAG_RW_PROMOTED)) {
+		/* sched_flags checked without lock, but will be rechecked while clearing */
+		lck_rw_clear_promotion(thread, unslide_for_kdebug(lck));
+	}
+#if CONFIG_DTRACE
+	LOCKSTAT_RECORD(LS_LCK_RW_DONE_RELEASE, lck, lock_type == LCK_RW_TYPE_SHARED ? 0 : 1);
+#endif
+
+#ifdef DEBUG_RW
+	remove_held_rwlock(lck, thread, lock_type);
+#endif /* DEBUG_RW */
+	return lock_type;
+}
+
 /*
  *      Routine:        lck_rw_done_gen
  *
@@ -2145,8 +2515,6 @@ lck_rw_done_gen(
 {
 	lck_rw_word_t   fake_lck;
 	lck_rw_type_t   lock_type;
-	thread_t        thread;
-	uint32_t        rwlock_count;
 
 	/*
 	 * prior_lock state is a snapshot of the 1st word of the
@@ -2171,30 +2539,7 @@ lck_rw_done_gen(
 		lock_type = LCK_RW_TYPE_EXCLUSIVE;
 	}
 
-	/* Check if dropping the lock means that we need to unpromote */
-	thread = current_thread();
-	if (fake_lck.can_sleep) {
-		rwlock_count = thread->rwlock_count--;
-	} else {
-		rwlock_count = UINT32_MAX;
-	}
-
-	if (rwlock_count == 0) {
-		panic("rw lock count underflow for thread %p", thread);
-	}
-
-	if ((rwlock_count == 1 /* field now 0 */) && (thread->sched_flags & TH_SFLAG_RW_PROMOTED)) {
-		/* sched_flags checked without lock, but will be rechecked while clearing */
-		lck_rw_clear_promotion(thread, unslide_for_kdebug(lck));
-	}
-#if CONFIG_DTRACE
-	LOCKSTAT_RECORD(LS_LCK_RW_DONE_RELEASE, lck, lock_type == LCK_RW_TYPE_SHARED ? 0 : 1);
-#endif
-
-#ifdef DEBUG_RW
-	remove_held_rwlock(lck, thread, lock_type);
-#endif /* DEBUG_RW */
-	return lock_type;
+	return lck_rw_done_thread(lck, lock_type, fake_lck.can_sleep);
 }
 
 /*!
@@ -2223,6 +2568,9 @@ lck_rw_done(
 	thread_t thread = current_thread();
 	assert_held_rwlock(lock, thread, 0);
 #endif /* DEBUG_RW */
+	if (lock->lck_rw_rbias_ok && lck_rw_rbias_exit(lock, current_thread())) {
+		return lck_rw_done_thread(lock, LCK_RW_TYPE_SHARED, lock->lck_rw_can_sleep);
+	}
 	for (;;) {
 		data = atomic_exchange_begin32(&lock->lck_rw_data, &prev, memory_order_release_smp);
 		if (data & LCK_RW_INTERLOCK) {          /* wait for interlock to clear */
@@ -2301,7 +2649,8 @@ lck_rw_unlock_shared(
 	assertf(lck->lck_rw_owner == 0,
 	    "state=0x%x, owner=%p", lck->lck_rw_data,
 	    ctid_get_thread_unsafe(lck->lck_rw_owner));
-	assertf(lck->lck_rw_shared_count > 0, "shared_count=0x%x", lck->lck_rw_shared_count);
+	assertf(lck->lck_rw_shared_count > 0 || lck_rw_rbias_held(lck, current_thread()),
+	    "shared_count=0x%x", lck->lck_rw_shared_count);
 	ret = lck_rw_done(lck);
 
 	if (ret != LCK_RW_TYPE_SHARED) {
@@ -2390,8 +2739,9 @@ lck_rw_assert(
 
 	switch (type) {
 	case LCK_RW_ASSERT_SHARED:
-		if ((lck->lck_rw_shared_count != 0) &&
-		    (lck->lck_rw_owner == 0)) {
+		if (((lck->lck_rw_shared_count != 0) &&
+		    (lck->lck_rw_owner == 0)) ||
+		    lck_rw_rbias_held(lck, thread)) {
 #if DEBUG_RW
 			assert_held_rwlock(lck, thread, LCK_RW_TYPE_SHARED);
 #endif /* DEBUG_RW */
@@ -2409,7 +2759,8 @@ lck_rw_assert(
 		}
 		break;
 	case LCK_RW_ASSERT_HELD:
-		if (lck->lck_rw_shared_count != 0) {
+		if (lck->lck_rw_shared_count != 0 ||
+		    lck_rw_rbias_held(lck, thread)) {
 #if DEBUG_RW
 			assert_held_rwlock(lck, thread, LCK_RW_TYPE_SHARED);
 #endif /* DEBUG_RW */
@@ -52,16 +52,18 @@ typedef union {
 		    r_waiting:              1,      /* Someone is sleeping on lock */
 		    w_waiting:              1,      /* Writer is sleeping on lock */
 		    can_sleep:              1,      /* Can attempts to lock go to sleep? */
-		    _pad2:                  8,      /* padding */
+		    rbias_ok:               1,      /* Group opted in to reader bias */
+		    rbias:                  1,      /* Readers may use the reader indicator table */
+		    _pad2:                  6,      /* padding */
 		    tag_valid:              1;      /* Field is actually a tag, not a bitfield */
 	};
 	uint32_t        data;                       /* Single word version of bitfields and shared count */
 } lck_rw_word_t;
 
 typedef struct {
-	uint32_t        lck_rw_unused : 24; /* tsid one day ... */
+	uint32_t        lck_rw_grp    : 24; /* lck_grp_t ID, for profiling */
 	uint32_t        lck_rw_type   :  8; /* LCK_TYPE_RW */
-	uint32_t        lck_rw_padding;
+	uint32_t        lck_rw_rbias_until; /* reader bias inhibited until, see LCK_RW_RBIAS_TIME_SHIFT */
 	lck_rw_word_t   lck_rw;
 	uint32_t        lck_rw_owner;       /* ctid_t */
 } lck_rw_t;     /* arm: 8  arm64: 16 x86: 16 */
@@ -74,6 +76,8 @@ typedef struct {
 #define lck_r_waiting           lck_rw.r_waiting
 #define lck_w_waiting           lck_rw.w_waiting
 #define lck_rw_can_sleep        lck_rw.can_sleep
+#define lck_rw_rbias_ok         lck_rw.rbias_ok
+#define lck_rw_rbias            lck_rw.rbias
 #define lck_rw_data             lck_rw.data
 // tag and data reference the same memory. When the tag_valid bit is set,
 // the data word should be treated as a tag instead of a bitfield.
@@ -88,7 +92,9 @@ typedef struct {
 #define LCK_RW_R_WAITING_BIT            20
 #define LCK_RW_W_WAITING_BIT            21
 #define LCK_RW_CAN_SLEEP_BIT            22
-//                                      23-30
+#define LCK_RW_RBIAS_OK_BIT             23
+#define LCK_RW_RBIAS_BIT                24
+//                                      25-30
 #define LCK_RW_TAG_VALID_BIT            31
 
 #define LCK_RW_INTERLOCK                (1U << LCK_RW_INTERLOCK_BIT)
@@ -98,11 +104,19 @@ typedef struct {
 #define LCK_RW_WANT_EXCL                (1U << LCK_RW_WANT_EXCL_BIT)
 #define LCK_RW_TAG_VALID                (1U << LCK_RW_TAG_VALID_BIT)
 #define LCK_RW_PRIV_EXCL                (1U << LCK_RW_PRIV_EXCL_BIT)
+#define LCK_RW_RBIAS_OK                 (1U << LCK_RW_RBIAS_OK_BIT)
+#define LCK_RW_RBIAS                    (1U << LCK_RW_RBIAS_BIT)
 #define LCK_RW_SHARED_MASK              (0xffff << LCK_RW_SHARED_READER_OFFSET)
 #define LCK_RW_SHARED_READER            (0x1 << LCK_RW_SHARED_READER_OFFSET)
 
 #define LCK_RW_TAG_DESTROYED            ((LCK_RW_TAG_VALID | 0xdddddeadu))      /* lock marked as Destroyed */
 
+/*
+ * lck_rw_rbias_until is kept in units of 2^LCK_RW_RBIAS_TIME_SHIFT
+ * absolute time ticks, truncated to 32 bits, and compared with wrap.
+ */
+#define LCK_RW_RBIAS_TIME_SHIFT         10
+
 #elif KERNEL_PRIVATE
 typedef struct {
 	uintptr_t               opaque[2] __kernel_data_semantics;
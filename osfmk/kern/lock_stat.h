@@ -120,6 +120,58 @@ extern void lck_grp_stat_inc(lck_grp_t *grp, lck_grp_stat_t *stat, bool always);
 #endif /* CONFIG_DTRACE */
 #endif /* XNU_KERNEL_PRIVATE */
 #if MACH_KERNEL_PRIVATE
+
+/*
+ * Sampled contention profiling
+ * ----------------------------
+ *
+ * Unlike the lockstat probes, this doesn't need DTrace: when
+ * lck_prof_sample_rate (kern.lock_prof_sample) is non zero, one in that
+ * many contended lck_mtx_t / lck_rw_t acquisitions of a thread is timed.
+ * The wait lands in the spin or block histogram of the lock group
+ * (block if the thread slept at all), and the backtrace of the acquisition
+ * is accounted in a small table of the most contended call sites.
+ *
+ * The thread then remembers the lock so that LCK_PROF_HOLD_END()
+ * can account for how long it held it.
+ *
+ * Uncontended acquisitions are never sampled, the only cost this adds
+ * to the fast paths is the LCK_PROF_HOLD_END() check on unlock.
+ */
+#define LCK_PROF_MTX            0       /* LOCKPROF_TYPE_MTX */
+#define LCK_PROF_RW             1       /* LOCKPROF_TYPE_RW */
+
+extern uint64_t lck_prof_sample_begin_slow(void);
+
+extern void lck_prof_sample_end(
+	const void             *lock,
+	uint32_t                grp_attr_id,
+	uint32_t                type,
+	uint64_t                start,
+	bool                    blocked);
+
+extern void lck_prof_hold_end(
+	thread_t                thread);
+
+/*
+ * Returns a non zero timestamp if this contended acquisition is sampled,
+ * which must then be passed to lck_prof_sample_end() once the lock is held.
+ */
+static inline uint64_t
+lck_prof_sample_begin(void)
+{
+	if (__probable(os_atomic_load(&lck_prof_sample_rate, relaxed) == 0)) {
+		return 0;
+	}
+	return lck_prof_sample_begin_slow();
+}
+
+#define LCK_PROF_HOLD_END(thread, lock) ({ \
+	if (__improbable((thread)->lck_prof_hold_lock == (lock))) {             \
+	        lck_prof_hold_end(thread);                                      \
+	}                                                                       \
+})
+
 #if CONFIG_DTRACE
 
 extern void dtrace_probe(uint32_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
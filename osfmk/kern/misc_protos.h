@@ -265,6 +265,7 @@ extern kern_return_t    kernel_get_special_port(
 	ipc_port_t      *portp);
 
 user_addr_t get_useraddr(void);
+user_addr_t get_usersp(void);
 
 /* symbol lookup */
 #ifndef __cplusplus
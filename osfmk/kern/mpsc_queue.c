@@ -173,6 +173,13 @@ _mpsc_queue_thread_wakeup(mpsc_daemon_queue_t dq)
 	thread_wakeup_thread((event_t)dq, dq->mpd_thread);
 }
 
+static void
+_mpsc_queue_thread_coalesced_wakeup(thread_call_param_t arg0,
+    thread_call_param_t arg1 __unused)
+{
+	_mpsc_queue_thread_wakeup((mpsc_daemon_queue_t)arg0);
+}
+
 static kern_return_t
 _mpsc_daemon_queue_init_with_thread(mpsc_daemon_queue_t dq,
     mpsc_daemon_invoke_fn_t invoke, int pri, const char *name,
@@ -270,6 +277,43 @@ mpsc_daemon_queue_init_with_target(mpsc_daemon_queue_t dq,
 	_mpsc_daemon_queue_init(dq, flags);
 }
 
+/* configuration */
+
+void
+mpsc_daemon_queue_set_batch_invoke(mpsc_daemon_queue_t dq,
+    mpsc_daemon_batch_invoke_fn_t invoke)
+{
+	assert((dq->mpd_options & MPSC_QUEUE_OPTION_BATCH) == 0);
+	dq->mpd_options |= MPSC_QUEUE_OPTION_BATCH_INVOKE;
+	dq->mpd_batch_invoke = invoke;
+}
+
+void
+mpsc_daemon_queue_set_wakeup_coalescing(mpsc_daemon_queue_t dq,
+    uint32_t threshold, uint64_t delay_ns)
+{
+	switch (dq->mpd_kind) {
+	case MPSC_QUEUE_KIND_THREAD:
+	case MPSC_QUEUE_KIND_THREAD_CRITICAL:
+		if (dq->mpd_coalesce_call == NULL) {
+			dq->mpd_coalesce_call = thread_call_allocate_with_options(
+				_mpsc_queue_thread_coalesced_wakeup, dq,
+				THREAD_CALL_PRIORITY_HIGH, THREAD_CALL_OPTIONS_ONCE);
+		}
+		break;
+	case MPSC_QUEUE_KIND_THREAD_CALL:
+		/* the drain thread call can be delayed directly */
+		dq->mpd_coalesce_call = dq->mpd_call;
+		break;
+	default:
+		panic("mpsc_queue[%p]: can't coalesce wakeups of kind %d",
+		    dq, dq->mpd_kind);
+	}
+
+	dq->mpd_coalesce_threshold = threshold;
+	nanoseconds_to_absolutetime(delay_ns, &dq->mpd_coalesce_delay);
+}
+
 /* enqueue, drain & cancelation */
 
 static void
@@ -303,9 +347,18 @@ again:
 		os_atomic_andnot(&dq->mpd_state, MPSC_QUEUE_STATE_WAKEUP, relaxed);
 	}
 
+	/* enqueues from now on count toward the next coalesced wakeup */
+	if (dq->mpd_coalesce_threshold) {
+		os_atomic_store(&dq->mpd_coalesce_count, 0, relaxed);
+	}
+
 	os_atomic_dependency_t dep = os_atomic_make_dependency((uintptr_t)st);
 	if ((head = mpsc_queue_dequeue_batch(&dq->mpd_queue, &tail, dep))) {
 		do {
+			if (dq->mpd_options & MPSC_QUEUE_OPTION_BATCH_INVOKE) {
+				dq->mpd_batch_invoke(head, tail, dq);
+				continue;
+			}
 			mpsc_queue_batch_foreach_safe(cur, head, tail) {
 				os_atomic_store(&cur->mpqc_next,
 				    MPSC_QUEUE_NOTQUEUED_MARKER, relaxed);
@@ -396,9 +449,29 @@ _mpsc_daemon_queue_enqueue(mpsc_daemon_queue_t dq, mpsc_queue_chain_t elm)
 
 		if ((st & (MPSC_QUEUE_STATE_DRAINING | MPSC_QUEUE_STATE_WAKEUP |
 		    MPSC_QUEUE_STATE_INACTIVE)) == 0) {
-			_mpsc_daemon_queue_wakeup(dq);
+			if (dq->mpd_coalesce_call) {
+				thread_call_enter_delayed(dq->mpd_coalesce_call,
+				    mach_absolute_time() + dq->mpd_coalesce_delay);
+			} else {
+				_mpsc_daemon_queue_wakeup(dq);
+			}
 		}
 	}
+
+	/*
+	 * Bring a delayed wakeup forward once enough items are pending.
+	 *
+	 * Only the enqueuer that manages to cancel the delayed wakeup
+	 * performs it, so that the drain is never woken up twice for
+	 * a single WAKEUP transition. If there is nothing to cancel,
+	 * the queue is already awake or about to be.
+	 */
+	if (dq->mpd_coalesce_threshold &&
+	    os_atomic_inc(&dq->mpd_coalesce_count, relaxed) ==
+	    dq->mpd_coalesce_threshold &&
+	    thread_call_cancel(dq->mpd_coalesce_call)) {
+		_mpsc_daemon_queue_wakeup(dq);
+	}
 }
 
 void
@@ -433,6 +506,17 @@ mpsc_daemon_queue_cancel_and_wait(mpsc_daemon_queue_t dq)
 {
 	mpsc_daemon_queue_state_t st;
 
+	/*
+	 * A pending coalesced wakeup is folded in the cancelation wakeup,
+	 * make sure it can't fire past this point for thread based queues.
+	 */
+	if (dq->mpd_coalesce_call && dq->mpd_kind != MPSC_QUEUE_KIND_THREAD_CALL) {
+		thread_call_cancel_wait(dq->mpd_coalesce_call);
+		thread_call_free(dq->mpd_coalesce_call);
+	}
+	dq->mpd_coalesce_call = NULL;
+	dq->mpd_coalesce_threshold = 0;
+
 	assert_wait((event_t)&dq->mpd_state, THREAD_UNINT);
 
 	st = os_atomic_or_orig(&dq->mpd_state, MPSC_QUEUE_STATE_CANCELED, relaxed);
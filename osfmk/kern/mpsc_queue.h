@@ -470,6 +470,18 @@ typedef struct mpsc_daemon_queue *mpsc_daemon_queue_t;
 typedef void (*mpsc_daemon_invoke_fn_t)(mpsc_queue_chain_t elm,
     mpsc_daemon_queue_t dq);
 
+/*!
+ * @typedef mpsc_daemon_batch_invoke_fn_t
+ *
+ * @brief
+ * The type for MPSC Daemon Queues batch invoke callbacks.
+ *
+ * @discussion
+ * See mpsc_daemon_queue_set_batch_invoke().
+ */
+typedef void (*mpsc_daemon_batch_invoke_fn_t)(mpsc_queue_chain_t head,
+    mpsc_queue_chain_t tail, mpsc_daemon_queue_t dq);
+
 /*!
  * @enum mpsc_daemon_queue_kind
  *
@@ -493,9 +505,13 @@ __enum_decl(mpsc_daemon_queue_kind_t, uint16_t, {
  * @const MPSC_QUEUE_OPTION_BATCH
  * Call the `invoke` callback at the end of a batch
  * with the magic @c MPSC_QUEUE_BATCH_END marker.
+ *
+ * @const MPSC_QUEUE_OPTION_BATCH_INVOKE
+ * Internal, set by @c mpsc_daemon_queue_set_batch_invoke().
  */
 __options_decl(mpsc_daemon_queue_options_t, uint16_t, {
-	MPSC_QUEUE_OPTION_BATCH  = 0x0001,
+	MPSC_QUEUE_OPTION_BATCH         = 0x0001,
+	MPSC_QUEUE_OPTION_BATCH_INVOKE  = 0x0002,
 });
 
 /*!
@@ -515,7 +531,10 @@ struct mpsc_daemon_queue {
 	mpsc_daemon_queue_kind_t    mpd_kind;
 	mpsc_daemon_queue_options_t mpd_options;
 	mpsc_daemon_queue_state_t _Atomic mpd_state;
-	mpsc_daemon_invoke_fn_t     mpd_invoke;
+	union {
+		mpsc_daemon_invoke_fn_t       mpd_invoke;
+		mpsc_daemon_batch_invoke_fn_t mpd_batch_invoke;
+	};
 	union {
 		mpsc_daemon_queue_t     mpd_target;
 		struct thread          *mpd_thread;
@@ -523,6 +542,12 @@ struct mpsc_daemon_queue {
 	};
 	struct mpsc_queue_head      mpd_queue;
 	struct mpsc_queue_chain     mpd_chain;
+
+	/* wakeup coalescing, see mpsc_daemon_queue_set_wakeup_coalescing() */
+	uint32_t                    mpd_coalesce_threshold;
+	uint32_t _Atomic            mpd_coalesce_count;
+	uint64_t                    mpd_coalesce_delay;
+	struct thread_call         *mpd_coalesce_call;
 };
 
 /*!
@@ -621,6 +646,63 @@ void
 mpsc_daemon_queue_nested_invoke(mpsc_queue_chain_t elm,
     mpsc_daemon_queue_t dq);
 
+/*!
+ * @function mpsc_daemon_queue_set_batch_invoke
+ *
+ * @brief
+ * Have the queue hand whole batches of items to a single callback.
+ *
+ * @discussion
+ * Instead of calling the `invoke` callback the queue was initialized with
+ * on every item, the drain calls @c invoke once per batch of items dequeued
+ * together, which it can walk with @c mpsc_queue_batch_foreach_safe().
+ *
+ * Unlike with per item callbacks, the items aren't marked with
+ * @c MPSC_QUEUE_NOTQUEUED_MARKER before being handed out.
+ *
+ * This must be called before the queue is used, and is incompatible
+ * with the @c MPSC_QUEUE_OPTION_BATCH option.
+ *
+ * @param dq
+ * The queue to configure.
+ *
+ * @param invoke
+ * The callback called with the first and last item of every batch.
+ */
+void
+mpsc_daemon_queue_set_batch_invoke(mpsc_daemon_queue_t dq,
+    mpsc_daemon_batch_invoke_fn_t invoke);
+
+/*!
+ * @function mpsc_daemon_queue_set_wakeup_coalescing
+ *
+ * @brief
+ * Delay the wakeup of an idle queue so that bursts are drained at once.
+ *
+ * @discussion
+ * When an item is enqueued onto an idle queue, the thread or thread call
+ * draining it is normally woken up right away. With coalescing, the wakeup
+ * happens @c delay_ns later, or as soon as @c threshold items have been
+ * enqueued since the last drain started, whichever comes first.
+ *
+ * This is only supported for queues initialized with
+ * @c mpsc_daemon_queue_init_with_thread() or
+ * @c mpsc_daemon_queue_init_with_thread_call(), and must be called before
+ * the queue is used.
+ *
+ * @param dq
+ * The queue to configure.
+ *
+ * @param threshold
+ * How many enqueues cause an immediate wakeup (0 for no limit).
+ *
+ * @param delay_ns
+ * The maximum delay of a wakeup, in nanoseconds.
+ */
+void
+mpsc_daemon_queue_set_wakeup_coalescing(mpsc_daemon_queue_t dq,
+    uint32_t threshold, uint64_t delay_ns);
+
 /*!
  * @function mpsc_daemon_queue_activate
  *
@@ -728,6 +810,9 @@ thread_deallocate_daemon_register_queue(mpsc_daemon_queue_t dq,
 int
 mpsc_test_pingpong(uint64_t count, uint64_t *out);
 
+int
+mpsc_test_burst(uint64_t count, bool coalesce, uint64_t *out);
+
 #endif /* DEBUG || DEVELOPMENT */
 
 #endif /* XNU_KERNEL_PRIVATE */
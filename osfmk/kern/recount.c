@@ -211,7 +211,7 @@ recount_update_start(struct recount_track *tracks, recount_topo_t topo,
 	return track;
 }
 
-#if RECOUNT_ENERGY
+#if RECOUNT_ENERGY || CONFIG_PERVASIVE_MEMBW
 
 static struct recount_track *
 recount_update_single_start(struct recount_track *tracks, recount_topo_t topo,
@@ -220,7 +220,7 @@ recount_update_single_start(struct recount_track *tracks, recount_topo_t topo,
 	return &tracks[recount_topo_index(topo, processor)];
 }
 
-#endif // RECOUNT_ENERGY
+#endif // RECOUNT_ENERGY || CONFIG_PERVASIVE_MEMBW
 
 static void
 recount_update_commit(void)
@@ -272,6 +272,9 @@ recount_usage_add(struct recount_usage *sum, const struct recount_usage *to_add)
 #if CONFIG_PERVASIVE_ENERGY
 	sum->ru_energy_nj += to_add->ru_energy_nj;
 #endif // CONFIG_PERVASIVE_CPI
+#if CONFIG_PERVASIVE_MEMBW
+	sum->ru_memory_bytes += to_add->ru_memory_bytes;
+#endif // CONFIG_PERVASIVE_MEMBW
 }
 
 OS_ALWAYS_INLINE
@@ -806,6 +809,42 @@ recount_add_energy(struct thread *off_thread, struct task *off_task,
 #endif // !RECOUNT_ENERGY
 }
 
+void
+recount_add_memory_bytes(struct thread *thread, struct task *task,
+    uint64_t bytes)
+{
+#if CONFIG_PERVASIVE_MEMBW
+	assert(ml_get_interrupts_enabled() == FALSE);
+	if (__improbable(!recount_started)) {
+		return;
+	}
+
+	// Idle threads can still take misses (from interrupt handlers), but like
+	// time, they are not attributed to the kernel task or the processor.
+	bool was_idle = (thread->options & TH_OPT_IDLE_THREAD) != 0;
+	processor_t processor = current_processor();
+
+	struct recount_track *th_track = recount_update_single_start(
+		thread->th_recount.rth_lifetime, recount_thread_plan.rpl_topo,
+		processor);
+	struct recount_track *tk_track = was_idle ? NULL :
+	    recount_update_single_start(task->tk_recount.rtk_lifetime,
+	    recount_task_plan.rpl_topo, processor);
+	struct recount_track *pr_track = was_idle ? NULL :
+	    recount_update_single_start(&processor->pr_recount.rpr_active,
+	    recount_processor_plan.rpl_topo, processor);
+
+	th_track->rt_usage.ru_memory_bytes += bytes;
+
+	if (!was_idle) {
+		tk_track->rt_usage.ru_memory_bytes += bytes;
+		pr_track->rt_usage.ru_memory_bytes += bytes;
+	}
+#else // CONFIG_PERVASIVE_MEMBW
+#pragma unused(thread, task, bytes)
+#endif // !CONFIG_PERVASIVE_MEMBW
+}
+
 
 #define MT_KDBG_IC_CPU_CSWITCH \
 	KDBG_EVENTID(DBG_MONOTONIC, DBG_MT_INSTRS_CYCLES, 1)
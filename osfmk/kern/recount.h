@@ -107,6 +107,10 @@ struct recount_track {
 #if CONFIG_PERVASIVE_ENERGY
 		uint64_t ru_energy_nj;
 #endif // CONFIG_PERVASIVE_ENERGY
+#if CONFIG_PERVASIVE_MEMBW
+		// Sampled memory traffic, in bytes of last-level cache misses.
+		uint64_t ru_memory_bytes;
+#endif // CONFIG_PERVASIVE_MEMBW
 	} rt_usage;
 };
 
@@ -305,6 +309,10 @@ void recount_switch_thread(struct recount_snap *snap, struct thread *off_thread,
 // Called by the machine-dependent code to accumulate energy.
 void recount_add_energy(struct thread *off_thread, struct task *off_task,
     uint64_t energy_nj);
+// Called by the machine-dependent PMI handler to charge a sample of memory
+// traffic to the thread on-core.
+void recount_add_memory_bytes(struct thread *thread, struct task *task,
+    uint64_t bytes);
 // Log a kdebug event on switching threads.
 void recount_log_switch_thread(const struct recount_snap *snap);
 
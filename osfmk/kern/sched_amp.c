@@ -774,6 +774,30 @@ sysctl_thread_bind_cluster_type(char cluster_type)
 	thread_bind_cluster_type(current_thread(), cluster_type, false);
 }
 
+/*
+ * One character per cpu id, 'E' or 'P', for tools which attribute samples
+ * taken with _os_cpu_number() to a cluster type. Returns the number of
+ * cpu ids filled in.
+ */
+extern int sysctl_get_cpu_cluster_types(char *buf, int len);
+int
+sysctl_get_cpu_cluster_types(char *buf, int len)
+{
+	int ncpus = 0;
+
+	for (int cpu = 0; cpu < MIN(len, MAX_SCHED_CPUS); cpu++) {
+		processor_t processor = processor_array[cpu];
+
+		if (processor == PROCESSOR_NULL) {
+			buf[cpu] = '0';
+			continue;
+		}
+		buf[cpu] = (processor->processor_set->pset_cluster_type == PSET_AMP_E) ? 'E' : 'P';
+		ncpus = cpu + 1;
+	}
+	return ncpus;
+}
+
 #endif /* DEVELOPMENT || DEBUG */
 
 #endif /* __AMP__ */
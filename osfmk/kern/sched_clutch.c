@@ -32,6 +32,7 @@
 #include <machine/sched_param.h>
 #include <machine/machine_cpu.h>
 #include <kern/kern_types.h>
+#include <kern/counter.h>
 #include <kern/debug.h>
 #include <kern/machine.h>
 #include <kern/misc_protos.h>
@@ -41,6 +42,8 @@
 #include <kern/sched_prim.h>
 #include <kern/task.h>
 #include <kern/thread.h>
+#include <kern/thread_group.h>
+#include <kern/work_interval.h>
 #include <kern/sched_clutch.h>
 #include <machine/atomic.h>
 #include <kern/sched_clutch.h>
@@ -1142,6 +1145,13 @@ sched_clutch_init_with_thread_group(
 	/* Grouping specific fields */
 	clutch->sc_tg = tg;
 	os_atomic_store(&clutch->sc_tg_priority, 0, relaxed);
+
+	/* No CPU bandwidth limit */
+	os_atomic_store(&clutch->sc_bw_quota, 0, relaxed);
+	os_atomic_store(&clutch->sc_bw_period, 0, relaxed);
+	os_atomic_store(&clutch->sc_bw_period_start, 0, relaxed);
+	os_atomic_store(&clutch->sc_bw_used, 0, relaxed);
+	os_atomic_store(&clutch->sc_bw_throttled_periods, 0, relaxed);
 }
 
 /*
@@ -1416,6 +1426,157 @@ sched_clutch_interactivity_from_cpu_data(sched_clutch_bucket_group_t clutch_buck
 	return interactive_score;
 }
 
+/*
+ * Clutch CPU bandwidth limits
+ *
+ * A thread group can be given a quota of CPU time per period, in the style
+ * of the cgroup CPU controller. The timeshare CPU time of its threads is
+ * charged to the quota from the same path that feeds the clutch bucket
+ * group CPU usage, and periods are rolled over lazily by the next charge
+ * or priority calculation, so there are no timers involved.
+ *
+ * Once the quota of the current period is used up, the clutch buckets of
+ * the thread group are put at the lowest clutch bucket priority of their
+ * root bucket the next time they are reevaluated (every time a thread is
+ * inserted or picked, and at every scheduler tick for pending clutch
+ * buckets). They keep running only when no other clutch bucket
+ * of the same root bucket is runnable, which keeps the scheduler work
+ * conserving. Fixed priority threads are not limited.
+ */
+
+static uint64_t
+sched_clutch_bw_period_start(
+	sched_clutch_t clutch,
+	uint64_t period,
+	uint64_t timestamp)
+{
+	uint64_t start = os_atomic_load(&clutch->sc_bw_period_start, relaxed);
+
+	if (timestamp > start && timestamp - start >= period) {
+		uint64_t new_start = timestamp - (timestamp - start) % period;
+		if (os_atomic_cmpxchg(&clutch->sc_bw_period_start, start, new_start, relaxed)) {
+			/* Charges racing with the rollover may land in either period */
+			if (os_atomic_xchg(&clutch->sc_bw_used, 0, relaxed) >=
+			    os_atomic_load(&clutch->sc_bw_quota, relaxed)) {
+				os_atomic_inc(&clutch->sc_bw_throttled_periods, relaxed);
+			}
+		}
+		start = new_start;
+	}
+	return start;
+}
+
+static void
+sched_clutch_bw_charge(
+	sched_clutch_t clutch,
+	uint64_t delta)
+{
+	uint64_t period = os_atomic_load(&clutch->sc_bw_period, relaxed);
+
+	if (period == 0) {
+		return;
+	}
+	sched_clutch_bw_period_start(clutch, period, mach_absolute_time());
+	os_atomic_add(&clutch->sc_bw_used, delta, relaxed);
+}
+
+static bool
+sched_clutch_bw_throttled(
+	sched_clutch_t clutch,
+	uint64_t timestamp)
+{
+	uint64_t period = os_atomic_load(&clutch->sc_bw_period, relaxed);
+
+	if (period == 0) {
+		return false;
+	}
+	sched_clutch_bw_period_start(clutch, period, timestamp);
+	return os_atomic_load(&clutch->sc_bw_used, relaxed) >=
+	       os_atomic_load(&clutch->sc_bw_quota, relaxed);
+}
+
+static struct thread_group *
+sched_clutch_bw_thread_group(
+	uint64_t tg_id)
+{
+	if (tg_id == 0) {
+		return thread_group_retain(thread_group_get(current_thread()));
+	}
+	return thread_group_find_by_id_and_retain(tg_id);
+}
+
+/*
+ * sched_clutch_cpu_bandwidth_set()
+ *
+ * Limit the timeshare CPU time of a thread group (or of the caller's own if
+ * tg_id is 0) to quota_us every period_us. A period of 0 removes the limit.
+ */
+kern_return_t
+sched_clutch_cpu_bandwidth_set(
+	uint64_t tg_id,
+	uint32_t quota_us,
+	uint32_t period_us)
+{
+	struct thread_group *tg;
+	uint64_t quota = 0, period = 0;
+
+	if (period_us != 0 && (quota_us == 0 || quota_us > period_us)) {
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	tg = sched_clutch_bw_thread_group(tg_id);
+	if (tg == NULL) {
+		return KERN_NOT_FOUND;
+	}
+
+	sched_clutch_t clutch = sched_clutch_for_thread_group(tg);
+	if (period_us != 0) {
+		clock_interval_to_absolutetime_interval(quota_us, NSEC_PER_USEC, &quota);
+		clock_interval_to_absolutetime_interval(period_us, NSEC_PER_USEC, &period);
+	}
+	/* Start from a fresh period */
+	os_atomic_store(&clutch->sc_bw_period, 0, relaxed);
+	os_atomic_store(&clutch->sc_bw_used, 0, relaxed);
+	os_atomic_store(&clutch->sc_bw_period_start, mach_absolute_time(), relaxed);
+	os_atomic_store(&clutch->sc_bw_quota, quota, relaxed);
+	os_atomic_store(&clutch->sc_bw_period, period, relaxed);
+
+	thread_group_release(tg);
+	return KERN_SUCCESS;
+}
+
+/*
+ * sched_clutch_cpu_bandwidth_get()
+ *
+ * Read back the CPU bandwidth limit of a thread group and the number of
+ * periods in which it was hit.
+ */
+kern_return_t
+sched_clutch_cpu_bandwidth_get(
+	uint64_t tg_id,
+	uint32_t *quota_us,
+	uint32_t *period_us,
+	uint64_t *throttled_periods)
+{
+	struct thread_group *tg;
+	uint64_t quota_ns, period_ns;
+
+	tg = sched_clutch_bw_thread_group(tg_id);
+	if (tg == NULL) {
+		return KERN_NOT_FOUND;
+	}
+
+	sched_clutch_t clutch = sched_clutch_for_thread_group(tg);
+	absolutetime_to_nanoseconds(os_atomic_load(&clutch->sc_bw_quota, relaxed), &quota_ns);
+	absolutetime_to_nanoseconds(os_atomic_load(&clutch->sc_bw_period, relaxed), &period_ns);
+	*quota_us = (uint32_t)(quota_ns / NSEC_PER_USEC);
+	*period_us = (uint32_t)(period_ns / NSEC_PER_USEC);
+	*throttled_periods = os_atomic_load(&clutch->sc_bw_throttled_periods, relaxed);
+
+	thread_group_release(tg);
+	return KERN_SUCCESS;
+}
+
 /*
  * sched_clutch_bucket_pri_calculate()
  *
@@ -1423,6 +1584,9 @@ sched_clutch_interactivity_from_cpu_data(sched_clutch_bucket_group_t clutch_buck
  * modification on the ULE interactivity score. It uses the base priority
  * of the clutch bucket and applies an interactivity score boost to the
  * highly responsive clutch buckets.
+ *
+ * Clutch buckets of thread groups over their CPU bandwidth limit get the
+ * lowest priority.
  */
 static uint8_t
 sched_clutch_bucket_pri_calculate(
@@ -1434,6 +1598,11 @@ sched_clutch_bucket_pri_calculate(
 		return 0;
 	}
 
+	if (clutch_bucket->scb_bucket != TH_BUCKET_FIXPRI &&
+	    sched_clutch_bw_throttled(clutch_bucket->scb_group->scbg_clutch, timestamp)) {
+		return 0;
+	}
+
 	uint8_t base_pri = sched_clutch_bucket_base_pri(clutch_bucket);
 	uint8_t interactive_score = sched_clutch_bucket_group_interactivity_score_calculate(clutch_bucket->scb_group, timestamp);
 
@@ -1574,6 +1743,7 @@ sched_clutch_cpu_usage_update(
 	sched_clutch_t clutch = sched_clutch_for_thread(thread);
 	sched_clutch_bucket_group_t clutch_bucket_group = &(clutch->sc_clutch_groups[thread->th_sched_bucket]);
 	sched_clutch_bucket_group_cpu_usage_update(clutch_bucket_group, delta);
+	sched_clutch_bw_charge(clutch, delta);
 }
 
 /*
@@ -2402,8 +2572,13 @@ sched_clutch_thread_insert(
 	 * - A queue linkage used for timesharing operations of threads at the scheduler tick
 	 */
 
-	/* Insert thread into the clutch_bucket stable priority runqueue using sched_pri */
-	thread->th_clutch_runq_link.stamp = current_timestamp;
+	/*
+	 * Insert thread into the clutch_bucket stable priority runqueue using sched_pri.
+	 * Threads enqueued at the tail are ordered by their stamp, which is the
+	 * latest start time for work intervals with deadlines.
+	 */
+	thread->th_clutch_runq_link.stamp = (options & SCHED_TAILQ) ?
+	    work_interval_runq_stamp(thread, current_timestamp) : current_timestamp;
 	priority_queue_entry_set_sched_pri(&clutch_bucket->scb_thread_runq, &thread->th_clutch_runq_link, thread->sched_pri,
 	    (options & SCHED_TAILQ) ? PRIORITY_QUEUE_ENTRY_NONE : PRIORITY_QUEUE_ENTRY_PREEMPTED);
 	priority_queue_insert(&clutch_bucket->scb_thread_runq, &thread->th_clutch_runq_link);
@@ -2555,6 +2730,85 @@ sched_clutch_thread_highest_remove(
 	return highest_thread;
 }
 
+/*
+ * Makerunnable to running latency histograms
+ *
+ * Each clutch bucket group keeps a log2 histogram of the time its threads
+ * spend runnable before being selected to run, so that the scheduling
+ * latency of a thread group can be looked at per QoS bucket without
+ * tracing the whole system. Samples are taken when a thread is chosen
+ * for a processor, whether from the local hierarchy, the bound runqueue
+ * or a steal.
+ */
+TUNABLE_WRITEABLE(uint32_t, sched_clutch_latency_hist_enabled, "sched_clutch_latency_hist", 1);
+
+static void
+sched_clutch_thread_latency_sample(
+	thread_t thread,
+	uint64_t current_timestamp)
+{
+	uint64_t latency_ns, latency_us;
+	uint32_t bin = 0;
+
+	if (!sched_clutch_latency_hist_enabled || thread == THREAD_NULL) {
+		return;
+	}
+	if (thread->th_sched_bucket >= TH_BUCKET_SCHED_MAX ||
+	    thread->last_made_runnable_time == THREAD_NOT_RUNNABLE ||
+	    current_timestamp < thread->last_made_runnable_time) {
+		return;
+	}
+
+	absolutetime_to_nanoseconds(current_timestamp - thread->last_made_runnable_time, &latency_ns);
+	latency_us = latency_ns / NSEC_PER_USEC;
+	if (latency_us != 0) {
+		bin = MIN(64 - __builtin_clzll(latency_us), SCHED_CLUTCH_LATENCY_BINS - 1);
+	}
+
+	sched_clutch_t clutch = sched_clutch_for_thread(thread);
+	os_atomic_inc(&clutch->sc_clutch_groups[thread->th_sched_bucket].scbg_latency_hist[bin], relaxed);
+}
+
+/*
+ * sched_clutch_latency_histogram_get()
+ *
+ * Copy out the latency histograms of all the clutch bucket groups of a
+ * thread group (or of the caller's own if tg_id is 0), as a
+ * [TH_BUCKET_SCHED_MAX][SCHED_CLUTCH_LATENCY_BINS] array.
+ */
+kern_return_t
+sched_clutch_latency_histogram_get(
+	uint64_t tg_id,
+	uint32_t *hist,
+	uint32_t count)
+{
+	struct thread_group *tg;
+
+	if (count != TH_BUCKET_SCHED_MAX * SCHED_CLUTCH_LATENCY_BINS) {
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	if (tg_id == 0) {
+		tg = thread_group_retain(thread_group_get(current_thread()));
+	} else {
+		tg = thread_group_find_by_id_and_retain(tg_id);
+	}
+	if (tg == NULL) {
+		return KERN_NOT_FOUND;
+	}
+
+	sched_clutch_t clutch = sched_clutch_for_thread_group(tg);
+	for (uint32_t bucket = 0; bucket < TH_BUCKET_SCHED_MAX; bucket++) {
+		for (uint32_t bin = 0; bin < SCHED_CLUTCH_LATENCY_BINS; bin++) {
+			hist[bucket * SCHED_CLUTCH_LATENCY_BINS + bin] =
+			    os_atomic_load(&clutch->sc_clutch_groups[bucket].scbg_latency_hist[bin], relaxed);
+		}
+	}
+
+	thread_group_release(tg);
+	return KERN_SUCCESS;
+}
+
 /* High level global accessor routines */
 
 /*
@@ -2901,6 +3155,7 @@ sched_clutch_choose_thread(
 	} else {
 		thread = run_queue_dequeue(bound_runq, SCHED_HEADQ);
 	}
+	sched_clutch_thread_latency_sample(thread, mach_absolute_time());
 	return thread;
 }
 
@@ -3589,6 +3844,7 @@ sched_edge_choose_thread(
 	} else {
 		thread = run_queue_dequeue(bound_runq, SCHED_HEADQ);
 	}
+	sched_clutch_thread_latency_sample(thread, mach_absolute_time());
 	return thread;
 }
 
@@ -3971,6 +4227,44 @@ sched_edge_steal_possible(processor_set_t idle_pset, processor_set_t candidate_p
 	}
 }
 
+/*
+ * Migration cost model for steals
+ *
+ * A thread which last ran on the cluster it is runnable on within the last
+ * sched_edge_steal_warm_us is assumed to still have a warm cache there.
+ * Such a thread is only stolen once it has also been waiting for that long,
+ * i.e. once the wait it has already paid outweighs the cost of refilling
+ * its cache elsewhere. Cold threads are stolen right away.
+ */
+TUNABLE_WRITEABLE(uint32_t, sched_edge_steal_warm_us, "sched_edge_steal_warm_us", 100);
+
+/* Steal attempts which took a thread, and which locked a cluster for nothing */
+SCALABLE_COUNTER_DEFINE(sched_edge_steal_success);
+SCALABLE_COUNTER_DEFINE(sched_edge_steal_failure);
+/* Steals declined by the migration cost model */
+SCALABLE_COUNTER_DEFINE(sched_edge_steal_warm_skips);
+/* Placements off the cluster a thread last ran on, and off its preferred cluster */
+SCALABLE_COUNTER_DEFINE(sched_edge_migrations);
+SCALABLE_COUNTER_DEFINE(sched_edge_spills);
+
+static bool
+sched_edge_steal_cache_warm(thread_t thread, processor_set_t candidate_pset, uint64_t ctime)
+{
+	uint64_t warm_abs;
+
+	if (sched_edge_steal_warm_us == 0 ||
+	    thread->last_processor == PROCESSOR_NULL ||
+	    thread->last_processor->processor_set != candidate_pset) {
+		return false;
+	}
+
+	nanoseconds_to_absolutetime((uint64_t)sched_edge_steal_warm_us * NSEC_PER_USEC, &warm_abs);
+	if (ctime - thread->last_run_time >= warm_abs) {
+		return false;
+	}
+	return ctime - thread->last_made_runnable_time < warm_abs;
+}
+
 static thread_t
 sched_edge_steal_thread(processor_set_t pset, uint64_t candidate_pset_bitmap)
 {
@@ -3993,19 +4287,34 @@ sched_edge_steal_thread(processor_set_t pset, uint64_t candidate_pset_bitmap)
 		if (incoming_edge->sce_steal_allowed == false) {
 			continue;
 		}
+		/*
+		 * Check the candidate's runnable bucket bitmap and load without its
+		 * lock first, so that idle cores scanning for work don't serialize
+		 * on the root locks of clusters which have nothing to give.
+		 */
+		if (sched_edge_steal_possible(pset, steal_from_pset) == false) {
+			continue;
+		}
 		pset_lock(steal_from_pset);
 		if (sched_edge_steal_possible(pset, steal_from_pset)) {
 			uint64_t current_timestamp = mach_absolute_time();
 			sched_clutch_root_bucket_t root_bucket = sched_clutch_root_highest_root_bucket(&steal_from_pset->pset_clutch_root, current_timestamp, SCHED_CLUTCH_HIGHEST_ROOT_BUCKET_UNBOUND_ONLY);
 			thread = sched_clutch_thread_unbound_lookup(&steal_from_pset->pset_clutch_root, root_bucket);
-			sched_clutch_thread_remove(&steal_from_pset->pset_clutch_root, thread, current_timestamp, SCHED_CLUTCH_BUCKET_OPTIONS_SAMEPRI_RR);
-			KDBG(MACHDBG_CODE(DBG_MACH_SCHED_CLUTCH, MACH_SCHED_EDGE_STEAL) | DBG_FUNC_NONE, thread_tid(thread), pset->pset_cluster_id, steal_from_pset->pset_cluster_id, 0);
-			sched_update_pset_load_average(steal_from_pset, current_timestamp);
+			if (sched_edge_steal_cache_warm(thread, steal_from_pset, current_timestamp)) {
+				counter_inc(&sched_edge_steal_warm_skips);
+				thread = THREAD_NULL;
+			} else {
+				sched_clutch_thread_remove(&steal_from_pset->pset_clutch_root, thread, current_timestamp, SCHED_CLUTCH_BUCKET_OPTIONS_SAMEPRI_RR);
+				KDBG(MACHDBG_CODE(DBG_MACH_SCHED_CLUTCH, MACH_SCHED_EDGE_STEAL) | DBG_FUNC_NONE, thread_tid(thread), pset->pset_cluster_id, steal_from_pset->pset_cluster_id, 0);
+				sched_update_pset_load_average(steal_from_pset, current_timestamp);
+			}
 		}
 		pset_unlock(steal_from_pset);
 		if (thread != THREAD_NULL) {
+			counter_inc(&sched_edge_steal_success);
 			break;
 		}
+		counter_inc(&sched_edge_steal_failure);
 	}
 	return thread;
 }
@@ -4031,12 +4340,14 @@ sched_edge_processor_idle(processor_set_t pset)
 	/* Find highest priority runnable thread on all non-native clusters */
 	thread = sched_edge_foreign_runnable_thread_remove(pset, ctime);
 	if (thread != THREAD_NULL) {
+		sched_clutch_thread_latency_sample(thread, mach_absolute_time());
 		return thread;
 	}
 
 	/* Find highest priority runnable thread on all native clusters */
 	thread = sched_edge_steal_thread(pset, pset->native_psets[0]);
 	if (thread != THREAD_NULL) {
+		sched_clutch_thread_latency_sample(thread, mach_absolute_time());
 		return thread;
 	}
 
@@ -4048,6 +4359,7 @@ sched_edge_processor_idle(processor_set_t pset)
 
 	/* No foreign threads found; find a thread to steal from all clusters based on weights/loads etc. */
 	thread = sched_edge_steal_thread(pset, pset->native_psets[0] | pset->foreign_psets[0]);
+	sched_clutch_thread_latency_sample(thread, mach_absolute_time());
 	return thread;
 }
 
@@ -4552,6 +4864,17 @@ sched_edge_choose_processor(processor_set_t pset, processor_t processor, thread_
 	if (chosen_pset) {
 		chosen_processor = choose_processor(chosen_pset, processor, thread);
 	}
+	if (chosen_processor != PROCESSOR_NULL) {
+		processor_set_t chosen = chosen_processor->processor_set;
+
+		if (chosen != preferred_pset) {
+			counter_inc(&sched_edge_spills);
+		}
+		if (thread->last_processor != PROCESSOR_NULL &&
+		    thread->last_processor->processor_set != chosen) {
+			counter_inc(&sched_edge_migrations);
+		}
+	}
 	/* For RT threads, choose_processor() can return a different cluster than the one passed into it */
 	assert(chosen_processor ? chosen_processor->processor_set->pset_type == chosen_pset->pset_type : true);
 	return chosen_processor;
@@ -292,6 +292,13 @@ typedef union sched_clutch_counter_time {
 #endif /* __LP64__ */
 } __attribute__((aligned(16))) sched_clutch_counter_time_t;
 
+/*
+ * Number of bins in the per clutch bucket group histogram of makerunnable
+ * to running latency. Bin 0 counts waits under 1us, bin n waits in
+ * [2^(n-1), 2^n) us and the last bin everything longer.
+ */
+#define SCHED_CLUTCH_LATENCY_BINS       16
+
 /*
  * struct sched_clutch_bucket_group
  *
@@ -327,6 +334,8 @@ struct sched_clutch_bucket_group {
 	sched_clutch_bucket_cpu_data_t  scbg_cpu_data;
 	/* Storage for all clutch buckets for a thread group at scbg_bucket */
 	struct sched_clutch_bucket      *scbg_clutch_buckets;
+	/* (A) makerunnable to running latency histogram */
+	uint32_t _Atomic                scbg_latency_hist[SCHED_CLUTCH_LATENCY_BINS];
 };
 typedef struct sched_clutch_bucket_group *sched_clutch_bucket_group_t;
 
@@ -358,6 +367,17 @@ struct sched_clutch {
 	};
 	/* (I) storage for all clutch_buckets for this clutch */
 	struct sched_clutch_bucket_group sc_clutch_groups[TH_BUCKET_SCHED_MAX];
+	/*
+	 * (A) CPU bandwidth limit: timeshare CPU time allowed per period (mach
+	 * absolute time units, 0 for no limit), start of the current period
+	 * and CPU time used in it.
+	 */
+	uint64_t _Atomic                sc_bw_quota;
+	uint64_t _Atomic                sc_bw_period;
+	uint64_t _Atomic                sc_bw_period_start;
+	uint64_t _Atomic                sc_bw_used;
+	/* (A) number of periods in which the limit was hit */
+	uint64_t _Atomic                sc_bw_throttled_periods;
 };
 typedef struct sched_clutch *sched_clutch_t;
 
@@ -374,6 +394,10 @@ uint32_t sched_edge_thread_preferred_cluster(thread_t);
 uint32_t sched_clutch_thread_run_bucket_incr(thread_t, sched_bucket_t);
 uint32_t sched_clutch_thread_run_bucket_decr(thread_t, sched_bucket_t);
 void sched_clutch_cpu_usage_update(thread_t, uint64_t);
+
+/* Clutch CPU bandwidth limits */
+kern_return_t sched_clutch_cpu_bandwidth_set(uint64_t, uint32_t, uint32_t);
+kern_return_t sched_clutch_cpu_bandwidth_get(uint64_t, uint32_t *, uint32_t *, uint64_t *);
 uint32_t sched_clutch_thread_pri_shift(thread_t, sched_bucket_t);
 
 /* Clutch properties accessors */
@@ -382,6 +406,7 @@ uint32_t sched_clutch_root_count(sched_clutch_root_t);
 /* Grouping specific external routines */
 extern sched_clutch_t sched_clutch_for_thread(thread_t);
 extern sched_clutch_t sched_clutch_for_thread_group(struct thread_group *);
+extern kern_return_t sched_clutch_latency_histogram_get(uint64_t, uint32_t *, uint32_t);
 
 #if CONFIG_SCHED_EDGE
 
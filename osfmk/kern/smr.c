@@ -26,6 +26,7 @@
  * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
  */
 
+#include <kern/clock.h>
 #include <kern/cpu_data.h>
 #include <kern/mpsc_queue.h>
 #include <kern/percpu.h>
@@ -614,6 +615,7 @@ typedef struct smr_bucket {
 	uint32_t             smrb_count;
 	uint32_t             smrb_size;
 	smr_seq_t            smrb_seq;
+	uint64_t             smrb_seal_time;
 	struct smr_record    smrb_recs[];
 } *smr_bucket_t;
 
@@ -636,9 +638,34 @@ static TUNABLE(uint32_t, smr_bucket_count_min, "smr_bucket_count_min", 8);
 static TUNABLE(vm_size_t, smr_retire_threshold, "smr_retire_threshold",
     SMR_RETIRE_THRESHOLD_DEFAULT);
 
+/*!
+ * the maximum number of records a retiring thread will destroy itself
+ * when it finds that the previous bucket of its cpu is past its grace
+ * period, rather than handing the bucket to the deallocate daemon.
+ * 0 disables reclaiming on the retiring cpu.
+ */
+static TUNABLE(uint32_t, smr_reclaim_budget, "smr_reclaim_budget", 64);
+
 /*! the number of items cached in per-cpu buckets */
 static SECURITY_READ_ONLY_LATE(uint32_t) smr_bucket_count;
 
+/*
+ * Statistics for the retirement of the system global SMR domain:
+ *
+ * smr_global_limbo_bytes:     bytes retired whose destructor hasn't run yet
+ * smr_global_limbo_bytes_max: high watermark of smr_global_limbo_bytes
+ * smr_global_reclaim_inline:  buckets reclaimed by the cpu that retired them
+ * smr_global_reclaim_daemon:  buckets reclaimed by the deallocate daemon
+ * smr_global_grace_ns_*:      time between a bucket being sealed and its
+ *                             destructors running
+ */
+uint64_t smr_global_limbo_bytes;
+uint64_t smr_global_limbo_bytes_max;
+uint64_t smr_global_reclaim_inline;
+uint64_t smr_global_reclaim_daemon;
+uint64_t smr_global_grace_ns_total;
+uint64_t smr_global_grace_ns_max;
+
 /*! the queue of elements that couldn't be freed immediately */
 static struct smr_bucket_list smr_buckets_pending =
     STAILQ_HEAD_INITIALIZER(smr_buckets_pending);
@@ -681,11 +708,41 @@ smr_bucket_free(smr_bucket_t bucket)
 	           smr_bucket_count, bucket);
 }
 
+/*
+ * Runs the destructors of a bucket whose grace period has elapsed,
+ * and leaves it empty so that it can be reused.
+ */
+static void
+smr_bucket_reclaim(smr_bucket_t bucket)
+{
+	uint64_t grace_ns;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() -
+	    bucket->smrb_seal_time, &grace_ns);
+	os_atomic_add(&smr_global_grace_ns_total, grace_ns, relaxed);
+	os_atomic_max(&smr_global_grace_ns_max, grace_ns, relaxed);
+
+	for (uint32_t i = 0; i < bucket->smrb_count; i++) {
+		struct smr_record *smrr = &bucket->smrb_recs[i];
+
+		smrr->smrr_dtor(smrr->smrr_val);
+	}
+
+	os_atomic_sub(&smr_global_limbo_bytes, bucket->smrb_size, relaxed);
+
+	bucket->smrb_count = 0;
+	bucket->smrb_size = 0;
+	bucket->smrb_seq = 0;
+	bucket->smrb_seal_time = 0;
+}
+
 void
 smr_global_retire(void *value, size_t size, void (*destructor)(void *))
 {
 	smr_bucket_t *slot;
 	smr_bucket_t bucket, free_bucket = NULL;
+	uint32_t old_size;
+	uint64_t limbo;
 
 	if (__improbable(startup_phase < STARTUP_SUB_EARLY_BOOT)) {
 		/*
@@ -701,9 +758,37 @@ again:
 	slot = PERCPU_GET(smr_bucket);
 	bucket = *slot;
 	if (bucket && bucket->smrb_seq) {
+		*slot = NULL;
+
+		/*
+		 * If the sealed bucket is already past its grace period,
+		 * and is small enough, destroy it here instead of making
+		 * it wait for the deallocate daemon.
+		 *
+		 * Only do so when the caller isn't holding spinlocks
+		 * (the destructors might take locks) and isn't in
+		 * an SMR critical section.
+		 */
+		if (bucket->smrb_count <= smr_reclaim_budget &&
+		    get_preemption_level() == 1 &&
+		    !smr_entered_nopreempt(&smr_system) &&
+		    smr_poll(&smr_system, bucket->smrb_seq)) {
+			enable_preemption();
+
+			smr_bucket_reclaim(bucket);
+			os_atomic_inc(&smr_global_reclaim_inline, relaxed);
+
+			if (free_bucket) {
+				smr_bucket_free(bucket);
+			} else {
+				free_bucket = bucket;
+			}
+			goto again;
+		}
+
 		mpsc_daemon_enqueue(&smr_deallocate_queue,
 		    &bucket->smrb_mplink, MPSC_QUEUE_NONE);
-		*slot = bucket = NULL;
+		bucket = NULL;
 	}
 	if (bucket == NULL) {
 		if (free_bucket) {
@@ -720,9 +805,13 @@ again:
 	bucket->smrb_recs[bucket->smrb_count].smrr_val = value;
 	bucket->smrb_recs[bucket->smrb_count].smrr_dtor = destructor;
 
+	old_size = bucket->smrb_size;
 	if (os_add_overflow(bucket->smrb_size, size, &bucket->smrb_size)) {
 		bucket->smrb_size = UINT32_MAX;
 	}
+	limbo = os_atomic_add(&smr_global_limbo_bytes,
+	    bucket->smrb_size - old_size, relaxed);
+	os_atomic_max(&smr_global_limbo_bytes_max, limbo, relaxed);
 
 	if (++bucket->smrb_count == smr_bucket_count ||
 	    bucket->smrb_size >= smr_retire_threshold) {
@@ -731,6 +820,7 @@ again:
 		 * to give readers a chance to notice the new clock.
 		 */
 		bucket->smrb_seq = smr_advance(&smr_system);
+		bucket->smrb_seal_time = mach_absolute_time();
 	}
 	enable_preemption();
 
@@ -741,29 +831,41 @@ again:
 
 
 static void
-smr_deallocate_queue_invoke(mpsc_queue_chain_t e,
+smr_deallocate_queue_invoke(mpsc_queue_chain_t head, mpsc_queue_chain_t tail,
     __assert_only mpsc_daemon_queue_t dq)
 {
+	mpsc_queue_chain_t e;
 	smr_bucket_t bucket;
+	smr_seq_t goal = SMR_SEQ_INVALID;
 
 	assert(dq == &smr_deallocate_queue);
 
-	bucket = mpsc_queue_element(e, struct smr_bucket, smrb_mplink);
-	smr_wait(&smr_system, bucket->smrb_seq);
-
-	for (uint32_t i = 0; i < bucket->smrb_count; i++) {
-		struct smr_record *smrr = &bucket->smrb_recs[i];
-
-		smrr->smrr_dtor(smrr->smrr_val);
+	/*
+	 * Buckets come from different CPUs and aren't sorted,
+	 * wait once for the most recent of them.
+	 */
+	mpsc_queue_batch_foreach_safe(e, head, tail) {
+		bucket = mpsc_queue_element(e, struct smr_bucket, smrb_mplink);
+		if (goal == SMR_SEQ_INVALID ||
+		    SMR_SEQ_CMP(bucket->smrb_seq, >, goal)) {
+			goal = bucket->smrb_seq;
+		}
 	}
+	smr_wait(&smr_system, goal);
 
-	smr_bucket_free(bucket);
+	mpsc_queue_batch_foreach_safe(e, head, tail) {
+		bucket = mpsc_queue_element(e, struct smr_bucket, smrb_mplink);
+		smr_bucket_reclaim(bucket);
+		os_atomic_inc(&smr_global_reclaim_daemon, relaxed);
+		smr_bucket_free(bucket);
+	}
 }
 
 void
 smr_register_mpsc_queue(void)
 {
-	thread_deallocate_daemon_register_queue(&smr_deallocate_queue,
+	thread_deallocate_daemon_register_queue(&smr_deallocate_queue, NULL);
+	mpsc_daemon_queue_set_batch_invoke(&smr_deallocate_queue,
 	    smr_deallocate_queue_invoke);
 }
 
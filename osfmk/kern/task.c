@@ -1107,10 +1107,10 @@ init_task_ledgers(void)
 	task_ledgers.purgeable_volatile_compressed = ledger_entry_add_with_flags(t, "purgeable_volatile_compress", "physmem", "bytes", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
 	task_ledgers.purgeable_nonvolatile_compressed = ledger_entry_add_with_flags(t, "purgeable_nonvolatile_compress", "physmem", "bytes", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
 #if DEBUG || DEVELOPMENT
-	task_ledgers.pages_grabbed = ledger_entry_add_with_flags(t, "pages_grabbed", "physmem", "count", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
-	task_ledgers.pages_grabbed_kern = ledger_entry_add_with_flags(t, "pages_grabbed_kern", "physmem", "count", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
-	task_ledgers.pages_grabbed_iopl = ledger_entry_add_with_flags(t, "pages_grabbed_iopl", "physmem", "count", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
-	task_ledgers.pages_grabbed_upl = ledger_entry_add_with_flags(t, "pages_grabbed_upl", "physmem", "count", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
+	task_ledgers.pages_grabbed = ledger_entry_add_with_flags(t, "pages_grabbed", "physmem", "count", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE | LEDGER_ENTRY_ALLOW_PERCPU);
+	task_ledgers.pages_grabbed_kern = ledger_entry_add_with_flags(t, "pages_grabbed_kern", "physmem", "count", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE | LEDGER_ENTRY_ALLOW_PERCPU);
+	task_ledgers.pages_grabbed_iopl = ledger_entry_add_with_flags(t, "pages_grabbed_iopl", "physmem", "count", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE | LEDGER_ENTRY_ALLOW_PERCPU);
+	task_ledgers.pages_grabbed_upl = ledger_entry_add_with_flags(t, "pages_grabbed_upl", "physmem", "count", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE | LEDGER_ENTRY_ALLOW_PERCPU);
 #endif
 	task_ledgers.tagged_nofootprint = ledger_entry_add_with_flags(t, "tagged_nofootprint", "physmem", "bytes", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
 	task_ledgers.tagged_footprint = ledger_entry_add_with_flags(t, "tagged_footprint", "physmem", "bytes", LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
@@ -1187,7 +1187,7 @@ init_task_ledgers(void)
 #endif /* CONFIG_MEMORYSTATUS */
 
 	task_ledgers.swapins = ledger_entry_add_with_flags(t, "swapins", "physmem", "bytes",
-	    LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE);
+	    LEDGER_ENTRY_ALLOW_PANIC_ON_NEGATIVE | LEDGER_ENTRY_ALLOW_PERCPU);
 
 	if ((task_ledgers.cpu_time < 0) ||
 	    (task_ledgers.tkm_private < 0) ||
@@ -2377,6 +2377,11 @@ task_mark_corpse(task_t task)
 	crash_label = mac_exc_create_label_for_proc((struct proc*)get_bsdtask_info(task));
 #endif
 
+	kr = task_corpse_coalition_throttle(task);
+	if (kr != KERN_SUCCESS) {
+		goto out;
+	}
+
 	kr = task_collect_crash_info(task,
 #if CONFIG_MACF
 	    crash_label,
@@ -4735,6 +4740,40 @@ task_freeze(
 	return kr;
 }
 
+/*
+ *	task_freeze_precompact:
+ *
+ *	Queue up to 'budget' of a likely freeze candidate's cold
+ *	anonymous pages for compression, so that a later task_freeze()
+ *	mostly relocates already compressed data.
+ *
+ * Conditions:
+ *      The caller holds a reference to the task
+ */
+kern_return_t
+task_freeze_precompact(
+	task_t          task,
+	uint32_t        budget,
+	uint32_t        *precompacted_count)
+{
+	*precompacted_count = 0;
+
+	if (task == TASK_NULL || task == kernel_task) {
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	task_lock(task);
+	if (task->frozen || task->changing_freeze_state) {
+		task_unlock(task);
+		return KERN_FAILURE;
+	}
+	task_unlock(task);
+
+	*precompacted_count = vm_map_freeze_precompact(task, budget);
+
+	return KERN_SUCCESS;
+}
+
 /*
  *	task_thaw:
  *
@@ -6234,6 +6273,9 @@ task_power_info_locked(
 		extra_info->energy = usage.ru_energy_nj;
 		extra_info->penergy = usage_perf.ru_energy_nj;
 #endif // CONFIG_PERVASIVE_ENERGY
+#if CONFIG_PERVASIVE_MEMBW
+		extra_info->memory_bytes = usage.ru_memory_bytes;
+#endif // CONFIG_PERVASIVE_MEMBW
 	}
 }
 
@@ -776,6 +776,12 @@ extern kern_return_t    task_freeze(
 	int             *freezer_error_code,
 	boolean_t       eval_only);
 
+/* Start compressing a likely freeze candidate's cold pages */
+extern kern_return_t    task_freeze_precompact(
+	task_t          task,
+	uint32_t        budget,
+	uint32_t        *precompacted_count);
+
 /* Thaw a currently frozen task */
 extern kern_return_t    task_thaw(
 	task_t          task);
@@ -849,6 +855,7 @@ struct task_power_info_extra {
 	uint64_t runnable_time;
 	uint64_t energy;
 	uint64_t penergy;
+	uint64_t memory_bytes;
 };
 
 void task_power_info_locked(
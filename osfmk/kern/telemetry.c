@@ -43,6 +43,7 @@
 #include <kern/sched_prim.h>
 #include <kern/telemetry.h>
 #include <kern/timer_call.h>
+#include <kern/thread_group.h>
 #include <kern/policy_internal.h>
 #include <kern/kcdata.h>
 
@@ -62,6 +63,7 @@
 #include <sys/kdebug.h>
 #include <uuid/uuid.h>
 #include <kdp/kdp_dyld.h>
+#include <os/hash.h>
 
 #define TELEMETRY_DEBUG 0
 
@@ -104,8 +106,49 @@ struct telemetry_target {
 	enum micro_snapshot_flags        microsnapshot_flags;
 	struct micro_snapshot_buffer    *buffer;
 	lck_mtx_t                       *buffer_mtx;
+	uint64_t                         agg_key;
 };
 
+/*
+ * Stack aggregation for the timer/PMI buffer (telemetry_aggregate=1).
+ *
+ * Each thread hashes to a slot remembering the key of its last record and
+ * where that record is in telemetry_buffer.  A sample with the same key is
+ * counted in the existing record (see kAggregatedRecord) rather than
+ * written again, as long as the record is still in the buffer: slots are
+ * only trusted for the generation they were written in, which is bumped
+ * when the buffer wraps and when userspace marks the data as consumed.
+ * Everything is protected by telemetry_mtx.
+ */
+#define TELEMETRY_AGG_SLOTS     (256)
+
+struct telemetry_agg_slot {
+	uint64_t        tas_key;
+	uint64_t        tas_thread_id;
+	uint32_t        tas_generation;
+	uint32_t        tas_count;
+	uint32_t        tas_msnap_offset;
+	uint32_t        tas_thsnap_offset;
+};
+
+static struct telemetry_agg_slot *telemetry_agg_slots;
+static uint32_t telemetry_agg_generation = 1;
+static uint32_t telemetry_agg_last_record;
+
+/*
+ * Per thread group sampling budget (telemetry_tg_budget=N): at most N
+ * timer/PMI samples per telemetry period are taken for the threads of a
+ * thread group, so that a few busy groups can't fill the buffer.  Groups
+ * hashing to the same slot share their budget.  Each slot holds the period
+ * in its upper half and the samples taken in it in its lower half.
+ */
+#define TELEMETRY_TG_SLOTS      (64)
+
+static uint32_t telemetry_tg_budget = 0;
+#if CONFIG_THREAD_GROUPS
+static uint64_t telemetry_tg_slots[TELEMETRY_TG_SLOTS];
+#endif /* CONFIG_THREAD_GROUPS */
+
 static int telemetry_process_sample(
 	const struct telemetry_target *target,
 	bool release_buffer_lock,
@@ -236,6 +279,16 @@ telemetry_init(void)
 #endif /* !defined(XNU_TARGET_OS_OSX) && !(DEVELOPMENT || DEBUG) */
 	}
 
+	uint32_t aggregate = 0;
+	if (PE_parse_boot_argn("telemetry_aggregate", &aggregate, sizeof(aggregate)) &&
+	    aggregate != 0) {
+		telemetry_agg_slots = kalloc_type(struct telemetry_agg_slot,
+		    TELEMETRY_AGG_SLOTS, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	}
+
+	(void)PE_parse_boot_argn("telemetry_tg_budget",
+	    &telemetry_tg_budget, sizeof(telemetry_tg_budget));
+
 	kprintf("Telemetry: Sampling %stasks once per %u second%s\n",
 	    (telemetry_sample_all_tasks) ? "all " : "",
 	    telemetry_sample_rate, telemetry_sample_rate == 1 ? "" : "s");
@@ -541,6 +594,121 @@ telemetry_instrumentation_end(__unused struct micro_snapshot_buffer *buffer)
 	    buffer->current_position, buffer->end_point);
 }
 
+/*
+ * Charge a sample to the budget of the thread's thread group for the
+ * current telemetry period.
+ */
+static bool
+telemetry_tg_budget_charge(thread_t thread)
+{
+#if CONFIG_THREAD_GROUPS
+	struct thread_group *tg;
+	uint64_t *slot, old_value, new_value;
+	uint32_t period = telemetry_timestamp;
+
+	if (telemetry_tg_budget == 0) {
+		return true;
+	}
+
+	tg = thread_group_get(thread);
+	if (tg == NULL) {
+		return true;
+	}
+	slot = &telemetry_tg_slots[thread_group_get_id(tg) % TELEMETRY_TG_SLOTS];
+
+	os_atomic_rmw_loop(slot, old_value, new_value, relaxed, {
+		if ((uint32_t)(old_value >> 32) != period) {
+		        new_value = ((uint64_t)period << 32) | 1;
+		} else if ((uint32_t)old_value >= telemetry_tg_budget) {
+		        os_atomic_rmw_loop_give_up(return false);
+		} else {
+		        new_value = old_value + 1;
+		}
+	});
+	return true;
+#else /* CONFIG_THREAD_GROUPS */
+#pragma unused(thread)
+	return true;
+#endif /* !CONFIG_THREAD_GROUPS */
+}
+
+static uint64_t
+telemetry_agg_key(const uintptr_t *frames, uint32_t btcount,
+    enum micro_snapshot_flags flags)
+{
+	uint32_t hash = os_hash_jenkins(frames, btcount * sizeof(frames[0]));
+
+	/* never 0, which means "don't aggregate", as flags has a record type */
+	return ((uint64_t)hash << 32) | ((uint64_t)btcount << 8) | (uint8_t)flags;
+}
+
+static struct telemetry_agg_slot *
+telemetry_agg_slot(thread_t thread)
+{
+	return &telemetry_agg_slots[thread_tid(thread) % TELEMETRY_AGG_SLOTS];
+}
+
+/*
+ * Fold the sample into the last record of the thread if it has the same
+ * key and is still in the buffer.  Returns whether the sample was consumed.
+ */
+static bool
+telemetry_agg_fold_locked(thread_t thread, uint64_t key)
+{
+	struct telemetry_agg_slot *slot = telemetry_agg_slot(thread);
+	struct micro_snapshot *msnap;
+	struct thread_snapshot *thsnap;
+	clock_sec_t secs;
+	clock_usec_t usecs;
+
+	LCK_MTX_ASSERT(&telemetry_mtx, LCK_MTX_ASSERT_OWNED);
+
+	if (slot->tas_key != key || slot->tas_thread_id != thread_tid(thread) ||
+	    slot->tas_generation != telemetry_agg_generation ||
+	    telemetry_buffer.buffer == 0) {
+		return false;
+	}
+
+	clock_get_calendar_microtime(&secs, &usecs);
+
+	msnap = (struct micro_snapshot *)(uintptr_t)(telemetry_buffer.buffer +
+	    slot->tas_msnap_offset);
+	thsnap = (struct thread_snapshot *)(uintptr_t)(telemetry_buffer.buffer +
+	    slot->tas_thsnap_offset);
+	assert(msnap->snapshot_magic == STACKSHOT_MICRO_SNAPSHOT_MAGIC);
+	assert(thsnap->snapshot_magic == STACKSHOT_THREAD_SNAPSHOT_MAGIC);
+
+	slot->tas_count++;
+	msnap->ms_flags |= kAggregatedRecord;
+	thsnap->wait_event = slot->tas_count;
+	thsnap->continuation = (uint64_t)secs * USEC_PER_SEC + usecs;
+	return true;
+}
+
+static void
+telemetry_agg_record_locked(thread_t thread, uint64_t key,
+    uint32_t msnap_offset, uint32_t thsnap_offset)
+{
+	struct telemetry_agg_slot *slot = telemetry_agg_slot(thread);
+
+	LCK_MTX_ASSERT(&telemetry_mtx, LCK_MTX_ASSERT_OWNED);
+
+	if (msnap_offset < telemetry_agg_last_record) {
+		/* the buffer wrapped, older records may be overwritten */
+		telemetry_agg_generation++;
+	}
+	telemetry_agg_last_record = msnap_offset;
+
+	*slot = (struct telemetry_agg_slot){
+		.tas_key = key,
+		.tas_thread_id = thread_tid(thread),
+		.tas_generation = telemetry_agg_generation,
+		.tas_count = 1,
+		.tas_msnap_offset = msnap_offset,
+		.tas_thsnap_offset = thsnap_offset,
+	};
+}
+
 void
 telemetry_take_sample(thread_t thread, enum micro_snapshot_flags flags)
 {
@@ -561,6 +729,10 @@ telemetry_take_sample(thread_t thread, enum micro_snapshot_flags flags)
 		return;
 	}
 
+	if (!telemetry_tg_budget_charge(thread)) {
+		return;
+	}
+
 	telemetry_instrumentation_begin(&telemetry_buffer, flags);
 
 	/* Collect backtrace from user thread. */
@@ -586,6 +758,20 @@ telemetry_take_sample(thread_t thread, enum micro_snapshot_flags flags)
 		}
 	}
 
+	uint64_t agg_key = 0;
+	if (telemetry_agg_slots != NULL) {
+		bool folded;
+
+		agg_key = telemetry_agg_key(frames, btcount, flags);
+		TELEMETRY_LOCK();
+		folded = telemetry_agg_fold_locked(thread, agg_key);
+		TELEMETRY_UNLOCK();
+		if (folded) {
+			telemetry_instrumentation_end(&telemetry_buffer);
+			return;
+		}
+	}
+
 	/* Process the backtrace. */
 	struct telemetry_target target = {
 		.thread = thread,
@@ -596,6 +782,7 @@ telemetry_take_sample(thread_t thread, enum micro_snapshot_flags flags)
 		.buffer = &telemetry_buffer,
 		.buffer_mtx = &telemetry_mtx,
 		.async_start_index = async_start_index,
+		.agg_key = agg_key,
 	};
 	telemetry_process_sample(&target, true, NULL);
 
@@ -1120,6 +1307,11 @@ copytobuffer:
 
 	thsnap->nuser_frames = btcount;
 
+	if (target->agg_key != 0) {
+		telemetry_agg_record_locked(thread, target->agg_key, current_record_start,
+		    (uint32_t)((vm_offset_t)thsnap - current_buffer->buffer));
+	}
+
 	/*
 	 * Now THIS is a hack.
 	 */
@@ -1135,6 +1327,11 @@ copytobuffer:
 	}
 
 cancel_sample:
+	if (rv != 0 && target->agg_key != 0) {
+		/* a partial record may have overwritten the one of a slot */
+		telemetry_agg_generation++;
+	}
+
 	if (release_buffer_lock) {
 		lck_mtx_unlock(buffer_mtx);
 	}
@@ -1272,6 +1469,10 @@ out:
 
 	if (mark && (*length > 0)) {
 		telemetry_bytes_since_last_mark = 0;
+		if (current_buffer == &telemetry_buffer) {
+			/* don't update records userspace has already consumed */
+			telemetry_agg_generation++;
+		}
 	}
 
 	TELEMETRY_UNLOCK();
@@ -134,3 +134,127 @@ mpsc_test_pingpong(uint64_t count, uint64_t *out)
 	    count, *out, (*out / count) / 1000, (*out / count) % 1000);
 	return 0;
 }
+
+struct mpsc_test_burst_queue {
+	struct mpsc_daemon_queue queue;
+	uint64_t _Atomic processed;
+	uint64_t _Atomic drains;
+	uint64_t total, end;
+};
+
+static void
+mpsc_test_burst_done(struct mpsc_test_burst_queue *q, uint64_t n)
+{
+	if (os_atomic_add(&q->processed, n, relaxed) == q->total) {
+		q->end = mach_absolute_time();
+		thread_wakeup(q);
+	}
+}
+
+static void
+mpsc_test_burst_invoke(mpsc_queue_chain_t elm, mpsc_daemon_queue_t dq)
+{
+	struct mpsc_test_burst_queue *q;
+	q = __container_of(dq, struct mpsc_test_burst_queue, queue);
+
+	if (elm == MPSC_QUEUE_BATCH_END) {
+		os_atomic_inc(&q->drains, relaxed);
+	} else {
+		mpsc_test_burst_done(q, 1);
+	}
+}
+
+static void
+mpsc_test_burst_batch_invoke(mpsc_queue_chain_t head, mpsc_queue_chain_t tail,
+    mpsc_daemon_queue_t dq)
+{
+	struct mpsc_test_burst_queue *q;
+	mpsc_queue_chain_t elm;
+	uint64_t n = 0;
+
+	q = __container_of(dq, struct mpsc_test_burst_queue, queue);
+	mpsc_queue_batch_foreach_safe(elm, head, tail) {
+		n++;
+	}
+	os_atomic_inc(&q->drains, relaxed);
+	mpsc_test_burst_done(q, n);
+}
+
+/*
+ * Enqueues `count` items in bursts of 32, 20us apart, onto a thread
+ * daemon queue, and measures the time it takes for all of them to be
+ * drained.
+ *
+ * Without `coalesce`, the queue uses a per item callback and wakes up
+ * its thread when a burst lands on an idle queue. With `coalesce`, it
+ * uses a batch callback and delays wakeups by up to 1ms or 128 items.
+ *
+ * The number of drains (a good proxy for thread wakeups) is logged.
+ */
+int
+mpsc_test_burst(uint64_t count, bool coalesce, uint64_t *out)
+{
+	struct mpsc_test_burst_queue q = { };
+	struct mpsc_queue_chain *elms;
+	kern_return_t kr;
+	wait_result_t wr;
+	uint32_t timeout = 5;
+	uint64_t start;
+
+	if (count < 1000 || count > 100 * 1000) {
+		return EINVAL;
+	}
+
+	elms = kalloc_type(struct mpsc_queue_chain, count, Z_WAITOK | Z_ZERO);
+	if (elms == NULL) {
+		return ENOMEM;
+	}
+
+	kr = mpsc_daemon_queue_init_with_thread(&q.queue,
+	    mpsc_test_burst_invoke, MINPRI_KERNEL, "burst",
+	    MPSC_DAEMON_INIT_INACTIVE);
+	if (kr != KERN_SUCCESS) {
+		panic("mpsc_test_burst: unable to create queue: %x", kr);
+	}
+	if (coalesce) {
+		mpsc_daemon_queue_set_batch_invoke(&q.queue,
+		    mpsc_test_burst_batch_invoke);
+		mpsc_daemon_queue_set_wakeup_coalescing(&q.queue, 128,
+		    NSEC_PER_MSEC);
+	} else {
+		q.queue.mpd_options |= MPSC_QUEUE_OPTION_BATCH;
+	}
+	mpsc_daemon_queue_activate(&q.queue);
+	q.total = count;
+
+#if KASAN
+	timeout = 30;
+#endif
+
+	start = mach_absolute_time();
+	for (uint64_t i = 0; i < count; i++) {
+		if (i % 32 == 0 && i) {
+			delay(20);
+		}
+		mpsc_daemon_enqueue(&q.queue, &elms[i],
+		    MPSC_QUEUE_DISABLE_PREEMPTION);
+	}
+
+	assert_wait_timeout(&q, THREAD_UNINT, timeout, NSEC_PER_SEC);
+	if (os_atomic_load(&q.processed, relaxed) == count) {
+		clear_wait(current_thread(), THREAD_AWAKENED);
+	} else {
+		wr = thread_block(THREAD_CONTINUE_NULL);
+		if (wr == THREAD_TIMED_OUT) {
+			panic("mpsc_test_burst: timed out: %p", &q);
+		}
+	}
+
+	mpsc_daemon_queue_cancel_and_wait(&q.queue);
+	kfree_type(struct mpsc_queue_chain, count, elms);
+	absolutetime_to_nanoseconds(q.end - start, out);
+
+	printf("mpsc_test_burst: %lld items%s in %lld ns, %lld drains\n",
+	    count, coalesce ? " (coalesced)" : "", *out, q.drains);
+	return 0;
+}
@@ -482,6 +482,11 @@ struct thread {
 	os_ref_atomic_t         ref_count;              /* number of references to me */
 
 	uint32_t                rwlock_count;           /* Number of lck_rw_t locks held by thread */
+	uint32_t                lck_prof_tick;          /* contended acquisitions since the last profiled one */
+	const void             *lck_prof_hold_lock;     /* lock whose hold time is being profiled */
+	uint64_t                lck_prof_hold_start;
+	uint16_t                lck_prof_hold_slot;     /* profile slot and LOCKPROF_TYPE_* of lck_prof_hold_lock */
+	uint16_t                lck_prof_hold_type;
 #ifdef DEBUG_RW
 	rw_lock_debug_t         rw_lock_held;           /* rw_locks currently held by the thread */
 #endif /* DEBUG_RW */
@@ -666,6 +671,7 @@ struct thread {
 	natural_t ith_assertions;                       /* assertions pending drop */
 #endif
 	circle_queue_head_t     ith_messages;           /* messages to reap */
+	struct ipc_kmsg        *ith_kmsg_cache;         /* spare kobject reply kmsg */
 	mach_port_t             ith_kernel_reply_port;  /* reply port for kernel RPCs */
 
 	/* Pending thread ast(s) */
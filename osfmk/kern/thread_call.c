@@ -91,6 +91,12 @@ static struct thread_call_group {
 	thread_call_group_flags_t tcg_flags;
 
 	struct waitq            waiters_waitq;
+
+	/* Stats, updated under the group lock: */
+	uint64_t                tcg_invokes;            /* pending calls invoked */
+	uint64_t                tcg_steals;             /* of which by another group's thread */
+	uint64_t                tcg_latency_total;      /* sum of enqueue to invoke latency */
+	uint64_t                tcg_latency_max;        /* max enqueue to invoke latency */
 } thread_call_groups[THREAD_CALL_INDEX_MAX] = {
 	[THREAD_CALL_INDEX_INVALID] = {
 		.tcg_name               = "invalid",
@@ -166,6 +172,13 @@ struct thread_call_thread_state {
 	thread_call_param_t thc_param1;
 };
 
+/*
+ * Let a thread which has drained its own group run the pending calls of
+ * another group of compatible priority rather than park, see
+ * thread_call_steal().
+ */
+static TUNABLE(bool, thread_call_steal_enabled, "thread_call_steal", true);
+
 static bool                     thread_call_daemon_awake = true;
 /*
  * This special waitq exists because the daemon thread
@@ -1704,123 +1717,242 @@ thread_call_invoke(thread_call_func_t func,
 }
 
 /*
- *	thread_call_thread:
+ *	thread_call_run_pending:
+ *
+ *	Dequeue and invoke the call at the head of the
+ *	group's pending queue, on behalf of the current
+ *	thread call thread.
+ *
+ *	Called with the group lock held and interrupts
+ *	disabled, returns the same way.
  */
 static void
-thread_call_thread(
+thread_call_run_pending(
 	thread_call_group_t             group,
-	wait_result_t                   wres)
+	struct thread_call_thread_state *thc_state,
+	spl_t                           *s)
 {
-	thread_t self = current_thread();
-
-	if ((thread_get_tag_internal(self) & THREAD_TAG_CALLOUT) == 0) {
-		(void)thread_set_tag_internal(self, THREAD_TAG_CALLOUT);
-	}
+	thread_call_t call = qe_dequeue_head(&group->pending_queue,
+	    struct thread_call, tc_qlink);
+	assert(call != NULL);
 
 	/*
-	 * A wakeup with THREAD_INTERRUPTED indicates that
-	 * we should terminate.
+	 * This thread_call_get_group is also here to validate
+	 * sanity of the thing popped off the queue
 	 */
-	if (wres == THREAD_INTERRUPTED) {
-		thread_terminate(self);
+	thread_call_group_t call_group = thread_call_get_group(call);
+	if (group != call_group) {
+		panic("(%p %p) call on pending_queue from wrong group %p",
+		    call, call->tc_func, call_group);
+	}
 
-		/* NOTREACHED */
-		panic("thread_terminate() returned?");
+	group->pending_count--;
+	if (group->pending_count == 0) {
+		assert(queue_empty(&group->pending_queue));
 	}
 
-	spl_t s = disable_ints_and_lock(group);
+	thread_call_func_t  func   = call->tc_func;
+	thread_call_param_t param0 = call->tc_param0;
+	thread_call_param_t param1 = call->tc_param1;
 
-	struct thread_call_thread_state thc_state = { .thc_group = group };
-	self->thc_state = &thc_state;
+	if (func == NULL) {
+		panic("pending call with NULL func: %p", call);
+	}
 
-	thread_sched_call(self, sched_call_thread);
+	call->tc_queue = NULL;
 
-	while (group->pending_count > 0) {
-		thread_call_t call = qe_dequeue_head(&group->pending_queue,
-		    struct thread_call, tc_qlink);
-		assert(call != NULL);
+	if (_is_internal_call(call)) {
+		_internal_call_release(call);
+	}
 
+	/*
+	 * Can only do wakeups for thread calls whose storage
+	 * we control.
+	 */
+	bool needs_finish = false;
+	if (call->tc_flags & THREAD_CALL_ALLOC) {
+		call->tc_refs++;        /* Delay free until we're done */
+	}
+	if (call->tc_flags & (THREAD_CALL_ALLOC | THREAD_CALL_ONCE)) {
 		/*
-		 * This thread_call_get_group is also here to validate
-		 * sanity of the thing popped off the queue
+		 * If THREAD_CALL_ONCE is used, and the timer wasn't
+		 * THREAD_CALL_ALLOC, then clients swear they will use
+		 * thread_call_cancel_wait() before destroying
+		 * the thread call.
+		 *
+		 * Else, the storage for the thread call might have
+		 * disappeared when thread_call_invoke() ran.
 		 */
-		thread_call_group_t call_group = thread_call_get_group(call);
-		if (group != call_group) {
-			panic("(%p %p) call on pending_queue from wrong group %p",
-			    call, call->tc_func, call_group);
-		}
+		needs_finish = true;
+		call->tc_flags |= THREAD_CALL_RUNNING;
+	}
 
-		group->pending_count--;
-		if (group->pending_count == 0) {
-			assert(queue_empty(&group->pending_queue));
-		}
+	thc_state->thc_call = call;
+	thc_state->thc_call_pending_timestamp = call->tc_pending_timestamp;
+	thc_state->thc_call_soft_deadline = call->tc_soft_deadline;
+	thc_state->thc_call_hard_deadline = call->tc_pqlink.deadline;
+	thc_state->thc_func = func;
+	thc_state->thc_param0 = param0;
+	thc_state->thc_param1 = param1;
+	thc_state->thc_IOTES_invocation_timestamp = 0;
 
-		thread_call_func_t  func   = call->tc_func;
-		thread_call_param_t param0 = call->tc_param0;
-		thread_call_param_t param1 = call->tc_param1;
+	enable_ints_and_unlock(group, *s);
 
-		if (func == NULL) {
-			panic("pending call with NULL func: %p", call);
-		}
+	thc_state->thc_call_start = mach_absolute_time();
 
-		call->tc_queue = NULL;
+	thread_call_invoke(func, param0, param1, call);
 
-		if (_is_internal_call(call)) {
-			_internal_call_release(call);
+	thc_state->thc_call = NULL;
+
+	if (get_preemption_level() != 0) {
+		int pl = get_preemption_level();
+		panic("thread_call_thread: preemption_level %d, last callout %p(%p, %p)",
+		    pl, (void *)VM_KERNEL_UNSLIDE(func), param0, param1);
+	}
+
+	*s = disable_ints_and_lock(group);
+
+	uint64_t latency = 0;
+	if (thc_state->thc_call_start > thc_state->thc_call_pending_timestamp) {
+		latency = thc_state->thc_call_start - thc_state->thc_call_pending_timestamp;
+	}
+	group->tcg_invokes++;
+	group->tcg_latency_total += latency;
+	if (latency > group->tcg_latency_max) {
+		group->tcg_latency_max = latency;
+	}
+
+	if (needs_finish) {
+		/* Release refcount, may free, may temporarily drop lock */
+		thread_call_finish(call, group, s);
+	}
+}
+
+/*
+ *	thread_call_steal_class:
+ *
+ *	Groups may only run each other's calls when they are
+ *	in the same class: kernel priorities, or user priorities
+ *	above throttled. Throttled work is never stolen.
+ */
+static int
+thread_call_steal_class(thread_call_group_t group)
+{
+	if (group->tcg_thread_pri >= BASEPRI_KERNEL) {
+		return 1;
+	}
+	if (group->tcg_thread_pri > MAXPRI_THROTTLE) {
+		return 2;
+	}
+	return 0;
+}
+
+/*
+ *	thread_call_steal:
+ *
+ *	Called by a thread which has drained its own group before it parks:
+ *	look for a group of the same class and no higher priority whose
+ *	calls are pending with no idle thread to run them, and run one of
+ *	those calls.  The thread is accounted as active in the other group
+ *	for the duration, so that its own group wakes or creates another
+ *	thread if new work shows up meanwhile.
+ *
+ *	Returns true if a call was run, in which case the caller should look
+ *	at its own group again.  Called with the group lock held and
+ *	interrupts disabled, returns the same way.
+ */
+static bool
+thread_call_steal(
+	thread_call_group_t             group,
+	struct thread_call_thread_state *thc_state,
+	spl_t                           *s)
+{
+	int steal_class = thread_call_steal_class(group);
+	bool stolen = false;
+
+	if (!thread_call_steal_enabled || steal_class == 0) {
+		return false;
+	}
+
+	for (int i = THREAD_CALL_INDEX_HIGH; i < THREAD_CALL_INDEX_MAX && !stolen; i++) {
+		thread_call_group_t victim = &thread_call_groups[i];
+
+		if (victim == group ||
+		    thread_call_steal_class(victim) != steal_class ||
+		    victim->tcg_thread_pri > group->tcg_thread_pri) {
+			continue;
 		}
 
-		/*
-		 * Can only do wakeups for thread calls whose storage
-		 * we control.
-		 */
-		bool needs_finish = false;
-		if (call->tc_flags & THREAD_CALL_ALLOC) {
-			call->tc_refs++;        /* Delay free until we're done */
+		/* Unlocked peek, rechecked below */
+		if (os_atomic_load(&victim->pending_count, relaxed) == 0 ||
+		    os_atomic_load(&victim->idle_count, relaxed) != 0) {
+			continue;
 		}
-		if (call->tc_flags & (THREAD_CALL_ALLOC | THREAD_CALL_ONCE)) {
-			/*
-			 * If THREAD_CALL_ONCE is used, and the timer wasn't
-			 * THREAD_CALL_ALLOC, then clients swear they will use
-			 * thread_call_cancel_wait() before destroying
-			 * the thread call.
-			 *
-			 * Else, the storage for the thread call might have
-			 * disappeared when thread_call_invoke() ran.
-			 */
-			needs_finish = true;
-			call->tc_flags |= THREAD_CALL_RUNNING;
+
+		group->active_count--;
+		thread_call_unlock(group);
+		thread_call_lock_spin(victim);
+
+		if (victim->pending_count > 0 && victim->idle_count == 0) {
+			victim->active_count++;
+			victim->tcg_steals++;
+			thc_state->thc_group = victim;
+
+			thread_call_run_pending(victim, thc_state, s);
+
+			thc_state->thc_group = group;
+			victim->active_count--;
+			if (victim->pending_count > 0) {
+				thread_call_wake(victim);
+			}
+			stolen = true;
 		}
 
-		thc_state.thc_call = call;
-		thc_state.thc_call_pending_timestamp = call->tc_pending_timestamp;
-		thc_state.thc_call_soft_deadline = call->tc_soft_deadline;
-		thc_state.thc_call_hard_deadline = call->tc_pqlink.deadline;
-		thc_state.thc_func = func;
-		thc_state.thc_param0 = param0;
-		thc_state.thc_param1 = param1;
-		thc_state.thc_IOTES_invocation_timestamp = 0;
+		thread_call_unlock(victim);
+		thread_call_lock_spin(group);
+		group->active_count++;
+	}
 
-		enable_ints_and_unlock(group, s);
+	return stolen;
+}
 
-		thc_state.thc_call_start = mach_absolute_time();
+/*
+ *	thread_call_thread:
+ */
+static void
+thread_call_thread(
+	thread_call_group_t             group,
+	wait_result_t                   wres)
+{
+	thread_t self = current_thread();
+
+	if ((thread_get_tag_internal(self) & THREAD_TAG_CALLOUT) == 0) {
+		(void)thread_set_tag_internal(self, THREAD_TAG_CALLOUT);
+	}
+
+	/*
+	 * A wakeup with THREAD_INTERRUPTED indicates that
+	 * we should terminate.
+	 */
+	if (wres == THREAD_INTERRUPTED) {
+		thread_terminate(self);
 
-		thread_call_invoke(func, param0, param1, call);
+		/* NOTREACHED */
+		panic("thread_terminate() returned?");
+	}
 
-		thc_state.thc_call = NULL;
+	spl_t s = disable_ints_and_lock(group);
 
-		if (get_preemption_level() != 0) {
-			int pl = get_preemption_level();
-			panic("thread_call_thread: preemption_level %d, last callout %p(%p, %p)",
-			    pl, (void *)VM_KERNEL_UNSLIDE(func), param0, param1);
-		}
+	struct thread_call_thread_state thc_state = { .thc_group = group };
+	self->thc_state = &thc_state;
 
-		s = disable_ints_and_lock(group);
+	thread_sched_call(self, sched_call_thread);
 
-		if (needs_finish) {
-			/* Release refcount, may free, may temporarily drop lock */
-			thread_call_finish(call, group, &s);
+	do {
+		while (group->pending_count > 0) {
+			thread_call_run_pending(group, &thc_state, &s);
 		}
-	}
+	} while (thread_call_steal(group, &thc_state, &s));
 
 	thread_sched_call(self, NULL);
 	group->active_count--;
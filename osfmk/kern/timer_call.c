@@ -101,6 +101,28 @@ LCK_GRP_DECLARE(timer_longterm_lck_grp, "timer_longterm");
 /* Sentinel for "scan limit exceeded": */
 #define TIMER_LONGTERM_SCAN_AGAIN       0
 
+/*
+ * With the timer_longterm_wheel boot-arg, the longterm queue is bucketed
+ * into a two-level timing wheel keyed by soft deadline instead of being
+ * kept as a single unordered list. A threshold scan then only visits the
+ * slots that are coming due rather than every longterm timer.
+ *
+ * Level 0 has one slot per TIMER_LONGTERM_WHEEL_WIDTH and holds the timers
+ * of the current turn (the level 0 cursor's block). Each level 1 slot spans
+ * a full turn of level 0 and is cascaded down when the cursor enters it.
+ * Timers further out than a full turn of level 1 stay in their level 1
+ * slot and are re-examined once per turn.
+ *
+ * Timers still leave the wheel with the deadline and soft deadline that
+ * timer_call_enter computed, so slop and QoS coalescing are unaffected.
+ */
+#define TIMER_LONGTERM_WHEEL_BITS       6
+#define TIMER_LONGTERM_WHEEL_SLOTS      (1u << TIMER_LONGTERM_WHEEL_BITS)
+#define TIMER_LONGTERM_WHEEL_MASK       (TIMER_LONGTERM_WHEEL_SLOTS - 1)
+#define TIMER_LONGTERM_WHEEL_WIDTH      (1ULL * NSEC_PER_SEC)   /* 1 sec */
+
+static TUNABLE(bool, timer_longterm_wheel, "timer_longterm_wheel", false);
+
 /*
  * In a similar way to the longterm queue's scan limit, the following bounds the
  * amount of time spent processing regular timers.
@@ -153,6 +175,11 @@ typedef struct {
 	uint64_t        scan_limit;     /* maximum scan time */
 	uint64_t        scan_interval;  /* interval between LT "escalation" scans */
 	uint64_t        scan_pauses;    /* num scans exceeding time limit */
+	                                /* Wheel (timer_longterm_wheel only): */
+	queue_head_t    wheel[2][TIMER_LONGTERM_WHEEL_SLOTS];
+	uint64_t        wheel_width;    /*   level 0 slot width */
+	uint64_t        wheel_cursor;   /*   current level 0 slot number */
+	uint64_t        wheel_cascades; /*   num level 1 slots cascaded */
 } timer_longterm_t;
 
 timer_longterm_t                timer_longterm = {
@@ -435,6 +462,29 @@ timer_call_entry_enqueue_deadline(
 	return old_mpqueue;
 }
 
+/*
+ * Return the longterm wheel slot a timer belongs in, by soft deadline.
+ * Timers at or before the cursor go in the current slot, which the next
+ * scan always visits. The longterm queue lock must be held.
+ */
+static queue_head_t *
+timer_longterm_wheel_slot(
+	timer_longterm_t        *tlp,
+	timer_call_t            call)
+{
+	uint64_t        slot = call->tc_soft_deadline / tlp->wheel_width;
+
+	if (slot < tlp->wheel_cursor) {
+		slot = tlp->wheel_cursor;
+	}
+	if ((slot >> TIMER_LONGTERM_WHEEL_BITS) ==
+	    (tlp->wheel_cursor >> TIMER_LONGTERM_WHEEL_BITS)) {
+		return &tlp->wheel[0][slot & TIMER_LONGTERM_WHEEL_MASK];
+	}
+	slot >>= TIMER_LONGTERM_WHEEL_BITS;
+	return &tlp->wheel[1][slot & TIMER_LONGTERM_WHEEL_MASK];
+}
+
 static __inline__ void
 timer_call_entry_enqueue_tail(
 	timer_call_t                    entry,
@@ -449,7 +499,16 @@ timer_call_entry_enqueue_tail(
 	 */
 	assert(queue == timer_longterm_queue);
 
-	enqueue_tail(&queue->head, &entry->tc_qlink);
+	/*
+	 * With the wheel, the entry is linked on its slot rather than on
+	 * the queue head, but tc_queue still names the longterm queue.
+	 */
+	if (timer_longterm_wheel) {
+		enqueue_tail(timer_longterm_wheel_slot(&timer_longterm, entry),
+		    &entry->tc_qlink);
+	} else {
+		enqueue_tail(&queue->head, &entry->tc_qlink);
+	}
 
 	entry->tc_queue = &queue->head;
 
@@ -1342,17 +1401,234 @@ timer_longterm_enqueue_unlocked(timer_call_t    call,
 	return timer_longterm_queue;
 }
 
+/*
+ * Examine one longterm timer during a scan. Both the master queue and the
+ * longterm queue are locked:
+ *  - if within the short-term threshold
+ *    - enter on the local queue (unless being deleted),
+ *  - otherwise:
+ *    - if sooner, deadline becomes the next threshold deadline.
+ */
+static void
+timer_longterm_scan_call(timer_longterm_t       *tlp,
+    timer_call_t           call,
+    uint64_t               threshold,
+    __unused uint64_t      time_start,
+    mpqueue_head_t         *timer_master_queue)
+{
+	uint64_t        deadline = call->tc_soft_deadline;
+
+	if (!simple_lock_try(&call->tc_lock, LCK_GRP_NULL)) {
+		/* case (2c) lock order inversion, dequeue only */
+#ifdef TIMER_ASSERT
+		TIMER_KDEBUG_TRACE(KDEBUG_TRACE,
+		    DECR_TIMER_ASYNC_DEQ | DBG_FUNC_NONE,
+		    VM_KERNEL_UNSLIDE_OR_PERM(call),
+		    VM_KERNEL_UNSLIDE_OR_PERM(call->tc_queue),
+		    0,
+		    0x2c, 0);
+#endif
+		timer_call_entry_dequeue_async(call);
+		return;
+	}
+	if (deadline < threshold) {
+		/*
+		 * This timer needs moving (escalating)
+		 * to the local (boot) processor's queue.
+		 */
+#ifdef TIMER_ASSERT
+		if (deadline < time_start) {
+			TIMER_KDEBUG_TRACE(KDEBUG_TRACE,
+			    DECR_TIMER_OVERDUE | DBG_FUNC_NONE,
+			    VM_KERNEL_UNSLIDE_OR_PERM(call),
+			    deadline,
+			    time_start,
+			    threshold,
+			    0);
+		}
+#endif
+		TIMER_KDEBUG_TRACE(KDEBUG_TRACE,
+		    DECR_TIMER_ESCALATE | DBG_FUNC_NONE,
+		    VM_KERNEL_UNSLIDE_OR_PERM(call),
+		    call->tc_pqlink.deadline,
+		    call->tc_entry_time,
+		    VM_KERNEL_UNSLIDE(call->tc_func),
+		    0);
+		tlp->escalates++;
+		timer_call_entry_dequeue(call);
+		timer_call_entry_enqueue_deadline(
+			call, timer_master_queue, call->tc_pqlink.deadline);
+		/*
+		 * A side-effect of the following call is to update
+		 * the actual hardware deadline if required.
+		 */
+		(void) timer_queue_assign(deadline);
+	} else {
+		if (deadline < tlp->threshold.deadline) {
+			tlp->threshold.deadline = deadline;
+			tlp->threshold.call = call;
+		}
+	}
+	simple_unlock(&call->tc_lock);
+}
+
+/*
+ * Scan one list of longterm timers, returning false if the scan was
+ * paused for taking too long.
+ */
+static bool
+timer_longterm_scan_list(timer_longterm_t       *tlp,
+    queue_head_t           *head,
+    uint64_t               threshold,
+    uint64_t               time_start,
+    mpqueue_head_t         *timer_master_queue)
+{
+	timer_call_t    call;
+	uint64_t        time_limit = time_start + tlp->scan_limit;
+
+	qe_foreach_element_safe(call, head, tc_qlink) {
+		timer_longterm_scan_call(tlp, call, threshold, time_start,
+		    timer_master_queue);
+
+		/* Abort scan if we're taking too long. */
+		if (mach_absolute_time() > time_limit) {
+			tlp->threshold.deadline = TIMER_LONGTERM_SCAN_AGAIN;
+			tlp->scan_pauses++;
+			DBG("timer_longterm_scan() paused %llu, qlen: %llu\n",
+			    time_limit, tlp->queue.count);
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Move the timers of a level 1 wheel slot that now fall within the
+ * current turn down to level 0. Only list linkage changes, which the
+ * longterm queue lock covers, so this is cheap and never paused.
+ */
+static void
+timer_longterm_wheel_cascade(timer_longterm_t   *tlp,
+    queue_head_t       *head)
+{
+	timer_call_t    call;
+	queue_head_t    *slot;
+
+	tlp->wheel_cascades++;
+	qe_foreach_element_safe(call, head, tc_qlink) {
+		slot = timer_longterm_wheel_slot(tlp, call);
+		if (slot != head) {
+			remqueue(&call->tc_qlink);
+			enqueue_tail(slot, &call->tc_qlink);
+		}
+	}
+}
+
+/*
+ * Wheel flavor of the longterm scan: advance the level 0 cursor up to the
+ * slot of the threshold, escalating the timers of each slot passed and
+ * cascading level 1 at every turn. Only the threshold's own slot can hold
+ * timers which stay longterm. If nothing is left there, the next
+ * threshold deadline is the soonest timer of the next occupied level 0
+ * slot, or the start of the next occupied level 1 slot, when it is
+ * cascaded.
+ */
+static void
+timer_longterm_wheel_scan(timer_longterm_t      *tlp,
+    uint64_t              threshold,
+    uint64_t              time_start,
+    mpqueue_head_t        *timer_master_queue)
+{
+	timer_call_t    call;
+	queue_head_t    *head;
+	uint64_t        target, block;
+	uint32_t        i;
+
+	if (threshold == TIMER_LONGTERM_NONE) {
+		/* Longterm timers are being disabled: escalate them all */
+		for (i = 0; i < TIMER_LONGTERM_WHEEL_SLOTS * 2; i++) {
+			head = &tlp->wheel[i / TIMER_LONGTERM_WHEEL_SLOTS]
+			    [i & TIMER_LONGTERM_WHEEL_MASK];
+			if (!timer_longterm_scan_list(tlp, head, threshold,
+			    time_start, timer_master_queue)) {
+				return;
+			}
+		}
+		return;
+	}
+
+	target = threshold / tlp->wheel_width;
+	for (;;) {
+		head = &tlp->wheel[0][tlp->wheel_cursor & TIMER_LONGTERM_WHEEL_MASK];
+		if (!timer_longterm_scan_list(tlp, head, threshold,
+		    time_start, timer_master_queue)) {
+			return;
+		}
+		if (tlp->wheel_cursor >= target) {
+			break;
+		}
+		tlp->wheel_cursor++;
+		if ((tlp->wheel_cursor & TIMER_LONGTERM_WHEEL_MASK) != 0) {
+			continue;
+		}
+
+		block = tlp->wheel_cursor >> TIMER_LONGTERM_WHEEL_BITS;
+		if ((target >> TIMER_LONGTERM_WHEEL_BITS) - block <
+		    TIMER_LONGTERM_WHEEL_SLOTS) {
+			timer_longterm_wheel_cascade(tlp,
+			    &tlp->wheel[1][block & TIMER_LONGTERM_WHEEL_MASK]);
+		} else {
+			/*
+			 * A full turn of level 1 went by (e.g. across sleep):
+			 * jump to the threshold's turn and cascade every slot.
+			 * Overdue timers land in the current slot.
+			 */
+			block = target >> TIMER_LONGTERM_WHEEL_BITS;
+			tlp->wheel_cursor = block << TIMER_LONGTERM_WHEEL_BITS;
+			for (i = 0; i < TIMER_LONGTERM_WHEEL_SLOTS; i++) {
+				timer_longterm_wheel_cascade(tlp, &tlp->wheel[1][i]);
+			}
+		}
+	}
+
+	if (tlp->threshold.deadline != TIMER_LONGTERM_NONE) {
+		return;
+	}
+
+	for (i = (tlp->wheel_cursor & TIMER_LONGTERM_WHEEL_MASK) + 1;
+	    i < TIMER_LONGTERM_WHEEL_SLOTS; i++) {
+		head = &tlp->wheel[0][i];
+		if (queue_empty(head)) {
+			continue;
+		}
+		qe_foreach_element(call, head, tc_qlink) {
+			if (call->tc_soft_deadline < tlp->threshold.deadline) {
+				tlp->threshold.deadline = call->tc_soft_deadline;
+				tlp->threshold.call = call;
+			}
+		}
+		return;
+	}
+
+	block = tlp->wheel_cursor >> TIMER_LONGTERM_WHEEL_BITS;
+	for (i = 1; i <= TIMER_LONGTERM_WHEEL_SLOTS; i++) {
+		head = &tlp->wheel[1][(block + i) & TIMER_LONGTERM_WHEEL_MASK];
+		if (!queue_empty(head)) {
+			tlp->threshold.deadline = ((block + i) <<
+			    TIMER_LONGTERM_WHEEL_BITS) * tlp->wheel_width;
+			return;
+		}
+	}
+}
+
 /*
  * Scan for timers below the longterm threshold.
  * Move these to the local timer queue (of the boot processor on which the
  * calling thread is running).
  * Both the local (boot) queue and the longterm queue are locked.
  * The scan is similar to the timer migrate sequence but is performed by
- * successively examining each timer on the longterm queue:
- *  - if within the short-term threshold
- *    - enter on the local queue (unless being deleted),
- *  - otherwise:
- *    - if sooner, deadline becomes the next threshold deadline.
+ * successively examining each timer on the longterm queue, or only the
+ * slots coming due when the longterm wheel is in use.
  * The total scan time is limited to TIMER_LONGTERM_SCAN_LIMIT. Should this be
  * exceeded, we abort and reschedule again so that we don't shut others from
  * the timer queues. Longterm timers firing late is not critical.
@@ -1361,10 +1637,7 @@ void
 timer_longterm_scan(timer_longterm_t    *tlp,
     uint64_t            time_start)
 {
-	timer_call_t    call;
 	uint64_t        threshold = TIMER_LONGTERM_NONE;
-	uint64_t        deadline;
-	uint64_t        time_limit = time_start + tlp->scan_limit;
 	mpqueue_head_t  *timer_master_queue;
 
 	assert(!ml_get_interrupts_enabled());
@@ -1377,76 +1650,19 @@ timer_longterm_scan(timer_longterm_t    *tlp,
 	tlp->threshold.deadline = TIMER_LONGTERM_NONE;
 	tlp->threshold.call = NULL;
 
-	if (queue_empty(&timer_longterm_queue->head)) {
+	if (timer_longterm_queue->count == 0) {
 		return;
 	}
 
 	timer_master_queue = timer_queue_cpu(master_cpu);
 	timer_queue_lock_spin(timer_master_queue);
 
-	qe_foreach_element_safe(call, &timer_longterm_queue->head, tc_qlink) {
-		deadline = call->tc_soft_deadline;
-		if (!simple_lock_try(&call->tc_lock, LCK_GRP_NULL)) {
-			/* case (2c) lock order inversion, dequeue only */
-#ifdef TIMER_ASSERT
-			TIMER_KDEBUG_TRACE(KDEBUG_TRACE,
-			    DECR_TIMER_ASYNC_DEQ | DBG_FUNC_NONE,
-			    VM_KERNEL_UNSLIDE_OR_PERM(call),
-			    VM_KERNEL_UNSLIDE_OR_PERM(call->tc_queue),
-			    0,
-			    0x2c, 0);
-#endif
-			timer_call_entry_dequeue_async(call);
-			continue;
-		}
-		if (deadline < threshold) {
-			/*
-			 * This timer needs moving (escalating)
-			 * to the local (boot) processor's queue.
-			 */
-#ifdef TIMER_ASSERT
-			if (deadline < time_start) {
-				TIMER_KDEBUG_TRACE(KDEBUG_TRACE,
-				    DECR_TIMER_OVERDUE | DBG_FUNC_NONE,
-				    VM_KERNEL_UNSLIDE_OR_PERM(call),
-				    deadline,
-				    time_start,
-				    threshold,
-				    0);
-			}
-#endif
-			TIMER_KDEBUG_TRACE(KDEBUG_TRACE,
-			    DECR_TIMER_ESCALATE | DBG_FUNC_NONE,
-			    VM_KERNEL_UNSLIDE_OR_PERM(call),
-			    call->tc_pqlink.deadline,
-			    call->tc_entry_time,
-			    VM_KERNEL_UNSLIDE(call->tc_func),
-			    0);
-			tlp->escalates++;
-			timer_call_entry_dequeue(call);
-			timer_call_entry_enqueue_deadline(
-				call, timer_master_queue, call->tc_pqlink.deadline);
-			/*
-			 * A side-effect of the following call is to update
-			 * the actual hardware deadline if required.
-			 */
-			(void) timer_queue_assign(deadline);
-		} else {
-			if (deadline < tlp->threshold.deadline) {
-				tlp->threshold.deadline = deadline;
-				tlp->threshold.call = call;
-			}
-		}
-		simple_unlock(&call->tc_lock);
-
-		/* Abort scan if we're taking too long. */
-		if (mach_absolute_time() > time_limit) {
-			tlp->threshold.deadline = TIMER_LONGTERM_SCAN_AGAIN;
-			tlp->scan_pauses++;
-			DBG("timer_longterm_scan() paused %llu, qlen: %llu\n",
-			    time_limit, tlp->queue.count);
-			break;
-		}
+	if (timer_longterm_wheel) {
+		timer_longterm_wheel_scan(tlp, threshold, time_start,
+		    timer_master_queue);
+	} else {
+		(void) timer_longterm_scan_list(tlp, &timer_longterm_queue->head,
+		    threshold, time_start, timer_master_queue);
 	}
 
 	timer_queue_unlock(timer_master_queue);
@@ -1589,6 +1805,15 @@ timer_longterm_init(void)
 
 	mpqueue_init(&tlp->queue, &timer_longterm_lck_grp, LCK_ATTR_NULL);
 
+	if (timer_longterm_wheel) {
+		for (int i = 0; i < TIMER_LONGTERM_WHEEL_SLOTS; i++) {
+			queue_init(&tlp->wheel[0][i]);
+			queue_init(&tlp->wheel[1][i]);
+		}
+		nanoseconds_to_absolutetime(TIMER_LONGTERM_WHEEL_WIDTH,
+		    &tlp->wheel_width);
+	}
+
 	timer_call_setup(&tlp->threshold.timer,
 	    timer_longterm_callout, (timer_call_param_t) tlp);
 
@@ -1601,6 +1826,7 @@ enum {
 	LATENCY, LATENCY_MIN, LATENCY_MAX, LONG_TERM_SCAN_LIMIT,
 	LONG_TERM_SCAN_INTERVAL, LONG_TERM_SCAN_PAUSES,
 	SCAN_LIMIT, SCAN_INTERVAL, SCAN_PAUSES, SCAN_POSTPONES,
+	LONG_TERM_WHEEL_CASCADES,
 };
 uint64_t
 timer_sysctl_get(int oid)
@@ -1643,6 +1869,8 @@ timer_sysctl_get(int oid)
 		return counter_load(&timer_scan_pauses_cnt);
 	case SCAN_POSTPONES:
 		return counter_load(&timer_scan_postpones_cnt);
+	case LONG_TERM_WHEEL_CASCADES:
+		return tlp->wheel_cascades;
 
 	default:
 		return 0;
@@ -265,13 +265,16 @@ turnstile_set_type_and_increment_gencount(struct turnstile *turnstile, turnstile
 /* Turnstile hashtable Implementation */
 
 /*
- * Maximum number of buckets in the turnstile hashtable. This number affects the
+ * Number of buckets in the turnstile hashtable. This number affects the
  * performance of the hashtable since it determines the hash collision
- * rate. To experiment with the number of buckets in this hashtable use the
- * "ts_htable_buckets" boot-arg.
+ * rate. By default the table is scaled with thread_max so that a fully
+ * populated system keeps short chains (about TURNSTILE_HTABLE_THREADS_PER_BUCKET
+ * threads per bucket); to experiment with the number of buckets in this
+ * hashtable use the "ts_htable_buckets" boot-arg.
  */
 #define TURNSTILE_HTABLE_BUCKETS_DEFAULT   32
-#define TURNSTILE_HTABLE_BUCKETS_MAX       1024
+#define TURNSTILE_HTABLE_BUCKETS_MAX       4096
+#define TURNSTILE_HTABLE_THREADS_PER_BUCKET 16
 
 SLIST_HEAD(turnstile_hashlist, turnstile);
 
@@ -300,6 +303,35 @@ LCK_GRP_DECLARE(turnstiles_htable_lock_grp, "turnstiles_htable_locks");
 #define kdp_turnstile_bucket_is_locked(bucket) \
 	kdp_lck_spin_is_acquired(&bucket->ts_ht_bucket_lock)
 
+#if DEVELOPMENT || DEBUG
+/* Occupancy stats for the irq safe [0] and irq unsafe [1] hashtables */
+static struct turnstile_htable_stats turnstile_htable_stats[2];
+
+static inline struct turnstile_htable_stats *
+turnstile_htable_stats_for_type(turnstile_type_t type)
+{
+	return &turnstile_htable_stats[!!(turnstile_hash_lock_policy[type] & TURNSTILE_IRQ_UNSAFE_HASH)];
+}
+
+static inline void
+turnstile_htable_stats_walk(turnstile_type_t type, uint32_t depth)
+{
+	struct turnstile_htable_stats *stats = turnstile_htable_stats_for_type(type);
+
+	os_atomic_inc(&stats->tshs_lookups, relaxed);
+	os_atomic_add(&stats->tshs_probes, depth, relaxed);
+	if (depth > os_atomic_load(&stats->tshs_max_chain, relaxed)) {
+		os_atomic_max(&stats->tshs_max_chain, depth, relaxed);
+	}
+}
+
+#define turnstile_htable_stats_hashed(type, delta) \
+	os_atomic_add(&turnstile_htable_stats_for_type(type)->tshs_hashed, (uint64_t)(delta), relaxed)
+#else
+#define turnstile_htable_stats_walk(type, depth)        ((void)(type), (void)(depth))
+#define turnstile_htable_stats_hashed(type, delta)      ((void)(type))
+#endif /* DEVELOPMENT || DEBUG */
+
 /*
  * Name: turnstiles_hashtable_init
  *
@@ -316,9 +348,17 @@ turnstiles_hashtable_init(void)
 {
 	/* Initialize number of buckets in the hashtable */
 	if (PE_parse_boot_argn("ts_htable_buckets", &ts_htable_buckets, sizeof(ts_htable_buckets)) != TRUE) {
-		ts_htable_buckets = TURNSTILE_HTABLE_BUCKETS_DEFAULT;
+		ts_htable_buckets = (uint32_t)thread_max / TURNSTILE_HTABLE_THREADS_PER_BUCKET;
+		ts_htable_buckets = MAX(ts_htable_buckets, TURNSTILE_HTABLE_BUCKETS_DEFAULT);
+		ts_htable_buckets = MIN(ts_htable_buckets, TURNSTILE_HTABLE_BUCKETS_MAX);
 	}
 
+	/* turnstile_hash() masks the hash, the bucket count must be a power of 2 */
+	if (ts_htable_buckets == 0) {
+		ts_htable_buckets = 1;
+	}
+	ts_htable_buckets = 0x80000000u >> __builtin_clz(ts_htable_buckets);
+
 	assert(ts_htable_buckets <= TURNSTILE_HTABLE_BUCKETS_MAX);
 	uint32_t ts_htable_size = ts_htable_buckets * sizeof(struct turnstile_htable_bucket);
 	turnstile_htable_irq_safe = zalloc_permanent(ts_htable_size, ZALIGN_PTR);
@@ -341,6 +381,11 @@ turnstiles_hashtable_init(void)
 		turnstile_bucket_lock_init(ts_bucket);
 		SLIST_INIT(&ts_bucket->ts_ht_bucket_list);
 	}
+
+#if DEVELOPMENT || DEBUG
+	turnstile_htable_stats[0].tshs_buckets = ts_htable_buckets;
+	turnstile_htable_stats[1].tshs_buckets = ts_htable_buckets;
+#endif /* DEVELOPMENT || DEBUG */
 }
 
 /*
@@ -577,13 +622,16 @@ turnstile_htable_lookup_add(
 	}
 
 	struct turnstile *ts;
+	uint32_t depth = 0;
 
 	SLIST_FOREACH(ts, &ts_bucket->ts_ht_bucket_list, ts_htable_link) {
+		depth++;
 		if (ts->ts_proprietor == proprietor) {
 			/*
 			 * Found an entry in the hashtable for this proprietor; add thread turnstile to freelist
 			 * and return this turnstile
 			 */
+			turnstile_htable_stats_walk(type, depth);
 			if (needs_lock) {
 				turnstile_bucket_unlock(ts_bucket);
 				if (irq_safe) {
@@ -598,6 +646,8 @@ turnstile_htable_lookup_add(
 	/* No entry for this proprietor; add the new turnstile in the hash table */
 	SLIST_INSERT_HEAD(&ts_bucket->ts_ht_bucket_list, new_turnstile, ts_htable_link);
 	turnstile_state_add(new_turnstile, TURNSTILE_STATE_HASHTABLE);
+	turnstile_htable_stats_walk(type, depth);
+	turnstile_htable_stats_hashed(type, 1);
 	if (needs_lock) {
 		turnstile_bucket_unlock(ts_bucket);
 		if (irq_safe) {
@@ -665,6 +715,7 @@ turnstable_htable_lookup_remove(
 		/* No turnstiles on the freelist; remove the turnstile from the hashtable and mark it freed */
 		*prev_tslink = SLIST_NEXT(ret_turnstile, ts_htable_link);
 		turnstile_state_remove(ret_turnstile, TURNSTILE_STATE_HASHTABLE);
+		turnstile_htable_stats_hashed(type, -1);
 		if (needs_lock) {
 			turnstile_bucket_unlock(ts_bucket);
 			if (irq_safe) {
@@ -733,8 +784,10 @@ turnstile_htable_lookup(
 	}
 	struct turnstile *ts = TURNSTILE_NULL;
 	struct turnstile *ret_turnstile = TURNSTILE_NULL;
+	uint32_t depth = 0;
 
 	SLIST_FOREACH(ts, &ts_bucket->ts_ht_bucket_list, ts_htable_link) {
+		depth++;
 		if (ts->ts_proprietor == proprietor) {
 			/* Found an entry in the hashtable for this proprietor */
 			ret_turnstile = ts;
@@ -742,6 +795,10 @@ turnstile_htable_lookup(
 		}
 	}
 
+	if (!kdp_ctx) {
+		turnstile_htable_stats_walk(type, depth);
+	}
+
 	if (needs_lock && !kdp_ctx) {
 		turnstile_bucket_unlock(ts_bucket);
 		if (irq_safe) {
@@ -3495,6 +3552,23 @@ turnstile_get_unboost_stats_sysctl(
 	return sysctl_io_opaque(req, turnstile_unboost_stats, sizeof(struct turnstile_stats) * TURNSTILE_MAX_HOP_DEFAULT, NULL);
 }
 
+/*
+ * Name: turnstile_get_htable_stats_sysctl
+ *
+ * Description: Function to get the occupancy stats of the irq safe and
+ *              irq unsafe turnstile hashtables, in that order.
+ *
+ * Args: req : opaque struct to pass to sysctl_io_opaque
+ *
+ * Returns: errorno
+ */
+int
+turnstile_get_htable_stats_sysctl(
+	void *req)
+{
+	return sysctl_io_opaque(req, turnstile_htable_stats, sizeof(turnstile_htable_stats), NULL);
+}
+
 /* Testing interface for Development kernels */
 #define tstile_test_prim_lock_interlock(test_prim) \
 	lck_spin_lock(&test_prim->ttprim_interlock)
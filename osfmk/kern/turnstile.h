@@ -45,6 +45,15 @@ struct turnstile_stats {
 	uint64_t ts_above_ui_pri_change;
 	uint64_t ts_no_turnstile;
 };
+
+/* Occupancy of one of the global turnstile hashtables */
+struct turnstile_htable_stats {
+	uint32_t tshs_buckets;          /* number of buckets */
+	uint32_t tshs_max_chain;        /* longest chain walked so far */
+	uint64_t tshs_hashed;           /* turnstiles currently hashed */
+	uint64_t tshs_lookups;          /* number of bucket walks */
+	uint64_t tshs_probes;           /* entries visited by those walks */
+};
 #endif
 
 #ifdef KERNEL_PRIVATE
@@ -704,6 +713,8 @@ int
 turnstile_get_boost_stats_sysctl(void *req);
 int
 turnstile_get_unboost_stats_sysctl(void *req);
+int
+turnstile_get_htable_stats_sysctl(void *req);
 #endif /* DEVELOPMENT || DEBUG */
 
 #pragma GCC visibility pop
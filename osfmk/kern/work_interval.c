@@ -42,6 +42,7 @@
 #include <kern/mpsc_queue.h>
 #include <kern/workload_config.h>
 #include <kern/assert.h>
+#include <kern/startup.h>
 
 #include <mach/kern_return.h>
 #include <mach/notify.h>
@@ -196,8 +197,27 @@ struct work_interval {
 	 */
 	wi_class_t wi_class;
 	uint8_t wi_class_offset;
+
+	/*
+	 * Deadline tracking, updated by the creating task on every notify.
+	 * wi_next_deadline and wi_duration_avg are read locklessly by the
+	 * scheduler to order runnable threads (see work_interval_runq_stamp()).
+	 */
+	uint64_t wi_next_deadline;      /* predicted deadline of the next interval */
+	uint64_t wi_duration_avg;       /* EWMA of (finish - start) */
+	uint32_t wi_deadline_misses;    /* consecutive intervals finished past deadline */
 };
 
+/*
+ * When enabled, runnable threads of a work interval with a known deadline
+ * are ordered within their clutch bucket by latest start time
+ * (next deadline - average interval duration) rather than by enqueue time.
+ */
+static TUNABLE(bool, sched_wi_deadline, "sched_wi_deadline", false);
+
+/* Weight of a new sample in wi_duration_avg, as a shift (1/8) */
+#define WORK_INTERVAL_DURATION_EWMA_SHIFT 3
+
 #if CONFIG_SCHED_AUTO_JOIN
 
 /*
@@ -947,6 +967,84 @@ work_interval_thread_terminate(thread_t thread)
 	return KERN_SUCCESS;
 }
 
+/*
+ * work_interval_update_deadline()
+ *
+ * Account for the interval described by a notify: track consecutive
+ * deadline misses, the average interval duration, and predict the deadline
+ * of the next interval from its start and the current period. The miss
+ * count is handed to the performance controller along with the notify.
+ */
+static void
+work_interval_update_deadline(struct work_interval *work_interval,
+    struct kern_work_interval_args *kwi_args)
+{
+	uint64_t start = kwi_args->start;
+	uint64_t finish = kwi_args->finish;
+	uint64_t deadline = kwi_args->deadline;
+	uint64_t next_deadline = 0;
+	uint32_t misses = work_interval->wi_deadline_misses;
+
+	if (finish > start) {
+		uint64_t duration = finish - start;
+		uint64_t avg = work_interval->wi_duration_avg;
+
+		if (avg == 0) {
+			avg = duration;
+		} else {
+			avg = avg - (avg >> WORK_INTERVAL_DURATION_EWMA_SHIFT) +
+			    (duration >> WORK_INTERVAL_DURATION_EWMA_SHIFT);
+		}
+		os_atomic_store(&work_interval->wi_duration_avg, avg, relaxed);
+	}
+
+	if (deadline != 0 && finish != 0) {
+		if (finish > deadline) {
+			misses++;
+			KDBG(MACHDBG_CODE(DBG_MACH_SCHED, MACH_SCHED_WI_DEADLINE_MISS),
+			    work_interval->wi_id, finish - deadline, misses);
+		} else {
+			misses = 0;
+		}
+		work_interval->wi_deadline_misses = misses;
+	}
+
+	if (kwi_args->next_start != 0 && deadline > start) {
+		next_deadline = kwi_args->next_start + (deadline - start);
+	}
+	os_atomic_store(&work_interval->wi_next_deadline, next_deadline, relaxed);
+
+	kwi_args->deadline_misses = misses;
+}
+
+/*
+ * work_interval_runq_stamp()
+ *
+ * Returns the timestamp used to order a thread among runnable threads of
+ * the same priority in its clutch bucket. Threads in a work interval with
+ * a pending deadline are stamped with their latest start time so that the
+ * group runs them earliest-deadline first; everything else keeps FIFO
+ * order by enqueue time. Called with the thread locked.
+ */
+uint64_t
+work_interval_runq_stamp(thread_t thread, uint64_t timestamp)
+{
+	struct work_interval *work_interval = thread->th_work_interval;
+
+	if (!sched_wi_deadline || work_interval == NULL) {
+		return timestamp;
+	}
+
+	uint64_t deadline = os_atomic_load(&work_interval->wi_next_deadline, relaxed);
+	if (deadline == 0 || deadline < timestamp) {
+		/* No deadline, or a stale one that was never notified */
+		return timestamp;
+	}
+
+	uint64_t duration = os_atomic_load(&work_interval->wi_duration_avg, relaxed);
+	return (deadline > duration) ? (deadline - duration) : 0;
+}
+
 kern_return_t
 kern_work_interval_notify(thread_t thread, struct kern_work_interval_args* kwi_args)
 {
@@ -980,6 +1078,8 @@ kern_work_interval_notify(thread_t thread, struct kern_work_interval_args* kwi_a
 
 	splx(s);
 
+	work_interval_update_deadline(work_interval, kwi_args);
+
 	/* called without interrupts disabled */
 	machine_work_interval_notify(thread, kwi_args);
 
@@ -48,6 +48,7 @@ struct kern_work_interval_args {
 	uint64_t next_start;
 	uint32_t notify_flags;
 	uint32_t create_flags;
+	uint32_t deadline_misses;       /* out: consecutive missed deadlines */
 	uint16_t urgency;
 };
 
@@ -100,6 +101,7 @@ void work_interval_auto_join_demote(thread_t thread);
 
 extern kern_return_t work_interval_thread_terminate(thread_t thread);
 extern int work_interval_get_priority(thread_t thread);
+extern uint64_t work_interval_runq_stamp(thread_t thread, uint64_t timestamp);
 
 #endif /* MACH_KERNEL_PRIVATE */
 
@@ -409,7 +409,7 @@ typedef struct zone_cache {
 	uint16_t                   zc_alloc_cur;
 	uint16_t                   zc_free_cur;
 	uint16_t                   zc_depot_cur;
-	uint16_t                   __zc_padding;
+	uint16_t                   zc_lat_sample; /* allocations until next latency sample */
 	zone_element_t            *zc_alloc_elems;
 	zone_element_t            *zc_free_elems;
 	hw_lck_ticket_t            zc_depot_lock;
@@ -595,6 +595,13 @@ static int zalloc_simulate_vm_pressure;
  *
  *   0 to disable.
  *
+ * zc_boost_threshold
+ *   number of contentions per second, sustained for two periods, after which
+ *   the per-cpu depots of a zone grow by a whole magazine per period on top
+ *   of the per-contention growth.
+ *
+ *   0 to disable.
+ *
  * zc_recirc_batch
  *   how many magazines to transfer at most from/to the recirculation depot.
  *   Default 4.
@@ -618,16 +625,35 @@ static int zalloc_simulate_vm_pressure;
  * zc_free_batch_size
  *   The size of batches of frees/reclaim that can be done keeping
  *   the zone lock held (and preemption disabled).
+ *
+ * zlat_sample_rate
+ *   one in how many per-cpu cache hits gets its latency recorded
+ *   (see mach_zone_get_latency_info()). Default 1024, 0 to disable.
  */
 static TUNABLE(uint16_t, zc_magazine_size, "zc_mag_size", 8);
 static TUNABLE(uint32_t, zc_auto_threshold, "zc_auto_enable_threshold", 20);
 static TUNABLE(uint32_t, zc_grow_threshold, "zc_grow_threshold", 8);
+static TUNABLE(uint32_t, zc_boost_threshold, "zc_boost_threshold", 32);
 static TUNABLE(uint16_t, zc_recirc_batch, "zc_recirc_batch", 4);
 static TUNABLE(uint32_t, zc_defrag_ratio, "zc_defrag_ratio", 66);
 static TUNABLE(uint32_t, zc_defrag_threshold, "zc_defrag_threshold", 512u << 10);
 static TUNABLE(uint32_t, zc_autogc_ratio, "zc_autogc_ratio", 20);
 static TUNABLE(uint32_t, zc_autogc_threshold, "zc_autogc_threshold", 4u << 20);
 static TUNABLE(uint32_t, zc_free_batch_size, "zc_free_batch_size", 256);
+static TUNABLE(uint16_t, zlat_sample_rate, "zlat_sample_rate", 1024);
+
+/*
+ * Per zone allocation path latency, indexed by zone ID.
+ *
+ * Only slow paths and sampled cache hits record into these,
+ * so relaxed atomics are cheap enough and keep the fast path
+ * free of any shared cacheline.
+ */
+static struct zone_latency_stats {
+	uint64_t                   zls_count[MZL_PATH_COUNT];
+	uint64_t                   zls_total_ns[MZL_PATH_COUNT];
+	uint32_t                   zls_hist[MZL_PATH_COUNT][MACH_ZONE_LATENCY_BUCKETS];
+} zone_latency_stats[MAX_ZONES];
 
 static SECURITY_READ_ONLY_LATE(size_t)    zone_pages_wired_max;
 static SECURITY_READ_ONLY_LATE(vm_map_t)  zone_submaps[Z_SUBMAP_IDX_COUNT];
@@ -2811,6 +2837,7 @@ zone_lock_was_contended(zone_t zone, zone_cache_t zc)
 	}
 
 	zc->zc_depot_max++;
+	zone->z_depot_grows++;
 }
 
 static inline void
@@ -2902,6 +2929,23 @@ zone_submaps_approx_size(void)
 	return size;
 }
 
+static void
+zone_latency_record(zone_t z, uint32_t path, uint64_t start)
+{
+	struct zone_latency_stats *zls = &zone_latency_stats[zone_index(z)];
+	uint32_t bucket = 0;
+	uint64_t ns;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+	if (ns >= 256) {
+		bucket = MIN(63 - __builtin_clzll(ns) - 7,
+		    MACH_ZONE_LATENCY_BUCKETS - 1);
+	}
+	os_atomic_inc(&zls->zls_hist[path][bucket], relaxed);
+	os_atomic_add(&zls->zls_total_ns[path], ns, relaxed);
+	os_atomic_inc(&zls->zls_count[path], relaxed);
+}
+
 static void
 zone_cache_swap_magazines(zone_cache_t cache)
 {
@@ -4683,6 +4727,10 @@ __ZONE_MAP_EXHAUSTED_AND_WAITING_FOR_GC__(zone_t z, uint32_t pgs)
 
 		mapped = os_atomic_load(&zone_pages_wired, relaxed);
 	}
+
+	if (wait_start) {
+		zone_latency_record(z, MZL_PATH_GC_STALL, wait_start);
+	}
 }
 
 static bool
@@ -4706,6 +4754,7 @@ zone_expand_locked(zone_t z, zalloc_flags_t flags, bool (*pred)(zone_t))
 	struct zone_expand ze = {
 		.ze_thread  = current_thread(),
 	};
+	uint64_t expand_start, wait_start;
 
 	if (!(ze.ze_thread->options & TH_OPT_VMPRIV) && zone_supports_vm(z)) {
 		ze.ze_thread->options |= TH_OPT_VMPRIV;
@@ -4757,6 +4806,8 @@ zone_expand_locked(zone_t z, zalloc_flags_t flags, bool (*pred)(zone_t))
 		    TH_UNINT, TIMEOUT_WAIT_FOREVER);
 	}
 
+	expand_start = mach_absolute_time();
+
 	do {
 		struct zone_page_metadata *meta = NULL;
 		uint32_t new_va = 0, cur_pages = 0, min_pages = 0, pages = 0;
@@ -4843,7 +4894,9 @@ zone_expand_locked(zone_t z, zalloc_flags_t flags, bool (*pred)(zone_t))
 				}
 
 				waited++;
+				wait_start = mach_absolute_time();
 				VM_PAGE_WAIT();
+				zone_latency_record(z, MZL_PATH_GC_STALL, wait_start);
 				continue;
 			}
 
@@ -4882,6 +4935,7 @@ zone_expand_locked(zone_t z, zalloc_flags_t flags, bool (*pred)(zone_t))
 	} while (pred(z));
 
 page_shortage:
+	zone_latency_record(z, MZL_PATH_EXPAND, expand_start);
 	if (z->z_expander == &ze) {
 		z->z_expander = ze.ze_next;
 	} else {
@@ -6708,6 +6762,44 @@ zalloc_cached_slow(
 	return zalloc_cached_from_recirc(zone, zstats, flags, cache);
 }
 
+__attribute__((noinline))
+static struct kalloc_result
+zalloc_cached_slow_timed(
+	zone_t                  zone,
+	zone_stats_t            zstats,
+	zalloc_flags_t          flags,
+	zone_cache_t            cache)
+{
+	uint64_t start = mach_absolute_time();
+	struct kalloc_result kr;
+
+	kr = zalloc_cached_slow(zone, zstats, flags, cache);
+	zone_latency_record(zone, MZL_PATH_DEPOT, start);
+	return kr;
+}
+
+__attribute__((noinline))
+static struct kalloc_result
+zalloc_cached_fast_sampled(
+	zone_t                  zone,
+	zone_stats_t            zstats,
+	zalloc_flags_t          flags,
+	zone_cache_t            cache)
+{
+	uint64_t start;
+	struct kalloc_result kr;
+
+	cache->zc_lat_sample = zlat_sample_rate ? zlat_sample_rate - 1 : UINT16_MAX;
+	if (zlat_sample_rate == 0) {
+		return zalloc_cached_fast(zone, zstats, flags, cache, NULL);
+	}
+
+	start = mach_absolute_time();
+	kr = zalloc_cached_fast(zone, zstats, flags, cache, NULL);
+	zone_latency_record(zone, MZL_PATH_CACHE, start);
+	return kr;
+}
+
 /*!
  * @function zalloc_cached
  *
@@ -6731,11 +6823,15 @@ zalloc_cached(zone_t zone, zone_stats_t zstats, zalloc_flags_t flags)
 
 	if (cache->zc_alloc_cur == 0) {
 		if (__improbable(cache->zc_free_cur == 0)) {
-			return zalloc_cached_slow(zone, zstats, flags, cache);
+			return zalloc_cached_slow_timed(zone, zstats, flags, cache);
 		}
 		zone_cache_swap_magazines(cache);
 	}
 
+	if (__improbable(cache->zc_lat_sample-- == 0)) {
+		return zalloc_cached_fast_sampled(zone, zstats, flags, cache);
+	}
+
 	return zalloc_cached_fast(zone, zstats, flags, cache, NULL);
 }
 
@@ -6852,6 +6948,261 @@ void *
 	return kr.addr;
 }
 
+/*
+ * Batched allocations and frees.
+ *
+ * The fast paths move elements between the caller's array and the local
+ * per-cpu magazines (refilling from, or overflowing into, the local depot)
+ * with preemption disabled once for the whole batch.
+ *
+ * Zones whose elements need per-element bookkeeping on the way in or out
+ * (kasan, tbi, tags, logging) always take the single element paths.
+ */
+static inline bool
+zone_batch_fast_path_allowed(zone_t zone)
+{
+#if KASAN_ZALLOC || (CONFIG_KERNEL_TBI && KASAN_TBI)
+	(void)zone;
+	return false;
+#else
+	if (zone->z_pcpu_cache == NULL || zone == zc_magazine_zone) {
+		return false;
+	}
+#if VM_TAG_SIZECLASSES
+	if (zone->z_uses_tags) {
+		return false;
+	}
+#endif /* VM_TAG_SIZECLASSES */
+#if ZONE_ENABLE_LOGGING || CONFIG_ZLEAKS
+	if (zone->z_btlog) {
+		return false;
+	}
+#endif /* ZONE_ENABLE_LOGGING || CONFIG_ZLEAKS */
+	return true;
+#endif /* !KASAN_ZALLOC && !(CONFIG_KERNEL_TBI && KASAN_TBI) */
+}
+
+/*
+ * Load a full magazine from the local depot as the (a) magazine,
+ * queuing the empty one it replaces on @c empty so the caller can
+ * free it once preemption is enabled again.
+ */
+static bool
+zalloc_n_refill_from_depot(
+	zone_t                  zone,
+	zone_cache_t            cache,
+	struct zone_depot      *empty)
+{
+	zone_magazine_t mag;
+
+	if (STAILQ_EMPTY(&cache->zc_depot)) {
+		return false;
+	}
+
+	zone_depot_lock_nopreempt(cache);
+
+	mag = STAILQ_FIRST(&cache->zc_depot);
+	if (mag == NULL) {
+		zone_depot_unlock_nopreempt(cache);
+		return false;
+	}
+
+	STAILQ_REMOVE_HEAD(&cache->zc_depot, zm_link);
+	STAILQ_NEXT(mag, zm_link) = NULL;
+
+	if (cache->zc_depot_cur-- == 0) {
+		zone_accounting_panic(zone, "zc_depot_cur wrap-around");
+	}
+	zone_depot_unlock_nopreempt(cache);
+
+	mag = zone_magazine_replace(&cache->zc_alloc_cur,
+	    &cache->zc_alloc_elems, mag);
+
+	z_debug_assert(cache->zc_alloc_cur == zc_mag_size());
+	z_debug_assert(mag->zm_cur == 0);
+
+	STAILQ_INSERT_TAIL(empty, mag, zm_link);
+	return true;
+}
+
+uint32_t
+(zalloc_n)(
+	union zone_or_view      zov,
+	uint32_t                count,
+	void                  **elems,
+	zalloc_flags_t          flags)
+{
+	zone_t zone = zov.zov_view->zv_zone;
+	zone_stats_t zstats = zov.zov_view->zv_stats;
+	vm_offset_t esize = zone_elem_size(zone);
+	struct zone_depot empty = STAILQ_HEAD_INITIALIZER(empty);
+	zone_cache_t cache;
+	zone_element_t ze;
+	uint32_t n = 0;
+
+	assert(zone > &zone_array[ZONE_ID__LAST_RO]);
+	assert(!zone->z_percpu);
+
+	if (count && zone_batch_fast_path_allowed(zone)) {
+		assertf(startup_phase < STARTUP_SUB_EARLY_BOOT ||
+		    ml_get_interrupts_enabled() ||
+		    ml_is_quiescing() ||
+		    debug_mode_active(),
+		    "Calling zalloc_n from interrupt disabled context isn't allowed");
+#if ZALLOC_ENABLE_ZERO_CHECK
+		if (zalloc_skip_zero_check()) {
+			flags |= Z_NOZZC;
+		}
+#endif
+
+		disable_preemption();
+		cache = zpercpu_get(zone->z_pcpu_cache);
+
+		while (n < count) {
+			if (cache->zc_alloc_cur == 0) {
+				if (cache->zc_free_cur) {
+					zone_cache_swap_magazines(cache);
+				} else if (!zalloc_n_refill_from_depot(zone, cache, &empty)) {
+					break;
+				}
+			}
+
+			while (n < count && cache->zc_alloc_cur) {
+				uint32_t index = --cache->zc_alloc_cur;
+
+				ze = cache->zc_alloc_elems[index];
+				cache->zc_alloc_elems[index].ze_value = 0;
+				elems[n++] = (void *)ze.ze_value;
+			}
+		}
+
+		zpercpu_get(zstats)->zs_mem_allocated += n * esize;
+		enable_preemption();
+
+		if (!STAILQ_EMPTY(&empty)) {
+			zone_magazine_free_list(&empty);
+		}
+
+		for (uint32_t i = 0; i < n; i++) {
+			ze.ze_value = (vm_offset_t)elems[i];
+			if (zone_meta_is_free(zone_meta_from_element(ze), ze)) {
+				zone_meta_double_free_panic(zone, ze, __func__);
+			}
+			elems[i] = zalloc_return(zone, ze, flags, esize).addr;
+		}
+	}
+
+	/*
+	 * Whatever the local caches couldn't provide goes through
+	 * the regular path, which refills them from the recirculation
+	 * depot or the zone.
+	 */
+	for (; n < count; n++) {
+		elems[n] = zalloc_ext(zone, zstats, flags).addr;
+		if (elems[n] == NULL) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+void
+(zfree_n)(
+	union zone_or_view      zov,
+	uint32_t                count,
+	void                  **elems)
+{
+	zone_t zone = zov.zov_view->zv_zone;
+	zone_stats_t zstats = zov.zov_view->zv_stats;
+	vm_offset_t esize = zone_elem_size(zone);
+	struct zone_page_metadata *meta;
+	zone_cache_t cache;
+	zone_element_t ze;
+	vm_size_t freed = 0;
+
+	assert(zone > &zone_array[ZONE_ID__LAST_RO]);
+	assert(!zone->z_percpu);
+
+	if (!zone_batch_fast_path_allowed(zone)) {
+		for (uint32_t i = 0; i < count; i++) {
+			if (elems[i]) {
+				(zfree)(zov, elems[i]);
+				elems[i] = NULL;
+			}
+		}
+		return;
+	}
+
+	/*
+	 * Preflight the whole batch: every element must belong to the zone
+	 * and be allocated, before any of them is handed back to the caches.
+	 */
+	for (uint32_t i = 0; i < count; i++) {
+		vm_offset_t elem = (vm_offset_t)elems[i];
+
+		if (elem == 0) {
+			continue;
+		}
+#if CONFIG_PROB_GZALLOC
+		if (__improbable(pgz_owned(elem))) {
+			(zfree)(zov, elems[i]);
+			elems[i] = NULL;
+			continue;
+		}
+#endif /* CONFIG_PROB_GZALLOC */
+		DTRACE_VM2(zfree, zone_t, zone, void*, elems[i]);
+
+		meta = zone_element_resolve(zone, elem, &ze);
+		if (zone_meta_is_free(meta, ze)) {
+			zone_meta_double_free_panic(zone, ze, __func__);
+		}
+		bzero((void *)elem, esize);
+		elems[i] = (void *)ze.ze_value;
+	}
+
+	disable_preemption();
+	cache = zpercpu_get(zone->z_pcpu_cache);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (elems[i] == NULL) {
+			continue;
+		}
+		ze.ze_value = (vm_offset_t)elems[i];
+		elems[i] = NULL;
+		freed += esize;
+
+		if (__improbable(cache->zc_alloc_elems == NULL) ||
+		    (cache->zc_free_cur >= zc_mag_size() &&
+		    cache->zc_alloc_cur >= zc_mag_size())) {
+			/*
+			 * Both magazines are full: let the single element
+			 * path push one into the depot, then resume
+			 * (possibly on another cpu).
+			 */
+			zpercpu_get(zstats)->zs_mem_freed += freed;
+			freed = 0;
+			meta = zone_meta_from_element(ze);
+			if (cache->zc_alloc_elems == NULL) {
+				zfree_item(zone, meta, ze);
+			} else {
+				zfree_cached_slow(zone, meta, ze, cache);
+			}
+			disable_preemption();
+			cache = zpercpu_get(zone->z_pcpu_cache);
+			continue;
+		}
+
+		if (cache->zc_free_cur >= zc_mag_size()) {
+			zone_cache_swap_magazines(cache);
+		}
+		cache->zc_free_elems[cache->zc_free_cur++] = ze;
+	}
+
+	zpercpu_get(zstats)->zs_mem_freed += freed;
+	enable_preemption();
+}
+
 #if ZSECURITY_CONFIG(READ_ONLY)
 
 __attribute__((always_inline))
@@ -7384,6 +7735,7 @@ zone_reclaim(zone_t z, zone_reclaim_mode_t mode)
 	}
 
 	if (z->z_pcpu_cache) {
+		z->z_depot_shrinks++;
 		if (mode != ZONE_RECLAIM_TRIM) {
 			zpercpu_foreach(zc, z->z_pcpu_cache) {
 				zc->zc_depot_max /= 2;
@@ -7714,10 +8066,63 @@ zone_defrag_async(__unused thread_call_param_t p0, __unused thread_call_param_t
 	}
 }
 
+/*
+ * Grow the per-cpu depots of a zone that has been heavily contended for
+ * two periods by one magazine each, as long as the depots stay within
+ * a tenth of the zone population.
+ */
+static void
+zone_depot_boost_locked(zone_t z)
+{
+	bool grown = false;
+
+	zpercpu_foreach(zc, z->z_pcpu_cache) {
+		if (zc->zc_depot_max + zc_mag_size() >= INT16_MAX) {
+			continue;
+		}
+		if ((zc->zc_depot_max + zc_mag_size()) * zpercpu_count() * 10u >=
+		    z->z_elems_avail) {
+			continue;
+		}
+		zc->zc_depot_max += zc_mag_size();
+		grown = true;
+	}
+	if (grown) {
+		z->z_depot_grows++;
+	}
+}
+
+/*
+ * Lower the per-cpu depots of a quiet zone: gently in the common case,
+ * and by half when the VM is low on free pages, so that idle zones give
+ * their cached elements back to the zone GC sooner.
+ */
+static void
+zone_depot_shrink_locked(zone_t z, bool pressure)
+{
+	bool shrunk = false;
+
+	zpercpu_foreach(zc, z->z_pcpu_cache) {
+		if (zc->zc_depot_max <= zc_mag_size()) {
+			continue;
+		}
+		if (pressure) {
+			zc->zc_depot_max = MAX(zc->zc_depot_max / 2, zc_mag_size());
+		} else {
+			zc->zc_depot_max--;
+		}
+		shrunk = true;
+	}
+	if (shrunk) {
+		z->z_depot_shrinks++;
+	}
+}
+
 void
 compute_zone_working_set_size(__unused void *param)
 {
 	uint32_t zc_auto = zc_auto_threshold;
+	uint32_t zc_boost = zc_boost_threshold;
 	bool kick_defrag = false;
 
 	/*
@@ -7732,6 +8137,9 @@ compute_zone_working_set_size(__unused void *param)
 	if (os_mul_overflow(zc_auto, Z_CONTENTION_WMA_UNIT, &zc_auto)) {
 		zc_auto = 0;
 	}
+	if (os_mul_overflow(zc_boost, Z_CONTENTION_WMA_UNIT, &zc_boost)) {
+		zc_boost = 0;
+	}
 
 	zone_foreach(z) {
 		uint32_t wma;
@@ -7761,15 +8169,17 @@ compute_zone_working_set_size(__unused void *param)
 
 		/*
 		 * If the zone seems to be very quiet,
-		 * gently lower its cpu-local depot size.
+		 * lower its cpu-local depot size.
+		 *
+		 * If it has been contending heavily for two periods,
+		 * grow it faster than zone_lock_was_contended() would.
 		 */
 		if (z->z_pcpu_cache && wma < Z_CONTENTION_WMA_UNIT / 2 &&
 		    z->z_contention_wma < Z_CONTENTION_WMA_UNIT / 2) {
-			zpercpu_foreach(zc, z->z_pcpu_cache) {
-				if (zc->zc_depot_max > zc_mag_size()) {
-					zc->zc_depot_max--;
-				}
-			}
+			zone_depot_shrink_locked(z, zone_caching_disabled);
+		} else if (z->z_pcpu_cache && !zone_caching_disabled && zc_boost &&
+		    wma >= zc_boost && z->z_contention_wma >= zc_boost) {
+			zone_depot_boost_locked(z);
 		}
 
 		/*
@@ -8406,6 +8816,59 @@ mach_zone_info_for_zone(
 	return KERN_FAILURE;
 }
 
+kern_return_t
+mach_zone_get_latency_info(
+	host_priv_t                     host,
+	mach_zone_name_t                name,
+	mach_zone_latency_info_t        *infop)
+{
+	struct zone_latency_stats *zls;
+	zone_t zone_ptr;
+
+	if (host == HOST_NULL) {
+		return KERN_INVALID_HOST;
+	}
+
+#if CONFIG_DEBUGGER_FOR_ZONE_INFO
+	if (!PE_i_can_has_debugger(NULL)) {
+		return KERN_INVALID_HOST;
+	}
+#endif
+
+	if (infop == NULL) {
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	zone_ptr = ZONE_NULL;
+	zone_foreach(z) {
+		char temp_zone_name[MAX_ZONE_NAME] = "";
+		snprintf(temp_zone_name, MAX_ZONE_NAME, "%s%s",
+		    zone_heap_name(z), z->z_name);
+
+		if (track_this_zone(temp_zone_name, name.mzn_name)) {
+			zone_ptr = z;
+			break;
+		}
+	}
+
+	if (zone_ptr == ZONE_NULL) {
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	zls = &zone_latency_stats[zone_index(zone_ptr)];
+	*infop = (mach_zone_latency_info_t){
+		.mzl_sample_rate = zlat_sample_rate,
+	};
+	for (uint32_t path = 0; path < MZL_PATH_COUNT; path++) {
+		infop->mzl_count[path] = os_atomic_load(&zls->zls_count[path], relaxed);
+		infop->mzl_total_ns[path] = os_atomic_load(&zls->zls_total_ns[path], relaxed);
+		for (uint32_t i = 0; i < MACH_ZONE_LATENCY_BUCKETS; i++) {
+			infop->mzl_hist[path][i] = os_atomic_load(&zls->zls_hist[path][i], relaxed);
+		}
+	}
+	return KERN_SUCCESS;
+}
+
 kern_return_t
 mach_zone_info_for_largest_zone(
 	host_priv_t                     host,
@@ -10639,4 +11102,74 @@ zone_alloc_replenish_test(__unused int64_t in, int64_t *out)
 }
 SYSCTL_TEST_REGISTER(zone_alloc_replenish_test, zone_alloc_replenish_test);
 
+/*
+ * Checks zalloc_n()/zfree_n() on a caching zone, and reports (in the
+ * kernel log) how they compare with the zalloc()/zfree() loop they replace.
+ */
+#define ZONE_BATCH_TEST_COUNT   64
+#define ZONE_BATCH_TEST_ROUNDS  1000
+
+static int
+zone_batch_test_run(__unused int64_t in, int64_t *out)
+{
+	void *elems[ZONE_BATCH_TEST_COUNT];
+	uint64_t start, loop_time, batch_time;
+	zone_t z;
+	uint32_t n;
+
+	if (os_atomic_xchg(&any_zone_test_running, true, relaxed)) {
+		printf("zone_batch_test: Test already running.\n");
+		return EALREADY;
+	}
+
+	z = zone_create("test_zone_batch", 64, ZC_DESTRUCTIBLE | ZC_CACHING);
+
+	/* warm up the caches so that both variants run from them */
+	n = zalloc_n(z, ZONE_BATCH_TEST_COUNT, elems, Z_WAITOK | Z_NOFAIL);
+	assert(n == ZONE_BATCH_TEST_COUNT);
+	for (uint32_t i = 0; i < n; i++) {
+		assert(elems[i] != NULL);
+		assert(zone_element_size(elems[i], NULL, false, NULL) >= 64);
+		for (uint32_t j = 0; j < i; j++) {
+			assert(elems[i] != elems[j]);
+		}
+		memset(elems[i], 0xa5, 64);
+	}
+	zfree_n(z, n, elems);
+	for (uint32_t i = 0; i < n; i++) {
+		assert(elems[i] == NULL);
+	}
+
+	start = mach_absolute_time();
+	for (uint32_t r = 0; r < ZONE_BATCH_TEST_ROUNDS; r++) {
+		for (uint32_t i = 0; i < ZONE_BATCH_TEST_COUNT; i++) {
+			elems[i] = zalloc_flags(z, Z_WAITOK | Z_NOFAIL);
+		}
+		for (uint32_t i = 0; i < ZONE_BATCH_TEST_COUNT; i++) {
+			zfree(z, elems[i]);
+		}
+	}
+	loop_time = mach_absolute_time() - start;
+
+	start = mach_absolute_time();
+	for (uint32_t r = 0; r < ZONE_BATCH_TEST_ROUNDS; r++) {
+		n = zalloc_n(z, ZONE_BATCH_TEST_COUNT, elems, Z_WAITOK | Z_NOFAIL);
+		assert(n == ZONE_BATCH_TEST_COUNT);
+		zfree_n(z, n, elems);
+	}
+	batch_time = mach_absolute_time() - start;
+
+	absolutetime_to_nanoseconds(loop_time, &loop_time);
+	absolutetime_to_nanoseconds(batch_time, &batch_time);
+	printf("zone_batch_test: %d x %d elements: loop %lld ns, batch %lld ns\n",
+	    ZONE_BATCH_TEST_ROUNDS, ZONE_BATCH_TEST_COUNT, loop_time, batch_time);
+
+	zdestroy(z);
+
+	*out = 1;
+	os_atomic_store(&any_zone_test_running, false, relaxed);
+	return 0;
+}
+SYSCTL_TEST_REGISTER(zone_batch_test, zone_batch_test_run);
+
 #endif /* DEBUG || DEVELOPMENT */
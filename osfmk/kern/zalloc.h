@@ -1070,6 +1070,55 @@ extern void *__sized_by(size) zalloc_permanent_tag(
 	__unsafe_forge_single(type_t *, \
 	    zalloc_permanent(sizeof(type_t), ZALIGN(type_t)))
 
+/*!
+ * @function zalloc_n()
+ *
+ * @abstract
+ * Allocates several elements from a zone at once.
+ *
+ * @discussion
+ * When the zone has per-cpu caching enabled, the elements are taken
+ * from the local magazines and depot with preemption disabled once,
+ * instead of once per element. Elements that can't be served that way
+ * are allocated one at a time with @c zalloc_flags().
+ *
+ * With @c Z_NOWAIT (or for exhaustible zones), fewer elements than
+ * requested might be returned.
+ *
+ * @param zone_or_view  the zone or zone view to allocate from
+ * @param count         the number of elements to allocate
+ * @param elems         an array of at least @c count pointers to fill
+ * @param flags         a collection of @c zalloc_flags_t.
+ *
+ * @returns             the number of elements allocated into @c elems.
+ */
+extern uint32_t zalloc_n(
+	zone_or_view_t  zone_or_view,
+	uint32_t        count,
+	void          **elems,
+	zalloc_flags_t  flags);
+
+/*!
+ * @function zfree_n()
+ *
+ * @abstract
+ * Frees several elements allocated from the same zone at once.
+ *
+ * @discussion
+ * Every element is validated as belonging to the zone, and not being
+ * already free, before any of them is put back in the per-cpu caches.
+ *
+ * The @c elems array is cleared.
+ *
+ * @param zone_or_view  the zone or zone view to free the elements to.
+ * @param count         the number of elements in @c elems
+ * @param elems         the elements to free
+ */
+extern void zfree_n(
+	zone_or_view_t  zone_or_view,
+	uint32_t        count,
+	void          **elems);
+
 /*!
  * @function zalloc_first_proc_made()
  *
@@ -307,6 +307,10 @@ struct zone {
 	 *
 	 * z_elems_avail:
 	 *   number of elements in the zone (at all).
+	 *
+	 * z_depot_grows, z_depot_shrinks:
+	 *   number of times the per-cpu depots of the zone were resized up/down
+	 *   in response to lock contention, idleness or memory pressure.
 	 */
 #define Z_CONTENTION_WMA_UNIT (1u << 8)
 	uint32_t            z_contention_wma;
@@ -319,6 +323,8 @@ struct zone {
 	uint32_t            z_elems_avail;  /* Number of elements available        */
 	uint32_t            z_elems_rsv;
 	uint32_t            z_array_size_class;
+	uint32_t            z_depot_grows;
+	uint32_t            z_depot_shrinks;
 
 #if KASAN_ZALLOC
 	uint32_t            z_kasan_redzone;
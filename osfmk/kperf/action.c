@@ -53,6 +53,7 @@
 #include <kperf/kptimer.h>
 #include <kperf/pet.h>
 #include <kperf/sample.h>
+#include <kperf/stackagg.h>
 #include <kperf/thread_samplers.h>
 
 #define ACTION_MAX (32)
@@ -145,6 +146,16 @@ kperf_sample_user_internal(struct kperf_usample *sbuf,
 
 	boolean_t intren = ml_set_interrupts_enabled(FALSE);
 
+	if ((sample_what & (SAMPLER_STACK_AGG | SAMPLER_USTACK)) ==
+	    (SAMPLER_STACK_AGG | SAMPLER_USTACK)) {
+		kperf_ucallstack_aggregate(&sbuf->ucallstack, context->cur_pid);
+		sample_what &= ~(SAMPLER_STACK_AGG | SAMPLER_USTACK);
+		if (sample_what == 0) {
+			ml_set_interrupts_enabled(intren);
+			return;
+		}
+	}
+
 	/*
 	 * No userdata or sample_flags for this one.
 	 */
@@ -302,6 +313,19 @@ log_sample:
 		userdata = actionv[actionid - 1].userdata;
 	}
 
+	/* fold the kernel callstack into the aggregation tables */
+	if (sample_what & SAMPLER_STACK_AGG) {
+		if (sample_what & SAMPLER_KSTACK) {
+			boolean_t intren = ml_set_interrupts_enabled(FALSE);
+			kperf_kcallstack_aggregate(&sbuf->kcallstack, context->cur_pid);
+			ml_set_interrupts_enabled(intren);
+		}
+		sample_what &= ~(SAMPLER_STACK_AGG | SAMPLER_KSTACK);
+		if (sample_what == 0) {
+			return SAMPLE_CONTINUE;
+		}
+	}
+
 	/* avoid logging if this sample only pended samples */
 	if (sample_flags & SAMPLE_FLAG_PEND_USER &&
 	    !(sample_what & ~(SAMPLER_USTACK | SAMPLER_TH_DISPATCH))) {
@@ -598,6 +622,10 @@ kperf_action_set_samplers(unsigned actionid, uint32_t samplers)
 		return EINVAL;
 	}
 
+	if (samplers & SAMPLER_STACK_AGG) {
+		kperf_stackagg_setup();
+	}
+
 	actionv[actionid - 1].sample = samplers;
 
 	return 0;
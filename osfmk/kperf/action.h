@@ -54,12 +54,15 @@ extern int kperf_max_actions;
 #define SAMPLER_SYS_MEM       (1U << 11)
 #define SAMPLER_TH_INSCYC     (1U << 12)
 #define SAMPLER_TK_INFO       (1U << 13)
+/* aggregate sampled callstacks in-kernel instead of tracing them */
+#define SAMPLER_STACK_AGG     (1U << 14)
 
 #define SAMPLER_TASK_MASK (SAMPLER_MEMINFO | SAMPLER_TK_SNAPSHOT | \
 	        SAMPLER_TK_INFO)
 #define SAMPLER_THREAD_MASK (SAMPLER_TH_INFO | SAMPLER_TH_SNAPSHOT | \
 	        SAMPLER_KSTACK | SAMPLER_USTACK | SAMPLER_PMC_THREAD | \
-	        SAMPLER_TH_SCHEDULING | SAMPLER_TH_DISPATCH | SAMPLER_TH_INSCYC)
+	        SAMPLER_TH_SCHEDULING | SAMPLER_TH_DISPATCH | SAMPLER_TH_INSCYC | \
+	        SAMPLER_STACK_AGG)
 
 /* flags for sample calls */
 
@@ -37,6 +37,7 @@
 #include <kperf/context.h>
 #include <kperf/callstack.h>
 #include <kperf/ast.h>
+#include <kperf/stackagg.h>
 #include <sys/errno.h>
 
 #if defined(__arm64__)
@@ -446,6 +447,43 @@ kperf_ucallstack_log(struct kp_ucallstack *cs)
 	    cs->kpuc_async_index, cs->kpuc_async_nframes);
 }
 
+void
+kperf_kcallstack_aggregate(struct kp_kcallstack *cs, int pid)
+{
+	uint64_t frames[KPERF_STACKAGG_MAX_FRAMES];
+	unsigned int nframes = MIN(cs->kpkc_nframes, KPERF_STACKAGG_MAX_FRAMES);
+
+	if (!(cs->kpkc_flags & CALLSTACK_VALID)) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < nframes; i++) {
+		if (cs->kpkc_flags & CALLSTACK_KERNEL_WORDS) {
+			frames[i] = scrub_word(cs->kpkc_word_frames, nframes, i, true);
+		} else {
+			frames[i] = scrub_frame(cs->kpkc_frames, nframes, i);
+		}
+	}
+	kperf_stackagg_add(pid, cs->kpkc_flags, frames, cs->kpkc_nframes);
+}
+
+void
+kperf_ucallstack_aggregate(struct kp_ucallstack *cs, int pid)
+{
+	uint64_t frames[KPERF_STACKAGG_MAX_FRAMES];
+	unsigned int nframes = MIN(cs->kpuc_nframes, KPERF_STACKAGG_MAX_FRAMES);
+
+	if (!(cs->kpuc_flags & CALLSTACK_VALID)) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < nframes; i++) {
+		frames[i] = cs->kpuc_frames[i];
+	}
+	kperf_stackagg_add(pid, cs->kpuc_flags & ~CALLSTACK_HAS_ASYNC, frames,
+	    cs->kpuc_nframes);
+}
+
 int
 kperf_ucallstack_pend(struct kperf_context * context, uint32_t depth,
     unsigned int actionid)
@@ -82,4 +82,7 @@ int kperf_ucallstack_pend(struct kperf_context *, uint32_t depth,
     unsigned int actionid);
 void kperf_ucallstack_log(struct kp_ucallstack *cs);
 
+void kperf_kcallstack_aggregate(struct kp_kcallstack *cs, int pid);
+void kperf_ucallstack_aggregate(struct kp_ucallstack *cs, int pid);
+
 #endif /* !defined(KPERF_CALLSTACK_H) */
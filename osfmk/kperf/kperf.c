@@ -42,6 +42,7 @@
 #include <kperf/lazy.h>
 #include <kperf/pet.h>
 #include <kperf/sample.h>
+#include <kperf/stackagg.h>
 
 /* from libkern/libkern.h */
 extern uint64_t strtouq(const char *, char **, int);
@@ -122,6 +123,7 @@ kperf_reset(void)
 	kperf_kdebug_reset();
 	kptimer_reset();
 	kppet_reset();
+	kperf_stackagg_reset();
 
 	/*
 	 * Most of the other systems call into actions, so reset them last.
@@ -45,6 +45,7 @@
 #include <kperf/kptimer.h>
 #include <kperf/pet.h>
 #include <kperf/lazy.h>
+#include <kperf/stackagg.h>
 
 #include <sys/ktrace.h>
 
@@ -81,6 +82,9 @@ enum kperf_request {
 	REQ_LAZY_WAIT_ACTION,
 	REQ_LAZY_CPU_TIME_THRESHOLD,
 	REQ_LAZY_CPU_ACTION,
+
+	REQ_STACKAGG_DRAIN,
+	REQ_STACKAGG_DROPPED,
 };
 
 int kperf_debug_level = 0;
@@ -473,6 +477,32 @@ sysctl_lazy_cpu_action(struct sysctl_req *req)
 	           kperf_lazy_set_cpu_action);
 }
 
+static int
+sysctl_stackagg_drain(struct sysctl_req *req)
+{
+	size_t size = 0;
+	int error;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+	if (req->oldptr == USER_ADDR_NULL) {
+		req->oldidx = kperf_stackagg_drain_size();
+		return 0;
+	}
+
+	error = kperf_stackagg_drain(req->oldptr, req->oldlen, &size);
+	req->oldidx = size;
+	return error;
+}
+
+static int
+sysctl_stackagg_dropped(struct sysctl_req *req)
+{
+	uint64_t dropped = kperf_stackagg_get_dropped();
+	return SYSCTL_OUT(req, &dropped, sizeof(dropped));
+}
+
 static int
 kperf_sysctl SYSCTL_HANDLER_ARGS
 {
@@ -565,6 +595,12 @@ kperf_sysctl SYSCTL_HANDLER_ARGS
 	case REQ_LAZY_CPU_ACTION:
 		ret = sysctl_lazy_cpu_action(req);
 		break;
+	case REQ_STACKAGG_DRAIN:
+		ret = sysctl_stackagg_drain(req);
+		break;
+	case REQ_STACKAGG_DROPPED:
+		ret = sysctl_stackagg_dropped(req);
+		break;
 	default:
 		ret = ENOENT;
 		break;
@@ -744,6 +780,23 @@ SYSCTL_PROC(_kperf_lazy, OID_AUTO, cpu_action,
     sizeof(uint64_t), kperf_sysctl, "UQ",
     "Which action to fire for lazy CPU samples");
 
+/* stack aggregation */
+
+SYSCTL_NODE(_kperf, OID_AUTO, stackagg, CTLFLAG_RW | CTLFLAG_LOCKED, 0,
+    "stackagg");
+
+SYSCTL_PROC(_kperf_stackagg, OID_AUTO, drain,
+    CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_MASKED | CTLFLAG_LOCKED,
+    (void *)REQ_STACKAGG_DRAIN,
+    0, kperf_sysctl, "S,kperf_stackagg_entry",
+    "Read and clear the aggregated callstacks of all CPUs");
+
+SYSCTL_PROC(_kperf_stackagg, OID_AUTO, dropped,
+    CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_MASKED | CTLFLAG_LOCKED,
+    (void *)REQ_STACKAGG_DROPPED,
+    sizeof(uint64_t), kperf_sysctl, "UQ",
+    "Number of samples that did not fit in the aggregation tables");
+
 /* misc */
 
 SYSCTL_PROC(_kperf, OID_AUTO, sampling,
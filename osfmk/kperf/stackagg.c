@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <kern/cpu_number.h>
+#include <kern/kalloc.h>
+#include <kern/misc_protos.h>
+#include <kern/processor.h>
+#include <libkern/libkern.h>
+#include <machine/atomic.h>
+#include <machine/machine_cpu.h>
+#include <machine/machine_routines.h>
+#include <os/hash.h>
+#include <sys/errno.h>
+
+#include <kperf/callstack.h>
+#include <kperf/stackagg.h>
+
+/* how many slots to probe before giving up on inserting a new stack */
+#define KPERF_STACKAGG_PROBES (8)
+
+/*
+ * Each CPU owns two tables: samples on that CPU insert into the active one
+ * with interrupts disabled, while a drain flips the active table and reads
+ * the other one.  The busy flag lets the drain wait out an insertion that
+ * raced with the flip.
+ */
+struct kperf_stackagg_cpu {
+	uint32_t ksc_active;
+	bool     ksc_busy;
+	uint64_t ksc_dropped;
+	struct kperf_stackagg_entry ksc_tables[2][KPERF_STACKAGG_ENTRIES];
+};
+
+static struct kperf_stackagg_cpu *kperf_stackagg_cpus[MAX_CPUS];
+static bool kperf_stackagg_is_setup = false;
+
+void
+kperf_stackagg_setup(void)
+{
+	if (kperf_stackagg_is_setup) {
+		return;
+	}
+
+	/*
+	 * The tables are never freed, so samples in flight on other CPUs never
+	 * see them go away.
+	 */
+	for (int i = 0; i <= ml_get_max_cpu_number(); i++) {
+		kperf_stackagg_cpus[i] = kalloc_type(struct kperf_stackagg_cpu,
+		    Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	}
+	os_atomic_store(&kperf_stackagg_is_setup, true, release);
+}
+
+void
+kperf_stackagg_add(int pid, uint32_t flags, const uint64_t *frames,
+    unsigned int nframes)
+{
+	assert(ml_get_interrupts_enabled() == FALSE);
+
+	if (!os_atomic_load(&kperf_stackagg_is_setup, acquire) || nframes == 0) {
+		return;
+	}
+
+	struct kperf_stackagg_cpu *ksc = kperf_stackagg_cpus[cpu_number()];
+	if (nframes > KPERF_STACKAGG_MAX_FRAMES) {
+		nframes = KPERF_STACKAGG_MAX_FRAMES;
+		flags |= CALLSTACK_TRUNCATED;
+	}
+
+	uint32_t hash = os_hash_jenkins(frames, nframes * sizeof(frames[0]));
+	hash = os_hash_jenkins_update(&pid, sizeof(pid), hash);
+	hash = os_hash_jenkins_finish(hash);
+
+	os_atomic_store(&ksc->ksc_busy, true, seq_cst);
+	struct kperf_stackagg_entry *table =
+	    ksc->ksc_tables[os_atomic_load(&ksc->ksc_active, seq_cst)];
+
+	for (unsigned int i = 0; i < KPERF_STACKAGG_PROBES; i++) {
+		struct kperf_stackagg_entry *kse =
+		    &table[(hash + i) % KPERF_STACKAGG_ENTRIES];
+
+		if (kse->kse_count == 0) {
+			kse->kse_count = 1;
+			kse->kse_pid = pid;
+			kse->kse_flags = flags;
+			kse->kse_nframes = nframes;
+			kse->kse_hash = hash;
+			memcpy(kse->kse_frames, frames, nframes * sizeof(frames[0]));
+			goto out;
+		}
+		if (kse->kse_hash == hash && kse->kse_pid == pid &&
+		    kse->kse_nframes == nframes &&
+		    memcmp(kse->kse_frames, frames, nframes * sizeof(frames[0])) == 0) {
+			kse->kse_count++;
+			goto out;
+		}
+	}
+	ksc->ksc_dropped++;
+
+out:
+	os_atomic_store(&ksc->ksc_busy, false, release);
+}
+
+/*
+ * Flip the CPU's active table and return the one that was active, after any
+ * insertion into it has finished.
+ */
+static struct kperf_stackagg_entry *
+kperf_stackagg_retire(struct kperf_stackagg_cpu *ksc)
+{
+	uint32_t retired = os_atomic_load(&ksc->ksc_active, relaxed);
+
+	os_atomic_store(&ksc->ksc_active, retired ^ 1, seq_cst);
+	while (os_atomic_load(&ksc->ksc_busy, seq_cst)) {
+		cpu_pause();
+	}
+
+	return ksc->ksc_tables[retired];
+}
+
+size_t
+kperf_stackagg_drain_size(void)
+{
+	if (!kperf_stackagg_is_setup) {
+		return 0;
+	}
+	return (size_t)(ml_get_max_cpu_number() + 1) * KPERF_STACKAGG_ENTRIES *
+	       sizeof(struct kperf_stackagg_entry);
+}
+
+/*
+ * Copy out and clear the aggregated stacks of every CPU.  Callers are
+ * serialized by the ktrace lock.
+ */
+int
+kperf_stackagg_drain(user_addr_t uaddr, size_t size, size_t *size_out)
+{
+	size_t copied = 0;
+	int error = 0;
+
+	*size_out = 0;
+	if (!kperf_stackagg_is_setup) {
+		return 0;
+	}
+
+	for (int i = 0; i <= ml_get_max_cpu_number(); i++) {
+		struct kperf_stackagg_entry *table =
+		    kperf_stackagg_retire(kperf_stackagg_cpus[i]);
+
+		for (unsigned int j = 0; j < KPERF_STACKAGG_ENTRIES; j++) {
+			if (table[j].kse_count == 0) {
+				continue;
+			}
+			if (error == 0 && copied + sizeof(table[j]) <= size) {
+				error = copyout(&table[j], uaddr + copied, sizeof(table[j]));
+				copied += sizeof(table[j]);
+			} else if (error == 0) {
+				error = ENOMEM;
+			}
+		}
+		bzero(table, sizeof(struct kperf_stackagg_entry) * KPERF_STACKAGG_ENTRIES);
+	}
+
+	*size_out = copied;
+	return error;
+}
+
+uint64_t
+kperf_stackagg_get_dropped(void)
+{
+	uint64_t dropped = 0;
+
+	if (!kperf_stackagg_is_setup) {
+		return 0;
+	}
+	for (int i = 0; i <= ml_get_max_cpu_number(); i++) {
+		dropped += os_atomic_load(&kperf_stackagg_cpus[i]->ksc_dropped, relaxed);
+	}
+	return dropped;
+}
+
+void
+kperf_stackagg_reset(void)
+{
+	if (!kperf_stackagg_is_setup) {
+		return;
+	}
+	for (int i = 0; i <= ml_get_max_cpu_number(); i++) {
+		struct kperf_stackagg_cpu *ksc = kperf_stackagg_cpus[i];
+
+		bzero(kperf_stackagg_retire(ksc),
+		    sizeof(struct kperf_stackagg_entry) * KPERF_STACKAGG_ENTRIES);
+		bzero(kperf_stackagg_retire(ksc),
+		    sizeof(struct kperf_stackagg_entry) * KPERF_STACKAGG_ENTRIES);
+		os_atomic_store(&ksc->ksc_dropped, 0, relaxed);
+	}
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef KPERF_STACKAGG_H
+#define KPERF_STACKAGG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <mach/mach_types.h>
+
+/*
+ * In-kernel callstack aggregation.
+ *
+ * Actions with SAMPLER_STACK_AGG fold their callstacks into per-CPU tables
+ * of unique stacks and hit counts instead of emitting them to the trace
+ * buffer.  The tables are drained through the kperf.stackagg.drain sysctl.
+ */
+
+#define KPERF_STACKAGG_MAX_FRAMES (32)
+#define KPERF_STACKAGG_ENTRIES    (128)
+
+struct kperf_stackagg_entry {
+	uint64_t kse_count;
+	int32_t  kse_pid;
+	uint32_t kse_flags;     /* CALLSTACK_* flags of the aggregated stack */
+	uint32_t kse_nframes;
+	uint32_t kse_hash;
+	uint64_t kse_frames[KPERF_STACKAGG_MAX_FRAMES];
+};
+
+void kperf_stackagg_setup(void);
+void kperf_stackagg_reset(void);
+void kperf_stackagg_add(int pid, uint32_t flags, const uint64_t *frames,
+    unsigned int nframes);
+int kperf_stackagg_drain(user_addr_t uaddr, size_t size, size_t *size_out);
+size_t kperf_stackagg_drain_size(void);
+uint64_t kperf_stackagg_get_dropped(void);
+
+#endif /* !defined(KPERF_STACKAGG_H) */
@@ -139,6 +139,7 @@ struct coalition_resource_usage {
 	uint64_t pm_writes;
 	uint64_t cpu_pinstructions;
 	uint64_t cpu_pcycles;
+	uint64_t memory_bytes;
 };
 
 #ifdef PRIVATE
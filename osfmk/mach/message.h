@@ -579,6 +579,22 @@ typedef struct {
 	uint32_t                msgdh_reserved; /* For future */
 } mach_msg_aux_header_t;
 
+/*
+ * mach msg2 batches: with MACH64_MSG_BATCH, the data argument points to an
+ * array of entries. Sends use the first send count entries, receives use
+ * the following receive count entries, and each entry gets its own result.
+ */
+#define MACH_MSG_BATCH_MAX_COUNT 64
+
+typedef struct {
+	/* a mach_msg_header_t* to send from or receive into */
+	mach_vm_address_t               mbe_msg;
+	/* send size, or receive buffer size */
+	mach_msg_size_t                 mbe_size;
+	/* (out) result of this send or receive */
+	mach_msg_return_t               mbe_return;
+} mach_msg_batch_entry_t;
+
 #endif /* PRIVATE */
 
 #define msgh_reserved                 msgh_voucher_port
@@ -985,6 +1001,8 @@ __options_decl(mach_msg_option64_t, uint64_t, {
 	MACH64_SEND_MQ_CALL                    = 0x0000000400000000ull,
 	/* This message destination is unknown. Used by old simulators only. */
 	MACH64_SEND_ANY                        = 0x0000000800000000ull,
+	/* Send and/or receive a batch of messages described by mach_msg_batch_entry_t */
+	MACH64_MSG_BATCH                       = 0x0000001000000000ull,
 
 #ifdef XNU_KERNEL_PRIVATE
 	/*
@@ -1058,14 +1076,15 @@ __options_decl(mach_msg_option64_t, uint64_t, {
 #define MACH64_MSG_OPTION_CFI_MASK (MACH64_SEND_KOBJECT_CALL | MACH64_SEND_MQ_CALL | \
 	        MACH64_SEND_ANY)
 
-#define MACH64_RCV_USER          (MACH_RCV_USER | MACH64_MSG_VECTOR)
+#define MACH64_RCV_USER          (MACH_RCV_USER | MACH64_MSG_VECTOR | \
+	        MACH64_MSG_BATCH)
 
 #define MACH_MSG_OPTION_USER     (MACH_SEND_USER | MACH_RCV_USER)
 
 #define MACH64_MSG_OPTION_USER   (MACH64_SEND_USER | MACH64_RCV_USER)
 
 #define MACH64_SEND_USER (MACH_SEND_USER | MACH64_MSG_VECTOR | \
-	        MACH64_MSG_OPTION_CFI_MASK)
+	        MACH64_MSG_BATCH | MACH64_MSG_OPTION_CFI_MASK)
 
 /* The options implemented by the library interface to mach_msg et. al. */
 #define MACH_MSG_OPTION_LIB      (MACH_SEND_INTERRUPT | MACH_RCV_INTERRUPT)
@@ -1371,6 +1390,38 @@ mach_msg2(
 	           MACH_MSG2_SHIFT_ARGS(rcv_size, priority), timeout);
 #undef MACH_MSG2_SHIFT_ARGS
 }
+
+/*
+ * Sends the first send_count entries, then receives up to rcv_count messages
+ * from rcv_name into the entries that follow. Only the first receive waits
+ * (subject to timeout); the others take what is already queued, and entries
+ * left unfilled report MACH_RCV_TIMED_OUT. A failed send does not stop the
+ * batch and is only reported in its entry, except for an interrupted send:
+ * it and the remaining entries report MACH_SEND_INTERRUPTED, were not sent,
+ * and no receive is attempted. Interrupted receives aren't restarted either.
+ */
+__API_AVAILABLE(macos(13.0), ios(16.0), tvos(16.0), watchos(9.0))
+__IOS_PROHIBITED __WATCHOS_PROHIBITED __TVOS_PROHIBITED
+static inline mach_msg_return_t
+mach_msg2_batch(
+	mach_msg_batch_entry_t *entries,
+	mach_msg_option64_t option64,
+	mach_msg_size_t send_count,
+	mach_msg_size_t rcv_count,
+	mach_port_t rcv_name,
+	uint64_t timeout,
+	uint32_t priority)
+{
+	/* restarting would redo the whole batch */
+	option64 |= MACH64_MSG_BATCH | MACH64_SEND_INTERRUPT | MACH64_RCV_INTERRUPT;
+
+#define MACH_MSG2_SHIFT_ARGS(lo, hi) ((uint64_t)hi << 32 | (uint32_t)lo)
+	return mach_msg2_internal(entries, option64,
+	           MACH_MSG2_SHIFT_ARGS(0, send_count), 0, 0,
+	           MACH_MSG2_SHIFT_ARGS(0, rcv_name),
+	           MACH_MSG2_SHIFT_ARGS(rcv_count, priority), timeout);
+#undef MACH_MSG2_SHIFT_ARGS
+}
 #endif
 #endif /* PRIVATE */
 
@@ -142,6 +142,30 @@ typedef struct mach_vm_range {
 	mach_vm_offset_t        max_address;
 } *mach_vm_range_t;
 
+/*!
+ * @typedef
+ *
+ * @brief
+ * One operation of a mach_vm_range_apply() batch.
+ *
+ * @discussion
+ * @c op is one of the @c MACH_VM_RANGE_OP_* values; @c arg is the new
+ * protection for @c MACH_VM_RANGE_OP_PROTECT, and the @c vm_behavior_t for
+ * @c MACH_VM_RANGE_OP_BEHAVIOR.
+ */
+typedef struct mach_vm_range_op {
+	mach_vm_offset_t        address;
+	mach_vm_size_t          size;
+	uint32_t                op;
+	int32_t                 arg;
+} *mach_vm_range_op_t;
+
+#define MACH_VM_RANGE_OP_DEALLOCATE     1
+#define MACH_VM_RANGE_OP_PROTECT        2
+#define MACH_VM_RANGE_OP_BEHAVIOR       3
+
+#define MACH_VM_RANGE_OP_MAX_COUNT      1024
+
 
 #ifdef XNU_KERNEL_PRIVATE
 
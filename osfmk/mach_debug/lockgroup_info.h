@@ -71,4 +71,37 @@ typedef struct lockgroup_info {
 
 typedef lockgroup_info_t *lockgroup_info_array_t;
 
+/*
+ * Sampled contention profiles, exported through the kern.lock_prof_groups
+ * and kern.lock_prof_sites sysctls when kern.lock_prof_sample is non zero.
+ *
+ * Histogram bucket 0 counts samples under 256ns, bucket n counts samples
+ * in [2^(n+7), 2^(n+8)) ns, and the last bucket everything above.
+ */
+#define LOCKPROF_TYPE_MTX       0
+#define LOCKPROF_TYPE_RW        1
+#define LOCKPROF_NTYPES         2
+
+#define LOCKPROF_NBUCKETS       24
+#define LOCKPROF_BUCKET_SHIFT   8
+
+typedef struct lockgroup_prof_info {
+	char            lockgroup_name[LOCKGROUP_MAX_NAME];
+	uint64_t        lockprof_samples[LOCKPROF_NTYPES];
+	uint32_t        lockprof_spin[LOCKPROF_NTYPES][LOCKPROF_NBUCKETS];
+	uint32_t        lockprof_block[LOCKPROF_NTYPES][LOCKPROF_NBUCKETS];
+	uint32_t        lockprof_hold[LOCKPROF_NTYPES][LOCKPROF_NBUCKETS];
+} lockgroup_prof_info_t;
+
+#define LOCKPROF_SITE_DEPTH     8
+
+typedef struct lockprof_site {
+	uint16_t        lockprof_group;         /* index in kern.lock_prof_groups */
+	uint16_t        lockprof_type;          /* LOCKPROF_TYPE_* */
+	uint32_t        lockprof_count;
+	uint64_t        lockprof_wait_total;    /* ns */
+	uint64_t        lockprof_wait_max;      /* ns */
+	uint64_t        lockprof_bt[LOCKPROF_SITE_DEPTH]; /* unslid */
+} lockprof_site_t;
+
 #endif  /* _MACH_DEBUG_LOCKGROUP_INFO_H_ */
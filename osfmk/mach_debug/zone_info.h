@@ -131,6 +131,30 @@ typedef mach_zone_info_t *mach_zone_info_array_t;
 #define SET_MZI_COLLECTABLE_FLAG(val, flag)             \
 	(val) = (flag) ? ((val) | 1) : (val)
 
+/*
+ * Allocation path latency of a zone, returned by mach_zone_get_latency_info().
+ *
+ * mzl_hist[path][0] counts events that took less than 256ns, bucket i
+ * those in [2^(i+7), 2^(i+8)) ns, and the last bucket everything slower.
+ * Cache hits are sampled, one allocation in mzl_sample_rate on each CPU;
+ * the other paths are all counted. Time spent expanding the zone or
+ * stalled is also part of the depot refill that triggered it.
+ */
+#define MACH_ZONE_LATENCY_BUCKETS       20
+
+#define MZL_PATH_CACHE                  0       /* served by the per-CPU cache */
+#define MZL_PATH_DEPOT                  1       /* per-CPU cache refilled from a depot or the zone */
+#define MZL_PATH_EXPAND                 2       /* zone grown with new VA and pages */
+#define MZL_PATH_GC_STALL               3       /* waited on the GC thread or for free pages */
+#define MZL_PATH_COUNT                  4
+
+typedef struct mach_zone_latency_info {
+	uint64_t        mzl_sample_rate;        /* cache hits: one sampled every n */
+	uint64_t        mzl_count[MZL_PATH_COUNT];
+	uint64_t        mzl_total_ns[MZL_PATH_COUNT];
+	uint64_t        mzl_hist[MZL_PATH_COUNT][MACH_ZONE_LATENCY_BUCKETS];
+} mach_zone_latency_info_t;
+
 typedef struct task_zone_info_data {
 	uint64_t        tzi_count;      /* count of elements in use */
 	uint64_t        tzi_cur_size;   /* current memory utilization */
@@ -102,6 +102,7 @@ extern kern_return_t arm64_ropjop_test(void);
 #endif /* __arm64__ */
 
 extern kern_return_t test_thread_call(void);
+extern kern_return_t lck_rw_rbias_test(void);
 
 
 struct xnupost_panic_widget xt_panic_widgets = {.xtp_context_p = NULL,
@@ -132,6 +133,7 @@ struct xnupost_test kernel_post_tests[] = {XNUPOST_TEST_CONFIG_BASIC(zalloc_test
 	                                   XNUPOST_TEST_CONFIG_BASIC(bitmap_post_test),
 	                                   //XNUPOST_TEST_CONFIG_TEST_PANIC(kcdata_api_assert_tests)
 	                                   XNUPOST_TEST_CONFIG_BASIC(test_thread_call),
+	                                   XNUPOST_TEST_CONFIG_BASIC(lck_rw_rbias_test),
 	                                   XNUPOST_TEST_CONFIG_BASIC(ts_kernel_primitive_test),
 	                                   XNUPOST_TEST_CONFIG_BASIC(ts_kernel_sleep_inheritor_test),
 	                                   XNUPOST_TEST_CONFIG_BASIC(ts_kernel_gate_test),
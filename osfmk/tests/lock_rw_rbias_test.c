@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#if !(DEVELOPMENT || DEBUG)
+#error "Testing is not enabled on RELEASE configurations"
+#endif
+
+#include <tests/xnupost.h>
+#include <kern/locks.h>
+#include <kern/processor.h>
+#include <kern/sched_prim.h>
+#include <kern/thread.h>
+#include <kern/clock.h>
+#include <kern/kalloc.h>
+
+kern_return_t lck_rw_rbias_test(void);
+
+LCK_GRP_DECLARE(rbias_test_plain_grp, "rw_rbias_test_plain");
+LCK_GRP_DECLARE_ATTR(rbias_test_biased_grp, "rw_rbias_test_biased", LCK_GRP_ATTR_RW_BIASED);
+
+#define RBIAS_BENCH_ITERATIONS  100000
+#define RBIAS_BENCH_MAX_THREADS 64
+
+struct rbias_bench {
+	lck_rw_t        rb_lock;
+	uint32_t        rb_write_interval;      /* 0 for read only */
+	int             rb_ready;
+	int             rb_go;
+	int             rb_done;
+	uint32_t        rb_in_write;            /* set while a writer holds the lock */
+	uint32_t        rb_violations;
+	uint64_t        rb_ticks;
+};
+
+static void
+rbias_wait(int *var, int value)
+{
+	while (os_atomic_load(var, acquire) != value) {
+		assert_wait((event_t)var, THREAD_UNINT);
+		if (os_atomic_load(var, acquire) != value) {
+			(void) thread_block(THREAD_CONTINUE_NULL);
+		} else {
+			clear_wait(current_thread(), THREAD_AWAKENED);
+		}
+	}
+}
+
+static void
+rbias_signal(int *var)
+{
+	os_atomic_inc(var, relaxed);
+	thread_wakeup((event_t)var);
+}
+
+static void
+rbias_bench_thread(void *arg, __unused wait_result_t wr)
+{
+	struct rbias_bench *rb = arg;
+	uint64_t start;
+
+	rbias_signal(&rb->rb_ready);
+	rbias_wait(&rb->rb_go, 1);
+
+	start = mach_absolute_time();
+	for (uint32_t i = 0; i < RBIAS_BENCH_ITERATIONS; i++) {
+		if (rb->rb_write_interval && (i % rb->rb_write_interval) == 0) {
+			lck_rw_lock_exclusive(&rb->rb_lock);
+			os_atomic_store(&rb->rb_in_write, 1, relaxed);
+			os_atomic_store(&rb->rb_in_write, 0, relaxed);
+			lck_rw_unlock_exclusive(&rb->rb_lock);
+			continue;
+		}
+		lck_rw_lock_shared(&rb->rb_lock);
+		if (os_atomic_load(&rb->rb_in_write, relaxed)) {
+			os_atomic_inc(&rb->rb_violations, relaxed);
+		}
+		lck_rw_unlock_shared(&rb->rb_lock);
+	}
+	os_atomic_add(&rb->rb_ticks, mach_absolute_time() - start, relaxed);
+
+	rbias_signal(&rb->rb_done);
+	thread_terminate_self();
+}
+
+static uint64_t
+rbias_bench_run(lck_grp_t *grp, uint32_t write_interval, int nthreads)
+{
+	struct rbias_bench *rb;
+	thread_t thread;
+	kern_return_t kr;
+	uint64_t ns;
+
+	rb = kalloc_type(struct rbias_bench, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	lck_rw_init(&rb->rb_lock, grp, LCK_ATTR_NULL);
+	rb->rb_write_interval = write_interval;
+
+	for (int i = 0; i < nthreads; i++) {
+		kr = kernel_thread_start((thread_continue_t)rbias_bench_thread, rb, &thread);
+		T_QUIET; T_ASSERT_EQ_INT(kr, KERN_SUCCESS, "start benchmark thread %d", i);
+		thread_deallocate(thread);
+	}
+	rbias_wait(&rb->rb_ready, nthreads);
+	rbias_signal(&rb->rb_go);
+	rbias_wait(&rb->rb_done, nthreads);
+
+	T_ASSERT_EQ_UINT(rb->rb_violations, 0, "no reader overlapped a writer");
+
+	absolutetime_to_nanoseconds(rb->rb_ticks, &ns);
+	ns /= (uint64_t)nthreads * RBIAS_BENCH_ITERATIONS;
+
+	lck_rw_destroy(&rb->rb_lock, grp);
+	kfree_type(struct rbias_bench, rb);
+	return ns;
+}
+
+static void
+rbias_functional_test(void)
+{
+	lck_rw_t lock;
+
+	lck_rw_init(&lock, &rbias_test_biased_grp, LCK_ATTR_NULL);
+	if (!lock.lck_rw_rbias_ok) {
+		T_LOG("reader bias disabled by boot-arg, skipping functional checks");
+		lck_rw_destroy(&lock, &rbias_test_biased_grp);
+		return;
+	}
+	T_ASSERT(lock.lck_rw_rbias, "biased locks start with the bias on");
+
+	lck_rw_lock_shared(&lock);
+	T_ASSERT_EQ_INT(lock.lck_rw_shared_count, 0, "biased reader is not counted");
+	lck_rw_assert(&lock, LCK_RW_ASSERT_SHARED);
+	T_ASSERT(!lck_rw_try_lock_exclusive(&lock), "try-lock exclusive fails against a biased reader");
+	T_ASSERT(lock.lck_rw_rbias, "failed try-lock leaves the bias on");
+	lck_rw_unlock_shared(&lock);
+
+	lck_rw_lock_exclusive(&lock);
+	T_ASSERT(!lock.lck_rw_rbias, "writer revoked the bias");
+	lck_rw_unlock_exclusive(&lock);
+
+	lck_rw_lock_shared(&lock);
+	T_ASSERT_EQ_INT(lock.lck_rw_shared_count, 1, "reader is counted right after a revocation");
+	lck_rw_unlock_shared(&lock);
+
+	/* once the inhibition period is over, the next reader turns the bias back on */
+	delay_for_interval(10, NSEC_PER_MSEC);
+	lck_rw_lock_shared(&lock);
+	lck_rw_unlock_shared(&lock);
+	T_ASSERT(lock.lck_rw_rbias, "bias restored after the inhibition period");
+
+	lck_rw_lock_shared(&lock);
+	T_ASSERT_EQ_INT(lock.lck_rw_shared_count, 0, "biased reader is not counted");
+	T_ASSERT(lck_rw_lock_shared_to_exclusive(&lock), "biased reader can upgrade");
+	lck_rw_assert(&lock, LCK_RW_ASSERT_EXCLUSIVE);
+	lck_rw_unlock_exclusive(&lock);
+
+	lck_rw_destroy(&lock, &rbias_test_biased_grp);
+}
+
+kern_return_t
+lck_rw_rbias_test(void)
+{
+	int nthreads = (int)MIN(processor_avail_count, RBIAS_BENCH_MAX_THREADS);
+	uint32_t intervals[] = { 0, 1000, 100 };
+	uint64_t plain_ns, biased_ns;
+
+	rbias_functional_test();
+
+	for (uint32_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+		plain_ns = rbias_bench_run(&rbias_test_plain_grp, intervals[i], nthreads);
+		biased_ns = rbias_bench_run(&rbias_test_biased_grp, intervals[i], nthreads);
+		T_LOG("{PERFORMANCE} threads: %d, write interval: %u, plain: %llu ns/op, biased: %llu ns/op",
+		    nthreads, intervals[i], plain_ns, biased_ns);
+	}
+
+	return KERN_SUCCESS;
+}
@@ -516,6 +516,23 @@ vnode_pager_get_isSSD(
 	return KERN_SUCCESS;
 }
 
+kern_return_t
+vnode_pager_get_object_mount_id(
+	memory_object_t         mem_obj,
+	uint32_t                *mount_id)
+{
+	vnode_pager_t   vnode_object;
+
+	if (mem_obj->mo_pager_ops != &vnode_pager_ops) {
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	vnode_object = vnode_pager_lookup(mem_obj);
+
+	*mount_id = vnode_pager_get_mount_id(vnode_object->vnode_handle);
+	return KERN_SUCCESS;
+}
+
 kern_return_t
 vnode_pager_get_object_size(
 	memory_object_t         mem_obj,
@@ -357,6 +357,9 @@ lz4_encode_2gb(uint8_t ** dst_ptr,
 EXPAND_FORWARD:
 
 		// Expand match forward
+#if LZ4_ENABLE_ASSEMBLY_MATCH_X86_64
+		match_end = lz4_match_end_asm(match_end - match_distance, match_end, src_end);
+#else
 		{
 			const uint8_t * ref_end = match_end - match_distance;
 			while (match_end < src_end) {
@@ -368,6 +371,7 @@ EXPAND_FORWARD:
 				ref_end += LZ4_MATCH_SEARCH_LOOP_SIZE;
 			}
 		}
+#endif
 
 		// Expand match backward
 		{
@@ -606,3 +610,96 @@ OUT_FAIL:
 IN_FAIL:
 	return 1; // FAIL
 }
+
+// LZ4 stream encoder, see the frame format in <libkern/compression/compression.h>
+#define LZ4_FRAME_COMPRESSED   0x31347662 // "bv41"
+#define LZ4_FRAME_UNCOMPRESSED 0x2d347662 // "bv4-"
+#define LZ4_FRAME_END          0x24347662 // "bv4$"
+
+void
+lz4_stream_encode_init(compression_stream_t *stream, void *state)
+{
+	lz4_stream_encode_state_t *s = state;
+
+	s->src_len = 0;
+	s->out_pos = s->out_len = 0;
+	s->ended = 0;
+	stream->dst_ptr = NULL;
+	stream->dst_size = 0;
+	stream->src_ptr = NULL;
+	stream->src_size = 0;
+	stream->state = s;
+}
+
+// Encode the staged block into out_buf
+static void
+lz4_stream_encode_block(lz4_stream_encode_state_t *s)
+{
+	size_t n = lz4raw_encode_buffer(s->out_buf + 12, LZ4_STREAM_BLOCK_SIZE,
+	    s->src_buf, s->src_len, s->hash_table);
+
+	if (n == 0 || n >= s->src_len) {
+		store4(s->out_buf, LZ4_FRAME_UNCOMPRESSED);
+		store4(s->out_buf + 4, s->src_len);
+		memcpy(s->out_buf + 8, s->src_buf, s->src_len);
+		s->out_len = 8 + s->src_len;
+	} else {
+		store4(s->out_buf, LZ4_FRAME_COMPRESSED);
+		store4(s->out_buf + 4, s->src_len);
+		store4(s->out_buf + 8, (uint32_t)n);
+		s->out_len = 12 + (uint32_t)n;
+	}
+	s->out_pos = 0;
+	s->src_len = 0;
+}
+
+compression_status_t
+lz4_stream_encode_process(compression_stream_t *stream, int flags)
+{
+	lz4_stream_encode_state_t *s = stream->state;
+	const int finalize = (flags & COMPRESSION_STREAM_FINALIZE) != 0;
+
+	for (;;) {
+		// Hand out pending output first
+		if (s->out_pos < s->out_len) {
+			size_t n = s->out_len - s->out_pos;
+			if (n > stream->dst_size) {
+				n = stream->dst_size;
+			}
+			memcpy(stream->dst_ptr, s->out_buf + s->out_pos, n);
+			stream->dst_ptr += n;
+			stream->dst_size -= n;
+			s->out_pos += (uint32_t)n;
+			if (s->out_pos < s->out_len) {
+				return COMPRESSION_STATUS_OK; // dst full
+			}
+		}
+		if (s->ended) {
+			return COMPRESSION_STATUS_END;
+		}
+
+		// Stage input
+		if (stream->src_size) {
+			size_t n = LZ4_STREAM_BLOCK_SIZE - s->src_len;
+			if (n > stream->src_size) {
+				n = stream->src_size;
+			}
+			memcpy(s->src_buf + s->src_len, stream->src_ptr, n);
+			stream->src_ptr += n;
+			stream->src_size -= n;
+			s->src_len += (uint32_t)n;
+		}
+
+		if (s->src_len == LZ4_STREAM_BLOCK_SIZE ||
+		    (finalize && stream->src_size == 0 && s->src_len)) {
+			lz4_stream_encode_block(s);
+		} else if (finalize && stream->src_size == 0) {
+			store4(s->out_buf, LZ4_FRAME_END);
+			s->out_pos = 0;
+			s->out_len = 4;
+			s->ended = 1;
+		} else {
+			return COMPRESSION_STATUS_OK; // src empty
+		}
+	}
+}
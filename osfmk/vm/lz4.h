@@ -31,6 +31,7 @@
 #include <stddef.h>
 #include <kern/assert.h>
 #include <machine/limits.h>
+#include <libkern/compression/compression.h>
 #include "lz4_assembly_select.h"
 #include "lz4_constants.h"
 
@@ -62,6 +63,12 @@ extern void lz4_encode_2gb(uint8_t **dst_ptr, size_t dst_size,
 extern int lz4_decode(uint8_t **dst_ptr, uint8_t *dst_begin, uint8_t *dst_end,
     const uint8_t **src_ptr, const uint8_t *src_end);
 
+#if LZ4_ENABLE_ASSEMBLY_MATCH_X86_64
+//  Vectorized forward match expansion used by the C encoder, see lz4_encode_x86_64.s.
+extern const uint8_t *lz4_match_end_asm(const uint8_t *ref, const uint8_t *cur,
+    const uint8_t *cur_end);
+#endif
+
 #if LZ4_ENABLE_ASSEMBLY_DECODE
 extern int lz4_decode_asm(uint8_t **dst_ptr, uint8_t *dst_begin, uint8_t *dst_end,
     const uint8_t **src_ptr, const uint8_t *src_end);
@@ -82,6 +89,35 @@ size_t lz4raw_decode_buffer(uint8_t * __restrict dst_buffer, size_t dst_size,
     const uint8_t * __restrict src_buffer, size_t src_size,
     void * __restrict work __attribute__((unused)));
 
+#pragma mark - Stream interfaces (LZ4 + frame)
+
+//  Built-in encoder for the COMPRESSION_LZ4 stream format described in
+//  <libkern/compression/compression.h>, for producers (stackshot, kcdata,
+//  corefiles) that cannot wait for the compression kext to register or must
+//  not allocate. The stream fields and return values are those of
+//  compression_stream_process(); the state lives in caller provided memory
+//  of lz4_stream_encode_state_size bytes.
+//
+//  Input is staged one LZ4_STREAM_BLOCK_SIZE block at a time, each block is
+//  encoded independently and stored uncompressed when that is smaller, so
+//  memory use does not depend on the stream length.
+#define LZ4_STREAM_BLOCK_SIZE 16384
+
+typedef struct {
+	lz4_hash_entry_t hash_table[LZ4_COMPRESS_HASH_ENTRIES];
+	uint32_t src_len;       // bytes staged in src_buf
+	uint32_t out_pos;       // next byte of out_buf to hand out
+	uint32_t out_len;       // bytes in out_buf
+	uint32_t ended;         // end of stream header emitted
+	uint8_t  src_buf[LZ4_STREAM_BLOCK_SIZE + LZ4_GOFAST_SAFETY_MARGIN];
+	uint8_t  out_buf[12 + LZ4_STREAM_BLOCK_SIZE];
+} lz4_stream_encode_state_t;
+
+static const size_t lz4_stream_encode_state_size = sizeof(lz4_stream_encode_state_t);
+
+void lz4_stream_encode_init(compression_stream_t *stream, void *state);
+compression_status_t lz4_stream_encode_process(compression_stream_t *stream, int flags);
+
 typedef __attribute__((__ext_vector_type__(8))) uint8_t vector_uchar8;
 typedef __attribute__((__ext_vector_type__(16))) uint8_t vector_uchar16;
 typedef __attribute__((__ext_vector_type__(32))) uint8_t vector_uchar32;
@@ -567,6 +567,17 @@ extern kern_return_t(pmap_attribute)(           /* Get/Set special memory
 struct pfc {
 	long    pfc_cpus;
 	long    pfc_invalid_global;
+#if __arm64__
+	/*
+	 * Invalidations deferred by PMAP_OPTIONS_NOFLUSH: the union of
+	 * the ranges changed in pfc_pmap, issued and synchronized once
+	 * by pmap_flush().
+	 */
+	pmap_t                  pfc_pmap;
+	vm_map_address_t        pfc_start;
+	vm_map_address_t        pfc_end;
+	bool                    pfc_strong_sync;
+#endif /* __arm64__ */
 };
 
 typedef struct pfc      pmap_flush_context;
@@ -762,6 +773,21 @@ extern void             pmap_remove_options(    /* Remove mappings. */
 	vm_map_offset_t e,
 	int             options);
 
+/*
+ * Like pmap_remove_options(), but lets the pmap layer issue the
+ * invalidations already deferred in "pfc" together with those of the
+ * removed range.  The removed range itself is always invalidated before
+ * this returns, since its PV entries are gone and its pages may be freed;
+ * the caller must still call pmap_flush() for anything else left in "pfc"
+ * before dropping the lock that keeps those ranges from being reused.
+ */
+extern void             pmap_remove_options_flush_context(
+	pmap_t          map,
+	vm_map_offset_t s,
+	vm_map_offset_t e,
+	int             options,
+	pmap_flush_context *pfc);
+
 extern void             fillPage(ppnum_t pa, unsigned int fill);
 
 #if defined(__LP64__)
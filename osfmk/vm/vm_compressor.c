@@ -210,6 +210,22 @@ struct c_sv_hash_entry {
 #define C_SV_HASH_MASK          ((1 << 10) - 1)
 #define C_SV_CSEG_ID            ((1 << 22) - 1)
 
+/*
+ * Slots whose payload is shared through c_dedup_table use one of the
+ * C_DEDUP_TABLE_CHUNKS segment numbers just below C_SV_CSEG_ID, with
+ * s_cindx indexing within that chunk of the table.
+ */
+#define C_DEDUP_TABLE_CHUNKS    4
+#define C_DEDUP_TABLE_SIZE      (C_DEDUP_TABLE_CHUNKS << 10)
+#define C_DEDUP_TABLE_MASK      (C_DEDUP_TABLE_SIZE - 1)
+#define C_DEDUP_MAX_PROBE       8
+#define C_DEDUP_CSEG_ID_BASE    (C_SV_CSEG_ID - C_DEDUP_TABLE_CHUNKS)
+
+#define C_SLOT_IS_DEDUP(slot)   ((slot)->s_cseg >= C_DEDUP_CSEG_ID_BASE && \
+	                         (slot)->s_cseg < C_SV_CSEG_ID)
+#define C_SLOT_DEDUP_INDEX(slot) \
+	((((slot)->s_cseg - C_DEDUP_CSEG_ID_BASE) << 10) | (slot)->s_cindx)
+
 
 union c_segu {
 	c_segment_t     c_seg;
@@ -297,6 +313,31 @@ uint32_t        c_segment_svp_nonzero_decompressions;
 
 uint32_t        c_segment_noncompressible_pages;
 
+struct c_dedup_entry {
+	uint32_t        cde_hash;       /* 0 if the entry is unused */
+	uint32_t        cde_refs;       /* slots sharing cde_data, 0 if only seen once */
+	uint32_t        cde_size;       /* compressed size in bytes */
+	uint32_t        cde_popcount;
+	uint16_t        cde_codec;
+	char            *cde_data;
+};
+
+/*
+ * Pages pushed through the dedup table per second, 0 disables it.
+ * Only takes effect if set at boot, since the table is sized then.
+ */
+TUNABLE_WRITEABLE(uint32_t, vm_compressor_dedup_rate, "vm_compressor_dedup_rate", 0);
+
+static struct c_dedup_entry *c_dedup_table;
+static uint64_t c_dedup_window_abs;
+static uint64_t c_dedup_window;
+static uint32_t c_dedup_window_count;
+
+uint64_t        c_dedup_bytes_saved;    /* compressed bytes not stored thanks to sharing */
+uint64_t        c_dedup_bytes_stored;   /* bytes held by the dedup table itself */
+uint64_t        c_dedup_hits;
+uint64_t        c_dedup_entries;
+
 uint32_t        c_segment_pages_compressed = 0; /* Tracks # of uncompressed pages fed into the compressor */
 #if CONFIG_FREEZE
 int32_t         c_segment_pages_compressed_incore = 0; /* Tracks # of uncompressed pages fed into the compressor that are in memory */
@@ -323,6 +364,7 @@ uint32_t        vm_compressor_catchup_threshold_divisor_overridden = 0;
 LCK_GRP_DECLARE(vm_compressor_lck_grp, "vm_compressor");
 LCK_RW_DECLARE(c_master_lock, &vm_compressor_lck_grp);
 LCK_MTX_DECLARE(c_list_lock_storage, &vm_compressor_lck_grp);
+static LCK_MTX_DECLARE(c_dedup_lock, &vm_compressor_lck_grp);
 
 boolean_t       decompressions_blocked = FALSE;
 
@@ -897,6 +939,11 @@ vm_compressor_set_size(void)
 		c_segments_limit = tmp_slot_ptr.s_cseg - 1; /*limited by segment idx bits in c_slot_mapping*/
 		compressor_pool_size = (c_segments_limit * (vm_size_t)(c_seg_allocsize));
 	}
+	if (c_segments_limit >= C_DEDUP_CSEG_ID_BASE) {
+		/* the top segment numbers are reserved for shared payloads */
+		c_segments_limit = C_DEDUP_CSEG_ID_BASE - 1;
+		compressor_pool_size = (c_segments_limit * (vm_size_t)(c_seg_allocsize));
+	}
 
 	c_segments_nearing_limit = (uint32_t)(((uint64_t)c_segments_limit * 98ULL) / 100ULL);
 
@@ -1180,6 +1227,12 @@ vm_compressor_init(void)
 		buf += compressor_cpus * vm_compressor_get_decode_scratch_size();
 		bufsize -= compressor_cpus * vm_compressor_get_decode_scratch_size();
 
+		if (vm_compressor_dedup_rate) {
+			c_dedup_table = zalloc_permanent(C_DEDUP_TABLE_SIZE * sizeof(struct c_dedup_entry),
+			    ZALIGN(struct c_dedup_entry));
+			nanoseconds_to_absolutetime(NSEC_PER_SEC, &c_dedup_window_abs);
+		}
+
 		kdp_compressor_scratch_buf = buf;
 		buf += vm_compressor_get_decode_scratch_size();
 		bufsize -= vm_compressor_get_decode_scratch_size();
@@ -4121,6 +4174,7 @@ c_seg_allocate(c_segment_t *current_chead)
 		c_seg->c_state = C_IS_EMPTY;
 		c_seg->c_firstemptyslot = C_SLOT_MAX_INDEX;
 		c_seg->c_mysegno = c_segno;
+		compressor_seg_selector_init(&c_seg->c_codec_selector);
 
 		lck_mtx_lock_spin_always(c_list_lock);
 		c_empty_count++;
@@ -4615,6 +4669,202 @@ c_segment_sv_hash_insert(uint32_t data)
 	return hash_sindx;
 }
 
+/*
+ * Sharing of identical compressed payloads.
+ *
+ * Pages that compress to the same bytes (identical library data,
+ * duplicated cached blobs, ...) can share a single copy of the
+ * compressed payload, kept outside of the c_segments in c_dedup_table
+ * and reference counted like the single-value hash.  Since those slots
+ * don't live in a segment, compaction, swap and relocation never see
+ * them.
+ *
+ * The first time a payload is seen only its hash is recorded; the second
+ * time, a copy is taken into the table and the slot shares it from then
+ * on, so storage is saved from the third copy onward.  Hashing costs CPU
+ * on every compression, which is why vm_compressor_dedup_rate bounds how
+ * many pages per second are considered.
+ */
+static uint32_t
+c_dedup_hash(const char *data, uint32_t size)
+{
+	const uint32_t *words = (const uint32_t *)(uintptr_t)data;
+	uint64_t        hash = 0xcbf29ce484222325ULL ^ size;
+	uint32_t        i;
+
+	for (i = 0; i < size / sizeof(uint32_t); i++) {
+		hash = (hash ^ words[i]) * 0x100000001b3ULL;
+	}
+	for (i *= sizeof(uint32_t); i < size; i++) {
+		hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+	}
+	hash ^= hash >> 32;
+
+	return (uint32_t)hash | 1;
+}
+
+static bool
+c_dedup_admit(void)
+{
+	uint64_t window;
+
+	if (c_dedup_table == NULL || vm_compressor_dedup_rate == 0) {
+		return false;
+	}
+
+	window = mach_absolute_time() / c_dedup_window_abs;
+	if (os_atomic_load(&c_dedup_window, relaxed) != window) {
+		os_atomic_store(&c_dedup_window, window, relaxed);
+		os_atomic_store(&c_dedup_window_count, 0, relaxed);
+	}
+	return os_atomic_inc(&c_dedup_window_count, relaxed) <= vm_compressor_dedup_rate;
+}
+
+/*
+ * Called with the c_seg holding "data" locked.  Returns the table index
+ * the slot should map to, with a reference taken on it, or -1 if the
+ * payload has to be stored in the segment as usual.
+ */
+static int
+c_dedup_insert(const char *data, uint32_t size, uint16_t codec, uint32_t popcount)
+{
+	struct c_dedup_entry *cde, *victim = NULL;
+	uint32_t        hash = c_dedup_hash(data, size);
+	uint32_t        rounded = (size + C_SEG_OFFSET_ALIGNMENT_MASK) & ~C_SEG_OFFSET_ALIGNMENT_MASK;
+	int             indx, result = -1;
+
+	lck_mtx_lock_spin_always(&c_dedup_lock);
+
+	for (int probe = 0; probe < C_DEDUP_MAX_PROBE; probe++) {
+		indx = (int)((hash + probe) & C_DEDUP_TABLE_MASK);
+		cde = &c_dedup_table[indx];
+
+		if (cde->cde_hash == hash && cde->cde_size == size && cde->cde_codec == codec) {
+			if (cde->cde_data == NULL) {
+				/* second sighting, keep a copy to share from now on */
+				cde->cde_data = kalloc_data(size, Z_NOWAIT);
+				if (cde->cde_data == NULL) {
+					break;
+				}
+				memcpy(cde->cde_data, data, size);
+				cde->cde_popcount = popcount;
+				cde->cde_refs = 1;
+				c_dedup_bytes_stored += size;
+				c_dedup_entries++;
+				result = indx;
+			} else if (memcmp(cde->cde_data, data, size) == 0) {
+				cde->cde_refs++;
+				c_dedup_bytes_saved += rounded;
+				c_dedup_hits++;
+				result = indx;
+			}
+			victim = NULL;
+			break;
+		}
+		if (victim == NULL && cde->cde_refs == 0) {
+			/* unused, or a payload only seen once */
+			victim = cde;
+		}
+	}
+	if (victim) {
+		victim->cde_hash = hash;
+		victim->cde_size = size;
+		victim->cde_codec = codec;
+	}
+
+	lck_mtx_unlock_always(&c_dedup_lock);
+
+	return result;
+}
+
+static void
+c_dedup_drop_ref(int indx)
+{
+	struct c_dedup_entry *cde = &c_dedup_table[indx];
+	char            *data = NULL;
+	uint32_t        size = cde->cde_size;
+
+	lck_mtx_lock_spin_always(&c_dedup_lock);
+
+	assert(cde->cde_refs > 0 && cde->cde_data != NULL);
+	if (--cde->cde_refs == 0) {
+		data = cde->cde_data;
+		cde->cde_data = NULL;
+		cde->cde_hash = 0;
+		c_dedup_bytes_stored -= size;
+		c_dedup_entries--;
+	} else {
+		c_dedup_bytes_saved -= (size + C_SEG_OFFSET_ALIGNMENT_MASK) & ~C_SEG_OFFSET_ALIGNMENT_MASK;
+	}
+
+	lck_mtx_unlock_always(&c_dedup_lock);
+
+	if (data) {
+		kfree_data(data, size);
+	}
+}
+
+static int
+c_dedup_decompress(char *dst, int indx, int flags)
+{
+	struct c_dedup_entry *cde = &c_dedup_table[indx];
+	bool            kdp_mode = (flags & C_KDP) != 0;
+	char            *scratch_buf;
+	int             retval = 0;
+
+	assert(cde->cde_refs > 0 && cde->cde_data != NULL);
+
+	if (cde->cde_size == PAGE_SIZE) {
+		memcpy(dst, cde->cde_data, PAGE_SIZE);
+		return 0;
+	}
+	if (__probable(!kdp_mode)) {
+		disable_preemption();
+		scratch_buf = &compressor_scratch_bufs[cpu_number() * vm_compressor_get_decode_scratch_size()];
+	} else {
+		scratch_buf = kdp_compressor_scratch_buf;
+	}
+
+	if (vm_compressor_algorithm() != VM_COMPRESSOR_DEFAULT_CODEC) {
+#if defined(__arm64__)
+		uint32_t inline_popcount;
+
+		if (!metadecompressor((const uint8_t *)cde->cde_data, (uint8_t *)dst,
+		    cde->cde_size, cde->cde_codec, (void *)scratch_buf, &inline_popcount)) {
+			retval = -1;
+		}
+#if __APPLE_WKDM_POPCNT_EXTENSIONS__
+		else if (inline_popcount != cde->cde_popcount) {
+			printf("decompression failure from dedup entry %d: popcount mismatch (%d != %d)\n",
+			    indx, inline_popcount, cde->cde_popcount);
+			retval = -1;
+		}
+#endif /* __APPLE_WKDM_POPCNT_EXTENSIONS__ */
+#endif
+	} else {
+#if defined(__arm64__)
+		__unreachable_ok_push
+		if (PAGE_SIZE == 4096) {
+			WKdm_decompress_4k((WK_word *)(uintptr_t)cde->cde_data,
+			    (WK_word *)(uintptr_t)dst, (WK_word *)(uintptr_t)scratch_buf, cde->cde_size);
+		} else {
+			WKdm_decompress_16k((WK_word *)(uintptr_t)cde->cde_data,
+			    (WK_word *)(uintptr_t)dst, (WK_word *)(uintptr_t)scratch_buf, cde->cde_size);
+		}
+		__unreachable_ok_pop
+#else
+		WKdm_decompress_new((WK_word *)(uintptr_t)cde->cde_data,
+		    (WK_word *)(uintptr_t)dst, (WK_word *)(uintptr_t)scratch_buf, cde->cde_size);
+#endif
+	}
+
+	if (__probable(!kdp_mode)) {
+		enable_preemption();
+	}
+	return retval;
+}
+
+
 
 #if RECORD_THE_COMPRESSED_DATA
 
@@ -4644,6 +4894,7 @@ c_compress_page(char *src, c_slot_mapping_t slot_ptr, c_segment_t *current_chead
 	c_slot_t        cs;
 	c_segment_t     c_seg;
 	bool            single_value = false;
+	uint32_t        popcount = C_SLOT_NO_POPCOUNT;
 
 	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_START, *current_chead, 0, 0, 0, 0);
 retry:
@@ -4685,9 +4936,11 @@ retry:
 			c_size = metacompressor((const uint8_t *) src,
 			    (uint8_t *) &c_seg->c_store.c_buffer[cs->c_offset],
 			    max_csize_adj, &ccodec,
-			    scratch_buf, &incomp_copy, &inline_popcount);
+			    scratch_buf, &incomp_copy, &inline_popcount,
+			    &c_seg->c_codec_selector);
 #if __APPLE_WKDM_POPCNT_EXTENSIONS__
 			cs->c_inline_popcount = inline_popcount;
+			popcount = inline_popcount;
 #else
 			assert(inline_popcount == C_SLOT_NO_POPCOUNT);
 #endif
@@ -4769,6 +5022,25 @@ retry:
 		OSAddAtomic(1, &c_segment_svp_hash_failed);
 	}
 
+	if (c_size > 4 && c_dedup_admit()) {
+		uint16_t        codec = 0;
+		int             dedup_index;
+
+#if defined(__arm64__)
+		codec = cs->c_codec;
+#endif
+		dedup_index = c_dedup_insert((char *)&c_seg->c_store.c_buffer[cs->c_offset],
+		    c_size, codec, popcount);
+
+		if (dedup_index != -1) {
+			slot_ptr->s_cindx = dedup_index & ((1 << 10) - 1);
+			slot_ptr->s_cseg = C_DEDUP_CSEG_ID_BASE + (dedup_index >> 10);
+			/* nothing was consumed in the segment */
+			c_size = 0;
+			goto sv_compression;
+		}
+	}
+
 #if RECORD_THE_COMPRESSED_DATA
 	c_compressed_record_data((char *)&c_seg->c_store.c_buffer[cs->c_offset], c_size);
 #endif
@@ -5405,6 +5677,19 @@ vm_compressor_get(ppnum_t pn, int *slot, int flags)
 		pmap_unmap_compressor_page(pn, dst);
 		return 0;
 	}
+	if (C_SLOT_IS_DEDUP(slot_ptr)) {
+		int     indx = C_SLOT_DEDUP_INDEX(slot_ptr);
+
+		retval = c_dedup_decompress(dst, indx, flags);
+		if (!(flags & C_KEEP)) {
+			c_dedup_drop_ref(indx);
+
+			OSAddAtomic(-1, &c_segment_pages_compressed);
+			*slot = 0;
+		}
+		pmap_unmap_compressor_page(pn, dst);
+		return retval;
+	}
 
 	retval = c_decompress_page(dst, slot_ptr, flags, &zeroslot);
 
@@ -5439,6 +5724,10 @@ vm_compressor_inject_error(int *slot)
 		printf("%s(): cannot inject errors in SV-compressed pages\n", __func__ );
 		return;
 	}
+	if (C_SLOT_IS_DEDUP(slot_ptr)) {
+		printf("%s(): cannot inject errors in shared compressed pages\n", __func__ );
+		return;
+	}
 
 	/* s_cseg is actually "segno+1" */
 	const uint32_t c_segno = slot_ptr->s_cseg - 1;
@@ -5543,6 +5832,13 @@ vm_compressor_free(int *slot, int flags)
 		*slot = 0;
 		return 0;
 	}
+	if (C_SLOT_IS_DEDUP(slot_ptr)) {
+		c_dedup_drop_ref(C_SLOT_DEDUP_INDEX(slot_ptr));
+		OSAddAtomic(-1, &c_segment_pages_compressed);
+
+		*slot = 0;
+		return 0;
+	}
 	retval = c_decompress_page(NULL, slot_ptr, flags, &zeroslot);
 	/*
 	 * returns 0 if we successfully freed the specified compressed page
@@ -5585,7 +5881,7 @@ vm_compressor_transfer(
 
 	src_slot = (c_slot_mapping_t) src_slot_p;
 
-	if (src_slot->s_cseg == C_SV_CSEG_ID) {
+	if (src_slot->s_cseg == C_SV_CSEG_ID || C_SLOT_IS_DEDUP(src_slot)) {
 		*dst_slot_p = *src_slot_p;
 		*src_slot_p = 0;
 		return;
@@ -5689,10 +5985,11 @@ vm_compressor_relocate(
 
 	src_slot = (c_slot_mapping_t) slot_p;
 
-	if (src_slot->s_cseg == C_SV_CSEG_ID) {
+	if (src_slot->s_cseg == C_SV_CSEG_ID || C_SLOT_IS_DEDUP(src_slot)) {
 		/*
 		 * no need to relocate... this is a page full of a single
-		 * value which is hashed to a single entry not contained
+		 * value which is hashed to a single entry, or a payload
+		 * shared through the dedup table, neither contained
 		 * in a c_segment_t
 		 */
 		return kr;
@@ -33,6 +33,7 @@
 #include <vm/vm_page.h>
 #include <vm/vm_protos.h>
 #include <vm/WKdm_new.h>
+#include <vm/vm_compressor_algorithms.h>
 #include <vm/vm_object.h>
 #include <vm/vm_map.h>
 #include <machine/pmap.h>
@@ -250,6 +251,8 @@ struct c_segment {
 	c_reserved:22;
 #endif /* CONFIG_FREEZE */
 
+	compressor_seg_selector_t c_codec_selector;
+
 	int             c_slot_var_array_len;
 	struct  c_slot  *c_slot_var_array;
 	struct  c_slot  c_slot_fixed_array[0];
@@ -462,7 +465,7 @@ extern void kdp_compressor_busy_find_owner(event64_t wait_event, thread_waitinfo
 #define PAGE_REPLACEMENT_ALLOWED(enable)        (enable == TRUE ? lck_rw_lock_exclusive(&c_master_lock) : lck_rw_done(&c_master_lock))
 
 
-#define AVAILABLE_NON_COMPRESSED_MEMORY         (vm_page_active_count + vm_page_inactive_count + vm_page_free_count + vm_page_speculative_count)
+#define AVAILABLE_NON_COMPRESSED_MEMORY         (vm_page_active_count + vm_page_inactive_count + VM_PAGE_FREE_COUNT_WITH_CACHED() + vm_page_speculative_count)
 #define AVAILABLE_MEMORY                        (AVAILABLE_NON_COMPRESSED_MEMORY + VM_PAGE_COMPRESSOR_COUNT)
 
 /*
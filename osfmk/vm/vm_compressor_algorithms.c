@@ -77,6 +77,7 @@ compressor_tuneables_t vmctune = {
 	.lz4_run_preselection_threshold = ~0U,
 	.lz4_run_continue_bytes = 0,
 	.lz4_profitable_bytes = 0,
+	.seg_sample_pages = 8,
 };
 
 compressor_state_t vmcstate = {
@@ -212,6 +213,72 @@ compressor_selector_update(int lz4sz, int didwk, int wksz)
 }
 
 
+void
+compressor_seg_selector_init(compressor_seg_selector_t *selector)
+{
+	selector->cs_wk_samples = 0;
+	selector->cs_lz4_samples = 0;
+	selector->cs_codec = CINVALID;
+	selector->cs_wk_bytes = 0;
+	selector->cs_lz4_bytes = 0;
+}
+
+static inline uint16_t
+compressor_seg_select(compressor_seg_selector_t *selector)
+{
+	if (selector->cs_codec != CINVALID) {
+		return selector->cs_codec;
+	}
+	return (selector->cs_wk_samples > selector->cs_lz4_samples) ? CCLZ4 : CCWK;
+}
+
+static inline void
+compressor_seg_selector_update(compressor_seg_selector_t *selector, uint16_t codec, int sz)
+{
+	uint32_t csize;
+
+	if (selector->cs_codec != CINVALID) {
+		return;
+	}
+
+	/* failures are stored uncompressed, single values take a word */
+	if (sz < 0) {
+		csize = PAGE_SIZE;
+	} else if (sz == 0) {
+		csize = sizeof(uint32_t);
+	} else {
+		csize = sz;
+	}
+
+	VM_COMPRESSOR_STAT(compressor_stats.seg_sample_compressions++);
+	if (codec == CCLZ4) {
+		selector->cs_lz4_samples++;
+		selector->cs_lz4_bytes += csize;
+		VM_COMPRESSOR_STAT(compressor_stats.seg_sample_lz4_bytes += csize);
+	} else {
+		selector->cs_wk_samples++;
+		selector->cs_wk_bytes += csize;
+		VM_COMPRESSOR_STAT(compressor_stats.seg_sample_wk_bytes += csize);
+	}
+
+	if (selector->cs_wk_samples + selector->cs_lz4_samples < MIN(vmctune.seg_sample_pages, UINT8_MAX)) {
+		return;
+	}
+
+	/*
+	 * Compare average sizes; WKdm is cheaper so it wins ties,
+	 * and LZ4 must also clear the profitability margin.
+	 */
+	if ((uint64_t)(selector->cs_lz4_bytes + vmctune.lz4_profitable_bytes * selector->cs_lz4_samples) * selector->cs_wk_samples <
+	    (uint64_t)selector->cs_wk_bytes * selector->cs_lz4_samples) {
+		selector->cs_codec = CCLZ4;
+		VM_COMPRESSOR_STAT(compressor_stats.seg_lz4_selections++);
+	} else {
+		selector->cs_codec = CCWK;
+		VM_COMPRESSOR_STAT(compressor_stats.seg_wk_selections++);
+	}
+}
+
 static inline void
 WKdm_hv(uint32_t *wkbuf)
 {
@@ -297,7 +364,8 @@ WKdmC(WK_word* src_buf, WK_word* dest_buf, WK_word* scratch,
 
 int
 metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *codec,
-    void *cscratchin, boolean_t *incomp_copy, uint32_t *pop_count_p)
+    void *cscratchin, boolean_t *incomp_copy, uint32_t *pop_count_p,
+    compressor_seg_selector_t *selector)
 {
 	int sz = -1;
 	int dowk = FALSE, dolz4 = FALSE, skiplz4 = FALSE;
@@ -322,12 +390,22 @@ metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *cod
 			assert(presel == CPRESELWK);
 			dowk = TRUE;
 		}
+	} else if (vm_compressor_current_codec == CMODE_SEG) {
+		assert(selector != NULL);
+		if (compressor_seg_select(selector) == CCLZ4) {
+			dolz4 = TRUE;
+			goto lz4compress;
+		}
+		dowk = TRUE;
 	}
 
 	if (dowk) {
+		__unused uint64_t wkcstart;
 		*codec = CCWK;
 		VM_COMPRESSOR_STAT(compressor_stats.wk_compressions++);
+		VM_COMPRESSOR_STAT(wkcstart = mach_absolute_time());
 		sz = WKdmC(in, cdst, &cscratch->wkscratch[0], incomp_copy, outbufsz, &pop_count);
+		VM_COMPRESSOR_STAT(compressor_stats.wk_cabstime += mach_absolute_time() - wkcstart);
 
 		if (sz == -1) {
 			VM_COMPRESSOR_STAT(compressor_stats.wk_compressed_bytes_total += PAGE_SIZE);
@@ -365,17 +443,26 @@ lz4compress:
 			sz = PAGE_SIZE;
 		}
 		int wksz = sz;
+		__unused uint64_t lz4cstart;
 		*codec = CCLZ4;
 
+		VM_COMPRESSOR_STAT(lz4cstart = mach_absolute_time());
 		sz = (int) lz4raw_encode_buffer(cdst, outbufsz, in, insize, &cscratch->lz4state[0]);
+		VM_COMPRESSOR_STAT(compressor_stats.lz4_cabstime += mach_absolute_time() - lz4cstart);
 
-		compressor_selector_update(sz, dowk, wksz);
+		/* the per-segment selector keeps its own statistics below */
+		if (vm_compressor_current_codec != CMODE_SEG) {
+			compressor_selector_update(sz, dowk, wksz);
+		}
 		if (sz == 0) {
 			sz = -1;
 			goto cexit;
 		}
 	}
 cexit:
+	if (vm_compressor_current_codec == CMODE_SEG) {
+		compressor_seg_selector_update(selector, *codec, sz);
+	}
 	assert(pop_count_p != NULL);
 	*pop_count_p = pop_count;
 	return sz;
@@ -459,7 +546,7 @@ vm_compressor_algorithm_init(void)
 
 	PE_parse_boot_argn("vm_compressor_codec", &new_codec, sizeof(new_codec));
 	assertf(((new_codec == VM_COMPRESSOR_DEFAULT_CODEC) || (new_codec == CMODE_WK) ||
-	    (new_codec == CMODE_LZ4) || (new_codec == CMODE_HYB)),
+	    (new_codec == CMODE_LZ4) || (new_codec == CMODE_HYB) || (new_codec == CMODE_SEG)),
 	    "Invalid VM compression codec: %u", new_codec);
 
 #if defined(__arm64__)
@@ -468,8 +555,145 @@ vm_compressor_algorithm_init(void)
 		new_codec = VM_COMPRESSOR_DEFAULT_CODEC;
 	} else if (PE_parse_boot_argn("-vm_compressor_hybrid", &tmpc, sizeof(tmpc))) {
 		new_codec = CMODE_HYB;
+	} else if (PE_parse_boot_argn("-vm_compressor_segment", &tmpc, sizeof(tmpc))) {
+		new_codec = CMODE_SEG;
 	}
 
 	vm_compressor_current_codec = new_codec;
 #endif /* arm/arm64 */
 }
+
+#if DEVELOPMENT || DEBUG
+/*
+ * Codec throughput benchmark (kern.perf_codec).
+ *
+ * Encodes the pages of a user buffer with the selected codec and, for the
+ * page codecs, decodes each of them again and checks the round trip. Only
+ * the codec calls are timed, the copyin of the buffer is not.
+ */
+kern_return_t
+run_codec_perf_test(
+	user_addr_t buf,
+	size_t buffer_size,
+	uint32_t codec,
+	uint64_t *encode_time,
+	uint64_t *decode_time,
+	uint64_t *bytes_encoded);
+
+#define CODEC_PERF_MAX_SIZE (64ull << 20)
+
+enum {
+	CODEC_PERF_WKDM = 0,            /* WKdm, page at a time */
+	CODEC_PERF_LZ4 = 1,             /* lz4raw, page at a time */
+	CODEC_PERF_LZ4_STREAM = 2,      /* LZ4 stream encoder, whole buffer */
+};
+
+kern_return_t
+run_codec_perf_test(
+	user_addr_t buf,
+	size_t buffer_size,
+	uint32_t codec,
+	uint64_t *encode_time,
+	uint64_t *decode_time,
+	uint64_t *bytes_encoded)
+{
+	size_t scratch_size = MAX(WKdm_SCRATCH_BUF_SIZE_INTERNAL, lz4_encode_scratch_size);
+	uint64_t enc = 0, dec = 0, out = 0, start;
+	kern_return_t kr = KERN_SUCCESS;
+	uint8_t *src, *cbuf, *dbuf;
+	void *scratch;
+
+	if (buffer_size == 0 || buffer_size > CODEC_PERF_MAX_SIZE ||
+	    (buffer_size & PAGE_MASK) || codec > CODEC_PERF_LZ4_STREAM) {
+		return KERN_INVALID_ARGUMENT;
+	}
+	if (codec == CODEC_PERF_LZ4_STREAM) {
+		scratch_size = lz4_stream_encode_state_size;
+	}
+
+	src = kalloc_data(buffer_size, Z_WAITOK);
+	cbuf = kalloc_data(PAGE_SIZE, Z_WAITOK);
+	dbuf = kalloc_data(PAGE_SIZE, Z_WAITOK);
+	scratch = kalloc_data(scratch_size, Z_WAITOK);
+	if (!src || !cbuf || !dbuf || !scratch) {
+		kr = KERN_RESOURCE_SHORTAGE;
+		goto out;
+	}
+	if (copyin(buf, src, buffer_size)) {
+		kr = KERN_INVALID_ARGUMENT;
+		goto out;
+	}
+
+	if (codec == CODEC_PERF_LZ4_STREAM) {
+		compression_stream_t stream;
+		compression_status_t status;
+
+		lz4_stream_encode_init(&stream, scratch);
+		stream.src_ptr = src;
+		stream.src_size = buffer_size;
+		start = mach_absolute_time();
+		do {
+			stream.dst_ptr = cbuf;
+			stream.dst_size = PAGE_SIZE;
+			status = lz4_stream_encode_process(&stream, COMPRESSION_STREAM_FINALIZE);
+			out += PAGE_SIZE - stream.dst_size;
+		} while (status == COMPRESSION_STATUS_OK);
+		enc = mach_absolute_time() - start;
+		if (status != COMPRESSION_STATUS_END) {
+			kr = KERN_FAILURE;
+		}
+		goto out;
+	}
+
+	for (size_t off = 0; off < buffer_size; off += PAGE_SIZE) {
+		uint8_t *page = src + off;
+		int sz;
+
+		start = mach_absolute_time();
+		if (codec == CODEC_PERF_WKDM) {
+			sz = WKdmC((WK_word *)page, (WK_word *)cbuf, scratch, NULL,
+			    PAGE_SIZE - 64, NULL);
+		} else {
+			sz = (int)lz4raw_encode_buffer(cbuf, PAGE_SIZE, page, PAGE_SIZE, scratch);
+			sz = sz ? sz : -1;
+		}
+		enc += mach_absolute_time() - start;
+
+		if (sz == -1) {
+			/* Incompressible, the compressor would store the page as is. */
+			out += PAGE_SIZE;
+			continue;
+		}
+		if (sz == 0) {
+			/* WKdm single value page */
+			out += sizeof(WK_word);
+			continue;
+		}
+		out += sz;
+
+		start = mach_absolute_time();
+		if (codec == CODEC_PERF_WKDM) {
+			WKdmD((WK_word *)cbuf, (WK_word *)dbuf, scratch, sz, NULL);
+		} else if (lz4raw_decode_buffer(dbuf, PAGE_SIZE, cbuf, sz, NULL) != PAGE_SIZE) {
+			kr = KERN_FAILURE;
+			goto out;
+		}
+		dec += mach_absolute_time() - start;
+
+		if (memcmp(dbuf, page, PAGE_SIZE) != 0) {
+			kr = KERN_FAILURE;
+			goto out;
+		}
+	}
+
+out:
+	absolutetime_to_nanoseconds(enc, encode_time);
+	absolutetime_to_nanoseconds(dec, decode_time);
+	*bytes_encoded = out;
+	kfree_data(scratch, scratch_size);
+	kfree_data(dbuf, PAGE_SIZE);
+	kfree_data(cbuf, PAGE_SIZE);
+	kfree_data(src, buffer_size);
+	return kr;
+}
+#endif /* DEVELOPMENT || DEBUG */
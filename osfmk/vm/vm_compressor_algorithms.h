@@ -72,6 +72,14 @@ typedef struct {
 
 	uint64_t wk_decompressed_bytes;
 	uint64_t wk_sv_decompressions;
+
+	uint64_t lz4_cabstime;
+
+	uint64_t seg_sample_compressions;
+	uint64_t seg_sample_wk_bytes;
+	uint64_t seg_sample_lz4_bytes;
+	uint64_t seg_wk_selections;
+	uint64_t seg_lz4_selections;
 } compressor_stats_t;
 
 extern compressor_stats_t compressor_stats;
@@ -86,12 +94,32 @@ typedef struct {
 	uint32_t lz4_run_preselection_threshold;
 	uint32_t lz4_run_continue_bytes;
 	uint32_t lz4_profitable_bytes;
+	uint32_t seg_sample_pages;
 } compressor_tuneables_t;
 
 extern compressor_tuneables_t vmctune;
 
+/*
+ * Codec selection state for CMODE_SEG, embedded in each c_segment and
+ * protected by its c_lock.
+ *
+ * The first vmctune.seg_sample_pages pages of a segment alternate between
+ * WKdm and LZ4; the codec with the better average compressed size is then
+ * used for the remainder of the segment.
+ */
+typedef struct {
+	uint8_t  cs_wk_samples;
+	uint8_t  cs_lz4_samples;
+	uint16_t cs_codec;              /* CINVALID while sampling */
+	uint32_t cs_wk_bytes;
+	uint32_t cs_lz4_bytes;
+} compressor_seg_selector_t;
+
+void compressor_seg_selector_init(compressor_seg_selector_t *selector);
+
 int metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz,
-    uint16_t *codec, void *cscratch, boolean_t *, uint32_t *pop_count_p);
+    uint16_t *codec, void *cscratch, boolean_t *, uint32_t *pop_count_p,
+    compressor_seg_selector_t *selector);
 bool metadecompressor(const uint8_t *source, uint8_t *dest, uint32_t csize,
     uint16_t ccodec, void *compressor_dscratch, uint32_t *pop_count_p);
 
@@ -106,7 +134,8 @@ typedef enum {
 	CMODE_LZ4 = 1,
 	CMODE_HYB = 2,
 	VM_COMPRESSOR_DEFAULT_CODEC = 3,
-	CMODE_INVALID = 4
+	CMODE_SEG = 4,
+	CMODE_INVALID = 5
 } vm_compressor_mode_t;
 
 void vm_compressor_algorithm_init(void);
@@ -961,6 +961,23 @@ vm_swapfile_gc_thread(void)
 #define   VM_SWAPOUT_LIMIT_T0P  6
 #define   VM_SWAPOUT_LIMIT_T0   8
 #define   VM_SWAPOUT_LIMIT_MAX  8
+#define   VM_SWAPOUT_CTX_MAX    32
+
+/*
+ * Writes kept in flight while the swapper is catching up (T0).
+ * Devices with deep command queues can raise it up to VM_SWAPOUT_CTX_MAX.
+ */
+TUNABLE(uint32_t, vm_swapout_limit_t0, "vm_swapout_depth", VM_SWAPOUT_LIMIT_T0);
+
+/*
+ * Writes allowed in flight while a faulting thread waits on a swap-in,
+ * so that its read isn't queued behind a full device queue of
+ * background swapouts.
+ */
+#define   VM_SWAPOUT_LIMIT_SWAPIN       1
+
+static uint32_t vm_swapin_fault_inflight;
+uint64_t vm_swapin_latency_histogram[VM_SWAPIN_LATENCY_BUCKETS];
 
 #define   VM_SWAPOUT_START      0
 #define   VM_SWAPOUT_T2_PASSIVE 1
@@ -1071,7 +1088,7 @@ vm_swapout_thread_throttle_adjust(void)
 
 			proc_set_thread_policy_with_tid(kernel_task, vm_swapout_thread_id,
 			    TASK_POLICY_INTERNAL, TASK_POLICY_PASSIVE_IO, TASK_POLICY_DISABLE);
-			vm_swapout_limit = VM_SWAPOUT_LIMIT_T0;
+			vm_swapout_limit = MIN(vm_swapout_limit_t0, VM_SWAPOUT_CTX_MAX);
 			vm_swapout_state = VM_SWAPOUT_T0;
 		}
 		break;
@@ -1092,7 +1109,7 @@ vm_swapout_thread_throttle_adjust(void)
 
 int vm_swapout_found_empty = 0;
 
-struct swapout_io_completion vm_swapout_ctx[VM_SWAPOUT_LIMIT_MAX];
+struct swapout_io_completion vm_swapout_ctx[VM_SWAPOUT_CTX_MAX];
 
 int vm_swapout_soc_busy = 0;
 int vm_swapout_soc_done = 0;
@@ -1103,12 +1120,12 @@ vm_swapout_find_free_soc(void)
 {
 	int      i;
 
-	for (i = 0; i < VM_SWAPOUT_LIMIT_MAX; i++) {
+	for (i = 0; i < VM_SWAPOUT_CTX_MAX; i++) {
 		if (vm_swapout_ctx[i].swp_io_busy == 0) {
 			return &vm_swapout_ctx[i];
 		}
 	}
-	assert(vm_swapout_soc_busy == VM_SWAPOUT_LIMIT_MAX);
+	assert(vm_swapout_soc_busy == VM_SWAPOUT_CTX_MAX);
 
 	return NULL;
 }
@@ -1119,7 +1136,7 @@ vm_swapout_find_done_soc(void)
 	int      i;
 
 	if (vm_swapout_soc_done) {
-		for (i = 0; i < VM_SWAPOUT_LIMIT_MAX; i++) {
+		for (i = 0; i < VM_SWAPOUT_CTX_MAX; i++) {
 			if (vm_swapout_ctx[i].swp_io_done) {
 				return &vm_swapout_ctx[i];
 			}
@@ -1168,11 +1185,27 @@ bool memorystatus_swap_over_trigger(uint64_t adjustment_factor);
  */
 uint32_t swapout_sleep_threshold = 90;
 #endif /* CONFIG_JETSAM */
+/*
+ * Number of swapout writes that may be in flight right now.  Swap-ins
+ * for faulting threads take precedence: while any are outstanding we
+ * drop to VM_SWAPOUT_LIMIT_SWAPIN, and the full depth comes back as
+ * soon as the next swapout completes after they are done.
+ */
+static int
+vm_swapout_effective_limit(void)
+{
+	if (vm_swapout_limit > VM_SWAPOUT_LIMIT_SWAPIN &&
+	    os_atomic_load(&vm_swapin_fault_inflight, relaxed) != 0) {
+		return VM_SWAPOUT_LIMIT_SWAPIN;
+	}
+	return vm_swapout_limit;
+}
+
 static bool
 should_process_swapout_queue(const queue_head_t *swapout_list_head)
 {
 	bool process_queue = !queue_empty(swapout_list_head) &&
-	    vm_swapout_soc_busy < vm_swapout_limit &&
+	    vm_swapout_soc_busy < vm_swapout_effective_limit() &&
 	    !compressor_store_stop_compaction;
 #if CONFIG_JETSAM
 	if (memorystatus_swap_all_apps && swapout_list_head == &c_late_swapout_list_head) {
@@ -1629,12 +1662,28 @@ vm_swap_create_file()
 	return swap_file_created;
 }
 
+static void
+vm_swapin_latency_record(uint64_t start)
+{
+	uint64_t        nsecs, usecs;
+	unsigned int    bucket = 0;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &nsecs);
+	usecs = nsecs / NSEC_PER_USEC;
+	if (usecs) {
+		bucket = MIN(64 - __builtin_clzll(usecs), VM_SWAPIN_LATENCY_BUCKETS - 1);
+	}
+	os_atomic_inc(&vm_swapin_latency_histogram[bucket], relaxed);
+}
+
 extern void vnode_put(struct vnode* vp);
 kern_return_t
 vm_swap_get(c_segment_t c_seg, uint64_t f_offset, uint64_t size)
 {
 	struct swapfile *swf = NULL;
 	uint64_t        file_offset = 0;
+	uint64_t        start;
+	bool            for_fault;
 	int             retval = 0;
 
 	assert(c_seg->c_store.c_buffer);
@@ -1657,10 +1706,24 @@ vm_swap_get(c_segment_t c_seg, uint64_t f_offset, uint64_t size)
 #endif
 	file_offset = (f_offset & SWAP_SLOT_MASK);
 
+	/*
+	 * VM threads swap in for compaction and defragmentation; anyone
+	 * else is waiting on a fault and gets priority over swapouts.
+	 */
+	for_fault = !(current_thread()->options & TH_OPT_VMPRIV);
+
 	if ((retval = vnode_getwithref(swf->swp_vp)) != 0) {
 		printf("vm_swap_get: vnode_getwithref on swapfile failed with %d\n", retval);
 	} else {
+		if (for_fault) {
+			os_atomic_inc(&vm_swapin_fault_inflight, relaxed);
+		}
+		start = mach_absolute_time();
 		retval = vm_swapfile_io(swf->swp_vp, file_offset, (uint64_t)c_seg->c_store.c_buffer, (int)(size / PAGE_SIZE_64), SWAP_READ, NULL);
+		vm_swapin_latency_record(start);
+		if (for_fault) {
+			os_atomic_dec(&vm_swapin_fault_inflight, relaxed);
+		}
 		vnode_put(swf->swp_vp);
 	}
 
@@ -40,6 +40,7 @@
 #include <mach/thread_act.h>
 #include <mach/mach_vm.h>
 
+#include <kern/clock.h>
 #include <kern/host.h>
 #include <kern/kalloc.h>
 #include <kern/thread.h>
@@ -74,6 +75,45 @@
  * pages are mapped copy-on-write, so that the originals stay clean.
  */
 
+/*
+ * Learned working sets.
+ *
+ * The pages fixed up by a pager during the first dyld_ws_learn_ms of its
+ * life are remembered when the pager goes away, keyed by the executable's
+ * UUID and the backing object/offset of the mapping.  The next time the
+ * same executable maps the same image with map_with_linking_np(), those
+ * pages are faulted in as a batch before returning to dyld, instead of
+ * trickling in one fault at a time.
+ *
+ * A stale or mismatched entry only costs a few extra read faults within
+ * the new mapping's own ranges.
+ */
+#define DYLD_WS_MAX_PAGES       64
+#define DYLD_WS_ENTRIES         64
+
+struct dyld_ws_key {
+	uint8_t                 dwk_uuid[16];
+	vm_object_t             dwk_object;
+	memory_object_offset_t  dwk_file_offset;
+};
+
+struct dyld_ws_entry {
+	struct dyld_ws_key      dwe_key;
+	uint32_t                dwe_count;
+	memory_object_offset_t  dwe_offsets[DYLD_WS_MAX_PAGES];
+};
+
+static TUNABLE_WRITEABLE(uint32_t, dyld_ws_learn_ms, "vm_dyld_ws_learn_ms", 50);
+
+static struct dyld_ws_entry dyld_ws_table[DYLD_WS_ENTRIES];
+static uint32_t dyld_ws_next;
+LCK_GRP_DECLARE(dyld_ws_lck_grp, "dyld_ws");
+LCK_MTX_DECLARE(dyld_ws_lock, &dyld_ws_lck_grp);
+
+uint32_t dyld_ws_prefetch_count = 0;
+
+extern void proc_getexecutableuuid(void *, unsigned char *, unsigned long);
+
 /* forward declarations */
 typedef struct dyld_pager *dyld_pager_t;
 static void dyld_pager_reference(memory_object_t mem_obj);
@@ -152,6 +192,10 @@ struct dyld_pager {
 #if defined(HAS_APPLE_PAC)
 	uint64_t                dyld_a_key;
 #endif /* defined(HAS_APPLE_PAC) */
+	struct dyld_ws_key      dyld_ws_key;         /* learned working set key */
+	uint64_t                dyld_ws_deadline;    /* stop learning after this */
+	uint32_t                dyld_ws_count;       /* pages learned so far */
+	memory_object_offset_t  dyld_ws_offsets[DYLD_WS_MAX_PAGES];
 };
 
 
@@ -167,6 +211,129 @@ LCK_MTX_DECLARE(dyld_pager_lock, &dyld_pager_lck_grp);
 uint32_t dyld_pager_count = 0;
 uint32_t dyld_pager_count_max = 0;
 
+static void
+dyld_ws_key_init(
+	task_t                 task,
+	vm_object_t            backing_object,
+	memory_object_offset_t file_offset,
+	struct dyld_ws_key     *key)
+{
+	void *bsd_info = get_bsdtask_info(task);
+
+	bzero(key, sizeof(*key));
+	if (bsd_info != NULL) {
+		proc_getexecutableuuid(bsd_info, key->dwk_uuid, sizeof(key->dwk_uuid));
+	}
+	key->dwk_object = backing_object;
+	key->dwk_file_offset = file_offset;
+}
+
+/*
+ * Note which pages a young pager had to fix up.
+ */
+static void
+dyld_ws_record(
+	dyld_pager_t                 pager,
+	memory_object_offset_t       offset,
+	memory_object_cluster_size_t length)
+{
+	if (mach_absolute_time() > pager->dyld_ws_deadline) {
+		return;
+	}
+
+	for (memory_object_offset_t o = offset; o < offset + length; o += PAGE_SIZE) {
+		uint32_t slot = os_atomic_inc_orig(&pager->dyld_ws_count, relaxed);
+
+		if (slot >= DYLD_WS_MAX_PAGES) {
+			os_atomic_store(&pager->dyld_ws_count, DYLD_WS_MAX_PAGES, relaxed);
+			return;
+		}
+		pager->dyld_ws_offsets[slot] = o;
+	}
+}
+
+/*
+ * Save what a pager learned, called once it's no longer in use.
+ */
+static void
+dyld_ws_publish(dyld_pager_t pager)
+{
+	struct dyld_ws_entry *dwe = NULL;
+	uint32_t count = MIN(pager->dyld_ws_count, DYLD_WS_MAX_PAGES);
+
+	if (count == 0) {
+		return;
+	}
+
+	lck_mtx_lock(&dyld_ws_lock);
+	for (uint32_t i = 0; i < DYLD_WS_ENTRIES; i++) {
+		if (bcmp(&dyld_ws_table[i].dwe_key, &pager->dyld_ws_key,
+		    sizeof(pager->dyld_ws_key)) == 0) {
+			dwe = &dyld_ws_table[i];
+			break;
+		}
+	}
+	if (dwe == NULL) {
+		dwe = &dyld_ws_table[dyld_ws_next];
+		dyld_ws_next = (dyld_ws_next + 1) % DYLD_WS_ENTRIES;
+		dwe->dwe_key = pager->dyld_ws_key;
+	}
+	dwe->dwe_count = count;
+	memcpy(dwe->dwe_offsets, pager->dyld_ws_offsets,
+	    count * sizeof(dwe->dwe_offsets[0]));
+	lck_mtx_unlock(&dyld_ws_lock);
+}
+
+/*
+ * Fault in the pages learned from a previous mapping of the same image
+ * by the same executable.
+ */
+static void
+dyld_ws_prefetch(
+	vm_map_t                map,
+	const struct dyld_ws_key *key,
+	struct mwl_region       *regions,
+	uint32_t                region_cnt)
+{
+	memory_object_offset_t offsets[DYLD_WS_MAX_PAGES];
+	uint32_t count = 0;
+
+	lck_mtx_lock(&dyld_ws_lock);
+	for (uint32_t i = 0; i < DYLD_WS_ENTRIES; i++) {
+		struct dyld_ws_entry *dwe = &dyld_ws_table[i];
+
+		if (dwe->dwe_count != 0 &&
+		    bcmp(&dwe->dwe_key, key, sizeof(*key)) == 0) {
+			count = dwe->dwe_count;
+			memcpy(offsets, dwe->dwe_offsets, count * sizeof(offsets[0]));
+			break;
+		}
+	}
+	lck_mtx_unlock(&dyld_ws_lock);
+
+	for (uint32_t i = 0; i < count; i++) {
+		for (uint32_t r = 0; r < region_cnt; r++) {
+			struct mwl_region *rp = &regions[r];
+
+			if (offsets[i] < rp->mwlr_file_offset ||
+			    offsets[i] - rp->mwlr_file_offset >= rp->mwlr_size) {
+				continue;
+			}
+			(void)vm_fault(map,
+			    vm_map_trunc_page(rp->mwlr_address + (offsets[i] - rp->mwlr_file_offset),
+			    vm_map_page_mask(map)),
+			    VM_PROT_READ,
+			    FALSE,                     /* change_wiring */
+			    VM_KERN_MEMORY_NONE,       /* tag - not wiring */
+			    THREAD_UNINT,
+			    NULL,                      /* caller_pmap */
+			    0);                        /* caller_pmap_addr */
+			os_atomic_inc(&dyld_ws_prefetch_count, relaxed);
+			break;
+		}
+	}
+}
+
 /*
  * dyld_pager_init()
  *
@@ -701,6 +868,8 @@ dyld_pager_data_request(
 	assert(pager->dyld_is_mapped); /* pager is mapped */
 	hdr = (struct mwl_info_hdr *)pager->dyld_link_info;
 
+	dyld_ws_record(pager, offset, length);
+
 	/*
 	 * Gather in a UPL all the VM pages requested by VM.
 	 */
@@ -1027,6 +1196,8 @@ dyld_pager_deallocate_internal(
 		 */
 		lck_mtx_unlock(&dyld_pager_lock);
 
+		dyld_ws_publish(pager);
+
 		kfree_data(pager->dyld_link_info, pager->dyld_link_info_size);
 		pager->dyld_link_info = NULL;
 
@@ -1170,9 +1341,6 @@ dyld_pager_lookup(
  */
 static dyld_pager_t
 dyld_pager_create(
-#if !defined(HAS_APPLE_PAC)
-	__unused
-#endif /* defined(HAS_APPLE_PAC) */
 	task_t            task,
 	vm_object_t       backing_object,
 	struct mwl_region *regions,
@@ -1211,6 +1379,16 @@ dyld_pager_create(
 	pager->dyld_a_key = (task->map && task->map->pmap && !task->map->pmap->disable_jop) ? task->jop_pid : 0;
 #endif /* defined(HAS_APPLE_PAC) */
 
+	dyld_ws_key_init(task, backing_object, regions[0].mwlr_file_offset,
+	    &pager->dyld_ws_key);
+	pager->dyld_ws_count = 0;
+	if (dyld_ws_learn_ms != 0) {
+		clock_interval_to_deadline(dyld_ws_learn_ms, NSEC_PER_MSEC,
+		    &pager->dyld_ws_deadline);
+	} else {
+		pager->dyld_ws_deadline = 0;
+	}
+
 	/*
 	 * Record the regions so the pager can find the offset from an address.
 	 */
@@ -1307,6 +1485,7 @@ vm_map_with_linking(
 	int                     vm_flags;
 	vm_map_kernel_flags_t   vmk_flags;
 	kern_return_t           kr = KERN_SUCCESS;
+	struct dyld_ws_key      ws_key;
 
 	object = memory_object_control_to_vm_object(file_control);
 	if (object == VM_OBJECT_NULL || object->internal) {
@@ -1350,6 +1529,10 @@ vm_map_with_linking(
 		}
 	}
 
+	/* warm up the pages this executable needed last time */
+	dyld_ws_key_init(task, object, regions[0].mwlr_file_offset, &ws_key);
+	dyld_ws_prefetch(map, &ws_key, regions, region_cnt);
+
 	/* success! */
 	kr = KERN_SUCCESS;
 
@@ -47,6 +47,7 @@
 
 extern uint32_t dyld_pager_count;
 extern uint32_t dyld_pager_count_max;
+extern uint32_t dyld_ws_prefetch_count;
 
 /*
  * VM call to implement map_with_linking_np() system call.
@@ -646,6 +646,146 @@ vm_fault_deactivate_behind(
 }
 
 
+/*
+ * Maximum number of neighboring compressed pages decompressed
+ * on a sequential fault into a compressed range (0 disables it).
+ */
+TUNABLE_WRITEABLE(uint32_t, vm_fault_decompress_ahead_max, "vm_decompress_ahead", 4);
+#define VM_FAULT_DECOMPRESS_AHEAD_LIMIT 32
+
+SCALABLE_COUNTER_DEFINE(vm_fault_decompress_ahead_triggers);
+SCALABLE_COUNTER_DEFINE(vm_fault_decompress_ahead_hits);
+SCALABLE_COUNTER_DEFINE(vm_fault_decompress_ahead_misses);
+
+/*
+ * vm_fault_decompress_ahead
+ *
+ * Called after the compressed page at "offset" in "object" has been
+ * decompressed and inserted.  If the object is being accessed
+ * sequentially, decompress the next few pages in the direction of
+ * the run that are still in the compressor, so that the following
+ * faults find them resident.
+ *
+ * Never blocks: pages are grabbed without waiting, the compressor is
+ * called with C_DONT_BLOCK, and we stop at the first neighbor that
+ * isn't cheaply available.
+ *
+ * object must be locked exclusive.
+ */
+static void
+vm_fault_decompress_ahead(
+	vm_object_t             object,
+	vm_object_offset_t      offset)
+{
+	vm_object_offset_t      next_offset = offset;
+	vm_object_offset_t      delta;
+	vm_page_t               m;
+	int                     sequential_run;
+	int                     my_fault_type;
+	int                     compressed_count_delta;
+	uint32_t                max_pages;
+	uint32_t                n;
+	kern_return_t           kr;
+
+	vm_object_lock_assert_exclusive(object);
+
+	max_pages = MIN(vm_fault_decompress_ahead_max, VM_FAULT_DECOMPRESS_AHEAD_LIMIT);
+	if (max_pages == 0 ||
+	    !object->internal ||
+	    object->pager == MEMORY_OBJECT_NULL ||
+	    object == kernel_object ||
+	    object->phys_contiguous ||
+	    (object->wimg_bits & VM_WIMG_MASK) != VM_WIMG_USE_DEFAULT) {
+		return;
+	}
+
+	/*
+	 * require at least two consecutive pages in the run
+	 * before we start guessing at the next ones
+	 */
+	sequential_run = object->sequential;
+	if (sequential_run >= (int)(2 * PAGE_SIZE)) {
+		delta = PAGE_SIZE_64;
+	} else if (sequential_run <= -(int)(2 * PAGE_SIZE)) {
+		delta = 0 - PAGE_SIZE_64;
+	} else {
+		return;
+	}
+
+	counter_inc(&vm_fault_decompress_ahead_triggers);
+
+	for (n = 0; n < max_pages; n++) {
+		if (delta == PAGE_SIZE_64) {
+			if (next_offset + PAGE_SIZE_64 >= object->vo_size) {
+				break;
+			}
+		} else if (next_offset < PAGE_SIZE_64) {
+			break;
+		}
+		next_offset += delta;
+
+		if (vm_page_lookup(object, next_offset) != VM_PAGE_NULL) {
+			/* already resident, keep walking the run */
+			continue;
+		}
+		if (VM_COMPRESSOR_PAGER_STATE_GET(object, next_offset) != VM_EXTERNAL_STATE_EXISTS) {
+			counter_inc(&vm_fault_decompress_ahead_misses);
+			break;
+		}
+		if (vm_page_free_count <= vm_page_free_target) {
+			/* don't trade reclaimable memory for a guess */
+			counter_inc(&vm_fault_decompress_ahead_misses);
+			break;
+		}
+		m = vm_page_grab_options(VM_PAGE_GRAB_OPTIONS_NONE);
+		if (m == VM_PAGE_NULL) {
+			counter_inc(&vm_fault_decompress_ahead_misses);
+			break;
+		}
+
+		kr = vm_compressor_pager_get(object->pager,
+		    next_offset + object->paging_offset,
+		    VM_PAGE_GET_PHYS_PAGE(m),
+		    &my_fault_type,
+		    C_DONT_BLOCK,
+		    &compressed_count_delta);
+
+		vm_compressor_pager_count(object->pager,
+		    compressed_count_delta,
+		    FALSE, /* shared_lock */
+		    object);
+
+		if (kr != KERN_SUCCESS) {
+			vm_page_release(m, FALSE);
+			counter_inc(&vm_fault_decompress_ahead_misses);
+			break;
+		}
+		m->vmp_dirty = TRUE;
+
+		if (((object->purgable != VM_PURGABLE_DENY) ||
+		    object->vo_ledger_tag) &&
+		    (object->vo_owner != NULL)) {
+			/* one less compressed purgeable/tagged page */
+			vm_object_owner_compressed_update(object, -1);
+		}
+		vm_page_insert(m, object, next_offset);
+
+		/*
+		 * the page hasn't been touched yet: leave it on the
+		 * inactive queue so that a wrong guess is cheap to reclaim
+		 */
+		vm_page_lockspin_queues();
+		vm_page_deactivate(m);
+		vm_page_unlock_queues();
+
+		PAGE_WAKEUP_DONE(m);
+
+		VM_STAT_DECOMPRESSIONS();
+		counter_inc(&vm_fault_decompress_ahead_hits);
+	}
+}
+
+
 #if (DEVELOPMENT || DEBUG)
 uint32_t        vm_page_creation_throttled_hard = 0;
 uint32_t        vm_page_creation_throttled_soft = 0;
@@ -1754,6 +1894,11 @@ vm_fault_page(
 				}
 				PAGE_WAKEUP_DONE(m);
 
+				if (rc == KERN_SUCCESS) {
+					vm_fault_is_sequential(object, offset, fault_info->behavior);
+					vm_fault_decompress_ahead(object, vm_object_trunc_page(offset));
+				}
+
 				rc = KERN_SUCCESS;
 				goto data_requested;
 			}
@@ -3985,6 +4130,113 @@ int vm_fault_resilient_media_inject_error3_rate = 0;
 int vm_fault_resilient_media_inject_error3 = 0;
 #endif /* MACH_ASSERT */
 
+/*
+ * Number of pages around a read fault on a file mapping that
+ * vm_fault_around() will try to map (0 disables fault-around).
+ */
+TUNABLE_WRITEABLE(uint32_t, vm_fault_around_pages, "vm_fault_around", 0);
+#define VM_FAULT_AROUND_MAX_PAGES       32
+
+SCALABLE_COUNTER_DEFINE(vm_fault_around_attempts);
+SCALABLE_COUNTER_DEFINE(vm_fault_around_mapped);
+
+/*
+ * vm_fault_around
+ *
+ * After a successful read fault on a page of a file-backed object,
+ * opportunistically map the neighboring pages of the same object
+ * that are already resident and valid, so that a reader walking an
+ * mmapped file doesn't take a full fault for each of them.
+ *
+ * All the pages are entered while the map and object locks taken
+ * by the original fault are still held.  Pages that are busy,
+ * unusual, still need code-signing validation or are already mapped
+ * are skipped; we stop at the first pmap_enter failure or if the
+ * pmap would have to expand.
+ *
+ * object must be locked (shared is enough) and so must be the map.
+ */
+static void
+vm_fault_around(
+	vm_object_t             object,
+	vm_object_offset_t      offset,
+	pmap_t                  pmap,
+	vm_map_offset_t         vaddr,
+	vm_prot_t               prot,
+	vm_object_fault_info_t  fault_info)
+{
+	vm_object_offset_t      start, end, cur_offset;
+	vm_map_offset_t         cur_vaddr;
+	vm_page_t               m;
+	uint32_t                npages;
+	boolean_t               need_retry;
+	int                     type_of_fault;
+	kern_return_t           kr;
+
+	npages = MIN(vm_fault_around_pages, VM_FAULT_AROUND_MAX_PAGES);
+	if (npages <= 1) {
+		return;
+	}
+
+	counter_inc(&vm_fault_around_attempts);
+
+	/*
+	 * center the window on the faulting page and clip it
+	 * to the part of the object covered by this map entry
+	 */
+	start = offset - MIN(offset, (npages / 2) * PAGE_SIZE_64);
+	if (start < vm_object_trunc_page(fault_info->lo_offset)) {
+		start = vm_object_trunc_page(fault_info->lo_offset);
+	}
+	end = start + npages * PAGE_SIZE_64;
+	if (end > vm_object_trunc_page(fault_info->hi_offset)) {
+		end = vm_object_trunc_page(fault_info->hi_offset);
+	}
+	if (end > vm_object_round_page(object->vo_size)) {
+		end = vm_object_round_page(object->vo_size);
+	}
+
+	for (cur_offset = start; cur_offset < end; cur_offset += PAGE_SIZE_64) {
+		if (cur_offset == offset) {
+			continue;
+		}
+		m = vm_page_lookup(object, cur_offset);
+		if (m == VM_PAGE_NULL ||
+		    m->vmp_busy ||
+		    m->vmp_unusual ||
+		    m->vmp_fictitious ||
+		    m->vmp_private ||
+		    m->vmp_cleaning ||
+		    m->vmp_laundry ||
+		    m->vmp_q_state == VM_PAGE_ON_PAGEOUT_Q ||
+		    VM_PAGE_GET_PHYS_PAGE(m) == vm_page_guard_addr) {
+			continue;
+		}
+		if (vm_fault_cs_need_validation(pmap, m, object, PAGE_SIZE, 0)) {
+			/* validation needs the object lock exclusive: leave it to a real fault */
+			continue;
+		}
+		if (cur_offset > offset) {
+			cur_vaddr = vaddr + (vm_map_offset_t)(cur_offset - offset);
+		} else {
+			cur_vaddr = vaddr - (vm_map_offset_t)(offset - cur_offset);
+		}
+		if (pmap_find_phys(pmap, cur_vaddr) != 0) {
+			continue;
+		}
+
+		need_retry = FALSE;
+		type_of_fault = DBG_CACHE_HIT_FAULT;
+		kr = vm_fault_enter(m, pmap, cur_vaddr, PAGE_SIZE, 0,
+		    prot, VM_PROT_READ, FALSE, FALSE, VM_KERN_MEMORY_NONE,
+		    fault_info, &need_retry, &type_of_fault);
+		if (kr != KERN_SUCCESS || need_retry) {
+			break;
+		}
+		counter_inc(&vm_fault_around_mapped);
+	}
+}
+
 kern_return_t
 vm_fault_internal(
 	vm_map_t        map,
@@ -4172,6 +4424,22 @@ RetryFault:
 	 */
 	fault_type = original_fault_type;
 	map = original_map;
+
+	/*
+	 * Faults on unmapped addresses (guard regions, wild pointers,
+	 * speculative prefaulting...) can be answered without taking
+	 * the map lock, and without queueing behind a writer.
+	 */
+	if (!change_wiring && !resilient_media_retry) {
+		boolean_t mapped;
+
+		if (vm_map_lookup_entry_speculative(map, vaddr, &mapped) &&
+		    !mapped) {
+			kr = KERN_INVALID_ADDRESS;
+			goto done;
+		}
+	}
+
 	vm_map_lock_read(map);
 
 	if (resilient_media_retry) {
@@ -4754,6 +5022,21 @@ FastPmapEnter:
 					    &fault_info,
 					    need_retry_ptr,
 					    &type_of_fault);
+
+					if (kr == KERN_SUCCESS &&
+					    need_retry == FALSE &&
+					    vm_fault_around_pages != 0 &&
+					    top_object == VM_OBJECT_NULL &&
+					    m_object == object &&
+					    !object->internal &&
+					    !(fault_type & VM_PROT_WRITE) &&
+					    !(prot & VM_PROT_EXECUTE) &&
+					    !wired && !change_wiring &&
+					    physpage_p == NULL &&
+					    fault_page_size == PAGE_SIZE) {
+						vm_fault_around(object, vm_object_trunc_page(cur_offset),
+						    pmap, vaddr, prot, &fault_info);
+					}
 				}
 
 				vm_fault_complete(
@@ -5204,6 +5487,11 @@ FastPmapEnter:
 
 					VM_STAT_DECOMPRESSIONS();
 
+					if (m_object == cur_object) {
+						vm_fault_is_sequential(cur_object, cur_offset, fault_info.behavior);
+						vm_fault_decompress_ahead(cur_object, vm_object_trunc_page(cur_offset));
+					}
+
 					if (cur_object != object) {
 						if (insert_cur_object) {
 							top_object = object;
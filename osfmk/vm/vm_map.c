@@ -86,6 +86,7 @@
 #include <kern/counter.h>
 #include <kern/exc_guard.h>
 #include <kern/kalloc.h>
+#include <kern/smr.h>
 #include <kern/zalloc_internal.h>
 
 #include <vm/cpm.h>
@@ -1656,6 +1657,33 @@ vm_map_entry_dispose(
 	zfree(vm_map_entry_zone, entry);
 }
 
+static void
+vm_map_entry_free_smr(
+	void                    *entry)
+{
+	zfree(vm_map_entry_zone, entry);
+}
+
+/*
+ *	Like vm_map_entry_dispose(), for entries that were linked
+ *	into a map: vm_map_lookup_entry_speculative() might still be
+ *	walking through them, so the free is deferred until the
+ *	current SMR global critical sections are over.
+ */
+static void
+vm_map_entry_retire(
+	vm_map_entry_t          entry)
+{
+#if MAP_ENTRY_CREATION_DEBUG
+	btref_put(entry->vme_creation_bt);
+#endif
+#if MAP_ENTRY_INSERTION_DEBUG
+	btref_put(entry->vme_insertion_bt);
+#endif
+	smr_global_retire(entry, sizeof(struct vm_map_entry),
+	    vm_map_entry_free_smr);
+}
+
 #define vm_map_copy_entry_dispose(copy_entry) \
 	vm_map_entry_dispose(copy_entry)
 
@@ -1711,7 +1739,7 @@ vm_map_zap_dispose(
 			vm_object_deallocate(VME_OBJECT(entry));
 		}
 
-		vm_map_entry_dispose(entry);
+		vm_map_entry_retire(entry);
 	}
 }
 
@@ -1872,6 +1900,96 @@ vm_map_lookup_entry_allow_pgz(
 }
 #endif /* CONFIG_PROB_GZALLOC */
 
+SCALABLE_COUNTER_DEFINE(vm_map_lookup_speculative_success);
+SCALABLE_COUNTER_DEFINE(vm_map_lookup_speculative_fail);
+
+#define VM_MAP_LOCK_WRITER_MASK \
+	((1u << LCK_RW_WANT_EXCL_BIT) | (1u << LCK_RW_WANT_UPGRADE_BIT))
+
+/*
+ * RB trees are at most 2 * log2(n + 1) deep, which a map can't
+ * exceed with 32-bit entry counts: a longer walk means we raced
+ * with a rebalance and followed stale links.
+ */
+#define VM_MAP_SPECULATIVE_DEPTH_MAX    64
+
+/*
+ *	vm_map_lookup_entry_speculative:
+ *
+ *	Lockless probe for whether "address" is mapped in "map".
+ *
+ *	The RB tree is walked inside an SMR global critical section,
+ *	which keeps unlinked entries from being freed under us
+ *	(see vm_map_entry_retire()).  The result is validated against
+ *	concurrent writers using the lock word and the map timestamp,
+ *	which vm_map_unlock() bumps before dropping every exclusive hold.
+ *
+ *	Returns FALSE if the answer can't be trusted, in which case the
+ *	caller must fall back to a locked lookup.  Otherwise "*mapped"
+ *	says whether an entry contains "address".
+ *
+ *	Only user maps are supported.
+ */
+boolean_t
+vm_map_lookup_entry_speculative(
+	vm_map_t        map,
+	vm_map_offset_t address,
+	boolean_t       *mapped)        /* OUT */
+{
+	struct vm_map_store *rb_entry;
+	vm_map_entry_t       cur;
+	unsigned int         timestamp;
+	uint32_t             lock_word;
+	boolean_t            found = FALSE;
+	int                  depth = 0;
+
+	if (map->pmap == kernel_pmap) {
+		return FALSE;
+	}
+
+	smr_global_enter();
+
+	timestamp = os_atomic_load(&map->timestamp, acquire);
+	lock_word = os_atomic_load(&map->lock.lck_rw_data, acquire);
+	if (lock_word & VM_MAP_LOCK_WRITER_MASK) {
+		goto fail;
+	}
+
+	rb_entry = os_atomic_load(&RB_ROOT(&map->hdr.rb_head_store), relaxed);
+	while (rb_entry != NULL) {
+		if (++depth > VM_MAP_SPECULATIVE_DEPTH_MAX) {
+			goto fail;
+		}
+		cur = VME_FOR_STORE(rb_entry);
+		if (address >= os_atomic_load(&cur->vme_start, relaxed)) {
+			if (address < os_atomic_load(&cur->vme_end, relaxed)) {
+				found = TRUE;
+				break;
+			}
+			rb_entry = os_atomic_load(&RB_RIGHT(rb_entry, entry), relaxed);
+		} else {
+			rb_entry = os_atomic_load(&RB_LEFT(rb_entry, entry), relaxed);
+		}
+	}
+
+	os_atomic_thread_fence(acquire);
+	lock_word = os_atomic_load(&map->lock.lck_rw_data, acquire);
+	if ((lock_word & VM_MAP_LOCK_WRITER_MASK) ||
+	    os_atomic_load(&map->timestamp, relaxed) != timestamp) {
+		goto fail;
+	}
+
+	smr_global_leave();
+	counter_inc(&vm_map_lookup_speculative_success);
+	*mapped = found;
+	return TRUE;
+
+fail:
+	smr_global_leave();
+	counter_inc(&vm_map_lookup_speculative_fail);
+	return FALSE;
+}
+
 #if !ZSECURITY_CONFIG(KERNEL_DATA_SPLIT)
 /*
  *	Routine:	vm_map_adjust_direction
@@ -2455,7 +2573,7 @@ vm_map_enter(
 			 * to be supported, SUPERPAGE_SIZE has to be replaced
 			 * with a lookup of the size depending on superpage_size.
 			 */
-#ifdef __x86_64__
+#if defined(__x86_64__) || (defined(__arm64__) && __ARM_16K_PG__)
 		case SUPERPAGE_SIZE_ANY:
 			/* handle it like 2 MB and round up to page size */
 			size = (size + 2 * 1024 * 1024 - 1) & ~(2 * 1024 * 1024 - 1);
@@ -2466,6 +2584,10 @@ vm_map_enter(
 		default:
 			return KERN_INVALID_ARGUMENT;
 		}
+		if (VM_MAP_PAGE_SHIFT(map) != PAGE_SHIFT) {
+			/* superpages are made of native pages */
+			return KERN_INVALID_ARGUMENT;
+		}
 		mask = SUPERPAGE_SIZE - 1;
 		if (size & (SUPERPAGE_SIZE - 1)) {
 			return KERN_INVALID_ARGUMENT;
@@ -5792,102 +5914,34 @@ vm_map_range_check(
 }
 
 /*
- *	vm_map_protect:
+ *	vm_map_protect_locked:
  *
- *	Sets the protection of the specified address
- *	region in the target map.  If "set_max" is
- *	specified, the maximum protection is to be set;
- *	otherwise, only the current protection is affected.
+ *	Guts of vm_map_protect(), called and returning with the map locked.
+ *	Pending TLB invalidations are accumulated in "pfc" rather than
+ *	issued, so that callers can coalesce them across several ranges.
  */
-kern_return_t
-vm_map_protect(
-	vm_map_t        map,
-	vm_map_offset_t start,
-	vm_map_offset_t end,
-	vm_prot_t       new_prot,
-	boolean_t       set_max)
+static kern_return_t
+vm_map_protect_locked(
+	vm_map_t                map,
+	vm_map_offset_t         start,
+	vm_map_offset_t         end,
+	vm_prot_t               new_prot,
+	boolean_t               set_max,
+	pmap_flush_context      *pfc)
 {
 	vm_map_entry_t                  current;
 	vm_map_offset_t                 prev;
 	vm_map_entry_t                  entry;
 	vm_prot_t                       new_max;
 	int                             pmap_options = 0;
-	kern_return_t                   kr;
-
-	if (new_prot & VM_PROT_COPY) {
-		vm_map_offset_t         new_start;
-		vm_prot_t               cur_prot, max_prot;
-		vm_map_kernel_flags_t   kflags;
-
-		/* LP64todo - see below */
-		if (start >= map->max_offset) {
-			return KERN_INVALID_ADDRESS;
-		}
-
-		if ((new_prot & VM_PROT_ALLEXEC) &&
-		    map->pmap != kernel_pmap &&
-		    (vm_map_cs_enforcement(map)
-#if XNU_TARGET_OS_OSX && __arm64__
-		    || !VM_MAP_IS_EXOTIC(map)
-#endif /* XNU_TARGET_OS_OSX && __arm64__ */
-		    ) &&
-		    VM_MAP_POLICY_WX_FAIL(map)) {
-			DTRACE_VM3(cs_wx,
-			    uint64_t, (uint64_t) start,
-			    uint64_t, (uint64_t) end,
-			    vm_prot_t, new_prot);
-			printf("CODE SIGNING: %d[%s] %s can't have both write and exec at the same time\n",
-			    proc_selfpid(),
-			    (get_bsdtask_info(current_task())
-			    ? proc_name_address(get_bsdtask_info(current_task()))
-			    : "?"),
-			    __FUNCTION__);
-			return KERN_PROTECTION_FAILURE;
-		}
-
-		/*
-		 * Let vm_map_remap_extract() know that it will need to:
-		 * + make a copy of the mapping
-		 * + add VM_PROT_WRITE to the max protections
-		 * + remove any protections that are no longer allowed from the
-		 *   max protections (to avoid any WRITE/EXECUTE conflict, for
-		 *   example).
-		 * Note that "max_prot" is an IN/OUT parameter only for this
-		 * specific (VM_PROT_COPY) case.  It's usually an OUT parameter
-		 * only.
-		 */
-		max_prot = new_prot & (VM_PROT_ALL | VM_PROT_ALLEXEC);
-		cur_prot = VM_PROT_NONE;
-		kflags = VM_MAP_KERNEL_FLAGS_NONE;
-		kflags.vmkf_remap_prot_copy = TRUE;
-		new_start = start;
-		kr = vm_map_remap(map,
-		    &new_start,
-		    end - start,
-		    0, /* mask */
-		    VM_FLAGS_FIXED | VM_FLAGS_OVERWRITE,
-		    kflags,
-		    0,
-		    map,
-		    start,
-		    TRUE, /* copy-on-write remapping! */
-		    &cur_prot, /* IN/OUT */
-		    &max_prot, /* IN/OUT */
-		    VM_INHERIT_DEFAULT);
-		if (kr != KERN_SUCCESS) {
-			return kr;
-		}
-		new_prot &= ~VM_PROT_COPY;
-	}
 
-	vm_map_lock(map);
+	vm_map_lock_assert_exclusive(map);
 
 	/* LP64todo - remove this check when vm_map_commpage64()
 	 * no longer has to stuff in a map_entry for the commpage
 	 * above the map's max_offset.
 	 */
 	if (start >= map->max_offset) {
-		vm_map_unlock(map);
 		return KERN_INVALID_ADDRESS;
 	}
 
@@ -5897,17 +5951,17 @@ vm_map_protect(
 		 *	entry, return an error.
 		 */
 		if (!vm_map_lookup_entry(map, start, &entry)) {
-			vm_map_unlock(map);
 			return KERN_INVALID_ADDRESS;
 		}
 
-		if (entry->superpage_size && (start & (SUPERPAGE_SIZE - 1))) { /* extend request to whole entry */
+		if (!SUPERPAGE_SPLITTABLE &&
+		    entry->superpage_size && (start & (SUPERPAGE_SIZE - 1))) { /* extend request to whole entry */
 			start = SUPERPAGE_ROUND_DOWN(start);
 			continue;
 		}
 		break;
 	}
-	if (entry->superpage_size) {
+	if (!SUPERPAGE_SPLITTABLE && entry->superpage_size) {
 		end = SUPERPAGE_ROUND_UP(end);
 	}
 
@@ -5924,7 +5978,6 @@ vm_map_protect(
 		 * If there is a hole, return an error.
 		 */
 		if (current->vme_start != prev) {
-			vm_map_unlock(map);
 			return KERN_INVALID_ADDRESS;
 		}
 
@@ -5937,20 +5990,17 @@ vm_map_protect(
 		}
 #endif
 		if ((new_prot & new_max) != new_prot) {
-			vm_map_unlock(map);
 			return KERN_PROTECTION_FAILURE;
 		}
 
 		if (current->used_for_jit &&
 		    pmap_has_prot_policy(map->pmap, current->translated_allow_execute, current->protection)) {
-			vm_map_unlock(map);
 			return KERN_PROTECTION_FAILURE;
 		}
 
 #if __arm64e__
 		/* Disallow remapping hw assisted TPRO mappings */
 		if (current->used_for_tpro) {
-			vm_map_unlock(map);
 			return KERN_PROTECTION_FAILURE;
 		}
 #endif /* __arm64e__ */
@@ -5979,7 +6029,6 @@ vm_map_protect(
 			    __FUNCTION__);
 			new_prot &= ~VM_PROT_ALLEXEC;
 			if (VM_MAP_POLICY_WX_FAIL(map)) {
-				vm_map_unlock(map);
 				return KERN_PROTECTION_FAILURE;
 			}
 		}
@@ -5993,7 +6042,6 @@ vm_map_protect(
 		if (map->map_disallow_new_exec == TRUE) {
 			if ((new_prot & VM_PROT_ALLEXEC) ||
 			    ((current->protection & VM_PROT_EXECUTE) && (new_prot & VM_PROT_WRITE))) {
-				vm_map_unlock(map);
 				return KERN_PROTECTION_FAILURE;
 			}
 		}
@@ -6025,7 +6073,6 @@ vm_map_protect(
 #endif /* __arm64__ */
 
 	if (end > prev) {
-		vm_map_unlock(map);
 		return KERN_INVALID_ADDRESS;
 	}
 
@@ -6033,6 +6080,10 @@ vm_map_protect(
 	 *	Go back and fix up protections.
 	 *	Clip to start here if the range starts within
 	 *	the entry.
+	 *
+	 *	TLB invalidations for the entries we downgrade are
+	 *	batched into "pfc", which the caller must flush before
+	 *	the map is unlocked.
 	 */
 
 	current = entry;
@@ -6142,8 +6193,8 @@ vm_map_protect(
 				    current->vme_start,
 				    current->vme_end,
 				    prot,
-				    pmap_options,
-				    NULL);
+				    pmap_options | PMAP_OPTIONS_NOFLUSH,
+				    pfc);
 			}
 		}
 		current = current->vme_next;
@@ -6156,10 +6207,104 @@ vm_map_protect(
 		current = current->vme_next;
 	}
 
-	vm_map_unlock(map);
 	return KERN_SUCCESS;
 }
 
+/*
+ *	vm_map_protect:
+ *
+ *	Sets the protection of the specified address
+ *	region in the target map.  If "set_max" is
+ *	specified, the maximum protection is to be set;
+ *	otherwise, only the current protection is affected.
+ */
+kern_return_t
+vm_map_protect(
+	vm_map_t        map,
+	vm_map_offset_t start,
+	vm_map_offset_t end,
+	vm_prot_t       new_prot,
+	boolean_t       set_max)
+{
+	pmap_flush_context              pmap_flush_context_storage;
+	kern_return_t                   kr;
+
+	if (new_prot & VM_PROT_COPY) {
+		vm_map_offset_t         new_start;
+		vm_prot_t               cur_prot, max_prot;
+		vm_map_kernel_flags_t   kflags;
+
+		/* LP64todo - see below */
+		if (start >= map->max_offset) {
+			return KERN_INVALID_ADDRESS;
+		}
+
+		if ((new_prot & VM_PROT_ALLEXEC) &&
+		    map->pmap != kernel_pmap &&
+		    (vm_map_cs_enforcement(map)
+#if XNU_TARGET_OS_OSX && __arm64__
+		    || !VM_MAP_IS_EXOTIC(map)
+#endif /* XNU_TARGET_OS_OSX && __arm64__ */
+		    ) &&
+		    VM_MAP_POLICY_WX_FAIL(map)) {
+			DTRACE_VM3(cs_wx,
+			    uint64_t, (uint64_t) start,
+			    uint64_t, (uint64_t) end,
+			    vm_prot_t, new_prot);
+			printf("CODE SIGNING: %d[%s] %s can't have both write and exec at the same time\n",
+			    proc_selfpid(),
+			    (get_bsdtask_info(current_task())
+			    ? proc_name_address(get_bsdtask_info(current_task()))
+			    : "?"),
+			    __FUNCTION__);
+			return KERN_PROTECTION_FAILURE;
+		}
+
+		/*
+		 * Let vm_map_remap_extract() know that it will need to:
+		 * + make a copy of the mapping
+		 * + add VM_PROT_WRITE to the max protections
+		 * + remove any protections that are no longer allowed from the
+		 *   max protections (to avoid any WRITE/EXECUTE conflict, for
+		 *   example).
+		 * Note that "max_prot" is an IN/OUT parameter only for this
+		 * specific (VM_PROT_COPY) case.  It's usually an OUT parameter
+		 * only.
+		 */
+		max_prot = new_prot & (VM_PROT_ALL | VM_PROT_ALLEXEC);
+		cur_prot = VM_PROT_NONE;
+		kflags = VM_MAP_KERNEL_FLAGS_NONE;
+		kflags.vmkf_remap_prot_copy = TRUE;
+		new_start = start;
+		kr = vm_map_remap(map,
+		    &new_start,
+		    end - start,
+		    0, /* mask */
+		    VM_FLAGS_FIXED | VM_FLAGS_OVERWRITE,
+		    kflags,
+		    0,
+		    map,
+		    start,
+		    TRUE, /* copy-on-write remapping! */
+		    &cur_prot, /* IN/OUT */
+		    &max_prot, /* IN/OUT */
+		    VM_INHERIT_DEFAULT);
+		if (kr != KERN_SUCCESS) {
+			return kr;
+		}
+		new_prot &= ~VM_PROT_COPY;
+	}
+
+	vm_map_lock(map);
+	pmap_flush_context_init(&pmap_flush_context_storage);
+	kr = vm_map_protect_locked(map, start, end, new_prot, set_max,
+	    &pmap_flush_context_storage);
+	pmap_flush(&pmap_flush_context_storage);
+	vm_map_unlock(map);
+
+	return kr;
+}
+
 /*
  *	vm_map_inherit:
  *
@@ -7906,13 +8051,14 @@ __options_decl(vm_map_delete_state_t, uint32_t, {
  *	This routine is called with map locked and leaves map locked.
  */
 static kmem_return_t
-vm_map_delete(
+vm_map_delete_flush_context(
 	vm_map_t                map,
 	vm_map_offset_t         start,
 	vm_map_offset_t         end,
 	vmr_flags_t             flags,
 	kmem_guard_t            guard,
-	vm_map_zap_t            zap_list)
+	vm_map_zap_t            zap_list,
+	pmap_flush_context      *caller_pfc)
 {
 	vm_map_entry_t          entry, next;
 	int                     interruptible;
@@ -7922,6 +8068,20 @@ vm_map_delete(
 	__unused vm_map_offset_t save_end = end;
 	vm_map_delete_state_t   state = VMDS_NONE;
 	kmem_return_t           ret = { };
+	pmap_flush_context      pmap_flush_context_storage;
+	pmap_flush_context      *pfc = caller_pfc;
+
+	/*
+	 * TLB invalidations for the ranges removed below are batched, and
+	 * must be issued before the map lock is dropped for any reason,
+	 * since the range could otherwise be reused with stale
+	 * translations still cached.  When the caller provides the flush
+	 * context, issuing the final flush is left to it.
+	 */
+	if (pfc == NULL) {
+		pfc = &pmap_flush_context_storage;
+		pmap_flush_context_init(pfc);
+	}
 
 	if (vm_map_pmap(map) == kernel_pmap) {
 		state |= VMDS_KERNEL_PMAP;
@@ -8295,6 +8455,7 @@ in_transition:
 				state &= ~VMDS_NEEDS_WAKEUP;
 			}
 
+			pmap_flush(pfc);
 			wait_result = vm_map_entry_wait(map, interruptible);
 
 			if (interruptible &&
@@ -8366,6 +8527,7 @@ in_transition:
 				wait_result_t wait_result;
 
 				entry->needs_wakeup = TRUE;
+				pmap_flush(pfc);
 				wait_result = vm_map_entry_wait(map,
 				    interruptible);
 
@@ -8405,6 +8567,7 @@ in_transition:
 			last_timestamp = map->timestamp;
 			entry->in_transition = TRUE;
 			tmp_entry = *entry;
+			pmap_flush(pfc);
 			vm_map_unlock(map);
 
 			if (tmp_entry.is_sub_map) {
@@ -8593,10 +8756,11 @@ in_transition:
 			 * do not have such VM invisible
 			 * translations.
 			 */
-			pmap_remove_options(map->pmap,
+			pmap_remove_options_flush_context(map->pmap,
 			    (addr64_t)entry->vme_start,
 			    (addr64_t)entry->vme_end,
-			    PMAP_OPTIONS_REMOVE);
+			    PMAP_OPTIONS_REMOVE,
+			    pfc);
 		}
 
 #if DEBUG
@@ -8665,6 +8829,8 @@ in_transition:
 		if ((flags & VM_MAP_REMOVE_NO_YIELD) == 0 && s < end) {
 			unsigned int last_timestamp = map->timestamp++;
 
+			pmap_flush(pfc);
+
 			if (lck_rw_lock_yield_exclusive(&map->lock,
 			    LCK_RW_YIELD_ANY_WAITER)) {
 				if (last_timestamp != map->timestamp + 1) {
@@ -8686,6 +8852,10 @@ in_transition:
 	}
 
 out:
+	if (caller_pfc == NULL) {
+		pmap_flush(pfc);
+	}
+
 	if ((state & VMDS_KERNEL_PMAP) && ret.kmr_return) {
 		__vm_map_delete_failed_panic(map, start, end, ret.kmr_return);
 	}
@@ -8705,6 +8875,19 @@ out:
 	return ret;
 }
 
+static kmem_return_t
+vm_map_delete(
+	vm_map_t                map,
+	vm_map_offset_t         start,
+	vm_map_offset_t         end,
+	vmr_flags_t             flags,
+	kmem_guard_t            guard,
+	vm_map_zap_t            zap_list)
+{
+	return vm_map_delete_flush_context(map, start, end, flags, guard,
+	           zap_list, NULL);
+}
+
 kmem_return_t
 vm_map_remove_and_unlock(
 	vm_map_t        map,
@@ -8742,6 +8925,119 @@ vm_map_remove_guard(
 	return vm_map_remove_and_unlock(map, start, end, flags, guard);
 }
 
+/*
+ *	vm_map_range_apply:
+ *
+ *	Applies a list of deallocate, protect and behavior operations to
+ *	the target map, in order.  Consecutive deallocate and protect
+ *	operations are applied under a single hold of the map lock, and
+ *	their TLB invalidations are coalesced into one flush issued before
+ *	the lock is dropped.  Behavior operations manage the map lock on
+ *	their own and end the current locked run.
+ *
+ *	Stops at the first failing operation, and returns the number of
+ *	operations that were applied in "applied".
+ */
+kern_return_t
+vm_map_range_apply(
+	vm_map_t                map,
+	const struct mach_vm_range_op *ops,
+	mach_vm_size_t          count,
+	mach_vm_size_t          *applied)
+{
+	pmap_flush_context      pmap_flush_context_storage;
+	kern_return_t           kr = KERN_SUCCESS;
+	bool                    locked = false;
+	mach_vm_size_t          i;
+	VM_MAP_ZAP_DECLARE(zap);
+
+	if (map == VM_MAP_NULL || vm_map_pmap(map) == kernel_pmap) {
+		*applied = 0;
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	for (i = 0; i < count; i++) {
+		const struct mach_vm_range_op *op = &ops[i];
+		vm_map_offset_t align_mask = VM_MAP_PAGE_MASK(map);
+		vm_map_offset_t start, end;
+
+		if (op->address + op->size < op->address) {
+			kr = KERN_INVALID_ARGUMENT;
+			break;
+		}
+		if (op->size == 0) {
+			continue;
+		}
+
+		if (op->op == MACH_VM_RANGE_OP_BEHAVIOR) {
+			switch (op->arg) {
+			case VM_BEHAVIOR_REUSABLE:
+			case VM_BEHAVIOR_REUSE:
+			case VM_BEHAVIOR_CAN_REUSE:
+				/* same alignment as mach_vm_behavior_set() */
+				align_mask = PAGE_MASK;
+				break;
+			default:
+				break;
+			}
+			if (locked) {
+				pmap_flush(&pmap_flush_context_storage);
+				vm_map_unlock(map);
+				locked = false;
+			}
+			kr = vm_map_behavior_set(map,
+			    vm_map_trunc_page(op->address, align_mask),
+			    vm_map_round_page(op->address + op->size, align_mask),
+			    op->arg);
+			if (kr != KERN_SUCCESS) {
+				break;
+			}
+			continue;
+		}
+
+		start = vm_map_trunc_page(op->address, align_mask);
+		end = vm_map_round_page(op->address + op->size, align_mask);
+
+		if (!locked) {
+			vm_map_lock(map);
+			pmap_flush_context_init(&pmap_flush_context_storage);
+			locked = true;
+		}
+
+		switch (op->op) {
+		case MACH_VM_RANGE_OP_DEALLOCATE:
+			kr = vm_map_delete_flush_context(map, start, end,
+			    VM_MAP_REMOVE_NO_FLAGS, KMEM_GUARD_NONE, &zap,
+			    &pmap_flush_context_storage).kmr_return;
+			break;
+		case MACH_VM_RANGE_OP_PROTECT:
+			/* VM_PROT_COPY needs a remap, which can't be done here */
+			if (op->arg & ~VM_PROT_ALL) {
+				kr = KERN_INVALID_ARGUMENT;
+				break;
+			}
+			kr = vm_map_protect_locked(map, start, end,
+			    (vm_prot_t)op->arg, FALSE, &pmap_flush_context_storage);
+			break;
+		default:
+			kr = KERN_INVALID_ARGUMENT;
+			break;
+		}
+		if (kr != KERN_SUCCESS) {
+			break;
+		}
+	}
+
+	if (locked) {
+		pmap_flush(&pmap_flush_context_storage);
+		vm_map_unlock(map);
+	}
+	vm_map_zap_dispose(&zap);
+
+	*applied = i;
+	return kr;
+}
+
 /*
  *	vm_map_terminate:
  *
@@ -11576,6 +11872,126 @@ vm_map_copyin_common(
 	           flags,
 	           copy_result);
 }
+/*
+ *	Routine:	vm_map_copyin_move	[internal use only]
+ *
+ *	Description:
+ *		Move a page-aligned region out of the source map by
+ *		unlinking its entries into a copy object, instead of
+ *		setting up copy-on-write and then deleting the source.
+ *		The receiver maps the very same objects, so neither
+ *		side takes a copy-on-write fault.
+ *
+ *		Only private anonymous memory that the caller could
+ *		have deallocated anyway qualifies; anything else
+ *		returns KERN_NOT_SUPPORTED and is left untouched,
+ *		for the caller to fall back to a regular copyin.
+ */
+static kern_return_t
+vm_map_copyin_move(
+	vm_map_t        src_map,
+	vm_map_address_t src_addr,
+	vm_map_size_t   len,
+	vm_map_copy_t   *copy_result)   /* OUT */
+{
+	vm_map_offset_t src_end = src_addr + len;
+	vm_map_offset_t addr;
+	vm_map_entry_t  entry, next, new_entry;
+	vm_map_copy_t   copy;
+	VM_MAP_ZAP_DECLARE(zap);
+
+	if (VM_MAP_PAGE_SHIFT(src_map) != PAGE_SHIFT ||
+	    !page_aligned(src_addr) || !page_aligned(len) ||
+	    src_map->mapped_in_other_pmaps) {
+		return KERN_NOT_SUPPORTED;
+	}
+
+	vm_map_lock(src_map);
+
+	if (!vm_map_lookup_entry(src_map, src_addr, &entry)) {
+		vm_map_unlock(src_map);
+		return KERN_NOT_SUPPORTED;
+	}
+
+	/*
+	 * Check the whole range before changing anything.
+	 */
+	for (next = entry, addr = src_addr; addr < src_end; next = next->vme_next) {
+		vm_object_t object;
+		bool eligible;
+
+		if (next == vm_map_to_entry(src_map) || next->vme_start > addr) {
+			/* hole in the range */
+			vm_map_unlock(src_map);
+			return KERN_NOT_SUPPORTED;
+		}
+		if (next->is_sub_map || next->is_shared || next->in_transition ||
+		    next->wired_count || next->user_wired_count ||
+		    next->vme_permanent || next->vme_atomic ||
+		    next->used_for_jit || next->superpage_size ||
+		    next->iokit_acct || !next->use_pmap ||
+		    !(next->protection & VM_PROT_READ)) {
+			vm_map_unlock(src_map);
+			return KERN_NOT_SUPPORTED;
+		}
+		addr = next->vme_end;
+
+		object = VME_OBJECT(next);
+		if (object == VM_OBJECT_NULL) {
+			continue;
+		}
+		vm_object_lock_shared(object);
+		eligible = object->internal && !object->true_share &&
+		    !object->phys_contiguous &&
+		    object->purgable == VM_PURGABLE_DENY;
+		vm_object_unlock(object);
+		if (!eligible) {
+			vm_map_unlock(src_map);
+			return KERN_NOT_SUPPORTED;
+		}
+	}
+
+	copy = vm_map_copy_allocate();
+	copy->type = VM_MAP_COPY_ENTRY_LIST;
+	copy->cpy_hdr.entries_pageable = src_map->hdr.entries_pageable;
+	copy->cpy_hdr.page_shift = (uint16_t)VM_MAP_PAGE_SHIFT(src_map);
+	vm_map_store_init(&copy->cpy_hdr);
+	copy->offset = src_addr;
+	copy->size = len;
+
+	vm_map_clip_start(src_map, entry, src_addr);
+
+	pmap_remove(src_map->pmap, (addr64_t)src_addr, (addr64_t)src_end);
+
+	/*
+	 * The entries can't be handed over as they are: lockless lookups
+	 * (vm_map_lookup_entry_speculative()) may still be walking them.
+	 * Move their contents, and the object references, to fresh copy
+	 * entries and retire the unlinked ones like vm_map_delete() does.
+	 */
+	while (entry != vm_map_to_entry(src_map) && entry->vme_start < src_end) {
+		vm_map_clip_end(src_map, entry, src_end);
+		next = entry->vme_next;
+
+		new_entry = vm_map_copy_entry_create(copy);
+		vm_map_entry_copy_full(new_entry, entry);
+		vm_map_copy_entry_link(copy, vm_map_copy_last_entry(copy), new_entry);
+
+		vm_map_entry_zap(src_map, entry, &zap);
+
+		entry = next;
+	}
+
+	vm_map_unlock(src_map);
+
+	while ((entry = vm_map_zap_pop(&zap))) {
+		vm_map_entry_retire(entry);
+	}
+
+	*copy_result = copy;
+	return KERN_SUCCESS;
+}
+
 kern_return_t
 vm_map_copyin_internal(
 	vm_map_t        src_map,
@@ -11620,7 +12036,7 @@ vm_map_copyin_internal(
 	}
 #endif /* CONFIG_KERNEL_TBI && KASAN_TBI */
 
-	src_destroy = (flags & VM_MAP_COPYIN_SRC_DESTROY) ? TRUE : FALSE;
+	src_destroy = (flags & (VM_MAP_COPYIN_SRC_DESTROY | VM_MAP_COPYIN_MOVE)) ? TRUE : FALSE;
 	use_maxprot = (flags & VM_MAP_COPYIN_USE_MAXPROT) ? TRUE : FALSE;
 	preserve_purgeable =
 	    (flags & VM_MAP_COPYIN_PRESERVE_PURGEABLE) ? TRUE : FALSE;
@@ -11675,6 +12091,11 @@ vm_map_copyin_internal(
 		           src_destroy, copy_result);
 	}
 
+	if ((flags & VM_MAP_COPYIN_MOVE) && !use_maxprot && !preserve_purgeable &&
+	    vm_map_copyin_move(src_map, src_addr, len, copy_result) == KERN_SUCCESS) {
+		return KERN_SUCCESS;
+	}
+
 	/*
 	 *	Allocate a header element for the list.
 	 *
@@ -13016,6 +13437,9 @@ vm_map_fork(
 	vm_inherit_t    old_entry_inheritance;
 	int             map_create_options;
 	kern_return_t   footprint_collect_kr;
+	pmap_flush_context pmap_flush_context_storage;
+	boolean_t       delayed_pmap_flush = FALSE;
+	unsigned int    fork_entries = 0;
 
 	if (options & ~(VM_MAP_FORK_SHARE_IF_INHERIT_NONE |
 	    VM_MAP_FORK_PRESERVE_PURGEABLE |
@@ -13055,6 +13479,10 @@ vm_map_fork(
 	vm_map_reference(old_map);
 	vm_map_lock(old_map);
 
+	VM_DEBUG_CONSTANT_EVENT(vm_map_fork, VM_MAP_FORK, DBG_FUNC_START,
+	    old_map->hdr.nentries, old_map->size, options, 0);
+	pmap_flush_context_init(&pmap_flush_context_storage);
+
 	map_create_options = 0;
 	if (old_map->hdr.entries_pageable) {
 		map_create_options |= VM_MAP_CREATE_PAGEABLE;
@@ -13114,10 +13542,15 @@ vm_map_fork(
 			}
 #endif /* PMAP_FORK_NEST */
 			vm_map_corpse_footprint_collect_done(new_map);
+			if (delayed_pmap_flush) {
+				pmap_flush(&pmap_flush_context_storage);
+			}
 			vm_map_unlock(new_map);
 			vm_map_unlock(old_map);
 			vm_map_deallocate(new_map);
 			vm_map_deallocate(old_map);
+			VM_DEBUG_CONSTANT_EVENT(vm_map_fork, VM_MAP_FORK, DBG_FUNC_END,
+			    fork_entries, 0, KERN_ABORTED, 0);
 			printf("Aborting corpse map due to system shutdown\n");
 			return VM_MAP_NULL;
 		}
@@ -13269,18 +13702,35 @@ vm_map_fork(
 
 				assert(!pmap_has_prot_policy(old_map->pmap, old_entry->translated_allow_execute, prot));
 
-				vm_object_pmap_protect(
-					VME_OBJECT(old_entry),
-					VME_OFFSET(old_entry),
-					(old_entry->vme_end -
-					old_entry->vme_start),
-					((old_entry->is_shared
-					|| old_map->mapped_in_other_pmaps)
-					? PMAP_NULL :
-					old_map->pmap),
-					VM_MAP_PAGE_SIZE(old_map),
-					old_entry->vme_start,
-					prot);
+				if (old_entry->is_shared ||
+				    old_map->mapped_in_other_pmaps ||
+				    VME_OBJECT(old_entry) == VM_OBJECT_NULL) {
+					vm_object_pmap_protect(
+						VME_OBJECT(old_entry),
+						VME_OFFSET(old_entry),
+						(old_entry->vme_end -
+						old_entry->vme_start),
+						PMAP_NULL,
+						VM_MAP_PAGE_SIZE(old_map),
+						old_entry->vme_start,
+						prot);
+				} else {
+					/*
+					 * Only our own pmap maps this range: write-protect
+					 * it directly and defer the TLB invalidation, so
+					 * a big parent pays for one flush instead of one
+					 * per entry.  The flush happens before old_map is
+					 * unlocked, so no write can go through a stale
+					 * translation once the child exists.
+					 */
+					pmap_protect_options(old_map->pmap,
+					    old_entry->vme_start,
+					    old_entry->vme_end,
+					    prot,
+					    PMAP_OPTIONS_NOFLUSH,
+					    &pmap_flush_context_storage);
+					delayed_pmap_flush = TRUE;
+				}
 
 				assert(old_entry->wired_count == 0);
 				old_entry->needs_copy = TRUE;
@@ -13297,9 +13747,16 @@ vm_map_fork(
 			    new_entry,
 			    VM_MAP_KERNEL_FLAGS_NONE);
 			new_size += entry_size;
+			fork_entries++;
 			break;
 
 slow_vm_map_fork_copy:
+			/* vm_map_fork_copy() can drop the map lock */
+			if (delayed_pmap_flush) {
+				pmap_flush(&pmap_flush_context_storage);
+				pmap_flush_context_init(&pmap_flush_context_storage);
+				delayed_pmap_flush = FALSE;
+			}
 			vm_map_copyin_flags = 0;
 			if (options & VM_MAP_FORK_PRESERVE_PURGEABLE) {
 				vm_map_copyin_flags |=
@@ -13310,6 +13767,7 @@ slow_vm_map_fork_copy:
 			    new_map,
 			    vm_map_copyin_flags)) {
 				new_size += entry_size;
+				fork_entries++;
 			}
 			continue;
 		}
@@ -13347,10 +13805,17 @@ slow_vm_map_fork_copy:
 		pmap_set_jit_entitled(new_map->pmap);
 	}
 
+	if (delayed_pmap_flush) {
+		pmap_flush(&pmap_flush_context_storage);
+	}
+
 	vm_map_unlock(new_map);
 	vm_map_unlock(old_map);
 	vm_map_deallocate(old_map);
 
+	VM_DEBUG_CONSTANT_EVENT(vm_map_fork, VM_MAP_FORK, DBG_FUNC_END,
+	    fork_entries, new_size, KERN_SUCCESS, 0);
+
 	return new_map;
 }
 
@@ -15601,7 +16066,11 @@ vm_map_simplify_entry(
 		} else {
 			vm_object_deallocate(VME_OBJECT(prev_entry));
 		}
-		vm_map_entry_dispose(prev_entry);
+		if (map->pmap == kernel_pmap) {
+			vm_map_entry_dispose(prev_entry);
+		} else {
+			vm_map_entry_retire(prev_entry);
+		}
 		SAVE_HINT_MAP_WRITE(map, this_entry);
 	}
 }
@@ -21062,6 +21531,63 @@ done:
 	return kr;
 }
 
+/*
+ * Queue up to 'budget' cold pages from the task's private anonymous
+ * objects for compression ahead of a likely freeze.  Only the read
+ * lock is needed since no entries change; see
+ * vm_object_compressed_freezer_precompact().
+ */
+unsigned int
+vm_map_freeze_precompact(
+	task_t       task,
+	unsigned int budget)
+{
+	vm_map_t        map = task->map;
+	vm_map_entry_t  entry;
+	unsigned int    queued_count = 0;
+
+	if (!VM_CONFIG_COMPRESSOR_IS_PRESENT || budget == 0) {
+		return 0;
+	}
+
+	vm_map_lock_read(map);
+
+	for (entry = vm_map_first_entry(map);
+	    entry != vm_map_to_entry(map) && queued_count < budget;
+	    entry = entry->vme_next) {
+		vm_object_t object;
+
+		if (entry->is_sub_map) {
+			continue;
+		}
+
+		object = VME_OBJECT(entry);
+		if (object == VM_OBJECT_NULL ||
+		    object->phys_contiguous ||
+		    !object->internal ||
+		    object->ref_count > 1 ||
+		    object->purgable == VM_PURGABLE_VOLATILE ||
+		    object->purgable == VM_PURGABLE_EMPTY) {
+			/*
+			 * The freezer skips shared objects and purges
+			 * volatile ones, so compressing them early is wasted.
+			 */
+			continue;
+		}
+
+		queued_count += vm_object_compressed_freezer_precompact(object,
+		    budget - queued_count);
+
+		if (vm_compressor_low_on_space()) {
+			break;
+		}
+	}
+
+	vm_map_unlock_read(map);
+
+	return queued_count;
+}
+
 #endif
 
 /*
@@ -508,6 +508,16 @@ VME_OBJECT_SHADOW(
 #define SUPERPAGE_ROUND_DOWN(a) (a & SUPERPAGE_MASK)
 #define SUPERPAGE_ROUND_UP(a) ((a + SUPERPAGE_SIZE-1) & SUPERPAGE_MASK)
 
+/*
+ * Superpages that aren't backed by a single block mapping in the pmap
+ * can be clipped, and fall back to base page mappings when they are.
+ */
+#if __arm64__
+#define SUPERPAGE_SPLITTABLE 1
+#else
+#define SUPERPAGE_SPLITTABLE 0
+#endif
+
 /*
  * wired_counts are unsigned short.  This value is used to safeguard
  * against any mishaps due to runaway user programs.
@@ -851,6 +861,12 @@ extern boolean_t        vm_map_lookup_entry_allow_pgz(
 #define vm_map_lookup_entry_allow_pgz vm_map_lookup_entry
 #endif
 
+/* Lockless check whether an address is mapped, FALSE if inconclusive */
+extern boolean_t        vm_map_lookup_entry_speculative(
+	vm_map_t                map,
+	vm_map_address_t        address,
+	boolean_t               *mapped);                               /* OUT */
+
 extern void             vm_map_copy_remap(
 	vm_map_t                map,
 	vm_map_entry_t          where,
@@ -1180,6 +1196,13 @@ extern kern_return_t    vm_map_protect(
 	vm_prot_t               new_prot,
 	boolean_t               set_max);
 
+/* Apply a batch of deallocate/protect/behavior operations */
+extern kern_return_t    vm_map_range_apply(
+	vm_map_t                map,
+	const struct mach_vm_range_op *ops,
+	mach_vm_size_t          count,
+	mach_vm_size_t          *applied);
+
 /* Check protection */
 extern boolean_t vm_map_check_protection(
 	vm_map_t                map,
@@ -1413,7 +1436,8 @@ extern kern_return_t    vm_map_copyin_common(
 #define VM_MAP_COPYIN_USE_MAXPROT       0x00000002
 #define VM_MAP_COPYIN_ENTRY_LIST        0x00000004
 #define VM_MAP_COPYIN_PRESERVE_PURGEABLE 0x00000008
-#define VM_MAP_COPYIN_ALL_FLAGS         0x0000000F
+#define VM_MAP_COPYIN_MOVE              0x00000010      /* steal entries, implies SRC_DESTROY */
+#define VM_MAP_COPYIN_ALL_FLAGS         0x0000001F
 extern kern_return_t    vm_map_copyin_internal(
 	vm_map_t                src_map,
 	vm_map_address_t        src_addr,
@@ -1849,6 +1873,10 @@ extern kern_return_t vm_map_freeze(
 	int          *freezer_error_code,
 	boolean_t    eval_only);
 
+extern unsigned int vm_map_freeze_precompact(
+	task_t       task,
+	unsigned int budget);
+
 #define FREEZER_ERROR_GENERIC                   (-1)
 #define FREEZER_ERROR_EXCESS_SHARED_MEMORY      (-2)
 #define FREEZER_ERROR_LOW_PRIVATE_SHARED_RATIO  (-3)
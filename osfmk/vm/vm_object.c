@@ -318,6 +318,7 @@ static const struct vm_object vm_object_template = {
 	.pages_created = 0,
 	.pages_used = 0,
 	.scan_collisions = 0,
+	.phantom_class = 0,
 #if CONFIG_PHANTOM_CACHE
 	.phantom_object_id = 0,
 #endif
@@ -7500,6 +7501,125 @@ vm_object_compressed_freezer_pageout(
 	return paged_out_count;
 }
 
+/*
+ * Background pre-compaction for likely freezer candidates.
+ *
+ * Hand up to 'budget' of the object's cold pages (on the inactive
+ * queue, with no software or pmap reference) to the internal pageout
+ * queue, so that the compressor threads compress them ahead of a
+ * freeze.  A later vm_object_compressed_freezer_pageout() then only
+ * has to relocate that data into the freezer's segments.
+ *
+ * Unlike vm_object_pageout(), this never waits for a throttled
+ * pageout queue: it just stops and lets the next pass pick up.
+ */
+uint32_t
+vm_object_compressed_freezer_precompact(
+	vm_object_t object, uint32_t budget)
+{
+	vm_page_t                       p, next;
+	struct  vm_pageout_queue        *iq;
+	uint32_t                        queued_count = 0;
+
+	assert(object != VM_OBJECT_NULL);
+
+	iq = &vm_pageout_queue_internal;
+
+	vm_object_lock(object);
+
+	if (!object->internal ||
+	    object->terminating ||
+	    !object->alive ||
+	    object->paging_in_progress ||
+	    object->activity_in_progress) {
+		vm_object_unlock(object);
+		return 0;
+	}
+
+	if (!object->pager_initialized || object->pager == MEMORY_OBJECT_NULL) {
+		if (!object->pager_initialized) {
+			vm_object_collapse(object, (vm_object_offset_t) 0, TRUE);
+
+			if (!object->pager_initialized) {
+				vm_object_compressor_pager_create(object);
+			}
+		}
+
+		if (!object->pager_initialized || object->pager == MEMORY_OBJECT_NULL) {
+			vm_object_unlock(object);
+			return 0;
+		}
+	}
+
+	next = (vm_page_t)vm_page_queue_first(&object->memq);
+
+	while (!vm_page_queue_end(&object->memq, (vm_page_queue_entry_t)next) &&
+	    queued_count < budget) {
+		p = next;
+		next = (vm_page_t)vm_page_queue_next(&next->vmp_listq);
+
+		if (p->vmp_q_state != VM_PAGE_ON_INACTIVE_INTERNAL_Q ||
+		    p->vmp_reference ||
+		    p->vmp_cleaning ||
+		    p->vmp_laundry ||
+		    p->vmp_busy ||
+		    p->vmp_absent ||
+		    VMP_ERROR_GET(p) ||
+		    p->vmp_fictitious ||
+		    VM_PAGE_WIRED(p)) {
+			continue;
+		}
+		if (vm_compressor_low_on_space()) {
+			break;
+		}
+
+		vm_page_lockspin_queues();
+
+		if (VM_PAGE_Q_THROTTLED(iq)) {
+			vm_page_unlock_queues();
+			break;
+		}
+
+		if (p->vmp_pmapped == TRUE) {
+			int refmod_state;
+			int pmap_options;
+
+			if (pmap_get_refmod(VM_PAGE_GET_PHYS_PAGE(p)) & VM_MEM_REFERENCED) {
+				/* touched since it went inactive, not cold */
+				vm_page_unlock_queues();
+				continue;
+			}
+
+			pmap_options = PMAP_OPTIONS_COMPRESSOR_IFF_MODIFIED;
+			if (p->vmp_dirty || p->vmp_precious) {
+				pmap_options = PMAP_OPTIONS_COMPRESSOR;
+			}
+			refmod_state = pmap_disconnect_options(VM_PAGE_GET_PHYS_PAGE(p),
+			    pmap_options,
+			    NULL);
+			if (refmod_state & VM_MEM_MODIFIED) {
+				SET_PAGE_DIRTY(p, FALSE);
+			}
+		}
+
+		if (!p->vmp_dirty && !p->vmp_precious) {
+			vm_page_unlock_queues();
+			VM_PAGE_FREE(p);
+			continue;
+		}
+		vm_page_queues_remove(p, TRUE);
+
+		vm_pageout_cluster(p);
+
+		vm_page_unlock_queues();
+
+		queued_count++;
+	}
+	vm_object_unlock(object);
+
+	return queued_count;
+}
+
 #endif /* CONFIG_FREEZE */
 
 
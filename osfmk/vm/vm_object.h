@@ -366,7 +366,7 @@ struct vm_object {
 #endif /* VM_OBJECT_ACCESS_TRACKING */
 
 	uint8_t                 scan_collisions;
-	uint8_t                 __object4_unused_bits[1];
+	uint8_t                 phantom_class;  /* phantom cache refault class (mount) */
 	vm_tag_t                wire_tag;
 
 #if CONFIG_PHANTOM_CACHE
@@ -859,6 +859,10 @@ __private_extern__ void
 vm_object_compressed_freezer_done(
 	void);
 
+__private_extern__ uint32_t
+vm_object_compressed_freezer_precompact(
+	vm_object_t     object, uint32_t budget);
+
 #endif /* CONFIG_FREEZE */
 
 __private_extern__ void
@@ -121,6 +121,7 @@ typedef struct vm_page          *vm_page_packed_t;
 
 #include <kern/macro_help.h>
 #include <libkern/OSAtomic.h>
+#include <os/atomic_private.h>
 
 
 
@@ -1295,6 +1296,17 @@ vm_offset_t     last_phys_addr;         /* physical address for last_page */
 extern
 unsigned int    vm_page_free_count;     /* How many pages are free? (sum of all colors) */
 extern
+unsigned int    vm_page_free_cached_count; /* free pages parked on per-CPU lists by vm_page_release() */
+
+/*
+ * Free pages, including the ones vm_page_release() parked on per-CPU
+ * lists.  The allocator itself only ever considers vm_page_free_count,
+ * since parked pages can't be handed out by other CPUs; this is what
+ * free memory reporting and pressure accounting should look at.
+ */
+#define VM_PAGE_FREE_COUNT_WITH_CACHED() \
+	(vm_page_free_count + os_atomic_load(&vm_page_free_cached_count, relaxed))
+extern
 unsigned int    vm_page_active_count;   /* How many pages are active? */
 extern
 unsigned int    vm_page_inactive_count; /* How many pages are inactive? */
@@ -1634,7 +1646,7 @@ extern void memorystatus_pages_update(unsigned int pages_avail);
 #define VM_CHECK_MEMORYSTATUS do { \
 	memorystatus_pages_update(              \
 	        vm_page_pageable_external_count + \
-	        vm_page_free_count +            \
+	        VM_PAGE_FREE_COUNT_WITH_CACHED() + \
 	        VM_PAGE_SECLUDED_COUNT_OVER_TARGET() + \
 	        (VM_DYNAMIC_PAGING_ENABLED() ? 0 : vm_page_purgeable_count) \
 	        ); \
@@ -280,6 +280,7 @@ boolean_t vps_yield_for_pgqlockwaiters = TRUE;
 extern boolean_t hibernate_cleaning_in_progress;
 
 struct cq ciq[MAX_COMPRESSOR_THREAD_COUNT];
+struct vm_compressor_thread_stats vmcts_stats[MAX_COMPRESSOR_THREAD_COUNT];
 
 #if VM_PRESSURE_EVENTS
 void vm_pressure_thread(void);
@@ -340,6 +341,13 @@ uint32_t vm_pageout_memorystatus_fb_factor_dr = 2;
 
 #if __AMP__
 int vm_compressor_ebound = 1;
+/*
+ * When set, one compressor thread is started per cluster (times
+ * vmcomp_threads_per_cluster) and soft bound to it, instead of
+ * binding all of them to the E-cluster.
+ */
+int vm_compressor_per_cluster = 0;
+int vm_compressor_threads_per_cluster = 1;
 int vm_pgo_pbound = 0;
 extern void thread_bind_cluster_type(thread_t, char, bool);
 #endif /* __AMP__ */
@@ -2126,6 +2134,18 @@ vps_calculate_filecache_min(void)
 		    ((AVAILABLE_NON_COMPRESSED_MEMORY) * 10) / divisor;
 	}
 #endif
+#if CONFIG_PHANTOM_CACHE
+	/*
+	 * raise the floor while the phantom cache sees some mount
+	 * refaulting its own recently evicted file pages, but never
+	 * past half of what's available
+	 */
+	if (vm_pageout_state.vm_page_filecache_min) {
+		vm_pageout_state.vm_page_filecache_min = (uint32_t)MIN(
+			vm_phantom_cache_filecache_min_adjust(vm_pageout_state.vm_page_filecache_min),
+			(AVAILABLE_NON_COMPRESSED_MEMORY) / 2);
+	}
+#endif /* CONFIG_PHANTOM_CACHE */
 	if (vm_page_free_count < (vm_page_free_reserved / 4)) {
 		vm_pageout_state.vm_page_filecache_min = 0;
 	}
@@ -2926,6 +2946,230 @@ vm_page_balance_inactive(int max_to_move)
 	}
 }
 
+/*
+ * Optional pageout scan helpers.
+ *
+ * vm_pageout_scan remains the only thread making reclaim policy decisions,
+ * but on large machines a single thread can't unmap and free clean file
+ * pages fast enough to keep up with demand.  When "vm_pageout_scan_helpers"
+ * is set, that many helper threads are started (soft bound round-robin
+ * across clusters on AMP systems).  vm_pageout_scan wakes them whenever it
+ * runs and trivially reclaimable pages are queued; each helper pulls a
+ * small batch of clean, unreferenced pages off the cleaned and aged
+ * speculative queues under the page queue lock, then does the
+ * pmap_disconnect and object work with the queue lock dropped, and hands
+ * the batch to vm_page_free_list.  Pages found to have been touched in the
+ * meantime are reactivated rather than freed.
+ */
+#define VM_PAGEOUT_SCAN_HELPER_MAX      8
+#define VM_PAGEOUT_SCAN_HELPER_BATCH    32
+
+TUNABLE(uint32_t, vm_pageout_scan_helper_count, "vm_pageout_scan_helpers", 0);
+
+static uint32_t vm_pageout_scan_helpers_idle;   /* protected by the page queue lock */
+
+SCALABLE_COUNTER_DEFINE(vm_pageout_scan_helper_freed);
+SCALABLE_COUNTER_DEFINE(vm_pageout_scan_helper_reactivated);
+
+/*
+ * Returns whether a page can be freed without any I/O or further
+ * policy decision: clean, unreferenced, idle and backed by a pager
+ * that can bring it back. Called with the page's object locked.
+ */
+static bool
+vps_page_reclaimable_clean(vm_page_t m, vm_object_t object)
+{
+	if (m->vmp_busy || m->vmp_cleaning || m->vmp_laundry ||
+	    m->vmp_free_when_done || m->vmp_absent || m->vmp_error ||
+	    m->vmp_dirty || m->vmp_precious || m->vmp_reference ||
+	    VM_PAGE_WIRED(m)) {
+		return false;
+	}
+	if (!object->alive || object->internal || object->pager == NULL) {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Called with the page queue lock held by vm_pageout_scan: kick idle
+ * helpers if there's clean work queued for them.
+ */
+static void
+vps_wakeup_scan_helpers(struct vm_speculative_age_q *sq)
+{
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	if (vm_pageout_scan_helpers_idle == 0) {
+		return;
+	}
+	if (vm_page_queue_empty(&vm_page_queue_cleaned) &&
+	    vm_page_queue_empty(&sq->age_q)) {
+		return;
+	}
+	vm_pageout_scan_helpers_idle = 0;
+	thread_wakeup((event_t)&vm_pageout_scan_helpers_idle);
+}
+
+/*
+ * Pull up to 'max' reclaimable pages off the head of the cleaned and
+ * aged speculative queues. Each page is returned off its queue, busy,
+ * with a paging reference on its object. Called with the page queue
+ * lock held.
+ */
+static int
+vps_helper_grab_batch(vm_page_t *batch, int max)
+{
+	struct vm_speculative_age_q *sq;
+	vm_object_t object;
+	vm_page_t m;
+	int n = 0;
+
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	sq = &vm_page_queue_speculative[VM_PAGE_SPECULATIVE_AGED_Q];
+
+	while (n < max && vm_page_free_count + n < vm_page_free_target) {
+		if (!vm_page_queue_empty(&vm_page_queue_cleaned)) {
+			m = (vm_page_t)vm_page_queue_first(&vm_page_queue_cleaned);
+		} else if (!vm_page_queue_empty(&sq->age_q)) {
+			m = (vm_page_t)vm_page_queue_first(&sq->age_q);
+		} else {
+			break;
+		}
+
+		object = VM_PAGE_OBJECT(m);
+		if (object == VM_OBJECT_NULL || !vm_object_lock_try_scan(object)) {
+			/* leave contended pages to vm_pageout_scan */
+			break;
+		}
+		if (!vps_page_reclaimable_clean(m, object)) {
+			vm_object_unlock(object);
+			break;
+		}
+
+		vm_page_queues_remove(m, TRUE);
+		m->vmp_busy = TRUE;
+		vm_object_paging_begin(object);
+		vm_object_unlock(object);
+
+		batch[n++] = m;
+	}
+	return n;
+}
+
+static void
+vm_pageout_scan_helper_reclaim(vm_page_t *batch, int n)
+{
+	vm_page_t local_freeq = NULL;
+	uint64_t freed = 0, reactivated = 0;
+	vm_object_t object;
+	vm_page_t m;
+	int refmod_state;
+
+	for (int i = 0; i < n; i++) {
+		m = batch[i];
+		object = VM_PAGE_OBJECT(m);
+
+		vm_object_lock(object);
+
+		if (m->vmp_pmapped) {
+			refmod_state = pmap_disconnect(VM_PAGE_GET_PHYS_PAGE(m));
+			if (refmod_state & VM_MEM_MODIFIED) {
+				SET_PAGE_DIRTY(m, FALSE);
+			}
+			if (refmod_state & VM_MEM_REFERENCED) {
+				m->vmp_reference = TRUE;
+			}
+		}
+
+		if (m->vmp_dirty || m->vmp_reference || m->vmp_precious) {
+			vm_page_lockspin_queues();
+			vm_page_activate(m);
+			vm_page_unlock_queues();
+			PAGE_WAKEUP_DONE(m);
+			reactivated++;
+		} else {
+			DTRACE_VM2(dfree, int, 1, (uint64_t *), NULL);
+			DTRACE_VM2(fsfree, int, 1, (uint64_t *), NULL);
+
+			if (m->vmp_tabled) {
+				vm_page_remove(m, TRUE);
+			}
+			assert(m->vmp_pageq.next == 0 && m->vmp_pageq.prev == 0);
+			m->vmp_snext = local_freeq;
+			local_freeq = m;
+			freed++;
+		}
+
+		vm_object_paging_end(object);
+		vm_object_unlock(object);
+	}
+
+	if (local_freeq) {
+		vm_page_free_list(local_freeq, TRUE);
+	}
+	counter_add(&vm_pageout_scan_helper_freed, freed);
+	counter_add(&vm_pageout_scan_helper_reactivated, reactivated);
+}
+
+__dead2
+static void
+vm_pageout_scan_helper_continue(void *arg __unused, wait_result_t wr __unused)
+{
+	vm_page_t batch[VM_PAGEOUT_SCAN_HELPER_BATCH];
+	int n;
+
+	for (;;) {
+		vm_page_lock_queues();
+		n = vps_helper_grab_batch(batch, VM_PAGEOUT_SCAN_HELPER_BATCH);
+		if (n == 0) {
+			vm_pageout_scan_helpers_idle++;
+			assert_wait((event_t)&vm_pageout_scan_helpers_idle, THREAD_UNINT);
+			vm_page_unlock_queues();
+			thread_block_parameter(vm_pageout_scan_helper_continue, NULL);
+			/*NOTREACHED*/
+		}
+		vm_page_unlock_queues();
+
+		vm_pageout_scan_helper_reclaim(batch, n);
+	}
+}
+
+__dead2
+static void
+vm_pageout_scan_helper_thread(void *arg, wait_result_t wr)
+{
+	thread_t self = current_thread();
+
+	self->options |= TH_OPT_VMPRIV;
+#if __AMP__
+	thread_bind_cluster_id(self,
+	    (uint32_t)(uintptr_t)arg % ml_get_cluster_count(), THREAD_BIND_SOFT);
+#endif /* __AMP__ */
+	vm_pageout_scan_helper_continue(arg, wr);
+}
+
+static void
+vm_pageout_scan_helpers_start(void)
+{
+	kern_return_t result;
+	thread_t thread;
+
+	if (vm_pageout_scan_helper_count > VM_PAGEOUT_SCAN_HELPER_MAX) {
+		vm_pageout_scan_helper_count = VM_PAGEOUT_SCAN_HELPER_MAX;
+	}
+	for (uint32_t i = 0; i < vm_pageout_scan_helper_count; i++) {
+		result = kernel_thread_start_priority(vm_pageout_scan_helper_thread,
+		    (void *)(uintptr_t)i, BASEPRI_VM, &thread);
+		if (result != KERN_SUCCESS) {
+			panic("vm_pageout_scan_helper: create failed");
+		}
+		thread_set_thread_name(thread, "VM_pageout_scan_helper");
+		thread_deallocate(thread);
+	}
+}
+
 /*
  *	vm_pageout_scan does the dirty work for the pageout daemon.
  *	It returns with both vm_page_queue_free_lock and vm_page_queue_lock
@@ -3139,6 +3383,8 @@ return_from_scan:
 		}
 		force_speculative_aging = FALSE;
 
+		vps_wakeup_scan_helpers(sq);
+
 		/*
 		 * Check to see if we need to evict objects from the cache.
 		 *
@@ -4118,6 +4364,12 @@ vm_pageout_iothread_internal_continue(struct cq *cq, __unused wait_result_t w)
 			break;
 		}
 
+		vmcts_stats[cq->id].vmcts_batches++;
+		vmcts_stats[cq->id].vmcts_queue_depth_total += q->pgo_laundry;
+		if ((uint32_t)q->pgo_laundry > vmcts_stats[cq->id].vmcts_queue_depth_max) {
+			vmcts_stats[cq->id].vmcts_queue_depth_max = q->pgo_laundry;
+		}
+
 		q->pgo_busy = TRUE;
 
 		if ((pgo_draining = q->pgo_draining) == FALSE) {
@@ -4169,6 +4421,7 @@ vm_pageout_iothread_internal_continue(struct cq *cq, __unused wait_result_t w)
 #if DEVELOPMENT || DEBUG
 				ncomps++;
 #endif
+				vmcts_stats[cq->id].vmcts_pages_compressed++;
 				KERNEL_DEBUG(0xe0400024 | DBG_FUNC_END, local_cnt, 0, 0, 0, 0);
 
 				m->vmp_snext = local_freeq;
@@ -4507,7 +4760,15 @@ vm_pageout_iothread_internal(struct cq *cq, __unused wait_result_t w)
 #endif /* CONFIG_THREAD_GROUPS */
 
 #if __AMP__
-	if (vm_compressor_ebound) {
+	if (vm_compressor_per_cluster) {
+		/*
+		 * Each thread fills its own c_segments, so keeping it on one
+		 * cluster keeps those segments warm in that cluster's caches.
+		 * The bind is soft so the thread can still make progress if
+		 * the cluster is derecommended.
+		 */
+		thread_bind_cluster_id(self, cq->cluster_id, THREAD_BIND_SOFT);
+	} else if (vm_compressor_ebound) {
 		/*
 		 * Use the soft bound option for vm_compressor to allow it to run on
 		 * P-cores if E-cluster is unavailable.
@@ -5172,6 +5433,8 @@ vm_pageout(void)
 	thread_set_thread_name(vm_pageout_state.vm_pageout_external_iothread, "VM_pageout_external_iothread");
 	thread_deallocate(vm_pageout_state.vm_pageout_external_iothread);
 
+	vm_pageout_scan_helpers_start();
+
 	thread_mtx_lock(vm_pageout_gc_thread );
 	thread_start(vm_pageout_gc_thread );
 	thread_mtx_unlock(vm_pageout_gc_thread);
@@ -5280,7 +5543,17 @@ vm_pageout_internal_start(void)
 
 #if     __AMP__
 	PE_parse_boot_argn("vmcomp_ecluster", &vm_compressor_ebound, sizeof(vm_compressor_ebound));
-	if (vm_compressor_ebound) {
+	PE_parse_boot_argn("vmcomp_per_cluster", &vm_compressor_per_cluster, sizeof(vm_compressor_per_cluster));
+	PE_parse_boot_argn("vmcomp_threads_per_cluster", &vm_compressor_threads_per_cluster,
+	    sizeof(vm_compressor_threads_per_cluster));
+	if (vm_compressor_per_cluster) {
+		if (vm_compressor_threads_per_cluster <= 0) {
+			vm_compressor_threads_per_cluster = 1;
+		}
+		vm_compressor_ebound = 0;
+		vm_pageout_state.vm_compressor_thread_count =
+		    ml_get_cluster_count() * vm_compressor_threads_per_cluster;
+	} else if (vm_compressor_ebound) {
 		vm_pageout_state.vm_compressor_thread_count = 2;
 	}
 #endif
@@ -5318,6 +5591,13 @@ vm_pageout_internal_start(void)
 		ciq[i].current_regular_swapout_chead = NULL;
 		ciq[i].current_late_swapout_chead = NULL;
 		ciq[i].scratch_buf = (char *)(buf + i * bufsize);
+#if __AMP__
+		ciq[i].cluster_id = vm_compressor_per_cluster ?
+		    (uint32_t)(i % ml_get_cluster_count()) : 0;
+#else /* __AMP__ */
+		ciq[i].cluster_id = 0;
+#endif /* __AMP__ */
+		vmcts_stats[i].vmcts_cluster_id = ciq[i].cluster_id;
 #if DEVELOPMENT || DEBUG
 		ciq[i].benchmark_q = &vm_pageout_queue_benchmark;
 #endif /* DEVELOPMENT || DEBUG */
@@ -193,6 +193,8 @@ extern int      vm_debug_events;
 
 #define VM_PHYS_WRITE_ACCT              0x142
 
+#define VM_MAP_FORK                     0x143
+
 #define VM_DEBUG_EVENT(name, event, control, arg1, arg2, arg3, arg4)    \
 	MACRO_BEGIN                                             \
 	if (__improbable(vm_debug_events)) {                    \
@@ -825,7 +827,7 @@ extern struct vm_pageout_debug vm_pageout_debug;
 #define VM_PAGEOUT_DEBUG(member, value)
 #endif
 
-#define MAX_COMPRESSOR_THREAD_COUNT      8
+#define MAX_COMPRESSOR_THREAD_COUNT      16
 
 /*
  * Forward declarations for internal routines.
@@ -837,6 +839,7 @@ struct cq {
 	void                    *current_late_swapout_chead;
 	char                    *scratch_buf;
 	int                     id;
+	uint32_t                cluster_id;
 #if DEVELOPMENT || DEBUG
 	struct vm_pageout_queue *benchmark_q;
 #endif /* DEVELOPMENT || DEBUG */
@@ -844,6 +847,38 @@ struct cq {
 
 extern struct cq ciq[MAX_COMPRESSOR_THREAD_COUNT];
 
+/*
+ * Per compressor thread throughput and queue depth counters.
+ * Only updated by the owning compressor thread.
+ */
+struct vm_compressor_thread_stats {
+	uint64_t vmcts_pages_compressed;
+	uint64_t vmcts_batches;
+	uint64_t vmcts_queue_depth_total;  /* pgo_laundry summed at each batch */
+	uint32_t vmcts_queue_depth_max;
+	uint32_t vmcts_cluster_id;
+};
+extern struct vm_compressor_thread_stats vmcts_stats[MAX_COMPRESSOR_THREAD_COUNT];
+
+/*
+ * Per-CPU free page list activity.
+ * Only updated by the owning CPU, with preemption disabled.
+ */
+struct vm_page_free_cache_stats {
+	uint64_t vpfc_hits;             /* grabs served from the per-CPU list */
+	uint64_t vpfc_misses;           /* grabs that found the per-CPU list empty */
+	uint64_t vpfc_refills;
+	uint64_t vpfc_refill_pages;
+	uint64_t vpfc_release_hits;     /* frees parked on the per-CPU list */
+	uint64_t vpfc_drains;
+	uint64_t vpfc_drain_pages;
+	uint64_t vpfc_last_refill;      /* mach_absolute_time() of the last refill */
+	uint32_t vpfc_count;            /* pages currently on the per-CPU list */
+	uint32_t vpfc_refill_size;      /* current refill batch size */
+	uint32_t vpfc_cached;           /* pages parked by vm_page_release() */
+};
+extern int vm_page_free_cache_stats_copy(struct vm_page_free_cache_stats *out, int max_cpus);
+
 struct vm_compressor_swapper_stats {
 	uint64_t unripe_under_30s;
 	uint64_t unripe_under_60s;
@@ -858,6 +893,14 @@ struct vm_compressor_swapper_stats {
 };
 extern struct vm_compressor_swapper_stats vmcs_stats;
 
+/*
+ * Swap-in latency, log2 buckets of microseconds: bucket 0 counts reads
+ * under 1us, bucket i (i > 0) reads in [2^(i-1), 2^i) us, and the last
+ * bucket everything slower.
+ */
+#define VM_SWAPIN_LATENCY_BUCKETS       24
+extern uint64_t vm_swapin_latency_histogram[VM_SWAPIN_LATENCY_BUCKETS];
+
 #if DEVELOPMENT || DEBUG
 typedef struct vmct_stats_s {
 	uint64_t vmct_runtimes[MAX_COMPRESSOR_THREAD_COUNT];
@@ -64,6 +64,31 @@ uint32_t        sample_period_ghost_added_count_ssd = 0;
 uint32_t        sample_period_ghost_found_count = 0;
 uint32_t        sample_period_ghost_found_count_ssd = 0;
 
+/*
+ * Per-class refault tracking.  A class is thrashing when most of the pages
+ * it evicts come back (found >= added / 2) and most of those come back from
+ * the newest quarter of the ring, i.e. its working set is only a little
+ * larger than what the file cache currently holds for it.  A streaming
+ * workload on another mount adds ghosts without finding them, which hides
+ * this in the global counts above.
+ *
+ * While some class is thrashing, vm_phantom_cache_filecache_boost grows by
+ * phantom_cache_filecache_boost_step percent per sample period up to
+ * phantom_cache_filecache_boost_max; otherwise it decays by half.
+ */
+uint32_t        phantom_cache_class_thrashing_threshold = 32;
+uint32_t        phantom_cache_filecache_boost_step = 25;
+uint32_t        phantom_cache_filecache_boost_max = 100;
+uint32_t        vm_phantom_cache_filecache_boost = 0;
+
+struct phantom_cache_class {
+	uint32_t        pcc_added;
+	uint32_t        pcc_found;
+	uint32_t        pcc_found_near;
+} phantom_cache_classes[VM_PHANTOM_CLASS_COUNT];
+
+uint64_t        vm_phantom_cache_refault_hist[VM_PHANTOM_CLASS_COUNT][VM_PHANTOM_DISTANCE_BUCKETS];
+
 uint32_t        vm_phantom_object_id = 1;
 #define         VM_PHANTOM_OBJECT_ID_AFTER_WRAP 1000000
 
@@ -176,6 +201,7 @@ vm_phantom_cache_add_ghost(vm_page_t m)
 	int             ghost_index;
 	int             pg_mask;
 	boolean_t       isSSD = FALSE;
+	uint32_t        mount_id = 0;
 	vm_phantom_hash_entry_t ghost_hash_index;
 
 	object = VM_PAGE_OBJECT(m);
@@ -195,6 +221,8 @@ vm_phantom_cache_add_ghost(vm_page_t m)
 		if (isSSD == TRUE) {
 			object->phantom_isssd = TRUE;
 		}
+		vnode_pager_get_object_mount_id(object->pager, &mount_id);
+		object->phantom_class = (uint8_t)(mount_id % VM_PHANTOM_CLASS_COUNT);
 
 		object->phantom_object_id = vm_phantom_object_id++;
 
@@ -265,6 +293,7 @@ vm_phantom_cache_add_ghost(vm_page_t m)
 
 done:
 	vm_pageout_vminfo.vm_phantom_cache_added_ghost++;
+	phantom_cache_classes[object->phantom_class].pcc_added++;
 
 	if (object->phantom_isssd) {
 		OSAddAtomic(1, &sample_period_ghost_added_count_ssd);
@@ -318,12 +347,32 @@ vm_phantom_cache_lookup_ghost(vm_page_t m, uint32_t pg_mask)
 
 
 
+/*
+ * Number of ghosts added to the ring since vpce was (re)used, which is
+ * how far back in eviction order the refaulting page sat.  Slot 0 is
+ * never used, so the ring spans [1, vm_phantom_cache_num_entries).
+ */
+static uint32_t
+vm_phantom_cache_distance(vm_ghost_t vpce)
+{
+	uint32_t        ghost_index = (uint32_t)(vpce - vm_phantom_cache);
+
+	if (vm_phantom_cache_nindx > ghost_index) {
+		return vm_phantom_cache_nindx - ghost_index;
+	}
+	return vm_phantom_cache_nindx + (vm_phantom_cache_num_entries - 1) - ghost_index;
+}
+
+
 void
 vm_phantom_cache_update(vm_page_t m)
 {
 	int             pg_mask;
 	vm_ghost_t      vpce;
 	vm_object_t     object;
+	uint32_t        distance;
+	uint32_t        bucket;
+	struct phantom_cache_class *pcc;
 
 	object = VM_PAGE_OBJECT(m);
 
@@ -347,6 +396,19 @@ vm_phantom_cache_update(vm_page_t m)
 		} else {
 			OSAddAtomic(1, &sample_period_ghost_found_count);
 		}
+
+		distance = vm_phantom_cache_distance(vpce);
+		bucket = 31 - __builtin_clz(distance);
+		if (bucket >= VM_PHANTOM_DISTANCE_BUCKETS) {
+			bucket = VM_PHANTOM_DISTANCE_BUCKETS - 1;
+		}
+		vm_phantom_cache_refault_hist[object->phantom_class][bucket]++;
+
+		pcc = &phantom_cache_classes[object->phantom_class];
+		pcc->pcc_found++;
+		if (distance <= vm_phantom_cache_num_entries / 4) {
+			pcc->pcc_found_near++;
+		}
 	}
 }
 
@@ -402,6 +464,58 @@ is_thrashing(uint32_t added, uint32_t found, uint32_t threshold)
 	return TRUE;
 }
 
+/*
+ * Close out the per-class counts for a sample period and move the
+ * file cache floor boost accordingly.
+ */
+static void
+vm_phantom_cache_evaluate_classes(void)
+{
+	struct phantom_cache_class *pcc;
+	boolean_t       class_thrashing = FALSE;
+	uint32_t        boost;
+	int             i;
+
+	for (i = 0; i < VM_PHANTOM_CLASS_COUNT; i++) {
+		pcc = &phantom_cache_classes[i];
+
+		if (is_thrashing(pcc->pcc_added, pcc->pcc_found,
+		    phantom_cache_class_thrashing_threshold) &&
+		    pcc->pcc_found_near >= pcc->pcc_found / 2) {
+			class_thrashing = TRUE;
+		}
+		pcc->pcc_added = 0;
+		pcc->pcc_found = 0;
+		pcc->pcc_found_near = 0;
+	}
+
+	boost = vm_phantom_cache_filecache_boost;
+	if (class_thrashing) {
+		boost += phantom_cache_filecache_boost_step;
+		if (boost > phantom_cache_filecache_boost_max) {
+			boost = phantom_cache_filecache_boost_max;
+		}
+	} else {
+		boost /= 2;
+	}
+	vm_phantom_cache_filecache_boost = boost;
+}
+
+/*
+ * Scale the file cache floor computed by vm_pageout_scan by the
+ * current boost.
+ */
+uint32_t
+vm_phantom_cache_filecache_min_adjust(uint32_t filecache_min)
+{
+	uint32_t        boost = vm_phantom_cache_filecache_boost;
+
+	if (boost == 0) {
+		return filecache_min;
+	}
+	return (uint32_t)(((uint64_t)filecache_min * (100 + boost)) / 100);
+}
+
 /*
  * the following function is never called
  * from multiple threads simultaneously due
@@ -446,6 +560,8 @@ vm_phantom_cache_check_pressure()
 			sample_period_ghost_counts_indx = 0;
 		}
 #endif
+		vm_phantom_cache_evaluate_classes();
+
 		sample_period_ghost_added_count = 0;
 		sample_period_ghost_found_count = 0;
 		sample_period_ghost_added_count_ssd = 0;
@@ -44,6 +44,21 @@ struct  vm_ghost {
 
 typedef struct vm_ghost *vm_ghost_t;
 
+/*
+ * Refaults are also tracked per object class so that a workload which is
+ * thrashing its own file cache is not hidden by a streaming workload on
+ * another mount.  An object's class is the fsid of its mount modulo
+ * VM_PHANTOM_CLASS_COUNT.
+ *
+ * Refault distance is the number of ghost entries added between a page's
+ * eviction and its refault, bucketed by log2.
+ */
+#define         VM_PHANTOM_CLASS_COUNT          16
+#define         VM_PHANTOM_DISTANCE_BUCKETS     24
+
+extern  uint64_t        vm_phantom_cache_refault_hist[VM_PHANTOM_CLASS_COUNT][VM_PHANTOM_DISTANCE_BUCKETS];
+extern  uint32_t        vm_phantom_cache_filecache_boost;
+
 
 extern  void            vm_phantom_cache_init(void);
 extern  void            vm_phantom_cache_add_ghost(vm_page_t);
@@ -51,3 +66,4 @@ extern  vm_ghost_t      vm_phantom_cache_lookup_ghost(vm_page_t, uint32_t);
 extern  void            vm_phantom_cache_update(vm_page_t);
 extern  boolean_t       vm_phantom_cache_check_pressure(void);
 extern  void            vm_phantom_cache_restart_sample(void);
+extern  uint32_t        vm_phantom_cache_filecache_min_adjust(uint32_t);
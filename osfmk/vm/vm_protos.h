@@ -312,6 +312,8 @@ extern uint32_t vnode_pager_isinuse(
 	struct vnode *);
 extern boolean_t vnode_pager_isSSD(
 	struct vnode *);
+extern uint32_t vnode_pager_get_mount_id(
+	struct vnode *);
 extern void vnode_pager_throttle(
 	void);
 extern uint32_t vnode_pager_return_throttle_io_limit(
@@ -379,6 +381,9 @@ extern kern_return_t vnode_pager_get_isinuse(
 extern kern_return_t vnode_pager_get_isSSD(
 	memory_object_t,
 	boolean_t *);
+extern kern_return_t vnode_pager_get_object_mount_id(
+	memory_object_t,
+	uint32_t *);
 extern kern_return_t vnode_pager_get_throttle_io_limit(
 	memory_object_t,
 	uint32_t *);
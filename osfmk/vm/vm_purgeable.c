@@ -38,6 +38,8 @@
 #include <vm/vm_page.h>
 #include <vm/vm_pageout.h>
 #include <vm/vm_protos.h>
+#include <kern/startup.h>
+#include <os/atomic_private.h>
 #include <vm/vm_purgeable_internal.h>
 
 #include <sys/kdebug.h>
@@ -88,7 +90,24 @@ int purgeable_nonvolatile_count;
 
 decl_lck_mtx_data(, vm_purgeable_queue_lock);
 
+/*
+ * When the object picked by vm_purgeable_object_purge_one() has at most
+ * this many resident pages, other objects this small are collected from
+ * the same queue and group during the same hold of the purgeable queue
+ * lock and purged along with it (up to PURGEABLE_BATCH_MAX objects).
+ * Zero disables batching.
+ */
+TUNABLE_WRITEABLE(uint32_t, vm_purgeable_batch_small_pages,
+    "vm_purgeable_batch_small_pages", 16);
+
+/* purge latency, in nanoseconds, of vm_purgeable_object_purge_one() */
+uint64_t vm_purgeable_purge_latency_max = 0;
+uint64_t vm_purgeable_purge_latency_total = 0;
+uint64_t vm_purgeable_purge_calls = 0;
+uint64_t vm_purgeable_purge_batched_objects = 0;
+
 static token_idx_t vm_purgeable_token_remove_first(purgeable_q_t queue);
+static void vm_purgeable_object_dequeue_locked(purgeable_q_t queue, int group, vm_object_t object);
 
 static void vm_purgeable_stats_helper(vm_purgeable_stat_t *stat, purgeable_q_t queue, int group, task_t target_task);
 
@@ -778,6 +797,22 @@ vm_purgeable_object_find_and_lock(
 	/* Locked. Great. We'll take it. Remove and return. */
 //	printf("FOUND PURGEABLE object %p skipped %d\n", object, num_objects_skipped);
 
+	vm_purgeable_object_dequeue_locked(queue, group, object);
+	return object;
+}
+
+/*
+ * Move a locked volatile object from its purgeable queue to the
+ * non-volatile queue, ahead of purging it.
+ * Call with purgeable queue locked.
+ */
+static void
+vm_purgeable_object_dequeue_locked(
+	purgeable_q_t   queue,
+	int             group,
+	vm_object_t     object)
+{
+	LCK_MTX_ASSERT(&vm_purgeable_queue_lock, LCK_MTX_ASSERT_OWNED);
 	vm_object_lock_assert_exclusive(object);
 
 	queue_remove(&queue->objq[group], object,
@@ -805,7 +840,81 @@ vm_purgeable_object_find_and_lock(
 #if MACH_ASSERT
 	queue->debug_count_objects--;
 #endif
-	return object;
+}
+
+/*
+ * Count the ripe tokens at the head of a token queue.
+ * Call with page queue locked.
+ */
+static int
+vm_purgeable_token_ripe_count(purgeable_q_t queue)
+{
+	token_idx_t     token;
+	int             count = 0;
+
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	for (token = queue->token_q_head;
+	    token != 0 && token != queue->token_q_unripe;
+	    token = tokens[token].next) {
+		count++;
+	}
+	return count;
+}
+
+/*
+ * Collect up to "batch_max" more small objects from the given queue and
+ * group, which can be locked without waiting, so that they are purged
+ * together with the object vm_purgeable_object_purge_one() picked.
+ * Objects that wait for a ripe token are only taken while "ripe_budget"
+ * allows, and objects that don't are skipped when "pick_ripe" is set,
+ * as vm_purgeable_object_find_and_lock() does.  Returns the number of
+ * locked, dequeued objects stored in "batch".
+ * Call with purgeable queue locked.
+ */
+static int
+vm_purgeable_object_find_and_lock_small(
+	purgeable_q_t   queue,
+	int             group,
+	boolean_t       pick_ripe,
+	int             ripe_budget,
+	vm_object_t     *batch,
+	int             batch_max)
+{
+	vm_object_t     object, next;
+	int             scanned = 0;
+	int             count = 0;
+
+	LCK_MTX_ASSERT(&vm_purgeable_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	for (object = (vm_object_t) queue_first(&queue->objq[group]);
+	    !queue_end(&queue->objq[group], (queue_entry_t) object) &&
+	    count < batch_max && scanned < PURGEABLE_LOOP_MAX;
+	    object = next, scanned++) {
+		next = (vm_object_t) queue_next(&object->objq);
+
+		if (object->resident_page_count > vm_purgeable_batch_small_pages) {
+			continue;
+		}
+		if (object->purgeable_when_ripe) {
+			if (ripe_budget == 0) {
+				continue;
+			}
+		} else if (pick_ripe) {
+			continue;
+		}
+		if (!vm_object_lock_try(object)) {
+			continue;
+		}
+
+		vm_purgeable_object_dequeue_locked(queue, group, object);
+		if (object->purgeable_when_ripe) {
+			ripe_budget--;
+		}
+		batch[count++] = object;
+	}
+
+	return count;
 }
 
 /* Can be called without holding locks */
@@ -888,6 +997,23 @@ vm_purgeable_object_purge_one_unlocked(
 	return retval;
 }
 
+/*
+ * Record how long one vm_purgeable_object_purge_one() call took.
+ */
+static void
+vm_purgeable_purge_latency_update(uint64_t start_abs, int batched)
+{
+	uint64_t        ns;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - start_abs, &ns);
+	os_atomic_inc(&vm_purgeable_purge_calls, relaxed);
+	os_atomic_add(&vm_purgeable_purge_latency_total, ns, relaxed);
+	os_atomic_max(&vm_purgeable_purge_latency_max, ns, relaxed);
+	if (batched) {
+		os_atomic_add(&vm_purgeable_purge_batched_objects, batched, relaxed);
+	}
+}
+
 boolean_t
 vm_purgeable_object_purge_one(
 	int     force_purge_below_group,
@@ -899,6 +1025,10 @@ vm_purgeable_object_purge_one(
 	purgeable_q_t   queue, queue2;
 	boolean_t       forced_purge;
 	unsigned int    resident_page_count;
+	vm_object_t     batch[PURGEABLE_BATCH_MAX];
+	int             batch_count = 0;
+	int             ripe_budget;
+	uint64_t        start_abs = mach_absolute_time();
 
 
 	KERNEL_DEBUG_CONSTANT((MACHDBG_CODE(DBG_MACH_VM, OBJECT_PURGE)) | DBG_FUNC_START,
@@ -933,6 +1063,10 @@ vm_purgeable_object_purge_one(
 		 * we find an object in that group, try to lock it (this can
 		 * fail). If locking is successful, we can drop the queue
 		 * lock, remove a token and then purge the object.
+		 *
+		 * If that object is small, other small objects of the same
+		 * group are collected in the same pass, so that purging many
+		 * tiny objects doesn't cost a queue lock round trip each.
 		 */
 		for (group = 0; group < NUM_VOLATILE_GROUPS; group++) {
 			if (!queue->token_q_head ||
@@ -950,10 +1084,19 @@ vm_purgeable_object_purge_one(
 				 */
 				if (!queue_empty(&queue->objq[group]) &&
 				    (object = vm_purgeable_object_find_and_lock(queue, group, FALSE))) {
+					if (object->resident_page_count <= vm_purgeable_batch_small_pages) {
+						batch_count = vm_purgeable_object_find_and_lock_small(queue,
+						    group, FALSE, INT_MAX, batch, PURGEABLE_BATCH_MAX);
+					}
 					lck_mtx_unlock(&vm_purgeable_queue_lock);
 					if (object->purgeable_when_ripe) {
 						vm_purgeable_token_delete_first(queue);
 					}
+					for (int b = 0; b < batch_count; b++) {
+						if (batch[b]->purgeable_when_ripe) {
+							vm_purgeable_token_delete_first(queue);
+						}
+					}
 					forced_purge = TRUE;
 					goto purge_now;
 				}
@@ -963,10 +1106,19 @@ vm_purgeable_object_purge_one(
 			}
 			if (!queue_empty(&queue->objq[group]) &&
 			    (object = vm_purgeable_object_find_and_lock(queue, group, TRUE))) {
+				if (object->resident_page_count <= vm_purgeable_batch_small_pages) {
+					/* the object we picked consumes one of the ripe tokens */
+					ripe_budget = vm_purgeable_token_ripe_count(queue) - 1;
+					batch_count = vm_purgeable_object_find_and_lock_small(queue,
+					    group, TRUE, MAX(ripe_budget, 0), batch, PURGEABLE_BATCH_MAX);
+				}
 				lck_mtx_unlock(&vm_purgeable_queue_lock);
 				if (object->purgeable_when_ripe) {
 					vm_purgeable_token_choose_and_delete_ripe(queue, 0);
 				}
+				for (int b = 0; b < batch_count; b++) {
+					vm_purgeable_token_choose_and_delete_ripe(queue, 0);
+				}
 				forced_purge = FALSE;
 				goto purge_now;
 			}
@@ -1000,6 +1152,7 @@ vm_purgeable_object_purge_one(
 	KERNEL_DEBUG_CONSTANT((MACHDBG_CODE(DBG_MACH_VM, OBJECT_PURGE)) | DBG_FUNC_END,
 	    0, 0, available_for_purge, 0, 0);
 
+	vm_purgeable_purge_latency_update(start_abs, 0);
 	return FALSE;
 
 purge_now:
@@ -1012,6 +1165,13 @@ purge_now:
 	assert(object->purgable == VM_PURGABLE_EMPTY);
 	/* no change in purgeable accounting */
 	vm_object_unlock(object);
+
+	for (int b = 0; b < batch_count; b++) {
+		resident_page_count += batch[b]->resident_page_count;
+		(void) vm_object_purge(batch[b], flags);
+		assert(batch[b]->purgable == VM_PURGABLE_EMPTY);
+		vm_object_unlock(batch[b]);
+	}
 	vm_page_lock_queues();
 
 	vm_pageout_vminfo.vm_pageout_pages_purged += resident_page_count;
@@ -1020,9 +1180,10 @@ purge_now:
 	    VM_KERNEL_UNSLIDE_OR_PERM(object),                          /* purged object */
 	    resident_page_count,
 	    available_for_purge,
-	    0,
+	    batch_count,
 	    0);
 
+	vm_purgeable_purge_latency_update(start_abs, batch_count);
 	return TRUE;
 }
 
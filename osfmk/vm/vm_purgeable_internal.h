@@ -128,6 +128,7 @@ void vm_object_owner_compressed_update(vm_object_t      object,
     int              delta);
 
 #define PURGEABLE_LOOP_MAX 64
+#define PURGEABLE_BATCH_MAX 16  /* small objects purged along with the victim */
 
 #define TOKEN_ADD               0x40    /* 0x100 */
 #define TOKEN_DELETE            0x41    /* 0x104 */
@@ -39,6 +39,7 @@
 #include <mach/vm_reclaim.h>
 #include <os/log.h>
 #include <pexpert/pexpert.h>
+#include <machine/machine_routines.h>
 #include <vm/vm_map_internal.h>
 #include <vm/vm_reclaim_internal.h>
 #include <sys/queue.h>
@@ -51,6 +52,9 @@ static integer_t kReclaimThreadPriority = BASEPRI_VM;
 TUNABLE_WRITEABLE(uint64_t, vm_reclaim_trim_divisor, "vm_reclaim_trim_divisor", 2);
 // Used to debug vm_reclaim kills
 TUNABLE(bool, panic_on_kill, "vm_reclaim_panic_on_kill", false);
+// Number of async reclaim threads, 0 means one per CPU cluster
+TUNABLE(uint32_t, vm_reclaim_thread_count, "vm_reclaim_threads", 0);
+#define VM_RECLAIM_MAX_THREADS 8
 uint64_t vm_reclaim_max_threshold;
 
 #pragma mark Declarations
@@ -117,9 +121,23 @@ LCK_MTX_DECLARE(async_reclamation_buffers_lock, &vm_reclaim_lock_grp);
 static size_t reclamation_buffers_length;
 static uint64_t reclamation_counter; // generation count for global reclaims
 
+/*
+ * The first async reclaim thread. Its address is also the event every
+ * reclaim thread waits on for work.
+ */
 static SECURITY_READ_ONLY_LATE(thread_t) vm_reclaim_thread;
+static uint32_t vm_reclaim_threads_started;
 static void reclaim_thread(void *param __unused, wait_result_t wr __unused);
 
+/*
+ * Statistics
+ */
+uint64_t vm_reclaim_entries_coalesced;  // entries freed as part of a bigger vm_map_remove
+uint64_t vm_reclaim_bytes_requests;     // calls to vm_deferred_reclamation_reclaim_bytes
+uint64_t vm_reclaim_bytes_reclaimed;    // bytes they reclaimed
+uint64_t vm_reclaim_bytes_latency_total_ns;
+uint64_t vm_reclaim_bytes_latency_max_ns;
+
 #pragma mark Implementation
 
 static vm_deferred_reclamation_metadata_t
@@ -595,11 +613,28 @@ reclaim_chunk(vm_deferred_reclamation_metadata_t metadata)
 	for (size_t i = 0; i < num_to_reclaim; i++) {
 		mach_vm_reclaim_entry_v1_t *entry = &reclaim_entries[i];
 		if (entry->address != 0 && entry->size != 0) {
-			kern_return_t kr = vm_map_remove_guard(map,
-			    vm_map_trunc_page(entry->address,
-			    VM_MAP_PAGE_MASK(map)),
-			    vm_map_round_page(entry->address + entry->size,
-			    VM_MAP_PAGE_MASK(map)),
+			vm_map_offset_t start, end;
+			size_t run_entries = 1, run_bytes = entry->size;
+
+			start = vm_map_trunc_page(entry->address, VM_MAP_PAGE_MASK(map));
+			end = vm_map_round_page(entry->address + entry->size, VM_MAP_PAGE_MASK(map));
+			/*
+			 * Allocators tend to free neighbouring ranges together.
+			 * Fold the following entries that start exactly where this
+			 * one ends into a single vm_map_remove.
+			 */
+			while (i + 1 < num_to_reclaim) {
+				mach_vm_reclaim_entry_v1_t *next = &reclaim_entries[i + 1];
+				if (next->address == 0 || next->size == 0 ||
+				    vm_map_trunc_page(next->address, VM_MAP_PAGE_MASK(map)) != end) {
+					break;
+				}
+				end = vm_map_round_page(next->address + next->size, VM_MAP_PAGE_MASK(map));
+				run_bytes += next->size;
+				run_entries++;
+				i++;
+			}
+			kern_return_t kr = vm_map_remove_guard(map, start, end,
 			    VM_MAP_REMOVE_GAPS_FAIL,
 			    KMEM_GUARD_NONE).kmr_return;
 			if (kr == KERN_INVALID_VALUE) {
@@ -607,13 +642,16 @@ reclaim_chunk(vm_deferred_reclamation_metadata_t metadata)
 				goto fail;
 			} else if (kr != KERN_SUCCESS) {
 				os_log_with_startup_serial(OS_LOG_DEFAULT,
-				    "vm_reclaim: Unable to deallocate 0x%llx (%u) from 0x%llx. Err: %d\n",
-				    entry->address, entry->size, (uint64_t) map, kr);
+				    "vm_reclaim: Unable to deallocate 0x%llx (%llu) from 0x%llx. Err: %d\n",
+				    entry->address, (uint64_t) (end - start), (uint64_t) map, kr);
 				reclaim_kill_with_reason(metadata, kGUARD_EXC_RECLAIM_DEALLOCATE_FAILURE, kr);
 				goto fail;
 			}
-			num_reclaimed++;
-			os_atomic_add(&metadata->vdrm_num_bytes_reclaimed, entry->size, relaxed);
+			num_reclaimed += run_entries;
+			if (run_entries > 1) {
+				os_atomic_add(&vm_reclaim_entries_coalesced, run_entries, relaxed);
+			}
+			os_atomic_add(&metadata->vdrm_num_bytes_reclaimed, run_bytes, relaxed);
 		}
 	}
 
@@ -825,6 +863,81 @@ vm_deferred_reclamation_reclaim_memory(vm_deferred_reclamation_action_t action)
 	}
 }
 
+static size_t
+estimated_reclaimable_bytes(vm_deferred_reclamation_metadata_t metadata)
+{
+	size_t num_bytes_reclaimed = os_atomic_load(&metadata->vdrm_num_bytes_reclaimed, relaxed);
+	size_t num_bytes_in_buffer = os_atomic_load(&metadata->vdrm_num_bytes_put_in_buffer, relaxed);
+
+	return num_bytes_in_buffer > num_bytes_reclaimed ? num_bytes_in_buffer - num_bytes_reclaimed : 0;
+}
+
+size_t
+vm_deferred_reclamation_reclaim_bytes(size_t bytes_goal)
+{
+	size_t total_reclaimed = 0;
+	uint64_t start, elapsed_ns;
+
+	start = mach_absolute_time();
+	lck_mtx_lock(&reclamation_buffers_lock);
+	reclamation_counter++;
+	while (total_reclaimed < bytes_goal) {
+		vm_deferred_reclamation_metadata_t metadata, best = NULL;
+		size_t best_bytes = 0, reclaimed_before, wanted;
+
+		/* Pick the buffer with the most to give that we haven't visited yet */
+		TAILQ_FOREACH(metadata, &reclamation_buffers, vdrm_list) {
+			size_t bytes = estimated_reclaimable_bytes(metadata);
+			if (metadata->vdrm_reclaimed_at < reclamation_counter && bytes > best_bytes) {
+				best = metadata;
+				best_bytes = bytes;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		metadata = best;
+		lck_mtx_lock(&metadata->vdrm_lock);
+		metadata->vdrm_reclaimed_at = reclamation_counter;
+		lck_mtx_unlock(&reclamation_buffers_lock);
+
+		if (!task_is_active(metadata->vdrm_task)) {
+			lck_mtx_unlock(&metadata->vdrm_lock);
+			lck_mtx_lock(&reclamation_buffers_lock);
+			continue;
+		}
+		wanted = bytes_goal - total_reclaimed;
+		reclaimed_before = os_atomic_load(&metadata->vdrm_num_bytes_reclaimed, relaxed);
+		while (true) {
+			size_t num_reclaimed = reclaim_chunk(metadata);
+			if (num_reclaimed == kReclaimChunkFailed) {
+				/* Lock has already been released & task is in the process of getting killed. */
+				metadata = NULL;
+				break;
+			}
+			if (num_reclaimed == 0 ||
+			    os_atomic_load(&metadata->vdrm_num_bytes_reclaimed, relaxed) - reclaimed_before >= wanted) {
+				break;
+			}
+		}
+		if (metadata != NULL) {
+			total_reclaimed += os_atomic_load(&metadata->vdrm_num_bytes_reclaimed, relaxed) - reclaimed_before;
+			lck_mtx_unlock(&metadata->vdrm_lock);
+		}
+
+		lck_mtx_lock(&reclamation_buffers_lock);
+	}
+	lck_mtx_unlock(&reclamation_buffers_lock);
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &elapsed_ns);
+	os_atomic_inc(&vm_reclaim_bytes_requests, relaxed);
+	os_atomic_add(&vm_reclaim_bytes_reclaimed, total_reclaimed, relaxed);
+	os_atomic_add(&vm_reclaim_bytes_latency_total_ns, elapsed_ns, relaxed);
+	os_atomic_max(&vm_reclaim_bytes_latency_max_ns, elapsed_ns, relaxed);
+
+	return total_reclaimed;
+}
+
 void
 vm_deferred_reclamation_reclaim_all_memory(void)
 {
@@ -842,7 +955,7 @@ vm_deferred_reclamation_reclaim_from_task_async(task_t task)
 		TAILQ_INSERT_TAIL(&async_reclamation_buffers, metadata, vdrm_async_list);
 		lck_mtx_unlock(&async_reclamation_buffers_lock);
 		queued = true;
-		thread_wakeup(&vm_reclaim_thread);
+		thread_wakeup_one(&vm_reclaim_thread);
 	}
 
 	return queued;
@@ -914,10 +1027,16 @@ vm_deferred_reclamation_buffer_unlock(vm_deferred_reclamation_metadata_t metadat
 static void
 reclaim_thread_init(void)
 {
+	__unused uint32_t id = os_atomic_inc_orig(&vm_reclaim_threads_started, relaxed);
+
 #if CONFIG_THREAD_GROUPS
 	thread_group_vm_add();
 #endif
 	thread_set_thread_name(current_thread(), "VM_reclaim");
+#if __AMP__
+	/* spread the reclaim threads over the clusters */
+	thread_bind_cluster_id(current_thread(), id % ml_get_cluster_count(), THREAD_BIND_SOFT);
+#endif /* __AMP__ */
 }
 
 
@@ -992,9 +1111,27 @@ vm_deferred_reclamation_init(void)
 		vm_reclaim_max_threshold = PAGE_SIZE;
 	}
 
+	if (vm_reclaim_thread_count == 0) {
+#if __AMP__
+		vm_reclaim_thread_count = ml_get_cluster_count();
+#else /* __AMP__ */
+		vm_reclaim_thread_count = 1;
+#endif /* __AMP__ */
+	}
+	vm_reclaim_thread_count = MIN(vm_reclaim_thread_count, VM_RECLAIM_MAX_THREADS);
+
 	result = kernel_thread_start_priority(reclaim_thread,
 	    (void *)RECLAIM_THREAD_INIT, kReclaimThreadPriority,
 	    &vm_reclaim_thread);
+	for (uint32_t i = 1; i < vm_reclaim_thread_count && result == KERN_SUCCESS; i++) {
+		thread_t thread;
+
+		result = kernel_thread_start_priority(reclaim_thread,
+		    (void *)RECLAIM_THREAD_INIT, kReclaimThreadPriority, &thread);
+		if (result == KERN_SUCCESS) {
+			thread_deallocate(thread);
+		}
+	}
 }
 
 STARTUP(EARLY_BOOT, STARTUP_RANK_MIDDLE, vm_deferred_reclamation_init);
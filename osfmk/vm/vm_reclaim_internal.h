@@ -66,6 +66,16 @@ void vm_deferred_reclamation_reclaim_memory(vm_deferred_reclamation_action_t act
  */
 void vm_deferred_reclamation_reclaim_all_memory(void);
 
+/*
+ * Reclaim at least bytes_goal bytes of deferred-free VA, taking from the
+ * buffers with the most reclaimable bytes first.
+ * For the memorystatus policy, when it needs a specific amount of memory
+ * back without draining every buffer. Latency is accounted in
+ * vm_reclaim_bytes_latency_{total,max}_ns.
+ * Returns the number of bytes reclaimed, which can be less than asked.
+ */
+size_t vm_deferred_reclamation_reclaim_bytes(size_t bytes_goal);
+
 bool vm_deferred_reclamation_reclaim_from_task_async(task_t task);
 bool vm_deferred_reclamation_reclaim_from_task_sync(task_t task, size_t max_entries_to_reclaim);
 
@@ -152,6 +152,31 @@ unsigned int shared_region_pagers_resident_peak = 0;
 
 int             PERCPU_DATA(start_color);
 vm_page_t       PERCPU_DATA(free_pages);
+struct vm_page_free_cache_stats PERCPU_DATA(free_pages_stats);
+
+/*
+ * Per-CPU free lists are refilled from the global free queues in
+ * batches of vpfc_refill_size pages.  A CPU that comes back for a new
+ * batch within VM_FREE_MAGAZINE_REFILL_FAST_NS doubles its batch, up
+ * to vm_free_magazine_depth times vm_free_magazine_refill_limit; one
+ * that takes more than 16 times as long halves it back down.
+ *
+ * While the system is above its free target and nobody is waiting
+ * for a page, vm_page_release() also parks freed pages on the per-CPU
+ * list, up to vm_free_magazine_release_max pages, and drains half of
+ * them back to the global free queues in one go when it overflows.
+ * Parked pages sit at the head of the list (vpfc_cached of them) and
+ * are counted in vm_page_free_cached_count rather than in
+ * vm_page_free_count; see VM_PAGE_FREE_COUNT_WITH_CACHED().  Once the
+ * free count drops below vm_page_free_reserved or someone is waiting
+ * for a page, each CPU gives its parked pages back on its next release.
+ */
+#define VM_FREE_MAGAZINE_REFILL_FAST_NS (1 * NSEC_PER_MSEC)
+
+TUNABLE(uint32_t, vm_free_magazine_depth, "vm_free_magazine_depth", 4);
+TUNABLE_WRITEABLE(uint32_t, vm_free_magazine_release_max,
+    "vm_free_magazine_release_max", 128);
+static uint64_t vm_free_magazine_refill_fast_abs;
 boolean_t       hibernate_cleaning_in_progress = FALSE;
 boolean_t       vm_page_free_verify = TRUE;
 
@@ -334,6 +359,7 @@ unsigned int    vm_page_free_wanted_privileged;
 unsigned int    vm_page_free_wanted_secluded;
 #endif /* CONFIG_SECLUDED_MEMORY */
 unsigned int    vm_page_free_count;
+unsigned int    vm_page_free_cached_count;
 
 /*
  *	Occasionally, the virtual memory system uses
@@ -3148,6 +3174,246 @@ vm_page_grab(void)
 boolean_t       hibernate_rebuild_needed = FALSE;
 #endif /* HIBERNATION */
 
+/*
+ * Size the next refill of this CPU's free list based on how quickly
+ * it went through the previous one.
+ * Called with preemption disabled.
+ */
+static unsigned int
+vm_page_free_cache_refill_size(
+	struct vm_page_free_cache_stats *stats)
+{
+	uint64_t        now = mach_absolute_time();
+	uint64_t        elapsed = now - stats->vpfc_last_refill;
+	unsigned int    size = stats->vpfc_refill_size;
+	unsigned int    max;
+
+	if (vm_free_magazine_refill_fast_abs == 0) {
+		nanoseconds_to_absolutetime(VM_FREE_MAGAZINE_REFILL_FAST_NS,
+		    &vm_free_magazine_refill_fast_abs);
+	}
+
+	max = vm_free_magazine_refill_limit * MAX(vm_free_magazine_depth, 1);
+	if (size < vm_free_magazine_refill_limit) {
+		size = vm_free_magazine_refill_limit;
+	} else if (elapsed < vm_free_magazine_refill_fast_abs) {
+		size = MIN(size * 2, max);
+	} else if (elapsed > 16 * vm_free_magazine_refill_fast_abs) {
+		size = MAX(size / 2, vm_free_magazine_refill_limit);
+	}
+
+	stats->vpfc_refill_size = size;
+	stats->vpfc_last_refill = now;
+	return size;
+}
+
+/*
+ * Return a list of pages that were sitting on a per-CPU free list
+ * to the global free queues, taking the free page lock once.
+ *
+ * Pages are only parked on per-CPU lists when nobody was waiting
+ * for memory, so waiters showing up in the meantime is rare: wake
+ * them all up and let them retry.
+ */
+static void
+vm_page_free_cache_drain(
+	vm_page_t       list,
+	unsigned int    count)
+{
+	vm_page_t       mem;
+	event_t         events[3];
+	int             nevents = 0;
+
+	vm_free_page_lock_spin();
+
+	while ((mem = list) != VM_PAGE_NULL) {
+		unsigned int color;
+
+		list = mem->vmp_snext;
+		assert(mem->vmp_q_state == VM_PAGE_ON_FREE_LOCAL_Q);
+		VM_PAGE_ZERO_PAGEQ_ENTRY(mem);
+		mem->vmp_q_state = VM_PAGE_ON_FREE_Q;
+
+		color = VM_PAGE_GET_COLOR(mem);
+#if defined(__x86_64__)
+		vm_page_queue_enter_clump(&vm_page_queue_free[color].qhead, mem);
+#else
+		vm_page_queue_enter(&vm_page_queue_free[color].qhead, mem, vmp_pageq);
+#endif
+	}
+	vm_page_free_count += count;
+
+	if (vm_page_free_wanted_privileged > 0) {
+		vm_page_free_wanted_privileged = 0;
+		events[nevents++] = (event_t)&vm_page_free_wanted_privileged;
+	}
+#if CONFIG_SECLUDED_MEMORY
+	if (vm_page_free_wanted_secluded > 0) {
+		vm_page_free_wanted_secluded = 0;
+		events[nevents++] = (event_t)&vm_page_free_wanted_secluded;
+	}
+#endif /* CONFIG_SECLUDED_MEMORY */
+	if (vm_page_free_wanted > 0) {
+		vm_page_free_wanted = 0;
+		events[nevents++] = (event_t)&vm_page_free_count;
+	}
+
+	vm_free_page_unlock();
+
+	VM_DEBUG_CONSTANT_EVENT(vm_page_release, VM_PAGE_RELEASE, DBG_FUNC_NONE, count, 0, 0, 0);
+
+	for (int i = 0; i < nevents; i++) {
+		if (vps_dynamic_priority_enabled == TRUE) {
+			wakeup_all_with_inheritor(events[i], THREAD_AWAKENED);
+		} else {
+			thread_wakeup(events[i]);
+		}
+	}
+}
+
+/*
+ * Give the pages vm_page_release() parked on the current CPU's free
+ * list back to the global free queues.
+ */
+static void
+vm_page_free_cache_reclaim(void)
+{
+	struct vm_page_free_cache_stats *stats;
+	vm_page_t       list, last;
+	unsigned int    count;
+
+	disable_preemption();
+
+	vm_offset_t pcpu_base = current_percpu_base();
+	vm_page_t *headp = PERCPU_GET_WITH_BASE(pcpu_base, free_pages);
+
+	stats = PERCPU_GET_WITH_BASE(pcpu_base, free_pages_stats);
+	count = stats->vpfc_cached;
+	if (count == 0) {
+		enable_preemption();
+		return;
+	}
+
+	list = last = *headp;
+	for (unsigned int i = 1; i < count; i++) {
+		last = last->vmp_snext;
+	}
+	*headp = last->vmp_snext;
+	last->vmp_snext = VM_PAGE_NULL;
+	stats->vpfc_count -= count;
+	stats->vpfc_cached = 0;
+	stats->vpfc_drains++;
+	stats->vpfc_drain_pages += count;
+
+	enable_preemption();
+
+	vm_page_free_cache_drain(list, count);
+	os_atomic_sub(&vm_page_free_cached_count, count, relaxed);
+}
+
+/*
+ * Try to park a page being freed on the current CPU's free list.
+ * Returns false if the page must go to the global free queues.
+ */
+static bool
+vm_page_free_cache_release(
+	vm_page_t       mem)
+{
+	struct vm_page_free_cache_stats *stats;
+	vm_page_t       drain = VM_PAGE_NULL;
+	unsigned int    drain_count = 0;
+	unsigned int    drain_cached = 0;
+	unsigned int    max = vm_free_magazine_release_max;
+	unsigned int    keep = max / 2;
+
+#if HIBERNATION
+	if (hibernate_rebuild_needed) {
+		return false;
+	}
+#endif /* HIBERNATION */
+	if (vm_page_free_count < vm_page_free_reserved ||
+	    vm_page_free_wanted != 0 ||
+	    vm_page_free_wanted_privileged != 0) {
+		/* memory is short: don't sit on free pages */
+		if (os_atomic_load(&vm_page_free_cached_count, relaxed) != 0) {
+			vm_page_free_cache_reclaim();
+		}
+		return false;
+	}
+	if (keep == 0 ||
+	    mem->vmp_lopage || vm_lopage_refill ||
+	    vm_page_free_count <= vm_page_free_target) {
+		return false;
+	}
+#if CONFIG_SECLUDED_MEMORY
+	if (vm_page_free_wanted_secluded != 0 ||
+	    (vm_page_secluded_count < vm_page_secluded_target &&
+	    num_tasks_can_use_secluded_mem == 0)) {
+		return false;
+	}
+#endif /* CONFIG_SECLUDED_MEMORY */
+
+	mem->vmp_on_specialq = VM_PAGE_SPECIAL_Q_EMPTY;
+	mem->vmp_q_state = VM_PAGE_ON_FREE_LOCAL_Q;
+
+	disable_preemption();
+
+	vm_offset_t pcpu_base = current_percpu_base();
+	vm_page_t *headp = PERCPU_GET_WITH_BASE(pcpu_base, free_pages);
+
+	stats = PERCPU_GET_WITH_BASE(pcpu_base, free_pages_stats);
+	if (stats->vpfc_count >= max) {
+		vm_page_t last = *headp;
+
+		/* keep the most recently freed (cache hot) half */
+		for (unsigned int i = 1; i < keep; i++) {
+			last = last->vmp_snext;
+		}
+		drain = last->vmp_snext;
+		last->vmp_snext = VM_PAGE_NULL;
+		drain_count = stats->vpfc_count - keep;
+		stats->vpfc_count = keep;
+		if (stats->vpfc_cached > keep) {
+			drain_cached = stats->vpfc_cached - keep;
+			stats->vpfc_cached = keep;
+		}
+		stats->vpfc_drains++;
+		stats->vpfc_drain_pages += drain_count;
+	}
+	mem->vmp_snext = *headp;
+	*headp = mem;
+	stats->vpfc_count++;
+	stats->vpfc_cached++;
+	stats->vpfc_release_hits++;
+	os_atomic_inc(&vm_page_free_cached_count, relaxed);
+
+	enable_preemption();
+
+	if (drain) {
+		vm_page_free_cache_drain(drain, drain_count);
+		if (drain_cached) {
+			os_atomic_sub(&vm_page_free_cached_count, drain_cached, relaxed);
+		}
+	}
+	return true;
+}
+
+int
+vm_page_free_cache_stats_copy(
+	struct vm_page_free_cache_stats *out,
+	int                             max_cpus)
+{
+	int cpu = 0;
+
+	percpu_foreach(stats, free_pages_stats) {
+		if (cpu == max_cpus) {
+			break;
+		}
+		out[cpu++] = *stats;
+	}
+	return cpu;
+}
+
 vm_page_t
 vm_page_grab_options(
 	int grab_options)
@@ -3169,6 +3435,16 @@ restart:
 		vm_page_grab_diags();
 
 		vm_offset_t pcpu_base = current_percpu_base();
+		struct vm_page_free_cache_stats *stats;
+
+		stats = PERCPU_GET_WITH_BASE(pcpu_base, free_pages_stats);
+		stats->vpfc_hits++;
+		stats->vpfc_count--;
+		if (stats->vpfc_cached != 0) {
+			/* parked pages are at the head of the list */
+			stats->vpfc_cached--;
+			os_atomic_dec(&vm_page_free_cached_count, relaxed);
+		}
 		counter_inc_preemption_disabled(&vm_page_grab_count);
 		*PERCPU_GET_WITH_BASE(pcpu_base, free_pages) = mem->vmp_snext;
 		VM_DEBUG_EVENT(vm_page_grab, VM_PAGE_GRAB, DBG_FUNC_NONE, grab_options, 0, 0, 0);
@@ -3197,6 +3473,7 @@ restart:
 		}
 		return mem;
 	}
+	PERCPU_GET(free_pages_stats)->vpfc_misses++;
 	enable_preemption();
 
 
@@ -3269,8 +3546,11 @@ restart:
 		vm_page_t        head;
 		vm_page_t        tail;
 		unsigned int     pages_to_steal;
+		unsigned int     pages_stolen;
+		unsigned int     refill_size;
 		unsigned int     color;
 		unsigned int clump_end, sub_count;
+		struct vm_page_free_cache_stats *stats;
 
 		while (vm_page_free_count == 0) {
 			vm_free_page_unlock();
@@ -3300,11 +3580,14 @@ restart:
 			goto restart;
 		}
 
+		stats = PERCPU_GET(free_pages_stats);
+		refill_size = vm_page_free_cache_refill_size(stats);
+
 		if (vm_page_free_count <= vm_page_free_reserved) {
 			pages_to_steal = 1;
 		} else {
-			if (vm_free_magazine_refill_limit <= (vm_page_free_count - vm_page_free_reserved)) {
-				pages_to_steal = vm_free_magazine_refill_limit;
+			if (refill_size <= (vm_page_free_count - vm_page_free_reserved)) {
+				pages_to_steal = refill_size;
 			} else {
 				pages_to_steal = (vm_page_free_count - vm_page_free_reserved);
 			}
@@ -3313,6 +3596,7 @@ restart:
 		head = tail = NULL;
 
 		vm_page_free_count -= pages_to_steal;
+		pages_stolen = pages_to_steal;
 		clump_end = sub_count = 0;
 
 		while (pages_to_steal--) {
@@ -3384,6 +3668,10 @@ restart:
 		vm_offset_t pcpu_base = current_percpu_base();
 		*PERCPU_GET_WITH_BASE(pcpu_base, free_pages) = head;
 		*PERCPU_GET_WITH_BASE(pcpu_base, start_color) = color;
+		assert(stats->vpfc_cached == 0);
+		stats->vpfc_count = pages_stolen;
+		stats->vpfc_refills++;
+		stats->vpfc_refill_pages += pages_stolen;
 
 		vm_free_page_unlock();
 		enable_preemption();
@@ -3673,8 +3961,6 @@ vm_page_release(
 
 	pmap_clear_noencrypt(VM_PAGE_GET_PHYS_PAGE(mem));
 
-	vm_free_page_lock_spin();
-
 	assert(mem->vmp_q_state == VM_PAGE_NOT_ON_Q);
 	assert(mem->vmp_busy);
 	assert(!mem->vmp_laundry);
@@ -3683,6 +3969,13 @@ vm_page_release(
 	assert(mem->vmp_listq.next == 0 && mem->vmp_listq.prev == 0);
 	assert(mem->vmp_specialq.next == 0 && mem->vmp_specialq.prev == 0);
 
+	if (!page_queues_locked && vm_page_free_cache_release(mem)) {
+		VM_DEBUG_CONSTANT_EVENT(vm_page_release, VM_PAGE_RELEASE, DBG_FUNC_NONE, 1, 0, 0, 0);
+		return;
+	}
+
+	vm_free_page_lock_spin();
+
 	/* Clear any specialQ hints before releasing page to the free pool*/
 	mem->vmp_on_specialq = VM_PAGE_SPECIAL_Q_EMPTY;
 
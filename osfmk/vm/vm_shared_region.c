@@ -107,6 +107,7 @@
 #include <mach/mach_vm.h>
 #include <mach/machine.h>
 
+#include <vm/vm_fault.h>
 #include <vm/vm_map.h>
 #include <vm/vm_map_internal.h>
 #include <vm/vm_shared_region.h>
@@ -146,6 +147,13 @@ int shared_region_persistence = 0;      /* no by default */
 /* delay in seconds before reclaiming an unused shared region */
 TUNABLE_WRITEABLE(int, shared_region_destroy_delay, "vm_shared_region_destroy_delay", 120);
 
+/*
+ * Number of pages at the start of each slid mapping to fault in (and
+ * slide) at map time rather than on first touch by a task.
+ */
+TUNABLE_WRITEABLE(uint32_t, shared_region_preslide_pages, "vm_shared_region_preslide", 0);
+uint64_t shared_region_preslid = 0;
+
 /*
  * Cached pointer to the most recently mapped shared region from PID 1, which should
  * be the most commonly mapped shared region in the system.  There are many processes
@@ -2737,6 +2745,29 @@ vm_shared_region_slide_mapping(
 	    (uint64_t) tmp_entry->vme_start,
 	    tmp_entry);
 
+	/*
+	 * Optionally slide the first pages of the mapping now: they land
+	 * in the pager's object and in the shared region's pmap, so every
+	 * task using this shared region finds them already slid.
+	 * This is best effort, any failure is left for the real fault.
+	 */
+	if (shared_region_preslide_pages) {
+		vm_map_offset_t preslide_end;
+
+		preslide_end = tmp_entry->vme_start +
+		    ptoa_64(MIN(shared_region_preslide_pages,
+		    atop_64(tmp_entry->vme_end - tmp_entry->vme_start)));
+		for (map_addr = tmp_entry->vme_start;
+		    map_addr < preslide_end;
+		    map_addr += PAGE_SIZE) {
+			if (vm_fault(sr_map, map_addr, VM_PROT_READ, FALSE,
+			    VM_KERN_MEMORY_NONE, THREAD_UNINT, NULL, 0) != KERN_SUCCESS) {
+				break;
+			}
+			shared_region_preslid++;
+		}
+	}
+
 	/* success! */
 	kr = KERN_SUCCESS;
 
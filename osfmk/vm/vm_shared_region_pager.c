@@ -316,8 +316,11 @@ LCK_MTX_DECLARE(shared_region_pager_lock, &shared_region_pager_lck_grp);
 
 /*
  * Maximum number of unmapped pagers we're willing to keep around.
+ * A cached pager keeps its already-slid pages resident, so the next
+ * task mapping the same slide (and, for auth sections, the same key)
+ * gets them without running the rebase chains again.
  */
-int shared_region_pager_cache_limit = 0;
+TUNABLE_WRITEABLE(int, shared_region_pager_cache_limit, "vm_shared_region_pager_cache", 0);
 
 /*
  * Statistics & counters.
@@ -2526,6 +2526,57 @@ out:
 	return kr;
 }
 
+/*
+ *	mach_vm_range_apply
+ *
+ *	Applies the array of struct mach_vm_range_op found at "ops_addr" in
+ *	the caller's address space to the target map, stopping at the first
+ *	failure.  On return, "ops_count" holds the number of operations that
+ *	were applied.
+ */
+kern_return_t
+mach_vm_range_apply(
+	vm_map_t                map,
+	mach_vm_address_t       ops_addr,
+	mach_vm_size_t          *ops_count)
+{
+	struct mach_vm_range_op *ops;
+	mach_vm_size_t          count, applied = 0;
+	vm_size_t               ops_size;
+	kern_return_t           kr;
+
+	if (map == VM_MAP_NULL || ops_count == NULL) {
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	count = *ops_count;
+	*ops_count = 0;
+	if (count == 0) {
+		return KERN_SUCCESS;
+	}
+	if (count > MACH_VM_RANGE_OP_MAX_COUNT) {
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	ops_size = (vm_size_t)count * sizeof(struct mach_vm_range_op);
+	ops = kalloc_data(ops_size, Z_WAITOK);
+	if (ops == NULL) {
+		return KERN_RESOURCE_SHORTAGE;
+	}
+
+	if (copyin(ops_addr, ops, ops_size)) {
+		kr = KERN_INVALID_ADDRESS;
+		goto out;
+	}
+
+	kr = vm_map_range_apply(map, ops, count, &applied);
+	*ops_count = applied;
+
+out:
+	kfree_data(ops, ops_size);
+	return kr;
+}
+
 kern_return_t
 mach_vm_page_info(
 	vm_map_t                map,
@@ -45,6 +45,7 @@
 
 #include <kern/copyout_shim.h>
 #include <kern/zalloc_internal.h>
+#include <libkern/copyio.h>
 
 #undef copyin
 #undef copyout
@@ -164,6 +165,93 @@ user_access_disable(void)
 #define COPYIO_TRACE(x, a, b, c, d, e) do { } while(0)
 #endif
 
+/*
+ * State saved by copyio_window_open() for copyio_window_close().
+ */
+struct copyio_window {
+	boolean_t       cw_pdswitch;
+	boolean_t       cw_nopagezero;
+	boolean_t       cw_recursive;
+};
+
+/*
+ * Open a window during which the current thread may access user memory.
+ *
+ * If the no_shared_cr3 boot-arg is set (true), the kernel runs on
+ * its own pmap and cr3 rather than the user's -- so that wild accesses
+ * from kernel or kexts can be trapped. So, during copyin and copyout,
+ * we need to switch back to the user's map/cr3. The thread is flagged
+ * "CopyIOActive" at this time so that if the thread is pre-empted,
+ * we will later restore the correct cr3.
+ */
+static inline void
+copyio_window_open(thread_t thread, pmap_t pmap, int use_kernel_map,
+    struct copyio_window *cw)
+{
+	boolean_t istate = FALSE;
+
+	cw->cw_nopagezero = pmap->pagezero_accessible;
+	cw->cw_recursive = thread->machine.specFlags & CopyIOActive;
+	cw->cw_pdswitch = no_shared_cr3 || cw->cw_nopagezero;
+
+	if (__improbable(cw->cw_pdswitch)) {
+		istate = ml_set_interrupts_enabled(FALSE);
+		if (cw->cw_nopagezero && pmap_pcid_ncpus) {
+			pmap_pcid_activate(pmap, cpu_number(), TRUE, TRUE);
+		} else if (get_cr3_base() != pmap->pm_cr3) {
+			set_cr3_raw(pmap->pm_cr3);
+		}
+		thread->machine.specFlags |= CopyIOActive;
+	} else {
+		thread->machine.specFlags |= CopyIOActive;
+	}
+
+	user_access_enable();
+
+#if DEVELOPMENT || DEBUG
+	/*
+	 * Ensure that we're running on the target thread's cr3.
+	 */
+	if ((pmap != kernel_pmap) && !use_kernel_map &&
+	    (get_cr3_base() != pmap->pm_cr3)) {
+		panic("copyio: thread %p cr3 is %p expects %p", thread,
+		    (void *) get_cr3_raw(), (void *) pmap->pm_cr3);
+	}
+#else
+	(void)use_kernel_map;
+#endif
+
+	if (__improbable(cw->cw_pdswitch)) {
+		(void) ml_set_interrupts_enabled(istate);
+	}
+}
+
+static inline void
+copyio_window_close(thread_t thread, pmap_t pmap, struct copyio_window *cw)
+{
+	boolean_t istate;
+
+	user_access_disable();
+
+	if (__improbable(cw->cw_pdswitch)) {
+		istate = ml_set_interrupts_enabled(FALSE);
+		if (!cw->cw_recursive && (get_cr3_raw() != kernel_pmap->pm_cr3)) {
+			if (cw->cw_nopagezero && pmap_pcid_ncpus) {
+				pmap_pcid_activate(pmap, cpu_number(), TRUE, FALSE);
+			} else {
+				set_cr3_raw(kernel_pmap->pm_cr3);
+			}
+		}
+
+		if (!cw->cw_recursive) {
+			thread->machine.specFlags &= ~CopyIOActive;
+		}
+		(void) ml_set_interrupts_enabled(istate);
+	} else if (!cw->cw_recursive) {
+		thread->machine.specFlags &= ~CopyIOActive;
+	}
+}
+
 static int
 copyio(int copy_type, user_addr_t user_addr, char *kernel_addr,
     vm_size_t nbytes, vm_size_t *lencopied, int use_kernel_map)
@@ -172,8 +260,7 @@ copyio(int copy_type, user_addr_t user_addr, char *kernel_addr,
 	pmap_t          pmap;
 	vm_size_t       bytes_copied;
 	int             error = 0;
-	boolean_t       istate = FALSE;
-	boolean_t       recursive_CopyIOActive;
+	struct copyio_window cw;
 #if     COPYIO_TRACE_ENABLED
 	int             debug_type = 0xeff70010;
 	debug_type += (copy_type << 2);
@@ -192,7 +279,6 @@ copyio(int copy_type, user_addr_t user_addr, char *kernel_addr,
 	}
 
 	pmap = thread->map->pmap;
-	boolean_t nopagezero = thread->map->pmap->pagezero_accessible;
 
 	if ((copy_type != COPYINPHYS) && (copy_type != COPYOUTPHYS)) {
 		if (__improbable((vm_offset_t)kernel_addr < VM_MIN_KERNEL_AND_KEXT_ADDRESS)) {
@@ -232,47 +318,7 @@ copyio(int copy_type, user_addr_t user_addr, char *kernel_addr,
 	}
 #endif
 
-	/*
-	 * If the no_shared_cr3 boot-arg is set (true), the kernel runs on
-	 * its own pmap and cr3 rather than the user's -- so that wild accesses
-	 * from kernel or kexts can be trapped. So, during copyin and copyout,
-	 * we need to switch back to the user's map/cr3. The thread is flagged
-	 * "CopyIOActive" at this time so that if the thread is pre-empted,
-	 * we will later restore the correct cr3.
-	 */
-	recursive_CopyIOActive = thread->machine.specFlags & CopyIOActive;
-
-	boolean_t pdswitch = no_shared_cr3 || nopagezero;
-
-	if (__improbable(pdswitch)) {
-		istate = ml_set_interrupts_enabled(FALSE);
-		if (nopagezero && pmap_pcid_ncpus) {
-			pmap_pcid_activate(pmap, cpu_number(), TRUE, TRUE);
-		} else if (get_cr3_base() != pmap->pm_cr3) {
-			set_cr3_raw(pmap->pm_cr3);
-		}
-		thread->machine.specFlags |= CopyIOActive;
-	} else {
-		thread->machine.specFlags |= CopyIOActive;
-	}
-
-	user_access_enable();
-
-#if DEVELOPMENT || DEBUG
-	/*
-	 * Ensure that we're running on the target thread's cr3.
-	 */
-	if ((pmap != kernel_pmap) && !use_kernel_map &&
-	    (get_cr3_base() != pmap->pm_cr3)) {
-		panic("copyio(%d,%p,%p,%ld,%p,%d) cr3 is %p expects %p",
-		    copy_type, (void *)user_addr, kernel_addr, nbytes, lencopied, use_kernel_map,
-		    (void *) get_cr3_raw(), (void *) pmap->pm_cr3);
-	}
-#endif
-
-	if (__improbable(pdswitch)) {
-		(void) ml_set_interrupts_enabled(istate);
-	}
+	copyio_window_open(thread, pmap, use_kernel_map, &cw);
 
 	COPYIO_TRACE(0xeff70044 | DBG_FUNC_NONE, user_addr,
 	    kernel_addr, nbytes, 0, 0);
@@ -363,33 +409,79 @@ copyio(int copy_type, user_addr_t user_addr, char *kernel_addr,
 		}
 	}
 
-	user_access_disable();
+	copyio_window_close(thread, pmap, &cw);
 
-	if (__improbable(pdswitch)) {
-		istate = ml_set_interrupts_enabled(FALSE);
-		if (!recursive_CopyIOActive && (get_cr3_raw() != kernel_pmap->pm_cr3)) {
-			if (nopagezero && pmap_pcid_ncpus) {
-				pmap_pcid_activate(pmap, cpu_number(), TRUE, FALSE);
-			} else {
-				set_cr3_raw(kernel_pmap->pm_cr3);
-			}
+out:
+	COPYIO_TRACE(debug_type | DBG_FUNC_END, user_addr, kernel_addr, nbytes, error, 0);
+
+	return error;
+}
+
+
+/*
+ * Vectored COPYIN/COPYOUT: the user region is range checked once, the
+ * kernel side of every element up front, and all the elements are then
+ * copied within a single window (one cr3 switch and STAC/CLAC pair).
+ */
+static int
+copyio_vector(int copy_type, user_addr_t uaddr, vm_size_t size,
+    const struct copyio_vec *vec, unsigned int count)
+{
+	thread_t        thread = current_thread();
+	pmap_t          pmap = thread->map->pmap;
+	struct copyio_window cw;
+	int             error = 0;
+
+	if (__improbable((pmap != kernel_pmap) &&
+	    ((uaddr + size < uaddr) || ((uaddr + size) > vm_map_max(thread->map))))) {
+		return EFAULT;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		const struct copyio_vec *civ = &vec[i];
+
+		if (__improbable(civ->civ_uaddr < uaddr || civ->civ_len > size ||
+		    civ->civ_uaddr - uaddr > size - civ->civ_len)) {
+			return EFAULT;
+		}
+		if (__improbable(civ->civ_len > copysize_limit_panic)) {
+			panic("%s(%p, %p, %lu) - transfer too large", __func__,
+			    (void *)civ->civ_uaddr, civ->civ_kaddr, civ->civ_len);
 		}
+		if (civ->civ_len == 0) {
+			continue;
+		}
+		if (__improbable((vm_offset_t)civ->civ_kaddr < VM_MIN_KERNEL_AND_KEXT_ADDRESS)) {
+			panic("Invalid copy parameter, copy type: %d, kernel address: %p",
+			    copy_type, civ->civ_kaddr);
+		}
+		zone_element_bounds_check((vm_offset_t)civ->civ_kaddr, civ->civ_len);
+#if KASAN
+		if (copy_type == COPYIN) {
+			__asan_storeN((uptr)civ->civ_kaddr, civ->civ_len);
+		} else {
+			__asan_loadN((uptr)civ->civ_kaddr, civ->civ_len);
+		}
+#endif
+	}
 
-		if (!recursive_CopyIOActive) {
-			thread->machine.specFlags &= ~CopyIOActive;
+	copyio_window_open(thread, pmap, 0, &cw);
+
+	for (unsigned int i = 0; i < count && error == 0; i++) {
+		if (copy_type == COPYIN) {
+			error = _bcopy((const void *) vec[i].civ_uaddr,
+			    vec[i].civ_kaddr, vec[i].civ_len);
+		} else {
+			error = _bcopy(vec[i].civ_kaddr,
+			    (void *) vec[i].civ_uaddr, vec[i].civ_len);
 		}
-		(void) ml_set_interrupts_enabled(istate);
-	} else if (!recursive_CopyIOActive) {
-		thread->machine.specFlags &= ~CopyIOActive;
 	}
 
-out:
-	COPYIO_TRACE(debug_type | DBG_FUNC_END, user_addr, kernel_addr, nbytes, error, 0);
+	copyio_window_close(thread, pmap, &cw);
 
 	return error;
 }
 
-
 static int
 copyio_phys(addr64_t source, addr64_t sink, vm_size_t csize, int which)
 {
@@ -504,6 +596,23 @@ copyout(const void *kernel_addr, user_addr_t user_addr, vm_size_t nbytes)
 	return copyio(COPYOUT, user_addr, (char *)(uintptr_t)kernel_addr, nbytes, NULL, 0);
 }
 
+int
+copyin_vec(user_addr_t uaddr, size_t size, const struct copyio_vec *vec,
+    unsigned int count)
+{
+	return copyio_vector(COPYIN, uaddr, size, vec, count);
+}
+
+int
+copyout_vec(user_addr_t uaddr, size_t size, const struct copyio_vec *vec,
+    unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		CALL_COPYOUT_SHIM_NRML(vec[i].civ_kaddr, vec[i].civ_uaddr, vec[i].civ_len)
+	}
+	return copyio_vector(COPYOUT, uaddr, size, vec, count);
+}
+
 #if (DEBUG || DEVELOPMENT)
 int
 verify_write(const void *source, void *dst, size_t size)
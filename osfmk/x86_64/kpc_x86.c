@@ -43,6 +43,9 @@
 #include <kperf/action.h>
 
 #include <kern/monotonic.h>
+#if MONOTONIC
+#include <x86_64/monotonic.h>
+#endif /* MONOTONIC */
 
 /* Fixed counter mask for each fixed counter -- each with OS and USER */
 #define IA32_FIXED_CTR_ENABLE_ALL_RINGS (0x3)
@@ -299,8 +302,22 @@ kpc_set_running_mp_call( void *vstate )
 		set_running_fixed(mp_config->classes & KPC_CLASS_FIXED_MASK);
 	}
 
+#if MONOTONIC && CONFIG_PERVASIVE_MEMBW
+	boolean_t enabled = ml_set_interrupts_enabled(FALSE);
+	if (mp_config->cfg_state_mask) {
+		mt_membw_release();
+	}
+#endif /* MONOTONIC && CONFIG_PERVASIVE_MEMBW */
+
 	set_running_configurable(mp_config->cfg_target_mask,
 	    mp_config->cfg_state_mask);
+
+#if MONOTONIC && CONFIG_PERVASIVE_MEMBW
+	if (!mp_config->cfg_state_mask) {
+		mt_membw_acquire();
+	}
+	ml_set_interrupts_enabled(enabled);
+#endif /* MONOTONIC && CONFIG_PERVASIVE_MEMBW */
 }
 
 int
@@ -490,6 +507,9 @@ kpc_set_config_mp_call(void *vmp_config)
 	}
 
 	if (classes & KPC_CLASS_CONFIGURABLE_MASK) {
+#if MONOTONIC && CONFIG_PERVASIVE_MEMBW
+		mt_membw_release();
+#endif /* MONOTONIC && CONFIG_PERVASIVE_MEMBW */
 		kpc_set_configurable_config(&new_config[count], mp_config->pmc_mask);
 		count += kpc_popcount(mp_config->pmc_mask);
 	}
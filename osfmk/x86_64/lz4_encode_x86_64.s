@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <vm/lz4_assembly_select.h>
+#if LZ4_ENABLE_ASSEMBLY_MATCH_X86_64
+
+/*
+
+  const uint8_t * lz4_match_end_asm(
+    const uint8_t * ref,                    first byte of the reference after the known 4 byte match
+    const uint8_t * cur,                    first byte of the current position after the known match
+    const uint8_t * cur_end)                "relaxed" end of input buffer
+
+  Extend a match forward 32 bytes at a time, comparing with pcmpeqb/pmovmskb
+  (vpcmpeqb on a 256-bit register when built for AVX2), and return the first
+  byte of cur that differs from ref.
+
+  Like the C loop in lz4_encode_2gb it replaces, this compares whole 32 byte
+  blocks as long as cur < cur_end, so it may read and return up to 31 bytes
+  past cur_end: the caller keeps LZ4_GOFAST_SAFETY_MARGIN bytes of slack.
+
+*/
+
+#define ref		%rdi    // arg0
+#define cur		%rsi    // arg1
+#define cur_end		%rdx    // arg2
+
+.globl _lz4_match_end_asm
+
+.text
+.p2align 6
+_lz4_match_end_asm:
+    push	%rbp
+    mov		%rsp,%rbp
+    cmp		cur_end,cur
+    jae		L_match_done
+
+L_match_loop:
+#ifdef __AVX2__
+    vmovdqu	(ref),%ymm0
+    vpcmpeqb	(cur),%ymm0,%ymm0
+    vpmovmskb	%ymm0,%eax			// bit i set if byte i matches
+#else
+    movdqu	(ref),%xmm0
+    movdqu	(cur),%xmm1
+    pcmpeqb	%xmm1,%xmm0
+    pmovmskb	%xmm0,%eax
+    movdqu	16(ref),%xmm0
+    movdqu	16(cur),%xmm1
+    pcmpeqb	%xmm1,%xmm0
+    pmovmskb	%xmm0,%ecx
+    shl		$16,%ecx
+    or		%ecx,%eax			// bit i set if byte i matches
+#endif
+    not		%eax				// bit i set if byte i differs
+    test	%eax,%eax
+    jnz		L_match_mismatch
+    add		$32,ref
+    add		$32,cur
+    cmp		cur_end,cur
+    jb		L_match_loop
+
+L_match_done:
+    mov		cur,%rax
+#ifdef __AVX2__
+    vzeroupper
+#endif
+    pop		%rbp
+    ret
+
+L_match_mismatch:
+    bsf		%eax,%eax			// index of the first differing byte
+    add		%rax,cur
+    jmp		L_match_done
+
+#endif // LZ4_ENABLE_ASSEMBLY_MATCH_X86_64
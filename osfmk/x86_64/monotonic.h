@@ -42,4 +42,15 @@
 
 extern bool mt_core_supported;
 
+#if CONFIG_PERVASIVE_MEMBW
+/*
+ * Memory traffic sampling uses the last configurable counter.  kpc releases
+ * it from the sampler on each CPU before configuring or running the
+ * configurable counters and gives it back when it stops running them.
+ */
+extern int mt_membw_supported;
+void mt_membw_release(void);
+void mt_membw_acquire(void);
+#endif /* CONFIG_PERVASIVE_MEMBW */
+
 #endif /* !defined(X86_64_MONOTONIC_H) */
@@ -33,6 +33,8 @@
 #include <i386/proc_reg.h>
 #include <kern/assert.h> /* static_assert, assert */
 #include <kern/monotonic.h>
+#include <kern/percpu.h>
+#include <kern/recount.h>
 #include <os/overflow.h>
 #include <sys/errno.h>
 #include <sys/monotonic.h>
@@ -184,6 +186,113 @@ mt_fixed_counter_set_ctrl_mask(uint8_t ctrlbits)
 
 static void mt_check_for_pmi(struct mt_cpu *mtc, x86_saved_state_t *state);
 
+#pragma mark memory traffic sampling
+
+#if CONFIG_PERVASIVE_MEMBW
+
+/*
+ * The last configurable counter counts last-level cache misses (an
+ * architectural event) and raises a PMI every `mt_membw_period` misses.  Each
+ * PMI charges that many cache lines of memory traffic to the thread on-core
+ * through Recount, so a thread is charged for the sampling periods it
+ * completes rather than for exactly the misses it took.
+ *
+ * The counter belongs to kpc while kpc uses the configurable counters, and the
+ * sampling stops on each CPU for that time.
+ */
+
+#define PERFEVTSEL_LLC_MISSES (0x412e) /* LONGEST_LAT_CACHE.MISS */
+#define PERFEVTSEL_USR (UINT64_C(1) << 16)
+#define PERFEVTSEL_OS (UINT64_C(1) << 17)
+#define PERFEVTSEL_INT (UINT64_C(1) << 20)
+#define PERFEVTSEL_EN (UINT64_C(1) << 22)
+
+/* CPUID.0AH:EBX bits are set for architectural events that are unavailable */
+#define CPUID_PERF_LLC_MISSES_UNAVAILABLE (1U << 4)
+
+int mt_membw_supported = 0;
+static uint32_t mt_membw_ctr;
+static uint32_t mt_membw_period = 16384;
+static uint64_t mt_membw_sample_bytes;
+static bool PERCPU_DATA(mt_membw_released);
+
+static bool
+mt_membw_active(void)
+{
+	return mt_membw_supported && !*PERCPU_GET(mt_membw_released);
+}
+
+static void
+mt_membw_arm(void)
+{
+	wrmsr64(MSR_IA32_EVNTSEL0 + mt_membw_ctr, 0);
+	wrmsr64(MSR_IA32_PERFCTR0 + mt_membw_ctr,
+	    kpc_configurable_max() - mt_membw_period);
+	wrmsr64(MSR_IA32_EVNTSEL0 + mt_membw_ctr, PERFEVTSEL_LLC_MISSES |
+	    PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_INT | PERFEVTSEL_EN);
+}
+
+static void
+mt_membw_pmi(void)
+{
+	recount_add_memory_bytes(current_thread(), current_task(),
+	    mt_membw_sample_bytes);
+	wrmsr64(MSR_IA32_PERFCTR0 + mt_membw_ctr,
+	    kpc_configurable_max() - mt_membw_period);
+	wrmsr64(GLOBAL_OVF, UINT64_C(1) << mt_membw_ctr);
+}
+
+void
+mt_membw_release(void)
+{
+	assert(ml_get_interrupts_enabled() == FALSE);
+	if (!mt_membw_active()) {
+		return;
+	}
+	*PERCPU_GET(mt_membw_released) = true;
+	wrmsr64(GLOBAL_CTRL, rdmsr64(GLOBAL_CTRL) & ~(UINT64_C(1) << mt_membw_ctr));
+	wrmsr64(MSR_IA32_EVNTSEL0 + mt_membw_ctr, 0);
+	wrmsr64(GLOBAL_OVF, UINT64_C(1) << mt_membw_ctr);
+}
+
+void
+mt_membw_acquire(void)
+{
+	assert(ml_get_interrupts_enabled() == FALSE);
+	if (!mt_membw_supported) {
+		return;
+	}
+	*PERCPU_GET(mt_membw_released) = false;
+	mt_membw_arm();
+	wrmsr64(GLOBAL_CTRL, rdmsr64(GLOBAL_CTRL) | (UINT64_C(1) << mt_membw_ctr));
+}
+
+static void
+mt_membw_init(i386_cpu_info_t *info)
+{
+	cpuid_arch_perf_leaf_t *perf = &info->cpuid_arch_perf_leaf;
+
+	if (perf->number == 0 || perf->events_number <= 4 ||
+	    (perf->events & CPUID_PERF_LLC_MISSES_UNAVAILABLE)) {
+		return;
+	}
+	if (PE_parse_boot_argn("mt_membw_period", &mt_membw_period,
+	    sizeof(mt_membw_period)) && mt_membw_period == 0) {
+		return;
+	}
+	/* the counters are preset through 32-bit sign-extended writes */
+	if (mt_membw_period > INT32_MAX) {
+		mt_membw_period = INT32_MAX;
+	}
+
+	mt_membw_ctr = perf->number - 1;
+	mt_membw_sample_bytes = (uint64_t)mt_membw_period *
+	    info->cpuid_cache_linesize;
+	mt_membw_supported = 1;
+}
+
+#endif /* CONFIG_PERVASIVE_MEMBW */
+
 static void
 enable_counters(void)
 {
@@ -194,6 +303,11 @@ enable_counters(void)
 	if (kpc_get_running() & KPC_CLASS_CONFIGURABLE_MASK) {
 		global_en |= kpc_get_configurable_pmc_mask(KPC_CLASS_CONFIGURABLE_MASK);
 	}
+#if CONFIG_PERVASIVE_MEMBW
+	if (mt_membw_active()) {
+		global_en |= UINT64_C(1) << mt_membw_ctr;
+	}
+#endif /* CONFIG_PERVASIVE_MEMBW */
 
 	wrmsr64(GLOBAL_CTRL, global_en);
 }
@@ -234,6 +348,11 @@ core_up(cpu_data_t *cpu)
 	for (uint32_t i = 0; i < kpc_fixed_count(); i++) {
 		mt_core_set_snap(i, mtc->mtc_snaps[i]);
 	}
+#if CONFIG_PERVASIVE_MEMBW
+	if (mt_membw_active()) {
+		mt_membw_arm();
+	}
+#endif /* CONFIG_PERVASIVE_MEMBW */
 	enable_counters();
 	mtc->mtc_active = true;
 }
@@ -302,6 +421,13 @@ mt_check_for_pmi(struct mt_cpu *mtc, x86_saved_state_t *state)
 		}
 	}
 
+#if CONFIG_PERVASIVE_MEMBW
+	if (mt_membw_active() && (status & (UINT64_C(1) << mt_membw_ctr))) {
+		mt_membw_pmi();
+		status &= ~(UINT64_C(1) << mt_membw_ctr);
+	}
+#endif /* CONFIG_PERVASIVE_MEMBW */
+
 	/* if any of the configurable counters overflowed, tell kpc */
 	if (status & ((UINT64_C(1) << 4) - 1)) {
 		extern void kpc_pmi_handler(void);
@@ -372,6 +498,9 @@ mt_early_init(void)
 	if (info->cpuid_arch_perf_leaf.version >= 2) {
 		lapic_set_pmi_func((i386_intr_func_t)mt_pmi_x86_64);
 		mt_core_supported = true;
+#if CONFIG_PERVASIVE_MEMBW
+		mt_membw_init(info);
+#endif /* CONFIG_PERVASIVE_MEMBW */
 	}
 }
 
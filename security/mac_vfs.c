@@ -1641,6 +1641,35 @@ mac_vnode_check_lookup(vfs_context_t ctx, struct vnode *dvp,
 	return error;
 }
 
+/*
+ * Whether a lookup on behalf of ctx would call any policy's
+ * vnode_check_lookup hook.  namei() only serves lookups from its path
+ * cache, which skips the per-component checks, when it would not.
+ */
+bool
+mac_vnode_check_lookup_needed(vfs_context_t ctx)
+{
+	kauth_cred_t cred;
+	bool needed = false;
+
+#if SECURITY_MAC_CHECK_ENFORCE
+	/* 21167099 - only check if we allow write */
+	if (!mac_vnode_enforce) {
+		return false;
+	}
+#endif
+	cred = vfs_context_ucred(ctx);
+	if (!mac_cred_check_enforce(cred)) {
+		return false;
+	}
+	MAC_POLICY_ITERATE({
+		if (mpc->mpc_ops->mpo_vnode_check_lookup != NULL) {
+			needed = true;
+		}
+	});
+	return needed;
+}
+
 int
 mac_vnode_check_open(vfs_context_t ctx, struct vnode *vp, int acc_mode)
 {
@@ -0,0 +1,276 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/sysctl.h>
+
+#include "benchmark/harness.h"
+
+/* Two-sided 95% Student's t critical values for 1..30 degrees of freedom. */
+static const double kStudentT95[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+static const double kNormal95 = 1.960;
+
+static int
+parse_uint(const char *str, unsigned int *out)
+{
+	char *end;
+	unsigned long value = strtoul(str, &end, 10);
+	if (end == str || *end != '\0' || value > UINT32_MAX) {
+		return -1;
+	}
+	*out = (unsigned int) value;
+	return 0;
+}
+
+int
+benchmark_parse_args(benchmark_config_t *config, int argc, char **argv)
+{
+	int i = 0;
+
+	while (i < argc && argv[i][0] == '-') {
+		const char *opt = argv[i];
+
+		if (strcmp(opt, "-v") == 0) {
+			config->verbose = true;
+			i++;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			break;
+		}
+		if (strcmp(opt, "--warmup") == 0) {
+			if (parse_uint(argv[i + 1], &config->warmup) != 0) {
+				return -1;
+			}
+		} else if (strcmp(opt, "--trials") == 0) {
+			if (parse_uint(argv[i + 1], &config->trials) != 0 || config->trials == 0) {
+				return -1;
+			}
+		} else if (strcmp(opt, "--cluster") == 0) {
+			if (strcasecmp(argv[i + 1], "E") == 0) {
+				config->cluster = BENCHMARK_CLUSTER_E;
+			} else if (strcasecmp(argv[i + 1], "P") == 0) {
+				config->cluster = BENCHMARK_CLUSTER_P;
+			} else {
+				return -1;
+			}
+		} else if (strcmp(opt, "--json") == 0) {
+			config->json_path = argv[i + 1];
+		} else {
+			/* Not ours, leave it for the workload. */
+			break;
+		}
+		i += 2;
+	}
+	return i;
+}
+
+const char *
+benchmark_usage(void)
+{
+	return "[--warmup <n>] [--trials <n>] [--cluster E|P] [--json <path>] [-v]";
+}
+
+int
+benchmark_bind_cluster(benchmark_cluster_t cluster)
+{
+	char type = (char) cluster;
+
+	if (cluster == BENCHMARK_CLUSTER_ANY) {
+		return 0;
+	}
+	if (sysctlbyname("kern.sched_thread_bind_cluster_type", NULL, NULL,
+	    &type, sizeof(type)) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Linear interpolation between the closest ranks of a sorted array. */
+static double
+percentile(const double *sorted, size_t n, double p)
+{
+	double rank = p * (double)(n - 1);
+	size_t lo = (size_t) rank;
+	double frac = rank - (double) lo;
+
+	if (lo + 1 >= n) {
+		return sorted[n - 1];
+	}
+	return sorted[lo] + frac * (sorted[lo + 1] - sorted[lo]);
+}
+
+void
+benchmark_compute_stats(double *samples, size_t n, benchmark_stats_t *stats)
+{
+	double sum = 0, sum_sq = 0, half_width, t;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->n = n;
+	if (n == 0) {
+		return;
+	}
+
+	qsort(samples, n, sizeof(double), compare_doubles);
+	stats->min = samples[0];
+	stats->max = samples[n - 1];
+	stats->median = percentile(samples, n, 0.50);
+	stats->p90 = percentile(samples, n, 0.90);
+	stats->p99 = percentile(samples, n, 0.99);
+
+	for (size_t i = 0; i < n; i++) {
+		sum += samples[i];
+	}
+	stats->mean = sum / (double) n;
+	for (size_t i = 0; i < n; i++) {
+		sum_sq += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+	}
+	stats->ci95_low = stats->ci95_high = stats->mean;
+	if (n < 2) {
+		return;
+	}
+	stats->stddev = sqrt(sum_sq / (double)(n - 1));
+
+	t = (n - 1 <= sizeof(kStudentT95) / sizeof(kStudentT95[0])) ?
+	    kStudentT95[n - 2] : kNormal95;
+	half_width = t * stats->stddev / sqrt((double) n);
+	stats->ci95_low = stats->mean - half_width;
+	stats->ci95_high = stats->mean + half_width;
+}
+
+static void
+json_write_string(FILE *f, const char *str)
+{
+	fputc('"', f);
+	for (const char *c = str; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			fprintf(f, "\\%c", *c);
+		} else if ((unsigned char)*c < 0x20) {
+			fprintf(f, "\\u%04x", (unsigned char)*c);
+		} else {
+			fputc(*c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static void
+sysctl_string(const char *name, char *buf, size_t len)
+{
+	size_t size = len;
+
+	if (sysctlbyname(name, buf, &size, NULL, 0) != 0) {
+		strlcpy(buf, "unknown", len);
+	}
+}
+
+static int
+write_json(const benchmark_config_t *config, const char *name, const char *unit,
+    const double *samples, const benchmark_stats_t *stats)
+{
+	char kernel_version[256], kernel_uuid[64];
+	FILE *f;
+
+	f = fopen(config->json_path, "a");
+	if (f == NULL) {
+		return errno;
+	}
+	sysctl_string("kern.version", kernel_version, sizeof(kernel_version));
+	sysctl_string("kern.uuid", kernel_uuid, sizeof(kernel_uuid));
+
+	fprintf(f, "{\"benchmark\": ");
+	json_write_string(f, name);
+	fprintf(f, ", \"unit\": ");
+	json_write_string(f, unit);
+	fprintf(f, ", \"kernel_version\": ");
+	json_write_string(f, kernel_version);
+	fprintf(f, ", \"kernel_uuid\": ");
+	json_write_string(f, kernel_uuid);
+	fprintf(f, ", \"cluster\": \"%s\", \"warmup\": %u, \"trials\": %zu",
+	    config->cluster == BENCHMARK_CLUSTER_E ? "E" :
+	    config->cluster == BENCHMARK_CLUSTER_P ? "P" : "any",
+	    config->warmup, stats->n);
+	fprintf(f, ", \"min\": %.6g, \"max\": %.6g, \"mean\": %.6g, \"stddev\": %.6g"
+	    ", \"median\": %.6g, \"p90\": %.6g, \"p99\": %.6g"
+	    ", \"ci95\": [%.6g, %.6g], \"samples\": [",
+	    stats->min, stats->max, stats->mean, stats->stddev,
+	    stats->median, stats->p90, stats->p99,
+	    stats->ci95_low, stats->ci95_high);
+	for (size_t i = 0; i < stats->n; i++) {
+		fprintf(f, "%s%.6g", i ? ", " : "", samples[i]);
+	}
+	fprintf(f, "]}\n");
+
+	if (fclose(f) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+int
+benchmark_report(const benchmark_config_t *config, const char *name,
+    const char *unit, double *samples, size_t n, benchmark_stats_t *stats)
+{
+	benchmark_compute_stats(samples, n, stats);
+
+	printf("%s: %zu trials, mean %.4g %s (95%% CI %.4g..%.4g), stddev %.4g\n",
+	    name, stats->n, stats->mean, unit, stats->ci95_low, stats->ci95_high,
+	    stats->stddev);
+	printf("%s: min %.4g, median %.4g, p90 %.4g, p99 %.4g, max %.4g %s\n",
+	    name, stats->min, stats->median, stats->p90, stats->p99, stats->max, unit);
+	fflush(stdout);
+
+	if (config->json_path != NULL) {
+		return write_json(config, name, unit, samples, stats);
+	}
+	return 0;
+}
+
+int
+benchmark_run(const benchmark_config_t *config, const char *name,
+    const char *unit, benchmark_trial_fn_t trial, void *ctx,
+    benchmark_stats_t *stats)
+{
+	double *samples;
+	int ret;
+
+	ret = benchmark_bind_cluster(config->cluster);
+	if (ret != 0) {
+		fprintf(stderr, "%s: failed to bind to cluster type %c: %s\n",
+		    name, (char) config->cluster, strerror(ret));
+		return ret;
+	}
+
+	samples = calloc(config->trials, sizeof(double));
+	if (samples == NULL) {
+		return ENOMEM;
+	}
+
+	for (unsigned int i = 0; i < config->warmup; i++) {
+		(void) trial(ctx);
+	}
+	for (unsigned int i = 0; i < config->trials; i++) {
+		samples[i] = trial(ctx);
+		if (config->verbose) {
+			printf("%s: trial %u: %.6g %s\n", name, i, samples[i], unit);
+		}
+	}
+
+	ret = benchmark_report(config, name, unit, samples, config->trials, stats);
+	free(samples);
+	return ret;
+}
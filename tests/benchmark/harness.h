@@ -0,0 +1,99 @@
+#ifndef BENCHMARK_HARNESS_H
+#define BENCHMARK_HARNESS_H
+
+/*
+ * Common driver for performance tests: warmup, repeated trials, summary
+ * statistics and machine-readable output.
+ *
+ * A benchmark supplies a trial function that runs its workload once and
+ * returns one sample, in whatever unit it reports (a duration, a rate...).
+ * benchmark_run() calls it config->warmup times without recording, then
+ * config->trials times, and reports min / max / mean / stddev, the
+ * median, p90, p99 and a 95% confidence interval for the mean.
+ *
+ * When config->json_path is set, one JSON object per benchmark is appended
+ * to that file, one per line, tagged with the kernel version and UUID so
+ * that results from different kernel builds can be concatenated and
+ * compared.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum benchmark_cluster {
+	BENCHMARK_CLUSTER_ANY = 0,
+	BENCHMARK_CLUSTER_E = 'E',
+	BENCHMARK_CLUSTER_P = 'P',
+} benchmark_cluster_t;
+
+typedef struct benchmark_config {
+	unsigned int warmup;
+	unsigned int trials;
+	benchmark_cluster_t cluster;
+	const char *json_path;
+	bool verbose;
+} benchmark_config_t;
+
+#define BENCHMARK_CONFIG_DEFAULT { \
+	.warmup = 1, \
+	.trials = 10, \
+	.cluster = BENCHMARK_CLUSTER_ANY, \
+	.json_path = NULL, \
+	.verbose = false, \
+}
+
+typedef struct benchmark_stats {
+	size_t n;
+	double min;
+	double max;
+	double mean;
+	double stddev;
+	double median;
+	double p90;
+	double p99;
+	double ci95_low;
+	double ci95_high;
+} benchmark_stats_t;
+
+/* Runs the workload once and returns the sample for that trial. */
+typedef double (*benchmark_trial_fn_t)(void *ctx);
+
+/*
+ * Consume the harness options (--warmup N, --trials N, --cluster E|P,
+ * --json PATH, -v) from the front of argv, leaving the workload's own
+ * arguments. Returns the number of arguments consumed, or -1 on a
+ * malformed option.
+ */
+int benchmark_parse_args(benchmark_config_t *config, int argc, char **argv);
+
+/* One line describing the options accepted by benchmark_parse_args(). */
+const char *benchmark_usage(void);
+
+/*
+ * Bind the calling thread to a cluster type (requires a development
+ * kernel). Multi-threaded workloads call this from each worker.
+ * BENCHMARK_CLUSTER_ANY is a no-op. Returns 0 or an errno.
+ */
+int benchmark_bind_cluster(benchmark_cluster_t cluster);
+
+/* Fill in stats for samples[0..n). Sorts samples in place. */
+void benchmark_compute_stats(double *samples, size_t n, benchmark_stats_t *stats);
+
+/*
+ * Compute stats for samples collected by the caller, print a summary and,
+ * if configured, append the JSON record. For workloads that produce many
+ * samples per run rather than going through benchmark_run().
+ */
+int benchmark_report(const benchmark_config_t *config, const char *name,
+    const char *unit, double *samples, size_t n, benchmark_stats_t *stats);
+
+/*
+ * Warm up, run the trials and report them. The calling thread is bound
+ * to config->cluster first. Returns 0, or an errno if binding or writing
+ * the JSON output failed.
+ */
+int benchmark_run(const benchmark_config_t *config, const char *name,
+    const char *unit, benchmark_trial_fn_t trial, void *ctx,
+    benchmark_stats_t *stats);
+
+#endif /* !defined(BENCHMARK_HARNESS_H) */
@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <sys/sysctl.h>
 
+#include "benchmark/harness.h"
 #include "benchmark/helpers.h"
 #include "counter/common.h"
 
@@ -41,6 +42,8 @@ typedef struct {
 	atomic_ullong tg_num_writes_remaining;
 	atomic_ullong tg_threads_ready;
 	test_args_t tg_args;
+	benchmark_cluster_t tg_cluster;
+	double tg_loss_total;
 	uint64_t tg_start_time;
 	uint64_t tg_end_time;
 	uint64_t tg_start_value;
@@ -49,58 +52,98 @@ typedef struct {
 } test_globals_t;
 
 static void parse_arguments(int argc, char** argv, test_args_t *args);
+static void print_help(char** argv);
+static const char *get_variant_name(test_variant_t variant);
 static const char *get_sysctl_name_for_test_variant(test_variant_t variant);
 static void *writer(void *);
 static uint64_t counter_read(test_variant_t);
 
-int
-main(int argc, char** argv)
+/*
+ * One benchmark trial: num_writes spread across n_threads writers.
+ * Returns the write rate; the loss is accumulated in tg_loss_total.
+ */
+static double
+counter_trial(void *arg)
 {
-	test_globals_t globals = {0};
+	test_globals_t *globals = arg;
 	pthread_t* threads = NULL;
-	int ret;
-	int is_development_kernel;
-	size_t is_development_kernel_size = sizeof(is_development_kernel);
 	pthread_attr_t pthread_attrs;
 	uint64_t duration, writes_stored;
-	double writes_per_second;
-	double loss;
-
-	if (sysctlbyname("kern.development", &is_development_kernel,
-	    &is_development_kernel_size, NULL, 0) != 0 || !is_development_kernel) {
-		fprintf(stderr, "%s requires the development kernel\n", argv[0]);
-		exit(1);
-	}
+	int ret;
 
-	parse_arguments(argc, argv, &(globals.tg_args));
-	atomic_store(&(globals.tg_num_writes_remaining), globals.tg_args.num_writes);
+	atomic_store(&(globals->tg_test_start), false);
+	atomic_store(&(globals->tg_threads_ready), 0);
+	atomic_store(&(globals->tg_num_writes_remaining), globals->tg_args.num_writes);
 
-	threads = malloc(sizeof(pthread_t) * globals.tg_args.n_threads);
+	threads = malloc(sizeof(pthread_t) * globals->tg_args.n_threads);
 	assert(threads);
 	ret = pthread_attr_init(&pthread_attrs);
 	assert(ret == 0);
 	ret = init_scalable_counter_test();
 	assert(ret == 0);
-	globals.tg_start_value = counter_read(globals.tg_args.variant);
-	for (size_t i = 0; i < globals.tg_args.n_threads; i++) {
-		ret = pthread_create(threads + i, &pthread_attrs, writer, &globals);
+	globals->tg_start_value = counter_read(globals->tg_args.variant);
+	for (size_t i = 0; i < globals->tg_args.n_threads; i++) {
+		ret = pthread_create(threads + i, &pthread_attrs, writer, globals);
 		assert(ret == 0);
 	}
-	for (size_t i = 0; i < globals.tg_args.n_threads; i++) {
+	for (size_t i = 0; i < globals->tg_args.n_threads; i++) {
 		ret = pthread_join(threads[i], NULL);
 		assert(ret == 0);
 	}
 	ret = fini_scalable_counter_test();
 	assert(ret == 0);
-	globals.tg_end_value = counter_read(globals.tg_args.variant);
+	globals->tg_end_value = counter_read(globals->tg_args.variant);
+	free(threads);
+
+	duration = globals->tg_end_time - globals->tg_start_time;
+	writes_stored = globals->tg_end_value - globals->tg_start_value;
+	globals->tg_loss_total += (1.0 - ((double) writes_stored / globals->tg_args.num_writes)) * 100;
+	return globals->tg_args.num_writes / ((double) duration / kNumNanosecondsInSecond);
+}
+
+int
+main(int argc, char** argv)
+{
+	test_globals_t globals = {0};
+	benchmark_config_t config = BENCHMARK_CONFIG_DEFAULT;
+	benchmark_stats_t stats;
+	int ret, consumed;
+	int is_development_kernel;
+	size_t is_development_kernel_size = sizeof(is_development_kernel);
+	char name[64];
+
+	if (sysctlbyname("kern.development", &is_development_kernel,
+	    &is_development_kernel_size, NULL, 0) != 0 || !is_development_kernel) {
+		fprintf(stderr, "%s requires the development kernel\n", argv[0]);
+		exit(1);
+	}
+
+	/* Each run is long; benchrun does its own repetitions by default. */
+	config.warmup = 0;
+	config.trials = 1;
+	consumed = benchmark_parse_args(&config, argc - 1, argv + 1);
+	if (consumed < 0) {
+		print_help(argv);
+		exit(1);
+	}
+	argv[consumed] = argv[0];
+	argc -= consumed;
+	argv += consumed;
+
+	parse_arguments(argc, argv, &(globals.tg_args));
+	globals.tg_args.verbose |= config.verbose;
+	globals.tg_cluster = config.cluster;
+
+	snprintf(name, sizeof(name), "counter.%s.%zu_threads",
+	    get_variant_name(globals.tg_args.variant), globals.tg_args.n_threads);
+	ret = benchmark_run(&config, name, "writes/sec", counter_trial, &globals, &stats);
+	if (ret != 0) {
+		exit(1);
+	}
 
-	duration = globals.tg_end_time - globals.tg_start_time;
 	printf("-----Results-----\n");
 	printf("rate,loss\n");
-	writes_per_second = globals.tg_args.num_writes / ((double) duration / kNumNanosecondsInSecond);
-	writes_stored = globals.tg_end_value - globals.tg_start_value;
-	loss = (1.0 - ((double) writes_stored / globals.tg_args.num_writes)) * 100;
-	printf("%.4f,%.4f\n", writes_per_second, loss);
+	printf("%.4f,%.4f\n", stats.mean, globals.tg_loss_total / (config.warmup + config.trials));
 	return 0;
 }
 
@@ -115,6 +158,8 @@ writer(void *arg)
 
 	sysctl_name = get_sysctl_name_for_test_variant(globals->tg_args.variant);
 	assert(sysctl_name != NULL);
+	ret = benchmark_bind_cluster(globals->tg_cluster);
+	assert(ret == 0);
 
 	if (atomic_fetch_add(&(globals->tg_threads_ready), 1) == globals->tg_args.n_threads - 1) {
 		globals->tg_start_time = current_timestamp_ns();
@@ -159,6 +204,21 @@ get_sysctl_name_for_test_variant(test_variant_t variant)
 	}
 }
 
+static const char *
+get_variant_name(test_variant_t variant)
+{
+	switch (variant) {
+	case VARIANT_SCALABLE_COUNTER:
+		return kScalableCounterArgument;
+	case VARIANT_ATOMIC:
+		return kAtomicCounterArgument;
+	case VARIANT_RACY:
+		return kRacyCounterArgument;
+	default:
+		return "unknown";
+	}
+}
+
 static const char*
 get_sysctl_load_name_for_test_variant(test_variant_t variant)
 {
@@ -189,7 +249,7 @@ counter_read(test_variant_t variant)
 static void
 print_help(char** argv)
 {
-	fprintf(stderr, "%s: <test-variant> [-v] num_writes num_threads\n", argv[0]);
+	fprintf(stderr, "%s: %s <test-variant> num_writes num_threads\n", argv[0], benchmark_usage());
 	fprintf(stderr, "\ntest variants:\n");
 	fprintf(stderr, "	%s	Benchmark scalable counters.\n", kScalableCounterArgument);
 	fprintf(stderr, "	%s	Benchmark single atomic counter.\n", kAtomicCounterArgument);
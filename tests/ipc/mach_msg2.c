@@ -612,6 +612,69 @@ T_DECL(mach_msg2_kevent_rcv, "Test mach_msg2() receive with kevent workloop")
 
 	T_FAIL("mach_msg2_kevent_rcv timed out");
 }
+
+#define BATCH_SEND_COUNT 4
+#define BATCH_RCV_COUNT  6
+
+T_DECL(mach_msg2_batch, "Test mach_msg2() batched send/rcv")
+{
+	mach_msg_batch_entry_t entries[BATCH_SEND_COUNT + BATCH_RCV_COUNT] = {};
+	inline_message_t msgs[BATCH_SEND_COUNT];
+	msg_rcv_buffer_t buffers[BATCH_RCV_COUNT];
+	mach_msg_option64_t options;
+	mach_port_t port;
+	kern_return_t kr;
+
+	kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &port);
+	T_QUIET; T_ASSERT_MACH_SUCCESS(kr, "port allocation");
+	kr = mach_port_insert_right(mach_task_self(), port, port, MACH_MSG_TYPE_MAKE_SEND);
+	T_QUIET; T_ASSERT_MACH_SUCCESS(kr, "insert right");
+
+	for (int i = 0; i < BATCH_SEND_COUNT; i++) {
+		msgs[i].header = (mach_msg_header_t){
+			.msgh_bits = MACH_MSGH_BITS_SET(MACH_MSG_TYPE_COPY_SEND, 0, 0, 0),
+			.msgh_size = sizeof(inline_message_t),
+			.msgh_remote_port = port,
+			.msgh_id = 4200 + i,
+		};
+		msgs[i].data = MESSAGE_DATA_BYTES;
+		entries[i].mbe_msg = (mach_vm_address_t)&msgs[i];
+		entries[i].mbe_size = sizeof(inline_message_t);
+	}
+	for (int i = 0; i < BATCH_RCV_COUNT; i++) {
+		entries[BATCH_SEND_COUNT + i].mbe_msg = (mach_vm_address_t)&buffers[i];
+		entries[BATCH_SEND_COUNT + i].mbe_size = sizeof(msg_rcv_buffer_t);
+	}
+
+	options = MACH64_SEND_MSG | MACH64_SEND_MQ_CALL | MACH64_RCV_MSG | MACH64_RCV_TIMEOUT;
+	kr = mach_msg2_batch(entries, options, BATCH_SEND_COUNT, BATCH_RCV_COUNT, port, 0, 0);
+	T_ASSERT_MACH_SUCCESS(kr, "batched send/rcv");
+
+	for (int i = 0; i < BATCH_SEND_COUNT; i++) {
+		T_EXPECT_MACH_SUCCESS(entries[i].mbe_return, "send %d", i);
+	}
+	for (int i = 0; i < BATCH_SEND_COUNT; i++) {
+		T_EXPECT_MACH_SUCCESS(entries[BATCH_SEND_COUNT + i].mbe_return, "receive %d", i);
+		T_EXPECT_EQ(buffers[i].msg.header.msgh_id, 4200 + i, "messages are received in order");
+		T_EXPECT_EQ(buffers[i].msg.data, MESSAGE_DATA_BYTES, "message data matches");
+	}
+	for (int i = BATCH_SEND_COUNT; i < BATCH_RCV_COUNT; i++) {
+		T_EXPECT_EQ(entries[BATCH_SEND_COUNT + i].mbe_return, MACH_RCV_TIMED_OUT,
+		    "unfilled entry %d reports a timeout", i);
+	}
+
+	/* nothing queued anymore */
+	kr = mach_msg2_batch(entries + BATCH_SEND_COUNT, MACH64_RCV_MSG | MACH64_RCV_TIMEOUT,
+	    0, BATCH_RCV_COUNT, port, 0, 0);
+	T_EXPECT_EQ(kr, MACH_RCV_TIMED_OUT, "empty batched receive times out");
+
+	kr = mach_msg2_batch(entries, MACH64_RCV_MSG | MACH64_RCV_TIMEOUT,
+	    0, MACH_MSG_BATCH_MAX_COUNT + 1, port, 0, 0);
+	T_EXPECT_EQ(kr, MACH_RCV_INVALID_ARGUMENTS, "oversized batch is rejected");
+
+	mach_port_mod_refs(mach_task_self(), port, MACH_PORT_RIGHT_RECEIVE, -1);
+	mach_port_deallocate(mach_task_self(), port);
+}
 #else
 T_DECL(mach_msg2_interop, "Test mach_msg2 inter-operability")
 {
@@ -627,4 +690,9 @@ T_DECL(mach_msg2_kevent_rcv, "Test mach_msg2() receive with kevent workloop")
 {
 	T_SKIP("This test is skipped on armv7k.");
 }
+
+T_DECL(mach_msg2_batch, "Test mach_msg2() batched send/rcv")
+{
+	T_SKIP("This test is skipped on armv7k.");
+}
 #endif /* defined(__LP64__) || defined (__arm64__) */
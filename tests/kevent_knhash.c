@@ -0,0 +1,112 @@
+#include <darwintest.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/event.h>
+#include <sys/sysctl.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.kevent"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("kevent"),
+	T_META_RUN_CONCURRENTLY(true));
+
+#define NKNOTES         (64 * 1024)
+#define NTHREADS        4
+#define NROUNDS         8
+
+static int
+user_knote(int kq, uintptr_t ident, uint16_t flags, uint32_t fflags)
+{
+	struct kevent64_s kev;
+
+	EV_SET64(&kev, ident, EVFILT_USER, flags | EV_RECEIPT, fflags, 0, 0, 0, 0);
+	if (kevent64(kq, &kev, 1, &kev, 1, 0, NULL) != 1) {
+		return errno;
+	}
+	return (int)kev.data;
+}
+
+static uint32_t
+knhash_resizes(void)
+{
+	uint32_t resizes = 0;
+	size_t size = sizeof(resizes);
+
+	if (sysctlbyname("kern.kevent.knhash_resizes", &resizes, &size, NULL, 0) != 0) {
+		return 0;
+	}
+	return resizes;
+}
+
+T_DECL(kevent_knhash_many_knotes,
+    "many hashed knotes can be added, triggered and deleted")
+{
+	uint32_t resizes = knhash_resizes();
+	struct kevent64_s kev;
+	int kq;
+
+	T_ASSERT_POSIX_SUCCESS(kq = kqueue(), "kqueue");
+
+	for (uintptr_t i = 0; i < NKNOTES; i++) {
+		T_QUIET; T_ASSERT_EQ(user_knote(kq, i, EV_ADD | EV_CLEAR, 0), 0,
+		    "add knote %lu", i);
+	}
+	T_QUIET; T_ASSERT_EQ(user_knote(kq, 0, EV_ADD, 0), 0, "add an existing knote");
+
+	for (uintptr_t i = 0; i < NKNOTES; i += 7) {
+		T_QUIET; T_ASSERT_EQ(user_knote(kq, i, 0, NOTE_TRIGGER), 0,
+		    "trigger knote %lu", i);
+		T_QUIET; T_ASSERT_EQ(kevent64(kq, NULL, 0, &kev, 1, 0,
+		    &(struct timespec){ 0, 0 }), 1, "receive knote %lu", i);
+		T_QUIET; T_ASSERT_EQ(kev.ident, (uint64_t)i, "received the triggered knote");
+	}
+
+	for (uintptr_t i = 0; i < NKNOTES; i++) {
+		T_QUIET; T_ASSERT_EQ(user_knote(kq, i, EV_DELETE, 0), 0,
+		    "delete knote %lu", i);
+	}
+	T_ASSERT_EQ(user_knote(kq, 0, EV_DELETE, 0), ENOENT, "knotes are gone");
+	T_PASS("%d knotes added, triggered and deleted", NKNOTES);
+
+	T_LOG("knote hash shards resized %u times", knhash_resizes() - resizes);
+	close(kq);
+}
+
+static int shared_kq;
+
+static void *
+churn_thread(void *arg)
+{
+	uintptr_t base = (uintptr_t)arg * NKNOTES;
+
+	for (int round = 0; round < NROUNDS; round++) {
+		for (uintptr_t i = base; i < base + NKNOTES / NTHREADS; i++) {
+			T_QUIET; T_ASSERT_EQ(user_knote(shared_kq, i, EV_ADD, 0), 0, "add");
+		}
+		for (uintptr_t i = base; i < base + NKNOTES / NTHREADS; i++) {
+			T_QUIET; T_ASSERT_EQ(user_knote(shared_kq, i, EV_ENABLE, 0), 0, "lookup");
+			T_QUIET; T_ASSERT_EQ(user_knote(shared_kq, i, EV_DELETE, 0), 0, "delete");
+		}
+	}
+	return NULL;
+}
+
+T_DECL(kevent_knhash_concurrent,
+    "concurrent registrations see every knote while the hash grows")
+{
+	pthread_t threads[NTHREADS];
+
+	T_ASSERT_POSIX_SUCCESS(shared_kq = kqueue(), "kqueue");
+
+	for (uintptr_t i = 0; i < NTHREADS; i++) {
+		T_ASSERT_POSIX_ZERO(pthread_create(&threads[i], NULL, churn_thread,
+		    (void *)i), "pthread_create");
+	}
+	for (int i = 0; i < NTHREADS; i++) {
+		T_ASSERT_POSIX_ZERO(pthread_join(threads[i], NULL), "pthread_join");
+	}
+	close(shared_kq);
+}
@@ -0,0 +1,145 @@
+#include <darwintest.h>
+
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/event.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.kevent"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("kevent"),
+	T_META_RUN_CONCURRENTLY(true));
+
+#define RING_ENTRIES    8
+
+static struct kevent_ring *
+ring_create(void)
+{
+	struct kevent_ring *ring;
+
+	ring = calloc(1, sizeof(*ring) + RING_ENTRIES * sizeof(struct kevent_qos_s));
+	T_QUIET; T_ASSERT_NOTNULL(ring, "calloc");
+	ring->kr_mask = RING_ENTRIES - 1;
+	return ring;
+}
+
+static void
+ring_submit(struct kevent_ring *sq, struct kevent_qos_s kev)
+{
+	sq->kr_entries[sq->kr_tail & sq->kr_mask] = kev;
+	sq->kr_tail++;
+}
+
+static int
+ring_enter(int kq, struct kevent_ring *sq, struct kevent_ring *cq, unsigned int flags)
+{
+	return kevent_qos(kq, (void *)sq, RING_ENTRIES, (void *)cq, RING_ENTRIES,
+	           NULL, NULL, KEVENT_FLAG_RING | flags);
+}
+
+T_DECL(kevent_ring_basic,
+    "KEVENT_FLAG_RING consumes submissions and delivers completions")
+{
+	struct kevent_ring *sq = ring_create(), *cq = ring_create();
+	struct kevent_qos_s *kev;
+	int kq, fds[2], rc;
+
+	T_ASSERT_POSIX_SUCCESS(kq = kqueue(), "kqueue");
+	T_ASSERT_POSIX_SUCCESS(pipe(fds), "pipe");
+
+	ring_submit(sq, (struct kevent_qos_s){
+		.ident = (uint64_t)fds[0],
+		.filter = EVFILT_READ,
+		.flags = EV_ADD | EV_RECEIPT,
+		.udata = 0x1234,
+	});
+	rc = ring_enter(kq, sq, cq, KEVENT_FLAG_IMMEDIATE);
+	T_ASSERT_POSIX_SUCCESS(rc, "register through the submission ring");
+	T_EXPECT_EQ(rc, 1, "one receipt");
+	T_EXPECT_EQ(sq->kr_head, sq->kr_tail, "submission ring was consumed");
+	T_EXPECT_EQ(cq->kr_tail, 1u, "completion ring tail advanced");
+	kev = &cq->kr_entries[cq->kr_head++ & cq->kr_mask];
+	T_EXPECT_TRUE(kev->flags & EV_ERROR, "receipt is flagged EV_ERROR");
+	T_EXPECT_EQ(kev->data, 0LL, "registration succeeded");
+
+	rc = ring_enter(kq, sq, cq, KEVENT_FLAG_IMMEDIATE);
+	T_EXPECT_EQ(rc, 0, "no event before the pipe is written");
+
+	T_ASSERT_POSIX_SUCCESS(write(fds[1], "x", 1), "write");
+	rc = ring_enter(kq, sq, cq, 0);
+	T_EXPECT_EQ(rc, 1, "read event delivered");
+	T_EXPECT_EQ(cq->kr_tail, 2u, "completion ring tail advanced");
+	kev = &cq->kr_entries[cq->kr_head++ & cq->kr_mask];
+	T_EXPECT_EQ(kev->ident, (uint64_t)fds[0], "event is for the pipe");
+	T_EXPECT_EQ(kev->filter, EVFILT_READ, "event is EVFILT_READ");
+	T_EXPECT_EQ(kev->udata, 0x1234ull, "udata is preserved");
+	T_EXPECT_EQ(kev->data, 1LL, "one byte is readable");
+
+	/* a full completion ring doesn't collect (or wait for) events */
+	cq->kr_head = cq->kr_tail - RING_ENTRIES;
+	rc = ring_enter(kq, sq, cq, 0);
+	T_EXPECT_EQ(rc, 0, "nothing delivered into a full ring");
+
+	cq->kr_mask = 6;
+	rc = ring_enter(kq, sq, cq, KEVENT_FLAG_IMMEDIATE);
+	T_EXPECT_POSIX_FAILURE(rc, EINVAL, "ring size must be a power of 2");
+
+	close(fds[0]);
+	close(fds[1]);
+	close(kq);
+	free(sq);
+	free(cq);
+}
+
+T_DECL(kevent_ring_aio,
+    "EVFILT_AIO with NOTE_AIO_SUBMIT submits and completes IO through the rings")
+{
+	struct kevent_ring *sq = ring_create(), *cq = ring_create();
+	char path[] = "/tmp/kevent_ring_aio.XXXXXX";
+	char data[64] = "kevent ring aio", buf[64] = { };
+	struct kevent_qos_s *kev;
+	struct aiocb cb = { };
+	int kq, fd, rc;
+
+	T_ASSERT_POSIX_SUCCESS(kq = kqueue(), "kqueue");
+	T_ASSERT_POSIX_SUCCESS(fd = mkstemp(path), "mkstemp");
+	unlink(path);
+	T_ASSERT_EQ(write(fd, data, sizeof(data)), (ssize_t)sizeof(data), "write");
+
+	cb.aio_fildes = fd;
+	cb.aio_buf = buf;
+	cb.aio_nbytes = sizeof(buf);
+	cb.aio_offset = 0;
+	cb.aio_lio_opcode = LIO_READ;
+
+	ring_submit(sq, (struct kevent_qos_s){
+		.ident = (uint64_t)(uintptr_t)&cb,
+		.filter = EVFILT_AIO,
+		.flags = EV_ADD,
+		.fflags = NOTE_AIO_SUBMIT,
+		.udata = 0xa10,
+	});
+
+	do {
+		rc = ring_enter(kq, sq, cq, 0);
+	} while (rc == -1 && errno == EINTR);
+	T_ASSERT_EQ(rc, 1, "one completion");
+	kev = &cq->kr_entries[cq->kr_head++ & cq->kr_mask];
+	T_EXPECT_EQ(kev->filter, EVFILT_AIO, "completion is EVFILT_AIO");
+	T_EXPECT_EQ(kev->udata, 0xa10ull, "udata is preserved");
+	T_EXPECT_EQ(kev->fflags, 0u, "no IO error");
+	T_EXPECT_EQ(kev->data, (int64_t)sizeof(buf), "read the whole buffer");
+	T_EXPECT_EQ(memcmp(buf, data, sizeof(buf)), 0, "read the file contents");
+
+	T_EXPECT_POSIX_FAILURE(aio_return(&cb), EINVAL,
+	    "the completion consumed the request");
+
+	close(fd);
+	close(kq);
+	free(sq);
+	free(cq);
+}
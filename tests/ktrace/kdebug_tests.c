@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <sys/kdebug.h>
 #include <sys/kdebug_signpost.h>
+#include <sys/mman.h>
 #include <sys/resource_private.h>
 #include <sys/sysctl.h>
 #include <stdint.h>
@@ -558,6 +559,164 @@ T_DECL(ascending_time_order,
 	dispatch_main();
 }
 
+#define MAPPED_DEBUGID (0xfeedfa00U)
+#define MAPPED_EVENTS (500)
+
+T_DECL(mapped_buffers,
+    "ensure events can be read straight out of the mapped per-CPU rings",
+    T_META_CHECK_LEAKS(false))
+{
+	kd_mapped_info info = { 0 };
+	size_t info_size = sizeof(info);
+	uint64_t seen = 0, last_ts = 0;
+	uint64_t *timestamps = calloc(MAPPED_EVENTS, sizeof(timestamps[0]));
+
+	T_QUIET; T_ASSERT_NOTNULL(timestamps, "allocate timestamp array");
+
+	start_controlling_ktrace();
+
+	int mib[4] = { CTL_KERN, KERN_KDEBUG };
+	mib[2] = KERN_KDSETBUF; mib[3] = 100000;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 4, NULL, 0, NULL, 0), "KERN_KDSETBUF");
+
+	mib[2] = KERN_KDMAPBUFS;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 3, &info, &info_size, NULL, 0),
+	    "KERN_KDMAPBUFS");
+	T_ASSERT_GT(info.kdmi_ring_count, 0, "there's at least one ring");
+	T_ASSERT_EQ(info.kdmi_ring_capacity & (info.kdmi_ring_capacity - 1), 0,
+	    "ring capacity is a power of 2");
+	T_ASSERT_EQ(info.kdmi_size, info.kdmi_ring_size * info.kdmi_ring_count,
+	    "mapping covers every ring");
+
+	mib[2] = KERN_KDENABLE; mib[3] = KDEBUG_ENABLE_TRACE;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 4, NULL, 0, NULL, 0), "KERN_KDENABLE");
+
+	for (int i = 0; i < MAPPED_EVENTS; i++) {
+		T_QUIET;
+		T_ASSERT_POSIX_SUCCESS(kdebug_trace(MAPPED_DEBUGID, (uint64_t)i, 0, 0, 0),
+		    NULL);
+	}
+
+	mib[2] = KERN_KDENABLE; mib[3] = 0;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 4, NULL, 0, NULL, 0), "disable tracing");
+
+	mib[2] = KERN_KDREADTR;
+	size_t read_size = sizeof(kd_buf);
+	kd_buf unused_buf;
+	T_EXPECT_POSIX_FAILURE(sysctl(mib, 3, &unused_buf, &read_size, NULL, 0),
+	    ENOTSUP, "KERN_KDREADTR is unsupported with mapped buffers");
+
+	for (uint32_t r = 0; r < info.kdmi_ring_count; r++) {
+		const kd_mapped_ring_header *ring = (const void *)(uintptr_t)
+		    (info.kdmi_address + r * info.kdmi_ring_size);
+		const kd_buf *events = (const kd_buf *)(ring + 1);
+		uint64_t head = __atomic_load_n(&ring->kdmr_head, __ATOMIC_ACQUIRE);
+		uint64_t tail = head > ring->kdmr_capacity ? head - ring->kdmr_capacity : 0;
+
+		T_QUIET; T_ASSERT_EQ(ring->kdmr_cpu, r, "ring %u is for CPU %u", r, r);
+		for (; tail < head; tail++) {
+			const kd_buf *slot = &events[tail & (ring->kdmr_capacity - 1)];
+			uint64_t seq = __atomic_load_n(&slot->unused, __ATOMIC_ACQUIRE);
+			if (seq != tail + 1) {
+				continue;
+			}
+			kd_buf event = *slot;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->unused, __ATOMIC_RELAXED) != seq) {
+				continue;
+			}
+			if ((event.debugid & KDBG_EVENTID_MASK) != MAPPED_DEBUGID) {
+				continue;
+			}
+			T_QUIET; T_ASSERT_LT(event.arg1, (uint64_t)MAPPED_EVENTS,
+			    "event argument is in range");
+			T_QUIET; T_ASSERT_EQ(timestamps[event.arg1], 0ULL,
+			    "event %llu is only seen once", (unsigned long long)event.arg1);
+			timestamps[event.arg1] = event.timestamp & KDBG_TIMESTAMP_MASK;
+			seen++;
+		}
+	}
+
+	T_EXPECT_EQ(seen, (uint64_t)MAPPED_EVENTS, "saw all events in the mapped rings");
+	for (int i = 0; i < MAPPED_EVENTS; i++) {
+		if (timestamps[i] == 0) {
+			continue;
+		}
+		T_QUIET; T_EXPECT_GE(timestamps[i], last_ts,
+		    "event %d is in timestamp order after merging", i);
+		last_ts = timestamps[i];
+	}
+
+	mib[2] = KERN_KDREMOVE;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 3, NULL, NULL, NULL, 0), "KERN_KDREMOVE");
+	(void)munmap((void *)(uintptr_t)info.kdmi_address, (size_t)info.kdmi_size);
+	free(timestamps);
+}
+
+#define RATE_SAMPLED_DEBUGID (0xfeed0100U)
+#define RATE_LIMITED_DEBUGID (0xfeed0200U)
+#define RATE_EVENTS (400)
+
+T_DECL(rate_rules,
+    "ensure sampling and rate limit rules drop and count matching events",
+    T_META_CHECK_LEAKS(false))
+{
+	kd_rate_rule rules[2] = {
+		{
+			.kdr_debugid = RATE_SAMPLED_DEBUGID,
+			.kdr_mask = KDBG_CSC_MASK,
+			.kdr_sample = 4,
+		},
+		{
+			.kdr_debugid = RATE_LIMITED_DEBUGID,
+			.kdr_mask = KDBG_CSC_MASK,
+			.kdr_rate = 1,
+			.kdr_burst = 10,
+		},
+	};
+	size_t rules_size = sizeof(rules);
+
+	start_controlling_ktrace();
+
+	int mib[4] = { CTL_KERN, KERN_KDEBUG };
+	mib[2] = KERN_KDSETBUF; mib[3] = 100000;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 4, NULL, 0, NULL, 0), "KERN_KDSETBUF");
+	mib[2] = KERN_KDSETUP;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 3, NULL, NULL, NULL, 0), "KERN_KDSETUP");
+
+	mib[2] = KERN_KDSET_RATE;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 3, rules, &rules_size, NULL, 0),
+	    "KERN_KDSET_RATE");
+
+	mib[2] = KERN_KDENABLE; mib[3] = KDEBUG_ENABLE_TRACE;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 4, NULL, 0, NULL, 0), "KERN_KDENABLE");
+	for (int i = 0; i < RATE_EVENTS; i++) {
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(kdebug_trace(RATE_SAMPLED_DEBUGID, 0, 0, 0, 0), NULL);
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(kdebug_trace(RATE_LIMITED_DEBUGID, 0, 0, 0, 0), NULL);
+	}
+	mib[2] = KERN_KDENABLE; mib[3] = 0;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 4, NULL, 0, NULL, 0), "disable tracing");
+
+	memset(rules, 0, sizeof(rules));
+	rules_size = sizeof(rules);
+	mib[2] = KERN_KDGET_RATE;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 3, rules, &rules_size, NULL, 0),
+	    "KERN_KDGET_RATE");
+	T_ASSERT_EQ(rules_size, sizeof(rules), "both rules are reported");
+
+	T_EXPECT_EQ(rules[0].kdr_matched, (uint64_t)RATE_EVENTS,
+	    "every sampled event matched");
+	T_EXPECT_GE(rules[0].kdr_sampled_out, (uint64_t)(RATE_EVENTS * 3 / 4),
+	    "at least 3 in 4 events were sampled out");
+	T_EXPECT_EQ(rules[1].kdr_matched, (uint64_t)RATE_EVENTS,
+	    "every rate limited event matched");
+	T_EXPECT_GE(rules[1].kdr_rate_limited, (uint64_t)(RATE_EVENTS - 20),
+	    "events past the burst were rate limited");
+
+	mib[2] = KERN_KDREMOVE;
+	T_ASSERT_POSIX_SUCCESS(sysctl(mib, 3, NULL, NULL, NULL, 0), "KERN_KDREMOVE");
+}
+
 #pragma mark dyld tracing
 
 __attribute__((aligned(8)))
@@ -0,0 +1,76 @@
+#include <darwintest.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/sysctl.h>
+#include <mach_debug/lockgroup_info.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.locks"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("locks"),
+	T_META_ASROOT(true),
+	T_META_CHECK_LEAKS(false)
+	);
+
+static unsigned int prof_rate_saved;
+
+static void
+prof_rate_restore(void)
+{
+	sysctlbyname("kern.lock_prof_sample", NULL, NULL,
+	    &prof_rate_saved, sizeof(prof_rate_saved));
+}
+
+static volatile bool prof_done;
+
+/* contend on the lock of the single pipe shared by all threads */
+static void *
+prof_contender(void *arg)
+{
+	int *fds = arg;
+	char c = 0;
+
+	while (!prof_done) {
+		(void)write(fds[1], &c, 1);
+		(void)read(fds[0], &c, 1);
+	}
+	return NULL;
+}
+
+T_DECL(lock_prof_sysctls,
+    "kern.lock_prof_groups and kern.lock_prof_sites return whole records")
+{
+	unsigned int rate = 1;
+	size_t size = sizeof(prof_rate_saved);
+	pthread_t threads[8];
+	int fds[2];
+
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.lock_prof_sample",
+	    &prof_rate_saved, &size, &rate, sizeof(rate)), "enable lock profiling");
+	T_ATEND(prof_rate_restore);
+
+	T_ASSERT_POSIX_SUCCESS(pipe(fds), "pipe");
+	for (int i = 0; i < 8; i++) {
+		T_QUIET; T_ASSERT_POSIX_ZERO(pthread_create(&threads[i], NULL,
+		    prof_contender, fds), "pthread_create");
+	}
+	sleep(1);
+	prof_done = true;
+	close(fds[1]);
+	for (int i = 0; i < 8; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	close(fds[0]);
+
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.lock_prof_groups", NULL, &size,
+	    NULL, 0), "kern.lock_prof_groups");
+	T_EXPECT_GT(size, (size_t)0, "the catch-all profile is always reported");
+	T_EXPECT_EQ(size % sizeof(lockgroup_prof_info_t), (size_t)0,
+	    "whole lockgroup_prof_info_t records");
+
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.lock_prof_sites", NULL, &size,
+	    NULL, 0), "kern.lock_prof_sites");
+	T_EXPECT_EQ(size % sizeof(lockprof_site_t), (size_t)0,
+	    "whole lockprof_site_t records");
+}
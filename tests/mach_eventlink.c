@@ -810,3 +810,64 @@ T_DECL(test_eventlink_wait_signal_loop, "eventlink wait_signal in loop", T_META_
 	mach_port_deallocate(mach_task_self(), port_pair[0]);
 	mach_port_deallocate(mach_task_self(), port_pair[1]);
 }
+
+static void *
+test_eventlink_wait_for_batched_signal(void *arg)
+{
+	kern_return_t kr;
+	mach_port_t eventlink_port = (mach_port_t) (uintptr_t)arg;
+	mach_port_t self = mach_thread_self();
+	uint64_t count = 0;
+
+	/* Associate thread with eventlink port */
+	kr = mach_eventlink_associate(eventlink_port, self, 0, 0, 0, 0, MELA_OPTION_NONE);
+	T_ASSERT_MACH_SUCCESS(kr, "mach_eventlink_associate");
+
+	/* Wait for the whole batch of signals */
+	count = 2;
+	kr = mach_eventlink_wait_until(eventlink_port, &count, MELSW_OPTION_NONE,
+	    KERN_CLOCK_MACH_ABSOLUTE_TIME, 0);
+
+	T_ASSERT_MACH_SUCCESS(kr, "mach_eventlink_wait_until");
+	T_EXPECT_EQ(count, (uint64_t)3, "mach_eventlink_wait_until returned batched count value");
+
+	return NULL;
+}
+
+/*
+ * Test 16: Test eventlink batched signal.
+ *
+ * Create an eventlink object, associate threads and deliver several signals at once.
+ */
+T_DECL(test_eventlink_batched_signal, "eventlink batched signal", T_META_ASROOT(YES))
+{
+	kern_return_t kr;
+	mach_port_t port_pair[2];
+	pthread_t pthread;
+	mach_port_t self = mach_thread_self();
+
+	/* Create an eventlink and associate threads to it */
+	kr = test_eventlink_create(port_pair);
+	if (kr != KERN_SUCCESS) {
+		return;
+	}
+
+	pthread = thread_create_for_test(test_eventlink_wait_for_batched_signal, (void *)(uintptr_t)port_pair[0]);
+
+	sleep(5);
+
+	/* Associate thread and signal the eventlink three times in one call */
+	kr = mach_eventlink_associate(port_pair[1], self, 0, 0, 0, 0, MELA_OPTION_NONE);
+	T_ASSERT_MACH_SUCCESS(kr, "mach_eventlink_associate for object 2");
+
+	kr = mach_eventlink_signal(port_pair[1], 3);
+	T_ASSERT_MACH_SUCCESS(kr, "mach_eventlink_signal with a count of 3");
+
+	pthread_join(pthread, NULL);
+
+	kr = mach_eventlink_signal(port_pair[1], (uint64_t)UINT32_MAX + 1);
+	T_EXPECT_MACH_ERROR(kr, KERN_INVALID_ARGUMENT, "oversized signal count is rejected");
+
+	mach_port_deallocate(mach_task_self(), port_pair[0]);
+	mach_port_deallocate(mach_task_self(), port_pair[1]);
+}
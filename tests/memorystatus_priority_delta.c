@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/kern_memorystatus.h>
+
+#include <darwintest.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.memorystatus"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"),
+	T_META_ASROOT(true),
+	T_META_CHECK_LEAKS(false)
+	);
+
+extern char **environ;
+
+#define DELTA_MAX_ENTRIES       1024
+#define DELTA_BUFFER_SIZE       (sizeof(memorystatus_priority_delta_header_t) + \
+	                         DELTA_MAX_ENTRIES * sizeof(memorystatus_priority_entry_t) + \
+	                         256 * sizeof(pid_t))
+
+static uint64_t
+get_delta(void *buffer, uint64_t since)
+{
+	memorystatus_priority_delta_header_t *header = buffer;
+	int size;
+
+	header->generation = since;
+	size = memorystatus_control(MEMORYSTATUS_CMD_GET_PRIORITY_LIST_DELTA, 0, 0, buffer, DELTA_BUFFER_SIZE);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(size, "MEMORYSTATUS_CMD_GET_PRIORITY_LIST_DELTA");
+	T_QUIET; T_ASSERT_EQ((size_t)size, sizeof(*header) +
+	    header->changed_count * sizeof(memorystatus_priority_entry_t) +
+	    header->removed_count * sizeof(pid_t), "returned size matches the counts");
+	return header->generation;
+}
+
+static bool
+delta_has_changed(void *buffer, pid_t pid, int32_t *priority)
+{
+	memorystatus_priority_delta_header_t *header = buffer;
+	memorystatus_priority_entry_t *entries = (memorystatus_priority_entry_t *)(header + 1);
+
+	for (uint32_t i = 0; i < header->changed_count; i++) {
+		if (entries[i].pid == pid) {
+			*priority = entries[i].priority;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+delta_has_removed(void *buffer, pid_t pid)
+{
+	memorystatus_priority_delta_header_t *header = buffer;
+	memorystatus_priority_entry_t *entries = (memorystatus_priority_entry_t *)(header + 1);
+	pid_t *removed = (pid_t *)(entries + header->changed_count);
+
+	for (uint32_t i = 0; i < header->removed_count; i++) {
+		if (removed[i] == pid) {
+			return true;
+		}
+	}
+	return false;
+}
+
+T_DECL(memorystatus_priority_delta,
+    "MEMORYSTATUS_CMD_GET_PRIORITY_LIST_DELTA reports band changes and exits")
+{
+	memorystatus_priority_properties_t props = { 0 };
+	void *buffer = calloc(1, DELTA_BUFFER_SIZE);
+	char *args[] = { "/usr/bin/true", NULL };
+	uint64_t gen, next;
+	int32_t priority = -1;
+	pid_t child;
+	int status;
+
+	T_QUIET; T_ASSERT_NOTNULL(buffer, "calloc");
+
+	gen = get_delta(buffer, 0);
+	T_EXPECT_GT(gen, 0ULL, "initial generation is non-zero");
+
+	props.priority = JETSAM_PRIORITY_BACKGROUND;
+	T_ASSERT_POSIX_SUCCESS(memorystatus_control(MEMORYSTATUS_CMD_SET_PRIORITY_PROPERTIES,
+	    getpid(), 0, &props, sizeof(props)), "move self to the background band");
+
+	next = get_delta(buffer, gen);
+	T_EXPECT_GT(next, gen, "generation advanced");
+	T_EXPECT_TRUE(delta_has_changed(buffer, getpid(), &priority), "self is reported as changed");
+	T_EXPECT_EQ(priority, JETSAM_PRIORITY_BACKGROUND, "reported priority is the new band");
+	gen = next;
+
+	T_ASSERT_POSIX_ZERO(posix_spawn(&child, args[0], NULL, NULL, args, environ), "spawn child");
+	T_ASSERT_POSIX_SUCCESS(waitpid(child, &status, 0), "wait for child");
+
+	get_delta(buffer, gen);
+	T_EXPECT_TRUE(delta_has_removed(buffer, child), "exited child is reported as removed");
+
+	free(buffer);
+}
@@ -24,3 +24,27 @@ T_DECL(pingpong, "mpsc_pingpong", T_META_ASROOT(true))
 	T_LOG("%lld asyncs in %lld ns (%g us/async)", count, nsecs,
 	    (nsecs / 1e3) / count);
 }
+
+static void
+mpsc_burst(const char *name)
+{
+	uint64_t count = 50 * 1000, nsecs = 0;
+	size_t nlen = sizeof(nsecs);
+	int error;
+
+	error = sysctlbyname(name, &nsecs, &nlen, &count, sizeof(count));
+	T_ASSERT_POSIX_SUCCESS(error, "sysctlbyname(%s)", name);
+	T_LOG("%lld items in %lld ns (%g ns/item)", count, nsecs,
+	    (double)nsecs / count);
+}
+
+T_DECL(burst, "mpsc_burst", T_META_ASROOT(true))
+{
+	mpsc_burst("kern.mpsc_test_burst");
+}
+
+T_DECL(burst_coalesced, "mpsc_burst with batching and wakeup coalescing",
+    T_META_ASROOT(true))
+{
+	mpsc_burst("kern.mpsc_test_burst_coalesced");
+}
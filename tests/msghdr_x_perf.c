@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * msghdr_x_perf.c
+ * - per message cost of sendmsg_x() and recvmsg_x() with batches of small
+ *   single iovec datagrams over loopback UDP, where the copyin of the
+ *   message headers and iovec arrays is a large part of the work
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <mach/mach_time.h>
+#include <darwintest.h>
+#include <darwintest_perf.h>
+
+/* -*- compile-command: "xcrun --sdk macosx.internal make -C tests msghdr_x_perf" -*- */
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false));
+
+#define BATCH           64
+#define DATAGRAM_SIZE   16
+#define ROUNDS          2000
+
+static uint8_t send_bufs[BATCH][DATAGRAM_SIZE];
+static uint8_t recv_bufs[BATCH][DATAGRAM_SIZE];
+static struct iovec send_iovs[BATCH], recv_iovs[BATCH];
+static struct msghdr_x send_msgs[BATCH], recv_msgs[BATCH];
+
+static double
+abs_to_ns(uint64_t delta)
+{
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0) {
+		mach_timebase_info(&tb);
+	}
+	return (double)delta * tb.numer / tb.denom;
+}
+
+static void
+udp_pair(int *snd, int *rcv)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(sin);
+	int rcvbuf = 4 * 1024 * 1024;
+
+	T_ASSERT_POSIX_SUCCESS(*rcv = socket(AF_INET, SOCK_DGRAM, 0), "receiver socket");
+	T_ASSERT_POSIX_SUCCESS(setsockopt(*rcv, SOL_SOCKET, SO_RCVBUF,
+	    &rcvbuf, sizeof(rcvbuf)), "SO_RCVBUF");
+	T_ASSERT_POSIX_SUCCESS(bind(*rcv, (struct sockaddr *)&sin, sizeof(sin)), "bind");
+	T_ASSERT_POSIX_SUCCESS(getsockname(*rcv, (struct sockaddr *)&sin, &len), "getsockname");
+
+	T_ASSERT_POSIX_SUCCESS(*snd = socket(AF_INET, SOCK_DGRAM, 0), "sender socket");
+	T_ASSERT_POSIX_SUCCESS(connect(*snd, (struct sockaddr *)&sin, sizeof(sin)), "connect");
+}
+
+T_DECL(msghdr_x_perf,
+    "per message cost of sendmsg_x()/recvmsg_x() batches of small datagrams",
+    T_META_TAG_PERF)
+{
+	uint64_t send_time = 0, recv_time = 0;
+	int snd, rcv;
+
+	udp_pair(&snd, &rcv);
+
+	for (int i = 0; i < BATCH; i++) {
+		memset(send_bufs[i], i, DATAGRAM_SIZE);
+		send_iovs[i] = (struct iovec){ send_bufs[i], DATAGRAM_SIZE };
+		send_msgs[i].msg_iov = &send_iovs[i];
+		send_msgs[i].msg_iovlen = 1;
+		recv_iovs[i] = (struct iovec){ recv_bufs[i], DATAGRAM_SIZE };
+	}
+
+	for (int round = 0; round < ROUNDS; round++) {
+		ssize_t sent, received = 0;
+		uint64_t start;
+
+		start = mach_absolute_time();
+		sent = sendmsg_x(snd, send_msgs, BATCH, 0);
+		send_time += mach_absolute_time() - start;
+		T_QUIET; T_ASSERT_EQ(sent, (ssize_t)BATCH, "sendmsg_x");
+
+		while (received < BATCH) {
+			ssize_t n;
+
+			for (int i = 0; i < BATCH; i++) {
+				recv_msgs[i] = (struct msghdr_x){
+					.msg_iov = &recv_iovs[i],
+					.msg_iovlen = 1,
+				};
+			}
+			start = mach_absolute_time();
+			n = recvmsg_x(rcv, recv_msgs, (u_int)(BATCH - received), 0);
+			recv_time += mach_absolute_time() - start;
+			T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "recvmsg_x");
+
+			for (ssize_t i = 0; i < n; i++) {
+				T_QUIET; T_ASSERT_EQ(recv_msgs[i].msg_datalen, (size_t)DATAGRAM_SIZE,
+				    "datagram size");
+				T_QUIET; T_ASSERT_EQ(recv_bufs[i][0], (uint8_t)(received + i),
+				    "datagrams arrive in order");
+			}
+			received += n;
+		}
+	}
+
+	T_PERF("sendmsg_x_per_msg", abs_to_ns(send_time) / (ROUNDS * BATCH),
+	    "ns", "sendmsg_x() time per 16 byte datagram, batches of 64");
+	T_PERF("recvmsg_x_per_msg", abs_to_ns(recv_time) / (ROUNDS * BATCH),
+	    "ns", "recvmsg_x() time per 16 byte datagram, batches of 64");
+
+	close(snd);
+	close(rcv);
+}
@@ -0,0 +1,591 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * net_perf.c
+ * - networking benchmark suite over a pair of fake ethernet interfaces:
+ *   TCP and UDP bulk throughput, TCP request/response latency and TCP
+ *   connection rate, once with feth attached as a legacy BSD interface
+ *   (dlil path) and once as a skywalk native netif behind the flowswitch
+ *
+ * Throughput is also reported per busy core, using host-wide CPU load over
+ * the run so that the dlil input threads and skywalk workers are counted.
+ */
+
+#include <darwintest.h>
+#include <darwintest_perf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <net/if.h>
+#include <net/if_fake_var.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/sockio.h>
+#include <sys/sysctl.h>
+
+#include "benchmark/harness.h"
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_ASROOT(true),
+    T_META_TAG_PERF,
+    T_META_CHECK_LEAKS(false),
+    T_META_RUN_CONCURRENTLY(false));
+
+#define FETH_SERVER             "feth820"
+#define FETH_CLIENT             "feth821"
+#define SERVER_ADDR             "10.182.0.1"
+#define CLIENT_ADDR             "10.182.0.2"
+#define SERVER_PORT             5820
+
+#define ROUNDS                  5
+#define TCP_BULK_SIZE           (256 * 1024 * 1024)
+#define TCP_BULK_BUFSZ          (128 * 1024)
+#define UDP_PACKETS             (512 * 1024)
+#define UDP_PAYLOAD             64
+#define UDP_IDLE_MS             200
+#define RR_TRANSACTIONS         20000
+#define CRR_CONNECTIONS         5000
+
+static int S_bsd_mode_saved = -1;
+
+#pragma mark - interfaces
+
+static void
+ifnet_destroy(const char *ifname)
+{
+	struct ifreq    ifr;
+	int             s;
+
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s < 0) {
+		return;
+	}
+	bzero(&ifr, sizeof(ifr));
+	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	(void)ioctl(s, SIOCIFDESTROY, &ifr);
+	close(s);
+}
+
+static void
+ifnet_create_up(int s, const char *ifname, const char *addr)
+{
+	struct ifaliasreq       ifra;
+	struct ifreq            ifr;
+	struct sockaddr_in      *sin;
+
+	bzero(&ifr, sizeof(ifr));
+	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	if (ioctl(s, SIOCIFCREATE, &ifr) < 0 && errno == EEXIST) {
+		ifnet_destroy(ifname);
+		T_QUIET;
+		T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCIFCREATE, &ifr),
+		    "SIOCIFCREATE %s", ifname);
+	}
+
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCGIFFLAGS, &ifr),
+	    "SIOCGIFFLAGS %s", ifname);
+	ifr.ifr_flags |= IFF_UP;
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCSIFFLAGS, &ifr),
+	    "SIOCSIFFLAGS %s", ifname);
+
+	bzero(&ifra, sizeof(ifra));
+	strlcpy(ifra.ifra_name, ifname, sizeof(ifra.ifra_name));
+	sin = (struct sockaddr_in *)(void *)&ifra.ifra_addr;
+	sin->sin_len = sizeof(*sin);
+	sin->sin_family = AF_INET;
+	inet_pton(AF_INET, addr, &sin->sin_addr);
+	sin = (struct sockaddr_in *)(void *)&ifra.ifra_mask;
+	sin->sin_len = sizeof(*sin);
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(IN_CLASSC_NET);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCAIFADDR, &ifra),
+	    "SIOCAIFADDR %s %s", ifname, addr);
+}
+
+static void
+fake_set_peer(int s, const char *feth, const char *feth_peer)
+{
+	struct if_fake_request  iffr;
+	struct ifdrv            ifd;
+
+	bzero(&iffr, sizeof(iffr));
+	strlcpy(iffr.iffr_peer_name, feth_peer, sizeof(iffr.iffr_peer_name));
+	bzero(&ifd, sizeof(ifd));
+	strlcpy(ifd.ifd_name, feth, sizeof(ifd.ifd_name));
+	ifd.ifd_cmd = IF_FAKE_S_CMD_SET_PEER;
+	ifd.ifd_len = sizeof(iffr);
+	ifd.ifd_data = &iffr;
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCSDRVSPEC, &ifd),
+	    "IF_FAKE_S_CMD_SET_PEER %s %s", feth, feth_peer);
+}
+
+static void
+cleanup(void)
+{
+	ifnet_destroy(FETH_SERVER);
+	ifnet_destroy(FETH_CLIENT);
+	if (S_bsd_mode_saved != -1) {
+		(void)sysctlbyname("net.link.fake.bsd_mode", NULL, NULL,
+		    &S_bsd_mode_saved, sizeof(S_bsd_mode_saved));
+	}
+}
+
+/* net.link.fake.bsd_mode is read when the interface is created */
+static void
+feth_pair_setup(int bsd_mode)
+{
+	size_t  len = sizeof(S_bsd_mode_saved);
+	int     s;
+
+	if (S_bsd_mode_saved == -1) {
+		T_QUIET;
+		T_ASSERT_POSIX_SUCCESS(sysctlbyname("net.link.fake.bsd_mode",
+		    &S_bsd_mode_saved, &len, NULL, 0), "net.link.fake.bsd_mode");
+		T_ATEND(cleanup);
+	}
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("net.link.fake.bsd_mode", NULL, NULL,
+	    &bsd_mode, sizeof(bsd_mode)), "net.link.fake.bsd_mode=%d", bsd_mode);
+
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+	ifnet_create_up(s, FETH_SERVER, SERVER_ADDR);
+	ifnet_create_up(s, FETH_CLIENT, CLIENT_ADDR);
+	fake_set_peer(s, FETH_SERVER, FETH_CLIENT);
+	close(s);
+}
+
+#pragma mark - measurement helpers
+
+static uint64_t
+abs_to_ns(uint64_t abs)
+{
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0) {
+		mach_timebase_info(&tb);
+	}
+	return abs * tb.numer / tb.denom;
+}
+
+typedef struct {
+	uint64_t        busy;
+	uint64_t        total;
+} cpu_ticks_t;
+
+static void
+cpu_ticks_get(cpu_ticks_t *ticks)
+{
+	host_cpu_load_info_data_t       load;
+	mach_msg_type_number_t          count = HOST_CPU_LOAD_INFO_COUNT;
+	kern_return_t                   kr;
+
+	kr = host_statistics(mach_host_self(), HOST_CPU_LOAD_INFO,
+	    (host_info_t)&load, &count);
+	T_QUIET;
+	T_ASSERT_MACH_SUCCESS(kr, "host_statistics(HOST_CPU_LOAD_INFO)");
+	ticks->busy = (uint64_t)load.cpu_ticks[CPU_STATE_USER] +
+	    load.cpu_ticks[CPU_STATE_SYSTEM] + load.cpu_ticks[CPU_STATE_NICE];
+	ticks->total = ticks->busy + load.cpu_ticks[CPU_STATE_IDLE];
+}
+
+/* number of cores kept busy between two samples, across the whole host */
+static double
+cpu_ticks_busy_cores(const cpu_ticks_t *start, const cpu_ticks_t *end)
+{
+	int     ncpu = 0;
+	size_t  len = sizeof(ncpu);
+	double  total = (double)(end->total - start->total);
+
+	(void)sysctlbyname("hw.activecpu", &ncpu, &len, NULL, 0);
+	if (total <= 0 || ncpu <= 0) {
+		return 1.0;
+	}
+	return MAX((double)(end->busy - start->busy) / total * ncpu, 0.01);
+}
+
+static int
+socket_bound(int type, const char *ifname, const char *addr, uint16_t port)
+{
+	struct sockaddr_in      sin;
+	int                     ifindex = (int)if_nametoindex(ifname);
+	int                     one = 1;
+	int                     s;
+
+	s = socket(AF_INET, type, 0);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+	/* keep the traffic on the fake interfaces instead of lo0 */
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, IPPROTO_IP, IP_BOUND_IF,
+	    &ifindex, sizeof(ifindex)), "IP_BOUND_IF %s", ifname);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, SOL_SOCKET, SO_REUSEADDR,
+	    &one, sizeof(one)), "SO_REUSEADDR");
+	bzero(&sin, sizeof(sin));
+	sin.sin_len = sizeof(sin);
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	inet_pton(AF_INET, addr, &sin.sin_addr);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(bind(s, (struct sockaddr *)&sin, sizeof(sin)),
+	    "bind %s:%u", addr, port);
+	return s;
+}
+
+static void
+socket_connect_server(int s)
+{
+	struct sockaddr_in      sin;
+
+	bzero(&sin, sizeof(sin));
+	sin.sin_len = sizeof(sin);
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(SERVER_PORT);
+	inet_pton(AF_INET, SERVER_ADDR, &sin.sin_addr);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(connect(s, (struct sockaddr *)&sin,
+	    sizeof(sin)), "connect");
+}
+
+/* returns a connected (client, server) pair of TCP sockets */
+static void
+tcp_pair(int *client, int *server)
+{
+	int     listener;
+
+	listener = socket_bound(SOCK_STREAM, FETH_SERVER, SERVER_ADDR, SERVER_PORT);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(listen(listener, 1), "listen");
+	*client = socket_bound(SOCK_STREAM, FETH_CLIENT, CLIENT_ADDR, 0);
+	socket_connect_server(*client);
+	*server = accept(listener, NULL, NULL);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(*server, "accept");
+	close(listener);
+}
+
+#pragma mark - TCP bulk
+
+static void *
+tcp_bulk_sender(void *arg)
+{
+	int             s = *(int *)arg;
+	static char     buf[TCP_BULK_BUFSZ];
+	size_t          left = TCP_BULK_SIZE;
+
+	while (left > 0) {
+		ssize_t n = write(s, buf, MIN(left, sizeof(buf)));
+		if (n <= 0) {
+			break;
+		}
+		left -= (size_t)n;
+	}
+	close(s);
+	return NULL;
+}
+
+static void
+tcp_bulk(const char *mode)
+{
+	dt_stat_t       gbps = dt_stat_create("Gb/s", "%s_tcp_bulk", mode);
+	dt_stat_t       per_core = dt_stat_create("Gb/s/core",
+	    "%s_tcp_bulk_per_core", mode);
+
+	for (int round = 0; round < ROUNDS; round++) {
+		static char     buf[TCP_BULK_BUFSZ];
+		cpu_ticks_t     cpu_start, cpu_end;
+		pthread_t       thread;
+		uint64_t        start, ns;
+		size_t          total = 0;
+		ssize_t         n;
+		int             client, server;
+		double          rate;
+
+		tcp_pair(&client, &server);
+		cpu_ticks_get(&cpu_start);
+		start = mach_absolute_time();
+		T_QUIET;
+		T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, tcp_bulk_sender,
+		    &client), "pthread_create");
+		while ((n = read(server, buf, sizeof(buf))) > 0) {
+			total += (size_t)n;
+		}
+		ns = abs_to_ns(mach_absolute_time() - start);
+		cpu_ticks_get(&cpu_end);
+		pthread_join(thread, NULL);
+		close(server);
+
+		T_QUIET;
+		T_ASSERT_EQ_ULONG(total, (size_t)TCP_BULK_SIZE, "received everything");
+		rate = (double)total * 8 / (double)ns;
+		dt_stat_add(gbps, rate);
+		dt_stat_add(per_core, rate / cpu_ticks_busy_cores(&cpu_start, &cpu_end));
+	}
+	dt_stat_finalize(gbps);
+	dt_stat_finalize(per_core);
+}
+
+#pragma mark - UDP bulk
+
+struct udp_receiver {
+	int             s;
+	uint64_t        received;
+	uint64_t        first;
+	uint64_t        last;
+};
+
+static void *
+udp_bulk_receiver(void *arg)
+{
+	struct udp_receiver     *r = arg;
+	char                    buf[UDP_PAYLOAD];
+
+	/* the sender is done once the socket has been idle for UDP_IDLE_MS */
+	while (recv(r->s, buf, sizeof(buf), 0) > 0) {
+		r->last = mach_absolute_time();
+		if (r->received++ == 0) {
+			r->first = r->last;
+		}
+	}
+	return NULL;
+}
+
+static void
+udp_bulk(const char *mode)
+{
+	dt_stat_t       mpps = dt_stat_create("Mpps", "%s_udp_bulk", mode);
+	dt_stat_t       per_core = dt_stat_create("Mpps/core",
+	    "%s_udp_bulk_per_core", mode);
+
+	for (int round = 0; round < ROUNDS; round++) {
+		struct timeval          idle = { 0, UDP_IDLE_MS * 1000 };
+		struct udp_receiver     r = { };
+		cpu_ticks_t             cpu_start, cpu_end;
+		char                    buf[UDP_PAYLOAD] = { };
+		int                     rcvbuf = 4 * 1024 * 1024;
+		pthread_t               thread;
+		uint64_t                ns;
+		double                  rate;
+		int                     client;
+
+		r.s = socket_bound(SOCK_DGRAM, FETH_SERVER, SERVER_ADDR, SERVER_PORT);
+		(void)setsockopt(r.s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+		T_QUIET;
+		T_ASSERT_POSIX_SUCCESS(setsockopt(r.s, SOL_SOCKET, SO_RCVTIMEO,
+		    &idle, sizeof(idle)), "SO_RCVTIMEO");
+		client = socket_bound(SOCK_DGRAM, FETH_CLIENT, CLIENT_ADDR, 0);
+		socket_connect_server(client);
+
+		cpu_ticks_get(&cpu_start);
+		T_QUIET;
+		T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, udp_bulk_receiver,
+		    &r), "pthread_create");
+		for (int i = 0; i < UDP_PACKETS; i++) {
+			/* ENOBUFS under load is expected, it shows up as loss */
+			(void)send(client, buf, sizeof(buf), 0);
+		}
+		pthread_join(thread, NULL);
+		cpu_ticks_get(&cpu_end);
+		close(client);
+		close(r.s);
+
+		T_QUIET;
+		T_ASSERT_GT_ULLONG(r.received, 1ULL, "received datagrams");
+		ns = abs_to_ns(r.last - r.first);
+		rate = (double)r.received * 1000 / (double)MAX(ns, 1);
+		T_LOG("%s udp round %d: %llu/%d received", mode, round,
+		    r.received, UDP_PACKETS);
+		dt_stat_add(mpps, rate);
+		dt_stat_add(per_core, rate / cpu_ticks_busy_cores(&cpu_start, &cpu_end));
+	}
+	dt_stat_finalize(mpps);
+	dt_stat_finalize(per_core);
+}
+
+#pragma mark - TCP request/response
+
+static void *
+tcp_rr_server(void *arg)
+{
+	int     s = *(int *)arg;
+	char    c;
+
+	while (read(s, &c, 1) == 1) {
+		if (write(s, &c, 1) != 1) {
+			break;
+		}
+	}
+	close(s);
+	return NULL;
+}
+
+static void
+tcp_rr(const char *mode)
+{
+	double                  *samples;
+	benchmark_stats_t       stats;
+	pthread_t               thread;
+	int                     client, server;
+	int                     one = 1;
+	char                    c = 'x';
+
+	samples = calloc(RR_TRANSACTIONS, sizeof(double));
+	T_QUIET;
+	T_ASSERT_NOTNULL(samples, "calloc");
+
+	tcp_pair(&client, &server);
+	(void)setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	(void)setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	T_QUIET;
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, tcp_rr_server,
+	    &server), "pthread_create");
+
+	for (int i = 0; i < RR_TRANSACTIONS; i++) {
+		uint64_t start = mach_absolute_time();
+
+		T_QUIET;
+		T_ASSERT_EQ_LONG(write(client, &c, 1), 1L, "request");
+		T_QUIET;
+		T_ASSERT_EQ_LONG(read(client, &c, 1), 1L, "response");
+		samples[i] = (double)abs_to_ns(mach_absolute_time() - start) / 1000;
+	}
+	close(client);
+	pthread_join(thread, NULL);
+
+	benchmark_compute_stats(samples, RR_TRANSACTIONS, &stats);
+	T_LOG("%s tcp_rr: median %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us",
+	    mode, stats.median, stats.p90, stats.p99, stats.max);
+	T_PERF("tcp_rr_median", stats.median, "us", "TCP 1 byte round trip, median");
+	T_PERF("tcp_rr_p99", stats.p99, "us", "TCP 1 byte round trip, p99");
+	T_PERF("tcp_rr_rate", 1e6 / stats.mean, "transactions/s",
+	    "TCP 1 byte request/response rate");
+	free(samples);
+}
+
+#pragma mark - TCP connection rate
+
+static void *
+tcp_crr_server(void *arg)
+{
+	int     listener = *(int *)arg;
+	char    c;
+
+	for (int i = 0; i < CRR_CONNECTIONS; i++) {
+		int s = accept(listener, NULL, NULL);
+		if (s < 0) {
+			break;
+		}
+		if (read(s, &c, 1) == 1) {
+			(void)write(s, &c, 1);
+		}
+		close(s);
+	}
+	return NULL;
+}
+
+/* connect, one request/response, close: the classic CRR pattern */
+static void
+tcp_crr(const char *mode)
+{
+	pthread_t       thread;
+	uint64_t        start, ns;
+	int             listener;
+	char            c = 'x';
+
+	listener = socket_bound(SOCK_STREAM, FETH_SERVER, SERVER_ADDR, SERVER_PORT);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(listen(listener, 128), "listen");
+	T_QUIET;
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, tcp_crr_server,
+	    &listener), "pthread_create");
+
+	start = mach_absolute_time();
+	for (int i = 0; i < CRR_CONNECTIONS; i++) {
+		struct linger   linger = { .l_onoff = 1, .l_linger = 0 };
+		int             s;
+
+		s = socket_bound(SOCK_STREAM, FETH_CLIENT, CLIENT_ADDR, 0);
+		/* reset on close so TIME_WAIT doesn't exhaust the port space */
+		(void)setsockopt(s, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+		socket_connect_server(s);
+		T_QUIET;
+		T_ASSERT_EQ_LONG(write(s, &c, 1), 1L, "request");
+		T_QUIET;
+		T_ASSERT_EQ_LONG(read(s, &c, 1), 1L, "response");
+		close(s);
+	}
+	ns = abs_to_ns(mach_absolute_time() - start);
+	pthread_join(thread, NULL);
+	close(listener);
+
+	T_PERF("tcp_crr_rate", (double)CRR_CONNECTIONS * 1e9 / (double)ns,
+	    "connections/s", "TCP connect/request/response/close rate");
+}
+
+#pragma mark - suites
+
+static void
+net_perf_suite(const char *mode, int bsd_mode)
+{
+	feth_pair_setup(bsd_mode);
+	tcp_bulk(mode);
+	udp_bulk(mode);
+	tcp_rr(mode);
+	tcp_crr(mode);
+}
+
+T_DECL(net_perf_dlil,
+    "TCP/UDP throughput, latency and connection rate over feth, dlil path")
+{
+	net_perf_suite("dlil", 1);
+}
+
+T_DECL(net_perf_skywalk,
+    "TCP/UDP throughput, latency and connection rate over feth, skywalk path")
+{
+	size_t  len = 0;
+
+	if (sysctlbyname("kern.skywalk.features", NULL, &len, NULL, 0) != 0) {
+		T_SKIP("skywalk not supported");
+	}
+	net_perf_suite("skywalk", 0);
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * pf_state_perf.c
+ * - UDP send rate over lo0 with pf keeping state for an increasing
+ *   number of flows
+ */
+
+#include <darwintest.h>
+#include <darwintest_perf.h>
+#include <darwintest_utils.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <mach/mach_time.h>
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_ASROOT(true),
+    T_META_TAG_PERF,
+    T_META_RUN_CONCURRENTLY(false));
+
+#define PFCTL_PATH              "/sbin/pfctl"
+
+#define FLOW_BASE_PORT          20000
+#define SEND_ROUNDS             8
+#define SEND_PACKETS            200000
+
+static void
+pf_cmd(const char *cmd, bool fail_on_error)
+{
+	pid_t pid = -1;
+	int exit_status = 0;
+	const char *argv[] = {
+		"/bin/sh",
+		"-c",
+		cmd,
+		NULL
+	};
+
+	T_QUIET;
+	T_ASSERT_EQ(dt_launch_tool(&pid, (char **)(void *)argv, false, NULL,
+	    NULL), 0, "dt_launch_tool(%s)", cmd);
+	if (!dt_waitpid(pid, &exit_status, NULL, 30) && fail_on_error) {
+		T_FAIL("%s failed", cmd);
+	}
+}
+
+static void
+cleanup_pf(void)
+{
+	pf_cmd(PFCTL_PATH " -d", false);
+	pf_cmd(PFCTL_PATH " -F all", false);
+}
+
+/* send to nflows destination ports, round robin; returns packets/s */
+static double
+send_flows(int s, u_int nflows, u_int npackets)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	mach_timebase_info_data_t tb;
+	uint64_t start, ns;
+	char buf[64] = {};
+
+	start = mach_absolute_time();
+	for (u_int i = 0; i < npackets; i++) {
+		sin.sin_port = htons((uint16_t)(FLOW_BASE_PORT + i % nflows));
+		(void)sendto(s, buf, sizeof(buf), 0,
+		    (struct sockaddr *)&sin, sizeof(sin));
+	}
+	ns = mach_absolute_time() - start;
+	mach_timebase_info(&tb);
+	ns = ns * tb.numer / tb.denom;
+	return (double)npackets * 1000000000 / (double)ns;
+}
+
+T_DECL(pf_state_perf,
+    "UDP send rate through pf with many states")
+{
+	u_int flows[] = { 16, 1024, 16384, 40000 };
+	struct stat sb;
+	int s;
+
+	if (stat(PFCTL_PATH, &sb) != 0) {
+		T_SKIP("%s not present", PFCTL_PATH);
+	}
+	T_ATEND(cleanup_pf);
+
+	pf_cmd("printf 'set limit states 100000\\n"
+	    "pass quick on lo0 proto udp all keep state\\n' | "
+	    PFCTL_PATH " -f -", true);
+	/* fails when pf is already enabled */
+	pf_cmd(PFCTL_PATH " -e", false);
+
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+
+	for (u_int i = 0; i < sizeof(flows) / sizeof(flows[0]); i++) {
+		dt_stat_t rate = dt_stat_create("packets/s", "pf_states_%u",
+		    flows[i]);
+
+		pf_cmd(PFCTL_PATH " -F states", true);
+		/* create the states before measuring lookups */
+		(void)send_flows(s, flows[i], flows[i]);
+		for (int round = 0; round < SEND_ROUNDS; round++) {
+			dt_stat_add(rate, send_flows(s, flows[i], SEND_PACKETS));
+		}
+		dt_stat_finalize(rate);
+	}
+	close(s);
+}
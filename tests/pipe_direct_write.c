@@ -0,0 +1,127 @@
+#include <darwintest.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.ipc"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("IPC"),
+	T_META_RUN_CONCURRENTLY(true));
+
+struct writer_args {
+	int             fd;
+	const uint8_t   *buf;
+	size_t          len;
+	ssize_t         written;
+	int             error;
+};
+
+static void *
+writer_thread(void *arg)
+{
+	struct writer_args *wa = arg;
+
+	wa->written = write(wa->fd, wa->buf, wa->len);
+	wa->error = wa->written < 0 ? errno : 0;
+	return NULL;
+}
+
+static uint8_t *
+pattern_alloc(size_t len)
+{
+	uint8_t *buf = malloc(len);
+
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	for (size_t i = 0; i < len; i++) {
+		buf[i] = (uint8_t)(i * 31 + 7);
+	}
+	return buf;
+}
+
+/*
+ * The writer blocks in the direct write path until the reader drains it;
+ * the reader only starts once the data is visible in FIONREAD.
+ */
+static void
+blocked_write_read(size_t len, size_t misalign)
+{
+	uint8_t *buf = pattern_alloc(len + misalign);
+	uint8_t *rbuf = malloc(len);
+	struct writer_args wa = { .buf = buf + misalign, .len = len };
+	pthread_t thread;
+	size_t nread = 0;
+	int fds[2], avail = 0;
+
+	T_QUIET; T_ASSERT_NOTNULL(rbuf, "malloc");
+	T_ASSERT_POSIX_SUCCESS(pipe(fds), "pipe");
+	wa.fd = fds[1];
+
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, writer_thread, &wa),
+	    "pthread_create");
+	while (avail == 0) {
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(ioctl(fds[0], FIONREAD, &avail), "FIONREAD");
+		usleep(1000);
+	}
+
+	while (nread < len) {
+		ssize_t n = read(fds[0], rbuf + nread, len - nread);
+
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "read");
+		T_QUIET; T_ASSERT_GT(n, 0L, "no early EOF");
+		nread += (size_t)n;
+	}
+	T_ASSERT_POSIX_ZERO(pthread_join(thread, NULL), "pthread_join");
+
+	T_ASSERT_EQ(wa.written, (ssize_t)len, "write of %zu bytes completed", len);
+	T_ASSERT_EQ(memcmp(rbuf, buf + misalign, len), 0, "data read matches data written");
+
+	close(fds[0]);
+	close(fds[1]);
+	free(rbuf);
+	free(buf);
+}
+
+T_DECL(pipe_direct_write_blocked,
+    "large writes into a pipe nobody is reading yet are delivered intact")
+{
+	blocked_write_read(64 * 1024, 0);
+	blocked_write_read(64 * 1024 + 1, 123);
+	blocked_write_read(1024 * 1024, 0);
+	blocked_write_read(3 * 1024 * 1024 + 17, 4095);
+}
+
+T_DECL(pipe_direct_write_reader_closes,
+    "a large blocked write fails with EPIPE when the reader goes away")
+{
+	size_t len = 256 * 1024;
+	uint8_t *buf = pattern_alloc(len);
+	struct writer_args wa = { .buf = buf, .len = len };
+	pthread_t thread;
+	int fds[2], avail = 0;
+
+	signal(SIGPIPE, SIG_IGN);
+	T_ASSERT_POSIX_SUCCESS(pipe(fds), "pipe");
+	wa.fd = fds[1];
+
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, writer_thread, &wa),
+	    "pthread_create");
+	while (avail == 0) {
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(ioctl(fds[0], FIONREAD, &avail), "FIONREAD");
+		usleep(1000);
+	}
+	close(fds[0]);
+	T_ASSERT_POSIX_ZERO(pthread_join(thread, NULL), "pthread_join");
+
+	T_ASSERT_EQ(wa.written, -1L, "write failed");
+	T_ASSERT_EQ(wa.error, EPIPE, "with EPIPE");
+
+	close(fds[1]);
+	free(buf);
+}
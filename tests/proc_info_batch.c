@@ -0,0 +1,49 @@
+#include <darwintest.h>
+#include <errno.h>
+#include <libproc.h>
+#include <libproc_internal.h>
+#include <string.h>
+#include <sys/proc_info.h>
+#include <unistd.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.proc_info"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("bsd"),
+	T_META_RUN_CONCURRENTLY(true));
+
+T_DECL(proc_pidinfo_batch, "proc_pidinfo_batch() matches individual proc_pidinfo() calls")
+{
+	struct proc_pidinfo_batch_entry entries[3] = {
+		{ .pbe_pid = getpid(), .pbe_flavor = PROC_PIDTBSDINFO, .pbe_size = PROC_PIDTBSDINFO_SIZE },
+		{ .pbe_pid = -1, .pbe_flavor = PROC_PIDTBSDINFO, .pbe_size = PROC_PIDTBSDINFO_SIZE },
+		{ .pbe_pid = getpid(), .pbe_flavor = PROC_PIDTASKINFO, .pbe_size = PROC_PIDTASKINFO_SIZE },
+	};
+	char buffer[PROC_PIDTBSDINFO_SIZE * 2 + PROC_PIDTASKINFO_SIZE];
+	struct proc_bsdinfo bsdinfo;
+	struct proc_bsdinfo *batch_bsdinfo;
+	int ret;
+
+	ret = proc_pidinfo(getpid(), PROC_PIDTBSDINFO, 0, &bsdinfo, sizeof(bsdinfo));
+	T_ASSERT_EQ(ret, (int)sizeof(bsdinfo), "proc_pidinfo(PROC_PIDTBSDINFO)");
+
+	ret = proc_pidinfo_batch(entries, 3, buffer, sizeof(buffer));
+	T_ASSERT_POSIX_SUCCESS(ret, "proc_pidinfo_batch");
+	T_EXPECT_GT(ret, 0, "batch returned data");
+
+	T_EXPECT_EQ(entries[0].pbe_error, 0, "own bsdinfo succeeded");
+	T_EXPECT_EQ(entries[0].pbe_retval, (int)sizeof(bsdinfo), "own bsdinfo size");
+	batch_bsdinfo = (struct proc_bsdinfo *)(void *)(buffer + entries[0].pbe_offset);
+	T_EXPECT_EQ(batch_bsdinfo->pbi_pid, bsdinfo.pbi_pid, "pid matches");
+	T_EXPECT_EQ_STR(batch_bsdinfo->pbi_comm, bsdinfo.pbi_comm, "command matches");
+
+	T_EXPECT_NE(entries[1].pbe_error, 0, "bogus pid reported its own error");
+
+	T_EXPECT_EQ(entries[2].pbe_error, 0, "own taskinfo succeeded");
+	T_EXPECT_EQ(entries[2].pbe_retval, (int)PROC_PIDTASKINFO_SIZE, "own taskinfo size");
+	T_EXPECT_EQ(entries[2].pbe_offset % sizeof(uint64_t), 0U, "results are aligned");
+
+	ret = proc_pidinfo_batch(entries, 0, buffer, sizeof(buffer));
+	T_EXPECT_EQ(ret, -1, "empty batch is rejected");
+	T_EXPECT_EQ(errno, EINVAL, "empty batch sets EINVAL");
+}
@@ -14,6 +14,8 @@
     T_META_REQUIRES_SYSCTL_EQ("kern.monotonic.supported", 1)
 #define REQUIRE_RECOUNT_ENERGY \
     T_META_REQUIRES_SYSTCL_EQ("kern.pervasive_energy", 1)
+#define REQUIRE_RECOUNT_MEMBW \
+    T_META_REQUIRES_SYSCTL_EQ("kern.pervasive_membw", 1)
 #define REQUIRE_MULTIPLE_PERF_LEVELS \
     T_META_REQUIRES_SYSCTL_NE("hw.nperflevels", 1)
 #define SET_THREAD_BIND_BOOTARG \
@@ -4,6 +4,8 @@
 #include <darwintest_posix.h>
 #include <libproc.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <unistd.h>
 
@@ -49,3 +51,36 @@ T_DECL(rusage_user_time_sanity,
 		    "system time should be non-zero");
 	}
 }
+
+T_DECL(rusage_memory_traffic_sanity,
+    "ensure memory traffic is charged to a task streaming through memory",
+    REQUIRE_RECOUNT_MEMBW)
+{
+	// Much larger than any last-level cache, so each pass misses.
+	const size_t size = 256 * 1024 * 1024;
+	struct rusage_info_v6 before = { 0 };
+	struct rusage_info_v6 after = { 0 };
+
+	T_SETUPBEGIN;
+	char *buf = malloc(size);
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	memset(buf, 1, size);
+	int ret = proc_pid_rusage(getpid(), RUSAGE_INFO_V6, (void *)&before);
+	T_ASSERT_POSIX_SUCCESS(ret, "proc_pid_rusage on self");
+	T_SETUPEND;
+
+	volatile uint64_t sum = 0;
+	for (int i = 0; i < 4; i++) {
+		for (size_t j = 0; j < size; j += 64) {
+			sum += (uint64_t)buf[j];
+		}
+	}
+
+	ret = proc_pid_rusage(getpid(), RUSAGE_INFO_V6, (void *)&after);
+	T_ASSERT_POSIX_SUCCESS(ret, "proc_pid_rusage on self");
+	T_LOG("memory traffic: %llu bytes",
+	    after.ri_memory_bytes - before.ri_memory_bytes);
+	T_EXPECT_GT(after.ri_memory_bytes, before.ri_memory_bytes,
+	    "memory traffic should be charged to the task");
+	free(buf);
+}
@@ -0,0 +1,63 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/sysctl.h>
+
+#include <darwintest.h>
+
+T_GLOBAL_META(T_META_RADAR_COMPONENT_NAME("xnu"),
+    T_META_RADAR_COMPONENT_VERSION("scheduler"),
+    T_META_CHECK_LEAKS(false));
+
+/* Must match struct thread_group_cpu_bandwidth in bsd/kern/kern_sysctl.c */
+struct tg_cpu_bandwidth {
+	uint64_t tg_id;
+	uint32_t quota_us;
+	uint32_t period_us;
+	uint64_t throttled_periods;
+};
+
+static int
+cpu_bandwidth(struct tg_cpu_bandwidth *bw, size_t inlen)
+{
+	size_t size = sizeof(*bw);
+	int ret;
+
+	ret = sysctlbyname("kern.thread_group_cpu_bandwidth", bw, &size, bw, inlen);
+	if (ret != 0 && errno == ENOENT) {
+		T_SKIP("kern.thread_group_cpu_bandwidth not supported");
+	}
+	return ret;
+}
+
+T_DECL(sched_clutch_cpu_bandwidth_read,
+    "the caller's thread group has no CPU bandwidth limit by default")
+{
+	struct tg_cpu_bandwidth bw = { .tg_id = 0 };
+
+	T_ASSERT_POSIX_SUCCESS(cpu_bandwidth(&bw, sizeof(bw.tg_id)),
+	    "read the caller's thread group limit");
+	T_EXPECT_EQ(bw.period_us, 0, "no period");
+	T_EXPECT_EQ(bw.quota_us, 0, "no quota");
+}
+
+T_DECL(sched_clutch_cpu_bandwidth_invalid,
+    "invalid CPU bandwidth limits are rejected", T_META_ASROOT(true))
+{
+	struct tg_cpu_bandwidth bw = {
+		.tg_id = 0,
+		.quota_us = 20000,
+		.period_us = 10000,
+	};
+
+	T_ASSERT_POSIX_FAILURE(cpu_bandwidth(&bw,
+	    offsetof(struct tg_cpu_bandwidth, throttled_periods)),
+	    EINVAL, "quota larger than the period");
+
+	bw.tg_id = UINT64_MAX;
+	bw.quota_us = 5000;
+	T_ASSERT_POSIX_FAILURE(cpu_bandwidth(&bw,
+	    offsetof(struct tg_cpu_bandwidth, throttled_periods)),
+	    ESRCH, "bogus thread group id");
+}
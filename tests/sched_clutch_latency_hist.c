@@ -0,0 +1,76 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/sysctl.h>
+
+#include <darwintest.h>
+
+T_GLOBAL_META(T_META_RADAR_COMPONENT_NAME("xnu"),
+    T_META_RADAR_COMPONENT_VERSION("scheduler"),
+    T_META_CHECK_LEAKS(false));
+
+/* Must match TH_BUCKET_SCHED_MAX and SCHED_CLUTCH_LATENCY_BINS */
+#define LATENCY_BUCKETS 6
+#define LATENCY_BINS    16
+
+static uint64_t
+latency_samples(void)
+{
+	uint32_t hist[LATENCY_BUCKETS * LATENCY_BINS];
+	size_t size = sizeof(hist);
+	uint64_t total = 0;
+	int ret;
+
+	ret = sysctlbyname("kern.thread_group_sched_latency", hist, &size, NULL, 0);
+	if (ret != 0 && errno == ENOENT) {
+		T_SKIP("kern.thread_group_sched_latency not supported");
+	}
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(ret, "kern.thread_group_sched_latency");
+	T_QUIET; T_ASSERT_EQ(size, sizeof(hist), "histogram size");
+
+	for (int i = 0; i < LATENCY_BUCKETS * LATENCY_BINS; i++) {
+		total += hist[i];
+	}
+	return total;
+}
+
+static void *
+sleeper(void *arg)
+{
+	(void)arg;
+	for (int i = 0; i < 100; i++) {
+		usleep(100);
+	}
+	return NULL;
+}
+
+T_DECL(sched_clutch_latency_hist,
+    "the caller's thread group accumulates scheduling latency samples")
+{
+	pthread_t threads[4];
+	uint64_t before, after;
+
+	before = latency_samples();
+
+	for (int i = 0; i < 4; i++) {
+		T_QUIET; T_ASSERT_POSIX_ZERO(pthread_create(&threads[i], NULL, sleeper, NULL), "pthread_create");
+	}
+	for (int i = 0; i < 4; i++) {
+		T_QUIET; T_ASSERT_POSIX_ZERO(pthread_join(threads[i], NULL), "pthread_join");
+	}
+
+	after = latency_samples();
+	T_EXPECT_GT(after, before, "wakeups were sampled (%llu -> %llu)", before, after);
+}
+
+T_DECL(sched_clutch_latency_hist_other_group,
+    "an unknown thread group id is rejected")
+{
+	uint32_t hist[LATENCY_BUCKETS * LATENCY_BINS];
+	size_t size = sizeof(hist);
+	uint64_t tg_id = UINT64_MAX;
+
+	T_ASSERT_POSIX_FAILURE(sysctlbyname("kern.thread_group_sched_latency", hist, &size,
+	    &tg_id, sizeof(tg_id)), geteuid() == 0 ? ESRCH : EPERM, "bogus thread group id");
+}
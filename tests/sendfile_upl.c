@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * sendfile_upl.c
+ * - sendfile of a cached file over loopback, with and without
+ *   kern.ipc.sendfile_upl, reporting MB per CPU second and checking that
+ *   the peer receives the file contents
+ * - writes to a file that was sent to a peer that stopped reading must
+ *   not wait for that peer
+ */
+
+#include <darwintest.h>
+#include <darwintest_perf.h>
+#include <darwintest_utils.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/param.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <sys/uio.h>
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_ASROOT(true),
+    T_META_TAG_PERF,
+    T_META_RUN_CONCURRENTLY(false));
+
+#define FILE_SIZE       (64 * 1024 * 1024)
+#define FILE_ROUNDS     8
+#define TRANSFER_ROUNDS 5
+
+static int S_upl_saved = -1;
+
+struct receiver_args {
+	int     fd;
+	size_t  total;
+	size_t  mismatches;
+};
+
+static uint8_t
+pattern(size_t off)
+{
+	return (uint8_t)((off >> 12) ^ off);
+}
+
+static void *
+receiver(void *arg)
+{
+	struct receiver_args *ra = arg;
+	static uint8_t buf[128 * 1024];
+	ssize_t n;
+
+	while ((n = read(ra->fd, buf, sizeof(buf))) > 0) {
+		for (ssize_t i = 0; i < n; i += 4096) {
+			size_t off = (ra->total + (size_t)i) % FILE_SIZE;
+			if (buf[i] != pattern(off)) {
+				ra->mismatches++;
+			}
+		}
+		ra->total += (size_t)n;
+	}
+	return NULL;
+}
+
+static double
+cpu_seconds(void)
+{
+	struct rusage ru;
+
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(getrusage(RUSAGE_SELF, &ru), "getrusage");
+	return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+	       (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/* returns MB sent per CPU second, sender and receiver together */
+static double
+transfer_once(int filefd)
+{
+	struct sockaddr_in      sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t               slen = sizeof(sin);
+	struct receiver_args    ra = {};
+	pthread_t               thread;
+	double                  cpu;
+	int                     listener, client;
+
+	listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(listener, "socket");
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(bind(listener, (struct sockaddr *)&sin,
+	    sizeof(sin)), "bind");
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(getsockname(listener, (struct sockaddr *)&sin,
+	    &slen), "getsockname");
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(listen(listener, 1), "listen");
+	client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(connect(client, (struct sockaddr *)&sin,
+	    sizeof(sin)), "connect");
+	ra.fd = accept(listener, NULL, NULL);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(ra.fd, "accept");
+	close(listener);
+
+	cpu = cpu_seconds();
+	T_QUIET;
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, receiver, &ra),
+	    "pthread_create");
+	for (int i = 0; i < FILE_ROUNDS; i++) {
+		off_t len = 0;
+
+		T_QUIET;
+		T_ASSERT_POSIX_SUCCESS(sendfile(filefd, client, 0, &len, NULL, 0),
+		    "sendfile");
+		T_QUIET;
+		T_ASSERT_EQ_LLONG((long long)len, (long long)FILE_SIZE,
+		    "sent the whole file");
+	}
+	close(client);
+	pthread_join(thread, NULL);
+	cpu = cpu_seconds() - cpu;
+	close(ra.fd);
+
+	T_QUIET;
+	T_ASSERT_EQ_ULONG(ra.total, (size_t)FILE_SIZE * FILE_ROUNDS,
+	    "received everything");
+	T_QUIET;
+	T_ASSERT_EQ_ULONG(ra.mismatches, 0UL, "received the file contents");
+	return (double)ra.total / (1024 * 1024) / cpu;
+}
+
+static void
+cleanup(void)
+{
+	if (S_upl_saved != -1) {
+		(void)sysctlbyname("kern.ipc.sendfile_upl", NULL, NULL,
+		    &S_upl_saved, sizeof(S_upl_saved));
+	}
+}
+
+T_DECL(sendfile_upl_perf,
+    "sendfile of a cached file with and without the page cache copy")
+{
+	char            path[MAXPATHLEN];
+	static uint8_t  buf[1024 * 1024];
+	size_t          len = sizeof(S_upl_saved);
+	int             fd;
+
+	if (sysctlbyname("kern.ipc.sendfile_upl", &S_upl_saved, &len,
+	    NULL, 0) != 0) {
+		T_SKIP("kern.ipc.sendfile_upl not available");
+	}
+	T_ATEND(cleanup);
+
+	snprintf(path, sizeof(path), "%s/sendfile_upl.XXXXXX", dt_tmpdir());
+	fd = mkstemp(path);
+	T_ASSERT_POSIX_SUCCESS(fd, "mkstemp %s", path);
+	unlink(path);
+	for (size_t off = 0; off < FILE_SIZE; off += sizeof(buf)) {
+		for (size_t i = 0; i < sizeof(buf); i++) {
+			buf[i] = pattern(off + i);
+		}
+		T_QUIET;
+		T_ASSERT_EQ_LONG(write(fd, buf, sizeof(buf)), (long)sizeof(buf),
+		    "write");
+	}
+	/* Pull everything into the page cache before measuring */
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(fsync(fd), "fsync");
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(lseek(fd, 0, SEEK_SET), "lseek");
+	while (read(fd, buf, sizeof(buf)) > 0) {
+		;
+	}
+
+	for (int upl = 0; upl <= 1; upl++) {
+		dt_stat_t rate = dt_stat_create("MB/cpu-s", "sendfile_upl_%d",
+		    upl);
+
+		T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.ipc.sendfile_upl",
+		    NULL, NULL, &upl, sizeof(upl)),
+		    "kern.ipc.sendfile_upl=%d", upl);
+		for (int i = 0; i < TRANSFER_ROUNDS; i++) {
+			dt_stat_add(rate, transfer_once(fd));
+		}
+		dt_stat_finalize(rate);
+	}
+	close(fd);
+}
+
+T_DECL(sendfile_upl_stalled_peer,
+    "writing a file does not wait on a sendfile peer that stopped reading",
+    T_META_TIMEOUT(60))
+{
+	struct sockaddr_in      sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t               slen = sizeof(sin);
+	char                    path[MAXPATHLEN];
+	static uint8_t          buf[1024 * 1024];
+	off_t                   sent = 0;
+	int                     fd, listener, client, peer;
+
+	for (size_t i = 0; i < sizeof(buf); i++) {
+		buf[i] = pattern(i);
+	}
+	snprintf(path, sizeof(path), "%s/sendfile_upl.XXXXXX", dt_tmpdir());
+	fd = mkstemp(path);
+	T_ASSERT_POSIX_SUCCESS(fd, "mkstemp %s", path);
+	unlink(path);
+	T_ASSERT_EQ_LONG(write(fd, buf, sizeof(buf)), (long)sizeof(buf), "write");
+	T_ASSERT_POSIX_SUCCESS(fsync(fd), "fsync");
+
+	listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(listener, "socket");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bind(listener, (struct sockaddr *)&sin,
+	    sizeof(sin)), "bind");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockname(listener,
+	    (struct sockaddr *)&sin, &slen), "getsockname");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(listen(listener, 1), "listen");
+	client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(connect(client, (struct sockaddr *)&sin,
+	    sizeof(sin)), "connect");
+	peer = accept(listener, NULL, NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(peer, "accept");
+	close(listener);
+
+	/* fill the socket buffers: the peer never reads */
+	T_ASSERT_POSIX_SUCCESS(fcntl(client, F_SETFL, O_NONBLOCK), "O_NONBLOCK");
+	for (;;) {
+		off_t len = 0;
+
+		if (sendfile(fd, client, sent % (off_t)sizeof(buf), &len, NULL, 0) != 0) {
+			T_QUIET; T_ASSERT_EQ(errno, EAGAIN, "sendfile");
+			sent += len;
+			if (len == 0) {
+				break;
+			}
+			continue;
+		}
+		sent += len;
+	}
+	T_LOG("%lld bytes in flight to a peer that doesn't read", (long long)sent);
+
+	memset(buf, 0xa5, sizeof(buf));
+	T_ASSERT_EQ_LONG(pwrite(fd, buf, sizeof(buf), 0), (long)sizeof(buf),
+	    "overwrite the file being sent");
+	T_ASSERT_POSIX_SUCCESS(fsync(fd), "fsync the file being sent");
+
+	close(client);
+	close(peer);
+	close(fd);
+}
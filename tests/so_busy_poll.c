@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * so_busy_poll.c
+ * - SO_BUSY_POLL is clamped to kern.ipc.busy_poll_max_usec, rejects
+ *   negative budgets and does not get in the way of a blocking read
+ * - blocking reads on busy-polling TCP and UDP sockets go through the
+ *   inet poll path and still return the data sent, whether or not the
+ *   interface can be polled
+ */
+
+#define PRIVATE 1
+
+#include <darwintest.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_RUN_CONCURRENTLY(true));
+
+static void *
+delayed_writer(void *arg)
+{
+	int fd = *(int *)arg;
+
+	usleep(50 * 1000);
+	T_QUIET;
+	T_ASSERT_EQ_LONG(write(fd, "x", 1), 1L, "write");
+	return NULL;
+}
+
+T_DECL(so_busy_poll_option, "SO_BUSY_POLL get/set and blocking reads")
+{
+	unsigned int    max;
+	size_t          len = sizeof(max);
+	socklen_t       olen;
+	pthread_t       thread;
+	char            c;
+	int             sv[2], val;
+
+	if (sysctlbyname("kern.ipc.busy_poll_max_usec", &max, &len,
+	    NULL, 0) != 0) {
+		T_SKIP("kern.ipc.busy_poll_max_usec not available");
+	}
+	T_ASSERT_POSIX_SUCCESS(socketpair(AF_UNIX, SOCK_STREAM, 0, sv),
+	    "socketpair");
+
+	val = -1;
+	T_EXPECT_POSIX_FAILURE(setsockopt(sv[0], SOL_SOCKET, SO_BUSY_POLL,
+	    &val, sizeof(val)), EINVAL, "negative budget");
+
+	val = (int)max + 1;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(sv[0], SOL_SOCKET, SO_BUSY_POLL,
+	    &val, sizeof(val)), "SO_BUSY_POLL %d", val);
+	olen = sizeof(val);
+	T_ASSERT_POSIX_SUCCESS(getsockopt(sv[0], SOL_SOCKET, SO_BUSY_POLL,
+	    &val, &olen), "getsockopt SO_BUSY_POLL");
+	T_EXPECT_EQ_UINT((unsigned int)val, max, "budget clamped to the max");
+
+	/* Not an inet socket: the read just sleeps as usual */
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, delayed_writer,
+	    &sv[1]), "pthread_create");
+	T_EXPECT_EQ_LONG(read(sv[0], &c, 1), 1L, "blocking read completes");
+	pthread_join(thread, NULL);
+
+	close(sv[0]);
+	close(sv[1]);
+}
+
+#define ROUNDS  200
+
+static void
+set_busy_poll(int fd, int usecs)
+{
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+	    &usecs, sizeof(usecs)), "SO_BUSY_POLL %d", usecs);
+}
+
+static uint64_t
+busy_poll_count(const char *name)
+{
+	uint64_t        val = 0;
+	size_t          len = sizeof(val);
+
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, &val, &len, NULL, 0), "%s", name);
+	return val;
+}
+
+/*
+ * Each round the peer answers only after a delay, so the reader finds its
+ * receive buffer empty and goes through sobusypoll() before sleeping.
+ */
+static void
+busy_poll_ping_pong(int rd, int wr)
+{
+	pthread_t       thread;
+	char            c;
+
+	for (int i = 0; i < ROUNDS; i++) {
+		T_QUIET;
+		T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, delayed_writer,
+		    &wr), "pthread_create");
+		T_QUIET;
+		T_ASSERT_EQ_LONG(read(rd, &c, 1), 1L, "blocking read completes");
+		T_QUIET;
+		T_ASSERT_EQ(c, 'x', "data intact");
+		pthread_join(thread, NULL);
+	}
+}
+
+static void
+inet_pair(int type, int *rd, int *wr)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(sin);
+	int lfd;
+
+	T_ASSERT_POSIX_SUCCESS(lfd = socket(AF_INET, type, 0), "socket");
+	T_ASSERT_POSIX_SUCCESS(bind(lfd, (struct sockaddr *)&sin, sizeof(sin)),
+	    "bind");
+	T_ASSERT_POSIX_SUCCESS(getsockname(lfd, (struct sockaddr *)&sin, &len),
+	    "getsockname");
+	T_ASSERT_POSIX_SUCCESS(*wr = socket(AF_INET, type, 0), "socket");
+
+	if (type == SOCK_STREAM) {
+		T_ASSERT_POSIX_SUCCESS(listen(lfd, 1), "listen");
+		T_ASSERT_POSIX_SUCCESS(connect(*wr, (struct sockaddr *)&sin,
+		    sizeof(sin)), "connect");
+		T_ASSERT_POSIX_SUCCESS(*rd = accept(lfd, NULL, NULL), "accept");
+		close(lfd);
+	} else {
+		T_ASSERT_POSIX_SUCCESS(connect(*wr, (struct sockaddr *)&sin,
+		    sizeof(sin)), "connect");
+		len = sizeof(sin);
+		T_ASSERT_POSIX_SUCCESS(getsockname(*wr, (struct sockaddr *)&sin,
+		    &len), "getsockname");
+		T_ASSERT_POSIX_SUCCESS(connect(lfd, (struct sockaddr *)&sin,
+		    sizeof(sin)), "connect");
+		*rd = lfd;
+	}
+}
+
+T_DECL(so_busy_poll_inet, "blocking reads on busy-polling inet sockets")
+{
+	uint64_t        polls;
+	unsigned int    max;
+	size_t          len = sizeof(max);
+	int             types[] = { SOCK_STREAM, SOCK_DGRAM };
+
+	if (sysctlbyname("kern.ipc.busy_poll_max_usec", &max, &len,
+	    NULL, 0) != 0) {
+		T_SKIP("kern.ipc.busy_poll_max_usec not available");
+	}
+	if (max == 0) {
+		T_SKIP("busy polling disabled");
+	}
+
+	polls = busy_poll_count("kern.ipc.busy_poll_hits") +
+	    busy_poll_count("kern.ipc.busy_poll_timeouts");
+
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		int rd, wr;
+
+		inet_pair(types[i], &rd, &wr);
+		/* the reader has to have sent for inp_last_outifp to be set */
+		T_ASSERT_EQ_LONG(write(rd, "y", 1), 1L, "reader sends first");
+		set_busy_poll(rd, (int)MIN(max, 100));
+
+		busy_poll_ping_pong(rd, wr);
+		T_PASS("%s: %d busy-polled blocking reads completed",
+		    types[i] == SOCK_STREAM ? "TCP" : "UDP", ROUNDS);
+
+		close(rd);
+		close(wr);
+	}
+
+	/*
+	 * lo0 is not rxpoll capable, so the reads above skip the poll and
+	 * sleep; the counters only move when the route goes over an
+	 * interface in polling mode.
+	 */
+	T_LOG("busy polls on this system so far: %llu -> %llu",
+	    polls, busy_poll_count("kern.ipc.busy_poll_hits") +
+	    busy_poll_count("kern.ipc.busy_poll_timeouts"));
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * so_recv_batch_fault.c
+ * - a stream read that faults part way through its buffer keeps the
+ *   data it didn't copy out on the socket, so the next read continues
+ *   right after the last byte that made it
+ */
+
+#include <darwintest.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_RUN_CONCURRENTLY(true));
+
+#define TOTAL_WORDS     (64 * 1024 / sizeof(uint32_t))
+#define GOOD_BYTES      (16 * 1024)
+
+static void
+tcp_pair(int *rd, int *wr)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(sin);
+	int lfd;
+
+	T_ASSERT_POSIX_SUCCESS(lfd = socket(AF_INET, SOCK_STREAM, 0), "socket");
+	T_ASSERT_POSIX_SUCCESS(bind(lfd, (struct sockaddr *)&sin, sizeof(sin)),
+	    "bind");
+	T_ASSERT_POSIX_SUCCESS(getsockname(lfd, (struct sockaddr *)&sin, &len),
+	    "getsockname");
+	T_ASSERT_POSIX_SUCCESS(listen(lfd, 1), "listen");
+	T_ASSERT_POSIX_SUCCESS(*wr = socket(AF_INET, SOCK_STREAM, 0), "socket");
+	T_ASSERT_POSIX_SUCCESS(connect(*wr, (struct sockaddr *)&sin, sizeof(sin)),
+	    "connect");
+	T_ASSERT_POSIX_SUCCESS(*rd = accept(lfd, NULL, NULL), "accept");
+	close(lfd);
+}
+
+T_DECL(so_recv_batch_fault,
+    "a faulting stream read doesn't drop the data it couldn't copy out")
+{
+	uint32_t *words = malloc(TOTAL_WORDS * sizeof(uint32_t));
+	uint32_t *good = malloc(GOOD_BYTES);
+	size_t pgsz = (size_t)getpagesize(), bad_len = 16 * pgsz;
+	size_t got = 0;
+	struct iovec iov[2];
+	void *bad;
+	int rd, wr, avail = 0;
+
+	T_QUIET; T_ASSERT_NOTNULL(words, "malloc");
+	T_QUIET; T_ASSERT_NOTNULL(good, "malloc");
+	for (uint32_t i = 0; i < TOTAL_WORDS; i++) {
+		words[i] = i;
+	}
+	bad = mmap(NULL, bad_len, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	T_ASSERT_NE(bad, MAP_FAILED, "mmap PROT_NONE");
+
+	tcp_pair(&rd, &wr);
+	T_ASSERT_EQ_LONG(write(wr, words, TOTAL_WORDS * sizeof(uint32_t)),
+	    (long)(TOTAL_WORDS * sizeof(uint32_t)), "write");
+	while ((size_t)avail < TOTAL_WORDS * sizeof(uint32_t)) {
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(ioctl(rd, FIONREAD, &avail), "FIONREAD");
+		usleep(1000);
+	}
+
+	/* the first iovec copies out, the second one faults */
+	iov[0] = (struct iovec){ good, GOOD_BYTES };
+	iov[1] = (struct iovec){ bad, bad_len };
+	T_EXPECT_POSIX_FAILURE(readv(rd, iov, 2), EFAULT, "readv into a PROT_NONE buffer");
+	for (uint32_t i = 0; i < GOOD_BYTES / sizeof(uint32_t); i++) {
+		T_QUIET; T_ASSERT_EQ(good[i], i, "data before the fault");
+	}
+
+	/* everything past what was copied is still there, in order */
+	while (got < TOTAL_WORDS * sizeof(uint32_t) - GOOD_BYTES) {
+		ssize_t n = read(rd, (char *)words + got,
+		    TOTAL_WORDS * sizeof(uint32_t) - GOOD_BYTES - got);
+
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "read");
+		T_QUIET; T_ASSERT_GT(n, 0L, "no early EOF");
+		got += (size_t)n;
+	}
+	for (uint32_t i = 0; i < got / sizeof(uint32_t); i++) {
+		T_QUIET; T_ASSERT_EQ(words[i], (uint32_t)(GOOD_BYTES / sizeof(uint32_t) + i),
+		    "data after the fault");
+	}
+	T_PASS("%zu bytes after the fault read back intact", got);
+
+	munmap(bad, bad_len);
+	close(rd);
+	close(wr);
+	free(good);
+	free(words);
+}
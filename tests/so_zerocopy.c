@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * so_zerocopy.c
+ * - TCP sends over loopback with SO_ZEROCOPY: the data arrives intact even
+ *   when the sender overwrites its buffer right after each write, and every
+ *   byte sent without copying is eventually reported as completed
+ */
+
+#define PRIVATE 1
+
+#include <darwintest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_RUN_CONCURRENTLY(true));
+
+#define CHUNK_SIZE      (256 * 1024)
+#define CHUNK_COUNT     64
+
+struct receiver_args {
+	int     fd;
+	size_t  bad_chunks;
+};
+
+static void *
+receiver(void *arg)
+{
+	struct receiver_args *ra = arg;
+	uint8_t *buf = malloc(CHUNK_SIZE);
+
+	T_QUIET;
+	T_ASSERT_NOTNULL(buf, "malloc");
+	for (int i = 0; i < CHUNK_COUNT; i++) {
+		size_t got = 0;
+
+		while (got < CHUNK_SIZE) {
+			ssize_t n = read(ra->fd, buf + got, CHUNK_SIZE - got);
+			T_QUIET;
+			T_ASSERT_GT_LONG(n, 0L, "read");
+			got += (size_t)n;
+		}
+		for (size_t j = 0; j < CHUNK_SIZE; j++) {
+			if (buf[j] != (uint8_t)i) {
+				ra->bad_chunks++;
+				break;
+			}
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+T_DECL(so_zerocopy_integrity,
+    "SO_ZEROCOPY sends survive the sender reusing its buffer")
+{
+	struct sockaddr_in      sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t               slen = sizeof(sin);
+	struct receiver_args    ra = {};
+	struct so_zerocopy_stat zcs;
+	pthread_t               thread;
+	uint8_t                 *buf;
+	int                     listener, client, on = 1;
+
+	listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	T_ASSERT_POSIX_SUCCESS(listener, "socket");
+	T_ASSERT_POSIX_SUCCESS(bind(listener, (struct sockaddr *)&sin,
+	    sizeof(sin)), "bind");
+	T_ASSERT_POSIX_SUCCESS(getsockname(listener, (struct sockaddr *)&sin,
+	    &slen), "getsockname");
+	T_ASSERT_POSIX_SUCCESS(listen(listener, 1), "listen");
+
+	client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	T_ASSERT_POSIX_SUCCESS(client, "socket");
+	if (setsockopt(client, SOL_SOCKET, SO_ZEROCOPY, &on,
+	    sizeof(on)) != 0) {
+		T_SKIP("SO_ZEROCOPY not supported (%d)", errno);
+	}
+	T_ASSERT_POSIX_SUCCESS(connect(client, (struct sockaddr *)&sin,
+	    sizeof(sin)), "connect");
+	ra.fd = accept(listener, NULL, NULL);
+	T_ASSERT_POSIX_SUCCESS(ra.fd, "accept");
+	close(listener);
+
+	buf = mmap(NULL, CHUNK_SIZE, PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_PRIVATE, -1, 0);
+	T_ASSERT_NE_PTR((void *)buf, MAP_FAILED, "mmap");
+
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, receiver, &ra),
+	    "pthread_create");
+	for (int i = 0; i < CHUNK_COUNT; i++) {
+		size_t sent = 0;
+
+		/* Overwrite what the previous write may still be sending */
+		memset(buf, i, CHUNK_SIZE);
+		while (sent < CHUNK_SIZE) {
+			ssize_t n = write(client, buf + sent, CHUNK_SIZE - sent);
+			T_QUIET;
+			T_ASSERT_POSIX_SUCCESS(n, "write");
+			sent += (size_t)n;
+		}
+	}
+	pthread_join(thread, NULL);
+	T_EXPECT_EQ_ULONG(ra.bad_chunks, 0UL, "received data is intact");
+
+	/* Everything has been read, hence acknowledged and released */
+	for (int tries = 0; tries < 100; tries++) {
+		slen = sizeof(zcs);
+		T_QUIET;
+		T_ASSERT_POSIX_SUCCESS(getsockopt(client, SOL_SOCKET,
+		    SO_ZEROCOPY_STAT, &zcs, &slen), "SO_ZEROCOPY_STAT");
+		if (zcs.zcs_completed == zcs.zcs_sent) {
+			break;
+		}
+		usleep(10 * 1000);
+	}
+	T_LOG("%llu bytes sent without copying, %llu completed",
+	    zcs.zcs_sent, zcs.zcs_completed);
+	T_EXPECT_EQ_ULLONG(zcs.zcs_completed, zcs.zcs_sent,
+	    "all zero-copy sends completed");
+
+	munmap(buf, CHUNK_SIZE);
+	close(client);
+	close(ra.fd);
+}
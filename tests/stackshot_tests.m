@@ -431,6 +431,59 @@ T_DECL(delta, "test delta stackshots")
 	});
 }
 
+static stackshot_ring_record_t *
+ring_capture(stackshot_config_t *config, uint64_t flags)
+{
+	stackshot_ring_header_t *ring;
+	stackshot_ring_record_t *record;
+	int ret;
+
+	T_QUIET; T_ASSERT_POSIX_ZERO(stackshot_config_set_flags(config, flags), "set flags");
+	do {
+		ret = stackshot_capture_with_config(config);
+	} while (ret == EBUSY || ret == ETIMEDOUT);
+	T_ASSERT_POSIX_ZERO(ret, "captured stackshot into the ring");
+
+	ring = stackshot_config_get_stackshot_buffer(config);
+	T_QUIET; T_ASSERT_NOTNULL(ring, "ring is mapped");
+	T_QUIET; T_ASSERT_EQ(ring->ssr_magic, STACKSHOT_RING_MAGIC, "ring magic");
+
+	record = (stackshot_ring_record_t *)((uintptr_t)(ring + 1) + (ring->ssr_last % ring->ssr_size));
+	T_QUIET; T_ASSERT_EQ(record->ssrr_generation, ring->ssr_generation, "newest record generation");
+	T_QUIET; T_ASSERT_EQ(ring->ssr_head - ring->ssr_last,
+	    (uint64_t)((sizeof(*record) + record->ssrr_size + STACKSHOT_RING_ALIGN - 1) & ~(STACKSHOT_RING_ALIGN - 1)),
+	    "newest record ends at the head");
+	return record;
+}
+
+T_DECL(delta_ring, "test stackshots appended to the shared ring")
+{
+	uint64_t flags = STACKSHOT_KCDATA_FORMAT | STACKSHOT_THREAD_WAITINFO | STACKSHOT_DELTA_RING;
+	stackshot_config_t *config = stackshot_config_create();
+	stackshot_ring_record_t *record;
+	void *ring;
+	uint32_t full_size;
+	uint64_t gen;
+
+	T_QUIET; T_ASSERT_NOTNULL(config, "created stackshot config");
+
+	record = ring_capture(config, flags);
+	ring = stackshot_config_get_stackshot_buffer(config);
+	full_size = record->ssrr_size;
+	gen = record->ssrr_generation;
+	parse_stackshot(0, record + 1, record->ssrr_size, nil);
+
+	record = ring_capture(config, flags | STACKSHOT_COLLECT_DELTA_SNAPSHOT);
+	T_EXPECT_EQ(stackshot_config_get_stackshot_buffer(config), ring, "ring mapping is reused");
+	T_EXPECT_EQ(record->ssrr_generation, gen + 1, "generation advanced");
+	T_EXPECT_LT(record->ssrr_size, full_size, "delta record only has what changed");
+
+	kcdata_iter_t iter = kcdata_iter(record + 1, record->ssrr_size);
+	T_EXPECT_EQ(kcdata_iter_type(iter), KCDATA_BUFFER_BEGIN_DELTA_STACKSHOT, "record is a delta stackshot");
+
+	T_QUIET; T_EXPECT_POSIX_ZERO(stackshot_config_dealloc(config), "deallocated stackshot config");
+}
+
 T_DECL(shared_cache_layout, "test stackshot inclusion of shared cache layout")
 {
 	struct scenario scenario = {
@@ -0,0 +1,56 @@
+#include <darwintest.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/sysctl.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.sysctl"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("sysctl"),
+	T_META_RUN_CONCURRENTLY(true));
+
+T_DECL(sysctl_batch, "batched sysctl reads match individual reads")
+{
+	int batch_mib[2] = { CTL_UNSPEC, 5 };
+	struct sysctl_batch_entry entries[3] = {
+		{ .sbe_name = { CTL_KERN, KERN_MAXPROC }, .sbe_namelen = 2, .sbe_size = sizeof(int) },
+		{ .sbe_name = { CTL_KERN, -12345 }, .sbe_namelen = 2, .sbe_size = sizeof(int) },
+		{ .sbe_name = { CTL_HW, HW_PAGESIZE }, .sbe_namelen = 2, .sbe_size = sizeof(int) },
+	};
+	union {
+		struct sysctl_batch_entry entries[3];
+		uint64_t align;
+		char bytes[sizeof(entries) + 64];
+	} buffer;
+	size_t len = sizeof(buffer);
+	struct sysctl_batch_entry *out = buffer.entries;
+	int maxproc, pagesize, value;
+	size_t size;
+
+	size = sizeof(maxproc);
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.maxproc", &maxproc, &size, NULL, 0), "kern.maxproc");
+	size = sizeof(pagesize);
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("hw.pagesize", &pagesize, &size, NULL, 0), "hw.pagesize");
+
+	T_ASSERT_POSIX_SUCCESS(sysctl(batch_mib, 2, &buffer, &len, entries, sizeof(entries)),
+	    "sysctl.batch");
+
+	T_EXPECT_EQ(out[0].sbe_error, 0, "kern.maxproc succeeded");
+	T_EXPECT_EQ(out[0].sbe_size, (uint32_t)sizeof(int), "kern.maxproc size");
+	memcpy(&value, buffer.bytes + out[0].sbe_offset, sizeof(value));
+	T_EXPECT_EQ(value, maxproc, "kern.maxproc matches");
+
+	T_EXPECT_NE(out[1].sbe_error, 0, "bogus OID reported its own error");
+
+	T_EXPECT_EQ(out[2].sbe_error, 0, "hw.pagesize succeeded");
+	T_EXPECT_EQ(out[2].sbe_offset % sizeof(uint64_t), 0U, "results are aligned");
+	memcpy(&value, buffer.bytes + out[2].sbe_offset, sizeof(value));
+	T_EXPECT_EQ(value, pagesize, "hw.pagesize matches");
+
+	entries[0].sbe_name[0] = CTL_UNSPEC;
+	len = sizeof(buffer);
+	T_ASSERT_POSIX_SUCCESS(sysctl(batch_mib, 2, &buffer, &len, entries, sizeof(entries)),
+	    "sysctl.batch with a meta-OID entry");
+	T_EXPECT_EQ(out[0].sbe_error, EINVAL, "meta-OID entries are rejected");
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * tcp_input_batch.c
+ * - bulk TCP receive over a pair of fake ethernet interfaces, with and
+ *   without net.inet.tcp.input_batch
+ */
+
+#include <darwintest.h>
+#include <darwintest_perf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <mach/mach_time.h>
+#include <net/if.h>
+#include <net/if_fake_var.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/sockio.h>
+#include <sys/sysctl.h>
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_ASROOT(true),
+    T_META_TAG_PERF,
+    T_META_RUN_CONCURRENTLY(false));
+
+#define FETH_SERVER             "feth810"
+#define FETH_CLIENT             "feth811"
+#define SERVER_ADDR             "10.181.0.1"
+#define CLIENT_ADDR             "10.181.0.2"
+#define SERVER_PORT             5810
+
+#define TRANSFER_SIZE           (256 * 1024 * 1024)
+#define TRANSFER_BUFSZ          (128 * 1024)
+#define TRANSFER_ROUNDS         5
+
+static int S_batch_saved = -1;
+
+static void
+ifnet_destroy(const char *ifname)
+{
+	struct ifreq    ifr;
+	int             s;
+
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s < 0) {
+		return;
+	}
+	bzero(&ifr, sizeof(ifr));
+	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	(void)ioctl(s, SIOCIFDESTROY, &ifr);
+	close(s);
+}
+
+static void
+ifnet_create_up(int s, const char *ifname, const char *addr)
+{
+	struct ifaliasreq       ifra;
+	struct ifreq            ifr;
+	struct sockaddr_in      *sin;
+
+	bzero(&ifr, sizeof(ifr));
+	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	if (ioctl(s, SIOCIFCREATE, &ifr) < 0 && errno == EEXIST) {
+		ifnet_destroy(ifname);
+		T_QUIET;
+		T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCIFCREATE, &ifr),
+		    "SIOCIFCREATE %s", ifname);
+	}
+
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCGIFFLAGS, &ifr),
+	    "SIOCGIFFLAGS %s", ifname);
+	ifr.ifr_flags |= IFF_UP;
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCSIFFLAGS, &ifr),
+	    "SIOCSIFFLAGS %s", ifname);
+
+	bzero(&ifra, sizeof(ifra));
+	strlcpy(ifra.ifra_name, ifname, sizeof(ifra.ifra_name));
+	sin = (struct sockaddr_in *)(void *)&ifra.ifra_addr;
+	sin->sin_len = sizeof(*sin);
+	sin->sin_family = AF_INET;
+	inet_pton(AF_INET, addr, &sin->sin_addr);
+	sin = (struct sockaddr_in *)(void *)&ifra.ifra_mask;
+	sin->sin_len = sizeof(*sin);
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(IN_CLASSC_NET);
+	T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCAIFADDR, &ifra),
+	    "SIOCAIFADDR %s %s", ifname, addr);
+}
+
+static void
+fake_set_peer(int s, const char *feth, const char *feth_peer)
+{
+	struct if_fake_request  iffr;
+	struct ifdrv            ifd;
+
+	bzero(&iffr, sizeof(iffr));
+	strlcpy(iffr.iffr_peer_name, feth_peer, sizeof(iffr.iffr_peer_name));
+	bzero(&ifd, sizeof(ifd));
+	strlcpy(ifd.ifd_name, feth, sizeof(ifd.ifd_name));
+	ifd.ifd_cmd = IF_FAKE_S_CMD_SET_PEER;
+	ifd.ifd_len = sizeof(iffr);
+	ifd.ifd_data = &iffr;
+	T_ASSERT_POSIX_SUCCESS(ioctl(s, SIOCSDRVSPEC, &ifd),
+	    "IF_FAKE_S_CMD_SET_PEER %s %s", feth, feth_peer);
+}
+
+static void
+cleanup(void)
+{
+	if (S_batch_saved != -1) {
+		(void)sysctlbyname("net.inet.tcp.input_batch", NULL, NULL,
+		    &S_batch_saved, sizeof(S_batch_saved));
+	}
+	ifnet_destroy(FETH_SERVER);
+	ifnet_destroy(FETH_CLIENT);
+}
+
+static uint64_t
+counter_get(const char *name)
+{
+	uint64_t        val = 0;
+	size_t          len = sizeof(val);
+
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, &val, &len, NULL, 0),
+	    "sysctl %s", name);
+	return val;
+}
+
+static int
+socket_bound(const char *ifname, const char *addr, uint16_t port)
+{
+	struct sockaddr_in      sin;
+	int                     ifindex = (int)if_nametoindex(ifname);
+	int                     s;
+
+	s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+	/* keep the traffic on the fake interfaces instead of lo0 */
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, IPPROTO_IP, IP_BOUND_IF,
+	    &ifindex, sizeof(ifindex)), "IP_BOUND_IF %s", ifname);
+	bzero(&sin, sizeof(sin));
+	sin.sin_len = sizeof(sin);
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	inet_pton(AF_INET, addr, &sin.sin_addr);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(bind(s, (struct sockaddr *)&sin, sizeof(sin)),
+	    "bind %s:%u", addr, port);
+	return s;
+}
+
+static void *
+sender(void *arg)
+{
+	int             s = *(int *)arg;
+	static char     buf[TRANSFER_BUFSZ];
+	size_t          left = TRANSFER_SIZE;
+
+	while (left > 0) {
+		ssize_t n = write(s, buf, MIN(left, sizeof(buf)));
+		if (n <= 0) {
+			break;
+		}
+		left -= (size_t)n;
+	}
+	close(s);
+	return NULL;
+}
+
+/* returns the receive rate in Mbit/s */
+static double
+transfer_once(void)
+{
+	static char             buf[TRANSFER_BUFSZ];
+	struct sockaddr_in      sin;
+	pthread_t               thread;
+	uint64_t                start, ns;
+	size_t                  total = 0;
+	ssize_t                 n;
+	int                     listener, client, server;
+	mach_timebase_info_data_t tb;
+
+	listener = socket_bound(FETH_SERVER, SERVER_ADDR, SERVER_PORT);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(listen(listener, 1), "listen");
+
+	client = socket_bound(FETH_CLIENT, CLIENT_ADDR, 0);
+	bzero(&sin, sizeof(sin));
+	sin.sin_len = sizeof(sin);
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(SERVER_PORT);
+	inet_pton(AF_INET, SERVER_ADDR, &sin.sin_addr);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(connect(client, (struct sockaddr *)&sin,
+	    sizeof(sin)), "connect");
+	server = accept(listener, NULL, NULL);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(server, "accept");
+	close(listener);
+
+	start = mach_absolute_time();
+	T_QUIET;
+	T_ASSERT_POSIX_ZERO(pthread_create(&thread, NULL, sender, &client),
+	    "pthread_create");
+	while ((n = read(server, buf, sizeof(buf))) > 0) {
+		total += (size_t)n;
+	}
+	ns = mach_absolute_time() - start;
+	mach_timebase_info(&tb);
+	ns = ns * tb.numer / tb.denom;
+	pthread_join(thread, NULL);
+	close(server);
+
+	T_QUIET;
+	T_ASSERT_EQ_ULONG(total, (size_t)TRANSFER_SIZE, "received everything");
+	return (double)total * 8 * 1000 / (double)ns;
+}
+
+T_DECL(tcp_input_batch_perf,
+    "bulk TCP receive over feth with and without batched input")
+{
+	size_t  len = sizeof(S_batch_saved);
+	int     s;
+
+	if (sysctlbyname("net.inet.tcp.input_batch", &S_batch_saved, &len,
+	    NULL, 0) != 0) {
+		T_SKIP("net.inet.tcp.input_batch not available");
+	}
+	T_ATEND(cleanup);
+
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	T_QUIET;
+	T_ASSERT_POSIX_SUCCESS(s, "socket");
+	ifnet_create_up(s, FETH_SERVER, SERVER_ADDR);
+	ifnet_create_up(s, FETH_CLIENT, CLIENT_ADDR);
+	fake_set_peer(s, FETH_SERVER, FETH_CLIENT);
+	close(s);
+
+	for (int batch = 0; batch <= 1; batch++) {
+		dt_stat_t rate = dt_stat_create("Mbps", "tcp_input_batch_%d",
+		    batch);
+		uint64_t batches, batched;
+
+		T_ASSERT_POSIX_SUCCESS(sysctlbyname("net.inet.tcp.input_batch",
+		    NULL, NULL, &batch, sizeof(batch)),
+		    "net.inet.tcp.input_batch=%d", batch);
+		batches = counter_get("net.inet.tcp.input_batches");
+		batched = counter_get("net.inet.tcp.input_batched");
+
+		for (int i = 0; i < TRANSFER_ROUNDS; i++) {
+			dt_stat_add(rate, transfer_once());
+		}
+		dt_stat_finalize(rate);
+
+		batches = counter_get("net.inet.tcp.input_batches") - batches;
+		batched = counter_get("net.inet.tcp.input_batched") - batched;
+		T_LOG("input_batch=%d: %llu runs, %llu segments", batch,
+		    batches, batched);
+		if (batch == 0) {
+			T_EXPECT_EQ_ULLONG(batches, 0ULL,
+			    "no runs with batching disabled");
+		}
+	}
+}
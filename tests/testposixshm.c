@@ -3,6 +3,7 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/sysctl.h>
 #include <stdatomic.h>
 #include <TargetConditionals.h>
@@ -218,3 +219,44 @@ T_DECL(testposixshm, "Posix Shared Memory tests")
 	T_EXPECT_EQ(pass_count, 1, "racing shm_unlink()");
 	T_EXPECT_EQ(fail_count, nthreads - 1, "racing shm_unlink()");
 }
+
+#ifndef O_SHM_PREFAULT
+#define O_SHM_PREFAULT  0x00040000
+#define O_SHM_LARGEPAGE 0x00080000
+#endif
+
+T_DECL(testposixshm_prefault, "Posix Shared Memory pre-faulted, large page objects")
+{
+	const char *name = "testposixshm_prefault";
+	size_t size = 4 * 1024 * 1024;
+	size_t pagesize = (size_t)getpagesize();
+	char *vec;
+	char *addr;
+	struct stat sb;
+	int fd1;
+
+	(void)shm_unlink(name);
+	fd1 = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_SHM_PREFAULT | O_SHM_LARGEPAGE,
+	    S_IRUSR | S_IWUSR);
+	T_ASSERT_POSIX_SUCCESS(fd1, "shm_open(O_SHM_PREFAULT | O_SHM_LARGEPAGE)");
+
+	T_ASSERT_POSIX_ZERO(ftruncate(fd1, (off_t)size - 1), NULL);
+	T_ASSERT_POSIX_ZERO(fstat(fd1, &sb), NULL);
+	T_EXPECT_EQ(sb.st_size % (2 * 1024 * 1024), 0LL, "size rounded to a large page");
+
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd1, 0);
+	T_ASSERT_NE((void *)addr, MAP_FAILED, "mmap()");
+	T_EXPECT_EQ((uintptr_t)addr % (2 * 1024 * 1024), 0UL, "mapping is large page aligned");
+
+	vec = malloc(size / pagesize);
+	T_QUIET; T_ASSERT_NOTNULL(vec, "malloc");
+	T_ASSERT_POSIX_ZERO(mincore(addr, size, vec), "mincore()");
+	for (size_t i = 0; i < size / pagesize; i++) {
+		T_QUIET; T_EXPECT_TRUE(vec[i] & MINCORE_INCORE, "page %zu resident", i);
+	}
+	free(vec);
+
+	T_EXPECT_POSIX_ZERO(munmap(addr, size), NULL);
+	T_EXPECT_POSIX_ZERO(close(fd1), "close()");
+	T_EXPECT_POSIX_SUCCESS(shm_unlink(name), "shm_unlink()");
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <darwintest.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"));
+
+#define SEGSZ   100
+#define SENDSZ  (2 * SEGSZ + 50)
+
+static void
+udp_pair(int *sender, int *receiver)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(sin);
+
+	T_ASSERT_POSIX_SUCCESS(*receiver = socket(AF_INET, SOCK_DGRAM, 0), "receiver");
+	T_ASSERT_POSIX_SUCCESS(bind(*receiver, (struct sockaddr *)&sin, sizeof(sin)), "bind");
+	T_ASSERT_POSIX_SUCCESS(getsockname(*receiver, (struct sockaddr *)&sin, &len), "getsockname");
+
+	T_ASSERT_POSIX_SUCCESS(*sender = socket(AF_INET, SOCK_DGRAM, 0), "sender");
+	T_ASSERT_POSIX_SUCCESS(connect(*sender, (struct sockaddr *)&sin, sizeof(sin)), "connect");
+}
+
+T_DECL(udp_segment, "UDP_SEGMENT splits one send into datagrams of the segment size")
+{
+	char buf[SENDSZ], rbuf[SENDSZ];
+	int s, r, segsz = SEGSZ;
+
+	udp_pair(&s, &r);
+	memset(buf, 'g', sizeof(buf));
+	T_ASSERT_POSIX_SUCCESS(setsockopt(s, IPPROTO_UDP, UDP_SEGMENT, &segsz, sizeof(segsz)),
+	    "UDP_SEGMENT");
+	T_ASSERT_EQ(send(s, buf, sizeof(buf), 0), (ssize_t)sizeof(buf), "one send");
+
+	T_EXPECT_EQ(recv(r, rbuf, sizeof(rbuf), 0), (ssize_t)SEGSZ, "first segment");
+	T_EXPECT_EQ(recv(r, rbuf, sizeof(rbuf), 0), (ssize_t)SEGSZ, "second segment");
+	T_EXPECT_EQ(recv(r, rbuf, sizeof(rbuf), 0), (ssize_t)(SENDSZ - 2 * SEGSZ), "short last segment");
+
+	close(s);
+	close(r);
+}
+
+T_DECL(udp_gro, "UDP_GRO delivers queued datagrams of a flow in one receive")
+{
+	char buf[SENDSZ], rbuf[SENDSZ];
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { .iov_base = rbuf, .iov_len = sizeof(rbuf) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cm;
+	int s, r, on = 1, segsz = 0;
+
+	udp_pair(&s, &r);
+	memset(buf, 'r', sizeof(buf));
+	T_ASSERT_POSIX_SUCCESS(setsockopt(r, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)), "UDP_GRO");
+
+	T_ASSERT_EQ(send(s, buf, SEGSZ, 0), (ssize_t)SEGSZ, "send");
+	T_ASSERT_EQ(send(s, buf, SEGSZ, 0), (ssize_t)SEGSZ, "send");
+	T_ASSERT_EQ(send(s, buf, SENDSZ - 2 * SEGSZ, 0), (ssize_t)(SENDSZ - 2 * SEGSZ), "send");
+	usleep(10000);
+
+	T_EXPECT_EQ(recvmsg(r, &msg, 0), (ssize_t)SENDSZ, "datagrams were coalesced");
+	cm = CMSG_FIRSTHDR(&msg);
+	T_ASSERT_NOTNULL(cm, "control message");
+	T_EXPECT_EQ(cm->cmsg_level, IPPROTO_UDP, "cmsg level");
+	T_EXPECT_EQ(cm->cmsg_type, UDP_GRO, "cmsg type");
+	memcpy(&segsz, CMSG_DATA(cm), sizeof(segsz));
+	T_EXPECT_EQ(segsz, SEGSZ, "segment size");
+
+	close(s);
+	close(r);
+}
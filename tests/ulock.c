@@ -2,9 +2,11 @@
 
 #include <stdatomic.h>
 
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <sys/ulock.h>
+#include <sys/sysctl.h>
 
 #include <os/tsd.h>
 
@@ -90,3 +92,66 @@ T_DECL(ulock_non_owner_wake, "ulock_wake respects non-owner wakes",
 	// won't ever actually join
 	pthread_join(waiter, NULL);
 }
+
+#pragma mark ulock_adaptive_spin
+
+static _Atomic uint32_t spin_ulock;
+static _Atomic bool spin_holder_ready;
+
+static uint64_t
+ulock_sysctl_counter(const char *name)
+{
+	uint64_t value = 0;
+	size_t len = sizeof(value);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, &value, &len, NULL, 0), "%s", name);
+	return value;
+}
+
+static void *
+spin_holder(void *arg __unused)
+{
+	uint64_t end;
+
+	atomic_store_explicit(&spin_ulock, _os_get_self() & ~0x3u, memory_order_relaxed);
+	atomic_store_explicit(&spin_holder_ready, true, memory_order_release);
+
+	/* stay on core for a little while, then release the lock */
+	end = clock_gettime_nsec_np(CLOCK_MONOTONIC) + 5000;
+	while (clock_gettime_nsec_np(CLOCK_MONOTONIC) < end) {
+	}
+
+	atomic_store_explicit(&spin_ulock, 0, memory_order_release);
+	/* the waiter may have given up spinning and blocked */
+	__ulock_wake(UL_UNFAIR_LOCK | ULF_NO_ERRNO, &spin_ulock, 0);
+	return NULL;
+}
+
+T_DECL(ulock_adaptive_spin, "ULF_WAIT_ADAPTIVE_SPIN spins on an on core owner",
+    T_META_CHECK_LEAKS(false))
+{
+	uint64_t spins = ulock_sysctl_counter("kern.ulock_adaptive_spins");
+	pthread_t holder;
+	uint32_t value;
+	int rc;
+
+	atomic_store_explicit(&spin_holder_ready, false, memory_order_relaxed);
+	T_ASSERT_POSIX_ZERO(pthread_create(&holder, NULL, spin_holder, NULL), "create holder");
+	while (!atomic_load_explicit(&spin_holder_ready, memory_order_acquire)) {
+	}
+
+	while ((value = atomic_load_explicit(&spin_ulock, memory_order_relaxed)) != 0) {
+		rc = __ulock_wait(UL_UNFAIR_LOCK | ULF_NO_ERRNO | ULF_WAIT_ADAPTIVE_SPIN,
+		    &spin_ulock, value, 0);
+		if (rc == -EINTR || rc == -EFAULT) {
+			continue;
+		}
+		T_QUIET; T_ASSERT_GE(rc, 0, "__ulock_wait");
+	}
+
+	T_ASSERT_POSIX_ZERO(pthread_join(holder, NULL), "join holder");
+	T_LOG("adaptive spins: %llu, successes: %llu",
+	    ulock_sysctl_counter("kern.ulock_adaptive_spins") - spins,
+	    ulock_sysctl_counter("kern.ulock_adaptive_spin_successes"));
+	T_PASS("waiter observed the release");
+}
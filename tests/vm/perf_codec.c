@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+/*
+ * Compressor codec throughput benchmark.
+ *
+ * Fills a buffer with one of a few data patterns and hands it to
+ * kern.perf_codec, which runs WKdm and LZ4 over it one page at a time
+ * (checking that every page decodes back to the original), or through the
+ * LZ4 stream encoder. Reports encode and decode MB/s and the compression
+ * ratio.
+ *
+ * Requires a DEVELOPMENT or DEBUG kernel.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+#include <sys/sysctl.h>
+#include <sys/types.h>
+
+#include "benchmark/harness.h"
+#include "benchmark/helpers.h"
+
+/* Mirror of the kernel structure exported through kern.perf_codec. */
+struct perf_codec_data {
+	user_addr_t buffer;
+	size_t buffer_size;
+	uint32_t codec;
+	uint32_t reserved;
+	uint64_t encode_time;
+	uint64_t decode_time;
+	uint64_t bytes_encoded;
+};
+
+typedef enum codec {
+	CODEC_WKDM = 0,
+	CODEC_LZ4 = 1,
+	CODEC_LZ4_STREAM = 2,
+	CODEC_COUNT
+} codec_t;
+
+static const char *kCodecNames[CODEC_COUNT] = {
+	[CODEC_WKDM] = "wkdm",
+	[CODEC_LZ4] = "lz4",
+	[CODEC_LZ4_STREAM] = "lz4-stream",
+};
+
+typedef enum pattern {
+	PATTERN_ZERO,
+	PATTERN_TEXT,
+	PATTERN_HEAP,
+	PATTERN_RANDOM,
+	PATTERN_COUNT
+} pattern_t;
+
+static const char *kPatternNames[PATTERN_COUNT] = {
+	[PATTERN_ZERO] = "zero",
+	[PATTERN_TEXT] = "text",
+	[PATTERN_HEAP] = "heap",
+	[PATTERN_RANDOM] = "random",
+};
+
+static int kInvalidArgument = 1;
+static int kBenchmarkFailed = 2;
+
+static void
+fill_buffer(unsigned char *buf, size_t size, pattern_t pattern)
+{
+	static const char *words[] = {
+		"the ", "kernel ", "page ", "of ", "memory ", "is ", "compressed ",
+		"when ", "it ", "becomes ", "inactive ", "and ", "a ", "fault ",
+	};
+	uint64_t *words64 = (uint64_t *)(void *)buf;
+
+	switch (pattern) {
+	case PATTERN_ZERO:
+		memset(buf, 0, size);
+		break;
+	case PATTERN_TEXT:
+		for (size_t off = 0; off < size;) {
+			const char *w = words[arc4random_uniform(sizeof(words) / sizeof(words[0]))];
+			size_t n = MIN(strlen(w), size - off);
+			memcpy(buf + off, w, n);
+			off += n;
+		}
+		break;
+	case PATTERN_HEAP:
+		/*
+		 * What WKdm is designed for: pointers into a few regions, small
+		 * integers and zeroes.
+		 */
+		for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
+			switch (arc4random_uniform(4)) {
+			case 0:
+				words64[i] = 0;
+				break;
+			case 1:
+				words64[i] = arc4random_uniform(256);
+				break;
+			default:
+				words64[i] = 0x0000600001000000ull +
+				    ((uint64_t)arc4random_uniform(8) << 20) +
+				    (arc4random_uniform(1 << 16) & ~0xfull);
+				break;
+			}
+		}
+		break;
+	case PATTERN_RANDOM:
+		arc4random_buf(buf, size);
+		break;
+	default:
+		abort();
+	}
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "usage: %s %s [--buffer-mb n] [--pattern zero|text|heap|random] "
+	    "[codec...]\n", progname, benchmark_usage());
+	fprintf(stderr, "codecs (default: all): wkdm lz4 lz4-stream\n");
+	exit(kInvalidArgument);
+}
+
+static int
+run_codec(const benchmark_config_t *config, codec_t codec, pattern_t pattern,
+    unsigned char *buf, size_t size)
+{
+	double *encode = calloc(config->trials, sizeof(double));
+	double *decode = calloc(config->trials, sizeof(double));
+	struct perf_codec_data data;
+	benchmark_stats_t stats;
+	uint64_t encoded = 0;
+	char name[64];
+	int ret = 0;
+
+	if (encode == NULL || decode == NULL) {
+		err(kBenchmarkFailed, "calloc");
+	}
+	for (unsigned int i = 0; i < config->warmup + config->trials; i++) {
+		size_t len = sizeof(data);
+
+		memset(&data, 0, sizeof(data));
+		data.buffer = (user_addr_t)buf;
+		data.buffer_size = size;
+		data.codec = codec;
+		if (sysctlbyname("kern.perf_codec", &data, &len, &data, len) != 0) {
+			warn("kern.perf_codec %s", kCodecNames[codec]);
+			ret = errno;
+			goto out;
+		}
+		if (i < config->warmup) {
+			continue;
+		}
+		encode[i - config->warmup] = (double)size / (1 << 20) /
+		    ((double)data.encode_time / kNumNanosecondsInSecond);
+		decode[i - config->warmup] = data.decode_time ? (double)size / (1 << 20) /
+		    ((double)data.decode_time / kNumNanosecondsInSecond) : 0;
+		encoded = data.bytes_encoded;
+	}
+
+	printf("%s/%s: ratio %.2f (%llu -> %llu bytes)\n", kCodecNames[codec],
+	    kPatternNames[pattern], (double)size / (double)encoded,
+	    (unsigned long long)size, (unsigned long long)encoded);
+	snprintf(name, sizeof(name), "%s_%s_encode", kCodecNames[codec], kPatternNames[pattern]);
+	ret = benchmark_report(config, name, "MB/s", encode, config->trials, &stats);
+	if (ret == 0 && codec != CODEC_LZ4_STREAM) {
+		snprintf(name, sizeof(name), "%s_%s_decode", kCodecNames[codec], kPatternNames[pattern]);
+		ret = benchmark_report(config, name, "MB/s", decode, config->trials, &stats);
+	}
+out:
+	free(encode);
+	free(decode);
+	return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+	benchmark_config_t config = BENCHMARK_CONFIG_DEFAULT;
+	bool codecs[CODEC_COUNT] = { false };
+	bool any_codec = false;
+	pattern_t pattern = PATTERN_HEAP;
+	size_t size = 32ULL << 20;
+	unsigned char *buf;
+	int consumed, ret = 0;
+
+	consumed = benchmark_parse_args(&config, argc - 1, argv + 1);
+	if (consumed < 0) {
+		usage(argv[0]);
+	}
+	for (int i = 1 + consumed; i < argc; i++) {
+		if (strcmp(argv[i], "--buffer-mb") == 0 && i + 1 < argc) {
+			size = strtoull(argv[++i], NULL, 10) << 20;
+			if (size == 0) {
+				usage(argv[0]);
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--pattern") == 0 && i + 1 < argc) {
+			i++;
+			for (pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+				if (strcasecmp(argv[i], kPatternNames[pattern]) == 0) {
+					break;
+				}
+			}
+			if (pattern == PATTERN_COUNT) {
+				usage(argv[0]);
+			}
+			continue;
+		}
+		for (codec_t codec = 0; codec <= CODEC_COUNT; codec++) {
+			if (codec == CODEC_COUNT) {
+				usage(argv[0]);
+			}
+			if (strcasecmp(argv[i], kCodecNames[codec]) == 0) {
+				codecs[codec] = any_codec = true;
+				break;
+			}
+		}
+	}
+
+	if (benchmark_bind_cluster(config.cluster) != 0) {
+		errx(kInvalidArgument, "Unable to bind to cluster type %c", (char)config.cluster);
+	}
+	buf = mmap_buffer(size);
+	if (buf == NULL) {
+		err(kBenchmarkFailed, "mmap");
+	}
+	fill_buffer(buf, size, pattern);
+
+	for (codec_t codec = 0; codec < CODEC_COUNT; codec++) {
+		if (!any_codec || codecs[codec]) {
+			ret = run_codec(&config, codec, pattern, buf, size) ?: ret;
+		}
+	}
+	return ret ? kBenchmarkFailed : 0;
+}
@@ -0,0 +1,704 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+/*
+ * VM pressure benchmark.
+ *
+ * Runs a sequence of phases that each stress one part of the VM under
+ * memory pressure, and snapshots the VM and compressor counters around
+ * every phase so that the cost of a phase can be attributed:
+ *
+ *   compress  kern.perf_compressor on typical data: compressor MB/s,
+ *             overall and per compressor thread.
+ *   fault     compress a buffer, then time the fault on each page:
+ *             decompress-on-fault latency histogram.
+ *   pressure  dirty more anonymous memory than is free from several
+ *             threads, then sweep it again: pageout scan rate,
+ *             compression and swap activity, swap-in latency.
+ *   jetsam    a child with a fatal footprint limit grows past it: time
+ *             from crossing the limit to the child's death.
+ *
+ * Requires a DEVELOPMENT or DEBUG kernel, and root for the jetsam phase.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/vm_page_size.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/kern_memorystatus.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/resource.h>
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <libproc.h>
+
+#include "benchmark/harness.h"
+#include "benchmark/helpers.h"
+
+/* Mirrors of the kernel structures exported through sysctl. */
+struct perf_compressor_data {
+	user_addr_t buffer;
+	size_t buffer_size;
+	uint64_t benchmark_time;
+	uint64_t bytes_processed;
+	uint64_t compressor_growth;
+};
+
+#define MAX_COMPRESSOR_THREADS 16
+struct vm_compressor_thread_stats {
+	uint64_t vmcts_pages_compressed;
+	uint64_t vmcts_batches;
+	uint64_t vmcts_queue_depth_total;
+	uint32_t vmcts_queue_depth_max;
+	uint32_t vmcts_cluster_id;
+};
+
+/* Matches vm.swapin_latency_histogram, and the fault histogram below. */
+#define LATENCY_BUCKETS 24
+
+typedef enum phase {
+	PHASE_COMPRESS,
+	PHASE_FAULT,
+	PHASE_PRESSURE,
+	PHASE_JETSAM,
+	PHASE_COUNT
+} phase_t;
+
+static const char *kPhaseNames[PHASE_COUNT] = {
+	"compress", "fault", "pressure", "jetsam",
+};
+
+typedef struct test_args {
+	benchmark_config_t ta_config;
+	bool ta_phases[PHASE_COUNT];
+	unsigned int ta_threads;
+	uint64_t ta_buffer_size;
+	uint64_t ta_pressure_size;
+	uint64_t ta_jetsam_limit_mb;
+} test_args_t;
+
+/* Snapshot of the counters read before and after each phase. */
+typedef struct vm_counters {
+	uint64_t vc_time_ns;
+	vm_statistics64_data_t vc_vm_stat;
+	uint64_t vc_compressor_input_bytes;
+	uint64_t vc_compressor_compressed_bytes;
+	uint64_t vc_compressor_bytes_used;
+	uint64_t vc_pageout_considered;
+	uint64_t vc_pageout_dirty_internal;
+	uint64_t vc_swapin_histogram[LATENCY_BUCKETS];
+	struct vm_compressor_thread_stats vc_threads[MAX_COMPRESSOR_THREADS];
+	int vc_nthreads;
+} vm_counters_t;
+
+/*
+ * Failure codes
+ */
+static int kInvalidArgument = 1;
+static int kAllocationFailure = 2;
+static int kCompressionFailure = 3;
+static int kCounterFailure = 4;
+static int kJetsamFailure = 5;
+
+static void parse_arguments(int argc, char **argv, test_args_t *args /* OUT */);
+static void print_help(const char *progname);
+static void fill_with_typical_data(unsigned char *buf, size_t size);
+static void sample_counters(vm_counters_t *counters /* OUT */);
+static void report_counter_deltas(const char *phase, const vm_counters_t *before, const vm_counters_t *after);
+static void run_compress_phase(const test_args_t *args);
+static void run_fault_phase(const test_args_t *args);
+static void run_pressure_phase(const test_args_t *args);
+static void run_jetsam_phase(const test_args_t *args);
+
+static void (*const kPhaseRunners[PHASE_COUNT])(const test_args_t *) = {
+	run_compress_phase, run_fault_phase, run_pressure_phase, run_jetsam_phase,
+};
+
+int
+main(int argc, char **argv)
+{
+	test_args_t args;
+	int ret;
+
+	parse_arguments(argc, argv, &args);
+	ret = benchmark_bind_cluster(args.ta_config.cluster);
+	if (ret != 0) {
+		errx(kInvalidArgument, "Unable to bind to cluster type %c: %s",
+		    (char) args.ta_config.cluster, strerror(ret));
+	}
+
+	for (int phase = 0; phase < PHASE_COUNT; phase++) {
+		vm_counters_t before, after;
+
+		if (!args.ta_phases[phase]) {
+			continue;
+		}
+		benchmark_log(args.ta_config.verbose, "Start %s phase\n", kPhaseNames[phase]);
+		sample_counters(&before);
+		kPhaseRunners[phase](&args);
+		sample_counters(&after);
+		report_counter_deltas(kPhaseNames[phase], &before, &after);
+		benchmark_log(args.ta_config.verbose, "Finished %s phase\n", kPhaseNames[phase]);
+	}
+	return 0;
+}
+
+#pragma mark Counters
+
+static uint64_t
+sysctl_u64(const char *name)
+{
+	uint64_t value = 0;
+	size_t len = sizeof(value);
+
+	if (sysctlbyname(name, &value, &len, NULL, 0) != 0) {
+		err(kCounterFailure, "sysctl %s", name);
+	}
+	return value;
+}
+
+static void
+sample_counters(vm_counters_t *counters)
+{
+	mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+	size_t len;
+
+	memset(counters, 0, sizeof(*counters));
+	if (host_statistics64(mach_host_self(), HOST_VM_INFO64,
+	    (host_info64_t) &counters->vc_vm_stat, &count) != KERN_SUCCESS) {
+		errx(kCounterFailure, "host_statistics64(HOST_VM_INFO64) failed");
+	}
+	counters->vc_compressor_input_bytes = sysctl_u64("vm.compressor_input_bytes");
+	counters->vc_compressor_compressed_bytes = sysctl_u64("vm.compressor_compressed_bytes");
+	counters->vc_compressor_bytes_used = sysctl_u64("vm.compressor_bytes_used");
+	counters->vc_pageout_considered = sysctl_u64("vm.pageout_considered_page");
+	counters->vc_pageout_dirty_internal = sysctl_u64("vm.pageout_inactive_dirty_internal");
+
+	len = sizeof(counters->vc_swapin_histogram);
+	if (sysctlbyname("vm.swapin_latency_histogram", counters->vc_swapin_histogram,
+	    &len, NULL, 0) != 0) {
+		err(kCounterFailure, "sysctl vm.swapin_latency_histogram");
+	}
+
+	len = sizeof(counters->vc_threads);
+	if (sysctlbyname("vm.compressor_thread_stats", counters->vc_threads,
+	    &len, NULL, 0) != 0) {
+		err(kCounterFailure, "sysctl vm.compressor_thread_stats");
+	}
+	counters->vc_nthreads = (int)(len / sizeof(counters->vc_threads[0]));
+
+	counters->vc_time_ns = current_timestamp_ns();
+}
+
+static void
+print_histogram(const char *name, const uint64_t *buckets)
+{
+	uint64_t total = 0;
+
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		total += buckets[i];
+	}
+	if (total == 0) {
+		return;
+	}
+	printf("%s (%llu samples):\n", name, total);
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		if (buckets[i] == 0) {
+			continue;
+		}
+		if (i == 0) {
+			printf("  %10s < 1us: %llu\n", "", buckets[i]);
+		} else if (i == LATENCY_BUCKETS - 1) {
+			printf("  %10llu+ us: %llu\n", 1ULL << (i - 1), buckets[i]);
+		} else {
+			printf("  %6llu-%llu us: %llu\n", 1ULL << (i - 1), 1ULL << i, buckets[i]);
+		}
+	}
+}
+
+static void
+report_counter_deltas(const char *phase, const vm_counters_t *before, const vm_counters_t *after)
+{
+	const vm_statistics64_data_t *b = &before->vc_vm_stat, *a = &after->vc_vm_stat;
+	double seconds = (double)(after->vc_time_ns - before->vc_time_ns) / kNumNanosecondsInSecond;
+	uint64_t input = after->vc_compressor_input_bytes - before->vc_compressor_input_bytes;
+	uint64_t compressed = after->vc_compressor_compressed_bytes - before->vc_compressor_compressed_bytes;
+	uint64_t considered = after->vc_pageout_considered - before->vc_pageout_considered;
+	uint64_t swapins[LATENCY_BUCKETS];
+
+	printf("-----%s counters (%.3f s)-----\n", phase, seconds);
+	printf("compressions=%llu decompressions=%llu pageouts=%llu swapins=%llu swapouts=%llu\n",
+	    a->compressions - b->compressions, a->decompressions - b->decompressions,
+	    a->pageouts - b->pageouts, a->swapins - b->swapins, a->swapouts - b->swapouts);
+	printf("faults=%llu cow_faults=%llu reactivations=%llu purges=%llu\n",
+	    a->faults - b->faults, a->cow_faults - b->cow_faults,
+	    a->reactivations - b->reactivations, a->purges - b->purges);
+	printf("pageout scan: %llu pages considered (%.0f pages/s), %llu dirty internal pages sent to the compressor\n",
+	    considered, considered / seconds,
+	    after->vc_pageout_dirty_internal - before->vc_pageout_dirty_internal);
+	printf("compressor: %.1f MB in, %.1f MB out, ratio %.2f, pool %+.1f MB, %.1f MB/s\n",
+	    input / 1e6, compressed / 1e6, compressed ? (double) input / compressed : 0,
+	    ((int64_t) after->vc_compressor_bytes_used - (int64_t) before->vc_compressor_bytes_used) / 1e6,
+	    input / 1e6 / seconds);
+	for (int i = 0; i < after->vc_nthreads && i < before->vc_nthreads; i++) {
+		const struct vm_compressor_thread_stats *tb = &before->vc_threads[i], *ta = &after->vc_threads[i];
+		uint64_t pages = ta->vmcts_pages_compressed - tb->vmcts_pages_compressed;
+		uint64_t batches = ta->vmcts_batches - tb->vmcts_batches;
+
+		if (pages == 0) {
+			continue;
+		}
+		printf("compressor thread %d (cluster %u): %llu pages, %.1f MB/s, mean queue depth %.1f\n",
+		    i, ta->vmcts_cluster_id, pages, pages * vm_kernel_page_size / 1e6 / seconds,
+		    batches ? (double)(ta->vmcts_queue_depth_total - tb->vmcts_queue_depth_total) / batches : 0);
+	}
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		swapins[i] = after->vc_swapin_histogram[i] - before->vc_swapin_histogram[i];
+	}
+	print_histogram("swap-in latency", swapins);
+	fflush(stdout);
+}
+
+#pragma mark Compress phase
+
+static unsigned char *
+alloc_typical_buffer(size_t size)
+{
+	unsigned char *buf = mmap_buffer(size);
+	if (!buf) {
+		err(kAllocationFailure, "Unable to allocate test buffer");
+	}
+	fill_with_typical_data(buf, size);
+	return buf;
+}
+
+/* Push every page of buf through the compressor. Returns the kernel's timing. */
+static void
+compress_buffer(unsigned char *buf, size_t size, struct perf_compressor_data *data /* OUT */)
+{
+	size_t len = sizeof(*data);
+
+	memset(data, 0, sizeof(*data));
+	data->buffer = (user_addr_t) buf;
+	data->buffer_size = size;
+	if (sysctlbyname("kern.perf_compressor", data, &len, data, sizeof(*data)) < 0) {
+		err(kCompressionFailure, "Failed to compress buffer");
+	}
+	if (data->bytes_processed != size) {
+		fprintf(stderr, "WARNING: Only compressed %llu bytes out of %zu bytes\n",
+		    data->bytes_processed, size);
+	}
+}
+
+static double
+compress_trial(void *ctx)
+{
+	const test_args_t *args = ctx;
+	struct perf_compressor_data data;
+	unsigned char *buf;
+
+	buf = alloc_typical_buffer(args->ta_buffer_size);
+	compress_buffer(buf, args->ta_buffer_size, &data);
+	munmap(buf, args->ta_buffer_size);
+	if (data.benchmark_time == 0) {
+		return 0;
+	}
+	return (double) data.bytes_processed / 1e6 / ((double) data.benchmark_time / kNumNanosecondsInSecond);
+}
+
+static void
+run_compress_phase(const test_args_t *args)
+{
+	benchmark_stats_t stats;
+
+	/*
+	 * The kernel runs one kern.perf_compressor request at a time, spread
+	 * over the compressor threads; the per-thread split is in the counter
+	 * deltas for this phase.
+	 */
+	if (benchmark_run(&args->ta_config, "vm_pressure.compress", "MB/s",
+	    compress_trial, (void *) args, &stats) != 0) {
+		errx(kCompressionFailure, "compress phase failed");
+	}
+}
+
+#pragma mark Fault phase
+
+static void
+run_fault_phase(const test_args_t *args)
+{
+	size_t pages = args->ta_buffer_size / vm_kernel_page_size;
+	size_t nsamples = 0;
+	uint64_t histogram[LATENCY_BUCKETS] = {0};
+	mach_timebase_info_data_t timebase;
+	benchmark_stats_t stats;
+	double *samples;
+
+	mach_timebase_info(&timebase);
+	samples = calloc(pages * args->ta_config.trials, sizeof(double));
+	if (samples == NULL) {
+		err(kAllocationFailure, "Unable to allocate sample buffer");
+	}
+
+	for (unsigned int trial = 0; trial < args->ta_config.warmup + args->ta_config.trials; trial++) {
+		bool record = trial >= args->ta_config.warmup;
+		struct perf_compressor_data data;
+		unsigned char *buf;
+
+		buf = alloc_typical_buffer(args->ta_buffer_size);
+		compress_buffer(buf, args->ta_buffer_size, &data);
+		for (size_t i = 0; i < pages; i++) {
+			volatile unsigned char *ptr = buf + i * vm_kernel_page_size;
+			uint64_t start, ns, us;
+			int bucket = 0;
+
+			start = mach_absolute_time();
+			(void) *ptr;
+			ns = (mach_absolute_time() - start) * timebase.numer / timebase.denom;
+			if (!record) {
+				continue;
+			}
+			us = ns / kNumNanosecondsInMicrosecond;
+			if (us) {
+				bucket = MIN(64 - __builtin_clzll(us), LATENCY_BUCKETS - 1);
+			}
+			histogram[bucket]++;
+			samples[nsamples++] = (double) ns / kNumNanosecondsInMicrosecond;
+		}
+		munmap(buf, args->ta_buffer_size);
+	}
+
+	print_histogram("decompress-on-fault latency", histogram);
+	benchmark_report(&args->ta_config, "vm_pressure.fault_latency", "us",
+	    samples, nsamples, &stats);
+	free(samples);
+}
+
+#pragma mark Pressure phase
+
+typedef struct pressure_thread {
+	pthread_t pt_thread;
+	const test_args_t *pt_args;
+	pthread_barrier_t *pt_barrier;
+	size_t pt_size;
+	double pt_fill_mbps;
+	double pt_sweep_mbps;
+} pressure_thread_t;
+
+static void *
+pressure_thread_main(void *arg)
+{
+	pressure_thread_t *pt = arg;
+	volatile unsigned char *ptr;
+	unsigned char *buf;
+	uint64_t start, end;
+
+	benchmark_bind_cluster(pt->pt_args->ta_config.cluster);
+	buf = mmap_buffer(pt->pt_size);
+	if (!buf) {
+		err(kAllocationFailure, "Unable to allocate pressure buffer");
+	}
+	pthread_barrier_wait(pt->pt_barrier);
+
+	/* Dirty our share: this is what pushes the system into pageout. */
+	start = current_timestamp_ns();
+	fill_with_typical_data(buf, pt->pt_size);
+	end = current_timestamp_ns();
+	pt->pt_fill_mbps = pt->pt_size / 1e6 / ((double)(end - start) / kNumNanosecondsInSecond);
+
+	/* Read it back: whatever was compressed or swapped out faults back in. */
+	pthread_barrier_wait(pt->pt_barrier);
+	start = current_timestamp_ns();
+	for (ptr = buf; ptr < buf + pt->pt_size; ptr += vm_kernel_page_size) {
+		(void) *ptr;
+	}
+	end = current_timestamp_ns();
+	pt->pt_sweep_mbps = pt->pt_size / 1e6 / ((double)(end - start) / kNumNanosecondsInSecond);
+
+	munmap(buf, pt->pt_size);
+	return NULL;
+}
+
+static void
+run_pressure_phase(const test_args_t *args)
+{
+	unsigned int nthreads = args->ta_threads;
+	pressure_thread_t *threads;
+	pthread_barrier_t barrier;
+	double *fill, *sweep;
+	benchmark_stats_t stats;
+
+	threads = calloc(nthreads, sizeof(*threads));
+	fill = calloc(nthreads, sizeof(double));
+	sweep = calloc(nthreads, sizeof(double));
+	if (!threads || !fill || !sweep) {
+		err(kAllocationFailure, "Unable to allocate thread state");
+	}
+	pthread_barrier_init(&barrier, NULL, nthreads);
+
+	for (unsigned int i = 0; i < nthreads; i++) {
+		threads[i].pt_args = args;
+		threads[i].pt_barrier = &barrier;
+		threads[i].pt_size = (args->ta_pressure_size / nthreads) & ~(size_t)(vm_kernel_page_size - 1);
+		if (pthread_create(&threads[i].pt_thread, NULL, pressure_thread_main, &threads[i]) != 0) {
+			err(kAllocationFailure, "pthread_create");
+		}
+	}
+	for (unsigned int i = 0; i < nthreads; i++) {
+		pthread_join(threads[i].pt_thread, NULL);
+		fill[i] = threads[i].pt_fill_mbps;
+		sweep[i] = threads[i].pt_sweep_mbps;
+	}
+
+	benchmark_report(&args->ta_config, "vm_pressure.fill_per_thread", "MB/s", fill, nthreads, &stats);
+	benchmark_report(&args->ta_config, "vm_pressure.sweep_per_thread", "MB/s", sweep, nthreads, &stats);
+
+	pthread_barrier_destroy(&barrier);
+	free(sweep);
+	free(fill);
+	free(threads);
+}
+
+#pragma mark Jetsam phase
+
+/*
+ * The child records the time at which its footprint crossed the limit in
+ * a page shared with the parent, then keeps growing until it is killed.
+ */
+static void __dead2
+jetsam_child(int start_fd, volatile uint64_t *crossed_at, uint64_t limit_bytes)
+{
+	struct rusage_info_v4 ru;
+	unsigned char *buf;
+	uint64_t base, size, touched = 0;
+	char c;
+
+	if (read(start_fd, &c, 1) != 1) {
+		_exit(kJetsamFailure);
+	}
+	if (proc_pid_rusage(getpid(), RUSAGE_INFO_V4, (rusage_info_t *) &ru) != 0) {
+		_exit(kJetsamFailure);
+	}
+	base = ru.ri_phys_footprint;
+	size = limit_bytes * 2;
+	buf = mmap_buffer(size);
+	if (!buf) {
+		_exit(kAllocationFailure);
+	}
+	for (uint64_t off = 0; off < size; off += vm_kernel_page_size) {
+		buf[off] = 1;
+		touched += vm_kernel_page_size;
+		if (*crossed_at == 0 && base + touched > limit_bytes) {
+			*crossed_at = mach_absolute_time();
+		}
+	}
+	/* Grew to twice the limit and survived. */
+	_exit(kJetsamFailure);
+}
+
+static double
+jetsam_trial(void *ctx)
+{
+	const test_args_t *args = ctx;
+	mach_timebase_info_data_t timebase;
+	volatile uint64_t *crossed_at;
+	uint64_t exited_at;
+	int fds[2], status;
+	pid_t pid;
+
+	mach_timebase_info(&timebase);
+	crossed_at = mmap(NULL, vm_kernel_page_size, PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_SHARED, -1, 0);
+	if (crossed_at == MAP_FAILED) {
+		err(kAllocationFailure, "mmap");
+	}
+	*crossed_at = 0;
+	if (pipe(fds) != 0) {
+		err(kJetsamFailure, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(kJetsamFailure, "fork");
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		jetsam_child(fds[0], crossed_at, args->ta_jetsam_limit_mb << 20);
+	}
+	close(fds[0]);
+
+	if (memorystatus_control(MEMORYSTATUS_CMD_SET_JETSAM_TASK_LIMIT, pid,
+	    (uint32_t) args->ta_jetsam_limit_mb, NULL, 0) != 0) {
+		kill(pid, SIGKILL);
+		err(kJetsamFailure, "Unable to set the memory limit of %d (requires root)", pid);
+	}
+	if (write(fds[1], "g", 1) != 1) {
+		err(kJetsamFailure, "write");
+	}
+	close(fds[1]);
+
+	if (waitpid(pid, &status, 0) != pid) {
+		err(kJetsamFailure, "waitpid");
+	}
+	exited_at = mach_absolute_time();
+	if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL || *crossed_at == 0) {
+		errx(kJetsamFailure, "Child was not killed for exceeding its limit (status 0x%x)", status);
+	}
+
+	exited_at = (exited_at - *crossed_at) * timebase.numer / timebase.denom;
+	munmap((void *) crossed_at, vm_kernel_page_size);
+	return (double) exited_at / kNumNanosecondsInMicrosecond;
+}
+
+static void
+run_jetsam_phase(const test_args_t *args)
+{
+	benchmark_stats_t stats;
+
+	if (benchmark_run(&args->ta_config, "vm_pressure.jetsam_latency", "us",
+	    jetsam_trial, (void *) args, &stats) != 0) {
+		errx(kJetsamFailure, "jetsam phase failed");
+	}
+}
+
+#pragma mark Setup
+
+/*
+ * Gives us the compression ratio we see in the typical case (~2.5)
+ */
+static void
+fill_with_typical_data(unsigned char *buf, size_t size)
+{
+	for (size_t i = 0; i < size / vm_kernel_page_size; i++) {
+		unsigned char val = 0;
+		for (size_t j = 0; j < vm_kernel_page_size; j += 16) {
+			memset(&buf[i * vm_kernel_page_size + j], val, 16);
+			if (i < 3400 * (vm_kernel_page_size / 4096)) {
+				val++;
+			}
+		}
+	}
+}
+
+static uint64_t
+parse_mb(const char *progname, const char *str)
+{
+	long value = strtol(str, NULL, 10);
+	if (value <= 0) {
+		print_help(progname);
+		exit(kInvalidArgument);
+	}
+	return (uint64_t) value;
+}
+
+static void
+parse_arguments(int argc, char **argv, test_args_t *args)
+{
+	benchmark_config_t config = BENCHMARK_CONFIG_DEFAULT;
+	uint64_t memsize = 0;
+	size_t len = sizeof(memsize);
+	bool any_phase = false;
+	int consumed, i;
+
+	memset(args, 0, sizeof(*args));
+	args->ta_threads = get_ncpu();
+	args->ta_buffer_size = 64ULL << 20;
+	args->ta_jetsam_limit_mb = 64;
+	if (sysctlbyname("hw.memsize", &memsize, &len, NULL, 0) != 0) {
+		err(kInvalidArgument, "sysctl hw.memsize");
+	}
+	/* Enough to force the pageout daemon to run on an otherwise idle system. */
+	args->ta_pressure_size = memsize / 4 * 3;
+
+	consumed = benchmark_parse_args(&config, argc - 1, argv + 1);
+	if (consumed < 0) {
+		print_help(argv[0]);
+		exit(kInvalidArgument);
+	}
+	args->ta_config = config;
+
+	for (i = 1 + consumed; i < argc; i++) {
+		if (argv[i][0] == '-') {
+			if (i + 1 >= argc) {
+				print_help(argv[0]);
+				exit(kInvalidArgument);
+			}
+			if (strcmp(argv[i], "--threads") == 0) {
+				args->ta_threads = (unsigned int) parse_mb(argv[0], argv[++i]);
+			} else if (strcmp(argv[i], "--buffer-mb") == 0) {
+				args->ta_buffer_size = parse_mb(argv[0], argv[++i]) << 20;
+			} else if (strcmp(argv[i], "--pressure-mb") == 0) {
+				args->ta_pressure_size = parse_mb(argv[0], argv[++i]) << 20;
+			} else if (strcmp(argv[i], "--jetsam-limit-mb") == 0) {
+				args->ta_jetsam_limit_mb = parse_mb(argv[0], argv[++i]);
+			} else {
+				fprintf(stderr, "Unknown argument %s\n", argv[i]);
+				print_help(argv[0]);
+				exit(kInvalidArgument);
+			}
+			continue;
+		}
+		for (int phase = 0; phase < PHASE_COUNT; phase++) {
+			if (strcasecmp(argv[i], kPhaseNames[phase]) == 0) {
+				args->ta_phases[phase] = true;
+				any_phase = true;
+				break;
+			}
+			if (phase == PHASE_COUNT - 1) {
+				fprintf(stderr, "Unknown phase %s\n", argv[i]);
+				print_help(argv[0]);
+				exit(kInvalidArgument);
+			}
+		}
+	}
+	if (!any_phase) {
+		for (int phase = 0; phase < PHASE_COUNT; phase++) {
+			args->ta_phases[phase] = true;
+		}
+	}
+}
+
+static void
+print_help(const char *progname)
+{
+	fprintf(stderr, "%s: %s [--threads n] [--buffer-mb n] [--pressure-mb n] [--jetsam-limit-mb n] [phase...]\n",
+	    progname, benchmark_usage());
+	fprintf(stderr, "\nphases (default: all, in this order):\n");
+	fprintf(stderr, "	%s	Compressor throughput via kern.perf_compressor.\n", kPhaseNames[PHASE_COMPRESS]);
+	fprintf(stderr, "	%s	Decompress-on-fault latency.\n", kPhaseNames[PHASE_FAULT]);
+	fprintf(stderr, "	%s	Dirty --pressure-mb (default 3/4 of memory) from --threads threads.\n", kPhaseNames[PHASE_PRESSURE]);
+	fprintf(stderr, "	%s	Time to kill a process past its footprint limit (root).\n", kPhaseNames[PHASE_JETSAM]);
+}
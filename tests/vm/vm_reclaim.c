@@ -71,6 +71,41 @@ T_DECL(vm_reclaim_single_entry, "Place a single entry in the buffer and call syn
 	mach_vm_reclaim_synchronize(&ringbuffer, 1);
 }
 
+T_DECL(vm_reclaim_adjacent_entries, "Adjacent entries are all reclaimed by one sync")
+{
+	struct mach_vm_reclaim_ringbuffer_v1_s ringbuffer;
+	static const size_t kNumEntries = 4;
+	static const size_t kEntrySize = (1UL << 18); // 256KB
+	mach_vm_address_t addr = 0, region_addr;
+	mach_vm_size_t region_size = 0;
+	vm_region_basic_info_data_64_t info;
+	mach_msg_type_number_t count = VM_REGION_BASIC_INFO_COUNT_64;
+	mach_port_t unused = MACH_PORT_NULL;
+	bool should_update_kernel_accounting = false;
+
+	kern_return_t kr = mach_vm_reclaim_ringbuffer_init(&ringbuffer);
+	T_QUIET; T_ASSERT_MACH_SUCCESS(kr, "mach_vm_reclaim_ringbuffer_init");
+
+	kr = mach_vm_map(mach_task_self(), &addr, kNumEntries * kEntrySize, 0, VM_FLAGS_ANYWHERE,
+	    MEMORY_OBJECT_NULL, 0, FALSE, VM_PROT_DEFAULT, VM_PROT_ALL, VM_INHERIT_DEFAULT);
+	T_QUIET; T_ASSERT_MACH_SUCCESS(kr, "mach_vm_map");
+	memset((void *) addr, 1, kNumEntries * kEntrySize);
+
+	for (size_t i = 0; i < kNumEntries; i++) {
+		uint64_t idx = mach_vm_reclaim_mark_free(&ringbuffer, addr + i * kEntrySize,
+		    (uint32_t) kEntrySize, &should_update_kernel_accounting);
+		T_QUIET; T_ASSERT_EQ(idx, (uint64_t) i, "idx is correct");
+	}
+	kr = mach_vm_reclaim_synchronize(&ringbuffer, kNumEntries);
+	T_QUIET; T_ASSERT_MACH_SUCCESS(kr, "mach_vm_reclaim_synchronize");
+
+	region_addr = addr;
+	kr = mach_vm_region(mach_task_self(), &region_addr, &region_size,
+	    VM_REGION_BASIC_INFO_64, (vm_region_info_t) &info, &count, &unused);
+	T_EXPECT_TRUE(kr != KERN_SUCCESS || region_addr >= addr + kNumEntries * kEntrySize,
+	    "the whole range was deallocated");
+}
+
 static int
 spawn_helper_and_wait_for_exit(char *helper)
 {
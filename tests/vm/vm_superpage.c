@@ -0,0 +1,78 @@
+#include <darwintest.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <mach/mach_init.h>
+#include <mach/mach_vm.h>
+#include <mach/vm_map.h>
+#include <mach/vm_page_size.h>
+#include <TargetConditionals.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"),
+	T_META_ENABLED(TARGET_CPU_ARM64));
+
+#define SP_SIZE (2 * 1024 * 1024)
+
+static mach_vm_address_t
+superpage_allocate(int superpage_flag)
+{
+	mach_vm_address_t addr = 0;
+	kern_return_t kr;
+
+	kr = mach_vm_allocate(mach_task_self(), &addr, SP_SIZE,
+	    VM_FLAGS_ANYWHERE | superpage_flag);
+	if (kr == KERN_NO_SPACE) {
+		T_SKIP("no physically contiguous 2MB run available");
+	}
+	T_ASSERT_MACH_SUCCESS(kr, "mach_vm_allocate(superpage)");
+	T_ASSERT_EQ(addr & (SP_SIZE - 1), 0ULL, "superpage is 2MB aligned");
+	return addr;
+}
+
+T_DECL(superpage_allocate_any,
+    "VM_FLAGS_SUPERPAGE_SIZE_ANY backs anonymous memory with an aligned run")
+{
+	mach_vm_address_t addr = superpage_allocate(VM_FLAGS_SUPERPAGE_SIZE_ANY);
+
+	memset((void *)addr, 0xa5, SP_SIZE);
+	T_EXPECT_EQ(((unsigned char *)addr)[SP_SIZE - 1], 0xa5, "superpage is writable");
+
+	T_ASSERT_MACH_SUCCESS(mach_vm_deallocate(mach_task_self(), addr, SP_SIZE),
+	    "mach_vm_deallocate(superpage)");
+}
+
+T_DECL(superpage_protect_split,
+    "a partial protection change splits a superpage instead of widening")
+{
+	mach_vm_address_t addr = superpage_allocate(VM_FLAGS_SUPERPAGE_SIZE_2MB);
+	mach_vm_address_t region_addr = addr;
+	mach_vm_size_t region_size = 0;
+	vm_region_basic_info_data_64_t info;
+	mach_msg_type_number_t count = VM_REGION_BASIC_INFO_COUNT_64;
+	mach_port_t unused = MACH_PORT_NULL;
+	kern_return_t kr;
+
+	memset((void *)addr, 0x5a, SP_SIZE);
+
+	kr = mach_vm_protect(mach_task_self(), addr, vm_page_size, FALSE, VM_PROT_READ);
+	T_ASSERT_MACH_SUCCESS(kr, "mach_vm_protect(first page, read-only)");
+
+	kr = mach_vm_region(mach_task_self(), &region_addr, &region_size,
+	    VM_REGION_BASIC_INFO_64, (vm_region_info_t)&info, &count, &unused);
+	T_ASSERT_MACH_SUCCESS(kr, "mach_vm_region()");
+	T_EXPECT_EQ(region_addr, addr, "first region starts at the superpage");
+	T_EXPECT_EQ(region_size, (mach_vm_size_t)vm_page_size, "only the first page changed protection");
+	T_EXPECT_EQ(info.protection, VM_PROT_READ, "first page is read-only");
+
+	/* the rest of the run must still be writable */
+	((unsigned char *)addr)[vm_page_size] = 0x11;
+	((unsigned char *)addr)[SP_SIZE - 1] = 0x22;
+	T_EXPECT_EQ(((unsigned char *)addr)[0], 0x5a, "first page contents preserved");
+
+	T_ASSERT_MACH_SUCCESS(mach_vm_deallocate(mach_task_self(), addr, SP_SIZE),
+	    "mach_vm_deallocate(superpage)");
+}
@@ -7,6 +7,7 @@
 #include <mach/mach_vm.h>
 #include <mach/vm_types.h>
 #include <sys/mman.h>
+#include <string.h>
 #include <unistd.h>
 #include <TargetConditionals.h>
 
@@ -186,3 +187,51 @@ T_DECL(permanent_mapping, "check permanent mappings semantics")
 	});
 	T_EXPECT_EQ(rc.sig, SIGBUS, "accessing the mapping caused a SIGBUS");
 }
+
+T_DECL(range_apply, "check mach_vm_range_apply() batches")
+{
+	mach_vm_address_t addr = 0;
+	mach_vm_size_t size = 4 * PAGE_SIZE;
+	mach_vm_size_t count;
+	kern_return_t kr;
+
+	kr = mach_vm_allocate(mach_task_self(), &addr, size, VM_FLAGS_ANYWHERE);
+	T_ASSERT_MACH_SUCCESS(kr, "allocate");
+	memset((void *)addr, 0xa5, size);
+
+	struct mach_vm_range_op ops[] = {
+		{ .address = addr, .size = PAGE_SIZE, .op = MACH_VM_RANGE_OP_PROTECT, .arg = VM_PROT_READ },
+		{ .address = addr + PAGE_SIZE, .size = PAGE_SIZE, .op = MACH_VM_RANGE_OP_BEHAVIOR, .arg = VM_BEHAVIOR_REUSABLE },
+		{ .address = addr + 2 * PAGE_SIZE, .size = 2 * PAGE_SIZE, .op = MACH_VM_RANGE_OP_DEALLOCATE },
+	};
+
+	count = sizeof(ops) / sizeof(ops[0]);
+	kr = mach_vm_range_apply(mach_task_self(), (mach_vm_address_t)ops, &count);
+	T_ASSERT_MACH_SUCCESS(kr, "range apply");
+	T_EXPECT_EQ(count, 3ULL, "all operations applied");
+
+	T_EXPECT_EQ(*(volatile unsigned char *)addr, 0xa5, "protected page still readable");
+
+	struct child_rc rc = fork_child_test(^{
+		*(volatile unsigned char *)addr = 0;
+	});
+	T_EXPECT_NE(rc.sig, 0, "write to the protected page faults");
+
+	mach_vm_address_t probe = addr + 2 * PAGE_SIZE;
+	mach_vm_size_t probe_size;
+	vm_region_basic_info_data_64_t info;
+	mach_msg_type_number_t info_count = VM_REGION_BASIC_INFO_COUNT_64;
+	mach_port_t unused;
+	kr = mach_vm_region(mach_task_self(), &probe, &probe_size, VM_REGION_BASIC_INFO_64,
+	    (vm_region_info_t)&info, &info_count, &unused);
+	T_EXPECT_TRUE(kr != KERN_SUCCESS || probe >= addr + size, "deallocated range is gone");
+
+	ops[0] = (struct mach_vm_range_op){ .address = addr, .size = PAGE_SIZE, .op = 42 };
+	count = 1;
+	kr = mach_vm_range_apply(mach_task_self(), (mach_vm_address_t)ops, &count);
+	T_EXPECT_MACH_ERROR(kr, KERN_INVALID_ARGUMENT, "unknown operation is rejected");
+	T_EXPECT_EQ(count, 0ULL, "nothing applied");
+
+	kr = mach_vm_deallocate(mach_task_self(), addr, 2 * PAGE_SIZE);
+	T_EXPECT_MACH_SUCCESS(kr, "deallocate");
+}
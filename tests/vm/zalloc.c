@@ -1,5 +1,7 @@
 #include <sys/sysctl.h>
 #include <signal.h>
+#include <mach/mach.h>
+#include <mach/mach_host.h>
 #include <darwintest.h>
 #include <darwintest_utils.h>
 
@@ -41,6 +43,41 @@ T_DECL(zone_stress_test, "Zone stress test of edge cases",
 	T_EXPECT_EQ(1ull, run_sysctl_test("zone_stress_test", 0), "zone_stress_test");
 }
 
+T_DECL(zone_batch_test, "zalloc_n/zfree_n test",
+    T_META_CHECK_LEAKS(false))
+{
+	T_EXPECT_EQ(1ull, run_sysctl_test("zone_batch_test", 0), "zone_batch_test");
+}
+
+T_DECL(zone_latency_info, "mach_zone_get_latency_info() reports slow paths",
+    T_META_CHECK_LEAKS(false))
+{
+	mach_zone_name_t name = { .mzn_name = "data.kalloc.128" };
+	mach_zone_latency_info_t info;
+	kern_return_t kr;
+
+	/* Churn the zone through its slow paths. */
+	T_EXPECT_EQ(1ull, run_sysctl_test("zone_stress_test", 0), "zone_stress_test");
+
+	kr = mach_zone_get_latency_info(mach_host_self(), name, &info);
+	T_ASSERT_MACH_SUCCESS(kr, "mach_zone_get_latency_info(%s)", name.mzn_name);
+
+	for (int path = 0; path < MZL_PATH_COUNT; path++) {
+		uint64_t total = 0;
+
+		for (int i = 0; i < MACH_ZONE_LATENCY_BUCKETS; i++) {
+			total += info.mzl_hist[path][i];
+		}
+		T_EXPECT_EQ(total != 0, info.mzl_count[path] != 0,
+		    "path %d: events are in the histogram", path);
+	}
+	T_EXPECT_GT(info.mzl_count[MZL_PATH_DEPOT], 0ull, "depot refills were recorded");
+
+	strlcpy(name.mzn_name, "no.such.zone", sizeof(name.mzn_name));
+	kr = mach_zone_get_latency_info(mach_host_self(), name, &info);
+	T_EXPECT_EQ(kr, KERN_INVALID_ARGUMENT, "unknown zones are rejected");
+}
+
 #define ZLOG_ZONE "data.kalloc.128"
 
 T_DECL(zlog_smoke_test, "check that zlog functions at all",
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+
+"""
+Derive kalloc size classes from observed allocation sizes.
+
+Boot with kalloc_size_histo=1, run the workload of interest, then run this
+script on the device. It reads the per-heap request size histograms
+(kern.kalloc_size_histogram.<heap>) and the current size classes
+(kern.kalloc_size_classes.<heap>), reports the internal fragmentation of the
+current table, and computes the table with the same number of classes that
+wastes the fewest bytes for the recorded requests.
+
+The result is printed as KZC_ENTRY() lines for k_zone_cfg / k_zone_cfg_data
+in osfmk/kern/kalloc.c and, for the data heap, as a kalloc_data_sizes=
+boot-arg that can be tried without rebuilding the kernel. Sizes are
+rounded to the 16 byte histogram granule, so waste below that is not seen.
+
+    kalloc_sizeclass_tune.py [--heap data] [--save out.json]
+    kalloc_sizeclass_tune.py --load out.json [--classes N]
+"""
+
+import argparse
+import ctypes
+import ctypes.util
+import json
+import os
+import struct
+import sys
+
+
+HEAPS = ("default", "data", "kt_var")
+GRANULE = 16
+
+
+def sysctl(name):
+    libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+    size = ctypes.c_size_t(0)
+    if libc.sysctlbyname(name.encode(), None, ctypes.byref(size), None, 0):
+        err = ctypes.get_errno()
+        raise OSError(err, os.strerror(err), name)
+    buf = ctypes.create_string_buffer(size.value)
+    if libc.sysctlbyname(name.encode(), buf, ctypes.byref(size), None, 0):
+        err = ctypes.get_errno()
+        raise OSError(err, os.strerror(err), name)
+    return buf.raw[:size.value]
+
+
+def read_heap(heap):
+    histo = sysctl("kern.kalloc_size_histogram." + heap)
+    classes = sysctl("kern.kalloc_size_classes." + heap)
+    return {
+        "histogram": list(struct.unpack("<{}Q".format(len(histo) // 8), histo)),
+        "classes": list(struct.unpack("<{}I".format(len(classes) // 4), classes)),
+    }
+
+
+def requests(histogram):
+    """(size, count) for the requests served by zones, largest bucket excluded."""
+    return [(i * GRANULE, n) for i, n in enumerate(histogram[:-1]) if i and n]
+
+
+def fragmentation(reqs, classes):
+    """Per class (size, requests, requested bytes, wasted bytes)."""
+    rows = [[size, 0, 0, 0] for size in classes]
+    ci = 0
+    for size, n in reqs:
+        while classes[ci] < size:
+            ci += 1
+        rows[ci][1] += n
+        rows[ci][2] += n * size
+        rows[ci][3] += n * (classes[ci] - size)
+    return rows
+
+
+def optimize(reqs, nclasses, max_size):
+    """
+    Pick nclasses sizes among the observed ones (and max_size, which must
+    stay the last class) minimizing the total waste.
+
+    With candidates c_0 < ... < c_m sorted, waste(i, j) of a class of size
+    c_j serving (c_i, c_j] is c_j * (N_j - N_i) - (B_j - B_i) using prefix
+    counts N and bytes B, which makes the usual O(k * m^2) dynamic program.
+    """
+    cands = sorted({size for size, _ in reqs} | {max_size})
+    m = len(cands)
+    if nclasses >= m:
+        return cands
+
+    counts = dict(reqs)
+    pn = [0] * (m + 1)
+    pb = [0] * (m + 1)
+    for j, size in enumerate(cands):
+        pn[j + 1] = pn[j] + counts.get(size, 0)
+        pb[j + 1] = pb[j] + counts.get(size, 0) * size
+
+    def waste(i, j):
+        # class cands[j - 1] serving cands[i:j]
+        return cands[j - 1] * (pn[j] - pn[i]) - (pb[j] - pb[i])
+
+    inf = float("inf")
+    best = [[inf] * (m + 1) for _ in range(nclasses + 1)]
+    prev = [[0] * (m + 1) for _ in range(nclasses + 1)]
+    best[0][0] = 0
+    for k in range(1, nclasses + 1):
+        for j in range(k, m + 1):
+            for i in range(k - 1, j):
+                if best[k - 1][i] == inf:
+                    continue
+                cost = best[k - 1][i] + waste(i, j)
+                if cost < best[k][j]:
+                    best[k][j] = cost
+                    prev[k][j] = i
+
+    sizes = []
+    j = m
+    for k in range(nclasses, 0, -1):
+        sizes.append(cands[j - 1])
+        j = prev[k][j]
+    return sorted(sizes)
+
+
+def print_report(title, rows):
+    total_n = sum(r[1] for r in rows)
+    total_req = sum(r[2] for r in rows)
+    total_waste = sum(r[3] for r in rows)
+
+    print(title)
+    print("  {:>8} {:>12} {:>14} {:>14} {:>7}".format(
+        "class", "requests", "requested", "wasted", "waste%"))
+    for size, n, req, wasted in rows:
+        print("  {:>8} {:>12} {:>14} {:>14} {:>6.1f}%".format(
+            size, n, req, wasted, 100.0 * wasted / (req + wasted) if n else 0))
+    print("  {:>8} {:>12} {:>14} {:>14} {:>6.1f}%".format(
+        "total", total_n, total_req, total_waste,
+        100.0 * total_waste / (total_req + total_waste) if total_n else 0))
+    print()
+    return total_waste
+
+
+def tune_heap(heap, data, nclasses):
+    histogram, classes = data["histogram"], data["classes"]
+    reqs = requests(histogram)
+
+    print("=== {} heap: {} requests, {} above {} bytes ===\n".format(
+        heap, sum(n for _, n in reqs), histogram[-1], classes[-1]))
+    if not reqs:
+        return
+
+    before = print_report("current size classes", fragmentation(reqs, classes))
+    tuned = optimize(reqs, nclasses or len(classes), classes[-1])
+    after = print_report("tuned size classes", fragmentation(reqs, tuned))
+    if before:
+        print("waste: {} -> {} bytes ({:+.1f}%)\n".format(
+            before, after, 100.0 * (after - before) / before))
+
+    # Caching only pays off for the busy classes.
+    rows = fragmentation(reqs, tuned)
+    total = sum(r[1] for r in rows)
+    for size, n, _, _ in rows:
+        print("\tKZC_ENTRY({}, {}),".format(
+            size, "true" if size <= 1024 and n * 100 >= total else "false"))
+    if heap == "data":
+        print("\nkalloc_data_sizes={}".format(",".join(str(s) for s in tuned)))
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--heap", choices=HEAPS, action="append",
+        help="heap to tune (default: all)")
+    parser.add_argument("--classes", type=int, default=0,
+        help="number of size classes (default: as many as today)")
+    parser.add_argument("--load", metavar="JSON",
+        help="read histograms saved with --save instead of sysctl")
+    parser.add_argument("--save", metavar="JSON",
+        help="save the histograms read from sysctl")
+    args = parser.parse_args()
+
+    heaps = args.heap or HEAPS
+    if args.load:
+        with open(args.load) as f:
+            data = json.load(f)
+    else:
+        data = {}
+        for heap in heaps:
+            try:
+                data[heap] = read_heap(heap)
+            except OSError as e:
+                sys.exit("{}: {} (was the kernel booted with "
+                    "kalloc_size_histo=1?)".format(e.filename, e.strerror))
+        if args.save:
+            with open(args.save, "w") as f:
+                json.dump(data, f)
+
+    for heap in heaps:
+        if heap in data:
+            tune_heap(heap, data[heap], args.classes)
+
+
+if __name__ == "__main__":
+    main()
@@ -2076,7 +2076,8 @@ PRETTIFY_FLAGS = {
         'page_tables',
         'disable_latency_info',
         'save_dyld_compactinfo',
-        'include_driver_threads_in_kernel'
+        'include_driver_threads_in_kernel',
+        'delta_ring'
     ],
     'system_state_flags': [
         'kUser64_p',
@@ -93,9 +93,12 @@ def IterateProcKnotes(proc):
             for kn in IterateListEntry(proc.p_fd.fd_knlist[i], 'struct knote *', 'kn_link', list_prefix='s'):
                 yield kn
     if int(proc.p_fd.fd_knhash) != 0:
-        for i in range(proc.p_fd.fd_knhashmask + 1):
-            for kn in IterateListEntry(proc.p_fd.fd_knhash[i], 'struct knote *', 'kn_link', list_prefix='s'):
-                yield kn
+        kh = proc.p_fd.fd_knhash
+        for s in range(sizeof(kh.kh_shards) // sizeof(kh.kh_shards[0])):
+            kht = kh.kh_shards[s].ks_table
+            for i in range(kht.kht_mask + 1):
+                for kn in IterateListEntry(kht.kht_list[i], 'struct knote *', 'kn_link', list_prefix='s'):
+                    yield kn
 
 def GetKnoteKqueue(kn):
     """ Get the kqueue corresponding to a given knote
@@ -715,8 +715,8 @@ def WhatIsHelper(cmd_args=None):
 # Macro: showzcache
 
 @lldb_type_summary(['zone','zone_t'])
-@header("{:18s}  {:32s}  {:>6s}  {:>6s}  {:>6s}  {:>6s}  {:>6s}  {:>6s}  {:<s}".format(
-    'ZONE', 'NAME', 'WSS', 'CONT', 'USED', 'FREE', 'CACHED', 'RECIRC', 'CPU_CACHES'))
+@header("{:18s}  {:32s}  {:>6s}  {:>6s}  {:>6s}  {:>6s}  {:>6s}  {:>6s}  {:>6s}  {:>6s}  {:<s}".format(
+    'ZONE', 'NAME', 'WSS', 'CONT', 'USED', 'FREE', 'CACHED', 'RECIRC', 'GROW', 'SHRINK', 'CPU_CACHES'))
 def GetZoneCacheCPUSummary(zone, zone_security, verbose, O):
     """ Summarize a zone's cache broken up per cpu
         params:
@@ -727,7 +727,8 @@ def GetZoneCacheCPUSummary(zone, zone_security, verbose, O):
     format_string  = '{zone:#018x}  {:32s}  '
     format_string += '{zone.z_elems_free_wss:6d}  {cont:6.2f}  '
     format_string += '{used:6d}  {zone.z_elems_free:6d}  '
-    format_string += '{cached:6d}  {recirc:6d}  {cpuinfo:s}'
+    format_string += '{cached:6d}  {recirc:6d}  '
+    format_string += '{zone.z_depot_grows:6d}  {zone.z_depot_shrinks:6d}  {cpuinfo:s}'
     cache_elem_count = 0
     cpu_info = ""
     mag_capacity = unsigned(kern.GetGlobalVariable('zc_magazine_size'))
@@ -794,6 +795,79 @@ def ZcacheCPUPrint(cmd_args=None, cmd_options={}, O=None):
 
 # EndMacro: showzcache
 
+# Macro: showzonelatency
+
+ZONE_LATENCY_PATHS = ['CACHE', 'DEPOT', 'EXPAND', 'GC_STALL']
+ZONE_LATENCY_BUCKETS = 20 # MACH_ZONE_LATENCY_BUCKETS
+
+def GetZoneLatencyBucketLabel(i, nbuckets):
+    """ Returns the range of a mach_zone_latency_info histogram bucket """
+    if i == 0:
+        return "< 256ns"
+    if i == nbuckets - 1:
+        return ">= {:d}ns".format(1 << (i + 7))
+    return "{:d}-{:d}ns".format(1 << (i + 7), 1 << (i + 8))
+
+@header("{:32s}  {:>9s}  {:>10s}  {:>9s}  {:>10s}  {:>9s}  {:>10s}  {:>9s}  {:>10s}".format(
+    'NAME', 'CACHE', 'AVG(ns)', 'DEPOT', 'AVG(ns)', 'EXPAND', 'AVG(ns)', 'GC_STALL', 'AVG(ns)'))
+def GetZoneLatencySummary(zone, zone_security, zls, verbose, O):
+    """ Summarize the allocation path latency of a zone
+        params:
+          zone: value - obj representing a zone in kernel
+          zls: value - the zone's struct zone_latency_stats
+        returns:
+          str - one line per zone, and histograms when verbose
+    """
+    columns = ""
+    for path in range(len(ZONE_LATENCY_PATHS)):
+        count = unsigned(zls.zls_count[path])
+        total = unsigned(zls.zls_total_ns[path])
+        columns += "  {:9d}  {:10d}".format(count, total // count if count else 0)
+    print(O.format("{:32s}{:s}", ZoneName(zone, zone_security), columns))
+
+    if not verbose:
+        return
+    nbuckets = ZONE_LATENCY_BUCKETS
+    for path in range(len(ZONE_LATENCY_PATHS)):
+        if unsigned(zls.zls_count[path]) == 0:
+            continue
+        print("    {:s}:".format(ZONE_LATENCY_PATHS[path]))
+        for i in range(nbuckets):
+            count = unsigned(zls.zls_hist[path][i])
+            if count:
+                print("      {:>20s}  {:d}".format(GetZoneLatencyBucketLabel(i, nbuckets), count))
+
+@lldb_command('showzonelatency', "V", fancy=True)
+def ShowZoneLatency(cmd_args=None, cmd_options={}, O=None):
+    """
+    Print the allocation path latency recorded for each zone: how many
+    allocations were served by the per-cpu cache (sampled), refilled the
+    cache from a depot, expanded the zone, or stalled on the GC, and their
+    average latency.
+
+    Usage: showzonelatency [-V] [<zone>]
+
+    Use -V       to also print the latency histograms
+    """
+    verbose = "-V" in cmd_options
+    stats = kern.globals.zone_latency_stats
+    print("cache hits sampled 1 in {:d}".format(unsigned(kern.globals.zlat_sample_rate)))
+    with O.table(GetZoneLatencySummary.header):
+        if len(cmd_args) == 1:
+            zone = kern.GetValueFromAddress(cmd_args[0], 'struct zone *')
+            zone_array = [z[0] for z in kern.zones]
+            zid = zone_array.index(zone)
+            GetZoneLatencySummary(zone, kern.zones[zid][1], stats[zid], verbose, O)
+        else:
+            for zid, (zval, zsval) in enumerate(kern.zones):
+                if not zval.z_self:
+                    continue
+                zls = stats[zid]
+                if sum(unsigned(zls.zls_count[p]) for p in range(len(ZONE_LATENCY_PATHS))):
+                    GetZoneLatencySummary(zval, zsval, zls, verbose, O)
+
+# EndMacro: showzonelatency
+
 def kalloc_array_decode(addr, ptr_type = None):
     pac_shift = unsigned(kern.globals.kalloc_array_type_shift)
     page_size = kern.globals.page_size
@@ -861,6 +935,15 @@ def GetZone(zone_val, zs_val, marks, security_marks):
     zone["cache_element_count"] = cache_elem_count
     zone["free_element_count"] = unsigned(zone_val.z_elems_free)
 
+    depot_max = 0
+    if zone_val.z_pcpu_cache:
+        for cache in IterateZPerCPU(zone_val.z_pcpu_cache):
+            depot_max += unsigned(cache.zc_depot_max)
+    zone["cache_depot_max"] = depot_max
+    zone["cache_contention"] = float(zone_val.z_contention_wma) / 256.
+    zone["cache_depot_grows"] = unsigned(zone_val.z_depot_grows)
+    zone["cache_depot_shrinks"] = unsigned(zone_val.z_depot_shrinks)
+
     if zone_val.z_percpu:
         zone["allocation_size"] = unsigned(pagesize)
         zone["allocation_ncpu"] = unsigned(zone_val.z_chunk_pages)
@@ -195,6 +195,9 @@ def longtermTimers(cmd_args=None):
     print(' number of enqueues  : {:d}'    .format(lt.enqueues))
     print(' number of dequeues  : {:d}'    .format(lt.dequeues))
     print(' number of escalates : {:d}'    .format(lt.escalates))
+    if unsigned(lt.wheel_width) != 0:
+        print(' wheel cursor        : {:d}'    .format(lt.wheel_cursor))
+        print(' wheel cascades      : {:d}'    .format(lt.wheel_cascades))
     print(' enqueues/escalates  : {:d}'    .format(ratio))
     print(' threshold.interval  : {:d}'    .format(ltt.interval))
     print(' threshold.margin    : {:d}'    .format(ltt.margin))
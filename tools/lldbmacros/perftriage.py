@@ -0,0 +1,378 @@
+""" Please make sure you read the README COMPLETELY BEFORE reading anything below.
+    It is very critical that you read coding guidelines in Section E in README file.
+
+    Macros to triage latency incidents and hangs: what is waiting to run and for
+    how long, which locks are contended and who owns them, which zones are
+    starved, and how deep the VM and network queues are.
+"""
+from __future__ import absolute_import, division, print_function
+
+from xnu import *
+from utils import *
+from process import GetThreadName, GetProcNameForTask, GetThreadSummary
+from scheduler import GetRecentTimestamp
+from waitq import Waitq
+from turnstile import GetTurnstileSummary
+from memory import ZoneName, GetZoneByName, IterateZPerCPU, IterateZoneElements
+
+TH_WAIT = 0x01
+TH_RUN = 0x04
+
+TURNSTILE_INHERITOR_THREAD = 0x4
+TURNSTILE_INHERITOR_TURNSTILE = 0x8
+TURNSTILE_INHERITOR_WORKQ = 0x40
+
+def _AbsToUs(abstime):
+    return kern.GetNanotimeFromAbstime(abstime) / 1000.0
+
+def _IterateAllThreads():
+    for task in kern.tasks:
+        for thread in IterateQueue(task.threads, 'thread *', 'task_threads'):
+            yield thread
+
+def _ThreadLabel(thread):
+    name = GetThreadName(thread)
+    proc = GetProcNameForTask(thread.t_tro.tro_task)
+    return "{:s}{:s}".format(proc, "/" + name if name else "")
+
+# Macro: showrunqlatency
+
+@header("{:<20s} {:>6s} {:>10s} {:>4s} {:>14s}  {:<s}".format(
+    "thread", "cpu", "tid", "pri", "time (us)", "process/thread"))
+def GetRunqLatencyThreadSummary(thread, cpu, elapsed):
+    """ Summarize a running or runnable thread with the time it has been
+        running (for the active thread) or waiting to run (for runq threads).
+    """
+    return "{:<#020x} {:>6s} {:>#10x} {:>4d} {:>14.3f}  {:<s}".format(
+            unsigned(thread), cpu, unsigned(thread.thread_id), int(thread.sched_pri),
+            _AbsToUs(elapsed), _ThreadLabel(thread))
+
+@lldb_command('showrunqlatency', 'N:', fancy=True)
+def ShowRunqLatency(cmd_args=None, cmd_options={}, O=None):
+    """ For every processor, show how long its active thread has been on core,
+        and the runnable threads enqueued on it sorted by how long they have
+        been waiting to run.
+
+        Usage: showrunqlatency [-N <count>]
+
+        -N <count>   only show the <count> longest waiting threads per run
+                     queue (default 5, 0 shows all of them)
+    """
+    limit = 5
+    if "-N" in cmd_options:
+        limit = ArgumentStringToInt(cmd_options["-N"])
+
+    now = GetRecentTimestamp()
+    waiting = {}
+    for thread in _IterateAllThreads():
+        if not (unsigned(thread.state) & TH_RUN) or not unsigned(thread.runq):
+            continue
+        waiting.setdefault(unsigned(thread.runq), []).append(thread)
+
+    print("timestamp: {:d}".format(now))
+    for processor in IterateLinkedList(kern.globals.processor_list, 'processor_list'):
+        cpu = "{:d}".format(processor.cpu_id)
+        print("Processor {:<#018x} cpu {:s} pset {:d}".format(unsigned(processor), cpu,
+                processor.processor_set.pset_id))
+        with O.table(GetRunqLatencyThreadSummary.header, indent=True):
+            active = processor.active_thread
+            if unsigned(active):
+                dispatch = unsigned(processor.last_dispatch)
+                print(GetRunqLatencyThreadSummary(active, cpu + "*",
+                        now - dispatch if now > dispatch else 0))
+
+            threads = waiting.get(unsigned(processor), [])
+            threads.sort(key=lambda t: unsigned(t.last_made_runnable_time))
+            for thread in threads[:limit] if limit else threads:
+                made_runnable = unsigned(thread.last_made_runnable_time)
+                print(GetRunqLatencyThreadSummary(thread, cpu,
+                        now - made_runnable if now > made_runnable else 0))
+            if limit and len(threads) > limit:
+                print("... {:d} more runnable threads".format(len(threads) - limit))
+
+# EndMacro: showrunqlatency
+
+# Macro: showcontendedlocks
+
+def _TurnstileWaiters(ts):
+    return [t for t in IterateSchedPriorityQueue(ts.ts_waitq.waitq_prio_queue,
+            'struct thread', 'wait_prioq_links')]
+
+def _TurnstileInheritorChain(ts, O):
+    """ Follow the push of a turnstile through the threads and turnstiles
+        it is inherited by, printing each link until the chain ends in a
+        thread that is running, runnable, or blocked on something that is
+        not a turnstile.
+    """
+    seen = set()
+    depth = 1
+    while ts and unsigned(ts) not in seen:
+        seen.add(unsigned(ts))
+        flags = unsigned(ts.ts_inheritor_flags)
+        inheritor = unsigned(ts.ts_waitq.waitq_inheritor)
+        prefix = "  " * depth + "-> "
+
+        if not inheritor:
+            print(prefix + "no inheritor")
+            return
+        if flags & TURNSTILE_INHERITOR_WORKQ:
+            print(prefix + "workqueue {:#x}".format(inheritor))
+            return
+        if flags & TURNSTILE_INHERITOR_TURNSTILE:
+            ts = kern.GetValueFromAddress(inheritor, 'struct turnstile *')
+            print(prefix + "turnstile {:#x} pri {:d}".format(inheritor, ts.ts_priority))
+            depth += 1
+            continue
+        if not flags & TURNSTILE_INHERITOR_THREAD:
+            print(prefix + "inheritor {:#x} flags {:#x}".format(inheritor, flags))
+            return
+
+        thread = kern.GetValueFromAddress(inheritor, 'thread *')
+        state = unsigned(thread.state)
+        print(prefix + "thread {:#x} tid {:#x} pri {:d} {:s} {:s}".format(inheritor,
+                unsigned(thread.thread_id), int(thread.sched_pri),
+                "waiting" if state & TH_WAIT else "running" if state & TH_RUN else "state {:#x}".format(state),
+                _ThreadLabel(thread)))
+        if not state & TH_WAIT or not unsigned(thread.waitq.wq_q):
+            return
+        ts = Waitq(thread.waitq.wq_q).asTurnstile()
+        if ts is None:
+            print("  " * (depth + 1) + "blocked on event {:#x}".format(unsigned(thread.wait_event)))
+            return
+        print("  " * (depth + 1) + "blocked on turnstile {:#x}".format(unsigned(ts)))
+        depth += 2
+
+@lldb_command('showcontendedlocks', 'VN:', fancy=True)
+def ShowContendedLocks(cmd_args=None, cmd_options={}, O=None):
+    """ Show every turnstile that has waiters, most waiters first, with the
+        chain of threads and turnstiles its priority push is inherited by.
+        A long chain or one ending in a waiting thread usually points at
+        the lock responsible for a hang.
+
+        Usage: showcontendedlocks [-V] [-N <count>]
+
+        -V           also list the waiting threads
+        -N <count>   only show the <count> most contended turnstiles
+    """
+    verbose = "-V" in cmd_options
+    limit = 0
+    if "-N" in cmd_options:
+        limit = ArgumentStringToInt(cmd_options["-N"])
+
+    contended = []
+    for ts in IterateZoneElements(GetZoneByName("turnstiles"), 'struct turnstile *'):
+        if not unsigned(ts.ts_proprietor):
+            continue
+        if not unsigned(ts.ts_waitq.waitq_prio_queue.pq_root):
+            continue
+        contended.append((len(_TurnstileWaiters(ts)), ts))
+
+    contended.sort(key=lambda e: e[0], reverse=True)
+    if limit:
+        contended = contended[:limit]
+
+    for nwaiters, ts in contended:
+        print("")
+        print("{:d} waiter(s) on proprietor {:#x}".format(nwaiters, unsigned(ts.ts_proprietor)))
+        with O.table(GetTurnstileSummary.header):
+            print(GetTurnstileSummary(ts))
+        _TurnstileInheritorChain(ts, O)
+        if verbose:
+            with O.table(GetThreadSummary.header, indent=True):
+                for thread in _TurnstileWaiters(ts):
+                    print(GetThreadSummary(thread, O=O))
+
+# EndMacro: showcontendedlocks
+
+# Macro: showzonedepotstarvation
+
+@header("{:<18s}  {:<32s}  {:>8s}  {:>8s}  {:>8s}  {:>8s}  {:>8s}  {:>6s}  {:>6s}  {:<s}".format(
+    "ZONE", "NAME", "FREE", "FREE_MIN", "CACHED", "RECIRC", "CONT", "GROWS", "EMPTY", "STATE"))
+def GetZoneDepotStarvationSummary(zone, zone_security, cached, empty_cpus, O):
+    """ Summarize how close a zone is to running dry """
+    state = []
+    if zone.z_expander:
+        state.append("expanding")
+    if zone.z_expanding_wait:
+        state.append("waiters")
+    if zone.z_async_refilling:
+        state.append("refilling")
+    if zone.z_wired_max and zone.z_wired_cur >= zone.z_wired_max:
+        state.append("at-max")
+
+    return O.format("{:<#018x}  {:<32s}  {:>8d}  {:>8d}  {:>8d}  {:>8d}  {:>8.2f}  {:>6d}  {:>6d}  {:<s}",
+            unsigned(zone), ZoneName(zone, zone_security), unsigned(zone.z_elems_free),
+            unsigned(zone.z_elems_free_min), cached,
+            unsigned(zone.z_recirc_cur) * unsigned(kern.GetGlobalVariable('zc_magazine_size')),
+            float(zone.z_contention_wma) / 256., unsigned(zone.z_depot_grows), empty_cpus,
+            ",".join(state))
+
+@lldb_command('showzonedepotstarvation', 'A', fancy=True)
+def ShowZoneDepotStarvation(cmd_args=None, cmd_options={}, O=None):
+    """ Show zones whose allocations are likely to stall: zones being
+        expanded or with threads waiting for expansion, zones at their size
+        limit, and caching zones whose recirculation depot is empty while
+        some CPUs have no cached elements left. Sorted by lock contention.
+
+        EMPTY is the number of CPUs whose cache is empty, CACHED the number of
+        elements held in per-cpu caches and RECIRC in the recirculation depot.
+
+        Usage: showzonedepotstarvation [-A]
+
+        -A           show all zones, not only the starved ones
+    """
+    show_all = "-A" in cmd_options
+    rows = []
+    for zone, zone_security in kern.zones:
+        if not zone.z_self:
+            continue
+
+        cached = 0
+        empty_cpus = 0
+        if zone.z_pcpu_cache:
+            for cache in IterateZPerCPU(zone.z_pcpu_cache):
+                n = unsigned(cache.zc_alloc_cur) + unsigned(cache.zc_free_cur)
+                if n == 0 and unsigned(cache.zc_depot_cur) == 0:
+                    empty_cpus += 1
+                cached += n
+                cached += unsigned(cache.zc_depot_cur) * unsigned(kern.GetGlobalVariable('zc_magazine_size'))
+
+        starved = (zone.z_expander or zone.z_expanding_wait or
+                (zone.z_wired_max and zone.z_wired_cur >= zone.z_wired_max) or
+                (empty_cpus and unsigned(zone.z_recirc_cur) == 0 and
+                unsigned(zone.z_elems_free) == 0))
+        if starved or show_all:
+            rows.append((unsigned(zone.z_contention_wma), zone, zone_security, cached, empty_cpus))
+
+    rows.sort(key=lambda r: r[0], reverse=True)
+    with O.table(GetZoneDepotStarvationSummary.header):
+        for _, zone, zone_security, cached, empty_cpus in rows:
+            print(GetZoneDepotStarvationSummary(zone, zone_security, cached, empty_cpus, O))
+
+# EndMacro: showzonedepotstarvation
+
+# Macro: showvmqueuedepths
+
+def _PageoutQueueSummary(name, q):
+    flags = []
+    if q.pgo_idle:
+        flags.append("idle")
+    if q.pgo_busy:
+        flags.append("busy")
+    if q.pgo_throttled:
+        flags.append("throttled")
+    if q.pgo_draining:
+        flags.append("draining")
+    if unsigned(q.pgo_laundry) >= unsigned(q.pgo_maxlaundry):
+        flags.append("FULL")
+    return "{:<24s} laundry {:>8d} / {:<8d} tid {:#x} {:s}".format(name,
+            unsigned(q.pgo_laundry), unsigned(q.pgo_maxlaundry),
+            unsigned(q.pgo_tid), ",".join(flags))
+
+@lldb_command('showvmqueuedepths')
+def ShowVMQueueDepths(cmd_args=None):
+    """ Show the depth of the page queues, of the pageout laundry queues and
+        of the compressor segment queues, to tell a pageout or compressor
+        backlog apart from plain memory pressure.
+
+        Usage: showvmqueuedepths
+    """
+    g = kern.globals
+
+    print("Page queues (pages):")
+    print("  free {:d} (min {:d}, target {:d}, wanted {:d})".format(
+            unsigned(g.vm_page_free_count), unsigned(g.vm_page_free_min),
+            unsigned(g.vm_page_free_target), unsigned(g.vm_page_free_wanted)))
+    print("  active {:d} inactive {:d} speculative {:d} throttled {:d}".format(
+            unsigned(g.vm_page_active_count), unsigned(g.vm_page_inactive_count),
+            unsigned(g.vm_page_speculative_count), unsigned(g.vm_page_throttled_count)))
+    print("  anonymous {:d} file-backed {:d} cleaned {:d}".format(
+            unsigned(g.vm_page_anonymous_count), unsigned(g.vm_page_pageable_external_count),
+            unsigned(g.vm_page_cleaned_count)))
+
+    print("Pageout queues:")
+    print("  " + _PageoutQueueSummary("internal", g.vm_pageout_queue_internal))
+    print("  " + _PageoutQueueSummary("external", g.vm_pageout_queue_external))
+
+    print("Compressor segments:")
+    print("  total {:d} (max {:d}) filling {:d} empty {:d} age {:d} minor {:d} major {:d}".format(
+            unsigned(g.c_segment_count), unsigned(g.c_segment_count_max),
+            unsigned(g.c_filling_count), unsigned(g.c_empty_count), unsigned(g.c_age_count),
+            unsigned(g.c_minor_count), unsigned(g.c_major_count)))
+    print("  swapout early {:d} regular {:d} late {:d} swapio {:d}".format(
+            unsigned(g.c_early_swapout_count), unsigned(g.c_regular_swapout_count),
+            unsigned(g.c_late_swapout_count), unsigned(g.c_swapio_count)))
+    print("  swappedin early {:d} regular {:d} late {:d} swappedout {:d} (sparse {:d}) bad {:d}".format(
+            unsigned(g.c_early_swappedin_count), unsigned(g.c_regular_swappedin_count),
+            unsigned(g.c_late_swappedin_count), unsigned(g.c_swappedout_count),
+            unsigned(g.c_swappedout_sparse_count), unsigned(g.c_bad_count)))
+    print("  compressed pages {:d}".format(unsigned(g.c_segment_pages_compressed)))
+
+# EndMacro: showvmqueuedepths
+
+# Macro: showifnetqueues
+
+@header("{:<18s} {:<16s} {:>10s} {:>10s} {:>6s} {:>14s} {:>10s}".format(
+    "ifnet", "name", "snd_len", "snd_max", "full%", "snd_drops", "input_len"))
+def GetIfnetQueueSummary(ifp):
+    """ Summarize the transmit class queue and the DLIL input queue of an
+        interface.
+    """
+    snd_len = snd_max = drops = 0
+    if unsigned(ifp.if_snd):
+        snd_len = unsigned(ifp.if_snd.ifcq_len)
+        snd_max = unsigned(ifp.if_snd.ifcq_maxlen)
+        drops = unsigned(ifp.if_snd.ifcq_dropcnt.packets)
+    dlifp = Cast(ifp, 'dlil_ifnet *')
+    in_len = unsigned(dlifp.dl_if_inpstorage.dlth_pkts.qlen)
+
+    return "{:<#018x} {:<16s} {:>10d} {:>10d} {:>6.1f} {:>14d} {:>10d}".format(
+            unsigned(ifp), str(ifp.if_xname), snd_len, snd_max,
+            100.0 * snd_len / snd_max if snd_max else 0, drops, in_len)
+
+@lldb_command('showifnetqueues', 'A', fancy=True)
+def ShowIfnetQueues(cmd_args=None, cmd_options={}, O=None):
+    """ Show the occupancy of the transmit and input queues of the attached
+        interfaces, fullest first.
+
+        Usage: showifnetqueues [-A]
+
+        -A           also show interfaces with empty queues
+    """
+    show_all = "-A" in cmd_options
+    rows = []
+    for ifp in IterateTAILQ_HEAD(kern.globals.ifnet_head, "if_link"):
+        snd_len = unsigned(ifp.if_snd.ifcq_len) if unsigned(ifp.if_snd) else 0
+        in_len = unsigned(Cast(ifp, 'dlil_ifnet *').dl_if_inpstorage.dlth_pkts.qlen)
+        if snd_len or in_len or show_all:
+            rows.append((snd_len + in_len, ifp))
+
+    rows.sort(key=lambda r: r[0], reverse=True)
+    with O.table(GetIfnetQueueSummary.header):
+        for _, ifp in rows:
+            print(GetIfnetQueueSummary(ifp))
+
+# EndMacro: showifnetqueues
+
+# Macro: showperftriage
+
+@lldb_command('showperftriage', fancy=True)
+def ShowPerfTriage(cmd_args=None, cmd_options={}, O=None):
+    """ Run the performance triage macros in sequence: run queue latency,
+        contended locks, starved zones, VM queue depths and interface queues.
+
+        Usage: showperftriage
+    """
+    for title, fn in [
+            ("Run queue latency", lambda: ShowRunqLatency(cmd_args=[], cmd_options={}, O=O)),
+            ("Contended locks", lambda: ShowContendedLocks(cmd_args=[], cmd_options={"-N": "10"}, O=O)),
+            ("Zone depot starvation", lambda: ShowZoneDepotStarvation(cmd_args=[], cmd_options={}, O=O)),
+            ("VM queue depths", lambda: ShowVMQueueDepths(cmd_args=[])),
+            ("Interface queues", lambda: ShowIfnetQueues(cmd_args=[], cmd_options={}, O=O))]:
+        print("\n===== {:s} =====".format(title))
+        try:
+            fn()
+        except Exception as e:
+            print("failed: {:s}".format(str(e)))
+
+# EndMacro: showperftriage
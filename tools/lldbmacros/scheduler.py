@@ -1217,6 +1217,13 @@ def PrintThreadGroup(group):
         "Blocked: {g.blocked_count:<3d} Pending: {g.pending_count:<3d} " +
         "Target: {g.target_thread_count:<3d}\n").format(g=group))
 
+    if unsigned(group.tcg_invokes) != 0 :
+        latency_avg = unsigned(group.tcg_latency_total) // unsigned(group.tcg_invokes)
+        print(("\t" + "Invoked: {g.tcg_invokes:d} Stolen: {g.tcg_steals:d} " +
+            "Latency avg: {:d} ns max: {:d} ns\n").format(
+            kern.GetNanotimeFromAbstime(latency_avg),
+            kern.GetNanotimeFromAbstime(unsigned(group.tcg_latency_max)), g=group))
+
     if unsigned(group.idle_timestamp) != 0 :
         print("\t" +"Idle Timestamp: {g.idle_timestamp:d} ({:03.06f})\n".format(idle_timestamp_distance_s,
             g=group))
@@ -1339,4 +1339,5 @@ from btlog import *
 from refgrp import *
 from workload import *
 from recount import *
+from perftriage import *
 from log import showLogStream, show_log_stream_info
@@ -16,6 +16,8 @@
 #include <string.h>
 #include <mach/mach.h>
 #include <mach/host_info.h>
+#include <mach_debug/lockgroup_info.h>
+#include <sys/sysctl.h>
 
 /*
  *	lockstat.c
@@ -23,6 +25,7 @@
  *	Utility to display kernel lock contention statistics.
  *	Usage:
  *	lockstat [all, spin, mutex, rw, <lock group name>] {<repeat interval>} {abs}
+ *	lockstat prof
  *
  *	Argument 1 specifies the type of lock to display contention statistics
  *	for; alternatively, a lock group (a logically grouped set of locks,
@@ -55,6 +58,15 @@
  *	locks, such as mutexes, incremented if the owner of the mutex
  *	wasn't active on another processor at the time of the lock
  *	attempt. This indicates that no adaptive spin occurred.
+ *
+ *	"prof" displays the sampled contention profiles of mutexes and
+ *	reader-writer locks, which doesn't require lock statistics to be
+ *	enabled, but requires the kern.lock_prof_sample sysctl to be set
+ *	to the sampling rate (one in N contended acquisitions). For each lock
+ *	group, log2 histograms of the time spent spinning or blocking
+ *	for the lock, and of the time the lock was then held, are displayed,
+ *	followed by the most contended call sites as unslid kernel
+ *	backtraces, which atos(1) can symbolicate.
  */
 
 /*
@@ -77,6 +89,7 @@ void print_rw(int requested, lockgroup_info_t *lockgroup);
 void print_all_rw(lockgroup_info_t *lockgroup);
 void prime_lockgroup_deltas(void);
 void get_lockgroup_deltas(void);
+void print_prof(void);
 
 char *pgmname;
 mach_port_t host_control;
@@ -101,6 +114,11 @@ main(int argc, char **argv)
 
 	host_control = mach_host_self();
 
+	if (argc == 2 && strcmp(argv[1], "prof") == 0) {
+		print_prof();
+		exit(0);
+	}
+
 	kr = host_lockgroup_info(host_control, &lockgroup_info, &count);
 
 	if (kr != KERN_SUCCESS) {
@@ -280,6 +298,7 @@ void
 usage()
 {
 	fprintf(stderr, "Usage: %s [all, spin, mutex, rw, <lock group name>] {<repeat interval>} {abs}\n", pgmname);
+	fprintf(stderr, "       %s prof\n", pgmname);
 	exit(EXIT_FAILURE);
 }
 
@@ -440,3 +459,126 @@ get_lockgroup_deltas(void)
 	}
 	memcpy(lockgroup_start, lockgroup_info, count * sizeof(lockgroup_info_t));
 }
+
+static void *
+prof_sysctl(const char *name, size_t *size)
+{
+	void *buf;
+
+	if (sysctlbyname(name, NULL, size, NULL, 0) != 0) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	if (*size == 0) {
+		return NULL;
+	}
+	buf = malloc(*size);
+	if (buf == NULL || sysctlbyname(name, buf, size, NULL, 0) != 0) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	return buf;
+}
+
+static const char *
+prof_bucket_name(int bucket)
+{
+	static const char *units[] = { "ns", "us", "ms", "s" };
+	static char name[16];
+	unsigned long long ns;
+	int unit = 0;
+
+	if (bucket == 0) {
+		return "<256ns";
+	}
+	ns = 1ULL << (bucket + LOCKPROF_BUCKET_SHIFT - 1);
+	while (ns >= 1024 && unit < 3) {
+		ns /= 1024;
+		unit++;
+	}
+	snprintf(name, sizeof(name), "%s%llu%s",
+	    bucket == LOCKPROF_NBUCKETS - 1 ? ">=" : "", ns, units[unit]);
+	return name;
+}
+
+static int
+prof_site_cmp(const void *a, const void *b)
+{
+	const lockprof_site_t *sa = a, *sb = b;
+
+	return (sa->lockprof_count < sb->lockprof_count) -
+	       (sa->lockprof_count > sb->lockprof_count);
+}
+
+void
+print_prof(void)
+{
+	static const char *type_names[LOCKPROF_NTYPES] = { "mutex", "rw" };
+	lockgroup_prof_info_t *groups;
+	lockprof_site_t *sites;
+	size_t gsize, ssize, rsize;
+	unsigned int rate = 0;
+	int ngroups, nsites;
+
+	rsize = sizeof(rate);
+	if (sysctlbyname("kern.lock_prof_sample", &rate, &rsize, NULL, 0) != 0) {
+		perror("kern.lock_prof_sample");
+		exit(EXIT_FAILURE);
+	}
+	if (rate == 0) {
+		printf("Lock profiling is disabled, set kern.lock_prof_sample to enable it\n");
+	} else {
+		printf("Profiling one in %u contended acquisitions\n", rate);
+	}
+
+	groups = prof_sysctl("kern.lock_prof_groups", &gsize);
+	sites = prof_sysctl("kern.lock_prof_sites", &ssize);
+	ngroups = (int)(gsize / sizeof(lockgroup_prof_info_t));
+	nsites = (int)(ssize / sizeof(lockprof_site_t));
+
+	for (int g = 0; g < ngroups; g++) {
+		lockgroup_prof_info_t *prof = &groups[g];
+
+		for (int t = 0; t < LOCKPROF_NTYPES; t++) {
+			if (prof->lockprof_samples[t] == 0) {
+				continue;
+			}
+			printf("\n%s %s: %llu samples\n", prof->lockgroup_name,
+			    type_names[t], prof->lockprof_samples[t]);
+			printf("%10s %12s %12s %12s\n", "", "spin", "block", "hold");
+			for (int b = 0; b < LOCKPROF_NBUCKETS; b++) {
+				if (prof->lockprof_spin[t][b] == 0 &&
+				    prof->lockprof_block[t][b] == 0 &&
+				    prof->lockprof_hold[t][b] == 0) {
+					continue;
+				}
+				printf("%10s %12u %12u %12u\n", prof_bucket_name(b),
+				    prof->lockprof_spin[t][b], prof->lockprof_block[t][b],
+				    prof->lockprof_hold[t][b]);
+			}
+		}
+	}
+
+	qsort(sites, (size_t)nsites, sizeof(lockprof_site_t), prof_site_cmp);
+	if (nsites) {
+		printf("\nMost contended call sites\n");
+	}
+	for (int i = 0; i < nsites; i++) {
+		lockprof_site_t *site = &sites[i];
+
+		printf("\n%s %s: %u samples, wait avg %lluns max %lluns\n",
+		    site->lockprof_group < ngroups ?
+		    groups[site->lockprof_group].lockgroup_name : "?",
+		    site->lockprof_type < LOCKPROF_NTYPES ?
+		    type_names[site->lockprof_type] : "?",
+		    site->lockprof_count,
+		    site->lockprof_wait_total / site->lockprof_count,
+		    site->lockprof_wait_max);
+		for (int f = 0; f < LOCKPROF_SITE_DEPTH && site->lockprof_bt[f]; f++) {
+			printf("\t0x%llx\n", site->lockprof_bt[f]);
+		}
+	}
+
+	free(groups);
+	free(sites);
+}
@@ -20,6 +20,7 @@
 #include <sys/signal.h>
 #include <errno.h>
 #include "../unit_tests/tests_common.h" /* for record_perf_data() */
+#include "benchmark/harness.h"
 
 #include <libkern/OSAtomic.h>
 
@@ -76,6 +77,8 @@ static boolean_t        threaded = FALSE;
 static boolean_t        oneway = FALSE;
 static boolean_t        useset = FALSE;
 static boolean_t        save_perfdata = FALSE;
+static boolean_t        dealloc = FALSE;
+static const char       *json_path = NULL;
 int                     msg_type;
 int                     num_ints;
 int                     num_msgs;
@@ -125,8 +128,11 @@ usage(const char *progname)
 	fprintf(stderr, "    -oneway\t\tdo not request return reply\n");
 	fprintf(stderr, "    -count num\t\tnumber of messages to send\n");
 	fprintf(stderr, "    -perf   \t\tCreate perfdata files for metrics.\n");
+	fprintf(stderr, "    -json path\t\tappend throughput and latency to path as JSON lines\n");
 	fprintf(stderr, "    -type trivial|inline|complex\ttype of messages to send\n");
 	fprintf(stderr, "    -numints num\tnumber of 32-bit ints to send in messages\n");
+	fprintf(stderr, "    -dealloc\t\tcomplex messages send a fresh page-aligned buffer\n");
+	fprintf(stderr, "            \t\tand deallocate it (move semantics)\n");
 	fprintf(stderr, "    -servers num\tnumber of server threads to run\n");
 	fprintf(stderr, "    -clients num\tnumber of clients per server\n");
 	fprintf(stderr, "    -delay num\t\tmicroseconds to sleep clients between messages\n");
@@ -196,6 +202,15 @@ parse_args(int argc, char *argv[])
 		} else if (0 == strcmp("-perf", argv[0])) {
 			save_perfdata = TRUE;
 			argc--; argv++;
+		} else if (0 == strcmp("-json", argv[0])) {
+			if (argc < 2) {
+				usage(progname);
+			}
+			json_path = argv[1];
+			argc -= 2; argv += 2;
+		} else if (0 == strcmp("-dealloc", argv[0])) {
+			dealloc = TRUE;
+			argc--; argv++;
 		} else if (0 == strcmp("-type", argv[0])) {
 			if (argc < 2) {
 				usage(progname);
@@ -748,12 +763,35 @@ client(void *threadarg)
 		}
 		req->msgh_id = oneway ? 0 : 1;
 		if (msg_type == msg_type_complex) {
+			vm_size_t ool_size = num_ints * sizeof(u_int32_t);
+			void *ool = ints;
+
+			if (dealloc) {
+				/*
+				 * Send a fresh, touched buffer each time and
+				 * give it away, as a producer handing off
+				 * filled buffers would.
+				 */
+				vm_address_t addr = 0;
+
+				ool_size = round_page(ool_size);
+				ret = vm_allocate(mach_task_self(), &addr, ool_size,
+				    VM_FLAGS_ANYWHERE);
+				if (KERN_SUCCESS != ret) {
+					mach_error("vm_allocate(): ", ret);
+					exit(1);
+				}
+				for (vm_size_t off = 0; off < ool_size; off += PAGE_SIZE) {
+					((volatile char *)addr)[off] = 1;
+				}
+				ool = (void *)addr;
+			}
 			(req)->msgh_bits |=  MACH_MSGH_BITS_COMPLEX;
 			((ipc_complex_message *)req)->body.msgh_descriptor_count = 1;
-			((ipc_complex_message *)req)->descriptor.address = ints;
+			((ipc_complex_message *)req)->descriptor.address = ool;
 			((ipc_complex_message *)req)->descriptor.size =
-			    num_ints * sizeof(u_int32_t);
-			((ipc_complex_message *)req)->descriptor.deallocate = FALSE;
+			    (mach_msg_size_t)ool_size;
+			((ipc_complex_message *)req)->descriptor.deallocate = dealloc;
 			((ipc_complex_message *)req)->descriptor.copy = MACH_MSG_VIRTUAL_COPY;
 			((ipc_complex_message *)req)->descriptor.type = MACH_MSG_OOL_DESCRIPTOR;
 		}
@@ -1019,6 +1057,27 @@ main(int argc, char *argv[])
 		record_perf_data(name, "usec", avg_msg_latency, "Message latency measured in microseconds. Lower is better", stderr);
 	}
 
+	if (json_path != NULL) {
+		benchmark_config_t config = BENCHMARK_CONFIG_DEFAULT;
+		benchmark_stats_t stats;
+		char name[256];
+
+		/* One run per invocation; MPMMtest_run.sh drives the repetitions. */
+		config.warmup = 0;
+		config.trials = 1;
+		config.json_path = json_path;
+		snprintf(name, sizeof(name), "%s.%d_servers.%d_clients.throughput",
+		    basename(argv[0]), num_servers, num_clients);
+		if (benchmark_report(&config, name, "msgs/sec", &throughput_msg_p_sec, 1, &stats) != 0) {
+			warn("failed to write %s", json_path);
+		}
+		snprintf(name, sizeof(name), "%s.%d_servers.%d_clients.latency",
+		    basename(argv[0]), num_servers, num_clients);
+		if (benchmark_report(&config, name, "usec", &avg_msg_latency, 1, &stats) != 0) {
+			warn("failed to write %s", json_path);
+		}
+	}
+
 	if (stress_prepost) {
 		int64_t sendns = abs_to_ns(g_client_send_time);
 		dsecs = (double)sendns / (double)NSEC_PER_SEC;
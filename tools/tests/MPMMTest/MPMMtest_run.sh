@@ -41,6 +41,20 @@ if [ -e $MPMMTEST_64 ] && [ -x $MPMMTEST_64 ] && [ $IS_64BIT_BOOTED_OS == 1 ]
 then
 	echo ""; echo " Running $MPMMTEST_64"
 	$MPMMTEST_64 -perf || { x=$?; echo "$MPMMTEST_64 failed $x"; exit $x; }
+
+	# Large out-of-line buffers handed off with deallocate (64KB and 1MB)
+	for NUMINTS in 16384 262144
+	do
+		echo ""; echo " Running $MPMMTEST_64 -type complex -numints $NUMINTS -dealloc"
+		$MPMMTEST_64 -type complex -numints $NUMINTS -dealloc -count 20000 || { x=$?; echo "$MPMMTEST_64 failed $x"; exit $x; }
+	done
+
+	# One-way sends from threads sharing one IPC space
+	for CLIENTS in 1 4 16
+	do
+		echo ""; echo " Running $MPMMTEST_64 -threaded -oneway -clients $CLIENTS"
+		$MPMMTEST_64 -threaded -oneway -clients $CLIENTS -perf || { x=$?; echo "$MPMMTEST_64 failed $x"; exit $x; }
+	done
 fi
 
 if [ -e $KQMPMMTEST ] && [ -x $KQMPMMTEST ]
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Measures the cost of multi-entry unmaps and protection changes, which
+ * the pmap layer invalidates in batches.
+ *
+ * Maps -n pages, then write-protects every other page so the range is
+ * made of -n / 2 separate map entries. -t threads keep touching the
+ * range from other CPUs so the translations are live in several TLBs.
+ * Each of -i iterations then times one mprotect(PROT_READ) and one
+ * munmap() over the whole range, and the averages are reported in
+ * nanoseconds per call and per entry.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <mach/mach_time.h>
+
+static size_t   npages = 4096;
+static int      nthreads = 4;
+static int      iterations = 100;
+
+static volatile char *arena;
+static volatile bool arena_valid;
+static volatile bool done;
+static size_t   pgsz;
+
+static uint64_t
+ns_since(uint64_t start)
+{
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0) {
+		mach_timebase_info(&tb);
+	}
+	return (mach_absolute_time() - start) * tb.numer / tb.denom;
+}
+
+/*
+ * Readers only touch the arena while it is marked valid, and the main
+ * thread waits for them to drain before unmapping it.
+ */
+static volatile int readers_active;
+
+static void *
+toucher(void *arg)
+{
+	(void)arg;
+
+	while (!done) {
+		if (!arena_valid) {
+			continue;
+		}
+		__sync_fetch_and_add(&readers_active, 1);
+		if (arena_valid) {
+			for (size_t i = 0; i < npages; i += 2) {
+				(void)arena[i * pgsz];
+			}
+		}
+		__sync_fetch_and_sub(&readers_active, 1);
+	}
+	return NULL;
+}
+
+static void
+arena_setup(void)
+{
+	char *p;
+
+	p = mmap(NULL, npages * pgsz, PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_PRIVATE, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	for (size_t i = 0; i < npages; i++) {
+		p[i * pgsz] = 1;
+	}
+	/* split the range into npages / 2 entries */
+	for (size_t i = 1; i < npages; i += 2) {
+		if (mprotect(p + i * pgsz, pgsz, PROT_READ) != 0) {
+			perror("mprotect");
+			exit(1);
+		}
+	}
+	arena = p;
+	arena_valid = true;
+}
+
+static void
+arena_quiesce(void)
+{
+	arena_valid = false;
+	while (readers_active != 0) {
+		;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	uint64_t protect_ns = 0, unmap_ns = 0, t;
+	pthread_t *threads;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:t:i:")) != -1) {
+		switch (c) {
+		case 'n':
+			npages = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n pages] [-t threads] [-i iterations]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (npages < 2 || iterations < 1 || nthreads < 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	pgsz = (size_t)getpagesize();
+	threads = calloc((size_t)nthreads, sizeof(pthread_t));
+	for (int i = 0; i < nthreads; i++) {
+		pthread_create(&threads[i], NULL, toucher, NULL);
+	}
+
+	for (int it = 0; it < iterations; it++) {
+		arena_setup();
+		usleep(1000);
+
+		t = mach_absolute_time();
+		if (mprotect((void *)arena, npages * pgsz, PROT_READ) != 0) {
+			perror("mprotect");
+			return 1;
+		}
+		protect_ns += ns_since(t);
+
+		arena_quiesce();
+
+		t = mach_absolute_time();
+		if (munmap((void *)arena, npages * pgsz) != 0) {
+			perror("munmap");
+			return 1;
+		}
+		unmap_ns += ns_since(t);
+	}
+
+	done = true;
+	for (int i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	printf("%zu pages, %zu entries, %d touching threads, %d iterations\n",
+	    npages, npages / 2, nthreads, iterations);
+	printf("mprotect: %llu ns/call, %llu ns/entry\n",
+	    protect_ns / iterations, protect_ns / iterations / (npages / 2));
+	printf("munmap:   %llu ns/call, %llu ns/entry\n",
+	    unmap_ns / iterations, unmap_ns / iterations / (npages / 2));
+	return 0;
+}
@@ -0,0 +1,611 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * entry_bench - cost of the hot kernel entry points, one path at a time.
+ *
+ * Every path runs in batches of --batch iterations and each batch is one
+ * trial. The thread's fixed PMCs (cycles and instructions, read with
+ * kpc_get_thread_counters()) and mach_absolute_time() are sampled around a
+ * batch and divided by its size, so every sample is a per-iteration cost.
+ * Summaries go through the common harness in tests/benchmark.
+ *
+ * --save-baseline records the median of each metric per path.
+ * --baseline compares this run against such a file, prints a per-path
+ * report and exits with status 1 if any path's median cycles (ns when the
+ * PMCs are unavailable) grew by more than --threshold percent.
+ */
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <mach/mach.h>
+#include <mach/mach_error.h>
+#include <mach/mach_time.h>
+#include <netinet/in.h>
+#include <sys/event.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/ulock.h>
+
+#include <kperf/kpc.h>
+
+#include "benchmark/harness.h"
+
+#if defined(__arm64__)
+#define KPC_FIXED_CYCLES        0
+#define KPC_FIXED_INSTRS        1
+#else /* defined(__arm64__) */
+/* Intel fixed counters: instructions retired, then unhalted core cycles. */
+#define KPC_FIXED_CYCLES        1
+#define KPC_FIXED_INSTRS        0
+#endif /* !defined(__arm64__) */
+
+#define MAX_FIXED_COUNTERS      8
+#define FILE_PAGES              16
+#define SOCKET_MSG_SIZE         64
+
+enum metric {
+	METRIC_CYCLES,
+	METRIC_INSTRS,
+	METRIC_NS,
+	METRIC_COUNT,
+};
+
+static const char *metric_names[METRIC_COUNT] = { "cycles", "instructions", "ns" };
+
+static struct {
+	int                     kq;
+	int                     fd;
+	int                     sock;
+	mach_port_t             port;
+	_Atomic uint32_t        ulock_word;
+	char                   *buf;
+	size_t                  pagesize;
+	char                    file_path[64];
+} g_state;
+
+static bool                     g_have_kpc;
+static uint32_t                 g_fixed_count;
+static struct mach_timebase_info g_timebase;
+static unsigned int             g_batch = 1000;
+static double                   g_threshold_pct = 5.0;
+static const char              *g_baseline_path;
+static const char              *g_save_baseline_path;
+
+#pragma mark - paths
+
+static void
+null_syscall_run(void)
+{
+	(void)getppid();
+}
+
+static void
+mach_msg_setup(void)
+{
+	kern_return_t kr;
+
+	kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &g_state.port);
+	if (kr != KERN_SUCCESS) {
+		errx(EX_OSERR, "mach_port_allocate: %s", mach_error_string(kr));
+	}
+	kr = mach_port_insert_right(mach_task_self(), g_state.port, g_state.port,
+	    MACH_MSG_TYPE_MAKE_SEND);
+	if (kr != KERN_SUCCESS) {
+		errx(EX_OSERR, "mach_port_insert_right: %s", mach_error_string(kr));
+	}
+}
+
+/* Send a header-only message to ourselves and receive it in the same trap. */
+static void
+mach_msg_run(void)
+{
+	union {
+		mach_msg_header_t header;
+		char bytes[sizeof(mach_msg_header_t) + MAX_TRAILER_SIZE];
+	} msg;
+	kern_return_t kr;
+
+	msg.header = (mach_msg_header_t){
+		.msgh_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, 0),
+		.msgh_size = sizeof(mach_msg_header_t),
+		.msgh_remote_port = g_state.port,
+		.msgh_local_port = MACH_PORT_NULL,
+		.msgh_id = 0x4242,
+	};
+	kr = mach_msg(&msg.header, MACH_SEND_MSG | MACH_RCV_MSG,
+	    sizeof(mach_msg_header_t), sizeof(msg), g_state.port,
+	    MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+	if (kr != MACH_MSG_SUCCESS) {
+		errx(EX_OSERR, "mach_msg: %s", mach_error_string(kr));
+	}
+}
+
+static void
+mach_msg_teardown(void)
+{
+	mach_port_destruct(mach_task_self(), g_state.port, -1, 0);
+}
+
+static void
+kevent_setup(void)
+{
+	struct kevent64_s kev;
+
+	g_state.kq = kqueue();
+	if (g_state.kq < 0) {
+		err(EX_OSERR, "kqueue");
+	}
+	EV_SET64(&kev, 1, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, 0, 0, 0);
+	if (kevent64(g_state.kq, &kev, 1, NULL, 0, 0, NULL) < 0) {
+		err(EX_OSERR, "kevent64(EV_ADD)");
+	}
+}
+
+/* Trigger a user event and collect it in one kevent call. */
+static void
+kevent_run(void)
+{
+	struct kevent64_s trigger, out;
+	const struct timespec zero = { 0, 0 };
+
+	EV_SET64(&trigger, 1, EVFILT_USER, 0, NOTE_TRIGGER, 0, 0, 0, 0);
+	if (kevent64(g_state.kq, &trigger, 1, &out, 1, 0, &zero) != 1) {
+		err(EX_OSERR, "kevent64(NOTE_TRIGGER)");
+	}
+}
+
+static void
+kevent_teardown(void)
+{
+	close(g_state.kq);
+}
+
+/*
+ * Uncontended ulock traffic: a wait whose value no longer matches returns
+ * without blocking and a wake finds no waiter, so this is the lookup and
+ * entry cost that every contended lock pays on top of the context switch.
+ */
+static void
+ulock_run(void)
+{
+	uint32_t value = atomic_load_explicit(&g_state.ulock_word, memory_order_relaxed);
+
+	(void)__ulock_wait(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, &g_state.ulock_word,
+	    value + 1, 0);
+	(void)__ulock_wake(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, &g_state.ulock_word, 0);
+}
+
+static void
+file_setup(void)
+{
+	strlcpy(g_state.file_path, "/tmp/entry_bench.XXXXXX", sizeof(g_state.file_path));
+	g_state.fd = mkstemp(g_state.file_path);
+	if (g_state.fd < 0) {
+		err(EX_OSERR, "mkstemp");
+	}
+	memset(g_state.buf, 0xa5, g_state.pagesize);
+	for (int i = 0; i < FILE_PAGES; i++) {
+		if (write(g_state.fd, g_state.buf, g_state.pagesize) != (ssize_t)g_state.pagesize) {
+			err(EX_OSERR, "write");
+		}
+	}
+	/* Pull every page into the UBC before timing. */
+	for (int i = 0; i < FILE_PAGES; i++) {
+		(void)pread(g_state.fd, g_state.buf, g_state.pagesize,
+		    (off_t)(i * g_state.pagesize));
+	}
+}
+
+static void
+file_teardown(void)
+{
+	close(g_state.fd);
+	unlink(g_state.file_path);
+}
+
+static void
+pread_run(void)
+{
+	static unsigned int page;
+
+	page = (page + 1) % FILE_PAGES;
+	if (pread(g_state.fd, g_state.buf, g_state.pagesize,
+	    (off_t)(page * g_state.pagesize)) != (ssize_t)g_state.pagesize) {
+		err(EX_OSERR, "pread");
+	}
+}
+
+/* Map a resident file page, take the minor fault on it and unmap it. */
+static void
+mmap_fault_run(void)
+{
+	volatile char *addr;
+
+	addr = mmap(NULL, g_state.pagesize, PROT_READ, MAP_FILE | MAP_SHARED, g_state.fd, 0);
+	if (addr == MAP_FAILED) {
+		err(EX_OSERR, "mmap");
+	}
+	(void)*addr;
+	if (munmap((void *)(uintptr_t)addr, g_state.pagesize) != 0) {
+		err(EX_OSERR, "munmap");
+	}
+}
+
+static void
+socket_setup(void)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(sin);
+
+	g_state.sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (g_state.sock < 0) {
+		err(EX_OSERR, "socket");
+	}
+	if (bind(g_state.sock, (struct sockaddr *)&sin, sizeof(sin)) != 0 ||
+	    getsockname(g_state.sock, (struct sockaddr *)&sin, &len) != 0 ||
+	    connect(g_state.sock, (struct sockaddr *)&sin, sizeof(sin)) != 0) {
+		err(EX_OSERR, "loopback socket setup");
+	}
+}
+
+/* Send a datagram to ourselves over loopback and read it back. */
+static void
+socket_run(void)
+{
+	if (send(g_state.sock, g_state.buf, SOCKET_MSG_SIZE, 0) != SOCKET_MSG_SIZE) {
+		err(EX_OSERR, "send");
+	}
+	if (recv(g_state.sock, g_state.buf, SOCKET_MSG_SIZE, 0) != SOCKET_MSG_SIZE) {
+		err(EX_OSERR, "recv");
+	}
+}
+
+static void
+socket_teardown(void)
+{
+	close(g_state.sock);
+}
+
+struct bench_path {
+	const char *name;
+	void (*setup)(void);
+	void (*run)(void);
+	void (*teardown)(void);
+	bool selected;
+	double median[METRIC_COUNT];
+};
+
+static struct bench_path g_paths[] = {
+	{ "null_syscall", NULL, null_syscall_run, NULL },
+	{ "mach_msg", mach_msg_setup, mach_msg_run, mach_msg_teardown },
+	{ "kevent", kevent_setup, kevent_run, kevent_teardown },
+	{ "ulock", NULL, ulock_run, NULL },
+	{ "pread", file_setup, pread_run, file_teardown },
+	{ "mmap_fault", file_setup, mmap_fault_run, file_teardown },
+	{ "socket_loopback", socket_setup, socket_run, socket_teardown },
+};
+
+#define NPATHS (sizeof(g_paths) / sizeof(g_paths[0]))
+
+#pragma mark - measurement
+
+static void
+read_counters(uint64_t counters[MAX_FIXED_COUNTERS])
+{
+	if (g_have_kpc && kpc_get_thread_counters(0, g_fixed_count, counters) != 0) {
+		err(EX_OSERR, "kpc_get_thread_counters");
+	}
+}
+
+static void
+setup_kpc(void)
+{
+	g_fixed_count = kpc_get_counter_count(KPC_CLASS_FIXED_MASK);
+	if (g_fixed_count <= KPC_FIXED_CYCLES || g_fixed_count <= KPC_FIXED_INSTRS ||
+	    g_fixed_count > MAX_FIXED_COUNTERS) {
+		warnx("fixed counters unavailable, reporting time only");
+		return;
+	}
+	if (kpc_force_all_ctrs_set(1) != 0 ||
+	    kpc_set_counting(KPC_CLASS_FIXED_MASK) != 0 ||
+	    kpc_set_thread_counting(KPC_CLASS_FIXED_MASK) != 0) {
+		warn("cannot enable thread counters (not root?), reporting time only");
+		return;
+	}
+	g_have_kpc = true;
+}
+
+static void
+teardown_kpc(void)
+{
+	if (g_have_kpc) {
+		(void)kpc_set_thread_counting(0);
+		(void)kpc_set_counting(0);
+		(void)kpc_force_all_ctrs_set(0);
+	}
+}
+
+static void
+run_batch(struct bench_path *path, double sample[METRIC_COUNT])
+{
+	uint64_t before[MAX_FIXED_COUNTERS] = {}, after[MAX_FIXED_COUNTERS] = {};
+	uint64_t start, end;
+
+	read_counters(before);
+	start = mach_absolute_time();
+	for (unsigned int i = 0; i < g_batch; i++) {
+		path->run();
+	}
+	end = mach_absolute_time();
+	read_counters(after);
+
+	sample[METRIC_CYCLES] = (double)(after[KPC_FIXED_CYCLES] - before[KPC_FIXED_CYCLES]) / g_batch;
+	sample[METRIC_INSTRS] = (double)(after[KPC_FIXED_INSTRS] - before[KPC_FIXED_INSTRS]) / g_batch;
+	sample[METRIC_NS] = (double)(end - start) * g_timebase.numer /
+	    g_timebase.denom / g_batch;
+}
+
+static void
+run_path(const benchmark_config_t *config, struct bench_path *path)
+{
+	double *samples[METRIC_COUNT];
+	double sample[METRIC_COUNT];
+	benchmark_stats_t stats;
+	char name[128];
+
+	for (int m = 0; m < METRIC_COUNT; m++) {
+		samples[m] = calloc(config->trials, sizeof(double));
+		if (samples[m] == NULL) {
+			err(EX_OSERR, "calloc");
+		}
+	}
+
+	if (path->setup) {
+		path->setup();
+	}
+	for (unsigned int i = 0; i < config->warmup; i++) {
+		run_batch(path, sample);
+	}
+	for (unsigned int i = 0; i < config->trials; i++) {
+		run_batch(path, sample);
+		for (int m = 0; m < METRIC_COUNT; m++) {
+			samples[m][i] = sample[m];
+		}
+	}
+	if (path->teardown) {
+		path->teardown();
+	}
+
+	for (int m = 0; m < METRIC_COUNT; m++) {
+		if (!g_have_kpc && m != METRIC_NS) {
+			continue;
+		}
+		snprintf(name, sizeof(name), "entry_bench.%s.%s", path->name, metric_names[m]);
+		if (benchmark_report(config, name, metric_names[m], samples[m],
+		    config->trials, &stats) != 0) {
+			warn("failed to write %s", config->json_path);
+		}
+		path->median[m] = stats.median;
+	}
+	for (int m = 0; m < METRIC_COUNT; m++) {
+		free(samples[m]);
+	}
+}
+
+#pragma mark - baselines
+
+static struct bench_path *
+find_path(const char *name)
+{
+	for (size_t i = 0; i < NPATHS; i++) {
+		if (strcmp(g_paths[i].name, name) == 0) {
+			return &g_paths[i];
+		}
+	}
+	return NULL;
+}
+
+/* One line per path: "<name> <cycles> <instructions> <ns>", medians per iteration. */
+static void
+save_baseline(const char *path)
+{
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL) {
+		err(EX_CANTCREAT, "%s", path);
+	}
+	for (size_t i = 0; i < NPATHS; i++) {
+		if (g_paths[i].selected) {
+			fprintf(f, "%s %.3f %.3f %.3f\n", g_paths[i].name,
+			    g_paths[i].median[METRIC_CYCLES],
+			    g_paths[i].median[METRIC_INSTRS],
+			    g_paths[i].median[METRIC_NS]);
+		}
+	}
+	if (fclose(f) != 0) {
+		err(EX_IOERR, "%s", path);
+	}
+}
+
+static double
+percent_change(double baseline, double current)
+{
+	return baseline > 0 ? (current - baseline) * 100.0 / baseline : 0;
+}
+
+/* Returns the number of regressed paths. */
+static int
+compare_baseline(const char *path)
+{
+	double base[METRIC_COUNT];
+	int regressions = 0;
+	char name[64];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		err(EX_NOINPUT, "%s", path);
+	}
+
+	printf("\n%-16s %12s %12s %8s %12s %8s %10s %8s\n", "path", "base cycles",
+	    "cycles", "delta", "instrs", "delta", "ns", "delta");
+	while (fscanf(f, "%63s %lf %lf %lf", name, &base[METRIC_CYCLES],
+	    &base[METRIC_INSTRS], &base[METRIC_NS]) == 4) {
+		struct bench_path *p = find_path(name);
+		enum metric gate = g_have_kpc ? METRIC_CYCLES : METRIC_NS;
+		double delta[METRIC_COUNT];
+		bool regressed;
+
+		if (p == NULL || !p->selected) {
+			continue;
+		}
+		for (int m = 0; m < METRIC_COUNT; m++) {
+			delta[m] = percent_change(base[m], p->median[m]);
+		}
+		regressed = delta[gate] > g_threshold_pct;
+		regressions += regressed;
+		printf("%-16s %12.1f %12.1f %+7.1f%% %12.1f %+7.1f%% %10.1f %+7.1f%%%s\n",
+		    name, base[METRIC_CYCLES], p->median[METRIC_CYCLES], delta[METRIC_CYCLES],
+		    p->median[METRIC_INSTRS], delta[METRIC_INSTRS],
+		    p->median[METRIC_NS], delta[METRIC_NS],
+		    regressed ? "  REGRESSION" : "");
+	}
+	fclose(f);
+
+	printf("%d path%s regressed by more than %.1f%%\n", regressions,
+	    regressions == 1 ? "" : "s", g_threshold_pct);
+	return regressions;
+}
+
+#pragma mark - main
+
+static void __attribute__((noreturn))
+usage(void)
+{
+	fprintf(stderr, "usage: %s %s\n\t[--batch <iterations>] [--baseline <file>] "
+	    "[--save-baseline <file>] [--threshold <percent>] [path ...]\n",
+	    getprogname(), benchmark_usage());
+	fprintf(stderr, "paths:");
+	for (size_t i = 0; i < NPATHS; i++) {
+		fprintf(stderr, " %s", g_paths[i].name);
+	}
+	fprintf(stderr, "\n");
+	exit(EX_USAGE);
+}
+
+int
+main(int argc, char *argv[])
+{
+	benchmark_config_t config = BENCHMARK_CONFIG_DEFAULT;
+	bool any_selected = false;
+	int i = 1;
+
+	while (i < argc) {
+		int consumed = benchmark_parse_args(&config, argc - i, argv + i);
+
+		if (consumed < 0) {
+			usage();
+		} else if (consumed > 0) {
+			i += consumed;
+		} else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+			g_batch = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+			i += 2;
+		} else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			g_baseline_path = argv[i + 1];
+			i += 2;
+		} else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) {
+			g_save_baseline_path = argv[i + 1];
+			i += 2;
+		} else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			g_threshold_pct = strtod(argv[i + 1], NULL);
+			i += 2;
+		} else if (argv[i][0] != '-') {
+			struct bench_path *p = find_path(argv[i]);
+			if (p == NULL) {
+				warnx("unknown path '%s'", argv[i]);
+				usage();
+			}
+			p->selected = any_selected = true;
+			i++;
+		} else {
+			usage();
+		}
+	}
+	if (g_batch == 0) {
+		usage();
+	}
+	if (!any_selected) {
+		for (size_t p = 0; p < NPATHS; p++) {
+			g_paths[p].selected = true;
+		}
+	}
+
+	if (mach_timebase_info(&g_timebase) != KERN_SUCCESS) {
+		errx(EX_OSERR, "mach_timebase_info");
+	}
+	g_state.pagesize = (size_t)getpagesize();
+	g_state.buf = malloc(g_state.pagesize);
+	if (g_state.buf == NULL) {
+		err(EX_OSERR, "malloc");
+	}
+
+	/* All counting is per-thread, so keep the workload on one cluster type. */
+	if (benchmark_bind_cluster(config.cluster) != 0) {
+		warn("failed to bind to cluster type %c", (char)config.cluster);
+	}
+	setup_kpc();
+
+	for (size_t p = 0; p < NPATHS; p++) {
+		if (g_paths[p].selected) {
+			run_path(&config, &g_paths[p]);
+		}
+	}
+	teardown_kpc();
+
+	if (g_save_baseline_path) {
+		save_baseline(g_save_baseline_path);
+	}
+	if (g_baseline_path && compare_baseline(g_baseline_path) > 0) {
+		return 1;
+	}
+	return 0;
+}
@@ -10,6 +10,7 @@
 #include <libgen.h>
 #include <unistd.h>
 #include "fail.h"
+#include "benchmark/harness.h"
 
 typedef struct parsed_args_struct {
 	char* my_name;
@@ -29,6 +30,7 @@ typedef struct test_struct {
 
 parsed_args_t args;
 test_t test;
+benchmark_config_t bench_config = BENCHMARK_CONFIG_DEFAULT;
 int ready_thread_count;
 pthread_mutex_t ready_thread_count_lock;
 pthread_cond_t start_cvar;
@@ -53,7 +55,7 @@ parse_args(int argc, char** argv, parsed_args_t* parsed_args)
 void
 print_usage(char** argv)
 {
-	printf("Usage: %s test_name threads length\n", argv[0]);
+	printf("Usage: %s %s test_name threads length\n", argv[0], benchmark_usage());
 }
 
 int
@@ -142,6 +144,7 @@ thread_setup(void *arg)
 	if (work_remainder > my_index) {
 		work_size++;
 	}
+	benchmark_bind_cluster(bench_config.cluster);
 
 	pthread_mutex_lock(&ready_thread_count_lock);
 	ready_thread_count++;
@@ -154,45 +157,27 @@ thread_setup(void *arg)
 	return NULL;
 }
 
-int
-main(int argc, char** argv)
+/*
+ * One timed run of the workload: setup and cleanup are not counted.
+ * Returns the elapsed time in seconds, or -1 if the test failed.
+ */
+static double
+run_trial(void *arg __unused)
 {
-	int retval;
+	int retval = PERFINDEX_SUCCESS;
 	int thread_index;
 	struct timeval timer;
 	pthread_t* threads;
 	int thread_retval;
 	void* thread_retval_ptr = &thread_retval;
-	char test_path[MAXPATHLEN];
-
-	retval = parse_args(argc, argv, &args);
-	if (retval) {
-		print_usage(argv);
-		return -1;
-	}
-
-	retval = find_test(args.test_name, test_path);
-	if (retval) {
-		printf("Unable to find test %s\n", args.test_name);
-		return -1;
-	}
-
-	load_test(test_path, &test);
-	if (retval) {
-		printf("Unable to load test %s\n", args.test_name);
-		return -1;
-	}
 
-	pthread_cond_init(&threads_ready_cvar, NULL);
-	pthread_cond_init(&start_cvar, NULL);
-	pthread_mutex_init(&ready_thread_count_lock, NULL);
 	ready_thread_count = 0;
 
 	if (test.setup) {
 		retval = test.setup(args.num_threads, args.length, 0, NULL);
 		if (retval == PERFINDEX_FAILURE) {
 			fprintf(stderr, "Test setup failed: %s\n", *test.error_str_ptr);
-			return -1;
+			exit(1);
 		}
 	}
 
@@ -217,19 +202,72 @@ main(int argc, char** argv)
 		}
 	}
 	end_timer(&timer);
+	free(threads);
 
 	if (test.cleanup) {
 		retval = test.cleanup(args.num_threads, args.length);
 	}
 	if (retval == PERFINDEX_FAILURE) {
 		fprintf(stderr, "Test cleanup failed: %s\n", *test.error_str_ptr);
-		free(threads);
+		exit(1);
+	}
+
+	if (bench_config.trials == 1 && bench_config.warmup == 0 && bench_config.json_path == NULL) {
+		print_timer(&timer);
+	}
+	return (double)timer.tv_sec + (double)timer.tv_usec / 1000000.0;
+}
+
+int
+main(int argc, char** argv)
+{
+	int retval;
+	int consumed;
+	char test_path[MAXPATHLEN];
+	char bench_name[MAXPATHLEN];
+	benchmark_stats_t stats;
+
+	/* One trial, printing only the elapsed seconds, unless asked otherwise. */
+	bench_config.warmup = 0;
+	bench_config.trials = 1;
+	consumed = benchmark_parse_args(&bench_config, argc - 1, argv + 1);
+	if (consumed < 0) {
+		print_usage(argv);
 		return -1;
 	}
+	argv[consumed] = argv[0];
+	argc -= consumed;
+	argv += consumed;
 
-	print_timer(&timer);
+	retval = parse_args(argc, argv, &args);
+	if (retval) {
+		print_usage(argv);
+		return -1;
+	}
 
-	free(threads);
+	retval = find_test(args.test_name, test_path);
+	if (retval) {
+		printf("Unable to find test %s\n", args.test_name);
+		return -1;
+	}
 
-	return 0;
+	retval = load_test(test_path, &test);
+	if (retval) {
+		printf("Unable to load test %s\n", args.test_name);
+		return -1;
+	}
+
+	pthread_cond_init(&threads_ready_cvar, NULL);
+	pthread_cond_init(&start_cvar, NULL);
+	pthread_mutex_init(&ready_thread_count_lock, NULL);
+
+	if (bench_config.trials == 1 && bench_config.warmup == 0 && bench_config.json_path == NULL) {
+		run_trial(NULL);
+		return 0;
+	}
+
+	snprintf(bench_name, sizeof(bench_name), "perf_index.%s.%d_threads.%lld",
+	    args.test_name, args.num_threads, args.length);
+	retval = benchmark_run(&bench_config, bench_name, "s", run_trial, NULL, &stats);
+	return retval ? -1 : 0;
 }
@@ -59,6 +59,9 @@
 #include <os/tsd.h>
 #include <os/lock.h>
 #include <TargetConditionals.h>
+#include <sys/work_interval.h>
+
+#include "benchmark/harness.h"
 
 typedef enum wake_type { WAKE_BROADCAST_ONESEM, WAKE_BROADCAST_PERTHREAD, WAKE_CHAIN, WAKE_HOP } wake_type_t;
 typedef enum my_policy_type { MY_POLICY_REALTIME, MY_POLICY_TIMESHARE, MY_POLICY_TIMESHARE_NO_SMT, MY_POLICY_FIXEDPRI } my_policy_type_t;
@@ -117,6 +120,28 @@ static boolean_t                g_churn_random = FALSE; /* churn threads randoml
 static uint32_t                 g_rt_churn_count = 0;
 static uint32_t                 g_traceworthy_count = 0;
 
+/*
+ * Scenario knobs: thread groups (one joinable work interval each, workers
+ * assigned round-robin), optional work interval notifications, a per-thread
+ * QoS / realtime mix and background-QoS load threads.
+ */
+#define MAX_QOS_MIX                     16
+#define QOS_MIX_RT                      (-1)
+#define BG_LOAD_ALL_CPUS                UINT32_MAX
+static uint32_t                 g_thread_groups = 0;
+static boolean_t                g_work_interval = FALSE;
+static int                      g_qos_mix[MAX_QOS_MIX];
+static uint32_t                 g_qos_mix_count = 0;
+static uint32_t                 g_bg_load_count = 0;
+static work_interval_t         *g_work_intervals;
+static mach_port_t             *g_work_interval_ports;
+static pthread_t               *g_bg_load_threads;
+
+/* CPU each worker woke up on in the current iteration, and its cluster type */
+static uint32_t                *g_thread_wake_cpus;
+static char                     g_cpu_cluster_types[64];
+static uint32_t                 g_cluster_cpus = 0;
+
 /*
  * If the number of threads on the command line is 0, meaning ncpus,
  * this signed number is added to the number of threads, making it
@@ -165,6 +190,13 @@ static boolean_t                g_test_strict_fail = FALSE;
 /* Print a histgram showing how many threads ran on each CPU */
 static boolean_t                g_histogram = FALSE;
 
+/* Append per-iteration latencies to this file through the benchmark harness */
+static const char              *g_json_path = NULL;
+/* Leading iterations left out of the harness report */
+static uint32_t                 g_warmup_iterations = 0;
+static const char              *g_waketype_arg;
+static const char              *g_policy_arg;
+
 /* One randomly chosen thread holds up the train for a certain duration. */
 static boolean_t                g_do_one_long_spin = FALSE;
 static uint32_t                 g_one_long_spin_id = 0;
@@ -310,6 +342,48 @@ join_churn_threads(void)
 	}
 }
 
+static void *
+bg_load_thread(void *arg)
+{
+	errno_t err = pthread_set_qos_class_self_np(QOS_CLASS_BACKGROUND, 0);
+	if (err) {
+		errc(EX_OSERR, err, "pthread_set_qos_class_self_np");
+	}
+
+	return churn_thread(arg);
+}
+
+static void
+create_bg_load_threads(void)
+{
+	if (g_bg_load_count == BG_LOAD_ALL_CPUS) {
+		g_bg_load_count = g_maxcpus;
+	}
+
+	g_bg_load_threads = (pthread_t*) valloc(sizeof(pthread_t) * g_bg_load_count);
+	assert(g_bg_load_threads);
+
+	for (uint32_t i = 0; i < g_bg_load_count; i++) {
+		errno_t err = pthread_create(&g_bg_load_threads[i], NULL, bg_load_thread, NULL);
+		if (err) {
+			errc(EX_OSERR, err, "pthread_create");
+		}
+	}
+}
+
+static void
+join_bg_load_threads(void)
+{
+	atomic_store_explicit(&g_churn_stop, TRUE, memory_order_seq_cst);
+
+	for (uint32_t i = 0; i < g_bg_load_count; i++) {
+		errno_t err = pthread_join(g_bg_load_threads[i], NULL);
+		if (err) {
+			errc(EX_OSERR, err, "pthread_join %d", i);
+		}
+	}
+}
+
 /*
  * Set policy
  */
@@ -471,6 +545,28 @@ parse_wakeup_pattern(const char *str)
 	}
 }
 
+static void
+set_realtime_policy(uint32_t my_id)
+{
+	kern_return_t kr;
+	thread_time_constraint_policy_data_t pol;
+
+	/* Hard-coded realtime parameters (similar to what Digi uses) */
+	pol.period      = 100000;
+	if (g_rt_ll) {
+		pol.constraint  = (uint32_t) nanos_to_abs(LL_CONSTRAINT_NANOS);
+		pol.computation = (uint32_t) nanos_to_abs(LL_COMPUTATION_NANOS);
+	} else {
+		pol.constraint  = (uint32_t) nanos_to_abs(CONSTRAINT_NANOS);
+		pol.computation = (uint32_t) nanos_to_abs(COMPUTATION_NANOS);
+	}
+	pol.preemptible = 0;         /* Ignored by OS */
+
+	kr = thread_policy_set(mach_thread_self(), THREAD_TIME_CONSTRAINT_POLICY,
+	    (thread_policy_t) &pol, THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+	mach_assert_zero_t(my_id, kr);
+}
+
 /*
  * Set policy
  */
@@ -479,7 +575,6 @@ thread_setup(uint32_t my_id)
 {
 	kern_return_t kr;
 	errno_t ret;
-	thread_time_constraint_policy_data_t pol;
 
 	if (g_priority) {
 		int policy = SCHED_OTHER;
@@ -500,20 +595,7 @@ thread_setup(uint32_t my_id)
 		proc_setthread_no_smt();
 		break;
 	case MY_POLICY_REALTIME:
-		/* Hard-coded realtime parameters (similar to what Digi uses) */
-		pol.period      = 100000;
-		if (g_rt_ll) {
-			pol.constraint  = (uint32_t) nanos_to_abs(LL_CONSTRAINT_NANOS);
-			pol.computation = (uint32_t) nanos_to_abs(LL_COMPUTATION_NANOS);
-		} else {
-			pol.constraint  = (uint32_t) nanos_to_abs(CONSTRAINT_NANOS);
-			pol.computation = (uint32_t) nanos_to_abs(COMPUTATION_NANOS);
-		}
-		pol.preemptible = 0;         /* Ignored by OS */
-
-		kr = thread_policy_set(mach_thread_self(), THREAD_TIME_CONSTRAINT_POLICY,
-		    (thread_policy_t) &pol, THREAD_TIME_CONSTRAINT_POLICY_COUNT);
-		mach_assert_zero_t(my_id, kr);
+		set_realtime_policy(my_id);
 		break;
 	case MY_POLICY_FIXEDPRI:
 		ret = pthread_set_fixedpriority_self();
@@ -538,6 +620,66 @@ thread_setup(uint32_t my_id)
 	return 0;
 }
 
+/*
+ * Apply the scenario to a worker: join its thread group and take its
+ * place in the QoS mix (which overrides the global policy for that thread).
+ */
+static void
+scenario_thread_setup(uint32_t my_id)
+{
+	if (g_thread_groups) {
+		int ret = work_interval_join_port(g_work_interval_ports[my_id % g_thread_groups]);
+		if (ret) {
+			err(EX_OSERR, "work_interval_join_port: %d", my_id);
+		}
+	}
+
+	if (g_qos_mix_count) {
+		int qos = g_qos_mix[my_id % g_qos_mix_count];
+
+		if (qos == QOS_MIX_RT) {
+			set_realtime_policy(my_id);
+		} else {
+			errno_t ret = pthread_set_qos_class_self_np((qos_class_t)qos, 0);
+			if (ret) {
+				errc(EX_OSERR, ret, "pthread_set_qos_class_self_np: %d", my_id);
+			}
+		}
+	}
+}
+
+/* The first thread in each group reports each iteration as one work interval instance */
+static void
+scenario_notify_work_interval(uint32_t my_id)
+{
+	if (g_work_interval && my_id < g_thread_groups) {
+		uint64_t now = mach_absolute_time();
+		int ret = work_interval_notify(g_work_intervals[my_id], g_starttime_abs, now,
+		    g_starttime_abs + nanos_to_abs(CONSTRAINT_NANOS), 0, 0);
+		if (ret) {
+			err(EX_OSERR, "work_interval_notify: %d", my_id);
+		}
+	}
+}
+
+static void
+setup_thread_groups(void)
+{
+	g_work_intervals = calloc(g_thread_groups, sizeof(work_interval_t));
+	g_work_interval_ports = calloc(g_thread_groups, sizeof(mach_port_t));
+	assert(g_work_intervals && g_work_interval_ports);
+
+	for (uint32_t i = 0; i < g_thread_groups; i++) {
+		if (work_interval_create(&g_work_intervals[i], WORK_INTERVAL_TYPE_DEFAULT |
+		    WORK_INTERVAL_FLAG_JOINABLE | WORK_INTERVAL_FLAG_GROUP)) {
+			err(EX_OSERR, "work_interval_create");
+		}
+		if (work_interval_copy_port(g_work_intervals[i], &g_work_interval_ports[i])) {
+			err(EX_OSERR, "work_interval_copy_port");
+		}
+	}
+}
+
 time_value_t
 get_thread_runtime(void)
 {
@@ -569,6 +711,7 @@ worker_thread(void *arg)
 
 	/* Set policy and so forth */
 	thread_setup(my_id);
+	scenario_thread_setup(my_id);
 
 	for (uint32_t i = 0; i < g_iterations; i++) {
 		if (my_id == 0) {
@@ -697,6 +840,7 @@ worker_thread(void *arg)
 		debug_log("Thread %p woke up on CPU %d for iteration %d.\n", pthread_self(), cpuid, i);
 		g_cpu_histogram[cpuid].current = 1;
 		g_cpu_histogram[cpuid].accum++;
+		g_thread_wake_cpus[my_id] = cpuid;
 
 		if (g_do_one_long_spin && g_one_long_spin_id == my_id) {
 			/* One randomly chosen thread holds up the train for a while. */
@@ -718,6 +862,8 @@ worker_thread(void *arg)
 			}
 		}
 
+		scenario_notify_work_interval(my_id);
+
 		uint32_t done_threads;
 		done_threads = atomic_fetch_add_explicit(&g_done_threads, 1, memory_order_relaxed) + 1;
 
@@ -830,6 +976,141 @@ typedef struct {
 	natural_t idle;
 } cpu_time_t;
 
+/* Wakeup latencies (ns, from a stop) indexed by the cluster type the thread woke on */
+static double                  *g_cluster_latencies[2];
+static uint32_t                 g_cluster_latency_count[2];
+static const char              *g_cluster_names[2] = { "E", "P" };
+
+static void
+setup_cluster_latencies(void)
+{
+	size_t len = sizeof(g_cpu_cluster_types);
+
+	/* Only DEVELOPMENT kernels on AMP systems export the cpu to cluster map */
+	if (sysctlbyname("kern.sched_cpu_cluster_types", g_cpu_cluster_types, &len, NULL, 0) != 0) {
+		return;
+	}
+	g_cluster_cpus = (uint32_t)len;
+
+	for (int c = 0; c < 2; c++) {
+		g_cluster_latencies[c] = calloc((size_t)g_iterations * g_numthreads, sizeof(double));
+		assert(g_cluster_latencies[c]);
+	}
+}
+
+static void
+record_cluster_latencies(uint32_t iteration)
+{
+	if (g_cluster_cpus == 0 || iteration < g_warmup_iterations) {
+		return;
+	}
+
+	for (uint32_t j = 0; j < g_numthreads; j++) {
+		uint32_t cpu = g_thread_wake_cpus[j];
+		int c = (cpu < g_cluster_cpus && g_cpu_cluster_types[cpu] == 'E') ? 0 : 1;
+
+		g_cluster_latencies[c][g_cluster_latency_count[c]++] =
+		    (double)abs_to_nanos(g_thread_endtimes_abs[j] - g_starttime_abs);
+	}
+}
+
+static void
+report_cluster_latencies(void)
+{
+	benchmark_config_t config = BENCHMARK_CONFIG_DEFAULT;
+	benchmark_stats_t stats;
+	char name[128];
+
+	if (g_cluster_cpus == 0) {
+		return;
+	}
+
+	config.warmup = g_warmup_iterations;
+	config.json_path = g_json_path;
+
+	putchar('\n');
+	printf("Wakeup latency by cluster type (from a stop):\n");
+	for (int c = 0; c < 2; c++) {
+		if (g_cluster_latency_count[c] == 0) {
+			printf("%s cores:\tno wakeups\n", g_cluster_names[c]);
+			continue;
+		}
+		config.trials = g_cluster_latency_count[c];
+		snprintf(name, sizeof(name), "zero-to-n.%s.%s.%u_threads.wake_on_%s",
+		    g_waketype_arg, g_policy_arg, g_numthreads, g_cluster_names[c]);
+
+		int ret = benchmark_report(&config, name, "ns", g_cluster_latencies[c],
+		    g_cluster_latency_count[c], &stats);
+		if (ret) {
+			warnc(ret, "failed to write %s", g_json_path);
+		}
+	}
+}
+
+/* System-wide Edge scheduler placement counters, sampled around the run */
+static const char *g_edge_counter_names[] = {
+	"kern.sched_edge_migrations",
+	"kern.sched_edge_spills",
+	"kern.sched_edge_steal_success",
+};
+#define EDGE_COUNTERS (sizeof(g_edge_counter_names) / sizeof(g_edge_counter_names[0]))
+
+static bool
+read_edge_counters(uint64_t counters[EDGE_COUNTERS])
+{
+	for (size_t i = 0; i < EDGE_COUNTERS; i++) {
+		size_t len = sizeof(counters[i]);
+
+		if (sysctlbyname(g_edge_counter_names[i], &counters[i], &len, NULL, 0) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+report_edge_counters(const uint64_t start[EDGE_COUNTERS], const uint64_t end[EDGE_COUNTERS])
+{
+	putchar('\n');
+	printf("Edge scheduler events during the run (system-wide):\n");
+	printf("Migrations:\t%llu\n", end[0] - start[0]);
+	printf("Spills:\t\t%llu\n", end[1] - start[1]);
+	printf("Steals:\t\t%llu\n", end[2] - start[2]);
+}
+
+/*
+ * Append one series of per-iteration worst latencies, minus the warmup
+ * iterations, to g_json_path through the common benchmark harness.
+ */
+static void
+report_benchmark(const char *series, uint64_t *latencies_ns)
+{
+	benchmark_config_t config = BENCHMARK_CONFIG_DEFAULT;
+	benchmark_stats_t stats;
+	uint32_t count = g_iterations - g_warmup_iterations;
+	char name[128];
+	double *samples;
+	int ret;
+
+	samples = calloc(count, sizeof(double));
+	assert(samples);
+	for (uint32_t i = 0; i < count; i++) {
+		samples[i] = (double)latencies_ns[g_warmup_iterations + i];
+	}
+
+	config.warmup = g_warmup_iterations;
+	config.trials = count;
+	config.json_path = g_json_path;
+	snprintf(name, sizeof(name), "zero-to-n.%s.%s.%u_threads.%s",
+	    g_waketype_arg, g_policy_arg, g_numthreads, series);
+
+	ret = benchmark_report(&config, name, "ns", samples, count, &stats);
+	if (ret) {
+		warnc(ret, "failed to write %s", g_json_path);
+	}
+	free(samples);
+}
+
 void
 record_cpu_time(cpu_time_t *cpu_time)
 {
@@ -1061,6 +1342,15 @@ main(int argc, char **argv)
 		errc(EX_OSERR, ret, "memset_s endtimes");
 	}
 
+	g_thread_wake_cpus = (uint32_t*) calloc(g_numthreads, sizeof(uint32_t));
+	assert(g_thread_wake_cpus);
+
+	setup_cluster_latencies();
+
+	if (g_thread_groups) {
+		setup_thread_groups();
+	}
+
 	size_t latencies_size = sizeof(uint64_t) * g_iterations;
 
 	worst_latencies_ns = (uint64_t*) valloc(latencies_size);
@@ -1170,6 +1460,9 @@ main(int argc, char **argv)
 	if (g_rt_churn) {
 		create_rt_churn_threads();
 	}
+	if (g_bg_load_count) {
+		create_bg_load_threads();
+	}
 
 	/* Let everyone get settled */
 	kr = semaphore_wait(g_main_sem);
@@ -1183,6 +1476,9 @@ main(int argc, char **argv)
 	cpu_time_t start_time;
 	cpu_time_t finish_time;
 
+	uint64_t edge_start[EDGE_COUNTERS], edge_end[EDGE_COUNTERS];
+	bool have_edge_counters = read_edge_counters(edge_start);
+
 	record_cpu_time(&start_time);
 
 	/* Go! */
@@ -1231,6 +1527,8 @@ main(int argc, char **argv)
 
 		worst_latencies_ns[i] = abs_to_nanos(worst_abs);
 
+		record_cluster_latencies(i);
+
 		worst_abs = 0;
 		for (j = 1; j < g_numthreads; j++) {
 			uint64_t latency_abs;
@@ -1276,6 +1574,7 @@ main(int argc, char **argv)
 	}
 
 	record_cpu_time(&finish_time);
+	have_edge_counters = have_edge_counters && read_edge_counters(edge_end);
 
 	/* Rejoin threads */
 	for (uint32_t i = 0; i < g_numthreads; i++) {
@@ -1293,6 +1592,10 @@ main(int argc, char **argv)
 		join_churn_threads();
 	}
 
+	if (g_bg_load_count) {
+		join_bg_load_threads();
+	}
+
 	uint32_t cpu_idle_time = (finish_time.idle - start_time.idle) * 10;
 	uint32_t worker_threads_runtime = worker_threads_total_runtime.seconds * 1000 + worker_threads_total_runtime.microseconds / 1000;
 
@@ -1323,6 +1626,21 @@ main(int argc, char **argv)
 		printf("Stddev:\t\t%.2f us\n", stddev / 1000.0);
 	}
 
+	report_cluster_latencies();
+
+	if (have_edge_counters) {
+		report_edge_counters(edge_start, edge_end);
+	}
+
+	if (g_json_path) {
+		putchar('\n');
+		report_benchmark("from_stop", worst_latencies_ns);
+		report_benchmark("from_first", worst_latencies_from_first_ns);
+		if ((g_waketype == WAKE_CHAIN) || (g_waketype == WAKE_HOP)) {
+			report_benchmark("from_previous", worst_latencies_from_previous_ns);
+		}
+	}
+
 	if (g_test_rt) {
 		putchar('\n');
 		printf("Count of trace-worthy latencies (>%.2f us): %d\n", ((float)g_traceworthy_latency_ns) / 1000.0, g_traceworthy_count);
@@ -1475,7 +1793,10 @@ usage()
 	    "[--no-sleep] [--drop-priority] [--churn-pri <pri>] [--churn-count <n>] [--churn-random]\n\t\t"
 	    "[--extra-thread-count <signed int>]\n\t\t"
 	    "[--rt-churn] [--rt-churn-count <n>] [--rt-ll]\n\t\t"
-	    "[--test-rt] [--test-rt-smt] [--test-rt-avoid0] [--test-strict-fail]",
+	    "[--test-rt] [--test-rt-smt] [--test-rt-avoid0] [--test-strict-fail]\n\t\t"
+	    "[--json <path>] [--warmup <iterations>]\n\t\t"
+	    "[--scenario cluster-spread | tg-contention | rt-mix | frame]\n\t\t"
+	    "[--thread-groups <n>] [--work-interval] [--qos-mix <rt|ui|in|def|ut|bg,...>] [--bg-load <n>]",
 	    getprogname());
 }
 
@@ -1514,6 +1835,83 @@ read_signed_dec_arg()
 	return arg_val;
 }
 
+static int
+parse_qos(const char *str)
+{
+	if (strcmp(str, "rt") == 0) {
+		return QOS_MIX_RT;
+	} else if (strcmp(str, "ui") == 0) {
+		return QOS_CLASS_USER_INTERACTIVE;
+	} else if (strcmp(str, "in") == 0) {
+		return QOS_CLASS_USER_INITIATED;
+	} else if (strcmp(str, "def") == 0) {
+		return QOS_CLASS_DEFAULT;
+	} else if (strcmp(str, "ut") == 0) {
+		return QOS_CLASS_UTILITY;
+	} else if (strcmp(str, "bg") == 0) {
+		return QOS_CLASS_BACKGROUND;
+	} else {
+		errx(EX_USAGE, "Invalid QoS \"%s\"", str);
+	}
+}
+
+/* Comma separated QoS classes, handed out to the worker threads round-robin */
+static void
+parse_qos_mix(const char *str)
+{
+	char *copy = strdup(str);
+	char *cursor = copy;
+	char *token;
+
+	assert(copy);
+	g_qos_mix_count = 0;
+	while ((token = strsep(&cursor, ",")) != NULL) {
+		if (g_qos_mix_count == MAX_QOS_MIX) {
+			errx(EX_USAGE, "--qos-mix takes at most %d entries", MAX_QOS_MIX);
+		}
+		g_qos_mix[g_qos_mix_count++] = parse_qos(token);
+	}
+	free(copy);
+}
+
+/* Canned combinations of the scenario knobs; options given after --scenario override it */
+static const struct scenario {
+	const char     *name;
+	uint32_t        thread_groups;
+	boolean_t       work_interval;
+	const char     *qos_mix;
+	uint32_t        bg_load;
+} g_scenarios[] = {
+	/* Interactive and utility work in separate groups, which Edge places on different clusters */
+	{ "cluster-spread", 2, FALSE, "ui,ut", 0 },
+	/* Several thread groups competing while background load occupies every core */
+	{ "tg-contention", 4, FALSE, NULL, BG_LOAD_ALL_CPUS },
+	/* Realtime threads interleaved with interactive and default timeshare threads */
+	{ "rt-mix", 0, FALSE, "rt,ui,def", 0 },
+	/* One frame-style group of realtime and interactive threads reporting work intervals */
+	{ "frame", 1, TRUE, "rt,ui", 0 },
+};
+
+static void
+apply_scenario(const char *name)
+{
+	for (size_t i = 0; i < sizeof(g_scenarios) / sizeof(g_scenarios[0]); i++) {
+		const struct scenario *sc = &g_scenarios[i];
+
+		if (strcmp(sc->name, name) == 0) {
+			g_thread_groups = sc->thread_groups;
+			g_work_interval = sc->work_interval;
+			g_bg_load_count = sc->bg_load;
+			g_qos_mix_count = 0;
+			if (sc->qos_mix) {
+				parse_qos_mix(sc->qos_mix);
+			}
+			return;
+		}
+	}
+	errx(EX_USAGE, "Invalid scenario \"%s\"", name);
+}
+
 static void
 parse_args(int argc, char *argv[])
 {
@@ -1526,6 +1924,12 @@ parse_args(int argc, char *argv[])
 		OPT_CHURN_COUNT,
 		OPT_RT_CHURN_COUNT,
 		OPT_EXTRA_THREAD_COUNT,
+		OPT_JSON,
+		OPT_WARMUP,
+		OPT_SCENARIO,
+		OPT_THREAD_GROUPS,
+		OPT_QOS_MIX,
+		OPT_BG_LOAD,
 	};
 
 	static struct option longopts[] = {
@@ -1537,6 +1941,13 @@ parse_args(int argc, char *argv[])
 		{ "churn-count",        required_argument,      NULL,                           OPT_CHURN_COUNT },
 		{ "rt-churn-count",     required_argument,      NULL,                           OPT_RT_CHURN_COUNT },
 		{ "extra-thread-count", required_argument,      NULL,                           OPT_EXTRA_THREAD_COUNT },
+		{ "json",               required_argument,      NULL,                           OPT_JSON },
+		{ "warmup",             required_argument,      NULL,                           OPT_WARMUP },
+		{ "scenario",           required_argument,      NULL,                           OPT_SCENARIO },
+		{ "thread-groups",      required_argument,      NULL,                           OPT_THREAD_GROUPS },
+		{ "qos-mix",            required_argument,      NULL,                           OPT_QOS_MIX },
+		{ "bg-load",            required_argument,      NULL,                           OPT_BG_LOAD },
+		{ "work-interval",      no_argument,            (int*)&g_work_interval,         TRUE },
 		{ "churn-random",       no_argument,            (int*)&g_churn_random,          TRUE },
 		{ "switched_apptype",   no_argument,            (int*)&g_seen_apptype,          TRUE },
 		{ "spin-one",           no_argument,            (int*)&g_do_one_long_spin,      TRUE },
@@ -1588,6 +1999,24 @@ parse_args(int argc, char *argv[])
 		case OPT_EXTRA_THREAD_COUNT:
 			g_extra_thread_count = read_signed_dec_arg();
 			break;
+		case OPT_JSON:
+			g_json_path = optarg;
+			break;
+		case OPT_WARMUP:
+			g_warmup_iterations = (uint32_t)read_dec_arg();
+			break;
+		case OPT_SCENARIO:
+			apply_scenario(optarg);
+			break;
+		case OPT_THREAD_GROUPS:
+			g_thread_groups = read_dec_arg();
+			break;
+		case OPT_QOS_MIX:
+			parse_qos_mix(optarg);
+			break;
+		case OPT_BG_LOAD:
+			g_bg_load_count = read_dec_arg();
+			break;
 		case '?':
 		case 'h':
 		default:
@@ -1625,9 +2054,11 @@ parse_args(int argc, char *argv[])
 
 	/* What wakeup pattern? */
 	g_waketype = parse_wakeup_pattern(argv[1]);
+	g_waketype_arg = argv[1];
 
 	/* Policy */
 	g_policy = parse_thread_policy(argv[2]);
+	g_policy_arg = argv[2];
 
 	/* Iterations */
 	g_iterations = (uint32_t)strtoull(argv[3], &cp, 10);
@@ -1640,6 +2071,15 @@ parse_args(int argc, char *argv[])
 		errx(EX_USAGE, "Must have at least one iteration");
 	}
 
+	if (g_warmup_iterations >= g_iterations) {
+		errx(EX_USAGE, "--warmup must leave at least one iteration");
+	}
+
+	/* Work interval notifications need a work interval to notify */
+	if (g_work_interval && g_thread_groups == 0) {
+		g_thread_groups = 1;
+	}
+
 	if (g_numthreads == 1 && g_waketype == WAKE_CHAIN) {
 		errx(EX_USAGE, "chain mode requires more than one thread");
 	}